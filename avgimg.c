@@ -17,18 +17,40 @@
 
 #include "io/analyze75.h"
 #include "util/startup.h"
+#include "util/parallel.h"
 
 #define _MAX_INPUTS 2048
 
+/**
+ * Number of voxels which are averaged at a time.
+ */
+#define _AVG_CHUNK 4096
+
 typedef struct _args {
 
   uint16_t ninputs;
   char    *inputs[_MAX_INPUTS];
   char    *output;
   uint16_t format;
+  uint16_t nthreads;
 
 } args_t;
 
+/**
+ * State shared by the threads which calculate the average image.
+ */
+typedef struct _avg_ctx {
+
+  uint16_t  nimgs;   /**< number of input images       */
+  dsr_t    *hdrs;    /**< input headers                */
+  uint8_t **imgs;    /**< input images                 */
+  dsr_t    *avghdr;  /**< average image header         */
+  uint8_t  *avgimg;  /**< average image                */
+  double   *mins;    /**< minimum value, per thread    */
+  double   *maxs;    /**< maximum value, per thread    */
+
+} avg_ctx_t;
+
 static char *doc = "avgimg -- average a collection of ANALYZE75 images\v\
   Supported formats:\n\
   2  - unsigned char (1 byte)\n\
@@ -39,7 +61,8 @@ static char *doc = "avgimg -- average a collection of ANALYZE75 images\v\
 
 
 static struct argp_option options[] = {
-  {"format", 'f', "INT", 0, "output format"},
+  {"format",  'f', "INT", 0, "output format"},
+  {NULL,      'j', "INT", 0, "number of threads (default: --threads)"},
   {0}
 };
 
@@ -49,7 +72,8 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 
   switch (key) {
 
-    case 'f': args->format = atoi(arg); break;
+    case 'f': args->format   = atoi(arg); break;
+    case 'j': args->nthreads = atoi(arg); break;
 
     case ARGP_KEY_ARG:
       
@@ -79,7 +103,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _load_images(
-  uint8_t    nfiles, /**< number of input images                        */
+  uint16_t   nfiles, /**< number of input images                        */
   char     **files,  /**< image file names                              */
   dsr_t    **hdrs,   /**< will be set to point to the allocated headers */
   uint8_t ***imgs    /**< will be set to point to the allocated images  */
@@ -92,12 +116,25 @@ static uint8_t _load_images(
  */
 static uint8_t _mk_avg_img(
   uint16_t  datatype, /**< datatype of average image          */
-  uint8_t   nimgs,    /**< number of input images             */  
+  uint16_t  nimgs,    /**< number of input images             */  
   dsr_t    *hdrs,     /**< input headers                      */
   uint8_t **imgs,     /**< input images                       */
   uint8_t **avgimg,   /**< pointer which will be set to point
                            to allocated space                 */
-  dsr_t    *avghdr    /**< space to store the averaged header */
+  dsr_t    *avghdr,   /**< space to store the averaged header */
+  uint16_t  nthreads  /**< number of threads (0 for all CPUs) */
+);
+
+/**
+ * parallel_for function which averages a range of voxels.
+ *
+ * \return 0.
+ */
+static uint8_t _avg_voxels(
+  uint64_t  start,  /**< first voxel                 */
+  uint64_t  end,    /**< one past last voxel         */
+  uint16_t  thread, /**< calling thread              */
+  void     *ctx     /**< pointer to an avg_ctx_t     */
 );
 
 int main (int argc, char *argv[]) {
@@ -133,7 +170,13 @@ int main (int argc, char *argv[]) {
   if (args.format == 0) args.format = analyze_datatype(hdrs);
 
   /*make average image*/
-  if (_mk_avg_img(args.format, args.ninputs, hdrs, imgs, &avgimg, &avghdr)) {
+  if (_mk_avg_img(args.format,
+                  args.ninputs,
+                  hdrs,
+                  imgs,
+                  &avgimg,
+                  &avghdr,
+                  args.nthreads)) {
     goto fail;
   }
 
@@ -163,12 +206,12 @@ fail:
 }
 
 uint8_t _load_images(
-  uint8_t    nfiles, 
+  uint16_t   nfiles, 
   char     **files, 
   dsr_t    **hdrs, 
   uint8_t ***imgs)
 {
-  uint8_t i;
+  uint16_t  i;
 
   dsr_t    *lhdrs;
   uint8_t **limgs;
@@ -183,11 +226,8 @@ uint8_t _load_images(
   limgs = calloc(nfiles, sizeof(uint8_t *));
   if (limgs == NULL) goto fail;
 
-  /*load all of the files in*/
-  for (i = 0; i < nfiles; i++) {
-    if (analyze_load(files[i], lhdrs+i, limgs+i)) 
-      goto fail;
-  }
+  /*load all of the files in, several at once*/
+  if (analyze_load_many(nfiles, files, lhdrs, limgs, 0)) goto fail;
 
   *hdrs = lhdrs;
   *imgs = limgs;
@@ -212,31 +252,38 @@ fail:
 
 uint8_t _mk_avg_img(
   uint16_t  datatype,
-  uint8_t   nimgs,  
+  uint16_t  nimgs,  
   dsr_t    *hdrs,
   uint8_t **imgs,
   uint8_t  **avgimg, 
-  dsr_t    *avghdr)
+  dsr_t    *avghdr,
+  uint16_t  nthreads)
 {
-  uint64_t i;
-  uint16_t j;
-  double   val;
-  uint32_t avgvalsz;
-  uint32_t nvals;
-  uint8_t *lavgimg;
-  double   min;
-  double   max;
-
+  uint16_t  i;
+  uint32_t  avgvalsz;
+  uint32_t  nvals;
+  uint8_t  *lavgimg;
+  double    min;
+  double    max;
+  avg_ctx_t ctx;
+
+  memset(&ctx, 0, sizeof(avg_ctx_t));
   lavgimg = NULL;
   min     =  DBL_MAX;
   max     = -DBL_MAX;
-  
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
   /*allocate space for average image*/
   nvals    = analyze_num_vals(     hdrs);
   avgvalsz = analyze_datatype_size(datatype);
 
-  lavgimg = malloc(avgvalsz * nvals);
-  if (lavgimg == NULL) {
+  lavgimg  = malloc(avgvalsz * nvals);
+  ctx.mins = malloc(nthreads * sizeof(double));
+  ctx.maxs = malloc(nthreads * sizeof(double));
+  
+  if (lavgimg == NULL || ctx.mins == NULL || ctx.maxs == NULL) {
     printf("out of memory?!\n");
     goto fail;
   }
@@ -245,25 +292,28 @@ uint8_t _mk_avg_img(
   avghdr->dime.datatype = datatype;
   avghdr->dime.bitpix   = avgvalsz * 8;
 
-  /*
-   * Read in, average, and write out, one value at 
-   * a time. Keep track of the minimum/maximum 
-   * values to put into the header afterwards
-   */
-  for (i = 0; i < nvals; i++) {
-
-    val = 0;
-
-    for (j = 0; j < nimgs; j++)  {
-      val += analyze_read_by_idx(hdrs+j, imgs[j], i);
-    }
+  for (i = 0; i < nthreads; i++) {
+    ctx.mins[i] =  DBL_MAX;
+    ctx.maxs[i] = -DBL_MAX;
+  }
 
-    val /= nimgs;
+  ctx.nimgs  = nimgs;
+  ctx.hdrs   = hdrs;
+  ctx.imgs   = imgs;
+  ctx.avghdr = avghdr;
+  ctx.avgimg = lavgimg;
 
-    if (val < min) min = val;
-    if (val > max) max = val;
+  /*
+   * Average blocks of voxels in parallel. Keep 
+   * track of the minimum/maximum values to put 
+   * into the header afterwards
+   */
+  if (parallel_for(nthreads, nvals, _AVG_CHUNK, &ctx, _avg_voxels))
+    goto fail;
 
-    analyze_write_by_idx(avghdr, lavgimg, i, val);
+  for (i = 0; i < nthreads; i++) {
+    if (ctx.mins[i] < min) min = ctx.mins[i];
+    if (ctx.maxs[i] > max) max = ctx.maxs[i];
   }
 
   avghdr->dime.cal_max = (float)   max;
@@ -271,12 +321,51 @@ uint8_t _mk_avg_img(
   avghdr->dime.glmax   = (uint32_t)max;
   avghdr->dime.glmin   = (uint32_t)min;
 
+  free(ctx.mins);
+  free(ctx.maxs);
 
   *avgimg = lavgimg;
-
   return 0;
 
 fail:
-  if (lavgimg != NULL) free(lavgimg);
+  if (lavgimg  != NULL) free(lavgimg);
+  if (ctx.mins != NULL) free(ctx.mins);
+  if (ctx.maxs != NULL) free(ctx.maxs);
   return 1;
 }
+
+uint8_t _avg_voxels(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   i;
+  uint16_t   j;
+  uint32_t   len;
+  avg_ctx_t *c;
+  double     min;
+  double     max;
+  double     vals[_AVG_CHUNK];
+
+  c   = ctx;
+  len = end - start;
+  min = c->mins[thread];
+  max = c->maxs[thread];
+
+  memset(vals, 0, len * sizeof(double));
+
+  for (j = 0; j < c->nimgs; j++)
+    analyze_add_block(c->hdrs+j, c->imgs[j], start, len, vals);
+
+  for (i = 0; i < len; i++) {
+
+    vals[i] /= c->nimgs;
+    
+    if (vals[i] < min) min = vals[i];
+    if (vals[i] > max) max = vals[i];
+  }
+
+  analyze_write_block(c->avghdr, c->avgimg, start, len, vals);
+
+  c->mins[thread] = min;
+  c->maxs[thread] = max;
+
+  return 0;
+}
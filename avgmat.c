@@ -1,6 +1,13 @@
 /**
  * Average a collection of matrix files.
  *
+ * The output is calculated in blocks of rows (of roughly AVG_BLOCK_BYTES
+ * bytes). The rows of each block are read from all of the inputs, and
+ * accumulated, across multiple threads if all of the inputs could be
+ * mapped into memory; then the block is written to the output in one go.
+ * For symmetric matrices, only the stored upper triangle of each row is
+ * read and accumulated.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <argp.h>
@@ -11,36 +18,78 @@
 
 #include "util/startup.h"
 #include "util/copyfile.h"
+#include "util/parallel.h"
 #include "io/mat.h"
 
-#define MAX_INPUTS 50
+/**
+ * Approximate size of the output blocks which are accumulated in memory.
+ */
+#define AVG_BLOCK_BYTES 67108864
+
+/**
+ * Number of rows handed out to a thread at a time.
+ */
+#define AVG_ROW_CHUNK 16
 
 typedef struct _args {
   
-  char   *inputs[MAX_INPUTS];
-  char   *output;
-  uint8_t ninputs;
+  char    **inputs;
+  char     *output;
+  uint16_t  ninputs;
+  uint16_t  nthreads;
  
 } args_t ;
 
+/**
+ * State shared by the threads accumulating a block of rows.
+ */
+typedef struct _avg_block {
+
+  mat_t   **inmats;  /**< input files                              */
+  uint16_t  ninputs; /**< number of input files                    */
+  uint64_t  ncols;   /**< number of columns                        */
+  uint8_t   sym;     /**< non-0 if the matrices are symmetric      */
+  uint64_t  row;     /**< first row in the block                   */
+  double   *vals;    /**< block values, row-major                  */
+  double  **bufs;    /**< per-thread row buffer, for inputs which
+                          cannot be accessed directly              */
+
+} avg_block_t;
+
+static struct argp_option options[] = {
+  {NULL,      'j', "INT", 0, "number of threads (default: --threads)"},
+  {0}
+};
+
 
 static char doc[] = "avgmat -- create an average matrix from "\
                     "a collection of input matrix files";
 
 static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
-  args_t *args;
+  args_t  *args;
+  char   **tmp;
 
   args = state->input;
 
   switch (key) {
 
+    case 'j': args->nthreads = atoi(arg); break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num == 0) args->output = arg;
       else {
-        
-        if (args->ninputs < MAX_INPUTS) args->inputs[args->ninputs++] = arg;
-        else printf("too many inputs - ignoring %s\n", arg);
+
+        if (args->ninputs == UINT16_MAX) {
+          printf("too many inputs - ignoring %s\n", arg);
+          break;
+        }
+
+        tmp = realloc(args->inputs, (args->ninputs + 1) * sizeof(char *));
+        if (tmp == NULL) argp_failure(state, 1, 0, "out of memory");
+
+        args->inputs = tmp;
+        args->inputs[args->ninputs++] = arg;
       }
         
       break;
@@ -59,26 +108,56 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 static mat_t * _create_outmat(
   char    *outf,
   mat_t  **inmats,
-  uint8_t  ninputs
+  uint16_t ninputs
 );
 
+/**
+ * Averages the input matrices, writing the result to the output matrix.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
 static uint8_t _agg_matrix(
-  mat_t  **inmats,
-  mat_t   *outmat,
-  uint8_t  ninputs
+  mat_t  **inmats,  /**< input files                         */
+  mat_t   *outmat,  /**< output file                         */
+  uint16_t ninputs, /**< number of inputs                    */
+  uint16_t nthreads /**< number of threads (0 for all CPUs)  */
+);
+
+/**
+ * parallel_for function which accumulates a range of rows in the current
+ * block.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _agg_rows(
+  uint64_t  start,  /**< first row, relative to the block start */
+  uint64_t  end,    /**< one past last row                      */
+  uint16_t  thread, /**< calling thread                         */
+  void     *ctx     /**< pointer to an avg_block_t struct       */
+);
+
+/**
+ * Adds vals[i] / n to out[i], for i in [0, len). Kept separate, and
+ * simple, so the compiler can vectorise it.
+ */
+static void _accumulate(
+  double       * restrict out,  /**< accumulated values */
+  const double * restrict vals, /**< values to add      */
+  uint64_t                len,  /**< number of values   */
+  double                  n     /**< divisor            */
 );
 
 int main(int argc, char *argv[]) {
 
   uint16_t    i;
-  mat_t      *inmats[MAX_INPUTS];
+  mat_t     **inmats;
   mat_t      *outmat;
   args_t      args;
-  struct argp argp = {NULL, _parse_opt, "OUTPUT [INPUT ...]", doc};
+  struct argp argp = {options, _parse_opt, "OUTPUT [INPUT ...]", doc};
   
   outmat = NULL;
+  inmats = NULL;
 
-  memset(inmats, 0, sizeof(inmats));
   memset(&args,  0, sizeof(args));
 
   startup("avgmat", argc, argv, &argp, &args);
@@ -88,9 +167,13 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
+  inmats = calloc(args.ninputs, sizeof(mat_t *));
+  if (inmats == NULL) goto fail;
+
   for (i = 0; i < args.ninputs; i++) {
     
-    inmats[i] = mat_open(args.inputs[i]);
+    inmats[i] = mat_open_mmap(args.inputs[i]);
+    if (inmats[i] == NULL) inmats[i] = mat_open(args.inputs[i]);
     
     if (inmats[i] == NULL) {
       printf("could not open input file %s\n", args.inputs[i]);
@@ -104,7 +187,7 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
-  if (_agg_matrix(inmats, outmat, args.ninputs)) {
+  if (_agg_matrix(inmats, outmat, args.ninputs, args.nthreads)) {
     printf("could not aggregate matrix\n");
     goto fail;
   }
@@ -112,22 +195,31 @@ int main(int argc, char *argv[]) {
   for (i = 0; i < args.ninputs; i++) 
     mat_close(inmats[i]);
 
-  mat_close(outmat);
+  if (mat_close(outmat)) {
+    printf("could not write output matrix %s\n", args.output);
+    outmat = NULL;
+    goto fail;
+  }
+
+  free(inmats);
+  free(args.inputs);
 
   return 0;
 
 fail:
 
-  for (i = 0; i < args.ninputs; i++) {
+  for (i = 0; inmats != NULL && i < args.ninputs; i++) {
       if (inmats[i] != NULL)
         mat_close(inmats[i]);
   }
 
-  if (outmat != NULL) mat_close(outmat);
+  if (inmats      != NULL) free(inmats);
+  if (outmat      != NULL) mat_close(outmat);
+  if (args.inputs != NULL) free(args.inputs);
   return 1;
 }
 
-mat_t * _create_outmat(char *outf, mat_t **inmats, uint8_t ninputs) {
+mat_t * _create_outmat(char *outf, mat_t **inmats, uint16_t ninputs) {
 
   mat_t *outmat;
 
@@ -143,52 +235,140 @@ mat_t * _create_outmat(char *outf, mat_t **inmats, uint8_t ninputs) {
 }
 
 
-uint8_t _agg_matrix(mat_t **inmats, mat_t *outmat, uint8_t ninputs) {
-  
-  uint16_t i;
-  uint64_t rowi;
-  uint64_t coli;
-  uint64_t nrows;
-  uint64_t ncols;
-  double  *inrowbuf;
-  double  *outrowbuf;
-
-  inrowbuf  = NULL;
-  outrowbuf = NULL;
-
-  nrows  = mat_num_rows(outmat);
-  ncols  = mat_num_cols(outmat);
-  
-  inrowbuf = malloc(ncols*sizeof(double));
-  if (inrowbuf == NULL) goto fail;
-  
-  outrowbuf = malloc(ncols*sizeof(double));
-  if (outrowbuf == NULL) goto fail;
+uint8_t _agg_matrix(
+  mat_t **inmats, mat_t *outmat, uint16_t ninputs, uint16_t nthreads) {
 
-  for (rowi = 0; rowi < nrows; rowi++) {
-    
-    memset(outrowbuf, 0, ncols*sizeof(double));
+  uint64_t    i;
+  uint64_t    nrows;
+  uint64_t    blkrows;
+  avg_block_t blk;
+
+  memset(&blk, 0, sizeof(avg_block_t));
 
-    for (i = 0; i < ninputs; i++) {
+  nrows = mat_num_rows(outmat);
 
-      if (mat_read_row(inmats[i], rowi, inrowbuf))
-        goto fail;
+  blk.inmats  = inmats;
+  blk.ninputs = ninputs;
+  blk.ncols   = mat_num_cols(outmat);
+  blk.sym     = mat_is_symmetric(outmat);
 
-      for (coli = 0; coli < ncols; coli++)
-        outrowbuf[coli] += inrowbuf[coli] / ninputs;
+  for (i = 0; i < ninputs; i++) {
+
+    if (mat_num_rows(inmats[i])     != nrows     ||
+        mat_num_cols(inmats[i])     != blk.ncols ||
+        mat_is_symmetric(inmats[i]) != blk.sym) {
+      printf("input matrices do not have the same dimensions\n");
+      goto fail;
     }
 
-    if (mat_write_row(outmat, rowi, outrowbuf))
-      goto fail; 
+    /*unmapped files cannot be read concurrently*/
+    if (!mat_is_mapped(inmats[i])) nthreads = 1;
   }
 
-  free(inrowbuf);
-  free(outrowbuf);
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  blkrows = AVG_BLOCK_BYTES / (blk.ncols * sizeof(double) + 1);
+  if (blkrows == 0)     blkrows = 1;
+  if (blkrows >  nrows) blkrows = nrows;
+
+  blk.vals = malloc(blkrows * blk.ncols * sizeof(double));
+  blk.bufs = calloc(nthreads, sizeof(double *));
+
+  if (blkrows > 0 && blk.vals == NULL) goto fail;
+  if (blk.bufs == NULL)                goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    blk.bufs[i] = malloc(blk.ncols * sizeof(double));
+    if (blk.bufs[i] == NULL) goto fail;
+  }
+
+  for (blk.row = 0; blk.row < nrows; blk.row += blkrows) {
+
+    if (blk.row + blkrows > nrows) blkrows = nrows - blk.row;
+
+    memset(blk.vals, 0, blkrows * blk.ncols * sizeof(double));
+
+    if (parallel_for(nthreads, blkrows, AVG_ROW_CHUNK, &blk, _agg_rows))
+      goto fail;
+
+    if (mat_write_rows(outmat, blk.row, blkrows, blk.vals))
+      goto fail;
+  }
+
+  for (i = 0; i < nthreads; i++) free(blk.bufs[i]);
+  free(blk.bufs);
+  free(blk.vals);
   return 0;
   
 fail:
 
-  if (inrowbuf  != NULL) free(inrowbuf);
-  if (outrowbuf != NULL) free(outrowbuf);
+  if (blk.bufs != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (blk.bufs[i] != NULL) free(blk.bufs[i]);
+    }
+    free(blk.bufs);
+  }
+  if (blk.vals != NULL) free(blk.vals);
   return 1;
 }
+
+uint8_t _agg_rows(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      row;
+  uint64_t      col;
+  uint64_t      len;
+  avg_block_t  *blk;
+  const double *vals;
+
+  blk = ctx;
+
+  for (i = start; i < end; i++) {
+
+    row = blk->row + i;
+
+    /*only the upper triangle of a symmetric matrix is stored*/
+    col = blk->sym ? row : 0;
+    len = blk->ncols - col;
+
+    for (j = 0; j < blk->ninputs; j++) {
+
+      /*
+       * mapped rows are used in place, as long as they are
+       * aligned (see mat_row_ptr), as _accumulate may be
+       * vectorised; all other rows are copied into the
+       * thread's buffer
+       */
+      vals = mat_row_ptr(blk->inmats[j], row);
+
+      if (vals == NULL) {
+
+        if (mat_read_row_part(
+              blk->inmats[j], row, col, len, blk->bufs[thread]))
+          goto fail;
+
+        vals = blk->bufs[thread];
+      }
+
+      _accumulate(blk->vals + i * blk->ncols + col, vals, len, blk->ninputs);
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _accumulate(
+  double       * restrict out,
+  const double * restrict vals,
+  uint64_t                len,
+  double                  n) {
+
+  uint64_t i;
+
+  for (i = 0; i < len; i++) out[i] += vals[i] / n;
+}
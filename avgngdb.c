@@ -1,7 +1,45 @@
 /**
  * 'Average' a collection of ngdb graph files.
  *
- * Author: Paul McCarthy <pauld.mccarthy@gmail.com> 
+ * The inputs are merged without loading any of them into memory as a
+ * graph. Node labels are read from every input first, to build the set of
+ * output nodes (one for each unique label). The output nodes are then
+ * processed in ranges; for each range, the references of the input nodes
+ * which map to that range are read from all of the inputs concurrently,
+ * and are sorted and combined into the output edges, which are written
+ * straight to the output file. So memory use is bounded by the number of
+ * input references in a range (AVG_CHUNK_REFS), rather than by the number
+ * of edges in all of the inputs.
+ *
+ * Instead of a sum or average, the output edge weights may be set to the
+ * variance of the input edge weights, or to a two-sample (Welch's) t
+ * statistic between two groups of inputs - the first -g inputs (group 1)
+ * and the remaining inputs (group 2). An input which does not contain an
+ * edge contributes a weight of 0 to it. The moments of every edge are
+ * accumulated in a single pass over its input weights, with Welford's
+ * algorithm. Edges which have no variance in either group are given a t
+ * statistic of 0.
+ *
+ * The network based statistic (NBS; Zalesky et al, 2010) may also be
+ * calculated, by passing -n. The edges whose t statistic is greater than
+ * the -T threshold form a set of connected components; the size (number
+ * of edges) of every component is compared against the distribution of
+ * the largest component size under random permutations of the group
+ * labels. The permutations are generated from the --seed, and are all
+ * evaluated at the same time, in parallel, on each range of edges, so the
+ * inputs are still only read once. Each permutation keeps a union-find of
+ * the output nodes, so memory use grows with the number of permutations
+ * times the number of output nodes. The inputs are assumed to be
+ * undirected - each edge is only counted in the direction u < v. Every
+ * component with at least one edge is written to the -n file, largest
+ * first, one per line:
+ *
+ *   nedges nnodes p node node ...
+ *
+ * where p is the fraction of permutations whose largest component has at
+ * least nedges edges, and the nodes are output node IDs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <argp.h>
 #include <math.h>
@@ -12,35 +50,64 @@
 #include <inttypes.h>
 
 #include "graph/graph.h"
+#include "util/rng.h"
 #include "util/startup.h"
-#include "util/compare.h"
+#include "util/memacct.h"
+#include "util/parallel.h"
+#include "io/ngdb.h"
 #include "io/ngdb_graph.h"
 
-#define MAX_INPUTS 50
-
+/**
+ * Approximate maximum number of input references which are read and
+ * combined at once. Fewer are read at once if AVG_CHUNK_REFS references
+ * would not fit in what is left of the --mem-budget (see util/memacct.h).
+ */
+#define AVG_CHUNK_REFS 4194304
 
 typedef enum {
 
   SUM_WEIGHTS = 0,
   COUNT_EDGES,
   AVG_WEIGHTS,
+  VAR_WEIGHTS,
+  TSTAT_WEIGHTS,
 
 } edge_weight_t;
 
 typedef struct _args {
-  char         *inputs[MAX_INPUTS];
+  char        **inputs;
   char         *output;
   uint16_t      ninputs;
   edge_weight_t edgeweight;
+  uint16_t      nthreads;
+  uint16_t      ngroup1;
+  char         *nbsfile;
+  double        nbsthres;
+  uint8_t       hasthres;
+  uint32_t      nperms;
 } args_t;
 
 static struct argp_option options[] = {
-  {"sumweights", 's', NULL, 0, "set output edge weights to the sum of "\
-                               "corresponding input edge weights (default)"},
-  {"countedges", 'c', NULL, 0, "set output edge weights to the number "\
-                               "of corresponding input edges"},
-  {"avgweights", 'a', NULL, 0, "set output edge weights to average "\
-                               "of corresponding input edge weights"},
+  {"sumweights", 's', NULL,    0, "set output edge weights to the sum of "\
+                                  "corresponding input edge weights "\
+                                  "(default)"},
+  {"countedges", 'c', NULL,    0, "set output edge weights to the number "\
+                                  "of corresponding input edges"},
+  {"avgweights", 'a', NULL,    0, "set output edge weights to average "\
+                                  "of corresponding input edge weights"},
+  {"variance",   'v', NULL,    0, "set output edge weights to the "\
+                                  "variance of corresponding input edge "\
+                                  "weights"},
+  {"tstat",      't', NULL,    0, "set output edge weights to the t "\
+                                  "statistic between the two groups"},
+  {"group1",     'g', "INT",   0, "number of inputs in group 1 - the "\
+                                  "remaining inputs are in group 2"},
+  {"nbs",        'n', "FILE",  0, "calculate the NBS, and write the "\
+                                  "components to FILE"},
+  {"nbsthres",   'T', "FLOAT", 0, "t statistic threshold for the NBS"},
+  {"perms",      'p', "INT",   0, "number of NBS permutations "\
+                                  "(default: 1000)"},
+  {NULL,         'j', "INT",   0, "number of threads (default: --threads)"},
   {0}
 };
 
@@ -49,373 +116,992 @@ static char doc[] = "avgngdb -- create an average graph from "\
 
 static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
-  args_t *args;
+  args_t  *args;
+  char   **tmp;
 
   args = state->input;
 
   switch (key) {
 
-    case 's': args->edgeweight = SUM_WEIGHTS; break; 
+    case 's': args->edgeweight = SUM_WEIGHTS; break;
     case 'c': args->edgeweight = COUNT_EDGES; break;
-    case 'a': args->edgeweight = AVG_WEIGHTS; break;
+    case 'a': args->edgeweight = AVG_WEIGHTS;   break;
+    case 'v': args->edgeweight = VAR_WEIGHTS;   break;
+    case 't': args->edgeweight = TSTAT_WEIGHTS; break;
+    case 'g': args->ngroup1    = atoi(arg);     break;
+    case 'n': args->nbsfile    = arg;           break;
+    case 'p': args->nperms     = atoi(arg);     break;
+    case 'j': args->nthreads   = atoi(arg);     break;
+    case 'T':
+      args->nbsthres = atof(arg);
+      args->hasthres = 1;
+      break;
 
     case ARGP_KEY_ARG:
       if (state->arg_num == 0) args->output = arg;
       else {
-        
-        if (args->ninputs < MAX_INPUTS) args->inputs[args->ninputs++] = arg;
-        else printf("too many inputs - ignoring %s\n", arg);
+
+        if (args->ninputs == UINT16_MAX) {
+          printf("too many inputs - ignoring %s\n", arg);
+          break;
+        }
+
+        tmp = realloc(args->inputs, (args->ninputs + 1) * sizeof(char *));
+        if (tmp == NULL) argp_failure(state, 1, 0, "out of memory");
+
+        args->inputs = tmp;
+        args->inputs[args->ninputs++] = arg;
       }
-        
+
       break;
 
     case ARGP_KEY_END:
       if (state->arg_num <= 1) argp_usage(state);
+
+      if (args->edgeweight == TSTAT_WEIGHTS || args->nbsfile != NULL) {
+        if (args->ngroup1 < 2 || args->ninputs - args->ngroup1 < 2)
+          argp_error(state, "-t and -n need -g, and at least two "\
+                            "inputs in each group");
+      }
+
+      if (args->nbsfile != NULL && !args->hasthres)
+        argp_error(state, "-n needs -T");
+
+      if (args->nbsfile != NULL && args->nperms == 0) args->nperms = 1000;
       break;
 
     default:
-      return ARGP_ERR_UNKNOWN; 
+      return ARGP_ERR_UNKNOWN;
   }
-  
+
   return 0;
 }
 
 /**
- * This struct contains two sets of mappings:
- *   - A mapping from all unique label values in all input graphs, to the
- *     node indices for each input graph that correspond to said label values.
- *   - For each input graph, a mapping from the input graph node IDs to the
- *     output graph node IDs.
+ * An input graph file.
+ */
+typedef struct _avg_input {
+
+  char          *fname;  /**< file name                                */
+  ngdb_t        *ngdb;   /**< open handle                              */
+  uint32_t       nnodes; /**< number of nodes                          */
+  ngdb_label_t  *labels; /**< node labels (only used while the output
+                              nodes are being identified)              */
+  uint32_t      *idmap;  /**< output node ID of every input node       */
+  uint32_t      *order;  /**< input node IDs, sorted by output node ID */
+  uint32_t       pos;    /**< index into order of the next input node
+                              to be read                               */
+
+} avg_input_t;
+
+/**
+ * One input reference, mapped to the output graph.
+ */
+typedef struct _avg_ref {
+
+  uint32_t u;     /**< output node                 */
+  uint32_t v;     /**< output neighbour            */
+  uint32_t input; /**< input graph it came from    */
+  float    wt;    /**< input edge weight           */
+
+} avg_ref_t;
+
+/**
+ * A buffer of mapped references.
+ */
+typedef struct _avg_buf {
+
+  avg_ref_t *refs; /**< the references            */
+  uint64_t   size; /**< number of references      */
+  uint64_t   cap;  /**< capacity of refs          */
+  uint32_t  *nbrs; /**< scratch space for reading */
+  double    *wts;  /**< scratch space for reading */
+  uint32_t   ncap; /**< capacity of nbrs and wts  */
+
+} avg_buf_t;
+
+/**
+ * Running moments of a set of values, updated with Welford's algorithm.
+ */
+typedef struct _avg_moments {
+
+  uint32_t n;    /**< number of values                         */
+  double   mean; /**< mean of the values                       */
+  double   m2;   /**< sum of squared deviations from the mean  */
+
+} avg_moments_t;
+
+/**
+ * NBS state - the group memberships and the union-find of the output
+ * nodes for the real grouping (0), and for every permutation (1 to
+ * nperms).
+ */
+typedef struct _avg_nbs {
+
+  uint32_t  nperms;  /**< number of permutations                      */
+  double    thres;   /**< t statistic threshold                       */
+  uint8_t  *groups;  /**< (nperms + 1) * ninputs group memberships -
+                          1 for group 1, 0 for group 2                */
+  uint32_t *parents; /**< (nperms + 1) * nlabels union-find parents   */
+  uint32_t *nedges;  /**< (nperms + 1) * nlabels number of edges in the
+                          component of every root                     */
+
+} avg_nbs_t;
+
+/**
+ * State shared by the threads reading the inputs.
+ */
+typedef struct _avg_ctx {
+
+  avg_input_t   *inputs;  /**< the inputs                              */
+  uint16_t       ninputs; /**< number of inputs                        */
+  ngdb_label_t  *labels;  /**< unique labels - one for every output
+                               node                                    */
+  uint32_t       nlabels; /**< number of output nodes                  */
+  uint32_t       hi;      /**< one past the last output node in the
+                               current range                           */
+  avg_buf_t     *bufs;    /**< one reference buffer for each thread    */
+  uint16_t       ngroup1; /**< number of inputs in group 1             */
+  uint8_t       *groups;  /**< group of every input - 1 for group 1,
+                               0 for group 2                           */
+  uint64_t      *edges;   /**< offset of the first reference of every
+                               edge in the current range, in bufs[0]   */
+  uint64_t       nedges;  /**< number of edges in the current range    */
+  uint64_t       ecap;    /**< capacity of edges                       */
+  avg_nbs_t     *nbs;     /**< NBS state, or NULL                      */
+
+} avg_ctx_t;
+
+/**
+ * parallel_for function which opens a range of inputs, and reads their
+ * node labels.
  *
- * This struct is created and populated by the _mk_nlbl_map function.
+ * \return 0 on success, non-0 on failure.
  */
-typedef struct __nlbl_map {
-
-  array_t labels;  /**< Array of graph_label_t structs, all
-                        unique labels in all input graphs.
-                        The size of this array will become
-                        the number of nodes in the output graph.   */
-  array_t nodeids; /**< Array of arrays, one for each unique
-                        label (i.e. this array is the same
-                        length as the labels array). Each
-                        array contains [ninputs] int64_t
-                        values, which are the node ID in
-                        the respective input graph that
-                        has the the unique label, or -1 if
-                        there is no such node in the input graph.  */
-  array_t sizes;   /**< Array of uint32_t values, one for
-                        each input graph, the number of
-                        nodes in that input graph.                 */
-  array_t idmap;   /**< Array of array_t structs, one for
-                        each input graph. Each array contains
-                        a uint32_t value for every node in
-                        the input graph, which is ID of the
-                        corresponding node in the output graph.    */
-
-} nlbl_map_t;
+static uint8_t _open_inputs(
+  uint64_t  start,  /**< first input           */
+  uint64_t  end,    /**< one past last input   */
+  uint16_t  thread, /**< calling thread        */
+  void     *ctx     /**< pointer to avg_ctx_t  */
+);
 
 /**
- * Searches through the input graphs and builds a list of the node indices
- * that correspond to all unique label values. Then, using this information,
- * builds a node ID mapping  from the nodes in each input graph to these
- * unique label vales (i.e. the nodes in the output graph).
+ * Builds the sorted list of unique labels in all of the inputs, which
+ * become the nodes of the output graph.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _mk_nlbl_map(
-  char      **inputs,  /**< list of input graph files          */
-  uint16_t    ninputs, /**< number of input files              */
-  nlbl_map_t *map      /**< pointer to uninitialised label map */
+static uint8_t _mk_labels(
+  avg_ctx_t *ctx /**< the context */
 );
 
 /**
- * Updates the label map for the given input graph.
+ * parallel_for function which builds the input -> output node ID mapping,
+ * and the output node order, for a range of inputs.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _update_nlbl_map(
-  graph_t    *g,       /**< input graph                */
-  uint16_t    ninputs, /**< total number of inputs     */
-  uint16_t    inidx,   /**< input number of this graph */
-  nlbl_map_t *map      /**< label map to update        */
+static uint8_t _map_inputs(
+  uint64_t  start,  /**< first input           */
+  uint64_t  end,    /**< one past last input   */
+  uint16_t  thread, /**< calling thread        */
+  void     *ctx     /**< pointer to avg_ctx_t  */
 );
 
 /**
- * Builds the node ID mapping from the given input graph to the output graph.
+ * parallel_for function which reads the references of all input nodes
+ * which map to the current range of output nodes, from a range of inputs,
+ * into the buffer for the calling thread.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _mk_id_map(
-  nlbl_map_t *map,  /**< label map to update */
-  uint16_t    inidx /**< input graph index   */
+static uint8_t _read_refs(
+  uint64_t  start,  /**< first input           */
+  uint64_t  end,    /**< one past last input   */
+  uint16_t  thread, /**< calling thread        */
+  void     *ctx     /**< pointer to avg_ctx_t  */
 );
 
 /**
- * Compares two graph_label_t structs on their x,y and z values.
+ * Combines the references in all of the thread buffers, and writes the
+ * resulting edges to the output file. The buffers are emptied.
  *
- * \return >0 if (*a > *b), 0 if (*a == *b), <0 if (*a < *b).
+ * \return 0 on success, non-0 on failure.
  */
-static int _compare_glbl(
-  const void *a, /**< pointer to a graph_label_t struct */
-  const void *b  /**< pointer to a graph_label_t struct */
+static uint8_t _write_refs(
+  avg_ctx_t    *ctx,        /**< the context                        */
+  uint16_t      nbufs,      /**< number of buffers                  */
+  ngdb_t       *out,        /**< output file                        */
+  edge_weight_t edgeweight  /**< how to set output graph edge weight */
+);
+
+/**
+ * Adds a value to the given moments.
+ */
+static void _moments_add(
+  avg_moments_t *m, /**< the moments */
+  double         x  /**< the value   */
+);
+
+/**
+ * Adds the given number of zero values to the given moments, in one
+ * step, by combining them with a set of nz zeros.
+ */
+static void _moments_add_zeros(
+  avg_moments_t *m, /**< the moments      */
+  uint32_t       nz /**< number of zeros  */
+);
+
+/**
+ * Calculates the moments of the weights of one output edge, in each
+ * group. Inputs which do not contain the edge count as a weight of 0.
+ */
+static void _edge_moments(
+  avg_ctx_t     *ctx,    /**< the context                       */
+  uint64_t       e,      /**< index of the edge in ctx->edges   */
+  uint8_t       *groups, /**< group of every input, or NULL to
+                              put every input in group 1        */
+  avg_moments_t *m       /**< moments of each group, [0] for
+                              group 2, [1] for group 1          */
 );
 
 /**
- * Compares two graph_label_t structs on their x,y and z values.
+ * \return Welch's t statistic between group 1 (m[1]) and group 2 (m[0])
+ * or 0 if neither group has any variance.
+ */
+static double _tstat(
+  avg_moments_t *m /**< moments of each group */
+);
+
+/**
+ * Allocates the NBS state, and generates the permutations.
  *
- * \return 0 if (*a >= *b) and b is the last element in the array, or *a is
- * less than the next value in the array, <0 if *a < *b, >0 otherwise. 
+ * \return 0 on success, non-0 on failure.
  */
-static int _compare_glbl_ins(
-  const void *a, /**< pointer to a graph_label_t struct */
-  const void *b  /**< pointer to a graph_label_t struct */
+static uint8_t _nbs_init(
+  avg_ctx_t *ctx,   /**< the context                */
+  uint32_t   nperms,/**< number of permutations     */
+  double     thres  /**< t statistic threshold      */
 );
 
 /**
- * Adds all of the edges from the given input graph to the output graph.
+ * parallel_for function which adds the suprathreshold edges in the
+ * current range to the union-finds of a range of permutations.
+ *
+ * \return 0.
+ */
+static uint8_t _nbs_edges(
+  uint64_t  start,  /**< first permutation          */
+  uint64_t  end,    /**< one past last permutation  */
+  uint16_t  thread, /**< calling thread             */
+  void     *ctx     /**< pointer to avg_ctx_t       */
+);
+
+/**
+ * \return the root of the given node in the given union-find. Paths are
+ * halved along the way.
+ */
+static uint32_t _nbs_find(
+  uint32_t *parents, /**< union-find parents */
+  uint32_t  u        /**< node               */
+);
+
+/**
+ * Writes the components of the real grouping, along with their p values,
+ * to the given file.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _update_avg_graph(
-  graph_t      *gin,        /**< the input graph                     */
-  graph_t      *gavg,       /**< the average (output) graph          */
-  array_t      *nodemap,    /**< input -> output node ID mapping     */
-  edge_weight_t edgeweight, /**< how to set output graph edge weight */
-  uint16_t      ninputs     /**< number of input graphs              */
+static uint8_t _nbs_write(
+  avg_ctx_t *ctx,  /**< the context      */
+  char      *fname /**< output file name */
 );
 
 /**
- * Creates an average graph from all of the input graphs.
- * 
+ * Creates an average graph from all of the input graphs, and writes it to
+ * the given file.
+ *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _mk_avg_graph(
-  char        **inputs,    /**< input graph files                   */
-  uint16_t      ninputs,   /**< number of input files               */
-  graph_t      *gavg,      /**< pointer to uninitialised graph      */
-  nlbl_map_t   *map,       /**< label->node index mapping           */
-  edge_weight_t edgeweight /**< how to set output graph edge weight */
+  args_t *args /**< program arguments */
+);
+
+/**
+ * Closes the inputs, and frees the memory used by the given context.
+ */
+static void _free_ctx(
+  avg_ctx_t *ctx,     /**< the context       */
+  uint16_t   nthreads /**< number of buffers */
+);
+
+/**
+ * Compares two ngdb_label_t structs on their label, z, y and x values.
+ *
+ * \return >0 if (*a > *b), 0 if (*a == *b), <0 if (*a < *b).
+ */
+static int _compare_glbl(
+  const void *a, /**< pointer to an ngdb_label_t struct */
+  const void *b  /**< pointer to an ngdb_label_t struct */
+);
+
+/**
+ * Compares two uint64_t values.
+ */
+static int _compare_u64(
+  const void *a, /**< pointer to a uint64_t       */
+  const void *b  /**< pointer to another uint64_t */
+);
+
+/**
+ * Compares two avg_ref_t structs, by output node, then output neighbour,
+ * then input.
+ */
+static int _compare_refs(
+  const void *a, /**< pointer to an avg_ref_t struct       */
+  const void *b  /**< pointer to another avg_ref_t struct  */
 );
 
 int main(int argc, char *argv[]) {
 
-  nlbl_map_t  map;
   args_t      args;
-  graph_t     gavg;
   struct argp argp = {options, _parse_opt, "OUTPUT [INPUT ...]", doc};
 
   memset(&args, 0, sizeof(args));
-  memset(&map,  0, sizeof(map));
 
   startup("avgngdb", argc, argv, &argp, &args);
 
-  if (_mk_nlbl_map(args.inputs, args.ninputs, &map)) {
-    printf("error creating node label map\n");
+  if (_mk_avg_graph(&args)) {
+    printf("error creating average graph\n");
     goto fail;
   }
 
-  if (_mk_avg_graph(args.inputs, args.ninputs, &gavg, &map, args.edgeweight)) {
-    printf("error creating average graph\n");
+  free(args.inputs);
+  return 0;
+
+fail:
+  if (args.inputs != NULL) free(args.inputs);
+  return 1;
+}
+
+uint8_t _mk_avg_graph(args_t *args) {
+
+  uint64_t   i;
+  uint64_t   nrefs;
+  uint64_t   chunkrefs;
+  uint32_t   lo;
+  uint32_t   cnt;
+  uint16_t   nthreads;
+  uint8_t   *hdr;
+  uint64_t  *outrefs;
+  ngdb_t    *out;
+  avg_ctx_t  ctx;
+
+  out     = NULL;
+  hdr     = NULL;
+  outrefs = NULL;
+  memset(&ctx, 0, sizeof(avg_ctx_t));
+
+  nthreads = args->nthreads;
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  ctx.ninputs = args->ninputs;
+  ctx.ngroup1 = args->ngroup1;
+  ctx.inputs  = calloc(args->ninputs, sizeof(avg_input_t));
+  ctx.bufs    = calloc(nthreads,      sizeof(avg_buf_t));
+  ctx.groups  = calloc(args->ninputs, sizeof(uint8_t));
+
+  if (ctx.inputs == NULL) goto fail;
+  if (ctx.bufs   == NULL) goto fail;
+  if (ctx.groups == NULL) goto fail;
+
+  for (i = 0; i < args->ninputs; i++) ctx.inputs[i].fname = args->inputs[i];
+  for (i = 0; i < args->ngroup1; i++) ctx.groups[i]       = 1;
+
+  if (parallel_for(nthreads, ctx.ninputs, 1, &ctx, _open_inputs)) goto fail;
+  if (_mk_labels(&ctx))                                           goto fail;
+  if (parallel_for(nthreads, ctx.ninputs, 1, &ctx, _map_inputs))  goto fail;
+
+  if (args->nbsfile != NULL &&
+      _nbs_init(&ctx, args->nperms, args->nbsthres))
+    goto fail;
+
+  /*number of input references for each output node*/
+  outrefs = calloc(ctx.nlabels, sizeof(uint64_t));
+  if (ctx.nlabels > 0 && outrefs == NULL) goto fail;
+
+  for (i = 0; i < ctx.ninputs; i++) {
+    for (cnt = 0; cnt < ctx.inputs[i].nnodes; cnt++) {
+      outrefs[ctx.inputs[i].idmap[cnt]] +=
+        ngdb_node_num_refs(ctx.inputs[i].ngdb, cnt);
+    }
+  }
+
+  out = ngdb_create(
+    args->output,
+    ctx.nlabels,
+    NGDB_HDR_DATA_SIZE,
+    sizeof(ngdb_label_t),
+    sizeof(double));
+  if (out == NULL) goto fail;
+
+  hdr = calloc(NGDB_HDR_DATA_SIZE, 1);
+  if (hdr == NULL) goto fail;
+
+  if (ngdb_hdr_set_data(out, hdr, NGDB_HDR_DATA_SIZE)) goto fail;
+
+  for (i = 0; i < ctx.nlabels; i++) {
+    if (ngdb_node_set_data(out,
+                           i,
+                           (uint8_t *)(ctx.labels + i),
+                           sizeof(ngdb_label_t)))
+      goto fail;
+  }
+
+  /*
+   * the reference buffers may grow to
+   * twice the number of references
+   */
+  chunkrefs = AVG_CHUNK_REFS;
+  if (!memacct_fits(chunkrefs * 2 * sizeof(avg_ref_t)))
+    chunkrefs = memacct_remaining() / (2 * sizeof(avg_ref_t));
+
+  /*as many output nodes as will fit in one chunk, but at least one*/
+  for (lo = 0; lo < ctx.nlabels; lo = ctx.hi) {
+
+    nrefs = 0;
+    for (ctx.hi = lo; ctx.hi < ctx.nlabels; ctx.hi++) {
+
+      if (ctx.hi > lo && nrefs + outrefs[ctx.hi] > chunkrefs) break;
+      nrefs += outrefs[ctx.hi];
+    }
+
+    if (parallel_for(nthreads, ctx.ninputs, 1, &ctx, _read_refs))
+      goto fail;
+
+    if (_write_refs(&ctx, nthreads, out, args->edgeweight)) goto fail;
+  }
+
+  if (ctx.nbs != NULL && _nbs_write(&ctx, args->nbsfile)) {
+    printf("error writing NBS components to %s\n", args->nbsfile);
     goto fail;
   }
 
-  if (ngdb_write(&gavg, args.output)) {
-    printf("error writing graph to %s\n", args.output);
+  if (ngdb_close(out)) {
+    out = NULL;
     goto fail;
   }
 
+  free(hdr);
+  free(outrefs);
+  _free_ctx(&ctx, nthreads);
+
   return 0;
-  
+
 fail:
+  if (out     != NULL) ngdb_close(out);
+  if (hdr     != NULL) free(hdr);
+  if (outrefs != NULL) free(outrefs);
+  _free_ctx(&ctx, nthreads);
   return 1;
 }
 
+void _free_ctx(avg_ctx_t *ctx, uint16_t nthreads) {
+
+  uint64_t i;
 
-uint8_t _mk_nlbl_map(char **inputs, uint16_t ninputs, nlbl_map_t *map) {
+  if (ctx->labels != NULL) free(ctx->labels);
+  if (ctx->groups != NULL) free(ctx->groups);
+  if (ctx->edges  != NULL) free(ctx->edges);
 
-  uint32_t i;
-  graph_t  g;
+  if (ctx->nbs != NULL) {
+    if (ctx->nbs->groups  != NULL) free(ctx->nbs->groups);
+    if (ctx->nbs->parents != NULL) free(ctx->nbs->parents);
+    if (ctx->nbs->nedges  != NULL) free(ctx->nbs->nedges);
+    free(ctx->nbs);
+  }
 
-  if (array_create(&(map->labels),  sizeof(graph_label_t), 1000))    goto fail;
-  if (array_create(&(map->nodeids), sizeof(array_t),       1000))    goto fail;
-  if (array_create(&(map->sizes),   sizeof(uint32_t),      ninputs)) goto fail;
-  if (array_create(&(map->idmap),   sizeof(array_t),       ninputs)) goto fail;
+  if (ctx->inputs != NULL) {
+    for (i = 0; i < ctx->ninputs; i++) {
+      if (ctx->inputs[i].ngdb   != NULL) ngdb_close(ctx->inputs[i].ngdb);
+      if (ctx->inputs[i].labels != NULL) free(ctx->inputs[i].labels);
+      if (ctx->inputs[i].idmap  != NULL) free(ctx->inputs[i].idmap);
+      if (ctx->inputs[i].order  != NULL) free(ctx->inputs[i].order);
+    }
+    free(ctx->inputs);
+  }
+
+  if (ctx->bufs != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (ctx->bufs[i].refs != NULL) free(ctx->bufs[i].refs);
+      if (ctx->bufs[i].nbrs != NULL) free(ctx->bufs[i].nbrs);
+      if (ctx->bufs[i].wts  != NULL) free(ctx->bufs[i].wts);
+    }
+    free(ctx->bufs);
+  }
+}
 
-  array_set_cmps(&(map->labels), _compare_glbl, _compare_glbl_ins);
+uint8_t _open_inputs(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
 
-  for (i = 0; i < ninputs; i++) {
+  uint64_t     i;
+  avg_input_t *in;
 
-    if (ngdb_read(inputs[i], &g))              goto fail;
-    if (_update_nlbl_map(&g, ninputs, i, map)) goto fail;
-    graph_free(&g);
+  for (i = start; i < end; i++) {
+
+    in = ((avg_ctx_t *)ctx)->inputs + i;
+
+    in->ngdb = ngdb_open_mmap(in->fname);
+    if (in->ngdb == NULL) in->ngdb = ngdb_open(in->fname);
+    if (in->ngdb == NULL) {
+      printf("error opening %s\n", in->fname);
+      goto fail;
+    }
+
+    if (ngdb_node_data_len(in->ngdb) != sizeof(ngdb_label_t) ||
+        ngdb_ref_data_len( in->ngdb) != sizeof(double)) {
+      printf("%s was not created by ngdb_write\n", in->fname);
+      goto fail;
+    }
+
+    in->nnodes = ngdb_num_nodes(in->ngdb);
+    in->labels = malloc(in->nnodes * sizeof(ngdb_label_t));
+    if (in->nnodes > 0 && in->labels == NULL) goto fail;
+
+    if (in->nnodes > 0 &&
+        ngdb_nodes_get_data(
+          in->ngdb, 0, in->nnodes, (uint8_t *)in->labels)) {
+      printf("error reading node labels from %s\n", in->fname);
+      goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mk_labels(avg_ctx_t *ctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       n;
+  ngdb_label_t  *labels;
+
+  n = 0;
+  for (i = 0; i < ctx->ninputs; i++) n += ctx->inputs[i].nnodes;
+
+  if (n > UINT32_MAX) goto fail;
+
+  labels = malloc(n * sizeof(ngdb_label_t));
+  if (n > 0 && labels == NULL) goto fail;
+
+  for (i = 0, j = 0; i < ctx->ninputs; i++) {
+    memcpy(labels + j,
+           ctx->inputs[i].labels,
+           ctx->inputs[i].nnodes * sizeof(ngdb_label_t));
+    j += ctx->inputs[i].nnodes;
   }
 
-  for (i = 0; i < ninputs; i++) {
-    if (_mk_id_map(map, i)) goto fail;
+  qsort(labels, n, sizeof(ngdb_label_t), _compare_glbl);
+
+  /*remove duplicates*/
+  for (i = 1, j = (n > 0); i < n; i++) {
+
+    if (_compare_glbl(labels + i, labels + j - 1) != 0)
+      labels[j++] = labels[i];
   }
 
+  ctx->labels  = labels;
+  ctx->nlabels = j;
+
   return 0;
-  
+
 fail:
   return 1;
 }
 
-uint8_t _update_nlbl_map(
-  graph_t *g, uint16_t ninputs, uint16_t inidx, nlbl_map_t *map) {
+uint8_t _map_inputs(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t      *keys;
+  avg_ctx_t     *c;
+  avg_input_t   *in;
+  ngdb_label_t  *lbl;
 
-  graph_label_t *lbl;
-  int64_t        i;
-  int64_t        tmp;
-  uint32_t       j;
-  uint32_t       lblidx;
-  uint32_t       nnodes;
-  array_t        nodeids;
-  array_t       *pnodeids;
+  c    = ctx;
+  keys = NULL;
 
-  tmp = -1;
+  for (i = start; i < end; i++) {
 
-  nnodes = graph_num_nodes(g);
+    in = c->inputs + i;
 
-  array_set(&(map->sizes), inidx, &nnodes);
+    in->idmap = malloc(in->nnodes * sizeof(uint32_t));
+    in->order = malloc(in->nnodes * sizeof(uint32_t));
+    keys      = malloc(in->nnodes * sizeof(uint64_t));
 
-  for (i = 0; i < nnodes; i++) {
-    
-    lbl = graph_get_nodelabel(g, i);
+    if (in->nnodes > 0 && in->idmap == NULL) goto fail;
+    if (in->nnodes > 0 && in->order == NULL) goto fail;
+    if (in->nnodes > 0 && keys      == NULL) goto fail;
 
-    switch (array_insert_sorted(&(map->labels), lbl, 1, &lblidx)) {
+    for (j = 0; j < in->nnodes; j++) {
 
-      case 0:
-        if (array_create(&nodeids, sizeof(int64_t), ninputs)) goto fail; 
-        for (j = 0; j < ninputs; j++) array_set(&nodeids, j, &tmp);
-        
-        if (array_insert(&(map->nodeids), lblidx, &nodeids))  goto fail;
+      lbl = bsearch(in->labels + j,
+                    c->labels,
+                    c->nlabels,
+                    sizeof(ngdb_label_t),
+                    _compare_glbl);
 
-        break;
+      if (lbl == NULL) goto fail;
 
-      case 1:
-        break;
-      default: goto fail;
+      in->idmap[j] = lbl - c->labels;
+      keys[j]      = ((uint64_t)in->idmap[j] << 32) | j;
     }
 
-    pnodeids = array_getd(&(map->nodeids), lblidx);
-    array_set(pnodeids, inidx, &i);
+    /*input nodes, in order of their output node ID*/
+    qsort(keys, in->nnodes, sizeof(uint64_t), _compare_u64);
+
+    for (j = 0; j < in->nnodes; j++) in->order[j] = keys[j] & 0xFFFFFFFF;
+
+    free(keys);
+    free(in->labels);
+    keys       = NULL;
+    in->labels = NULL;
+    in->pos    = 0;
   }
 
   return 0;
+
 fail:
+  if (keys != NULL) free(keys);
   return 1;
 }
 
-uint8_t _mk_id_map(nlbl_map_t *map, uint16_t inidx) {
+uint8_t _read_refs(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
 
-  uint64_t i;
-  uint32_t navgnodes;
-  uint32_t ninnodes;
-  uint32_t avgnodeid;
-  int64_t  innodeid;
-  array_t *idmap;
-  array_t *nodeids;
+  uint64_t     i;
+  uint64_t     j;
+  uint32_t     u;
+  uint32_t     nidx;
+  uint32_t     nrefs;
+  void        *tmp;
+  avg_ctx_t   *c;
+  avg_input_t *in;
+  avg_buf_t   *buf;
+
+  c   = ctx;
+  buf = c->bufs + thread;
+
+  for (i = start; i < end; i++) {
+
+    in = c->inputs + i;
+
+    for (; in->pos < in->nnodes; in->pos++) {
+
+      nidx = in->order[in->pos];
+      u    = in->idmap[nidx];
+
+      if (u >= c->hi) break;
+
+      nrefs = ngdb_node_num_refs(in->ngdb, nidx);
+      if (nrefs == 0xFFFFFFFF) goto fail;
+      if (nrefs == 0)          continue;
+
+      if (nrefs > buf->ncap) {
+
+        tmp = realloc(buf->nbrs, nrefs * sizeof(uint32_t));
+        if (tmp == NULL) goto fail;
+        buf->nbrs = tmp;
+
+        tmp = realloc(buf->wts, nrefs * sizeof(double));
+        if (tmp == NULL) goto fail;
+        buf->wts = tmp;
+
+        buf->ncap = nrefs;
+      }
+
+      if (buf->size + nrefs > buf->cap) {
 
-  idmap     =              array_getd(&(map->idmap), inidx);
-  ninnodes  = *(uint32_t *)array_getd(&(map->sizes), inidx);
-  navgnodes = map->labels.size;
+        buf->cap = 2 * (buf->size + nrefs);
+        tmp      = realloc(buf->refs, buf->cap * sizeof(avg_ref_t));
+        if (tmp == NULL) goto fail;
+        buf->refs = tmp;
+      }
+
+      if (ngdb_node_get_all_refs(in->ngdb, nidx, buf->nbrs, buf->wts))
+        goto fail;
 
-  if (array_create(idmap, sizeof(uint32_t), ninnodes)) goto fail;
+      for (j = 0; j < nrefs; j++) {
 
-  for (i = 0; i < navgnodes; i++) {
+        if (buf->nbrs[j] >= in->nnodes) goto fail;
 
-    nodeids = array_getd(&(map->nodeids), i);
-    
-    innodeid = *(int64_t *)array_getd(nodeids, inidx);
+        buf->refs[buf->size].u     = u;
+        buf->refs[buf->size].v     = in->idmap[buf->nbrs[j]];
+        buf->refs[buf->size].input = i;
+        buf->refs[buf->size].wt    = buf->wts[j];
 
-    if (innodeid == -1) continue;
+        /*two input nodes with the same label*/
+        if (buf->refs[buf->size].v == u) continue;
 
-    avgnodeid = i;
-    array_set(idmap, innodeid, &avgnodeid);
+        buf->size++;
+      }
+    }
   }
 
   return 0;
 
 fail:
+  printf("error reading references from %s\n", c->inputs[i].fname);
   return 1;
 }
 
-int _compare_glbl(const void *a, const void *b) {
+uint8_t _write_refs(
+  avg_ctx_t *ctx, uint16_t nbufs, ngdb_t *out, edge_weight_t edgeweight) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      k;
+  uint64_t      e;
+  uint64_t      n;
+  uint64_t      ecap;
+  float         outwt;
+  double        wt;
+  avg_moments_t m[2];
+  avg_ref_t    *refs;
+  avg_buf_t    *buf;
+  void         *tmp;
+
+  /*gather all of the references into the first buffer*/
+  buf = ctx->bufs;
+  n   = 0;
+  for (i = 0; i < nbufs; i++) n += ctx->bufs[i].size;
+
+  if (n > buf->cap) {
+    tmp = realloc(buf->refs, n * sizeof(avg_ref_t));
+    if (tmp == NULL) goto fail;
+    buf->refs = tmp;
+    buf->cap  = n;
+  }
 
-  graph_label_t *ga;
-  graph_label_t *gb;
-  
-  ga = (graph_label_t *)a;
-  gb = (graph_label_t *)b;
+  for (i = 1; i < nbufs; i++) {
 
-  if      (ga->labelval > gb->labelval) return  1;
-  else if (ga->labelval < gb->labelval) return -1;
+    memcpy(buf->refs + buf->size,
+           ctx->bufs[i].refs,
+           ctx->bufs[i].size * sizeof(avg_ref_t));
+
+    buf->size         += ctx->bufs[i].size;
+    ctx->bufs[i].size  = 0;
+  }
+
+  refs = buf->refs;
+  qsort(refs, n, sizeof(avg_ref_t), _compare_refs);
+
+  /*
+   * drop duplicate references (an input may contain
+   * the same edge twice), and find the first
+   * reference of every edge
+   */
+  ctx->nedges = 0;
+  for (i = 0, k = 0; i < n; i++) {
+
+    if (k > 0 && refs[i].u == refs[k-1].u && refs[i].v == refs[k-1].v) {
+      if (refs[i].input == refs[k-1].input) continue;
+    }
+    else {
+
+      if (ctx->nedges + 2 > ctx->ecap) {
+
+        ecap = (ctx->ecap == 0) ? 1024 : 2 * ctx->ecap;
+        tmp  = realloc(ctx->edges, ecap * sizeof(uint64_t));
+        if (tmp == NULL) goto fail;
+
+        ctx->edges = tmp;
+        ctx->ecap  = ecap;
+      }
+
+      ctx->edges[ctx->nedges++] = k;
+    }
+
+    refs[k++] = refs[i];
+  }
+
+  if (ctx->nedges > 0) ctx->edges[ctx->nedges] = k;
+
+  for (e = 0; e < ctx->nedges; e++) {
+
+    i = ctx->edges[e];
+    j = ctx->edges[e+1];
+
+    switch (edgeweight) {
+
+      /*
+       * weights are accumulated in input order, at single
+       * precision, exactly as they would be if the edges
+       * were added to a graph_t one input at a time
+       */
+      case SUM_WEIGHTS:
+      case COUNT_EDGES:
+      case AVG_WEIGHTS:
+
+        outwt = 0;
+        for (k = i; k < j; k++) {
+          switch (edgeweight) {
+            case SUM_WEIGHTS: outwt = outwt + refs[k].wt;                break;
+            case COUNT_EDGES: outwt = outwt + 1;                         break;
+            default:          outwt = outwt + (refs[k].wt/ctx->ninputs); break;
+          }
+        }
+        wt = outwt;
+        break;
+
+      case VAR_WEIGHTS:
+        _edge_moments(ctx, e, NULL, m);
+        wt = (m[1].n > 1) ? m[1].m2 / (m[1].n - 1) : 0;
+        break;
+
+      case TSTAT_WEIGHTS:
+        _edge_moments(ctx, e, ctx->groups, m);
+        wt = _tstat(m);
+        break;
+
+      default: goto fail;
+    }
+
+    if (ngdb_add_ref(out, refs[i].u, refs[i].v, &wt, sizeof(double)) ==
+        0xFFFFFFFF)
+      goto fail;
+  }
+
+  if (ctx->nbs != NULL &&
+      parallel_for(nbufs, ctx->nbs->nperms + 1, 1, ctx, _nbs_edges))
+    goto fail;
+
+  buf->size = 0;
 
-  if      (ga->zval > gb->zval) return  1;
-  else if (ga->zval < gb->zval) return -1;
-  
-  if      (ga->yval > gb->yval) return  1;
-  else if (ga->yval < gb->yval) return -1;
-  
-  if      (ga->xval > gb->xval) return  1;
-  else if (ga->xval < gb->xval) return -1;
-  
   return 0;
+
+fail:
+  return 1;
 }
 
-int _compare_glbl_ins(const void *a, const void *b) {
-  
-  return compare_insert(a, b, sizeof(graph_label_t), _compare_glbl);
+void _moments_add(avg_moments_t *m, double x) {
+
+  double delta;
+
+  m->n    += 1;
+  delta    = x - m->mean;
+  m->mean += delta / m->n;
+  m->m2   += delta * (x - m->mean);
 }
 
+void _moments_add_zeros(avg_moments_t *m, uint32_t nz) {
 
-uint8_t _update_avg_graph(
-  graph_t      *gin,
-  graph_t      *gavg,
-  array_t      *nodemap,
-  edge_weight_t edgeweight,
-  uint16_t      ninputs) {
+  double delta;
+  double n;
 
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  ginnodes;
-  uint32_t *nbrs;
-  uint32_t  nnbrs;
-  uint32_t  outi;
-  uint32_t  outj;
-  float     inwt;
-  float     outwt;
+  if (nz == 0) return;
 
-  ginnodes = graph_num_nodes(gin);
+  n        = (double)m->n + nz;
+  delta    = -m->mean;
+  m->m2   += delta * delta * ((double)m->n * nz / n);
+  m->mean += delta * (nz / n);
+  m->n    += nz;
+}
 
-  for (i = 0; i < ginnodes; i++) {
+void _edge_moments(
+  avg_ctx_t *ctx, uint64_t e, uint8_t *groups, avg_moments_t *m) {
 
-    outi  = *(uint32_t *)array_getd(nodemap, i);
-    nnbrs = graph_num_neighbours(gin, i);
-    nbrs  = graph_get_neighbours(gin, i);
+  uint64_t   i;
+  uint8_t    g;
+  avg_ref_t *refs;
 
-    for (j = 0; j < nnbrs; j++) {
+  refs = ctx->bufs[0].refs;
 
-      if (i >= nbrs[j]) continue;
+  memset(m, 0, 2 * sizeof(avg_moments_t));
 
-      outj = *(uint32_t *)array_getd(nodemap, nbrs[j]);
+  for (i = ctx->edges[e]; i < ctx->edges[e+1]; i++) {
 
-      /*will have no effect if edge already exists*/
-      graph_add_edge(gavg, outi, outj, 0.0);
+    g = (groups == NULL) ? 1 : groups[refs[i].input];
+    _moments_add(m + g, refs[i].wt);
+  }
 
-      inwt  = graph_get_weight(gin,  i,    nbrs[j]);
-      outwt = graph_get_weight(gavg, outi, outj);
+  if (groups == NULL) {
+    _moments_add_zeros(m + 1, ctx->ninputs - m[1].n);
+  }
+  else {
+    _moments_add_zeros(m + 1, ctx->ngroup1                - m[1].n);
+    _moments_add_zeros(m,     ctx->ninputs - ctx->ngroup1 - m[0].n);
+  }
+}
 
-      switch (edgeweight) {
+double _tstat(avg_moments_t *m) {
 
-        case SUM_WEIGHTS: outwt = outwt + inwt;           break;
-        case COUNT_EDGES: outwt = outwt + 1;              break;
-        case AVG_WEIGHTS: outwt = outwt + (inwt/ninputs); break;
-        default:          goto fail;
-      }
+  double se;
+
+  se = m[1].m2 / ((double)m[1].n * (m[1].n - 1)) +
+       m[0].m2 / ((double)m[0].n * (m[0].n - 1));
+
+  if (se <= 0) return 0;
+
+  return (m[1].mean - m[0].mean) / sqrt(se);
+}
+
+uint8_t _nbs_init(avg_ctx_t *ctx, uint32_t nperms, double thres) {
+
+  uint64_t   i;
+  uint64_t   p;
+  uint64_t   j;
+  uint8_t    tmp;
+  uint8_t   *groups;
+  rng_t     *rng;
+  avg_nbs_t *nbs;
+
+  nbs = calloc(1, sizeof(avg_nbs_t));
+  if (nbs == NULL) goto fail;
+
+  ctx->nbs     = nbs;
+  nbs->nperms  = nperms;
+  nbs->thres   = thres;
+  nbs->groups  = malloc((nperms + 1) * (uint64_t)ctx->ninputs);
+  nbs->parents = malloc((nperms + 1) * (uint64_t)ctx->nlabels *
+                        sizeof(uint32_t));
+  nbs->nedges  = calloc((nperms + 1) * (uint64_t)ctx->nlabels,
+                        sizeof(uint32_t));
+
+  if (nbs->groups == NULL)                      goto fail;
+  if (ctx->nlabels > 0 && nbs->parents == NULL) goto fail;
+  if (ctx->nlabels > 0 && nbs->nedges  == NULL) goto fail;
+
+  for (p = 0; p <= nperms; p++) {
+    for (i = 0; i < ctx->nlabels; i++)
+      nbs->parents[p * ctx->nlabels + i] = i;
+  }
+
+  /*
+   * row 0 is the real grouping, and every other row
+   * a Fisher-Yates shuffle of it, drawn in order from
+   * the default generator, so the permutations only
+   * depend on the seed
+   */
+  rng = rng_default();
+  memcpy(nbs->groups, ctx->groups, ctx->ninputs);
 
-      if (graph_set_weight(gavg, outi, outj, outwt))
-         goto fail;
+  for (p = 1; p <= nperms; p++) {
+
+    groups = nbs->groups + p * ctx->ninputs;
+    memcpy(groups, ctx->groups, ctx->ninputs);
+
+    for (i = ctx->ninputs - 1; i > 0; i--) {
+
+      j         = rng_range(rng, i + 1);
+      tmp       = groups[i];
+      groups[i] = groups[j];
+      groups[j] = tmp;
     }
   }
 
@@ -425,42 +1111,250 @@ fail:
   return 1;
 }
 
-uint8_t _mk_avg_graph(
-  char        **inputs,
-  uint16_t      ninputs,
-  graph_t      *gavg,
-  nlbl_map_t   *map,
-  edge_weight_t edgeweight) {
+uint8_t _nbs_edges(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
 
-  uint64_t       i;
-  uint32_t       nnodes;
-  graph_label_t *lbl;
-  array_t       *nodemap;
-  graph_t        gin;
+  uint64_t       p;
+  uint64_t       e;
+  uint32_t       u;
+  uint32_t       v;
+  uint32_t      *parents;
+  uint32_t      *nedges;
+  uint8_t       *groups;
+  avg_moments_t  m[2];
+  avg_ctx_t     *c;
+  avg_ref_t     *refs;
+
+  c    = ctx;
+  refs = c->bufs[0].refs;
+
+  for (p = start; p < end; p++) {
+
+    groups  = c->nbs->groups  + p * c->ninputs;
+    parents = c->nbs->parents + p * c->nlabels;
+    nedges  = c->nbs->nedges  + p * c->nlabels;
+
+    for (e = 0; e < c->nedges; e++) {
+
+      u = refs[c->edges[e]].u;
+      v = refs[c->edges[e]].v;
+
+      if (u >= v) continue;
+
+      _edge_moments(c, e, groups, m);
+
+      if (_tstat(m) <= c->nbs->thres) continue;
+
+      u = _nbs_find(parents, u);
+      v = _nbs_find(parents, v);
+
+      if (u == v) {
+        nedges[u]++;
+        continue;
+      }
+
+      /*the component with more edges becomes the root*/
+      if (nedges[u] < nedges[v]) {
+        parents[u]  = v;
+        nedges[v]  += nedges[u] + 1;
+      }
+      else {
+        parents[v]  = u;
+        nedges[u]  += nedges[v] + 1;
+      }
+    }
+  }
 
-  nnodes = map->labels.size;
+  return 0;
+}
 
-  if (graph_create(gavg, nnodes, 0)) goto fail;
+uint32_t _nbs_find(uint32_t *parents, uint32_t u) {
 
-  for (i = 0; i < nnodes; i++) {
-    
-    lbl = array_getd(&(map->labels), i);
-    if (graph_set_nodelabel(gavg, i, lbl)) goto fail;
+  while (parents[u] != u) {
+    parents[u] = parents[parents[u]];
+    u          = parents[u];
   }
 
-  for (i = 0; i < ninputs; i++) {
+  return u;
+}
+
+uint8_t _nbs_write(avg_ctx_t *ctx, char *fname) {
+
+  uint64_t   i;
+  uint64_t   j;
+  uint64_t   p;
+  uint64_t   nkeys;
+  uint64_t   nlarger;
+  uint64_t   lo;
+  uint64_t   hi;
+  uint32_t   root;
+  uint32_t   nnodes;
+  uint32_t   max;
+  uint32_t  *maxes;
+  uint32_t  *parents;
+  uint32_t  *nedges;
+  uint64_t  *keys;
+  uint64_t  *comps;
+  uint64_t   ncomps;
+  FILE      *fd;
+  avg_nbs_t *nbs;
+
+  fd    = NULL;
+  keys  = NULL;
+  comps = NULL;
+  maxes = NULL;
+  nbs   = ctx->nbs;
+
+  /*largest component of every permutation*/
+  maxes = calloc(nbs->nperms, sizeof(uint32_t));
+  if (maxes == NULL) goto fail;
+
+  for (p = 1; p <= nbs->nperms; p++) {
+
+    parents = nbs->parents + p * ctx->nlabels;
+    nedges  = nbs->nedges  + p * ctx->nlabels;
+    max     = 0;
+
+    for (i = 0; i < ctx->nlabels; i++) {
+      if (parents[i] == i && nedges[i] > max) max = nedges[i];
+    }
+
+    maxes[p-1] = max;
+  }
+
+  /*
+   * nodes of the real grouping which are in a component
+   * with at least one edge, sorted by their root, and
+   * the components, sorted by their size (descending)
+   */
+  parents = nbs->parents;
+  nedges  = nbs->nedges;
+  keys    = malloc(ctx->nlabels * sizeof(uint64_t));
+  comps   = malloc(ctx->nlabels * sizeof(uint64_t));
+
+  if (ctx->nlabels > 0 && keys  == NULL) goto fail;
+  if (ctx->nlabels > 0 && comps == NULL) goto fail;
+
+  for (i = 0, nkeys = 0, ncomps = 0; i < ctx->nlabels; i++) {
+
+    root = _nbs_find(parents, i);
 
-    nodemap = array_getd(&(map->idmap), i);
-    
-    if (ngdb_read(inputs[i], &gin)) goto fail;
+    if (nedges[root] == 0) continue;
 
-    if (_update_avg_graph(&gin, gavg, nodemap, edgeweight, ninputs))
+    keys[nkeys++] = ((uint64_t)root << 32) | i;
+
+    if (root == i)
+      comps[ncomps++] = ((uint64_t)(UINT32_MAX - nedges[i]) << 32) | i;
+  }
+
+  qsort(keys,  nkeys,  sizeof(uint64_t), _compare_u64);
+  qsort(comps, ncomps, sizeof(uint64_t), _compare_u64);
+
+  fd = fopen(fname, "wt");
+  if (fd == NULL) goto fail;
+
+  for (i = 0; i < ncomps; i++) {
+
+    root = comps[i] & 0xFFFFFFFF;
+
+    for (p = 0, nlarger = 0; p < nbs->nperms; p++) {
+      if (maxes[p] >= nedges[root]) nlarger++;
+    }
+
+    /*first key of this component - root is in the upper 32 bits*/
+    lo = 0;
+    hi = nkeys;
+    while (lo < hi) {
+      j = (lo + hi) / 2;
+      if ((keys[j] >> 32) < root) lo = j + 1;
+      else                        hi = j;
+    }
+
+    for (j = lo, nnodes = 0;
+         j + nnodes < nkeys && (keys[j + nnodes] >> 32) == root;
+         nnodes++);
+
+    if (fprintf(fd, "%u %u %0.6f",
+                nedges[root],
+                nnodes,
+                (double)nlarger / nbs->nperms) < 0)
       goto fail;
-    graph_free(&gin);
+
+    for (p = j; p < j + nnodes; p++) {
+      if (fprintf(fd, " %u", (uint32_t)(keys[p] & 0xFFFFFFFF)) < 0)
+        goto fail;
+    }
+
+    if (fprintf(fd, "\n") < 0) goto fail;
   }
 
+  if (fclose(fd)) {
+    fd = NULL;
+    goto fail;
+  }
+
+  free(maxes);
+  free(keys);
+  free(comps);
   return 0;
 
 fail:
+  if (fd    != NULL) fclose(fd);
+  if (maxes != NULL) free(maxes);
+  if (keys  != NULL) free(keys);
+  if (comps != NULL) free(comps);
   return 1;
 }
+
+int _compare_glbl(const void *a, const void *b) {
+
+  graph_label_t *ga;
+  graph_label_t *gb;
+
+  ga = &(((ngdb_label_t *)a)->label);
+  gb = &(((ngdb_label_t *)b)->label);
+
+  if      (ga->labelval > gb->labelval) return  1;
+  else if (ga->labelval < gb->labelval) return -1;
+
+  if      (ga->zval > gb->zval) return  1;
+  else if (ga->zval < gb->zval) return -1;
+
+  if      (ga->yval > gb->yval) return  1;
+  else if (ga->yval < gb->yval) return -1;
+
+  if      (ga->xval > gb->xval) return  1;
+  else if (ga->xval < gb->xval) return -1;
+
+  return 0;
+}
+
+int _compare_u64(const void *a, const void *b) {
+
+  uint64_t ua;
+  uint64_t ub;
+
+  ua = *(const uint64_t *)a;
+  ub = *(const uint64_t *)b;
+
+  if (ua < ub) return -1;
+  if (ua > ub) return  1;
+  return 0;
+}
+
+int _compare_refs(const void *a, const void *b) {
+
+  const avg_ref_t *ra;
+  const avg_ref_t *rb;
+
+  ra = a;
+  rb = b;
+
+  if (ra->u     < rb->u)     return -1;
+  if (ra->u     > rb->u)     return  1;
+  if (ra->v     < rb->v)     return -1;
+  if (ra->v     > rb->v)     return  1;
+  if (ra->input < rb->input) return -1;
+  if (ra->input > rb->input) return  1;
+  return 0;
+}
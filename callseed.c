@@ -1,7 +1,18 @@
 /**
  * Extract the 'components' from a graph, by iteratively extracting
  * a 'seeded subgraph', with the maximum degree node as the seed.
- * 
+ *
+ * Subgraphs are extracted from the input graph, rather than from a copy
+ * of the remainder which is rebuilt for every subgraph. The nodes which
+ * remain are kept in a degree bucket queue (see graph/degree_queue.h),
+ * which gives the maximum degree node, and their degrees are decremented
+ * as the neighbouring nodes are removed. Seeds are expanded with a
+ * breadth first search, using a single workspace from which every
+ * extracted node is excluded (see bfs_ws_exclude, in graph/bfs.h), and
+ * each subgraph is written out as a view of the input graph (see
+ * graph/graph_view.h), so the cost of extracting a subgraph is
+ * proportional to its size, rather than to the size of the graph.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com> 
  */
 #include <stdio.h>
@@ -10,8 +21,11 @@
 #include <stdint.h>
 #include <argp.h>
 
+#include "graph/bfs.h"
 #include "graph/graph.h"
-#include "graph/graph_seed.h"
+#include "graph/graph_mask.h"
+#include "graph/graph_view.h"
+#include "graph/degree_queue.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 #include "io/analyze75.h"
@@ -56,21 +70,100 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * \return the node in the queue with the maximum degree, the lowest ID
+ * being chosen out of tied nodes.
+ */
 static uint32_t _get_seed_node(
-  graph_t *g
+  degree_queue_t *q /**< queue of the nodes which remain */
+);
+
+/**
+ * Context passed to the _seed_level function.
+ */
+typedef struct _seed_ctx {
+
+  uint32_t  depth;  /**< search depth                     */
+  uint32_t *nodes;  /**< place to store the nodes reached */
+  uint32_t  nnodes; /**< number of nodes reached          */
+
+} seed_ctx_t;
+
+/**
+ * Breadth first searches out from the seed node, to the given depth,
+ * through the nodes which have not been excluded from the workspace.
+ *
+ * \return the number of nodes reached, including the seed, which are
+ * stored in the nodes array, or 0 on failure.
+ */
+static uint32_t _seed(
+  bfs_ws_t *ws,    /**< search workspace                  */
+  graph_t  *g,     /**< the input graph                   */
+  uint32_t  seed,  /**< the seed node                     */
+  uint8_t   depth, /**< search depth                      */
+  uint32_t *nodes  /**< place to store the nodes reached  */
+);
+
+/**
+ * BFS callback function used by _seed. Adds the nodes in the current
+ * level to the list of nodes reached, and ends the search once the
+ * maximum depth has been reached.
+ */
+static uint8_t _seed_level(
+  bfs_state_t *state, /**< search state                 */
+  void        *ctx    /**< pointer to a seed_ctx_t struct */
+);
+
+/**
+ * Writes each of the extracted subgraphs to a file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_subgraphs(
+  graph_t  *g,       /**< the input graph                           */
+  uint32_t *cmps,    /**< subgraph of each node, or GRAPH_VIEW_NONE */
+  uint32_t  ncmps,   /**< number of subgraphs                       */
+  char     *outpref  /**< output file prefix                        */
+);
+
+/**
+ * Creates lists of the nodes which have an edge to each node - the
+ * neighbours of each node, for an undirected graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _predecessors(
+  graph_t   *g,    /**< the graph                                   */
+  uint32_t **offs, /**< place to store the start of the list of each
+                        node, with an extra entry for the end       */
+  uint32_t **pred  /**< place to store the lists                    */
 );
 
 int main (int argc, char *argv[]) {
 
-  uint64_t    i;
-  uint32_t    seed;
-  graph_t     gin;
-  graph_t     grem;
-  graph_t     gout;
-  struct argp argp = {opts, _parse_opt, "INPUT OUTPREF", doc};
-  args_t      args;
-  char        fname[1024];
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        k;
+  uint32_t        u;
+  uint32_t        seed;
+  uint32_t        nnodes;
+  uint32_t        nseeded;
+  uint32_t       *nodes;
+  uint32_t       *cmps;
+  uint32_t       *offs;
+  uint32_t       *pred;
+  graph_t         gin;
+  bfs_ws_t        ws;
+  degree_queue_t  q;
+  struct argp     argp = {opts, _parse_opt, "INPUT OUTPREF", doc};
+  args_t          args;
 
+  nodes = NULL;
+  cmps  = NULL;
+  offs  = NULL;
+  pred  = NULL;
+  memset(&q,    0, sizeof(degree_queue_t));
+  memset(&ws,   0, sizeof(bfs_ws_t));
   memset(&args, 0, sizeof(args_t));
   args.depth   = 1;
   args.maxcmps = 10;
@@ -82,60 +175,260 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
 
+  nnodes = graph_num_nodes(&gin);
+  nodes  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  cmps   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (nodes == NULL || cmps == NULL || bfs_ws_init(&ws, nnodes)) {
+    printf("Out of memory\n");
+    goto fail;
+  }
+
+  for (i = 0; i < nnodes; i++) cmps[i] = GRAPH_VIEW_NONE;
+
+  if (_predecessors(&gin, &offs, &pred) || degree_queue_init(&q, &gin)) {
+    printf("Error creating degree queue\n");
+    goto fail;
+  }
+
   for (i = 0; i < args.maxcmps; i++) {
 
-    if (graph_num_nodes(&gin) == 0)
+    if (degree_queue_size(&q) == 0)
       break;
 
-    seed = _get_seed_node(&gin);
+    seed    = _get_seed_node(&q);
+    nseeded = _seed(&ws, &gin, seed, args.depth, nodes);
 
-    if (graph_seed(&gin,&gout, &seed, 1, args.depth, &grem)) {
+    if (nseeded == 0) {
       printf("Error creating seed subgraph\n");
       goto fail;
     }
 
-    sprintf(fname, "%s_%02u.ngdb", args.outpref, (uint32_t)i);
+    /*
+     * the seeded nodes are all removed before any
+     * degrees are decremented, so that only the
+     * nodes which remain are decremented
+     */
+    for (j = 0; j < nseeded; j++) {
+
+      cmps[nodes[j]] = i;
+      degree_queue_remove(&q,  nodes[j]);
+      bfs_ws_exclude(     &ws, nodes[j]);
+    }
+
+    for (j = 0; j < nseeded; j++) {
+
+      for (k = offs[nodes[j]]; k < offs[nodes[j]+1]; k++) {
+
+        u = pred[k];
+        if (degree_queue_contains(&q, u)) degree_queue_decrement(&q, u);
+      }
+    }
+  }
+
+  if (i > 0 && _write_subgraphs(&gin, cmps, i, args.outpref)) goto fail;
+
+  degree_queue_free(&q);
+  bfs_ws_free(&ws);
+  graph_free(&gin);
+  free(nodes);
+  free(cmps);
+  free(offs);
+  free(pred);
+
+  return 0;
+  
+fail:
+  return 1;
+}
+
+uint32_t _get_seed_node(degree_queue_t *q) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  seed;
+  uint32_t *nodes;
+
+  nnodes = degree_queue_nodes(q, degree_queue_max_degree(q), &nodes);
+  seed   = nodes[0];
+
+  for (i = 1; i < nnodes; i++) {
+    if (nodes[i] < seed) seed = nodes[i];
+  }
+
+  return seed;
+}
+
+uint32_t _seed(
+  bfs_ws_t *ws,
+  graph_t  *g,
+  uint32_t  seed,
+  uint8_t   depth,
+  uint32_t *nodes) {
+
+  seed_ctx_t ctx;
+
+  /*as with graph_seed, at least one level is searched*/
+  if (depth == 0) depth = 1;
+
+  nodes[0]   = seed;
+  ctx.depth  = depth;
+  ctx.nodes  = nodes;
+  ctx.nnodes = 1;
+
+  if (bfs_ws_search(
+        ws, g, &seed, 1, NULL, &ctx, NULL, _seed_level, NULL))
+    return 0;
+
+  return ctx.nnodes;
+}
+
+uint8_t _seed_level(bfs_state_t *state, void *ctx) {
+
+  seed_ctx_t *sctx;
+
+  sctx = ctx;
+
+  memcpy(sctx->nodes + sctx->nnodes,
+         state->thislevel.data,
+         state->thislevel.size * sizeof(uint32_t));
+
+  sctx->nnodes += state->thislevel.size;
+
+  return state->depth >= sctx->depth;
+}
+
+uint8_t _write_subgraphs(
+  graph_t  *g,
+  uint32_t *cmps,
+  uint32_t  ncmps,
+  char     *outpref) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint32_t      nnodes;
+  uint8_t      *mask;
+  graph_view_t *views;
+  graph_t       gout;
+  char          fname[1024];
+
+  mask   = NULL;
+  views  = NULL;
+  nnodes = graph_num_nodes(g);
+
+  /*
+   * views can only be created on undirected
+   * graphs - subgraphs of a directed graph
+   * are copied out with graph_mask instead
+   */
+  if (graph_is_directed(g)) {
+    mask = calloc((uint64_t)nnodes + 1, sizeof(uint8_t));
+    if (mask == NULL) goto fail;
+  }
+  else {
+    views = calloc(ncmps, sizeof(graph_view_t));
+    if (views == NULL) goto fail;
+
+    if (graph_view_partition(views, g, cmps, ncmps)) {
+      free(views);
+      views = NULL;
+      goto fail;
+    }
+  }
+
+  for (i = 0; i < ncmps; i++) {
+
+    sprintf(fname, "%s_%02u.ngdb", outpref, (uint32_t)i);
+
+    if (views != NULL) {
+
+      printf("Seeded subgraph %u (%u nodes): %s\n",
+             (uint32_t)i, graph_view_num_nodes(views + i), fname);
+
+      if (ngdb_write_view(views + i, fname)) {
+        printf("Could not write to %s\n", fname);
+        goto fail;
+      }
+      continue;
+    }
+
+    for (j = 0; j < nnodes; j++) mask[j] = cmps[j] == i;
+
+    if (graph_mask(g, &gout, mask)) {
+      printf("Error creating seed subgraph\n");
+      goto fail;
+    }
 
     printf("Seeded subgraph %u (%u nodes): %s\n",
            (uint32_t)i, graph_num_nodes(&gout), fname);
 
     if (ngdb_write(&gout, fname)) {
       printf("Could not write to %s\n", fname);
+      graph_free(&gout);
       goto fail;
     }
 
-    graph_free(&gin);
     graph_free(&gout);
-    memcpy(&gin, &grem, sizeof(graph_t));
   }
 
+  if (views != NULL) graph_view_partition_free(views, ncmps);
+  if (views != NULL) free(views);
+  if (mask  != NULL) free(mask);
+
   return 0;
-  
+
 fail:
+  if (views != NULL) graph_view_partition_free(views, ncmps);
+  if (views != NULL) free(views);
+  if (mask  != NULL) free(mask);
   return 1;
 }
 
-uint32_t _get_seed_node(graph_t *g) {
+uint8_t _predecessors(graph_t *g, uint32_t **offs, uint32_t **pred) {
 
-  uint64_t       i;
-  uint32_t       nnodes;
-  uint32_t       thisdeg;
-  uint32_t       maxdeg;
-  uint32_t       maxdegi;
+  uint64_t  i;
+  uint32_t  u;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t *o;
+  uint32_t *p;
 
-  nnodes  = graph_num_nodes(g);
-  thisdeg = 0;
-  maxdeg  = 0;
-  maxdegi = 0;
-  
-  for (i = 0; i < nnodes; i++) {
-     
-    thisdeg = graph_num_neighbours(g, i);
-    if (thisdeg > maxdeg) {
-      maxdeg  = thisdeg;
-      maxdegi = i;
-    }
+  o      = NULL;
+  p      = NULL;
+  nnodes = graph_num_nodes(g);
+
+  o = calloc((uint64_t)nnodes + 2, sizeof(uint32_t));
+  if (o == NULL) goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(g, u);
+    nbrs  = graph_get_neighbours(g, u);
+
+    for (i = 0; i < nnbrs; i++) o[nbrs[i] + 2]++;
   }
 
-  return maxdegi;
+  /*o[v+1] is where the list for node v is filled from*/
+  for (u = 0; u < nnodes; u++) o[u + 2] += o[u + 1];
+
+  p = malloc(((uint64_t)o[nnodes + 1] + 1) * sizeof(uint32_t));
+  if (p == NULL) goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(g, u);
+    nbrs  = graph_get_neighbours(g, u);
+
+    for (i = 0; i < nnbrs; i++) p[o[nbrs[i] + 1]++] = u;
+  }
+
+  *offs = o;
+  *pred = p;
+  return 0;
+
+fail:
+  if (o != NULL) free(o);
+  if (p != NULL) free(p);
+  return 1;
 }
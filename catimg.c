@@ -8,14 +8,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <float.h>
+#include <sys/stat.h>
 
 #include "io/analyze75.h"
 #include "util/startup.h"
 #include "util/suffix.h"
-#include "util/filesize.h"
+#include "util/copyfile.h"
+#include "util/ioqueue.h"
+
+/**
+ * Context for the ioqueue_run functions - _load_hdr, _open_input and
+ * _copy_input.
+ */
+typedef struct _cat_ctx {
+
+  char    **inputs;  /**< names of input files                    */
+  dsr_t    *hdrs;    /**< place to store input headers            */
+  uint8_t  *failed;  /**< set for each input whose header failed  */
+  FILE     *outf;    /**< output image file                       */
+  FILE    **infs;    /**< input image files                       */
+  uint64_t *sizes;   /**< input image file sizes                  */
+  uint64_t *offsets; /**< offset of each input in the output file */
+
+} cat_ctx_t;
 
 /**
  * Creates a new file which is the concatenation of the given input files.
+ * The data is copied with copyfile_range, so it never passes through this
+ * program (and, on a copy-on-write filesystem, may not be copied at all).
+ * The inputs are opened, and then copied into place, several at a time
+ * (see util/ioqueue.h).
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -25,6 +47,37 @@ static uint8_t _concat(
   uint16_t  ninputs /**< number of input files */
 );
 
+/**
+ * Loads the header of one input file, flagging it in ctx->failed if it
+ * can't be loaded, so that every header is tried.
+ *
+ * \return 0.
+ */
+static uint8_t _load_hdr(
+  uint64_t i,  /**< input index            */
+  void    *ctx /**< pointer to a cat_ctx_t */
+);
+
+/**
+ * Opens the image file of one input, and stores its size.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _open_input(
+  uint64_t i,  /**< input index            */
+  void    *ctx /**< pointer to a cat_ctx_t */
+);
+
+/**
+ * Copies the image file of one input into place in the output file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _copy_input(
+  uint64_t i,  /**< input index            */
+  void    *ctx /**< pointer to a cat_ctx_t */
+);
+
 /**
  * Creates a header for the new concatenated image.
  */
@@ -41,11 +94,14 @@ int main (int argc, char *argv[]) {
   char    **inputs;
   dsr_t     newhdr;
   dsr_t    *hdrs;
+  uint8_t  *failed;
   uint16_t  i;
   uint16_t  ninputs;
   float     dimsz;
+  cat_ctx_t ctx;
 
-  hdrs = NULL;
+  hdrs   = NULL;
+  failed = NULL;
 
   startup("catimg", argc, argv, NULL, NULL);
 
@@ -59,11 +115,18 @@ int main (int argc, char *argv[]) {
   dimsz   = atof(argv[2]);
   inputs  = argv+3;
 
-  hdrs = malloc(ninputs*sizeof(dsr_t));
-  if (hdrs == NULL) goto fail;
+  hdrs   = malloc(ninputs*sizeof(dsr_t));
+  failed = calloc(ninputs, 1);
+  if (hdrs == NULL || failed == NULL) goto fail;
+
+  ctx.inputs = inputs;
+  ctx.hdrs   = hdrs;
+  ctx.failed = failed;
+
+  if (ioqueue_run(ninputs, 0, &ctx, _load_hdr)) goto fail;
 
   for (i = 0; i < ninputs; i++) {
-    if (analyze_load_hdr(inputs[i], hdrs+i)) {
+    if (failed[i]) {
       printf("Couldn't load image %s\n", inputs[i]);
       goto fail;
     }
@@ -87,26 +150,24 @@ int main (int argc, char *argv[]) {
   }
   
   free(hdrs);
+  free(failed);
   return 0;
 
 fail:
   printf("Cat failed\n");
-  if (hdrs != NULL) free(hdrs);
+  if (hdrs   != NULL) free(hdrs);
+  if (failed != NULL) free(failed);
   return 1;
 }
 
 uint8_t _concat(char *filename, char **inputs, uint16_t ninputs) {
 
-  uint16_t i;
-  int      size;
-  uint8_t *buf;
-  FILE    *outf;
-  FILE    *inf;
-  char    *infname;
+  uint16_t  i;
+  FILE     *outf;
+  cat_ctx_t ctx;
 
-  buf       = NULL;
-  outf      = NULL;
-  inf       = NULL;
+  outf = NULL;
+  memset(&ctx, 0, sizeof(ctx));
 
   filename = set_suffix(filename, "img");
   if (filename == NULL) goto fail;
@@ -114,41 +175,95 @@ uint8_t _concat(char *filename, char **inputs, uint16_t ninputs) {
   outf = fopen(filename, "wb");
   if (outf == NULL) goto fail;
 
-  for (i = 0; i < ninputs; i++, inf = NULL, buf = NULL) {
+  ctx.inputs  = inputs;
+  ctx.outf    = outf;
+  ctx.infs    = calloc(ninputs, sizeof(FILE *));
+  ctx.sizes   = calloc(ninputs, sizeof(uint64_t));
+  ctx.offsets = calloc(ninputs, sizeof(uint64_t));
 
-    infname = set_suffix(inputs[i], "img");
-    if (infname == NULL) goto fail;
-
-    inf = fopen(infname, "rb");
-    if (inf == NULL) goto fail;
+  if (ctx.infs == NULL || ctx.sizes == NULL || ctx.offsets == NULL)
+    goto fail;
 
-    size = filesize(inf);
-    buf  = malloc(size);
+  if (ioqueue_run(ninputs, 0, &ctx, _open_input)) goto fail;
 
-    if (buf == NULL) goto fail;
+  /*each input is copied into place at the end of the previous one*/
+  for (i = 1; i < ninputs; i++)
+    ctx.offsets[i] = ctx.offsets[i-1] + ctx.sizes[i-1];
 
-    if (fread( buf, 1, size, inf)  != size) goto fail;
-    if (fwrite(buf, 1, size, outf) != size) goto fail;
+  if (ioqueue_run(ninputs, 0, &ctx, _copy_input)) goto fail;
 
-    fclose(inf);
-    free(buf);
-    free(infname);
-    infname = NULL;
-    inf     = NULL;
-  }
+  for (i = 0; i < ninputs; i++) fclose(ctx.infs[i]);
+  free(ctx.infs);
+  free(ctx.sizes);
+  free(ctx.offsets);
  
-  fclose(outf);
+  if (fclose(outf)) {
+    outf = NULL;
+    goto fail;
+  }
   free(filename);
   return 0;
 
  fail:
-  if (outf     != NULL) fclose(outf);
-  if (inf      != NULL) fclose(inf);
-  if (filename != NULL) free(filename);
-  if (buf      != NULL) free(buf);
+  if (ctx.infs != NULL) {
+    for (i = 0; i < ninputs; i++) {
+      if (ctx.infs[i] != NULL) fclose(ctx.infs[i]);
+    }
+    free(ctx.infs);
+  }
+  if (ctx.sizes   != NULL) free(ctx.sizes);
+  if (ctx.offsets != NULL) free(ctx.offsets);
+  if (outf        != NULL) fclose(outf);
+  if (filename    != NULL) free(filename);
+  return 1;
+}
+
+uint8_t _load_hdr(uint64_t i, void *vctx) {
+
+  cat_ctx_t *ctx;
+
+  ctx = vctx;
+
+  if (analyze_load_hdr(ctx->inputs[i], ctx->hdrs+i)) ctx->failed[i] = 1;
+
+  return 0;
+}
+
+uint8_t _open_input(uint64_t i, void *vctx) {
+
+  char       *infname;
+  struct stat st;
+  cat_ctx_t  *ctx;
+
+  ctx     = vctx;
+  infname = set_suffix(ctx->inputs[i], "img");
+  if (infname == NULL) goto fail;
+
+  ctx->infs[i] = fopen(infname, "rb");
+  if (ctx->infs[i] == NULL) goto fail;
+
+  if (fstat(fileno(ctx->infs[i]), &st)) goto fail;
+
+  ctx->sizes[i] = st.st_size;
+
+  free(infname);
+  return 0;
+
+fail:
+  if (infname != NULL) free(infname);
   return 1;
 }
 
+uint8_t _copy_input(uint64_t i, void *vctx) {
+
+  cat_ctx_t *ctx;
+
+  ctx = vctx;
+
+  return copyfile_range(
+    ctx->infs[i], 0, ctx->outf, ctx->offsets[i], ctx->sizes[i]);
+}
+
 void _mk_hdr(dsr_t *hdr, dsr_t *input_hdrs, uint16_t ninputs, float dimsz) {
 
   uint8_t  ndims;
@@ -0,0 +1,1095 @@
+/**
+ * Benchmarks the main graph statistics, and ngdb and mat file I/O, over a
+ * set of reproducible random graphs.
+ *
+ * Graphs are generated, for every combination of the given sizes and
+ * average degrees, as clustered graphs (with one cluster per
+ * BENCH_CLUSTER_SIZE nodes, so that modularity is meaningful) and as
+ * scale free graphs. The random number generator is seeded with --seed
+ * (see util/startup.c), so the same graphs are generated on every run.
+ *
+ * Each benchmark is run --repeat times on each graph, and one tab
+ * separated line is printed for each benchmark, after a header line:
+ *
+ *   graph nodes degree edges benchmark repeats min mean value
+ *
+ * where min and mean are wall clock times in seconds, and value is the
+ * result of the benchmark (e.g. the average path length), which should
+ * not change when the code is only made faster. 'make bench' builds and
+ * runs this program with the default settings.
+ *
+ * With the --pipeline option, the pipeline benchmarks are run instead,
+ * to check that changes to file I/O translate into wall clock time on
+ * the storage being used. For every given volume size (voxels along each
+ * axis), a 4D volume is synthesised with tsgen, and is then taken through
+ * the steps of a typical analysis - opening the volume, calculating its
+ * correlation matrix with tsmat, thresholding it into a graph with
+ * tsgraph (and directly, with tsmat -g), reading the matrix and the
+ * graph, writing the graph, and averaging BENCH_PIPE_SUBJECTS copies of
+ * the graph with avgngdb. The programs are run from the --bindir
+ * directory (by default, the directory containing cbench), and their
+ * files are created in --tmpdir; the other steps are run in-process. One
+ * tab separated line is printed for each step, after a header line:
+ *
+ *   voxels tslen step repeats min mean MB/s pairs/s
+ *
+ * where MB/s is the number of bytes read or written by the step, and
+ * pairs/s the number of voxel pairs it processed (or - if it does not
+ * process pairs), per second of the minimum time. The correlation matrix
+ * needs 4 * voxels^2 bytes, so sizes much above 20 need a lot of disk.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "graph/graph.h"
+#include "graph/graph_compact.h"
+#include "util/startup.h"
+#include "util/parallel.h"
+#include "io/mat.h"
+#include "io/ngdb_graph.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "timeseries/analyze_volume.h"
+
+/**
+ * Maximum number of graph sizes, or average degrees, which may be given.
+ */
+#define BENCH_MAX_PARAMS 16
+
+/**
+ * Number of nodes per cluster in the clustered graphs.
+ */
+#define BENCH_CLUSTER_SIZE 50
+
+/**
+ * Maximum number of rows/columns in the matrix used by the mat file
+ * benchmarks, which is an nnodes * nnodes symmetric matrix.
+ */
+#define BENCH_MAT_MAX 2048
+
+/**
+ * Number of copies of the graph which are averaged by the avgngdb
+ * pipeline benchmark.
+ */
+#define BENCH_PIPE_SUBJECTS 4
+
+/**
+ * Correlation threshold used by the tsgraph pipeline benchmark. The
+ * volumes are generated with BENCH_PIPE_TEMPLATES signal templates, so
+ * about one in BENCH_PIPE_TEMPLATES voxel pairs are above it.
+ */
+#define BENCH_PIPE_THRES 0.3
+
+/**
+ * Number of signal templates in the pipeline benchmark volumes.
+ */
+#define BENCH_PIPE_TEMPLATES 8
+
+/**
+ * Maximum length of a command run by the pipeline benchmarks.
+ */
+#define BENCH_CMD_LEN 4096
+
+typedef struct _args {
+  char    *tmpdir;
+  char    *sizes;
+  char    *degrees;
+  char    *pipeline;
+  char    *bindir;
+  uint16_t tslen;
+  uint16_t repeat;
+  uint16_t nthreads;
+} args_t;
+
+static struct argp_option options[] = {
+  {"sizes",   'n', "LIST", 0, "comma-separated graph sizes "\
+                              "(default: 1000,4000)"},
+  {"degrees", 'd', "LIST", 0, "comma-separated average degrees "\
+                              "(default: 8,32)"},
+  {"repeat",  'r', "INT",  0, "number of times to run each benchmark "\
+                              "(default: 3)"},
+  {NULL,      'j', "INT",  0, "number of threads (default: --threads)"},
+  {"tmpdir",  't', "DIR",  0, "directory for the files created by the "\
+                              "I/O benchmarks (default: /tmp)"},
+  {"pipeline", 'p', "LIST", 0, "run the pipeline benchmarks, on volumes "\
+                               "with these comma-separated numbers of "\
+                               "voxels along each axis (e.g. 16,20)"},
+  {"tslen",    'l', "INT",  0, "pipeline: time series length "\
+                               "(default: 100)"},
+  {"bindir",   'b', "DIR",  0, "pipeline: directory containing the "\
+                               "programs (default: that of cbench)"},
+  {0}
+};
+
+static char doc[] = "cbench -- benchmark graph statistics and file I/O";
+
+static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
+
+  args_t *args;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'n': args->sizes    = arg;       break;
+    case 'd': args->degrees  = arg;       break;
+    case 'r': args->repeat   = atoi(arg); break;
+    case 'j': args->nthreads = atoi(arg); break;
+    case 't': args->tmpdir   = arg;       break;
+    case 'p': args->pipeline = arg;       break;
+    case 'l': args->tslen    = atoi(arg); break;
+    case 'b': args->bindir   = arg;       break;
+
+    case ARGP_KEY_ARG:
+      argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * State passed to each benchmark function.
+ */
+typedef struct _bench_ctx {
+
+  graph_t *g;     /**< the graph                            */
+  char    *ngdbf; /**< file used by the ngdb benchmarks     */
+  char    *matf;  /**< file used by the mat benchmarks      */
+  double   value; /**< place to store the benchmark result  */
+
+} bench_ctx_t;
+
+/**
+ * A benchmark. The function returns 0 on success, non-0 on failure.
+ */
+typedef struct _bench {
+
+  char    *name;                  /**< name printed in the output */
+  uint8_t (*fn)(bench_ctx_t *ctx); /**< benchmark function         */
+
+} bench_t;
+
+static uint8_t _bench_pathlength( bench_ctx_t *ctx);
+static uint8_t _bench_efficiency( bench_ctx_t *ctx);
+static uint8_t _bench_clustering( bench_ctx_t *ctx);
+static uint8_t _bench_betweenness(bench_ctx_t *ctx);
+static uint8_t _bench_modularity( bench_ctx_t *ctx);
+static uint8_t _bench_components( bench_ctx_t *ctx);
+static uint8_t _bench_compact(    bench_ctx_t *ctx);
+static uint8_t _bench_ngdb_write( bench_ctx_t *ctx);
+static uint8_t _bench_ngdb_read(  bench_ctx_t *ctx);
+static uint8_t _bench_mat_write(  bench_ctx_t *ctx);
+static uint8_t _bench_mat_read(   bench_ctx_t *ctx);
+
+/**
+ * Benchmarks, in the order in which they are run. ngdb_read and mat_read
+ * read the files created by ngdb_write and mat_write. compact calculates
+ * the average path length over a compact copy of the graph (see
+ * graph/graph_compact.h), and should give the same value as pathlength.
+ */
+static bench_t _benches[] = {
+  {"pathlength",  _bench_pathlength},
+  {"efficiency",  _bench_efficiency},
+  {"clustering",  _bench_clustering},
+  {"betweenness", _bench_betweenness},
+  {"modularity",  _bench_modularity},
+  {"components",  _bench_components},
+  {"compact",     _bench_compact},
+  {"ngdb_write",  _bench_ngdb_write},
+  {"ngdb_read",   _bench_ngdb_read},
+  {"mat_write",   _bench_mat_write},
+  {"mat_read",    _bench_mat_read},
+  {NULL,          NULL}
+};
+
+/**
+ * State passed to each pipeline benchmark function.
+ */
+typedef struct _pipe_ctx {
+
+  args_t  *args;    /**< program arguments                          */
+  uint32_t nvoxels; /**< number of voxels in the volume             */
+  uint32_t side;    /**< number of voxels along each axis           */
+  char    *voldir;  /**< directory containing the volume            */
+  char    *matf;    /**< matrix file created by tsmat               */
+  char    *ngdbf;   /**< graph file created by tsgraph              */
+  char    *outf;    /**< file written by the other steps            */
+  graph_t  g;       /**< graph read by ngdb_read                    */
+  uint8_t  hasg;    /**< non-0 if g has been read                   */
+  uint64_t bytes;   /**< place to store the bytes read or written   */
+  uint64_t pairs;   /**< place to store the voxel pairs processed   */
+
+} pipe_ctx_t;
+
+/**
+ * A pipeline benchmark. The function returns 0 on success, non-0 on
+ * failure.
+ */
+typedef struct _pipe_bench {
+
+  char    *name;                  /**< name printed in the output */
+  uint8_t (*fn)(pipe_ctx_t *ctx); /**< benchmark function         */
+
+} pipe_bench_t;
+
+static uint8_t _pipe_tsgen(      pipe_ctx_t *ctx);
+static uint8_t _pipe_open_volume(pipe_ctx_t *ctx);
+static uint8_t _pipe_tsmat(      pipe_ctx_t *ctx);
+static uint8_t _pipe_tsgraph(    pipe_ctx_t *ctx);
+static uint8_t _pipe_tsmat_graph(pipe_ctx_t *ctx);
+static uint8_t _pipe_mat_read(   pipe_ctx_t *ctx);
+static uint8_t _pipe_ngdb_read(  pipe_ctx_t *ctx);
+static uint8_t _pipe_ngdb_write( pipe_ctx_t *ctx);
+static uint8_t _pipe_avgngdb(    pipe_ctx_t *ctx);
+
+/**
+ * Pipeline benchmarks, in the order in which they are run - each step
+ * uses the files created by the steps before it.
+ */
+static pipe_bench_t _pipe_benches[] = {
+  {"tsgen",       _pipe_tsgen},
+  {"open_volume", _pipe_open_volume},
+  {"tsmat",       _pipe_tsmat},
+  {"tsgraph",     _pipe_tsgraph},
+  {"tsmat_graph", _pipe_tsmat_graph},
+  {"mat_read",    _pipe_mat_read},
+  {"ngdb_read",   _pipe_ngdb_read},
+  {"ngdb_write",  _pipe_ngdb_write},
+  {"avgngdb",     _pipe_avgngdb},
+  {NULL,          NULL}
+};
+
+/**
+ * Runs every pipeline benchmark on a volume of each of the given sizes,
+ * and prints the results.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _run_pipeline(
+  args_t *args /**< program arguments */
+);
+
+/**
+ * Runs the given program from the --bindir directory, with the given
+ * printf-style arguments, discarding its standard output.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _pipe_exec(
+  pipe_ctx_t *ctx,  /**< benchmark state          */
+  char       *prog, /**< program name             */
+  char       *fmt,  /**< format of the arguments  */
+  ...
+);
+
+/**
+ * \return the size of the given file, or 0 if it does not exist.
+ */
+static uint64_t _file_size(
+  char *path /**< file name */
+);
+
+/**
+ * Removes the given volume directory, and every file in it.
+ */
+static void _remove_dir(
+  char *path /**< directory name */
+);
+
+/**
+ * Parses a comma-separated list of positive integers.
+ *
+ * \return the number of values, or 0 on failure.
+ */
+static uint32_t _parse_list(
+  char     *list,  /**< comma-separated list           */
+  uint32_t *vals   /**< space for BENCH_MAX_PARAMS values */
+);
+
+/**
+ * \return the current time, in seconds, from a monotonic clock.
+ */
+static double _now(void);
+
+/**
+ * Generates the given type of benchmark graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _generate(
+  graph_t *g,         /**< uninitialised graph       */
+  char    *type,      /**< "clustered" or "scalefree" */
+  uint32_t nnodes,    /**< number of nodes           */
+  uint32_t degree     /**< average degree            */
+);
+
+/**
+ * Runs every benchmark on the given graph, and prints the results.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _run(
+  args_t      *args,   /**< program arguments      */
+  bench_ctx_t *ctx,    /**< benchmark state        */
+  char        *type,   /**< graph type             */
+  uint32_t     degree  /**< requested degree       */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint64_t    k;
+  uint32_t    nsizes;
+  uint32_t    ndegrees;
+  uint32_t    sizes  [BENCH_MAX_PARAMS];
+  uint32_t    degrees[BENCH_MAX_PARAMS];
+  graph_t     g;
+  bench_ctx_t ctx;
+  args_t      args;
+  struct argp argp = {options, _parse_opt, "", doc};
+  char       *types[] = {"clustered", "scalefree"};
+
+  memset(&args, 0, sizeof(args_t));
+  memset(&ctx,  0, sizeof(bench_ctx_t));
+
+  args.sizes   = "1000,4000";
+  args.degrees = "8,32";
+  args.tmpdir  = "/tmp";
+  args.repeat  = 3;
+  args.tslen   = 100;
+
+  startup("cbench", argc, argv, &argp, &args);
+
+  if (args.repeat == 0) args.repeat = 1;
+  if (args.tslen  <  2) args.tslen  = 2;
+
+  parallel_set_threads(args.nthreads);
+
+  if (args.pipeline != NULL) {
+
+    if (args.bindir == NULL) {
+
+      args.bindir = malloc(strlen(argv[0]) + 2);
+      if (args.bindir == NULL) goto fail;
+
+      strcpy(args.bindir, argv[0]);
+
+      if (strrchr(args.bindir, '/') != NULL) *strrchr(args.bindir, '/') = 0;
+      else                                   strcpy(args.bindir, ".");
+    }
+
+    return _run_pipeline(&args);
+  }
+
+  nsizes   = _parse_list(args.sizes,   sizes);
+  ndegrees = _parse_list(args.degrees, degrees);
+
+  if (nsizes == 0 || ndegrees == 0) {
+    printf("invalid --sizes or --degrees\n");
+    goto fail;
+  }
+
+  ctx.ngdbf = malloc(strlen(args.tmpdir) + 32);
+  ctx.matf  = malloc(strlen(args.tmpdir) + 32);
+  if (ctx.ngdbf == NULL) goto fail;
+  if (ctx.matf  == NULL) goto fail;
+
+  sprintf(ctx.ngdbf, "%s/cbench_%d.ngdb", args.tmpdir, (int)getpid());
+  sprintf(ctx.matf,  "%s/cbench_%d.mat",  args.tmpdir, (int)getpid());
+
+  printf("graph\tnodes\tdegree\tedges\tbenchmark\t"\
+         "repeats\tmin\tmean\tvalue\n");
+
+  for (i = 0; i < sizeof(types) / sizeof(char *); i++) {
+    for (j = 0; j < nsizes; j++) {
+      for (k = 0; k < ndegrees; k++) {
+
+        if (_generate(&g, types[i], sizes[j], degrees[k])) {
+          printf("error generating %s graph (%u nodes, degree %u)\n",
+                 types[i], sizes[j], degrees[k]);
+          goto fail;
+        }
+
+        ctx.g = &g;
+        if (_run(&args, &ctx, types[i], degrees[k])) {
+          graph_free(&g);
+          goto fail;
+        }
+
+        graph_free(&g);
+      }
+    }
+  }
+
+  remove(ctx.ngdbf);
+  remove(ctx.matf);
+  free(ctx.ngdbf);
+  free(ctx.matf);
+
+  return 0;
+
+fail:
+  if (ctx.ngdbf != NULL) { remove(ctx.ngdbf); free(ctx.ngdbf); }
+  if (ctx.matf  != NULL) { remove(ctx.matf);  free(ctx.matf);  }
+  return 1;
+}
+
+uint32_t _parse_list(char *list, uint32_t *vals) {
+
+  uint32_t n;
+  char    *copy;
+  char    *tkn;
+
+  n    = 0;
+  copy = malloc(strlen(list) + 1);
+  if (copy == NULL) goto fail;
+  strcpy(copy, list);
+
+  tkn = strtok(copy, ",");
+
+  while (tkn != NULL) {
+
+    if (n == BENCH_MAX_PARAMS) goto fail;
+
+    vals[n] = atoi(tkn);
+    if (vals[n] == 0) goto fail;
+
+    n++;
+    tkn = strtok(NULL, ",");
+  }
+
+  free(copy);
+  return n;
+
+fail:
+  if (copy != NULL) free(copy);
+  return 0;
+}
+
+double _now(void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+uint8_t _generate(graph_t *g, char *type, uint32_t nnodes, uint32_t degree) {
+
+  uint32_t nclusters;
+  uint16_t m;
+
+  if (!strcmp(type, "clustered")) {
+
+    nclusters = nnodes / BENCH_CLUSTER_SIZE;
+    if (nclusters == 0) nclusters = 1;
+
+    /*four fifths of each node's edges are within its cluster*/
+    if (graph_create_clustered_by_degree(
+          g, nnodes, nclusters, 0.8 * degree, 0.2 * degree, 0))
+      goto fail;
+  }
+  else {
+
+    m = degree / 2;
+    if (m == 0) m = 1;
+
+    if (graph_create_scalefree(g, nnodes, m, m + 1)) goto fail;
+  }
+
+  /*as in cnet, statistics are calculated over frozen graphs*/
+  if (graph_freeze(g)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _run(args_t *args, bench_ctx_t *ctx, char *type, uint32_t degree) {
+
+  uint64_t i;
+  uint64_t j;
+  double   start;
+  double   elapsed;
+  double   min;
+  double   total;
+
+  for (i = 0; _benches[i].name != NULL; i++) {
+
+    min   = 0;
+    total = 0;
+
+    for (j = 0; j < args->repeat; j++) {
+
+      ctx->value = 0;
+
+      start = _now();
+      if (_benches[i].fn(ctx)) {
+        printf("error running %s benchmark\n", _benches[i].name);
+        goto fail;
+      }
+      elapsed = _now() - start;
+
+      if (j == 0 || elapsed < min) min = elapsed;
+      total += elapsed;
+    }
+
+    printf("%s\t%u\t%u\t%u\t%s\t%u\t%0.6f\t%0.6f\t%f\n",
+           type,
+           graph_num_nodes(ctx->g),
+           degree,
+           graph_num_edges(ctx->g),
+           _benches[i].name,
+           args->repeat,
+           min,
+           total / args->repeat,
+           ctx->value);
+    fflush(stdout);
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _bench_pathlength(bench_ctx_t *ctx) {
+
+  ctx->value = stats_avg_pathlength(ctx->g);
+  return 0;
+}
+
+uint8_t _bench_efficiency(bench_ctx_t *ctx) {
+
+  ctx->value = stats_global_efficiency(ctx->g);
+  return 0;
+}
+
+uint8_t _bench_clustering(bench_ctx_t *ctx) {
+
+  ctx->value = stats_avg_clustering(ctx->g);
+  return 0;
+}
+
+uint8_t _bench_betweenness(bench_ctx_t *ctx) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  double  *nodebetw;
+
+  nnodes   = graph_num_nodes(ctx->g);
+  nodebetw = calloc(nnodes, sizeof(double));
+  if (nodebetw == NULL) goto fail;
+
+  if (stats_brandes(ctx->g, NULL, 0, 0, nodebetw, NULL)) goto fail;
+
+  for (i = 0; i < nnodes; i++) ctx->value += nodebetw[i];
+  ctx->value /= nnodes;
+
+  free(nodebetw);
+  return 0;
+
+fail:
+  if (nodebetw != NULL) free(nodebetw);
+  return 1;
+}
+
+uint8_t _bench_modularity(bench_ctx_t *ctx) {
+
+  ctx->value = stats_cache_modularity(ctx->g);
+  return 0;
+}
+
+uint8_t _bench_components(bench_ctx_t *ctx) {
+
+  ctx->value = stats_num_components(ctx->g, 1, NULL, NULL);
+  return 0;
+}
+
+uint8_t _bench_compact(bench_ctx_t *ctx) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nnodes;
+  uint32_t        count;
+  uint32_t       *dists;
+  uint32_t       *queue;
+  double          tally;
+  graph_compact_t c;
+
+  dists  = NULL;
+  queue  = NULL;
+  nnodes = graph_num_nodes(ctx->g);
+
+  memset(&c, 0, sizeof(graph_compact_t));
+
+  dists = malloc(nnodes * sizeof(uint32_t));
+  queue = malloc(nnodes * sizeof(uint32_t));
+  if (dists == NULL) goto fail;
+  if (queue == NULL) goto fail;
+
+  if (graph_compact_create(ctx->g, &c, 8)) goto fail;
+
+  /*the value is the average path length, as for _bench_pathlength*/
+  for (i = 0; i < nnodes; i++) {
+
+    if (graph_compact_bfs(&c, i, dists, queue)) goto fail;
+
+    for (j = 0, tally = 0, count = 0; j < nnodes; j++) {
+
+      if (j == i || dists[j] == GRAPH_COMPACT_NO_PATH) continue;
+
+      tally += dists[j];
+      count ++;
+    }
+
+    if (count > 0) ctx->value += tally / count;
+  }
+
+  ctx->value /= nnodes;
+
+  graph_compact_free(&c);
+  free(dists);
+  free(queue);
+  return 0;
+
+fail:
+  graph_compact_free(&c);
+  if (dists != NULL) free(dists);
+  if (queue != NULL) free(queue);
+  return 1;
+}
+
+uint8_t _bench_ngdb_write(bench_ctx_t *ctx) {
+
+  if (ngdb_write(ctx->g, ctx->ngdbf)) return 1;
+
+  ctx->value = graph_num_edges(ctx->g);
+  return 0;
+}
+
+uint8_t _bench_ngdb_read(bench_ctx_t *ctx) {
+
+  graph_t g;
+
+  if (ngdb_read(ctx->ngdbf, &g)) return 1;
+
+  ctx->value = graph_num_edges(&g);
+  graph_free(&g);
+  return 0;
+}
+
+uint8_t _bench_mat_write(bench_ctx_t *ctx) {
+
+  uint64_t i;
+  uint64_t j;
+  uint32_t n;
+  double  *row;
+  mat_t   *mat;
+
+  mat = NULL;
+  n   = graph_num_nodes(ctx->g);
+  if (n > BENCH_MAT_MAX) n = BENCH_MAT_MAX;
+
+  row = malloc(n * sizeof(double));
+  if (row == NULL) goto fail;
+
+  mat = mat_create(ctx->matf, n, n, (1 << MAT_IS_SYMMETRIC), 0, 0);
+  if (mat == NULL) goto fail;
+
+  for (i = 0; i < n; i++) {
+
+    for (j = 0; j <= i; j++) row[j] = ((i + j) % 100) / 100.0;
+
+    if (mat_write_row_part(mat, i, 0, i + 1, row)) goto fail;
+  }
+
+  if (mat_close(mat)) {
+    mat = NULL;
+    goto fail;
+  }
+
+  ctx->value = n;
+
+  free(row);
+  return 0;
+
+fail:
+  if (row != NULL) free(row);
+  if (mat != NULL) mat_close(mat);
+  return 1;
+}
+
+uint8_t _bench_mat_read(bench_ctx_t *ctx) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t n;
+  double  *row;
+  mat_t   *mat;
+
+  row = NULL;
+  mat = mat_open(ctx->matf);
+  if (mat == NULL) goto fail;
+
+  n   = mat_num_rows(mat);
+  row = malloc(n * sizeof(double));
+  if (row == NULL) goto fail;
+
+  for (i = 0; i < n; i++) {
+
+    if (mat_read_row(mat, i, row)) goto fail;
+
+    for (j = 0; j < n; j++) ctx->value += row[j];
+  }
+
+  mat_close(mat);
+  free(row);
+  return 0;
+
+fail:
+  if (row != NULL) free(row);
+  if (mat != NULL) mat_close(mat);
+  return 1;
+}
+
+uint8_t _run_pipeline(args_t *args) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint64_t    k;
+  uint32_t    nsides;
+  uint32_t    sides[BENCH_MAX_PARAMS];
+  double      start;
+  double      elapsed;
+  double      min;
+  double      total;
+  uint64_t    len;
+  pipe_ctx_t  ctx;
+
+  memset(&ctx, 0, sizeof(pipe_ctx_t));
+
+  ctx.args = args;
+  nsides   = _parse_list(args->pipeline, sides);
+
+  if (nsides == 0) {
+    printf("invalid --pipeline\n");
+    goto fail;
+  }
+
+  len        = strlen(args->tmpdir) + 32;
+  ctx.voldir = malloc(len);
+  ctx.matf   = malloc(len);
+  ctx.ngdbf  = malloc(len);
+  ctx.outf   = malloc(len);
+
+  if (ctx.voldir == NULL) goto fail;
+  if (ctx.matf   == NULL) goto fail;
+  if (ctx.ngdbf  == NULL) goto fail;
+  if (ctx.outf   == NULL) goto fail;
+
+  sprintf(ctx.voldir, "%s/cbench_%d_vol",   args->tmpdir, (int)getpid());
+  sprintf(ctx.matf,   "%s/cbench_%d.mat",   args->tmpdir, (int)getpid());
+  sprintf(ctx.ngdbf,  "%s/cbench_%d.ngdb",  args->tmpdir, (int)getpid());
+  sprintf(ctx.outf,   "%s/cbench_%d_out",   args->tmpdir, (int)getpid());
+
+  printf("voxels\ttslen\tstep\trepeats\tmin\tmean\tMB/s\tpairs/s\n");
+
+  for (i = 0; i < nsides; i++) {
+
+    ctx.side    = sides[i];
+    ctx.nvoxels = sides[i] * sides[i] * sides[i];
+
+    if (mkdir(ctx.voldir, 0755)) {
+      printf("error creating %s\n", ctx.voldir);
+      goto fail;
+    }
+
+    for (j = 0; _pipe_benches[j].name != NULL; j++) {
+
+      min   = 0;
+      total = 0;
+
+      for (k = 0; k < args->repeat; k++) {
+
+        ctx.bytes = 0;
+        ctx.pairs = 0;
+
+        start = _now();
+        if (_pipe_benches[j].fn(&ctx)) {
+          printf("error running %s benchmark\n", _pipe_benches[j].name);
+          goto fail;
+        }
+        elapsed = _now() - start;
+
+        if (k == 0 || elapsed < min) min = elapsed;
+        total += elapsed;
+      }
+
+      if (min <= 0) min = 1e-9;
+
+      printf("%u\t%u\t%s\t%u\t%0.6f\t%0.6f\t%0.2f\t",
+             ctx.nvoxels,
+             args->tslen,
+             _pipe_benches[j].name,
+             args->repeat,
+             min,
+             total / args->repeat,
+             ctx.bytes / min / 1e6);
+
+      if (ctx.pairs > 0) printf("%0.0f\n", ctx.pairs / min);
+      else               printf("-\n");
+      fflush(stdout);
+    }
+
+    if (ctx.hasg) graph_free(&ctx.g);
+    ctx.hasg = 0;
+
+    _remove_dir(ctx.voldir);
+    remove(ctx.matf);
+    remove(ctx.ngdbf);
+    remove(ctx.outf);
+  }
+
+  free(ctx.voldir);
+  free(ctx.matf);
+  free(ctx.ngdbf);
+  free(ctx.outf);
+
+  return 0;
+
+fail:
+  if (ctx.hasg) graph_free(&ctx.g);
+  if (ctx.voldir != NULL) { _remove_dir(ctx.voldir); free(ctx.voldir); }
+  if (ctx.matf   != NULL) { remove(ctx.matf);        free(ctx.matf);   }
+  if (ctx.ngdbf  != NULL) { remove(ctx.ngdbf);       free(ctx.ngdbf);  }
+  if (ctx.outf   != NULL) { remove(ctx.outf);        free(ctx.outf);   }
+  return 1;
+}
+
+uint8_t _pipe_exec(pipe_ctx_t *ctx, char *prog, char *fmt, ...) {
+
+  int     len;
+  int     n;
+  char    cmd[BENCH_CMD_LEN];
+  va_list ap;
+
+  len = snprintf(cmd, BENCH_CMD_LEN, "%s/%s ", ctx->args->bindir, prog);
+  if (len < 0 || len >= BENCH_CMD_LEN) goto fail;
+
+  va_start(ap, fmt);
+  n = vsnprintf(cmd + len, BENCH_CMD_LEN - len, fmt, ap);
+  va_end(ap);
+
+  if (n < 0 || len + n >= BENCH_CMD_LEN) goto fail;
+  len += n;
+
+  /*the programs use the same number of threads as cbench*/
+  if (ctx->args->nthreads > 0)
+    n = snprintf(cmd + len, BENCH_CMD_LEN - len,
+                 " --threads=%u > /dev/null", ctx->args->nthreads);
+  else
+    n = snprintf(cmd + len, BENCH_CMD_LEN - len, " > /dev/null");
+
+  if (n < 0 || len + n >= BENCH_CMD_LEN) goto fail;
+
+  if (system(cmd) != 0) {
+    printf("error running %s\n", cmd);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint64_t _file_size(char *path) {
+
+  struct stat st;
+
+  if (stat(path, &st)) return 0;
+
+  return st.st_size;
+}
+
+void _remove_dir(char *path) {
+
+  DIR           *dir;
+  struct dirent *ent;
+  char          *f;
+
+  dir = opendir(path);
+  if (dir == NULL) return;
+
+  f = malloc(strlen(path) + 258);
+
+  while (f != NULL && (ent = readdir(dir)) != NULL) {
+
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+
+    sprintf(f, "%s/%s", path, ent->d_name);
+    remove(f);
+  }
+
+  closedir(dir);
+  if (f != NULL) free(f);
+  rmdir(path);
+}
+
+uint8_t _pipe_tsgen(pipe_ctx_t *ctx) {
+
+  if (_pipe_exec(ctx, "tsgen",
+                 "-a %u -b %u -c %u -d %u -t 16 -l 0 -h 1 -k %u %s",
+                 ctx->side, ctx->side, ctx->side, ctx->args->tslen,
+                 BENCH_PIPE_TEMPLATES, ctx->voldir))
+    return 1;
+
+  /*float voxel values*/
+  ctx->bytes = (uint64_t)ctx->nvoxels * ctx->args->tslen * 4;
+  return 0;
+}
+
+uint8_t _pipe_open_volume(pipe_ctx_t *ctx) {
+
+  uint64_t         i;
+  analyze_volume_t vol;
+
+  if (analyze_open_volume(ctx->voldir, &vol)) return 1;
+
+  /*the images may be mapped, so the data is only read when cached*/
+  if (analyze_cache_volume(&vol, NULL, 0)) {
+    analyze_free_volume(&vol);
+    return 1;
+  }
+
+  for (i = 0; i < vol.nimgs; i++) {
+    ctx->bytes += (uint64_t)analyze_num_vals(vol.hdrs + i) *
+                  analyze_value_size(vol.hdrs + i);
+  }
+
+  analyze_free_volume(&vol);
+  return 0;
+}
+
+uint8_t _pipe_tsmat(pipe_ctx_t *ctx) {
+
+  if (_pipe_exec(ctx, "tsmat", "%s %s", ctx->voldir, ctx->matf)) return 1;
+
+  ctx->bytes = _file_size(ctx->matf);
+  ctx->pairs = (uint64_t)ctx->nvoxels * (ctx->nvoxels - 1) / 2;
+  return 0;
+}
+
+uint8_t _pipe_tsgraph(pipe_ctx_t *ctx) {
+
+  if (_pipe_exec(ctx, "tsgraph", "-t %f %s %s",
+                 BENCH_PIPE_THRES, ctx->matf, ctx->ngdbf))
+    return 1;
+
+  ctx->bytes = _file_size(ctx->matf) + _file_size(ctx->ngdbf);
+  ctx->pairs = (uint64_t)ctx->nvoxels * (ctx->nvoxels - 1) / 2;
+  return 0;
+}
+
+uint8_t _pipe_tsmat_graph(pipe_ctx_t *ctx) {
+
+  if (_pipe_exec(ctx, "tsmat", "-g -T %f %s %s",
+                 BENCH_PIPE_THRES, ctx->voldir, ctx->outf))
+    return 1;
+
+  ctx->bytes = _file_size(ctx->outf);
+  ctx->pairs = (uint64_t)ctx->nvoxels * (ctx->nvoxels - 1) / 2;
+  return 0;
+}
+
+uint8_t _pipe_mat_read(pipe_ctx_t *ctx) {
+
+  uint64_t i;
+  uint64_t n;
+  double  *row;
+  mat_t   *mat;
+
+  row = NULL;
+  mat = mat_open(ctx->matf);
+  if (mat == NULL) goto fail;
+
+  n   = mat_num_rows(mat);
+  row = malloc(n * sizeof(double));
+  if (row == NULL) goto fail;
+
+  for (i = 0; i < n; i++) {
+    if (mat_read_row(mat, i, row)) goto fail;
+  }
+
+  mat_close(mat);
+  free(row);
+
+  ctx->bytes = _file_size(ctx->matf);
+  ctx->pairs = n * (n - 1) / 2;
+  return 0;
+
+fail:
+  if (row != NULL) free(row);
+  if (mat != NULL) mat_close(mat);
+  return 1;
+}
+
+uint8_t _pipe_ngdb_read(pipe_ctx_t *ctx) {
+
+  if (ctx->hasg) graph_free(&ctx->g);
+  ctx->hasg = 0;
+
+  if (ngdb_read(ctx->ngdbf, &ctx->g)) return 1;
+
+  ctx->hasg  = 1;
+  ctx->bytes = _file_size(ctx->ngdbf);
+  return 0;
+}
+
+uint8_t _pipe_ngdb_write(pipe_ctx_t *ctx) {
+
+  if (!ctx->hasg)                     return 1;
+  if (ngdb_write(&ctx->g, ctx->outf)) return 1;
+
+  ctx->bytes = _file_size(ctx->outf);
+  return 0;
+}
+
+uint8_t _pipe_avgngdb(pipe_ctx_t *ctx) {
+
+  uint64_t i;
+  char     inputs[BENCH_CMD_LEN];
+  uint64_t len;
+
+  for (i = 0, len = 0; i < BENCH_PIPE_SUBJECTS; i++) {
+
+    if (len + strlen(ctx->ngdbf) + 2 > BENCH_CMD_LEN) return 1;
+
+    len += sprintf(inputs + len, " %s", ctx->ngdbf);
+  }
+
+  if (_pipe_exec(ctx, "avgngdb", "%s%s", ctx->outf, inputs)) return 1;
+
+  ctx->bytes = BENCH_PIPE_SUBJECTS * _file_size(ctx->ngdbf) +
+               _file_size(ctx->outf);
+  return 0;
+}
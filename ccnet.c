@@ -16,6 +16,7 @@
 #include "io/ngdb_graph.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "stats/stats_plan.h"
 
 static char doc[] = "ccnet -- calculate and print standard statistics "\
                     "over ngdb graph files in table format";
@@ -24,10 +25,14 @@ static struct argp_option opts[] = {
   {"global",     'g', NULL, 0, "print global statistics"},
   {"node",       'n', NULL, 0, "print node statistics"},
   {"bigstats",   'b', NULL, 0, "zero big global stats"},
-  {"pathlength", 'p', NULL, 0, "zero pathlength"},
+  {"pathlength", 'p', NULL, 0, "zero pathlength and eccentricity"},
   {"clustering", 'c', NULL, 0, "zero clustering"},
   {"efficiency", 'f', NULL, 0, "zero efficiency"},
   {"edgedist",   'e', NULL, 0, "zero edgedist"},
+  {"cache",      'k', "FILE", OPTION_ARG_OPTIONAL,
+                              "load cached statistics from FILE (default "\
+                              "INPUT.cache) if it was saved from the same "\
+                              "graph, and save them on exit"},
   {0}
 };
 
@@ -35,6 +40,8 @@ static struct argp_option opts[] = {
 typedef struct _args {
 
   char   *input;
+  char   *cachefile;
+  uint8_t cache;
   uint8_t global;
   uint8_t node;
   uint8_t bigstats;
@@ -58,6 +65,10 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'c': args->clustering = 1; break;
     case 'f': args->efficiency = 1; break;
     case 'e': args->edgedist   = 1; break;
+    case 'k':
+      args->cache     = 1;
+      args->cachefile = arg;
+      break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) args->input  = arg;
@@ -95,6 +106,7 @@ int main(int argc, char *argv[]) {
   graph_t     g;
   uint64_t    i;  
   uint32_t    nnodes;
+  uint8_t     measures;
   args_t      args;
   struct argp argp = {opts, _parse_opt, "INPUT", doc};
 
@@ -112,6 +124,33 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
+  if (args.cache && args.cachefile == NULL) {
+
+    args.cachefile = malloc(strlen(args.input) + 7);
+    if (args.cachefile == NULL) goto fail;
+    sprintf(args.cachefile, "%s.cache", args.input);
+  }
+
+  if (args.cache && stats_cache_load(&g, args.cachefile)) {
+    printf("error loading stats cache %s\n", args.cachefile);
+    goto fail;
+  }
+
+  /*
+   * The shortest path measures are calculated
+   * together, from one set of searches
+   */
+  measures = 0;
+  if (args.global && !args.bigstats)
+    measures |= STATS_PLAN_PATHLENGTH | STATS_PLAN_EFFICIENCY;
+  if (args.node && !args.pathlength)
+    measures |= STATS_PLAN_PATHLENGTH;
+
+  if (stats_plan_paths(&g, measures)) {
+    printf("error calculating path measures\n");
+    goto fail;
+  }
+
   if (args.global) _print_global_stats(&g, &args);
 
   if (args.node) {
@@ -123,6 +162,11 @@ int main(int argc, char *argv[]) {
       _print_node_stats(&g, &args, i);
   }
 
+  if (args.cache && stats_cache_save(&g, args.cachefile)) {
+    printf("error saving stats cache %s\n", args.cachefile);
+    goto fail;
+  }
+
   graph_free(&g);
   return 0;
 
@@ -133,13 +177,19 @@ fail:
 
 void _print_global_stats(graph_t *g, args_t *args) {
 
-  uint32_t nnodes;
-  double   clustering;
-  double   pathlength;
-  double   swidx;
-  double   globeff;
-  double   loceff;
-  double   assort;
+  uint32_t               nnodes;
+  double                 clustering;
+  double                 pathlength;
+  double                 swidx;
+  double                 globeff;
+  double                 loceff;
+  double                 assort;
+  stats_degree_summary_t degs;
+
+  memset(&degs, 0, sizeof(stats_degree_summary_t));
+
+  /*the degree statistics are all calculated in one sweep*/
+  stats_cache_degree_summary(g, &degs);
 
   clustering = 0;
   pathlength = 0;
@@ -153,16 +203,16 @@ void _print_global_stats(graph_t *g, args_t *args) {
     swidx      = stats_smallworld_index(       g);
     globeff    = stats_cache_global_efficiency(g);
     loceff     = stats_cache_local_efficiency( g);
-    assort     = stats_cache_assortativity(    g);
+    assort     = degs.assortativity;
   }
 
   nnodes = graph_num_nodes(g);
 
   printf("# nodes              %u\n",    graph_num_nodes(               g));
   printf("# edges              %u\n",    graph_num_edges(               g));
-  printf("# density            %0.6f\n", stats_density(                 g));
-  printf("# degree             %0.3f\n", stats_avg_degree(              g));
-  printf("# max degree         %0.0f\n", stats_cache_max_degree(        g));
+  printf("# density            %0.6f\n", degs.density);
+  printf("# degree             %0.3f\n", degs.avgdegree);
+  printf("# max degree         %0.0f\n", degs.maxdegree);
   printf("# components         %0.0f\n", stats_cache_num_components(    g));
   printf("# largest component  %0.0f\n", stats_cache_largest_component( g));
   printf("# connected          %0.0f\n", stats_cache_connected(         g));
@@ -173,6 +223,7 @@ void _print_global_stats(graph_t *g, args_t *args) {
   printf("# global efficiency  %0.6f\n", globeff);
   printf("# local efficiency   %0.6f\n", loceff);
   printf("# assortativity      %0.6f\n", assort);
+  printf("# diameter           %0.0f\n", stats_cache_diameter(          g));
 }
 
 void _print_node_stats_header(graph_t *g, args_t *args) {
@@ -189,7 +240,8 @@ void _print_node_stats_header(graph_t *g, args_t *args) {
   printf("closeness,");
   printf("edgedist,");
   printf("local smallworld index,");
-  printf("component\n");
+  printf("component,");
+  printf("eccentricity\n");
 }
 
 void _print_node_stats(graph_t *g, args_t *args, uint32_t n) {
@@ -202,7 +254,9 @@ void _print_node_stats(graph_t *g, args_t *args, uint32_t n) {
   double         close;
   double         lswidx;
   uint32_t       cmp;
+  uint32_t       ecc;
 
+  ecc      = 0;
   clust    = 0;
   leff     = 0;
   plen     = 0;
@@ -216,6 +270,7 @@ void _print_node_stats(graph_t *g, args_t *args, uint32_t n) {
   if (!args->efficiency) stats_cache_node_local_efficiency( g, n, &leff);
   if (!args->pathlength) stats_cache_node_pathlength(       g, n, &plen);
   if (!args->edgedist)   stats_cache_node_edgedist(         g, n, &edgedist);
+  if (!args->pathlength) stats_cache_node_eccentricity(     g, n, &ecc);
 
   if (!args->pathlength)
     close = stats_closeness_centrality(g, n);
@@ -237,5 +292,6 @@ void _print_node_stats(graph_t *g, args_t *args, uint32_t n) {
   printf("%0.6f,", close);
   printf("%0.6f,", edgedist);
   printf("%0.6f,", lswidx);
-  printf("%u\n",   cmp);
+  printf("%u,",    cmp);
+  printf("%u\n",   ecc);
 }
@@ -0,0 +1,277 @@
+/**
+ * Combine partial path statistics which have been calculated by cnet
+ * --partial, from different ranges of source nodes of the same graph.
+ *
+ * Source-based statistics (path length, closeness, global efficiency,
+ * number of paths, betweenness) for a large graph may be calculated in
+ * shards, e.g. as separate jobs on a cluster:
+ *
+ *   cnet -p -y -j -B 0     -C 50000  --partial part0.mat graph.ngdb
+ *   cnet -p -y -j -B 50000 -C 100000 --partial part1.mat graph.ngdb
+ *   ccombine part0.mat part1.mat
+ *
+ * The inputs are summed, and the statistics are printed in the same way as
+ * by cnet. Every node must have been used as a source exactly once. The
+ * summed partial results may instead be saved, with --output, so that
+ * shards can be merged hierarchically - in this case, not every node needs
+ * to have been used as a source.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "util/startup.h"
+#include "stats/stats_partial.h"
+
+typedef struct _args {
+  char   **inputs;
+  char    *output;
+  uint16_t ninputs;
+  uint8_t  nodevals;
+} args_t;
+
+static struct argp_option options[] = {
+  {"output",   'o', "FILE", 0, "save the combined partial results to "\
+                               "FILE, instead of printing statistics"},
+  {"nodevals", 'n', NULL,   0, "print node-level values"},
+  {0}
+};
+
+static char doc[] = "ccombine -- combine partial path statistics "\
+                    "calculated by cnet --partial";
+
+static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
+
+  args_t  *args;
+  char   **tmp;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'o': args->output   = arg;  break;
+    case 'n': args->nodevals = 0xFF; break;
+
+    case ARGP_KEY_ARG:
+
+      if (args->ninputs == UINT16_MAX) {
+        printf("too many inputs - ignoring %s\n", arg);
+        break;
+      }
+
+      tmp = realloc(args->inputs, (args->ninputs + 1) * sizeof(char *));
+      if (tmp == NULL) argp_failure(state, 1, 0, "out of memory");
+
+      args->inputs = tmp;
+      args->inputs[args->ninputs++] = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < 1) argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Checks how many times each node has been used as a source.
+ *
+ * \return 0 if no node has been used more than once and, if complete is
+ * non-0, every node has been used once; non-0 otherwise.
+ */
+static uint8_t _check_sources(
+  stats_partial_t *p,       /**< combined partial results  */
+  uint8_t          complete /**< every node must be used   */
+);
+
+/**
+ * Prints the values of one node-level statistic.
+ */
+static void _print_node_vals(
+  char    *name,   /**< name of the statistic */
+  uint32_t nnodes, /**< number of nodes       */
+  double  *vals    /**< value for each node   */
+);
+
+/**
+ * Prints graph-level statistics (and node-level values if requested)
+ * from the given combined partial results.
+ */
+static void _print_stats(
+  stats_partial_t *p,       /**< combined partial results   */
+  uint8_t          nodevals /**< print node-level values    */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t        i;
+  stats_partial_t p;
+  stats_partial_t in;
+  args_t          args;
+  struct argp     argp = {options, _parse_opt, "INPUT [INPUT ...]", doc};
+
+  memset(&args, 0, sizeof(args_t));
+  memset(&p,    0, sizeof(stats_partial_t));
+  memset(&in,   0, sizeof(stats_partial_t));
+
+  startup("ccombine", argc, argv, &argp, &args);
+
+  if (stats_partial_load(args.inputs[0], &p)) {
+    printf("error loading %s\n", args.inputs[0]);
+    goto fail;
+  }
+
+  for (i = 1; i < args.ninputs; i++) {
+
+    if (stats_partial_load(args.inputs[i], &in)) {
+      printf("error loading %s\n", args.inputs[i]);
+      goto fail;
+    }
+
+    if (stats_partial_merge(&p, &in)) {
+      printf("%s was calculated from a different graph to %s\n",
+             args.inputs[i], args.inputs[0]);
+      goto fail;
+    }
+
+    stats_partial_free(&in);
+  }
+
+  if (_check_sources(&p, args.output == NULL)) goto fail;
+
+  if (args.output != NULL) {
+    if (stats_partial_save(&p, args.output)) {
+      printf("error saving %s\n", args.output);
+      goto fail;
+    }
+  }
+  else _print_stats(&p, args.nodevals);
+
+  stats_partial_free(&p);
+  free(args.inputs);
+  return 0;
+
+fail:
+  stats_partial_free(&p);
+  stats_partial_free(&in);
+  if (args.inputs != NULL) free(args.inputs);
+  return 1;
+}
+
+uint8_t _check_sources(stats_partial_t *p, uint8_t complete) {
+
+  uint64_t i;
+  uint32_t missing;
+
+  missing = 0;
+
+  for (i = 0; i < p->nnodes; i++) {
+
+    if (p->sources[i] > 1) {
+      printf("node %" PRIu64 " has been used as a source %0.0f times\n",
+             i, p->sources[i]);
+      goto fail;
+    }
+
+    if (p->sources[i] == 0) missing++;
+  }
+
+  if (complete && missing > 0) {
+    printf("%u nodes have not been used as sources\n", missing);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _print_node_vals(char *name, uint32_t nnodes, double *vals) {
+
+  uint64_t i;
+
+  for (i = 0; i < nnodes; i++)
+    printf("%s %" PRIu64 ":\t%f\n", name, i, vals[i]);
+  printf("\n");
+}
+
+void _print_stats(stats_partial_t *p, uint8_t nodevals) {
+
+  uint64_t i;
+  uint32_t n;
+  uint32_t connected;
+  double   pathlength;
+  double   invsum;
+  double   closeness;
+  double   betweenness;
+  double  *vals;
+
+  n           = p->nnodes;
+  connected   = 0;
+  pathlength  = 0;
+  invsum      = 0;
+  closeness   = 0;
+  betweenness = 0;
+
+  /*
+   * Every node with neighbours has a path length of at
+   * least 1, so the connected nodes, over which cnet
+   * averages path length, are those with a non-0 value.
+   */
+  for (i = 0; i < n; i++) {
+
+    if (p->pathlength[i] > 0) {
+      connected++;
+      closeness += 1.0 / p->pathlength[i];
+    }
+
+    pathlength  += p->pathlength[i];
+    invsum      += p->invdist[i];
+
+    p->betweenness[i] /= ((n-1.0)*(n-2.0));
+    betweenness       += p->betweenness[i];
+  }
+
+  if (nodevals) {
+
+    if (!isnan(pathlength)) {
+
+      _print_node_vals("pathlength", n, p->pathlength);
+
+      /*the path lengths have been printed, and are replaced by closeness*/
+      vals = p->pathlength;
+      for (i = 0; i < n; i++) vals[i] = (vals[i] > 0) ? 1.0 / vals[i] : 0;
+
+      _print_node_vals("closeness", n, vals);
+    }
+
+    if (!isnan(betweenness)) _print_node_vals("betweenness", n, p->betweenness);
+    if (!isnan(p->numpaths[0]))
+      _print_node_vals("numpaths", n, p->numpaths);
+  }
+
+  printf("nodes:                 %u\n", n);
+  printf("edges:                 %" PRIu64 "\n", p->nedges);
+
+  if (!isnan(pathlength)) {
+    printf("avg pathlength:        %f\n", pathlength / connected);
+    printf("closeness:             %f\n", closeness  / n);
+  }
+
+  if (!isnan(invsum))
+    printf("global efficiency:     %f\n", invsum / (n*(n-1.0)));
+
+  if (!isnan(betweenness))
+    printf("betweenness:           %f\n", betweenness / n);
+}
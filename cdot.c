@@ -93,7 +93,11 @@ int main (int argc, char *argv[]) {
   hd = fopen(args.output, "wt");
   if (hd == NULL) goto fail;
 
-  dot_write(hd, &g, args.cmap, args.dotopts);
+  if (dot_write(hd, &g, args.cmap, args.dotopts)) {
+    printf("error writing dot file %s\n", args.output);
+    fclose(hd);
+    goto fail;
+  }
 
   fclose(hd);
 
@@ -1,6 +1,8 @@
 /**
  * Normalise the edge weights of a graph so that they lie in a specified
- * range.
+ * range. If the input and output files are the same, the reference data
+ * sections of the file are updated in place, rather than the whole file
+ * being rewritten (this is not possible for compressed files).
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -12,6 +14,8 @@
 
 #include "util/startup.h"
 #include "graph/graph.h"
+#include "graph/graph_weights.h"
+#include "io/ngdb.h"
 #include "io/ngdb_graph.h"
 
 static char doc [] = "cedgenorm - normalise edge weights of a ngdb "\
@@ -59,24 +63,17 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 }
 
 /**
- * Finds the minimum and maximum edge weight values in the given graph.
+ * Rescales the edge weights of the given ngdb file to the new range
+ * (newlo,newhi), in place, without loading the graph. The weights are
+ * rounded to single precision, as they would be if the graph were loaded,
+ * so the result is the same as that of graph_normalise_weights.
+ *
+ * \return 0 on success, non-0 on failure.
  */
-static void _find_minmax(
-  graph_t *g,   /**< the graph */
-  double  *min, /**< place to store minimum edge weight */
-  double  *max  /**< place to store maximum edge weight */
-);
-
-/**
- * Rescales all of the edge weights in the given graph from the old range
- * (oldlo,oldhi) to the new range (newlo,newhi).
- */
-static void _normalise_edge_weights(
-  graph_t *g,     /**< the graph         */
-  double   oldlo, /**< old minimum value */
-  double   oldhi, /**< old maximum value */
-  double   newlo, /**< new minimum value */
-  double   newhi  /**< new maximum value */
+static uint8_t _normalise_inplace(
+  char  *fname, /**< ngdb file to update */
+  double newlo, /**< new minimum value   */
+  double newhi  /**< new maximum value   */
 );
 
 int main (int argc, char *argv[]) {
@@ -91,13 +88,23 @@ int main (int argc, char *argv[]) {
 
   startup("cedgenorm", argc, argv, &argp, &args);
 
+  if (!strcmp(args.input, args.output)) {
+
+    if (_normalise_inplace(args.input, args.newlo, args.newhi)) {
+      printf("error normalising %s in place\n", args.input);
+      goto fail;
+    }
+
+    return 0;
+  }
+
   if (ngdb_read(args.input, &g)) {
     printf("error loading ngdb file %s\n", args.input);
     goto fail;
   }
 
-  _find_minmax(           &g, &oldlo, &oldhi);
-  _normalise_edge_weights(&g,  oldlo,  oldhi, args.newlo, args.newhi);
+  graph_weight_range(     &g, &oldlo, &oldhi);
+  graph_normalise_weights(&g,  oldlo,  oldhi, args.newlo, args.newhi);
 
   if (ngdb_write(&g, args.output)) {
     printf("Could not write to %s\n", args.output);
@@ -110,53 +117,107 @@ fail:
   return 1;
 }
 
-void _find_minmax(graph_t *g, double *min, double *max) {
+uint8_t _normalise_inplace(char *fname, double newlo, double newhi) {
 
   uint64_t  i;
   uint64_t  j;
+  uint8_t   pass;
   uint32_t  nnodes;
-  uint32_t  nnbrs;
-  float    *wts;
+  uint32_t  nrefs;
+  uint32_t  cap;
+  uint32_t *refs;
+  double   *wts;
+  float    *fwts;
+  void     *tmp;
+  float     lo;
+  float     hi;
+  double    oldlo;
+  double    oldhi;
+  ngdb_t   *ngdb;
 
-  *min =  DBL_MAX;
-  *max = -DBL_MAX;
+  ngdb  = NULL;
+  refs  = NULL;
+  wts   = NULL;
+  fwts  = NULL;
+  cap   = 0;
+  oldlo =  DBL_MAX;
+  oldhi = -DBL_MAX;
 
-  nnodes = graph_num_nodes(g);
+  ngdb = ngdb_open_update(fname);
+  if (ngdb == NULL) goto fail;
 
-  for (i = 0; i < nnodes; i++) {
+  if (ngdb_ref_data_len(ngdb) != sizeof(double)) goto fail;
 
-    nnbrs = graph_num_neighbours(g, i);
-    wts   = graph_get_weights   (g, i);
+  nnodes = ngdb_num_nodes(ngdb);
 
-    for (j = 0; j < nnbrs; j++) {
+  /*
+   * pass 0 finds the weight range, and pass 1 rescales
+   * the weights; they are rounded to single precision,
+   * as they would be if the graph were loaded
+   */
+  for (pass = 0; pass < 2; pass++) {
+    for (i = 0; i < nnodes; i++) {
 
-      if (wts[j] < *min) *min = wts[j];
-      if (wts[j] > *max) *max = wts[j];
-    }
-  }
-}
+      nrefs = ngdb_node_num_refs(ngdb, i);
+      if (nrefs == 0xFFFFFFFF) goto fail;
+      if (nrefs == 0)          continue;
+
+      if (nrefs > cap) {
+
+        tmp = realloc(refs, nrefs*sizeof(uint32_t));
+        if (tmp == NULL) goto fail;
+        refs = tmp;
 
-void _normalise_edge_weights(
-  graph_t *g, double oldlo, double oldhi, double newlo, double newhi) {
+        tmp = realloc(wts, nrefs*sizeof(double));
+        if (tmp == NULL) goto fail;
+        wts = tmp;
 
+        tmp = realloc(fwts, nrefs*sizeof(float));
+        if (tmp == NULL) goto fail;
+        fwts = tmp;
 
-  uint64_t i;
-  uint64_t j;
-  uint32_t nnodes;
-  uint32_t nnbrs;
-  double   scale;
-  float   *wts;
+        cap = nrefs;
+      }
 
-  scale  = (newhi - newlo) / (oldhi - oldlo);
+      if (ngdb_node_get_all_refs(ngdb, i, refs, wts)) goto fail;
 
-  nnodes = graph_num_nodes(g);
+      for (j = 0; j < nrefs; j++) fwts[j] = wts[j];
 
-  for (i = 0; i < nnodes; i++) {
-    
-    nnbrs = graph_num_neighbours(g, i);
-    wts   = graph_get_weights   (g, i);
+      if (pass == 0) {
 
-    for (j = 0; j < nnbrs; j++)
-      wts[j] = (wts[j] - oldlo) * scale + newlo;
+        graph_weights_range(fwts, nrefs, &lo, &hi);
+
+        if (lo <= hi && lo < oldlo) oldlo = lo;
+        if (lo <= hi && hi > oldhi) oldhi = hi;
+        continue;
+      }
+
+      graph_weights_scale(fwts, nrefs, oldlo, oldhi, newlo, newhi);
+
+      for (j = 0; j < nrefs; j++) wts[j] = fwts[j];
+
+      if (ngdb_node_set_all_ref_data(ngdb, i, wts)) goto fail;
+    }
+  }
+
+  free(refs);
+  free(wts);
+  free(fwts);
+  refs = NULL;
+  wts  = NULL;
+  fwts = NULL;
+
+  if (ngdb_close(ngdb)) {
+    ngdb = NULL;
+    goto fail;
   }
+
+  return 0;
+
+fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  if (fwts != NULL) free(fwts);
+  return 1;
 }
@@ -1,7 +1,8 @@
 /**
  * ceo - convert a Radatools lol partition file, or an Infomap .tree file,
  * into an equivalent ngdb file.  All communities in the ngdb file are fully
- * connected.
+ * connected. With --labels, the label value of every node is set to the
+ * number (starting from 1) of the community that it is in.
  *
  * See:
  *   - http://deim.urv.cat/~sgomez/radatools.php
@@ -44,6 +45,7 @@ typedef struct args {
   char       *output;
   char       *connfile;
   file_type_t type;
+  uint8_t     labels;
 
 } args_t;
 
@@ -51,6 +53,8 @@ static struct argp_option options[] = {
   {"type",     't', "STRING",   0, "file type (either 'lol' or 'tree')"},
   {"connfile", 'c', "NGDBFILE", 0, "ngdb graph file from which connectivity "\
                                    "and labels can be extracted"},
+  {"labels",   'l', NULL,       0, "set node label values to community "\
+                                   "numbers"},
   {0}
 };
 
@@ -70,6 +74,10 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
       a->connfile = arg;
       break;
 
+    case 'l':
+      a->labels = 1;
+      break;
+
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) a->input  = arg;
       else if (state->arg_num == 1) a->output = arg;
@@ -143,6 +151,12 @@ int main (int argc, char *argv[]) {
     }
   }
 
+  /*applied after the labels are copied, so the coordinates are kept*/
+  if (args.labels && graph_label_by_partition(&g, &part)) {
+    printf("error setting node labels\n");
+    goto fail;
+  }
+
   if (ngdb_write(&g, args.output)) {
     printf("error writing graph to file %s\n", args.output);
     goto fail;
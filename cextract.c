@@ -3,7 +3,9 @@
  *
  * This program may be used to extract a subgraph from a parent graph. Nodes
  * to be included in the subgraph are selected either by their label value, or
- * by component number.
+ * by component number. With --split, the graph is instead partitioned by
+ * every label value (or component) in one pass, and each region is written
+ * to its own file, in parallel.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
@@ -16,10 +18,13 @@
 
 #include "stats/stats.h"
 #include "graph/graph.h"
+#include "graph/graph_cmpindex.h"
 #include "graph/graph_log.h"
-#include "graph/graph_mask.h"
+#include "graph/graph_view.h"
 #include "util/startup.h"
 #include "util/array.h"
+#include "util/compare.h"
+#include "util/parallel.h"
 #include "io/ngdb_graph.h"
 #include "io/analyze75.h"
 
@@ -34,7 +39,8 @@
  */
 typedef struct _args {
   char    *input;                    /**< name of input file               */
-  char    *output;                   /**< name of output file              */
+  char    *output;                   /**< name of output file, or file
+                                          name template with split         */
   char    *lblfile;                  /**< ANALYZE75 file containing
                                           node labels                      */
   uint8_t  relabel;                  /**< nodes are relabelled using label
@@ -49,7 +55,11 @@ typedef struct _args {
   uint32_t labels[MAX_LABEL_VALUES]; /**< labels (or components) to
                                           include in subgraph              */
   uint8_t  nlabels;                  /**< number of labels (or components) */
-  
+  uint8_t  split;                    /**< write one subgraph for every
+                                          label value/component            */
+  uint16_t nthreads;                 /**< number of threads used with
+                                          split                            */
+
 } args_t;
 
 static char doc[]   = "cextract - extract a subgraph by "\
@@ -65,6 +75,11 @@ static struct argp_option options[] = {
   {"relabel",   'a', NULL,   0, "Relabel nodes in output graph according to "\
                                 "provided label file"},
   {"real",      'r',  NULL,  0, "node coordinates are in real units"},
+  {"split",     's',  NULL,  0, "write one subgraph for every label "\
+                                "value/component (or every --lblval); "\
+                                "OUTPUT is a file name template, in which "\
+                                "%u is replaced with the value"},
+  {NULL,        'j', "INT",  0, "number of threads (default: --threads)"},
   {0}
 };
 
@@ -82,6 +97,8 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
     case 'a': args->relabel   = 1;   break;
     case 'r': args->real      = 1;   break;
     case 'h': args->hdrmsg    = arg; break;
+    case 's': args->split     = 1;   break;
+    case 'j': args->nthreads  = atoi(arg); break;
     case 'l':
       if (args->nlabels < MAX_LABEL_VALUES) 
         args->labels[args->nlabels++] = atoi(arg);
@@ -132,6 +149,48 @@ static uint8_t _find_nodes_by_component(
   uint8_t   *mask     /**< empty mask array to populate             */
 );
 
+/**
+ * Assigns every node in the given graph to a region, by its label value
+ * or component. Regions are numbered in ascending order of their value.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _find_regions(
+  graph_t   *g,        /**< input graph                                   */
+  uint8_t    cmp,      /**< partition by component instead of by label    */
+  uint32_t  *labels,   /**< values to include, or NULL for all values     */
+  uint8_t    nlabels,  /**< number of values                              */
+  uint32_t  *parts,    /**< space to store the region of every node, or
+                            GRAPH_VIEW_NONE                               */
+  uint32_t **values,   /**< set to a newly allocated list of the value of
+                            each region                                   */
+  uint32_t  *nregions  /**< set to the number of regions                  */
+);
+
+/**
+ * Writes the subgraphs of the given views to file. Called via
+ * parallel_for, once for every region.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_regions(
+  uint64_t start,  /**< first region                 */
+  uint64_t end,    /**< one past the last region     */
+  uint16_t thread, /**< calling thread               */
+  void    *ctx     /**< pointer to a split_ctx_t     */
+);
+
+/**
+ * Context passed to _write_regions.
+ */
+typedef struct _split_ctx {
+
+  graph_view_t *views;    /**< one view for every region      */
+  uint32_t     *values;   /**< value of each region           */
+  char         *template; /**< output file name template      */
+
+} split_ctx_t;
+
 /**
  * Tests whether the given node is in the list of included labels.
  *
@@ -147,31 +206,49 @@ static uint8_t _test_label(
 
 int main (int argc, char *argv[]) {
 
-
-  graph_t     gin;
-  graph_t     gincpy;
-  graph_t     gout;
-  dsr_t       hdr;
-  uint8_t    *img;
-  uint32_t    nginnodes;
-  uint8_t    *mask;
-  struct argp argp = {options, _parse_opt, "INPUT OUTPUT", doc};
-  args_t      args;  
+  uint64_t       i;
+  graph_t        gin;
+  graph_view_t   view;
+  dsr_t          hdr;
+  uint8_t       *img;
+  uint32_t       nginnodes;
+  uint8_t       *mask;
+  graph_label_t *origlbls;
+  uint32_t      *parts;
+  uint32_t      *values;
+  uint32_t       nregions;
+  graph_view_t  *views;
+  split_ctx_t    ctx;
+  struct argp    argp = {options, _parse_opt, "INPUT OUTPUT", doc};
+  args_t         args;  
 
   memset(&args, 0, sizeof(args_t));
-  img = NULL;
+  img      = NULL;
+  origlbls = NULL;
+  mask     = NULL;
+  parts    = NULL;
+  values   = NULL;
+  views    = NULL;
+  nregions = 0;
 
   startup("cextract", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &gin)) {
-    printf("Could not read in %s\n", args.input);
+  if (args.split && args.exclude) {
+    printf("--exclude cannot be used with --split\n");
+    goto fail;
+  }
+
+  if (args.split && strstr(args.output, "%u") == NULL) {
+    printf("output file name template must contain %%u\n");
     goto fail;
   }
 
-  if (ngdb_read(args.input, &gincpy)) {
+  if (ngdb_read(args.input, &gin)) {
     printf("Could not read in %s\n", args.input);
     goto fail;
-  }  
+  }
+
+  nginnodes = graph_num_nodes(&gin);
 
   if (args.lblfile) {
     if (analyze_load(args.lblfile, &hdr, &img)) {
@@ -179,21 +256,62 @@ int main (int argc, char *argv[]) {
       goto fail;
     }
 
+    /*
+     * The original labels are saved, rather than the
+     * whole graph, so that they can be restored for
+     * the output if it is not to be relabelled
+     */
+    if (!args.relabel) {
+
+      origlbls = malloc(nginnodes * sizeof(graph_label_t));
+      if (origlbls == NULL) {
+        printf("memory error!?\n");
+        goto fail;
+      }
+
+      for (i = 0; i < nginnodes; i++)
+        memcpy(origlbls + i,
+               graph_get_nodelabel(&gin, i),
+               sizeof(graph_label_t));
+    }
+
     if (graph_relabel(&gin, &hdr, img, args.real)) {
       printf("Could not relabel graph\n");
       goto fail;
     }
   }
 
-  nginnodes = graph_num_nodes(&gin);
+  if (args.split) {
 
-  mask = calloc(nginnodes, sizeof(uint8_t));
-  if (mask == NULL) {
-    printf("memory error!?\n");
-    goto fail;
+    parts = malloc((nginnodes > 0 ? nginnodes : 1) * sizeof(uint32_t));
+    if (parts == NULL) {
+      printf("memory error!?\n");
+      goto fail;
+    }
+
+    if (_find_regions(&gin,
+                      args.component,
+                      args.nlabels > 0 ? args.labels : NULL,
+                      args.nlabels,
+                      parts,
+                      &values,
+                      &nregions)) {
+      printf("Could not partition graph\n");
+      goto fail;
+    }
+  }
+  else {
+    mask = calloc(nginnodes, sizeof(uint8_t));
+    if (mask == NULL) {
+      printf("memory error!?\n");
+      goto fail;
+    }
   }
 
-  if (!args.component) {
+  if (args.split) {
+    /*the regions were found above*/
+  }
+  else if (!args.component) {
     if (_find_nodes_by_label(
           &gin, args.exclude, args.labels, args.nlabels, mask)) {
       printf("Could not find nodes by label\n");
@@ -208,33 +326,59 @@ int main (int argc, char *argv[]) {
     }
   }
 
-  if (args.relabel) {
-    if (graph_mask(&gin, &gout, mask)) {
-      printf("could not mask graph\n");
-      goto fail;
+  if (origlbls != NULL) {
+    for (i = 0; i < nginnodes; i++) {
+      if (graph_set_nodelabel(&gin, i, origlbls + i)) {
+        printf("Could not restore node labels\n");
+        goto fail;
+      }
     }
   }
 
-  else {
-    if (graph_mask(&gincpy, &gout, mask)) {
-      printf("could not mask graph\n");
+  if (args.hdrmsg != NULL) {
+    if (graph_log_add(&gin, args.hdrmsg)) {
+      printf("Error adding header message\n");
       goto fail;
     }
   }
 
-  if (graph_log_copy(&gin, &gout)) {
-    printf("Error copying graph log\n");
-    goto fail;
-  }
+  if (args.split) {
 
-  if (args.hdrmsg != NULL) {
-    if (graph_log_add(&gout, args.hdrmsg)) {
-      printf("Error adding header message\n");
+    if (nregions == 0) {
+      printf("No regions to write\n");
       goto fail;
     }
+
+    views = malloc(nregions * sizeof(graph_view_t));
+    if (views == NULL) {
+      printf("memory error!?\n");
+      goto fail;
+    }
+
+    if (graph_view_partition(views, &gin, parts, nregions)) {
+      printf("could not partition graph\n");
+      goto fail;
+    }
+
+    ctx.views    = views;
+    ctx.values   = values;
+    ctx.template = args.output;
+
+    if (parallel_for(args.nthreads, nregions, 1, &ctx, _write_regions)) {
+      printf("Could not write regions\n");
+      goto fail;
+    }
+
+    return 0;
   }
 
-  if (ngdb_write(&gout, args.output)) {
+  /*the subgraph is written straight from the input graph*/
+  if (graph_view_create(&view, &gin, mask)) {
+    printf("could not mask graph\n");
+    goto fail;
+  }
+
+  if (ngdb_write_view(&view, args.output)) {
     printf("Could not write to %s\n", args.output);
     goto fail;
   }
@@ -303,39 +447,141 @@ uint8_t _find_nodes_by_component(
 
   uint64_t  i;
   uint64_t  j;
-  uint32_t *componentnums;
   uint32_t  nnodes;
+  uint32_t *nodes;
 
-  componentnums = NULL;
-  nnodes        = graph_num_nodes(g);
+  /*only the nodes of the listed components are visited*/
+  if (exclude) memset(mask, 1, graph_num_nodes(g));
 
-  componentnums = calloc(nnodes, sizeof(uint32_t));
-  if (componentnums == NULL) goto fail;
+  for (i = 0; i < ncmps; i++) {
 
-  stats_num_components(g, 0, NULL, componentnums);
+    if (graph_cmpindex_nodes(g, cmps[i], &nodes, &nnodes)) goto fail;
 
-  for (i = 0; i < nnodes; i++) {
+    for (j = 0; j < nnodes; j++) mask[nodes[j]] = !exclude;
+  }
 
-    for (j = 0; j < ncmps; j++) {
+  return 0;
+  
+fail:
+  return 1;
+}
 
-      if (cmps[j] == componentnums[i]) {
+uint8_t _find_regions(
+  graph_t   *g,
+  uint8_t    cmp,
+  uint32_t  *labels,
+  uint8_t    nlabels,
+  uint32_t  *parts,
+  uint32_t **values,
+  uint32_t  *nregions) {
+
+  uint64_t       i;
+  uint32_t       j;
+  uint32_t       nnodes;
+  uint32_t       nvals;
+  uint32_t      *vals;
+  uint32_t      *val;
+  graph_label_t *lbl;
+
+  vals   = NULL;
+  nnodes = graph_num_nodes(g);
 
-        if (exclude) break;
+  /*
+   * the value of every node is stored in parts, and
+   * replaced with the index of that value afterwards
+   */
+  if (cmp) {
+    stats_num_components(g, 0, NULL, parts);
+  }
+  else {
+    for (i = 0; i < nnodes; i++) {
+      lbl      = graph_get_nodelabel(g, i);
+      parts[i] = (lbl != NULL) ? lbl->labelval : GRAPH_VIEW_NONE;
+    }
+  }
 
-        mask[i] = 1;
-        break;
-      }
+  if (labels != NULL) {
+    nvals = nlabels;
+    vals  = malloc((nvals > 0 ? nvals : 1) * sizeof(uint32_t));
+    if (vals == NULL) goto fail;
+    memcpy(vals, labels, nvals * sizeof(uint32_t));
+  }
+  else {
+    nvals = nnodes;
+    vals  = malloc((nvals > 0 ? nvals : 1) * sizeof(uint32_t));
+    if (vals == NULL) goto fail;
+    for (i = 0, nvals = 0; i < nnodes; i++) {
+      if (parts[i] != GRAPH_VIEW_NONE) vals[nvals++] = parts[i];
     }
+  }
 
-    if (exclude && j == ncmps) {
-      mask[i] = 1;
+  /*sort, and remove duplicates*/
+  qsort(vals, nvals, sizeof(uint32_t), compare_u32);
+
+  for (i = 0, j = 0; i < nvals; i++) {
+    if (j > 0 && vals[j-1] == vals[i]) continue;
+    vals[j++] = vals[i];
+  }
+  nvals = j;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (parts[i] == GRAPH_VIEW_NONE) continue;
+
+    val = bsearch(parts + i, vals, nvals, sizeof(uint32_t), compare_u32);
+
+    if (val == NULL) parts[i] = GRAPH_VIEW_NONE;
+    else             parts[i] = val - vals;
+  }
+
+  *values   = vals;
+  *nregions = nvals;
+  return 0;
+
+fail:
+  if (vals != NULL) free(vals);
+  return 1;
+}
+
+uint8_t _write_regions(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t     i;
+  split_ctx_t *sctx;
+  char        *pref;
+  char        *fname;
+  size_t       len;
+
+  sctx  = ctx;
+  fname = NULL;
+  pref  = strstr(sctx->template, "%u");
+  len   = strlen(sctx->template) + 16;
+
+  fname = malloc(len);
+  if (fname == NULL) goto fail;
+
+  for (i = start; i < end; i++) {
+
+    /*
+     * only the first %u is substituted - the
+     * template is not used as a format string
+     */
+    snprintf(fname, len, "%.*s%u%s",
+             (int)(pref - sctx->template),
+             sctx->template,
+             sctx->values[i],
+             pref + 2);
+
+    if (ngdb_write_view(sctx->views + i, fname)) {
+      printf("Could not write to %s\n", fname);
+      goto fail;
     }
   }
 
-  free(componentnums);
+  free(fname);
   return 0;
-  
+
 fail:
-  if (componentnums != NULL) free(componentnums);
+  if (fname != NULL) free(fname);
   return 1;
 }
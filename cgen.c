@@ -9,11 +9,16 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <argp.h>
+#include <inttypes.h>
 
 #include "util/startup.h"
+#include "util/parallel.h"
+#include "util/rng.h"
 #include "graph/graph.h"
 #include "io/ngdb_graph.h"
 #include "io/edgefile.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
 
 typedef enum {
   TYPE_ER_RANDOM = 1, /* "errandom"   */
@@ -21,7 +26,8 @@ typedef enum {
   TYPE_SCALEFREE,     /* "scalefree"  */
   TYPE_SMALLWORLD,    /* "smallworld" */
   TYPE_NCUT,          /* "ncut"       */
-  TYPE_EDGEFILE       /* "edgefile"   */
+  TYPE_EDGEFILE,      /* "edgefile"   */
+  TYPE_CONFIGURATION  /* "configuration" */
 } graph_type_t;
 
 static char doc[] = "cgen - generate graphs";
@@ -33,6 +39,7 @@ typedef struct args {
   uint32_t     numnodes;
   graph_type_t type;
   double       density;
+  uint64_t     numedges;
   uint32_t     numclusters;
   double       internal;
   double       external;
@@ -55,12 +62,72 @@ typedef struct args {
 
 
   char        *infile;
+
+  uint32_t     count;
+  uint16_t     nthreads;
+  char        *stats;
 } args_t;
 
+/**
+ * A graph statistic which may be calculated in batch mode.
+ */
+typedef struct _cgen_stat {
+
+  char   *name;              /**< name used on the command line */
+  double (*fn)(graph_t *g);  /**< function which calculates it  */
+
+} cgen_stat_t;
+
+/**
+ * State shared by the threads generating a batch of graphs.
+ */
+typedef struct _batch {
+
+  args_t   *args;    /**< program arguments                          */
+  rng_t    *rngs;    /**< random number stream for each graph         */
+  char     *prefix;  /**< output file name prefix                     */
+  uint32_t  width;   /**< number of digits in output file numbers     */
+  uint32_t  nstats;  /**< number of statistics to calculate           */
+  uint32_t *stats;   /**< indices into _stats of the statistics       */
+  double   *results; /**< count x nstats statistic values             */
+
+} batch_t;
+
+/**
+ * \return the number of nodes in the given graph.
+ */
+static double _num_nodes(graph_t *g);
+
+/**
+ * \return the number of edges in the given graph.
+ */
+static double _num_edges(graph_t *g);
+
+/**
+ * Statistics which may be calculated in batch mode.
+ */
+static cgen_stat_t _stats[] = {
+  {"nodes",         _num_nodes},
+  {"edges",         _num_edges},
+  {"density",       stats_density},
+  {"degree",        stats_avg_degree},
+  {"maxdegree",     stats_cache_max_degree},
+  {"clustering",    stats_cache_graph_clustering},
+  {"pathlength",    stats_cache_graph_pathlength},
+  {"efficiency",    stats_cache_global_efficiency},
+  {"components",    stats_cache_num_components},
+  {"assortativity", stats_cache_assortativity},
+  {"modularity",    stats_cache_modularity},
+  {"chira",         stats_cache_chira},
+  {NULL,            NULL}
+};
+
 static struct argp_option options[] = {
   {"numnodes",    'n', "INT",    0, "number of nodes"},
   {"type",        't', "STRING", 0, "graph type"},
   {"density",     'd', "DOUBLE", 0, "overall graph density"},
+  {"numedges",    'E', "INT",    0, "number of edges, for errandom "\
+                                    "graphs (overrides density)"},
   {"numclusters", 'c', "INT",    0, "number of clusters, for "\
                                     "clustered graphs"},
   {"internal",    'i', "DOUBLE", 0, "internal density/degree for "\
@@ -87,7 +154,20 @@ static struct argp_option options[] = {
   {"sx",          'x', "DOUBLE", 0, "distance sigma, for ncut graphs"},
   {"radius",      'u', "DOUBLE", 0, "connectivity radius, for ncut graphs"},
   {"threshold",   'h', "DOUBLE", 0, "threshold, for ncut graphs"},
-  {"infile",      'b', "FILE",   0, "input file for edgefile graphs"},
+  {"count",       'K', "INT",    0, "generate INT graphs, in parallel, "\
+                                    "saving them to OUTPUT_N.ngdb"},
+  {NULL,          'j', "INT",    0, "number of threads for --count "\
+                                    "(default: --threads)"},
+  {"stats",       'S', "LIST",   0, "with --count, print the given "\
+                                    "comma-separated statistics for each "\
+                                    "graph, instead of saving them (any "\
+                                    "of nodes, edges, density, degree, "\
+                                    "maxdegree, clustering, pathlength, "\
+                                    "efficiency, components, "\
+                                    "assortativity, modularity, chira)"},
+  {"infile",      'b', "FILE",   0, "input file for edgefile graphs, or "\
+                                    "ngdb graph whose degree sequence is "\
+                                    "used for configuration graphs"},
   {0}
 };
 
@@ -107,10 +187,13 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
       else if (!strcasecmp(arg, "smallworld")) a->type = TYPE_SMALLWORLD;
       else if (!strcasecmp(arg, "ncut"))       a->type = TYPE_NCUT;
       else if (!strcasecmp(arg, "edgefile"))   a->type = TYPE_EDGEFILE;
+      else if (!strcasecmp(arg, "configuration"))
+        a->type = TYPE_CONFIGURATION;
       else argp_usage(state);
       break;
 
     case 'd': a->density     = atof(arg); break;
+    case 'E': a->numedges    = atoll(arg); break;
     case 'c': a->numclusters = atoi(arg); break;
     case 'i': a->internal    = atof(arg); break;
     case 'e': a->external    = atof(arg); break;
@@ -128,6 +211,9 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'u': a->radius      = atof(arg); break;
     case 'h': a->threshold   = atof(arg); break;
     case 'b': a->infile      = arg;       break;
+    case 'K': a->count       = atoi(arg); break;
+    case 'j': a->nthreads    = atoi(arg); break;
+    case 'S': a->stats       = arg;       break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) a->output = arg;
@@ -135,7 +221,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
       break;
       
     case ARGP_KEY_END:  
-      if (state->arg_num < 1) argp_usage(state);
+      if (state->arg_num < 1 && a->stats == NULL) argp_usage(state);
       break;
       
     default:
@@ -144,60 +230,147 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * Creates a configuration model graph with the same degree sequence, and
+ * node labels, as the graph in the given ngdb file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_configuration(
+  graph_t *g,    /**< uninitialised graph      */
+  char    *fname /**< template graph file name */
+);
+
+/**
+ * Generates a graph of the type specified in the given arguments.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _generate(
+  args_t  *args, /**< program arguments    */
+  graph_t *g     /**< uninitialised graph  */
+);
+
+/**
+ * Generates args->count graphs in parallel, and either saves them, or
+ * prints the requested statistics for each of them.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _batch(
+  args_t *args /**< program arguments */
+);
+
+/**
+ * parallel_for function which generates a range of graphs in a batch.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _batch_graphs(
+  uint64_t  start,  /**< first graph          */
+  uint64_t  end,    /**< one past last graph  */
+  uint16_t  thread, /**< calling thread       */
+  void     *ctx     /**< pointer to a batch_t */
+);
+
+/**
+ * Parses the comma-separated list of statistic names in args->stats.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _parse_stats(
+  char     *list,   /**< comma-separated statistic names        */
+  uint32_t *nstats, /**< place to store number of statistics    */
+  uint32_t *stats   /**< place to store indices into _stats     */
+);
+
 int main(int argc, char *argv[]) {
 
-  dsr_t          hdr;
-  uint8_t       *img;
   graph_t        g;
   args_t         args;
   struct argp    argp = {options, _parse_opt, "OUTPUT", doc};
 
-  img = NULL;
   memset(&args, 0, sizeof(args_t));
   startup("cgen", argc, argv, &argp, &args);
 
-  switch(args.type) {
+  if (args.count > 0 || args.stats != NULL) {
+
+    if (_batch(&args)) {
+      printf("error generating graphs\n");
+      goto fail;
+    }
+    return 0;
+  }
+
+  if (_generate(&args, &g)) goto fail;
+
+  if (ngdb_write(&g, args.output)) {
+    printf("Could not write to %s\n", args.output);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _generate(args_t *args, graph_t *g) {
+
+  dsr_t    hdr;
+  uint8_t *img;
+
+  img = NULL;
+
+  switch(args->type) {
 
     case TYPE_ER_RANDOM:
-      if (graph_create_er_random(&g, args.numnodes, args.density)) {
+      if (args->numedges > 0) {
+        if (graph_create_er_random_edges(
+              g, args->numnodes, args->numedges)) {
+          printf("could not create random graph\n");
+          goto fail;
+        }
+      }
+      else if (graph_create_er_random(g, args->numnodes, args->density)) {
         printf("could not create random graph\n");
         goto fail;
       }
       break;
 
     case TYPE_CLUSTERED:
-      if (args.iedegree || !(args.iedegree || args.intext || args.intdens)) {
+      if (args->iedegree || !(args->iedegree || args->intext || args->intdens)) {
         if (graph_create_clustered_by_degree(
-              &g,
-              args.numnodes,
-              args.numclusters,
-              args.internal,
-              args.external,
-              args.sizerange)) {
+              g,
+              args->numnodes,
+              args->numclusters,
+              args->internal,
+              args->external,
+              args->sizerange)) {
           printf("could not create clustered graph\n");
           goto fail;
         }     
       }
-      else if (args.intext) {
+      else if (args->intext) {
         if (graph_create_clustered(
-              &g,
-              args.numnodes,
-              args.numclusters,
-              args.internal,
-              args.external,
-              args.sizerange)) {
+              g,
+              args->numnodes,
+              args->numclusters,
+              args->internal,
+              args->external,
+              args->sizerange)) {
           printf("could not create clustered graph\n");
           goto fail;
         }
       }
       else {
         if (graph_create_clustered_by_total(
-              &g,
-              args.numnodes,
-              args.numclusters,
-              args.internal,
-              args.density,
-              args.sizerange)) {
+              g,
+              args->numnodes,
+              args->numclusters,
+              args->internal,
+              args->density,
+              args->sizerange)) {
           printf("could not create clustered graph\n");
           goto fail;
         }
@@ -207,10 +380,10 @@ int main(int argc, char *argv[]) {
     case TYPE_SCALEFREE:
 
       if (graph_create_scalefree(
-            &g,
-            args.numnodes,
-            args.sfm,
-            args.sfm0)) {
+            g,
+            args->numnodes,
+            args->sfm,
+            args->sfm0)) {
         printf("could not create scale free graph\n");
         goto fail;
       }
@@ -219,10 +392,10 @@ int main(int argc, char *argv[]) {
     case TYPE_SMALLWORLD:
 
       if (graph_create_smallworld(
-            &g,
-            args.numnodes,
-            args.swp,
-            args.swk)) {
+            g,
+            args->numnodes,
+            args->swp,
+            args->swk)) {
         printf("could not create small world graph\n");
         goto fail;
       }
@@ -230,19 +403,19 @@ int main(int argc, char *argv[]) {
 
     case TYPE_NCUT:
 
-      if (analyze_load(args.imgf, &hdr, &img)) {
+      if (analyze_load(args->imgf, &hdr, &img)) {
         printf("could not load image file\n");
         goto fail;
       }
 
       if (graph_create_ncut(
-            &g,
+            g,
             &hdr,
             img,
-            args.si,
-            args.sx,
-            args.radius,
-            args.threshold)) {
+            args->si,
+            args->sx,
+            args->radius,
+            args->threshold)) {
         printf("could not create ncut graph\n");
         goto fail;
       }
@@ -251,22 +424,31 @@ int main(int argc, char *argv[]) {
 
     case TYPE_EDGEFILE:
 
-      if (!args.infile) {
+      if (!args->infile) {
         printf("You must specify an input edge file\n");
         goto fail;
       }
 
-      if (!args.numnodes) {
-        printf("You must specify the number of nodes\n");
+      /*the number of nodes is inferred from the file if not given*/
+      if (edgefile_read(g, args->numnodes, args->infile, 0)) {
+        printf("error reading in edge file\n");
         goto fail;
       }
 
-      if (edgefile_read(&g, args.numnodes, args.infile)) {
-        printf("error reading in edge file\n");
+
+      break;
+
+    case TYPE_CONFIGURATION:
+
+      if (!args->infile) {
+        printf("You must specify an input graph file\n");
         goto fail;
       }
 
-
+      if (_create_configuration(g, args->infile)) {
+        printf("could not create configuration graph\n");
+        goto fail;
+      }
       break;
       
     default:
@@ -274,13 +456,240 @@ int main(int argc, char *argv[]) {
       goto fail;
   }
 
-  if (ngdb_write(&g, args.output)) {
-    printf("Could not write to %s\n", args.output);
+  if (img != NULL) free(img);
+  return 0;
+
+fail:
+  if (img != NULL) free(img);
+  return 1;
+}
+
+uint8_t _create_configuration(graph_t *g, char *fname) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *degrees;
+  graph_t   tmpl;
+
+  degrees = NULL;
+  memset(&tmpl, 0, sizeof(graph_t));
+
+  if (ngdb_read(fname, &tmpl)) goto fail;
+
+  nnodes  = graph_num_nodes(&tmpl);
+  degrees = malloc(nnodes * sizeof(uint32_t));
+  if (degrees == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++)
+    degrees[i] = graph_num_neighbours(&tmpl, i);
+
+  if (graph_create_configuration(g, nnodes, degrees)) goto fail;
+  if (graph_copy_nodelabels(&tmpl, g))                goto fail;
+
+  free(degrees);
+  graph_free(&tmpl);
+  return 0;
+
+fail:
+  if (degrees != NULL) free(degrees);
+  graph_free(&tmpl);
+  return 1;
+}
+
+uint8_t _batch(args_t *args) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  len;
+  batch_t   batch;
+
+  memset(&batch, 0, sizeof(batch_t));
+
+  batch.args = args;
+
+  if (args->count == 0) args->count = 1;
+
+  if (args->stats != NULL) {
+
+    batch.stats = malloc(sizeof(_stats) / sizeof(cgen_stat_t) *
+                         sizeof(uint32_t));
+    if (batch.stats == NULL) goto fail;
+
+    if (_parse_stats(args->stats, &batch.nstats, batch.stats)) {
+      printf("unknown statistic in %s\n", args->stats);
+      goto fail;
+    }
+
+    batch.results = calloc((uint64_t)args->count * batch.nstats,
+                           sizeof(double));
+    if (batch.nstats > 0 && batch.results == NULL) goto fail;
+  }
+  else {
+
+    /*OUTPUT.ngdb -> OUTPUT_N.ngdb*/
+    len          = strlen(args->output);
+    batch.prefix = malloc(len + 1);
+    if (batch.prefix == NULL) goto fail;
+
+    strcpy(batch.prefix, args->output);
+    if (len > 5 && !strcmp(batch.prefix + len - 5, ".ngdb"))
+      batch.prefix[len - 5] = '\0';
+
+    for (i = args->count - 1, batch.width = 1; i >= 10; i /= 10)
+      batch.width++;
+  }
+
+  /*
+   * every graph gets its own random number stream,
+   * so the batch does not depend on the number of
+   * threads
+   */
+  batch.rngs = malloc(args->count * sizeof(rng_t));
+  if (batch.rngs == NULL) goto fail;
+
+  rng_seed(batch.rngs, rng_next(rng_default()));
+  for (i = 1; i < args->count; i++) {
+    batch.rngs[i] = batch.rngs[i-1];
+    rng_jump(batch.rngs+i);
+  }
+
+  if (parallel_for(
+        args->nthreads, args->count, 1, &batch, _batch_graphs))
     goto fail;
+
+  if (args->stats != NULL) {
+
+    printf("graph");
+    for (j = 0; j < batch.nstats; j++)
+      printf("\t%s", _stats[batch.stats[j]].name);
+    printf("\n");
+
+    for (i = 0; i < args->count; i++) {
+
+      printf("%" PRIu64, i);
+      for (j = 0; j < batch.nstats; j++)
+        printf("\t%f", batch.results[i * batch.nstats + j]);
+      printf("\n");
+    }
   }
 
+  free(batch.rngs);
+  if (batch.stats   != NULL) free(batch.stats);
+  if (batch.results != NULL) free(batch.results);
+  if (batch.prefix  != NULL) free(batch.prefix);
   return 0;
 
 fail:
+  if (batch.rngs    != NULL) free(batch.rngs);
+  if (batch.stats   != NULL) free(batch.stats);
+  if (batch.results != NULL) free(batch.results);
+  if (batch.prefix  != NULL) free(batch.prefix);
   return 1;
 }
+
+uint8_t _batch_graphs(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t  i;
+  uint64_t  j;
+  graph_t   g;
+  char     *fname;
+  batch_t  *batch;
+  double   *results;
+
+  batch = ctx;
+  fname = NULL;
+
+  if (batch->prefix != NULL) {
+    fname = malloc(strlen(batch->prefix) + batch->width + 32);
+    if (fname == NULL) goto fail;
+  }
+
+  for (i = start; i < end; i++) {
+
+    rng_set_default(batch->rngs + i);
+
+    if (_generate(batch->args, &g)) goto fail;
+
+    if (batch->prefix != NULL) {
+
+      sprintf(fname, "%s_%0*" PRIu64 ".ngdb", batch->prefix, batch->width, i);
+
+      if (ngdb_write(&g, fname)) {
+        printf("Could not write to %s\n", fname);
+        graph_free(&g);
+        goto fail;
+      }
+    }
+    else {
+
+      results = batch->results + i * batch->nstats;
+
+      if (graph_freeze(&g) || stats_cache_init(&g)) {
+        graph_free(&g);
+        goto fail;
+      }
+
+      for (j = 0; j < batch->nstats; j++)
+        results[j] = _stats[batch->stats[j]].fn(&g);
+    }
+
+    graph_free(&g);
+  }
+
+  if (fname != NULL) free(fname);
+  return 0;
+
+fail:
+  if (fname != NULL) free(fname);
+  return 1;
+}
+
+uint8_t _parse_stats(char *list, uint32_t *nstats, uint32_t *stats) {
+
+  uint32_t  i;
+  uint32_t  j;
+  uint32_t  n;
+  char     *copy;
+  char     *tkn;
+  char     *save;
+
+  n    = 0;
+  copy = strdup(list);
+  if (copy == NULL) goto fail;
+
+  for (tkn = strtok_r(copy, ",", &save);
+       tkn != NULL;
+       tkn = strtok_r(NULL, ",", &save)) {
+
+    for (i = 0; _stats[i].name != NULL; i++) {
+      if (!strcasecmp(tkn, _stats[i].name)) break;
+    }
+
+    if (_stats[i].name == NULL) goto fail;
+
+    /*each statistic is only printed once*/
+    for (j = 0; j < n; j++) {
+      if (stats[j] == i) break;
+    }
+
+    if (j == n) stats[n++] = i;
+  }
+
+  *nstats = n;
+
+  free(copy);
+  return 0;
+
+fail:
+  if (copy != NULL) free(copy);
+  return 1;
+}
+
+double _num_nodes(graph_t *g) {
+  return graph_num_nodes(g);
+}
+
+double _num_edges(graph_t *g) {
+  return graph_num_edges(g);
+}
@@ -0,0 +1,254 @@
+/**
+ * Calculates node measures over a collection of ngdb files which share one
+ * set of nodes - e.g. the graphs of one subject at several thresholds, or
+ * in several time windows. The inputs are loaded one at a time, as layers
+ * of a single multi-layer graph (see graph/graph_layers.h), so the node
+ * labels are only stored once, and each measure is calculated for every
+ * layer in a single pass over the nodes.
+ *
+ * By default, one line is printed for every node, containing the node
+ * ID, its label value, and then the value of each selected measure in
+ * every layer, in input order. With --avg, one line is printed for every
+ * layer instead, containing the average of each measure over all nodes.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "graph/graph_layers.h"
+#include "io/ngdb_graph.h"
+#include "util/startup.h"
+
+typedef struct _args {
+
+  char   **inputs;
+  uint16_t ninputs;
+  uint8_t  degree;
+  uint8_t  clustering;
+  uint8_t  avg;
+  uint16_t nthreads;
+
+} args_t;
+
+static struct argp_option options[] = {
+  {"degree",     'd', NULL,  0, "print the degree of every node (default)"},
+  {"clustering", 'c', NULL,  0, "print the clustering coefficient of "
+                                "every node"},
+  {"avg",        'a', NULL,  0, "print the average of each measure in "
+                                "every layer, rather than node values"},
+  {NULL,         'j', "INT", 0, "number of threads (default: --threads)"},
+  {0}
+};
+
+static char doc[] = "clayers -- calculate node measures over a collection "
+                    "of graphs which share the same nodes";
+
+static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
+
+  args_t  *args;
+  char   **tmp;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'd': args->degree     = 1;         break;
+    case 'c': args->clustering = 1;         break;
+    case 'a': args->avg        = 1;         break;
+    case 'j': args->nthreads   = atoi(arg); break;
+
+    case ARGP_KEY_ARG:
+
+      tmp = realloc(args->inputs, (args->ninputs + 1) * sizeof(char *));
+      if (tmp == NULL) argp_failure(state, 1, 0, "out of memory");
+
+      args->inputs = tmp;
+      args->inputs[args->ninputs++] = arg;
+      break;
+
+    case ARGP_KEY_END:
+      if (args->ninputs == 0) argp_usage(state);
+      if (!args->degree && !args->clustering) args->degree = 1;
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Loads every input, and adds it to the given multi-layer graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _load_layers(
+  args_t         *args, /**< program arguments                     */
+  graph_layers_t *l     /**< uninitialised multi-layer graph       */
+);
+
+/**
+ * Prints the measures, for every node, or averaged over all nodes.
+ */
+static void _print(
+  args_t         *args,    /**< program arguments                     */
+  graph_layers_t *l,       /**< the multi-layer graph                 */
+  uint32_t       *degrees, /**< degrees of every node in every layer,
+                                or NULL                               */
+  double         *clust    /**< clustering coefficients, or NULL      */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t       nvals;
+  uint32_t      *degrees;
+  double        *clust;
+  graph_layers_t l;
+  args_t         args;
+  struct argp    argp = {options, _parse_opt, "INPUT [INPUT ...]", doc};
+
+  degrees = NULL;
+  clust   = NULL;
+
+  memset(&args, 0, sizeof(args));
+  memset(&l,    0, sizeof(l));
+
+  startup("clayers", argc, argv, &argp, &args);
+
+  if (_load_layers(&args, &l)) goto fail;
+
+  nvals = (uint64_t)graph_layers_num_layers(&l) * graph_layers_num_nodes(&l);
+
+  if (args.degree) {
+
+    degrees = malloc((nvals > 0 ? nvals : 1) * sizeof(uint32_t));
+    if (degrees == NULL) {
+      printf("out of memory?!\n");
+      goto fail;
+    }
+
+    if (graph_layers_degree(&l, degrees, args.nthreads)) {
+      printf("error calculating degree\n");
+      goto fail;
+    }
+  }
+
+  if (args.clustering) {
+
+    clust = malloc((nvals > 0 ? nvals : 1) * sizeof(double));
+    if (clust == NULL) {
+      printf("out of memory?!\n");
+      goto fail;
+    }
+
+    if (graph_layers_clustering(&l, clust, args.nthreads)) {
+      printf("error calculating clustering coefficient\n");
+      goto fail;
+    }
+  }
+
+  _print(&args, &l, degrees, clust);
+
+  if (degrees != NULL) free(degrees);
+  if (clust   != NULL) free(clust);
+  graph_layers_free(&l);
+  free(args.inputs);
+  return 0;
+
+fail:
+  if (degrees != NULL) free(degrees);
+  if (clust   != NULL) free(clust);
+  graph_layers_free(&l);
+  return 1;
+}
+
+uint8_t _load_layers(args_t *args, graph_layers_t *l) {
+
+  uint64_t i;
+  graph_t  g;
+
+  for (i = 0; i < args->ninputs; i++) {
+
+    if (ngdb_read(args->inputs[i], &g)) {
+      printf("error reading input file %s\n", args->inputs[i]);
+      goto fail;
+    }
+
+    if (i == 0 && graph_layers_init(l, &g)) {
+      printf("out of memory?!\n");
+      graph_free(&g);
+      goto fail;
+    }
+
+    if (graph_layers_add(l, &g)) {
+      printf("error adding %s - the nodes of every input must be the "
+             "same\n", args->inputs[i]);
+      graph_free(&g);
+      goto fail;
+    }
+
+    graph_free(&g);
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _print(
+  args_t         *args,
+  graph_layers_t *l,
+  uint32_t       *degrees,
+  double         *clust) {
+
+  uint64_t i;
+  uint64_t u;
+  uint32_t n;
+  uint32_t nlayers;
+  double   degsum;
+  double   clustsum;
+
+  n       = graph_layers_num_nodes(l);
+  nlayers = graph_layers_num_layers(l);
+
+  if (args->avg) {
+
+    for (i = 0; i < nlayers; i++) {
+
+      degsum   = 0;
+      clustsum = 0;
+
+      for (u = 0; u < n; u++) {
+        if (degrees != NULL) degsum   += degrees[i*n + u];
+        if (clust   != NULL) clustsum += clust  [i*n + u];
+      }
+
+      printf("%llu", (unsigned long long)i);
+      if (degrees != NULL) printf(" %0.6f", n > 0 ? degsum   / n : 0);
+      if (clust   != NULL) printf(" %0.6f", n > 0 ? clustsum / n : 0);
+      printf("\n");
+    }
+
+    return;
+  }
+
+  for (u = 0; u < n; u++) {
+
+    printf("%llu %u",
+           (unsigned long long)u, graph_layers_get_nodelabel(l, u)->labelval);
+
+    for (i = 0; degrees != NULL && i < nlayers; i++)
+      printf(" %u", degrees[i*n + u]);
+    for (i = 0; clust != NULL && i < nlayers; i++)
+      printf(" %0.6f", clust[i*n + u]);
+
+    printf("\n");
+  }
+}
@@ -0,0 +1,293 @@
+/**
+ * Finds the communities of a ngdb graph with the multilevel Louvain method,
+ * and saves a copy of the graph in which the label value of every node is
+ * set to the ID of its community. The number of communities, and the
+ * modularity of the partition, are printed to standard output.
+ *
+ * If more than one run is requested, or partitions are loaded from other
+ * ngdb files, the result is instead the consensus of the partitions (see
+ * graph/graph_consensus.h). The partitions of the runs differ because each
+ * run visits the nodes in a different random order.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "graph/graph_consensus.h"
+#include "graph/graph_louvain.h"
+#include "stats/stats.h"
+#include "util/rng.h"
+#include "util/startup.h"
+#include "io/ngdb_graph.h"
+
+/**
+ * Maximum number of partition files which may be given.
+ */
+#define MAX_PARTITION_FILES 50
+
+typedef struct _args {
+  char    *input;
+  char    *output;
+  uint8_t  weighted;
+  uint16_t nthreads;
+  uint32_t nruns;
+  double   tau;
+  uint32_t maxiters;
+  uint8_t  nfiles;
+  char    *files[MAX_PARTITION_FILES];
+} args_t;
+
+static char doc[] = "clouvain -- find communities with the Louvain method";
+
+static struct argp_option options[] = {
+  {"weighted", 'w', NULL,  0, "use edge weights (default: false)"},
+  {NULL,       'j', "INT", 0, "number of threads (default: --threads)"},
+  {"runs",     'n', "INT", 0,
+   "number of Louvain runs to find the consensus of (default: 1, or 0 "\
+   "if --partition is given)"},
+  {"partition", 'p', "FILE", 0,
+   "ngdb file whose node labels give a partition to include in the "\
+   "consensus (may be given more than once)"},
+  {"tau",      't', "DOUBLE", 0,
+   "consensus co-assignment threshold (default: 0.5)"},
+  {"iterations", 'i', "INT", 0,
+   "maximum number of consensus iterations (default: 20)"},
+  {0}
+};
+
+static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
+
+  args_t *args;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'w': args->weighted = 1;         break;
+    case 'j': args->nthreads = atoi(arg); break;
+    case 'n': args->nruns    = atoi(arg); break;
+    case 't': args->tau      = atof(arg); break;
+    case 'i': args->maxiters = atoi(arg); break;
+
+    case 'p':
+      if (args->nfiles < MAX_PARTITION_FILES)
+        args->files[args->nfiles++] = arg;
+      break;
+
+    case ARGP_KEY_ARG:
+      if      (state->arg_num == 0) args->input  = arg;
+      else if (state->arg_num == 1) args->output = arg;
+      else                          argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num != 2) argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Creates the partitions for a consensus - the node labels of each of the
+ * partition files, followed by a Louvain run for each of the requested
+ * runs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _load_partitions(
+  graph_t   *g,      /**< the graph                                  */
+  args_t    *args,   /**< the command line arguments                 */
+  uint32_t   nparts, /**< number of partitions                       */
+  uint32_t **parts   /**< place to store the partitions - each is
+                          allocated, and of length num_nodes         */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t       i;
+  graph_t        g;
+  graph_label_t  lbl;
+  uint32_t      *communities;
+  uint32_t     **parts;
+  uint32_t       nparts;
+  uint32_t       ncomms;
+  uint32_t       niters;
+  double         mod;
+  args_t         args;
+  struct argp    argp = {options, _parse_opt, "INPUT OUTPUT", doc};
+
+  communities = NULL;
+  parts       = NULL;
+  nparts      = 0;
+
+  memset(&args, 0, sizeof(args));
+  args.nruns    = UINT32_MAX;
+  args.tau      = CONSENSUS_TAU;
+  args.maxiters = CONSENSUS_MAX_ITERS;
+
+  startup("clouvain", argc, argv, &argp, &args);
+
+  if (args.nruns == UINT32_MAX) args.nruns = (args.nfiles > 0) ? 0 : 1;
+
+  if (args.tau <= 0 || args.tau > 1) {
+    printf("tau must be in the range (0, 1]\n");
+    goto fail;
+  }
+
+  if (ngdb_read(args.input, &g)) {
+    printf("error opening input file %s\n", args.input);
+    goto fail;
+  }
+
+  communities = malloc(graph_num_nodes(&g) * sizeof(uint32_t));
+  if (communities == NULL) {
+    printf("out of memory?\n");
+    goto fail;
+  }
+
+  /*a single run does not need a consensus*/
+  if (args.nfiles == 0 && args.nruns <= 1) {
+
+    if (graph_louvain(
+          &g, args.weighted, args.nthreads, communities, &ncomms, &mod)) {
+      printf("error finding communities (the graph must be undirected, "
+             "and edge weights must be non-negative)\n");
+      goto fail;
+    }
+  }
+  else {
+
+    nparts = args.nfiles + args.nruns;
+
+    parts = calloc(nparts, sizeof(uint32_t *));
+    if (parts == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+
+    if (_load_partitions(&g, &args, nparts, parts)) goto fail;
+
+    if (graph_consensus(&g,
+                        nparts,
+                        parts,
+                        args.tau,
+                        args.maxiters,
+                        args.nthreads,
+                        rng_default(),
+                        communities,
+                        &ncomms,
+                        &niters)) {
+      printf("error finding consensus (the graph must be undirected)\n");
+      goto fail;
+    }
+
+    mod = stats_modularity(&g, ncomms, communities);
+
+    printf("partitions:  %u\n", nparts);
+    printf("iterations:  %u%s\n",
+           niters, (niters == args.maxiters) ? " (not converged)" : "");
+  }
+
+  for (i = 0; i < graph_num_nodes(&g); i++) {
+
+    memcpy(&lbl, graph_get_nodelabel(&g, i), sizeof(graph_label_t));
+    lbl.labelval = communities[i];
+
+    if (graph_set_nodelabel(&g, i, &lbl)) {
+      printf("error labelling node %lu\n", i);
+      goto fail;
+    }
+  }
+
+  if (ngdb_write(&g, args.output)) {
+    printf("error writing to output file %s\n", args.output);
+    goto fail;
+  }
+
+  printf("communities: %u\n",  ncomms);
+  printf("modularity:  %0.6f\n", mod);
+
+  for (i = 0; i < nparts; i++) free(parts[i]);
+  free(parts);
+  free(communities);
+  return 0;
+
+fail:
+  if (parts != NULL) {
+    for (i = 0; i < nparts; i++) {
+      if (parts[i] != NULL) free(parts[i]);
+    }
+    free(parts);
+  }
+  if (communities != NULL) free(communities);
+  return 1;
+}
+
+uint8_t _load_partitions(
+  graph_t *g, args_t *args, uint32_t nparts, uint32_t **parts) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  k;
+  graph_t   pg;
+
+  nnodes = graph_num_nodes(g);
+
+  for (i = 0; i < nparts; i++) {
+
+    parts[i] = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+    if (parts[i] == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+  }
+
+  for (i = 0; i < args->nfiles; i++) {
+
+    if (ngdb_read(args->files[i], &pg)) {
+      printf("error opening partition file %s\n", args->files[i]);
+      goto fail;
+    }
+
+    if (graph_num_nodes(&pg) != nnodes) {
+      printf("partition file %s has a different number of nodes\n",
+             args->files[i]);
+      graph_free(&pg);
+      goto fail;
+    }
+
+    for (j = 0; j < nnodes; j++)
+      parts[i][j] = (uint32_t)graph_get_nodelabel(&pg, j)->labelval;
+
+    graph_free(&pg);
+  }
+
+  for (i = args->nfiles; i < nparts; i++) {
+
+    if (graph_louvain_shuffled(g,
+                               args->weighted,
+                               args->nthreads,
+                               rng_default(),
+                               parts[i],
+                               &k)) {
+      printf("error finding communities (the graph must be undirected, "
+             "and edge weights must be non-negative)\n");
+      goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
@@ -13,7 +13,6 @@
 #include <inttypes.h>
 
 #include "graph/graph.h"
-#include "graph/graph_mask.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 #include "io/analyze75.h"
@@ -107,6 +106,7 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
 int main(int argc, char *argv[]) {
 
+  ngdb_t     *ngdb;
   graph_t     gin;
   graph_t     gout;
   uint32_t    nnodes;
@@ -121,7 +121,13 @@ int main(int argc, char *argv[]) {
 
   startup("cmask", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &gin)) {
+  /*
+   * node labels are loaded first, and then only the
+   * adjacency of the nodes which survive the mask
+   */
+  ngdb = ngdb_open_mmap(args.input);
+  if (ngdb == NULL) ngdb = ngdb_open(args.input);
+  if (ngdb == NULL || ngdb_read_nodes(ngdb, &gin, NULL)) {
     printf("error opening input file %s\n", args.input);
     goto fail;
   }
@@ -151,11 +157,13 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
-  if (graph_mask(&gin, &gout, mask)) {
+  if (ngdb_read_mask(ngdb, &gout, mask)) {
     printf("error masking graph\n");
     goto fail;
   }
 
+  ngdb_close(ngdb);
+
   if (ngdb_write(&gout, args.output)) {
     printf("error writing to output file %s\n", args.output);
     goto fail;
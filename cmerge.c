@@ -17,6 +17,8 @@
 #include <stdio.h>
 
 #include "graph/graph.h"
+#include "graph/graph_aggregate.h"
+#include "graph/graph_builder.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 
@@ -371,28 +373,40 @@ fail:
 static uint8_t _copy_edges(
   graph_t *gin, graph_t *gout, uint32_t *nodemap, uint32_t nnodes) {
 
-  uint64_t  nidx;
-  uint64_t  nbridx;
-  uint64_t  nnbrs;
-  uint32_t *nbrs;
+  uint64_t          i;
+  graph_aggregate_t agg;
+  graph_builder_t   builder;
 
-  for (nidx = 0; nidx < nnodes; nidx++) {
+  memset(&agg,     0, sizeof(graph_aggregate_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (nnodes != graph_num_nodes(gin)) goto fail;
 
-    nnbrs = graph_num_neighbours(gin, nidx);
-    nbrs  = graph_get_neighbours(gin, nidx);
+  /*
+   * the node map assigns every input node to an output
+   * node, so each pair of connected groups is an edge
+   */
+  if (graph_aggregate(&agg, gin, nodemap, graph_num_nodes(gout), 0))
+    goto fail;
 
-    for (nbridx = 0; nbridx < nnbrs; nbridx++) {
+  if (graph_builder_init(&builder, gout, agg.npairs)) goto fail;
 
-      if (nodemap[nidx] == nodemap[nbrs[nbridx]]) continue;
+  for (i = 0; i < agg.npairs; i++) {
 
-      if (graph_add_edge(gout, nodemap[nidx], nodemap[nbrs[nbridx]], 1))
-        goto fail;
-    }
+    if (graph_builder_add(
+          &builder, agg.pairs[2*i], agg.pairs[2*i+1], 1))
+      goto fail;
   }
 
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  graph_aggregate_free(&agg);
   return 0;
 
 fail:
+  graph_builder_free(&builder);
+  graph_aggregate_free(&agg);
   return 1;
 }
 
@@ -1,6 +1,24 @@
 /**
  * Calculates and prints a bunch of statistics over a graph.
  *
+ * In batch mode (--batch), graph-level statistics are calculated for a
+ * list of graphs, and printed as a table, with one row per graph. Graphs
+ * are loaded by a separate thread, so loading the next graphs overlaps
+ * with calculating statistics on the current ones, and are handed out to
+ * a pool of worker threads. Small graphs are processed with a single
+ * thread each; larger graphs (see --intra) are also parallelised
+ * internally.
+ *
+ * With --stream, the graph is not loaded - the components, and the
+ * --approxpaths estimates, are calculated by streaming the references of
+ * the file (see io/ngdb_extmem.h), for graphs which do not fit in memory.
+ * With --packed, the adjacency is loaded into the compact format (see
+ * graph/graph_compact.h), which is several times smaller than a graph_t,
+ * and the measures which only need the adjacency are calculated from it.
+ * If only those measures are requested, and the graph would not fit in
+ * what is left of the --mem-budget (see util/memacct.h), --packed is used
+ * automatically.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
@@ -9,15 +27,29 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <inttypes.h>
 #include <argp.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "graph/graph.h"
+#include "graph/graph_cmpindex.h"
+#include "graph/graph_compact.h"
+#include "graph/graph_reorder.h"
+#include "util/memacct.h"
 #include "util/startup.h"
+#include "util/parallel.h"
+#include "util/progress.h"
+#include "io/mat.h"
+#include "io/ngdb_extmem.h"
 #include "io/ngdb_graph.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "stats/stats_plan.h"
+#include "stats/stats_partial.h"
+#include "stats/stats_reference.h"
 
 
 static char doc[] = "cnet - calculate and print statistics "\
@@ -33,7 +65,11 @@ static struct argp_option options[] = {
   {"lefficiency",   'f', NULL,  0, "print the local efficiency"},
   {"degree",        'g', NULL,  0, "print the average degree"},
   {"numpaths",      'h', NULL,  0, "print the number of paths"},
+  {"lognumpaths",   'X', NULL,  0, "print the natural logarithm of the "\
+                                   "number of paths, which does not "\
+                                   "overflow"},
   {"closeness",     'i', NULL,  0, "print the closeness centrality"},
+  {"harmonic",      '3', NULL,  0, "print the harmonic centrality"},
   {"betweenness",   'j', NULL,  0, "print the betweenness centrality"},
   {"comppops",      'k', NULL,  0, "print the nodes in each component"},
   {"clustering",    'l', NULL,  0, "print the clustering coefficient"},
@@ -54,7 +90,9 @@ static struct argp_option options[] = {
   {"all",           'x', NULL,  0, "print everything"},
   {"gefficiency",   'y', NULL,  0, "print the global efficiency"},
   {"mutualinfo",    'z', NULL,  0, "print the normalised mutual information"},
-  {"compspan",      'A', NULL,  0, "print spatial span of each component"},
+  {"compspan",      'A', NULL,  0, "print the spatial extent of each "\
+                                   "component - its bounding box, "\
+                                   "centroid, and approximate span"},
   {"nodestart",     'B', "INT", 0, "start index for printing node values"},
   {"nodeend",       'C', "INT", 0, "end index for printing node values"},
   {"alledges",      'D', NULL,  0, "print all edges"},
@@ -63,6 +101,110 @@ static struct argp_option options[] = {
   {"degcent",       'F', NULL,  0, "print the degree centrality for each " \
                                    "node"},
   {"chira",         'G', NULL,  0, "print the Chira community strength"},
+  {"approxbetw",    'H', "NSAMPLES", OPTION_ARG_OPTIONAL,
+                                   "print an approximation of the "\
+                                   "betweenness centrality, sampling "\
+                                   "NSAMPLES source nodes (default 1% of "\
+                                   "nodes)"},
+  {"triangles",     'I', NULL,  0, "print the number of triangles"},
+  {"coreness",      'J', NULL,  0, "print the core number of each node, "\
+                                   "and the largest core number"},
+  {"regions",       'Y', NULL,  0, "print the density of the edges within "\
+                                   "and leaving each region (nodes with "\
+                                   "the same label value)"},
+  {"strength",      '7', NULL,  0, "print the strength (sum of edge "\
+                                   "weights) of each node"},
+  {"wclustering",   '8', NULL,  0, "print the weighted (Onnela) clustering "\
+                                   "coefficient"},
+  {"wdegcent",      '9', NULL,  0, "print the weighted degree centrality "\
+                                   "of each node"},
+  {"diameter",      0xD1A0, NULL, 0, "print the exact diameter"},
+  {"eccentricity",  0xECC0, NULL, 0, "print the exact eccentricity of each "\
+                                   "node, and the diameter"},
+  {"roles",         '6', NULL,  0, "print the participation coefficient and "\
+                                   "within-module degree z-score of each "\
+                                   "node, with modules given by the node "\
+                                   "label values"},
+  {"richclub",      '5', NULL,  0, "print the rich-club coefficient for "\
+                                   "every degree; with --refgraphs, also "\
+                                   "print the coefficients of, and "\
+                                   "normalised against, an ensemble of "\
+                                   "degree-preserving random graphs"},
+  {"cache",         'K', "FILE", OPTION_ARG_OPTIONAL,
+                                   "load cached statistics from FILE "\
+                                   "(default INPUT.cache) if it was saved "\
+                                   "from the same graph, and save them "\
+                                   "on exit"},
+  {"compact",       'L', NULL,  0, "store pair-level statistics at reduced "\
+                                   "precision, to save memory"},
+  {"cachebudget",   'M', "MB",  0, "limit the stats cache to MB megabytes, "\
+                                   "evicting the least recently used "\
+                                   "statistics"},
+  {"cachereport",   'N', NULL,  0, "print the memory used by each cached "\
+                                   "statistic"},
+  {"refgraphs",     'O', "INT", 0, "with --ersmallworld or --richclub, "\
+                                   "compare against an "\
+                                   "ensemble of INT random reference "\
+                                   "graphs, rather than analytic "\
+                                   "Erdos-Renyi approximations"},
+  {"reftype",       'P', "er|degree", 0,
+                                   "reference graph type for --refgraphs: "\
+                                   "Erdos-Renyi (default), or "\
+                                   "degree-preserving"},
+  {"refcache",      'Q', "FILE", 0, "load reference values from FILE, if "\
+                                   "it exists, and save them on exit"},
+  {"batch",         'R', "FILE", 0, "batch mode: print graph-level "\
+                                   "statistics, as a table, for every "\
+                                   "graph listed (one per line) in FILE, "\
+                                   "or on standard input if FILE is -"},
+  {"workers",       'S', "INT", 0, "batch mode: number of graphs to "\
+                                   "process concurrently (default: "\
+                                   "--threads)"},
+  {"intra",         'T', "INT", 0, "batch mode: also parallelise the "\
+                                   "statistics for graphs with at least "\
+                                   "INT nodes (default: 10000)"},
+  {"binary",        'U', "PREFIX", 0, "write node-level values, and the "\
+                                   "--ebmatrix/--psmatrix matrices, to "\
+                                   "binary mat files PREFIX.nodes.mat, "\
+                                   "PREFIX.eb.mat and PREFIX.ps.mat, "\
+                                   "instead of printing them"},
+  {"partial",       'V', "FILE", 0, "calculate the --pathlength, "\
+                                   "--closeness, --gefficiency, "\
+                                   "--numpaths and --betweenness sums "\
+                                   "from the sources in the --nodestart/"\
+                                   "--nodeend range only, and save them "\
+                                   "to FILE, to be merged with ccombine"},
+  {"weighted",      'W', "weight|inverse", 0,
+                                   "print the weighted path length, "\
+                                   "global efficiency and betweenness, "\
+                                   "with edge lengths equal to the edge "\
+                                   "weights, or to their inverse"},
+  {"approxpaths",   'Z', "NSAMPLES", OPTION_ARG_OPTIONAL,
+                                   "estimate the graph-level path length "\
+                                   "and global efficiency (and so the "\
+                                   "small-world index) from searches from "\
+                                   "NSAMPLES source nodes (default 1% of "\
+                                   "nodes, at least 100), and print the "\
+                                   "estimates and their 95% confidence "\
+                                   "intervals"},
+  {"clusterr",      '2', "SE", 0,  "with --approxclust, stop sampling once "\
+                                   "the standard error of the estimate is "\
+                                   "no greater than SE, and print the "\
+                                   "error"},
+  {"reorder",       '4', "rcm|degree|spatial", 0,
+                                   "renumber the nodes before calculating "\
+                                   "statistics, to speed up traversal; "\
+                                   "node values are still printed in "\
+                                   "terms of the original node IDs"},
+  {"stream",        0x57E0, NULL, 0, "do not load the graph, but stream it "\
+                                   "from the file - only --nodes, "\
+                                   "--edges, --components and "\
+                                   "--approxpaths are available"},
+  {"packed",        0x9AC0, NULL, 0, "load the graph into the compact "\
+                                   "adjacency format - only --nodes, "\
+                                   "--edges, --connected, --density, "\
+                                   "--degree, --components and "\
+                                   "--approxpaths are available"},
   {"ebmatrix",      '0', NULL,  0, "print edge-betweenness matrix"},
   {"psmatrix",      '1', NULL,  0, "print path-sharing matrix"},
   {0}
@@ -70,6 +212,28 @@ static struct argp_option options[] = {
 
 struct args {
   char    *input;
+  char    *cachefile;
+  uint8_t  cache;
+  uint8_t  compact;
+  uint64_t cachebudget;
+  uint8_t  cachereport;
+  uint32_t refgraphs;
+  uint8_t  reftype;
+  char    *refcache;
+  char    *batch;
+  char    *binary;
+  char    *partial;
+  uint16_t workers;
+  uint32_t intra;
+  uint8_t  weighted;
+  uint8_t  wlength;
+  int32_t  approxpaths;
+  double   clusterr;
+  uint8_t  reorder;
+  uint8_t  order;
+  uint32_t *perm;
+  uint8_t  stream;
+  uint8_t  packed;
   int64_t  nodestart;
   int64_t  nodeend;
   uint8_t  assortativity;
@@ -80,6 +244,7 @@ struct args {
   uint8_t  lefficiency;
   uint8_t  degree;
   uint8_t  numpaths;
+  uint8_t  lognumpaths;
   uint8_t  closeness;
   uint8_t  betweenness;
   uint8_t  comppops;
@@ -102,6 +267,18 @@ struct args {
   uint8_t  avgedist;
   uint8_t  degcent;
   uint8_t  chira;
+  int32_t  approxbetw;
+  uint8_t  triangles;
+  uint8_t  coreness;
+  uint8_t  regions;
+  uint8_t  harmonic;
+  uint8_t  richclub;
+  uint8_t  roles;
+  uint8_t  strength;
+  uint8_t  wclustering;
+  uint8_t  wdegcent;
+  uint8_t  diameter;
+  uint8_t  eccentricity;
   
   uint8_t  ebmatrix;
   uint8_t  psmatrix;
@@ -121,6 +298,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'f': a->lefficiency   = 0xFF; break;
     case 'g': a->degree        = 0xFF; break;
     case 'h': a->numpaths      = 0xFF; break;
+    case 'X': a->lognumpaths   = 0xFF; break;
     case 'i': a->closeness     = 0xFF; break;
     case 'j': a->betweenness   = 0xFF; break;
     case 'k': a->comppops      = 0xFF; break;
@@ -142,7 +320,8 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'v': a->edgedist      = 0xFF; break;
     case 'w': a->labelvals     = 0xFF; break;
     case 'x': 
-      memset(&(a->assortativity), 0xFF, sizeof(struct args)-sizeof(char*));
+      memset(&(a->assortativity), 0xFF,
+             sizeof(struct args) - offsetof(struct args, assortativity));
       break;
     case 'y': a->gefficiency   = 0xFF;      break;
     case 'z': a->mutualinfo    = 0xFF;      break;
@@ -153,7 +332,61 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'E': a->avgedist      = 0xFF;      break;
     case 'F': a->degcent       = 0xFF;      break;
     case 'G': a->chira         = 0xFF;      break;
+    case 'H':
+      if (arg == 0) a->approxbetw = -1;
+      else          a->approxbetw = atoi(arg);
+      break;
+    case 'I': a->triangles     = 0xFF;      break;
+    case 'J': a->coreness      = 0xFF;      break;
+    case 'Y': a->regions       = 0xFF;      break;
+    case '3': a->harmonic      = 0xFF;      break;
+    case '5': a->richclub      = 0xFF;      break;
+    case '6': a->roles         = 0xFF;      break;
+    case '7': a->strength      = 0xFF;      break;
+    case '8': a->wclustering   = 0xFF;      break;
+    case '9': a->wdegcent      = 0xFF;      break;
+    case 0xD1A0: a->diameter     = 0xFF;    break;
+    case 0xECC0: a->eccentricity = 0xFF;    break;
+    case 'Z':
+      if (arg == 0) a->approxpaths = -1;
+      else          a->approxpaths = atoi(arg);
+      break;
+    case 'L': a->compact       = 1;         break;
+    case 'M': a->cachebudget   = atof(arg) * 1048576; break;
+    case 'N': a->cachereport   = 1;         break;
+    case 'O': a->refgraphs     = atoi(arg); break;
+    case 'P':
+      if      (!strcmp(arg, "er"))     a->reftype = STATS_REF_ER;
+      else if (!strcmp(arg, "degree")) a->reftype = STATS_REF_DEGREE;
+      else                             argp_usage(state);
+      break;
+    case 'Q': a->refcache      = arg;       break;
+    case 'R': a->batch         = arg;       break;
+    case 'S': a->workers       = atoi(arg); break;
+    case 'T': a->intra         = atoi(arg); break;
+    case 'U': a->binary        = arg;       break;
+    case 'V': a->partial       = arg;       break;
+    case 'W':
+      a->weighted = 1;
+      if      (!strcmp(arg, "weight"))  a->wlength = DIJKSTRA_LENGTH_WEIGHT;
+      else if (!strcmp(arg, "inverse")) a->wlength = DIJKSTRA_LENGTH_INVERSE;
+      else                              argp_usage(state);
+      break;
+    case 'K':
+      a->cache     = 1;
+      a->cachefile = arg;
+      break;
     
+    case '2': a->clusterr      = atof(arg); break;
+    case '4':
+      a->reorder = 1;
+      if      (!strcmp(arg, "rcm"))     a->order = GRAPH_ORDER_RCM;
+      else if (!strcmp(arg, "degree"))  a->order = GRAPH_ORDER_DEGREE;
+      else if (!strcmp(arg, "spatial")) a->order = GRAPH_ORDER_SPATIAL;
+      else                              argp_usage(state);
+      break;
+    case 0x57E0: a->stream     = 1;         break;
+    case 0x9AC0: a->packed     = 1;         break;
     case '0': a->ebmatrix      = 0xFF;      break;
     case '1': a->psmatrix      = 0xFF;      break;
     case ARGP_KEY_ARG:
@@ -161,7 +394,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
       else                          argp_usage(state);
       break;
     case ARGP_KEY_END:
-      if (state->arg_num < 1) argp_usage(state);
+      if (state->arg_num < 1 && a->batch == NULL) argp_usage(state);
       break;
     default:
       return ARGP_ERR_UNKNOWN;
@@ -172,14 +405,364 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 static void print_matrix(
   graph_t *g, uint8_t (*func)(graph_t *g, uint32_t u, double *d));
 static void print_matrix_line(graph_t *g, uint32_t nidx, double *data);
-static void print_stats(graph_t *g, struct args *args);
+static uint8_t print_stats(graph_t *g, struct args *args);
+static void print_cache_report(graph_t *g);
+
+/**
+ * \return the number of source nodes to sample for --approxpaths, or 0 if
+ * it was not given.
+ */
+static uint32_t path_samples(
+  uint32_t     nnodes, /**< number of nodes in the graph */
+  struct args *args    /**< program arguments            */
+);
+
+/**
+ * Runs --stream mode - prints the statistics which can be calculated
+ * without loading the graph into memory.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream(
+  struct args *args /**< program arguments */
+);
+
+/**
+ * \return non-0 if the given arguments only request the statistics which
+ * are available in --packed mode, 0 otherwise.
+ */
+static uint8_t _packable(
+  struct args *args /**< program arguments */
+);
+
+/**
+ * Runs --packed mode - loads the adjacency of the graph into the compact
+ * format, and prints the statistics which can be calculated from it.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _packed(
+  struct args *args /**< program arguments */
+);
+
+/**
+ * Prints the number of nodes in each region, and the densities of the
+ * edges within the region, and between the region and the rest of the
+ * graph (see stats_regions).
+ */
+/**
+ * Renumbers the nodes of the given graph with the given ordering (see
+ * --reorder), in place.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t reorder_graph(
+  graph_t      *g,     /**< the graph                                   */
+  graph_order_t order, /**< the ordering                                */
+  uint32_t    **perm   /**< place to store a pointer to the permutation
+                            (new ID -> original ID), or NULL if it is
+                            not needed                                  */
+);
+
+static void print_regions(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Prints the rich-club coefficient of the graph for every degree and, if
+ * --refgraphs was given, the reference and normalised coefficients (see
+ * stats_reference_rich_club).
+ */
+static void print_rich_club(
+  graph_t     *g,   /**< the graph         */
+  struct args *args /**< program arguments */
+);
+
+/**
+ * Calculates partial path statistics from the sources in the
+ * --nodestart/--nodeend range, for the measures which were requested,
+ * and saves them to the --partial file (see stats_partial.h).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t write_partial(
+  graph_t     *g,   /**< the graph         */
+  struct args *args /**< program arguments */
+);
 static void print_edge_vals(
   graph_t *g, double (*func)(graph_t *g, uint32_t u, uint32_t v),
   char *prefix);
 
+/**
+ * Prints the distance of every edge, as print_edge_vals does with
+ * stats_edge_distance, but calculated in one sweep (see
+ * stats_edge_distances).
+ */
+static void print_edge_distances(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Size of the row labels (statistic names) in the --binary node file.
+ */
+#define NODE_MAT_LABEL_SIZE 32
+
+/**
+ * Size of the header data (a description of the columns) in the
+ * --binary node file.
+ */
+#define NODE_MAT_HDR_SIZE 128
+
+/**
+ * Destination for node-level values - either standard output, as text,
+ * or a mat file (see --binary).
+ */
+typedef struct _node_out {
+
+  mat_t    *mat;  /**< mat file, or NULL to print values as text   */
+  uint64_t  row;  /**< next row of the mat file to write           */
+  uint32_t *perm; /**< node permutation (see --reorder), or NULL   */
+  double   *buf;  /**< space to put values back into original node
+                       order, if perm is not NULL                  */
+
+} node_out_t;
+
+/**
+ * If --binary was given, and any node-level statistics were requested,
+ * creates the mat file for node-level values. The file has one row for
+ * each statistic, labelled with its name, containing the values for
+ * nodes [nodestart, nodeend), so each statistic is stored as a
+ * contiguous vector.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t open_node_out(
+  struct args *args,      /**< program arguments           */
+  uint32_t     nodestart, /**< first node                  */
+  uint32_t     nodeend,   /**< one past the last node      */
+  node_out_t  *out        /**< destination to initialise   */
+);
+
+/**
+ * Prints the values of a node-level statistic for nodes [start, end), as
+ * text, or writes them to the next row of the mat file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t print_node_vals(
+  node_out_t *out,   /**< destination              */
+  char       *name,  /**< name of the statistic    */
+  uint32_t    start, /**< first node               */
+  uint32_t    end,   /**< one past the last node   */
+  double     *vals   /**< value for each node      */
+);
+
+/**
+ * Writes a node * node matrix of edge values to the given mat file. The
+ * values for the neighbours of each node are provided by func, in the
+ * same way as for print_matrix; values for pairs of nodes which are not
+ * neighbours are 0. For undirected graphs, the file is symmetric.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t write_matrix(
+  graph_t *g,      /**< the graph                           */
+  char    *fname,  /**< name of the file to create          */
+  uint8_t (*func)( /**< provides the edge values for a node */
+    graph_t *g,    /**< the graph                           */
+    uint32_t u,    /**< the node                            */
+    double  *d)    /**< place to store the values           */
+);
+
+/**
+ * Calculates the path-sharing value of every edge of node u, in the same
+ * way as --psmatrix does in text mode, for use with write_matrix.
+ *
+ * \return 0.
+ */
+static uint8_t pathsharing_row(
+  graph_t *g, /**< the graph                 */
+  uint32_t u, /**< the node                  */
+  double  *d  /**< place to store the values */
+);
+
+/**
+ * Graph-level statistics which may be printed in batch mode.
+ */
+typedef enum {
+  BATCH_NODES = 0,
+  BATCH_EDGES,
+  BATCH_DISCONNECTED,
+  BATCH_CONNECTED,
+  BATCH_DENSITY,
+  BATCH_DEGREE,
+  BATCH_COMPONENTS,
+  BATCH_CLUSTERING,
+  BATCH_APPROXCLUST,
+  BATCH_TRIANGLES,
+  BATCH_PATHLENGTH,
+  BATCH_GEFFICIENCY,
+  BATCH_LEFFICIENCY,
+  BATCH_REFCLUSTERING,
+  BATCH_REFPATHLENGTH,
+  BATCH_SMALLWORLD,
+  BATCH_ASSORTATIVITY,
+  BATCH_MODULARITY,
+  BATCH_CHIRA,
+  BATCH_NINTRA,
+  BATCH_NINTER,
+  BATCH_LABELVALS,
+  BATCH_NEWMANERROR,
+  BATCH_MUTUALINFO,
+  BATCH_DIAMETER,
+  BATCH_NUM_COLS
+} batch_col_id_t;
+
+/**
+ * A batch mode table column - its name, and the offset of the flag in
+ * struct args which selects it.
+ */
+typedef struct _batch_col {
+
+  char  *name;
+  size_t flag;
+
+} batch_col_t;
+
+static batch_col_t _batch_cols[] = {
+  {"nodes",         offsetof(struct args, nodes)},
+  {"edges",         offsetof(struct args, edges)},
+  {"disconnected",  offsetof(struct args, connected)},
+  {"connected",     offsetof(struct args, connected)},
+  {"density",       offsetof(struct args, density)},
+  {"degree",        offsetof(struct args, degree)},
+  {"components",    offsetof(struct args, components)},
+  {"clustering",    offsetof(struct args, clustering)},
+  {"approxclust",   offsetof(struct args, approxclust)},
+  {"triangles",     offsetof(struct args, triangles)},
+  {"pathlength",    offsetof(struct args, pathlength)},
+  {"gefficiency",   offsetof(struct args, gefficiency)},
+  {"lefficiency",   offsetof(struct args, lefficiency)},
+  {"refclustering", offsetof(struct args, ersmallworld)},
+  {"refpathlength", offsetof(struct args, ersmallworld)},
+  {"smallworld",    offsetof(struct args, ersmallworld)},
+  {"assortativity", offsetof(struct args, assortativity)},
+  {"modularity",    offsetof(struct args, modularity)},
+  {"chira",         offsetof(struct args, chira)},
+  {"nintra",        offsetof(struct args, nintra)},
+  {"ninter",        offsetof(struct args, ninter)},
+  {"labelvals",     offsetof(struct args, labelvals)},
+  {"newmanerror",   offsetof(struct args, newmanerror)},
+  {"mutualinfo",    offsetof(struct args, mutualinfo)},
+  {"diameter",      offsetof(struct args, diameter)}
+};
+
+/**
+ * A graph which has been loaded, and is waiting to be processed.
+ */
+typedef struct _batch_graph {
+
+  uint32_t idx;    /**< index of the graph in the batch    */
+  uint8_t  loaded; /**< 1 if the graph was loaded, 0 if it
+                        could not be loaded                */
+  graph_t  g;      /**< the graph                          */
+
+} batch_graph_t;
+
+/**
+ * State shared by the loader and worker threads in batch mode.
+ */
+typedef struct _batch {
+
+  struct args   *args;
+  char         **inputs;  /**< graph file names                     */
+  uint32_t       ninputs; /**< number of graphs                     */
+  uint32_t       ncols;   /**< number of selected columns           */
+  uint32_t       cols[BATCH_NUM_COLS]; /**< selected column IDs    */
+  double        *results; /**< ninputs*ncols results                */
+  uint8_t       *status;  /**< per graph: 0 pending, 1 done, 2
+                               failed                               */
+  uint32_t       nprinted; /**< number of table rows printed        */
+  uint8_t        failed;   /**< set if any graph failed            */
+
+  batch_graph_t *queue;   /**< loaded graphs, waiting for a worker  */
+  uint32_t       qsize;   /**< queue capacity                       */
+  uint32_t       qhead;   /**< index of first graph in queue        */
+  uint32_t       qcount;  /**< number of graphs in queue            */
+  uint8_t        done;    /**< set when all graphs have been loaded */
+
+  pthread_mutex_t lock;
+  pthread_cond_t  notfull;
+  pthread_cond_t  notempty;
+
+} batch_t;
+
+/**
+ * Runs batch mode - calculates the selected graph-level statistics for
+ * every graph listed in args->batch, and prints a table of them.
+ *
+ * \return 0 on success, non-0 if any graph could not be processed.
+ */
+static uint8_t _batch(
+  struct args *args /**< program arguments */
+);
+
+/**
+ * Reads the list of graph files for batch mode, one per line.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _batch_read_list(
+  char       *fname,   /**< list file name, or - for stdin */
+  char     ***inputs,  /**< place to store file names       */
+  uint32_t   *ninputs  /**< place to store number of files  */
+);
+
+/**
+ * Loader thread - loads every graph in the batch, in order, and adds it to
+ * the queue.
+ */
+static void * _batch_loader(
+  void *ctx /**< pointer to a batch_t struct */
+);
+
+/**
+ * parallel_for function, run once per worker. Takes graphs from the queue
+ * until there are none left, and calculates statistics on them.
+ *
+ * \return 0.
+ */
+static uint8_t _batch_worker(
+  uint64_t  start,  /**< unused                      */
+  uint64_t  end,    /**< unused                      */
+  uint16_t  thread, /**< calling thread              */
+  void     *ctx     /**< pointer to a batch_t struct */
+);
+
+/**
+ * Calculates the selected statistics for the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _batch_stats(
+  batch_t *batch,  /**< the batch                       */
+  graph_t *g,      /**< the graph                       */
+  char    *input,  /**< graph file name                 */
+  double  *row     /**< place to store the ncols values */
+);
+
+/**
+ * Prints all rows which are ready, in order, from the row after the last
+ * one printed. Must be called with the batch lock held.
+ */
+static void _batch_flush(
+  batch_t *batch /**< the batch */
+);
+
 int main (int argc, char *argv[]) {
 
   graph_t     g;
+  struct stat st;
   struct args args;
   struct argp argp = {options, _parse_opt, "INPUT", doc};
 
@@ -189,24 +772,166 @@ int main (int argc, char *argv[]) {
 
   startup("cnet", argc, argv, &argp, &args);
 
+  if (args.batch  != NULL) return _batch(&args);
+  if (args.stream)         return _stream(&args);
+
+  /*
+   * the in-memory graph is at least as
+   * large as the file it was read from
+   */
+  if (!args.packed               &&
+      _packable(&args)           &&
+      !stat(args.input, &st)     &&
+      !memacct_fits(st.st_size)) {
+    printf("%s does not fit in the memory budget - loading a packed copy\n",
+           args.input);
+    args.packed = 1;
+  }
+
+  if (args.packed)         return _packed(&args);
+
+  /*
+   * the stats cache, partial results, and the
+   * outputs which list node IDs are all in terms
+   * of the renumbered nodes, so are not allowed
+   */
+  if (args.reorder &&
+      (args.nodestart != -1 || args.nodeend != -1 ||
+       args.cache           || args.partial != NULL ||
+       args.comppops        || args.alledges        ||
+       args.edgedist        || args.ebmatrix        || args.psmatrix)) {
+    printf("--reorder cannot be used with --nodestart, --nodeend, "
+           "--cache, --partial, --comppops, --alledges, --edgedist, "
+           "--ebmatrix or --psmatrix\n");
+    goto fail;
+  }
+
   if (ngdb_read(args.input, &g) != 0) {
     printf("error loading %s\n", args.input);
     goto fail;
   }
 
+  if (args.reorder && reorder_graph(&g, args.order, &args.perm)) {
+    printf("error reordering graph\n");
+    goto fail;
+  }
+
+  /*the graph is not modified, so it can be frozen for faster traversal*/
+  if (graph_freeze(&g)) {
+    printf("error freezing graph\n");
+    goto fail;
+  }
+
   if (stats_cache_init(&g)) {
     printf("error initialising stats cache\n");
     goto fail;
   }
 
-  print_stats(&g, &args);
+  if (args.compact && stats_cache_compact_pairs(&g, 1)) {
+    printf("error configuring stats cache\n");
+    goto fail;
+  }
+
+  if (args.cachebudget > 0 &&
+      stats_cache_set_budget(&g, args.cachebudget)) {
+    printf("error configuring stats cache\n");
+    goto fail;
+  }
+
+  if (stats_cache_set_path_samples(&g, path_samples(graph_num_nodes(&g), &args))) {
+    printf("error configuring stats cache\n");
+    goto fail;
+  }
+
+  if (args.cache && args.cachefile == NULL) {
+
+    args.cachefile = malloc(strlen(args.input) + 7);
+    if (args.cachefile == NULL) goto fail;
+    sprintf(args.cachefile, "%s.cache", args.input);
+  }
+
+  if (args.cache && stats_cache_load(&g, args.cachefile)) {
+    printf("error loading stats cache %s\n", args.cachefile);
+    goto fail;
+  }
+
+  if (args.refcache && stats_reference_load(args.refcache)) {
+    printf("error loading reference cache %s\n", args.refcache);
+    goto fail;
+  }
+
+  if (args.partial != NULL) {
+
+    if (graph_is_directed(&g)) {
+      printf("--partial is not supported for directed graphs\n");
+      goto fail;
+    }
+
+    if (write_partial(&g, &args)) {
+      printf("error writing partial results %s\n", args.partial);
+      goto fail;
+    }
+  }
+
+  else if (print_stats(&g, &args)) {
+    printf("error writing binary output %s\n", args.binary);
+    goto fail;
+  }
+
+  if (args.cachereport) print_cache_report(&g);
+
+  if (args.cache && stats_cache_save(&g, args.cachefile)) {
+    printf("error saving stats cache %s\n", args.cachefile);
+    goto fail;
+  }
+
+  if (args.refcache && stats_reference_save(args.refcache)) {
+    printf("error saving reference cache %s\n", args.refcache);
+    goto fail;
+  }
+
+  return 0;
+fail:
+  return 1;
+}
+
+uint8_t write_partial(graph_t *g, struct args *args) {
+
+  uint32_t        numnodes;
+  uint32_t        nodestart;
+  uint32_t        nodeend;
+  uint8_t         measures;
+  stats_partial_t p;
 
+  memset(&p, 0, sizeof(stats_partial_t));
+
+  numnodes = graph_num_nodes(g);
+  measures = 0;
+
+  if (args->nodestart == -1) nodestart = 0;
+  else                       nodestart = args->nodestart;
+  if (args->nodeend   == -1) nodeend   = numnodes;
+  else                       nodeend   = args->nodeend;
+
+  if (args->pathlength || args->closeness) measures |= STATS_PLAN_PATHLENGTH;
+  if (args->gefficiency)                   measures |= STATS_PLAN_EFFICIENCY;
+  if (args->numpaths)                      measures |= STATS_PLAN_NUMPATHS;
+  if (args->betweenness)                   measures |= STATS_PLAN_BETWEENNESS;
+
+  progress_begin(PROGRESS_SOURCES, nodeend - nodestart);
+  if (stats_partial_calc(g, measures, nodestart, nodeend, 0, &p)) goto fail;
+  progress_end(PROGRESS_SOURCES);
+  if (stats_partial_save(&p, args->partial))                     goto fail;
+
+  stats_partial_free(&p);
   return 0;
+
 fail:
+  stats_partial_free(&p);
   return 1;
 }
 
-void print_stats(graph_t *g, struct args *args) {
+uint8_t print_stats(graph_t *g, struct args *args) {
 
   uint64_t       i;
   uint64_t       j;
@@ -216,33 +941,88 @@ void print_stats(graph_t *g, struct args *args) {
   uint32_t       numcmps;
   double         degree;
   double         degcent;
+  double         strength;
+  double         wclustering;
+  double         wdegcent;
   double         swidx;
+  stats_ref_t    ref;
   double         pathlength;
   double         locefficiency;
   uint32_t       connected;
   double         clustering;
   double         closeness;
+  double         harmonic;
   double         betweenness;
+  double         approxbetw;
+  double         approxerr;
+  double         clusterr;
+  double        *approxvals;
+  stats_approx_paths_t approxpaths;
+  double         wpathlength;
+  double         wefficiency;
+  double         wbetweenness;
+  double        *wbetw;
+  stats_paths_t  wpaths;
+  stats_paths_t  lpaths;
+  uint32_t      *sources;
+  double        *nodevals;
+  double        *vals;
+  node_out_t     out;
+  uint32_t      *inv;
+  uint32_t       n;
+  char          *fname;
+  uint64_t       ntriangles;
+  uint32_t      *cores;
+  uint32_t       maxcore;
+  uint32_t      *ecc;
+  double         diameter;
+  stats_span_t  *spans;
   
   uint32_t      *components;
+  uint32_t      *cmpnodes;
+  uint32_t       ncmpnodes;
   array_t        cmpsizes;
   graph_label_t *label;
   double         tmp;
   uint32_t       nlblvals;
   uint32_t      *lblvals;
+  uint8_t        measures;
 
   degree         = 0;
   degcent        = 0;
+  strength       = 0;
+  wclustering    = 0;
+  wdegcent       = 0;
   swidx          = 0;
   pathlength     = 0;
   connected      = 0;
   locefficiency  = 0;
   clustering     = 0;
   closeness      = 0;
+  harmonic       = 0;
   betweenness    = 0;
+  approxbetw     = 0;
+  approxerr      = 0;
+  wpathlength    = 0;
+  wefficiency    = 0;
+  wbetweenness   = 0;
   nlblvals       = 0;
   
+  maxcore        = 0;
+  diameter       = 0;
+  
   components     = NULL;
+  cores          = NULL;
+  ecc            = NULL;
+  spans          = NULL;
+  vals           = NULL;
+  nodevals       = NULL;
+  fname          = NULL;
+  inv            = NULL;
+  out.mat        = NULL;
+  out.row        = 0;
+  out.perm       = NULL;
+  out.buf        = NULL;
   array_create(&cmpsizes, sizeof(uint32_t), 10);
 
   numnodes  = graph_num_nodes(g);
@@ -253,12 +1033,90 @@ void print_stats(graph_t *g, struct args *args) {
   if (args->nodeend   == -1) nodeend   = numnodes;
   else                       nodeend   = args->nodeend; 
 
+  if (nodeend   > numnodes) nodeend   = numnodes;
+  if (nodestart > nodeend)  nodestart = nodeend;
+
   components = calloc(numnodes, sizeof(uint32_t));
+  vals       = calloc(numnodes, sizeof(double));
+  if (vals == NULL) goto fail;
+
+  if (open_node_out(args, nodestart, nodeend, &out)) goto fail;
+
+  /*
+   * If the nodes have been renumbered, values are
+   * printed in original node order - inv maps
+   * original node IDs to the renumbered IDs
+   */
+  if (args->perm != NULL) {
+
+    out.perm = args->perm;
+    out.buf  = malloc(numnodes * sizeof(double));
+    inv      = malloc(numnodes * sizeof(uint32_t));
+
+    if (out.buf == NULL) goto fail;
+    if (inv     == NULL) goto fail;
+
+    for (i = 0; i < numnodes; i++) inv[args->perm[i]] = i;
+  }
+
+  /*
+   * When printing values for every node, node-level
+   * statistics are first calculated for all nodes in
+   * one (parallel) pass, which populates the cache
+   */
+  if (nodestart == 0 && nodeend == numnodes)
+    nodevals = calloc(numnodes, sizeof(double));
+
+  /*
+   * The shortest path measures are calculated
+   * together, from one set of searches
+   */
+  measures = 0;
+  if (args->betweenness)  measures |= STATS_PLAN_BETWEENNESS;
+
+  /*graph-level values are estimated with --approxpaths*/
+  if (args->approxpaths == 0) {
+    if (args->gefficiency) measures |= STATS_PLAN_EFFICIENCY;
+    if (args->ersmallworld && args->refgraphs == 0)
+      measures |= STATS_PLAN_PATHLENGTH;
+  }
+
+  if (nodevals != NULL) {
+    if (args->pathlength) measures |= STATS_PLAN_PATHLENGTH;
+    if (args->closeness)  measures |= STATS_PLAN_PATHLENGTH;
+    if (args->harmonic)   measures |= STATS_PLAN_HARMONIC;
+    if (args->numpaths)   measures |= STATS_PLAN_NUMPATHS;
+  }
+
+  if (measures != 0) progress_begin(PROGRESS_SOURCES, numnodes);
+  stats_plan_paths(g, measures);
+  progress_end(PROGRESS_SOURCES);
+
+  /*in binary mode, each label property is a separate row*/
+  if (args->nodelabel && out.mat != NULL) {
+
+    for (i = nodestart; i < nodeend; i++)
+      vals[i] = graph_get_nodelabel(g, i)->labelval;
+    if (print_node_vals(&out, "label", nodestart, nodeend, vals)) goto fail;
 
-  if (args->nodelabel) {
+    for (i = nodestart; i < nodeend; i++)
+      vals[i] = graph_get_nodelabel(g, i)->xval;
+    if (print_node_vals(&out, "x", nodestart, nodeend, vals)) goto fail;
+
+    for (i = nodestart; i < nodeend; i++)
+      vals[i] = graph_get_nodelabel(g, i)->yval;
+    if (print_node_vals(&out, "y", nodestart, nodeend, vals)) goto fail;
+
+    for (i = nodestart; i < nodeend; i++)
+      vals[i] = graph_get_nodelabel(g, i)->zval;
+    if (print_node_vals(&out, "z", nodestart, nodeend, vals)) goto fail;
+  }
+
+  else if (args->nodelabel) {
 
     for (i = nodestart; i < nodeend; i++) {
-      label = graph_get_nodelabel(g,i);
+      n     = (inv != NULL) ? inv[i] : i;
+      label = graph_get_nodelabel(g,n);
       printf("label %" PRIu64 ":\t%u,%f,%f,%f\n", i, 
         label->labelval, 
         label->xval, 
@@ -271,157 +1129,445 @@ void print_stats(graph_t *g, struct args *args) {
   if (args->degree) {
 
     for (i = nodestart; i < nodeend; i++) {
-      tmp = stats_degree(g, i);
-      degree += tmp;
-
-      printf("degree %" PRIu64 ":\t%f\n", i, tmp);
+      vals[i] = stats_degree(g, i);
+      degree += vals[i];
     }
-    printf("\n");
+    if (print_node_vals(&out, "degree", nodestart, nodeend, vals)) goto fail;
   }
 
   if (args->degcent) {
 
     for (i = nodestart; i < nodeend; i++) {
-      tmp = stats_degree_centrality(g, i);
-      degcent += tmp;
-
-      printf("degree centraliy %" PRIu64 ":\t%f\n", i, tmp);
+      vals[i] = stats_degree_centrality(g, i);
+      degcent += vals[i];
     }
-    printf("\n");
+    if (print_node_vals(
+          &out, "degree centraliy", nodestart, nodeend, vals)) goto fail;
   } 
 
-  if (args->ersmallworld) {
-    swidx = stats_smallworld_index(g);
-  }
+  if (args->strength || args->wdegcent) {
 
-  if (args->clustering) {
+    if (nodevals != NULL) stats_cache_node_strength(g, -1, nodevals);
 
     for (i = nodestart; i < nodeend; i++) {
-      stats_cache_node_clustering(g, i, &tmp);
-      clustering += tmp;
-
-      printf("clustering %" PRIu64 ":\t%f\n", i, tmp);
+      stats_cache_node_strength(g, i, &tmp);
+      strength += tmp;
+      vals[i]   = tmp;
     }
-    printf("\n");
+    if (args->strength &&
+        print_node_vals(&out, "strength", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->pathlength) {
+  if (args->wdegcent) {
 
     for (i = nodestart; i < nodeend; i++) {
-      stats_cache_node_pathlength(g, i, &tmp);
-      pathlength += tmp;
+      vals[i]   = stats_weighted_degree_centrality(g, i);
+      wdegcent += vals[i];
+    }
+    if (print_node_vals(
+          &out, "weighted degree centrality", nodestart, nodeend, vals))
+      goto fail;
+  }
 
-      printf("pathlength %" PRIu64 ":\t%f\n", i, tmp);
+  if (args->wclustering) {
+
+    /*every node is calculated in one parallel pass*/
+    if (stats_cache_node_wclustering(g, -1, vals)) {
+      for (i = 0; i < numnodes; i++) vals[i] = NAN;
     }
-    printf("\n");
+
+    for (i = nodestart; i < nodeend; i++) wclustering += vals[i];
+
+    if (print_node_vals(
+          &out, "weighted clustering", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->closeness) {
+  if (args->coreness) {
+
+    cores = calloc(numnodes, sizeof(uint32_t));
+    if (cores == NULL) goto fail;
+
+    /*core numbers are only defined for undirected graphs*/
+    if (stats_cache_node_coreness(g, -1, cores)) {
+      free(cores);
+      cores = NULL;
+    }
 
     for (i = nodestart; i < nodeend; i++) {
-      tmp = stats_closeness_centrality(g, i);
-      closeness += tmp;
-      
-      printf("closeness %" PRIu64 ":\t%f\n", i, tmp);
+      if (cores != NULL) vals[i] = cores[i];
+      else               vals[i] = NAN;
     }
-    printf("\n");
+
+    /*the largest core number is over all nodes*/
+    for (i = 0; i < numnodes && cores != NULL; i++) {
+      if (cores[i] > maxcore) maxcore = cores[i];
+    }
+
+    if (print_node_vals(&out, "coreness", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->betweenness) {
+  if (args->eccentricity) {
+
+    ecc = calloc(numnodes, sizeof(uint32_t));
+    if (ecc == NULL) goto fail;
+
+    /*eccentricities are only calculated for undirected graphs*/
+    if (stats_cache_node_eccentricity(g, -1, ecc)) {
+      free(ecc);
+      ecc = NULL;
+    }
 
     for (i = nodestart; i < nodeend; i++) {
-      stats_cache_betweenness_centrality(g, i, &tmp);
-      betweenness += tmp;
-      
-      printf("betweenness %" PRIu64 ":\t%f\n", i, tmp);
+      if (ecc != NULL) vals[i] = ecc[i];
+      else             vals[i] = NAN;
     }
-    printf("\n");
+
+    if (print_node_vals(&out, "eccentricity", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->lefficiency) {
+  /*the diameter is cached along with the eccentricities*/
+  if (args->diameter || args->eccentricity)
+    diameter = stats_cache_diameter(g);
 
-    for (i = nodestart; i < nodeend; i++) {
+  if (args->roles) {
 
-      stats_cache_node_local_efficiency(g, i, &tmp);
-      locefficiency += tmp;
+    if (stats_cache_node_participation(g, -1, vals)) goto fail;
+    if (print_node_vals(&out, "participation", nodestart, nodeend, vals))
+      goto fail;
 
-      printf("efficiency %" PRIu64 ":\t%f\n", i, tmp);
-    }
-    printf("\n");
+    /*the z-scores were cached along with the participation*/
+    if (stats_cache_node_zscore(g, -1, vals)) goto fail;
+    if (print_node_vals(&out, "zscore", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->numpaths) {
+  if (args->ersmallworld && args->refgraphs == 0) {
+    swidx = stats_smallworld_index(g);
+  }
 
-    for (i = nodestart; i < nodeend; i++) {
+  if (args->ersmallworld && args->refgraphs > 0) {
 
-      stats_cache_node_numpaths(g, i, &tmp);
-      printf("numpaths %" PRIu64 ":\t%f\n", i, tmp);
+    if (stats_reference(
+          g, args->reftype, args->refgraphs, 0, &ref) == 0) {
+      swidx = stats_reference_smallworld_index(g, &ref);
+    }
+    else {
+      ref.clustering = NAN;
+      ref.pathlength = NAN;
+      swidx          = NAN;
     }
-    printf("\n");
   }
 
-  if (args->components) {
-    stats_num_components(g, 1, &cmpsizes, components);
+  if (args->clustering) {
+
+    if (nodevals != NULL) stats_cache_node_clustering(g, -1, nodevals);
+
     for (i = nodestart; i < nodeend; i++) {
-      printf("component %" PRIu64 ":\t%u\n", i, components[i]);
-    }
-    for (i = 0; i < cmpsizes.size; i++) {
-      printf("component %" PRIu64 " size:\t%u\n", i,
-             ((uint32_t *)(cmpsizes.data))[i]);
+      stats_cache_node_clustering(g, i, &tmp);
+      clustering += tmp;
+      vals[i] = tmp;
     }
-    printf("\n");
+    if (print_node_vals(&out, "clustering", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->comppops) {
-    stats_num_components(g, 1, &cmpsizes, components);
+  if (args->pathlength) {
 
-    for (i = 0; i < cmpsizes.size; i++) {
-      printf("component %" PRIu64 " population: ", i);
+    /*
+     * calculating the characteristic path length
+     * populates the cache for every node in one
+     * (parallel) pass
+     */
+    if (nodestart == 0 && nodeend == numnodes)
+      stats_cache_graph_pathlength(g);
 
-      for (j = 0; j < numnodes; j++) {
-        if (components[j] == i) printf("%" PRIu64 " ", (j+1));
-      }
-      printf("\n");
+    for (i = nodestart; i < nodeend; i++) {
+      stats_cache_node_pathlength(g, i, &tmp);
+      pathlength += tmp;
+      vals[i] = tmp;
     }
+    if (print_node_vals(&out, "pathlength", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->labelvals) {
-    nlblvals = graph_num_labelvals(g);
-    lblvals  = graph_get_labelvals(g);
-    
+  if (args->closeness) {
 
-    for (i = 0; i < nlblvals; i++) {
-      tmp = stats_num_labelled_nodes(g, lblvals[i]);
-      printf("label value %" PRIu64 ": %u (%0.0f)\n", i, lblvals[i], tmp);
+    for (i = nodestart; i < nodeend; i++) {
+      vals[i] = stats_closeness_centrality(g, i);
+      closeness += vals[i];
     }
+    if (print_node_vals(&out, "closeness", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->compspan) {
-    numcmps = stats_cache_num_components(g);
+  if (args->harmonic) {
 
-    for (i = 0; i < numcmps; i++) {
+    for (i = nodestart; i < nodeend; i++) {
+      stats_cache_node_harmonic(g, i, &tmp);
+      harmonic += tmp;
+      vals[i]   = tmp;
+    }
+    if (print_node_vals(&out, "harmonic", nodestart, nodeend, vals))
+      goto fail;
+  }
+
+  if (args->betweenness) {
 
-      printf("component %" PRIu64 " span: %0.6f\n",
-             i, stats_component_span(g, i));
+    for (i = nodestart; i < nodeend; i++) {
+      stats_cache_betweenness_centrality(g, i, &tmp);
+      betweenness += tmp;
+      vals[i] = tmp;
     }
+    if (print_node_vals(&out, "betweenness", nodestart, nodeend, vals))
+      goto fail;
   }
 
-  if (args->avgedist) {
+  if (args->approxbetw) {
 
-    for (i = 0; i < numnodes; i++) {
+    if (args->approxbetw < 0) args->approxbetw = numnodes/100;
+    if (args->approxbetw < 1) args->approxbetw = 1;
+
+    approxvals = calloc(numnodes, sizeof(double));
+
+    if (approxvals != NULL &&
+        !stats_approx_betweenness(g, args->approxbetw, approxvals)) {
+
+      for (i = nodestart; i < nodeend; i++)
+        approxbetw += approxvals[i];
 
-      printf("avg edge distance %" PRIu64 ": %0.6f\n",
-             i, stats_avg_edge_distance(g, i));
+      if (print_node_vals(
+            &out, "approx. betweenness", nodestart, nodeend, approxvals)) {
+        free(approxvals);
+        goto fail;
+      }
+
+      approxerr = stats_approx_betweenness_error(
+        numnodes, numnodes, args->approxbetw, 0.05);
     }
-  }
 
-  degree         /= (nodeend - nodestart);
+    /*the binary file has a row for every requested statistic*/
+    else if (out.mat != NULL) {
+
+      for (i = nodestart; i < nodeend; i++) vals[i] = NAN;
+
+      if (print_node_vals(
+            &out, "approx. betweenness", nodestart, nodeend, vals)) {
+        if (approxvals != NULL) free(approxvals);
+        goto fail;
+      }
+    }
+
+    if (approxvals != NULL) free(approxvals);
+  }
+
+  if (args->weighted) {
+
+    memset(&wpaths, 0, sizeof(stats_paths_t));
+
+    wbetw              = calloc(numnodes, sizeof(double));
+    wpaths.pathlength  = calloc(numnodes, sizeof(double));
+    wpaths.invdist     = calloc(numnodes, sizeof(double));
+
+    if (wbetw == NULL || wpaths.pathlength == NULL || wpaths.invdist == NULL ||
+        stats_weighted_brandes(
+          g, NULL, 0, 0, args->wlength, wbetw, &wpaths)) {
+
+      if (wbetw             != NULL) free(wbetw);
+      if (wpaths.pathlength != NULL) free(wpaths.pathlength);
+      if (wpaths.invdist    != NULL) free(wpaths.invdist);
+      goto fail;
+    }
+
+    for (i = 0; i < numnodes; i++) {
+
+      wefficiency += wpaths.invdist[i];
+
+      if (numnodes > 2) wbetw[i] /= ((numnodes-1.0)*(numnodes-2.0));
+      else              wbetw[i]  = 0;
+    }
+
+    if (numnodes > 1) wefficiency /= ((double)numnodes*(numnodes-1));
+
+    for (i = nodestart; i < nodeend; i++) {
+      wpathlength  += wpaths.pathlength[i];
+      wbetweenness += wbetw[i];
+    }
+
+    if (print_node_vals(&out,
+                        "weighted pathlength",
+                        nodestart,
+                        nodeend,
+                        wpaths.pathlength) ||
+        print_node_vals(&out,
+                        "weighted betweenness",
+                        nodestart,
+                        nodeend,
+                        wbetw)) {
+      free(wbetw);
+      free(wpaths.pathlength);
+      free(wpaths.invdist);
+      goto fail;
+    }
+
+    free(wbetw);
+    free(wpaths.pathlength);
+    free(wpaths.invdist);
+  }
+
+  if (args->lefficiency) {
+
+    if (nodevals != NULL) stats_cache_node_local_efficiency(g, -1, nodevals);
+
+    for (i = nodestart; i < nodeend; i++) {
+
+      stats_cache_node_local_efficiency(g, i, &tmp);
+      locefficiency += tmp;
+      vals[i]        = tmp;
+    }
+    if (print_node_vals(&out, "efficiency", nodestart, nodeend, vals))
+      goto fail;
+  }
+
+  if (args->numpaths) {
+
+    if (nodevals != NULL) stats_cache_node_numpaths(g, -1, nodevals);
+
+    for (i = nodestart; i < nodeend; i++)
+      stats_cache_node_numpaths(g, i, vals+i);
+
+    if (print_node_vals(&out, "numpaths", nodestart, nodeend, vals))
+      goto fail;
+  }
+
+  if (args->lognumpaths) {
+
+    /*only the sources in the requested range are searched*/
+    memset(&lpaths, 0, sizeof(stats_paths_t));
+    lpaths.lognumpaths = vals;
+
+    sources = malloc((nodeend - nodestart + 1) * sizeof(uint32_t));
+    if (sources == NULL) goto fail;
+
+    for (i = nodestart; i < nodeend; i++) sources[i - nodestart] = i;
+
+    if (nodeend == nodestart ||
+        stats_brandes_paths(
+          g, sources, nodeend - nodestart, 0, NULL, &lpaths)) {
+      for (i = nodestart; i < nodeend; i++) vals[i] = NAN;
+    }
+
+    free(sources);
+
+    if (print_node_vals(&out, "lognumpaths", nodestart, nodeend, vals))
+      goto fail;
+  }
+
+  if (args->components) {
+    stats_num_components(g, 1, &cmpsizes, components);
+
+    if (out.mat != NULL) {
+
+      for (i = nodestart; i < nodeend; i++) vals[i] = components[i];
+
+      if (print_node_vals(&out, "component", nodestart, nodeend, vals))
+        goto fail;
+    }
+    else {
+      for (i = nodestart; i < nodeend; i++) {
+        n = (inv != NULL) ? inv[i] : i;
+        printf("component %" PRIu64 ":\t%u\n", i, components[n]);
+      }
+    }
+    for (i = 0; i < cmpsizes.size; i++) {
+      printf("component %" PRIu64 " size:\t%u\n", i,
+             ((uint32_t *)(cmpsizes.data))[i]);
+    }
+    printf("\n");
+  }
+
+  if (args->comppops) {
+    stats_num_components(g, 1, &cmpsizes, components);
+
+    for (i = 0; i < cmpsizes.size; i++) {
+      printf("component %" PRIu64 " population: ", i);
+
+      if (graph_cmpindex_nodes(g, i, &cmpnodes, &ncmpnodes)) goto fail;
+
+      for (j = 0; j < ncmpnodes; j++)
+        printf("%u ", cmpnodes[j] + 1);
+      printf("\n");
+    }
+  }
+
+  if (args->labelvals) {
+    nlblvals = graph_num_labelvals(g);
+    lblvals  = graph_get_labelvals(g);
+    
+
+    for (i = 0; i < nlblvals; i++) {
+      tmp = stats_num_labelled_nodes(g, lblvals[i]);
+      printf("label value %" PRIu64 ": %u (%0.0f)\n", i, lblvals[i], tmp);
+    }
+  }
+
+  if (args->regions)  print_regions(g);
+  if (args->richclub) print_rich_club(g, args);
+
+  /*
+   * the spans of every component are
+   * estimated together, in linear time
+   */
+  if (args->compspan) {
+    numcmps = stats_cache_num_components(g);
+
+    spans = calloc(numcmps + 1, sizeof(stats_span_t));
+    if (spans == NULL) goto fail;
+
+    if (stats_component_spans(g, numcmps, spans)) goto fail;
+
+    for (i = 0; i < numcmps; i++) {
+
+      printf("component %" PRIu64 " span: %0.6f\n", i, spans[i].span);
+      printf("component %" PRIu64 " span bound: %0.6f\n",
+             i, spans[i].spanbound);
+      printf("component %" PRIu64 " bounds: %f,%f,%f,%f,%f,%f\n", i,
+             spans[i].min[0], spans[i].min[1], spans[i].min[2],
+             spans[i].max[0], spans[i].max[1], spans[i].max[2]);
+      printf("component %" PRIu64 " centroid: %f,%f,%f\n", i,
+             spans[i].centroid[0],
+             spans[i].centroid[1],
+             spans[i].centroid[2]);
+    }
+  }
+
+  if (args->avgedist) {
+
+    for (i = 0; i < numnodes; i++) {
+
+      n = (inv != NULL) ? inv[i] : i;
+      stats_cache_node_edgedist(g, n, &tmp);
+      printf("avg edge distance %" PRIu64 ": %0.6f\n", i, tmp);
+    }
+  }
+
+  degree         /= (nodeend - nodestart);
   degcent        /= (nodeend - nodestart);
+  strength       /= (nodeend - nodestart);
+  wdegcent       /= (nodeend - nodestart);
   clustering     /= (nodeend - nodestart);
+  wclustering    /= (nodeend - nodestart);
   pathlength     /= connected;
   locefficiency  /= connected;
   closeness      /= (nodeend - nodestart);
+  harmonic       /= (nodeend - nodestart);
   betweenness    /= (nodeend - nodestart);
+  approxbetw     /= (nodeend - nodestart);
+  wpathlength    /= (nodeend - nodestart);
+  wbetweenness   /= (nodeend - nodestart);
   
   if (args->nodes)
     printf("nodes:                 %u\n",    numnodes);
@@ -435,23 +1581,59 @@ void print_stats(graph_t *g, struct args *args) {
     printf("avg degree:            %f\n",    degree);
   if (args->degcent)
     printf("avg degree centrality: %f\n",    degcent); 
+  if (args->strength)
+    printf("avg strength:          %f\n",    strength);
+  if (args->wdegcent)
+    printf("avg w. degree cent.:   %f\n",    wdegcent);
+  if (args->coreness) {
+    if (cores == NULL) printf("max coreness:          n/a\n");
+    else               printf("max coreness:          %u\n", maxcore);
+  }
+  if (args->diameter || args->eccentricity) {
+    if (diameter < 0) printf("diameter:              n/a\n");
+    else              printf("diameter:              %0.0f\n", diameter);
+  }
   if (args->components) {
     printf("components:            %u\n",    cmpsizes.size);
   }
   if (args->clustering)
     printf("avg clustering:        %f\n",    clustering);
-  if (args->approxclust) {
+  if (args->wclustering)
+    printf("avg w. clustering:     %f\n",    wclustering);
+  if (args->approxclust && args->clusterr > 0) {
+    if (args->approxclust < 0) args->approxclust = numnodes/10;
+    if (stats_approx_clustering_err(
+          g, args->approxclust, args->clusterr, &tmp, &clusterr)) {
+      printf("approx. clustering:    n/a\n");
+    }
+    else {
+      printf("approx. clustering:    %f\n", tmp);
+      printf("approx. clust. error:  %f\n", clusterr);
+    }
+  }
+  else if (args->approxclust) {
     if (args->approxclust < 0) args->approxclust = numnodes/10;
     printf("approx. clustering:    %f\n",    stats_cache_approx_clustering(
                                                g,args->approxclust));
   }
+  if (args->triangles) {
+    if (stats_num_triangles(g, &ntriangles))
+      printf("triangles:             n/a\n");
+    else
+      printf("triangles:             %" PRIu64 "\n", ntriangles);
+  }
   if (args->pathlength)
     printf("avg pathlength:        %f\n",    pathlength);
   if (args->gefficiency)
     printf("global efficiency:     %f\n",    stats_cache_global_efficiency(g));
   if (args->lefficiency)
     printf("avg local efficiency:  %f\n",    locefficiency);
-  if (args->ersmallworld) {
+  if (args->ersmallworld && args->refgraphs > 0) {
+    printf("ref clustering:        %f\n",    ref.clustering);
+    printf("ref pathlength:        %f\n",    ref.pathlength);
+    printf("small-world index:     %f\n",    swidx);
+  }
+  else if (args->ersmallworld) {
     printf("er clustering:         %f\n",    stats_er_clustering(g));
     printf("er pathlength:         %f\n",    stats_er_pathlength(g));
     printf("small-world index:     %f\n",    swidx);
@@ -460,8 +1642,32 @@ void print_stats(graph_t *g, struct args *args) {
     printf("assortativity:         %f\n",    stats_cache_assortativity(g));
   if (args->closeness)
     printf("closeness:             %f\n",    closeness);
+  if (args->harmonic)
+    printf("harmonic:              %f\n",    harmonic);
   if (args->betweenness)
     printf("betweenness:           %f\n",    betweenness);
+  if (args->approxbetw) {
+    printf("approx. betweenness:   %f\n",    approxbetw);
+    printf("approx. betw. error:   %f\n",    approxerr);
+  }
+  if (args->approxpaths) {
+    if (stats_cache_approx_paths(
+          g, stats_cache_path_samples(g), &approxpaths)) {
+      printf("approx. pathlength:    n/a\n");
+      printf("approx. efficiency:    n/a\n");
+    }
+    else {
+      printf("approx. pathlength:    %f\n", approxpaths.pathlength);
+      printf("approx. path. error:   %f\n", approxpaths.pathlength_err);
+      printf("approx. efficiency:    %f\n", approxpaths.efficiency);
+      printf("approx. effic. error:  %f\n", approxpaths.efficiency_err);
+    }
+  }
+  if (args->weighted) {
+    printf("weighted pathlength:   %f\n",    wpathlength);
+    printf("weighted gefficiency:  %f\n",    wefficiency);
+    printf("weighted betweenness:  %f\n",    wbetweenness);
+  }
   if (args->modularity)
     printf("modularity:            %f\n",    stats_cache_modularity(g));
   if (args->chira)
@@ -478,81 +1684,1210 @@ void print_stats(graph_t *g, struct args *args) {
     printf("mutual info:           %f\n",    stats_graph_mutual_information(g));
   }
 
-  if (args->ebmatrix) print_matrix(   g, &stats_cache_edge_betweenness);
-  if (args->psmatrix)
+  if (args->binary != NULL && (args->ebmatrix || args->psmatrix)) {
+
+    fname = malloc(strlen(args->binary) + 8);
+    if (fname == NULL) goto fail;
+  }
+
+  if (args->binary != NULL && args->ebmatrix) {
+
+    sprintf(fname, "%s.eb.mat", args->binary);
+    if (write_matrix(g, fname, &stats_cache_edge_betweenness)) goto fail;
+  }
+  else if (args->ebmatrix) print_matrix(g, &stats_cache_edge_betweenness);
+
+  if (args->binary != NULL && args->psmatrix) {
+
+    sprintf(fname, "%s.ps.mat", args->binary);
+    if (write_matrix(g, fname, &pathsharing_row)) goto fail;
+  }
+  else if (args->psmatrix)
     print_edge_vals(g, &stats_edge_pathsharing, "path-sharing");
-  if (args->edgedist)
-    print_edge_vals(g, &stats_edge_distance, "distance");
+
+  if (args->edgedist) print_edge_distances(g);
   if (args->alledges)
     print_edge_vals(g, &graph_get_weight, "edge");
+
+  if (out.mat  != NULL && mat_close(out.mat)) {
+    out.mat = NULL;
+    goto fail;
+  }
+  if (nodevals != NULL) free(nodevals);
+  if (cores    != NULL) free(cores);
+  if (ecc      != NULL) free(ecc);
+  if (spans    != NULL) free(spans);
+  if (fname    != NULL) free(fname);
+  if (out.buf  != NULL) free(out.buf);
+  if (inv      != NULL) free(inv);
+  free(vals);
+
+  return 0;
+
+fail:
+  if (out.mat  != NULL) mat_close(out.mat);
+  if (nodevals != NULL) free(nodevals);
+  if (cores    != NULL) free(cores);
+  if (ecc      != NULL) free(ecc);
+  if (spans    != NULL) free(spans);
+  if (vals     != NULL) free(vals);
+  if (fname    != NULL) free(fname);
+  if (out.buf  != NULL) free(out.buf);
+  if (inv      != NULL) free(inv);
+  return 1;
 }
 
-void print_matrix(
-  graph_t *g, uint8_t (*func)(graph_t *g, uint32_t u, double *d)) {
+uint32_t path_samples(uint32_t nnodes, struct args *args) {
 
-  double  *d;
-  uint64_t i;
-  uint32_t nnodes;
-  
-  nnodes = graph_num_nodes(g);
-  d      = malloc(nnodes*sizeof(double));
+  uint32_t nsamples;
 
-  printf("    | ");
-  for (i = 0; i < nnodes; i++) printf("%03" PRIu64 "     ", i); printf("\n");
-  printf("    | ");
-  for (i = 0; i < nnodes; i++) printf("--------"); printf("\n");
+  if (args->approxpaths == 0) return 0;
+  if (args->approxpaths >  0) return args->approxpaths;
 
-  for (i = 0; i < nnodes; i++) {
-    func(g, i, d);
-    print_matrix_line(g, i, d);
-  }
-  free(d);
+  nsamples = nnodes / 100;
+  if (nsamples < 100) nsamples = 100;
+
+  return nsamples;
 }
 
-void print_matrix_line(graph_t *g, uint32_t nidx, double *data) {
+uint8_t _stream(struct args *args) {
+
+  uint64_t              i;
+  uint64_t              nodestart;
+  uint64_t              nodeend;
+  uint32_t              nnodes;
+  uint32_t              ncmps;
+  uint32_t             *components;
+  uint8_t              *rest;
+  ngdb_t               *ngdb;
+  array_t               cmpsizes;
+  stats_approx_paths_t  approxpaths;
+  struct args           chk;
+
+  ngdb       = NULL;
+  components = NULL;
+
+  memset(&cmpsizes, 0, sizeof(array_t));
+
+  /*
+   * every measure other than those which
+   * can be streamed needs the loaded graph
+   */
+  memcpy(&chk, args, sizeof(struct args));
+  chk.nodes      = 0;
+  chk.edges      = 0;
+  chk.components = 0;
+
+  rest = (uint8_t *)&chk.assortativity;
+
+  for (i = 0; i < sizeof(struct args) - offsetof(struct args, assortativity);
+       i++) {
+    if (rest[i] != 0) break;
+  }
 
-  uint64_t i;
-  uint64_t j;
-  uint32_t nnodes;
+  if (i < sizeof(struct args) - offsetof(struct args, assortativity) ||
+      args->cache   || args->reorder   || args->partial != NULL ||
+      args->binary  || args->weighted  || args->refgraphs) {
+    printf("only --nodes, --edges, --components and --approxpaths "
+           "can be used with --stream\n");
+    goto fail;
+  }
 
-  nnodes = graph_num_nodes(g);
+  ngdb = ngdb_open_mmap(args->input);
+  if (ngdb == NULL) ngdb = ngdb_open(args->input);
+  if (ngdb == NULL) {
+    printf("error loading %s\n", args->input);
+    goto fail;
+  }
 
-  j = 0;
-  printf("%03u | ", nidx);
-  for (i = 0; i < nnodes; i++) {
+  nnodes = ngdb_num_nodes(ngdb);
 
-    if (!graph_are_neighbours(g, nidx, i)) printf("------- ");
-    else printf("%7.3f ", data[j++]);
+  if (args->nodestart == -1) nodestart = 0;
+  else                       nodestart = args->nodestart;
+  if (args->nodeend   == -1) nodeend   = nnodes;
+  else                       nodeend   = args->nodeend;
+
+  if (nodeend   > nnodes)  nodeend   = nnodes;
+  if (nodestart > nodeend) nodestart = nodeend;
+
+  if (args->components) {
+
+    components = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+    if (components == NULL)                             goto fail;
+    if (array_create(&cmpsizes, sizeof(uint32_t), 10)) goto fail;
+
+    if (ngdb_ext_components(ngdb, components, &ncmps, &cmpsizes)) {
+      printf("error finding components\n");
+      goto fail;
+    }
+
+    for (i = nodestart; i < nodeend; i++)
+      printf("component %" PRIu64 ":\t%u\n", i, components[i]);
+
+    for (i = 0; i < cmpsizes.size; i++) {
+      printf("component %" PRIu64 " size:\t%u\n", i,
+             ((uint32_t *)(cmpsizes.data))[i]);
+    }
+    printf("\n");
   }
-  printf("\n");
+
+  if (args->nodes)
+    printf("nodes:                 %u\n", nnodes);
+  if (args->edges)
+    printf("edges:                 %u\n", ngdb_num_refs(ngdb) / 2);
+  if (args->components)
+    printf("components:            %u\n", ncmps);
+
+  if (args->approxpaths) {
+    if (ngdb_ext_approx_paths(
+          ngdb, path_samples(nnodes, args), &approxpaths)) {
+      printf("approx. pathlength:    n/a\n");
+      printf("approx. efficiency:    n/a\n");
+    }
+    else {
+      printf("approx. pathlength:    %f\n", approxpaths.pathlength);
+      printf("approx. path. error:   %f\n", approxpaths.pathlength_err);
+      printf("approx. efficiency:    %f\n", approxpaths.efficiency);
+      printf("approx. effic. error:  %f\n", approxpaths.efficiency_err);
+    }
+  }
+
+  ngdb_close(ngdb);
+  if (components    != NULL) free(components);
+  if (cmpsizes.data != NULL) array_free(&cmpsizes);
+  return 0;
+
+fail:
+  if (ngdb          != NULL) ngdb_close(ngdb);
+  if (components    != NULL) free(components);
+  if (cmpsizes.data != NULL) array_free(&cmpsizes);
+  return 1;
 }
 
-void print_edge_vals(
-  graph_t *g,
-  double (*func)(graph_t *g, uint32_t u, uint32_t v),
-  char *prefix) {
+uint8_t _packable(struct args *args) {
+
+  uint64_t     i;
+  uint8_t     *rest;
+  struct args  chk;
+
+  /*
+   * the compact graph has no labels or
+   * stats cache, and is unweighted
+   */
+  memcpy(&chk, args, sizeof(struct args));
+  chk.nodes      = 0;
+  chk.edges      = 0;
+  chk.connected  = 0;
+  chk.density    = 0;
+  chk.degree     = 0;
+  chk.components = 0;
+
+  rest = (uint8_t *)&chk.assortativity;
+
+  for (i = 0; i < sizeof(struct args) - offsetof(struct args, assortativity);
+       i++) {
+    if (rest[i] != 0) return 0;
+  }
 
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  nnodes;
-  uint32_t  nnbrs;
-  uint32_t *nbrs;
-  double    val;
+  if (args->cache   || args->reorder   || args->partial != NULL ||
+      args->binary  || args->weighted  || args->refgraphs)
+    return 0;
 
-  nnodes = graph_num_nodes(g);
+  return 1;
+}
 
-  for (i = 0; i < nnodes; i++) {
-    
-    nnbrs = graph_num_neighbours(g, i);
-    nbrs  = graph_get_neighbours(g, i);
+uint8_t _packed(struct args *args) {
+
+  uint64_t              i;
+  uint64_t              nodestart;
+  uint64_t              nodeend;
+  uint32_t              nnodes;
+  uint32_t              ncmps;
+  uint32_t              connected;
+  double                degree;
+  uint32_t             *components;
+  graph_compact_t       c;
+  array_t               cmpsizes;
+  stats_approx_paths_t  approxpaths;
+
+  components = NULL;
+  degree     = 0;
+
+  memset(&c,        0, sizeof(graph_compact_t));
+  memset(&cmpsizes, 0, sizeof(array_t));
+
+  if (!_packable(args)) {
+    printf("only --nodes, --edges, --connected, --density, --degree, "
+           "--components and --approxpaths can be used with --packed\n");
+    goto fail;
+  }
 
-    for (j = 0; j < nnbrs; j++) {
+  if (ngdb_read_compact(args->input, &c, 0)) {
+    printf("error loading %s\n", args->input);
+    goto fail;
+  }
 
-      if (nbrs[j] < i) continue;
+  nnodes = c.nnodes;
 
-      val = func(g, i, nbrs[j]);
+  if (args->nodestart == -1) nodestart = 0;
+  else                       nodestart = args->nodestart;
+  if (args->nodeend   == -1) nodeend   = nnodes;
+  else                       nodeend   = args->nodeend;
 
-      printf("%s %" PRIu64 " -- %u: %0.6f\n", prefix, i, nbrs[j], val);
+  if (nodeend   > nnodes)  nodeend   = nnodes;
+  if (nodestart > nodeend) nodestart = nodeend;
+
+  if (args->degree) {
+
+    for (i = nodestart; i < nodeend; i++) {
+      printf("degree %" PRIu64 ":\t%f\n", i,
+             (double)graph_compact_num_neighbours(&c, i));
+      degree += graph_compact_num_neighbours(&c, i);
+    }
+    printf("\n");
+
+    degree /= (nodeend - nodestart);
+  }
+
+  if (args->components) {
+
+    components = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+    if (components == NULL)                             goto fail;
+    if (array_create(&cmpsizes, sizeof(uint32_t), 10)) goto fail;
+
+    if (graph_compact_components(&c, components, &ncmps, &cmpsizes)) {
+      printf("error finding components\n");
+      goto fail;
     }
+
+    for (i = nodestart; i < nodeend; i++)
+      printf("component %" PRIu64 ":\t%u\n", i, components[i]);
+
+    for (i = 0; i < cmpsizes.size; i++) {
+      printf("component %" PRIu64 " size:\t%u\n", i,
+             ((uint32_t *)(cmpsizes.data))[i]);
+    }
+    printf("\n");
   }
+
+  connected = 0;
+  for (i = 0; i < nnodes; i++) {
+    if (graph_compact_num_neighbours(&c, i) > 0) connected++;
+  }
+
+  if (args->nodes)
+    printf("nodes:                 %u\n",    nnodes);
+  if (args->edges)
+    printf("edges:                 %" PRIu64 "\n",
+           graph_compact_num_edges(&c));
+  if (args->connected)
+    printf("dis/connected:         %u/%u\n", nnodes-connected, connected);
+  if (args->density)
+    printf("density:               %f\n",
+           graph_compact_num_edges(&c) / (nnodes*(nnodes-1.0) / 2.0));
+  if (args->degree)
+    printf("avg degree:            %f\n",    degree);
+  if (args->components)
+    printf("components:            %u\n",    ncmps);
+
+  if (args->approxpaths) {
+    if (stats_approx_paths_compact(
+          &c, path_samples(nnodes, args), &approxpaths)) {
+      printf("approx. pathlength:    n/a\n");
+      printf("approx. efficiency:    n/a\n");
+    }
+    else {
+      printf("approx. pathlength:    %f\n", approxpaths.pathlength);
+      printf("approx. path. error:   %f\n", approxpaths.pathlength_err);
+      printf("approx. efficiency:    %f\n", approxpaths.efficiency);
+      printf("approx. effic. error:  %f\n", approxpaths.efficiency_err);
+    }
+  }
+
+  graph_compact_free(&c);
+  if (components    != NULL) free(components);
+  if (cmpsizes.data != NULL) array_free(&cmpsizes);
+  return 0;
+
+fail:
+  graph_compact_free(&c);
+  if (components    != NULL) free(components);
+  if (cmpsizes.data != NULL) array_free(&cmpsizes);
+  return 1;
+}
+
+uint8_t reorder_graph(graph_t *g, graph_order_t order, uint32_t **perm) {
+
+  uint32_t *p;
+
+  p = malloc(graph_num_nodes(g) * sizeof(uint32_t));
+  if (p == NULL) goto fail;
+
+  if (graph_order(  g, order, p)) goto fail;
+  if (graph_permute(g, p))        goto fail;
+
+  if (perm != NULL) *perm = p;
+  else              free(p);
+
+  return 0;
+
+fail:
+  if (p != NULL) free(p);
+  return 1;
+}
+
+void print_regions(graph_t *g) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        n;
+  uint32_t        sz;
+  uint32_t        nnodes;
+  double          inter;
+  stats_regions_t regs;
+
+  if (stats_regions(g, 0, &regs)) {
+    printf("regions:               n/a\n");
+    return;
+  }
+
+  n      = regs.nregions;
+  nnodes = graph_num_nodes(g);
+
+  for (i = 0; i < n; i++) {
+
+    sz    = regs.sizes[i];
+    inter = 0;
+
+    for (j = 0; j < n; j++) {
+      if (j != i) inter += regs.counts[i * n + j];
+    }
+
+    if (sz > 0 && nnodes > sz) inter /= (double)sz * (nnodes - sz);
+
+    printf("region %u: %u nodes, intra density %f, inter density %f\n",
+           regs.labels[i], sz, stats_region_density(&regs, i, i), inter);
+  }
+
+  stats_regions_free(&regs);
+}
+
+void print_rich_club(graph_t *g, struct args *args) {
+
+  uint64_t  k;
+  uint32_t  ndegrees;
+  double   *phi;
+  double   *ref;
+  double   *norm;
+
+  phi  = NULL;
+  ref  = NULL;
+  norm = NULL;
+
+  ndegrees = (uint32_t)stats_max_degree(g) + 1;
+  phi      = malloc(ndegrees * sizeof(double));
+  if (phi == NULL) goto fail;
+
+  if (stats_rich_club(g, phi)) goto fail;
+
+  if (args->refgraphs > 0) {
+
+    ref  = malloc(ndegrees * sizeof(double));
+    norm = malloc(ndegrees * sizeof(double));
+
+    if (ref  == NULL) goto fail;
+    if (norm == NULL) goto fail;
+
+    if (stats_reference_rich_club(g, args->refgraphs, 0, ref, norm))
+      goto fail;
+  }
+
+  for (k = 0; k < ndegrees; k++) {
+
+    if (ref == NULL)
+      printf("rich club %" PRIu64 ": %f\n", k, phi[k]);
+    else
+      printf("rich club %" PRIu64 ": %f, ref %f, normalised %f\n",
+             k, phi[k], ref[k], norm[k]);
+  }
+
+  free(phi);
+  if (ref  != NULL) free(ref);
+  if (norm != NULL) free(norm);
+  return;
+
+fail:
+  printf("rich club:             n/a\n");
+  if (phi  != NULL) free(phi);
+  if (ref  != NULL) free(ref);
+  if (norm != NULL) free(norm);
+}
+
+void print_cache_report(graph_t *g) {
+
+  uint64_t             i;
+  uint64_t             total;
+  array_t              usage;
+  stats_cache_usage_t *u;
+
+  if (array_create(&usage, sizeof(stats_cache_usage_t), 10)) {
+    printf("cache report:          n/a\n");
+    return;
+  }
+
+  if (stats_cache_usage(g, &usage, &total)) {
+    printf("cache report:          n/a\n");
+    array_free(&usage);
+    return;
+  }
+
+  for (i = 0; i < usage.size; i++) {
+    u = array_getd(&usage, i);
+    printf("cache %-22s %" PRIu64 " bytes\n",
+           stats_cache_field_name(u->id), u->bytes);
+  }
+
+  printf("cache total:           %" PRIu64 " bytes\n", total);
+
+  array_free(&usage);
+}
+
+void print_matrix(
+  graph_t *g, uint8_t (*func)(graph_t *g, uint32_t u, double *d)) {
+
+  double  *d;
+  uint64_t i;
+  uint32_t nnodes;
+  
+  nnodes = graph_num_nodes(g);
+  d      = malloc(nnodes*sizeof(double));
+
+  printf("    | ");
+  for (i = 0; i < nnodes; i++) printf("%03" PRIu64 "     ", i); printf("\n");
+  printf("    | ");
+  for (i = 0; i < nnodes; i++) printf("--------"); printf("\n");
+
+  for (i = 0; i < nnodes; i++) {
+    func(g, i, d);
+    print_matrix_line(g, i, d);
+  }
+  free(d);
+}
+
+void print_matrix_line(graph_t *g, uint32_t nidx, double *data) {
+
+  uint64_t i;
+  uint64_t j;
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  j = 0;
+  printf("%03u | ", nidx);
+  for (i = 0; i < nnodes; i++) {
+
+    if (!graph_are_neighbours(g, nidx, i)) printf("------- ");
+    else printf("%7.3f ", data[j++]);
+  }
+  printf("\n");
+}
+
+uint8_t open_node_out(
+  struct args *args,
+  uint32_t     nodestart,
+  uint32_t     nodeend,
+  node_out_t  *out) {
+
+  uint32_t nrows;
+  char    *fname;
+  char     hdr[NODE_MAT_HDR_SIZE];
+
+  fname    = NULL;
+  out->mat = NULL;
+  out->row = 0;
+
+  if (args->binary == NULL) return 0;
+
+  nrows = 0;
+  if (args->nodelabel)   nrows += 4;
+  if (args->degree)      nrows++;
+  if (args->degcent)     nrows++;
+  if (args->clustering)  nrows++;
+  if (args->pathlength)  nrows++;
+  if (args->closeness)   nrows++;
+  if (args->harmonic)    nrows++;
+  if (args->betweenness) nrows++;
+  if (args->approxbetw)  nrows++;
+  if (args->weighted)    nrows += 2;
+  if (args->lefficiency) nrows++;
+  if (args->numpaths)    nrows++;
+  if (args->lognumpaths) nrows++;
+  if (args->components)  nrows++;
+
+  if (nrows == 0) return 0;
+
+  fname = malloc(strlen(args->binary) + 11);
+  if (fname == NULL) goto fail;
+  sprintf(fname, "%s.nodes.mat", args->binary);
+
+  out->mat = mat_create(fname,
+                        nrows,
+                        nodeend - nodestart,
+                        (1 << MAT_HAS_ROW_LABELS),
+                        NODE_MAT_HDR_SIZE,
+                        NODE_MAT_LABEL_SIZE);
+  if (out->mat == NULL) goto fail;
+
+  snprintf(hdr, sizeof(hdr), "cnet node values: columns are nodes %u-%u",
+           nodestart, nodeend - 1);
+  if (mat_write_hdr_data(out->mat, hdr, strlen(hdr) + 1)) goto fail;
+
+  free(fname);
+  return 0;
+
+fail:
+  if (fname    != NULL) free(fname);
+  if (out->mat != NULL) mat_close(out->mat);
+  out->mat = NULL;
+  return 1;
+}
+
+uint8_t print_node_vals(
+  node_out_t *out, char *name, uint32_t start, uint32_t end, double *vals) {
+
+  uint64_t i;
+  char     label[NODE_MAT_LABEL_SIZE];
+
+  /*
+   * the nodes have been renumbered - put the values back into
+   * original node order (start and end span every node)
+   */
+  if (out->perm != NULL) {
+
+    for (i = start; i < end; i++) out->buf[out->perm[i]] = vals[i];
+    vals = out->buf;
+  }
+
+  if (out->mat == NULL) {
+
+    for (i = start; i < end; i++)
+      printf("%s %" PRIu64 ":\t%f\n", name, i, vals[i]);
+    printf("\n");
+
+    return 0;
+  }
+
+  memset( label, 0,    sizeof(label));
+  strncpy(label, name, sizeof(label) - 1);
+
+  if (mat_write_row_label(out->mat, out->row, label))         goto fail;
+  if (mat_write_rows(     out->mat, out->row, 1, vals+start)) goto fail;
+
+  out->row++;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t write_matrix(
+  graph_t *g,
+  char    *fname,
+  uint8_t (*func)(graph_t *g, uint32_t u, double *d)) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint16_t  flags;
+  double   *d;
+  double   *row;
+  mat_t    *mat;
+
+  d      = NULL;
+  row    = NULL;
+  mat    = NULL;
+  flags  = 0;
+  nnodes = graph_num_nodes(g);
+
+  if (!graph_is_directed(g)) flags |= (1 << MAT_IS_SYMMETRIC);
+
+  d   = malloc(nnodes*sizeof(double));
+  row = calloc(nnodes, sizeof(double));
+  if (d   == NULL) goto fail;
+  if (row == NULL) goto fail;
+
+  mat = mat_create(fname, nnodes, nnodes, flags, 0, 0);
+  if (mat == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    if (func(g, i, d)) goto fail;
+
+    for (j = 0; j < nnbrs; j++) row[nbrs[j]] = d[j];
+
+    if (mat_write_rows(mat, i, 1, row)) goto fail;
+
+    for (j = 0; j < nnbrs; j++) row[nbrs[j]] = 0;
+  }
+
+  free(d);
+  free(row);
+  if (mat_close(mat)) return 1;
+
+  return 0;
+
+fail:
+  if (d   != NULL) free(d);
+  if (row != NULL) free(row);
+  if (mat != NULL) mat_close(mat);
+  return 1;
+}
+
+uint8_t pathsharing_row(graph_t *g, uint32_t u, double *d) {
+
+  uint64_t  i;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+
+  nnbrs = graph_num_neighbours(g, u);
+  nbrs  = graph_get_neighbours(g, u);
+
+  for (i = 0; i < nnbrs; i++) d[i] = stats_edge_pathsharing(g, u, nbrs[i]);
+
+  return 0;
+}
+
+void print_edge_vals(
+  graph_t *g,
+  double (*func)(graph_t *g, uint32_t u, uint32_t v),
+  char *prefix) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  double    val;
+
+  nnodes = graph_num_nodes(g);
+
+  for (i = 0; i < nnodes; i++) {
+    
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] < i) continue;
+
+      val = func(g, i, nbrs[j]);
+
+      printf("%s %" PRIu64 " -- %u: %0.6f\n", prefix, i, nbrs[j], val);
+    }
+  }
+}
+
+void print_edge_distances(graph_t *g) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  off;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  double   *dists;
+
+  nnodes = graph_num_nodes(g);
+  dists  = malloc((2 * (uint64_t)graph_num_edges(g) + 1) * sizeof(double));
+
+  if (dists == NULL || stats_edge_distances(g, dists, NULL)) {
+    if (dists != NULL) free(dists);
+    print_edge_vals(g, &stats_edge_distance, "distance");
+    return;
+  }
+
+  off = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] < i) continue;
+
+      printf("distance %" PRIu64 " -- %u: %0.6f\n",
+             i, nbrs[j], dists[off+j]);
+    }
+
+    off += nnbrs;
+  }
+
+  free(dists);
+}
+
+uint8_t _batch(struct args *args) {
+
+  uint64_t  i;
+  uint8_t   locked;
+  uint8_t   loading;
+  pthread_t loader;
+  batch_t   batch;
+
+  memset(&batch, 0, sizeof(batch_t));
+  locked  = 0;
+  loading = 0;
+
+  batch.args = args;
+
+  if (args->workers == 0) args->workers = parallel_num_threads();
+  if (args->intra   == 0) args->intra   = 10000;
+
+  for (i = 0; i < BATCH_NUM_COLS; i++) {
+
+    /*approxclust is a sample count, not a flag*/
+    if (i == BATCH_APPROXCLUST) {
+      if (args->approxclust != 0) batch.cols[batch.ncols++] = i;
+    }
+    else if (*((uint8_t *)args + _batch_cols[i].flag))
+      batch.cols[batch.ncols++] = i;
+  }
+
+  if (batch.ncols == 0) {
+    printf("no graph-level statistics selected\n");
+    goto fail;
+  }
+
+  if (_batch_read_list(args->batch, &batch.inputs, &batch.ninputs)) {
+    printf("error reading graph list %s\n", args->batch);
+    goto fail;
+  }
+
+  if (args->workers > batch.ninputs) args->workers = batch.ninputs;
+  if (args->workers == 0)            args->workers = 1;
+
+  batch.qsize   = args->workers;
+  batch.queue   = calloc(batch.qsize,   sizeof(batch_graph_t));
+  batch.status  = calloc(batch.ninputs, sizeof(uint8_t));
+  batch.results = calloc((uint64_t)batch.ninputs * batch.ncols,
+                         sizeof(double));
+
+  if (batch.queue   == NULL) goto fail;
+  if (batch.status  == NULL) goto fail;
+  if (batch.results == NULL) goto fail;
+
+  if (args->refcache && stats_reference_load(args->refcache)) {
+    printf("error loading reference cache %s\n", args->refcache);
+    goto fail;
+  }
+
+  if (pthread_mutex_init(&batch.lock, NULL)) goto fail;
+  locked = 1;
+  
+  if (pthread_cond_init(&batch.notfull,  NULL)) goto fail;
+  locked = 2;
+  if (pthread_cond_init(&batch.notempty, NULL)) goto fail;
+  locked = 3;
+
+  printf("graph");
+  for (i = 0; i < batch.ncols; i++)
+    printf("\t%s", _batch_cols[batch.cols[i]].name);
+  printf("\n");
+
+  if (pthread_create(&loader, NULL, _batch_loader, &batch)) goto fail;
+  loading = 1;
+
+  /*one work item per worker - workers pull graphs off the queue*/
+  if (parallel_for(
+        args->workers, args->workers, 1, &batch, _batch_worker))
+    goto fail;
+
+  pthread_join(loader, NULL);
+  loading = 0;
+
+  if (args->refcache && stats_reference_save(args->refcache)) {
+    printf("error saving reference cache %s\n", args->refcache);
+    goto fail;
+  }
+
+  pthread_cond_destroy( &batch.notempty);
+  pthread_cond_destroy( &batch.notfull);
+  pthread_mutex_destroy(&batch.lock);
+
+  for (i = 0; i < batch.ninputs; i++) free(batch.inputs[i]);
+  free(batch.inputs);
+  free(batch.queue);
+  free(batch.status);
+  free(batch.results);
+
+  return batch.failed;
+
+fail:
+
+  if (loading) pthread_join(loader, NULL);
+
+  if (locked > 2) pthread_cond_destroy( &batch.notempty);
+  if (locked > 1) pthread_cond_destroy( &batch.notfull);
+  if (locked > 0) pthread_mutex_destroy(&batch.lock);
+
+  if (batch.inputs != NULL) {
+    for (i = 0; i < batch.ninputs; i++) free(batch.inputs[i]);
+    free(batch.inputs);
+  }
+  if (batch.queue   != NULL) free(batch.queue);
+  if (batch.status  != NULL) free(batch.status);
+  if (batch.results != NULL) free(batch.results);
+  return 1;
+}
+
+uint8_t _batch_read_list(char *fname, char ***inputs, uint32_t *ninputs) {
+
+  FILE     *f;
+  char      line[4096];
+  char    **list;
+  char    **tmp;
+  uint32_t  n;
+  uint32_t  cap;
+  size_t    len;
+
+  f    = NULL;
+  list = NULL;
+  n    = 0;
+  cap  = 0;
+
+  if (!strcmp(fname, "-")) f = stdin;
+  else                     f = fopen(fname, "rt");
+  if (f == NULL) goto fail;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+
+    len = strlen(line);
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+      line[--len] = '\0';
+
+    if (len == 0) continue;
+
+    if (n == cap) {
+      cap = (cap == 0) ? 64 : cap * 2;
+      tmp = realloc(list, cap * sizeof(char *));
+      if (tmp == NULL) goto fail;
+      list = tmp;
+    }
+
+    list[n] = malloc(len + 1);
+    if (list[n] == NULL) goto fail;
+    strcpy(list[n++], line);
+  }
+
+  if (ferror(f)) goto fail;
+  if (f != stdin) fclose(f);
+
+  *inputs  = list;
+  *ninputs = n;
+  return 0;
+
+fail:
+  if (f != NULL && f != stdin) fclose(f);
+  if (list != NULL) {
+    while (n > 0) free(list[--n]);
+    free(list);
+  }
+  return 1;
+}
+
+void * _batch_loader(void *ctx) {
+
+  uint32_t       i;
+  batch_t       *batch;
+  batch_graph_t  bg;
+
+  batch = ctx;
+
+  for (i = 0; i < batch->ninputs; i++) {
+
+    bg.idx    = i;
+    bg.loaded = 0;
+
+    if (ngdb_read(batch->inputs[i], &bg.g) == 0) {
+
+      /*only graph-level values are printed, so no permutation is kept*/
+      if (batch->args->reorder &&
+          reorder_graph(&bg.g, batch->args->order, NULL))
+        graph_free(&bg.g);
+
+      /*graphs are not modified, so can be frozen*/
+      else if (graph_freeze(&bg.g)) graph_free(&bg.g);
+      else                          bg.loaded = 1;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+
+    while (batch->qcount == batch->qsize)
+      pthread_cond_wait(&batch->notfull, &batch->lock);
+
+    batch->queue[(batch->qhead + batch->qcount) % batch->qsize] = bg;
+    batch->qcount++;
+
+    pthread_cond_signal(&batch->notempty);
+    pthread_mutex_unlock(&batch->lock);
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  batch->done = 1;
+  pthread_cond_broadcast(&batch->notempty);
+  pthread_mutex_unlock(&batch->lock);
+
+  return NULL;
+}
+
+uint8_t _batch_worker(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t       i;
+  uint8_t        status;
+  batch_t       *batch;
+  batch_graph_t  bg;
+  double        *row;
+
+  batch = ctx;
+
+  while (1) {
+
+    pthread_mutex_lock(&batch->lock);
+
+    while (batch->qcount == 0 && !batch->done)
+      pthread_cond_wait(&batch->notempty, &batch->lock);
+
+    if (batch->qcount == 0) {
+      pthread_mutex_unlock(&batch->lock);
+      break;
+    }
+
+    bg = batch->queue[batch->qhead];
+    batch->qhead = (batch->qhead + 1) % batch->qsize;
+    batch->qcount--;
+
+    pthread_cond_signal(&batch->notfull);
+    pthread_mutex_unlock(&batch->lock);
+
+    row    = batch->results + (uint64_t)bg.idx * batch->ncols;
+    status = 2;
+
+    if (bg.loaded) {
+
+      /*small graphs are processed with a single thread*/
+      if (graph_num_nodes(&bg.g) < batch->args->intra) 
+        parallel_set_threads(1);
+      else
+        parallel_set_threads(0);
+
+      if (!_batch_stats(batch, &bg.g, batch->inputs[bg.idx], row))
+        status = 1;
+
+      graph_free(&bg.g);
+    }
+
+    if (status != 1) {
+      for (i = 0; i < batch->ncols; i++) row[i] = NAN;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    batch->status[bg.idx] = status;
+    if (status != 1) batch->failed = 1;
+    _batch_flush(batch);
+    pthread_mutex_unlock(&batch->lock);
+  }
+
+  parallel_set_threads(0);
+  return 0;
+}
+
+uint8_t _batch_stats(batch_t *batch, graph_t *g, char *input, double *row) {
+
+  uint64_t     i;
+  uint32_t     approxclust;
+  uint64_t     ntriangles;
+  char        *cachefile;
+  uint8_t      measures;
+  stats_ref_t  ref;
+  struct args *args;
+
+  args      = batch->args;
+  cachefile = NULL;
+
+  if (stats_cache_init(g))                                    goto fail;
+  if (args->compact && stats_cache_compact_pairs(g, 1))       goto fail;
+  if (args->cachebudget > 0 &&
+      stats_cache_set_budget(g, args->cachebudget))           goto fail;
+  if (stats_cache_set_path_samples(g, path_samples(graph_num_nodes(g), args))) goto fail;
+
+  if (args->cache) {
+
+    cachefile = malloc(strlen(input) + 7);
+    if (cachefile == NULL) goto fail;
+    sprintf(cachefile, "%s.cache", input);
+
+    if (stats_cache_load(g, cachefile)) goto fail;
+  }
+
+  if (args->ersmallworld && args->refgraphs > 0) {
+
+    if (stats_reference(g, args->reftype, args->refgraphs, 0, &ref)) {
+      ref.clustering = NAN;
+      ref.pathlength = NAN;
+    }
+  }
+  else if (args->ersmallworld) {
+    ref.clustering = stats_er_clustering(g);
+    ref.pathlength = stats_er_pathlength(g);
+  }
+
+  measures = 0;
+  for (i = 0; i < batch->ncols; i++) {
+
+    switch (batch->cols[i]) {
+      case BATCH_PATHLENGTH:  measures |= STATS_PLAN_PATHLENGTH; break;
+      case BATCH_GEFFICIENCY: measures |= STATS_PLAN_EFFICIENCY; break;
+      case BATCH_SMALLWORLD:
+        if (args->refgraphs == 0) measures |= STATS_PLAN_PATHLENGTH;
+        break;
+      default: break;
+    }
+  }
+
+  /*graph-level values are estimated with --approxpaths*/
+  if (args->approxpaths != 0) measures = 0;
+
+  if (stats_plan_paths(g, measures)) goto fail;
+
+  for (i = 0; i < batch->ncols; i++) {
+
+    switch (batch->cols[i]) {
+
+      case BATCH_NODES:
+        row[i] = graph_num_nodes(g);
+        break;
+      case BATCH_EDGES:
+        row[i] = graph_num_edges(g);
+        break;
+      case BATCH_DISCONNECTED:
+        row[i] = graph_num_nodes(g) - stats_cache_connected(g);
+        break;
+      case BATCH_CONNECTED:
+        row[i] = stats_cache_connected(g);
+        break;
+      case BATCH_DENSITY:
+        row[i] = stats_density(g);
+        break;
+      case BATCH_DEGREE:
+        row[i] = stats_avg_degree(g);
+        break;
+      case BATCH_COMPONENTS:
+        row[i] = stats_cache_num_components(g);
+        break;
+      case BATCH_CLUSTERING:
+        row[i] = stats_cache_graph_clustering(g);
+        break;
+      case BATCH_APPROXCLUST:
+        approxclust = args->approxclust;
+        if (args->approxclust < 0) approxclust = graph_num_nodes(g) / 10;
+        if (args->clusterr > 0) {
+          if (stats_approx_clustering_err(
+                g, approxclust, args->clusterr, row + i, NULL))
+            row[i] = NAN;
+        }
+        else row[i] = stats_cache_approx_clustering(g, approxclust);
+        break;
+      case BATCH_TRIANGLES:
+        if (stats_num_triangles(g, &ntriangles)) row[i] = NAN;
+        else                                     row[i] = ntriangles;
+        break;
+      case BATCH_PATHLENGTH:
+        row[i] = stats_cache_graph_pathlength(g);
+        break;
+      case BATCH_GEFFICIENCY:
+        row[i] = stats_cache_global_efficiency(g);
+        break;
+      case BATCH_LEFFICIENCY:
+        row[i] = stats_cache_local_efficiency(g);
+        break;
+      case BATCH_REFCLUSTERING:
+        row[i] = ref.clustering;
+        break;
+      case BATCH_REFPATHLENGTH:
+        row[i] = ref.pathlength;
+        break;
+      case BATCH_SMALLWORLD:
+        if (args->refgraphs > 0)
+          row[i] = stats_reference_smallworld_index(g, &ref);
+        else
+          row[i] = stats_smallworld_index(g);
+        break;
+      case BATCH_ASSORTATIVITY:
+        row[i] = stats_cache_assortativity(g);
+        break;
+      case BATCH_MODULARITY:
+        row[i] = stats_cache_modularity(g);
+        break;
+      case BATCH_CHIRA:
+        row[i] = stats_cache_chira(g);
+        break;
+      case BATCH_NINTRA:
+        row[i] = stats_cache_intra_edges(g);
+        break;
+      case BATCH_NINTER:
+        row[i] = stats_cache_inter_edges(g);
+        break;
+      case BATCH_LABELVALS:
+        row[i] = graph_num_labelvals(g);
+        break;
+      case BATCH_NEWMANERROR:
+        row[i] = stats_newman_error(g);
+        break;
+      case BATCH_MUTUALINFO:
+        row[i] = stats_graph_mutual_information(g);
+        break;
+      case BATCH_DIAMETER:
+        row[i] = stats_cache_diameter(g);
+        if (row[i] < 0) row[i] = NAN;
+        break;
+      default:
+        row[i] = NAN;
+    }
+  }
+
+  if (args->cache && stats_cache_save(g, cachefile)) goto fail;
+
+  if (cachefile != NULL) free(cachefile);
+  return 0;
+
+fail:
+  if (cachefile != NULL) free(cachefile);
+  return 1;
+}
+
+void _batch_flush(batch_t *batch) {
+
+  uint64_t i;
+  double  *row;
+
+  while (batch->nprinted < batch->ninputs &&
+         batch->status[batch->nprinted] != 0) {
+
+    row = batch->results + (uint64_t)batch->nprinted * batch->ncols;
+
+    printf("%s", batch->inputs[batch->nprinted]);
+    for (i = 0; i < batch->ncols; i++) printf("\t%f", row[i]);
+    printf("\n");
+
+    batch->nprinted++;
+  }
+
+  fflush(stdout);
 }
@@ -15,6 +15,12 @@
 
 #include "io/analyze75.h"
 #include "util/startup.h"
+#include "util/parallel.h"
+
+/**
+ * Number of values which are checked at a time.
+ */
+#define _COUNT_CHUNK 65536
 
 typedef struct _args {
 
@@ -39,6 +45,36 @@ static struct argp_option options[] = {
 };
 
 
+/**
+ * Context passed to _count_vals.
+ */
+typedef struct _count_ctx {
+
+  dsr_t    *hdr;     /**< image header                                */
+  uint8_t  *img;     /**< image data                                  */
+  double    lo;      /**< lowest passing value                        */
+  double    hi;      /**< highest passing value                       */
+  uint8_t   abs;     /**< compare absolute values                     */
+  uint32_t *idxs;    /**< indices of passing values, or NULL - the
+                          values in each chunk start at the chunk
+                          offset                                      */
+  uint32_t *counts;  /**< number of passing values in each chunk      */
+  uint32_t *nnormal; /**< number of normal values in each chunk       */
+
+} count_ctx_t;
+
+/**
+ * parallel_for function which checks a chunk of values.
+ *
+ * \return 0.
+ */
+static uint8_t _count_vals(
+  uint64_t  start,  /**< first value             */
+  uint64_t  end,    /**< one past last value     */
+  uint16_t  thread, /**< calling thread          */
+  void     *ctx     /**< pointer to count_ctx_t  */
+);
+
 static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   
   args_t *args = state->input;
@@ -73,10 +109,12 @@ int main(int argc, char *argv[]) {
   uint32_t    count;
   uint32_t    nnormalvals;
   uint32_t    nvals;
+  uint32_t    nchunks;
   uint64_t    i;
+  uint64_t    j;
   uint32_t    dims[4];
   args_t      args;
-  uint8_t     passed;
+  count_ctx_t ctx;
   struct argp argp = {options, _parse_opt, "INPUT", doc}; 
 
 
@@ -85,6 +123,7 @@ int main(int argc, char *argv[]) {
   data        = NULL;
 
   memset(&args, 0, sizeof(args));
+  memset(&ctx,  0, sizeof(ctx));
 
   startup("countimg", argc, argv, &argp, &args);
 
@@ -93,35 +132,44 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
-  nvals = analyze_num_vals(&hdr);
+  nvals   = analyze_num_vals(&hdr);
+  nchunks = (nvals + _COUNT_CHUNK - 1) / _COUNT_CHUNK;
   if (args.absolute)
-    args.threshold = abs(args.threshold);
+    args.threshold = fabs(args.threshold);
+
+  ctx.hdr     = &hdr;
+  ctx.img     = data;
+  ctx.abs     = args.absolute;
+  ctx.lo      = args.lessthan ? -INFINITY      : args.threshold;
+  ctx.hi      = args.lessthan ? args.threshold :  INFINITY;
+  ctx.counts  = calloc(nchunks, sizeof(uint32_t));
+  ctx.nnormal = calloc(nchunks, sizeof(uint32_t));
+
+  if (ctx.counts  == NULL && nchunks > 0) goto fail;
+  if (ctx.nnormal == NULL && nchunks > 0) goto fail;
+
+  if (args.printidx) {
+    ctx.idxs = malloc((uint64_t)nvals * sizeof(uint32_t));
+    if (ctx.idxs == NULL && nvals > 0) goto fail;
+  }
 
-  for (i = 0; i < nvals; i++) {
+  if (parallel_for(0, nvals, _COUNT_CHUNK, &ctx, _count_vals)) goto fail;
 
-    passed = 0;
-    val    = analyze_read_by_idx(&hdr, data, i);
+  for (i = 0; i < nchunks; i++) {
 
-    if (val && !isnormal(val))
-      continue;
+    count       += ctx.counts[i];
+    nnormalvals += ctx.nnormal[i];
 
-    nnormalvals ++;
+    if (!args.printidx) continue;
 
-    if (args.absolute)
-      val = abs(val);
+    for (j = 0; j < ctx.counts[i]; j++) {
 
-    if (args.lessthan) {
-      if (val <= args.threshold) passed = 1;
-    }
-    else {
-      if (val >= args.threshold) passed = 1;
-    }
+      val = analyze_read_by_idx(&hdr, data, ctx.idxs[i * _COUNT_CHUNK + j]);
 
-    if (!passed) continue;
+      if (args.absolute)
+        val = fabs(val);
 
-    count ++;
-    if (args.printidx) {
-      analyze_get_indices(&hdr, i, dims);
+      analyze_get_indices(&hdr, ctx.idxs[i * _COUNT_CHUNK + j], dims);
       printf("%2u %2u %2u: %6.4f\n" , dims[0], dims[1], dims[2], val);
     }
   }
@@ -134,9 +182,36 @@ int main(int argc, char *argv[]) {
     args.threshold);
 
   free(data);
+  free(ctx.counts);
+  free(ctx.nnormal);
+  if (ctx.idxs != NULL) free(ctx.idxs);
   exit(0);
 
  fail:
-  if (data != NULL) free(data);
+  if (data        != NULL) free(data);
+  if (ctx.counts  != NULL) free(ctx.counts);
+  if (ctx.nnormal != NULL) free(ctx.nnormal);
+  if (ctx.idxs    != NULL) free(ctx.idxs);
   exit(1);
 }
+
+uint8_t _count_vals(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  count_ctx_t *c = ctx;
+  uint64_t     chunk;
+
+  chunk = start / _COUNT_CHUNK;
+
+  c->counts[chunk] = analyze_search_block(
+    c->hdr,
+    c->img,
+    start,
+    end - start,
+    c->lo,
+    c->hi,
+    c->abs,
+    c->nnormal + chunk,
+    (c->idxs == NULL) ? NULL : c->idxs + start);
+
+  return 0;
+}
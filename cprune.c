@@ -3,7 +3,9 @@
  *
  * This program creates a new graph from an input graph, removing any
  * disconnected nodes, or disconnected components, which are below a certain
- * size.
+ * size. Files created by ngdb_write are pruned without loading the graph
+ * into memory (see ngdb_prune); other files are loaded and pruned with
+ * graph_prune.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
@@ -92,6 +94,10 @@ int main(int argc, char *argv[]) {
   memset(&args, 0, sizeof(args_t));
   startup("cprune", argc, argv, &argp, &args);
 
+  if (!ngdb_prune(
+        args.input, args.output, args.size, args.prop, args.hdrmsg))
+    return 0;
+
   if (ngdb_read(args.input, &gin)) {
     printf("Could not read in %s\n", args.input);
     goto fail;
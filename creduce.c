@@ -16,34 +16,13 @@
 #include <argp.h>
 
 #include "graph/graph.h"
+#include "graph/graph_aggregate.h"
+#include "graph/graph_builder.h"
 #include "graph/graph_threshold.h"
 #include "io/analyze75.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 
-/**
- * A node and its label.
- */
-typedef struct _node {
-
-  uint32_t      nid; /**< node ID    */
-  graph_label_t lbl; /**< node label */
-
-} node_t;
-
-/**
- * A partition, a collection of same-labelled nodes
- * in the input graph. Also corresponds to a single
- * node in the output graph.
- */
-typedef struct _partition {
-
-  uint32_t       nnodes; /**< number of nodes       */
-  node_t        *nodes;  /**< list of nodes         */
-  graph_label_t  plbl;   /**< 'averaged' node label */
-
-} partition_t;
-
 /**
  * Input arguments.
  */
@@ -55,6 +34,7 @@ typedef struct args {
   uint8_t  pcount;    /**< print out label connectivity       */
   uint8_t  norm;      /**< normalise edge counts to densities */
   uint8_t  real;      /**< node coordinates are in real units */
+  uint16_t nthreads;  /**< number of threads                  */
 } args_t;
 
 /**
@@ -71,65 +51,29 @@ static uint8_t _reduce(
 );
 
 /**
- * Creates node_t structs for every node in the given graph. It
- * is the caller's responsibility to free the nodes pointer when 
- * it is no longer needed. 
- *
- * \return 0 on success, non-0 on failure.
- */
-static uint8_t _get_nodes(
-  graph_t  *g,    /**< the graph                                          */
-  node_t  **nodes /**< will be updated to point to list of node_t structs */
-);
-
-/**
- * Counts the number of edges which exist between every pair 
- * of nodes in the given two partitions.
- *
- * \return the number of edges between the nodes in the given partitions.
+ * Calculates the 'averaged' label of every group of nodes - the label
+ * value of the group, and the mean xyz coordinates of its nodes.
  */
-static uint32_t _count_edges(
-  graph_t     *g,  /**< the graph            */
-  partition_t *p1, /**< the first partition  */
-  partition_t *p2  /**< the second partition */
+static void _group_labels(
+  graph_t           *g,      /**< the graph                       */
+  uint32_t          *groups, /**< group of every node             */
+  uint32_t          *labels, /**< label value of every group      */
+  graph_aggregate_t *agg,    /**< edge counts and group sizes     */
+  graph_label_t     *plbls   /**< space to store the group labels */
 );
 
 /**
- * Groups the given list of nodes into partitions, according to their label
- * value. It is the caller's responsibility to free the partition list when it
- * is no longed needed. 
- *
- * Note: the node list is sorted in place, and partition entries, rather than
- * containing a copy of the node entries, simply point into different sections
- * of the sorted node list. Thus, you must not free the node list until you no
- * longer need the partition list.
- *
- * \return 0 on success, non-0 on failure.
+ * \return the weight of the edge between the given groups, given the
+ * number of edges between them.
  */
-static uint8_t _group_nodes(
-  node_t       *nodes,  /**< list of nodes                                 */
-  uint32_t      nnodes, /**< number of nodes                               */ 
-  partition_t **ptns,   /**< pointer to partition list will be stored here */
-  uint32_t     *nptns   /**< number of partitions will be stored here      */
+static float _edge_weight(
+  graph_aggregate_t *agg,   /**< edge counts and group sizes  */
+  uint32_t           i,     /**< first group                  */
+  uint32_t           j,     /**< second group                 */
+  uint32_t           count, /**< number of edges between them */
+  uint8_t            norm   /**< normalise to a density       */
 );
 
-/**
- * Sub-function of _group_nodes - creates a single partition from the 
- * same-labelled nodes at the start of the nodes list.
- *
- * \return 0 on success, non-0 on failure.
- */
-static uint8_t _next_group(
-  node_t      *nodes,  /**< list of nodes                  */
-  uint32_t     nnodes, /**< number of nodes                */
-  partition_t *ptn     /**< pointer to partition to create */
-);
-
-/**
- * Compares two node_t structs; used for sorting a list of nodes via qsort.
- */
-static int _compare_nodes(const void *vn1, const void *vn2);
-
 static char doc[] = "creduce - reduce a labelled graph";
 
 static struct argp_option options[] = {
@@ -141,6 +85,7 @@ static struct argp_option options[] = {
                                  "densities, rather than absolute counts"},
   {"lblfile",   'l', "FILE",  0, "ANALYZE75 file containing node labels"},
   {"real",      'r', NULL,    0, "node coordinates are in real units"},
+  {NULL,        'j', "INT",   0, "number of threads (default: --threads)"},
   {0}
 };
 
@@ -156,6 +101,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'n': a->norm      = 0xFF;      break;
     case 'l': a->lblfile   = arg;       break;
     case 'r': a->real      = 0xFF;      break;
+    case 'j': a->nthreads  = atoi(arg); break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) a->input  = arg;
@@ -236,203 +182,166 @@ fail:
 
 uint8_t _reduce(graph_t *gin, graph_t *gout, args_t *args) {
 
-  partition_t *ptns;
-  node_t      *nodes;
-  uint32_t     nnodes;
-  uint32_t     nptns;
-  float        wt;
-  uint32_t     i;
-  uint32_t     j;
-
-  ptns  = NULL;
-  nptns = 0;
+  uint64_t           i;
+  uint64_t           j;
+  uint64_t           p;
+  uint32_t           nnodes;
+  uint32_t           ngroups;
+  uint32_t          *groups;
+  uint32_t          *labels;
+  uint32_t           count;
+  float              wt;
+  graph_label_t     *plbls;
+  graph_aggregate_t  agg;
+  graph_builder_t    builder;
+
+  groups = NULL;
+  labels = NULL;
+  plbls  = NULL;
+  memset(&agg,     0, sizeof(graph_aggregate_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
+  memset(gout,     0, sizeof(graph_t));
 
   /*
-   * 1. partition nodes into label groups
-   * 2. create an edge between every partition in
-   *    output graph
-   * 3. count number of edges which exist between 
-   *    every pair of partitions, in input graph
-   * 4. (optional) normalise edge weights
-   * 5. assign edge counts from #3-#4 as edge
+   * 1. map every node to a dense label group index
+   * 2. count the number of edges between every pair
+   *    of groups, in one pass over the input graph
+   * 3. (optional) normalise edge weights
+   * 4. assign edge counts from #2-#3 as edge
    *    weights in output graph
    */
 
   nnodes = graph_num_nodes(gin);
 
-  if (_get_nodes(  gin, &nodes))                  goto fail;
-  if (_group_nodes(nodes, nnodes, &ptns, &nptns)) goto fail;
-  if (graph_create(gout, nptns, 0))               goto fail;
-
-  /*count edges between every pair of partitions*/
-  for (i = 0; i < nptns; i++) {
-    for (j = i+1; j < nptns; j++) {
-
-      wt = _count_edges(gin, ptns+i, ptns+j);
-
-      if (args->norm) 
-        wt /= ((ptns[i].nnodes) * (ptns[j].nnodes)) / 2.0;
+  groups = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  if (groups == NULL) goto fail;
 
-      if (args->pcount) {
-        printf("  %u -> %u: %0.4f\n", 
-          ptns[i].plbl.labelval,
-          ptns[j].plbl.labelval,
-          wt);
-      }
-
-      /*don't create an edge for partitions with no edges between them*/
-      if (wt == 0) continue;
-
-      if (graph_add_edge(gout, i, j, wt)) goto fail;
-    }
-
-    /*set the averaged label as the new node label*/
-    if (graph_set_nodelabel(gout, i, &(ptns[i].plbl))) goto fail;
-  }
-
-  return 0;
-
-fail:
-  graph_free(gout);
-  return 1;
-}
+  if (graph_aggregate_labels(gin, groups, &labels, &ngroups)) goto fail;
+  if (graph_aggregate(&agg, gin, groups, ngroups, args->nthreads))
+    goto fail;
 
-uint8_t _get_nodes(graph_t *g, node_t **nodes) {
+  plbls = malloc((ngroups > 0 ? ngroups : 1) * sizeof(graph_label_t));
+  if (plbls == NULL) goto fail;
 
-  uint32_t       i;
-  uint32_t       nnodes;
-  graph_label_t *lbl;
+  _group_labels(gin, groups, labels, &agg, plbls);
 
-  *nodes  = NULL;
+  if (graph_create(gout, ngroups, 0))           goto fail;
+  if (graph_builder_init(&builder, gout, 1024)) goto fail;
 
-  nnodes = graph_num_nodes(g);
+  /*
+   * pairs are in ascending order of (i, j); for directed
+   * input graphs, only edges from lower to higher label
+   * groups are counted, so pairs where j < i are skipped
+   */
+  for (p = 0; p < agg.npairs; p++) {
 
-  *nodes = malloc(sizeof(node_t)*nnodes);
-  if (*nodes == NULL) goto fail;
+    i = agg.pairs[2*p];
+    j = agg.pairs[2*p+1];
 
-  for (i = 0; i < nnodes; i++) {
+    if (j < i) continue;
 
-    (*nodes)[i].nid = i;
+    wt = _edge_weight(&agg, i, j, agg.counts[p], args->norm);
 
-    lbl = graph_get_nodelabel(g, i);
-    memcpy(&((*nodes)[i].lbl), lbl, sizeof(graph_label_t));
+    if (graph_builder_add(&builder, i, j, wt)) goto fail;
   }
 
-  return 0;
-
-fail:
-  if (*nodes != NULL) free(*nodes);
-  *nodes = NULL;
-  return 1;
-}
+  if (graph_builder_finalise(&builder)) goto fail;
 
-uint32_t _count_edges(graph_t *g, partition_t *p1, partition_t *p2) {
+  /*print the connectivity between every pair of groups, even if 0*/
+  if (args->pcount) {
 
-  uint32_t ct;
-  uint32_t i;
-  uint32_t j;
+    for (i = 0, p = 0; i < ngroups; i++) {
+      for (j = i+1; j < ngroups; j++) {
 
-  ct = 0;
+        while (p < agg.npairs &&
+               (agg.pairs[2*p] < i ||
+                (agg.pairs[2*p] == i && agg.pairs[2*p+1] < j)))
+          p++;
 
-  for (i = 0; i < p1->nnodes; i++) {
-    for (j = 0; j < p2->nnodes; j++) {
+        count = 0;
+        if (p < agg.npairs &&
+            agg.pairs[2*p] == i && agg.pairs[2*p+1] == j)
+          count = agg.counts[p];
 
-      if (graph_are_neighbours(g, p1->nodes[i].nid, p2->nodes[j].nid)) 
-        ct++;
+        printf("  %u -> %u: %0.4f\n",
+          labels[i],
+          labels[j],
+          _edge_weight(&agg, i, j, count, args->norm));
+      }
     }
   }
-  return ct;
-}
-
-uint8_t _group_nodes(
-  node_t *nodes, uint32_t nnodes, partition_t **ptns, uint32_t *nptns) {
-
-  partition_t  next;
-  partition_t *lptns;
-  uint32_t     lnptns;
-
-  *ptns  = NULL;
-  lptns  = NULL;
-  *nptns = 0;
-  lnptns = 0;
-
-  /*sort the nodes by label*/
-  qsort(nodes, nnodes, sizeof(node_t), _compare_nodes);
 
-  /*create partitions by stepping through the sorted node list*/
-  while (nnodes > 0) {
-
-    _next_group(nodes, nnodes, &next);
-
-    if (next.nnodes > nnodes) goto fail;
-
-    nnodes -= next.nnodes;
-    nodes  += next.nnodes;
-
-    lnptns++;
-    lptns = realloc(lptns, lnptns*sizeof(partition_t));
-    if (lptns == NULL) goto fail;
-
-    memcpy(&(lptns[lnptns-1]), &next, sizeof(partition_t));
+  /*set the averaged labels as the new node labels*/
+  for (i = 0; i < ngroups; i++) {
+    if (graph_set_nodelabel(gout, i, plbls + i)) goto fail;
   }
 
-  *ptns  = lptns;
-  *nptns = lnptns;
-
+  graph_builder_free(&builder);
+  graph_aggregate_free(&agg);
+  free(groups);
+  free(labels);
+  free(plbls);
   return 0;
 
 fail:
-  if (lptns != NULL) free(lptns);
-  *ptns  = NULL;
-  *nptns = 0;
+  graph_builder_free(&builder);
+  graph_aggregate_free(&agg);
+  if (groups != NULL) free(groups);
+  if (labels != NULL) free(labels);
+  if (plbls  != NULL) free(plbls);
+  graph_free(gout);
   return 1;
 }
 
-uint8_t _next_group(node_t *nodes, uint32_t nnodes, partition_t *ptn) {
-
-  uint32_t i;
+void _group_labels(
+  graph_t           *g,
+  uint32_t          *groups,
+  uint32_t          *labels,
+  graph_aggregate_t *agg,
+  graph_label_t     *plbls) {
 
-  if (nnodes == 0) goto fail;
+  uint64_t       i;
+  uint32_t       nnodes;
+  graph_label_t *lbl;
 
-  ptn->plbl.labelval = nodes[0].lbl.labelval;
-  ptn->plbl.xval     = 0;
-  ptn->plbl.yval     = 0;
-  ptn->plbl.zval     = 0;
+  nnodes = graph_num_nodes(g);
 
-  ptn->nnodes = 0;
-  ptn->nodes  = nodes;
+  for (i = 0; i < agg->ngroups; i++) {
+    plbls[i].labelval = labels[i];
+    plbls[i].xval     = 0;
+    plbls[i].yval     = 0;
+    plbls[i].zval     = 0;
+  }
 
   for (i = 0; i < nnodes; i++) {
 
-    if (nodes[i].lbl.labelval != ptn->plbl.labelval) break;
-
-    ptn->nnodes++;
+    lbl = graph_get_nodelabel(g, i);
 
-    ptn->plbl.xval += nodes[i].lbl.xval;
-    ptn->plbl.yval += nodes[i].lbl.yval;
-    ptn->plbl.zval += nodes[i].lbl.zval;
+    plbls[groups[i]].xval += lbl->xval;
+    plbls[groups[i]].yval += lbl->yval;
+    plbls[groups[i]].zval += lbl->zval;
   }
 
-  ptn->plbl.xval /= ptn->nnodes;
-  ptn->plbl.yval /= ptn->nnodes;
-  ptn->plbl.zval /= ptn->nnodes;
-
-  return 0;
-
-fail:
-  return 1;
+  for (i = 0; i < agg->ngroups; i++) {
+    plbls[i].xval /= agg->sizes[i];
+    plbls[i].yval /= agg->sizes[i];
+    plbls[i].zval /= agg->sizes[i];
+  }
 }
 
-int _compare_nodes(const void *vn1, const void *vn2) {
+float _edge_weight(
+  graph_aggregate_t *agg,
+  uint32_t           i,
+  uint32_t           j,
+  uint32_t           count,
+  uint8_t            norm) {
 
-  node_t *n1;
-  node_t *n2;
+  float wt;
 
-  n1 = (node_t *)vn1;
-  n2 = (node_t *)vn2;
+  wt = count;
 
-  if (n1->lbl.labelval  > n2->lbl.labelval) return 1;
-  if (n1->lbl.labelval  < n2->lbl.labelval) return -1;
+  if (norm)
+    wt /= ((double)(agg->sizes[i]) * (agg->sizes[j])) / 2.0;
 
-  return 0;
+  return wt;
 }
@@ -32,19 +32,21 @@ static struct argp_option opts[] = {
   {"means",   'm',  NULL,  0, "print out node measures for each region"},
   {"nonorm",  'n',  NULL,  0, "show edge counts, rather "\
                               "than normalised densities"},
+  {NULL,      'j', "INT",  0, "number of threads (default: --threads)"},
   {0}
 };
 
 typedef struct _args {
 
-  char   *input;
-  char   *lblfile;
-  char   *lblmap;
-  uint8_t real;
-  uint8_t region;
-  uint8_t sizes;
-  uint8_t means;
-  uint8_t nonorm;
+  char    *input;
+  char    *lblfile;
+  char    *lblmap;
+  uint8_t  real;
+  uint8_t  region;
+  uint8_t  sizes;
+  uint8_t  means;
+  uint8_t  nonorm;
+  uint16_t nthreads;
 
 } args_t;
 
@@ -54,13 +56,14 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 
   switch (key) {
 
-    case 'l': args->lblfile = arg; break;
-    case 'a': args->lblmap  = arg; break;
-    case 'r': args->real    = 1;   break;
-    case 'e': args->region  = 1;   break;
-    case 's': args->sizes   = 1;   break;
-    case 'm': args->means   = 1;   break;
-    case 'n': args->nonorm  = 1;   break;
+    case 'l': args->lblfile  = arg;       break;
+    case 'a': args->lblmap   = arg;       break;
+    case 'r': args->real     = 1;         break;
+    case 'e': args->region   = 1;         break;
+    case 's': args->sizes    = 1;         break;
+    case 'm': args->means    = 1;         break;
+    case 'n': args->nonorm   = 1;         break;
+    case 'j': args->nthreads = atoi(arg); break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) args->input  = arg;
@@ -75,17 +78,13 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
-static uint8_t _mk_density_matrix(
-  graph_t          *g,
-  node_partition_t *ptn,
-  double           *matrix
-);
-
+/**
+ * Prints the matrix of edge counts or densities within and between
+ * every pair of regions.
+ */
 static void _print_density_matrix(
-  graph_t          *g,
-  node_partition_t *ptn,
-  double           *matrix,
-  uint8_t           nonorm
+  stats_regions_t *regs,  /**< region edge counts                    */
+  uint8_t          nonorm /**< print counts, rather than densities */
 );
 
 static void _print_region_sizes(
@@ -104,10 +103,9 @@ int main (int argc, char *argv[]) {
   uint8_t         *img;
   args_t           args;
   node_partition_t ptn;
-  double          *matrix;
+  stats_regions_t  regs;
   struct argp      argp = {opts, _parse_opt, "INPUT", doc};
 
-  matrix = NULL;
   memset(&args, 0, sizeof(args));
 
   startup("creg", argc, argv, &argp, &args);
@@ -146,19 +144,14 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
 
-  matrix = calloc(sizeof(double), ptn.nparts*ptn.nparts);
-  if (matrix == NULL) {
-    printf("out of memory?\n");
-    goto fail;
-  }
-
   if (args.region) {  
-    if (_mk_density_matrix(&g, &ptn, matrix)) {
+    if (stats_regions(&g, args.nthreads, &regs)) {
       printf("error creating density matrix\n");
       goto fail;
     }
 
-    _print_density_matrix(&g, &ptn, matrix, args.nonorm);
+    _print_density_matrix(&regs, args.nonorm);
+    stats_regions_free(&regs);
   }
 
   if (args.sizes) {
@@ -181,98 +174,31 @@ fail:
 
 
 
-uint8_t _mk_density_matrix(
-  graph_t *g, node_partition_t *ptn, double *matrix) {
-
-  uint64_t       i;
-  uint64_t       j;
-  int64_t        iptnid;
-  int64_t        jptnid;
-  uint32_t       nnodes;
-  uint32_t       nparts;
-  uint32_t       nnbrs;
-  uint32_t      *nbrs;
-  graph_label_t *lbl;
-
-  nparts = ptn->nparts;
-  nnodes = graph_num_nodes(g);
-
-  for (i = 0; i < nnodes; i++) {
-
-    nnbrs  = graph_num_neighbours(g, i);
-    nbrs   = graph_get_neighbours(g, i);
-    lbl    = graph_get_nodelabel( g, i);
-    iptnid = array_find(ptn->partids, &(lbl->labelval), 1);
-    if (iptnid < 0) goto fail;
-    
-    for (j = 0; j < nnbrs; j++) {
-
-      if (i > nbrs[j]) continue;
-
-      lbl = graph_get_nodelabel(g, nbrs[j]);
-
-      jptnid = array_find(ptn->partids, &(lbl->labelval), 1);
-      if (jptnid < 0) goto fail;
-
-      if (iptnid == jptnid) {
-        matrix[iptnid*nparts + jptnid] ++;
-      }
-      else {
-        matrix[iptnid*nparts + jptnid] ++;
-        matrix[jptnid*nparts + iptnid] ++;
-      }
-    }
-  }
-
-  return 0;
-  
-fail:
-  return 1;
-}
-
-void _print_density_matrix(
-  graph_t *g, node_partition_t *ptn, double *matrix, uint8_t nonorm) {
+void _print_density_matrix(stats_regions_t *regs, uint8_t nonorm) {
 
   uint64_t i;
   uint64_t j;
-  uint32_t iid;
-  uint32_t isz;
-  uint32_t jsz;
-  uint32_t normfac;
-  uint32_t nparts;
+  uint32_t nregs;
   double   val;
 
-  nparts = ptn->nparts;
+  nregs = regs->nregions;
 
   printf("       ");
-  for (i = 0; i < nparts; i++) {
-    iid = *(uint32_t *)array_getd(ptn->partids, i);
-    printf("%6u ", iid);
-  }
+  for (i = 0; i < nregs; i++) printf("%6u ", regs->labels[i]);
   printf("\n\n");
 
-  for (i = 0; i < nparts; i++) {
-    
-    iid = *(uint32_t *)array_getd(ptn->partids, i);
-    isz  = ((array_t *)array_getd(ptn->parts,   i))->size;
+  for (i = 0; i < nregs; i++) {
     
-    printf("%6u ", iid);
+    printf("%6u ", regs->labels[i]);
     
-    for (j = 0; j < nparts; j++) {
-
-      val = matrix[i * nparts + j];
-
-      jsz = ((array_t *)array_getd(ptn->parts, j))->size;
-
-      if (nonorm) printf("%6u ", (uint32_t)val);
+    for (j = 0; j < nregs; j++) {
 
+      if (nonorm) {
+        val = regs->counts[i * nregs + j];
+        printf("%6u ", (uint32_t)val);
+      }
       else {
-
-        if (i == j) normfac = (isz*(isz-1)/2.0);
-        else        normfac = isz*jsz;
-
-        if (normfac > 1) val /= normfac;
-
+        val = stats_region_density(regs, i, j);
         printf("%12.10f ", val);
       }
     }
@@ -53,7 +53,14 @@ static void _crop_hdr(
   args_t *args
 );
 
-static void _crop_img(
+/**
+ * Copies the cropped region of the input image into the output image. All
+ * of the values along the fourth and higher dimensions are copied.
+ *
+ * \return 0 on success, non-0 if the crop limits are outside of the input
+ * image.
+ */
+static uint8_t _crop_img(
   dsr_t   *inhdr,
   dsr_t   *outhdr,
   uint8_t *inimg,
@@ -99,7 +106,11 @@ int main (int argc, char *argv[]) {
   outimg = calloc(nbytes, 1);
   if (outimg == NULL) goto fail;
 
-  _crop_img(&inhdr, &outhdr, inimg, outimg, &args);
+  if (args.xlo > args.xhi || args.ylo > args.yhi || args.zlo > args.zhi ||
+      _crop_img(&inhdr, &outhdr, inimg, outimg, &args)) {
+    printf("invalid crop limits\n");
+    goto fail;
+  }
 
   if (analyze_write_hdr(args.output, &outhdr)) {
     printf("error writing header %s\n", args.output);
@@ -161,7 +172,7 @@ static void _crop_hdr(dsr_t *inhdr, dsr_t *outhdr, args_t *args) {
   outhdr->dime.dim[3] = args->zhi - args->zlo;
 }
 
-static void _crop_img(
+static uint8_t _crop_img(
   dsr_t   *inhdr,
   dsr_t   *outhdr,
   uint8_t *inimg,
@@ -169,31 +180,20 @@ static void _crop_img(
   args_t  *args
 ) {
 
-  uint32_t xsz;
-  uint32_t ysz;
-  uint32_t zsz;
-  uint32_t ini[4];
-  uint32_t outi[4];
-  double   val;
+  uint8_t  i;
+  uint32_t ini[8];
+  uint32_t outi[8];
+  uint32_t size[8];
 
   memset(ini,  0, sizeof(ini));
   memset(outi, 0, sizeof(outi));
 
-  xsz = analyze_dim_size(outhdr, 0);
-  ysz = analyze_dim_size(outhdr, 1);
-  zsz = analyze_dim_size(outhdr, 2);
-
-  for (outi[0] = 0; outi[0] < xsz; outi[0]++) {
-    for (outi[1] = 0; outi[1] < ysz; outi[1]++) {
-      for (outi[2] = 0; outi[2] < zsz; outi[2]++) {
+  for (i = 0; i < analyze_num_dims(outhdr) && i < 8; i++)
+    size[i] = analyze_dim_size(outhdr, i);
 
-        ini[0] = outi[0] + args->xlo;
-        ini[1] = outi[1] + args->ylo;
-        ini[2] = outi[2] + args->zlo;
+  ini[0] = args->xlo;
+  ini[1] = args->ylo;
+  ini[2] = args->zlo;
 
-        val = analyze_read_val(inhdr,  inimg,  ini);
-        analyze_write_val(     outhdr, outimg, outi, val);
-      }
-    }
-  }
+  return analyze_copy_box(inhdr, inimg, ini, outhdr, outimg, outi, size);
 }
@@ -12,7 +12,9 @@
 
 #include "graph/graph.h"
 #include "graph/graph_seed.h"
+#include "graph/graph_spatial.h"
 #include "util/startup.h"
+#include "io/ngdb.h"
 #include "io/ngdb_graph.h"
 #include "io/analyze75.h"
 
@@ -96,12 +98,24 @@ static uint8_t _get_seed_node(
   array_t *seeds
 );
 
+/**
+ * Equivalent to _get_seed_node, but searches the input ngdb file directly,
+ * rather than a graph which has been loaded from it. Label files are not
+ * supported.
+ */
+static uint8_t _get_seed_node_ngdb(
+  args_t  *args,
+  ngdb_t  *ngdb,
+  array_t *seeds
+);
+
 int main (int argc, char *argv[]) {
 
 
   graph_t     gin;
   graph_t     gout;
   graph_t     grem;
+  ngdb_t     *ngdb;
   array_t     seeds;
   struct argp argp = {opts, _parse_opt, "INPUT OUTPUT", doc};
   args_t      args;  
@@ -111,25 +125,57 @@ int main (int argc, char *argv[]) {
 
   startup("cseed", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &gin)) {
-    printf("Could not read in %s\n", args.input);
-    goto fail;
-  }
-
   if (array_create(&seeds, sizeof(uint32_t), 10)) {
     printf("out of memory?!\n");
     goto fail;
   }
 
-  if(_get_seed_node(&args, &gin, &seeds)) {
-    printf("Could not find seed node(s)\n");
-    goto fail;
+  /*
+   * Unless we need the remainder graph, or need to
+   * relabel the input graph, the subgraph can be read
+   * straight from the input file, without loading
+   * the whole graph.
+   */
+  if (args.saverem == NULL && args.labelf == NULL) {
+
+    ngdb = ngdb_open_mmap(args.input);
+    if (ngdb == NULL) ngdb = ngdb_open(args.input);
+    if (ngdb == NULL) {
+      printf("Could not read in %s\n", args.input);
+      goto fail;
+    }
+
+    if (_get_seed_node_ngdb(&args, ngdb, &seeds)) {
+      printf("Could not find seed node(s)\n");
+      goto fail;
+    }
+
+    if (ngdb_read_seed(
+          ngdb, &gout, (uint32_t *)seeds.data, seeds.size, args.depth)) {
+      printf("Error creating seed subgraph\n");
+      goto fail;
+    }
+
+    ngdb_close(ngdb);
   }
 
-  if (graph_seed(
-        &gin, &gout, (uint32_t *)seeds.data, seeds.size, args.depth, &grem)) {
-    printf("Error creating seed subgraph\n");
-    goto fail;
+  else {
+
+    if (ngdb_read(args.input, &gin)) {
+      printf("Could not read in %s\n", args.input);
+      goto fail;
+    }
+
+    if(_get_seed_node(&args, &gin, &seeds)) {
+      printf("Could not find seed node(s)\n");
+      goto fail;
+    }
+
+    if (graph_seed(
+          &gin, &gout, (uint32_t *)seeds.data, seeds.size, args.depth, &grem)) {
+      printf("Error creating seed subgraph\n");
+      goto fail;
+    }
   }
 
   if (ngdb_write(&gout, args.output)) {
@@ -157,6 +203,9 @@ uint8_t _get_seed_node(args_t *args, graph_t *gin, array_t *seeds) {
   uint32_t       thisdeg;
   uint32_t       maxdeg;
   uint32_t       maxdegi;
+  uint32_t       seed;
+  float          pt[3];
+  double         dist;
   dsr_t          hdr;
   uint8_t       *img;
   graph_label_t *lbl;
@@ -174,16 +223,13 @@ uint8_t _get_seed_node(args_t *args, graph_t *gin, array_t *seeds) {
   /* xyz coordinates used to specify seed */
   else if (args->usecds) {
 
-    for (i = 0; i < nnodes; i++) {
-      
-      lbl = graph_get_nodelabel(gin, i);
+    pt[0] = args->x;
+    pt[1] = args->y;
+    pt[2] = args->z;
 
-      if ( lbl->xval == args->x
-        && lbl->yval == args->y
-        && lbl->zval == args->z) {
-        if (array_append(seeds, (uint32_t *)(&i))) goto fail;
-        break;
-      }
+    /* the lowest ID node at exactly the given coordinates */
+    if (!graph_spatial_nearest(gin, pt, &seed, &dist) && dist == 0) {
+      if (array_append(seeds, &seed)) goto fail;
     }
   }
 
@@ -224,3 +270,78 @@ uint8_t _get_seed_node(args_t *args, graph_t *gin, array_t *seeds) {
 fail:
   return -1;
 }
+
+uint8_t _get_seed_node_ngdb(args_t *args, ngdb_t *ngdb, array_t *seeds) {
+
+  uint64_t      i;
+  uint32_t      nnodes;
+  uint32_t      thisdeg;
+  uint32_t      maxdeg;
+  uint32_t      maxdegi;
+  ngdb_label_t  lbl;
+
+  nnodes  = ngdb_num_nodes(ngdb);
+  thisdeg = 0;
+  maxdeg  = 0;
+  maxdegi = 0;
+
+  if (ngdb_node_data_len(ngdb) > sizeof(ngdb_label_t)) goto fail;
+
+  memset(&lbl, 0, sizeof(ngdb_label_t));
+
+  /* node id used to specify seed */
+  if (args->usen) {
+    if (array_append(seeds, &(args->n))) goto fail;
+  }
+
+  /* xyz coordinates used to specify seed */
+  else if (args->usecds) {
+
+    for (i = 0; i < nnodes; i++) {
+
+      if (ngdb_node_get_data(ngdb, i, (uint8_t *)&lbl)) goto fail;
+
+      if ( lbl.label.xval == args->x
+        && lbl.label.yval == args->y
+        && lbl.label.zval == args->z) {
+        if (array_append(seeds, (uint32_t *)(&i))) goto fail;
+        break;
+      }
+    }
+  }
+
+  /* node with maximum degree used as seed */
+  else if (args->maxdeg) {
+
+    for (i = 0; i < nnodes; i++) {
+
+      thisdeg = ngdb_node_num_refs(ngdb, i);
+      if (thisdeg == 0xFFFFFFFF) goto fail;
+
+      if (thisdeg > maxdeg) {
+        maxdeg  = thisdeg;
+        maxdegi = i;
+      }
+    }
+
+    if (array_append(seeds, &maxdegi)) goto fail;
+  }
+
+  /* seed node(s) specified by label value(s)*/
+  else if (args->uselbl) {
+
+    for (i = 0; i < nnodes; i++) {
+
+      if (ngdb_node_get_data(ngdb, i, (uint8_t *)&lbl)) goto fail;
+
+      if (lbl.label.labelval == args->lblval) {
+        if (array_append(seeds, (uint32_t *)(&i))) goto fail;
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
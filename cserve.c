@@ -0,0 +1,769 @@
+/**
+ * Analysis server - keeps ngdb graphs, and their stats caches, loaded in
+ * memory between queries, so that repeated queries against the same large
+ * graphs do not pay for loading them each time.
+ *
+ * The server listens on a local (UNIX domain) socket. Each line sent by a
+ * client is one request - a command, followed by its arguments, separated
+ * by white space (so file names may not contain white space). The reply
+ * is zero or more lines of tab separated results, followed by a line
+ * containing "ok", or a line starting with "error:". The commands are:
+ *
+ *   stats GRAPH NAME...         print graph-level statistics (any of the
+ *                               names listed by cserve --help)
+ *   seed  GRAPH OUTPUT DEPTH NODE...
+ *                               save the subgraph reached from the given
+ *                               seed nodes, like cseed -n -d
+ *   slice GRAPH OUTPUT XLO XHI YLO YHI ZLO ZHI
+ *                               save the subgraph of the nodes within the
+ *                               given (inclusive) coordinate ranges, like
+ *                               cslice
+ *   load  GRAPH                 load a graph, if it is not already loaded
+ *   evict GRAPH                 unload a graph
+ *   list                        print the loaded graphs
+ *   shutdown                    stop the server
+ *
+ * A graph is loaded the first time it is named, and reloaded if its file
+ * has been modified since. If a memory budget is given (--mem-budget),
+ * the least recently used graphs are unloaded so that the graphs and
+ * their stats caches (as counted by util/memacct.h) fit within it.
+ * Requests are served one at a time; statistics are calculated with the
+ * default number of threads (--threads).
+ *
+ * With --client, a single request, given on the command line, is sent to
+ * the server, and the reply printed.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "graph/graph.h"
+#include "graph/graph_seed.h"
+#include "graph/graph_view.h"
+#include "io/ngdb_graph.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "util/getline.h"
+#include "util/memacct.h"
+#include "util/startup.h"
+
+/**
+ * Maximum number of graphs which are kept loaded at once.
+ */
+#define MAX_GRAPHS 64
+
+/**
+ * Maximum number of words in a request.
+ */
+#define MAX_WORDS 4096
+
+typedef struct _args {
+
+  char    *socket; /**< socket path                       */
+  uint8_t  client; /**< send a request, rather than serve */
+  char    *words[MAX_WORDS];
+  uint32_t nwords;
+
+} args_t;
+
+/**
+ * A loaded graph.
+ */
+typedef struct _entry {
+
+  char     *path;     /**< file the graph was loaded from          */
+  time_t    mtime;    /**< modification time of the file when it
+                           was loaded                              */
+  uint64_t  bytes;    /**< memory used by the graph and its cache  */
+  uint64_t  lastused; /**< server clock value at last request      */
+  graph_t   g;        /**< the graph                               */
+
+} entry_t;
+
+/**
+ * Server state.
+ */
+typedef struct _server {
+
+  uint32_t nentries;            /**< number of loaded graphs    */
+  uint64_t clock;               /**< incremented every request  */
+  uint8_t  done;                /**< set by shutdown            */
+  entry_t  entries[MAX_GRAPHS]; /**< the loaded graphs          */
+
+} server_t;
+
+typedef struct _cserve_stat {
+
+  char   *name;              /**< name used in requests     */
+  double (*fn)(graph_t *g);  /**< function which calculates */
+
+} cserve_stat_t;
+
+static double _num_nodes(graph_t *g);
+static double _num_edges(graph_t *g);
+
+/**
+ * Statistics which may be requested with the stats command.
+ */
+static cserve_stat_t _stats[] = {
+  {"nodes",         _num_nodes},
+  {"edges",         _num_edges},
+  {"density",       stats_density},
+  {"degree",        stats_avg_degree},
+  {"maxdegree",     stats_cache_max_degree},
+  {"clustering",    stats_cache_graph_clustering},
+  {"pathlength",    stats_cache_graph_pathlength},
+  {"efficiency",    stats_cache_global_efficiency},
+  {"components",    stats_cache_num_components},
+  {"assortativity", stats_cache_assortativity},
+  {"modularity",    stats_cache_modularity},
+  {"chira",         stats_cache_chira},
+  {"diameter",      stats_cache_diameter},
+  {NULL,            NULL}
+};
+
+static char doc[] = "cserve -- serve queries over resident ngdb graphs\v"\
+  "Requests (one per line): stats GRAPH NAME..., "\
+  "seed GRAPH OUTPUT DEPTH NODE..., "\
+  "slice GRAPH OUTPUT XLO XHI YLO YHI ZLO ZHI, load GRAPH, evict GRAPH, "\
+  "list, shutdown. Statistics: nodes, edges, density, degree, maxdegree, "\
+  "clustering, pathlength, efficiency, components, assortativity, "\
+  "modularity, chira, diameter.";
+
+static struct argp_option options[] = {
+  {"client", 'c', NULL, 0, "send the request given after SOCKET to the "\
+                           "server, and print the reply"},
+  {0}
+};
+
+static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
+
+  args_t *args = state->input;
+
+  switch (key) {
+
+    case 'c': args->client = 1; break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num == 0) args->socket = arg;
+      else if (args->nwords < MAX_WORDS)
+        args->words[args->nwords++] = arg;
+      else argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < 1)                 argp_usage(state);
+      if ( args->client && args->nwords == 0) argp_usage(state);
+      if (!args->client && args->nwords >  0) argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Listens on the given socket, and serves requests until a shutdown
+ * request is received.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _serve(
+  char *path /**< socket path */
+);
+
+/**
+ * Sends the given request to the server, and prints the reply.
+ *
+ * \return 0 if the server replied "ok", non-0 otherwise.
+ */
+static uint8_t _client(
+  char     *path,   /**< socket path          */
+  char    **words,  /**< words of the request */
+  uint32_t  nwords  /**< number of words      */
+);
+
+/**
+ * Runs the given request, and writes the reply, other than the final ok or
+ * error line, to the given stream.
+ *
+ * \return NULL on success, or an error message on failure.
+ */
+static char * _request(
+  server_t *srv,   /**< server state              */
+  char     *line,  /**< the request               */
+  FILE     *out    /**< stream to write the reply */
+);
+
+/**
+ * Finds the given graph, loading it (and unloading others to make room
+ * for it) if necessary.
+ *
+ * \return the graph entry, or NULL on failure.
+ */
+static entry_t * _get_graph(
+  server_t *srv, /**< server state    */
+  char     *path /**< graph file name */
+);
+
+/**
+ * Unloads the given graph.
+ */
+static void _evict(
+  server_t *srv, /**< server state       */
+  uint32_t  idx  /**< index of the entry */
+);
+
+/**
+ * Unloads the least recently used graphs, other than the given one, until
+ * the loaded graphs use no more than the given number of bytes.
+ */
+static void _fit(
+  server_t *srv,   /**< server state                        */
+  entry_t  *keep,  /**< entry not to unload (may be NULL)   */
+  uint64_t  limit  /**< number of bytes to fit within       */
+);
+
+/**
+ * Creates a mask of the nodes of the given graph which are within the
+ * given coordinate ranges.
+ */
+static void _slice_mask(
+  graph_t *g,    /**< the graph                          */
+  float   *lo,   /**< low X, Y and Z coordinates         */
+  float   *hi,   /**< high X, Y and Z coordinates        */
+  uint8_t *mask  /**< space for one value for every node */
+);
+
+int main(int argc, char *argv[]) {
+
+  args_t      args;
+  struct argp argp = {options, _parse_opt, "SOCKET [REQUEST...]", doc};
+
+  memset(&args, 0, sizeof(args_t));
+
+  startup("cserve", argc, argv, &argp, &args);
+
+  if (args.client) return _client(args.socket, args.words, args.nwords);
+  else             return _serve(args.socket);
+}
+
+uint8_t _serve(char *path) {
+
+  uint64_t            i;
+  int                 lfd;
+  int                 fd;
+  FILE               *in;
+  FILE               *out;
+  char               *line;
+  char               *err;
+  size_t              len;
+  server_t           *srv;
+  struct sockaddr_un  addr;
+  struct stat         st;
+
+  lfd  = -1;
+  line = NULL;
+  len  = 0;
+
+  srv = calloc(1, sizeof(server_t));
+  if (srv == NULL) {
+    printf("out of memory?\n");
+    goto fail;
+  }
+
+  /*a client which disconnects early must not kill the server*/
+  signal(SIGPIPE, SIG_IGN);
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("socket path %s is too long\n", path);
+    goto fail;
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  /*
+   * a socket left behind by an earlier server is
+   * removed, but nothing else is ever replaced
+   */
+  if (lstat(path, &st) == 0) {
+
+    if (!S_ISSOCK(st.st_mode)) {
+      printf("%s exists, and is not a socket\n", path);
+      goto fail;
+    }
+
+    if (unlink(path) != 0) {
+      printf("error removing %s: %s\n", path, strerror(errno));
+      goto fail;
+    }
+  }
+
+  lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (lfd < 0                                                     ||
+      bind(lfd, (struct sockaddr *)&addr, sizeof(addr))      != 0 ||
+      listen(lfd, 16)                                        != 0) {
+    printf("error listening on %s: %s\n", path, strerror(errno));
+    goto fail;
+  }
+
+  printf("listening on %s\n", path);
+  fflush(stdout);
+
+  while (!srv->done) {
+
+    fd = accept(lfd, NULL, NULL);
+
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      printf("error accepting connection: %s\n", strerror(errno));
+      goto fail;
+    }
+
+    in  = fdopen(fd, "r");
+    out = (in == NULL) ? NULL : fdopen(dup(fd), "w");
+
+    if (out == NULL) {
+      if (in != NULL) fclose(in);
+      else            close(fd);
+      continue;
+    }
+
+    while (!srv->done && cnet_getline(&line, &len, in) > 0) {
+
+      err = _request(srv, line, out);
+
+      if (err == NULL) fprintf(out, "ok\n");
+      else             fprintf(out, "error: %s\n", err);
+
+      fflush(out);
+    }
+
+    fclose(in);
+    fclose(out);
+  }
+
+  for (i = srv->nentries; i > 0; i--) _evict(srv, i - 1);
+
+  close(lfd);
+  unlink(path);
+  free(srv);
+  if (line != NULL) free(line);
+  return 0;
+
+fail:
+  if (lfd  >= 0)    close(lfd);
+  if (srv  != NULL) free(srv);
+  if (line != NULL) free(line);
+  return 1;
+}
+
+uint8_t _client(char *path, char **words, uint32_t nwords) {
+
+  uint64_t            i;
+  int                 fd;
+  FILE               *in;
+  FILE               *out;
+  char               *line;
+  size_t              len;
+  uint8_t             ok;
+  struct sockaddr_un  addr;
+
+  line = NULL;
+  len  = 0;
+  ok   = 0;
+  in   = NULL;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) goto fail;
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) goto fail;
+
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    printf("error connecting to %s: %s\n", path, strerror(errno));
+    close(fd);
+    goto fail;
+  }
+
+  in  = fdopen(fd, "r");
+  out = (in == NULL) ? NULL : fdopen(dup(fd), "w");
+
+  if (out == NULL) {
+    if (in != NULL) fclose(in);
+    else            close(fd);
+    goto fail;
+  }
+
+  for (i = 0; i < nwords; i++)
+    fprintf(out, "%s%s", (i > 0) ? " " : "", words[i]);
+  fprintf(out, "\n");
+  fclose(out);
+
+  while (cnet_getline(&line, &len, in) > 0) {
+
+    if (!strcmp(line, "ok\n")) {
+      ok = 1;
+      break;
+    }
+
+    fputs(line, stdout);
+    if (!strncmp(line, "error:", 6)) break;
+  }
+
+  fclose(in);
+  if (line != NULL) free(line);
+  return !ok;
+
+fail:
+  if (line != NULL) free(line);
+  return 1;
+}
+
+char * _request(server_t *srv, char *line, FILE *out) {
+
+  uint64_t      i;
+  uint32_t      sidx;
+  uint32_t      nwords;
+  uint32_t      nseeds;
+  uint64_t      before;
+  int64_t       delta;
+  char         *words[MAX_WORDS];
+  char         *save;
+  char         *err;
+  uint32_t     *seeds;
+  uint8_t      *mask;
+  uint32_t      nnodes;
+  float         lo[3];
+  float         hi[3];
+  entry_t      *e;
+  graph_t       gout;
+  graph_view_t  view;
+
+  e      = NULL;
+  seeds  = NULL;
+  mask   = NULL;
+  err    = NULL;
+  nwords = 0;
+  before = memacct_current(MEMACCT_NONE);
+
+  srv->clock++;
+
+  words[0] = strtok_r(line, " \t\r\n", &save);
+
+  while (words[nwords] != NULL && nwords < MAX_WORDS - 1) {
+    nwords++;
+    words[nwords] = strtok_r(NULL, " \t\r\n", &save);
+  }
+
+  if (nwords == 0) return "empty request";
+
+  if (!strcmp(words[0], "shutdown")) {
+    srv->done = 1;
+    return NULL;
+  }
+
+  if (!strcmp(words[0], "list")) {
+
+    for (i = 0; i < srv->nentries; i++) {
+      e = srv->entries + i;
+      fprintf(out, "%s\t%u\t%u\t%lu\n",
+              e->path,
+              graph_num_nodes(&e->g),
+              graph_num_edges(&e->g),
+              e->bytes);
+    }
+    return NULL;
+  }
+
+  if (strcmp(words[0], "stats") &&
+      strcmp(words[0], "seed")  &&
+      strcmp(words[0], "slice") &&
+      strcmp(words[0], "load")  &&
+      strcmp(words[0], "evict"))
+    return "unknown command";
+
+  if (nwords < 2) return "no graph given";
+
+  if (!strcmp(words[0], "evict")) {
+
+    for (i = 0; i < srv->nentries; i++) {
+      if (!strcmp(srv->entries[i].path, words[1])) {
+        _evict(srv, i);
+        return NULL;
+      }
+    }
+    return "graph is not loaded";
+  }
+
+  /*every other request needs the graph*/
+  if (!strcmp(words[0], "stats") && nwords < 3) return "no statistics given";
+  if (!strcmp(words[0], "seed")  && nwords < 5) return "usage: seed GRAPH "
+                                                       "OUTPUT DEPTH NODE...";
+  if (!strcmp(words[0], "slice") && nwords != 9)
+    return "usage: slice GRAPH OUTPUT XLO XHI YLO YHI ZLO ZHI";
+
+  if (!strcmp(words[0], "stats")) {
+    for (i = 2; i < nwords; i++) {
+
+      sidx = 0;
+      while (_stats[sidx].name != NULL && strcmp(_stats[sidx].name, words[i]))
+        sidx++;
+
+      if (_stats[sidx].name == NULL) return "unknown statistic";
+    }
+  }
+
+  e = _get_graph(srv, words[1]);
+  if (e == NULL) return "could not load graph";
+
+  before = memacct_current(MEMACCT_NONE);
+  nnodes = graph_num_nodes(&e->g);
+
+  if (!strcmp(words[0], "load")) {
+    fprintf(out, "nodes\t%u\n", nnodes);
+    fprintf(out, "edges\t%u\n", graph_num_edges(&e->g));
+  }
+
+  else if (!strcmp(words[0], "stats")) {
+
+    for (i = 2; i < nwords; i++) {
+
+      sidx = 0;
+      while (strcmp(_stats[sidx].name, words[i])) sidx++;
+
+      fprintf(out, "%s\t%f\n", words[i], _stats[sidx].fn(&e->g));
+    }
+  }
+
+  else if (!strcmp(words[0], "seed")) {
+
+    nseeds = nwords - 4;
+    seeds  = malloc(nseeds * sizeof(uint32_t));
+
+    if (seeds == NULL) {
+      err = "out of memory";
+      goto end;
+    }
+
+    for (i = 0; i < nseeds; i++) {
+      seeds[i] = atoi(words[i + 4]);
+      if (seeds[i] >= nnodes) {
+        err = "invalid seed node";
+        goto end;
+      }
+    }
+
+    if (graph_seed(&e->g, &gout, seeds, nseeds, atoi(words[3]), NULL)) {
+      err = "error creating seed subgraph";
+      goto end;
+    }
+
+    if (ngdb_write(&gout, words[2])) err = "could not write output file";
+
+    fprintf(out, "nodes\t%u\n", graph_num_nodes(&gout));
+    fprintf(out, "edges\t%u\n", graph_num_edges(&gout));
+    graph_free(&gout);
+  }
+
+  else if (!strcmp(words[0], "slice")) {
+
+    for (i = 0; i < 3; i++) {
+      lo[i] = atof(words[3 + 2*i]);
+      hi[i] = atof(words[4 + 2*i]);
+    }
+
+    mask = calloc((uint64_t)nnodes + 1, sizeof(uint8_t));
+    if (mask == NULL) {
+      err = "out of memory";
+      goto end;
+    }
+
+    _slice_mask(&e->g, lo, hi, mask);
+
+    /*the subgraph is written straight from a view of the graph*/
+    if (graph_view_create(&view, &e->g, mask)) {
+      err = "error creating subgraph";
+      goto end;
+    }
+
+    if (ngdb_write_view(&view, words[2])) err = "could not write output file";
+
+    fprintf(out, "nodes\t%u\n", graph_view_num_nodes(&view));
+    graph_view_free(&view);
+  }
+
+end:
+
+  /*the graph's share of memory includes whatever its cache gained*/
+  delta = (int64_t)memacct_current(MEMACCT_NONE) - (int64_t)before;
+  if (delta < 0 && (uint64_t)(-delta) > e->bytes) e->bytes  = 0;
+  else                                            e->bytes += delta;
+
+  if (memacct_budget() > 0) _fit(srv, e, memacct_budget());
+
+  if (seeds != NULL) free(seeds);
+  if (mask  != NULL) free(mask);
+  return err;
+}
+
+entry_t * _get_graph(server_t *srv, char *path) {
+
+  uint64_t    i;
+  uint64_t    before;
+  uint64_t    budget;
+  uint64_t    used;
+  entry_t    *e;
+  struct stat st;
+
+  e = NULL;
+
+  if (stat(path, &st)) goto fail;
+
+  for (i = 0; i < srv->nentries; i++) {
+
+    if (strcmp(srv->entries[i].path, path)) continue;
+
+    /*reload the graph if its file has changed*/
+    if (srv->entries[i].mtime != st.st_mtime) {
+      _evict(srv, i);
+      break;
+    }
+
+    srv->entries[i].lastused = srv->clock;
+    return srv->entries + i;
+  }
+
+  /*
+   * make room for the graph - its size in
+   * memory is guessed from the file size
+   */
+  budget = memacct_budget();
+  if (budget > 0) {
+    if ((uint64_t)st.st_size >= budget) _fit(srv, NULL, 0);
+    else                                _fit(srv, NULL, budget - st.st_size);
+  }
+
+  if (srv->nentries == MAX_GRAPHS) {
+
+    used = 0;
+    for (i = 1; i < srv->nentries; i++) {
+      if (srv->entries[i].lastused < srv->entries[used].lastused) used = i;
+    }
+    _evict(srv, used);
+  }
+
+  e = srv->entries + srv->nentries;
+
+  memset(e, 0, sizeof(entry_t));
+
+  before = memacct_current(MEMACCT_NONE);
+
+  e->path = strdup(path);
+  if (e->path == NULL) goto fail;
+
+  if (ngdb_read(path, &e->g)) goto fail;
+
+  /*the graph is not modified, so it can be frozen for faster traversal*/
+  if (graph_freeze(&e->g) || stats_cache_init(&e->g)) {
+    graph_free(&e->g);
+    goto fail;
+  }
+
+  e->mtime    = st.st_mtime;
+  e->lastused = srv->clock;
+  e->bytes    = memacct_current(MEMACCT_NONE) - before;
+
+  srv->nentries++;
+
+  return e;
+
+fail:
+  if (e != NULL && e->path != NULL) free(e->path);
+  return NULL;
+}
+
+void _evict(server_t *srv, uint32_t idx) {
+
+  entry_t *e;
+
+  e = srv->entries + idx;
+
+  graph_free(&e->g);
+  free(e->path);
+
+  srv->nentries--;
+
+  memmove(e, e + 1, (srv->nentries - idx) * sizeof(entry_t));
+}
+
+void _fit(server_t *srv, entry_t *keep, uint64_t limit) {
+
+  uint64_t i;
+  uint64_t lru;
+  uint64_t used;
+
+  while (1) {
+
+    used = 0;
+    lru  = srv->nentries;
+
+    for (i = 0; i < srv->nentries; i++) {
+
+      used += srv->entries[i].bytes;
+
+      if (srv->entries + i == keep) continue;
+      if (lru == srv->nentries ||
+          srv->entries[i].lastused < srv->entries[lru].lastused)
+        lru = i;
+    }
+
+    if (used <= limit)         break;
+    if (lru == srv->nentries) break;
+
+    _evict(srv, lru);
+
+    /*the kept entry moves down when an entry before it is removed*/
+    if (keep != NULL && keep > srv->entries + lru) keep--;
+  }
+}
+
+void _slice_mask(graph_t *g, float *lo, float *hi, uint8_t *mask) {
+
+  uint64_t       i;
+  graph_label_t *lbl;
+
+  for (i = 0; i < graph_num_nodes(g); i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+
+    mask[i] = lbl->xval >= lo[0] && lbl->xval <= hi[0] &&
+              lbl->yval >= lo[1] && lbl->yval <= hi[1] &&
+              lbl->zval >= lo[2] && lbl->zval <= hi[2];
+  }
+}
+
+double _num_nodes(graph_t *g) {
+  return graph_num_nodes(g);
+}
+
+double _num_edges(graph_t *g) {
+  return graph_num_edges(g);
+}
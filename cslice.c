@@ -17,7 +17,7 @@
 #include "stats/stats.h"
 #include "graph/graph.h"
 #include "graph/graph_log.h"
-#include "graph/graph_mask.h"
+#include "graph/graph_spatial.h"
 #include "util/startup.h"
 #include "util/array.h"
 #include "io/ngdb_graph.h"
@@ -106,6 +106,7 @@ static uint8_t _find_nodes_by_coordinate(
 
 int main (int argc, char *argv[]) {
 
+  ngdb_t     *ngdb;
   graph_t     gin;
   graph_t     gout;
   uint32_t    nginnodes;
@@ -124,7 +125,13 @@ int main (int argc, char *argv[]) {
 
   startup("cslice", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &gin)) {
+  /*
+   * node labels are loaded first, and then only the
+   * adjacency of the nodes which are in the box
+   */
+  ngdb = ngdb_open_mmap(args.input);
+  if (ngdb == NULL) ngdb = ngdb_open(args.input);
+  if (ngdb == NULL || ngdb_read_nodes(ngdb, &gin, NULL)) {
     printf("Could not read in %s\n", args.input);
     goto fail;
   }
@@ -145,11 +152,13 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
   
-  if (graph_mask(&gin, &gout, mask)) {
+  if (ngdb_read_mask(ngdb, &gout, mask)) {
     printf("could not mask graph\n");
     goto fail;
   }
 
+  ngdb_close(ngdb);
+
   if (graph_log_copy(&gin, &gout)) {
     printf("Error copying graph log\n");
     goto fail;
@@ -181,21 +190,30 @@ uint8_t _find_nodes_by_coordinate(
   float zlo, float zhi,
   uint8_t *mask) {
 
-  uint64_t       i;
-  uint32_t       nnodes;
-  graph_label_t *lbl;
+  uint64_t i;
+  uint32_t n;
+  array_t  nodes;
+  float    lo[3];
+  float    hi[3];
 
-  nnodes = graph_num_nodes(g);
+  nodes.data = NULL;
 
-  for (i = 0; i < nnodes; i++) {
+  lo[0] = xlo; lo[1] = ylo; lo[2] = zlo;
+  hi[0] = xhi; hi[1] = yhi; hi[2] = zhi;
 
-    lbl = graph_get_nodelabel(g, i);
+  if (array_create(&nodes, sizeof(uint32_t), 1024)) goto fail;
+  if (graph_spatial_box(g, lo, hi, &nodes))         goto fail;
 
-    if (lbl->xval >= xlo && lbl->xval <= xhi) 
-      if (lbl->yval >= ylo && lbl->yval <= yhi) 
-        if (lbl->zval >= zlo && lbl->zval <= zhi)
-          mask[i] = 1;
+  for (i = 0; i < nodes.size; i++) {
+    array_get(&nodes, i, &n);
+    mask[n] = 1;
   }
 
+  array_free(&nodes);
+
   return 0;
+
+fail:
+  if (nodes.data != NULL) array_free(&nodes);
+  return 1;
 }
@@ -0,0 +1,517 @@
+/**
+ * Threshold a weighted ngdb file at a series of thresholds, and calculate
+ * statistics over each thresholded graph. The edges of the input graph are
+ * sorted once, and added to a graph from the highest weight to the lowest
+ * (see graph/graph_sweep.h), so every threshold is produced from one pass
+ * over the edges. The thresholded graphs may optionally be saved.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+
+#include <argp.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "graph/graph_sweep.h"
+#include "io/ngdb_graph.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "util/startup.h"
+
+/**
+ * Ways in which the thresholds may be specified (see cthres).
+ */
+typedef enum {
+  SWEEP_WEIGHT = 0, /**< edge weight                    */
+  SWEEP_DENSITY,    /**< graph density                  */
+  SWEEP_PERCENTILE, /**< percentile of the edge weights */
+  SWEEP_COUNT       /**< number of edges                */
+} sweep_mode_t;
+
+typedef struct _args {
+  char   *input;
+  char   *values;
+  char   *stats;
+  char   *prefix;
+  uint8_t mode;
+  uint8_t absval;
+  uint8_t reverse;
+} args_t;
+
+/**
+ * A statistic which may be calculated at each threshold. Statistics which
+ * are tracked by the sweep are read from it directly; the others are
+ * calculated from scratch on each thresholded graph.
+ */
+typedef struct _sweep_stat {
+
+  char     *name;                        /**< name used on the command line */
+  double  (*sweepfn)(graph_sweep_t *gs); /**< function which reads it from
+                                              the sweep, or NULL            */
+  double  (*graphfn)(graph_t *g);        /**< function which calculates it
+                                              on the graph, or NULL         */
+  uint8_t   triangles;                   /**< whether triangles must be
+                                              tracked                       */
+
+} sweep_stat_t;
+
+/**
+ * A threshold in the sweep.
+ */
+typedef struct _checkpoint {
+
+  char    *value;  /**< threshold, as given on the command line */
+  uint64_t nedges; /**< number of edges retained at threshold    */
+
+} checkpoint_t;
+
+/**
+ * Functions which return the statistics maintained by the sweep.
+ */
+static double _num_nodes( graph_sweep_t *gs);
+static double _num_edges( graph_sweep_t *gs);
+static double _density(   graph_sweep_t *gs);
+static double _avg_degree(graph_sweep_t *gs);
+static double _max_degree(graph_sweep_t *gs);
+static double _clustering(graph_sweep_t *gs);
+static double _triangles( graph_sweep_t *gs);
+static double _components(graph_sweep_t *gs);
+static double _largest(   graph_sweep_t *gs);
+
+/**
+ * Statistics which may be calculated.
+ */
+static sweep_stat_t _stats[] = {
+  {"nodes",         _num_nodes,  NULL,                          0},
+  {"edges",         _num_edges,  NULL,                          0},
+  {"density",       _density,    NULL,                          0},
+  {"degree",        _avg_degree, NULL,                          0},
+  {"maxdegree",     _max_degree, NULL,                          0},
+  {"clustering",    _clustering, NULL,                          1},
+  {"triangles",     _triangles,  NULL,                          1},
+  {"components",    _components, NULL,                          0},
+  {"largest",       _largest,    NULL,                          0},
+  {"pathlength",    NULL,        stats_cache_graph_pathlength,  0},
+  {"efficiency",    NULL,        stats_cache_global_efficiency, 0},
+  {"assortativity", NULL,        stats_cache_assortativity,     0},
+  {"modularity",    NULL,        stats_cache_modularity,        0},
+  {"chira",         NULL,        stats_cache_chira,             0},
+  {NULL,            NULL,        NULL,                          0}
+};
+
+static char doc[] =
+  "csweep -- threshold a weighted ngdb file at a series of thresholds, "\
+  "and calculate statistics at each one\v"\
+  "Thresholds are given as a comma separated list of values. Statistics "\
+  "are printed for each threshold, in order of increasing number of "\
+  "edges. Available statistics: nodes, edges, density, degree, maxdegree, "\
+  "clustering, triangles, components, largest, pathlength, efficiency, "\
+  "assortativity, modularity, chira. The first nine are maintained as "\
+  "edges are added; the rest are calculated at each threshold.";
+
+static struct argp_option options[] = {
+  {"threshold",  't', "LIST",   0, "edge threshold values"},
+  {"density",    'd', "LIST",   0, "graph densities (0.0 - 1.0)"},
+  {"percentile", 'p', "LIST",   0, "percentiles of the edge weights "\
+                                   "(0.0 - 100.0)"},
+  {"count",      'k', "LIST",   0, "numbers of edges"},
+  {"stats",      's', "LIST",   0, "statistics to calculate (default: "\
+                                   "edges,density)"},
+  {"output",     'o', "PREFIX", 0, "save each thresholded graph to "\
+                                   "PREFIX_VALUE.ngdb"},
+  {"absval",     'a',  NULL,    0, "threshold at absolute value"},
+  {"reverse",    'r',  NULL,    0, "remove edges below the "\
+                                   "threshold, rather than above"},
+  {0}
+};
+
+static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
+
+  args_t *args;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 't':
+    case 'd':
+    case 'p':
+    case 'k':
+
+      if (args->values != NULL)
+        argp_error(state, "only one of -t, -d, -p and -k may be given");
+
+      if      (key == 't') args->mode = SWEEP_WEIGHT;
+      else if (key == 'd') args->mode = SWEEP_DENSITY;
+      else if (key == 'p') args->mode = SWEEP_PERCENTILE;
+      else                 args->mode = SWEEP_COUNT;
+
+      args->values = arg;
+      break;
+
+    case 's': args->stats   = arg; break;
+    case 'o': args->prefix  = arg; break;
+    case 'a': args->absval  = 1;   break;
+    case 'r': args->reverse = 1;   break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num == 0) args->input = arg;
+      else                     argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num != 1) argp_usage(state);
+      if (args->values == NULL)
+        argp_error(state, "one of -t, -d, -p and -k must be given");
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Parses the list of statistics.
+ *
+ * \return 0 on success, non-0 if the list contains an unknown statistic.
+ */
+static uint8_t _parse_stats(
+  char     *list,   /**< comma separated list of statistic names */
+  uint32_t *nstats, /**< place to store the number of statistics */
+  uint32_t *stats   /**< place to store indices into _stats      */
+);
+
+/**
+ * Parses the list of thresholds, and works out the number of edges which
+ * are retained at each one. The checkpoints are sorted by number of edges.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _parse_checkpoints(
+  args_t        *args,   /**< command line arguments                   */
+  graph_sweep_t *gs,     /**< the sweep                                */
+  char          *list,   /**< copy of the threshold list, which is
+                              modified, and referred to by the
+                              checkpoints                              */
+  uint32_t      *ncps,   /**< place to store the number of checkpoints */
+  checkpoint_t **cps     /**< place to store a pointer to an allocated
+                              array of checkpoints                     */
+);
+
+/**
+ * Calculates the given statistic on the current graph of the sweep.
+ *
+ * \return the value of the statistic, or NAN on failure.
+ */
+static double _calculate(
+  graph_sweep_t *gs,  /**< the sweep                   */
+  sweep_stat_t  *stat /**< the statistic to calculate */
+);
+
+/**
+ * qsort comparison function for checkpoint_t structs, by number of edges.
+ */
+static int _compare_checkpoints(
+  const void *a, /**< pointer to a checkpoint_t */
+  const void *b  /**< pointer to a checkpoint_t */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t      i;
+  uint64_t      j;
+  graph_t       gin;
+  graph_sweep_t gs;
+  args_t        args;
+  uint32_t      nstats;
+  uint32_t     *stats;
+  uint32_t      ncps;
+  checkpoint_t *cps;
+  uint8_t       triangles;
+  char         *list;
+  char         *fname;
+  char         *names[] = {"threshold", "density", "percentile", "count"};
+  struct argp   argp    = {options, _parse_opt, "INPUT", doc};
+
+  stats = NULL;
+  cps   = NULL;
+  list  = NULL;
+  fname = NULL;
+  memset(&args, 0, sizeof(args));
+  memset(&gs,   0, sizeof(gs));
+
+  startup("csweep", argc, argv, &argp, &args);
+
+  if (args.stats == NULL) args.stats = "edges,density";
+
+  stats = malloc(sizeof(_stats) / sizeof(sweep_stat_t) * sizeof(uint32_t));
+  if (stats == NULL) goto fail;
+
+  if (_parse_stats(args.stats, &nstats, stats)) {
+    printf("unknown statistic in %s\n", args.stats);
+    goto fail;
+  }
+
+  for (i = 0, triangles = 0; i < nstats; i++)
+    triangles |= _stats[stats[i]].triangles;
+
+  if (ngdb_read(args.input, &gin)) {
+    printf("error opening input file %s\n", args.input);
+    goto fail;
+  }
+
+  if (graph_sweep_init(&gs, &gin, args.absval, args.reverse, triangles)) {
+    printf("error sorting edges (the graph must be undirected "\
+           "and weighted)\n");
+    goto fail;
+  }
+
+  graph_free(&gin);
+
+  list = strdup(args.values);
+  if (list == NULL) goto fail;
+
+  if (_parse_checkpoints(&args, &gs, list, &ncps, &cps)) {
+    printf("invalid threshold in %s\n", args.values);
+    goto fail;
+  }
+
+  if (args.prefix != NULL) {
+    fname = malloc(strlen(args.prefix) + strlen(args.values) + 7);
+    if (fname == NULL) goto fail;
+  }
+
+  printf("%s", names[args.mode]);
+  for (i = 0; i < nstats; i++) printf("\t%s", _stats[stats[i]].name);
+  printf("\n");
+
+  for (i = 0; i < ncps; i++) {
+
+    if (graph_sweep_add(&gs, cps[i].nedges)) {
+      printf("error adding edges\n");
+      goto fail;
+    }
+
+    printf("%s", cps[i].value);
+    for (j = 0; j < nstats; j++)
+      printf("\t%f", _calculate(&gs, _stats + stats[j]));
+    printf("\n");
+
+    if (fname != NULL) {
+
+      sprintf(fname, "%s_%s.ngdb", args.prefix, cps[i].value);
+
+      if (ngdb_write(graph_sweep_graph(&gs), fname)) {
+        printf("error writing to output file %s\n", fname);
+        goto fail;
+      }
+    }
+  }
+
+  graph_sweep_free(&gs);
+  free(stats);
+  free(list);
+  free(cps);
+  if (fname != NULL) free(fname);
+  return 0;
+
+fail:
+  graph_sweep_free(&gs);
+  if (stats != NULL) free(stats);
+  if (list  != NULL) free(list);
+  if (cps   != NULL) free(cps);
+  if (fname != NULL) free(fname);
+  return 1;
+}
+
+uint8_t _parse_stats(char *list, uint32_t *nstats, uint32_t *stats) {
+
+  uint32_t  i;
+  uint32_t  j;
+  uint32_t  n;
+  char     *copy;
+  char     *tkn;
+  char     *save;
+
+  n    = 0;
+  copy = strdup(list);
+  if (copy == NULL) goto fail;
+
+  for (tkn = strtok_r(copy, ",", &save);
+       tkn != NULL;
+       tkn = strtok_r(NULL, ",", &save)) {
+
+    for (i = 0; _stats[i].name != NULL; i++) {
+      if (!strcasecmp(tkn, _stats[i].name)) break;
+    }
+
+    if (_stats[i].name == NULL) goto fail;
+
+    /*each statistic is only printed once*/
+    for (j = 0; j < n; j++) {
+      if (stats[j] == i) break;
+    }
+
+    if (j == n) stats[n++] = i;
+  }
+
+  *nstats = n;
+
+  free(copy);
+  return 0;
+
+fail:
+  if (copy != NULL) free(copy);
+  return 1;
+}
+
+uint8_t _parse_checkpoints(
+  args_t        *args,
+  graph_sweep_t *gs,
+  char          *list,
+  uint32_t      *ncps,
+  checkpoint_t **cps) {
+
+  uint32_t      n;
+  uint64_t      i;
+  double        val;
+  double        nnodes;
+  char         *tkn;
+  char         *save;
+  checkpoint_t *cp;
+
+  *cps   = NULL;
+  nnodes = graph_num_nodes(graph_sweep_graph(gs));
+
+  for (i = 0, n = 1; list[i] != '\0'; i++) {
+    if (list[i] == ',') n++;
+  }
+
+  *cps = calloc(n, sizeof(checkpoint_t));
+  if (*cps == NULL) goto fail;
+
+  for (tkn = strtok_r(list, ",", &save), n = 0;
+       tkn != NULL;
+       tkn = strtok_r(NULL, ",", &save), n++) {
+
+    cp        = *cps + n;
+    cp->value = tkn;
+    val       = atof(tkn);
+
+    switch (args->mode) {
+
+      case SWEEP_WEIGHT:
+        cp->nedges = graph_sweep_count(gs, val);
+        break;
+
+      case SWEEP_DENSITY:
+        if (val < 0 || val > 1) goto fail;
+        cp->nedges = round(val * nnodes * (nnodes - 1) / 2.0);
+        break;
+
+      /*the same as cthres - see _threshold in cthres.c*/
+      case SWEEP_PERCENTILE:
+        if (val < 0 || val > 100) goto fail;
+        if (!args->reverse) val = 100 - val;
+        cp->nedges = round(gs->nedges * val / 100.0);
+        break;
+
+      case SWEEP_COUNT:
+        if (val < 0) goto fail;
+        cp->nedges = val;
+        break;
+    }
+  }
+
+  qsort(*cps, n, sizeof(checkpoint_t), _compare_checkpoints);
+
+  *ncps = n;
+  return 0;
+
+fail:
+  if (*cps != NULL) free(*cps);
+  *cps = NULL;
+  return 1;
+}
+
+double _calculate(graph_sweep_t *gs, sweep_stat_t *stat) {
+
+  graph_t g;
+  double  val;
+
+  if (stat->sweepfn != NULL) return stat->sweepfn(gs);
+
+  /*
+   * other statistics are calculated on a frozen
+   * copy of the graph, with its own stats cache
+   */
+  if (graph_copy(graph_sweep_graph(gs), &g)) return NAN;
+
+  if (graph_freeze(&g) || stats_cache_init(&g)) {
+    graph_free(&g);
+    return NAN;
+  }
+
+  val = stat->graphfn(&g);
+
+  graph_free(&g);
+
+  return val;
+}
+
+int _compare_checkpoints(const void *a, const void *b) {
+
+  const checkpoint_t *ca;
+  const checkpoint_t *cb;
+
+  ca = a;
+  cb = b;
+
+  if (ca->nedges < cb->nedges) return -1;
+  if (ca->nedges > cb->nedges) return  1;
+
+  return 0;
+}
+
+double _num_nodes(graph_sweep_t *gs) {
+  return graph_num_nodes(graph_sweep_graph(gs));
+}
+
+double _num_edges(graph_sweep_t *gs) {
+  return graph_num_edges(graph_sweep_graph(gs));
+}
+
+double _density(graph_sweep_t *gs) {
+  return stats_density(graph_sweep_graph(gs));
+}
+
+double _avg_degree(graph_sweep_t *gs) {
+  return stats_avg_degree(graph_sweep_graph(gs));
+}
+
+double _max_degree(graph_sweep_t *gs) {
+  return graph_sweep_max_degree(gs);
+}
+
+double _clustering(graph_sweep_t *gs) {
+  return graph_sweep_clustering(gs);
+}
+
+double _triangles(graph_sweep_t *gs) {
+  return graph_sweep_num_triangles(gs);
+}
+
+double _components(graph_sweep_t *gs) {
+  return graph_sweep_num_components(gs);
+}
+
+double _largest(graph_sweep_t *gs) {
+  return graph_sweep_largest_component(gs);
+}
@@ -1,6 +1,16 @@
 /**
  * Threshold the edges of a weighted ngdb file.
  *
+ * The threshold may be given as an edge weight, as a density, as a
+ * percentile of the edge weights, or as a number of edges to retain. If a
+ * comma separated list of values is given, the input file is loaded once,
+ * and a graph is written for each value, to OUTPUT_VALUE.ngdb.
+ *
+ * With --stream, a weight threshold is applied while the input file is
+ * copied to the output file, without either graph being loaded into
+ * memory (see ngdb_threshold), so graphs which are larger than memory may
+ * be thresholded. A weight threshold is also streamed if the input file
+ * would not fit in what is left of the --mem-budget (see util/memacct.h).
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -11,27 +21,53 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include "graph/graph.h"
 #include "graph/graph_threshold.h"
+#include "util/memacct.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 
+/**
+ * Ways in which the threshold may be specified.
+ */
+typedef enum {
+  THRES_WEIGHT = 0, /**< edge weight                    */
+  THRES_DENSITY,    /**< output graph density           */
+  THRES_PERCENTILE, /**< percentile of the edge weights */
+  THRES_COUNT       /**< number of edges to retain      */
+} thres_mode_t;
+
 typedef struct _args {
   char   *input;
   char   *output;
-  double  threshold;
+  char   *values;
+  uint8_t mode;
   uint8_t absval;
   uint8_t reverse;
+  uint8_t stream;
 } args_t;
 
 static char doc[] = "cthres -- threshold the edges of a weighted ngdb file";
 
 static struct argp_option options[] = {
-  {"threshold", 't', "DOUBLE", 0, "edge threshold value"},
-  {"absval",    'a',  NULL,    0, "threshold at absolute value"},
-  {"reverse",   'r',  NULL,    0, "remove edges below the "\
-                                  "threshold, rather than above"},
+  {"threshold",  't', "DOUBLE", 0, "edge threshold value"},
+  {"density",    'd', "DOUBLE", 0, "retain the highest weighted edges, "\
+                                   "up to this density (0.0 - 1.0)"},
+  {"percentile", 'p', "DOUBLE", 0, "threshold at this percentile of the "\
+                                   "edge weights (0.0 - 100.0)"},
+  {"count",      'k', "INT",    0, "retain this many of the highest "\
+                                   "weighted edges"},
+  {"absval",     'a',  NULL,    0, "threshold at absolute value"},
+  {"reverse",    'r',  NULL,    0, "remove edges below the "\
+                                   "threshold, rather than above"},
+  {"stream",     's',  NULL,    0, "stream the input file to the output "\
+                                   "file, rather than loading it into "\
+                                   "memory (only with -t)"},
+  {0, 0, 0, 0, "Any of -t, -d, -p and -k may be given a comma separated "\
+               "list of values, in which case one graph is written for "\
+               "each value, to OUTPUT_VALUE.ngdb"},
   {0}
 };
 
@@ -43,9 +79,25 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
   switch (key) {
     
-    case 't': args->threshold = atof(arg); break;
-    case 'a': args->absval    = 1;         break;
-    case 'r': args->reverse   = 1;         break;
+    case 't':
+    case 'd':
+    case 'p':
+    case 'k':
+
+      if (args->values != NULL)
+        argp_error(state, "only one of -t, -d, -p and -k may be given");
+
+      if      (key == 't') args->mode = THRES_WEIGHT;
+      else if (key == 'd') args->mode = THRES_DENSITY;
+      else if (key == 'p') args->mode = THRES_PERCENTILE;
+      else                 args->mode = THRES_COUNT;
+
+      args->values = arg;
+      break;
+      
+    case 'a': args->absval  = 1; break;
+    case 'r': args->reverse = 1; break;
+    case 's': args->stream  = 1; break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) args->input  = arg;
@@ -55,6 +107,8 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
     case ARGP_KEY_END:
       if (state->arg_num != 2) argp_usage(state);
+      if (args->stream && args->mode != THRES_WEIGHT)
+        argp_error(state, "--stream may only be used with -t");
       break;
 
     default:
@@ -64,36 +118,149 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * Thresholds the input graph according to the given value.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _threshold(
+  graph_t *gin,  /**< input graph                     */
+  graph_t *gout, /**< empty output graph              */
+  args_t  *args, /**< command line arguments          */
+  double   val   /**< threshold, density, percentile,
+                      or number of edges             */
+);
+
 int main(int argc, char *argv[]) {
 
   graph_t     gin;
   graph_t     gout;
   args_t      args;
+  char       *copy;
+  char       *tkn;
+  char       *save;
+  char       *fname;
+  uint64_t    len;
+  uint8_t     sweep;
+  struct stat st;
   struct argp argp = {options, _parse_opt, "INPUT OUTPUT", doc};
 
+  copy  = NULL;
+  fname = NULL;
   memset(&args, 0, sizeof(args));
 
   startup("cthres", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &gin)) {
-    printf("error openineg input file %s\n", args.input);
-    goto fail;
+  if (args.values == NULL) args.values = "0";
+
+  sweep = strchr(args.values, ',') != NULL;
+
+  /*
+   * the in-memory graph is at least as
+   * large as the file it was read from
+   */
+  if (!args.stream                &&
+      args.mode == THRES_WEIGHT   &&
+      !stat(args.input, &st)      &&
+      !memacct_fits(st.st_size)) {
+    printf("%s does not fit in the memory budget - streaming\n",
+           args.input);
+    args.stream = 1;
   }
 
-  if (graph_threshold_weight(
-        &gin, &gout, args.threshold, args.absval, args.reverse)) {
-    printf("error thresholding graph\n");
+  if (!args.stream && ngdb_read(args.input, &gin)) {
+    printf("error openineg input file %s\n", args.input);
     goto fail;
   }
 
-  if (ngdb_write(&gout, args.output)) {
-    printf("error writing to output file %s\n", args.output);
-    goto fail;
+  copy  = strdup(args.values);
+  len   = strlen(args.output);
+  fname = malloc(len + strlen(args.values) + 7);
+  if (copy == NULL || fname == NULL) goto fail;
+
+  /*OUTPUT.ngdb -> OUTPUT_VALUE.ngdb*/
+  if (sweep && len > 5 && !strcmp(args.output + len - 5, ".ngdb"))
+    len -= 5;
+
+  for (tkn = strtok_r(copy, ",", &save);
+       tkn != NULL;
+       tkn = strtok_r(NULL, ",", &save)) {
+
+    if (sweep) sprintf(fname, "%.*s_%s.ngdb", (int)len, args.output, tkn);
+    else       strcpy( fname, args.output);
+
+    if (args.stream) {
+
+      if (ngdb_threshold(args.input,
+                         fname,
+                         atof(tkn),
+                         args.absval,
+                         args.reverse)) {
+        printf("error thresholding %s at %s\n", args.input, tkn);
+        goto fail;
+      }
+      continue;
+    }
+
+    if (_threshold(&gin, &gout, &args, atof(tkn))) {
+      printf("error thresholding graph at %s\n", tkn);
+      goto fail;
+    }
+
+    if (ngdb_write(&gout, fname)) {
+      printf("error writing to output file %s\n", fname);
+      goto fail;
+    }
+
+    graph_free(&gout);
   }
-  
 
+  free(copy);
+  free(fname);
   return 0;
   
 fail:
+  if (copy  != NULL) free(copy);
+  if (fname != NULL) free(fname);
+  return 1;
+}
+
+uint8_t _threshold(graph_t *gin, graph_t *gout, args_t *args, double val) {
+
+  double nedges;
+
+  switch (args->mode) {
+
+    case THRES_WEIGHT:
+      return graph_threshold_weight(
+        gin, gout, val, args->absval, args->reverse);
+
+    case THRES_DENSITY:
+      return graph_threshold_density(
+        gin, gout, val, args->absval, args->reverse);
+
+    case THRES_PERCENTILE:
+
+      if (val < 0 || val > 100) return 1;
+
+      /*
+       * edges at or above the percentile are retained,
+       * or at or below it if the threshold is reversed
+       */
+      if (!args->reverse) val = 100 - val;
+
+      nedges = round(graph_num_edges(gin) * val / 100.0);
+
+      return graph_threshold_top(
+        gin, gout, nedges, args->absval, args->reverse);
+
+    case THRES_COUNT:
+
+      if (val < 0) return 1;
+
+      return graph_threshold_top(
+        gin, gout, val, args->absval, args->reverse);
+  }
+
   return 1;
 }
@@ -6,6 +6,15 @@
  *   - path-sharing
  *   - edge-betweenness
  *
+ * Long runs may be checkpointed with the --checkpoint option; if the
+ * checkpoint file exists when ctrim is started, edge removal carries on
+ * from where it was saved (see graph_threshold_checkpoint). The file is
+ * deleted once the output graph has been written.
+ *
+ * With --modularity, the --removed option saves the order in which edges
+ * were removed, so that the whole community hierarchy found by one run
+ * may be recovered, not just the level with the maximum modularity.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <inttypes.h>
@@ -19,6 +28,7 @@
 #include "graph/graph_threshold.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "util/progress.h"
 #include "util/startup.h"
 #include "io/ngdb_graph.h"
 
@@ -47,6 +57,11 @@ typedef struct args {
   uint32_t   nedges;
   uint32_t   cmplimit;
   uint32_t   igndis;
+  uint32_t   nsamples;
+  uint32_t   batch;
+  char      *checkpoint;
+  uint32_t   ckinterval;
+  char      *removed;
   
 } args_t;
 
@@ -65,6 +80,20 @@ static struct argp_option options[] = {
   {"igndis",     'd', "INT",    OPTION_ARG_OPTIONAL,
                                    "do not class components this size or "\
                                    "smaller as components (default 1)"},
+  {"samples",    's', "INT",    0, "approximate edge-betweenness by "\
+                                   "sampling this many source nodes on "\
+                                   "each iteration"},
+  {"batch",      'b', "INT",    0, "remove this many edges between each "\
+                                   "recalculation of edge values "\
+                                   "(default 1)"},
+  {"checkpoint", 'k', "FILE",   0, "periodically save progress to this "\
+                                   "file, and resume from it if it exists"},
+  {"ckinterval", 'i', "SECS",   0, "minimum time between checkpoints "\
+                                   "(default 600)"},
+  {"removed",    'r', "FILE",   0, "with --modularity, save the removed "\
+                                   "edges, in order, along with the "\
+                                   "number of components and modularity "\
+                                   "after each removal, to this file"},
   {0}
 };
 
@@ -79,6 +108,11 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'o': a->modularity = 0xFF;      break;
     case 'h': a->chira      = 0xFF;      break;
     case 'p': a->printmod   = 0xFF;      break;
+    case 's': a->nsamples   = atoi(arg); break;
+    case 'b': a->batch      = atoi(arg); break;
+    case 'k': a->checkpoint = arg;       break;
+    case 'i': a->ckinterval = atoi(arg); break;
+    case 'r': a->removed    = arg;       break;
     case 'd':
       if (arg != NULL) a->igndis = atoi(arg);
       else             a->igndis = 1;
@@ -116,6 +150,19 @@ static uint8_t _trim(
   args_t    *a
 );
 
+/**
+ * Saves the edges removed by graph_threshold_modularity to the given file,
+ * one per line, with the number of components and the modularity after
+ * each removal. Any level of the community hierarchy may be reconstructed
+ * from this, rather than only the one with the maximum modularity.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_removed(
+  char      *fname,
+  mod_opt_t *modopt
+);
+
 int main(int argc, char *argv[]) {
 
   graph_t gin;
@@ -125,6 +172,7 @@ int main(int argc, char *argv[]) {
   struct argp argp = {options, _parse_opt, "INPUT OUTPUT", doc};
 
   memset(&args, 0, sizeof(args_t));
+  args.ckinterval = 600;
   startup("ctrim", argc, argv, &argp, &args);
 
   if (ngdb_read(args.input, &gin)) {
@@ -135,6 +183,8 @@ int main(int argc, char *argv[]) {
 
   stats_cache_init(&gin);
 
+  graph_threshold_checkpoint(args.checkpoint, args.ckinterval);
+
   if (_trim(&gin, &gout, &args)) {
     printf("Could not trim graph\n");
     goto fail;
@@ -145,6 +195,8 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
+  if (args.checkpoint != NULL) remove(args.checkpoint);
+
   return 0;
 
 fail:
@@ -161,7 +213,7 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
   mod_opt_t modopt;
   uint8_t (*tfunc)(
     graph_t  *gin, graph_t *gout, uint32_t cmplimit, 
-    uint32_t igndis, void *opt,
+    uint32_t igndis, void *opt, uint32_t batch,
     uint8_t (*init)(graph_t *g),
     uint8_t (*remove)(
       graph_t *g, double *space, array_t *edges, graph_edge_t *edge),
@@ -195,6 +247,10 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
   }
   else goto fail;
 
+  /*the number of edges removed to split the graph is not known*/
+  progress_begin(PROGRESS_EDGES, (tfunc == &graph_threshold_components) ?
+                                 0 : val);
+
   switch (a->criteria) {
 
     case C_PATHSHARING:
@@ -203,6 +259,7 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
                 val,
                 flags,
                 opt,
+                a->batch,
                 &graph_init_pathsharing,
                 &graph_remove_pathsharing,
                 &graph_recalculate_pathsharing))
@@ -210,11 +267,21 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
       break;
 
     case C_EDGEBETWEENNESS:
+
+      graph_approx_edge_betweenness(a->nsamples);
+
+      if (a->nsamples > 0 && a->printmod)
+        printf("approx. edge betweenness error (normalised): %f\n",
+               stats_approx_betweenness_error(graph_num_nodes(gin),
+                                              graph_num_edges(gin),
+                                              a->nsamples,
+                                              0.05));
       if (tfunc(gin,
                 gout,
                 val,
                 flags,
                 opt,
+                a->batch,
                 &graph_init_edge_betweenness,
                 &graph_remove_edge_betweenness,
                 &graph_recalculate_edge_betweenness))
@@ -222,6 +289,8 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
       break;
   }
 
+  progress_end(PROGRESS_EDGES);
+
   if (a->modularity && a->printmod) {
 
     oldcmp = 0xFFFFFFFF;
@@ -237,8 +306,42 @@ static uint8_t _trim(graph_t *gin, graph_t *gout, args_t *a) {
     }
   }
 
+  if (a->modularity && a->removed != NULL) {
+    if (_write_removed(a->removed, &modopt)) goto fail;
+  }
+
   return 0;
   
 fail:
   return 1;
 }
+
+static uint8_t _write_removed(char *fname, mod_opt_t *modopt) {
+
+  uint64_t i;
+  FILE    *f;
+
+  f = fopen(fname, "wt");
+  if (f == NULL) goto fail;
+
+  for (i = 0; i < modopt->nvals; i++) {
+
+    if (fprintf(f, "%u %u %u %0.6f\n",
+                modopt->removed[i].u,
+                modopt->removed[i].v,
+                modopt->ncmps[i],
+                modopt->modularity[i]) < 0)
+      goto fail;
+  }
+
+  if (fclose(f)) {
+    f = NULL;
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  if (f != NULL) fclose(f);
+  return 1;
+}
@@ -1,6 +1,8 @@
 /**
  * Program which cuts a single volume into a series of 
  * images. The volume is cut up along the last dimension.
+ * The image data is never read in - each image is copied
+ * straight out of the volume file (see util/copyfile.h).
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -11,7 +13,8 @@
 #include <float.h>
 
 #include "io/analyze75.h"
-#include "util/filesize.h"
+#include "util/suffix.h"
+#include "util/copyfile.h"
 #include "util/startup.h"
 
 /**
@@ -21,7 +24,7 @@
  */
 static uint8_t _split(
   dsr_t   *hdr,    /**< volume header                 */
-  uint8_t *img,    /**< volume data                   */
+  char    *input,  /**< volume file name              */
   char    *outdir, /**< output directory              */
   uint8_t  pref    /**< start number of output images */
 );
@@ -31,21 +34,16 @@ static uint8_t _split(
  */
 static void _mk_hdr(
   dsr_t   *inhdr,  /**< volume header               */
-  dsr_t   *outhdr, /**< place to store image header */
-  uint8_t *img,    /**< image data                  */
-  uint32_t imgsz   /**< image size in bytes         */
+  dsr_t   *outhdr  /**< place to store image header */
 );
 
 int main (int argc, char *argv[]) {
 
   dsr_t    hdr;
-  uint8_t *img;
   uint8_t  pref;
 
   pref = 1;
 
-  img = NULL;
-
   startup("cutimg", argc, argv, NULL, NULL);
 
   if (argc != 3 && argc != 4) {
@@ -55,32 +53,34 @@ int main (int argc, char *argv[]) {
 
   if (argc == 4) pref = atoi(argv[3]);
 
-  if (analyze_load(argv[1], &hdr, &img)) goto fail;
+  if (analyze_load_hdr(argv[1], &hdr)) goto fail;
 
-  if (_split(&hdr, img, argv[2], pref)) goto fail;
+  if (_split(&hdr, argv[1], argv[2], pref)) goto fail;
 
-  free(img);
   return 0;
 
 fail:
   printf("Cut failed\n");
-  if (img != NULL) free(img);
   return 1;
 }
 
-uint8_t _split(dsr_t *hdr, uint8_t *img, char *outdir, uint8_t pref) {
+uint8_t _split(dsr_t *hdr, char *input, char *outdir, uint8_t pref) {
 
   dsr_t     newhdr;
   uint32_t  i;
   uint16_t  ndims;
   uint32_t  dimsz;
   uint8_t   valsize;
-  uint32_t  cutsize;
+  uint64_t  cutsize;
   uint32_t  dimoff;
+  FILE     *inf;
   FILE     *f;
+  char     *infname;
   char     *filename;
 
+  inf      = NULL;
   f        = NULL;
+  infname  = NULL;
   filename = NULL;
 
   ndims   = analyze_num_dims(  hdr);
@@ -88,7 +88,15 @@ uint8_t _split(dsr_t *hdr, uint8_t *img, char *outdir, uint8_t pref) {
   dimsz   = analyze_dim_size(  hdr, ndims-1);
   dimoff  = analyze_dim_offset(hdr, ndims-1);
 
-  cutsize = dimoff*valsize;
+  cutsize = (uint64_t)dimoff*valsize;
+
+  _mk_hdr(hdr, &newhdr);
+
+  infname = set_suffix(input, "img");
+  if (infname == NULL) goto fail;
+
+  inf = fopen(infname, "rb");
+  if (inf == NULL) goto fail;
 
   filename = malloc(strlen(outdir) + 20);
   if (filename == NULL) goto fail;
@@ -99,25 +107,30 @@ uint8_t _split(dsr_t *hdr, uint8_t *img, char *outdir, uint8_t pref) {
     f = fopen(filename, "wb");
     if (f == NULL) goto fail;
 
-    if (fwrite(img + (i*cutsize), 1, cutsize, f) != cutsize) goto fail;
-    fclose(f);
-
-    _mk_hdr(hdr, &newhdr, img + (i*cutsize), cutsize);
+    if (copyfile_range(inf, i*cutsize, f, 0, cutsize)) goto fail;
+    if (fclose(f)) {
+      f = NULL;
+      goto fail;
+    }
 
     if (analyze_write_hdr(filename, &newhdr)) goto fail;
   }
   
+  fclose(inf);
+  free(infname);
   free(filename);
   return 0;
 
 fail:
+  if (inf      != NULL) fclose(inf);
   if (f        != NULL) fclose(f);
+  if (infname  != NULL) free(infname);
   if (filename != NULL) free(filename);
 
   return 1;
 }
 
-void _mk_hdr(dsr_t *inhdr, dsr_t *outhdr, uint8_t *img, uint32_t imgsz) {
+void _mk_hdr(dsr_t *inhdr, dsr_t *outhdr) {
 
   uint8_t ndims;
 
@@ -1,5 +1,5 @@
 /**
- * Output a graph, and associated statistics, in ASCII vtk format.
+ * Output a graph, and associated statistics, in vtk format.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
@@ -21,8 +21,14 @@
 
 #define MAX_SCALAR_FILES 50
 
+/**
+ * Maximum number of node scalars - the command line statistics, and the
+ * scalar files.
+ */
+#define MAX_SCALARS (5 + MAX_SCALAR_FILES)
+
 static char doc[] = "cvtk - output a graph, and associated statistics, "\
-                    "in ASCII vtk format";
+                    "in vtk format";
 
 static struct argp_option options[] = {
   {"degree",     'd', NULL,        0, "include degree as a node scalar"},
@@ -37,6 +43,10 @@ static struct argp_option options[] = {
                                       "multiple times)"},
   {"omitedges",  'o', NULL,        0, "do not export edges"},
   {"omitnodes",  'm', NULL,        0, "do not export nodes"},
+  {"binary",     'b', NULL,        0, "output legacy vtk in binary, rather "\
+                                      "than ASCII"},
+  {"xml",        'x', NULL,        0, "output XML vtk (.vtp), with raw "\
+                                      "binary data"},
   {0}
 };
 
@@ -53,6 +63,8 @@ typedef struct args {
   uint8_t efficiency;
   uint8_t omitedges;
   uint8_t omitnodes;
+  uint8_t binary;
+  uint8_t xml;
 } args_t;
 
 static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
@@ -67,6 +79,8 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 'e': a->efficiency                     = 0xFF; break;
     case 'o': a->omitedges                      = 0xFF; break;
     case 'm': a->omitnodes                      = 0xFF; break;
+    case 'b': a->binary                         = 0xFF; break;
+    case 'x': a->xml                            = 0xFF; break;
     case 'f':
       if (a->nscalarfiles < MAX_SCALAR_FILES) {
         
@@ -105,14 +119,18 @@ static uint8_t _print_graph(
 );
 
 /**
- * Prints the scalar data as specified on the command line.
+ * Calculates or loads the scalar data as specified on the command line.
+ * Space is allocated for each scalar array - the caller is responsible
+ * for freeing it.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _print_node_scalars(
-  FILE    *f,    /**< file handle            */ 
-  graph_t *g,    /**< the graph              */
-  args_t  *args  /**< command line arguments */
+static uint8_t _load_node_scalars(
+  graph_t  *g,        /**< the graph                            */
+  args_t   *args,     /**< command line arguments               */
+  uint8_t  *nscalars, /**< place to store the number of scalars */
+  char    **names,    /**< place to store the scalar names      */
+  double  **data      /**< place to store the scalar arrays     */
 );
 
 /**
@@ -154,97 +172,124 @@ fail:
 
 uint8_t _print_graph(graph_t *g, args_t *args) {
 
-  FILE *fout;
-  
-  fout = NULL;
+  uint8_t       i;
+  FILE         *fout;
+  vtk_format_t  fmt;
+  uint8_t       nscalars;
+  char         *names[MAX_SCALARS];
+  double       *data [MAX_SCALARS];
+
+  fout     = NULL;
+  nscalars = 0;
+
+  if      (args->xml)    fmt = VTK_XML;
+  else if (args->binary) fmt = VTK_BINARY;
+  else                   fmt = VTK_ASCII;
+
+  if (!args->omitnodes &&
+      _load_node_scalars(g, args, &nscalars, names, data))
+    goto fail;
 
   if (args->output != NULL) {
 
-    fout = fopen(args->output, "wt");
+    fout = fopen(args->output, (fmt == VTK_ASCII) ? "wt" : "wb");
     if (fout == NULL) goto fail;
   }
   else
     fout = stdout;
 
-  if (vtk_print_hdr(                          fout, g))       goto fail;
-  if (!args->omitnodes && vtk_print_nodes(    fout, g))       goto fail;
-  if (!args->omitedges && vtk_print_edges(    fout, g))       goto fail;
-  if (!args->omitnodes && _print_node_scalars(fout, g, args)) goto fail;
+  if (vtk_print_graph(fout,
+                      g,
+                      fmt,
+                      !args->omitnodes,
+                      !args->omitedges,
+                      nscalars,
+                      names,
+                      data))
+    goto fail;
 
   if (fout != stdout) fclose(fout);
+  for (i = 0; i < nscalars; i++) free(data[i]);
   return 0;
 
 fail:
 
   if (fout != NULL && fout != stdout) fclose(fout);
+  for (i = 0; i < nscalars; i++) free(data[i]);
   return 1;
 }
 
-uint8_t _print_node_scalars(FILE *f, graph_t *g, args_t *args) {
+uint8_t _load_node_scalars(
+  graph_t *g, args_t *args, uint8_t *nscalars, char **names, double **data) {
 
   uint32_t       i;
-  uint32_t       sidx;
-  double        *data;
-  uint32_t       nnodes; 
+  uint8_t        sidx;
+  uint8_t        nalloc;
+  uint32_t       nnodes;
   graph_label_t *lbl;
 
-  sidx   = 0;
-  data   = NULL;
+  char *stats[] = {"degree", "label", "clustering", "pathlength",
+                   "efficiency"};
+  uint8_t flags[] = {args->degree, args->label, args->clustering,
+                     args->pathlength, args->efficiency};
+
+  nalloc = 0;
   nnodes = graph_num_nodes(g);
 
-  data   = calloc(nnodes, sizeof(double));
-  if (data == NULL) goto fail;
+  /*statistics come first, then scalar files, in the order given*/
+  for (i = 0; i < 5 + args->nscalarfiles; i++) {
 
-  if (args->degree) {
-    
-    for (i = 0; i < nnodes; i++) 
-      data[i] = graph_num_neighbours(g, i);
+    if (i < 5 && !flags[i]) continue;
+
+    data[nalloc] = calloc((uint64_t)nnodes + 1, sizeof(double));
+    if (data[nalloc] == NULL) goto fail;
 
-    if (vtk_print_node_scalar(f, g, !(sidx++), "degree", data)) goto fail;
+    names[nalloc] = (i < 5) ? stats[i] : args->scalarfilenames[i - 5];
+    nalloc++;
+  }
+
+  sidx = 0;
+
+  if (args->degree) {
+    for (i = 0; i < nnodes; i++)
+      data[sidx][i] = graph_num_neighbours(g, i);
+    sidx++;
   }
 
   if (args->label) {
     for (i = 0; i < nnodes; i++) {
-      
+
       lbl = graph_get_nodelabel(g, i);
       if (lbl == NULL) goto fail;
-      
-      data[i] = lbl->labelval;
-    }
 
-    if (vtk_print_node_scalar(f, g, !(sidx++), "label", data)) goto fail;
+      data[sidx][i] = lbl->labelval;
+    }
+    sidx++;
   }
 
   if (args->clustering) {
-    if (stats_cache_node_clustering(g, -1, data))                   goto fail;
-    if (vtk_print_node_scalar(f, g, !(sidx++), "clustering", data)) goto fail;
+    if (stats_cache_node_clustering(g, -1, data[sidx++]))       goto fail;
   }
 
   if (args->pathlength) {
-    if (stats_cache_node_pathlength(g, -1, data))                   goto fail;
-    if (vtk_print_node_scalar(f, g, !(sidx++), "pathlength", data)) goto fail;
+    if (stats_cache_node_pathlength(g, -1, data[sidx++]))       goto fail;
   }
 
   if (args->efficiency) {
-    if (stats_cache_node_local_efficiency(g, -1, data))             goto fail;
-    if (vtk_print_node_scalar(f, g, !(sidx++), "efficiency", data)) goto fail;
+    if (stats_cache_node_local_efficiency(g, -1, data[sidx++])) goto fail;
   }
 
-
   for (i = 0; i < args->nscalarfiles; i++) {
-
-    memset(data, 0, nnodes*sizeof(double));
-    if (_load_file_scalar(args->scalarfiles[i], nnodes, data) < 0)
-      goto fail;
-    if (vtk_print_node_scalar(f, g, !(sidx++), args->scalarfilenames[i], data))
+    if (_load_file_scalar(args->scalarfiles[i], nnodes, data[sidx++]) < 0)
       goto fail;
   }
 
-  free(data);
+  *nscalars = sidx;
   return 0;
+
 fail:
 
-  if (data != NULL) free(data);
+  for (i = 0; i < nalloc; i++) free(data[i]);
   return 1;
 }
 
@@ -1,6 +1,15 @@
 /**
  * Removes as many edges from a graph as possible, such that it remains
- * connected.
+ * connected. Edges are removed in order of increasing weight, until the
+ * next edge cannot be removed without disconnecting the graph, or until
+ * the graph has reached a given density.
+ *
+ * Rather than removing edges one at a time, and testing connectivity after
+ * each removal, the edges are added back, in order of decreasing weight,
+ * to a disjoint set forest of the nodes, until the forest has a single
+ * tree. The edge which joins the last two trees is the first edge which
+ * would disconnect the graph if it were removed; it and every edge above
+ * it are retained, and the output graph is created in one pass.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -11,8 +20,8 @@
 
 #include "graph/graph.h"
 #include "graph/graph_prune.h"
-#include "graph/bfs.h"
 #include "io/ngdb_graph.h"
+#include "util/progress.h"
 #include "util/startup.h"
 #include "util/array.h"
 
@@ -28,13 +37,16 @@ typedef struct args {
   int16_t  prune;
   uint8_t  pruneon;
   uint8_t  absval;
+  double   density;
 } args_t;
 
 
 static struct argp_option options[] = {
-  {"absval", 'a',  NULL, 0, "use absolute value of edge weight"},
-  {"prune",  'p', "INT", 0, "prune components this size before starting "\
-                            "- set to 0 for automatic pruning"},
+  {"absval",  'a',  NULL,    0, "use absolute value of edge weight"},
+  {"prune",   'p', "INT",    0, "prune components this size before "\
+                                "starting - set to 0 for automatic pruning"},
+  {"density", 'd', "DOUBLE", 0, "stop removing edges when the graph "\
+                                "reaches this density"},
   {0}
 };
 
@@ -47,6 +59,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 
     case 'a': a->absval  = 1;                       break;
     case 'p': a->pruneon = 1; a->prune = atoi(arg); break;
+    case 'd': a->density = atof(arg);               break;
       
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) a->input  = arg;
@@ -65,9 +78,22 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 }
 
 
+/**
+ * The first edge which is retained - an edge is retained if it compares
+ * greater than or equal to this edge (see _compare_edges).
+ */
+typedef struct _cutoff {
+
+  graph_edge_t edge;   /**< the first retained edge     */
+  uint8_t      absval; /**< use absolute edge weights   */
+
+} cutoff_t;
+
+
 /**
  * Compares two graph_edge_t structs. The edge with the higher weight is
- * considered to be the larger.
+ * considered to be the larger; edges with the same weight are ordered by
+ * their end points, so that every edge has a unique position.
  *
  * \return 1, 0, or -1.
  */
@@ -92,46 +118,53 @@ static uint8_t _sort_edges(
 
 
 /**
- * Context structure used in breadth first search.
+ * Finds the number of edges which can be removed, in order, from the
+ * graph, before the next removal would disconnect it.
+ *
+ * \return 0 on success, non-0 on failure.
  */
-typedef struct _bfs_ctx {
-  uint64_t nvisited; /**< number of nodes that have
-                          been visited in the search */
-} bfs_ctx_t;
+static uint8_t _find_cutoff(
+  graph_t      *g,       /**< the graph                               */
+  graph_edge_t *edges,   /**< the edges of the graph, sorted by weight */
+  uint32_t     *nremove  /**< place to store the number of edges     */
+);
 
 
 /**
- * \return positive if the graph is connected (i.e. consists of a single
- * component), zero otherwise, negative on error.
+ * \return the root of the tree which contains node u, halving the path to
+ * it along the way.
  */
-static int8_t _is_connected(
-  graph_t *g, /**< the graph      */
-  uint32_t u, /**< starting point */
-  uint32_t v  /**< starting point */
+static uint32_t _find(
+  uint32_t *parent, /**< disjoint set forest */
+  uint32_t  u       /**< the node            */
 );
 
 
 /**
- * Callback function used by the _is_connected function to run a
- * breadth first search.
+ * graph_edge_filter_t function - retains the edges at or above the cutoff.
  *
- * \return 0 always.
+ * \return non-0 if the edge is retained, 0 otherwise.
  */
-static uint8_t _bfs_cb(
-  bfs_state_t *state, /**< search state                  */
-  void        *ctx    /**< pointer to a bfs_ctx_t struct */
+static uint8_t _retained(
+  void    *ctx, /**< pointer to a cutoff_t */
+  uint32_t u,   /**< edge end point        */
+  uint32_t v,   /**< edge end point        */
+  float    wt   /**< edge weight           */
 );
 
 
 int main(int argc, char *argv[]) {
 
-  uint64_t      i;
-  int8_t        is_con;
   uint32_t      nedges;
+  uint32_t      nremove;
+  uint64_t      target;
+  double        nnodes;
   graph_t       g;
   graph_t       tmp;
-  graph_edge_t *curedge;
+  graph_t       gout;
   graph_edge_t *edges;
+  graph_edge_t *cut;
+  cutoff_t      cutoff;
   args_t        args;
   struct argp   argp = {options, _parse_opt, "INPUT OUTPUT", doc};
 
@@ -157,46 +190,49 @@ int main(int argc, char *argv[]) {
   
   nedges = graph_num_edges(&g);
   printf("sorting %u edges ...\n", nedges);
-  _sort_edges(&g, &edges, args.absval);
+  if (_sort_edges(&g, &edges, args.absval)) {
+    printf("error sorting edges\n");
+    goto fail;
+  }
 
-  for (i = 0; i < nedges; i++) {
-    
-    curedge = edges+i;
+  /*every edge is examined if the graph never becomes connected*/
+  progress_begin(PROGRESS_EDGES, nedges);
+  if (_find_cutoff(&g, edges, &nremove)) {
+    printf("error identifying graph components\n");
+    goto fail;
+  }
+  progress_end(PROGRESS_EDGES);
 
-    /* remove the current edge (the edge with the lowest weight) */
-    printf("removing edge %5lu (%5u -- %5u: %0.6f) ...\n",
-           i, curedge->u, curedge->v, curedge->val);
-    if (graph_remove_edge(&g, curedge->u, curedge->v)) {
-      printf("error removing edge %5u -- %5u\n", curedge->u, curedge->v);
-      goto fail;
-    }
+  if (nremove < nedges) {
+    cut = edges + nremove;
+    printf("graph disconnected at edge %5u (%5u -- %5u: %0.6f)\n",
+           nremove, cut->u, cut->v, cut->val);
+  }
 
-    /* test the graph to see if it has become disconnected */
-    is_con = _is_connected(&g, curedge->u, curedge->v);
+  /*stop early if the target density is reached first*/
+  if (args.density > 0) {
 
-    /* something went wrong */
-    if (is_con < 0) {
-      printf("error testing connectivity\n");
-      goto fail;
-    }
+    nnodes = graph_num_nodes(&g);
+    target = round(args.density * nnodes * (nnodes - 1) / 2.0);
 
-    /*
-     * Removing this edge caused the graph to become disconnected; put
-     * it back, and stop. Otherwise, continue on to the next edge.
-     */
-    if (is_con == 0) {
+    if      (target >= nedges)          nremove = 0;
+    else if (nedges - target < nremove) nremove = nedges - target;
+  }
 
-      printf("graph disconnected at edge %5lu (%5u -- %5u: %0.6f)\n",
-             i, curedge->u, curedge->v, curedge->val);
+  printf("removing %u edges ...\n", nremove);
 
-      if (graph_add_edge(&g, curedge->u, curedge->v, curedge->val)) {
-        printf("error re-inserting edge %5u -- %5u: %0.6f\n",
-               curedge->u, curedge->v, curedge->val);
-        goto fail;
-      }
+  if (nremove < nedges) {
 
-      break;
+    cutoff.edge   = edges[nremove];
+    cutoff.absval = args.absval;
+
+    if (graph_copy_filtered(&g, &gout, _retained, &cutoff)) {
+      printf("error removing edges\n");
+      goto fail;
     }
+
+    graph_free(&g);
+    memcpy(&g, &gout, sizeof(graph_t));
   }
 
   if (ngdb_write(&g, args.output)) {
@@ -221,6 +257,10 @@ int _compare_edges(const void *a, const void *b) {
 
   if (ea->val > eb->val) return 1;
   if (ea->val < eb->val) return -1;
+  if (ea->u   > eb->u)   return 1;
+  if (ea->u   < eb->u)   return -1;
+  if (ea->v   > eb->v)   return 1;
+  if (ea->v   < eb->v)   return -1;
 
   return 0;
 }
@@ -281,41 +321,88 @@ fail:
 }
 
 
-int8_t _is_connected(graph_t *g, uint32_t u, uint32_t v) {
+uint8_t _find_cutoff(graph_t *g, graph_edge_t *edges, uint32_t *nremove) {
 
+  int64_t   i;
+  uint32_t  u;
+  uint32_t  v;
   uint32_t  nnodes;
-  uint32_t  unnbrs;
-  uint32_t  vnnbrs;
-  uint32_t  root;
-  bfs_ctx_t ctx;
-  
-  memset(&ctx, 0, sizeof(bfs_ctx_t));
+  uint32_t  ntrees;
+  uint32_t *parent;
+  uint32_t *size;
 
+  parent = NULL;
+  size   = NULL;
   nnodes = graph_num_nodes(g);
-  unnbrs = graph_num_neighbours(g, u);
-  vnnbrs = graph_num_neighbours(g, v);
+  ntrees = nnodes;
+
+  parent = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  size   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  if (parent == NULL) goto fail;
+  if (size   == NULL) goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+    parent[u] = u;
+    size  [u] = 1;
+  }
+
+  /*
+   * edges are added back from the highest weight down,
+   * until the graph is connected; if it never becomes
+   * connected, no edges can be removed
+   */
+  for (i = (int64_t)graph_num_edges(g) - 1; i >= 0 && ntrees > 1; i--) {
+
+    PROGRESS_ADD(PROGRESS_EDGES, 1);
 
-  if (unnbrs >= vnnbrs) root = u;
-  else                  root = v;
+    u = _find(parent, edges[i].u);
+    v = _find(parent, edges[i].v);
 
-  if (bfs(g, &root, 1, NULL, &ctx, NULL, &_bfs_cb, NULL)) goto fail;
+    if (u == v) continue;
+
+    /*the smaller tree is attached to the larger one*/
+    if (size[u] < size[v]) { parent[u] = v; size[v] += size[u]; }
+    else                   { parent[v] = u; size[u] += size[v]; }
+
+    ntrees--;
+  }
 
-  /* -1 because the root node is not visited during the search */
-  if (ctx.nvisited == (nnodes - 1)) return 1;
+  if (ntrees > 1) *nremove = 0;
+  else            *nremove = i + 1;
 
+  free(parent);
+  free(size);
   return 0;
 
 fail:
-  return -1;
+  if (parent != NULL) free(parent);
+  if (size   != NULL) free(size);
+  return 1;
 }
 
 
-uint8_t _bfs_cb(bfs_state_t *state, void *ctx) {
+uint32_t _find(uint32_t *parent, uint32_t u) {
 
-  bfs_ctx_t *bctx;
-  
-  bctx            = ctx;
-  bctx->nvisited += state->thislevel.size;
+  while (parent[u] != u) {
+    parent[u] = parent[parent[u]];
+    u         = parent[u];
+  }
 
-  return 0;
+  return u;
+}
+
+
+uint8_t _retained(void *ctx, uint32_t u, uint32_t v, float wt) {
+
+  cutoff_t     *cutoff;
+  graph_edge_t  edge;
+
+  cutoff   = ctx;
+  edge.u   = u;
+  edge.v   = v;
+
+  if (cutoff->absval) edge.val = fabs(wt);
+  else                edge.val =      wt;
+
+  return _compare_edges(&edge, &cutoff->edge) >= 0;
 }
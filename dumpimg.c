@@ -71,7 +71,10 @@ int main(int argc, char *argv[]) {
   dimorder = malloc(analyze_num_dims(&hdr));
   if (dimorder == NULL) goto fail;
 
-  dimorder_parse(&hdr, argv+dooff, dimorder, argc-dooff);
+  if (dimorder_parse(&hdr, argv+dooff, dimorder, argc-dooff)) {
+    printf("invalid dimension order\n");
+    goto fail;
+  }
 
   _dumpimg(&hdr, data, dimorder, pcoord);
 
@@ -111,41 +114,59 @@ void _dump_coords(dsr_t *hdr, uint32_t *dims, char pcoord) {
 void _dumpimg(
   dsr_t *hdr, uint8_t *image, uint8_t *dimorder, char pcoord) {
 
-  uint32_t  i;
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  len;
   uint8_t   ndims;
   uint32_t  nvals;
   uint32_t *dims;
-  double    val;
+  uint8_t  *ordered;
+  double    vals[1024];
   char      str[30];
 
   dims     = NULL;
+  ordered  = NULL;
   ndims    = analyze_num_dims(hdr);
   nvals    = analyze_num_vals(hdr);
 
   dims = calloc(ndims, sizeof(int));
   if (dims == NULL) goto fail;
 
-  /*print out the image, one value at a time*/
-  for (i = 0; i < nvals; i++) {
+  /*
+   * reorder the whole image up front, so that it
+   * can be printed by reading it sequentially
+   */
+  ordered = malloc((uint64_t)nvals * analyze_value_size(hdr));
+  if (ordered == NULL) goto fail;
+
+  if (dimorder_transpose(hdr, image, dimorder, ordered)) goto fail;
+
+  for (i = 0; i < nvals; i += len) {
 
-    /*read the value from the image*/
-    val = analyze_read_val(hdr, image, dims);
-    
-    /*print coordinates if necessary*/
-    if (pcoord) _dump_coords(hdr, dims, pcoord);
+    len = (nvals - i > 1024) ? 1024 : nvals - i;
 
-    analyze_sprint_val(hdr, str, val);
-    printf("%s\n", str);
+    analyze_read_block(hdr, ordered, i, len, vals);
 
-    /* update dimension indices */
-    dimorder_next(hdr, dims, dimorder);
+    for (j = 0; j < len; j++) {
+
+      /*print coordinates if necessary*/
+      if (pcoord) {
+        _dump_coords(hdr, dims, pcoord);
+        dimorder_next(hdr, dims, dimorder);
+      }
+
+      analyze_sprint_val(hdr, str, vals[j]);
+      printf("%s\n", str);
+    }
   }
 
   free(dims);
+  free(ordered);
 
   return;
 
 fail:
-  if (dims != NULL) free(dims);
+  if (dims    != NULL) free(dims);
+  if (ordered != NULL) free(ordered);
   return;
 }
@@ -13,8 +13,24 @@
 
 #include "io/mat.h"
 #include "util/startup.h"
+#include "util/outbuf.h"
 #include "graph/graph.h"
 
+/**
+ * Number of rows read from the file at a time.
+ */
+#define BATCH_ROWS 256
+
+/**
+ * Context passed to _fmt_rows - one batch of rows.
+ */
+typedef struct _rows_ctx {
+
+  double  *vals;  /**< row data, row-major order */
+  uint64_t ncols; /**< number of columns         */
+
+} rows_ctx_t;
+
 typedef struct _args {
 
   char   *input;
@@ -83,27 +99,55 @@ static void _print_stats(
  * Prints row/column labels.
  */
 static void _print_labels(
-  mat_t *mat /**< mat file to query */
+  mat_t    *mat, /**< mat file to query */
+  outbuf_t *ob   /**< stream to print to */
 );
 
 /**
- * Prints the matrix data.
+ * Prints the matrix data. Rows are read a batch at a time, and each batch
+ * is formatted in parallel.
  */
 static void _print_data(
-  mat_t *mat /**< mat file to query */
+  mat_t    *mat, /**< mat file to query  */
+  outbuf_t *ob   /**< stream to print to */
+);
+
+/**
+ * Writes a label line, as printf("%s %5u: %0.3f %0.3f %0.3f %u\n").
+ */
+static void _fmt_label(
+  outbuf_t      *ob,     /**< stream to write to  */
+  const char    *prefix, /**< "row" or "col"      */
+  uint64_t       i,      /**< row/column index    */
+  graph_label_t *label   /**< the label           */
 );
 
+/**
+ * outbuf_parallel function which formats a range of rows in the current
+ * batch.
+ */
+static uint8_t _fmt_rows(
+  uint64_t start, uint64_t end, outbuf_t *ob, void *ctx);
+
 
 int main (int argc, char *argv[]) {
 
   struct argp argp = {options, _parse_opt, "INPUT", doc};
   args_t      args;
   mat_t      *mat;
+  outbuf_t    ob;
 
+  mat = NULL;
   memset(&args, 0, sizeof(args));
+  memset(&ob,   0, sizeof(ob));
 
   startup("dumpmat", argc, argv, &argp, &args);
 
+  if (outbuf_create(&ob, stdout, 0)) {
+    printf("error allocating output buffer\n");
+    goto fail;
+  }
+
   mat = mat_open(args.input);
   if (mat == NULL) {
 
@@ -113,13 +157,16 @@ int main (int argc, char *argv[]) {
 
   if (args.meta)   _print_meta(  mat);
   if (args.stats)  _print_stats( mat);
-  if (args.labels) _print_labels(mat);
-  if (args.data)   _print_data(  mat);
+  if (args.labels) _print_labels(mat, &ob);
+  if (args.data)   _print_data(  mat, &ob);
 
+  outbuf_flush(&ob);
+  outbuf_free(&ob);
   mat_close(mat);
   return 0;
 
 fail:
+  outbuf_free(&ob);
   return 1;
 }
 
@@ -136,6 +183,7 @@ static void _print_meta(mat_t *mat) {
   printf("hdr data size:  %u\n",          hdrsize);
   printf("label size:     %u\n",          mat_label_size(    mat));
   printf("symmetric:      %u\n",          mat_is_symmetric(  mat));
+  printf("tiled:          %u\n",          mat_is_tiled(      mat));
   printf("has row labels: %u\n",          mat_has_row_labels(mat));
   printf("has col labels: %u\n",          mat_has_col_labels(mat));
 
@@ -168,75 +216,135 @@ static void _print_stats(mat_t *mat) {
 
 }
 
-static void _print_labels(mat_t *mat) {
+static void _print_labels(mat_t *mat, outbuf_t *ob) {
+
+  uint64_t       i;
+  uint64_t       nrows;
+  uint64_t       ncols;
+  uint64_t       nlbls;
+  uint16_t       lblsize;
+  uint8_t       *labels;
+  graph_label_t  label;
+
+  nrows   = mat_num_rows(mat);
+  ncols   = mat_num_cols(mat);
+  lblsize = mat_label_size(mat);
+  nlbls   = (nrows > ncols) ? nrows : ncols;
 
-  uint64_t      i;
-  uint64_t      nrows;
-  uint64_t      ncols;
-  graph_label_t label;
+  /*
+   * all of the row (or column) labels are read in one go. Labels
+   * may be larger than a graph_label_t (e.g. an ngdb_label_t, with
+   * node metadata following the label), or smaller.
+   */
+  labels = malloc(nlbls * lblsize);
+  if (labels == NULL) return;
 
-  nrows = mat_num_rows(mat);
-  ncols = mat_num_cols(mat);
-  
+  if (lblsize > sizeof(label)) lblsize = sizeof(label);
+
+  memset(&label, 0, sizeof(label));
 
   if (mat_has_row_labels(mat)) {
-    for (i = 0; i < nrows; i++) {
-      if (mat_read_row_label(mat, i, &label)) {
-        printf("error reading row label %" PRIu64 "\n", i);
-        break;
+    if (mat_read_row_labels(mat, 0, nrows, labels)) {
+      outbuf_flush(ob);
+      printf("error reading row labels\n");
+    }
+    else {
+      for (i = 0; i < nrows; i++) {
+        memcpy(&label, labels + i*mat_label_size(mat), lblsize);
+        _fmt_label(ob, "row", i, &label);
       }
-      printf(
-        "row %5" PRIu64 ": %0.3f %0.3f %0.3f %u\n",
-        i, label.xval, label.yval, label.zval, label.labelval);
     }
   }
 
   if (mat_has_col_labels(mat)) {
-    for (i = 0; i < ncols; i++) {
-      if (mat_read_col_label(mat, i, &label)) {
-        printf("error reading col label %" PRIu64 "\n", i);
-        break;
+    if (mat_read_col_labels(mat, 0, ncols, labels)) {
+      outbuf_flush(ob);
+      printf("error reading col labels\n");
+    }
+    else {
+      for (i = 0; i < ncols; i++) {
+        memcpy(&label, labels + i*mat_label_size(mat), lblsize);
+        _fmt_label(ob, "col", i, &label);
       }
-      printf(
-        "col %5" PRIu64 ": %0.3f %0.3f %0.3f %u\n",
-        i, label.xval, label.yval, label.zval, label.labelval);
     }
   }
+
+  free(labels);
 }
 
-static void _print_data(mat_t *mat) {
+static void _print_data(mat_t *mat, outbuf_t *ob) {
 
-  uint64_t i;
-  uint64_t j;
-  uint64_t nrows;
-  uint64_t ncols;
-  double  *rowvals;
+  uint64_t   start;
+  uint64_t   n;
+  uint64_t   nrows;
+  rows_ctx_t ctx;
 
-  
-  rowvals = NULL;
-  nrows   = mat_num_rows(mat);
-  ncols   = mat_num_cols(mat);
+  nrows     = mat_num_rows(mat);
+  ctx.ncols = mat_num_cols(mat);
+  ctx.vals  = malloc(BATCH_ROWS*ctx.ncols*sizeof(double));
 
-  rowvals = malloc(ncols*sizeof(double));
+  if (ctx.vals == NULL) goto fail;
 
-  for (i = 0; i < nrows; i++) {
+  for (start = 0; start < nrows; start += n) {
 
-    if (mat_read_row(mat, i, rowvals)) {
-      printf("error reading row %" PRIu64 " data\n", i);
+    n = BATCH_ROWS;
+    if (start + n > nrows) n = nrows - start;
+
+    if (mat_read_block(mat, start, 0, n, ctx.ncols, ctx.vals)) {
+      outbuf_flush(ob);
+      printf("error reading rows %" PRIu64 "-%" PRIu64 " data\n",
+             start, start + n - 1);
       goto fail;
     }
 
-    for (j = 0; j < ncols; j++) {
-      
-      printf("%0.3f", rowvals[j]);
-      if (j < ncols - 1) printf(" ");
-    }
-    printf("\n");
+    if (outbuf_parallel(ob, 0, n, 1, &ctx, _fmt_rows)) goto fail;
   }
 
-  free(rowvals);
+  free(ctx.vals);
   return;
-  
+
 fail:
-  if (rowvals != NULL) free(rowvals);
+  if (ctx.vals != NULL) free(ctx.vals);
+}
+
+static void _fmt_label(
+  outbuf_t *ob, const char *prefix, uint64_t i, graph_label_t *label) {
+
+  outbuf_str      (ob, prefix);
+  outbuf_char     (ob, ' ');
+  outbuf_u64_width(ob, i, 5);
+  outbuf_str      (ob, ": ");
+  outbuf_fixed    (ob, label->xval, 3);
+  outbuf_char     (ob, ' ');
+  outbuf_fixed    (ob, label->yval, 3);
+  outbuf_char     (ob, ' ');
+  outbuf_fixed    (ob, label->zval, 3);
+  outbuf_char     (ob, ' ');
+  outbuf_u64      (ob, label->labelval);
+  outbuf_char     (ob, '\n');
+}
+
+static uint8_t _fmt_rows(
+  uint64_t start, uint64_t end, outbuf_t *ob, void *vctx) {
+
+  uint64_t    i;
+  uint64_t    j;
+  double     *row;
+  rows_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++) {
+
+    row = ctx->vals + i*ctx->ncols;
+
+    for (j = 0; j < ctx->ncols; j++) {
+
+      outbuf_fixed(ob, row[j], 3);
+      if (j < ctx->ncols - 1) outbuf_char(ob, ' ');
+    }
+    outbuf_char(ob, '\n');
+  }
+
+  return ob->err;
 }
@@ -1,9 +1,10 @@
 /**
  * Prints out the contents of a ngdb file.
- * 
- * Author: Paul McCarthy <pauld.mccarthy@gmail.com> 
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <argp.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -12,9 +13,20 @@
 
 #include "graph/graph.h"
 #include "graph/graph_log.h"
+#include "io/ngdb.h"
 #include "io/ngdb_graph.h"
 #include "util/startup.h"
-#include "stats/stats.h"
+#include "util/outbuf.h"
+
+/**
+ * Number of nodes read from the file at a time in streaming mode.
+ */
+#define BATCH_NODES 65536
+
+/**
+ * Number of nodes formatted by each call to a formatting function.
+ */
+#define FORMAT_CHUNK 1024
 
 typedef struct _args {
   char   *input;
@@ -23,8 +35,29 @@ typedef struct _args {
   uint8_t graph;
   uint8_t weights;
   uint8_t dists;
+  uint8_t stream;
 } args_t;
 
+/**
+ * Context passed to the formatting functions. In normal mode, everything
+ * is taken from the loaded graph. In streaming mode, the node labels are
+ * held in lbls, and the references of one batch of nodes at a time in
+ * offsets/refs/wts.
+ */
+typedef struct _dump_ctx {
+
+  graph_t       *g;       /**< the graph (normal mode), or NULL           */
+  graph_label_t *lbls;    /**< labels of every node (streaming mode)      */
+  uint32_t       first;   /**< first node in the current batch            */
+  uint64_t      *offsets; /**< offset of the references of each node in
+                               the batch, relative to the first node      */
+  uint32_t      *refs;    /**< references of the nodes in the batch       */
+  double        *wts;     /**< reference weights of the nodes in the batch */
+  uint8_t        weights; /**< print edge weights                         */
+  uint8_t        dists;   /**< print edge distances                       */
+
+} dump_ctx_t;
+
 static char doc[] =
   "dumpngdb -- print the contents of a .ngdb file";
 
@@ -34,6 +67,8 @@ static struct argp_option options[] = {
   {"graph",   'g', NULL, 0, "print nodes and neighbours"},
   {"weights", 'w', NULL, 0, "print edge weights"},
   {"dists",   'd', NULL, 0, "print edge distances"},
+  {"stream",  's', NULL, 0, "read the file sequentially, without "\
+                            "loading the graph into memory"},
   {0}
 };
 
@@ -44,13 +79,14 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   args = state->input;
 
   switch(key) {
-    
+
     case 'm': args->meta    = 1; break;
     case 'l': args->labels  = 1; break;
     case 'g': args->graph   = 1; break;
     case 'w': args->weights = 1; break;
     case 'd': args->dists   = 1; break;
-      
+    case 's': args->stream  = 1; break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num == 0) args->input = arg;
       else argp_usage(state);
@@ -58,123 +94,447 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
 
     case ARGP_KEY_END:
       if (state->arg_num != 1) argp_usage(state);
-      break; 
-      
+      break;
+
     default:
       return ARGP_ERR_UNKNOWN;
 
   }
-  
+
   return 0;
 }
 
-static void _meta(  graph_t *g);
-static void _labels(graph_t *g);
-static void _graph( graph_t *g, uint8_t weights, uint8_t dists);
+static void _meta(  graph_t *g, uint32_t nnodes, uint32_t nedges);
+static uint8_t _labels(outbuf_t *ob, dump_ctx_t *ctx, uint32_t nnodes);
+static uint8_t _graph( outbuf_t *ob, dump_ctx_t *ctx, uint32_t nnodes);
+
+/**
+ * Prints the contents of the given file without loading the graph - the
+ * node labels are loaded if they are needed, and the references are read
+ * and printed one batch of nodes at a time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream(
+  outbuf_t *ob,  /**< stream to print to */
+  char     *fin, /**< file to print      */
+  args_t   *args /**< what to print      */
+);
+
+/**
+ * Reads the header data of the given file into the log of the given
+ * (empty) graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_log(
+  ngdb_t  *ngdb, /**< the file            */
+  graph_t *g     /**< graph to store logs */
+);
+
+/**
+ * Reads the labels of every node in the given file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_labels(
+  ngdb_t        *ngdb, /**< the file                                */
+  graph_label_t *lbls  /**< place to store ngdb_num_nodes labels    */
+);
+
+/**
+ * \return the label of the given node.
+ */
+static graph_label_t * _label(
+  dump_ctx_t *ctx, /**< context   */
+  uint64_t    n    /**< node index */
+);
+
+/**
+ * outbuf_parallel function which formats the labels of a range of nodes.
+ */
+static uint8_t _fmt_labels(
+  uint64_t start, uint64_t end, outbuf_t *ob, void *ctx);
+
+/**
+ * outbuf_parallel function which formats the neighbours of a range of
+ * nodes in the current batch (streaming mode), or in the graph.
+ */
+static uint8_t _fmt_graph(
+  uint64_t start, uint64_t end, outbuf_t *ob, void *ctx);
 
 int main(int argc, char *argv[]) {
 
   struct argp argp = {options, _parse_opt, "INPUT", doc};
-  args_t      args; 
+  args_t      args;
   graph_t     g;
+  outbuf_t    ob;
+  dump_ctx_t  ctx;
+  uint32_t    nnodes;
 
   memset(&args, 0, sizeof(args));
+  memset(&ob,   0, sizeof(ob));
+  memset(&ctx,  0, sizeof(ctx));
 
   startup("dumpngdb", argc, argv, &argp, &args);
 
+  if (outbuf_create(&ob, stdout, 0)) {
+    printf("error allocating output buffer\n");
+    goto fail;
+  }
+
+  if (args.stream) {
+
+    if (_stream(&ob, args.input, &args)) {
+      fflush(stdout);
+      printf("error reading ngdb file %s\n", args.input);
+      goto fail;
+    }
+    outbuf_free(&ob);
+    return 0;
+  }
+
   if (ngdb_read(args.input, &g)) {
     printf("error reading ngdb file %s\n", args.input);
     goto fail;
   }
 
-  if (args.meta)   _meta(  &g);
-  if (args.labels) _labels(&g);
-  if (args.graph)  _graph( &g, args.weights, args.dists);
+  nnodes      = graph_num_nodes(&g);
+  ctx.g       = &g;
+  ctx.weights = args.weights;
+  ctx.dists   = args.dists;
+
+  if (args.meta) _meta(&g, nnodes, graph_num_edges(&g));
+
+  if (args.labels && _labels(&ob, &ctx, nnodes)) goto fail;
+  if (args.graph  && _graph( &ob, &ctx, nnodes)) goto fail;
+  if (outbuf_flush(&ob))                         goto fail;
 
+  outbuf_free(&ob);
   graph_free(&g);
   return 0;
-  
+
 fail:
+  outbuf_free(&ob);
   return 1;
 }
 
 
-void _meta(graph_t *g) {
+void _meta(graph_t *g, uint32_t nnodes, uint32_t nedges) {
 
   uint32_t i;
-  uint16_t nmsgs;
+  uint32_t nmsgs;
   char    *msg;
 
   nmsgs = graph_log_num_msgs(g);
 
-  printf("num nodes: %u\n", graph_num_nodes(g));
-  printf("num edges: %u\n", graph_num_edges(g));
+  printf("num nodes: %u\n", nnodes);
+  printf("num edges: %u\n", nedges);
   printf("directed:  %u\n", graph_is_directed(g));
 
 
   printf("log messages:\n");
   for (i = 0; i < nmsgs; i++) {
-    
+
     msg = graph_log_get_msg(g, i);
     printf("  %3u: %s\n", i, msg);
   }
 
 }
 
-void _labels(graph_t *g) {
+uint8_t _labels(outbuf_t *ob, dump_ctx_t *ctx, uint32_t nnodes) {
 
-  graph_label_t *lbl;
-  uint32_t       nnodes;
-  uint64_t       i;
+  return outbuf_parallel(ob, 0, nnodes, FORMAT_CHUNK, ctx, _fmt_labels);
+}
+
+uint8_t _graph(outbuf_t *ob, dump_ctx_t *ctx, uint32_t nnodes) {
+
+  return outbuf_parallel(ob, 0, nnodes, FORMAT_CHUNK, ctx, _fmt_graph);
+}
 
-  nnodes = graph_num_nodes(g);
+uint8_t _stream(outbuf_t *ob, char *fin, args_t *args) {
 
-  for (i = 0; i < nnodes; i++) {
-    
-    lbl = graph_get_nodelabel(g, i);
+  ngdb_t    *ngdb;
+  graph_t    g;
+  dump_ctx_t ctx;
+  uint64_t   i;
+  uint64_t   nrefs;
+  uint64_t   cap;
+  uint32_t   nnodes;
+  uint32_t   start;
+  uint32_t   n;
+  uint32_t  *tmprefs;
+  double    *tmpwts;
 
-    printf(
-      "node %5" PRIu64 ": %0.3f %0.3f %0.3f %u\n",
-      i, lbl->xval, lbl->yval, lbl->zval, lbl->labelval);
+  ngdb = NULL;
+
+  memset(&g,   0, sizeof(g));
+  memset(&ctx, 0, sizeof(ctx));
+
+  ctx.weights = args->weights;
+  ctx.dists   = args->dists;
+  cap         = 0;
+
+  ngdb = ngdb_open_mmap(fin);
+  if (ngdb == NULL) ngdb = ngdb_open(fin);
+  if (ngdb == NULL) goto fail;
+
+  nnodes = ngdb_num_nodes(ngdb);
+
+  if (args->meta) {
+
+    if (_stream_log(ngdb, &g)) goto fail;
+    _meta(&g, nnodes, ngdb_num_refs(ngdb) / 2);
+    graph_free(&g);
+  }
+
+  if (args->labels || (args->graph && args->dists)) {
+
+    ctx.lbls = malloc((uint64_t)nnodes * sizeof(graph_label_t));
+    if (ctx.lbls == NULL)              goto fail;
+    if (_stream_labels(ngdb, ctx.lbls)) goto fail;
   }
 
+  if (args->labels && _labels(ob, &ctx, nnodes)) goto fail;
+
+  if (args->graph) {
+
+    if (args->weights && ngdb_ref_data_len(ngdb) != sizeof(double))
+      goto fail;
+
+    ctx.offsets = malloc((BATCH_NODES + 1) * sizeof(uint64_t));
+    if (ctx.offsets == NULL) goto fail;
+
+    for (start = 0; start < nnodes; start += n) {
+
+      n = BATCH_NODES;
+      if (start + n > nnodes) n = nnodes - start;
+
+      ctx.offsets[0] = 0;
+      for (i = 0; i < n; i++) {
+
+        nrefs = ngdb_node_num_refs(ngdb, start + i);
+        if (nrefs == 0xFFFFFFFF) goto fail;
+
+        ctx.offsets[i + 1] = ctx.offsets[i] + nrefs;
+      }
+
+      nrefs = ctx.offsets[n];
+
+      if (nrefs > cap) {
+
+        tmprefs = realloc(ctx.refs, nrefs * sizeof(uint32_t));
+        if (tmprefs == NULL) goto fail;
+        ctx.refs = tmprefs;
+
+        if (args->weights) {
+          tmpwts = realloc(ctx.wts, nrefs * sizeof(double));
+          if (tmpwts == NULL) goto fail;
+          ctx.wts = tmpwts;
+        }
+
+        cap = nrefs;
+      }
+
+      if (ngdb_nodes_get_all_refs(ngdb, start, n, ctx.refs, ctx.wts))
+        goto fail;
+
+      ctx.first = start;
+
+      if (outbuf_parallel(ob, 0, n, FORMAT_CHUNK, &ctx, _fmt_graph))
+        goto fail;
+    }
+  }
+
+  if (outbuf_flush(ob)) goto fail;
+
+  ngdb_close(ngdb);
+  free(ctx.lbls);
+  free(ctx.offsets);
+  free(ctx.refs);
+  free(ctx.wts);
+  return 0;
+
+fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
+  graph_free(&g);
+  free(ctx.lbls);
+  free(ctx.offsets);
+  free(ctx.refs);
+  free(ctx.wts);
+  return 1;
 }
 
-void _graph(graph_t *g, uint8_t weights, uint8_t dists) {
+uint8_t _stream_log(ngdb_t *ngdb, graph_t *g) {
 
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  nnodes;
-  uint32_t  nnbrs;
-  uint32_t *nbrs;
-  float    *wts;
-  double    dist;
+  char    *hdrdata;
+  uint16_t hdrlen;
 
-  nnodes = graph_num_nodes(g);
+  hdrdata = NULL;
+  hdrlen  = ngdb_hdr_data_len(ngdb);
 
-  for (i = 0; i < nnodes; i++) {
+  if (graph_log_init(g)) goto fail;
+  if (hdrlen == 0)       return 0;
 
-    nnbrs = graph_num_neighbours(g, i);
-    nbrs  = graph_get_neighbours(g, i);
-    wts   = graph_get_weights(   g, i);
+  hdrdata = malloc(hdrlen);
+  if (hdrdata == NULL) goto fail;
 
-    printf("%5" PRIu64 ": ", i);
+  if (ngdb_hdr_get_data(ngdb, (uint8_t *)hdrdata)) goto fail;
+  if (graph_log_import(g, hdrdata, "\n"))          goto fail;
+
+  free(hdrdata);
+  return 0;
+
+fail:
+  if (hdrdata != NULL) free(hdrdata);
+  return 1;
+}
+
+uint8_t _stream_labels(ngdb_t *ngdb, graph_label_t *lbls) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t start;
+  uint32_t n;
+  uint16_t len;
+  uint8_t *data;
+
+  data   = NULL;
+  nnodes = ngdb_num_nodes(ngdb);
+  len    = ngdb_node_data_len(ngdb);
+
+  if (len < sizeof(graph_label_t)) goto fail;
+
+  data = malloc((uint64_t)BATCH_NODES * len);
+  if (data == NULL) goto fail;
+
+  for (start = 0; start < nnodes; start += n) {
+
+    n = BATCH_NODES;
+    if (start + n > nnodes) n = nnodes - start;
+
+    if (ngdb_nodes_get_data(ngdb, start, n, data)) goto fail;
+
+    for (i = 0; i < n; i++)
+      memcpy(lbls + start + i, data + i * len, sizeof(graph_label_t));
+  }
+
+  free(data);
+  return 0;
+
+fail:
+  if (data != NULL) free(data);
+  return 1;
+}
+
+graph_label_t * _label(dump_ctx_t *ctx, uint64_t n) {
+
+  if (ctx->g != NULL) return graph_get_nodelabel(ctx->g, n);
+  else                return ctx->lbls + n;
+}
+
+uint8_t _fmt_labels(uint64_t start, uint64_t end, outbuf_t *ob, void *vctx) {
+
+  uint64_t       i;
+  graph_label_t *lbl;
+  dump_ctx_t    *ctx;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++) {
+
+    lbl = _label(ctx, i);
+
+    outbuf_str      (ob, "node ");
+    outbuf_u64_width(ob, i, 5);
+    outbuf_str      (ob, ": ");
+    outbuf_fixed    (ob, lbl->xval, 3);
+    outbuf_char     (ob, ' ');
+    outbuf_fixed    (ob, lbl->yval, 3);
+    outbuf_char     (ob, ' ');
+    outbuf_fixed    (ob, lbl->zval, 3);
+    outbuf_char     (ob, ' ');
+    outbuf_u64      (ob, lbl->labelval);
+    outbuf_char     (ob, '\n');
+  }
+
+  return ob->err;
+}
+
+uint8_t _fmt_graph(uint64_t start, uint64_t end, outbuf_t *ob, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       u;
+  uint32_t       nnbrs;
+  uint32_t      *nbrs;
+  float         *fwts;
+  double        *dwts;
+  double         dist;
+  double         dx;
+  double         dy;
+  double         dz;
+  graph_label_t *lu;
+  graph_label_t *lv;
+  dump_ctx_t    *ctx;
+
+  ctx  = vctx;
+  fwts = NULL;
+  dwts = NULL;
+
+  for (i = start; i < end; i++) {
+
+    if (ctx->g != NULL) {
+      u     = i;
+      nnbrs = graph_num_neighbours(ctx->g, u);
+      nbrs  = graph_get_neighbours(ctx->g, u);
+      fwts  = graph_get_weights(   ctx->g, u);
+    }
+    else {
+      u     = ctx->first + i;
+      nnbrs = ctx->offsets[i + 1] - ctx->offsets[i];
+      nbrs  = ctx->refs + ctx->offsets[i];
+      if (ctx->wts != NULL) dwts = ctx->wts + ctx->offsets[i];
+    }
+
+    outbuf_u64_width(ob, u, 5);
+    outbuf_str      (ob, ": ");
 
     for (j = 0; j < nnbrs; j++) {
-      
-      printf("%5u", nbrs[j]);
 
-      dist = stats_edge_distance(g, i, nbrs[j]);
+      outbuf_u64_width(ob, nbrs[j], 5);
 
-      if (weights || dists) printf(" (");
+      if (ctx->weights || ctx->dists) outbuf_str(ob, " (");
 
-      if (weights) printf("%0.4f",   wts[j]);
-      if (dists)   printf(":%0.4f:", dist);
-      
-      if (weights || dists) printf(")");
-      
-      if (j < nnbrs-1) printf(" ");
+      /*the graph stores weights in single precision*/
+      if (ctx->weights) {
+        if (fwts != NULL) outbuf_fixed(ob,         fwts[j],  4);
+        else              outbuf_fixed(ob, (float)(dwts[j]), 4);
+      }
+
+      /*calculated in the same way as stats_edge_distance*/
+      if (ctx->dists) {
+
+        lu = _label(ctx, u);
+        lv = _label(ctx, nbrs[j]);
+
+        dx = lu->xval - lv->xval;
+        dy = lu->yval - lv->yval;
+        dz = lu->zval - lv->zval;
+
+        dist = pow((dx*dx) + (dy*dy) + (dz*dz), 0.5);
+
+        outbuf_char (ob, ':');
+        outbuf_fixed(ob, dist, 4);
+        outbuf_char (ob, ':');
+      }
+
+      if (ctx->weights || ctx->dists) outbuf_char(ob, ')');
+
+      if (j < nnbrs-1) outbuf_char(ob, ' ');
     }
-    printf("\n");
+    outbuf_char(ob, '\n');
   }
+
+  return ob->err;
 }
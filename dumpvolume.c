@@ -14,6 +14,14 @@
 #include "util/dimorder.h"
 #include "timeseries/analyze_volume.h"
 
+/**
+ * Prints the time series of every voxel in the volume, one voxel per line,
+ * in the given dimension order. The time series are read in blocks of
+ * voxels, via the volume time series cache, so each image is read in
+ * ascending order rather than voxel by voxel.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
 static uint8_t _dumpvol(
   analyze_volume_t *vol,
   uint8_t          *dimorder
@@ -45,7 +53,10 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
 
-  dimorder_parse(vol.hdrs, argv+2, dimorder, argc-2);
+  if (dimorder_parse(vol.hdrs, argv+2, dimorder, argc-2)) {
+    printf("invalid dimension order\n");
+    goto fail;
+  }
 
   if (_dumpvol(&vol, dimorder)) {
     printf("error dumping volume\n");
@@ -62,39 +73,58 @@ fail:
 
 uint8_t _dumpvol(analyze_volume_t *vol, uint8_t *dimorder) {
 
-  uint64_t i, j;
-  uint32_t nvals;
-  double  *tsdata;
-  uint32_t dims[4];
-  char     str[20];
+  uint64_t  i, j, k;
+  uint32_t  nvals;
+  uint32_t  nidxs;
+  uint32_t  blksz;
+  uint32_t *idxs;
+  double   *tsdata;
+  uint32_t  dims[4];
+  char      str[20];
 
   memset(dims, 0, sizeof(dims));
 
-  tsdata = NULL;
-  nvals  = analyze_num_vals(vol->hdrs);
+  idxs  = NULL;
+  nvals = analyze_num_vals(vol->hdrs);
+
+  /*limit the cache to about 4 million values*/
+  blksz = 4194304 / (vol->nimgs > 0 ? vol->nimgs : 1);
+  if (blksz < 256)   blksz = 256;
+  if (blksz > nvals) blksz = nvals;
+
+  idxs = malloc(blksz * sizeof(uint32_t));
+  if (idxs == NULL && blksz > 0) goto fail;
+
+  for (i = 0; i < nvals; i += nidxs) {
+
+    nidxs = (nvals - i > blksz) ? blksz : nvals - i;
+
+    for (k = 0; k < nidxs; k++) {
+      idxs[k] = analyze_get_index(vol->hdrs, dims);
+      dimorder_next(vol->hdrs, dims, dimorder);
+    }
 
-  tsdata = calloc(vol->nimgs, sizeof(double));
-  if (tsdata == NULL) goto fail;
+    if (analyze_cache_volume(vol, idxs, nidxs)) goto fail;
 
-  for (i = 0; i < nvals; i++) {
+    for (k = 0; k < nidxs; k++) {
 
-    analyze_read_timeseries(vol, dims[0], dims[1], dims[2], tsdata);
-    dimorder_next(vol->hdrs, dims, dimorder);
+      tsdata = vol->tscache + k*vol->nimgs;
 
-    for (j = 0; j < vol->nimgs; j++) {
+      for (j = 0; j < vol->nimgs; j++) {
       
-      analyze_sprint_val(vol->hdrs, str, tsdata[j]);
-      printf("%s", str);
-      if (j < (vol->nimgs-1)) printf(" ");
+        analyze_sprint_val(vol->hdrs, str, tsdata[j]);
+        printf("%s", str);
+        if (j < (vol->nimgs-1)) printf(" ");
+      }
+      printf("\n");
     }
-    printf("\n");
   }
 
-  free(tsdata);
+  free(idxs);
   return 0;
 
 fail:
 
-  if (tsdata != NULL) free(tsdata);
+  if (idxs != NULL) free(idxs);
   return 1;
 }
@@ -6,11 +6,242 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "util/array.h"
 #include "graph/graph.h"
 #include "graph/bfs.h"
 #include "graph/expand.h"
+#include "graph/graph_bitset.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/progress.h"
+
+/**
+ * bfs_hybrid switches to bottom-up expansion when the number of edges
+ * leaving the current level is more than 1/BFS_HYBRID_ALPHA of the number
+ * of edges leaving unvisited nodes.
+ */
+#define BFS_HYBRID_ALPHA 14
+
+/**
+ * bfs_hybrid switches back to top-down expansion when the current level
+ * contains fewer than 1/BFS_HYBRID_BETA of the nodes in the graph.
+ */
+#define BFS_HYBRID_BETA 24
+
+/**
+ * \return the sum of the degrees of the nodes in the given list.
+ */
+static uint64_t _sum_degrees(
+  graph_t *g,    /**< the graph     */
+  array_t *nodes /**< list of nodes */
+);
+
+/**
+ * Key for the default workspace of each thread, which is used by bfs and
+ * bfs_hybrid, and freed when the thread exits.
+ */
+static pthread_key_t  _ws_key;
+static pthread_once_t _ws_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Creates _ws_key - called once, via pthread_once.
+ */
+static void _ws_key_init(void);
+
+/**
+ * Frees a thread's default workspace - the _ws_key destructor.
+ */
+static void _ws_destroy(
+  void *vws /**< pointer to a bfs_ws_t struct */
+);
+
+/**
+ * \return the calling thread's default workspace, creating it if
+ * necessary. If the default workspace is already in use (i.e. a search
+ * has been started from within the callback of another search), a new
+ * workspace is created, and owned is set to 1. Returns NULL on failure.
+ */
+static bfs_ws_t * _acquire_ws(
+  uint32_t numnodes, /**< number of nodes in the graph to be searched */
+  uint8_t *owned     /**< set to 1 if the workspace must be freed by
+                          _release_ws, 0 otherwise                    */
+);
+
+/**
+ * Releases a workspace returned by _acquire_ws.
+ */
+static void _release_ws(
+  bfs_ws_t *ws,   /**< the workspace                  */
+  uint8_t   owned /**< value returned by _acquire_ws  */
+);
+
+/**
+ * Prepares the given workspace for a search from the given roots - grows
+ * the workspace if necessary, applies the subgraph mask, and adds the
+ * roots to the first level.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _begin_search(
+  bfs_ws_t *ws,          /**< the workspace         */
+  graph_t  *g,           /**< the graph to search   */
+  uint32_t *roots,       /**< root nodes            */
+  uint32_t  nroots,      /**< number of root nodes  */
+  uint8_t  *subgraphmask /**< subgraph mask or NULL */
+);
+
+/**
+ * Records the given newly visited nodes, so the visited mask can be
+ * cleared at the end of the search.
+ */
+static void _touch(
+  bfs_ws_t *ws,   /**< the workspace           */
+  array_t  *nodes /**< newly visited nodes     */
+);
+
+/**
+ * Clears the visited mask of the given workspace at the end of a search.
+ * Without a subgraph mask, only the entries for the nodes which were
+ * visited are cleared, so the cost is proportional to the size of the
+ * search, rather than to the size of the graph.
+ */
+static void _end_search(
+  bfs_ws_t *ws,          /**< the workspace                   */
+  graph_t  *g,           /**< the graph which was searched    */
+  uint8_t  *subgraphmask /**< subgraph mask used by the search */
+);
+
+/**
+ * Number of searches handed to a thread at a time by bfs_all.
+ */
+#define BFS_ALL_CHUNK 16
+
+/**
+ * Per-thread workspace for bfs_all.
+ */
+typedef struct _bfs_all_ws {
+
+  uint8_t  *visited; /**< visited mask, including the subgraph mask */
+  uint32_t *order;   /**< visit order (numnodes entries)            */
+  uint32_t *levels;  /**< level start indices (numnodes+1 entries)  */
+
+} bfs_all_ws_t;
+
+/**
+ * Context shared between all of the threads working on a bfs_all call.
+ */
+typedef struct _bfs_all_ctx {
+
+  graph_t       *g;
+  uint32_t      *roots;
+  uint8_t       *mask;
+  bfs_all_ws_t  *ws;
+  void          *context;
+  uint8_t      (*callback)(bfs_all_state_t *, void *);
+
+} bfs_all_ctx_t;
+
+/**
+ * Per-thread workspace for bfs_multi.
+ */
+typedef struct _bfs_multi_ws {
+
+  uint64_t *seen;     /**< searches which have reached each node     */
+  uint64_t *visit;    /**< searches at each node in the current level */
+  uint64_t *next;     /**< searches at each node in the next level    */
+  uint32_t *level;    /**< nodes in the current level                */
+  uint32_t *nlevel;   /**< nodes in the next level                   */
+  uint32_t  roots[BFS_MULTI_WIDTH]; /**< root nodes in current batch */
+
+} bfs_multi_ws_t;
+
+/**
+ * Context shared between all of the threads working on a bfs_multi call.
+ */
+typedef struct _bfs_multi_ctx {
+
+  graph_t         *g;
+  uint32_t        *roots;
+  uint32_t         nroots;
+  uint8_t         *mask;
+  bfs_multi_ws_t  *ws;
+  void            *context;
+  uint8_t        (*callback)(bfs_multi_state_t *, void *);
+
+} bfs_multi_ctx_t;
+
+/**
+ * parallel_for function for bfs_multi - runs the given batches of
+ * searches.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _bfs_multi_batches(
+  uint64_t start,  /**< first batch                  */
+  uint64_t end,    /**< one past the last batch      */
+  uint16_t thread, /**< calling thread               */
+  void    *vctx    /**< pointer to a bfs_multi_ctx_t */
+);
+
+/**
+ * parallel_for function for bfs_all - runs the searches from roots
+ * [start, end).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _bfs_all_range(
+  uint64_t start,  /**< first root                 */
+  uint64_t end,    /**< one past the last root     */
+  uint16_t thread, /**< calling thread             */
+  void    *vctx    /**< pointer to a bfs_all_ctx_t */
+);
+
+uint8_t bfs_ws_init(bfs_ws_t *ws, uint32_t numnodes) {
+
+  memset(ws, 0, sizeof(bfs_ws_t));
+
+  if (array_create(&(ws->thislevel), sizeof(uint32_t), numnodes/4))
+    goto fail;
+  if (array_create(&(ws->nextlevel), sizeof(uint32_t), numnodes/4))
+    goto fail;
+
+  ws->numnodes = numnodes;
+  ws->visited  = calloc(numnodes + 1,      sizeof(uint8_t));
+  ws->inlevel  = calloc(numnodes + 1,      sizeof(uint8_t));
+  ws->inbits   = calloc(numnodes / 64 + 2, sizeof(uint64_t));
+  ws->touched  = malloc((numnodes + 1)   * sizeof(uint32_t));
+
+  if (ws->visited == NULL) goto fail;
+  if (ws->inlevel == NULL) goto fail;
+  if (ws->inbits  == NULL) goto fail;
+  if (ws->touched == NULL) goto fail;
+
+  return 0;
+
+fail:
+  bfs_ws_free(ws);
+  return 1;
+}
+
+void bfs_ws_free(bfs_ws_t *ws) {
+
+  array_free(&(ws->thislevel));
+  array_free(&(ws->nextlevel));
+
+  if (ws->visited != NULL) free(ws->visited);
+  if (ws->inlevel != NULL) free(ws->inlevel);
+  if (ws->inbits  != NULL) free(ws->inbits);
+  if (ws->touched != NULL) free(ws->touched);
+
+  memset(ws, 0, sizeof(bfs_ws_t));
+}
+
+void bfs_ws_exclude(bfs_ws_t *ws, uint32_t u) {
+
+  ws->visited[u] = 1;
+}
 
 uint8_t bfs(
   graph_t    *g,
@@ -26,71 +257,803 @@ uint8_t bfs(
     expand_state_t *state,
     void           *context))
 {
-  uint64_t    i;
+  uint8_t   status;
+  uint8_t   owned;
+  bfs_ws_t *ws;
+
+  ws = _acquire_ws(graph_num_nodes(g), &owned);
+  if (ws == NULL) return 1;
+
+  status = bfs_ws_search(ws, g, roots, nroots, subgraphmask,
+                         lvl_context, edge_context,
+                         lvl_callback, edge_callback);
+
+  _release_ws(ws, owned);
+
+  return status;
+}
+
+uint8_t bfs_hybrid(
+  graph_t    *g,
+  uint32_t   *roots,
+  uint32_t    nroots,
+  uint8_t    *subgraphmask,
+  void       *lvl_context,
+  uint8_t   (*lvl_callback) (
+    bfs_state_t *state,
+    void        *context))
+{
+  uint8_t   status;
+  uint8_t   owned;
+  bfs_ws_t *ws;
+
+  ws = _acquire_ws(graph_num_nodes(g), &owned);
+  if (ws == NULL) return 1;
+
+  status = bfs_ws_hybrid(
+    ws, g, roots, nroots, subgraphmask, lvl_context, lvl_callback);
+
+  _release_ws(ws, owned);
+
+  return status;
+}
+
+uint8_t bfs_ws_search(
+  bfs_ws_t   *ws,
+  graph_t    *g,
+  uint32_t   *roots,
+  uint32_t    nroots,
+  uint8_t    *subgraphmask,
+  void       *lvl_context,
+  void       *edge_context,
+  uint8_t   (*lvl_callback) (
+    bfs_state_t *state,
+    void        *context),
+  uint8_t   (*edge_callback) (
+    expand_state_t *state,
+    void           *context))
+{
   bfs_state_t state;
   array_t     tmp;       /* temp pointer used for swapping levels      */
-  array_t     nextlevel; /* array to store nodes in next level         */
+  array_t    *nextlevel; /* array to store nodes in next level         */
   uint8_t    *visited;   /* whether nodes have or haven't been visited */
-  uint32_t    numnodes;  /* number of nodes in graph                   */
+  uint8_t     stop;      /* set if the edge callback ends the search   */
+  uint64_t    nexp;      /* number of nodes expanded, when profiling   */
+  uint64_t    nscan;     /* number of edges scanned, when profiling    */
+  PROFILE_FUNC();
 
-  visited              = NULL;
-  nextlevel.data       = NULL;
-  state.thislevel.data = NULL;
+  nexp  = 0;
+  nscan = 0;
 
-  numnodes = graph_num_nodes(g);
+  if (_begin_search(ws, g, roots, nroots, subgraphmask)) goto fail;
 
-  if (array_create(&(state.thislevel), sizeof(uint32_t), numnodes/4))
-    goto fail;
-  if (array_create(&nextlevel,         sizeof(uint32_t), numnodes/4))
-    goto fail;
+  visited   = ws->visited;
+  nextlevel = &(ws->nextlevel);
 
-  visited = calloc(numnodes, sizeof(uint8_t));
-  if (visited == NULL) goto fail;
-
-  if (subgraphmask != NULL) 
-    memcpy(visited, subgraphmask, numnodes*sizeof(uint8_t));
-
-  for (i = 0; i < nroots; i++) {
-    array_append(&(state.thislevel), &(roots[i]));
-    visited[roots[i]] = 1;
-  }
+  memcpy(&(state.thislevel), &(ws->thislevel), sizeof(array_t));
 
   state.depth   = 0;
   state.visited = visited;
 
   do {
 
-    array_clear(&nextlevel);
+    array_clear(nextlevel);
     if (state.depth > 0) 
       if (lvl_callback != NULL && lvl_callback(&state, lvl_context))
         break; 
 
-    if (expand(
+    if (profile_on) {
+      nexp  += state.thislevel.size;
+      nscan += _sum_degrees(g, &(state.thislevel));
+    }
+
+    stop = expand(
       g,
       &(state.thislevel),
-      &nextlevel,
+      nextlevel,
       visited,
       edge_context,
-      edge_callback)) break;
+      edge_callback);
+
+    _touch(ws, nextlevel);
+
+    if (stop) break;
 
     state.depth++;
    
+    memcpy(&tmp,               &(state.thislevel), sizeof(array_t));
+    memcpy(&(state.thislevel), nextlevel,          sizeof(array_t));
+    memcpy(nextlevel,          &tmp,               sizeof(array_t));
+    
+  } while (state.thislevel.size != 0);
+
+  /*the level arrays may have been swapped, and grown*/
+  memcpy(&(ws->thislevel), &(state.thislevel), sizeof(array_t));
+
+  _end_search(ws, g, subgraphmask);
+
+  PROFILE_COUNT(PROFILE_BFS_SEARCHES, 1);
+  PROGRESS_ADD(PROGRESS_SOURCES, 1);
+  PROFILE_COUNT(PROFILE_BFS_NODES,    nexp);
+  PROFILE_COUNT(PROFILE_BFS_EDGES,    nscan);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t bfs_ws_hybrid(
+  bfs_ws_t   *ws,
+  graph_t    *g,
+  uint32_t   *roots,
+  uint32_t    nroots,
+  uint8_t    *subgraphmask,
+  void       *lvl_context,
+  uint8_t   (*lvl_callback) (
+    bfs_state_t *state,
+    void        *context))
+{
+  uint64_t        i;
+  uint32_t        ni;
+  bfs_state_t     state;
+  array_t         tmp;       /* temp pointer used for swapping levels      */
+  array_t        *nextlevel; /* array to store nodes in next level         */
+  uint8_t        *visited;   /* whether nodes have or haven't been visited */
+  uint8_t        *inlevel;   /* whether nodes are in the current level     */
+  uint64_t       *inbits;    /* inlevel as a bitset, for dense graphs      */
+  graph_bitset_t *bs;        /* bitset adjacency matrix, for dense graphs  */
+  uint32_t        numnodes;  /* number of nodes in graph                   */
+  uint64_t        mf;        /* number of edges leaving the current level  */
+  uint64_t        mu;        /* number of edges leaving unvisited nodes    */
+  uint8_t         bottomup;  /* whether the last level was bottom-up       */
+  uint64_t        nexp;      /* number of nodes expanded, when profiling   */
+  uint64_t        nscan;     /* number of edges scanned, when profiling    */
+  PROFILE_FUNC();
+
+  bottomup = 0;
+  nexp     = 0;
+  nscan    = 0;
+  numnodes = graph_num_nodes(g);
+
+  if (_begin_search(ws, g, roots, nroots, subgraphmask)) goto fail;
+
+  visited   = ws->visited;
+  inlevel   = ws->inlevel;
+  inbits    = ws->inbits;
+  nextlevel = &(ws->nextlevel);
+
+  memcpy(&(state.thislevel), &(ws->thislevel), sizeof(array_t));
+
+  /*
+   * dense graphs may have a bitset adjacency matrix,
+   * which is used for the bottom-up levels
+   */
+  bs = graph_bitset_get(g);
+
+  /*
+   * Without a mask, the total degree of the unvisited
+   * nodes can be calculated from the edge count, rather
+   * than by visiting every node in the graph
+   */
+  if (subgraphmask == NULL) {
+    mu  = 2 * (uint64_t)graph_num_edges(g);
+    mu -= _sum_degrees(g, &(state.thislevel));
+  }
+  else {
+    mu = 0;
+    for (i = 0; i < numnodes; i++) {
+      if (!visited[i]) mu += graph_num_neighbours(g, i);
+    }
+  }
+
+  state.depth   = 0;
+  state.visited = visited;
+
+  do {
+
+    array_clear(nextlevel);
+    if (state.depth > 0) 
+      if (lvl_callback != NULL && lvl_callback(&state, lvl_context))
+        break; 
+
+    if (profile_on) {
+      nexp  += state.thislevel.size;
+      nscan += _sum_degrees(g, &(state.thislevel));
+    }
+
+    if (!graph_is_directed(g)) {
+
+      mf = _sum_degrees(g, &(state.thislevel));
+
+      if      (!bottomup && mf > mu / BFS_HYBRID_ALPHA)
+        bottomup = 1;
+      else if ( bottomup && state.thislevel.size < numnodes / BFS_HYBRID_BETA)
+        bottomup = 0;
+    }
+
+    if (bottomup && bs != NULL) {
+
+      for (i = 0; i < state.thislevel.size; i++) {
+        array_get(&(state.thislevel), i, &ni);
+        inbits[ni / 64] |= 1ULL << (ni % 64);
+      }
+
+      expand_bottomup_bitset(g, bs, inbits, nextlevel, visited);
+
+      for (i = 0; i < state.thislevel.size; i++) {
+        array_get(&(state.thislevel), i, &ni);
+        inbits[ni / 64] = 0;
+      }
+    }
+    else if (bottomup) {
+
+      for (i = 0; i < state.thislevel.size; i++) {
+        array_get(&(state.thislevel), i, &ni);
+        inlevel[ni] = 1;
+      }
+
+      expand_bottomup(g, inlevel, nextlevel, visited);
+
+      for (i = 0; i < state.thislevel.size; i++) {
+        array_get(&(state.thislevel), i, &ni);
+        inlevel[ni] = 0;
+      }
+    }
+    else {
+      expand(g, &(state.thislevel), nextlevel, visited, NULL, NULL);
+    }
+
+    _touch(ws, nextlevel);
+
+    mu -= _sum_degrees(g, nextlevel);
+
+    state.depth++;
     
     memcpy(&tmp,               &(state.thislevel), sizeof(array_t));
-    memcpy(&(state.thislevel), &nextlevel,         sizeof(array_t));
-    memcpy(&nextlevel,         &tmp,               sizeof(array_t));
+    memcpy(&(state.thislevel), nextlevel,          sizeof(array_t));
+    memcpy(nextlevel,          &tmp,               sizeof(array_t));
     
   } while (state.thislevel.size != 0);
 
-  array_free(&(state.thislevel));
-  array_free(&nextlevel);
-  free(visited);
+  memcpy(&(ws->thislevel), &(state.thislevel), sizeof(array_t));
+
+  _end_search(ws, g, subgraphmask);
+
+  PROFILE_COUNT(PROFILE_BFS_SEARCHES, 1);
+  PROGRESS_ADD(PROGRESS_SOURCES, 1);
+  PROFILE_COUNT(PROFILE_BFS_NODES,    nexp);
+  PROFILE_COUNT(PROFILE_BFS_EDGES,    nscan);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _begin_search(
+  bfs_ws_t *ws,
+  graph_t  *g,
+  uint32_t *roots,
+  uint32_t  nroots,
+  uint8_t  *subgraphmask) {
+
+  uint64_t i;
+  uint32_t numnodes;
+
+  numnodes = graph_num_nodes(g);
+
+  /*the workspace is grown if it is too small for the graph*/
+  if (ws->numnodes < numnodes) {
+    bfs_ws_free(ws);
+    if (bfs_ws_init(ws, numnodes)) goto fail;
+  }
+
+  array_clear(&(ws->thislevel));
+  array_clear(&(ws->nextlevel));
+  ws->ntouched = 0;
+
+  if (subgraphmask != NULL) 
+    memcpy(ws->visited, subgraphmask, numnodes*sizeof(uint8_t));
+
+  for (i = 0; i < nroots; i++) {
+
+    if (array_append(&(ws->thislevel), &(roots[i]))) goto fail;
+
+    if (!ws->visited[roots[i]])
+      ws->touched[ws->ntouched++] = roots[i];
+
+    ws->visited[roots[i]] = 1;
+  }
+
+  return 0;
+
+fail:
+  _end_search(ws, g, subgraphmask);
+  return 1;
+}
+
+void _touch(bfs_ws_t *ws, array_t *nodes) {
+
+  memcpy(ws->touched + ws->ntouched,
+         nodes->data,
+         nodes->size * sizeof(uint32_t));
+
+  ws->ntouched += nodes->size;
+}
+
+void _end_search(bfs_ws_t *ws, graph_t *g, uint8_t *subgraphmask) {
+
+  uint64_t i;
+
+  if (subgraphmask != NULL) {
+    memset(ws->visited, 0, graph_num_nodes(g) * sizeof(uint8_t));
+  }
+  else {
+    for (i = 0; i < ws->ntouched; i++) ws->visited[ws->touched[i]] = 0;
+  }
+
+  ws->ntouched = 0;
+}
+
+void _ws_key_init(void) {
+
+  pthread_key_create(&_ws_key, _ws_destroy);
+}
+
+void _ws_destroy(void *vws) {
+
+  bfs_ws_free(vws);
+  free(vws);
+}
+
+bfs_ws_t * _acquire_ws(uint32_t numnodes, uint8_t *owned) {
+
+  bfs_ws_t *ws;
+
+  *owned = 0;
+
+  pthread_once(&_ws_once, _ws_key_init);
+
+  ws = pthread_getspecific(_ws_key);
+
+  if (ws == NULL) {
+
+    ws = calloc(1, sizeof(bfs_ws_t));
+    if (ws == NULL)                       goto fail;
+    if (bfs_ws_init(ws, numnodes))        goto fail;
+    if (pthread_setspecific(_ws_key, ws)) goto fail;
+  }
+
+  /*
+   * the thread's workspace is in use - this is a
+   * search started from the callback of another
+   * search, so it is given its own workspace
+   */
+  else if (ws->busy) {
+
+    ws = calloc(1, sizeof(bfs_ws_t));
+    if (ws == NULL)                goto fail;
+    if (bfs_ws_init(ws, numnodes)) goto fail;
+
+    *owned = 1;
+  }
+
+  ws->busy = 1;
+  return ws;
+
+fail:
+  if (ws != NULL) {
+    bfs_ws_free(ws);
+    free(ws);
+  }
+  return NULL;
+}
+
+void _release_ws(bfs_ws_t *ws, uint8_t owned) {
+
+  ws->busy = 0;
+
+  if (owned) {
+    bfs_ws_free(ws);
+    free(ws);
+  }
+}
+
+uint64_t _sum_degrees(graph_t *g, array_t *nodes) {
+
+  uint64_t i;
+  uint64_t sum;
+  uint32_t ni;
+
+  sum = 0;
+
+  for (i = 0; i < nodes->size; i++) {
+    array_get(nodes, i, &ni);
+    sum += graph_num_neighbours(g, ni);
+  }
+
+  return sum;
+}
+
+uint8_t bfs_all(
+  graph_t  *g,
+  uint32_t *roots,
+  uint32_t  nroots,
+  uint8_t  *subgraphmask,
+  uint16_t  nthreads,
+  void     *context,
+  uint8_t (*callback)(
+    bfs_all_state_t *state,
+    void            *context)) {
+
+  uint64_t      i;
+  uint32_t      numnodes;
+  bfs_all_ctx_t ctx;
+  PROFILE_FUNC();
+
+  numnodes = graph_num_nodes(g);
+
+  memset(&ctx, 0, sizeof(bfs_all_ctx_t));
+
+  if (roots == NULL) nroots = numnodes;
+  if (nroots == 0)   return 0;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads >  nroots)               nthreads = nroots;
+
+  ctx.g        = g;
+  ctx.roots    = roots;
+  ctx.mask     = subgraphmask;
+  ctx.context  = context;
+  ctx.callback = callback;
+
+  ctx.ws = calloc(nthreads, sizeof(bfs_all_ws_t));
+  if (ctx.ws == NULL) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+
+    ctx.ws[i].visited = calloc(numnodes,   sizeof(uint8_t));
+    ctx.ws[i].order   = malloc(numnodes   *sizeof(uint32_t));
+    ctx.ws[i].levels  = malloc((numnodes+1)*sizeof(uint32_t));
+
+    if (ctx.ws[i].visited == NULL) goto fail;
+    if (ctx.ws[i].order   == NULL) goto fail;
+    if (ctx.ws[i].levels  == NULL) goto fail;
+
+    if (subgraphmask != NULL)
+      memcpy(ctx.ws[i].visited, subgraphmask, numnodes*sizeof(uint8_t));
+  }
+
+  if (parallel_for(nthreads, nroots, BFS_ALL_CHUNK, &ctx, _bfs_all_range))
+    goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    free(ctx.ws[i].visited);
+    free(ctx.ws[i].order);
+    free(ctx.ws[i].levels);
+  }
+  free(ctx.ws);
+
+  return 0;
+
+fail:
+  if (ctx.ws != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (ctx.ws[i].visited != NULL) free(ctx.ws[i].visited);
+      if (ctx.ws[i].order   != NULL) free(ctx.ws[i].order);
+      if (ctx.ws[i].levels  != NULL) free(ctx.ws[i].levels);
+    }
+    free(ctx.ws);
+  }
+  return 1;
+}
+
+uint8_t _bfs_all_range(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t         i;
+  uint64_t         j;
+  uint64_t         head;
+  uint64_t         tail;
+  uint32_t         root;
+  uint32_t         v;
+  uint32_t         nnbrs;
+  uint32_t        *nbrs;
+  uint8_t         *visited;
+  uint64_t         nexp;
+  uint64_t         nscan;
+  bfs_all_ctx_t   *ctx;
+  bfs_all_state_t  state;
+
+  ctx     = vctx;
+  visited = ctx->ws[thread].visited;
+  nexp    = 0;
+  nscan   = 0;
+
+  state.thread = thread;
+  state.order  = ctx->ws[thread].order;
+  state.levels = ctx->ws[thread].levels;
+
+  for (i = start; i < end; i++) {
+
+    root = (ctx->roots != NULL) ? ctx->roots[i] : i;
+
+    state.root      = root;
+    state.maxdepth  = 0;
+    state.order[0]  = root;
+    state.levels[0] = 0;
+    visited[root]   = 1;
+
+    head = 0;
+    tail = 1;
+
+    /*
+     * The order array is used as a queue; each pass
+     * through this loop expands one level, in the
+     * same order as the expand function would.
+     */
+    while (head < tail) {
+
+      state.levels[state.maxdepth+1] = tail;
+
+      for (; head < state.levels[state.maxdepth+1]; head++) {
+
+        nnbrs  = graph_num_neighbours(ctx->g, state.order[head]);
+        nbrs   = graph_get_neighbours(ctx->g, state.order[head]);
+        nscan += nnbrs;
+
+        for (j = 0; j < nnbrs; j++) {
+
+          if (visited[nbrs[j]]) continue;
+
+          visited[nbrs[j]]    = 1;
+          state.order[tail++] = nbrs[j];
+        }
+      }
+
+      if (tail > head) state.maxdepth++;
+    }
+
+    /*
+     * restore the visited mask (the root may
+     * have been masked out), so this thread's
+     * workspace is clean for the next search
+     */
+    for (j = 0; j < tail; j++) {
+      v          = state.order[j];
+      visited[v] = (ctx->mask != NULL) ? ctx->mask[v] : 0;
+    }
+
+    nexp += tail;
+
+    if (ctx->callback != NULL && ctx->callback(&state, ctx->context))
+      goto fail;
+  }
+
+  PROFILE_COUNT(PROFILE_BFS_SEARCHES, end - start);
+  PROGRESS_ADD(PROGRESS_SOURCES, end - start);
+  PROFILE_COUNT(PROFILE_BFS_NODES,    nexp);
+  PROFILE_COUNT(PROFILE_BFS_EDGES,    nscan);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t bfs_multi(
+  graph_t  *g,
+  uint32_t *roots,
+  uint32_t  nroots,
+  uint8_t  *subgraphmask,
+  uint16_t  nthreads,
+  void     *context,
+  uint8_t (*callback)(
+    bfs_multi_state_t *state,
+    void              *context)) {
+
+  uint64_t         i;
+  uint64_t         nbatches;
+  uint32_t         numnodes;
+  bfs_multi_ctx_t  ctx;
+  bfs_multi_ws_t  *ws;
+  PROFILE_FUNC();
+
+  numnodes = graph_num_nodes(g);
+
+  memset(&ctx, 0, sizeof(bfs_multi_ctx_t));
+
+  if (roots == NULL) nroots = numnodes;
+  if (nroots == 0)   return 0;
+
+  nbatches = (nroots + BFS_MULTI_WIDTH - 1) / BFS_MULTI_WIDTH;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads >  nbatches)             nthreads = nbatches;
+
+  ctx.g        = g;
+  ctx.roots    = roots;
+  ctx.nroots   = nroots;
+  ctx.mask     = subgraphmask;
+  ctx.context  = context;
+  ctx.callback = callback;
+
+  ctx.ws = calloc(nthreads, sizeof(bfs_multi_ws_t));
+  if (ctx.ws == NULL) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+
+    ws = ctx.ws + i;
+
+    ws->seen   = malloc(numnodes*sizeof(uint64_t));
+    ws->visit  = calloc(numnodes, sizeof(uint64_t));
+    ws->next   = calloc(numnodes, sizeof(uint64_t));
+    ws->level  = malloc(numnodes*sizeof(uint32_t));
+    ws->nlevel = malloc(numnodes*sizeof(uint32_t));
+
+    if (ws->seen   == NULL) goto fail;
+    if (ws->visit  == NULL) goto fail;
+    if (ws->next   == NULL) goto fail;
+    if (ws->level  == NULL) goto fail;
+    if (ws->nlevel == NULL) goto fail;
+  }
+
+  if (parallel_for(nthreads, nbatches, 1, &ctx, _bfs_multi_batches))
+    goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    ws = ctx.ws + i;
+    free(ws->seen);
+    free(ws->visit);
+    free(ws->next);
+    free(ws->level);
+    free(ws->nlevel);
+  }
+  free(ctx.ws);
+
+  return 0;
+
+fail:
+  if (ctx.ws != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      ws = ctx.ws + i;
+      if (ws->seen   != NULL) free(ws->seen);
+      if (ws->visit  != NULL) free(ws->visit);
+      if (ws->next   != NULL) free(ws->next);
+      if (ws->level  != NULL) free(ws->level);
+      if (ws->nlevel != NULL) free(ws->nlevel);
+    }
+    free(ctx.ws);
+  }
+  return 1;
+}
+
+uint8_t _bfs_multi_batches(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t           i;
+  uint64_t           j;
+  uint64_t           b;
+  uint32_t           u;
+  uint32_t           v;
+  uint32_t           n;
+  uint32_t           nnbrs;
+  uint32_t          *nbrs;
+  uint32_t          *utmp;
+  uint64_t          *tmp;
+  uint64_t           bits;
+  uint32_t           numnodes;
+  uint64_t           nexp;
+  uint64_t           nscan;
+  bfs_multi_ctx_t   *ctx;
+  bfs_multi_ws_t    *ws;
+  bfs_multi_state_t  state;
+
+  ctx      = vctx;
+  ws       = ctx->ws + thread;
+  numnodes = graph_num_nodes(ctx->g);
+  nexp     = 0;
+  nscan    = 0;
+
+  state.thread = thread;
+  state.roots  = ws->roots;
+
+  for (b = start; b < end; b++) {
+
+    state.batch  = b * BFS_MULTI_WIDTH;
+    state.nroots = ctx->nroots - state.batch;
+    state.depth  = 0;
+    state.nlevel = 0;
+
+    if (state.nroots > BFS_MULTI_WIDTH) state.nroots = BFS_MULTI_WIDTH;
+
+    /*masked out nodes are marked as seen by every search*/
+    for (i = 0; i < numnodes; i++) {
+      if (ctx->mask != NULL && ctx->mask[i]) ws->seen[i] = ~0ULL;
+      else                                   ws->seen[i] =  0;
+    }
+
+    for (i = 0; i < state.nroots; i++) {
+
+      if (ctx->roots != NULL) u = ctx->roots[state.batch + i];
+      else                    u = state.batch + i;
+
+      ws->roots[i] = u;
+
+      if (ws->visit[u] == 0) ws->level[state.nlevel++] = u;
+
+      ws->seen [u] |= 1ULL << i;
+      ws->visit[u] |= 1ULL << i;
+    }
+
+    while (state.nlevel > 0) {
+
+      n     = 0;
+      nexp += state.nlevel;
+
+      /*
+       * Every search in the batch which is at node u
+       * advances to each of u's neighbours, unless it
+       * has already reached that neighbour
+       */
+      for (i = 0; i < state.nlevel; i++) {
+
+        u      = ws->level[i];
+        nnbrs  = graph_num_neighbours(ctx->g, u);
+        nbrs   = graph_get_neighbours(ctx->g, u);
+        nscan += nnbrs;
+
+        for (j = 0; j < nnbrs; j++) {
+
+          v    = nbrs[j];
+          bits = ws->visit[u] & ~ws->seen[v];
+
+          if (bits == 0) continue;
+
+          if (ws->next[v] == 0) ws->nlevel[n++] = v;
+          ws->next[v] |= bits;
+        }
+      }
+
+      for (i = 0; i < state.nlevel; i++) ws->visit[ws->level[i]] = 0;
+
+      for (i = 0; i < n; i++) {
+        v            = ws->nlevel[i];
+        ws->seen[v] |= ws->next[v];
+      }
+
+      /*the next level becomes the current level*/
+      tmp        = ws->visit;
+      ws->visit  = ws->next;
+      ws->next   = tmp;
+      utmp       = ws->level;
+      ws->level  = ws->nlevel;
+      ws->nlevel = utmp;
+
+      state.depth++;
+      state.nlevel  = n;
+      state.level   = ws->level;
+      state.reached = ws->visit;
+
+      if (state.nlevel == 0) break;
+
+      if (ctx->callback != NULL && ctx->callback(&state, ctx->context))
+        goto fail;
+    }
+
+    PROFILE_COUNT(PROFILE_BFS_SEARCHES, state.nroots);
+    PROGRESS_ADD(PROGRESS_SOURCES, state.nroots);
+  }
+
+  /*a node reached by several searches at once is expanded once*/
+  PROFILE_COUNT(PROFILE_BFS_NODES, nexp);
+  PROFILE_COUNT(PROFILE_BFS_EDGES, nscan);
 
   return 0;
 
 fail:
-  array_free(&(state.thislevel));
-  array_free(&nextlevel);
-  if (visited != NULL) free(visited);
   return 1;
 }
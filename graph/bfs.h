@@ -25,6 +25,73 @@ typedef struct _bfs_state {
 
 } bfs_state_t;
 
+/**
+ * Workspace for breadth first searches - the visited mask and level
+ * arrays, which can be reused across searches, so that a search does not
+ * need to allocate, or clear, space for every node in the graph. Between
+ * searches, the visited mask is all 0; at the end of each search, only
+ * the entries for the nodes which were visited are cleared (unless a
+ * subgraph mask was used). The cost of a search is therefore proportional
+ * to the number of nodes that it reaches, rather than to the size of the
+ * graph. Nodes which have been excluded with bfs_ws_exclude stay marked
+ * as visited between searches.
+ *
+ * The bfs and bfs_hybrid functions use a workspace which belongs to the
+ * calling thread, and is kept until the thread exits, so workspaces only
+ * need to be managed explicitly by callers which want to control their
+ * lifetime. A workspace must not be used by more than one search at a
+ * time.
+ */
+typedef struct _bfs_ws {
+
+  uint32_t  numnodes;  /**< number of nodes the workspace has space for */
+  uint8_t   busy;      /**< non-0 while a thread's default workspace is
+                            in use                                      */
+  uint8_t  *visited;   /**< visited mask                                */
+  uint8_t  *inlevel;   /**< current level mask, for bottom-up levels    */
+  uint64_t *inbits;    /**< current level bitset, for bottom-up levels  */
+  uint32_t *touched;   /**< nodes visited by the current search         */
+  uint32_t  ntouched;  /**< number of nodes in touched                  */
+  array_t   thislevel; /**< nodes in the current level                  */
+  array_t   nextlevel; /**< nodes in the next level                     */
+
+} bfs_ws_t;
+
+/**
+ * Initialises a workspace for searches of graphs with up to the given
+ * number of nodes (the workspace is grown if it is used to search a
+ * larger graph).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t bfs_ws_init(
+  bfs_ws_t *ws,      /**< the workspace   */
+  uint32_t  numnodes /**< number of nodes */
+);
+
+/**
+ * Frees the memory used by the given workspace.
+ */
+void bfs_ws_free(
+  bfs_ws_t *ws /**< the workspace */
+);
+
+/**
+ * Excludes the given node from every later search which uses the given
+ * workspace, as if it were masked out with a subgraph mask. Unlike a
+ * subgraph mask, which is copied at the start of every search, an
+ * exclusion costs nothing per search, so a sequence of searches which
+ * each remove the nodes that they reach from the graph (e.g. iterative
+ * subgraph extraction) costs time proportional to the number of nodes
+ * reached. Exclusions are cleared if the workspace is grown, or used
+ * with a subgraph mask. Must not be called during a search.
+ */
+void bfs_ws_exclude(
+  bfs_ws_t *ws, /**< the workspace                          */
+  uint32_t  u   /**< node to exclude - less than the number
+                     of nodes the workspace has space for   */
+);
+
 /**
  * Performs a breadth first search through the graph, starting from the given
  * root nodes. Every time the search expands out to the next depth, the given
@@ -60,4 +127,179 @@ uint8_t bfs(
     void           *context)   /**< expand callback context                */
 );
 
+/**
+ * Equivalent to bfs, but without an expand callback. At each level, the
+ * search chooses between top-down expansion (see expand), and bottom-up
+ * expansion (see expand_bottomup), which is much cheaper for the middle
+ * levels of a low diameter graph, where the frontier covers most of the
+ * graph. Bottom-up expansion is used while the number of edges leaving
+ * the current level is large compared to the number of edges leaving the
+ * nodes which have not been visited, and until the current level becomes
+ * small again. Directed graphs are always searched top-down.
+ *
+ * The same nodes are found at each depth as with bfs, but the nodes in a
+ * level which was expanded bottom-up are in ascending order, rather than
+ * in the order in which they were found, so this function should only be
+ * used when the callback does not depend on the order of the nodes within
+ * each level.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t bfs_hybrid(
+  graph_t    *g,               /**< the graph to search                    */
+  uint32_t   *roots,           /**< nodes to start the search from         */
+  uint32_t    nroots,          /**< number of root nodes                   */
+  uint8_t    *subgraphmask,    /**< subgraph to search                     */
+  void       *lvl_context,     /**< context to pass to callback function   */
+  uint8_t   (*lvl_callback) (  /**< optional callback called at each depth */
+    bfs_state_t *state,        /**< current search state                   */
+    void        *context)      /**< callback context                       */
+);
+
+/**
+ * Equivalent to bfs, but uses the given workspace.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t bfs_ws_search(
+  bfs_ws_t   *ws,              /**< workspace to use                       */
+  graph_t    *g,               /**< the graph to search                    */
+  uint32_t   *roots,           /**< nodes to start the search from         */
+  uint32_t    nroots,          /**< number of root nodes                   */
+  uint8_t    *subgraphmask,    /**< subgraph to search                     */
+  void       *lvl_context,     /**< context to pass to callback function   */
+  void       *edge_context,    /**< expand callback context                */
+  uint8_t   (*lvl_callback) (  /**< optional callback called at each depth */
+    bfs_state_t *state,        /**< current search state                   */
+    void        *context),     /**< callback context                       */
+  uint8_t   (*edge_callback) ( /**< optional callback called at each edge  */
+    expand_state_t *state,     /**< current expand state                   */
+    void           *context)   /**< expand callback context                */
+);
+
+/**
+ * Equivalent to bfs_hybrid, but uses the given workspace.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t bfs_ws_hybrid(
+  bfs_ws_t   *ws,              /**< workspace to use                       */
+  graph_t    *g,               /**< the graph to search                    */
+  uint32_t   *roots,           /**< nodes to start the search from         */
+  uint32_t    nroots,          /**< number of root nodes                   */
+  uint8_t    *subgraphmask,    /**< subgraph to search                     */
+  void       *lvl_context,     /**< context to pass to callback function   */
+  uint8_t   (*lvl_callback) (  /**< optional callback called at each depth */
+    bfs_state_t *state,        /**< current search state                   */
+    void        *context)      /**< callback context                       */
+);
+
+/**
+ * Struct passed to the bfs_all callback function, at the end of each
+ * search. The nodes which were reached by the search are listed in the
+ * order in which they were visited, level by level; the nodes at depth d
+ * are order[levels[d]] to order[levels[d+1]-1].
+ */
+typedef struct _bfs_all_state {
+
+  uint32_t  root;     /**< node the search was started from           */
+  uint16_t  thread;   /**< calling thread, in the range [0, nthreads) */
+  uint32_t  maxdepth; /**< depth of the deepest level                 */
+  uint32_t *order;    /**< nodes in the order in which they were
+                           visited - order[0] is the root node        */
+  uint32_t *levels;   /**< start of each level in the order array
+                           (maxdepth+2 entries)                       */
+
+} bfs_all_state_t;
+
+/**
+ * Performs a separate breadth first search from each of the given root
+ * nodes (or from every node in the graph, if roots is NULL). The searches
+ * are shared between the given number of threads (pass in 0 to use all
+ * available processors); each thread has its own workspace, so the cost
+ * of each search is proportional to the number of nodes that it reaches,
+ * rather than to the size of the graph.
+ *
+ * When each search is complete, the callback function is called with the
+ * search state. The callback is called concurrently from different
+ * threads, so it must not write to any shared data without locking - the
+ * thread field of the state may be used to index per-thread storage.
+ * Searches are neighbour-ordered in the same way as the bfs function.
+ *
+ * The optional subgraph mask is the same as that for the bfs function.
+ *
+ * \return 0 on success, non-0 on failure, or if the callback function
+ * returns non-0 (in which case no further searches are started).
+ */
+uint8_t bfs_all(
+  graph_t  *g,            /**< the graph to search                      */
+  uint32_t *roots,        /**< nodes to start searches from, or NULL    */
+  uint32_t  nroots,       /**< number of root nodes (ignored if roots
+                               is NULL)                                 */
+  uint8_t  *subgraphmask, /**< subgraph to search                       */
+  uint16_t  nthreads,     /**< number of threads to use                 */
+  void     *context,      /**< context to pass to callback function     */
+  uint8_t (*callback)(    /**< function called at the end of each search */
+    bfs_all_state_t *state,   /**< search state     */
+    void            *context) /**< callback context */
+);
+
+/**
+ * Maximum number of searches which are run together by bfs_multi.
+ */
+#define BFS_MULTI_WIDTH 64
+
+/**
+ * Struct passed to the bfs_multi callback function, at each depth. For
+ * every node in the level array, bit i of reached[node] is set if the
+ * node was first reached, at this depth, by the search from roots[i].
+ */
+typedef struct _bfs_multi_state {
+
+  uint16_t  thread;  /**< calling thread, in the range [0, nthreads)   */
+  uint32_t  batch;   /**< index of roots[0] in the full list of roots  */
+  uint32_t  nroots;  /**< number of roots in this batch (at most
+                          BFS_MULTI_WIDTH)                             */
+  uint32_t *roots;   /**< root nodes in this batch                     */
+  uint32_t  depth;   /**< current depth                                */
+  uint32_t  nlevel;  /**< number of nodes in the level array           */
+  uint32_t *level;   /**< nodes reached by any search at this depth    */
+  uint64_t *reached; /**< per node bit mask of the searches which
+                          reached the node at this depth               */
+
+} bfs_multi_state_t;
+
+/**
+ * Performs a separate breadth first search from each of the given root
+ * nodes (or from every node in the graph, if roots is NULL), like
+ * bfs_all. The searches are run in batches of up to BFS_MULTI_WIDTH,
+ * where the state of every search in a batch is stored as a bit mask for
+ * each node, so one scan of each node's neighbours advances all of the
+ * searches in the batch at once. Batches are shared between the given
+ * number of threads (pass in 0 to use all available processors).
+ *
+ * The searches only provide the depth at which each node is reached - the
+ * order in which nodes are visited is not available. The callback is
+ * called once for every depth (starting at 1) of every batch, and may be
+ * called concurrently from different threads; results may be safely
+ * stored in arrays indexed by (batch + i), for i in [0, nroots).
+ *
+ * The optional subgraph mask is the same as that for the bfs function.
+ *
+ * \return 0 on success, non-0 on failure, or if the callback function
+ * returns non-0.
+ */
+uint8_t bfs_multi(
+  graph_t  *g,            /**< the graph to search                   */
+  uint32_t *roots,        /**< nodes to start searches from, or NULL */
+  uint32_t  nroots,       /**< number of root nodes (ignored if roots
+                               is NULL)                              */
+  uint8_t  *subgraphmask, /**< subgraph to search                    */
+  uint16_t  nthreads,     /**< number of threads to use              */
+  void     *context,      /**< context to pass to callback function  */
+  uint8_t (*callback)(    /**< function called at each depth         */
+    bfs_multi_state_t *state,   /**< search state     */
+    void              *context) /**< callback context */
+);
+
 #endif /* __BFS_H__ */
@@ -0,0 +1,179 @@
+/**
+ * A bucket queue of nodes, ordered by degree. See graph/degree_queue.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/degree_queue.h"
+
+/**
+ * Moves the given node, which is in the given bucket, down to the end of
+ * the bucket below.
+ */
+static void _move_down(
+  degree_queue_t *q, /**< the queue                 */
+  uint32_t        u, /**< the node                  */
+  uint32_t        b  /**< bucket the node is now in */
+);
+
+uint8_t degree_queue_init(degree_queue_t *q, graph_t *g) {
+
+  uint32_t u;
+  uint32_t b;
+  uint32_t maxdeg;
+  uint32_t start;
+  uint32_t count;
+
+  memset(q, 0, sizeof(degree_queue_t));
+
+  q->nnodes = graph_num_nodes(g);
+  q->nalive = q->nnodes;
+  maxdeg    = 0;
+
+  q->deg  = malloc(((uint64_t)q->nnodes + 1) * sizeof(uint32_t));
+  q->vert = malloc(((uint64_t)q->nnodes + 1) * sizeof(uint32_t));
+  q->pos  = malloc(((uint64_t)q->nnodes + 1) * sizeof(uint32_t));
+
+  if (q->deg  == NULL) goto fail;
+  if (q->vert == NULL) goto fail;
+  if (q->pos  == NULL) goto fail;
+
+  for (u = 0; u < q->nnodes; u++) {
+    q->deg[u] = graph_num_neighbours(g, u);
+    if (q->deg[u] > maxdeg) maxdeg = q->deg[u];
+  }
+
+  q->nbuckets = maxdeg + 2;
+  q->bottom   = 1;
+  q->top      = maxdeg + 1;
+
+  q->bin = calloc((uint64_t)q->nbuckets + 1, sizeof(uint32_t));
+  if (q->bin == NULL) goto fail;
+
+  /*count the nodes in each bucket, then find where each bucket starts*/
+  for (u = 0; u < q->nnodes; u++) q->bin[q->deg[u] + 1]++;
+
+  for (b = 0, start = 0; b <= q->nbuckets; b++) {
+    count     = q->bin[b];
+    q->bin[b] = start;
+    start    += count;
+  }
+
+  /*place the nodes, using pos as a cursor into each bucket*/
+  for (u = 0; u < q->nnodes; u++) {
+
+    b          = q->deg[u] + 1;
+    q->pos[u]  = q->bin[b];
+    q->bin[b] ++;
+
+    q->vert[q->pos[u]] = u;
+  }
+
+  /*the cursors have moved to the start of the next bucket*/
+  for (b = q->nbuckets; b > 0; b--) q->bin[b] = q->bin[b - 1];
+  q->bin[0] = 0;
+
+  return 0;
+
+fail:
+  degree_queue_free(q);
+  return 1;
+}
+
+void degree_queue_free(degree_queue_t *q) {
+
+  if (q->deg  != NULL) free(q->deg);
+  if (q->vert != NULL) free(q->vert);
+  if (q->pos  != NULL) free(q->pos);
+  if (q->bin  != NULL) free(q->bin);
+
+  memset(q, 0, sizeof(degree_queue_t));
+}
+
+uint32_t degree_queue_size(degree_queue_t *q) {
+  return q->nalive;
+}
+
+uint8_t degree_queue_contains(degree_queue_t *q, uint32_t u) {
+  return q->pos[u] >= q->bin[1];
+}
+
+uint32_t degree_queue_degree(degree_queue_t *q, uint32_t u) {
+  return q->deg[u];
+}
+
+uint32_t degree_queue_min_degree(degree_queue_t *q) {
+
+  if (q->nalive == 0) return 0;
+
+  while (q->bin[q->bottom] == q->bin[q->bottom + 1]) q->bottom++;
+
+  return q->bottom - 1;
+}
+
+uint32_t degree_queue_max_degree(degree_queue_t *q) {
+
+  if (q->nalive == 0) return 0;
+
+  while (q->bin[q->top] == q->bin[q->top + 1]) q->top--;
+
+  return q->top - 1;
+}
+
+uint32_t degree_queue_nodes(
+  degree_queue_t *q, uint32_t deg, uint32_t **nodes) {
+
+  uint32_t b;
+
+  b = deg + 1;
+
+  if (b >= q->nbuckets) {
+    *nodes = q->vert + q->nnodes;
+    return 0;
+  }
+
+  *nodes = q->vert + q->bin[b];
+  return q->bin[b + 1] - q->bin[b];
+}
+
+void degree_queue_decrement(degree_queue_t *q, uint32_t u) {
+
+  _move_down(q, u, q->deg[u] + 1);
+
+  q->deg[u]--;
+
+  /*the degree of u is now the lowest, or above it*/
+  if (q->deg[u] + 1 < q->bottom) q->bottom = q->deg[u] + 1;
+}
+
+void degree_queue_remove(degree_queue_t *q, uint32_t u) {
+
+  uint32_t b;
+
+  for (b = q->deg[u] + 1; b > 0; b--) _move_down(q, u, b);
+
+  q->nalive--;
+}
+
+void _move_down(degree_queue_t *q, uint32_t u, uint32_t b) {
+
+  uint32_t pu;
+  uint32_t pw;
+  uint32_t w;
+
+  pu = q->pos[u];
+  pw = q->bin[b];
+  w  = q->vert[pw];
+
+  q->vert[pu] = w;
+  q->vert[pw] = u;
+  q->pos [w]  = pu;
+  q->pos [u]  = pw;
+
+  q->bin[b]++;
+}
@@ -0,0 +1,143 @@
+/**
+ * A bucket queue of nodes, ordered by degree, which supports constant time
+ * degree decrements and queries for the minimum and maximum degree. It is
+ * intended for algorithms which repeatedly remove nodes from a graph, and
+ * need to know the degrees of the nodes which remain, without recomputing
+ * them from scratch.
+ *
+ * The queue is laid out as in:
+ *
+ *   Batagelj V, Zaversnik M 2003. An O(m) algorithm for cores decomposition
+ *   of networks. arXiv:cs/0310049.
+ *
+ * All nodes are stored in one array, sorted by bucket. A node which is in
+ * the queue with degree d is in bucket d+1; nodes which have been removed
+ * are in bucket 0. A node is moved down one bucket by swapping it with the
+ * first node of its bucket, and moving the start of the bucket up one.
+ *
+ * The queue tracks degrees only - the graph is not modified, and it is up
+ * to the caller to decrement the degrees of the neighbours of the nodes
+ * which they remove.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __DEGREE_QUEUE_H__
+#define __DEGREE_QUEUE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Degree bucket queue.
+ */
+typedef struct _degree_queue {
+
+  uint32_t  nnodes;   /**< number of nodes                            */
+  uint32_t  nalive;   /**< number of nodes in the queue               */
+  uint32_t  nbuckets; /**< number of buckets (maximum degree + 2)     */
+  uint32_t  bottom;   /**< lower bound on the lowest non-empty bucket,
+                           other than bucket 0                        */
+  uint32_t  top;      /**< upper bound on the highest non-empty bucket */
+  uint32_t *deg;      /**< degree of each node                        */
+  uint32_t *vert;     /**< nodes, sorted by bucket                    */
+  uint32_t *pos;      /**< position of each node in vert              */
+  uint32_t *bin;      /**< start of each bucket in vert, with one extra
+                           entry equal to nnodes                      */
+
+} degree_queue_t;
+
+/**
+ * Initialises a queue containing every node in the given graph, with its
+ * degree (the number of neighbours, i.e. the out-degree of a directed
+ * graph). Runs in time linear in the number of nodes.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t degree_queue_init(
+  degree_queue_t *q, /**< queue to initialise */
+  graph_t        *g  /**< the graph           */
+);
+
+/**
+ * Frees the memory used by the queue.
+ */
+void degree_queue_free(
+  degree_queue_t *q /**< the queue */
+);
+
+/**
+ * \return the number of nodes in the queue.
+ */
+uint32_t degree_queue_size(
+  degree_queue_t *q /**< the queue */
+);
+
+/**
+ * \return non-0 if the given node is in the queue, 0 if it has been
+ * removed.
+ */
+uint8_t degree_queue_contains(
+  degree_queue_t *q, /**< the queue */
+  uint32_t        u  /**< the node  */
+);
+
+/**
+ * \return the current degree of the given node, or its degree at the time
+ * it was removed.
+ */
+uint32_t degree_queue_degree(
+  degree_queue_t *q, /**< the queue */
+  uint32_t        u  /**< the node  */
+);
+
+/**
+ * \return the lowest degree of the nodes which are in the queue, or 0 if
+ * the queue is empty.
+ */
+uint32_t degree_queue_min_degree(
+  degree_queue_t *q /**< the queue */
+);
+
+/**
+ * \return the highest degree of the nodes which are in the queue, or 0 if
+ * the queue is empty.
+ */
+uint32_t degree_queue_max_degree(
+  degree_queue_t *q /**< the queue */
+);
+
+/**
+ * Retrieves the nodes in the queue which have the given degree. The nodes
+ * are not in any particular order. The returned pointer belongs to the
+ * queue, and is invalidated when the queue is changed.
+ *
+ * \return the number of nodes with the given degree.
+ */
+uint32_t degree_queue_nodes(
+  degree_queue_t *q,     /**< the queue                       */
+  uint32_t        deg,   /**< the degree                      */
+  uint32_t      **nodes  /**< place to store a pointer to the
+                              nodes with the given degree     */
+);
+
+/**
+ * Decrements the degree of the given node, which must be in the queue, and
+ * have a degree greater than 0.
+ */
+void degree_queue_decrement(
+  degree_queue_t *q, /**< the queue */
+  uint32_t        u  /**< the node  */
+);
+
+/**
+ * Removes the given node, which must be in the queue. The node is moved
+ * down one bucket at a time, so this takes time proportional to its
+ * degree.
+ */
+void degree_queue_remove(
+  degree_queue_t *q, /**< the queue */
+  uint32_t        u  /**< the node  */
+);
+
+#endif /* __DEGREE_QUEUE_H__ */
@@ -0,0 +1,542 @@
+/**
+ * Weighted shortest paths, by Dijkstra's algorithm, and by delta-stepping.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "graph/graph.h"
+#include "graph/dijkstra.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/progress.h"
+#include "util/radix_heap.h"
+
+/**
+ * Number of nodes in each chunk of work handed to a thread by
+ * dijkstra_delta_stepping.
+ */
+#define NODE_CHUNK 256
+
+/**
+ * Maximum number of delta-stepping buckets - a larger number means that
+ * the bucket width is far too small for the graph.
+ */
+#define MAX_BUCKETS (1 << 26)
+
+/**
+ * A growable list of nodes.
+ */
+typedef struct _node_list {
+
+  uint32_t *nodes; /**< the nodes        */
+  uint64_t  size;  /**< number of nodes  */
+  uint64_t  cap;   /**< capacity         */
+
+} node_list_t;
+
+/**
+ * A request to lower the tentative distance of a node.
+ */
+typedef struct _request {
+
+  uint32_t node; /**< the node          */
+  double   dist; /**< the new distance  */
+
+} request_t;
+
+/**
+ * A growable list of requests.
+ */
+typedef struct _request_list {
+
+  request_t *reqs; /**< the requests        */
+  uint64_t   size; /**< number of requests  */
+  uint64_t   cap;  /**< capacity            */
+
+} request_list_t;
+
+/**
+ * State shared by the threads relaxing edges in dijkstra_delta_stepping.
+ */
+typedef struct _delta_ctx {
+
+  graph_t          *g;       /**< the graph                          */
+  dijkstra_length_t length;  /**< edge length conversion             */
+  double            delta;   /**< bucket width                       */
+  double           *dist;    /**< tentative distances                */
+  uint8_t           heavy;   /**< relax heavy (length > delta)
+                                  edges, rather than light edges     */
+  node_list_t      *nodes;   /**< nodes whose edges are to be relaxed */
+  request_list_t   *reqs;    /**< one list of requests per thread    */
+
+} delta_ctx_t;
+
+/**
+ * Appends a node to the given list.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _list_append(
+  node_list_t *l, /**< the list */
+  uint32_t     n  /**< the node */
+);
+
+/**
+ * Appends a request to the given list.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _request_append(
+  request_list_t *l,    /**< the list          */
+  uint32_t        node, /**< the node          */
+  double          dist  /**< the new distance  */
+);
+
+/**
+ * parallel_for function - relaxes the light or heavy edges of the nodes
+ * in the range [start, end) of the context node list, storing a request
+ * for every edge which would lower the tentative distance of its end
+ * point. Distances are only read, so no locking is needed.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _relax(
+  uint64_t start,  /**< first node           */
+  uint64_t end,    /**< one past last node   */
+  uint16_t thread, /**< calling thread       */
+  void    *ctx     /**< pointer to a delta_ctx_t */
+);
+
+/**
+ * \return the mean length of the edges in the given graph, or 1 if it has
+ * no usable edges.
+ */
+static double _mean_length(
+  graph_t          *g,     /**< the graph              */
+  dijkstra_length_t length /**< edge length conversion */
+);
+
+double dijkstra_edge_length(dijkstra_length_t length, float wt) {
+
+  if (wt <= 0) return -1;
+
+  if (length == DIJKSTRA_LENGTH_INVERSE) return 1.0 / wt;
+  return wt;
+}
+
+uint8_t dijkstra_create(
+  dijkstra_t *d, graph_t *g, dijkstra_length_t length) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  memset(d, 0, sizeof(dijkstra_t));
+  radix_heap_create(&(d->heap));
+
+  nnodes = graph_num_nodes(g);
+
+  d->g      = g;
+  d->length = length;
+  d->dist   = malloc((nnodes > 0 ? nnodes : 1) * sizeof(double));
+  d->sigma  = calloc((nnodes > 0 ? nnodes : 1),  sizeof(double));
+  d->order  = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+
+  if (d->dist  == NULL) goto fail;
+  if (d->sigma == NULL) goto fail;
+  if (d->order == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) d->dist[i] = INFINITY;
+
+  return 0;
+
+fail:
+  dijkstra_free(d);
+  return 1;
+}
+
+void dijkstra_free(dijkstra_t *d) {
+
+  if (d == NULL) return;
+
+  if (d->dist  != NULL) free(d->dist);
+  if (d->sigma != NULL) free(d->sigma);
+  if (d->order != NULL) free(d->order);
+  radix_heap_free(&(d->heap));
+
+  memset(d, 0, sizeof(dijkstra_t));
+}
+
+uint8_t dijkstra_search(dijkstra_t *d, uint32_t s) {
+
+  uint64_t  i;
+  uint64_t  key;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+  double    len;
+  double    nd;
+  uint64_t  nedges;
+
+  if (s >= graph_num_nodes(d->g)) goto fail;
+
+  PROFILE_COUNT(PROFILE_BFS_SEARCHES, 1);
+  PROGRESS_ADD(PROGRESS_SOURCES, 1);
+
+  /*reset the nodes reached by the previous search*/
+  for (i = 0; i < d->norder; i++) {
+    d->dist [d->order[i]] = INFINITY;
+    d->sigma[d->order[i]] = 0;
+  }
+
+  d->norder = 0;
+  nedges    = 0;
+  radix_heap_clear(&(d->heap));
+
+  d->dist [s] = 0;
+  d->sigma[s] = 1;
+  if (radix_heap_push(&(d->heap), radix_heap_key(0), s)) goto fail;
+
+  while (radix_heap_size(&(d->heap)) > 0) {
+
+    if (radix_heap_pop(&(d->heap), &key, &u)) goto fail;
+
+    /*
+     * nodes are only pushed when their distance
+     * decreases, so any pair which does not hold
+     * the current distance is stale
+     */
+    if (key != radix_heap_key(d->dist[u])) continue;
+
+    d->order[d->norder++] = u;
+
+    nnbrs   = graph_num_neighbours(d->g, u);
+    nbrs    = graph_get_neighbours(d->g, u);
+    wts     = graph_get_weights(   d->g, u);
+    nedges += nnbrs;
+
+    for (i = 0; i < nnbrs; i++) {
+
+      v   = nbrs[i];
+      len = dijkstra_edge_length(d->length, wts[i]);
+
+      if (len < 0) continue;
+
+      nd = d->dist[u] + len;
+
+      if (nd < d->dist[v]) {
+
+        d->dist [v] = nd;
+        d->sigma[v] = d->sigma[u];
+
+        if (radix_heap_push(&(d->heap), radix_heap_key(nd), v)) goto fail;
+      }
+      else if (nd == d->dist[v]) {
+        d->sigma[v] += d->sigma[u];
+      }
+    }
+  }
+
+  PROFILE_COUNT(PROFILE_BFS_NODES, d->norder);
+  PROFILE_COUNT(PROFILE_BFS_EDGES, nedges);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t dijkstra_delta_stepping(
+  graph_t          *g,
+  dijkstra_length_t length,
+  uint32_t          s,
+  double            delta,
+  uint16_t          nthreads,
+  double           *dist) {
+
+  uint64_t     i;
+  uint64_t     t;
+  uint64_t     cur;
+  uint64_t     idx;
+  uint64_t     nbuckets;
+  uint32_t     v;
+  uint32_t     nnodes;
+  uint32_t     stamp;
+  uint32_t    *fstamps;
+  uint32_t    *rstamps;
+  node_list_t *buckets;
+  node_list_t *tmp;
+  node_list_t  frontier;
+  node_list_t  settled;
+  request_t   *req;
+  delta_ctx_t  ctx;
+
+  PROFILE_FUNC();
+
+  buckets  = NULL;
+  fstamps  = NULL;
+  rstamps  = NULL;
+  nbuckets = 0;
+  stamp    = 0;
+  nnodes   = graph_num_nodes(g);
+  memset(&frontier, 0, sizeof(node_list_t));
+  memset(&settled,  0, sizeof(node_list_t));
+  memset(&ctx,      0, sizeof(delta_ctx_t));
+
+  if (s >= nnodes) goto fail;
+
+  if (nthreads == 0) nthreads = parallel_num_threads();
+  if (delta    <= 0) delta    = _mean_length(g, length);
+
+  ctx.g      = g;
+  ctx.length = length;
+  ctx.delta  = delta;
+  ctx.dist   = dist;
+  ctx.reqs   = calloc(nthreads, sizeof(request_list_t));
+  fstamps    = calloc(nnodes,   sizeof(uint32_t));
+  rstamps    = calloc(nnodes,   sizeof(uint32_t));
+
+  if (ctx.reqs == NULL) goto fail;
+  if (fstamps  == NULL) goto fail;
+  if (rstamps  == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) dist[i] = INFINITY;
+
+  dist[s]  = 0;
+  buckets  = calloc(1, sizeof(node_list_t));
+  nbuckets = 1;
+  if (buckets == NULL)                goto fail;
+  if (_list_append(buckets + 0, s))   goto fail;
+
+  for (cur = 0; cur < nbuckets; cur++) {
+
+    if (buckets[cur].size == 0) continue;
+
+    settled.size = 0;
+
+    /*
+     * relaxing light edges may add nodes to the
+     * current bucket, so it is emptied repeatedly
+     */
+    while (buckets[cur].size > 0) {
+
+      stamp++;
+      frontier.size = 0;
+
+      for (i = 0; i < buckets[cur].size; i++) {
+
+        v = buckets[cur].nodes[i];
+
+        /*nodes which have since moved to a lower bucket are stale*/
+        if ((uint64_t)(dist[v] / delta) != cur) continue;
+        if (fstamps[v] == stamp)                 continue;
+
+        fstamps[v] = stamp;
+        if (_list_append(&frontier, v)) goto fail;
+
+        if (rstamps[v] != cur + 1) {
+          rstamps[v] = cur + 1;
+          if (_list_append(&settled, v)) goto fail;
+        }
+      }
+
+      buckets[cur].size = 0;
+
+      /*light edges of the frontier, then heavy edges of every settled node*/
+      for (ctx.heavy = 0; ctx.heavy < 2; ctx.heavy++) {
+
+        if (ctx.heavy && buckets[cur].size > 0) break;
+
+        ctx.nodes = ctx.heavy ? &settled : &frontier;
+
+        for (t = 0; t < nthreads; t++) ctx.reqs[t].size = 0;
+
+        if (parallel_for(
+              nthreads, ctx.nodes->size, NODE_CHUNK, &ctx, _relax))
+          goto fail;
+
+        /*requests are applied serially, in thread order*/
+        for (t = 0; t < nthreads; t++) {
+          for (i = 0; i < ctx.reqs[t].size; i++) {
+
+            req = ctx.reqs[t].reqs + i;
+
+            if (req->dist >= dist[req->node]) continue;
+
+            dist[req->node] = req->dist;
+            idx             = (uint64_t)(req->dist / delta);
+
+            if (idx >= MAX_BUCKETS) goto fail;
+
+            if (idx >= nbuckets) {
+
+              tmp = realloc(buckets, (idx + 1) * sizeof(node_list_t));
+              if (tmp == NULL) goto fail;
+
+              buckets = tmp;
+              memset(buckets + nbuckets,
+                     0,
+                     (idx + 1 - nbuckets) * sizeof(node_list_t));
+              nbuckets = idx + 1;
+            }
+
+            if (_list_append(buckets + idx, req->node)) goto fail;
+          }
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < nbuckets; i++) free(buckets[i].nodes);
+  for (t = 0; t < nthreads; t++) free(ctx.reqs[t].reqs);
+  free(buckets);
+  free(ctx.reqs);
+  free(fstamps);
+  free(rstamps);
+  free(frontier.nodes);
+  free(settled.nodes);
+
+  return 0;
+
+fail:
+  if (buckets != NULL) {
+    for (i = 0; i < nbuckets; i++) free(buckets[i].nodes);
+    free(buckets);
+  }
+  if (ctx.reqs != NULL) {
+    for (t = 0; t < nthreads; t++) free(ctx.reqs[t].reqs);
+    free(ctx.reqs);
+  }
+  if (fstamps != NULL) free(fstamps);
+  if (rstamps != NULL) free(rstamps);
+  free(frontier.nodes);
+  free(settled.nodes);
+  return 1;
+}
+
+uint8_t _list_append(node_list_t *l, uint32_t n) {
+
+  uint64_t  newcap;
+  uint32_t *nodes;
+
+  if (l->size == l->cap) {
+
+    newcap = (l->cap == 0) ? 64 : 2 * l->cap;
+    nodes  = realloc(l->nodes, newcap * sizeof(uint32_t));
+    if (nodes == NULL) goto fail;
+
+    l->nodes = nodes;
+    l->cap   = newcap;
+  }
+
+  l->nodes[l->size++] = n;
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _request_append(request_list_t *l, uint32_t node, double dist) {
+
+  uint64_t   newcap;
+  request_t *reqs;
+
+  if (l->size == l->cap) {
+
+    newcap = (l->cap == 0) ? 64 : 2 * l->cap;
+    reqs   = realloc(l->reqs, newcap * sizeof(request_t));
+    if (reqs == NULL) goto fail;
+
+    l->reqs = reqs;
+    l->cap  = newcap;
+  }
+
+  l->reqs[l->size].node = node;
+  l->reqs[l->size].dist = dist;
+  l->size++;
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _relax(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t     i;
+  uint64_t     j;
+  uint32_t     u;
+  uint32_t     nnbrs;
+  uint32_t    *nbrs;
+  float       *wts;
+  double       len;
+  double       nd;
+  delta_ctx_t *dctx;
+
+  dctx = ctx;
+
+  for (i = start; i < end; i++) {
+
+    u     = dctx->nodes->nodes[i];
+    nnbrs = graph_num_neighbours(dctx->g, u);
+    nbrs  = graph_get_neighbours(dctx->g, u);
+    wts   = graph_get_weights(   dctx->g, u);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      len = dijkstra_edge_length(dctx->length, wts[j]);
+
+      if (len < 0)                                  continue;
+      if ((len > dctx->delta) != (dctx->heavy > 0)) continue;
+
+      nd = dctx->dist[u] + len;
+
+      if (nd >= dctx->dist[nbrs[j]]) continue;
+
+      if (_request_append(dctx->reqs + thread, nbrs[j], nd)) goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+double _mean_length(graph_t *g, dijkstra_length_t length) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  count;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  float    *wts;
+  double    len;
+  double    sum;
+
+  nnodes = graph_num_nodes(g);
+  count  = 0;
+  sum    = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      len = dijkstra_edge_length(length, wts[j]);
+      if (len < 0) continue;
+
+      sum += len;
+      count++;
+    }
+  }
+
+  if (count == 0 || sum == 0) return 1;
+  return sum / count;
+}
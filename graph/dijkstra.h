@@ -0,0 +1,126 @@
+/**
+ * Weighted shortest paths. Edge weights (see graph_get_weights) are
+ * converted to edge lengths in one of two ways - either the weight is used
+ * as the length directly, or, for graphs in which a larger weight means a
+ * stronger connection (e.g. correlation graphs), the length is the inverse
+ * of the weight. Edges with a weight which is not positive are ignored.
+ *
+ * dijkstra_search runs Dijkstra's algorithm, with a monotone radix heap
+ * (see util/radix_heap.h), from one source, and counts the number of
+ * shortest paths to every node, for Brandes' algorithm. Its buffers are
+ * re-used across searches, so it is suited to running searches from many
+ * sources, one per thread. dijkstra_delta_stepping instead parallelises a
+ * single search, for when only one source is of interest.
+ *
+ *   Dijkstra EW 1959. A note on two problems in connexion with graphs.
+ *   Numerische Mathematik 1:269-271
+ *
+ *   Meyer U & Sanders P 2003. Delta-stepping: a parallelizable shortest
+ *   path algorithm. Journal of Algorithms 49(1):114-152
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __DIJKSTRA_H__
+#define __DIJKSTRA_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "util/radix_heap.h"
+
+/**
+ * How edge weights are converted to edge lengths.
+ */
+typedef enum {
+
+  DIJKSTRA_LENGTH_WEIGHT  = 0, /**< length is the weight     */
+  DIJKSTRA_LENGTH_INVERSE = 1  /**< length is 1 / the weight */
+
+} dijkstra_length_t;
+
+/**
+ * Search buffers, and the results of the last search.
+ */
+typedef struct _dijkstra {
+
+  graph_t          *g;      /**< the graph                             */
+  dijkstra_length_t length; /**< edge length conversion                */
+  double           *dist;   /**< distance from the source to each node,
+                                 or INFINITY if it was not reached      */
+  double           *sigma;  /**< number of shortest paths from the
+                                 source to each node                    */
+  uint32_t         *order;  /**< reached nodes, in order of increasing
+                                 distance                               */
+  uint32_t          norder; /**< number of reached nodes (including the
+                                 source)                                */
+  radix_heap_t      heap;   /**< priority queue                         */
+
+} dijkstra_t;
+
+/**
+ * \return the length of an edge with the given weight, or a negative
+ * value if the edge is to be ignored.
+ */
+double dijkstra_edge_length(
+  dijkstra_length_t length, /**< edge length conversion */
+  float             wt      /**< edge weight            */
+);
+
+/**
+ * Allocates search buffers for the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t dijkstra_create(
+  dijkstra_t       *d,     /**< search to initialise   */
+  graph_t          *g,     /**< the graph              */
+  dijkstra_length_t length /**< edge length conversion */
+);
+
+/**
+ * Frees the memory used by the given search.
+ */
+void dijkstra_free(
+  dijkstra_t *d /**< the search */
+);
+
+/**
+ * Finds the shortest paths from the given source to every other node,
+ * storing the distances and path counts in d->dist and d->sigma, and the
+ * reached nodes in d->order. Only the entries for the nodes reached by the
+ * previous search are reset, so a search costs O(m log C) for the part of
+ * the graph that it reaches, regardless of the size of the graph.
+ *
+ * Path counts are of paths whose lengths, summed in floating point, are
+ * exactly equal.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t dijkstra_search(
+  dijkstra_t *d, /**< the search     */
+  uint32_t    s  /**< source node    */
+);
+
+/**
+ * Finds the shortest distances from the given source to every other node,
+ * with the delta-stepping algorithm. Nodes are placed in buckets of width
+ * delta, according to their tentative distance; the edges of all of the
+ * nodes in the lowest bucket are relaxed in parallel. The distances are
+ * identical to those found by dijkstra_search.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t dijkstra_delta_stepping(
+  graph_t          *g,        /**< the graph                              */
+  dijkstra_length_t length,   /**< edge length conversion                 */
+  uint32_t          s,        /**< source node                            */
+  double            delta,    /**< bucket width, or 0 to use the mean
+                                   edge length                            */
+  uint16_t          nthreads, /**< number of threads (0 for default, see
+                                   util/parallel.h)                       */
+  double           *dist      /**< space to store graph_num_nodes(g)
+                                   distances - INFINITY for nodes which
+                                   are not reachable                      */
+);
+
+#endif /* __DIJKSTRA_H__ */
@@ -0,0 +1,106 @@
+/**
+ * A binary heap of edges, ordered by their values.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/edge_heap.h"
+
+/**
+ * \return non-0 if entry a must be above entry b in the heap, 0 otherwise.
+ */
+static uint8_t _before(
+  edge_heap_t  *h, /**< the heap      */
+  graph_edge_t *a, /**< an entry      */
+  graph_edge_t *b  /**< another entry */
+);
+
+void edge_heap_init(edge_heap_t *h, uint8_t max) {
+
+  memset(h, 0, sizeof(edge_heap_t));
+  h->max = max;
+}
+
+void edge_heap_free(edge_heap_t *h) {
+
+  if (h->entries != NULL) free(h->entries);
+
+  h->entries = NULL;
+  h->size    = 0;
+  h->cap     = 0;
+}
+
+void edge_heap_clear(edge_heap_t *h) {
+
+  h->size = 0;
+}
+
+uint8_t edge_heap_push(edge_heap_t *h, graph_edge_t *e) {
+
+  uint64_t      i;
+  uint64_t      parent;
+  uint64_t      newcap;
+  graph_edge_t *entries;
+
+  if (h->size == h->cap) {
+
+    newcap  = (h->cap == 0) ? 1024 : 2 * h->cap;
+    entries = realloc(h->entries, newcap * sizeof(graph_edge_t));
+    if (entries == NULL) goto fail;
+
+    h->entries = entries;
+    h->cap     = newcap;
+  }
+
+  i = h->size++;
+
+  while (i > 0) {
+
+    parent = (i - 1) / 2;
+
+    if (!_before(h, e, h->entries + parent)) break;
+
+    h->entries[i] = h->entries[parent];
+    i             = parent;
+  }
+
+  h->entries[i] = *e;
+  return 0;
+
+fail:
+  return 1;
+}
+
+void edge_heap_pop(edge_heap_t *h) {
+
+  uint64_t     i;
+  uint64_t     child;
+  graph_edge_t last;
+
+  last = h->entries[--h->size];
+  i    = 0;
+
+  while ((child = 2 * i + 1) < h->size) {
+
+    if (child + 1 < h->size &&
+        _before(h, h->entries + child + 1, h->entries + child))
+      child++;
+
+    if (!_before(h, h->entries + child, &last)) break;
+
+    h->entries[i] = h->entries[child];
+    i             = child;
+  }
+
+  if (h->size > 0) h->entries[i] = last;
+}
+
+uint8_t _before(edge_heap_t *h, graph_edge_t *a, graph_edge_t *b) {
+
+  if (h->max) return a->val > b->val;
+  else        return a->val < b->val;
+}
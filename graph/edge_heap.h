@@ -0,0 +1,76 @@
+/**
+ * A binary heap of edges, ordered by their values, for thresholding
+ * functions which repeatedly remove the edge with the minimum (or maximum)
+ * value, and then recalculate the values of a few other edges.
+ *
+ * The heap is intended to be used lazily - an edge's old entry is not
+ * removed when the edge is removed from the graph, or when its value
+ * changes. Instead, a new entry is pushed for every recalculated value,
+ * and stale entries are discarded by the caller when they reach the top
+ * of the heap, if the edge no longer exists or its value no longer
+ * matches the current value.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __EDGE_HEAP_H__
+#define __EDGE_HEAP_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Edge heap.
+ */
+typedef struct _edge_heap {
+
+  graph_edge_t *entries; /**< the heap - entries[0] is the top   */
+  uint64_t      size;    /**< number of entries in the heap       */
+  uint64_t      cap;     /**< capacity of the heap                */
+  uint8_t       max;     /**< non-0 if the entry with the largest
+                              value is at the top, 0 if the entry
+                              with the smallest value is          */
+
+} edge_heap_t;
+
+/**
+ * Initialises an empty heap. No memory is allocated until the first entry
+ * is pushed.
+ */
+void edge_heap_init(
+  edge_heap_t *h,  /**< heap to initialise                     */
+  uint8_t      max /**< non-0 for a max-heap, 0 for a min-heap */
+);
+
+/**
+ * Frees the memory used by the heap, and empties it.
+ */
+void edge_heap_free(
+  edge_heap_t *h /**< the heap */
+);
+
+/**
+ * Removes every entry from the heap, without freeing its memory.
+ */
+void edge_heap_clear(
+  edge_heap_t *h /**< the heap */
+);
+
+/**
+ * Pushes a copy of the given entry onto the heap.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t edge_heap_push(
+  edge_heap_t  *h, /**< the heap  */
+  graph_edge_t *e  /**< the entry */
+);
+
+/**
+ * Removes the top entry from the heap, which must not be empty.
+ */
+void edge_heap_pop(
+  edge_heap_t *h /**< the heap */
+);
+
+#endif /* __EDGE_HEAP_H__ */
@@ -10,6 +10,7 @@
 
 #include "util/array.h"
 #include "graph/graph.h"
+#include "graph/graph_bitset.h"
 #include "graph/expand.h"
 
 uint8_t expand(
@@ -62,3 +63,66 @@ uint8_t expand(
 
   return 0;
 }
+
+void expand_bottomup(
+  graph_t *g,
+  uint8_t *inlevel,
+  array_t *nextlevel,
+  uint8_t *visited)
+{
+  uint32_t  i;
+  uint32_t  j;
+  uint32_t  numnodes;
+  uint32_t  nneighbours;
+  uint32_t *neighbours;
+
+  numnodes = graph_num_nodes(g);
+
+  for (i = 0; i < numnodes; i++) {
+
+    if (visited[i]) continue;
+
+    nneighbours = graph_num_neighbours(g, i);
+    neighbours  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nneighbours; j++) {
+
+      if (!inlevel[neighbours[j]]) continue;
+
+      array_append(nextlevel, &i);
+      visited[i] = 1;
+      break;
+    }
+  }
+}
+
+void expand_bottomup_bitset(
+  graph_t        *g,
+  graph_bitset_t *bs,
+  uint64_t       *inlevel,
+  array_t        *nextlevel,
+  uint8_t        *visited)
+{
+  uint32_t  i;
+  uint32_t  w;
+  uint32_t  numnodes;
+  uint64_t *row;
+
+  numnodes = graph_num_nodes(g);
+
+  for (i = 0; i < numnodes; i++) {
+
+    if (visited[i]) continue;
+
+    row = bs->rows + (uint64_t)i * bs->nwords;
+
+    for (w = 0; w < bs->nwords; w++) {
+
+      if (!(row[w] & inlevel[w])) continue;
+
+      array_append(nextlevel, &i);
+      visited[i] = 1;
+      break;
+    }
+  }
+}
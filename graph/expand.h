@@ -10,6 +10,7 @@
 #include <stdint.h>
 
 #include "graph/graph.h"
+#include "graph/graph_bitset.h"
 #include "util/array.h"
 
 /**
@@ -60,4 +61,38 @@ uint8_t expand(
   )
 );
 
+/**
+ * Bottom-up equivalent of expand. Instead of scanning the neighbours of
+ * every node in the current level, every node which has not yet been
+ * visited is checked for a neighbour in the current level, as indicated
+ * by the inlevel mask. This is faster than expand when the current level
+ * contains a large proportion of the graph, as each unvisited node only
+ * needs to be scanned until a neighbour is found.
+ *
+ * Newly found nodes are marked as visited, and stored in nextlevel in
+ * ascending order. The graph must be undirected, as the search follows
+ * edges in the reverse direction.
+ */
+void expand_bottomup(
+  graph_t *g,         /**< the graph to query                        */
+  uint8_t *inlevel,   /**< non-0 for every node in the current level */
+  array_t *nextlevel, /**< place to store newly found nodes          */
+  uint8_t *visited    /**< visited mask, one entry for each node     */
+);
+
+/**
+ * Equivalent of expand_bottomup for graphs which have a bitset adjacency
+ * matrix (see graph/graph_bitset.h). The current level is given as a
+ * bitset, so each unvisited node is checked for a neighbour in the
+ * current level 64 nodes at a time.
+ */
+void expand_bottomup_bitset(
+  graph_t        *g,         /**< the graph to query                    */
+  graph_bitset_t *bs,        /**< its adjacency matrix                  */
+  uint64_t       *inlevel,   /**< bitset of the nodes in the current
+                                  level (bs->nwords words)              */
+  array_t        *nextlevel, /**< place to store newly found nodes      */
+  uint8_t        *visited    /**< visited mask, one entry for each node */
+);
+
 #endif /* __EXPAND_H__ */
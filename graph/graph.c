@@ -7,11 +7,150 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 
 #include "graph/graph.h"
 #include "graph/graph_event.h"
+#include "graph/graph_spatial.h"
+#include "graph/graph_cmpindex.h"
+#include "graph/graph_labelidx.h"
+#include "graph/graph_bitset.h"
+#include "graph/graph_log.h"
 #include "util/array.h"
+#include "util/bigmem.h"
 #include "util/compare.h"
+#include "util/memacct.h"
+#include "util/parallel.h"
+
+/**
+ * Default initial capacity of each neighbour/weight list.
+ */
+#define LIST_CAPACITY       100
+
+/**
+ * Default initial capacity of each neighbour/weight list, for arena-backed
+ * graphs - lists are cheap to grow, as the space released by a list when
+ * it grows is re-used by other lists.
+ */
+#define ARENA_LIST_CAPACITY 8
+
+/**
+ * Number of nodes handed to a thread at a time by graph_permute.
+ */
+#define PERMUTE_CHUNK 4096
+
+/**
+ * A neighbour, and the weight of the edge to it - graph_permute sorts
+ * renumbered neighbour lists as an array of these.
+ */
+typedef struct _nbr_wt {
+
+  uint32_t nbr; /**< neighbour ID */
+  float    wt;  /**< edge weight  */
+
+} nbr_wt_t;
+
+/**
+ * Context shared between all of the threads working on a graph_permute
+ * call.
+ */
+typedef struct _permute_ctx {
+
+  graph_t   *g;       /**< the graph                                    */
+  uint32_t  *perm;    /**< the permutation                              */
+  uint32_t  *inv;     /**< inverse permutation - the new ID of each node */
+  uint64_t  *offsets; /**< new CSR offsets, or NULL if the graph is not
+                           frozen                                       */
+  uint32_t  *nbrs;    /**< new CSR neighbours                           */
+  float     *wts;     /**< new CSR weights                              */
+  nbr_wt_t **bufs;    /**< sort buffer for each thread                  */
+
+} permute_ctx_t;
+
+/**
+ * Builds the neighbour list hash indices for the high degree nodes of the
+ * given graph, which has just been frozen. Nothing is done if no node has
+ * GRAPH_HUB_DEGREE or more neighbours.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build_hubs(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return the slot at which a neighbour starts its search of a hash index
+ * of the given size (a power of two).
+ */
+static uint64_t _hub_hash(
+  uint32_t v,   /**< the neighbour        */
+  uint64_t size /**< size of the index    */
+);
+
+/**
+ * parallel_for function used by graph_permute. Renumbers, and sorts, the
+ * neighbour lists of new nodes start to end-1. For a frozen graph, each
+ * list is first copied from its old position into the new CSR arrays;
+ * otherwise the lists have already been moved to their new nodes.
+ *
+ * \return 0.
+ */
+static uint8_t _permute_range(
+  uint64_t start,  /**< first node               */
+  uint64_t end,    /**< one past the last node   */
+  uint16_t thread, /**< calling thread           */
+  void    *ctx     /**< pointer to permute_ctx_t */
+);
+
+/**
+ * Compares two nbr_wt_t structs, by neighbour ID.
+ */
+static int _compare_nbr_wts(const void *a, const void *b);
+
+/**
+ * Sub-function of graph_create, graph_create_arena and graph_copy.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+/**
+ * \return non-0 if the given memory was allocated for the graph, 0 if it
+ * lies within the file mapping of a graph image (see graph_image.h), and
+ * is released with the mapping.
+ */
+static uint8_t _graph_owns(
+  graph_t    *g, /**< the graph         */
+  const void *p  /**< memory to check   */
+);
+
+/**
+ * \return the size, in bytes, of the CSR arrays of the given graph, if it
+ * is frozen and owns them (see memacct.h), 0 otherwise.
+ */
+static uint64_t _csr_bytes(
+  graph_t *g /**< the graph */
+);
+
+static uint8_t _graph_create(
+  graph_t  *g,         /**< pointer to an empty graph_t struct     */
+  uint32_t  numnodes,  /**< number of nodes                        */
+  uint8_t   directed,  /**< directed or undirected                 */
+  uint8_t   arena,     /**< allocate lists from an arena           */
+  uint32_t *capacities /**< initial capacity of the lists for each
+                            node, or NULL to use the default       */
+);
+
+/**
+ * Creates a neighbour or weight list for one node of the given graph,
+ * from the graph's arena if it has one.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_list(
+  graph_t  *g,       /**< the graph          */
+  array_t  *list,    /**< list to create     */
+  uint32_t  datasz,  /**< size of one value  */
+  uint32_t  capacity /**< initial capacity   */
+);
 
 /**
  * Sub-function of graph_add_edge. Adds a directed edge from u to v,
@@ -43,6 +182,423 @@ uint8_t graph_is_directed(graph_t *g) {
   return ((g->flags) >> GRAPH_FLAG_DIRECTED) & 1;
 }
 
+uint8_t graph_is_frozen(graph_t *g) {
+  return ((g->flags) >> GRAPH_FLAG_FROZEN) & 1;
+}
+
+uint8_t graph_freeze(graph_t *g) {
+
+  uint64_t  i;
+  uint64_t  off;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint64_t *offsets;
+  uint32_t *nbrs;
+  float    *wts;
+
+  offsets = NULL;
+  nbrs    = NULL;
+  wts     = NULL;
+
+  if (g == NULL)          goto fail;
+  if (graph_is_frozen(g)) return 0;
+
+  nnodes = graph_num_nodes(g);
+
+  offsets = bigmem_alloc((nnodes+1)*sizeof(uint64_t));
+  if (offsets == NULL) goto fail;
+
+  for (i = 0, off = 0; i < nnodes; i++) {
+    offsets[i] = off;
+    off       += graph_num_neighbours(g, i);
+  }
+  offsets[nnodes] = off;
+
+  /*
+   * the CSR arrays are usually the largest, and most
+   * frequently accessed, memory in a program, so are
+   * eligible for huge pages and NUMA placement
+   */
+  nbrs = bigmem_alloc(off*sizeof(uint32_t));
+  wts  = bigmem_alloc(off*sizeof(float));
+  if (nbrs == NULL) goto fail;
+  if (wts  == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+
+    memcpy(nbrs + offsets[i], g->neighbours[i].data, nnbrs*sizeof(uint32_t));
+    memcpy(wts  + offsets[i], g->weights[i].data,    nnbrs*sizeof(float));
+
+    array_free(&(g->neighbours[i]));
+    array_free(&(g->weights   [i]));
+  }
+
+  free(g->neighbours);
+  free(g->weights);
+
+  /*the arena is re-created if the graph is thawed*/
+  if (g->arena != NULL) {
+    arena_destroy(g->arena);
+    free(g->arena);
+  }
+
+  g->arena      = NULL;
+  g->neighbours = NULL;
+  g->weights    = NULL;
+  g->csroffsets = offsets;
+  g->csrnbrs    = nbrs;
+  g->csrwts     = wts;
+  g->flags     |= 1 << GRAPH_FLAG_FROZEN;
+
+  memacct_alloc(MEMACCT_GRAPH, _csr_bytes(g));
+
+  /*
+   * the hub index is optional - if there is not enough
+   * memory for it, hub neighbour lists are binary searched
+   */
+  _build_hubs(g);
+
+  return 0;
+
+fail:
+  bigmem_free(offsets);
+  bigmem_free(nbrs);
+  bigmem_free(wts);
+  return 1;
+}
+
+uint8_t graph_thaw(graph_t *g) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  array_t  *nbrs;
+  array_t  *wts;
+
+  nbrs = NULL;
+  wts  = NULL;
+
+  if (g == NULL)           goto fail;
+  if (!graph_is_frozen(g)) return 0;
+
+  nnodes = graph_num_nodes(g);
+
+  nbrs = calloc(nnodes, sizeof(array_t));
+  wts  = calloc(nnodes, sizeof(array_t));
+  if (nbrs == NULL) goto fail;
+  if (wts  == NULL) goto fail;
+
+  if ((g->flags >> GRAPH_FLAG_ARENA) & 1) {
+
+    g->arena = malloc(sizeof(arena_t));
+    if (g->arena == NULL)           goto fail;
+    if (arena_create(g->arena, 0)) goto fail;
+
+    arena_set_acct(g->arena, MEMACCT_GRAPH);
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    
+    if (_create_list(g, nbrs+i, sizeof(uint32_t), nnbrs+1)) goto fail;
+    if (_create_list(g, wts +i, sizeof(float),    nnbrs+1)) goto fail;
+
+    array_set_cmps(nbrs+i, compare_u32, compare_u32_insert);
+
+    memcpy(nbrs[i].data, graph_get_neighbours(g, i), nnbrs*sizeof(uint32_t));
+    memcpy(wts [i].data, graph_get_weights(   g, i), nnbrs*sizeof(float));
+
+    nbrs[i].size = nnbrs;
+    wts [i].size = nnbrs;
+  }
+
+  memacct_free(MEMACCT_GRAPH, _csr_bytes(g));
+
+  if (_graph_owns(g, g->csroffsets)) bigmem_free(g->csroffsets);
+  if (_graph_owns(g, g->csrnbrs))    bigmem_free(g->csrnbrs);
+  if (_graph_owns(g, g->csrwts))     bigmem_free(g->csrwts);
+
+  if (g->huboffsets != NULL && _graph_owns(g, g->huboffsets))
+    free(g->huboffsets);
+  if (g->hubidx     != NULL && _graph_owns(g, g->hubidx))
+    free(g->hubidx);
+
+  g->huboffsets = NULL;
+  g->hubidx     = NULL;
+  g->csroffsets = NULL;
+  g->csrnbrs    = NULL;
+  g->csrwts     = NULL;
+  g->neighbours = nbrs;
+  g->weights    = wts;
+  g->flags     &= ~(1 << GRAPH_FLAG_FROZEN);
+
+  return 0;
+
+fail:
+  if (nbrs != NULL) {
+    for (i = 0; i < nnodes; i++) array_free(nbrs+i);
+    free(nbrs);
+  }
+  if (wts != NULL) {
+    for (i = 0; i < nnodes; i++) array_free(wts+i);
+    free(wts);
+  }
+  if (g != NULL && g->arena != NULL) {
+    arena_destroy(g->arena);
+    free(g->arena);
+    g->arena = NULL;
+  }
+  return 1;
+}
+
+uint8_t graph_permute(graph_t *g, uint32_t *perm) {
+
+  uint64_t       i;
+  uint64_t       s;
+  uint64_t       off;
+  uint32_t       nnodes;
+  uint32_t       nnbrs;
+  uint32_t       maxnbrs;
+  uint16_t       nthreads;
+  void          *tmp;
+  graph_label_t *lbls;
+  uint32_t      *u32s;
+  array_t       *lists;
+  permute_ctx_t  ctx;
+
+  tmp      = NULL;
+  lists    = NULL;
+  nthreads = 0;
+  memset(&ctx, 0, sizeof(permute_ctx_t));
+
+  if (g == NULL) goto fail;
+
+  nnodes   = graph_num_nodes(g);
+  ctx.g    = g;
+  ctx.perm = perm;
+
+  ctx.inv = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  tmp     = malloc(((uint64_t)nnodes + 1) * sizeof(graph_label_t));
+  if (ctx.inv == NULL) goto fail;
+  if (tmp     == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) ctx.inv[i] = 0xFFFFFFFF;
+
+  for (i = 0, maxnbrs = 1; i < nnodes; i++) {
+
+    if (perm[i] >= nnodes)              goto fail;
+    if (ctx.inv[perm[i]] != 0xFFFFFFFF) goto fail;
+
+    ctx.inv[perm[i]] = i;
+    nnbrs            = graph_num_neighbours(g, i);
+
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  /*
+   * every allocation is made before the graph is touched,
+   * so that it is left unchanged if one of them fails
+   */
+  nthreads = parallel_num_threads();
+  if (nthreads > PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads == 0)                   nthreads = 1;
+
+  ctx.bufs = calloc(nthreads, sizeof(nbr_wt_t *));
+  if (ctx.bufs == NULL) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    ctx.bufs[i] = malloc(maxnbrs * sizeof(nbr_wt_t));
+    if (ctx.bufs[i] == NULL) goto fail;
+  }
+
+  /*
+   * a frozen graph is gathered into new CSR arrays, in
+   * the new node order; the lists of a graph which is
+   * not frozen are simply moved to their new nodes
+   */
+  if (graph_is_frozen(g)) {
+
+    ctx.offsets = bigmem_alloc(((uint64_t)nnodes + 1) * sizeof(uint64_t));
+    if (ctx.offsets == NULL) goto fail;
+
+    for (i = 0, off = 0; i < nnodes; i++) {
+      ctx.offsets[i] = off;
+      off           += graph_num_neighbours(g, perm[i]);
+    }
+    ctx.offsets[nnodes] = off;
+
+    ctx.nbrs = bigmem_alloc(off * sizeof(uint32_t));
+    ctx.wts  = bigmem_alloc(off * sizeof(float));
+    if (ctx.nbrs == NULL) goto fail;
+    if (ctx.wts  == NULL) goto fail;
+  }
+  else {
+
+    lists = malloc(((uint64_t)nnodes + 1) * sizeof(array_t));
+    if (lists == NULL) goto fail;
+
+    for (i = 0; i < nnodes; i++) lists[i] = g->neighbours[perm[i]];
+    memcpy(g->neighbours, lists, nnodes * sizeof(array_t));
+
+    for (i = 0; i < nnodes; i++) lists[i] = g->weights[perm[i]];
+    memcpy(g->weights, lists, nnodes * sizeof(array_t));
+
+    free(lists);
+    lists = NULL;
+  }
+
+  if (parallel_for(nthreads, nnodes, PERMUTE_CHUNK, &ctx, _permute_range))
+    goto fail;
+
+  /*node labels, metadata and neighbour counts*/
+  lbls = (graph_label_t *)(g->nodelabels.data);
+  for (i = 0; i < nnodes; i++) ((graph_label_t *)tmp)[i] = lbls[perm[i]];
+  memcpy(lbls, tmp, nnodes * sizeof(graph_label_t));
+
+  u32s = (uint32_t *)(g->numneighbours.data);
+  for (i = 0; i < nnodes; i++) ((uint32_t *)tmp)[i] = u32s[perm[i]];
+  memcpy(u32s, tmp, nnodes * sizeof(uint32_t));
+
+  for (s = 0; s < _GRAPH_NODE_LABEL_META; s++) {
+
+    u32s = g->meta[s];
+    if (u32s == NULL) continue;
+
+    for (i = 0; i < nnodes; i++) ((uint32_t *)tmp)[i] = u32s[perm[i]];
+    memcpy(u32s, tmp, nnodes * sizeof(uint32_t));
+  }
+
+  if (graph_is_frozen(g)) {
+
+    memacct_free(MEMACCT_GRAPH, _csr_bytes(g));
+
+    if (_graph_owns(g, g->csroffsets)) bigmem_free(g->csroffsets);
+    if (_graph_owns(g, g->csrnbrs))    bigmem_free(g->csrnbrs);
+    if (_graph_owns(g, g->csrwts))     bigmem_free(g->csrwts);
+
+    if (g->huboffsets != NULL && _graph_owns(g, g->huboffsets))
+      free(g->huboffsets);
+    if (g->hubidx     != NULL && _graph_owns(g, g->hubidx))
+      free(g->hubidx);
+
+    g->huboffsets = NULL;
+    g->hubidx     = NULL;
+    g->csroffsets = ctx.offsets;
+    g->csrnbrs    = ctx.nbrs;
+    g->csrwts     = ctx.wts;
+
+    memacct_alloc(MEMACCT_GRAPH, _csr_bytes(g));
+
+    _build_hubs(g);
+  }
+
+  /*
+   * the spatial index maps coordinates to node IDs, and
+   * has no event listener, so is simply discarded,
+   * as is the label value index
+   */
+  graph_spatial_free(g);
+  graph_labelidx_free(g);
+  graph_event_fire(g, GRAPH_EVENT_EDGES_REBUILT, NULL);
+
+  for (i = 0; i < nthreads; i++) free(ctx.bufs[i]);
+  free(ctx.bufs);
+  free(ctx.inv);
+  free(tmp);
+  return 0;
+
+fail:
+  if (ctx.bufs != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (ctx.bufs[i] != NULL) free(ctx.bufs[i]);
+    }
+    free(ctx.bufs);
+  }
+  if (ctx.inv     != NULL) free(ctx.inv);
+  if (tmp         != NULL) free(tmp);
+  if (lists       != NULL) free(lists);
+  if (ctx.offsets != NULL) bigmem_free(ctx.offsets);
+  if (ctx.nbrs    != NULL) bigmem_free(ctx.nbrs);
+  if (ctx.wts     != NULL) bigmem_free(ctx.wts);
+  return 1;
+}
+
+uint8_t _permute_range(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint32_t       nnbrs;
+  uint32_t      *nbrs;
+  float         *wts;
+  nbr_wt_t      *buf;
+  uint8_t        sorted;
+  permute_ctx_t *ctx;
+
+  ctx = vctx;
+  buf = ctx->bufs[thread];
+
+  for (i = start; i < end; i++) {
+
+    if (ctx->offsets != NULL) {
+
+      nnbrs = ctx->offsets[i + 1] - ctx->offsets[i];
+      nbrs  = ctx->nbrs + ctx->offsets[i];
+      wts   = ctx->wts  + ctx->offsets[i];
+
+      memcpy(nbrs, graph_get_neighbours(ctx->g, ctx->perm[i]),
+             nnbrs * sizeof(uint32_t));
+      memcpy(wts,  graph_get_weights(   ctx->g, ctx->perm[i]),
+             nnbrs * sizeof(float));
+    }
+    else {
+      nnbrs = ctx->g->neighbours[i].size;
+      nbrs  = (uint32_t *)(ctx->g->neighbours[i].data);
+      wts   = (float    *)(ctx->g->weights   [i].data);
+    }
+
+    for (j = 0, sorted = 1; j < nnbrs; j++) {
+
+      nbrs[j] = ctx->inv[nbrs[j]];
+
+      if (j > 0 && nbrs[j] < nbrs[j - 1]) sorted = 0;
+    }
+
+    /*orderings which preserve locality often preserve order*/
+    if (sorted) continue;
+
+    for (j = 0; j < nnbrs; j++) {
+      buf[j].nbr = nbrs[j];
+      buf[j].wt  = wts [j];
+    }
+
+    qsort(buf, nnbrs, sizeof(nbr_wt_t), _compare_nbr_wts);
+
+    for (j = 0; j < nnbrs; j++) {
+      nbrs[j] = buf[j].nbr;
+      wts [j] = buf[j].wt;
+    }
+  }
+
+  return 0;
+}
+
+int _compare_nbr_wts(const void *a, const void *b) {
+
+  const nbr_wt_t *na;
+  const nbr_wt_t *nb;
+
+  na = a;
+  nb = b;
+
+  if (na->nbr < nb->nbr) return -1;
+  if (na->nbr > nb->nbr) return  1;
+  return 0;
+}
+
 uint32_t graph_num_nodes(graph_t *g) {
   return g->numnodes;
 }
@@ -61,9 +617,7 @@ uint32_t *graph_get_labelvals(graph_t *g) {
 
 void graph_get_meta(graph_t *g, uint32_t slot, uint32_t *meta) {
 
-  uint64_t       i;
-  uint32_t       nnodes;
-  graph_label_t *lbl;
+  uint32_t nnodes;
 
   if (slot >= _GRAPH_NODE_LABEL_META) return;
   if (meta == NULL)                   return;
@@ -71,12 +625,63 @@ void graph_get_meta(graph_t *g, uint32_t slot, uint32_t *meta) {
 
   nnodes = graph_num_nodes(g);
 
-  for (i = 0; i < nnodes; i++) {
-    
-    lbl = graph_get_nodelabel(g, i);
+  if (g->meta[slot] == NULL) memset(meta, 0, nnodes * sizeof(uint32_t));
+  else memcpy(meta, g->meta[slot], nnodes * sizeof(uint32_t));
+}
+
+uint32_t graph_get_node_meta(graph_t *g, uint32_t nidx, uint32_t slot) {
+
+  if (slot >= _GRAPH_NODE_LABEL_META) return 0;
+  if (nidx >= g->numnodes)            return 0;
+  if (g->meta[slot] == NULL)          return 0;
+
+  return g->meta[slot][nidx];
+}
+
+uint8_t graph_set_node_meta(
+  graph_t *g, uint32_t nidx, uint32_t slot, uint32_t val) {
+
+  if (slot >= _GRAPH_NODE_LABEL_META) goto fail;
+  if (nidx >= g->numnodes)            goto fail;
+
+  if (g->meta[slot] == NULL) {
 
-    meta[i] = lbl->meta[slot];
+    if (val == 0) return 0;
+
+    g->meta[slot] = calloc(g->numnodes, sizeof(uint32_t));
+    if (g->meta[slot] == NULL) goto fail;
   }
+
+  g->meta[slot][nidx] = val;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_copy_nodelabel(
+  graph_t *gin, uint32_t nin, graph_t *gout, uint32_t nout) {
+
+  uint64_t       i;
+  graph_label_t *lbl;
+
+  lbl = graph_get_nodelabel(gin, nin);
+  if (lbl == NULL) goto fail;
+
+  if (graph_set_nodelabel(gout, nout, lbl)) goto fail;
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++) {
+
+    if (gin->meta[i] == NULL) continue;
+
+    if (graph_set_node_meta(gout, nout, i, gin->meta[i][nin])) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
 }
 
 graph_label_t *graph_get_nodelabel(graph_t *g, uint32_t nidx) {
@@ -87,6 +692,9 @@ graph_label_t *graph_get_nodelabel(graph_t *g, uint32_t nidx) {
 }
 
 uint32_t *graph_get_neighbours(graph_t *g, uint32_t nidx) {
+
+  if (graph_is_frozen(g)) return g->csrnbrs + g->csroffsets[nidx];
+  
   return (uint32_t *)(g->neighbours[nidx].data);
 }
 
@@ -95,12 +703,14 @@ double graph_get_weight(graph_t *g, uint32_t u, uint32_t v) {
   int64_t vidx;
   float   wt;
 
-  if (g->weights == NULL) return 0;
+  if (!graph_is_frozen(g) && g->weights == NULL) return 0;
 
   vidx = graph_get_nbr_idx(g, u, v);
 
   if (vidx < 0) return 0;
 
+  if (graph_is_frozen(g)) return graph_get_weights(g, u)[vidx];
+
   if (array_get(&g->weights[u], vidx, &wt)) return 0;
 
   return wt;
@@ -111,19 +721,21 @@ uint8_t graph_set_weight(graph_t *g, uint32_t u, uint32_t v, float wt) {
   int64_t vidx;
   int64_t uidx;
 
-  if (g->weights == NULL) return 0;
+  if (!graph_is_frozen(g) && g->weights == NULL) return 0;
 
   vidx = graph_get_nbr_idx(g, u, v);
   if (vidx < 0) goto fail;
 
-  array_set(&(g->weights[u]), vidx, &wt);
+  if (graph_is_frozen(g)) graph_get_weights(g, u)[vidx] = wt;
+  else                    array_set(&(g->weights[u]), vidx, &wt);
 
   if (!graph_is_directed(g)) {
 
     uidx = graph_get_nbr_idx(g, v, u);
     if (uidx < 0) goto fail;
 
-    array_set(&(g->weights[v]), uidx, &wt);
+    if (graph_is_frozen(g)) graph_get_weights(g, v)[uidx] = wt;
+    else                    array_set(&(g->weights[v]), uidx, &wt);
   }
 
   return 0;
@@ -134,6 +746,8 @@ fail:
 
 float *graph_get_weights(graph_t *g, uint32_t nidx) {
 
+  if (graph_is_frozen(g)) return g->csrwts + g->csroffsets[nidx];
+
   return (g->weights == NULL) 
            ? NULL
            : (float *)(g->weights[nidx].data);
@@ -150,47 +764,141 @@ uint32_t graph_num_neighbours(graph_t *g, uint32_t nidx) {
 
 uint8_t graph_are_neighbours(graph_t *g, uint32_t u, uint32_t v) {
 
-  uint32_t  unnbrs;
-  uint32_t  vnnbrs;
-  uint32_t *unbrs;
-  uint32_t *vnbrs;
+  graph_bitset_t *bs;
 
-  unnbrs = graph_num_neighbours(g, u);
-  vnnbrs = graph_num_neighbours(g, v);
-  unbrs  = graph_get_neighbours(g, u);
-  vnbrs  = graph_get_neighbours(g, v);
+  /*dense graphs may have a bitset adjacency matrix*/
+  bs = graph_bitset_get(g);
+  if (bs != NULL) return graph_bitset_test(bs, u, v);
 
-  if (bsearch(&v, unbrs, unnbrs, sizeof(uint32_t), compare_u32))
-    return 1;
-  if (graph_is_directed(g) && 
-      bsearch(&u, vnbrs, vnnbrs, sizeof(uint32_t), compare_u32))
-    return 1;
+  /*an edge in either direction counts in a directed graph*/
+  if (graph_is_directed(g))
+    return graph_get_nbr_idx(g, u, v) >= 0 ||
+           graph_get_nbr_idx(g, v, u) >= 0;
 
-  return 0;
+  /*
+   * either neighbour list can be searched in an
+   * undirected graph - the shorter one is used
+   */
+  if (graph_num_neighbours(g, v) < graph_num_neighbours(g, u))
+    return graph_get_nbr_idx(g, v, u) >= 0;
+
+  return graph_get_nbr_idx(g, u, v) >= 0;
 }
 
 int64_t graph_get_nbr_idx(graph_t *g, uint32_t i, uint32_t j) {
 
-  uint32_t *loc;
+  uint64_t  s;
+  uint64_t  size;
+  uint32_t  slot;
+  uint32_t *idx;
   uint32_t *nbrs;
   uint32_t  nnbrs;
 
-  nnbrs = graph_num_neighbours(g, i);
-  nbrs  = graph_get_neighbours(g, i);
+  nbrs = graph_get_neighbours(g, i);
+
+  /*high degree nodes of frozen graphs have a hash index*/
+  if (g->huboffsets != NULL) {
 
-  loc = bsearch(&j, nbrs, nnbrs, sizeof(uint32_t), compare_u32);
+    size = g->huboffsets[i + 1] - g->huboffsets[i];
 
-  if (loc == NULL) return -1;
-  return loc - nbrs;
+    if (size > 0) {
+
+      idx = g->hubidx + g->huboffsets[i];
+
+      for (s = _hub_hash(j, size); ; s = (s + 1) & (size - 1)) {
+
+        slot = idx[s];
+
+        if (slot == 0xFFFFFFFF) return -1;
+        if (nbrs[slot] == j)    return slot;
+      }
+    }
+  }
+
+  nnbrs = graph_num_neighbours(g, i);
+
+  return search_u32(nbrs, nnbrs, j);
 }
 
 uint8_t graph_create(graph_t *g, uint32_t numnodes, uint8_t directed) {
 
-  int64_t i;
+  return _graph_create(g, numnodes, directed, 0, NULL);
+}
+
+uint8_t graph_create_arena(graph_t *g, uint32_t numnodes, uint8_t directed) {
+
+  return _graph_create(g, numnodes, directed, 1, NULL);
+}
+
+uint8_t graph_create_frozen(
+  graph_t  *g,
+  uint32_t  numnodes,
+  uint8_t   directed,
+  uint64_t *offsets,
+  uint32_t *nbrs,
+  float    *wts) {
+
+  uint64_t  i;
+  uint32_t *numnbrs;
+
+  memset(g, 0, sizeof(graph_t));
+
+  g->numnodes   = numnodes;
+  g->flags      = 1 << GRAPH_FLAG_FROZEN;
+  g->csroffsets = offsets;
+  g->csrnbrs    = nbrs;
+  g->csrwts     = wts;
+
+  if (directed) g->flags |= 1 << GRAPH_FLAG_DIRECTED;
+
+  g->numedges = directed ? offsets[numnodes] : offsets[numnodes] / 2;
+
+  memacct_alloc(MEMACCT_GRAPH, _csr_bytes(g));
+
+  if (array_create(&g->nodelabels, sizeof(graph_label_t), numnodes))
+    goto fail;
+
+  if (array_create(&g->numneighbours, sizeof(uint32_t), numnodes))
+    goto fail;
+
+  array_set_acct(&g->nodelabels,    MEMACCT_GRAPH);
+  array_set_acct(&g->numneighbours, MEMACCT_GRAPH);
+
+  numnbrs = (uint32_t *)g->numneighbours.data;
+  for (i = 0; i < numnodes; i++) numnbrs[i] = offsets[i+1] - offsets[i];
+  g->numneighbours.size = numnodes;
+
+  if (array_create(&g->labelvals, sizeof(uint32_t), 60))
+    goto fail;
+  array_set_cmps(&g->labelvals, compare_u32, compare_u32_insert);
+
+  if (array_create(&g->event_listeners, sizeof(graph_event_listener_t), 5))
+    goto fail;
+  array_set_cmps(&g->event_listeners, graph_compare_event_listeners, NULL);
+
+  _build_hubs(g);
+
+  return 0;
+
+fail:
+  graph_free(g);
+  return 1;
+}
+
+uint8_t _graph_create(
+  graph_t  *g,
+  uint32_t  numnodes,
+  uint8_t   directed,
+  uint8_t   arena,
+  uint32_t *capacities) {
+
+  int64_t  i;
+  uint32_t capacity;
 
   memset(g, 0, sizeof(graph_t));
   g->numnodes = numnodes;
   g->flags    = 0;
+  capacity    = arena ? ARENA_LIST_CAPACITY : LIST_CAPACITY;
 
   if (directed) g->flags |= 1 << GRAPH_FLAG_DIRECTED;
 
@@ -200,6 +908,9 @@ uint8_t graph_create(graph_t *g, uint32_t numnodes, uint8_t directed) {
   if (array_create(&g->numneighbours, sizeof(uint32_t), numnodes))
     goto fail;
 
+  array_set_acct(&g->nodelabels,    MEMACCT_GRAPH);
+  array_set_acct(&g->numneighbours, MEMACCT_GRAPH);
+
   if (array_create(&g->labelvals, sizeof(uint32_t), 60))
     goto fail;
   array_set_cmps(&g->labelvals, compare_u32, compare_u32_insert);
@@ -208,6 +919,21 @@ uint8_t graph_create(graph_t *g, uint32_t numnodes, uint8_t directed) {
     goto fail;
   array_set_cmps(&g->event_listeners, graph_compare_event_listeners, NULL);
 
+  if (arena) {
+
+    g->flags |= 1 << GRAPH_FLAG_ARENA;
+
+    g->arena = malloc(sizeof(arena_t));
+    if (g->arena == NULL)           goto fail;
+    if (arena_create(g->arena, 0)) {
+      free(g->arena);
+      g->arena = NULL;
+      goto fail;
+    }
+
+    arena_set_acct(g->arena, MEMACCT_GRAPH);
+  }
+
   g->neighbours = calloc(numnodes, sizeof(array_t));
   if (g->neighbours == NULL) goto fail;
 
@@ -215,8 +941,13 @@ uint8_t graph_create(graph_t *g, uint32_t numnodes, uint8_t directed) {
   if (g->weights == NULL) goto fail;
 
   for (i = 0; i < numnodes; i++) {
-    if (array_create(&(g->neighbours[i]), sizeof(uint32_t), 100)) goto fail;
-    if (array_create(&(g->weights   [i]), sizeof(float),    100)) goto fail;
+
+    if (capacities != NULL) capacity = capacities[i];
+
+    if (_create_list(g, &(g->neighbours[i]), sizeof(uint32_t), capacity))
+      goto fail;
+    if (_create_list(g, &(g->weights   [i]), sizeof(float),    capacity))
+      goto fail;
 
     array_set_cmps(&(g->neighbours[i]), compare_u32, compare_u32_insert);
   }
@@ -227,66 +958,159 @@ fail:
   return 1;
 }
 
+uint8_t _create_list(
+  graph_t *g, array_t *list, uint32_t datasz, uint32_t capacity) {
+
+  if (g->arena != NULL)
+    return array_create_arena(list, datasz, capacity, g->arena);
+
+  if (array_create(list, datasz, capacity)) return 1;
+
+  array_set_acct(list, MEMACCT_GRAPH);
+  return 0;
+}
+
 void graph_free(graph_t *g) {
 
   uint32_t i;
 
   if (g == NULL) return;
 
-  array_free(&g->nodelabels);
-  array_free(&g->numneighbours);
+  if (_graph_owns(g, g->nodelabels.data))    array_free(&g->nodelabels);
+  if (_graph_owns(g, g->numneighbours.data)) array_free(&g->numneighbours);
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++) {
+    if (g->meta[i] != NULL && _graph_owns(g, g->meta[i])) free(g->meta[i]);
+    g->meta[i] = NULL;
+  }
   array_free(&g->labelvals);
  
-  if (g->neighbours != NULL) {
-    for (i = 0; i < g->numnodes; i++) {
+  /*arena-backed lists are all released with the arena*/
+  if (g->arena != NULL) {
+    arena_destroy(g->arena);
+    free(g->arena);
+    g->arena = NULL;
+  }
+
+  else {
+    if (g->neighbours != NULL) {
+      for (i = 0; i < g->numnodes; i++) {
 
-      if (g->neighbours[i].data != NULL) array_free(&(g->neighbours[i]));
+        if (g->neighbours[i].data != NULL) array_free(&(g->neighbours[i]));
+      }
     }
-    free(g->neighbours);
-  }
 
-  if (g->weights != NULL) {
-    for (i = 0; i < g->numnodes; i++) {
-      if (g->weights[i].data != NULL) array_free(&(g->weights[i]));
+    if (g->weights != NULL) {
+      for (i = 0; i < g->numnodes; i++) {
+        if (g->weights[i].data != NULL) array_free(&(g->weights[i]));
+      }
     }
-    free(g->weights);
   }
 
+  if (g->neighbours != NULL) free(g->neighbours);
+  if (g->weights    != NULL) free(g->weights);
+
+  memacct_free(MEMACCT_GRAPH, _csr_bytes(g));
+
+  if (_graph_owns(g, g->csroffsets)) bigmem_free(g->csroffsets);
+  if (_graph_owns(g, g->csrnbrs))    bigmem_free(g->csrnbrs);
+  if (_graph_owns(g, g->csrwts))     bigmem_free(g->csrwts);
+  
+  if (g->huboffsets != NULL && _graph_owns(g, g->huboffsets))
+    free(g->huboffsets);
+  if (g->hubidx     != NULL && _graph_owns(g, g->hubidx))
+    free(g->hubidx);
+
   for (i = 0; i < _GRAPH_CTX_SIZE_; i++) {
 
     if (g->ctx[i] != NULL && g->ctx_free[i] != NULL) 
       g->ctx_free[i](g->ctx[i]);
   }
+
+  if (g->map != NULL) munmap(g->map, g->mapsize);
+  g->map     = NULL;
+  g->mapsize = 0;
+}
+
+uint64_t _csr_bytes(graph_t *g) {
+
+  uint32_t nnodes;
+
+  if (g->csroffsets == NULL)          return 0;
+  if (!_graph_owns(g, g->csroffsets)) return 0;
+
+  nnodes = graph_num_nodes(g);
+
+  return ((uint64_t)nnodes + 1) * sizeof(uint64_t) +
+         g->csroffsets[nnodes]  * (sizeof(uint32_t) + sizeof(float));
+}
+
+uint8_t _graph_owns(graph_t *g, const void *p) {
+
+  const uint8_t *b;
+
+  b = p;
+
+  if (g->map == NULL) return 1;
+
+  return b < g->map || b >= g->map + g->mapsize;
 }
 
 uint8_t graph_copy(graph_t *gin, graph_t *gout) {
 
+  return graph_copy_opts(gin, gout, GRAPH_COPY_LABELS);
+}
+
+uint8_t graph_copy_opts(graph_t *gin, graph_t *gout, uint32_t flags) {
+
   uint64_t  i;
-  uint64_t  j;
   uint32_t  nnodes;
   uint32_t  nnbrs;
-  uint32_t *nbrs;
-  float    *wts;
+  uint32_t *counts;
 
   if (gin  == NULL) goto fail;
   if (gout == NULL) goto fail;
 
   nnodes = graph_num_nodes(gin);
+  counts = (uint32_t *)(gin->numneighbours.data);
 
-  if (graph_create(         gout, nnodes, graph_is_directed(gin))) goto fail;
-  if (graph_copy_nodelabels(gin,  gout))                           goto fail;
+  if (_graph_create(gout, nnodes, graph_is_directed(gin), 1, counts))
+    goto fail;
 
+  if ((flags & GRAPH_COPY_LABELS) && graph_copy_nodelabels(gin, gout))
+    goto fail;
+  if ((flags & GRAPH_COPY_LOG) && graph_log_exists(gin)) {
+    if (graph_log_copy(gin, gout)) goto fail;
+  }
+
+  /*
+   * The neighbour lists of the input graph are already
+   * sorted and de-duplicated, so can be copied directly -
+   * the result is the same as adding every edge via
+   * graph_add_edge.
+   */
   for (i = 0; i < nnodes; i++) {
 
-    nnbrs = graph_num_neighbours(gin, i);
-    nbrs  = graph_get_neighbours(gin, i);
-    wts   = graph_get_weights(   gin, i);
+    nnbrs = counts[i];
 
-    for (j = 0; j < nnbrs; j++) {
-      if (graph_add_edge(gout, i, nbrs[j], wts[j])) goto fail;
-    }
+    memcpy(gout->neighbours[i].data,
+           graph_get_neighbours(gin, i),
+           nnbrs*sizeof(uint32_t));
+    memcpy(gout->weights[i].data,
+           graph_get_weights(gin, i),
+           nnbrs*sizeof(float));
+
+    gout->neighbours[i].size = nnbrs;
+    gout->weights   [i].size = nnbrs;
   }
 
+  if (nnodes > 0) {
+    memcpy(gout->numneighbours.data, counts, nnodes * sizeof(uint32_t));
+    gout->numneighbours.size = nnodes;
+  }
+
+  gout->numedges = graph_num_edges(gin);
+
   return 0;
   
 fail:
@@ -306,6 +1130,7 @@ uint8_t graph_add_edge(
   vidx = 0;
 
   if (g == NULL)                     goto fail;
+  if (graph_is_frozen(g))            goto fail;
   if (u == v)                        goto fail;
   if (u >= g->numnodes)              goto fail;
   if (v >= g->numnodes)              goto fail;
@@ -363,7 +1188,8 @@ uint8_t graph_remove_edge(
   uint32_t           uidx;
   uint32_t           vidx;
 
-  if (g == NULL) goto fail;
+  if (g == NULL)          goto fail;
+  if (graph_is_frozen(g)) goto fail;
 
   nnodes = graph_num_nodes(g);
   uidx   = 0;
@@ -390,6 +1216,154 @@ fail:
   return 1;
 }
 
+uint8_t graph_filter_edges(
+  graph_t *g, graph_edge_filter_t keep, void *ctx) {
+
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  j;
+  uint32_t  k;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+  uint8_t   directed;
+  uint64_t  nedges;
+
+  if (g == NULL)          goto fail;
+  if (graph_is_frozen(g)) goto fail;
+
+  nnodes   = graph_num_nodes(g);
+  directed = graph_is_directed(g);
+  nedges   = 0;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(g, u);
+    nbrs  = graph_get_neighbours(g, u);
+    wts   = graph_get_weights(   g, u);
+
+    /*kept edges are shifted down over the removed ones*/
+    for (j = 0, k = 0; j < nnbrs; j++) {
+
+      v = nbrs[j];
+
+      if (directed || u < v) { if (!keep(ctx, u, v, wts[j])) continue; }
+      else                   { if (!keep(ctx, v, u, wts[j])) continue; }
+
+      if (directed || u < v) nedges++;
+
+      nbrs[k] = v;
+      wts [k] = wts[j];
+      k++;
+    }
+
+    g->neighbours[u].size = k;
+    g->weights   [u].size = k;
+    array_set(&g->numneighbours, u, &k);
+  }
+
+  g->numedges = nedges;
+
+  graph_event_fire(g, GRAPH_EVENT_EDGES_REBUILT, NULL);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_copy_filtered(
+  graph_t *gin, graph_t *gout, graph_edge_filter_t keep, void *ctx) {
+
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  j;
+  uint32_t  k;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t *onbrs;
+  float    *wts;
+  float    *owts;
+  uint32_t *counts;
+  uint8_t   directed;
+  uint64_t  nedges;
+
+  counts = NULL;
+
+  if (gin  == NULL) goto fail;
+  if (gout == NULL) goto fail;
+
+  nnodes   = graph_num_nodes(gin);
+  directed = graph_is_directed(gin);
+  nedges   = 0;
+
+  counts = calloc((uint64_t)nnodes + 1, sizeof(uint32_t));
+  if (counts == NULL) goto fail;
+
+  /*
+   * the edges are visited twice - the first time
+   * to count the edges of each node which are kept,
+   * so that their lists can be allocated to fit
+   */
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(gin, u);
+    nbrs  = graph_get_neighbours(gin, u);
+    wts   = graph_get_weights(   gin, u);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      v = nbrs[j];
+
+      if (directed || u < v) { if (!keep(ctx, u, v, wts[j])) continue; }
+      else                   { if (!keep(ctx, v, u, wts[j])) continue; }
+
+      if (directed || u < v) nedges++;
+
+      counts[u]++;
+    }
+  }
+
+  if (_graph_create(gout, nnodes, directed, 1, counts)) goto fail;
+  if (graph_copy_nodelabels(gin, gout))                 goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(gin, u);
+    nbrs  = graph_get_neighbours(gin, u);
+    wts   = graph_get_weights(   gin, u);
+    onbrs = (uint32_t *)(gout->neighbours[u].data);
+    owts  = (float    *)(gout->weights   [u].data);
+
+    for (j = 0, k = 0; j < nnbrs && k < counts[u]; j++) {
+
+      v = nbrs[j];
+
+      if (directed || u < v) { if (!keep(ctx, u, v, wts[j])) continue; }
+      else                   { if (!keep(ctx, v, u, wts[j])) continue; }
+
+      onbrs[k] = v;
+      owts [k] = wts[j];
+      k++;
+    }
+
+    gout->neighbours[u].size = k;
+    gout->weights   [u].size = k;
+    array_set(&gout->numneighbours, u, &k);
+  }
+
+  gout->numedges = nedges;
+
+  free(counts);
+  return 0;
+
+fail:
+  if (counts != NULL) free(counts);
+  return 1;
+}
+
 uint8_t _graph_remove_edge(
   graph_t *g, uint32_t u, uint32_t v, uint32_t *idx) {
 
@@ -426,29 +1400,131 @@ uint8_t graph_set_nodelabel(graph_t *g, uint32_t nid, graph_label_t *lbl) {
 
   array_set(&g->nodelabels, nid, &newlbl);
 
+  /*the node coordinates and label value may have changed*/
+  graph_spatial_free(g);
+  graph_cmpindex_free(g);
+
   if (array_insert_sorted(&g->labelvals,
                           &(newlbl.labelval),
                           1,
                           NULL) == 2) return 1;
-  
+
+  graph_labelidx_set(g, nid, newlbl.labelval);
+
   return 0;
 }
 
+uint8_t graph_set_labelvals(graph_t *g, uint32_t *labelvals) {
+
+  uint64_t       i;
+  uint32_t       nnodes;
+  uint32_t       prev;
+  graph_label_t *lbls;
+
+  if (g == NULL) goto fail;
+
+  nnodes = g->numnodes;
+  lbls   = (graph_label_t *)g->nodelabels.data;
+
+  if (g->nodelabels.size < nnodes) {
+    memset(lbls + g->nodelabels.size,
+           0,
+           (nnodes - g->nodelabels.size) * sizeof(graph_label_t));
+    g->nodelabels.size = nnodes;
+  }
+
+  for (i = 0; i < nnodes; i++) lbls[i].labelval = labelvals[i];
+
+  /*the label values may have changed*/
+  graph_spatial_free(g);
+  graph_cmpindex_free(g);
+  graph_labelidx_free(g);
+
+  /*
+   * the unique values are appended as runs of equal
+   * values end, and are then sorted in one go
+   */
+  array_clear(&g->labelvals);
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (i > 0 && labelvals[i] == prev) continue;
+
+    prev = labelvals[i];
+
+    if (array_append(&g->labelvals, &prev)) goto fail;
+  }
+
+  if (array_merge_sorted(&g->labelvals, 0, 1)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
 uint8_t graph_copy_nodelabels(graph_t *gin, graph_t *gout) {
 
   uint64_t       i;
-  graph_label_t *lbl;
+  uint64_t       j;
+  uint32_t       nnodes;
+  graph_label_t *lbls;
+  uint32_t       prev;
 
   if (gin           == NULL)           goto fail;
   if (gout          == NULL)           goto fail;
   if (gin->numnodes != gout->numnodes) goto fail;
 
-  for (i = 0; i < gin->numnodes; i++) {
+  nnodes = gin->numnodes;
+  lbls   = (graph_label_t *)gin->nodelabels.data;
+  prev   = 0;
+
+  /*
+   * The labels and metadata are copied in bulk - the
+   * result is the same as copying every node with
+   * graph_copy_nodelabel.
+   */
+  if (nnodes > 0) {
+    memcpy(gout->nodelabels.data, lbls, nnodes * sizeof(graph_label_t));
+    gout->nodelabels.size = nnodes;
+  }
+
+  graph_spatial_free(gout);
+  graph_cmpindex_free(gout);
+  graph_labelidx_free(gout);
+
+  /*
+   * nodes with the same label value tend to be adjacent, so
+   * the label value set is only searched when the value
+   * changes
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    if (i > 0 && lbls[i].labelval == prev) continue;
+
+    prev = lbls[i].labelval;
+
+    if (array_insert_sorted(&gout->labelvals, &prev, 1, NULL) == 2)
+      goto fail;
+  }
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++) {
+
+    if (gin->meta[i] == NULL) continue;
+
+    if (gout->meta[i] == NULL) {
 
-    lbl = graph_get_nodelabel(gin, i);
-    if (lbl == NULL) goto fail;
+      /* slots which are never set are not allocated */
+      for (j = 0; j < nnodes; j++) {
+        if (gin->meta[i][j] != 0) break;
+      }
+      if (j == nnodes) continue;
 
-    if (graph_set_nodelabel(gout, i, lbl)) goto fail;
+      gout->meta[i] = malloc(nnodes * sizeof(uint32_t));
+      if (gout->meta[i] == NULL) goto fail;
+    }
+
+    memcpy(gout->meta[i], gin->meta[i], nnodes * sizeof(uint32_t));
   }
 
   return 0;
@@ -456,3 +1532,82 @@ uint8_t graph_copy_nodelabels(graph_t *gin, graph_t *gout) {
 fail:
   return 1;
 }
+
+uint8_t _build_hubs(graph_t *g) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  s;
+  uint64_t  size;
+  uint64_t  total;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t *idx;
+  uint64_t *offsets;
+
+  offsets = NULL;
+  idx     = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  for (i = 0; i < nnodes; i++) {
+    if (graph_num_neighbours(g, i) >= GRAPH_HUB_DEGREE) break;
+  }
+
+  if (i == nnodes) return 0;
+
+  offsets = malloc(((uint64_t)nnodes + 1) * sizeof(uint64_t));
+  if (offsets == NULL) goto fail;
+
+  /*each index is at most half full*/
+  for (i = 0, total = 0; i < nnodes; i++) {
+
+    nnbrs      = graph_num_neighbours(g, i);
+    offsets[i] = total;
+
+    if (nnbrs < GRAPH_HUB_DEGREE) continue;
+
+    for (size = 1; size < 2 * (uint64_t)nnbrs; size *= 2);
+    total += size;
+  }
+  offsets[nnodes] = total;
+
+  idx = malloc(total * sizeof(uint32_t));
+  if (idx == NULL) goto fail;
+
+  memset(idx, 0xFF, total * sizeof(uint32_t));
+
+  for (i = 0; i < nnodes; i++) {
+
+    size = offsets[i + 1] - offsets[i];
+    if (size == 0) continue;
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      s = _hub_hash(nbrs[j], size);
+
+      while (idx[offsets[i] + s] != 0xFFFFFFFF) s = (s + 1) & (size - 1);
+
+      idx[offsets[i] + s] = j;
+    }
+  }
+
+  g->huboffsets = offsets;
+  g->hubidx     = idx;
+
+  return 0;
+
+fail:
+  if (offsets != NULL) free(offsets);
+  if (idx     != NULL) free(idx);
+  return 1;
+}
+
+uint64_t _hub_hash(uint32_t v, uint64_t size) {
+
+  /*Fibonacci hashing - the top bits of the product are used*/
+  return ((uint32_t)(v * 2654435769u)) >> (32 - __builtin_ctzll(size));
+}
@@ -9,21 +9,36 @@
 #include <stdint.h>
 
 #include "io/analyze75.h"
+#include "util/arena.h"
 #include "util/array.h"
 #include "util/stack.h"
 
-#define _GRAPH_CTX_SIZE_             5
+#define _GRAPH_CTX_SIZE_             7
 #define _GRAPH_STATS_CACHE_CTX_LOC_  1
 #define _GRAPH_LOG_CTX_LOC_          2
+#define _GRAPH_SPATIAL_CTX_LOC_      3
+#define _GRAPH_CMPINDEX_CTX_LOC_     4
+#define _GRAPH_BITSET_CTX_LOC_       5
+#define _GRAPH_LABELIDX_CTX_LOC_     6
 
 #define _GRAPH_NODE_LABEL_META      16
 
+/**
+ * When a graph is frozen, nodes with at least this many neighbours are
+ * given a hash index of their neighbour list (see graph_get_nbr_idx).
+ */
+#define GRAPH_HUB_DEGREE           256
+
 /**
  * Graph flag bit locations.
  */
 typedef enum _graph_flags {
 
-  GRAPH_FLAG_DIRECTED = 0
+  GRAPH_FLAG_DIRECTED = 0,
+  GRAPH_FLAG_FROZEN   = 1, /**< adjacency is stored in CSR form,
+                                see graph_freeze */
+  GRAPH_FLAG_ARENA    = 2  /**< adjacency lists are allocated from
+                                an arena, see graph_create_arena */
 
 } graph_flags_t;
 
@@ -33,11 +48,45 @@ typedef struct _graph {
   uint32_t        numedges;      /**< number of edges in the graph       */
   array_t         numneighbours; /**< number of neighbours for each node */
   array_t         nodelabels;    /**< node labels                        */
+  uint32_t       *meta[_GRAPH_NODE_LABEL_META]; /**< node metadata, one
+                                                     array per slot, or
+                                                     NULL for slots which
+                                                     have not been set   */
   array_t         labelvals;     /**< all unique node label values       */
   array_t        *neighbours;    /**< neighbours for each node           */
   array_t        *weights;       /**< weights for each edge              */
   uint16_t        flags;         /**< graph flags                        */
 
+  /*
+   * Compressed sparse row adjacency, used instead of the neighbours
+   * and weights arrays when the graph is frozen (see graph_freeze).
+   * The neighbours of node i are stored at csrnbrs[csroffsets[i]]
+   * to csrnbrs[csroffsets[i+1]-1].
+   */
+  uint64_t       *csroffsets;    /**< start of each node's neighbours    */
+  uint32_t       *csrnbrs;       /**< all neighbours, node by node       */
+  float          *csrwts;        /**< all weights, node by node          */
+
+  /*
+   * Hash indices of the neighbour lists of high degree nodes of a frozen
+   * graph. The index for node i is stored at hubidx[huboffsets[i]] to
+   * hubidx[huboffsets[i+1]-1] - its size is a power of two, or zero for
+   * nodes with fewer than GRAPH_HUB_DEGREE neighbours. Each slot contains
+   * the position of a neighbour in the neighbour list, or 0xFFFFFFFF.
+   * huboffsets is NULL if no node has an index.
+   */
+  uint64_t       *huboffsets;    /**< start of each node's hash index    */
+  uint32_t       *hubidx;        /**< all hash indices, node by node     */
+
+  arena_t        *arena;         /**< arena from which the neighbours and
+                                      weights lists are allocated, or NULL
+                                      (see graph_create_arena)           */
+
+  uint8_t        *map;           /**< file mapping which the node labels,
+                                      metadata and CSR adjacency point
+                                      into, or NULL (see graph_image.h)  */
+  uint64_t        mapsize;       /**< size of the file mapping           */
+
   array_t         event_listeners; /**< array of registered event listeners */
 
   /*
@@ -53,7 +102,9 @@ typedef struct _graph {
 
 /**
  * Struct representing a label attached to nodes in a graph. I will make this
- * more generic when I really have to.
+ * more generic when I really have to. Extra node metadata is not stored in
+ * the label, but separately, one slot at a time (see graph_get_meta), so
+ * that scans over label values and coordinates stay compact.
  */
 typedef struct _graph_label {
 
@@ -62,9 +113,6 @@ typedef struct _graph_label {
   float    yval;     /**< y-coordinate */
   float    zval;     /**< z-coordinate */
 
-  uint32_t meta[_GRAPH_NODE_LABEL_META]; /**< Space for storage of
-                                                extra node metadata  */
-
 } graph_label_t;
 
 /**
@@ -112,6 +160,63 @@ uint8_t graph_is_directed(
   graph_t *g /**< graph to query */
 );
 
+/**
+ * \return non-0 if the graph is frozen (see graph_freeze), 0 otherwise.
+ */
+uint8_t graph_is_frozen(
+  graph_t *g /**< graph to query */
+);
+
+/**
+ * Converts the adjacency lists of the given graph into a single compressed
+ * sparse row (CSR) structure - all neighbours and weights are stored
+ * contiguously, node by node, in two arrays. This is much more cache
+ * friendly than the per-node lists for algorithms which repeatedly walk
+ * the graph (e.g. BFS-based measures), and uses less memory.
+ *
+ * All of the graph query functions work as normal on a frozen graph, as
+ * does graph_set_weight, but edges cannot be added or removed until the
+ * graph has been thawed with graph_thaw. Freezing a frozen graph has no
+ * effect.
+ *
+ * \return 0 on success, non-0 on failure. The graph is unchanged on
+ * failure.
+ */
+uint8_t graph_freeze(
+  graph_t *g /**< the graph to freeze */
+);
+
+/**
+ * Converts a frozen graph back into its normal, modifiable form. Thawing a
+ * graph which is not frozen has no effect.
+ *
+ * \return 0 on success, non-0 on failure. The graph is unchanged on
+ * failure.
+ */
+uint8_t graph_thaw(
+  graph_t *g /**< the graph to thaw */
+);
+
+/**
+ * Renumbers the nodes of the given graph in place, according to the given
+ * permutation - on return, node i is the node which was perm[i], with the
+ * same label, metadata, and edges. This gives the same result as
+ * graph_reorder (see graph/graph_reorder.h), without a second graph - the
+ * neighbour lists are moved to their new nodes (or, for a frozen graph,
+ * gathered into new CSR arrays, which replace the old ones), and the
+ * neighbours of each list are renumbered and re-sorted, in parallel.
+ *
+ * A GRAPH_EVENT_EDGES_REBUILT event is fired, and the spatial index (see
+ * graph_spatial.h), if there is one, is discarded.
+ *
+ * \return 0 on success, non-0 on failure. The graph is unchanged on
+ * failure (including if perm is not a permutation of the node IDs).
+ */
+uint8_t graph_permute(
+  graph_t  *g,   /**< the graph                          */
+  uint32_t *perm /**< permutation, e.g. from graph_order */
+);
+
 /**
  * \return the number of nodes in the graph,
  */
@@ -142,7 +247,7 @@ uint32_t *graph_get_labelvals(
 
 /**
  * Retrieves the metadata in the specified slot, and copies it to the given
- * meta array.
+ * meta array. The metadata of a slot which has not been set is 0.
  */
 void graph_get_meta(
   graph_t  *g,    /**< the graph                                 */
@@ -150,6 +255,42 @@ void graph_get_meta(
   uint32_t *meta  /**< place to store metadata                   */
 );
 
+/**
+ * \return the metadata of the given node in the given slot, or 0 if the
+ * slot has not been set.
+ */
+uint32_t graph_get_node_meta(
+  graph_t *g,    /**< the graph                                 */
+  uint32_t nidx, /**< the node                                  */
+  uint32_t slot  /**< meta slot (0 to _GRAPH_NODE_LABEL_META-1) */
+);
+
+/**
+ * Sets the metadata of the given node in the given slot. Space for the
+ * slot is allocated, for every node, the first time that a non-0 value
+ * is stored in it.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_set_node_meta(
+  graph_t *g,    /**< the graph                                 */
+  uint32_t nidx, /**< the node                                  */
+  uint32_t slot, /**< meta slot (0 to _GRAPH_NODE_LABEL_META-1) */
+  uint32_t val   /**< the metadata                              */
+);
+
+/**
+ * Copies the label and metadata of node nin in gin to node nout in gout.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_copy_nodelabel(
+  graph_t *gin,  /**< source graph      */
+  uint32_t nin,  /**< source node       */
+  graph_t *gout, /**< destination graph */
+  uint32_t nout  /**< destination node  */
+);
+
 /**
  * \return a pointer to the label for the given node, NULL if this graph has
  * no labels.
@@ -225,8 +366,9 @@ uint8_t graph_are_neighbours(
  * \return the length of the shortest path from u
  * to v, 0 if there is no path from u to v. If the
  * path parameter is not NULL, the nodes contained
- * in the path from u to v are stored in the path
- * parameter.
+ * in the path from u to v (including u and v) are
+ * stored, in order, in the path parameter, which
+ * must be an array of uint32_t values.
  */
 uint32_t graph_pathlength(
   graph_t *g,   /**< the graph to query                              */
@@ -235,6 +377,24 @@ uint32_t graph_pathlength(
   array_t *path /**< if not NULL, intermediate nodes are stored here */
 );
 
+/**
+ * Calculates the shortest path length between each of the given pairs of
+ * nodes, as for graph_pathlength. Search buffers are allocated once per
+ * thread, and are re-used for every pair, so this is much faster than
+ * calling graph_pathlength repeatedly.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_pathlengths(
+  graph_t  *g,       /**< the graph to query                            */
+  uint32_t  npairs,  /**< number of node pairs                          */
+  uint32_t *pairs,   /**< 2*npairs node IDs - the (u, v) pairs          */
+  uint32_t *lengths, /**< space to store npairs path lengths (0 if
+                          there is no path)                             */
+  uint16_t  nthreads /**< number of threads (0 for default, see
+                          util/parallel.h)                              */
+);
+
 /**
  * Populates the given array with the IDs of the nodes in the given
  * component.
@@ -248,21 +408,54 @@ uint8_t graph_get_component(
 );
 
 /**
- * Populates the given stack with arrays (pointers to array_t
- * structs) of node indices; the top array contains the indices
- * of the nodes which are the furthest from the source node,
- * and the bottom array contains those nodes which are closest
- * to the source node.
+ * The nodes at each distance from a source node, as found by
+ * graph_levels. The nodes are stored in a single array, in the order in
+ * which they were visited; the nodes at distance d from the source are
+ * order[offsets[d]] to order[offsets[d+1]-1], so level 0 contains just
+ * the source node. A level structure may be reused for any number of
+ * searches.
+ */
+typedef struct _graph_levels {
+
+  uint32_t  capacity; /**< number of nodes there is space for        */
+  uint32_t  nlevels;  /**< number of levels                          */
+  uint32_t *order;    /**< nodes, level by level                     */
+  uint32_t *offsets;  /**< start of each level in the order array
+                           (nlevels+1 entries)                       */
+
+} graph_levels_t;
+
+/**
+ * Initialises a level structure with space for the given number of
+ * nodes (it is grown if necessary by graph_levels).
  *
- * The caller is responsible for freeing the stack elements,
- * and the stack itself.
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_levels_init(
+  graph_levels_t *levels,  /**< the level structure */
+  uint32_t        numnodes /**< number of nodes     */
+);
+
+/**
+ * Frees the memory used by the given level structure.
+ */
+void graph_levels_free(
+  graph_levels_t *levels /**< the level structure */
+);
+
+/**
+ * Performs a breadth first search from node u, and stores the nodes at
+ * each distance from u in the given level structure, replacing its
+ * previous contents. Nodes which are furthest from u are in the last
+ * level, so the levels may be processed in order of decreasing distance
+ * by scanning the order array backwards.
  *
  * \return 0 on success, non-0 on failure.
  */
-uint8_t graph_level_stack(
-  graph_t  *g,    /**< the graph                           */
-  uint32_t  u,    /**< source node                         */
-  cstack_t *stack /**< uninitialised stack to be populated */
+uint8_t graph_levels(
+  graph_t        *g,     /**< the graph                      */
+  uint32_t        u,     /**< source node                    */
+  graph_levels_t *levels /**< initialised level structure    */
 );
 
 /**
@@ -289,6 +482,48 @@ uint8_t graph_create(
   uint8_t   directed  /**< directed or undirected             */
 );
 
+/**
+ * Initialise the given graph_t struct for the given number of nodes, with
+ * the neighbour and weight lists of every node allocated from a single
+ * arena (see util/arena.h), rather than individually with malloc. The
+ * adjacency of the graph then lives in a few large blocks, lists which
+ * shrink and grow as edges are removed and added re-use each other's
+ * space, rather than fragmenting the heap, and graph_free releases all of
+ * the lists at once. This suits graphs which are heavily edited.
+ *
+ * Apart from memory use, an arena-backed graph behaves identically to one
+ * created by graph_create. If it is frozen and thawed, it remains
+ * arena-backed.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_create_arena(
+  graph_t  *g,        /**< pointer to an empty graph_t struct */
+  uint32_t  numnodes, /**< number of nodes                    */
+  uint8_t   directed  /**< directed or undirected             */
+);
+
+/**
+ * Initialises the given graph_t struct as a frozen graph (see
+ * graph_freeze), from the given CSR arrays, which must have been allocated
+ * with bigmem_alloc (see util/bigmem.h). The graph takes ownership of the
+ * arrays, which are freed by graph_free, or on failure. The neighbours of
+ * every node must be in ascending order, and for undirected graphs, every
+ * edge must be stored in the lists of both of its end points. Every node
+ * is given a zero label.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_create_frozen(
+  graph_t  *g,        /**< pointer to an empty graph_t struct      */
+  uint32_t  numnodes, /**< number of nodes                         */
+  uint8_t   directed, /**< directed or undirected                  */
+  uint64_t *offsets,  /**< start of each node's neighbours, with
+                           offsets[numnodes] the total             */
+  uint32_t *nbrs,     /**< all neighbours, node by node            */
+  float    *wts       /**< all weights, node by node               */
+);
+
 /**
  * Frees the memory used by the given graph. Does not attempt to free the
  * graph_t struct itself.
@@ -299,7 +534,10 @@ void graph_free(
 
 /**
  * Creates a complete copy of the input graph; the gout pointer is
- * initialised, and updated so that it points to the copy.
+ * initialised, and updated so that it points to the copy. The copy is
+ * arena-backed (see graph_create_arena), as copies are typically made in
+ * order to be edited. Event listeners and context (e.g. a stats cache) are
+ * not copied.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -308,9 +546,38 @@ uint8_t graph_copy(
   graph_t *gout /**< pointer to uninitialised graph */
 );
 
+/**
+ * Flags for graph_copy_opts, which select what is copied along with the
+ * edges.
+ */
+typedef enum _graph_copy_flags {
+
+  GRAPH_COPY_LABELS = 1, /**< node labels and metadata              */
+  GRAPH_COPY_LOG    = 2  /**< the log (see graph_log.h), which is
+                              shared with the copy, not duplicated  */
+
+} graph_copy_flags_t;
+
+/**
+ * Creates a copy of the input graph, in the same way as graph_copy, but
+ * only copies the node labels and context which are selected by the given
+ * flags (graph_copy is equivalent to passing GRAPH_COPY_LABELS). Callers
+ * which repeatedly take snapshots of a graph whose labels are already
+ * known can pass 0, in which case every node of the copy has an empty
+ * label.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_copy_opts(
+  graph_t *gin,  /**< graph to copy                         */
+  graph_t *gout, /**< pointer to uninitialised graph        */
+  uint32_t flags /**< bitwise OR of graph_copy_flags_t values */
+);
+
 /**
  * Add an edge to the given graph. If the graph is undirected,
  * two edges are added - one from u to v, and one from v to u.
+ * Fails if the graph is frozen.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -322,7 +589,7 @@ uint8_t graph_add_edge(
 );
 
 /**
- * Remove an edge from the given graph. 
+ * Remove an edge from the given graph. Fails if the graph is frozen.
  *
  * \return 0 on success, non-0 on failure, or if the edge does not exist.
  */
@@ -332,6 +599,53 @@ uint8_t graph_remove_edge(
   uint32_t v  /**< edge end point        */
 );
 
+/**
+ * Function which decides whether an edge is kept by graph_filter_edges.
+ *
+ * \return non-0 if the edge is to be kept, 0 if it is to be removed.
+ */
+typedef uint8_t (*graph_edge_filter_t)(
+  void    *ctx, /**< context pointer passed to graph_filter_edges */
+  uint32_t u,   /**< edge start point                            */
+  uint32_t v,   /**< edge end point                              */
+  float    wt   /**< edge weight                                 */
+);
+
+/**
+ * Removes every edge for which the given function returns 0. Every
+ * neighbour list is compacted in place, in one pass, so this is much
+ * faster than removing edges one at a time with graph_remove_edge. Rather
+ * than an event for every removed edge, one GRAPH_EVENT_EDGES_REBUILT
+ * event is fired. Fails if the graph is frozen.
+ *
+ * The function is called once for each direction of an undirected edge,
+ * both times with the lower end point as u, so must be deterministic.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_filter_edges(
+  graph_t            *g,    /**< the graph                   */
+  graph_edge_filter_t keep, /**< decides which edges to keep */
+  void               *ctx   /**< passed to keep              */
+);
+
+/**
+ * Creates a copy of the input graph which only contains the edges for
+ * which the given function returns non-0, in the same way as graph_copy
+ * followed by graph_filter_edges. The neighbour lists of the copy are
+ * allocated to fit the edges which are kept, and the edges which are not
+ * kept are never copied, so this is faster than filtering a full copy when
+ * many edges are removed.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_copy_filtered(
+  graph_t            *gin,  /**< graph to copy                  */
+  graph_t            *gout, /**< pointer to uninitialised graph */
+  graph_edge_filter_t keep, /**< decides which edges to keep    */
+  void               *ctx   /**< passed to keep                 */
+);
+
 /**
  * Sets the label for the given graph. The given label is copied into the
  * graph struct.
@@ -345,8 +659,22 @@ uint8_t graph_set_nodelabel(
 );
 
 /**
- * Copies node labels from gin to gout. The graphs must have the same number
- * of nodes.
+ * Sets the label value of every node, in one pass, without changing the
+ * node coordinates (nodes which have no label are given coordinates of
+ * 0), and rebuilds the set of unique label values once. This is much
+ * faster than calling graph_set_nodelabel for every node, and, unlike
+ * graph_set_nodelabel, does not retain stale label values.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_set_labelvals(
+  graph_t  *g,        /**< the graph                     */
+  uint32_t *labelvals /**< new label value for every node */
+);
+
+/**
+ * Copies node labels, and metadata, from gin to gout. The graphs must have
+ * the same number of nodes.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -359,7 +687,7 @@ uint8_t graph_copy_nodelabels(
 /**
  * Generates an Erdos-Renyi random graph with the given number of nodes and
  * given density. All possible edges in the graph are included with the
- * probability specified by the 'density' parameter.
+ * probability specified by the 'density' parameter. Takes O(V+E) time.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -370,15 +698,47 @@ uint8_t graph_create_er_random(
 );
 
 /**
- * Generates a scale free random graph. Assumes that the random number
- * generator has been seeded. Edge weights are set to random values between -1
- * and 1.
+ * Generates an Erdos-Renyi random graph with exactly the given number of
+ * nodes and edges, chosen uniformly at random from all possible node pairs.
+ * Takes O(V + E log E) time.
+ *
+ * \return 0 on success, non-0 on failure (including if there are more
+ * edges than node pairs).
+ */
+uint8_t graph_create_er_random_edges(
+  graph_t *g,      /**< pointer to an uninitialised graph */
+  uint32_t nnodes, /**< number of nodes                   */
+  uint64_t nedges  /**< number of edges                   */
+);
+
+/**
+ * Generates a scale free random graph by preferential attachment, in O(E)
+ * time. Assumes that the random number generator has been seeded. Edge
+ * weights are set to random values between -1 and 1.
+ *
+ * \return 0 on success, non-0 on failure.
  */
 uint8_t graph_create_scalefree(
   graph_t *g,      /**< pointer to an uninitialised graph        */
   uint32_t nnodes, /**< number of nodes                          */
-  uint16_t m,      /**< number of fully connected nodes to start */
-  uint16_t m0      /**< number of connections new nodes make     */
+  uint16_t m,      /**< number of connections new nodes make     */
+  uint16_t m0      /**< number of fully connected nodes to start */
+);
+
+/**
+ * Generates a random graph with the given degree sequence, using the
+ * configuration model - every node is given one stub per unit of degree,
+ * and stubs are paired at random. Self loops and duplicate edges are
+ * discarded, so some nodes may end up with a slightly lower degree than
+ * requested. Edge weights are set to random values between -1 and 1.
+ *
+ * \return 0 on success, non-0 on failure (including if the sum of the
+ * degrees is odd).
+ */
+uint8_t graph_create_configuration(
+  graph_t  *g,      /**< pointer to an uninitialised graph */
+  uint32_t  nnodes, /**< number of nodes                   */
+  uint32_t *degrees /**< desired degree of each node       */
 );
 
 /**
@@ -409,7 +769,11 @@ uint8_t graph_are_connected(
 
 /**
  * Modifies the given graph, to ensure that a path exists between all of the
- * nodes in the given group.
+ * nodes in the given group. Edges are added between randomly chosen pairs
+ * of group members which are not yet connected (via the edges between
+ * group members), until the group is connected. Connectivity is tracked
+ * with a disjoint set forest, so this takes close to linear time in the
+ * group size and the number of edges of its members.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -438,7 +802,11 @@ uint8_t graph_connect_from(
  * uniformly distributed over the range ((1-sizerange)*(nnodes/nclusters),
  * (1+sizerange)*(nnodes/nclusters)). Edges within clusters are included
  * with probability 'internal'. Edges between clusters are included with
- * probability 'external'.
+ * probability 'external'. Edges are drawn by geometric skipping over the
+ * candidate node pairs (see graph_create_er_random), so generation takes
+ * O(V+E) time; clusters are generated in parallel, each with its own
+ * generator (seeded from the default generator), so the result does not
+ * depend upon the number of threads.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -513,6 +881,20 @@ uint8_t graph_relabel(
   uint8_t  real /**< node coordinates are in real units */
 );
 
+/**
+ * Sets the label value of a single node label to the value of the voxel,
+ * in the given ANALYZE75 image, at the node coordinates.
+ *
+ * \return 0 on success, non-0 on failure (e.g. if the coordinates lie
+ * outside of the image).
+ */
+uint8_t graph_relabel_label(
+  graph_label_t *lbl, /**< the label to update                 */
+  dsr_t         *hdr, /**< image header                        */
+  uint8_t       *img, /**< image data                          */
+  uint8_t        real /**< node coordinates are in real units  */
+);
+
 /**
  * Relabels the nodes of a graph using the label mapping contained in the
  * given file. The label map file must be a plain text file, where each line
@@ -533,4 +915,20 @@ uint8_t graph_group_by_label(
   node_partition_t *ptn
 );
 
+/**
+ * The inverse of graph_group_by_label - sets the label value of every node
+ * in each partition to the partition identifier (see node_partition_t), or
+ * to the partition index + 1 if the partition has no identifiers (e.g. if
+ * it was loaded with lol_load or infomap_load). Nodes which are not in any
+ * partition keep their label values. All of the labels are set with one
+ * call to graph_set_labelvals.
+ *
+ * \return 0 on success, non-0 on failure (e.g. if the partition contains
+ * a node ID which is not in the graph).
+ */
+uint8_t graph_label_by_partition(
+  graph_t          *g,  /**< the graph     */
+  node_partition_t *ptn /**< the partition */
+);
+
 #endif /* __GRAPH_H__ */
@@ -0,0 +1,520 @@
+/**
+ * Single-pass aggregation of the edges of a graph between groups of nodes.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_aggregate.h"
+#include "util/compare.h"
+#include "util/parallel.h"
+
+/**
+ * Maximum total number of entries in the per-thread count matrices. If
+ * there are too many groups (or threads) for dense matrices, group pairs
+ * are accumulated in lists instead.
+ */
+#define DENSE_MAX_ENTRIES (1 << 24)
+
+/**
+ * Number of nodes in each chunk of work handed to a thread.
+ */
+#define NODE_CHUNK 1024
+
+/**
+ * A group pair, and the number of edges between the groups.
+ */
+typedef struct _pair_count {
+
+  uint64_t key;   /**< (i << 32) | j */
+  uint64_t count; /**< number of edges */
+
+} pair_count_t;
+
+/**
+ * State shared by the threads counting edges.
+ */
+typedef struct _agg_ctx {
+
+  graph_t       *g;        /**< the graph                              */
+  uint32_t      *groups;   /**< group of every node                    */
+  uint32_t       ngroups;  /**< number of groups                       */
+  uint8_t        directed; /**< non-0 if the graph is directed         */
+  uint32_t     **matrices; /**< one ngroups*ngroups count matrix per
+                                thread, or NULL if pairs are listed    */
+  uint64_t     **keys;     /**< one list of group pair keys per thread */
+  uint64_t      *nkeys;    /**< number of keys in each list            */
+  uint64_t      *capkeys;  /**< capacity of each list                  */
+  pair_count_t **merged;   /**< sorted, merged, pair counts for each
+                                thread                                 */
+  uint64_t      *nmerged;  /**< number of pair counts for each thread  */
+
+} agg_ctx_t;
+
+/**
+ * parallel_for function - counts the edges leaving the nodes in the
+ * range [start, end).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _count_chunk(
+  uint64_t start,  /**< first node            */
+  uint64_t end,    /**< one past last node    */
+  uint16_t thread, /**< calling thread        */
+  void    *ctx     /**< pointer to agg_ctx_t  */
+);
+
+/**
+ * parallel_for function - sorts the key lists in the range [start, end),
+ * and merges the duplicate keys in each, into pair counts.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _merge_keys(
+  uint64_t start,  /**< first list            */
+  uint64_t end,    /**< one past last list    */
+  uint16_t thread, /**< calling thread        */
+  void    *ctx     /**< pointer to agg_ctx_t  */
+);
+
+/**
+ * Sums the per-thread count matrices, and stores the non-0 counts in the
+ * given aggregate.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _reduce_matrices(
+  agg_ctx_t         *ctx,      /**< counting state        */
+  uint16_t           nthreads, /**< number of matrices    */
+  graph_aggregate_t *agg       /**< aggregate to populate */
+);
+
+/**
+ * Combines the per-thread pair counts, and stores them in the given
+ * aggregate.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _reduce_lists(
+  agg_ctx_t         *ctx,      /**< counting state        */
+  uint16_t           nthreads, /**< number of lists       */
+  graph_aggregate_t *agg       /**< aggregate to populate */
+);
+
+/**
+ * Frees the per-thread state in the given context.
+ */
+static void _free_ctx(
+  agg_ctx_t *ctx,     /**< counting state    */
+  uint16_t   nthreads /**< number of threads */
+);
+
+/**
+ * Compares two pair_count_t structs by key.
+ */
+static int _compare_pair_counts(const void *a, const void *b);
+
+uint8_t graph_aggregate_labels(
+  graph_t *g, uint32_t *groups, uint32_t **labels, uint32_t *ngroups) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint32_t       nnodes;
+  uint32_t       nlbls;
+  uint32_t      *lbls;
+  uint32_t      *lblp;
+  graph_label_t *lbl;
+
+  lbls   = NULL;
+  nnodes = graph_num_nodes(g);
+
+  lbls = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  if (lbls == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+    if (lbl == NULL) goto fail;
+
+    lbls[i] = lbl->labelval;
+  }
+
+  /*sort, and remove duplicates*/
+  qsort(lbls, nnodes, sizeof(uint32_t), compare_u32);
+
+  for (i = 0, j = 0; i < nnodes; i++) {
+    if (j > 0 && lbls[j-1] == lbls[i]) continue;
+    lbls[j++] = lbls[i];
+  }
+  nlbls = j;
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl  = graph_get_nodelabel(g, i);
+    lblp = bsearch(
+      &(lbl->labelval), lbls, nlbls, sizeof(uint32_t), compare_u32);
+
+    groups[i] = lblp - lbls;
+  }
+
+  *labels  = lbls;
+  *ngroups = nlbls;
+  return 0;
+
+fail:
+  if (lbls != NULL) free(lbls);
+  return 1;
+}
+
+uint8_t graph_aggregate(
+  graph_aggregate_t *agg,
+  graph_t           *g,
+  uint32_t          *groups,
+  uint32_t           ngroups,
+  uint16_t           nthreads) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint64_t  nentries;
+  agg_ctx_t ctx;
+
+  memset(agg,  0, sizeof(graph_aggregate_t));
+  memset(&ctx, 0, sizeof(agg_ctx_t));
+
+  if (nthreads == 0) nthreads = parallel_num_threads();
+
+  nnodes       = graph_num_nodes(g);
+  nentries     = (uint64_t)ngroups * ngroups;
+  agg->ngroups = ngroups;
+  ctx.g        = g;
+  ctx.groups   = groups;
+  ctx.ngroups  = ngroups;
+  ctx.directed = graph_is_directed(g);
+
+  agg->sizes  = calloc((ngroups > 0 ? ngroups : 1), sizeof(uint32_t));
+  agg->within = calloc((ngroups > 0 ? ngroups : 1), sizeof(uint32_t));
+  if (agg->sizes  == NULL) goto fail;
+  if (agg->within == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    if (groups[i] == GRAPH_AGGREGATE_NONE) continue;
+    if (groups[i] >= ngroups)              goto fail;
+    agg->sizes[groups[i]]++;
+  }
+
+  if (nentries * nthreads <= DENSE_MAX_ENTRIES) {
+
+    ctx.matrices = calloc(nthreads, sizeof(uint32_t *));
+    if (ctx.matrices == NULL) goto fail;
+
+    for (i = 0; i < nthreads; i++) {
+      ctx.matrices[i] = calloc((nentries > 0 ? nentries : 1),
+                               sizeof(uint32_t));
+      if (ctx.matrices[i] == NULL) goto fail;
+    }
+  }
+  else {
+
+    ctx.keys    = calloc(nthreads, sizeof(uint64_t *));
+    ctx.nkeys   = calloc(nthreads, sizeof(uint64_t));
+    ctx.capkeys = calloc(nthreads, sizeof(uint64_t));
+    ctx.merged  = calloc(nthreads, sizeof(pair_count_t *));
+    ctx.nmerged = calloc(nthreads, sizeof(uint64_t));
+
+    if (ctx.keys    == NULL) goto fail;
+    if (ctx.nkeys   == NULL) goto fail;
+    if (ctx.capkeys == NULL) goto fail;
+    if (ctx.merged  == NULL) goto fail;
+    if (ctx.nmerged == NULL) goto fail;
+  }
+
+  if (parallel_for(nthreads, nnodes, NODE_CHUNK, &ctx, _count_chunk))
+    goto fail;
+
+  if (ctx.matrices != NULL) {
+    if (_reduce_matrices(&ctx, nthreads, agg)) goto fail;
+  }
+  else {
+    if (parallel_for(nthreads, nthreads, 1, &ctx, _merge_keys)) goto fail;
+    if (_reduce_lists(&ctx, nthreads, agg))                     goto fail;
+  }
+
+  _free_ctx(&ctx, nthreads);
+  return 0;
+
+fail:
+  _free_ctx(&ctx, nthreads);
+  graph_aggregate_free(agg);
+  return 1;
+}
+
+void graph_aggregate_free(graph_aggregate_t *agg) {
+
+  if (agg == NULL) return;
+
+  if (agg->sizes  != NULL) free(agg->sizes);
+  if (agg->pairs  != NULL) free(agg->pairs);
+  if (agg->counts != NULL) free(agg->counts);
+  if (agg->within != NULL) free(agg->within);
+
+  memset(agg, 0, sizeof(graph_aggregate_t));
+}
+
+uint8_t _count_chunk(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   u;
+  uint64_t   i;
+  uint32_t   gu;
+  uint32_t   gv;
+  uint32_t   nnbrs;
+  uint32_t  *nbrs;
+  uint32_t  *matrix;
+  uint64_t  *keys;
+  uint64_t   newcap;
+  agg_ctx_t *actx;
+
+  actx   = ctx;
+  matrix = (actx->matrices != NULL) ? actx->matrices[thread] : NULL;
+
+  for (u = start; u < end; u++) {
+
+    gu = actx->groups[u];
+    if (gu == GRAPH_AGGREGATE_NONE) continue;
+
+    nnbrs = graph_num_neighbours(actx->g, u);
+    nbrs  = graph_get_neighbours(actx->g, u);
+
+    for (i = 0; i < nnbrs; i++) {
+
+      gv = actx->groups[nbrs[i]];
+
+      if (gv == GRAPH_AGGREGATE_NONE) continue;
+
+      /*
+       * undirected edges are in the neighbour
+       * lists of both end points - count each
+       * one from the lower group only, or from
+       * the lower node, if they are in the
+       * same group
+       */
+      if (!actx->directed && gv <  gu)               continue;
+      if (!actx->directed && gv == gu && nbrs[i] < u) continue;
+
+      if (matrix != NULL) {
+        matrix[(uint64_t)gu * actx->ngroups + gv]++;
+        continue;
+      }
+
+      if (actx->nkeys[thread] == actx->capkeys[thread]) {
+
+        newcap = (actx->capkeys[thread] == 0) ?
+          1024 : 2 * actx->capkeys[thread];
+
+        keys = realloc(actx->keys[thread], newcap * sizeof(uint64_t));
+        if (keys == NULL) goto fail;
+
+        actx->keys[thread]    = keys;
+        actx->capkeys[thread] = newcap;
+      }
+
+      actx->keys[thread][actx->nkeys[thread]++] =
+        ((uint64_t)gu << 32) | gv;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _merge_keys(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t      t;
+  uint64_t      i;
+  uint64_t      n;
+  uint64_t      nkeys;
+  uint64_t     *keys;
+  pair_count_t *merged;
+  agg_ctx_t    *actx;
+
+  actx = ctx;
+
+  for (t = start; t < end; t++) {
+
+    keys  = actx->keys[t];
+    nkeys = actx->nkeys[t];
+
+    if (nkeys == 0) continue;
+
+    qsort(keys, nkeys, sizeof(uint64_t), compare_u64);
+
+    for (i = 0, n = 0; i < nkeys; i++) {
+      if (i == 0 || keys[i] != keys[i-1]) n++;
+    }
+
+    merged = malloc(n * sizeof(pair_count_t));
+    if (merged == NULL) goto fail;
+
+    for (i = 0, n = 0; i < nkeys; i++) {
+
+      if (i > 0 && keys[i] == keys[i-1]) {
+        merged[n-1].count++;
+        continue;
+      }
+
+      merged[n].key   = keys[i];
+      merged[n].count = 1;
+      n++;
+    }
+
+    actx->merged[t]  = merged;
+    actx->nmerged[t] = n;
+
+    /*the raw keys are no longer needed*/
+    free(actx->keys[t]);
+    actx->keys[t] = NULL;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _reduce_matrices(
+  agg_ctx_t *ctx, uint16_t nthreads, graph_aggregate_t *agg) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  n;
+  uint64_t  nentries;
+  uint32_t *sum;
+
+  nentries = (uint64_t)ctx->ngroups * ctx->ngroups;
+  sum      = ctx->matrices[0];
+
+  for (i = 1; i < nthreads; i++) {
+    for (j = 0; j < nentries; j++) sum[j] += ctx->matrices[i][j];
+  }
+
+  /*the diagonal holds the edges within each group*/
+  for (i = 0; i < ctx->ngroups; i++) {
+    agg->within[i]            = sum[i * ctx->ngroups + i];
+    sum[i * ctx->ngroups + i] = 0;
+  }
+
+  for (i = 0, n = 0; i < nentries; i++) {
+    if (sum[i] > 0) n++;
+  }
+
+  agg->pairs  = malloc((n > 0 ? 2 * n : 1) * sizeof(uint32_t));
+  agg->counts = malloc((n > 0 ?     n : 1) * sizeof(uint32_t));
+  if (agg->pairs  == NULL) goto fail;
+  if (agg->counts == NULL) goto fail;
+
+  for (i = 0; i < nentries; i++) {
+
+    if (sum[i] == 0) continue;
+
+    agg->pairs[2 * agg->npairs]     = i / ctx->ngroups;
+    agg->pairs[2 * agg->npairs + 1] = i % ctx->ngroups;
+    agg->counts[agg->npairs]        = sum[i];
+    agg->npairs++;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _reduce_lists(
+  agg_ctx_t *ctx, uint16_t nthreads, graph_aggregate_t *agg) {
+
+  uint64_t      i;
+  uint64_t      n;
+  uint64_t      total;
+  pair_count_t *all;
+
+  all   = NULL;
+  total = 0;
+
+  for (i = 0; i < nthreads; i++) total += ctx->nmerged[i];
+
+  all = malloc((total > 0 ? total : 1) * sizeof(pair_count_t));
+  if (all == NULL) goto fail;
+
+  for (i = 0, n = 0; i < nthreads; i++) {
+
+    if (ctx->nmerged[i] == 0) continue;
+
+    memcpy(all + n, ctx->merged[i], ctx->nmerged[i] * sizeof(pair_count_t));
+    n += ctx->nmerged[i];
+  }
+
+  qsort(all, total, sizeof(pair_count_t), _compare_pair_counts);
+
+  for (i = 0, n = 0; i < total; i++) {
+
+    if (n > 0 && all[n-1].key == all[i].key) all[n-1].count += all[i].count;
+    else                                     all[n++] = all[i];
+  }
+
+  /*pairs (i, i) hold the edges within each group*/
+  for (i = 0, total = n, n = 0; i < total; i++) {
+
+    if ((all[i].key >> 32) == (all[i].key & 0xFFFFFFFF))
+      agg->within[all[i].key >> 32] = all[i].count;
+    else
+      all[n++] = all[i];
+  }
+
+  agg->pairs  = malloc((n > 0 ? 2 * n : 1) * sizeof(uint32_t));
+  agg->counts = malloc((n > 0 ?     n : 1) * sizeof(uint32_t));
+  if (agg->pairs  == NULL) goto fail;
+  if (agg->counts == NULL) goto fail;
+
+  for (i = 0; i < n; i++) {
+    agg->pairs[2 * i]     = all[i].key >> 32;
+    agg->pairs[2 * i + 1] = all[i].key & 0xFFFFFFFF;
+    agg->counts[i]        = all[i].count;
+  }
+  agg->npairs = n;
+
+  free(all);
+  return 0;
+
+fail:
+  if (all != NULL) free(all);
+  return 1;
+}
+
+void _free_ctx(agg_ctx_t *ctx, uint16_t nthreads) {
+
+  uint64_t i;
+
+  for (i = 0; i < nthreads; i++) {
+    if (ctx->matrices != NULL) free(ctx->matrices[i]);
+    if (ctx->keys     != NULL) free(ctx->keys[i]);
+    if (ctx->merged   != NULL) free(ctx->merged[i]);
+  }
+
+  free(ctx->matrices);
+  free(ctx->keys);
+  free(ctx->nkeys);
+  free(ctx->capkeys);
+  free(ctx->merged);
+  free(ctx->nmerged);
+}
+
+int _compare_pair_counts(const void *a, const void *b) {
+
+  return compare_u64(&(((pair_count_t *)a)->key),
+                     &(((pair_count_t *)b)->key));
+}
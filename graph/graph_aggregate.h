@@ -0,0 +1,86 @@
+/**
+ * Single-pass aggregation of the edges of a graph between groups of nodes.
+ * Every node is assigned a dense group index once (e.g. by label value,
+ * with graph_aggregate_labels), and the edges between every pair of groups
+ * are then counted in one pass over the graph, in parallel, rather than by
+ * searching for the nodes of each group, or testing every pair of nodes.
+ *
+ * Counts are accumulated into a per-thread matrix when there are few
+ * enough groups, or into per-thread lists of group pairs which are sorted
+ * and merged otherwise, so the cost is roughly linear in the number of
+ * edges, regardless of the number of groups.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_AGGREGATE_H__
+#define __GRAPH_AGGREGATE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Group of nodes which are not in any group.
+ */
+#define GRAPH_AGGREGATE_NONE 0xFFFFFFFF
+
+/**
+ * Edge counts between groups of nodes.
+ */
+typedef struct _graph_aggregate {
+
+  uint32_t  ngroups; /**< group IDs are in the range [0, ngroups)       */
+  uint32_t *sizes;   /**< number of nodes in each group                 */
+  uint32_t  npairs;  /**< number of pairs of groups with edges
+                          between them                                  */
+  uint32_t *pairs;   /**< 2*npairs group IDs - the (i, j) pairs, in
+                          ascending order of i, then j                  */
+  uint32_t *counts;  /**< number of edges between each pair             */
+  uint32_t *within;  /**< number of edges within each group             */
+
+} graph_aggregate_t;
+
+/**
+ * Assigns every node in the given graph to a group, by its label value.
+ * Groups are numbered in ascending order of label value. It is the
+ * caller's responsibility to free the labels list.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_aggregate_labels(
+  graph_t   *g,       /**< the graph                                    */
+  uint32_t  *groups,  /**< space to store the group of every node       */
+  uint32_t **labels,  /**< set to a newly allocated list of the label
+                           value of every group                         */
+  uint32_t  *ngroups  /**< set to the number of groups                  */
+);
+
+/**
+ * Counts the edges between every pair of different groups of nodes. For
+ * an undirected graph, every edge is counted once, for the pair (i, j)
+ * with i < j. For a directed graph, pairs are ordered - an edge u -> v is
+ * counted for the pair (group of u, group of v). Edges within a group are
+ * counted separately, for each group, and edges with an end point which
+ * is not in any group are ignored.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_aggregate(
+  graph_aggregate_t *agg,      /**< aggregate to initialise            */
+  graph_t           *g,        /**< the graph                          */
+  uint32_t          *groups,   /**< group of every node, in the range
+                                    [0, ngroups), or
+                                    GRAPH_AGGREGATE_NONE                */
+  uint32_t           ngroups,  /**< number of groups                   */
+  uint16_t           nthreads  /**< number of threads (0 for default,
+                                    see util/parallel.h)               */
+);
+
+/**
+ * Frees the memory used by the given aggregate.
+ */
+void graph_aggregate_free(
+  graph_aggregate_t *agg /**< the aggregate */
+);
+
+#endif /* __GRAPH_AGGREGATE_H__ */
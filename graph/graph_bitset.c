@@ -0,0 +1,284 @@
+/**
+ * A dense bitset adjacency matrix for a graph. See graph/graph_bitset.h
+ * for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "graph/graph_bitset.h"
+
+/**
+ * The bitset adjacency matrix of a graph.
+ */
+typedef struct _bitset_ctx {
+
+  graph_bitset_t bs;    /**< the matrix                                 */
+  graph_t       *g;     /**< the graph                                  */
+  uint8_t        stale; /**< non-0 if the edges of the graph have been
+                             rebuilt since the matrix was built         */
+
+  graph_event_listener_t gel; /**< keeps the matrix up to date on edge
+                                   events                             */
+
+} bitset_ctx_t;
+
+/**
+ * \return non-0 if the given graph should have a bitset adjacency matrix.
+ */
+static uint8_t _is_dense(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * (Re-)builds the given matrix from the current state of its graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build(
+  bitset_ctx_t *ctx /**< the matrix */
+);
+
+/**
+ * Frees the given matrix - passed to the graph as its ctx_free function.
+ */
+static void _bitset_free(
+  void *vctx /**< pointer to a bitset_ctx_t struct */
+);
+
+/**
+ * Sets or clears the bits for the edge between u and v.
+ */
+static void _set_edge(
+  graph_bitset_t *bs, /**< the matrix                     */
+  uint32_t        u,  /**< first node                     */
+  uint32_t        v,  /**< second node                    */
+  uint8_t         on  /**< non-0 to set, 0 to clear       */
+);
+
+/**
+ * Edge event callbacks - apply the change to the matrix, or mark it as
+ * stale.
+ */
+static void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt);
+static void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx);
+static void _edges_rebuilt(graph_t *g, void *ctx);
+
+uint8_t graph_bitset_init(graph_t *g) {
+
+  bitset_ctx_t *ctx;
+
+  ctx = g->ctx[_GRAPH_BITSET_CTX_LOC_];
+
+  if (ctx != NULL) {
+
+    if (!ctx->stale && ctx->bs.nnodes == graph_num_nodes(g)) return 0;
+
+    /*the graph may no longer be dense enough*/
+    if (!_is_dense(g)) {
+      graph_bitset_free(g);
+      return 0;
+    }
+
+    return _build(ctx);
+  }
+
+  if (!_is_dense(g)) return 0;
+
+  ctx = calloc(1, sizeof(bitset_ctx_t));
+  if (ctx == NULL) goto fail;
+
+  ctx->g = g;
+
+  if (_build(ctx)) goto fail;
+
+  ctx->gel.ctx           = ctx;
+  ctx->gel.edge_added    = _edge_added;
+  ctx->gel.edge_removed  = _edge_removed;
+  ctx->gel.edges_rebuilt = _edges_rebuilt;
+
+  if (graph_add_event_listener(g, &ctx->gel)) {
+    ctx->gel.ctx = NULL;
+    goto fail;
+  }
+
+  g->ctx[     _GRAPH_BITSET_CTX_LOC_] = ctx;
+  g->ctx_free[_GRAPH_BITSET_CTX_LOC_] = _bitset_free;
+
+  return 0;
+
+fail:
+  if (ctx != NULL) _bitset_free(ctx);
+  return 1;
+}
+
+void graph_bitset_free(graph_t *g) {
+
+  if (g->ctx[_GRAPH_BITSET_CTX_LOC_] == NULL) return;
+
+  _bitset_free(g->ctx[_GRAPH_BITSET_CTX_LOC_]);
+
+  g->ctx[     _GRAPH_BITSET_CTX_LOC_] = NULL;
+  g->ctx_free[_GRAPH_BITSET_CTX_LOC_] = NULL;
+}
+
+graph_bitset_t *graph_bitset_get(graph_t *g) {
+
+  bitset_ctx_t *ctx;
+
+  ctx = g->ctx[_GRAPH_BITSET_CTX_LOC_];
+
+  if (ctx == NULL)                          return NULL;
+  if (ctx->stale)                           return NULL;
+  if (ctx->bs.nnodes != graph_num_nodes(g)) return NULL;
+
+  return &ctx->bs;
+}
+
+uint8_t graph_bitset_test(graph_bitset_t *bs, uint32_t u, uint32_t v) {
+
+  return (bs->rows[(uint64_t)u * bs->nwords + v / 64] >> (v % 64)) & 1;
+}
+
+uint32_t graph_bitset_common(graph_bitset_t *bs, uint32_t u, uint32_t v) {
+
+  uint64_t  i;
+  uint32_t  count;
+  uint64_t *urow;
+  uint64_t *vrow;
+
+  urow  = bs->rows + (uint64_t)u * bs->nwords;
+  vrow  = bs->rows + (uint64_t)v * bs->nwords;
+  count = 0;
+
+  for (i = 0; i < bs->nwords; i++)
+    count += __builtin_popcountll(urow[i] & vrow[i]);
+
+  return count;
+}
+
+uint8_t _is_dense(graph_t *g) {
+
+  uint32_t nnodes;
+  double   density;
+
+  nnodes = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) return 0;
+  if (nnodes < 2)           return 0;
+
+  density = (2.0 * graph_num_edges(g)) / ((double)nnodes * (nnodes - 1));
+
+  return density >= GRAPH_BITSET_DENSITY;
+}
+
+uint8_t _build(bitset_ctx_t *ctx) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nnodes;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  graph_bitset_t *bs;
+  graph_t        *g;
+
+  g          = ctx->g;
+  bs         = &ctx->bs;
+  nnodes     = graph_num_nodes(g);
+  ctx->stale = 1;
+
+  if (bs->rows != NULL) free(bs->rows);
+
+  bs->nnodes = nnodes;
+  bs->nwords = (nnodes + 63) / 64;
+  bs->rows   = calloc((uint64_t)nnodes * bs->nwords + 1, sizeof(uint64_t));
+
+  if (bs->rows == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++)
+      bs->rows[i * bs->nwords + nbrs[j] / 64] |= 1ULL << (nbrs[j] % 64);
+  }
+
+  ctx->stale = 0;
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _bitset_free(void *vctx) {
+
+  bitset_ctx_t *ctx;
+
+  ctx = vctx;
+
+  if (ctx == NULL) return;
+
+  if (ctx->gel.ctx != NULL) graph_remove_event_listener(ctx->g, &ctx->gel);
+
+  if (ctx->bs.rows != NULL) free(ctx->bs.rows);
+
+  free(ctx);
+}
+
+void _set_edge(graph_bitset_t *bs, uint32_t u, uint32_t v, uint8_t on) {
+
+  uint64_t *uword;
+  uint64_t *vword;
+
+  uword = bs->rows + (uint64_t)u * bs->nwords + v / 64;
+  vword = bs->rows + (uint64_t)v * bs->nwords + u / 64;
+
+  if (on) {
+    *uword |=  (1ULL << (v % 64));
+    *vword |=  (1ULL << (u % 64));
+  }
+  else {
+    *uword &= ~(1ULL << (v % 64));
+    *vword &= ~(1ULL << (u % 64));
+  }
+}
+
+void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt) {
+
+  bitset_ctx_t *bctx;
+
+  bctx = ctx;
+
+  if (bctx->stale) return;
+
+  _set_edge(&bctx->bs, u, v, 1);
+}
+
+void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx) {
+
+  bitset_ctx_t *bctx;
+
+  bctx = ctx;
+
+  if (bctx->stale) return;
+
+  _set_edge(&bctx->bs, u, v, 0);
+}
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  ((bitset_ctx_t *)ctx)->stale = 1;
+}
@@ -0,0 +1,100 @@
+/**
+ * A dense bitset adjacency matrix for a graph. For dense graphs, a bit
+ * matrix answers adjacency queries in constant time, and allows sets of
+ * neighbours to be intersected, and breadth first search levels to be
+ * expanded, a word (64 nodes) at a time.
+ *
+ * The matrix is an addition to the neighbour lists of the graph, not a
+ * replacement for them, and is only created for undirected graphs with a
+ * density of at least GRAPH_BITSET_DENSITY. At that density the matrix
+ * (n*n/8 bytes) is less than a third of the size of the neighbour and
+ * weight lists. Functions which benefit from the matrix call
+ * graph_bitset_init, which creates it if the graph is dense enough; other
+ * functions (e.g. graph_are_neighbours, bfs_hybrid) use it if it exists.
+ *
+ * Like the component index (see graph/graph_cmpindex.h), the matrix is
+ * attached to the graph via its ctx fields, and is freed along with the
+ * graph. It listens for edge events on the graph - added and removed edges
+ * are applied to the matrix as they happen, and it is rebuilt on the next
+ * call to graph_bitset_init after the edges of the graph are rebuilt.
+ *
+ * The matrix is not created in a thread-safe manner - if a graph is to be
+ * queried by several threads, graph_bitset_init should be called first.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_BITSET_H__
+#define __GRAPH_BITSET_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Graphs with at least this density are given a bitset adjacency matrix.
+ */
+#define GRAPH_BITSET_DENSITY 0.05
+
+/**
+ * A bitset adjacency matrix. Bit v of row u is set if u and v are
+ * neighbours.
+ */
+typedef struct _graph_bitset {
+
+  uint32_t  nnodes; /**< number of nodes                            */
+  uint32_t  nwords; /**< number of 64 bit words in each row          */
+  uint64_t *rows;   /**< rows, node by node - the row for node u is
+                         stored at rows[u*nwords] to
+                         rows[(u+1)*nwords-1]                        */
+
+} graph_bitset_t;
+
+/**
+ * Creates (or rebuilds) the bitset adjacency matrix for the given graph,
+ * if the graph is undirected, has a density of at least
+ * GRAPH_BITSET_DENSITY, and does not have an up to date matrix. Nothing
+ * is done for other graphs.
+ *
+ * \return 0 on success (including when no matrix is needed), non-0 on
+ * failure.
+ */
+uint8_t graph_bitset_init(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Frees the bitset adjacency matrix of the given graph, if it has one.
+ */
+void graph_bitset_free(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return the up to date bitset adjacency matrix of the given graph, or
+ * NULL if it does not have one. The matrix is never created by this
+ * function, so it may be called from multiple threads. The returned
+ * pointer belongs to the graph.
+ */
+graph_bitset_t *graph_bitset_get(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return non-0 if nodes u and v are neighbours, 0 otherwise.
+ */
+uint8_t graph_bitset_test(
+  graph_bitset_t *bs, /**< the matrix  */
+  uint32_t        u,  /**< first node  */
+  uint32_t        v   /**< second node */
+);
+
+/**
+ * \return the number of neighbours which are shared by nodes u and v.
+ */
+uint32_t graph_bitset_common(
+  graph_bitset_t *bs, /**< the matrix  */
+  uint32_t        u,  /**< first node  */
+  uint32_t        v   /**< second node */
+);
+
+#endif /* __GRAPH_BITSET_H__ */
@@ -0,0 +1,498 @@
+/**
+ * Bulk editing of graph edges.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "graph/graph_builder.h"
+#include "util/array.h"
+#include "util/compare.h"
+
+/**
+ * An edge which has been queued, but not yet added to (or removed from)
+ * the graph. The weight of a queued removal is unused.
+ */
+typedef struct _pending_edge {
+
+  uint32_t u;  /**< edge start point */
+  uint32_t v;  /**< edge end point   */
+  float    wt; /**< edge weight      */
+
+} pending_edge_t;
+
+/**
+ * One entry in a node's neighbour list, used by graph_builder_finalise.
+ */
+typedef struct _nbr_entry {
+
+  uint32_t nbr; /**< neighbour                                    */
+  float    wt;  /**< edge weight                                  */
+  uint64_t seq; /**< 0 for edges already in the graph, otherwise
+                     1 + the index of the edge in the queue; used
+                     to retain the first of any duplicate edges   */
+
+} nbr_entry_t;
+
+/**
+ * Comparison function for nbr_entry_t structs - orders by neighbour,
+ * then by sequence number.
+ */
+static int _compare_nbr_entries(
+  const void *a, /**< pointer to a nbr_entry_t struct       */
+  const void *b  /**< pointer to another nbr_entry_t struct */
+);
+
+/**
+ * Queues an edge in the given list, stored from low to high.
+ *
+ * \return 0 on success, non-0 on failure (including if u == v, or either
+ * node is out of range).
+ */
+static uint8_t _queue_edge(
+  graph_builder_t *b,     /**< the builder      */
+  array_t         *queue, /**< list to queue in */
+  uint32_t         u,     /**< edge start point */
+  uint32_t         v,     /**< edge end point   */
+  float            wt     /**< edge weight      */
+);
+
+/**
+ * Checks that the neighbour lists of an undirected graph are symmetric,
+ * i.e. that for every edge u -> v, there is also an edge v -> u with the
+ * same weight, and recalculates the graph edge count.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _check_neighbours(
+  graph_t *g /**< the graph */
+);
+
+uint8_t graph_builder_init(graph_builder_t *b, graph_t *g, uint32_t capacity) {
+
+  if (b == NULL)          goto fail;
+  if (g == NULL)          goto fail;
+  if (graph_is_frozen(g)) goto fail;
+  if (capacity == 0)      capacity = 1;
+
+  b->g      = g;
+  b->direct = 0;
+
+  if (array_create(&b->edges, sizeof(pending_edge_t), capacity)) goto fail;
+  if (array_create(&b->removals, sizeof(pending_edge_t), 1)) {
+    array_free(&b->edges);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void graph_builder_free(graph_builder_t *b) {
+
+  if (b == NULL) return;
+
+  array_free(&b->edges);
+  array_free(&b->removals);
+}
+
+uint8_t graph_builder_add(
+  graph_builder_t *b, uint32_t u, uint32_t v, float wt) {
+
+  if (b == NULL) return 1;
+
+  return _queue_edge(b, &b->edges, u, v, wt);
+}
+
+uint8_t graph_builder_remove(graph_builder_t *b, uint32_t u, uint32_t v) {
+
+  if (b == NULL) return 1;
+
+  return _queue_edge(b, &b->removals, u, v, 0);
+}
+
+uint8_t graph_builder_set_neighbours(
+  graph_builder_t *b, uint32_t u, uint32_t nnbrs, uint32_t *nbrs, double *wts) {
+
+  uint64_t  i;
+  uint32_t *gnbrs;
+  float    *gwts;
+  graph_t  *g;
+
+  if (b == NULL)                  goto fail;
+  if (u >= graph_num_nodes(b->g)) goto fail;
+
+  g = b->g;
+
+  for (i = 0; i < nnbrs; i++) {
+    if (nbrs[i] >= graph_num_nodes(g))  goto fail;
+    if (nbrs[i] == u)                   goto fail;
+    if (i > 0 && nbrs[i] <= nbrs[i-1])  goto fail;
+  }
+
+  if (array_expand(&(g->neighbours[u]), nnbrs)) goto fail;
+  if (array_expand(&(g->weights   [u]), nnbrs)) goto fail;
+
+  gnbrs = (uint32_t *)(g->neighbours[u].data);
+  gwts  = (float    *)(g->weights   [u].data);
+
+  memcpy(gnbrs, nbrs, nnbrs*sizeof(uint32_t));
+  for (i = 0; i < nnbrs; i++) gwts[i] = wts[i];
+
+  g->neighbours[u].size = nnbrs;
+  g->weights   [u].size = nnbrs;
+  array_set(&g->numneighbours, u, &nnbrs);
+
+  b->direct = 1;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_builder_finalise(graph_builder_t *b) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        k;
+  uint64_t        r;
+  uint64_t        nentries;
+  uint64_t        newedges;
+  uint64_t        oldedges;
+  uint32_t        nnodes;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  float          *wts;
+  uint64_t       *offsets;
+  uint64_t       *fill;
+  uint64_t       *roffsets;
+  uint64_t       *rfill;
+  uint32_t       *rentries;
+  uint32_t       *rnode;
+  nbr_entry_t    *entries;
+  nbr_entry_t    *node;
+  pending_edge_t *e;
+  graph_t        *g;
+
+  offsets  = NULL;
+  fill     = NULL;
+  entries  = NULL;
+  roffsets = NULL;
+  rfill    = NULL;
+  rentries = NULL;
+
+  if (b == NULL)             goto fail;
+  if (graph_is_frozen(b->g)) goto fail;
+
+  if (b->direct) {
+
+    if (_check_neighbours(b->g)) goto fail;
+    b->direct = 0;
+
+    if (b->edges.size == 0 && b->removals.size == 0) {
+      graph_event_fire(b->g, GRAPH_EVENT_EDGES_REBUILT, NULL);
+      return 0;
+    }
+  }
+
+  if (b->edges.size == 0 && b->removals.size == 0) return 0;
+
+  g      = b->g;
+  nnodes = graph_num_nodes(g);
+
+  offsets  = calloc(nnodes+1, sizeof(uint64_t));
+  fill     = calloc(nnodes,   sizeof(uint64_t));
+  roffsets = calloc(nnodes+1, sizeof(uint64_t));
+  rfill    = calloc(nnodes,   sizeof(uint64_t));
+  if (offsets  == NULL) goto fail;
+  if (fill     == NULL) goto fail;
+  if (roffsets == NULL) goto fail;
+  if (rfill    == NULL) goto fail;
+
+  /*
+   * queued removals are grouped by node, in the same
+   * way as entries, and sorted, so that they can be
+   * matched against the (sorted) existing neighbours
+   */
+  for (i = 0; i < b->removals.size; i++) {
+
+    e = array_getd(&b->removals, i);
+
+    roffsets[e->u+1]++;
+    if (!graph_is_directed(g)) roffsets[e->v+1]++;
+  }
+
+  for (i = 0; i < nnodes; i++) roffsets[i+1] += roffsets[i];
+
+  if (roffsets[nnodes] > 0) {
+    rentries = malloc(roffsets[nnodes]*sizeof(uint32_t));
+    if (rentries == NULL) goto fail;
+  }
+
+  for (i = 0; i < b->removals.size; i++) {
+
+    e = array_getd(&b->removals, i);
+
+    rentries[roffsets[e->u] + rfill[e->u]++] = e->v;
+    if (!graph_is_directed(g))
+      rentries[roffsets[e->v] + rfill[e->v]++] = e->u;
+  }
+
+  /*count the existing and new entries for each node*/
+  for (i = 0; i < nnodes; i++) offsets[i+1] = graph_num_neighbours(g, i);
+
+  for (i = 0; i < b->edges.size; i++) {
+
+    e = array_getd(&b->edges, i);
+
+    offsets[e->u+1]++;
+    if (!graph_is_directed(g)) offsets[e->v+1]++;
+  }
+
+  for (i = 0; i < nnodes; i++) offsets[i+1] += offsets[i];
+
+  nentries = offsets[nnodes];
+
+  entries = malloc(nentries*sizeof(nbr_entry_t));
+  if (entries == NULL && nentries > 0) goto fail;
+
+  /*
+   * existing entries first, minus any which are to
+   * be removed, then new entries in queue order.
+   * Every queued removal must match exactly one
+   * existing entry.
+   */
+  oldedges = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+    rnode = rentries + roffsets[i];
+
+    if (rfill[i] > 1)
+      qsort(rnode, rfill[i], sizeof(uint32_t), compare_u32);
+
+    for (j = 0, r = 0; j < nnbrs; j++) {
+
+      if (r < rfill[i] && rnode[r] <  nbrs[j]) goto fail;
+      if (r < rfill[i] && rnode[r] == nbrs[j]) {
+        if (nbrs[j] > i) oldedges++;
+        r++;
+        continue;
+      }
+
+      node      = entries + offsets[i] + fill[i]++;
+      node->nbr = nbrs[j];
+      node->wt  = wts[j];
+      node->seq = 0;
+    }
+
+    if (r < rfill[i]) goto fail;
+  }
+
+  for (i = 0; i < b->edges.size; i++) {
+
+    e = array_getd(&b->edges, i);
+
+    node      = entries + offsets[e->u] + fill[e->u]++;
+    node->nbr = e->v;
+    node->wt  = e->wt;
+    node->seq = i+1;
+
+    if (!graph_is_directed(g)) {
+      node      = entries + offsets[e->v] + fill[e->v]++;
+      node->nbr = e->u;
+      node->wt  = e->wt;
+      node->seq = i+1;
+    }
+  }
+
+  /*
+   * sort and de-duplicate each list. The de-duplicated
+   * lengths are stored in fill. Capacity is reserved
+   * before the graph is touched, so that a failure
+   * part way through leaves the graph unchanged.
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    node = entries + offsets[i];
+
+    qsort(node, fill[i], sizeof(nbr_entry_t), _compare_nbr_entries);
+
+    for (j = 0, k = 0; j < fill[i]; j++) {
+
+      if (k > 0 && node[k-1].nbr == node[j].nbr) continue;
+      node[k++] = node[j];
+    }
+
+    fill[i] = k;
+
+    if (array_expand(&(g->neighbours[i]), k)) goto fail;
+    if (array_expand(&(g->weights   [i]), k)) goto fail;
+  }
+
+  newedges = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    node  = entries + offsets[i];
+    nbrs  = (uint32_t *)(g->neighbours[i].data);
+    wts   = (float    *)(g->weights   [i].data);
+    nnbrs = fill[i];
+
+    for (j = 0; j < nnbrs; j++) {
+
+      nbrs[j] = node[j].nbr;
+      wts [j] = node[j].wt;
+
+      /*each new edge is counted once, at its low end point*/
+      if (node[j].seq > 0 && node[j].nbr > i) newedges++;
+    }
+
+    g->neighbours[i].size = nnbrs;
+    g->weights   [i].size = nnbrs;
+    array_set(&g->numneighbours, i, &nnbrs);
+  }
+
+  g->numedges += newedges;
+  g->numedges -= oldedges;
+
+  array_clear(&b->edges);
+  array_clear(&b->removals);
+  if (entries  != NULL) free(entries);
+  if (rentries != NULL) free(rentries);
+  free(offsets);
+  free(fill);
+  free(roffsets);
+  free(rfill);
+
+  graph_event_fire(g, GRAPH_EVENT_EDGES_REBUILT, NULL);
+
+  return 0;
+
+fail:
+  if (entries  != NULL) free(entries);
+  if (offsets  != NULL) free(offsets);
+  if (fill     != NULL) free(fill);
+  if (rentries != NULL) free(rentries);
+  if (roffsets != NULL) free(roffsets);
+  if (rfill    != NULL) free(rfill);
+  return 1;
+}
+
+uint8_t _queue_edge(
+  graph_builder_t *b, array_t *queue, uint32_t u, uint32_t v, float wt) {
+
+  pending_edge_t e;
+
+  if (u == v)                     goto fail;
+  if (u >= graph_num_nodes(b->g)) goto fail;
+  if (v >= graph_num_nodes(b->g)) goto fail;
+
+  /*edges are always stored from low to high (see graph_add_edge)*/
+  e.u  = (u > v) ? v : u;
+  e.v  = (u > v) ? u : v;
+  e.wt = wt;
+
+  if (array_append(queue, &e)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+int _compare_nbr_entries(const void *a, const void *b) {
+
+  const nbr_entry_t *ea;
+  const nbr_entry_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->nbr < eb->nbr) return -1;
+  if (ea->nbr > eb->nbr) return  1;
+  if (ea->seq < eb->seq) return -1;
+  if (ea->seq > eb->seq) return  1;
+  return 0;
+}
+
+uint8_t _check_neighbours(graph_t *g) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  numedges;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t  v;
+  uint32_t *nbrs;
+  float    *wts;
+  uint32_t *cursor;
+
+  cursor   = NULL;
+  numedges = 0;
+  nnodes   = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) {
+
+    for (i = 0; i < nnodes; i++) numedges += graph_num_neighbours(g, i);
+    g->numedges = numedges;
+    return 0;
+  }
+
+  cursor = calloc(nnodes, sizeof(uint32_t));
+  if (cursor == NULL) goto fail;
+
+  /*
+   * Lists are sorted, so as we iterate through the nodes in
+   * ascending order, the reverse edge (v -> i) of every edge
+   * (i -> v, v > i) must be the next unmatched entry in the
+   * neighbour list of v.
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      v = nbrs[j];
+      if (v < i) continue;
+
+      if (cursor[v] >= graph_num_neighbours(g, v))         goto fail;
+      if (graph_get_neighbours(g, v)[cursor[v]] != i)      goto fail;
+      if (graph_get_weights(   g, v)[cursor[v]] != wts[j]) goto fail;
+
+      cursor[v]++;
+      numedges++;
+    }
+  }
+
+  /*every entry below the diagonal must have been matched*/
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    if (cursor[i] < nnbrs && nbrs[cursor[i]] < i) goto fail;
+  }
+
+  g->numedges = numedges;
+
+  free(cursor);
+  return 0;
+
+fail:
+  if (cursor != NULL) free(cursor);
+  return 1;
+}
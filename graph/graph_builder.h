@@ -0,0 +1,140 @@
+/**
+ * Bulk editing of graph edges. Adding or removing edges one by one via
+ * graph_add_edge and graph_remove_edge is slow for large graphs, as every
+ * edge is inserted into (or removed from) two sorted neighbour lists, and
+ * an event is fired for every edge, so every listener (e.g. an
+ * edge_array_t, or a stats cache) pays a per-edge cost. A graph_builder_t
+ * instead accumulates edge additions and removals in unsorted lists; they
+ * are then applied to the graph in one go by graph_builder_finalise, which
+ * rebuilds each neighbour list once, and fires a single
+ * GRAPH_EVENT_EDGES_REBUILT event, so that listeners rebuild their state
+ * once.
+ *
+ * Queued removals are applied before queued additions. The resulting graph
+ * is identical to that which would be created by calling graph_remove_edge
+ * for every removed edge, and then graph_add_edge for every added edge, in
+ * the order that they were added to the builder - duplicate edges are
+ * ignored, so the weight of the first occurrence of an edge (or of the edge
+ * already in the graph) is retained.
+ *
+ * Edges produced by several threads at once are better added with a
+ * concurrent builder (see graph/graph_cbuilder.h).
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_BUILDER_H__
+#define __GRAPH_BUILDER_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "util/array.h"
+
+/**
+ * Builder handle.
+ */
+typedef struct _graph_builder {
+
+  graph_t *g;        /**< the graph being built           */
+  array_t  edges;    /**< edges which have not yet been
+                          added to the graph              */
+  array_t  removals; /**< edges which have not yet been
+                          removed from the graph          */
+  uint8_t  direct;   /**< non-0 if any neighbour lists
+                          have been set directly, via
+                          graph_builder_set_neighbours    */
+
+} graph_builder_t;
+
+/**
+ * Initialises a builder for the given graph, which must already have been
+ * created, and must not be frozen (see graph_freeze). The graph may
+ * already contain edges.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_builder_init(
+  graph_builder_t *b,       /**< builder to initialise                */
+  graph_t         *g,       /**< the graph                            */
+  uint32_t         capacity /**< initial capacity (number of edges) -
+                                 this is only a hint                  */
+);
+
+/**
+ * Frees the memory used by the given builder. Any edges which have not
+ * been added to or removed from the graph are discarded. The graph is not
+ * affected.
+ */
+void graph_builder_free(
+  graph_builder_t *b /**< the builder */
+);
+
+/**
+ * Queues an edge to be added to the graph. The edge is not added until
+ * graph_builder_finalise is called.
+ *
+ * \return 0 on success, non-0 on failure (including if u == v, or either
+ * node is out of range).
+ */
+uint8_t graph_builder_add(
+  graph_builder_t *b,  /**< the builder      */
+  uint32_t         u,  /**< edge start point */
+  uint32_t         v,  /**< edge end point   */
+  float            wt  /**< edge weight      */
+);
+
+/**
+ * Queues an edge to be removed from the graph. The edge is not removed
+ * until graph_builder_finalise is called, at which point it must be in the
+ * graph. Removals only apply to edges which are in the graph before
+ * graph_builder_finalise is called, not to queued additions.
+ *
+ * \return 0 on success, non-0 on failure (including if u == v, or either
+ * node is out of range).
+ */
+uint8_t graph_builder_remove(
+  graph_builder_t *b,  /**< the builder      */
+  uint32_t         u,  /**< edge start point */
+  uint32_t         v   /**< edge end point   */
+);
+
+/**
+ * Sets the neighbours of the given node directly, replacing any existing
+ * neighbours. This is faster than adding the edges one by one, but the
+ * neighbours must be in ascending order, and must not contain duplicates or
+ * u itself. For undirected graphs, the caller must set the neighbours of
+ * both end points of every edge, with the same weight. This is checked when
+ * graph_builder_finalise is called.
+ *
+ * \return 0 on success, non-0 on failure (including if the neighbours are
+ * not in ascending order).
+ */
+uint8_t graph_builder_set_neighbours(
+  graph_builder_t *b,     /**< the builder                       */
+  uint32_t         u,     /**< the node                          */
+  uint32_t         nnbrs, /**< number of neighbours              */
+  uint32_t        *nbrs,  /**< the neighbours, in ascending order */
+  double          *wts    /**< weight of each edge               */
+);
+
+/**
+ * Removes all queued removals from, and adds all queued edges to, the
+ * graph, sorting and de-duplicating each neighbour list, and then fires a
+ * single GRAPH_EVENT_EDGES_REBUILT event. The builder is emptied, and may
+ * be re-used.
+ *
+ * If any neighbour lists have been set with graph_builder_set_neighbours,
+ * they are first checked for consistency, and the graph edge count is
+ * recalculated.
+ *
+ * \return 0 on success, non-0 on failure. The graph is unchanged on
+ * failure (including if a queued removal is not in the graph, or the same
+ * edge has been queued for removal more than once), unless
+ * graph_builder_set_neighbours has been used, in which case the graph may
+ * be inconsistent, and should be freed.
+ */
+uint8_t graph_builder_finalise(
+  graph_builder_t *b /**< the builder */
+);
+
+#endif /* __GRAPH_BUILDER_H__ */
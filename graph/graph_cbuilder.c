@@ -0,0 +1,458 @@
+/**
+ * Concurrent graph construction.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_cbuilder.h"
+#include "util/bigmem.h"
+#include "util/parallel.h"
+
+/**
+ * Number of edges handed to a thread at a time when counting and
+ * scattering the buffered edges.
+ */
+#define CBUILDER_EDGE_CHUNK 65536
+
+/**
+ * Number of nodes handed to a thread at a time when sorting and
+ * compacting the neighbour lists.
+ */
+#define CBUILDER_NODE_CHUNK 1024
+
+/**
+ * One entry in a node's neighbour list, used by graph_cbuilder_finalise.
+ */
+typedef struct _cbuilder_entry {
+
+  uint32_t nbr; /**< neighbour                                      */
+  float    wt;  /**< edge weight                                    */
+  uint32_t fwd; /**< non-0 if the edge was added with its lower end
+                     point (or, if directed, its start point) as u  */
+
+} cbuilder_entry_t;
+
+/**
+ * Context passed to the parallel_for functions of graph_cbuilder_finalise.
+ */
+typedef struct _cbuilder_ctx {
+
+  graph_cbuilder_t *b;        /**< the builder                          */
+  uint64_t         *bstarts;  /**< global index of the first edge in
+                                   each buffer, and the total           */
+  uint64_t         *offsets;  /**< start of each node's entries         */
+  uint64_t         *cursors;  /**< next free entry of each node, then
+                                   de-duplicated list lengths           */
+  uint64_t         *csroffs;  /**< start of each node's final list      */
+  cbuilder_entry_t *entries;  /**< all entries, node by node            */
+  uint32_t         *nbrs;     /**< final neighbour lists                */
+  float            *wts;      /**< final weight lists                   */
+
+} cbuilder_ctx_t;
+
+/**
+ * parallel_for function which counts the entries of every node, for a
+ * range of buffered edges.
+ *
+ * \return 0.
+ */
+static uint8_t _count_edges(
+  uint64_t start,  /**< first edge                  */
+  uint64_t end,    /**< one past the last edge      */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to a cbuilder_ctx_t */
+);
+
+/**
+ * parallel_for function which scatters a range of buffered edges into the
+ * entry lists of their end points.
+ *
+ * \return 0.
+ */
+static uint8_t _scatter_edges(
+  uint64_t start,  /**< first edge                  */
+  uint64_t end,    /**< one past the last edge      */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to a cbuilder_ctx_t */
+);
+
+/**
+ * parallel_for function which sorts and de-duplicates the entry lists of
+ * a range of nodes, storing their new lengths in the cursors array.
+ *
+ * \return 0.
+ */
+static uint8_t _sort_nodes(
+  uint64_t start,  /**< first node                  */
+  uint64_t end,    /**< one past the last node      */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to a cbuilder_ctx_t */
+);
+
+/**
+ * parallel_for function which copies the de-duplicated entry lists of a
+ * range of nodes into the final CSR arrays.
+ *
+ * \return 0.
+ */
+static uint8_t _copy_nodes(
+  uint64_t start,  /**< first node                  */
+  uint64_t end,    /**< one past the last node      */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to a cbuilder_ctx_t */
+);
+
+/**
+ * \return a pointer to the buffered edge with the given global index, and
+ * updates *buf to the buffer which contains it.
+ */
+static graph_cbuilder_edge_t * _get_edge(
+  cbuilder_ctx_t *ctx, /**< the context                            */
+  uint64_t        idx, /**< global edge index                      */
+  uint16_t       *buf  /**< buffer of the previous edge; updated   */
+);
+
+/**
+ * Comparison function for cbuilder_entry_t structs - orders by neighbour,
+ * then forward edges first, then by descending weight.
+ */
+static int _compare_entries(
+  const void *a, /**< pointer to a cbuilder_entry_t       */
+  const void *b  /**< pointer to another cbuilder_entry_t */
+);
+
+uint8_t graph_cbuilder_init(
+  graph_cbuilder_t *b, uint32_t numnodes, uint8_t directed, uint16_t nthreads) {
+
+  if (b == NULL) goto fail;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  b->numnodes = numnodes;
+  b->directed = directed;
+  b->nbufs    = nthreads;
+  b->bufs     = calloc(nthreads, sizeof(graph_cbuilder_buf_t));
+
+  if (b->bufs == NULL) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void graph_cbuilder_free(graph_cbuilder_t *b) {
+
+  uint64_t i;
+
+  if (b       == NULL) return;
+  if (b->bufs == NULL) return;
+
+  for (i = 0; i < b->nbufs; i++) {
+    if (b->bufs[i].edges != NULL) free(b->bufs[i].edges);
+  }
+
+  free(b->bufs);
+  b->bufs  = NULL;
+  b->nbufs = 0;
+}
+
+uint8_t graph_cbuilder_add(
+  graph_cbuilder_t *b, uint16_t thread, uint32_t u, uint32_t v, float wt) {
+
+  graph_cbuilder_buf_t  *buf;
+  graph_cbuilder_edge_t *edges;
+  uint64_t               newcap;
+
+  if (b == NULL)           goto fail;
+  if (thread >= b->nbufs)  goto fail;
+  if (u == v)              goto fail;
+  if (u >= b->numnodes)    goto fail;
+  if (v >= b->numnodes)    goto fail;
+
+  buf = b->bufs + thread;
+
+  if (buf->size == buf->capacity) {
+
+    newcap = buf->capacity > 0 ? 2 * buf->capacity : 1024;
+    edges  = realloc(buf->edges, newcap * sizeof(graph_cbuilder_edge_t));
+    if (edges == NULL) goto fail;
+
+    buf->edges    = edges;
+    buf->capacity = newcap;
+  }
+
+  buf->edges[buf->size].u  = u;
+  buf->edges[buf->size].v  = v;
+  buf->edges[buf->size].wt = wt;
+  buf->size++;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint64_t graph_cbuilder_num_edges(graph_cbuilder_t *b) {
+
+  uint64_t i;
+  uint64_t n;
+
+  for (i = 0, n = 0; i < b->nbufs; i++) n += b->bufs[i].size;
+
+  return n;
+}
+
+uint8_t graph_cbuilder_finalise(
+  graph_cbuilder_t *b, graph_t *g, uint16_t nthreads) {
+
+  uint64_t       i;
+  uint64_t       total;
+  uint64_t       nentries;
+  uint32_t       n;
+  cbuilder_ctx_t ctx;
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  if (b == NULL) goto fail;
+
+  n           = b->numnodes;
+  ctx.b       = b;
+  ctx.bstarts = malloc(((uint64_t)b->nbufs + 1) * sizeof(uint64_t));
+  ctx.offsets = calloc((uint64_t)n + 1,         sizeof(uint64_t));
+  ctx.cursors = malloc(((uint64_t)n + 1) * sizeof(uint64_t));
+  ctx.csroffs = bigmem_alloc(((uint64_t)n + 1) * sizeof(uint64_t));
+
+  if (ctx.bstarts == NULL) goto fail;
+  if (ctx.offsets == NULL) goto fail;
+  if (ctx.cursors == NULL) goto fail;
+  if (ctx.csroffs == NULL) goto fail;
+
+  ctx.bstarts[0] = 0;
+  for (i = 0; i < b->nbufs; i++)
+    ctx.bstarts[i+1] = ctx.bstarts[i] + b->bufs[i].size;
+
+  total = ctx.bstarts[b->nbufs];
+
+  /*
+   * count the entries of each node, and scatter the edges
+   * into per-node lists - the order of the entries within
+   * a list depends on thread timing, but they are sorted
+   * into a deterministic order afterwards
+   */
+  if (parallel_for(
+        nthreads, total, CBUILDER_EDGE_CHUNK, &ctx, _count_edges))
+    goto fail;
+
+  for (i = 0; i < n; i++) ctx.offsets[i+1] += ctx.offsets[i];
+
+  nentries = ctx.offsets[n];
+
+  ctx.entries = bigmem_alloc((nentries > 0 ? nentries : 1) *
+                             sizeof(cbuilder_entry_t));
+  if (ctx.entries == NULL) goto fail;
+
+  memcpy(ctx.cursors, ctx.offsets, ((uint64_t)n + 1) * sizeof(uint64_t));
+
+  if (parallel_for(
+        nthreads, total, CBUILDER_EDGE_CHUNK, &ctx, _scatter_edges))
+    goto fail;
+
+  if (parallel_for(
+        nthreads, n, CBUILDER_NODE_CHUNK, &ctx, _sort_nodes))
+    goto fail;
+
+  ctx.csroffs[0] = 0;
+  for (i = 0; i < n; i++) ctx.csroffs[i+1] = ctx.csroffs[i] + ctx.cursors[i];
+
+  ctx.nbrs = bigmem_alloc((ctx.csroffs[n] > 0 ? ctx.csroffs[n] : 1) *
+                          sizeof(uint32_t));
+  ctx.wts  = bigmem_alloc((ctx.csroffs[n] > 0 ? ctx.csroffs[n] : 1) *
+                          sizeof(float));
+  if (ctx.nbrs == NULL) goto fail;
+  if (ctx.wts  == NULL) goto fail;
+
+  if (parallel_for(
+        nthreads, n, CBUILDER_NODE_CHUNK, &ctx, _copy_nodes))
+    goto fail;
+
+  bigmem_free(ctx.entries);
+  ctx.entries = NULL;
+
+  /*the graph owns the CSR arrays, even on failure*/
+  if (graph_create_frozen(
+        g, n, b->directed, ctx.csroffs, ctx.nbrs, ctx.wts)) {
+    ctx.csroffs = NULL;
+    ctx.nbrs    = NULL;
+    ctx.wts     = NULL;
+    goto fail;
+  }
+
+  for (i = 0; i < b->nbufs; i++) b->bufs[i].size = 0;
+
+  free(ctx.bstarts);
+  free(ctx.offsets);
+  free(ctx.cursors);
+  return 0;
+
+fail:
+  if (ctx.bstarts != NULL) free(ctx.bstarts);
+  if (ctx.offsets != NULL) free(ctx.offsets);
+  if (ctx.cursors != NULL) free(ctx.cursors);
+  bigmem_free(ctx.csroffs);
+  bigmem_free(ctx.entries);
+  bigmem_free(ctx.nbrs);
+  bigmem_free(ctx.wts);
+  return 1;
+}
+
+uint8_t _count_edges(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t               i;
+  uint16_t               buf;
+  uint64_t              *offsets;
+  cbuilder_ctx_t        *ctx;
+  graph_cbuilder_edge_t *e;
+
+  ctx     = vctx;
+  offsets = ctx->offsets;
+  buf     = 0;
+
+  for (i = start; i < end; i++) {
+
+    e = _get_edge(ctx, i, &buf);
+
+    __atomic_add_fetch(offsets + e->u + 1, 1, __ATOMIC_RELAXED);
+    if (!ctx->b->directed)
+      __atomic_add_fetch(offsets + e->v + 1, 1, __ATOMIC_RELAXED);
+  }
+
+  return 0;
+}
+
+uint8_t _scatter_edges(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t               i;
+  uint64_t               k;
+  uint16_t               buf;
+  uint32_t               fwd;
+  cbuilder_ctx_t        *ctx;
+  cbuilder_entry_t      *entry;
+  graph_cbuilder_edge_t *e;
+
+  ctx = vctx;
+  buf = 0;
+
+  for (i = start; i < end; i++) {
+
+    e   = _get_edge(ctx, i, &buf);
+    fwd = ctx->b->directed || e->u < e->v;
+
+    k          = __atomic_fetch_add(ctx->cursors + e->u, 1, __ATOMIC_RELAXED);
+    entry      = ctx->entries + k;
+    entry->nbr = e->v;
+    entry->wt  = e->wt;
+    entry->fwd = fwd;
+
+    if (ctx->b->directed) continue;
+
+    k          = __atomic_fetch_add(ctx->cursors + e->v, 1, __ATOMIC_RELAXED);
+    entry      = ctx->entries + k;
+    entry->nbr = e->u;
+    entry->wt  = e->wt;
+    entry->fwd = fwd;
+  }
+
+  return 0;
+}
+
+uint8_t _sort_nodes(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t          u;
+  uint64_t          j;
+  uint64_t          k;
+  uint64_t          len;
+  cbuilder_ctx_t   *ctx;
+  cbuilder_entry_t *node;
+
+  ctx = vctx;
+
+  for (u = start; u < end; u++) {
+
+    node = ctx->entries + ctx->offsets[u];
+    len  = ctx->offsets[u+1] - ctx->offsets[u];
+
+    if (len > 1)
+      qsort(node, len, sizeof(cbuilder_entry_t), _compare_entries);
+
+    /*the preferred copy of a duplicate edge is sorted first*/
+    for (j = 0, k = 0; j < len; j++) {
+
+      if (k > 0 && node[k-1].nbr == node[j].nbr) continue;
+      node[k++] = node[j];
+    }
+
+    ctx->cursors[u] = k;
+  }
+
+  return 0;
+}
+
+uint8_t _copy_nodes(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t          u;
+  uint64_t          j;
+  uint64_t          off;
+  cbuilder_ctx_t   *ctx;
+  cbuilder_entry_t *node;
+
+  ctx = vctx;
+
+  for (u = start; u < end; u++) {
+
+    node = ctx->entries + ctx->offsets[u];
+    off  = ctx->csroffs[u];
+
+    for (j = 0; j < ctx->cursors[u]; j++) {
+      ctx->nbrs[off + j] = node[j].nbr;
+      ctx->wts [off + j] = node[j].wt;
+    }
+  }
+
+  return 0;
+}
+
+graph_cbuilder_edge_t * _get_edge(
+  cbuilder_ctx_t *ctx, uint64_t idx, uint16_t *buf) {
+
+  while (idx >= ctx->bstarts[*buf + 1]) (*buf)++;
+
+  return ctx->b->bufs[*buf].edges + (idx - ctx->bstarts[*buf]);
+}
+
+int _compare_entries(const void *a, const void *b) {
+
+  const cbuilder_entry_t *ea;
+  const cbuilder_entry_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->nbr < eb->nbr) return -1;
+  if (ea->nbr > eb->nbr) return  1;
+  if (ea->fwd > eb->fwd) return -1;
+  if (ea->fwd < eb->fwd) return  1;
+  if (ea->wt  > eb->wt)  return -1;
+  if (ea->wt  < eb->wt)  return  1;
+
+  return 0;
+}
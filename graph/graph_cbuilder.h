@@ -0,0 +1,131 @@
+/**
+ * Concurrent graph construction. Both graph_add_edge and graph_builder_t
+ * (see graph/graph_builder.h) modify shared state, so a parallel producer
+ * (e.g. a thresholding loop run with parallel_for) has to hand its edges
+ * back to a single thread to add them. A graph_cbuilder_t instead gives
+ * every thread its own edge buffer, which it appends to without any
+ * locking; graph_cbuilder_finalise then creates the graph from all of the
+ * buffers in parallel - the edges are counted and scattered into one list
+ * per source node (a single pass radix sort by source), with undirected
+ * edges scattered to both of their end points, and then every list is
+ * sorted, de-duplicated, and compacted into a frozen CSR graph (see
+ * graph_freeze).
+ *
+ * Unlike a graph_builder_t, a concurrent builder creates a new graph, and
+ * does not support edge removal. The resulting graph does not depend on
+ * which thread added which edge, or on the order in which they were
+ * added: if an undirected edge is added more than once, a copy which was
+ * added with its lower end point as u is preferred, and amongst those
+ * copies, the one with the greatest weight is kept (likewise, for
+ * duplicate directed edges, the greatest weight is kept).
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_CBUILDER_H__
+#define __GRAPH_CBUILDER_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * An edge in a per-thread buffer.
+ */
+typedef struct _graph_cbuilder_edge {
+
+  uint32_t u;  /**< edge start point */
+  uint32_t v;  /**< edge end point   */
+  float    wt; /**< edge weight      */
+
+} graph_cbuilder_edge_t;
+
+/**
+ * The edge buffer of one thread. Buffers are padded to a cache line, so
+ * that threads appending to neighbouring buffers do not contend.
+ */
+typedef struct _graph_cbuilder_buf {
+
+  graph_cbuilder_edge_t *edges;    /**< the edges                   */
+  uint64_t               size;     /**< number of edges             */
+  uint64_t               capacity; /**< space in the edges array    */
+  uint8_t                pad[40];  /**< padding to 64 bytes         */
+
+} graph_cbuilder_buf_t;
+
+/**
+ * Concurrent builder handle.
+ */
+typedef struct _graph_cbuilder {
+
+  uint32_t              numnodes; /**< number of nodes               */
+  uint8_t               directed; /**< directed or undirected        */
+  uint16_t              nbufs;    /**< number of per-thread buffers  */
+  graph_cbuilder_buf_t *bufs;     /**< the per-thread buffers        */
+
+} graph_cbuilder_t;
+
+/**
+ * Initialises a concurrent builder for a graph with the given number of
+ * nodes, with one edge buffer for each of the given number of threads.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_cbuilder_init(
+  graph_cbuilder_t *b,        /**< builder to initialise                */
+  uint32_t          numnodes, /**< number of nodes                      */
+  uint8_t           directed, /**< directed or undirected               */
+  uint16_t          nthreads  /**< number of threads which will add
+                                   edges (0 for default, see
+                                   util/parallel.h)                     */
+);
+
+/**
+ * Frees the memory used by the given builder. Any edges which have not
+ * been added to a graph are discarded.
+ */
+void graph_cbuilder_free(
+  graph_cbuilder_t *b /**< the builder */
+);
+
+/**
+ * Appends an edge to the buffer of the given thread. Different threads
+ * may call this function at the same time, as long as they pass
+ * different thread identifiers - e.g. the identifier passed to a
+ * parallel_for function (see util/parallel.h).
+ *
+ * \return 0 on success, non-0 on failure (including if u == v, either
+ * node is out of range, or the thread identifier is out of range).
+ */
+uint8_t graph_cbuilder_add(
+  graph_cbuilder_t *b,      /**< the builder                     */
+  uint16_t          thread, /**< thread identifier, less than the
+                                 number of threads given to
+                                 graph_cbuilder_init             */
+  uint32_t          u,      /**< edge start point                */
+  uint32_t          v,      /**< edge end point                  */
+  float             wt      /**< edge weight                     */
+);
+
+/**
+ * \return the number of edges which have been added to the builder,
+ * including any duplicates.
+ */
+uint64_t graph_cbuilder_num_edges(
+  graph_cbuilder_t *b /**< the builder */
+);
+
+/**
+ * Creates a frozen graph containing every edge which has been added to
+ * the builder, using the given number of threads. The nodes are given
+ * zero labels. The builder is emptied, and may be re-used.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_cbuilder_finalise(
+  graph_cbuilder_t *b,       /**< the builder                         */
+  graph_t          *g,       /**< uninitialised graph struct          */
+  uint16_t          nthreads /**< number of threads (0 for default,
+                                  see util/parallel.h)                */
+);
+
+#endif /* __GRAPH_CBUILDER_H__ */
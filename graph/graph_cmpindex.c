@@ -0,0 +1,277 @@
+/**
+ * An index of the nodes in each component of a graph. See
+ * graph/graph_cmpindex.h for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "graph/graph_cmpindex.h"
+#include "graph/graph_labelidx.h"
+#include "stats/stats_cache.h"
+#include "util/array.h"
+
+/**
+ * The component index of a graph.
+ */
+typedef struct _cmpindex {
+
+  graph_t  *g;       /**< the graph                                   */
+  uint8_t   stale;   /**< non-0 if the graph has changed since the
+                          index was built                             */
+  uint32_t  ncmps;   /**< number of component IDs                     */
+  uint64_t *offsets; /**< start of each component in nodes, with an
+                          extra entry equal to the number of nodes    */
+  uint32_t *nodes;   /**< node IDs, component by component            */
+  uint32_t *lblidxs; /**< label value index of each node              */
+
+  graph_event_listener_t gel; /**< marks the index as stale on edge
+                                   events                          */
+
+} cmpindex_t;
+
+/**
+ * \return the up to date component index of the given graph, building
+ * it if necessary, or NULL on failure.
+ */
+static cmpindex_t *_get_index(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * (Re-)builds the given index from the current state of its graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build(
+  cmpindex_t *ci /**< the index */
+);
+
+/**
+ * Frees the given index - passed to the graph as its ctx_free function.
+ */
+static void _cmpindex_free(
+  void *vci /**< pointer to a cmpindex_t struct */
+);
+
+/**
+ * Edge event callbacks - mark the index as stale.
+ */
+static void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt);
+static void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx);
+static void _edges_rebuilt(graph_t *g, void *ctx);
+
+uint8_t graph_cmpindex_init(graph_t *g) {
+
+  return _get_index(g) == NULL;
+}
+
+void graph_cmpindex_free(graph_t *g) {
+
+  if (g->ctx[_GRAPH_CMPINDEX_CTX_LOC_] == NULL) return;
+
+  _cmpindex_free(g->ctx[_GRAPH_CMPINDEX_CTX_LOC_]);
+
+  g->ctx[     _GRAPH_CMPINDEX_CTX_LOC_] = NULL;
+  g->ctx_free[_GRAPH_CMPINDEX_CTX_LOC_] = NULL;
+}
+
+uint32_t graph_cmpindex_num(graph_t *g) {
+
+  cmpindex_t *ci;
+
+  ci = _get_index(g);
+  if (ci == NULL) return 0;
+
+  return ci->ncmps;
+}
+
+uint8_t graph_cmpindex_nodes(
+  graph_t *g, uint32_t cmp, uint32_t **nodes, uint32_t *nnodes) {
+
+  cmpindex_t *ci;
+
+  ci = _get_index(g);
+  if (ci == NULL) goto fail;
+
+  if (cmp >= ci->ncmps) {
+    *nodes  = ci->nodes;
+    *nnodes = 0;
+    return 0;
+  }
+
+  *nodes  = ci->nodes + ci->offsets[cmp];
+  *nnodes = ci->offsets[cmp + 1] - ci->offsets[cmp];
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint32_t *graph_cmpindex_labelidxs(graph_t *g) {
+
+  cmpindex_t *ci;
+
+  ci = _get_index(g);
+  if (ci == NULL) return NULL;
+
+  return ci->lblidxs;
+}
+
+cmpindex_t *_get_index(graph_t *g) {
+
+  cmpindex_t *ci;
+
+  ci = g->ctx[_GRAPH_CMPINDEX_CTX_LOC_];
+
+  if (ci != NULL) {
+
+    if (!ci->stale) return ci;
+    if (_build(ci)) goto fail;
+
+    return ci;
+  }
+
+  ci = calloc(1, sizeof(cmpindex_t));
+  if (ci == NULL) goto fail;
+
+  ci->g = g;
+
+  if (_build(ci)) goto fail;
+
+  ci->gel.ctx           = ci;
+  ci->gel.edge_added    = _edge_added;
+  ci->gel.edge_removed  = _edge_removed;
+  ci->gel.edges_rebuilt = _edges_rebuilt;
+
+  if (graph_add_event_listener(g, &ci->gel)) {
+    ci->gel.ctx = NULL;
+    goto fail;
+  }
+
+  g->ctx[     _GRAPH_CMPINDEX_CTX_LOC_] = ci;
+  g->ctx_free[_GRAPH_CMPINDEX_CTX_LOC_] = _cmpindex_free;
+
+  return ci;
+
+fail:
+  if (ci != NULL && g->ctx[_GRAPH_CMPINDEX_CTX_LOC_] != ci)
+    _cmpindex_free(ci);
+  return NULL;
+}
+
+uint8_t _build(cmpindex_t *ci) {
+
+  uint64_t  i;
+  uint64_t  c;
+  uint32_t  nnodes;
+  uint32_t  ncmps;
+  uint32_t *cmps;
+  uint32_t *lblidxs;
+  graph_t  *g;
+
+  g      = ci->g;
+  cmps   = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (ci->offsets != NULL) free(ci->offsets);
+  if (ci->nodes   != NULL) free(ci->nodes);
+  if (ci->lblidxs != NULL) free(ci->lblidxs);
+
+  ci->offsets = NULL;
+  ci->nodes   = NULL;
+  ci->lblidxs = NULL;
+  ci->ncmps   = 0;
+  ci->stale   = 1;
+
+  cmps        = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  ci->nodes   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  ci->lblidxs = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (cmps        == NULL) goto fail;
+  if (ci->nodes   == NULL) goto fail;
+  if (ci->lblidxs == NULL) goto fail;
+
+  if (nnodes > 0 && stats_cache_node_component(g, -1, cmps)) goto fail;
+
+  for (i = 0, ncmps = 0; i < nnodes; i++)
+    if (cmps[i] >= ncmps) ncmps = cmps[i] + 1;
+
+  ci->offsets = calloc((uint64_t)ncmps + 2, sizeof(uint64_t));
+  if (ci->offsets == NULL) goto fail;
+
+  /*count the nodes in each component, then place them in order*/
+  for (i = 0; i < nnodes; i++) ci->offsets[cmps[i] + 2]++;
+
+  for (c = 2; c <= ncmps + 1; c++)
+    ci->offsets[c] += ci->offsets[c - 1];
+
+  for (i = 0; i < nnodes; i++)
+    ci->nodes[ci->offsets[cmps[i] + 1]++] = i;
+
+  /*
+   * the label value indices are taken from the
+   * graph's label value index - a node with a
+   * label value which is not in the list has an
+   * index past the end of the list
+   */
+  lblidxs = graph_labelidx_nodes(g);
+  if (lblidxs == NULL) goto fail;
+
+  memcpy(ci->lblidxs, lblidxs, (uint64_t)nnodes * sizeof(uint32_t));
+
+  ci->ncmps = ncmps;
+  ci->stale = 0;
+
+  free(cmps);
+  return 0;
+
+fail:
+  if (cmps != NULL) free(cmps);
+  return 1;
+}
+
+void _cmpindex_free(void *vci) {
+
+  cmpindex_t *ci;
+
+  ci = vci;
+
+  if (ci == NULL) return;
+
+  if (ci->gel.ctx != NULL) graph_remove_event_listener(ci->g, &ci->gel);
+
+  if (ci->offsets != NULL) free(ci->offsets);
+  if (ci->nodes   != NULL) free(ci->nodes);
+  if (ci->lblidxs != NULL) free(ci->lblidxs);
+
+  free(ci);
+}
+
+void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt) {
+
+  ((cmpindex_t *)ctx)->stale = 1;
+}
+
+void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx) {
+
+  ((cmpindex_t *)ctx)->stale = 1;
+}
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  ((cmpindex_t *)ctx)->stale = 1;
+}
@@ -0,0 +1,79 @@
+/**
+ * An index of the nodes in each component of a graph, so that the members
+ * of a component can be retrieved in time proportional to its size,
+ * rather than by scanning every node.
+ *
+ * The index stores the nodes of the graph component by component (in a
+ * compressed sparse row layout), in ascending order of ID within each
+ * component, along with the index of the label value of every node in
+ * graph_get_labelvals(g). Component IDs are as returned by
+ * stats_cache_node_component.
+ *
+ * The index is created the first time that it is needed, with one linear
+ * pass over the nodes, and is attached to the graph (via the graph ctx
+ * fields), so it is reused by later queries, and freed along with the
+ * graph. It listens for edge events on the graph, and is rebuilt on the
+ * next query after an edge has been added or removed; it is discarded
+ * when a node label is changed with graph_set_nodelabel.
+ *
+ * The index is not created in a thread-safe manner - if a graph is to be
+ * queried by several threads, graph_cmpindex_init should be called first.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_CMPINDEX_H__
+#define __GRAPH_CMPINDEX_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Creates (or rebuilds) the component index for the given graph, if it
+ * does not exist, or is out of date.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_cmpindex_init(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Frees the component index of the given graph, if it has one.
+ */
+void graph_cmpindex_free(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return the number of component IDs in the index, i.e. one more than
+ * the highest component ID, or 0 on failure.
+ */
+uint32_t graph_cmpindex_num(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Retrieves the nodes in the given component, in ascending order. The
+ * returned pointer belongs to the index, and is invalidated when the
+ * graph is changed. A component ID which is not in use has no nodes.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_cmpindex_nodes(
+  graph_t   *g,      /**< the graph                                */
+  uint32_t   cmp,    /**< the component                            */
+  uint32_t **nodes,  /**< place to store a pointer to the nodes    */
+  uint32_t  *nnodes  /**< place to store the number of nodes       */
+);
+
+/**
+ * \return the index, in graph_get_labelvals(g), of the label value of
+ * every node, or NULL on failure. The returned pointer belongs to the
+ * index, and is invalidated when the graph is changed.
+ */
+uint32_t *graph_cmpindex_labelidxs(
+  graph_t *g /**< the graph */
+);
+
+#endif /* __GRAPH_CMPINDEX_H__ */
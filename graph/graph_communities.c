@@ -10,17 +10,11 @@
 #include <stdlib.h>
 
 #include "graph/graph.h"
-#include "stats/stats.h"
-#include "stats/stats_cache.h"
+#include "graph/graph_cmpindex.h"
+#include "util/compare.h"
 
 /**
- * Compares two node_group_t structs first by the component number, and then
- * by the label value.
- */
-static int _group_cmp(const void *g1, const void *g2);
-
-/**
- * Compares two node)group_t structs by the number of nodes.
+ * Compares two node_group_t structs by the number of nodes.
  */
 static int _group_size_cmp(const void *g1, const void *g2);
 
@@ -28,43 +22,73 @@ uint8_t graph_communities(graph_t *g, uint32_t sz, array_t *groups) {
   
   uint64_t       i;
   uint64_t       j;
-  int64_t        gidx;
+  uint32_t       c;
+  uint32_t       ncmps;
   uint32_t       nnodes;
+  uint32_t      *nodes;
+  uint32_t      *lblidxs;
   uint32_t      *lblvals;
   uint32_t       nlblvals;
+  uint32_t      *counts;
+  uint32_t      *touched;
+  uint32_t       ntouched;
+  uint32_t       missing;
   node_group_t   group;
-  uint32_t       tmp;
-  
-  nnodes     = graph_num_nodes(g);
-  lblvals    = graph_get_labelvals(g);
-  nlblvals   = graph_num_labelvals(g);
 
-  array_set_cmps(groups, _group_cmp, NULL);
+  counts   = NULL;
+  touched  = NULL;
+  lblvals  = graph_get_labelvals(g);
+  nlblvals = graph_num_labelvals(g);
+  ncmps    = graph_cmpindex_num(g);
+  lblidxs  = graph_cmpindex_labelidxs(g);
 
-  for (i = 0; i < nnodes; i++) {
-    
-    stats_cache_node_component(g, i, &tmp);
-    group.labelval  = graph_get_nodelabel(g, i)->labelval;
-    group.component = tmp;
-
-    gidx = array_find(groups, &group, 1);
-    if (gidx == -1) {
-
-      //lookup labelval index
-      for (j = 0; j < nlblvals; j++) {
-        if (lblvals[j] == group.labelval) break;
-      }
-      
-      group.labelidx = j;
-      group.nnodes   = 1;
-      if (array_insert_sorted(groups, &group, 1, NULL) == 2)
-        goto fail;
+  if (lblidxs == NULL) goto fail;
+
+  counts  = calloc((uint64_t)nlblvals + 1, sizeof(uint32_t));
+  touched = malloc(((uint64_t)nlblvals + 1) * sizeof(uint32_t));
+
+  if (counts  == NULL) goto fail;
+  if (touched == NULL) goto fail;
+
+  /*
+   * Count the nodes with each label in each component.
+   * Groups are created in order of component, and then
+   * label value - label values are sorted, so their
+   * indices are in the same order as the values.
+   */
+  for (c = 0; c < ncmps; c++) {
+
+    if (graph_cmpindex_nodes(g, c, &nodes, &nnodes)) goto fail;
+
+    ntouched = 0;
+    missing  = 0;
+
+    for (i = 0; i < nnodes; i++) {
+
+      j = lblidxs[nodes[i]];
+
+      if (counts[j]++ > 0) continue;
+
+      touched[ntouched++] = j;
+
+      /*a label value which is not in the label value list*/
+      if (j == nlblvals)
+        missing = graph_get_nodelabel(g, nodes[i])->labelval;
     }
-    else {
-      
-      if (array_get(groups, gidx, &group)) goto fail;
-      group.nnodes ++;
-      array_set(groups, gidx, &group);
+
+    qsort(touched, ntouched, sizeof(uint32_t), compare_u32);
+
+    for (i = 0; i < ntouched; i++) {
+
+      j = touched[i];
+
+      group.component = c;
+      group.labelval  = (j < nlblvals) ? lblvals[j] : missing;
+      group.labelidx  = j;
+      group.nnodes    = counts[j];
+      counts[j]       = 0;
+
+      if (array_append(groups, &group)) goto fail;
     }
   }
 
@@ -78,29 +102,16 @@ uint8_t graph_communities(graph_t *g, uint32_t sz, array_t *groups) {
     while (array_remove_by_val(groups, &group, 1) >= 0);
   }
 
+  free(counts);
+  free(touched);
   return 0;
   
 fail:
+  if (counts  != NULL) free(counts);
+  if (touched != NULL) free(touched);
   return 1;
 }
 
-int _group_cmp(const void *g1, const void *g2) {
-
-  node_group_t *ng1;
-  node_group_t *ng2;
-
-  ng1 = (node_group_t *)g1;
-  ng2 = (node_group_t *)g2;
-
-  if      (ng1->component > ng2->component) return 1;
-  else if (ng1->component < ng2->component) return -1;
-
-  if      (ng1->labelval > ng2->labelval) return 1;
-  else if (ng1->labelval < ng2->labelval) return -1;
-
-  return 0;
-}
-
 int _group_size_cmp(const void *g1, const void *g2) {
 
   node_group_t *ng1;
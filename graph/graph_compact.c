@@ -0,0 +1,546 @@
+/**
+ * A compact, read-only adjacency structure. See graph/graph_compact.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_compact.h"
+#include "util/vbyte.h"
+
+/**
+ * Maximum number of bytes used to code a 32 bit gap.
+ */
+#define _MAX_GAP_LEN 5
+
+/**
+ * Ensures that the given array has space for at least need values,
+ * doubling its capacity as necessary.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _reserve(
+  void    **arr,  /**< the array                          */
+  uint64_t  cap,  /**< current capacity                   */
+  uint64_t  need, /**< required capacity                  */
+  size_t    size, /**< size of one value                  */
+  uint64_t *ncap  /**< place to store the new capacity    */
+);
+
+/**
+ * Stores the weight of the given edge.
+ */
+static void _set_weight(
+  graph_compact_t *c,    /**< the compact graph */
+  uint64_t         edge, /**< edge index        */
+  float            wt    /**< weight            */
+);
+
+/**
+ * \return the weight of the given edge.
+ */
+static float _get_weight(
+  graph_compact_t *c,   /**< the compact graph */
+  uint64_t         edge /**< edge index        */
+);
+
+/**
+ * \return non-0 if v is in the neighbour list of u, 0 otherwise.
+ */
+static uint8_t _has_nbr(
+  graph_compact_t *c, /**< the compact graph */
+  uint32_t         u, /**< node to search    */
+  uint32_t         v  /**< node to find      */
+);
+
+uint8_t graph_compact_init(
+  graph_compact_t *c,
+  uint32_t         nnodes,
+  uint8_t          directed,
+  uint8_t          wtbits,
+  float            wtmin,
+  float            wtmax) {
+
+  uint32_t ncodes;
+
+  memset(c, 0, sizeof(graph_compact_t));
+
+  if (wtbits != 0 && wtbits != 8 && wtbits != 16 && wtbits != 32)
+    goto fail;
+  if (wtmax < wtmin) goto fail;
+
+  c->nnodes   = nnodes;
+  c->directed = directed;
+  c->wtbits   = wtbits;
+  c->wtmin    = wtmin;
+  c->wtstep   = 0;
+
+  /*the highest code is reserved for NaN*/
+  if (wtbits == 8 || wtbits == 16) {
+
+    ncodes = (1 << wtbits) - 1;
+    c->wtstep = (wtmax - wtmin) / (ncodes - 1);
+  }
+
+  c->offsets = calloc((uint64_t)nnodes + 1, sizeof(uint64_t));
+  c->blocks  = calloc((uint64_t)nnodes + 1, sizeof(uint64_t));
+
+  if (c->offsets == NULL) goto fail;
+  if (c->blocks  == NULL) goto fail;
+
+  return 0;
+
+fail:
+  graph_compact_free(c);
+  return 1;
+}
+
+uint8_t graph_compact_add_node(
+  graph_compact_t *c, uint32_t *nbrs, float *wts, uint32_t nnbrs) {
+
+  uint64_t i;
+  uint64_t u;
+  uint64_t nblocks;
+  uint64_t cap;
+
+  u = c->nadded;
+
+  if (u >= c->nnodes) goto fail;
+
+  for (i = 1; i < nnbrs; i++) {
+    if (nbrs[i] <= nbrs[i-1]) goto fail;
+  }
+
+  nblocks = (nnbrs + GRAPH_COMPACT_BLOCK - 1) / GRAPH_COMPACT_BLOCK;
+
+  cap = c->blockcap;
+  if (_reserve((void **)&c->firsts, c->blockcap, c->nblocks + nblocks,
+               sizeof(uint32_t), &cap))
+    goto fail;
+  if (_reserve((void **)&c->starts, c->blockcap, c->nblocks + nblocks,
+               sizeof(uint64_t), &cap))
+    goto fail;
+  c->blockcap = cap;
+
+  if (_reserve((void **)&c->data, c->datacap,
+               c->datalen + (uint64_t)nnbrs * _MAX_GAP_LEN,
+               sizeof(uint8_t), &c->datacap))
+    goto fail;
+
+  if (c->wtbits != 0 &&
+      _reserve(&c->wts, c->edgecap, c->offsets[u] + nnbrs,
+               c->wtbits / 8, &c->edgecap))
+    goto fail;
+
+  for (i = 0; i < nnbrs; i++) {
+
+    if (i % GRAPH_COMPACT_BLOCK == 0) {
+      c->firsts[c->nblocks] = nbrs[i];
+      c->starts[c->nblocks] = c->datalen;
+      c->nblocks ++;
+    }
+    else {
+      c->datalen += vbyte_encode(nbrs[i] - nbrs[i-1], c->data + c->datalen);
+    }
+
+    if (c->wtbits != 0)
+      _set_weight(c, c->offsets[u] + i, (wts != NULL) ? wts[i] : 1.0);
+  }
+
+  c->offsets[u+1] = c->offsets[u] + nnbrs;
+  c->blocks [u+1] = c->nblocks;
+  c->nadded ++;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_compact_finalise(graph_compact_t *c) {
+
+  void    *tmp;
+  uint64_t nedges;
+
+  if (c->nadded != c->nnodes) goto fail;
+
+  nedges = c->offsets[c->nnodes];
+
+  /*failure to shrink an array is not an error*/
+  tmp = realloc(c->firsts, (c->nblocks + 1) * sizeof(uint32_t));
+  if (tmp != NULL) c->firsts = tmp;
+
+  tmp = realloc(c->starts, (c->nblocks + 1) * sizeof(uint64_t));
+  if (tmp != NULL) c->starts = tmp;
+
+  tmp = realloc(c->data, c->datalen + 1);
+  if (tmp != NULL) c->data = tmp;
+
+  if (c->wtbits != 0) {
+    tmp = realloc(c->wts, (nedges + 1) * (c->wtbits / 8));
+    if (tmp != NULL) c->wts = tmp;
+  }
+
+  c->blockcap = c->nblocks;
+  c->datacap  = c->datalen;
+  c->edgecap  = nedges;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_compact_create(graph_t *g, graph_compact_t *c, uint8_t wtbits) {
+
+  uint64_t i;
+  uint64_t j;
+  uint32_t nnodes;
+  uint32_t nnbrs;
+  float   *wts;
+  float    wtmin;
+  float    wtmax;
+
+  nnodes = graph_num_nodes(g);
+  wtmin  = 1;
+  wtmax  = 1;
+
+  for (i = 0; i < nnodes && wtbits != 0; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    for (j = 0; j < nnbrs && wts != NULL; j++) {
+
+      if (isnan(wts[j])) continue;
+
+      if (wts[j] < wtmin) wtmin = wts[j];
+      if (wts[j] > wtmax) wtmax = wts[j];
+    }
+  }
+
+  if (graph_compact_init(
+        c, nnodes, graph_is_directed(g), wtbits, wtmin, wtmax))
+    goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (graph_compact_add_node(c,
+                               graph_get_neighbours(g, i),
+                               graph_get_weights(   g, i),
+                               graph_num_neighbours(g, i)))
+      goto fail;
+  }
+
+  if (graph_compact_finalise(c)) goto fail;
+
+  return 0;
+
+fail:
+  graph_compact_free(c);
+  return 1;
+}
+
+void graph_compact_free(graph_compact_t *c) {
+
+  if (c->offsets != NULL) free(c->offsets);
+  if (c->blocks  != NULL) free(c->blocks);
+  if (c->firsts  != NULL) free(c->firsts);
+  if (c->starts  != NULL) free(c->starts);
+  if (c->data    != NULL) free(c->data);
+  if (c->wts     != NULL) free(c->wts);
+
+  memset(c, 0, sizeof(graph_compact_t));
+}
+
+uint64_t graph_compact_size(graph_compact_t *c) {
+
+  uint64_t size;
+
+  size  = sizeof(graph_compact_t);
+  size += 2 * ((uint64_t)c->nnodes + 1) * sizeof(uint64_t);
+  size += c->blockcap * (sizeof(uint32_t) + sizeof(uint64_t));
+  size += c->datacap;
+  size += c->edgecap  * (c->wtbits / 8);
+
+  return size;
+}
+
+uint64_t graph_compact_num_edges(graph_compact_t *c) {
+
+  if (c->directed) return c->offsets[c->nnodes];
+  else             return c->offsets[c->nnodes] / 2;
+}
+
+uint32_t graph_compact_num_neighbours(graph_compact_t *c, uint32_t u) {
+
+  return c->offsets[u+1] - c->offsets[u];
+}
+
+void graph_compact_iter(
+  graph_compact_t *c, uint32_t u, graph_compact_iter_t *it) {
+
+  it->c     = c;
+  it->first = c->offsets[u];
+  it->edge  = c->offsets[u];
+  it->end   = c->offsets[u+1];
+  it->block = c->blocks[u];
+  it->byte  = 0;
+  it->prev  = 0;
+}
+
+uint8_t graph_compact_next(graph_compact_iter_t *it, uint32_t *v, float *wt) {
+
+  uint64_t         b;
+  uint64_t         gap;
+  graph_compact_t *c;
+
+  c = it->c;
+
+  if (it->edge >= it->end) return 0;
+
+  /*the first neighbour of each block is stored as-is*/
+  if ((it->edge - it->first) % GRAPH_COMPACT_BLOCK == 0) {
+
+    b        = it->block + (it->edge - it->first) / GRAPH_COMPACT_BLOCK;
+    it->prev = c->firsts[b];
+    it->byte = c->starts[b];
+  }
+  else {
+    it->byte += vbyte_decode(
+      c->data + it->byte, c->datalen - it->byte, &gap);
+    it->prev += gap;
+  }
+
+  *v = it->prev;
+  if (wt != NULL) *wt = _get_weight(c, it->edge);
+
+  it->edge ++;
+
+  return 1;
+}
+
+uint8_t graph_compact_are_neighbours(
+  graph_compact_t *c, uint32_t u, uint32_t v) {
+
+  if (_has_nbr(c, u, v))                return 1;
+  if (c->directed && _has_nbr(c, v, u)) return 1;
+
+  return 0;
+}
+
+uint8_t graph_compact_bfs(
+  graph_compact_t *c, uint32_t root, uint32_t *dists, uint32_t *queue) {
+
+  uint64_t             i;
+  uint64_t             head;
+  uint64_t             tail;
+  uint32_t             x;
+  uint32_t             y;
+  graph_compact_iter_t it;
+
+  if (root >= c->nnodes) goto fail;
+
+  for (i = 0; i < c->nnodes; i++) dists[i] = GRAPH_COMPACT_NO_PATH;
+
+  dists[root] = 0;
+  queue[0]    = root;
+  head        = 0;
+  tail        = 1;
+
+  while (head < tail) {
+
+    x = queue[head++];
+
+    graph_compact_iter(c, x, &it);
+
+    while (graph_compact_next(&it, &y, NULL)) {
+
+      if (dists[y] != GRAPH_COMPACT_NO_PATH) continue;
+
+      dists[y]      = dists[x] + 1;
+      queue[tail++] = y;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_compact_components(
+  graph_compact_t *c,
+  uint32_t        *components,
+  uint32_t        *ncmps,
+  array_t         *sizes) {
+
+  uint64_t             i;
+  uint64_t             head;
+  uint64_t             tail;
+  uint32_t             x;
+  uint32_t             y;
+  uint32_t             cmp;
+  uint32_t             size;
+  uint32_t            *queue;
+  graph_compact_iter_t it;
+
+  queue = malloc(((uint64_t)c->nnodes + 1) * sizeof(uint32_t));
+  if (queue == NULL) goto fail;
+
+  for (i = 0; i < c->nnodes; i++) components[i] = UINT32_MAX;
+
+  cmp = 0;
+
+  for (i = 0; i < c->nnodes; i++) {
+
+    if (components[i] != UINT32_MAX) continue;
+
+    components[i] = cmp;
+    queue[0]      = i;
+    head          = 0;
+    tail          = 1;
+
+    while (head < tail) {
+
+      x = queue[head++];
+
+      graph_compact_iter(c, x, &it);
+
+      while (graph_compact_next(&it, &y, NULL)) {
+
+        if (components[y] != UINT32_MAX) continue;
+
+        components[y] = cmp;
+        queue[tail++] = y;
+      }
+    }
+
+    size = tail;
+    if (sizes != NULL && array_append(sizes, &size)) goto fail;
+
+    cmp++;
+  }
+
+  *ncmps = cmp;
+
+  free(queue);
+  return 0;
+
+fail:
+  if (queue != NULL) free(queue);
+  return 1;
+}
+
+uint8_t _reserve(
+  void **arr, uint64_t cap, uint64_t need, size_t size, uint64_t *ncap) {
+
+  void *tmp;
+
+  if (need <= cap) {
+    *ncap = cap;
+    return 0;
+  }
+
+  if (cap == 0) cap = 1024;
+  while (cap < need) cap *= 2;
+
+  tmp = realloc(*arr, cap * size);
+  if (tmp == NULL) goto fail;
+
+  *arr  = tmp;
+  *ncap = cap;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _set_weight(graph_compact_t *c, uint64_t edge, float wt) {
+
+  uint32_t ncodes;
+  double   code;
+
+  if (c->wtbits == 32) {
+    ((float *)c->wts)[edge] = wt;
+    return;
+  }
+
+  ncodes = (1 << c->wtbits) - 1;
+
+  if      (isnan(wt))      code = ncodes;
+  else if (c->wtstep == 0) code = 0;
+  else {
+    code = round((wt - c->wtmin) / c->wtstep);
+
+    if (code < 0)          code = 0;
+    if (code > ncodes - 1) code = ncodes - 1;
+  }
+
+  if (c->wtbits == 8) ((uint8_t  *)c->wts)[edge] = code;
+  else                ((uint16_t *)c->wts)[edge] = code;
+}
+
+float _get_weight(graph_compact_t *c, uint64_t edge) {
+
+  uint32_t code;
+
+  switch (c->wtbits) {
+    case 0:  return 1.0;
+    case 32: return ((float *)c->wts)[edge];
+    case 8:  code = ((uint8_t  *)c->wts)[edge]; break;
+    default: code = ((uint16_t *)c->wts)[edge]; break;
+  }
+
+  if (code == (1u << c->wtbits) - 1) return NAN;
+
+  return c->wtmin + code * c->wtstep;
+}
+
+uint8_t _has_nbr(graph_compact_t *c, uint32_t u, uint32_t v) {
+
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t mid;
+  uint64_t e;
+  uint64_t end;
+  uint64_t gap;
+  uint64_t byte;
+  uint32_t prev;
+
+  lo = c->blocks[u];
+  hi = c->blocks[u+1];
+
+  if (lo == hi)          return 0;
+  if (c->firsts[lo] > v) return 0;
+
+  /*find the last block whose first neighbour is not greater than v*/
+  while (hi - lo > 1) {
+
+    mid = lo + (hi - lo) / 2;
+
+    if (c->firsts[mid] <= v) lo = mid;
+    else                     hi = mid;
+  }
+
+  prev = c->firsts[lo];
+  byte = c->starts[lo];
+  e    = c->offsets[u] + (lo - c->blocks[u]) * GRAPH_COMPACT_BLOCK;
+  end  = e + GRAPH_COMPACT_BLOCK;
+
+  if (end > c->offsets[u+1]) end = c->offsets[u+1];
+
+  for (e = e + 1; prev < v && e < end; e++) {
+
+    byte += vbyte_decode(c->data + byte, c->datalen - byte, &gap);
+    prev += gap;
+  }
+
+  return prev == v;
+}
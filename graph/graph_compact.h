@@ -0,0 +1,235 @@
+/**
+ * A compact, read-only adjacency structure for graphs which are too large
+ * to be held as a graph_t. A graph_t stores every edge as a 32 bit
+ * neighbour ID and a 32 bit weight, in both directions; for a whole brain
+ * voxel graph, with hundreds of millions of edges, that is more memory
+ * than is available.
+ *
+ * The neighbour list of each node is split into blocks of
+ * GRAPH_COMPACT_BLOCK neighbours. The first neighbour of each block is
+ * stored as-is, in a skip list which is searched to find the block which
+ * may contain a given neighbour; the remaining neighbours are stored as
+ * the gaps between consecutive neighbours, in variable byte code (see
+ * util/vbyte.h). As the neighbours of a voxel are close to it, most gaps
+ * fit in one or two bytes. Edge weights are optionally quantised to 8 or
+ * 16 bits, evenly spaced between the smallest and largest weight of the
+ * graph.
+ *
+ * Neighbour lists are never decompressed as a whole - they are read one
+ * neighbour at a time with a graph_compact_iter_t, and adjacency queries
+ * decode at most one block.
+ *
+ * A compact graph is built one node at a time, in node order, with
+ * graph_compact_init, graph_compact_add_node and graph_compact_finalise,
+ * so that it can be built straight from a file (see ngdb_read_compact in
+ * io/ngdb_graph.h); or from a graph with graph_compact_create.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_COMPACT_H__
+#define __GRAPH_COMPACT_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Number of neighbours in each block.
+ */
+#define GRAPH_COMPACT_BLOCK 64
+
+/**
+ * Distance which graph_compact_bfs gives to nodes which are not reached.
+ */
+#define GRAPH_COMPACT_NO_PATH 0xFFFFFFFF
+
+/**
+ * A compact graph. The neighbours of node u are edges offsets[u] to
+ * offsets[u+1]-1, and are stored in blocks blocks[u] to blocks[u+1]-1.
+ */
+typedef struct _graph_compact {
+
+  uint32_t  nnodes;   /**< number of nodes                                */
+  uint8_t   directed; /**< non-0 if the graph is directed                 */
+  uint8_t   wtbits;   /**< bits per weight - 0 (no weights, every weight
+                           is 1), 8 or 16 (quantised), or 32 (float)      */
+  float     wtmin;    /**< weight given by quantised code 0               */
+  float     wtstep;   /**< difference between consecutive codes           */
+
+  uint64_t *offsets;  /**< index of the first edge of each node           */
+  uint64_t *blocks;   /**< index of the first block of each node          */
+  uint32_t *firsts;   /**< first neighbour in each block (the skip list)  */
+  uint64_t *starts;   /**< offset of the gaps of each block into data     */
+  uint8_t  *data;     /**< gap-coded neighbours                           */
+  void     *wts;      /**< edge weights, in edge order                    */
+
+  uint32_t  nadded;   /**< number of nodes added so far                   */
+  uint64_t  nblocks;  /**< number of blocks                               */
+  uint64_t  blockcap; /**< capacity of firsts and starts                  */
+  uint64_t  datalen;  /**< number of bytes of data                        */
+  uint64_t  datacap;  /**< capacity of data                               */
+  uint64_t  edgecap;  /**< capacity of wts, in edges                      */
+
+} graph_compact_t;
+
+/**
+ * Iterator over the neighbours of a node.
+ */
+typedef struct _graph_compact_iter {
+
+  graph_compact_t *c;     /**< the graph                      */
+  uint64_t         first; /**< index of the first edge        */
+  uint64_t         edge;  /**< index of the next edge         */
+  uint64_t         end;   /**< index one past the last edge   */
+  uint64_t         block; /**< index of the first block       */
+  uint64_t         byte;  /**< offset of the next gap in data */
+  uint32_t         prev;  /**< last neighbour returned        */
+
+} graph_compact_iter_t;
+
+/**
+ * Initialises an empty compact graph with the given number of nodes.
+ * Weights outside of [wtmin, wtmax] are clamped when they are quantised.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_compact_init(
+  graph_compact_t *c,        /**< uninitialised compact graph  */
+  uint32_t         nnodes,   /**< number of nodes              */
+  uint8_t          directed, /**< directed or undirected       */
+  uint8_t          wtbits,   /**< 0, 8, 16 or 32               */
+  float            wtmin,    /**< smallest edge weight         */
+  float            wtmax     /**< largest edge weight          */
+);
+
+/**
+ * Adds the neighbours of the next node to the given compact graph. Nodes
+ * must be added in order, starting from node 0, and every node must be
+ * added, even if it has no neighbours. For undirected graphs, every edge
+ * must be added in both directions.
+ *
+ * \return 0 on success, non-0 on failure, including if the neighbours are
+ * not in ascending order, or if every node has already been added.
+ */
+uint8_t graph_compact_add_node(
+  graph_compact_t *c,     /**< the compact graph                          */
+  uint32_t        *nbrs,  /**< neighbours, in ascending order             */
+  float           *wts,   /**< weights, or NULL if every weight is 1      */
+  uint32_t         nnbrs  /**< number of neighbours                       */
+);
+
+/**
+ * Releases the unused space in the given compact graph, after every node
+ * has been added.
+ *
+ * \return 0 on success, non-0 if not every node has been added.
+ */
+uint8_t graph_compact_finalise(
+  graph_compact_t *c /**< the compact graph */
+);
+
+/**
+ * Creates a compact copy of the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_compact_create(
+  graph_t         *g,     /**< the graph                       */
+  graph_compact_t *c,     /**< uninitialised compact graph     */
+  uint8_t          wtbits /**< 0, 8, 16 or 32                  */
+);
+
+/**
+ * Frees the memory used by the given compact graph.
+ */
+void graph_compact_free(
+  graph_compact_t *c /**< the compact graph */
+);
+
+/**
+ * \return the number of bytes used by the given compact graph.
+ */
+uint64_t graph_compact_size(
+  graph_compact_t *c /**< the compact graph */
+);
+
+/**
+ * \return the number of edges in the given compact graph - for undirected
+ * graphs, each edge is counted once.
+ */
+uint64_t graph_compact_num_edges(
+  graph_compact_t *c /**< the compact graph */
+);
+
+/**
+ * \return the number of neighbours of node u.
+ */
+uint32_t graph_compact_num_neighbours(
+  graph_compact_t *c, /**< the compact graph */
+  uint32_t         u  /**< the node          */
+);
+
+/**
+ * Initialises the given iterator to iterate over the neighbours of node u.
+ */
+void graph_compact_iter(
+  graph_compact_t      *c,  /**< the compact graph        */
+  uint32_t              u,  /**< the node                 */
+  graph_compact_iter_t *it  /**< the iterator to initialise */
+);
+
+/**
+ * Retrieves the next neighbour from the given iterator, in ascending order.
+ *
+ * \return 1 if a neighbour was retrieved, 0 if there are no more.
+ */
+uint8_t graph_compact_next(
+  graph_compact_iter_t *it, /**< the iterator                         */
+  uint32_t             *v,  /**< place to store the neighbour         */
+  float                *wt  /**< place to store the weight, or NULL   */
+);
+
+/**
+ * \return non-0 if nodes u and v are neighbours, 0 otherwise.
+ */
+uint8_t graph_compact_are_neighbours(
+  graph_compact_t *c, /**< the compact graph */
+  uint32_t         u, /**< first node        */
+  uint32_t         v  /**< second node       */
+);
+
+/**
+ * Breadth first search from the given node. The distance from the root to
+ * every node is stored in dists, with GRAPH_COMPACT_NO_PATH for nodes
+ * which are not reached.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_compact_bfs(
+  graph_compact_t *c,     /**< the compact graph                          */
+  uint32_t         root,  /**< node to start from                         */
+  uint32_t        *dists, /**< place to store nnodes distances            */
+  uint32_t        *queue  /**< space for nnodes values, used as the queue */
+);
+
+/**
+ * Labels the connected components of the given (undirected) compact
+ * graph, with a breadth first search from the lowest unlabelled node,
+ * until every node has been labelled. As with stats_num_components (see
+ * stats/stats.h) with a minimum size of 1, components are numbered from
+ * 0, in order of their lowest node.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_compact_components(
+  graph_compact_t *c,          /**< the compact graph                   */
+  uint32_t        *components, /**< place to store the component of
+                                    every node                          */
+  uint32_t        *ncmps,      /**< place to store the number of
+                                    components                          */
+  array_t         *sizes       /**< NULL, or an array of uint32_t in
+                                    which to store the size of every
+                                    component                           */
+);
+
+#endif /* __GRAPH_COMPACT_H__ */
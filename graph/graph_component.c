@@ -8,34 +8,21 @@
 
 #include "graph/graph.h"
 #include "util/array.h"
-#include "stats/stats.h"
-#include "stats/stats_cache.h"
+#include "graph/graph_cmpindex.h"
 
 uint8_t graph_get_component(graph_t *g, uint32_t cmp, array_t *nodeids) {
 
   uint64_t  i;
   uint32_t  nnodes;
-  uint32_t *cmpnums;
+  uint32_t *nodes;
 
-  cmpnums = NULL;
-  nnodes  = graph_num_nodes(g);
+  if (graph_cmpindex_nodes(g, cmp, &nodes, &nnodes)) goto fail;
 
-  cmpnums = calloc(nnodes, sizeof(uint32_t));
-  if (cmpnums == NULL) goto fail;
+  for (i = 0; i < nnodes; i++)
+    if (array_append(nodeids, nodes + i)) goto fail;
 
-  if (stats_cache_node_component(g, -1, cmpnums)) goto fail;
-
-  for (i = 0; i < nnodes; i++) {
-
-    if (cmpnums[i] != cmp) continue;
-
-    if (array_append(nodeids, &i)) goto fail;
-  }
-
-  free(cmpnums);
   return 0;
 
 fail:
-  if (cmpnums != NULL) free(cmpnums);
-  return -1;
+  return 1;
 }
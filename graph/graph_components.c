@@ -0,0 +1,544 @@
+/**
+ * Incremental tracking of the connected components of an undirected graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "graph/graph_components.h"
+#include "util/array.h"
+#include "util/compare.h"
+
+/**
+ * Marks the end of a component node list.
+ */
+#define GRAPH_COMPONENTS_NONE 0xFFFFFFFF
+
+/**
+ * Identifies the components of the graph from scratch, and builds a
+ * breadth first spanning forest.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build(
+  graph_components_t *gc /**< the tracker */
+);
+
+/**
+ * Sets the size of the given component, updating the component counts and
+ * the largest component size. A size of 0 means that the component no
+ * longer exists.
+ */
+static void _set_size(
+  graph_components_t *gc,  /**< the tracker      */
+  uint32_t            id,  /**< component ID     */
+  uint32_t            size /**< new size         */
+);
+
+/**
+ * Adds node u to the node list of the given component, and sets its
+ * component ID. If its ID has changed, the moved callback is called.
+ */
+static void _list_push(
+  graph_components_t *gc, /**< the tracker  */
+  uint32_t            id, /**< component ID */
+  uint32_t            u   /**< the node     */
+);
+
+/**
+ * Removes node u from the node list of its component.
+ */
+static void _list_remove(
+  graph_components_t *gc, /**< the tracker */
+  uint32_t            u   /**< the node    */
+);
+
+/**
+ * Adds the edge (u, v) to the spanning forest.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _forest_add(
+  graph_components_t *gc, /**< the tracker      */
+  uint32_t            u,  /**< edge start point */
+  uint32_t            v   /**< edge end point   */
+);
+
+/**
+ * Removes the edge (u, v) from the spanning forest, if it is in the forest.
+ *
+ * \return 1 if the edge was in the forest, 0 otherwise.
+ */
+static uint8_t _forest_remove(
+  graph_components_t *gc, /**< the tracker      */
+  uint32_t            u,  /**< edge start point */
+  uint32_t            v   /**< edge end point   */
+);
+
+/**
+ * Called when the forest edge (u, v) has been removed. Searches the two
+ * halves of the tree in lock step, and either finds a replacement edge, or
+ * splits off the smaller half as a new component.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _split(
+  graph_components_t *gc, /**< the tracker      */
+  uint32_t            u,  /**< edge start point */
+  uint32_t            v   /**< edge end point   */
+);
+
+/**
+ * Graph event callback. Merges the components of u and v, if they are
+ * different.
+ */
+static void _edge_added(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the tracker                  */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx, /**< index of v in u's neighbours */
+  float    wt    /**< edge weight                  */
+);
+
+/**
+ * Graph event callback. Splits the component of u and v, if they are no
+ * longer connected.
+ */
+static void _edge_removed(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the tracker                  */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx  /**< index of v in u's neighbours */
+);
+
+/**
+ * Graph event callback. Identifies the components from scratch.
+ */
+static void _edges_rebuilt(
+  graph_t *g,  /**< the graph   */
+  void    *ctx /**< the tracker */
+);
+
+uint8_t graph_components_init(
+  graph_components_t *gc, graph_t *g, uint32_t minsize) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  if (gc == NULL)           return 1;
+  if (graph_is_directed(g)) return 1;
+
+  memset(gc, 0, sizeof(graph_components_t));
+
+  nnodes      = graph_num_nodes(g);
+  gc->g       = g;
+  gc->minsize = minsize;
+
+  gc->cmps    = calloc(nnodes,   sizeof(uint32_t));
+  gc->sizes   = calloc(nnodes,   sizeof(uint32_t));
+  gc->counts  = calloc(nnodes+1, sizeof(uint32_t));
+  gc->heads   = calloc(nnodes,   sizeof(uint32_t));
+  gc->next    = calloc(nnodes,   sizeof(uint32_t));
+  gc->prev    = calloc(nnodes,   sizeof(uint32_t));
+  gc->freeids = calloc(nnodes,   sizeof(uint32_t));
+  gc->queue   = calloc(nnodes,   sizeof(uint32_t));
+  gc->mark    = calloc(nnodes,   sizeof(uint8_t));
+  gc->forest  = calloc(nnodes,   sizeof(array_t));
+
+  if (gc->cmps    == NULL) goto fail;
+  if (gc->sizes   == NULL) goto fail;
+  if (gc->counts  == NULL) goto fail;
+  if (gc->heads   == NULL) goto fail;
+  if (gc->next    == NULL) goto fail;
+  if (gc->prev    == NULL) goto fail;
+  if (gc->freeids == NULL) goto fail;
+  if (gc->queue   == NULL) goto fail;
+  if (gc->mark    == NULL) goto fail;
+  if (gc->forest  == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    if (array_create(gc->forest+i, sizeof(uint32_t), 2)) goto fail;
+    array_set_cmps(gc->forest+i, compare_u32, compare_u32_insert);
+  }
+
+  if (_build(gc)) goto fail;
+
+  gc->gel.ctx           = gc;
+  gc->gel.edge_added    = _edge_added;
+  gc->gel.edge_removed  = _edge_removed;
+  gc->gel.edges_rebuilt = _edges_rebuilt;
+
+  if (graph_add_event_listener(g, &gc->gel)) goto fail;
+
+  return 0;
+
+fail:
+  gc->gel.ctx = NULL;
+  graph_components_free(gc);
+  return 1;
+}
+
+void graph_components_free(graph_components_t *gc) {
+
+  uint64_t i;
+
+  if (gc == NULL) return;
+
+  if (gc->gel.ctx != NULL) graph_remove_event_listener(gc->g, &gc->gel);
+
+  if (gc->forest != NULL) {
+    for (i = 0; i < graph_num_nodes(gc->g); i++) {
+      if (gc->forest[i].data != NULL) array_free(gc->forest+i);
+    }
+    free(gc->forest);
+  }
+
+  if (gc->cmps    != NULL) free(gc->cmps);
+  if (gc->sizes   != NULL) free(gc->sizes);
+  if (gc->counts  != NULL) free(gc->counts);
+  if (gc->heads   != NULL) free(gc->heads);
+  if (gc->next    != NULL) free(gc->next);
+  if (gc->prev    != NULL) free(gc->prev);
+  if (gc->freeids != NULL) free(gc->freeids);
+  if (gc->queue   != NULL) free(gc->queue);
+  if (gc->mark    != NULL) free(gc->mark);
+
+  memset(gc, 0, sizeof(graph_components_t));
+}
+
+void graph_components_on_move(
+  graph_components_t *gc, graph_components_moved_t moved, void *ctx) {
+
+  gc->moved    = moved;
+  gc->movedctx = ctx;
+}
+
+uint32_t graph_components_count(graph_components_t *gc) {
+  return gc->nlarge;
+}
+
+uint32_t graph_components_id(graph_components_t *gc, uint32_t u) {
+  return gc->cmps[u];
+}
+
+uint32_t graph_components_size(graph_components_t *gc, uint32_t u) {
+  return gc->sizes[gc->cmps[u]];
+}
+
+uint32_t graph_components_largest(graph_components_t *gc) {
+  return gc->maxsize;
+}
+
+uint8_t _build(graph_components_t *gc) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  head;
+  uint64_t  tail;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t  id;
+  uint32_t  ni;
+
+  nnodes = graph_num_nodes(gc->g);
+
+  for (i = 0; i < nnodes; i++) array_clear(gc->forest+i);
+
+  memset(gc->sizes,  0, nnodes    *sizeof(uint32_t));
+  memset(gc->counts, 0, (nnodes+1)*sizeof(uint32_t));
+  memset(gc->mark,   0, nnodes    *sizeof(uint8_t));
+
+  gc->ncmps   = 0;
+  gc->nlarge  = 0;
+  gc->maxsize = 0;
+  id          = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (gc->mark[i]) continue;
+
+    gc->heads[id] = GRAPH_COMPONENTS_NONE;
+
+    head              = 0;
+    tail              = 0;
+    gc->queue[tail++] = i;
+    gc->mark[i]       = 1;
+
+    while (head < tail) {
+
+      ni    = gc->queue[head++];
+      nnbrs = graph_num_neighbours(gc->g, ni);
+      nbrs  = graph_get_neighbours(gc->g, ni);
+
+      _list_push(gc, id, ni);
+
+      for (j = 0; j < nnbrs; j++) {
+
+        if (gc->mark[nbrs[j]]) continue;
+
+        gc->mark[nbrs[j]] = 1;
+        gc->queue[tail++] = nbrs[j];
+
+        if (_forest_add(gc, ni, nbrs[j])) goto fail;
+      }
+    }
+
+    _set_size(gc, id, tail);
+    id++;
+  }
+
+  /*the remaining IDs are unused*/
+  gc->nfree = 0;
+  for (i = nnodes; i > id; i--) gc->freeids[gc->nfree++] = i-1;
+
+  memset(gc->mark, 0, nnodes*sizeof(uint8_t));
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _set_size(graph_components_t *gc, uint32_t id, uint32_t size) {
+
+  uint32_t old;
+
+  old = gc->sizes[id];
+
+  if (old > 0) {
+    gc->counts[old]--;
+    gc->ncmps--;
+    if (old >= gc->minsize) gc->nlarge--;
+  }
+
+  if (size > 0) {
+    gc->counts[size]++;
+    gc->ncmps++;
+    if (size >= gc->minsize) gc->nlarge++;
+  }
+
+  gc->sizes[id] = size;
+
+  if (size > gc->maxsize) gc->maxsize = size;
+
+  while (gc->maxsize > 0 && gc->counts[gc->maxsize] == 0) gc->maxsize--;
+}
+
+void _list_push(graph_components_t *gc, uint32_t id, uint32_t u) {
+
+  uint32_t old;
+
+  old         = gc->cmps[u];
+  gc->cmps[u] = id;
+  gc->prev[u] = GRAPH_COMPONENTS_NONE;
+  gc->next[u] = gc->heads[id];
+
+  if (gc->heads[id] != GRAPH_COMPONENTS_NONE) gc->prev[gc->heads[id]] = u;
+
+  gc->heads[id] = u;
+
+  if (gc->moved != NULL && old != id) gc->moved(gc->movedctx, u, old, id);
+}
+
+void _list_remove(graph_components_t *gc, uint32_t u) {
+
+  uint32_t p;
+  uint32_t n;
+
+  p = gc->prev[u];
+  n = gc->next[u];
+
+  if (p != GRAPH_COMPONENTS_NONE) gc->next[p]            = n;
+  else                            gc->heads[gc->cmps[u]] = n;
+  if (n != GRAPH_COMPONENTS_NONE) gc->prev[n]            = p;
+}
+
+uint8_t _forest_add(graph_components_t *gc, uint32_t u, uint32_t v) {
+
+  if (array_insert_sorted(gc->forest+u, &v, 1, NULL) == 2) goto fail;
+  if (array_insert_sorted(gc->forest+v, &u, 1, NULL) == 2) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _forest_remove(graph_components_t *gc, uint32_t u, uint32_t v) {
+
+  if (array_remove_by_val(gc->forest+u, &v, 1) < 0) return 0;
+
+  array_remove_by_val(gc->forest+v, &u, 1);
+
+  return 1;
+}
+
+uint8_t _split(graph_components_t *gc, uint32_t u, uint32_t v) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  side;
+  uint64_t  small;
+  uint64_t  head[2];
+  uint64_t  tail[2];
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t *tree;
+  uint32_t  ntree;
+  uint32_t  ni;
+  uint32_t  id;
+  uint32_t  oldid;
+  uint32_t  size;
+
+  nnodes = graph_num_nodes(gc->g);
+
+  /*
+   * The halves are disjoint, so the u half is queued
+   * from the start of the queue, and the v half from
+   * the end. Queue positions are given by qpos.
+   */
+#define qpos(s, k) ((s) == 0 ? (k) : nnodes - 1 - (k))
+
+  head[0] = 0; tail[0] = 0;
+  head[1] = 0; tail[1] = 0;
+
+  gc->queue[qpos(0, tail[0]++)] = u;
+  gc->queue[qpos(1, tail[1]++)] = v;
+  gc->mark[u]                   = 1;
+  gc->mark[v]                   = 2;
+
+  /*expand one node from each half in turn*/
+  for (side = 0; ; side = 1 - side) {
+
+    if (head[side] == tail[side]) break;
+
+    ni    = gc->queue[qpos(side, head[side]++)];
+    ntree = gc->forest[ni].size;
+    tree  = (uint32_t *)gc->forest[ni].data;
+
+    for (j = 0; j < ntree; j++) {
+
+      if (gc->mark[tree[j]]) continue;
+
+      gc->mark[tree[j]]                   = side+1;
+      gc->queue[qpos(side, tail[side]++)] = tree[j];
+    }
+  }
+
+  small = side;
+
+  /*look for an edge leaving the smaller half*/
+  for (i = 0; i < tail[small]; i++) {
+
+    ni    = gc->queue[qpos(small, i)];
+    nnbrs = graph_num_neighbours(gc->g, ni);
+    nbrs  = graph_get_neighbours(gc->g, ni);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (gc->mark[nbrs[j]] == small+1) continue;
+
+      if (_forest_add(gc, ni, nbrs[j])) goto fail;
+      goto done;
+    }
+  }
+
+  /*no replacement - the smaller half is a new component*/
+  oldid         = gc->cmps[u];
+  id            = gc->freeids[--gc->nfree];
+  size          = tail[small];
+  gc->heads[id] = GRAPH_COMPONENTS_NONE;
+
+  for (i = 0; i < size; i++) {
+
+    ni = gc->queue[qpos(small, i)];
+
+    _list_remove(gc, ni);
+    _list_push(  gc, id, ni);
+  }
+
+  _set_size(gc, oldid, gc->sizes[oldid] - size);
+  _set_size(gc, id,    size);
+
+done:
+  for (side = 0; side < 2; side++) {
+    for (i = 0; i < tail[side]; i++)
+      gc->mark[gc->queue[qpos(side, i)]] = 0;
+  }
+
+#undef qpos
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt) {
+
+  graph_components_t *gc;
+  uint32_t            big;
+  uint32_t            small;
+  uint32_t            ni;
+  uint32_t            nj;
+
+  gc = ctx;
+
+  if (gc->cmps[u] == gc->cmps[v]) return;
+
+  big   = gc->cmps[u];
+  small = gc->cmps[v];
+
+  if (gc->sizes[small] > gc->sizes[big]) {
+    big   = gc->cmps[v];
+    small = gc->cmps[u];
+  }
+
+  /*the nodes of the smaller component are moved into the larger*/
+  for (ni = gc->heads[small]; ni != GRAPH_COMPONENTS_NONE; ni = nj) {
+    nj = gc->next[ni];
+    _list_push(gc, big, ni);
+  }
+
+  _set_size(gc, big,   gc->sizes[big] + gc->sizes[small]);
+  _set_size(gc, small, 0);
+
+  gc->heads[small]         = GRAPH_COMPONENTS_NONE;
+  gc->freeids[gc->nfree++] = small;
+
+  _forest_add(gc, u, v);
+}
+
+void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx) {
+
+  graph_components_t *gc;
+
+  gc = ctx;
+
+  if (!_forest_remove(gc, u, v)) return;
+
+  /*
+   * on failure, the forest is no longer
+   * valid, so everything is recalculated
+   */
+  if (_split(gc, u, v)) _build(gc);
+}
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  _build(ctx);
+}
@@ -0,0 +1,152 @@
+/**
+ * Incremental tracking of the connected components of an undirected graph.
+ * A graph_components_t listens for edge events on its graph (see
+ * graph_event.h), and keeps the component membership of every node, the
+ * size of every component, and the number of components, up to date as
+ * edges are added and removed, so they can be queried in constant time.
+ *
+ * A spanning forest of the graph is maintained alongside the components:
+ *
+ * - Adding an edge between two components merges them, relabelling the
+ *   nodes of the smaller component; the edge joins the forest.
+ *
+ * - Removing an edge which is not in the forest does not change anything.
+ *
+ * - Removing a forest edge (u, v) splits its tree in two. The two halves
+ *   are searched in lock step, from u and from v, until the smaller one
+ *   has been exhausted. The edges of the smaller half are then scanned for
+ *   a replacement edge which reconnects the halves; if there is none, the
+ *   smaller half becomes a new component.
+ *
+ * So the cost of an update is proportional to the size of the smaller of
+ * the affected components or tree halves, rather than to the size of the
+ * graph. Component IDs are in the range [0, graph_num_nodes(g)), and the
+ * IDs of removed components are re-used. Initially, components are
+ * numbered in order of their lowest node, in the same way as by
+ * stats_num_components, but the numbering diverges as the graph is edited.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_COMPONENTS_H__
+#define __GRAPH_COMPONENTS_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "util/array.h"
+
+/**
+ * Function which is called whenever a node is moved from one component to
+ * another, after the component ID of the node has been changed. The sizes
+ * of the components may not yet have been updated.
+ */
+typedef void (*graph_components_moved_t)(
+  void    *ctx,  /**< context pointer passed to graph_components_on_move */
+  uint32_t u,    /**< the node                                           */
+  uint32_t from, /**< old component ID                                   */
+  uint32_t to    /**< new component ID                                   */
+);
+
+/**
+ * Component tracker handle.
+ */
+typedef struct _graph_components {
+
+  graph_t  *g;       /**< the graph                                   */
+  uint32_t  minsize; /**< minimum size of a component for it to be
+                          counted by graph_components_count           */
+  uint32_t  ncmps;   /**< total number of components                 */
+  uint32_t  nlarge;  /**< number of components with at least
+                          minsize nodes                               */
+  uint32_t  maxsize; /**< size of the largest component              */
+  uint32_t *cmps;    /**< component ID of each node                  */
+  uint32_t *sizes;   /**< size of each component, indexed by ID      */
+  uint32_t *counts;  /**< number of components of each size          */
+  uint32_t *heads;   /**< first node of each component, indexed by ID */
+  uint32_t *next;    /**< next node in the same component            */
+  uint32_t *prev;    /**< previous node in the same component        */
+  uint32_t *freeids; /**< stack of unused component IDs              */
+  uint32_t  nfree;   /**< number of unused component IDs             */
+  array_t  *forest;  /**< sorted spanning forest neighbours of each
+                          node                                        */
+  uint32_t *queue;   /**< search workspace                           */
+  uint8_t  *mark;    /**< search workspace                           */
+
+  graph_components_moved_t  moved;    /**< called when a node changes
+                                           component (may be NULL) */
+  void                     *movedctx; /**< passed to moved          */
+
+  graph_event_listener_t gel; /**< listens for edge additions and
+                                   removals on the graph              */
+
+} graph_components_t;
+
+/**
+ * Identifies the components of the given graph, which must be undirected,
+ * and starts tracking them.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t graph_components_init(
+  graph_components_t *gc,     /**< tracker to initialise              */
+  graph_t            *g,      /**< the graph                          */
+  uint32_t            minsize /**< components with fewer nodes than
+                                   this are not counted by
+                                   graph_components_count             */
+);
+
+/**
+ * Stops tracking components, and frees the memory used by the tracker.
+ * The graph is not affected.
+ */
+void graph_components_free(
+  graph_components_t *gc /**< the tracker */
+);
+
+/**
+ * Registers a function which is called whenever a node is moved from one
+ * component to another, so that other structures can follow the
+ * components without recalculating them. Only one function may be
+ * registered at a time; passing NULL removes it.
+ */
+void graph_components_on_move(
+  graph_components_t       *gc,    /**< the tracker              */
+  graph_components_moved_t  moved, /**< function to call, or NULL */
+  void                     *ctx    /**< passed to the function    */
+);
+
+/**
+ * \return the number of components with at least minsize nodes (see
+ * graph_components_init). This is the same as the value returned by
+ * stats_num_components, for the same minimum size.
+ */
+uint32_t graph_components_count(
+  graph_components_t *gc /**< the tracker */
+);
+
+/**
+ * \return the ID of the component containing node u.
+ */
+uint32_t graph_components_id(
+  graph_components_t *gc, /**< the tracker */
+  uint32_t            u   /**< the node    */
+);
+
+/**
+ * \return the number of nodes in the component containing node u.
+ */
+uint32_t graph_components_size(
+  graph_components_t *gc, /**< the tracker */
+  uint32_t            u   /**< the node    */
+);
+
+/**
+ * \return the number of nodes in the largest component.
+ */
+uint32_t graph_components_largest(
+  graph_components_t *gc /**< the tracker */
+);
+
+#endif /* __GRAPH_COMPONENTS_H__ */
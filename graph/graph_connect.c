@@ -12,6 +12,8 @@
 
 #include "graph/bfs.h"
 #include "graph/graph.h"
+#include "util/rng.h"
+#include "util/compare.h"
 
 /**
  * Breadth first search context.
@@ -34,6 +36,26 @@ static uint8_t _bfs_cb(
   void        *context /**< pointer to a ctx_t struct */
 );
 
+/**
+ * \return the root of the tree which contains group member u, halving the
+ * path to it along the way.
+ */
+static uint32_t _find(
+  uint32_t *parent, /**< disjoint set forest */
+  uint32_t  u       /**< the group member    */
+);
+
+/**
+ * \return the position of the given node in the group, or -1 if it is not
+ * in the group.
+ */
+static int64_t _group_idx(
+  uint64_t *sorted, /**< group node IDs, each shifted up 32 bits and
+                         combined with its position, in ascending order */
+  uint32_t  ngroup, /**< number of nodes in the group                   */
+  uint32_t  node    /**< node to search for                             */
+);
+
 
 uint8_t graph_are_connected(graph_t *g, uint32_t *group, uint32_t ngroup) {
 
@@ -101,26 +123,105 @@ static uint8_t _bfs_cb(bfs_state_t *state, void *context) {
 
 uint8_t graph_connect(graph_t *g, uint32_t *group, uint32_t ngroup) {
 
-  uint64_t i;
-  uint64_t j;
+  uint64_t  i;
+  uint64_t  j;
+  int64_t   k;
+  uint32_t  ri;
+  uint32_t  rj;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t  nsets;
+  uint32_t *parent;
+  uint32_t *sizes;
+  uint64_t *sorted;
+
+  parent = NULL;
+  sizes  = NULL;
+  sorted = NULL;
 
-  /* add edges at random until the group is connected */
   printf("              ");
-  while (!graph_are_connected(g, group, ngroup)) {
 
-    i = (uint32_t)(rand() * ((double)ngroup / RAND_MAX));
-    j = i;
+  if (ngroup <= 1) return 0;
+
+  parent = malloc(ngroup * sizeof(uint32_t));
+  sizes  = malloc(ngroup * sizeof(uint32_t));
+  sorted = malloc(ngroup * sizeof(uint64_t));
+
+  if (parent == NULL) goto fail;
+  if (sizes  == NULL) goto fail;
+  if (sorted == NULL) goto fail;
+
+  for (i = 0; i < ngroup; i++) {
+    parent[i] = i;
+    sizes [i] = 1;
+    sorted[i] = ((uint64_t)group[i] << 32) | i;
+  }
+
+  qsort(sorted, ngroup, sizeof(uint64_t), compare_u64);
+
+  /*
+   * Join the group members which are already
+   * connected by an edge in the graph.
+   */
+  nsets = ngroup;
+  for (i = 0; i < ngroup; i++) {
+
+    nnbrs = graph_num_neighbours(g, group[i]);
+    nbrs  = graph_get_neighbours(g, group[i]);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      k = _group_idx(sorted, ngroup, nbrs[j]);
+      if (k < 0) continue;
+
+      ri = _find(parent, i);
+      rj = _find(parent, k);
+
+      if (ri == rj) continue;
+
+      if (sizes[ri] < sizes[rj]) { k = ri; ri = rj; rj = k; }
 
-    while (j == i) 
-      j = (uint32_t)(rand() * ((double)ngroup / RAND_MAX));
+      parent[rj]  = ri;
+      sizes[ri]  += sizes[rj];
+      nsets--;
+    }
+  }
+
+  /*
+   * Add random edges between members of different
+   * sets until there is only one set left. Pairs in
+   * the same set would not change the connectivity,
+   * so they are rejected, rather than added.
+   */
+  while (nsets > 1) {
+
+    i = rng_range(rng_default(), ngroup);
+    j = rng_range(rng_default(), ngroup);
+
+    ri = _find(parent, i);
+    rj = _find(parent, j);
+
+    if (ri == rj) continue;
 
     if (graph_add_edge(g, group[i], group[j], 1))
       goto fail;
+
+    if (sizes[ri] < sizes[rj]) { k = ri; ri = rj; rj = k; }
+
+    parent[rj]  = ri;
+    sizes[ri]  += sizes[rj];
+    nsets--;
   }
-  
+
+  free(parent);
+  free(sizes);
+  free(sorted);
   return 0;
   
 fail:
+  if (parent != NULL) free(parent);
+  if (sizes  != NULL) free(sizes);
+  if (sorted != NULL) free(sorted);
   return 1;
 }
 
@@ -148,3 +249,36 @@ fail:
 
   return 1;
 }
+
+uint32_t _find(uint32_t *parent, uint32_t u) {
+
+  while (parent[u] != u) {
+    parent[u] = parent[parent[u]];
+    u         = parent[u];
+  }
+
+  return u;
+}
+
+int64_t _group_idx(uint64_t *sorted, uint32_t ngroup, uint32_t node) {
+
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t mid;
+  uint32_t val;
+
+  lo = 0;
+  hi = ngroup;
+
+  while (lo < hi) {
+
+    mid = lo + (hi - lo) / 2;
+    val = sorted[mid] >> 32;
+
+    if      (val < node) lo = mid + 1;
+    else if (val > node) hi = mid;
+    else                 return sorted[mid] & 0xFFFFFFFF;
+  }
+
+  return -1;
+}
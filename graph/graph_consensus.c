@@ -0,0 +1,419 @@
+/**
+ * Consensus clustering over the edges of a graph. See graph_consensus.h.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "graph/graph_consensus.h"
+#include "graph/graph_louvain.h"
+#include "graph/graph_reorder.h"
+#include "util/edge_array.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/rng.h"
+
+/**
+ * Number of nodes processed at a time by each thread.
+ */
+#define CONSENSUS_CHUNK 1024
+
+/**
+ * State shared by the co-assignment threads.
+ */
+typedef struct _consensus_ctx {
+
+  graph_t      *g;        /**< the graph                                */
+  uint32_t      nparts;   /**< number of partitions                     */
+  uint32_t    **parts;    /**< the partitions                           */
+  uint32_t      mincount; /**< smallest co-assignment count which is
+                               above the threshold                      */
+  edge_array_t  counts;   /**< co-assignment count (uint32_t) of every
+                               edge                                     */
+  uint32_t     *keep;     /**< for a node with no edges above the
+                               threshold, the neighbour which it was
+                               most often co-assigned with - UINT32_MAX
+                               for every other node                     */
+  uint32_t     *comms;    /**< per-thread space for the communities of
+                               one node in every partition              */
+
+} consensus_ctx_t;
+
+/**
+ * parallel_reduce function which counts the co-assignments of every edge
+ * of the nodes in the given range.
+ *
+ * \return 0.
+ */
+static uint8_t _coassign(
+  uint64_t  start,  /**< first node                        */
+  uint64_t  end,    /**< one past the last node            */
+  uint16_t  thread, /**< calling thread                    */
+  void     *ctx,    /**< pointer to a consensus_ctx_t      */
+  double   *nmixed  /**< place to store the number of edges
+                         on which the partitions disagree  */
+);
+
+/**
+ * Creates the consensus graph - the edges of the input graph which are
+ * above the threshold (or are kept to stop a node from being isolated),
+ * weighted by their fraction of co-assignments.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build(
+  consensus_ctx_t *ctx, /**< the co-assignment counts      */
+  graph_t         *cg   /**< uninitialised graph to create */
+);
+
+/**
+ * Renumbers the given communities in order of their lowest node.
+ *
+ * \return the number of communities, or 0 on failure.
+ */
+static uint32_t _renumber(
+  uint32_t  nnodes, /**< number of nodes            */
+  uint32_t *comms   /**< community of every node    */
+);
+
+uint8_t graph_louvain_shuffled(
+  graph_t  *g,
+  uint8_t   weighted,
+  uint16_t  nthreads,
+  rng_t    *rng,
+  uint32_t *communities,
+  uint32_t *ncomms) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  tmp;
+  uint32_t  nnodes;
+  uint32_t *perm;
+  uint32_t *pcomms;
+  graph_t   pg;
+
+  perm   = NULL;
+  pcomms = NULL;
+  nnodes = graph_num_nodes(g);
+
+  memset(&pg, 0, sizeof(graph_t));
+
+  perm   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  pcomms = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (perm   == NULL) goto fail;
+  if (pcomms == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) perm[i] = i;
+
+  for (i = nnodes; i > 1; i--) {
+
+    j         = rng_range(rng, i);
+    tmp       = perm[i - 1];
+    perm[i-1] = perm[j];
+    perm[j]   = tmp;
+  }
+
+  if (graph_reorder(g, &pg, perm)) goto fail;
+
+  if (graph_louvain(&pg, weighted, nthreads, pcomms, ncomms, NULL)) {
+    graph_free(&pg);
+    goto fail;
+  }
+
+  graph_free(&pg);
+
+  for (i = 0; i < nnodes; i++) communities[perm[i]] = pcomms[i];
+
+  if (nnodes > 0 && _renumber(nnodes, communities) == 0) goto fail;
+
+  free(perm);
+  free(pcomms);
+  return 0;
+
+fail:
+  if (perm   != NULL) free(perm);
+  if (pcomms != NULL) free(pcomms);
+  return 1;
+}
+
+uint8_t graph_consensus(
+  graph_t   *g,
+  uint32_t   nparts,
+  uint32_t **parts,
+  double     tau,
+  uint32_t   maxiters,
+  uint16_t   nthreads,
+  rng_t     *rng,
+  uint32_t  *communities,
+  uint32_t  *ncomms,
+  uint32_t  *niters) {
+
+  uint64_t        i;
+  uint32_t        iter;
+  uint32_t        nnodes;
+  uint32_t        k;
+  double          nmixed;
+  uint8_t         built;
+  graph_t         cg;
+  consensus_ctx_t ctx;
+
+  PROFILE_FUNC();
+
+  memset(&ctx, 0, sizeof(consensus_ctx_t));
+  memset(&cg,  0, sizeof(graph_t));
+  built = 0;
+
+  if (graph_is_directed(g)) goto fail;
+  if (nparts == 0)          goto fail;
+  if (tau <= 0 || tau > 1)  goto fail;
+
+  nnodes = graph_num_nodes(g);
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads == 0)                    nthreads = 1;
+
+  ctx.g        = g;
+  ctx.nparts   = nparts;
+  ctx.parts    = parts;
+  ctx.mincount = ceil(tau * nparts - 1e-9);
+  ctx.keep     = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  ctx.comms    = malloc((uint64_t)nthreads * nparts * sizeof(uint32_t));
+
+  if (ctx.mincount == 0) ctx.mincount = 1;
+
+  if (ctx.keep  == NULL)                                  goto fail;
+  if (ctx.comms == NULL)                                  goto fail;
+  if (edge_array_create(g, sizeof(uint32_t), &ctx.counts)) goto fail;
+
+  /*
+   * each iteration counts the co-assignments of
+   * the current partitions, and stops if they
+   * all agree, or re-clusters the consensus graph
+   * to give the next set of partitions
+   */
+  for (iter = 0; iter < maxiters; iter++) {
+
+    nmixed = 0;
+    if (parallel_reduce(
+          nthreads, nnodes, CONSENSUS_CHUNK, &ctx, _coassign, &nmixed))
+      goto fail;
+
+    if (nmixed == 0) break;
+
+    if (_build(&ctx, &cg)) goto fail;
+    built = 1;
+
+    for (i = 0; i < nparts; i++) {
+      if (graph_louvain_shuffled(&cg, 1, nthreads, rng, parts[i], &k))
+        goto fail;
+    }
+
+    graph_free(&cg);
+    built = 0;
+  }
+
+  memcpy(communities, parts[0], nnodes * sizeof(uint32_t));
+
+  *ncomms = 0;
+  if (nnodes > 0) {
+    *ncomms = _renumber(nnodes, communities);
+    if (*ncomms == 0) goto fail;
+  }
+
+  if (niters != NULL) *niters = iter;
+
+  edge_array_free(&ctx.counts);
+  free(ctx.keep);
+  free(ctx.comms);
+  return 0;
+
+fail:
+  if (built)                graph_free(&cg);
+  if (ctx.counts.g != NULL) edge_array_free(&ctx.counts);
+  if (ctx.keep     != NULL) free(ctx.keep);
+  if (ctx.comms    != NULL) free(ctx.comms);
+  return 1;
+}
+
+uint8_t _coassign(
+  uint64_t  start,
+  uint64_t  end,
+  uint16_t  thread,
+  void     *vctx,
+  double   *nmixed) {
+
+  uint64_t         u;
+  uint64_t         i;
+  uint64_t         r;
+  uint32_t         v;
+  uint32_t         nnbrs;
+  uint32_t        *nbrs;
+  uint32_t        *counts;
+  uint32_t        *comms;
+  uint32_t         c;
+  uint32_t         maxc;
+  uint8_t          above;
+  consensus_ctx_t *ctx;
+
+  ctx     = vctx;
+  comms   = ctx->comms + (uint64_t)thread * ctx->nparts;
+  *nmixed = 0;
+
+  for (u = start; u < end; u++) {
+
+    nnbrs  = graph_num_neighbours(ctx->g, u);
+    nbrs   = graph_get_neighbours(ctx->g, u);
+    counts = edge_array_get_all(&ctx->counts, u);
+    above  = 0;
+    maxc   = 0;
+
+    ctx->keep[u] = UINT32_MAX;
+
+    /*the communities of u are compared against every neighbour*/
+    for (r = 0; r < ctx->nparts; r++) comms[r] = ctx->parts[r][u];
+
+    for (i = 0; i < nnbrs; i++) {
+
+      v = nbrs[i];
+      c = 0;
+
+      for (r = 0; r < ctx->nparts; r++)
+        c += (ctx->parts[r][v] == comms[r]);
+
+      counts[i] = c;
+
+      if (c > 0 && c < ctx->nparts) *nmixed += 1;
+      if (c >= ctx->mincount)       above    = 1;
+
+      if (c > maxc) {
+        maxc         = c;
+        ctx->keep[u] = v;
+      }
+    }
+
+    if (above) ctx->keep[u] = UINT32_MAX;
+  }
+
+  return 0;
+}
+
+uint8_t _build(consensus_ctx_t *ctx, graph_t *cg) {
+
+  uint64_t         u;
+  uint64_t         i;
+  uint32_t         v;
+  uint32_t         n;
+  uint32_t         nnodes;
+  uint32_t         nnbrs;
+  uint32_t         maxnbrs;
+  uint32_t        *nbrs;
+  uint32_t        *counts;
+  uint32_t        *cnbrs;
+  double          *cwts;
+  graph_builder_t  b;
+
+  cnbrs   = NULL;
+  cwts    = NULL;
+  nnodes  = graph_num_nodes(ctx->g);
+  maxnbrs = 0;
+
+  memset(&b, 0, sizeof(graph_builder_t));
+
+  for (u = 0; u < nnodes; u++) {
+    nnbrs = graph_num_neighbours(ctx->g, u);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  cnbrs = malloc(((uint64_t)maxnbrs + 1) * sizeof(uint32_t));
+  cwts  = malloc(((uint64_t)maxnbrs + 1) * sizeof(double));
+
+  if (cnbrs == NULL)                   goto fail;
+  if (cwts  == NULL)                   goto fail;
+  if (graph_create(cg, nnodes, 0))     goto fail;
+  if (graph_builder_init(&b, cg, 0))   goto fail;
+
+  /*
+   * an edge kept for either of its end points is
+   * kept for both, so the neighbour lists are
+   * symmetric
+   */
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs  = graph_num_neighbours(ctx->g, u);
+    nbrs   = graph_get_neighbours(ctx->g, u);
+    counts = edge_array_get_all(&ctx->counts, u);
+
+    for (i = 0, n = 0; i < nnbrs; i++) {
+
+      v = nbrs[i];
+
+      if (counts[i] == 0) continue;
+
+      if (counts[i] >= ctx->mincount ||
+          ctx->keep[u] == v          ||
+          ctx->keep[v] == u) {
+
+        cnbrs[n] = v;
+        cwts[ n] = (double)counts[i] / ctx->nparts;
+        n++;
+      }
+    }
+
+    if (graph_builder_set_neighbours(&b, u, n, cnbrs, cwts)) goto fail;
+  }
+
+  if (graph_builder_finalise(&b)) goto fail;
+
+  graph_builder_free(&b);
+  free(cnbrs);
+  free(cwts);
+  return 0;
+
+fail:
+  if (b.g != NULL) {
+    graph_builder_free(&b);
+    graph_free(cg);
+    memset(cg, 0, sizeof(graph_t));
+  }
+  if (cnbrs != NULL) free(cnbrs);
+  if (cwts  != NULL) free(cwts);
+  return 1;
+}
+
+uint32_t _renumber(uint32_t nnodes, uint32_t *comms) {
+
+  uint64_t  i;
+  uint32_t  k;
+  uint32_t  maxc;
+  uint32_t *map;
+
+  maxc = 0;
+  for (i = 0; i < nnodes; i++) {
+    if (comms[i] > maxc) maxc = comms[i];
+  }
+
+  map = malloc(((uint64_t)maxc + 1) * sizeof(uint32_t));
+  if (map == NULL) goto fail;
+
+  for (i = 0; i <= maxc; i++) map[i] = UINT32_MAX;
+
+  for (i = 0, k = 0; i < nnodes; i++) {
+
+    if (map[comms[i]] == UINT32_MAX) map[comms[i]] = k++;
+
+    comms[i] = map[comms[i]];
+  }
+
+  free(map);
+  return k;
+
+fail:
+  return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Consensus clustering - combines a set of partitions of a graph (e.g. the
+ * results of several community detection runs, or of runs at different
+ * thresholds) into one partition which is stable across them:
+ *
+ *   Lancichinetti A & Fortunato S 2012. Consensus clustering in complex
+ *   networks. Scientific Reports 2:336
+ *
+ * The co-assignment count of a pair of nodes is the number of partitions
+ * which put them in the same community. Rather than for every pair of
+ * nodes, which needs O(N^2) memory, the counts are only accumulated for
+ * the pairs which are joined by an edge of the graph, in an edge_array_t,
+ * in parallel over the nodes. Edges whose fraction of co-assignments is
+ * below a threshold are discarded, and the remaining edges, weighted by
+ * their fractions, form a consensus graph. A node which would be left
+ * with no edges keeps the edge to the neighbour it was most often
+ * co-assigned with. The consensus graph is re-clustered several times
+ * with the Louvain method (see graph_louvain.h), each time with its nodes
+ * in a different random order, which gives a new set of partitions. This
+ * is repeated until every partition agrees on every edge - each edge is
+ * co-assigned by all of the partitions, or by none of them.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_CONSENSUS_H__
+#define __GRAPH_CONSENSUS_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "util/rng.h"
+
+/**
+ * Default co-assignment threshold.
+ */
+#define CONSENSUS_TAU 0.5
+
+/**
+ * Default maximum number of iterations.
+ */
+#define CONSENSUS_MAX_ITERS 20
+
+/**
+ * Partitions the nodes of the given graph with the Louvain method (see
+ * graph_louvain), with the nodes renumbered in a random order drawn from
+ * the given generator. Communities are numbered from 0, in order of their
+ * lowest node.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_louvain_shuffled(
+  graph_t  *g,           /**< the graph                               */
+  uint8_t   weighted,    /**< non-0 to use edge weights               */
+  uint16_t  nthreads,    /**< number of threads (0 to use all CPUs)   */
+  rng_t    *rng,         /**< random number generator                 */
+  uint32_t *communities, /**< place to store the community of each
+                              node - must be of length num_nodes      */
+  uint32_t *ncomms       /**< place to store the number of
+                              communities                             */
+);
+
+/**
+ * Finds the consensus of the given partitions of the given graph, which
+ * must be undirected. If the partitions have not agreed after the given
+ * number of iterations, the first partition of the last iteration is
+ * returned. Communities are numbered from 0, in order of their lowest
+ * node.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t graph_consensus(
+  graph_t   *g,           /**< the graph                               */
+  uint32_t   nparts,      /**< number of partitions                    */
+  uint32_t **parts,       /**< the partitions - the community of every
+                               node, in each partition. The arrays are
+                               overwritten with the partitions of each
+                               iteration.                              */
+  double     tau,         /**< co-assignment threshold, in (0, 1]      */
+  uint32_t   maxiters,    /**< maximum number of iterations            */
+  uint16_t   nthreads,    /**< number of threads (0 to use all CPUs)   */
+  rng_t     *rng,         /**< random number generator, for the node
+                               orders of the re-clusterings            */
+  uint32_t  *communities, /**< place to store the community of each
+                               node - must be of length num_nodes      */
+  uint32_t  *ncomms,      /**< place to store the number of
+                               communities                             */
+  uint32_t  *niters       /**< place to store the number of iterations
+                               (may be NULL)                           */
+);
+
+#endif /* __GRAPH_CONSENSUS_H__ */
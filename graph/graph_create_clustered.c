@@ -10,7 +10,28 @@
 #include <math.h>
 
 #include "graph/graph.h"
+#include "graph/graph_builder.h"
 #include "util/array.h"
+#include "util/parallel.h"
+#include "util/rng.h"
+
+/**
+ * Context passed to _gen_cluster. Edges are stored per thread, as packed
+ * (u << 32 | v) values.
+ */
+typedef struct _clust_ctx {
+
+  uint32_t   nnodes;    /**< number of nodes                          */
+  uint32_t   nclusters; /**< number of clusters                       */
+  uint32_t  *ends;      /**< node index boundary of each cluster      */
+  uint64_t  *seeds;     /**< generator seed for each cluster          */
+  double     internal;  /**< intra-cluster density                    */
+  double     external;  /**< inter-cluster density                    */
+  uint64_t **edges;     /**< edges generated by each thread           */
+  uint64_t  *nedges;    /**< number of edges generated by each thread */
+  uint64_t  *capedges;  /**< capacity of each edge list               */
+
+} clust_ctx_t;
 
 /**
  * Randomly generates sizes for each cluster over the range [clustersz -
@@ -41,6 +62,52 @@ static void _mk_label(
   uint32_t       ncidx /**< index of current node within cluster */
 );
 
+/**
+ * parallel_for function - generates the edges within each of the clusters
+ * in the range [start, end), and the edges between those clusters and all
+ * of the clusters which follow them.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _gen_cluster(
+  uint64_t start,  /**< first cluster          */
+  uint64_t end,    /**< one past last cluster  */
+  uint16_t thread, /**< calling thread         */
+  void    *ctx     /**< pointer to clust_ctx_t */
+);
+
+/**
+ * Appends the edge between the given nodes to the edge list of the given
+ * thread.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _append(
+  clust_ctx_t *ctx,    /**< the context      */
+  uint16_t     thread, /**< calling thread   */
+  uint32_t     u,      /**< edge start point */
+  uint32_t     v       /**< edge end point   */
+);
+
+/**
+ * \return the number of node pairs to skip before the next edge, drawn
+ * from a geometric distribution, for an edge density p, where lq is
+ * log(1-p). The value is returned as a double, as it may be very large
+ * for small densities.
+ */
+static double _skip(
+  rng_t *rng, /**< the generator */
+  double lq   /**< log(1-p)      */
+);
+
+/**
+ * Frees the memory used by the given context.
+ */
+static void _free_ctx(
+  clust_ctx_t *ctx,     /**< the context       */
+  uint16_t     nthreads /**< number of threads */
+);
+
 uint8_t graph_create_clustered_by_degree(
   graph_t *g,
   uint32_t nnodes,
@@ -114,15 +181,25 @@ uint8_t graph_create_clustered(
   double   sizerange
 ) {
 
-  uint64_t      ni;     /* node i        */
-  uint64_t      nj;     /* node j        */
-  uint64_t      ci;     /* cluster i     */
-  uint64_t      cj;     /* cluster j     */
-  array_t       sizes;  /* cluster sizes */
-  uint64_t      nci;    /* index within cluster of node i */
-  graph_label_t lbl;
-  uint32_t      sz;
-  uint32_t      tmp;
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        ni;     /* node i        */
+  uint64_t        ci;     /* cluster i     */
+  uint64_t        nci;    /* index within cluster of node i */
+  uint32_t        start;
+  uint32_t        sz;
+  uint64_t        nedges;
+  uint16_t        nthreads;
+  array_t         sizes;  /* cluster sizes */
+  graph_label_t   lbl;
+  clust_ctx_t     ctx;
+  graph_builder_t builder;
+
+  memset(&ctx,     0, sizeof(clust_ctx_t));
+  memset(&sizes,   0, sizeof(array_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  nthreads = parallel_num_threads();
 
   if (g         == NULL)   goto fail;
   if (nnodes    == 0)      goto fail;
@@ -139,60 +216,78 @@ uint8_t graph_create_clustered(
   if (_create_sizes(nnodes, nclusters, &sizes, sizerange)) goto fail;
 
   array_get(&sizes, sizes.size-1, &nnodes);
-  
+
+  ctx.nnodes    = nnodes;
+  ctx.nclusters = nclusters;
+  ctx.ends      = (uint32_t *)sizes.data;
+  ctx.internal  = internal;
+  ctx.external  = external;
+  ctx.seeds     = malloc(nclusters * sizeof(uint64_t));
+  ctx.edges     = calloc(nthreads,  sizeof(uint64_t *));
+  ctx.nedges    = calloc(nthreads,  sizeof(uint64_t));
+  ctx.capedges  = calloc(nthreads,  sizeof(uint64_t));
+
+  if (ctx.seeds    == NULL) goto fail;
+  if (ctx.edges    == NULL) goto fail;
+  if (ctx.nedges   == NULL) goto fail;
+  if (ctx.capedges == NULL) goto fail;
+
+  /*
+   * Each cluster is given its own generator, seeded
+   * from the default generator, so the graph does
+   * not depend on the number of threads.
+   */
+  for (ci = 0; ci < nclusters; ci++)
+    ctx.seeds[ci] = rng_next(rng_default());
+
   if (graph_create(g, nnodes, 0)) goto fail;
 
   memset(&lbl, 0, sizeof(graph_label_t));
 
-  ci  = 0;
-  for (nci = 0, ni = 0; ni < nnodes; ni++, nci++) {
+  for (ci = 0, ni = 0; ci < nclusters; ci++) {
 
-    array_get(&sizes, ci, &sz);
-    if (ni == sz) {
-      ci++;
-      nci = 0;
-    }
+    start = (ci == 0) ? 0 : ctx.ends[ci-1];
+    sz    = ctx.ends[ci] - start;
 
-    if (ci == 0) {
-      array_get(&sizes, 0, &sz);
-    }
-    else {
-      array_get(&sizes, ci-1, &tmp);
-      array_get(&sizes, ci,   &sz);
-      sz -= tmp;
+    for (nci = 0; nci < sz; nci++, ni++) {
+      _mk_label(&lbl, nclusters, ci, sz, nci);
+      graph_set_nodelabel(g, ni, &lbl);
     }
-    _mk_label(&lbl, sizes.size, ci, sz, nci);
-    graph_set_nodelabel(g, ni, &lbl);
+  }
 
-    cj = ci;
-    for (nj = ni+1; nj < nnodes; nj++) {
+  if (parallel_for(nthreads, nclusters, 1, &ctx, _gen_cluster)) goto fail;
 
-      array_get(&sizes, cj, &sz);
+  for (i = 0, nedges = 0; i < nthreads; i++) nedges += ctx.nedges[i];
 
-      if (nj == sz) cj++;
+  if (nedges >= UINT32_MAX) nedges = UINT32_MAX - 1;
 
-      /*intra-cluster edges are added with 'internal' probability*/
-      if (ci == cj) {
-        
-        if (((double)rand()/RAND_MAX) <= internal) {
-          if (graph_add_edge(g, ni, nj, 1.0)) goto fail;
-        }
-      }
-      
-      /*inter-cluster edges are added with 'external' probability*/
-      else {
-        
-        if (((double)rand()/RAND_MAX) <= external) {
-          if (graph_add_edge(g, ni, nj, 1.0)) goto fail;
-        }
-      }
+  if (graph_builder_init(&builder, g, nedges + 1)) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    for (j = 0; j < ctx.nedges[i]; j++) {
+
+      if (graph_builder_add(&builder,
+                            ctx.edges[i][j] >> 32,
+                            ctx.edges[i][j] & 0xFFFFFFFF,
+                            1.0))
+        goto fail;
     }
+
+    free(ctx.edges[i]);
+    ctx.edges[i] = NULL;
   }
 
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
   array_free(&sizes);
+  _free_ctx(&ctx, nthreads);
 
   return 0;
 fail:
+  graph_builder_free(&builder);
+  if (sizes.data != NULL) array_free(&sizes);
+  _free_ctx(&ctx, nthreads);
   return 1;
 }
 
@@ -226,7 +321,7 @@ uint8_t _create_sizes(
   tally = 0;
   for (i = 0; i < nclusters; i++) {
       
-    sz = minsz + ((double)rand() / RAND_MAX) * (maxsz - minsz);
+    sz = minsz + rng_uniform(rng_default()) * (maxsz - minsz);
 
     tally += sz;
     array_append(sizes, &tally);
@@ -257,3 +352,147 @@ static void _mk_label(
   lbl->yval     = yoff + 1 + sin(angle);
   lbl->zval     = 0;
 }
+
+uint8_t _gen_cluster(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t     c;
+  uint64_t     k;
+  uint64_t     v;
+  uint64_t     w;
+  uint64_t     first;
+  uint64_t     last;
+  uint64_t     sz;
+  uint64_t     rowlen;
+  double       npairs;
+  double       gap;
+  double       lq;
+  rng_t        rng;
+  clust_ctx_t *cctx;
+
+  cctx = ctx;
+
+  for (c = start; c < end; c++) {
+
+    rng_seed(&rng, cctx->seeds[c]);
+
+    first  = (c == 0) ? 0 : cctx->ends[c-1];
+    last   = cctx->ends[c];
+    sz     = last - first;
+    rowlen = cctx->nnodes - last;
+
+    /*
+     * Intra-cluster pairs (w, v), w < v, are visited in
+     * order, and the number of pairs skipped before
+     * the next edge is drawn from a geometric
+     * distribution.
+     */
+    if (cctx->internal > 0.0 && sz > 1) {
+
+      lq     = log(1.0 - cctx->internal);
+      npairs = (double)sz * (sz - 1) / 2.0;
+      k      = 0;
+      v      = 1;
+      w      = 0;
+
+      while (1) {
+
+        gap = _skip(&rng, lq);
+        if ((double)k + gap >= npairs) break;
+
+        k += (uint64_t)gap;
+        w += (uint64_t)gap;
+
+        while (w >= v) {
+          w -= v;
+          v ++;
+        }
+
+        if (_append(cctx, thread, first + w, first + v)) goto fail;
+
+        k++;
+        w++;
+      }
+    }
+
+    /*
+     * The inter-cluster pairs between the nodes in this
+     * cluster and the nodes in all later clusters form
+     * a sz * rowlen block, which is sampled in the
+     * same way.
+     */
+    if (cctx->external > 0.0 && sz > 0 && rowlen > 0) {
+
+      lq     = log(1.0 - cctx->external);
+      npairs = (double)sz * rowlen;
+      k      = 0;
+
+      while (1) {
+
+        gap = _skip(&rng, lq);
+        if ((double)k + gap >= npairs) break;
+
+        k += (uint64_t)gap;
+
+        if (_append(cctx, thread, first + k / rowlen, last + k % rowlen))
+          goto fail;
+
+        k++;
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _append(clust_ctx_t *ctx, uint16_t thread, uint32_t u, uint32_t v) {
+
+  uint64_t  newcap;
+  uint64_t *edges;
+
+  if (ctx->nedges[thread] == ctx->capedges[thread]) {
+
+    newcap = (ctx->capedges[thread] == 0) ?
+      1024 : 2 * ctx->capedges[thread];
+
+    edges = realloc(ctx->edges[thread], newcap * sizeof(uint64_t));
+    if (edges == NULL) goto fail;
+
+    ctx->edges[thread]    = edges;
+    ctx->capedges[thread] = newcap;
+  }
+
+  ctx->edges[thread][ctx->nedges[thread]++] = ((uint64_t)u << 32) | v;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+double _skip(rng_t *rng, double lq) {
+
+  /*for p == 1, lq is -inf, and no pairs are skipped*/
+  return floor(log(1.0 - rng_uniform(rng)) / lq);
+}
+
+void _free_ctx(clust_ctx_t *ctx, uint16_t nthreads) {
+
+  uint64_t i;
+
+  if (ctx->edges != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (ctx->edges[i] != NULL) free(ctx->edges[i]);
+    }
+    free(ctx->edges);
+  }
+
+  if (ctx->seeds    != NULL) free(ctx->seeds);
+  if (ctx->nedges   != NULL) free(ctx->nedges);
+  if (ctx->capedges != NULL) free(ctx->capedges);
+
+  memset(ctx, 0, sizeof(clust_ctx_t));
+}
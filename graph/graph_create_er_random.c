@@ -1,5 +1,5 @@
 /**
- * A function which generates an Erdos-Renyi random graph. Assumes that the
+ * Functions which generate Erdos-Renyi random graphs. Assumes that the
  * random number generator has been seeded. Edge weights are set to random
  * values between -1 and 1.
  *
@@ -7,56 +7,308 @@
  *   graphs. Publications of the Mathematical Institute of 
  *   the Hungarian Academy of Sciences. 5:17-61.
  *
+ * G(n,p) graphs are generated by geometric skipping, which draws the gap
+ * to the next edge directly, rather than testing every node pair, so takes
+ * O(V+E) time:
+ *
+ *   V. Batagelj, U. Brandes, 2005. Efficient generation of large random
+ *   networks. Physical Review E 71(3):036113.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "util/rng.h"
+
+/**
+ * Creates the graph, sets random node labels, and initialises the builder.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _init(
+  graph_t         *g,       /**< uninitialised graph          */
+  uint32_t         nnodes,  /**< number of nodes              */
+  graph_builder_t *builder, /**< builder to initialise        */
+  uint64_t         nedges   /**< expected number of edges     */
+);
+
+/**
+ * Queues the edge between the given nodes, with a random weight.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _add(
+  graph_builder_t *builder, /**< the builder      */
+  uint32_t         u,       /**< edge start point */
+  uint32_t         v        /**< edge end point   */
+);
+
+/**
+ * Converts the given pair index, in the range [0, n(n-1)/2), into a node
+ * pair (u, v), with u < v. Pairs are ordered by v, then by u.
+ */
+static void _pair(
+  uint64_t  k, /**< pair index          */
+  uint32_t *u, /**< place to store u    */
+  uint32_t *v  /**< place to store v    */
+);
+
+/**
+ * Draws k distinct random pair indices from the range [0, npairs), and
+ * stores them, in ascending order, in the given array.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _sample(
+  uint64_t  npairs, /**< size of range           */
+  uint64_t  k,      /**< number of indices       */
+  uint64_t *idxs    /**< place to store indices  */
+);
+
+/**
+ * Comparison function for uint64_t values.
+ */
+static int _compare_u64(
+  const void *a, /**< pointer to a uint64_t       */
+  const void *b  /**< pointer to another uint64_t */
+);
 
 static void _mk_label(graph_label_t *lbl);
 
 uint8_t graph_create_er_random(
   graph_t *g, uint32_t nnodes, double density) {
 
-  uint64_t      i;
-  uint64_t      j;
-  double        prob;
-  double        wt;
-  graph_label_t lbl;
+  int64_t         v;
+  int64_t         w;
+  double          r;
+  double          lq;
+  graph_builder_t builder;
+
+  memset(&builder, 0, sizeof(graph_builder_t));
 
   if (g      == NULL) goto fail;
   if (nnodes == 0)    goto fail;
   if (density > 1.0)  goto fail;
   if (density < 0.0)  goto fail;
-  
-  if (graph_create(g, nnodes, 0)) goto fail;
 
-  for (i = 0; i < nnodes; i++) {
-    _mk_label(&lbl);
-    graph_set_nodelabel(g, i, &lbl);
-    for (j = i+1; j < nnodes; j++) {
+  if (_init(g, nnodes, &builder, 
+            density * ((double)nnodes * (nnodes - 1) / 2)))
+    goto fail;
 
-      prob = (double)rand() / RAND_MAX;
+  /*
+   * Candidate pairs (w, v), w < v, are visited in order,
+   * and the number of pairs skipped before the next edge
+   * is drawn from a geometric distribution.
+   */
+  if (density >= 1.0) {
+    for (v = 1; v < nnodes; v++) {
+      for (w = 0; w < v; w++) {
+        if (_add(&builder, w, v)) goto fail;
+      }
+    }
+  }
+  else if (density > 0.0) {
+
+    lq = log(1.0 - density);
+    v  = 1;
+    w  = -1;
 
-      if (prob <= density) {
-        wt = -1.0 + 2.0*((double)rand() / RAND_MAX);
-        if (graph_add_edge(g, i, j, wt)) goto fail;
+    while (v < nnodes) {
+
+      r  = rng_uniform(rng_default());
+      w += 1 + (int64_t)floor(log(1.0 - r) / lq);
+
+      while (w >= v && v < nnodes) {
+        w -= v;
+        v ++;
       }
+
+      if (v < nnodes && _add(&builder, w, v)) goto fail;
     }
   }
 
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+
   return 0;
 fail:
+  graph_builder_free(&builder);
   graph_free(g);
   return 1;
 }
 
+uint8_t graph_create_er_random_edges(
+  graph_t *g, uint32_t nnodes, uint64_t nedges) {
+
+  uint64_t        i;
+  uint64_t        k;
+  uint64_t        npairs;
+  uint64_t        nexcl;
+  uint64_t       *idxs;
+  uint32_t        u;
+  uint32_t        v;
+  graph_builder_t builder;
+
+  idxs = NULL;
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (g      == NULL) goto fail;
+  if (nnodes == 0)    goto fail;
+
+  npairs = ((uint64_t)nnodes * (nnodes - 1)) / 2;
+
+  if (nedges > npairs) goto fail;
+
+  if (_init(g, nnodes, &builder, nedges)) goto fail;
+
+  /*
+   * For dense graphs, it is cheaper to sample the
+   * pairs which are not connected, and to add
+   * every other pair.
+   */
+  if (nedges <= npairs / 2) {
+
+    idxs = malloc(nedges * sizeof(uint64_t));
+    if (nedges > 0 && idxs == NULL) goto fail;
+
+    if (_sample(npairs, nedges, idxs)) goto fail;
+
+    for (i = 0; i < nedges; i++) {
+      _pair(idxs[i], &u, &v);
+      if (_add(&builder, u, v)) goto fail;
+    }
+  }
+  else {
+
+    nexcl = npairs - nedges;
+    idxs  = malloc(nexcl * sizeof(uint64_t));
+    if (nexcl > 0 && idxs == NULL) goto fail;
+
+    if (_sample(npairs, nexcl, idxs)) goto fail;
+
+    for (i = 0, k = 0; k < npairs; k++) {
+
+      if (i < nexcl && idxs[i] == k) {
+        i++;
+        continue;
+      }
+
+      _pair(k, &u, &v);
+      if (_add(&builder, u, v)) goto fail;
+    }
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  if (idxs != NULL) free(idxs);
+
+  return 0;
+fail:
+  graph_builder_free(&builder);
+  graph_free(g);
+  if (idxs != NULL) free(idxs);
+  return 1;
+}
+
+static uint8_t _init(
+  graph_t *g, uint32_t nnodes, graph_builder_t *builder, uint64_t nedges) {
+
+  uint64_t      i;
+  graph_label_t lbl;
+
+  if (nedges >= UINT32_MAX) nedges = UINT32_MAX - 1;
+
+  if (graph_create(g, nnodes, 0))                  goto fail;
+  if (graph_builder_init(builder, g, nedges + 1)) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    _mk_label(&lbl);
+    if (graph_set_nodelabel(g, i, &lbl)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+static uint8_t _add(graph_builder_t *builder, uint32_t u, uint32_t v) {
+
+  double wt;
+
+  wt = -1.0 + 2.0*rng_uniform(rng_default());
+
+  return graph_builder_add(builder, u, v, wt);
+}
+
+static void _pair(uint64_t k, uint32_t *u, uint32_t *v) {
+
+  uint64_t j;
+
+  /*pairs with end point j start at index j(j-1)/2*/
+  j = (uint64_t)((1.0 + sqrt(1.0 + 8.0 * (double)k)) / 2.0);
+
+  /*correct for floating point error*/
+  while (j * (j - 1) / 2 >  k) j--;
+  while (j * (j + 1) / 2 <= k) j++;
+
+  *v = j;
+  *u = k - j * (j - 1) / 2;
+}
+
+static uint8_t _sample(uint64_t npairs, uint64_t k, uint64_t *idxs) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t n;
+
+  /*
+   * Draw indices, discard duplicates, and top up
+   * until there are enough. As k <= npairs / 2,
+   * at least half of each round is kept, on average.
+   */
+  n = 0;
+  while (n < k) {
+
+    for (i = n; i < k; i++) idxs[i] = rng_range(rng_default(), npairs);
+
+    qsort(idxs, k, sizeof(uint64_t), _compare_u64);
+
+    for (i = 1, j = 1; i < k; i++) {
+      if (idxs[i] != idxs[j-1]) idxs[j++] = idxs[i];
+    }
+
+    n = j;
+  }
+
+  return 0;
+}
+
+static int _compare_u64(const void *a, const void *b) {
+
+  uint64_t ua;
+  uint64_t ub;
+
+  ua = *(const uint64_t *)a;
+  ub = *(const uint64_t *)b;
+
+  if (ua < ub) return -1;
+  if (ua > ub) return  1;
+  return 0;
+}
+
 static void _mk_label(graph_label_t *lbl) {
 
   lbl->labelval = 0;
-  lbl->xval     = 5*((double)rand()/RAND_MAX);
-  lbl->yval     = 5*((double)rand()/RAND_MAX);
+  lbl->xval     = 5*rng_uniform(rng_default());
+  lbl->yval     = 5*rng_uniform(rng_default());
   lbl->zval     = 0;
 }
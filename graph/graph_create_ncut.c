@@ -7,17 +7,76 @@
  * IEEE Transactions on Pattern Analysis and Machine Intelligence, vol. 22,
  * no. 8, pp. 888-905.
  *
+ * Images with up to three dimensions are connected with a stencil - the
+ * list of grid offsets which lie within the radius, along with their
+ * spatial affinity terms, is calculated once, and is then applied at every
+ * voxel, so only the voxels within the radius of each voxel are visited.
+ * The image is split into blocks of rows, which are connected in parallel,
+ * and the neighbour lists are set directly, rather than edge by edge.
+ * Images with more dimensions fall back to comparing every pair of nodes.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdio.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "graph/graph.h"
+#include "graph/graph_builder.h"
 #include "stats/stats.h"
+#include "util/parallel.h"
 #include "io/analyze75.h"
 
+/**
+ * Number of image rows connected by one parallel work item.
+ */
+#define NCUT_BLOCK_ROWS 64
+
+/**
+ * One stencil entry - a grid offset within the radius.
+ */
+typedef struct _ncut_offset {
+
+  int32_t dx;  /**< x offset                                  */
+  int32_t dy;  /**< y offset                                  */
+  int32_t dz;  /**< z offset                                  */
+  int64_t off; /**< offset in node indices                    */
+  double  wt;  /**< spatial term of the affinity at this offset */
+
+} ncut_offset_t;
+
+/**
+ * Neighbour lists of the nodes in one block of rows, stored one after
+ * the other.
+ */
+typedef struct _ncut_block {
+
+  uint32_t *nbrs; /**< neighbours                    */
+  double   *wts;  /**< edge weights                  */
+  uint64_t  size; /**< number of neighbours stored   */
+  uint64_t  cap;  /**< capacity of nbrs and wts      */
+
+} ncut_block_t;
+
+/**
+ * Context passed to _connect_blocks.
+ */
+typedef struct _ncut_ctx {
+
+  uint32_t       dims[3];  /**< image dimensions                   */
+  uint32_t      *vals;     /**< label value of every node          */
+  double         si;       /**< intensity sigma                    */
+  double         thres;    /**< edge weight threshold              */
+  ncut_offset_t *stencil;  /**< offsets within the radius, ordered
+                                by node index offset               */
+  uint32_t       nstencil; /**< number of offsets                  */
+  uint32_t      *degrees;  /**< number of neighbours of every node */
+  ncut_block_t  *blocks;   /**< neighbours of every block          */
+
+} ncut_ctx_t;
+
 /**
  * Gives each node in the graph a label corresponding to its pixel
  * location and value in the image.
@@ -32,11 +91,62 @@ static uint8_t _label(
 
 /**
  * Adds weighted edges to the graph, based on distance between nodes, and
- * similarity of their pixel value.
+ * similarity of their pixel value, using a stencil of the offsets which
+ * lie within the radius. The image must have at most three dimensions.
  *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _connect(
+  graph_t *g,    /**< the graph                                 */
+  dsr_t   *hdr,  /**< image header                              */
+  double   si,   /**< intensity sigma (see _connect_pairs)      */
+  double   sx,   /**< distance sigma                            */
+  double   rad,  /**< radius                                    */
+  double   thres /**< edge weight threshold                     */
+);
+
+/**
+ * Creates the stencil - every offset which lies within the given radius,
+ * and whose spatial affinity term is not below the threshold, in order of
+ * node index offset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stencil(
+  ncut_ctx_t *ctx, /**< context, with dims set */
+  double      sx,  /**< distance sigma         */
+  double      rad  /**< radius                 */
+);
+
+/**
+ * parallel_for function which calculates the neighbours of every node in
+ * blocks [start, end).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _connect_blocks(
+  uint64_t  start,  /**< first block          */
+  uint64_t  end,    /**< one past last block  */
+  uint16_t  thread, /**< calling thread       */
+  void     *ctx     /**< pointer to ncut_ctx_t */
+);
+
+/**
+ * Comparison function for ncut_offset_t structs, which orders them by node
+ * index offset.
+ */
+static int _compare_offsets(
+  const void *a, /**< pointer to a ncut_offset_t       */
+  const void *b  /**< pointer to another ncut_offset_t */
+);
+
+/**
+ * Adds weighted edges to the graph, based on distance between nodes, and
+ * similarity of their pixel value, by comparing every pair of nodes.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _connect_pairs(
   graph_t *g,    /**< the graph                                 */
   double   si,   /**< intensity sigma, strength of edge weight
                       decreases exponentially as the intensity
@@ -74,13 +184,27 @@ uint8_t graph_create_ncut(
   double   rad,
   double   thres) {
 
+  uint8_t  i;
+  uint8_t  ndims;
   uint32_t nnodes;
 
   nnodes = analyze_num_vals(hdr);
+  ndims  = analyze_num_dims(hdr);
+
+  if (graph_create(g, nnodes, 0)) goto fail;
+  if (_label(g, hdr, img))        goto fail;
+
+  /*the stencil can be used if extra dimensions are singular*/
+  for (i = 3; i < ndims; i++) {
+    if (analyze_dim_size(hdr, i) > 1) break;
+  }
 
-  if (graph_create(g, nnodes, 0))      goto fail;
-  if (_label(g, hdr, img))             goto fail;
-  if (_connect(g, si, sx, rad, thres)) goto fail;
+  if (i >= ndims) {
+    if (_connect(g, hdr, si, sx, rad, thres))  goto fail;
+  }
+  else {
+    if (_connect_pairs(g, si, sx, rad, thres)) goto fail;
+  }
 
   return 0;
 
@@ -94,7 +218,7 @@ uint8_t _label(graph_t *g, dsr_t *hdr, uint8_t *img) {
   uint32_t      nnodes;
   double        val;  
   graph_label_t lbl;
-  uint32_t      dims[3];
+  uint32_t      dims[8];
 
   memset(dims, 0, sizeof(dims));
 
@@ -108,7 +232,7 @@ uint8_t _label(graph_t *g, dsr_t *hdr, uint8_t *img) {
     lbl.labelval = val;
     lbl.xval     = dims[0];
     lbl.yval     = dims[1];
-    lbl.zval     = 0.0;
+    lbl.zval     = dims[2];
 
     if (graph_set_nodelabel(g, i, &lbl)) goto fail;
   }
@@ -119,29 +243,304 @@ fail:
   return 1;
 }
 
-uint8_t _connect(graph_t *g, double si, double sx, double rad, double thres) {
+uint8_t _connect(
+  graph_t *g, dsr_t *hdr, double si, double sx, double rad, double thres) {
 
-  uint64_t i;
-  uint64_t j;
-  double   wt;
-  uint32_t nnodes;
+  uint64_t         i;
+  uint64_t         j;
+  uint64_t         pos;
+  uint64_t         nrows;
+  uint64_t         nblocks;
+  uint64_t         first;
+  uint64_t         last;
+  uint32_t         nnodes;
+  ncut_ctx_t       ctx;
+  ncut_block_t    *blk;
+  graph_builder_t  builder;
+
+  memset(&ctx,     0, sizeof(ncut_ctx_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
 
   nnodes = graph_num_nodes(g);
 
+  for (i = 0; i < 3; i++) {
+    ctx.dims[i] = (i < analyze_num_dims(hdr)) ? analyze_dim_size(hdr, i) : 1;
+  }
+
+  ctx.si    = si;
+  ctx.thres = thres;
+  nrows     = (uint64_t)ctx.dims[1] * ctx.dims[2];
+  nblocks   = (nrows + NCUT_BLOCK_ROWS - 1) / NCUT_BLOCK_ROWS;
+
+  ctx.vals    = malloc(nnodes  * sizeof(uint32_t));
+  ctx.degrees = calloc(nnodes,   sizeof(uint32_t));
+  ctx.blocks  = calloc(nblocks,  sizeof(ncut_block_t));
+
+  if (ctx.vals    == NULL) goto fail;
+  if (ctx.degrees == NULL) goto fail;
+  if (ctx.blocks  == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++)
+    ctx.vals[i] = graph_get_nodelabel(g, i)->labelval;
+
+  if (_stencil(&ctx, sx, rad)) goto fail;
+
+  if (parallel_for(0, nblocks, 1, &ctx, _connect_blocks)) goto fail;
+
+  if (graph_builder_init(&builder, g, 0)) goto fail;
+
+  for (i = 0; i < nblocks; i++) {
+
+    blk   = ctx.blocks + i;
+    first = i * NCUT_BLOCK_ROWS * ctx.dims[0];
+    last  = (i + 1) * NCUT_BLOCK_ROWS * ctx.dims[0];
+    if (last > nnodes) last = nnodes;
+
+    for (j = first, pos = 0; j < last; j++) {
+
+      if (ctx.degrees[j] == 0) continue;
+
+      if (graph_builder_set_neighbours(
+            &builder, j, ctx.degrees[j], blk->nbrs + pos, blk->wts + pos))
+        goto fail;
+
+      pos += ctx.degrees[j];
+    }
+
+    free(blk->nbrs);
+    free(blk->wts);
+    blk->nbrs = NULL;
+    blk->wts  = NULL;
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(ctx.vals);
+  free(ctx.degrees);
+  free(ctx.blocks);
+  free(ctx.stencil);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  if (ctx.blocks != NULL) {
+    for (i = 0; i < nblocks; i++) {
+      if (ctx.blocks[i].nbrs != NULL) free(ctx.blocks[i].nbrs);
+      if (ctx.blocks[i].wts  != NULL) free(ctx.blocks[i].wts);
+    }
+    free(ctx.blocks);
+  }
+  if (ctx.vals    != NULL) free(ctx.vals);
+  if (ctx.degrees != NULL) free(ctx.degrees);
+  if (ctx.stencil != NULL) free(ctx.stencil);
+  return 1;
+}
+
+uint8_t _stencil(ncut_ctx_t *ctx, double sx, double rad) {
+
+  int64_t        x;
+  int64_t        y;
+  int64_t        z;
+  int64_t        r[3];
+  uint64_t       i;
+  uint64_t       n;
+  double         d2;
+  double         dx;
+  double         wt;
+  ncut_offset_t *st;
+
+  /*offsets are limited by the radius, and by the image size*/
+  for (i = 0; i < 3; i++) {
+    r[i] = (rad > 0) ? floor(rad) : 0;
+    if (r[i] > (int64_t)ctx->dims[i] - 1) r[i] = ctx->dims[i] - 1;
+  }
+
+  st = malloc((2*r[0]+1) * (2*r[1]+1) * (2*r[2]+1) * sizeof(ncut_offset_t));
+  if (st == NULL) goto fail;
+
+  n = 0;
+
+  for (z = -r[2]; z <= r[2]; z++) {
+    for (y = -r[1]; y <= r[1]; y++) {
+      for (x = -r[0]; x <= r[0]; x++) {
+
+        if (x == 0 && y == 0 && z == 0) continue;
+
+        /*as calculated by stats_edge_distance*/
+        d2 = (double)(x*x + y*y + z*z);
+        dx = pow(d2, 0.5);
+
+        if (dx > rad) continue;
+
+        /*
+         * the intensity term is at most 1, so an
+         * offset whose spatial term is below the
+         * threshold never produces an edge
+         */
+        wt = exp(-(dx*dx)/(sx*sx));
+        if (wt < ctx->thres) continue;
+
+        st[n].dx  = x;
+        st[n].dy  = y;
+        st[n].dz  = z;
+        st[n].off = x + (int64_t)ctx->dims[0] * (y + (int64_t)ctx->dims[1] * z);
+        st[n].wt  = wt;
+        n++;
+      }
+    }
+  }
+
+  /*neighbour lists must be in ascending order*/
+  qsort(st, n, sizeof(ncut_offset_t), _compare_offsets);
+
+  ctx->stencil  = st;
+  ctx->nstencil = n;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _connect_blocks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       b;
+  uint64_t       k;
+  uint64_t       row;
+  uint64_t       lastrow;
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       newcap;
+  int64_t        x;
+  int64_t        y;
+  int64_t        z;
+  uint32_t       deg;
+  double         df;
+  double         wt;
+  void          *tmp;
+  ncut_ctx_t    *ctx;
+  ncut_offset_t *st;
+  ncut_block_t  *blk;
+
+  ctx = vctx;
+
+  for (b = start; b < end; b++) {
+
+    blk     = ctx->blocks + b;
+    row     = b * NCUT_BLOCK_ROWS;
+    lastrow = row + NCUT_BLOCK_ROWS;
+
+    if (lastrow > (uint64_t)ctx->dims[1] * ctx->dims[2])
+      lastrow = (uint64_t)ctx->dims[1] * ctx->dims[2];
+
+    for (; row < lastrow; row++) {
+
+      y = row % ctx->dims[1];
+      z = row / ctx->dims[1];
+
+      for (x = 0; x < ctx->dims[0]; x++) {
+
+        i   = x + row * ctx->dims[0];
+        deg = 0;
+
+        /*room for every offset*/
+        if (blk->size + ctx->nstencil > blk->cap) {
+
+          newcap = 2 * blk->cap;
+          if (newcap < blk->size + ctx->nstencil)
+            newcap = blk->size + ctx->nstencil + 1024;
+
+          tmp = realloc(blk->nbrs, newcap * sizeof(uint32_t));
+          if (tmp == NULL) goto fail;
+          blk->nbrs = tmp;
+
+          tmp = realloc(blk->wts,  newcap * sizeof(double));
+          if (tmp == NULL) goto fail;
+          blk->wts = tmp;
+
+          blk->cap = newcap;
+        }
+
+        for (k = 0; k < ctx->nstencil; k++) {
+
+          st = ctx->stencil + k;
+
+          if (x + st->dx < 0 || x + st->dx >= ctx->dims[0]) continue;
+          if (y + st->dy < 0 || y + st->dy >= ctx->dims[1]) continue;
+          if (z + st->dz < 0 || z + st->dz >= ctx->dims[2]) continue;
+
+          j  = i + st->off;
+          df = (double)ctx->vals[i] - ctx->vals[j];
+          wt = exp(-(df*df)/(ctx->si*ctx->si)) * st->wt;
+
+          if (wt <  ctx->thres) continue;
+          if (wt == 0.0)        continue;
+
+          blk->nbrs[blk->size + deg] = j;
+          blk->wts [blk->size + deg] = wt;
+          deg++;
+        }
+
+        ctx->degrees[i] = deg;
+        blk->size      += deg;
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+int _compare_offsets(const void *a, const void *b) {
+
+  const ncut_offset_t *oa;
+  const ncut_offset_t *ob;
+
+  oa = a;
+  ob = b;
+
+  if (oa->off < ob->off) return -1;
+  if (oa->off > ob->off) return  1;
+  return 0;
+}
+
+uint8_t _connect_pairs(
+  graph_t *g, double si, double sx, double rad, double thres) {
+
+  uint64_t        i;
+  uint64_t        j;
+  double          wt;
+  uint32_t        nnodes;
+  graph_builder_t builder;
+
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  nnodes = graph_num_nodes(g);
+
+  if (graph_builder_init(&builder, g, nnodes)) goto fail;
+
   for (i = 0; i < nnodes; i++) {
     
     for (j = i+1; j < nnodes; j++) {
 
       wt = _edge_weight(g, si, sx, rad, thres, i, j);
 
-      if (wt == 0.0)                   continue;
-      if (graph_add_edge(g, i, j, wt)) goto fail;
+      if (wt == 0.0)                                continue;
+      if (graph_builder_add(&builder, i, j, wt)) goto fail;
     }
   }
 
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
   return 0;
   
 fail:
+  graph_builder_free(&builder);
   return 1;
 }
 
@@ -1,38 +1,58 @@
 /**
- * A function which generates a scale free random graph. Assumes that the
+ * Functions which generate scale free random graphs. Assumes that the
  * random number generator has been seeded. Edge weights are set to random
  * values between -1 and 1.
  *
  *   A.L. Barabasi and R. Albert, 1999. Emergence of Scaling
  *   in Random Networks. Science, Vol. 286, pp. 509-512.
  *
+ * Preferential attachment is implemented with a list of edge end points,
+ * in which every node appears once for each of its edges; a node chosen
+ * uniformly from this list is chosen with probability proportional to its
+ * degree, so each new edge takes constant time:
+ *
+ *   V. Batagelj, U. Brandes, 2005. Efficient generation of large random
+ *   networks. Physical Review E 71(3):036113.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
 #include <stdint.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
 
 #include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "util/rng.h"
 
 static void _mk_label(graph_label_t *lbl);
 
 uint8_t graph_create_scalefree(
   graph_t *g, uint32_t nnodes, uint16_t m, uint16_t m0) {
 
-  uint64_t      i;
-  uint64_t      j;
-  uint32_t      n;
-  double        prob;
-  uint64_t      tot_deg;
-  double        wt;
-  graph_label_t lbl;
-
-  if (g      == NULL) goto fail;
-  if (nnodes == 0)    goto fail;
-  if (m      == 0)    goto fail;
-  if (m0     == 0)    goto fail;
-  if (m      >  m0)   goto fail;
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        k;
+  uint64_t        nends;
+  uint32_t        n;
+  uint32_t       *ends;
+  uint32_t       *chosen;
+  uint32_t       *targets;
+  double          wt;
+  graph_label_t   lbl;
+  graph_builder_t builder;
+
+  ends    = NULL;
+  chosen  = NULL;
+  targets = NULL;
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (g      == NULL)   goto fail;
+  if (nnodes == 0)      goto fail;
+  if (m      == 0)      goto fail;
+  if (m0     == 0)      goto fail;
+  if (m      >  m0)     goto fail;
+  if (m0     >  nnodes) goto fail;
   
   if (graph_create(g, nnodes, 0)) goto fail;
 
@@ -41,52 +61,175 @@ uint8_t graph_create_scalefree(
     graph_set_nodelabel(g, i, &lbl);
   }
 
-  /*fully connect the first m0 nodes*/
-  tot_deg = (m0*m0) - m0;
+  nends   = (uint64_t)m0 * (m0 - 1) + 2 * (uint64_t)m * (nnodes - m0);
+  ends    = malloc(nends  * sizeof(uint32_t));
+  chosen  = malloc(nnodes * sizeof(uint32_t));
+  targets = malloc(m      * sizeof(uint32_t));
+
+  if (nends > 0 && ends == NULL) goto fail;
+  if (chosen  == NULL)           goto fail;
+  if (targets == NULL)           goto fail;
 
+  if (graph_builder_init(&builder, g, nends / 2 + 1)) goto fail;
+
+  /*
+   * chosen[n] is set to i + 1 when node n is picked as
+   * a target for node i, so duplicates can be rejected
+   */
+  memset(chosen, 0, nnodes * sizeof(uint32_t));
+
+  /*fully connect the first m0 nodes*/
+  nends = 0;
   for (i = 0; i < m0; i++) {
 
     for (j = i+1; j < m0; j++) {
       
-      wt = -1.0 + 2.0*((double)rand() / RAND_MAX); 
-      if (graph_add_edge(g, i, j, wt)) goto fail;
+      wt = -1.0 + 2.0*rng_uniform(rng_default()); 
+      if (graph_builder_add(&builder, i, j, wt)) goto fail;
+
+      ends[nends++] = i;
+      ends[nends++] = j;
     }
   }
 
   /*connect the rest of the nodes with preferential attachment*/
   for (i = m0; i < nnodes; i++) {
 
-    j = 0;
+    for (j = 0; j < m; ) {
+
+      /*
+       * if there are no edges yet (m0 == 1),
+       * all existing nodes are equally likely
+       */
+      if (nends == 0) n = rng_range(rng_default(), i);
+      else            n = ends[rng_range(rng_default(), nends)];
 
-    while (j < m) {
+      if (chosen[n] == i + 1) continue;
 
-      n    = floor(i * ((double)rand() / RAND_MAX));
-      prob = (double)graph_num_neighbours(g, n) / tot_deg;
+      chosen[n]    = i + 1;
+      targets[j++] = n;
+    }
 
-      if (((double)rand() / RAND_MAX) > prob)
-        continue;
+    for (j = 0; j < m; j++) {
 
-      wt = -1.0 + 2.0*((double)rand() / RAND_MAX);
+      wt = -1.0 + 2.0*rng_uniform(rng_default());
       
-      if (graph_add_edge(g, i, n, wt))
-        goto fail;
+      if (graph_builder_add(&builder, i, targets[j], wt)) goto fail;
+    }
 
-      j       += 1;
-      tot_deg += 2;
+    /*
+     * end points are only added once all the targets
+     * have been chosen, so the new node cannot connect
+     * to itself
+     */
+    for (k = 0; k < m; k++) {
+      ends[nends++] = i;
+      ends[nends++] = targets[k];
     }
   }
-  
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(ends);
+  free(chosen);
+  free(targets);
+
+  return 0;
+fail:
+  graph_builder_free(&builder);
+  graph_free(g);
+  if (ends    != NULL) free(ends);
+  if (chosen  != NULL) free(chosen);
+  if (targets != NULL) free(targets);
+  return 1;
+}
+
+uint8_t graph_create_configuration(
+  graph_t *g, uint32_t nnodes, uint32_t *degrees) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        nstubs;
+  uint32_t       *stubs;
+  uint32_t        tmp;
+  uint32_t        u;
+  uint32_t        v;
+  double          wt;
+  graph_label_t   lbl;
+  graph_builder_t builder;
+
+  stubs = NULL;
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (g       == NULL) goto fail;
+  if (nnodes  == 0)    goto fail;
+  if (degrees == NULL) goto fail;
+
+  nstubs = 0;
+  for (i = 0; i < nnodes; i++) {
+    if (degrees[i] >= nnodes) goto fail;
+    nstubs += degrees[i];
+  }
+
+  if (nstubs % 2) goto fail;
+
+  if (graph_create(g, nnodes, 0)) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    _mk_label(&lbl);
+    graph_set_nodelabel(g, i, &lbl);
+  }
+
+  stubs = malloc(nstubs * sizeof(uint32_t));
+  if (nstubs > 0 && stubs == NULL) goto fail;
+
+  if (graph_builder_init(&builder, g, nstubs / 2 + 1)) goto fail;
+
+  /*every node has one stub for each unit of degree*/
+  for (i = 0, j = 0; i < nnodes; i++) {
+    for (tmp = 0; tmp < degrees[i]; tmp++) stubs[j++] = i;
+  }
+
+  /*Fisher-Yates shuffle, then pair adjacent stubs*/
+  for (i = 0; i + 1 < nstubs; i++) {
+
+    j        = i + rng_range(rng_default(), nstubs - i);
+    tmp      = stubs[i];
+    stubs[i] = stubs[j];
+    stubs[j] = tmp;
+  }
+
+  for (i = 0; i < nstubs; i += 2) {
+
+    u = stubs[i];
+    v = stubs[i+1];
+
+    /*self loops are discarded, and duplicates are ignored by the builder*/
+    if (u == v) continue;
+
+    wt = -1.0 + 2.0*rng_uniform(rng_default());
+
+    if (graph_builder_add(&builder, u, v, wt)) goto fail;
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  if (stubs != NULL) free(stubs);
 
   return 0;
 fail:
+  graph_builder_free(&builder);
   graph_free(g);
+  if (stubs != NULL) free(stubs);
   return 1;
 }
 
 static void _mk_label(graph_label_t *lbl) {
 
   lbl->labelval = 0;
-  lbl->xval     = 5*((double)rand()/RAND_MAX);
-  lbl->yval     = 5*((double)rand()/RAND_MAX);
+  lbl->xval     = 5*rng_uniform(rng_default());
+  lbl->yval     = 5*rng_uniform(rng_default());
   lbl->zval     = 0;
 }
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 
 #include "graph/graph.h"
+#include "util/rng.h"
 
 static void _mk_label(graph_label_t *lbl);
 
@@ -51,7 +52,7 @@ uint8_t graph_create_smallworld(
     /* by adding an edge from the current node to the next (k/2) nodes */
     for (j = i+1; j < (i + 1 + k/2); j++) {
 
-      wt = -1.0 + 2.0*((double)rand() / RAND_MAX);
+      wt = -1.0 + 2.0*rng_uniform(rng_default());
 
       if (graph_add_edge(g, i, (j % nnodes), wt)) goto fail;
     }
@@ -68,10 +69,10 @@ uint8_t graph_create_smallworld(
       if (i < nbrs[j])
         continue;
 
-      if (((double)rand() / RAND_MAX) > p)
+      if (rng_uniform(rng_default()) > p)
         continue;
 
-      wt = -1.0 + 2.0*((double)rand() / RAND_MAX);
+      wt = -1.0 + 2.0*rng_uniform(rng_default());
 
       oldnbr = nbrs[j];
 
@@ -82,7 +83,7 @@ uint8_t graph_create_smallworld(
       /*choose a new neighbour*/
       while (1) {
         
-        newnbr = floor(nnodes * ((double)rand() / RAND_MAX));
+        newnbr = rng_range(rng_default(), nnodes);
 
         if (newnbr == i)                        continue;
         if (newnbr == oldnbr)                   continue;
@@ -104,7 +105,7 @@ fail:
 static void _mk_label(graph_label_t *lbl) {
 
   lbl->labelval = 0;
-  lbl->xval     = 5*((double)rand()/RAND_MAX);
-  lbl->yval     = 5*((double)rand()/RAND_MAX);
+  lbl->xval     = 5*rng_uniform(rng_default());
+  lbl->yval     = 5*rng_uniform(rng_default());
   lbl->zval     = 0;
 }
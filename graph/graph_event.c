@@ -31,6 +31,13 @@ static void _fire_edge_removed(
   edge_removed_ctx_t *ctx
 );
 
+/**
+ * Fires the edges rebuilt event on all listeners.
+ */
+static void _fire_edges_rebuilt(
+  graph_t *g
+);
+
 uint8_t graph_add_event_listener(graph_t *g, graph_event_listener_t *l) {
 
   l->id = _id_counter ++;
@@ -50,6 +57,7 @@ void graph_event_fire(graph_t *g, graph_event_t type, void *ctx) {
   switch(type) {
     case GRAPH_EVENT_EDGE_ADDED:   _fire_edge_added(  g, ctx); break;
     case GRAPH_EVENT_EDGE_REMOVED: _fire_edge_removed(g, ctx); break;
+    case GRAPH_EVENT_EDGES_REBUILT: _fire_edges_rebuilt(g);    break;
   }
 }
 
@@ -79,6 +87,19 @@ void _fire_edge_removed(graph_t *g, edge_removed_ctx_t *ctx) {
   }
 }
 
+void _fire_edges_rebuilt(graph_t *g) {
+
+  uint64_t               i;
+  graph_event_listener_t l;
+
+  for (i = 0; i < g->event_listeners.size; i++) {
+
+    if (array_get(&g->event_listeners, i, &l)) return;
+    if (!l.edges_rebuilt) continue;
+    l.edges_rebuilt(g, l.ctx);
+  }
+}
+
 int graph_compare_event_listeners(const void *a, const void *b) {
 
   graph_event_listener_t *gela;
@@ -50,6 +50,15 @@ typedef struct _graph_event_listener {
     uint32_t vidx       /**< index of v, in u's neighbour list             */
   );
 
+  void (*edges_rebuilt)( /**< Called when the neighbour lists of the graph
+                              have been rebuilt, e.g. after a bulk edge
+                              addition (see graph_builder.h). Any per-edge
+                              state kept by the listener is invalid, and
+                              must be rebuilt.                             */
+    graph_t *g,          /**< the graph                                    */
+    void    *ctx         /**< listener context                             */
+  );
+
 } graph_event_listener_t;
 
 /**
@@ -59,6 +68,7 @@ typedef enum {
   
   GRAPH_EVENT_EDGE_ADDED,
   GRAPH_EVENT_EDGE_REMOVED,
+  GRAPH_EVENT_EDGES_REBUILT, /**< no context */
   
 } graph_event_t;
 
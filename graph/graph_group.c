@@ -4,9 +4,11 @@
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "graph/graph.h"
+#include "graph/graph_labelidx.h"
 #include "util/array.h"
 #include "util/compare.h"
 
@@ -22,12 +24,28 @@ static uint8_t _add_node_to_ptn(
 
 uint8_t graph_group_by_label(graph_t *g, node_partition_t *ptn ) {
 
-  uint64_t i;
-  uint32_t nnodes;
+  uint64_t  i;
+  uint32_t  nid;
+  uint32_t  nnodes;
+  uint32_t  nvals;
+  uint32_t  nparts;
+  uint32_t *lblvals;
+  uint32_t *lblidxs;
+  uint32_t *counts;
+  uint32_t *partidxs;
+  array_t   nodeids;
+
+  counts   = NULL;
+  partidxs = NULL;
 
   memset(ptn, 0, sizeof(node_partition_t));
 
-  nnodes = graph_num_nodes(g);
+  nnodes  = graph_num_nodes(g);
+  nvals   = graph_num_labelvals(g);
+  lblvals = graph_get_labelvals(g);
+  lblidxs = graph_labelidx_nodes(g);
+
+  if (lblidxs == NULL) goto fail;
 
   ptn->partids =  calloc(1, sizeof(array_t));
   if (ptn->partids == NULL) goto fail;
@@ -43,16 +61,59 @@ uint8_t graph_group_by_label(graph_t *g, node_partition_t *ptn ) {
   ptn->nparts = 0;
   ptn->nnodes = nnodes;
 
-  for (i = 0; i < nnodes; i++) {
+  /*
+   * count the nodes with each label value index, and
+   * create one partition for every index which is in
+   * use - indices are in label value order, so the
+   * partitions are created in sorted order
+   */
+  counts   = calloc((uint64_t)nvals + 1, sizeof(uint32_t));
+  partidxs = malloc(((uint64_t)nvals + 1) * sizeof(uint32_t));
+
+  if (counts   == NULL) goto fail;
+  if (partidxs == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) counts[lblidxs[i]]++;
+
+  for (i = 0, nparts = 0; i < nvals; i++) {
+
+    if (counts[i] == 0) continue;
+
+    if (array_create(&nodeids, sizeof(uint32_t), counts[i])) goto fail;
+    if (array_append(ptn->partids, lblvals + i))             goto fail;
+    if (array_append(ptn->parts,   &nodeids))                goto fail;
+
+    partidxs[i] = nparts++;
+  }
+
+  for (nid = 0; nid < nnodes; nid++) {
+
+    if (lblidxs[nid] == nvals) continue;
+
+    if (array_append(
+          array_getd(ptn->parts, partidxs[lblidxs[nid]]), &nid)) goto fail;
+  }
+
+  /*
+   * nodes whose label value is not in the label value
+   * list are inserted into their partitions one by one
+   */
+  for (i = 0; counts[nvals] > 0 && i < nnodes; i++) {
+
+    if (lblidxs[i] != nvals) continue;
 
     if (_add_node_to_ptn(g, i, ptn)) goto fail;
   }
   
   ptn->nparts = ptn->parts->size;
 
+  free(counts);
+  free(partidxs);
   return 0;
 
 fail:
+  if (counts   != NULL) free(counts);
+  if (partidxs != NULL) free(partidxs);
   return 1;
 }
 
@@ -85,3 +146,49 @@ uint8_t _add_node_to_ptn(graph_t *g, uint32_t n, node_partition_t *ptn) {
 fail:
   return 1;
 }
+
+uint8_t graph_label_by_partition(graph_t *g, node_partition_t *ptn) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint32_t       nnodes;
+  uint32_t       id;
+  uint32_t      *nids;
+  uint32_t      *lblvals;
+  graph_label_t *lbl;
+
+  lblvals = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  lblvals = malloc(nnodes * sizeof(uint32_t));
+  if (nnodes > 0 && lblvals == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl        = graph_get_nodelabel(g, i);
+    lblvals[i] = (i < g->nodelabels.size) ? lbl->labelval : 0;
+  }
+
+  for (i = 0; i < ptn->nparts; i++) {
+
+    if (ptn->partids != NULL) array_get(ptn->partids, i, &id);
+    else                      id = i + 1;
+
+    nids = (uint32_t *)ptn->parts[i].data;
+
+    for (j = 0; j < ptn->parts[i].size; j++) {
+
+      if (nids[j] >= nnodes) goto fail;
+      lblvals[nids[j]] = id;
+    }
+  }
+
+  if (graph_set_labelvals(g, lblvals)) goto fail;
+
+  free(lblvals);
+  return 0;
+
+fail:
+  if (lblvals != NULL) free(lblvals);
+  return 1;
+}
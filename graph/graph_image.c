@@ -0,0 +1,427 @@
+/**
+ * Memory-mappable images of frozen graphs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "graph/graph.h"
+#include "graph/graph_log.h"
+#include "graph/graph_event.h"
+#include "graph/graph_image.h"
+#include "util/array.h"
+#include "util/compare.h"
+
+#define GRAPH_IMAGE_VERSION 1
+
+/**
+ * Every section of an image starts on a multiple of this many bytes.
+ */
+#define GRAPH_IMAGE_ALIGN 64
+
+/**
+ * Image file header.
+ */
+typedef struct _image_hdr {
+
+  uint32_t magic;      /**< GRAPH_IMAGE_MAGIC                        */
+  uint32_t version;    /**< GRAPH_IMAGE_VERSION                      */
+  uint32_t numnodes;   /**< number of nodes                          */
+  uint32_t numedges;   /**< number of edges                          */
+  uint32_t directed;   /**< non-0 if the graph is directed           */
+  uint32_t nlabelvals; /**< number of unique label values            */
+  uint32_t metaslots;  /**< bit i is set if metadata slot i is saved */
+  uint32_t loglen;     /**< length of the exported log, including the
+                            terminating null, or 0 if there is none  */
+  uint64_t numrefs;    /**< total length of the neighbour lists      */
+  uint64_t numhubidx;  /**< total size of the hub indices, or 0 if the
+                            graph has no hub index                   */
+
+} image_hdr_t;
+
+/**
+ * Image file sections, in file order. The metadata section contains one
+ * array for every saved slot, in slot order.
+ */
+typedef enum {
+  IMAGE_LABELS = 0,
+  IMAGE_NUMNBRS,
+  IMAGE_LABELVALS,
+  IMAGE_META,
+  IMAGE_CSROFFSETS,
+  IMAGE_CSRNBRS,
+  IMAGE_CSRWTS,
+  IMAGE_HUBOFFSETS,
+  IMAGE_HUBIDX,
+  IMAGE_LOG,
+  IMAGE_END
+} image_section_t;
+
+/**
+ * Calculates the file offset of every section of an image with the given
+ * header, and the size of one metadata slot array.
+ */
+static void _layout(
+  image_hdr_t *hdr,    /**< image header                         */
+  uint64_t    *offs,   /**< place to store IMAGE_END+1 offsets   */
+  uint64_t    *metasz  /**< place to store size of a meta array  */
+);
+
+/**
+ * \return the given size, rounded up to a multiple of GRAPH_IMAGE_ALIGN.
+ */
+static uint64_t _align(
+  uint64_t sz /**< size to round up */
+);
+
+/**
+ * Writes the given data at the given file offset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_at(
+  FILE       *fd,  /**< file to write to  */
+  uint64_t    off, /**< file offset       */
+  const void *src, /**< data to write     */
+  uint64_t    len  /**< number of bytes   */
+);
+
+/**
+ * Points the given array at the given data, which is not owned by the
+ * array, and must not be resized.
+ */
+static void _map_array(
+  array_t *array,  /**< array to initialise       */
+  uint32_t datasz, /**< size of one value         */
+  uint32_t n,      /**< number of values          */
+  void    *data    /**< values                    */
+);
+
+uint8_t graph_image_write(graph_t *g, char *f) {
+
+  uint64_t    i;
+  uint64_t    off;
+  uint64_t    metasz;
+  uint64_t    offs[IMAGE_END+1];
+  uint32_t    n;
+  char       *log;
+  FILE       *fd;
+  image_hdr_t hdr;
+
+  fd  = NULL;
+  log = NULL;
+
+  if (g == NULL)           goto fail;
+  if (!graph_is_frozen(g)) goto fail;
+
+  n = graph_num_nodes(g);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic      = GRAPH_IMAGE_MAGIC;
+  hdr.version    = GRAPH_IMAGE_VERSION;
+  hdr.numnodes   = n;
+  hdr.numedges   = graph_num_edges(g);
+  hdr.directed   = graph_is_directed(g);
+  hdr.nlabelvals = graph_num_labelvals(g);
+  hdr.numrefs    = g->csroffsets[n];
+
+  if (g->huboffsets != NULL) hdr.numhubidx = g->huboffsets[n];
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++) {
+    if (g->meta[i] != NULL) hdr.metaslots |= 1u << i;
+  }
+
+  /*the log is exported in the same way as by ngdb_write*/
+  if (graph_log_exists(g) && graph_log_total_len(g) > 0) {
+
+    hdr.loglen = graph_log_total_len(g) + graph_log_num_msgs(g);
+
+    log = calloc(hdr.loglen, 1);
+    if (log == NULL) goto fail;
+
+    graph_log_export(g, log, "\n");
+  }
+
+  _layout(&hdr, offs, &metasz);
+
+  fd = fopen(f, "wb");
+  if (fd == NULL) goto fail;
+
+  if (_write_at(fd, 0, &hdr, sizeof(hdr))) goto fail;
+
+  if (_write_at(fd,
+                offs[IMAGE_LABELS],
+                g->nodelabels.data,
+                (uint64_t)n * sizeof(graph_label_t)))
+    goto fail;
+
+  if (_write_at(fd,
+                offs[IMAGE_NUMNBRS],
+                g->numneighbours.data,
+                (uint64_t)n * sizeof(uint32_t)))
+    goto fail;
+
+  if (_write_at(fd,
+                offs[IMAGE_LABELVALS],
+                g->labelvals.data,
+                (uint64_t)hdr.nlabelvals * sizeof(uint32_t)))
+    goto fail;
+
+  for (i = 0, off = offs[IMAGE_META]; i < _GRAPH_NODE_LABEL_META; i++) {
+
+    if (g->meta[i] == NULL) continue;
+
+    if (_write_at(fd, off, g->meta[i], (uint64_t)n * sizeof(uint32_t)))
+      goto fail;
+    off += metasz;
+  }
+
+  if (_write_at(fd,
+                offs[IMAGE_CSROFFSETS],
+                g->csroffsets,
+                ((uint64_t)n + 1) * sizeof(uint64_t)))
+    goto fail;
+
+  if (_write_at(fd,
+                offs[IMAGE_CSRNBRS],
+                g->csrnbrs,
+                hdr.numrefs * sizeof(uint32_t)))
+    goto fail;
+
+  if (_write_at(fd,
+                offs[IMAGE_CSRWTS],
+                g->csrwts,
+                hdr.numrefs * sizeof(float)))
+    goto fail;
+
+  if (hdr.numhubidx > 0) {
+
+    if (_write_at(fd,
+                  offs[IMAGE_HUBOFFSETS],
+                  g->huboffsets,
+                  ((uint64_t)n + 1) * sizeof(uint64_t)))
+      goto fail;
+
+    if (_write_at(fd,
+                  offs[IMAGE_HUBIDX],
+                  g->hubidx,
+                  hdr.numhubidx * sizeof(uint32_t)))
+      goto fail;
+  }
+
+  if (_write_at(fd, offs[IMAGE_LOG], log, hdr.loglen)) goto fail;
+
+  /*the file must span every section, even if the last ones are empty*/
+  if (fflush(fd))                                   goto fail;
+  if (ftruncate(fileno(fd), offs[IMAGE_END]))       goto fail;
+  if (fclose(fd))                    { fd = NULL;     goto fail; }
+
+  if (log != NULL) free(log);
+
+  return 0;
+
+fail:
+  if (fd  != NULL) fclose(fd);
+  if (log != NULL) free(log);
+  return 1;
+}
+
+uint8_t graph_image_attach(char *f, graph_t *g) {
+
+  int         fd;
+  uint64_t    i;
+  uint64_t    off;
+  uint64_t    metasz;
+  uint64_t    offs[IMAGE_END+1];
+  uint32_t    n;
+  uint8_t    *map;
+  uint64_t    mapsize;
+  struct stat st;
+  image_hdr_t hdr;
+
+  fd      = -1;
+  map     = NULL;
+  mapsize = 0;
+
+  memset(g, 0, sizeof(graph_t));
+
+  fd = open(f, O_RDONLY);
+  if (fd < 0)                              goto fail;
+  if (fstat(fd, &st))                      goto fail;
+  if (st.st_size < (off_t)sizeof(hdr))     goto fail;
+
+  mapsize = st.st_size;
+
+  /*
+   * private and writable, so that the graph can be
+   * modified by this process, without affecting the
+   * file or any other process attached to it
+   */
+  map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) { map = NULL; goto fail; }
+
+  close(fd);
+  fd = -1;
+
+  memcpy(&hdr, map, sizeof(hdr));
+
+  if (hdr.magic   != GRAPH_IMAGE_MAGIC)   goto fail;
+  if (hdr.version != GRAPH_IMAGE_VERSION) goto fail;
+
+  _layout(&hdr, offs, &metasz);
+
+  if (offs[IMAGE_END] > mapsize) goto fail;
+
+  n = hdr.numnodes;
+
+  g->numnodes   = n;
+  g->numedges   = hdr.numedges;
+  g->flags      = 1 << GRAPH_FLAG_FROZEN;
+  g->map        = map;
+  g->mapsize    = mapsize;
+  g->csroffsets = (uint64_t *)(map + offs[IMAGE_CSROFFSETS]);
+  g->csrnbrs    = (uint32_t *)(map + offs[IMAGE_CSRNBRS]);
+  g->csrwts     = (float    *)(map + offs[IMAGE_CSRWTS]);
+
+  if (hdr.directed)     g->flags |= 1 << GRAPH_FLAG_DIRECTED;
+  if (hdr.numhubidx > 0) {
+    g->huboffsets = (uint64_t *)(map + offs[IMAGE_HUBOFFSETS]);
+    g->hubidx     = (uint32_t *)(map + offs[IMAGE_HUBIDX]);
+  }
+
+  if (g->csroffsets[n] != hdr.numrefs) goto fail;
+
+  _map_array(&g->nodelabels,
+             sizeof(graph_label_t), n, map + offs[IMAGE_LABELS]);
+  _map_array(&g->numneighbours,
+             sizeof(uint32_t),      n, map + offs[IMAGE_NUMNBRS]);
+
+  for (i = 0, off = offs[IMAGE_META]; i < _GRAPH_NODE_LABEL_META; i++) {
+
+    if (!((hdr.metaslots >> i) & 1)) continue;
+
+    g->meta[i] = (uint32_t *)(map + off);
+    off       += metasz;
+  }
+
+  /*
+   * the label value list is grown when labels are
+   * changed, so is copied rather than mapped
+   */
+  if (array_create(&g->labelvals, sizeof(uint32_t), hdr.nlabelvals + 1))
+    goto fail;
+  array_set_cmps(&g->labelvals, compare_u32, compare_u32_insert);
+
+  memcpy(g->labelvals.data,
+         map + offs[IMAGE_LABELVALS],
+         hdr.nlabelvals * sizeof(uint32_t));
+  g->labelvals.size = hdr.nlabelvals;
+
+  if (array_create(&g->event_listeners, sizeof(graph_event_listener_t), 5))
+    goto fail;
+  array_set_cmps(&g->event_listeners, graph_compare_event_listeners, NULL);
+
+  if (hdr.loglen > 0) {
+
+    map[offs[IMAGE_LOG] + hdr.loglen - 1] = '\0';
+
+    if (graph_log_init(g))                                      goto fail;
+    if (graph_log_import(g, (char *)map + offs[IMAGE_LOG], "\n")) goto fail;
+  }
+
+  return 0;
+
+fail:
+  if (fd >= 0) close(fd);
+  if (g->map != NULL) graph_free(g);
+  else if (map != NULL) munmap(map, mapsize);
+  memset(g, 0, sizeof(graph_t));
+  return 1;
+}
+
+uint8_t graph_image_is(char *f) {
+
+  FILE    *fd;
+  uint32_t magic;
+
+  fd = fopen(f, "rb");
+  if (fd == NULL) return 0;
+
+  if (fread(&magic, sizeof(magic), 1, fd) != 1) magic = 0;
+
+  fclose(fd);
+
+  return magic == GRAPH_IMAGE_MAGIC;
+}
+
+void _layout(image_hdr_t *hdr, uint64_t *offs, uint64_t *metasz) {
+
+  uint64_t i;
+  uint64_t n;
+  uint64_t nslots;
+  uint64_t hubs;
+
+  n      = hdr->numnodes;
+  hubs   = hdr->numhubidx > 0;
+  nslots = 0;
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++)
+    nslots += (hdr->metaslots >> i) & 1;
+
+  *metasz = _align(n * sizeof(uint32_t));
+
+  offs[IMAGE_LABELS]     = _align(sizeof(image_hdr_t));
+  offs[IMAGE_NUMNBRS]    = offs[IMAGE_LABELS]     +
+                           _align(n * sizeof(graph_label_t));
+  offs[IMAGE_LABELVALS]  = offs[IMAGE_NUMNBRS]    +
+                           _align(n * sizeof(uint32_t));
+  offs[IMAGE_META]       = offs[IMAGE_LABELVALS]  +
+                           _align(hdr->nlabelvals * sizeof(uint32_t));
+  offs[IMAGE_CSROFFSETS] = offs[IMAGE_META]       + nslots * (*metasz);
+  offs[IMAGE_CSRNBRS]    = offs[IMAGE_CSROFFSETS] +
+                           _align((n + 1) * sizeof(uint64_t));
+  offs[IMAGE_CSRWTS]     = offs[IMAGE_CSRNBRS]    +
+                           _align(hdr->numrefs * sizeof(uint32_t));
+  offs[IMAGE_HUBOFFSETS] = offs[IMAGE_CSRWTS]     +
+                           _align(hdr->numrefs * sizeof(float));
+  offs[IMAGE_HUBIDX]     = offs[IMAGE_HUBOFFSETS] +
+                           hubs * _align((n + 1) * sizeof(uint64_t));
+  offs[IMAGE_LOG]        = offs[IMAGE_HUBIDX]     +
+                           _align(hdr->numhubidx * sizeof(uint32_t));
+  offs[IMAGE_END]        = offs[IMAGE_LOG]        + hdr->loglen;
+}
+
+uint64_t _align(uint64_t sz) {
+
+  return (sz + GRAPH_IMAGE_ALIGN - 1) & ~((uint64_t)GRAPH_IMAGE_ALIGN - 1);
+}
+
+uint8_t _write_at(FILE *fd, uint64_t off, const void *src, uint64_t len) {
+
+  if (len == 0) return 0;
+
+  if (fseeko(fd, off, SEEK_SET))      goto fail;
+  if (fwrite(src, 1, len, fd) != len) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _map_array(array_t *array, uint32_t datasz, uint32_t n, void *data) {
+
+  memset(array, 0, sizeof(array_t));
+
+  array->capacity = n;
+  array->size     = n;
+  array->datasz   = datasz;
+  array->data     = data;
+}
@@ -0,0 +1,66 @@
+/**
+ * Memory-mappable images of frozen graphs, which can be shared between
+ * processes.
+ *
+ * A graph image is a single file containing the CSR adjacency of a frozen
+ * graph (see graph_freeze), its hub indices, node labels, metadata and
+ * graph log, laid out exactly as they are stored in memory. Attaching to
+ * an image maps the file into memory, and points the graph arrays into
+ * the mapping - nothing is copied, apart from the (small) list of unique
+ * label values and the graph log, so attaching takes constant time
+ * regardless of the size of the graph.
+ *
+ * The mapping is private and copy-on-write. Processes which attach to the
+ * same image share its pages through the page cache, so each process only
+ * pays for the memory it modifies. An image stored in a RAM backed file
+ * system (e.g. /dev/shm) is effectively a shared memory segment.
+ *
+ * Images are written in the native byte order and type sizes, so are
+ * only portable between machines of the same architecture.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_IMAGE_H__
+#define __GRAPH_IMAGE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Identifies a graph image file.
+ */
+#define GRAPH_IMAGE_MAGIC 0x474D4947
+
+/**
+ * Writes the given graph to an image file. The graph must be frozen.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_image_write(
+  graph_t *g, /**< frozen graph to write */
+  char    *f  /**< file to write it to   */
+);
+
+/**
+ * Attaches the given graph struct to the given image file. The graph is
+ * frozen; it may be thawed, modified and freed as normal, but none of
+ * the changes are written back to the file. The mapping is released by
+ * graph_free.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_image_attach(
+  char    *f, /**< image file to attach to          */
+  graph_t *g  /**< uninitialised graph struct       */
+);
+
+/**
+ * \return non-0 if the given file is a graph image, 0 otherwise (or if it
+ * cannot be read).
+ */
+uint8_t graph_image_is(
+  char *f /**< file to check */
+);
+
+#endif /* __GRAPH_IMAGE_H__ */
@@ -0,0 +1,71 @@
+/**
+ * k-core decomposition of an undirected graph. See graph/graph_kcore.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "graph/graph.h"
+#include "graph/graph_kcore.h"
+#include "graph/degree_queue.h"
+
+uint8_t graph_kcore(graph_t *g, uint32_t *cores, uint32_t *maxk) {
+
+  uint32_t        i;
+  uint32_t        u;
+  uint32_t        v;
+  uint32_t        d;
+  uint32_t        k;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  uint32_t       *nodes;
+  degree_queue_t  q;
+
+  if (graph_is_directed(g))     goto fail;
+  if (degree_queue_init(&q, g)) goto fail;
+
+  k = 0;
+
+  while (degree_queue_size(&q) > 0) {
+
+    d = degree_queue_min_degree(&q);
+    degree_queue_nodes(&q, d, &nodes);
+
+    v        = nodes[0];
+    cores[v] = d;
+
+    if (d > k) k = d;
+
+    nbrs  = graph_get_neighbours(g, v);
+    nnbrs = graph_num_neighbours(g, v);
+
+    /*
+     * neighbours which have a higher degree lose an
+     * edge; the degree of a node never drops below
+     * the degree of the node being removed, which
+     * is therefore its core number
+     */
+    for (i = 0; i < nnbrs; i++) {
+
+      u = nbrs[i];
+
+      if (!degree_queue_contains(&q, u))   continue;
+      if (degree_queue_degree(&q, u) <= d) continue;
+
+      degree_queue_decrement(&q, u);
+    }
+
+    degree_queue_remove(&q, v);
+  }
+
+  degree_queue_free(&q);
+
+  if (maxk != NULL) *maxk = k;
+
+  return 0;
+
+fail:
+  return 1;
+}
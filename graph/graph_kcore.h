@@ -0,0 +1,36 @@
+/**
+ * k-core decomposition of an undirected graph. The k-core of a graph is
+ * the largest subgraph in which every node has a degree of at least k; the
+ * core number (or coreness) of a node is the largest k for which the node
+ * is in the k-core. Core numbers are calculated in time linear in the
+ * number of edges, with the algorithm described in:
+ *
+ *   Batagelj V, Zaversnik M 2003. An O(m) algorithm for cores decomposition
+ *   of networks. arXiv:cs/0310049.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_KCORE_H__
+#define __GRAPH_KCORE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Calculates the core number of every node in the given graph, which must
+ * be undirected. Nodes are repeatedly removed, lowest degree first (see
+ * graph/degree_queue.h); the core number of a node is its degree at the
+ * time it is removed.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_kcore(
+  graph_t  *g,     /**< the graph                               */
+  uint32_t *cores, /**< array of length num_nodes, to store the
+                        core number of each node                */
+  uint32_t *maxk   /**< optional place to store the largest core
+                        number (the degeneracy of the graph)    */
+);
+
+#endif /* __GRAPH_KCORE_H__ */
@@ -0,0 +1,247 @@
+/**
+ * A dense index of the label values of a graph. See graph/graph_labelidx.h
+ * for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_labelidx.h"
+
+/**
+ * Multiplier used to hash label values (Knuth's multiplicative hash).
+ */
+#define LABELIDX_HASH_MULT 0x9E3779B1u
+
+/**
+ * The label value index of a graph.
+ */
+typedef struct _labelidx {
+
+  uint32_t  nvals;    /**< number of label values                    */
+  uint32_t  nmissing; /**< number of nodes whose label value is not
+                           in the label value list                   */
+  uint32_t  hashbits; /**< log2 of the hash table size               */
+  uint32_t *keys;     /**< hash table keys (label values)            */
+  uint32_t *slots;    /**< hash table values - 1 + the index of the
+                           key, or 0 if the slot is empty            */
+  uint32_t *nodes;    /**< label value index of each node            */
+
+} labelidx_t;
+
+/**
+ * \return the up to date label value index of the given graph, building
+ * it if necessary, or NULL on failure.
+ */
+static labelidx_t *_get_index(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Builds a label value index from the current state of the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build(
+  graph_t    *g, /**< the graph                  */
+  labelidx_t *li /**< zeroed index to build into */
+);
+
+/**
+ * \return the index of the given label value, or li->nvals if it is not
+ * in the index.
+ */
+static uint32_t _lookup(
+  labelidx_t *li,      /**< the index             */
+  uint32_t    labelval /**< label value to look up */
+);
+
+/**
+ * Frees the given index - passed to the graph as its ctx_free function.
+ */
+static void _labelidx_free(
+  void *vli /**< pointer to a labelidx_t struct */
+);
+
+uint8_t graph_labelidx_init(graph_t *g) {
+
+  return _get_index(g) == NULL;
+}
+
+void graph_labelidx_free(graph_t *g) {
+
+  if (g->ctx[_GRAPH_LABELIDX_CTX_LOC_] == NULL) return;
+
+  _labelidx_free(g->ctx[_GRAPH_LABELIDX_CTX_LOC_]);
+
+  g->ctx[     _GRAPH_LABELIDX_CTX_LOC_] = NULL;
+  g->ctx_free[_GRAPH_LABELIDX_CTX_LOC_] = NULL;
+}
+
+uint32_t *graph_labelidx_nodes(graph_t *g) {
+
+  labelidx_t *li;
+
+  li = _get_index(g);
+  if (li == NULL) return NULL;
+
+  return li->nodes;
+}
+
+int64_t graph_labelidx_find(graph_t *g, uint32_t labelval) {
+
+  uint32_t    idx;
+  labelidx_t *li;
+
+  li = _get_index(g);
+  if (li == NULL) return -1;
+
+  idx = _lookup(li, labelval);
+
+  if (idx == li->nvals) return -1;
+  return idx;
+}
+
+uint32_t graph_labelidx_num(graph_t *g) {
+
+  labelidx_t *li;
+
+  li = _get_index(g);
+  if (li == NULL) return 0;
+
+  return li->nvals + (li->nmissing > 0);
+}
+
+void graph_labelidx_set(graph_t *g, uint32_t nid, uint32_t labelval) {
+
+  uint32_t    idx;
+  labelidx_t *li;
+
+  li = g->ctx[_GRAPH_LABELIDX_CTX_LOC_];
+
+  if (li == NULL) return;
+
+  /*
+   * a new label value shifts the indices of
+   * every larger value, so the index is rebuilt
+   */
+  idx = _lookup(li, labelval);
+
+  if (idx == li->nvals) {
+    graph_labelidx_free(g);
+    return;
+  }
+
+  if (li->nodes[nid] == li->nvals) li->nmissing--;
+
+  li->nodes[nid] = idx;
+}
+
+labelidx_t *_get_index(graph_t *g) {
+
+  labelidx_t *li;
+
+  li = g->ctx[_GRAPH_LABELIDX_CTX_LOC_];
+
+  if (li != NULL) return li;
+
+  li = calloc(1, sizeof(labelidx_t));
+  if (li == NULL) goto fail;
+
+  if (_build(g, li)) goto fail;
+
+  g->ctx[     _GRAPH_LABELIDX_CTX_LOC_] = li;
+  g->ctx_free[_GRAPH_LABELIDX_CTX_LOC_] = _labelidx_free;
+
+  return li;
+
+fail:
+  if (li != NULL) _labelidx_free(li);
+  return NULL;
+}
+
+uint8_t _build(graph_t *g, labelidx_t *li) {
+
+  uint64_t  i;
+  uint32_t  h;
+  uint32_t  mask;
+  uint32_t  nnodes;
+  uint32_t *lblvals;
+
+  nnodes       = graph_num_nodes(g);
+  lblvals      = graph_get_labelvals(g);
+  li->nvals    = graph_num_labelvals(g);
+  li->hashbits = 4;
+
+  /*the table is kept at most half full*/
+  while ((1ull << li->hashbits) < 2 * (uint64_t)li->nvals) li->hashbits++;
+
+  li->keys  = malloc( (1ull << li->hashbits) * sizeof(uint32_t));
+  li->slots = calloc( (1ull << li->hashbits),  sizeof(uint32_t));
+  li->nodes = malloc(((uint64_t)nnodes + 1)  * sizeof(uint32_t));
+
+  if (li->keys  == NULL) goto fail;
+  if (li->slots == NULL) goto fail;
+  if (li->nodes == NULL) goto fail;
+
+  mask = (1u << li->hashbits) - 1;
+
+  /*label values are unique, so are inserted without checking*/
+  for (i = 0; i < li->nvals; i++) {
+
+    h = (lblvals[i] * LABELIDX_HASH_MULT) >> (32 - li->hashbits);
+
+    while (li->slots[h] != 0) h = (h + 1) & mask;
+
+    li->keys [h] = lblvals[i];
+    li->slots[h] = i + 1;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    li->nodes[i] = _lookup(li, graph_get_nodelabel(g, i)->labelval);
+
+    if (li->nodes[i] == li->nvals) li->nmissing++;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint32_t _lookup(labelidx_t *li, uint32_t labelval) {
+
+  uint32_t h;
+  uint32_t mask;
+
+  mask = (1u << li->hashbits) - 1;
+  h    = (labelval * LABELIDX_HASH_MULT) >> (32 - li->hashbits);
+
+  while (li->slots[h] != 0) {
+
+    if (li->keys[h] == labelval) return li->slots[h] - 1;
+
+    h = (h + 1) & mask;
+  }
+
+  return li->nvals;
+}
+
+void _labelidx_free(void *vli) {
+
+  labelidx_t *li;
+
+  li = vli;
+
+  if (li == NULL) return;
+
+  if (li->keys  != NULL) free(li->keys);
+  if (li->slots != NULL) free(li->slots);
+  if (li->nodes != NULL) free(li->nodes);
+
+  free(li);
+}
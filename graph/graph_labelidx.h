@@ -0,0 +1,92 @@
+/**
+ * A dense index of the label values of a graph. Every label value in
+ * graph_get_labelvals(g) is given an index in the range [0, L), where L is
+ * graph_num_labelvals(g) - the index of a value is its position in the
+ * (sorted) label value list - and the index of the label value of every
+ * node is stored in a column, so that functions which group nodes by
+ * label (e.g. graph_group_by_label, modularity) can use the indices to
+ * address plain arrays, rather than searching for every value. A node
+ * whose label value is not in the list (e.g. the zero label of a node in
+ * a new graph) is given the index L.
+ *
+ * A hash table maps label values to their indices, so the index of any
+ * value may be found in constant time with graph_labelidx_find.
+ *
+ * The index is created the first time that it is needed, with one linear
+ * pass over the nodes, and is attached to the graph (via the graph ctx
+ * fields), so it is reused by later queries, and freed along with the
+ * graph. When a node label is changed with graph_set_nodelabel, the node's
+ * entry in the column is updated in place if the new label value is
+ * already in the index; if it is a new value (which changes the position
+ * of every larger value), the index is discarded, and rebuilt on the next
+ * query.
+ *
+ * The index is not created in a thread-safe manner - if a graph is to be
+ * queried by several threads, graph_labelidx_init should be called first.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_LABELIDX_H__
+#define __GRAPH_LABELIDX_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Creates the label value index for the given graph, if it does not
+ * exist.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_labelidx_init(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Frees the label value index of the given graph, if it has one.
+ */
+void graph_labelidx_free(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return the index of the label value of every node, in the range
+ * [0, graph_num_labelvals(g)], or NULL on failure. The returned pointer
+ * belongs to the index, and is invalidated when a label is changed.
+ */
+uint32_t *graph_labelidx_nodes(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return the index of the given label value, or -1 if it is not in the
+ * graph's label value list (or on failure).
+ */
+int64_t graph_labelidx_find(
+  graph_t *g,       /**< the graph             */
+  uint32_t labelval /**< label value to look up */
+);
+
+/**
+ * \return the number of indices used by the nodes of the graph - either
+ * graph_num_labelvals(g), or one more, if any node has a label value
+ * which is not in the list - or 0 on failure.
+ */
+uint32_t graph_labelidx_num(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Updates the index entry of the given node, after its label value has
+ * been changed - called by graph_set_nodelabel, after the new value has
+ * been added to the label value list. Does nothing if the graph has no
+ * index.
+ */
+void graph_labelidx_set(
+  graph_t *g,       /**< the graph             */
+  uint32_t nid,     /**< the node              */
+  uint32_t labelval /**< its new label value   */
+);
+
+#endif /* __GRAPH_LABELIDX_H__ */
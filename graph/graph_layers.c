@@ -0,0 +1,322 @@
+/**
+ * Multi-layer graphs which share one set of nodes.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_layers.h"
+#include "util/bigmem.h"
+#include "util/intersect.h"
+#include "util/parallel.h"
+
+/**
+ * Number of nodes handed out to a thread at a time by the stats functions.
+ */
+#define LAYERS_CHUNK 1024
+
+/**
+ * Context passed to _degree_nodes and _clustering_nodes.
+ */
+typedef struct _layers_ctx {
+
+  graph_layers_t *l;       /**< the multi-layer graph          */
+  uint32_t       *degrees; /**< degree output, or NULL         */
+  double         *clust;   /**< clustering output, or NULL     */
+
+} layers_ctx_t;
+
+/**
+ * parallel_for function which calculates the degree of a range of nodes,
+ * in every layer.
+ *
+ * \return 0.
+ */
+static uint8_t _degree_nodes(
+  uint64_t start,  /**< first node                     */
+  uint64_t end,    /**< one past the last node         */
+  uint16_t thread, /**< thread identifier              */
+  void    *ctx     /**< pointer to a layers_ctx_t      */
+);
+
+/**
+ * parallel_for function which calculates the clustering coefficient of a
+ * range of nodes, in every layer.
+ *
+ * \return 0.
+ */
+static uint8_t _clustering_nodes(
+  uint64_t start,  /**< first node                     */
+  uint64_t end,    /**< one past the last node         */
+  uint16_t thread, /**< thread identifier              */
+  void    *ctx     /**< pointer to a layers_ctx_t      */
+);
+
+uint8_t graph_layers_init(graph_layers_t *l, graph_t *g) {
+
+  uint64_t i;
+  uint32_t n;
+  uint32_t nvals;
+
+  memset(l, 0, sizeof(graph_layers_t));
+
+  n     = graph_num_nodes(g);
+  nvals = graph_num_labelvals(g);
+
+  l->numnodes   = n;
+  l->directed   = graph_is_directed(g);
+  l->nlabelvals = nvals;
+
+  l->labels    = malloc(((uint64_t)n + 1) * sizeof(graph_label_t));
+  l->labelvals = malloc(((uint64_t)nvals + 1) * sizeof(uint32_t));
+  if (l->labels == NULL || l->labelvals == NULL) goto fail;
+
+  for (i = 0; i < n; i++) {
+    if (graph_get_nodelabel(g, i) != NULL)
+      l->labels[i] = *graph_get_nodelabel(g, i);
+    else
+      memset(l->labels + i, 0, sizeof(graph_label_t));
+  }
+
+  memcpy(l->labelvals, graph_get_labelvals(g), nvals * sizeof(uint32_t));
+
+  return 0;
+
+fail:
+  graph_layers_free(l);
+  return 1;
+}
+
+void graph_layers_free(graph_layers_t *l) {
+
+  uint64_t i;
+
+  for (i = 0; i < l->nlayers; i++) {
+    bigmem_free(l->layers[i].offsets);
+    bigmem_free(l->layers[i].nbrs);
+    bigmem_free(l->layers[i].wts);
+  }
+
+  if (l->layers    != NULL) free(l->layers);
+  if (l->labels    != NULL) free(l->labels);
+  if (l->labelvals != NULL) free(l->labelvals);
+
+  memset(l, 0, sizeof(graph_layers_t));
+}
+
+uint8_t graph_layers_add(graph_layers_t *l, graph_t *g) {
+
+  uint64_t       i;
+  uint64_t       nrefs;
+  uint32_t       n;
+  uint32_t       nnbrs;
+  uint32_t       newcap;
+  graph_label_t *lbl;
+  graph_layer_t *layers;
+  graph_layer_t  layer;
+
+  memset(&layer, 0, sizeof(graph_layer_t));
+
+  n = l->numnodes;
+
+  if (graph_num_nodes(g)   != n)           goto fail;
+  if (graph_is_directed(g) != l->directed) goto fail;
+
+  for (i = 0; i < n; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+
+    if (lbl == NULL) continue;
+    if (memcmp(lbl, l->labels + i, sizeof(graph_label_t))) goto fail;
+  }
+
+  if (l->nlayers == l->capacity) {
+
+    newcap = l->capacity > 0 ? 2 * l->capacity : 4;
+    layers = realloc(l->layers, newcap * sizeof(graph_layer_t));
+    if (layers == NULL) goto fail;
+
+    l->layers   = layers;
+    l->capacity = newcap;
+  }
+
+  layer.numedges = graph_num_edges(g);
+  layer.offsets  = bigmem_alloc(((uint64_t)n + 1) * sizeof(uint64_t));
+  if (layer.offsets == NULL) goto fail;
+
+  layer.offsets[0] = 0;
+  for (i = 0; i < n; i++)
+    layer.offsets[i+1] = layer.offsets[i] + graph_num_neighbours(g, i);
+
+  nrefs = layer.offsets[n];
+
+  layer.nbrs = bigmem_alloc((nrefs > 0 ? nrefs : 1) * sizeof(uint32_t));
+  layer.wts  = bigmem_alloc((nrefs > 0 ? nrefs : 1) * sizeof(float));
+  if (layer.nbrs == NULL || layer.wts == NULL) goto fail;
+
+  /*a frozen graph is already in the layer's form*/
+  if (graph_is_frozen(g)) {
+    memcpy(layer.nbrs, g->csrnbrs, nrefs * sizeof(uint32_t));
+    memcpy(layer.wts,  g->csrwts,  nrefs * sizeof(float));
+  }
+  else {
+    for (i = 0; i < n; i++) {
+
+      nnbrs = graph_num_neighbours(g, i);
+
+      memcpy(layer.nbrs + layer.offsets[i],
+             graph_get_neighbours(g, i),
+             nnbrs * sizeof(uint32_t));
+      memcpy(layer.wts + layer.offsets[i],
+             graph_get_weights(g, i),
+             nnbrs * sizeof(float));
+    }
+  }
+
+  l->layers[l->nlayers++] = layer;
+
+  return 0;
+
+fail:
+  bigmem_free(layer.offsets);
+  bigmem_free(layer.nbrs);
+  bigmem_free(layer.wts);
+  return 1;
+}
+
+uint32_t graph_layers_num_layers(graph_layers_t *l) {
+  return l->nlayers;
+}
+
+uint32_t graph_layers_num_nodes(graph_layers_t *l) {
+  return l->numnodes;
+}
+
+graph_label_t * graph_layers_get_nodelabel(graph_layers_t *l, uint32_t nidx) {
+  return l->labels + nidx;
+}
+
+uint32_t graph_layers_num_neighbours(
+  graph_layers_t *l, uint32_t layer, uint32_t nidx) {
+
+  graph_layer_t *ly;
+
+  ly = l->layers + layer;
+
+  return ly->offsets[nidx+1] - ly->offsets[nidx];
+}
+
+uint32_t * graph_layers_get_neighbours(
+  graph_layers_t *l, uint32_t layer, uint32_t nidx) {
+
+  graph_layer_t *ly;
+
+  ly = l->layers + layer;
+
+  return ly->nbrs + ly->offsets[nidx];
+}
+
+float * graph_layers_get_weights(
+  graph_layers_t *l, uint32_t layer, uint32_t nidx) {
+
+  graph_layer_t *ly;
+
+  ly = l->layers + layer;
+
+  return ly->wts + ly->offsets[nidx];
+}
+
+uint8_t graph_layers_degree(
+  graph_layers_t *l, uint32_t *degrees, uint16_t nthreads) {
+
+  layers_ctx_t ctx;
+
+  ctx.l       = l;
+  ctx.degrees = degrees;
+  ctx.clust   = NULL;
+
+  return parallel_for(
+    nthreads, l->numnodes, LAYERS_CHUNK, &ctx, _degree_nodes);
+}
+
+uint8_t graph_layers_clustering(
+  graph_layers_t *l, double *clust, uint16_t nthreads) {
+
+  layers_ctx_t ctx;
+
+  if (l->directed) return 1;
+
+  ctx.l       = l;
+  ctx.degrees = NULL;
+  ctx.clust   = clust;
+
+  return parallel_for(
+    nthreads, l->numnodes, LAYERS_CHUNK, &ctx, _clustering_nodes);
+}
+
+uint8_t _degree_nodes(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t        u;
+  uint64_t        i;
+  layers_ctx_t   *ctx;
+  graph_layers_t *l;
+
+  ctx = vctx;
+  l   = ctx->l;
+
+  for (u = start; u < end; u++) {
+    for (i = 0; i < l->nlayers; i++)
+      ctx->degrees[i*l->numnodes + u] = graph_layers_num_neighbours(l, i, u);
+  }
+
+  return 0;
+}
+
+uint8_t _clustering_nodes(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t        u;
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        numedges;
+  uint64_t        maxedges;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  layers_ctx_t   *ctx;
+  graph_layers_t *l;
+  double         *out;
+
+  ctx = vctx;
+  l   = ctx->l;
+
+  for (u = start; u < end; u++) {
+    for (i = 0; i < l->nlayers; i++) {
+
+      out   = ctx->clust + i*l->numnodes + u;
+      nnbrs = graph_layers_num_neighbours(l, i, u);
+      nbrs  = graph_layers_get_neighbours(l, i, u);
+
+      if (nnbrs == 0) { *out = 0.0; continue; }
+      if (nnbrs == 1) { *out = 1.0; continue; }
+
+      maxedges = (uint64_t)nnbrs * (nnbrs - 1) / 2;
+      numedges = 0;
+
+      for (j = 0; j < nnbrs - 1; j++) {
+        numedges += intersect_count(
+          nbrs + j + 1,
+          nnbrs - j - 1,
+          graph_layers_get_neighbours(l, i, nbrs[j]),
+          graph_layers_num_neighbours(l, i, nbrs[j]));
+      }
+
+      *out = (double)numedges / maxedges;
+    }
+  }
+
+  return 0;
+}
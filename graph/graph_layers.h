@@ -0,0 +1,165 @@
+/**
+ * Multi-layer graphs - a collection of graphs which share one set of nodes,
+ * such as the graphs of one subject at several thresholds, in several
+ * frequency bands, or in several time windows. The node labels are stored
+ * once, and the adjacency of each layer is stored separately, in CSR form
+ * (see graph_freeze), so a layer costs no more than its edges.
+ *
+ * The stats functions in this module calculate a measure for every layer
+ * in a single pass over the nodes - each thread takes a range of nodes,
+ * and calculates the measure of each node in every layer before moving on
+ * to the next node, so per-node work (and the node labels) are shared
+ * between the layers.
+ *
+ * Node metadata (see graph_get_meta) and graph logs are not kept.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_LAYERS_H__
+#define __GRAPH_LAYERS_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * The adjacency of one layer. The neighbours of node u are stored at
+ * nbrs[offsets[u]] to nbrs[offsets[u+1]-1], in ascending order.
+ */
+typedef struct _graph_layer {
+
+  uint32_t  numedges; /**< number of edges in the layer       */
+  uint64_t *offsets;  /**< start of each node's neighbours    */
+  uint32_t *nbrs;     /**< all neighbours, node by node       */
+  float    *wts;      /**< all weights, node by node          */
+
+} graph_layer_t;
+
+/**
+ * A multi-layer graph.
+ */
+typedef struct _graph_layers {
+
+  uint32_t       numnodes;   /**< number of nodes                   */
+  uint8_t        directed;   /**< non-0 if the layers are directed  */
+  uint32_t       nlayers;    /**< number of layers                  */
+  uint32_t       capacity;   /**< space in the layers array         */
+  graph_label_t *labels;     /**< label of every node               */
+  uint32_t       nlabelvals; /**< number of unique label values     */
+  uint32_t      *labelvals;  /**< unique label values, ascending    */
+  graph_layer_t *layers;     /**< the layers                        */
+
+} graph_layers_t;
+
+/**
+ * Initialises an empty multi-layer graph, with the nodes and labels of
+ * the given graph. The graph is not added as a layer.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_layers_init(
+  graph_layers_t *l, /**< uninitialised multi-layer graph */
+  graph_t        *g  /**< graph to take the nodes from    */
+);
+
+/**
+ * Frees the memory used by the given multi-layer graph.
+ */
+void graph_layers_free(
+  graph_layers_t *l /**< the multi-layer graph */
+);
+
+/**
+ * Adds a copy of the adjacency of the given graph as a new layer. The
+ * graph must have the same number of nodes, with the same labels, and
+ * the same directedness, as the multi-layer graph; it is not modified,
+ * and may be freed once it has been added.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph does
+ * not match).
+ */
+uint8_t graph_layers_add(
+  graph_layers_t *l, /**< the multi-layer graph */
+  graph_t        *g  /**< graph to add          */
+);
+
+/**
+ * \return the number of layers.
+ */
+uint32_t graph_layers_num_layers(
+  graph_layers_t *l /**< the multi-layer graph */
+);
+
+/**
+ * \return the number of nodes.
+ */
+uint32_t graph_layers_num_nodes(
+  graph_layers_t *l /**< the multi-layer graph */
+);
+
+/**
+ * \return a pointer to the label of the given node.
+ */
+graph_label_t * graph_layers_get_nodelabel(
+  graph_layers_t *l,   /**< the multi-layer graph */
+  uint32_t        nidx /**< the node              */
+);
+
+/**
+ * \return the number of neighbours of the given node in the given layer.
+ */
+uint32_t graph_layers_num_neighbours(
+  graph_layers_t *l,     /**< the multi-layer graph */
+  uint32_t        layer, /**< the layer             */
+  uint32_t        nidx   /**< the node              */
+);
+
+/**
+ * \return a pointer to the neighbours of the given node in the given
+ * layer.
+ */
+uint32_t * graph_layers_get_neighbours(
+  graph_layers_t *l,     /**< the multi-layer graph */
+  uint32_t        layer, /**< the layer             */
+  uint32_t        nidx   /**< the node              */
+);
+
+/**
+ * \return a pointer to the weights of the edges of the given node in the
+ * given layer.
+ */
+float * graph_layers_get_weights(
+  graph_layers_t *l,     /**< the multi-layer graph */
+  uint32_t        layer, /**< the layer             */
+  uint32_t        nidx   /**< the node              */
+);
+
+/**
+ * Calculates the degree of every node in every layer. The degree of node
+ * u in layer i is stored at degrees[i*numnodes + u].
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_layers_degree(
+  graph_layers_t *l,       /**< the multi-layer graph                   */
+  uint32_t       *degrees, /**< space for nlayers*numnodes values       */
+  uint16_t        nthreads /**< number of threads (0 for default, see
+                                util/parallel.h)                        */
+);
+
+/**
+ * Calculates the clustering coefficient of every node in every layer, in
+ * the same way as stats_clustering (see stats/stats.h). The coefficient
+ * of node u in layer i is stored at clust[i*numnodes + u]. The layers
+ * must be undirected.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_layers_clustering(
+  graph_layers_t *l,       /**< the multi-layer graph                   */
+  double         *clust,   /**< space for nlayers*numnodes values       */
+  uint16_t        nthreads /**< number of threads (0 for default, see
+                                util/parallel.h)                        */
+);
+
+#endif /* __GRAPH_LAYERS_H__ */
@@ -0,0 +1,92 @@
+/**
+ * Provides functions which find the nodes at each distance from a source
+ * node, and store them in a flat array, level by level.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/bfs.h"
+
+/**
+ * Breadth first search callback function. Appends the
+ * current level to the level structure.
+ *
+ * \return 0 always.
+ */
+static uint8_t _bfs_cb(
+  bfs_state_t *state,  /**< bfs state                             */
+  void        *context /**< pointer to a graph_levels_t struct    */
+);
+
+uint8_t graph_levels_init(graph_levels_t *levels, uint32_t numnodes) {
+
+  memset(levels, 0, sizeof(graph_levels_t));
+
+  levels->order   = malloc(((uint64_t)numnodes + 1) * sizeof(uint32_t));
+  levels->offsets = malloc(((uint64_t)numnodes + 2) * sizeof(uint32_t));
+
+  if (levels->order   == NULL) goto fail;
+  if (levels->offsets == NULL) goto fail;
+
+  levels->capacity = numnodes;
+
+  return 0;
+
+fail:
+  graph_levels_free(levels);
+  return 1;
+}
+
+void graph_levels_free(graph_levels_t *levels) {
+
+  if (levels->order   != NULL) free(levels->order);
+  if (levels->offsets != NULL) free(levels->offsets);
+
+  memset(levels, 0, sizeof(graph_levels_t));
+}
+
+uint8_t graph_levels(graph_t *g, uint32_t u, graph_levels_t *levels) {
+
+  uint32_t numnodes;
+
+  numnodes = graph_num_nodes(g);
+
+  if (levels->capacity < numnodes) {
+    graph_levels_free(levels);
+    if (graph_levels_init(levels, numnodes)) goto fail;
+  }
+
+  levels->order[0]   = u;
+  levels->offsets[0] = 0;
+  levels->offsets[1] = 1;
+  levels->nlevels    = 1;
+
+  if (bfs(g, &u, 1, NULL, levels, NULL, _bfs_cb, NULL)) goto fail;
+
+  return 0;
+  
+fail:
+  return 1;
+}
+
+uint8_t _bfs_cb(bfs_state_t *state, void *context) {
+
+  graph_levels_t *levels;
+  uint32_t        start;
+
+  levels = (graph_levels_t *)context;
+  start  = levels->offsets[state->depth];
+
+  memcpy(levels->order + start,
+         state->thislevel.data,
+         state->thislevel.size * sizeof(uint32_t));
+
+  levels->offsets[state->depth + 1] = start + state->thislevel.size;
+  levels->nlevels                   = state->depth + 1;
+
+  return 0;
+}
@@ -7,51 +7,176 @@
 #include <stdint.h>
 #include <stdlib.h>
 
-#include "util/array.h"
 #include "graph/graph.h"
 #include "graph/graph_log.h"
 
 /**
- * Frees the memory used by the given trailx.
+ * A log - the messages are stored, '\0' terminated, one after the other in
+ * a single buffer. A log may be shared between several graphs; it is freed
+ * when the last of them releases it.
+ */
+typedef struct _graph_log {
+
+  uint32_t  refs;    /**< number of graphs sharing the log         */
+  char     *buf;     /**< message data                             */
+  uint64_t  len;     /**< bytes used in buf, including terminators */
+  uint64_t  cap;     /**< capacity of buf                          */
+  uint64_t *offsets; /**< offset of each message in buf            */
+  uint32_t  nmsgs;   /**< number of messages                       */
+  uint32_t  msgcap;  /**< capacity of offsets                      */
+
+} graph_log_t;
+
+/**
+ * Releases the given log, freeing it if no other graph shares it.
  */
 static void _log_free(
-  void *log /**< pointer to an array_t struct containing messages */
+  void *log /**< pointer to a graph_log_t struct */
+);
+
+/**
+ * Makes sure that the log attached to the given graph is not shared with
+ * any other graph, copying it if necessary, so that it may be written to.
+ *
+ * \return the log, or NULL if the graph has no log, or on failure.
+ */
+static graph_log_t * _log_own(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Appends a message of the given length to the log, which must not be
+ * shared.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _log_append(
+  graph_log_t *log, /**< the log                       */
+  char        *msg, /**< the message                   */
+  uint64_t     len  /**< length of msg, excluding '\0' */
 );
 
 uint8_t graph_log_init(graph_t *g) {
 
-  array_t *log;
+  graph_log_t *log;
 
-  log = calloc(sizeof(array_t), 1);
+  log = calloc(sizeof(graph_log_t), 1);
   if (log == NULL) goto fail;
 
-  if (array_create(log, sizeof(char *), 10)) goto fail;
+  log->refs = 1;
+
+  if (g->ctx[_GRAPH_LOG_CTX_LOC_] != NULL)
+    _log_free(g->ctx[_GRAPH_LOG_CTX_LOC_]);
 
   g->ctx[     _GRAPH_LOG_CTX_LOC_] = log;
   g->ctx_free[_GRAPH_LOG_CTX_LOC_] = _log_free;
 
   return 0;
-  
+
 fail:
-  if (log != NULL) free(log);
   return 1;
 }
 
 void _log_free(void *vlog) {
 
-  array_t *log;
-  char    *msg;
-  uint64_t i;
+  graph_log_t *log;
 
   log = vlog;
 
-  for (i = 0; i < log->size; i++) {
+  if (__atomic_sub_fetch(&log->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+  if (log->buf     != NULL) free(log->buf);
+  if (log->offsets != NULL) free(log->offsets);
+  free(log);
+}
+
+graph_log_t * _log_own(graph_t *g) {
+
+  graph_log_t *log;
+  graph_log_t *cpy;
 
-    msg = *(char **)array_getd(log, i);
-    if (msg != NULL) free(msg);
+  cpy = NULL;
+  log = g->ctx[_GRAPH_LOG_CTX_LOC_];
+
+  if (log == NULL) return NULL;
+
+  if (__atomic_load_n(&log->refs, __ATOMIC_ACQUIRE) == 1) return log;
+
+  cpy = calloc(sizeof(graph_log_t), 1);
+  if (cpy == NULL) goto fail;
+
+  cpy->refs   = 1;
+  cpy->len    = log->len;
+  cpy->cap    = log->len;
+  cpy->nmsgs  = log->nmsgs;
+  cpy->msgcap = log->nmsgs;
+
+  if (log->len > 0) {
+    cpy->buf     = malloc(log->len);
+    cpy->offsets = malloc(log->nmsgs * sizeof(uint64_t));
+
+    if (cpy->buf     == NULL) goto fail;
+    if (cpy->offsets == NULL) goto fail;
+
+    memcpy(cpy->buf,     log->buf,     log->len);
+    memcpy(cpy->offsets, log->offsets, log->nmsgs * sizeof(uint64_t));
   }
 
-  array_free(log);
+  _log_free(log);
+  g->ctx[_GRAPH_LOG_CTX_LOC_] = cpy;
+
+  return cpy;
+
+fail:
+  if (cpy != NULL) {
+    if (cpy->buf     != NULL) free(cpy->buf);
+    if (cpy->offsets != NULL) free(cpy->offsets);
+    free(cpy);
+  }
+  return NULL;
+}
+
+uint8_t _log_append(graph_log_t *log, char *msg, uint64_t len) {
+
+  char     *buf;
+  uint64_t *offsets;
+  uint64_t  cap;
+  uint32_t  msgcap;
+
+  if (log->nmsgs == UINT32_MAX) goto fail;
+
+  if (log->len + len + 1 > log->cap) {
+
+    cap = (log->cap == 0) ? 256 : log->cap;
+    while (cap < log->len + len + 1) cap *= 2;
+
+    buf = realloc(log->buf, cap);
+    if (buf == NULL) goto fail;
+
+    log->buf = buf;
+    log->cap = cap;
+  }
+
+  if (log->nmsgs == log->msgcap) {
+
+    msgcap  = (log->msgcap == 0) ? 16 : 2 * log->msgcap;
+    offsets = realloc(log->offsets, msgcap * sizeof(uint64_t));
+    if (offsets == NULL) goto fail;
+
+    log->offsets = offsets;
+    log->msgcap  = msgcap;
+  }
+
+  memcpy(log->buf + log->len, msg, len);
+  log->buf[log->len + len] = '\0';
+
+  log->offsets[log->nmsgs++] = log->len;
+  log->len                  += len + 1;
+
+  return 0;
+
+fail:
+  return 1;
 }
 
 uint8_t graph_log_exists(graph_t *g) {
@@ -59,62 +184,52 @@ uint8_t graph_log_exists(graph_t *g) {
   return g->ctx[_GRAPH_LOG_CTX_LOC_] != NULL ? 1 : 0;
 }
 
-uint16_t graph_log_num_msgs(graph_t *g) {
+uint32_t graph_log_num_msgs(graph_t *g) {
 
-  array_t *log;
+  graph_log_t *log;
 
   log = g->ctx[_GRAPH_LOG_CTX_LOC_];
-  
+
   if (log == NULL) return 0;
 
-  return log->size;
-  
-  return 0;
+  return log->nmsgs;
 }
 
-char * graph_log_get_msg(graph_t *g, uint16_t i) {
+char * graph_log_get_msg(graph_t *g, uint32_t i) {
 
-  array_t *log;
+  graph_log_t *log;
 
   log = g->ctx[_GRAPH_LOG_CTX_LOC_];
-  
-  if (log == NULL)      return NULL;
-  if (i   >= log->size) return NULL;
 
-  return *(char **)array_getd(log, i);
+  if (log == NULL)       return NULL;
+  if (i   >= log->nmsgs) return NULL;
+
+  return log->buf + log->offsets[i];
 }
 
 uint8_t graph_log_add(graph_t *g, char *msg) {
 
-  array_t *log;
-  char    *msgcpy;
-  uint32_t len;
+  graph_log_t *log;
 
-  msgcpy = NULL;
-  len    = strlen(msg);
-  log    = g->ctx[_GRAPH_LOG_CTX_LOC_];
-  
-  if (log == NULL) return 0;
+  if (g->ctx[_GRAPH_LOG_CTX_LOC_] == NULL) return 0;
 
-  msgcpy = malloc(len+1);
-  if (msgcpy == NULL) goto fail;
-  
-  strcpy(msgcpy, msg);
+  log = _log_own(g);
+  if (log == NULL) goto fail;
 
-  if (array_append(log, &msgcpy)) goto fail;
+  if (_log_append(log, msg, strlen(msg))) goto fail;
 
   return 0;
-  
+
 fail:
-  if (msgcpy!= NULL) free(msgcpy);
   return 1;
 }
 
 uint8_t graph_log_copy(graph_t *gin, graph_t *gout) {
 
-  uint32_t i;
-  uint16_t nmsgs;
-  char    *msg;
+  uint32_t     i;
+  graph_log_t *inlog;
+  graph_log_t *outlog;
+  char        *msg;
 
   if (gin  == NULL) goto fail;
   if (gout == NULL) goto fail;
@@ -123,79 +238,75 @@ uint8_t graph_log_copy(graph_t *gin, graph_t *gout) {
     if (graph_log_init(gout))
       goto fail;
   }
-  
+
   if (!graph_log_exists(gin)) return 0;
 
-  nmsgs = graph_log_num_msgs(gin);
+  inlog  = gin ->ctx[_GRAPH_LOG_CTX_LOC_];
+  outlog = gout->ctx[_GRAPH_LOG_CTX_LOC_];
+
+  if (inlog == outlog) return 0;
 
-  for (i = 0; i < nmsgs; i++) {
+  /* nothing to keep in the output log - share the input log */
+  if (outlog->nmsgs == 0) {
 
-    msg = graph_log_get_msg(gin, i);
+    __atomic_add_fetch(&inlog->refs, 1, __ATOMIC_ACQ_REL);
+    _log_free(outlog);
+    gout->ctx[_GRAPH_LOG_CTX_LOC_] = inlog;
+    return 0;
+  }
+
+  outlog = _log_own(gout);
+  if (outlog == NULL) goto fail;
+
+  for (i = 0; i < inlog->nmsgs; i++) {
 
-    if (msg == NULL) continue;
+    msg = inlog->buf + inlog->offsets[i];
 
-    if (graph_log_add(gout, msg)) goto fail;
+    if (_log_append(outlog, msg, strlen(msg))) goto fail;
   }
 
   return 0;
-  
+
 fail:
   return 1;
 }
 
-uint16_t graph_log_total_len(graph_t *g) {
+uint32_t graph_log_total_len(graph_t *g) {
 
-  uint64_t i;
-  uint16_t len;  
-  array_t *log;
-  char    *msg;
+  graph_log_t *log;
 
-  len = 0;
   log = g->ctx[_GRAPH_LOG_CTX_LOC_];
 
   if (log == NULL) return 0;
 
-  for (i = 0; i < log->size; i++) {
-    
-    msg = *(char **)array_getd(log, i);
-    len += strlen(msg);
-  }
-
-  return len;
+  return log->len - log->nmsgs;
 }
 
 uint8_t graph_log_import(graph_t *g, char *data, char *delim) {
 
-  int32_t  len;
-  uint16_t dlen;
-  array_t *log;
-  char    *msg;
-  char    *substr;
-  uint16_t substrlen;
+  int64_t      len;
+  uint32_t     dlen;
+  graph_log_t *log;
+  char        *substr;
+  uint64_t     substrlen;
 
-  msg  = NULL;
-  log  = g->ctx[_GRAPH_LOG_CTX_LOC_];
+  if (g->ctx[_GRAPH_LOG_CTX_LOC_] == NULL) return 0;
+
+  log  = _log_own(g);
   len  = strlen(data);
   dlen = strlen(delim);
 
-  if (log == NULL) return 0;
-  
+  if (log == NULL) goto fail;
+
   while (len > 0) {
-    
+
     substr = strstr(data, delim);
 
     if (substr == NULL) substrlen = len;
     else                substrlen = substr - data;
 
     if (substrlen > 0) {
-
-      msg = calloc(substrlen+1, 1);
-      if (msg == NULL) goto fail;
-
-      memcpy(msg, data, substrlen);
-      msg[substrlen] = '\0';
-
-      if (array_append(log, &msg)) goto fail;
+      if (_log_append(log, data, substrlen)) goto fail;
     }
 
     data += (substrlen + dlen);
@@ -203,33 +314,35 @@ uint8_t graph_log_import(graph_t *g, char *data, char *delim) {
   }
 
   return 0;
-  
+
 fail:
   return 1;
 }
 
 void graph_log_export(graph_t *g, char *dest, char *delim) {
 
-  uint32_t i;
-  array_t *log;
-  uint16_t dlen;
-  uint16_t len;
-  char    *msg;
+  uint32_t     i;
+  graph_log_t *log;
+  uint32_t     dlen;
+  uint64_t     len;
+  char        *msg;
 
   dlen = strlen(delim);
   log  = g->ctx[_GRAPH_LOG_CTX_LOC_];
-  
+
   if (log == NULL) return;
 
-  for (i = 0; i < log->size; i++) {
-    
-    msg = *(char **)array_getd(log, i);
-    len = strlen(msg);
+  for (i = 0; i < log->nmsgs; i++) {
+
+    msg = log->buf + log->offsets[i];
+
+    if (i < log->nmsgs - 1) len = log->offsets[i+1] - log->offsets[i] - 1;
+    else                    len = log->len          - log->offsets[i] - 1;
 
     memcpy(dest, msg, len);
     dest += len;
-    
-    if (i < log->size - 1) {
+
+    if (i < log->nmsgs - 1) {
       memcpy(dest, delim, dlen);
       dest += dlen;
     }
@@ -1,6 +1,12 @@
 /**
  * Little module to attach an audit trail to a graph_t struct.
  *
+ * The messages are stored one after the other in a single append-only
+ * buffer, along with the offset of each message. A log which is copied to
+ * another graph with graph_log_copy is shared between the two graphs,
+ * rather than duplicated; it is only copied when one of the graphs adds a
+ * message to it.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #ifndef _GRAPH_LOG_H_
@@ -11,7 +17,8 @@
 #include "graph/graph.h"
 
 /**
- * Creates and attaches an array_t of char* pointers to the given graph.
+ * Creates and attaches an empty log to the given graph, replacing any log
+ * which is already attached.
  */
 uint8_t graph_log_init(
   graph_t *g /**< graph to attach an audit trail to */
@@ -35,7 +42,7 @@ uint8_t graph_log_add(
 /**
  * \return the number of messages in the log.
  */
-uint16_t graph_log_num_msgs(
+uint32_t graph_log_num_msgs(
   graph_t *g /**< graph to query */
 );
 
@@ -44,12 +51,14 @@ uint16_t graph_log_num_msgs(
  */
 char * graph_log_get_msg(
   graph_t *g, /**< graph to query */
-  uint16_t i  /**< message index  */
+  uint32_t i  /**< message index  */
 );
 
 /**
  * Copies the log from the input graph to the output graph. Initialises
- * logging on the output graph if necessary.
+ * logging on the output graph if necessary. If the output graph log is
+ * empty, the input graph log is shared with it, which takes constant time;
+ * otherwise, the messages of the input graph are appended to it.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -61,7 +70,7 @@ uint8_t graph_log_copy(
 /**
  * \return the total length, combined, of all the messages in the log.
  */
-uint16_t graph_log_total_len(
+uint32_t graph_log_total_len(
   graph_t *g /**< the graph */
 );
 
@@ -0,0 +1,739 @@
+/**
+ * Multilevel (Louvain) community detection.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_louvain.h"
+#include "util/parallel.h"
+
+/**
+ * Number of nodes in each batch of the local move phase. This is fixed,
+ * rather than being derived from the number of threads, so that the
+ * result does not depend upon the number of threads.
+ */
+#define LOUVAIN_BATCH 1024
+
+/**
+ * Number of nodes handed to a thread at a time, within a batch.
+ */
+#define LOUVAIN_CHUNK 64
+
+/**
+ * A move is only made if it increases (unnormalised) modularity by more
+ * than this, so rounding errors cannot cause nodes to move back and forth
+ * forever.
+ */
+#define LOUVAIN_EPS 1e-10
+
+/**
+ * The weighted, undirected graph that is worked on at each level. At the
+ * first level, this is a copy of the input graph; at subsequent levels,
+ * each node represents a community of the previous level.
+ */
+typedef struct _level {
+
+  uint32_t  nnodes;  /**< number of nodes                             */
+  uint64_t *offsets; /**< start of the neighbours of each node in nbrs
+                          and wts (length nnodes+1)                   */
+  uint32_t *nbrs;    /**< neighbours of every node                    */
+  double   *wts;     /**< edge weights                                */
+  double   *self;    /**< weight of the edges within each node,
+                          counted in both directions                  */
+  double   *degree;  /**< total weight of each node, including self   */
+
+} level_t;
+
+/**
+ * State used during the local move phase.
+ */
+typedef struct _louvain {
+
+  level_t  *lvl;       /**< the current level                         */
+  uint32_t *comm;      /**< community of each node                    */
+  double   *tot;       /**< total degree of each community            */
+  double    m2;        /**< total degree of the graph (twice the total
+                            edge weight)                              */
+  uint64_t  start;     /**< first node of the current batch           */
+  uint32_t *proposals; /**< proposed community for each node in the
+                            current batch                             */
+  uint32_t  wsize;     /**< length of each per-thread workspace       */
+  double   *acc;       /**< per-thread workspace - weight of the edges
+                            from a node to each community, or -1 for
+                            communities which are not adjacent        */
+  uint32_t *touched;   /**< per-thread workspace - the communities
+                            which are adjacent to a node              */
+
+} louvain_t;
+
+/**
+ * Copies the given graph into the given level.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph has
+ * negative weights).
+ */
+static uint8_t _level_init(
+  graph_t *g,        /**< the graph                */
+  uint8_t  weighted, /**< non-0 to use edge weights */
+  level_t *lvl       /**< level to initialise       */
+);
+
+/**
+ * Frees the memory used by the given level.
+ */
+static void _level_free(
+  level_t *lvl /**< the level */
+);
+
+/**
+ * Runs the local move phase on the current level, starting with every
+ * node in its own community, until no more moves can be made.
+ *
+ * \return 0 on success, non-0 on failure. The total number of moves which
+ * were made is stored in nmoves.
+ */
+static uint8_t _local_moves(
+  louvain_t *lv,       /**< local move state          */
+  uint16_t   nthreads, /**< number of threads         */
+  uint64_t  *nmoves    /**< place to store the number
+                            of moves                  */
+);
+
+/**
+ * parallel_for function which finds the best community for each node in
+ * the current batch.
+ *
+ * \return 0.
+ */
+static uint8_t _propose(
+  uint64_t  start,  /**< first batch item          */
+  uint64_t  end,    /**< one past last batch item  */
+  uint16_t  thread, /**< calling thread identifier */
+  void     *ctx     /**< pointer to louvain_t      */
+);
+
+/**
+ * Renumbers the given communities, in place, so that they are numbered
+ * from 0, in order of their lowest node.
+ *
+ * \return the number of communities.
+ */
+static uint32_t _renumber(
+  uint32_t  n,    /**< number of nodes                 */
+  uint32_t *comm, /**< community of each node          */
+  uint32_t *work  /**< workspace of length at least n  */
+);
+
+/**
+ * Collapses each community of the given level into a single node of the
+ * next level.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _aggregate(
+  level_t  *lvl,     /**< the current level                         */
+  uint32_t *comm,    /**< community of each node, numbered from 0   */
+  uint32_t  ncomms,  /**< number of communities                     */
+  double   *acc,     /**< workspace of length at least ncomms,
+                          with every value initialised to -1        */
+  uint32_t *touched, /**< workspace of length at least ncomms       */
+  level_t  *next     /**< level to create                           */
+);
+
+/**
+ * Splits every community which is not connected into its connected parts,
+ * and renumbers the communities in order of their lowest node.
+ *
+ * \return 0 on success, non-0 on failure. The new number of communities
+ * is stored in ncomms.
+ */
+static uint8_t _split(
+  graph_t  *g,      /**< the graph                           */
+  uint32_t *comm,   /**< community of each node              */
+  uint32_t *ncomms  /**< place to store number of communities */
+);
+
+/**
+ * \return the modularity of the given partition of the given level.
+ */
+static double _modularity(
+  level_t  *lvl,    /**< the level                           */
+  uint32_t *comm,   /**< community of each node              */
+  uint32_t  ncomms, /**< number of communities               */
+  double   *tot     /**< workspace of length at least ncomms */
+);
+
+uint8_t graph_louvain(
+  graph_t  *g,
+  uint8_t   weighted,
+  uint16_t  nthreads,
+  uint32_t *communities,
+  uint32_t *ncomms,
+  double   *modularity) {
+
+  uint64_t  i;
+  uint64_t  nmoves;
+  uint32_t  nnodes;
+  uint32_t  k;
+  level_t   lvl;
+  level_t   next;
+  louvain_t lv;
+
+  memset(&lvl,  0, sizeof(level_t));
+  memset(&next, 0, sizeof(level_t));
+  memset(&lv,   0, sizeof(louvain_t));
+
+  if (graph_is_directed(g)) goto fail;
+
+  nnodes = graph_num_nodes(g);
+
+  if (nthreads == 0)                   nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  if (_level_init(g, weighted, &lvl)) goto fail;
+
+  lv.wsize     = nnodes;
+  lv.comm      = malloc(nnodes   * sizeof(uint32_t));
+  lv.tot       = malloc(nnodes   * sizeof(double));
+  lv.proposals = malloc(LOUVAIN_BATCH * sizeof(uint32_t));
+  lv.acc       = malloc((uint64_t)nthreads * nnodes * sizeof(double));
+  lv.touched   = malloc((uint64_t)nthreads * nnodes * sizeof(uint32_t));
+
+  if (lv.comm      == NULL) goto fail;
+  if (lv.tot       == NULL) goto fail;
+  if (lv.proposals == NULL) goto fail;
+  if (lv.acc       == NULL) goto fail;
+  if (lv.touched   == NULL) goto fail;
+
+  for (i = 0; i < (uint64_t)nthreads * nnodes; i++) lv.acc[i] = -1;
+
+  lv.m2 = 0;
+  for (i = 0; i < nnodes; i++) {
+    communities[i] = i;
+    lv.m2         += lvl.degree[i];
+  }
+
+  /*
+   * communities maps every node of the input graph
+   * to its node in the current level. Each level is
+   * collapsed into the next until nothing moves.
+   */
+  while (lv.m2 > 0) {
+
+    lv.lvl = &lvl;
+
+    if (_local_moves(&lv, nthreads, &nmoves)) goto fail;
+    if (nmoves == 0) break;
+
+    k = _renumber(lvl.nnodes, lv.comm, lv.touched);
+
+    for (i = 0; i < nnodes; i++)
+      communities[i] = lv.comm[communities[i]];
+
+    if (k == lvl.nnodes) break;
+
+    if (_aggregate(&lvl, lv.comm, k, lv.acc, lv.touched, &next))
+      goto fail;
+
+    _level_free(&lvl);
+    lvl = next;
+    memset(&next, 0, sizeof(level_t));
+  }
+
+  _level_free(&lvl);
+
+  if (_split(g, communities, ncomms)) goto fail;
+
+  if (modularity != NULL) {
+
+    *modularity = 0;
+
+    if (lv.m2 > 0) {
+      if (_level_init(g, weighted, &lvl)) goto fail;
+      *modularity = _modularity(&lvl, communities, *ncomms, lv.tot);
+      _level_free(&lvl);
+    }
+  }
+
+  free(lv.comm);
+  free(lv.tot);
+  free(lv.proposals);
+  free(lv.acc);
+  free(lv.touched);
+
+  return 0;
+
+fail:
+  _level_free(&lvl);
+  _level_free(&next);
+  if (lv.comm      != NULL) free(lv.comm);
+  if (lv.tot       != NULL) free(lv.tot);
+  if (lv.proposals != NULL) free(lv.proposals);
+  if (lv.acc       != NULL) free(lv.acc);
+  if (lv.touched   != NULL) free(lv.touched);
+  return 1;
+}
+
+uint8_t _level_init(graph_t *g, uint8_t weighted, level_t *lvl) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  nentries;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+  double    wt;
+
+  memset(lvl, 0, sizeof(level_t));
+
+  nnodes   = graph_num_nodes(g);
+  nentries = 0;
+
+  for (i = 0; i < nnodes; i++) nentries += graph_num_neighbours(g, i);
+
+  lvl->nnodes  = nnodes;
+  lvl->offsets = malloc((nnodes+1) * sizeof(uint64_t));
+  lvl->nbrs    = malloc(nentries   * sizeof(uint32_t));
+  lvl->wts     = malloc(nentries   * sizeof(double));
+  lvl->self    = calloc(nnodes,      sizeof(double));
+  lvl->degree  = calloc(nnodes,      sizeof(double));
+
+  if (lvl->offsets == NULL)                 goto fail;
+  if (lvl->nbrs    == NULL && nentries > 0) goto fail;
+  if (lvl->wts     == NULL && nentries > 0) goto fail;
+  if (lvl->self    == NULL)                 goto fail;
+  if (lvl->degree  == NULL)                 goto fail;
+
+  lvl->offsets[0] = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    lvl->offsets[i+1] = lvl->offsets[i] + nnbrs;
+
+    for (j = 0; j < nnbrs; j++) {
+
+      wt = weighted ? wts[j] : 1.0;
+      if (wt < 0) goto fail;
+
+      lvl->nbrs[lvl->offsets[i] + j] = nbrs[j];
+      lvl->wts [lvl->offsets[i] + j] = wt;
+      lvl->degree[i]                += wt;
+    }
+  }
+
+  return 0;
+
+fail:
+  _level_free(lvl);
+  return 1;
+}
+
+void _level_free(level_t *lvl) {
+
+  if (lvl->offsets != NULL) free(lvl->offsets);
+  if (lvl->nbrs    != NULL) free(lvl->nbrs);
+  if (lvl->wts     != NULL) free(lvl->wts);
+  if (lvl->self    != NULL) free(lvl->self);
+  if (lvl->degree  != NULL) free(lvl->degree);
+
+  memset(lvl, 0, sizeof(level_t));
+}
+
+uint8_t _local_moves(louvain_t *lv, uint16_t nthreads, uint64_t *nmoves) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  b;
+  uint64_t  nb;
+  uint64_t  moves;
+  uint32_t  u;
+  uint32_t  c;
+  uint32_t  d;
+  double    ki;
+  double    kic;
+  double    kid;
+  double    gc;
+  double    gd;
+  level_t  *lvl;
+
+  lvl     = lv->lvl;
+  *nmoves = 0;
+
+  for (i = 0; i < lvl->nnodes; i++) {
+    lv->comm[i] = i;
+    lv->tot [i] = lvl->degree[i];
+  }
+
+  do {
+
+    moves = 0;
+
+    for (b = 0; b < lvl->nnodes; b += LOUVAIN_BATCH) {
+
+      nb = lvl->nnodes - b;
+      if (nb > LOUVAIN_BATCH) nb = LOUVAIN_BATCH;
+
+      lv->start = b;
+
+      if (parallel_for(nthreads, nb, LOUVAIN_CHUNK, lv, _propose))
+        goto fail;
+
+      /*
+       * Other moves in this batch may have been made
+       * since each proposal was calculated, so the
+       * gain of each one is re-checked before it is
+       * made. Only the current and proposed community
+       * need to be considered.
+       */
+      for (i = 0; i < nb; i++) {
+
+        u = b + i;
+        c = lv->proposals[i];
+        d = lv->comm[u];
+
+        if (c == d) continue;
+
+        ki  = lvl->degree[u];
+        kic = 0;
+        kid = 0;
+
+        for (j = lvl->offsets[u]; j < lvl->offsets[u+1]; j++) {
+
+          if      (lv->comm[lvl->nbrs[j]] == c) kic += lvl->wts[j];
+          else if (lv->comm[lvl->nbrs[j]] == d) kid += lvl->wts[j];
+        }
+
+        gc = kic - (lv->tot[c])      * ki / lv->m2;
+        gd = kid - (lv->tot[d] - ki) * ki / lv->m2;
+
+        if (gc <= gd + LOUVAIN_EPS) continue;
+
+        lv->tot[d] -= ki;
+        lv->tot[c] += ki;
+        lv->comm[u] = c;
+        moves ++;
+      }
+    }
+
+    *nmoves += moves;
+
+  } while (moves > 0);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _propose(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   i;
+  uint64_t   j;
+  uint32_t   u;
+  uint32_t   c;
+  uint32_t   d;
+  uint32_t   nt;
+  uint32_t   best;
+  double     ki;
+  double     gain;
+  double     bestgain;
+  double    *acc;
+  uint32_t  *touched;
+  level_t   *lvl;
+  louvain_t *lv;
+
+  lv      = ctx;
+  lvl     = lv->lvl;
+  acc     = lv->acc     + (uint64_t)thread * lv->wsize;
+  touched = lv->touched + (uint64_t)thread * lv->wsize;
+
+  for (i = start; i < end; i++) {
+
+    u  = lv->start + i;
+    d  = lv->comm[u];
+    ki = lvl->degree[u];
+    nt = 0;
+
+    /*total edge weight from u to each adjacent community*/
+    for (j = lvl->offsets[u]; j < lvl->offsets[u+1]; j++) {
+
+      c = lv->comm[lvl->nbrs[j]];
+
+      if (acc[c] < 0) {
+        acc[c]        = 0;
+        touched[nt++] = c;
+      }
+      acc[c] += lvl->wts[j];
+    }
+
+    /*
+     * The gain of moving u into community c, after
+     * it has been removed from its own community, is
+     * proportional to acc[c] - tot[c]*ki/m2. Staying
+     * put is preferred over an equally good move.
+     */
+    best     = d;
+    bestgain = (acc[d] < 0) ? 0 : acc[d];
+    bestgain = bestgain - (lv->tot[d] - ki) * ki / lv->m2;
+
+    for (j = 0; j < nt; j++) {
+
+      c = touched[j];
+
+      if (c != d) {
+        gain = acc[c] - lv->tot[c] * ki / lv->m2;
+
+        if (gain > bestgain + LOUVAIN_EPS) {
+          best     = c;
+          bestgain = gain;
+        }
+      }
+
+      acc[c] = -1;
+    }
+
+    lv->proposals[i] = best;
+  }
+
+  return 0;
+}
+
+uint32_t _renumber(uint32_t n, uint32_t *comm, uint32_t *work) {
+
+  uint64_t i;
+  uint32_t k;
+
+  for (i = 0; i < n; i++) work[i] = 0xFFFFFFFF;
+
+  k = 0;
+  for (i = 0; i < n; i++) {
+
+    if (work[comm[i]] == 0xFFFFFFFF) work[comm[i]] = k++;
+    comm[i] = work[comm[i]];
+  }
+
+  return k;
+}
+
+uint8_t _aggregate(
+  level_t  *lvl,
+  uint32_t *comm,
+  uint32_t  ncomms,
+  double   *acc,
+  uint32_t *touched,
+  level_t  *next) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  k;
+  uint64_t  nentries;
+  uint32_t  u;
+  uint32_t  c;
+  uint32_t  nt;
+  uint32_t *starts;
+  uint32_t *members;
+
+  starts  = NULL;
+  members = NULL;
+
+  memset(next, 0, sizeof(level_t));
+
+  /*
+   * every edge of this level maps to at most one
+   * edge of the next, so this level's edge count
+   * is an upper bound on the space needed
+   */
+  nentries = lvl->offsets[lvl->nnodes];
+
+  starts        = calloc(ncomms+1,    sizeof(uint32_t));
+  members       = malloc(lvl->nnodes * sizeof(uint32_t));
+  next->nnodes  = ncomms;
+  next->offsets = malloc((ncomms+1) * sizeof(uint64_t));
+  next->nbrs    = malloc(nentries   * sizeof(uint32_t));
+  next->wts     = malloc(nentries   * sizeof(double));
+  next->self    = calloc(ncomms,      sizeof(double));
+  next->degree  = calloc(ncomms,      sizeof(double));
+
+  if (starts        == NULL)                 goto fail;
+  if (members       == NULL)                 goto fail;
+  if (next->offsets == NULL)                 goto fail;
+  if (next->nbrs    == NULL && nentries > 0) goto fail;
+  if (next->wts     == NULL && nentries > 0) goto fail;
+  if (next->self    == NULL)                 goto fail;
+  if (next->degree  == NULL)                 goto fail;
+
+  /*group the nodes of each community together*/
+  for (i = 0; i < lvl->nnodes; i++) starts[comm[i]+1]++;
+  for (i = 0; i < ncomms;      i++) starts[i+1] += starts[i];
+  for (i = 0; i < lvl->nnodes; i++) members[starts[comm[i]]++] = i;
+  for (i = ncomms; i > 0;      i--) starts[i] = starts[i-1];
+  starts[0] = 0;
+
+  next->offsets[0] = 0;
+
+  for (c = 0; c < ncomms; c++) {
+
+    nt = 0;
+
+    for (i = starts[c]; i < starts[c+1]; i++) {
+
+      u = members[i];
+
+      next->self  [c] += lvl->self  [u];
+      next->degree[c] += lvl->degree[u];
+
+      for (j = lvl->offsets[u]; j < lvl->offsets[u+1]; j++) {
+
+        k = comm[lvl->nbrs[j]];
+
+        if (k == c) {
+          next->self[c] += lvl->wts[j];
+          continue;
+        }
+
+        if (acc[k] < 0) {
+          acc[k]        = 0;
+          touched[nt++] = k;
+        }
+        acc[k] += lvl->wts[j];
+      }
+    }
+
+    next->offsets[c+1] = next->offsets[c] + nt;
+
+    for (i = 0; i < nt; i++) {
+
+      k = next->offsets[c] + i;
+
+      next->nbrs[k]   = touched[i];
+      next->wts [k]   = acc[touched[i]];
+      acc[touched[i]] = -1;
+    }
+  }
+
+  free(starts);
+  free(members);
+  return 0;
+
+fail:
+  if (starts  != NULL) free(starts);
+  if (members != NULL) free(members);
+  _level_free(next);
+  return 1;
+}
+
+uint8_t _split(graph_t *g, uint32_t *comm, uint32_t *ncomms) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t  head;
+  uint32_t  tail;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  k;
+  uint32_t *nbrs;
+  uint32_t *ids;
+  uint32_t *queue;
+
+  ids    = NULL;
+  queue  = NULL;
+  nnodes = graph_num_nodes(g);
+
+  ids   = malloc(nnodes * sizeof(uint32_t));
+  queue = malloc(nnodes * sizeof(uint32_t));
+  if (ids   == NULL) goto fail;
+  if (queue == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) ids[i] = 0xFFFFFFFF;
+
+  /*
+   * breadth first search from the lowest unvisited node,
+   * through neighbours which are in the same community
+   */
+  k = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    if (ids[i] != 0xFFFFFFFF) continue;
+
+    head          = 0;
+    tail          = 0;
+    ids[i]        = k;
+    queue[tail++] = i;
+
+    while (head < tail) {
+
+      u     = queue[head++];
+      nnbrs = graph_num_neighbours(g, u);
+      nbrs  = graph_get_neighbours(g, u);
+
+      for (j = 0; j < nnbrs; j++) {
+
+        v = nbrs[j];
+
+        if (ids[v]  != 0xFFFFFFFF) continue;
+        if (comm[v] != comm[i])    continue;
+
+        ids[v]        = k;
+        queue[tail++] = v;
+      }
+    }
+
+    k++;
+  }
+
+  memcpy(comm, ids, nnodes * sizeof(uint32_t));
+  *ncomms = k;
+
+  free(ids);
+  free(queue);
+  return 0;
+
+fail:
+  if (ids   != NULL) free(ids);
+  if (queue != NULL) free(queue);
+  return 1;
+}
+
+double _modularity(
+  level_t *lvl, uint32_t *comm, uint32_t ncomms, double *tot) {
+
+  uint64_t i;
+  uint64_t j;
+  double   m2;
+  double   in;
+  double   mod;
+
+  m2 = 0;
+  in = 0;
+
+  for (i = 0; i < ncomms; i++) tot[i] = 0;
+
+  for (i = 0; i < lvl->nnodes; i++) {
+
+    m2           += lvl->degree[i];
+    in           += lvl->self  [i];
+    tot[comm[i]] += lvl->degree[i];
+
+    for (j = lvl->offsets[i]; j < lvl->offsets[i+1]; j++) {
+      if (comm[lvl->nbrs[j]] == comm[i]) in += lvl->wts[j];
+    }
+  }
+
+  if (m2 == 0) return 0;
+
+  mod = in / m2;
+  for (i = 0; i < ncomms; i++) mod -= (tot[i] / m2) * (tot[i] / m2);
+
+  return mod;
+}
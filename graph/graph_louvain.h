@@ -0,0 +1,67 @@
+/**
+ * Multilevel (Louvain) community detection. Communities are found by
+ * greedily maximising modularity:
+ *
+ *   Blondel VD, Guillaume J-L, Lambiotte R & Lefebvre E 2008. Fast
+ *   unfolding of communities in large networks. Journal of Statistical
+ *   Mechanics: Theory and Experiment P10008
+ *
+ * Each level consists of a local move phase, in which nodes are repeatedly
+ * moved into the neighbouring community which gives the largest increase
+ * in modularity, until no move gives an increase. The communities are then
+ * collapsed into the nodes of a new, smaller, weighted graph, and the
+ * process is repeated until no more moves can be made.
+ *
+ * The local move phase is parallelised by processing nodes in fixed size
+ * batches. The best move for every node in a batch is found in parallel,
+ * against the communities as they were at the start of the batch; the
+ * moves are then applied in node order, and each one is only made if it
+ * still increases modularity. So every move is a genuine improvement, and
+ * the result does not depend upon the number of threads.
+ *
+ * The main problem with Louvain is that it may produce badly connected, or
+ * even disconnected, communities:
+ *
+ *   Traag VA, Waltman L & van Eck NJ 2019. From Louvain to Leiden:
+ *   guaranteeing well-connected communities. Scientific Reports 9:5233
+ *
+ * The full Leiden refinement phase is not implemented but, as a final
+ * step, every community which is not connected is split into its connected
+ * parts. This can only increase modularity, and guarantees that every
+ * community is connected.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_LOUVAIN_H__
+#define __GRAPH_LOUVAIN_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Partitions the nodes of the given graph, which must be undirected, into
+ * communities, using the multilevel Louvain method. Communities are
+ * numbered from 0, in order of their lowest node.
+ *
+ * If weighted is non-0, edge weights are used, and must all be
+ * non-negative. Otherwise every edge is given a weight of 1, and the
+ * resulting modularity is the same as that given by stats_modularity.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed, or has negative edge weights).
+ */
+uint8_t graph_louvain(
+  graph_t  *g,           /**< the graph                               */
+  uint8_t   weighted,    /**< non-0 to use edge weights               */
+  uint16_t  nthreads,    /**< number of threads to use in the local
+                              move phase (0 to use all CPUs)          */
+  uint32_t *communities, /**< place to store the community of each
+                              node - must be of length num_nodes      */
+  uint32_t *ncomms,      /**< place to store the number of
+                              communities                             */
+  double   *modularity   /**< place to store the modularity of the
+                              partition (may be NULL)                 */
+);
+
+#endif /* __GRAPH_LOUVAIN_H__ */
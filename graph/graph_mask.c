@@ -10,6 +10,7 @@
 #include "util/array.h"
 #include "graph/graph.h"
 #include "graph/graph_mask.h"
+#include "graph/graph_view.h"
 
 /**
  * Struct which provides an index mapping for a node, 
@@ -85,9 +86,27 @@ fail:
 
 uint8_t graph_mask(graph_t *gin, graph_t *gout, uint8_t *mask) {
 
-  array_t nodemap;
+  array_t      nodemap;
+  graph_view_t view;
+  uint8_t      result;
+
   memset(&nodemap, 0, sizeof(nodemap));
 
+  /*
+   * Undirected graphs are masked via a view, which only
+   * visits the neighbour lists of the retained nodes,
+   * rather than testing every pair of retained nodes.
+   */
+  if (!graph_is_directed(gin)) {
+
+    if (graph_view_create(&view, gin, mask)) goto fail;
+
+    result = graph_view_materialise(&view, gout);
+    graph_view_free(&view);
+
+    return result;
+  }
+
   if (array_create(&nodemap, sizeof(nodemap_t), 100))             goto fail;
   if (_create_node_mapping(&nodemap, mask, graph_num_nodes(gin))) goto fail;
   if (graph_create(gout, nodemap.size, 0))                        goto fail;
@@ -162,18 +181,15 @@ fail:
 uint8_t _copy_nodelabels(
   graph_t *gin, graph_t *gout, array_t *nodes) {
 
-  uint64_t       i;
-  graph_label_t *label;
-  nodemap_t     *node;
+  uint64_t   i;
+  nodemap_t *node;
 
   for (i = 0; i < nodes->size; i++) {
 
     node = array_getd(nodes, i);
 
-    label = graph_get_nodelabel(gin,  node->gin_idx);
-    if (label == NULL) goto fail;
-    
-    if (graph_set_nodelabel(gout, node->gout_idx, label)) goto fail;
+    if (graph_copy_nodelabel(gin, node->gin_idx, gout, node->gout_idx))
+      goto fail;
   }
 
   return 0;
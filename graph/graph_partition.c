@@ -0,0 +1,468 @@
+/**
+ * Incremental community quality measures for a partition of an undirected
+ * graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "graph/graph_labelidx.h"
+#include "graph/graph_partition.h"
+
+/**
+ * Calculates all of the per-node and per-community sums from scratch.
+ */
+static void _build(
+  graph_partition_t *gp /**< the partition */
+);
+
+/**
+ * Adds delta to the degree of the given community, updating the sum of
+ * squared degrees.
+ */
+static void _add_degree(
+  graph_partition_t *gp,   /**< the partition    */
+  uint32_t           comm, /**< community ID     */
+  double             delta /**< change in degree */
+);
+
+/**
+ * \return the contribution of a node to the strength of its community,
+ * in terms of its number of neighbours in the same community, and its
+ * degree.
+ */
+static double _node_strength(
+  uint32_t in,    /**< neighbours in the same community */
+  uint32_t degree /**< node degree                      */
+);
+
+/**
+ * \return the contribution of the given community to the Chira fitness
+ * sum.
+ */
+static double _chira_term(
+  graph_partition_t *gp,  /**< the partition */
+  uint32_t           comm /**< community ID  */
+);
+
+/**
+ * Adjusts the size, internal edge count and strength of the given
+ * community, updating the number of non-empty communities, and the Chira
+ * fitness sum.
+ */
+static void _update(
+  graph_partition_t *gp,        /**< the partition      */
+  uint32_t           comm,      /**< community ID       */
+  int64_t            dsize,     /**< change in size     */
+  double             dinternal, /**< change in internal
+                                     edge count         */
+  double             dstrength  /**< change in strength */
+);
+
+/**
+ * Graph event callback. Updates the sums for u, v and their communities.
+ */
+static void _edge_added(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the partition                */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx, /**< index of v in u's neighbours */
+  float    wt    /**< edge weight                  */
+);
+
+/**
+ * Graph event callback. Updates the sums for u, v and their communities.
+ */
+static void _edge_removed(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the partition                */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx  /**< index of v in u's neighbours */
+);
+
+/**
+ * Graph event callback. Recalculates everything.
+ */
+static void _edges_rebuilt(
+  graph_t *g,  /**< the graph     */
+  void    *ctx /**< the partition */
+);
+
+uint8_t graph_partition_init(
+  graph_partition_t *gp, graph_t *g, uint32_t *comms) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *lblidxs;
+
+  if (gp == NULL)           return 1;
+  if (graph_is_directed(g)) return 1;
+
+  memset(gp, 0, sizeof(graph_partition_t));
+
+  nnodes     = graph_num_nodes(g);
+  gp->g      = g;
+  gp->ncomms = nnodes;
+
+  /*stale label values may be retained, see graph_set_nodelabel*/
+  if (comms == NULL && graph_num_labelvals(g) > nnodes)
+    gp->ncomms = graph_num_labelvals(g);
+
+  gp->comms     = calloc(nnodes,     sizeof(uint32_t));
+  gp->indegrees = calloc(nnodes,     sizeof(uint32_t));
+  gp->sizes     = calloc(gp->ncomms, sizeof(uint32_t));
+  gp->degrees   = calloc(gp->ncomms, sizeof(double));
+  gp->internal  = calloc(gp->ncomms, sizeof(double));
+  gp->strengths = calloc(gp->ncomms, sizeof(double));
+
+  if (gp->comms     == NULL) goto fail;
+  if (gp->indegrees == NULL) goto fail;
+  if (gp->sizes     == NULL) goto fail;
+  if (gp->degrees   == NULL) goto fail;
+  if (gp->internal  == NULL) goto fail;
+  if (gp->strengths == NULL) goto fail;
+
+  /*by default, communities are label value indices*/
+  if (comms == NULL) {
+    lblidxs = graph_labelidx_nodes(g);
+    if (lblidxs == NULL) goto fail;
+  }
+  else lblidxs = comms;
+
+  for (i = 0; i < nnodes; i++) {
+
+    gp->comms[i] = lblidxs[i];
+
+    if (gp->comms[i] >= gp->ncomms) goto fail;
+  }
+
+  _build(gp);
+
+  gp->gel.ctx           = gp;
+  gp->gel.edge_added    = _edge_added;
+  gp->gel.edge_removed  = _edge_removed;
+  gp->gel.edges_rebuilt = _edges_rebuilt;
+
+  if (graph_add_event_listener(g, &gp->gel)) goto fail;
+
+  return 0;
+
+fail:
+  gp->gel.ctx = NULL;
+  graph_partition_free(gp);
+  return 1;
+}
+
+void graph_partition_free(graph_partition_t *gp) {
+
+  if (gp == NULL) return;
+
+  if (gp->gel.ctx != NULL) graph_remove_event_listener(gp->g, &gp->gel);
+
+  if (gp->comms     != NULL) free(gp->comms);
+  if (gp->indegrees != NULL) free(gp->indegrees);
+  if (gp->sizes     != NULL) free(gp->sizes);
+  if (gp->degrees   != NULL) free(gp->degrees);
+  if (gp->internal  != NULL) free(gp->internal);
+  if (gp->strengths != NULL) free(gp->strengths);
+
+  memset(gp, 0, sizeof(graph_partition_t));
+}
+
+uint8_t graph_partition_move(
+  graph_partition_t *gp, uint32_t u, uint32_t comm) {
+
+  uint64_t  i;
+  uint32_t  old;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t  v;
+  uint32_t  vin;
+  uint32_t  vdeg;
+  uint32_t  nold;
+  uint32_t  nnew;
+  double    dold;
+  double    dnew;
+
+  if (comm >= gp->ncomms) return 1;
+
+  old = gp->comms[u];
+
+  if (old == comm) return 0;
+
+  nnbrs = graph_num_neighbours(gp->g, u);
+  nbrs  = graph_get_neighbours(gp->g, u);
+  nold  = 0;
+  nnew  = 0;
+  dold  = 0;
+  dnew  = 0;
+
+  /*
+   * edges from u to its old community become
+   * inter-community edges, and edges to its
+   * new community become intra-community edges,
+   * changing the strengths of both communities
+   */
+  for (i = 0; i < nnbrs; i++) {
+
+    v    = nbrs[i];
+    vin  = gp->indegrees[v];
+    vdeg = graph_num_neighbours(gp->g, v);
+
+    if (gp->comms[v] == old) {
+      nold ++;
+      dold += _node_strength(vin-1, vdeg) - _node_strength(vin, vdeg);
+      gp->indegrees[v]--;
+    }
+    else if (gp->comms[v] == comm) {
+      nnew ++;
+      dnew += _node_strength(vin+1, vdeg) - _node_strength(vin, vdeg);
+      gp->indegrees[v]++;
+    }
+  }
+
+  dold -= _node_strength(gp->indegrees[u], nnbrs);
+  dnew += _node_strength(nnew,             nnbrs);
+
+  gp->intra       += (double)nnew - nold;
+  gp->indegrees[u] = nnew;
+  gp->comms[u]     = comm;
+
+  _update(gp, old,  -1, -(double)nold, dold);
+  _update(gp, comm,  1,  (double)nnew, dnew);
+
+  _add_degree(gp, old,  -(double)nnbrs);
+  _add_degree(gp, comm,  (double)nnbrs);
+
+  return 0;
+}
+
+uint32_t graph_partition_community(graph_partition_t *gp, uint32_t u) {
+  return gp->comms[u];
+}
+
+double graph_partition_modularity(graph_partition_t *gp) {
+
+  double m;
+
+  m = graph_num_edges(gp->g);
+
+  if (m == 0) return 0;
+
+  /*
+   * The fraction of edge ends within communities, minus
+   * the sum of the squared fractions of edge ends which
+   * are attached to each community (see stats_modularity)
+   */
+  return (gp->intra / m) - (gp->sumsq / (4 * m * m));
+}
+
+double graph_partition_chira(graph_partition_t *gp) {
+
+  double m;
+
+  m = graph_num_edges(gp->g);
+
+  if (m == 0 || gp->nused == 0) return 0;
+
+  /*
+   * The strength of a community is the sum of its node
+   * strengths, (in - out)/size, plus half of the node
+   * strengths of their neighbours within the community,
+   * which is (1/size) * sum((in - out) * (1 + in/2)).
+   * It is scaled by (internal/m)/size, and the result
+   * averaged across communities (see stats_chira).
+   */
+  return gp->chira / (m * gp->nused);
+}
+
+double graph_partition_intra_edges(graph_partition_t *gp) {
+  return gp->intra;
+}
+
+double graph_partition_inter_edges(graph_partition_t *gp) {
+  return graph_num_edges(gp->g) - gp->intra;
+}
+
+void _build(graph_partition_t *gp) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t  c;
+
+  nnodes = graph_num_nodes(gp->g);
+
+  memset(gp->indegrees, 0, nnodes     * sizeof(uint32_t));
+  memset(gp->sizes,     0, gp->ncomms * sizeof(uint32_t));
+  memset(gp->degrees,   0, gp->ncomms * sizeof(double));
+  memset(gp->internal,  0, gp->ncomms * sizeof(double));
+  memset(gp->strengths, 0, gp->ncomms * sizeof(double));
+
+  gp->nused = 0;
+  gp->intra = 0;
+  gp->sumsq = 0;
+  gp->chira = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(gp->g, i);
+    nbrs  = graph_get_neighbours(gp->g, i);
+    c     = gp->comms[i];
+
+    gp->sizes  [c] ++;
+    gp->degrees[c] += nnbrs;
+
+    for (j = 0; j < nnbrs; j++) {
+      if (gp->comms[nbrs[j]] == c) gp->indegrees[i]++;
+    }
+
+    gp->internal [c] += gp->indegrees[i] / 2.0;
+    gp->strengths[c] += _node_strength(gp->indegrees[i], nnbrs);
+    gp->intra        += gp->indegrees[i] / 2.0;
+  }
+
+  for (i = 0; i < gp->ncomms; i++) {
+
+    if (gp->sizes[i] > 0) gp->nused++;
+
+    gp->sumsq += gp->degrees[i] * gp->degrees[i];
+    gp->chira += _chira_term(gp, i);
+  }
+}
+
+void _add_degree(graph_partition_t *gp, uint32_t comm, double delta) {
+
+  /*(d + delta)^2 - d^2*/
+  gp->sumsq         += delta * (2 * gp->degrees[comm] + delta);
+  gp->degrees[comm] += delta;
+}
+
+double _node_strength(uint32_t in, uint32_t degree) {
+
+  return (2.0 * in - degree) * (1 + in / 2.0);
+}
+
+double _chira_term(graph_partition_t *gp, uint32_t comm) {
+
+  double size;
+
+  size = gp->sizes[comm];
+
+  if (size == 0) return 0;
+
+  return gp->internal[comm] * gp->strengths[comm] / (size * size);
+}
+
+void _update(
+  graph_partition_t *gp,
+  uint32_t           comm,
+  int64_t            dsize,
+  double             dinternal,
+  double             dstrength) {
+
+  if (gp->sizes[comm] > 0) gp->nused--;
+  gp->chira -= _chira_term(gp, comm);
+
+  gp->sizes    [comm] += dsize;
+  gp->internal [comm] += dinternal;
+  gp->strengths[comm] += dstrength;
+
+  if (gp->sizes[comm] > 0) gp->nused++;
+  gp->chira += _chira_term(gp, comm);
+}
+
+void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt) {
+
+  graph_partition_t *gp;
+  uint32_t           cu;
+  uint32_t           cv;
+  uint32_t           du;
+  uint32_t           dv;
+  uint32_t           iu;
+  uint32_t           iv;
+
+  gp = ctx;
+  cu = gp->comms[u];
+  cv = gp->comms[v];
+  du = graph_num_neighbours(g, u);
+  dv = graph_num_neighbours(g, v);
+  iu = gp->indegrees[u];
+  iv = gp->indegrees[v];
+
+  /*the degrees of u and v have already been incremented*/
+  if (cu == cv) {
+
+    gp->intra ++;
+    gp->indegrees[u]++;
+    gp->indegrees[v]++;
+
+    _update(gp, cu, 0, 1,
+            _node_strength(iu+1, du) - _node_strength(iu, du-1) +
+            _node_strength(iv+1, dv) - _node_strength(iv, dv-1));
+  }
+  else {
+    _update(gp, cu, 0, 0, _node_strength(iu, du) - _node_strength(iu, du-1));
+    _update(gp, cv, 0, 0, _node_strength(iv, dv) - _node_strength(iv, dv-1));
+  }
+
+  _add_degree(gp, cu, 1);
+  _add_degree(gp, cv, 1);
+}
+
+void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx) {
+
+  graph_partition_t *gp;
+  uint32_t           cu;
+  uint32_t           cv;
+  uint32_t           du;
+  uint32_t           dv;
+  uint32_t           iu;
+  uint32_t           iv;
+
+  gp = ctx;
+  cu = gp->comms[u];
+  cv = gp->comms[v];
+  du = graph_num_neighbours(g, u);
+  dv = graph_num_neighbours(g, v);
+  iu = gp->indegrees[u];
+  iv = gp->indegrees[v];
+
+  /*the degrees of u and v have already been decremented*/
+  if (cu == cv) {
+
+    gp->intra --;
+    gp->indegrees[u]--;
+    gp->indegrees[v]--;
+
+    _update(gp, cu, 0, -1,
+            _node_strength(iu-1, du) - _node_strength(iu, du+1) +
+            _node_strength(iv-1, dv) - _node_strength(iv, dv+1));
+  }
+  else {
+    _update(gp, cu, 0, 0, _node_strength(iu, du) - _node_strength(iu, du+1));
+    _update(gp, cv, 0, 0, _node_strength(iv, dv) - _node_strength(iv, dv+1));
+  }
+
+  _add_degree(gp, cu, -1);
+  _add_degree(gp, cv, -1);
+}
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  _build(ctx);
+}
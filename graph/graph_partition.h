@@ -0,0 +1,128 @@
+/**
+ * Incremental community quality measures for a partition of an undirected
+ * graph into communities. A graph_partition_t keeps per-node and
+ * per-community degree sums up to date as edges are added to or removed
+ * from the graph (via graph events, see graph_event.h), and as nodes are
+ * moved between communities. So the modularity (see stats_modularity) and
+ * Chira fitness (see stats_chira) of the partition, and the numbers of
+ * intra- and inter-community edges, can be queried in constant time.
+ *
+ * Adding or removing an edge costs O(1), and moving a node costs
+ * O(degree), as only the two communities involved, and the neighbours of
+ * the node, are affected. Edge weights are not used.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_PARTITION_H__
+#define __GRAPH_PARTITION_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+
+/**
+ * Partition handle.
+ */
+typedef struct _graph_partition {
+
+  graph_t  *g;         /**< the graph                                */
+  uint32_t  ncomms;    /**< community IDs are in the range
+                            [0, ncomms)                              */
+  uint32_t  nused;     /**< number of non-empty communities          */
+  uint32_t *comms;     /**< community of each node                   */
+  uint32_t *indegrees; /**< number of neighbours of each node which
+                            are in the same community                */
+  uint32_t *sizes;     /**< number of nodes in each community        */
+  double   *degrees;   /**< total degree of each community           */
+  double   *internal;  /**< number of edges within each community    */
+  double   *strengths; /**< sum, over the nodes of each community, of
+                            (in - out) * (1 + in/2), where in and out
+                            are the numbers of neighbours inside and
+                            outside of the community                 */
+  double    intra;     /**< number of edges within communities       */
+  double    sumsq;     /**< sum of the squared community degrees     */
+  double    chira;     /**< sum, over all communities, of
+                            internal * strength / size^2             */
+
+  graph_event_listener_t gel; /**< listens for edge additions and
+                                   removals on the graph             */
+
+} graph_partition_t;
+
+/**
+ * Initialises a partition of the given graph, which must be undirected.
+ * If comms is NULL, nodes are grouped into communities by their label
+ * value - the community ID of a node is the index of its label value
+ * (see graph/graph_labelidx.h); otherwise, comms contains the community ID of every node, which
+ * must be in the range [0, graph_num_nodes(g)).
+ *
+ * Changes to node labels are not tracked; if nodes are relabelled, they
+ * must be moved with graph_partition_move.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed, or a community ID is out of range).
+ */
+uint8_t graph_partition_init(
+  graph_partition_t *gp,   /**< partition to initialise             */
+  graph_t           *g,    /**< the graph                           */
+  uint32_t          *comms /**< community of each node, or NULL to
+                                use node label values               */
+);
+
+/**
+ * Stops tracking the partition, and frees the memory used by it. The graph
+ * is not affected.
+ */
+void graph_partition_free(
+  graph_partition_t *gp /**< the partition */
+);
+
+/**
+ * Moves node u into the given community.
+ *
+ * \return 0 on success, non-0 if the community ID is out of range.
+ */
+uint8_t graph_partition_move(
+  graph_partition_t *gp,  /**< the partition           */
+  uint32_t           u,   /**< the node                */
+  uint32_t           comm /**< its new community ID    */
+);
+
+/**
+ * \return the community of node u.
+ */
+uint32_t graph_partition_community(
+  graph_partition_t *gp, /**< the partition */
+  uint32_t           u   /**< the node      */
+);
+
+/**
+ * \return the modularity of the partition (see stats_modularity).
+ */
+double graph_partition_modularity(
+  graph_partition_t *gp /**< the partition */
+);
+
+/**
+ * \return the Chira fitness of the partition (see stats_chira).
+ */
+double graph_partition_chira(
+  graph_partition_t *gp /**< the partition */
+);
+
+/**
+ * \return the number of edges which lie within communities.
+ */
+double graph_partition_intra_edges(
+  graph_partition_t *gp /**< the partition */
+);
+
+/**
+ * \return the number of edges which lie between communities.
+ */
+double graph_partition_inter_edges(
+  graph_partition_t *gp /**< the partition */
+);
+
+#endif /* __GRAPH_PARTITION_H__ */
@@ -1,195 +1,404 @@
 /**
+ * Point-to-point shortest path lengths, by bidirectional breadth first
+ * search. The search is expanded, one whole level at a time, from
+ * whichever of the two end points has the smaller frontier, until the two
+ * searches meet. On graphs with short average path lengths, this visits a
+ * small fraction of the nodes that a search from one end point would.
+ *
+ * Directed graphs do not store incoming edges, so they are searched from
+ * the first node only.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
- */ 
+ */
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include "util/array.h"
-#include "graph/bfs.h"
-#include "graph/expand.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/progress.h"
 #include "graph/graph.h"
 
 /**
- * Context information used to keep state during the breadth first search. The
- * same struct is shared by both the bfs and the expand callback functions.
+ * Value used for path lengths which have not (yet) been found.
+ */
+#define NO_PATH 0xFFFFFFFF
+
+/**
+ * Number of pairs in each chunk of work handed to a thread by
+ * graph_pathlengths.
+ */
+#define PAIR_CHUNK 16
+
+/**
+ * Search buffers, which are re-used across queries. Rather than clearing
+ * the marks array before every query, each query uses a new pair of mark
+ * values, one for each direction.
+ */
+typedef struct _search {
+
+  graph_t  *g;         /**< the graph                                  */
+  uint32_t  epoch;     /**< forward mark of the current query; the
+                            backward mark is epoch+1                   */
+  uint32_t *marks;     /**< mark of each node - nodes with neither of
+                            the current marks have not been visited    */
+  uint32_t *dists;     /**< distance of each visited node from the end
+                            point which its search started from        */
+  uint32_t *parents;   /**< parent of each visited node                */
+  uint32_t *queues[2]; /**< visited nodes for each direction, in the
+                            order in which they were visited           */
+
+} search_t;
+
+/**
+ * Context passed to _search_pairs.
  */
-typedef struct _ctx {
-
-  uint32_t src;        /**< source node (u)                */
-  uint32_t dest;       /**< destination node (v)           */
-  uint32_t pathlength; /**< the end result is stored here
-                            (0 if no path was found)       */
-  array_t  nodes;      /**< all visited nodes              */
-  array_t  parents;    /**< parents of all visited nodes   */
-  array_t  offsets;    /**< offsets of each depth, into
-                            nodes and parents array        */
-  array_t *path;       /**< if not NULL, indices of nodes
-                            on the end path are saved here */
-  
-} ctx_t;
+typedef struct _pairs_ctx {
+
+  search_t *searches; /**< one set of search buffers per thread */
+  uint32_t *pairs;    /**< node pairs                           */
+  uint32_t *lengths;  /**< place to store path lengths          */
+
+} pairs_ctx_t;
 
 /**
- * Breadth first search callback function, called on each depth change in the
- * search. Saves the offset (into nodes and parents) of the depth that was
- * just searched, into the offsets array.
+ * Allocates search buffers for the given graph.
  *
- * \return 0.
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _search_create(
+  search_t *s, /**< search buffers to initialise */
+  graph_t  *g  /**< the graph                    */
+);
+
+/**
+ * Frees the given search buffers.
  */
-static uint8_t _bfs_cb(
-  bfs_state_t *state,  /**< bfs state                 */
-  void        *context /**< pointer to a ctx_t struct */
+static void _search_free(
+  search_t *s /**< search buffers */
 );
 
 /**
- * Expand callback function, called on each edge traversal in the search.
- * Saves the child-parent relationship to the nodes/parents arrays. If/when
- * the destination node is found, terminates the search and constructs the
- * final path (if the path parameter is not NULL).
+ * Finds the shortest path from u to v, using the given search buffers.
  *
- * \return 1 if the dest node has been found, 0 otherwise.
+ * \return the length of the shortest path, or NO_PATH if there is no
+ * path, or u == v.
  */
-static uint8_t _expand_cb(
-  expand_state_t *state,  /**< expand state             */
-  void           *context /**< pointe to a ctx_t struct */
+static uint32_t _search(
+  search_t *s,   /**< search buffers                        */
+  uint32_t  u,   /**< first node                            */
+  uint32_t  v,   /**< second node                           */
+  array_t  *path /**< if not NULL, the path is stored here  */
 );
 
 /**
- * Constructs the path from src to dest by searching backwards through the
- * nodes/parents/offsets arrays.
+ * Stores the nodes on the path which passes through the given edge, at
+ * which the two searches met, in the given array.
  *
- * \return 0 on success, non-0 otherwise.
+ * \return 0 on success, non-0 on failure.
  */
 static uint8_t _create_path(
-  ctx_t *ctx /**< pointer to a ctx struct */
+  search_t *s,    /**< search buffers                           */
+  uint32_t  fwd,  /**< end point of the edge visited from u     */
+  uint32_t  bwd,  /**< end point of the edge visited from v     */
+  uint32_t  len,  /**< path length                              */
+  array_t  *path  /**< array to store the path in               */
+);
+
+/**
+ * parallel_for function - finds the path lengths for the pairs in the
+ * range [start, end).
+ *
+ * \return 0.
+ */
+static uint8_t _search_pairs(
+  uint64_t start,  /**< first pair                */
+  uint64_t end,    /**< one past last pair        */
+  uint16_t thread, /**< calling thread            */
+  void    *ctx     /**< pointer to a pairs_ctx_t  */
 );
 
 uint32_t graph_pathlength(
   graph_t *g, uint32_t u, uint32_t v, array_t *path) {
 
-  ctx_t context;
+  search_t s;
+  uint32_t len;
 
-  context.src        = u;
-  context.dest       = v;
-  context.pathlength = 0;
-  context.path       = path;
-  
-  if (array_create(&(context.nodes),   sizeof(uint32_t), 50)) goto fail;
-  if (array_create(&(context.parents), sizeof(uint32_t), 50)) goto fail;
-  if (array_create(&(context.offsets), sizeof(uint32_t), 10)) goto fail;
+  if (path != NULL) array_clear(path);
 
-  array_append(&(context.offsets), 0);
+  if (_search_create(&s, g)) goto fail;
 
-  if (bfs(g, &u, 1, NULL, &context, &context, _bfs_cb, _expand_cb))
-    goto fail;
-  
-  array_free(&(context.nodes));
-  array_free(&(context.parents));
-  array_free(&(context.offsets));
+  len = _search(&s, u, v, path);
+
+  _search_free(&s);
+
+  if (len == NO_PATH) return 0;
+  return len;
 
-  return context.pathlength;
-  
 fail:
   return 0;
 }
 
-uint8_t _bfs_cb(bfs_state_t *state, void *context) {
+uint8_t graph_pathlengths(
+  graph_t  *g,
+  uint32_t  npairs,
+  uint32_t *pairs,
+  uint32_t *lengths,
+  uint16_t  nthreads) {
+
+  uint64_t    i;
+  pairs_ctx_t ctx;
 
-  ctx_t *ctx;
+  ctx.searches = NULL;
+  ctx.pairs    = pairs;
+  ctx.lengths  = lengths;
 
-  ctx = (ctx_t *)context;
+  if (nthreads == 0) nthreads = parallel_num_threads();
+
+  /*there is no point in allocating buffers for idle threads*/
+  if (nthreads > (npairs + PAIR_CHUNK - 1) / PAIR_CHUNK)
+    nthreads = (npairs + PAIR_CHUNK - 1) / PAIR_CHUNK;
+  if (nthreads == 0)
+    nthreads = 1;
+
+  ctx.searches = calloc(nthreads, sizeof(search_t));
+  if (ctx.searches == NULL) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    if (_search_create(ctx.searches + i, g)) goto fail;
+  }
+
+  if (parallel_for(nthreads, npairs, PAIR_CHUNK, &ctx, _search_pairs))
+    goto fail;
 
-  /*
-   * the _expand_cb function appended the indices of all
-   * nodes found in the previous depth to the nodes
-   * array - store the location in the nodes array into
-   * the offsets array, so the _create_path function
-   * knows where the nodes from this depth finish.
-   */
-  array_append(&(ctx->offsets), &(ctx->nodes.size));
+  for (i = 0; i < nthreads; i++) _search_free(ctx.searches + i);
+  free(ctx.searches);
 
   return 0;
+
+fail:
+  if (ctx.searches != NULL) {
+    for (i = 0; i < nthreads; i++) _search_free(ctx.searches + i);
+    free(ctx.searches);
+  }
+  return 1;
 }
 
-uint8_t _expand_cb(expand_state_t *state, void *context) {
+uint8_t _search_create(search_t *s, graph_t *g) {
 
-  ctx_t *ctx;
+  uint32_t nnodes;
 
-  ctx = (ctx_t *)context;
+  memset(s, 0, sizeof(search_t));
 
-  if (state->visited) return 0;
+  nnodes = graph_num_nodes(g);
+  if (nnodes == 0) nnodes = 1;
 
-  /*save the node id and its parent*/
-  array_append(&(ctx->nodes),   &(state->child));
-  array_append(&(ctx->parents), &(state->parent));
+  s->g     = g;
+  s->epoch = 1;
 
-  /*we've found our destination*/
-  if (state->child == ctx->dest) {
-    
-    array_append(&(ctx->offsets), &(ctx->nodes.size));
-    
-    ctx->pathlength = ctx->offsets.size-1;
-    
-    if (ctx->path != NULL) _create_path(ctx);
+  s->marks     = calloc(nnodes, sizeof(uint32_t));
+  s->dists     = malloc(nnodes * sizeof(uint32_t));
+  s->parents   = malloc(nnodes * sizeof(uint32_t));
+  s->queues[0] = malloc(nnodes * sizeof(uint32_t));
+  s->queues[1] = malloc(nnodes * sizeof(uint32_t));
+
+  if (s->marks     == NULL) goto fail;
+  if (s->dists     == NULL) goto fail;
+  if (s->parents   == NULL) goto fail;
+  if (s->queues[0] == NULL) goto fail;
+  if (s->queues[1] == NULL) goto fail;
 
-    /*kill the search here*/
-    return 1;
-  }
   return 0;
+
+fail:
+  _search_free(s);
+  return 1;
 }
 
-uint8_t _create_path(ctx_t *ctx) {
+void _search_free(search_t *s) {
 
-  array_t *path;
-  int64_t  i;
-  int64_t  j;
-  uint32_t off1;
-  uint32_t off2;
-  uint32_t node1;
-  uint32_t node2;
-  uint32_t parent;
-
-  path = ctx->path;
-
-  /*
-   * resize the path array to fit the
-   * indices of every node in the path
-   */
-  if (array_expand(path, ctx->pathlength+1)) goto fail;
-
-  /*we know the start and endpoints of the path*/
-  array_set(path, ctx->pathlength, &(ctx->dest));
-  array_set(path, 0,               &(ctx->src));
-
-  /*
-   * search backwards through the node/parent
-   * list, looking for the parent of the node
-   * that was last added to the path, and
-   * appending the ids to the path as we go
-   */
-  for (i = ctx->offsets.size-1; i > 1; i--) {
-    
-    array_get(&(ctx->offsets), i,   &off1);
-    array_get(&(ctx->offsets), i-1, &off2);
-
-    for (j = off1; j > off2; j--) {
-
-      array_get(&(ctx->nodes), j-1, &node1);
-      array_get(path,          i,   &node2);
-
-      if (node1 == node2) {
-
-        array_get(&(ctx->parents), j-1, &parent);
-        
-        array_set(path, i-1, &parent);
-        break;
+  if (s->marks     != NULL) free(s->marks);
+  if (s->dists     != NULL) free(s->dists);
+  if (s->parents   != NULL) free(s->parents);
+  if (s->queues[0] != NULL) free(s->queues[0]);
+  if (s->queues[1] != NULL) free(s->queues[1]);
+
+  memset(s, 0, sizeof(search_t));
+}
+
+uint32_t _search(search_t *s, uint32_t u, uint32_t v, array_t *path) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint8_t   side;
+  uint8_t   directed;
+  uint32_t  x;
+  uint32_t  y;
+  uint32_t  mark[2];
+  uint32_t  head[2];
+  uint32_t  tail[2];
+  uint32_t  end;
+  uint32_t  best;
+  uint32_t  len;
+  uint32_t  meet[2];
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint64_t  nexpanded;
+  uint64_t  nedges;
+
+  if (u >= graph_num_nodes(s->g)) return NO_PATH;
+  if (v >= graph_num_nodes(s->g)) return NO_PATH;
+  if (u == v)                     return NO_PATH;
+
+  PROFILE_COUNT(PROFILE_BFS_SEARCHES, 1);
+  PROGRESS_ADD(PROGRESS_SOURCES, 1);
+
+  /*start afresh when the mark values run out*/
+  if (s->epoch >= 0xFFFFFFFD) {
+    memset(s->marks, 0, graph_num_nodes(s->g) * sizeof(uint32_t));
+    s->epoch = 1;
+  }
+
+  mark[0]   = s->epoch;
+  mark[1]   = s->epoch + 1;
+  s->epoch += 2;
+
+  directed  = graph_is_directed(s->g);
+  best      = NO_PATH;
+  meet[0]   = 0;
+  meet[1]   = 0;
+  nexpanded = 0;
+  nedges    = 0;
+
+  s->marks[u]     = mark[0];
+  s->dists[u]     = 0;
+  s->parents[u]   = u;
+  s->queues[0][0] = u;
+
+  s->marks[v]     = mark[1];
+  s->dists[v]     = 0;
+  s->parents[v]   = v;
+  s->queues[1][0] = v;
+
+  head[0] = 0;
+  head[1] = 0;
+  tail[0] = 1;
+  tail[1] = 1;
+
+  while (head[0] < tail[0] && head[1] < tail[1]) {
+
+    /*
+     * expand the smaller frontier; for a directed
+     * graph, v is a target, and is never expanded
+     */
+    if (directed) side = 0;
+    else          side = (tail[0] - head[0]) > (tail[1] - head[1]);
+
+    end = tail[side];
+
+    for (i = head[side]; i < end; i++) {
+
+      x     = s->queues[side][i];
+      nnbrs = graph_num_neighbours(s->g, x);
+      nbrs  = graph_get_neighbours(s->g, x);
+
+      nexpanded ++;
+      nedges    += nnbrs;
+
+      for (j = 0; j < nnbrs; j++) {
+
+        y = nbrs[j];
+
+        if (s->marks[y] == mark[side]) continue;
+
+        /*the searches have met*/
+        if (s->marks[y] == mark[1-side]) {
+
+          len = s->dists[x] + 1 + s->dists[y];
+
+          if (len < best) {
+            best         = len;
+            meet[side]   = x;
+            meet[1-side] = y;
+          }
+          continue;
+        }
+
+        s->marks[y]   = mark[side];
+        s->dists[y]   = s->dists[x] + 1;
+        s->parents[y] = x;
+
+        s->queues[side][tail[side]++] = y;
       }
     }
+
+    head[side] = end;
+
+    /*
+     * the whole level has been expanded,
+     * so the best meeting point is final
+     */
+    if (best != NO_PATH) break;
+  }
+
+  PROFILE_COUNT(PROFILE_BFS_NODES, nexpanded);
+  PROFILE_COUNT(PROFILE_BFS_EDGES, nedges);
+
+  if (best != NO_PATH && path != NULL) {
+    if (_create_path(s, meet[0], meet[1], best, path)) return NO_PATH;
+  }
+
+  return best;
+}
+
+uint8_t _create_path(
+  search_t *s, uint32_t fwd, uint32_t bwd, uint32_t len, array_t *path) {
+
+  int64_t  i;
+  uint32_t n;
+
+  array_clear(path);
+  if (array_expand(path, len + 1)) goto fail;
+
+  /*walk back from the meeting point to u, filling the path in reverse*/
+  n = fwd;
+  for (i = s->dists[fwd]; i >= 0; i--) {
+    array_set(path, i, &n);
+    n = s->parents[n];
+  }
+
+  /*and forwards from the meeting point to v*/
+  n = bwd;
+  for (i = s->dists[fwd] + 1; i <= len; i++) {
+    array_set(path, i, &n);
+    n = s->parents[n];
   }
 
   return 0;
-  
+
 fail:
   return 1;
 }
+
+uint8_t _search_pairs(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t     i;
+  uint32_t     len;
+  pairs_ctx_t *pctx;
+
+  pctx = ctx;
+
+  for (i = start; i < end; i++) {
+
+    len = _search(pctx->searches + thread,
+                  pctx->pairs[2*i],
+                  pctx->pairs[2*i+1],
+                  NULL);
+
+    pctx->lengths[i] = (len == NO_PATH) ? 0 : len;
+  }
+
+  return 0;
+}
@@ -64,8 +64,6 @@ uint8_t graph_prune(graph_t *gin, graph_t *gout, uint32_t size, double prop) {
   uint32_t *components;
   array_t   sizes;
   uint32_t  nnodes;
-  uint64_t  i;
-  uint32_t  s;
 
   components = NULL;
   sizes.data = NULL;
@@ -81,38 +79,8 @@ uint8_t graph_prune(graph_t *gin, graph_t *gout, uint32_t size, double prop) {
   if (_find_components(gin, components, &sizes))
     goto fail;
 
-  /*
-   * If size is 0, find the size of the largest component(s)
-   * 
-   */
-  if (size == 0) {
-
-    for (i = 0; i < sizes.size; i++) {
-      
-      array_get(&sizes, i, &s);
-      if (s > size) size = s;
-    }
-
-    /*
-     * if the network consists wholly of disconnected nodes (i.e. all
-     * components have size == 1), just remove them all; otherwise, remove
-     * all components that are smaller than the largtest component
-     */
-    if (size > 1)
-      size -= 1;
-    /*
-     * If size is 0 and prop is > 0.0, the graph is pruned such that only the
-     * largest component remains, but only if that component is at least
-     * (prop*100)% of the total network size. If this is not the case, the
-     * graph is pruned as if (size=1,prop=0.0) were passed in - i.e. only
-     * disconnected nodes are pruned.
-     */
-    if (prop > 0) {
-      if (size / ((double)nnodes) < prop) {
-        size = 1;
-      }
-    }
-  }
+  size = graph_prune_threshold(
+    (uint32_t *)sizes.data, sizes.size, nnodes, size, prop);
 
   if (_prune(gin, gout, size, components, sizes.size, (uint32_t *)sizes.data))
     goto fail;
@@ -124,6 +92,45 @@ fail:
   return 1;
 }
 
+uint32_t graph_prune_threshold(
+  uint32_t *sizes, uint32_t ncomponents, uint32_t nnodes, uint32_t size,
+  double prop) {
+
+  uint64_t i;
+
+  if (size > 0) return size;
+
+  /*
+   * If size is 0, find the size of the largest component(s)
+   * 
+   */
+  for (i = 0; i < ncomponents; i++) {
+    if (sizes[i] > size) size = sizes[i];
+  }
+
+  /*
+   * if the network consists wholly of disconnected nodes (i.e. all
+   * components have size == 1), just remove them all; otherwise, remove
+   * all components that are smaller than the largtest component
+   */
+  if (size > 1)
+    size -= 1;
+  /*
+   * If size is 0 and prop is > 0.0, the graph is pruned such that only the
+   * largest component remains, but only if that component is at least
+   * (prop*100)% of the total network size. If this is not the case, the
+   * graph is pruned as if (size=1,prop=0.0) were passed in - i.e. only
+   * disconnected nodes are pruned.
+   */
+  if (prop > 0) {
+    if (size / ((double)nnodes) < prop) {
+      size = 1;
+    }
+  }
+
+  return size;
+}
+
 uint8_t _find_components(graph_t *g, uint32_t *components, array_t *sizes) {
 
   uint64_t i;
@@ -153,7 +160,7 @@ uint8_t _find_components(graph_t *g, uint32_t *components, array_t *sizes) {
     ctx.size = 1;
     ctx.components[i] = ctx.component_id;
 
-    if (bfs(g, &n, 1, NULL, &ctx, NULL, _bfs_cb, NULL)) goto fail;
+    if (bfs_hybrid(g, &n, 1, NULL, &ctx, _bfs_cb)) goto fail;
 
     ctx.component_id ++;
     if (array_append(sizes, &(ctx.size))) goto fail;
@@ -258,7 +265,7 @@ uint8_t _prune(
 
     lbl = graph_get_nodelabel(gin, i);
     if (lbl == NULL) break;
-    if (graph_set_nodelabel(gout, nidmap[i], lbl)) goto fail;
+    if (graph_copy_nodelabel(gin, i, gout, nidmap[i])) goto fail;
   }
   
   free(nidmap);
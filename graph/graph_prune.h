@@ -38,4 +38,19 @@ uint8_t graph_prune(
   double   prop  /**< minimum proportion of largest component */
 );
 
+/**
+ * Calculates the component size threshold used by graph_prune, from the
+ * given size and prop parameters, and the sizes of all of the components
+ * in the graph. Components of this size or smaller are removed.
+ *
+ * \return the size threshold.
+ */
+uint32_t graph_prune_threshold(
+  uint32_t *sizes,       /**< size of every component                 */
+  uint32_t  ncomponents, /**< number of components                    */
+  uint32_t  nnodes,      /**< number of nodes in the graph            */
+  uint32_t  size,        /**< size parameter                          */
+  double    prop         /**< minimum proportion of largest component */
+);
+
 #include "graph/graph.h"
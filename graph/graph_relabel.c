@@ -21,17 +21,8 @@ uint8_t graph_relabel(graph_t *g, dsr_t *hdr, uint8_t *img, uint8_t real) {
   graph_label_t *plbl;
   uint32_t       nnodes;
   uint64_t       i;
-  double         xl;
-  double         yl;
-  double         zl;
-  uint32_t       dims[3];
 
   nnodes = graph_num_nodes(g);
-  xl     = analyze_pixdim_size(hdr, 0);
-  yl     = analyze_pixdim_size(hdr, 1);
-  zl     = analyze_pixdim_size(hdr, 2);
-
-  if (analyze_num_dims(hdr) != 3) goto fail;
 
   for (i = 0; i < nnodes; i++) {
 
@@ -40,26 +31,48 @@ uint8_t graph_relabel(graph_t *g, dsr_t *hdr, uint8_t *img, uint8_t real) {
 
     memcpy(&lbl, plbl, sizeof(graph_label_t));
 
-    if (real) {
-      dims[0] = (uint32_t)(round(lbl.xval / xl));
-      dims[1] = (uint32_t)(round(lbl.yval / yl));
-      dims[2] = (uint32_t)(round(lbl.zval / zl));
-    }
-    else {
-      dims[0] = (uint32_t)lbl.xval;
-      dims[1] = (uint32_t)lbl.yval;
-      dims[2] = (uint32_t)lbl.zval;
-    }
+    if (graph_relabel_label(&lbl, hdr, img, real)) goto fail;
+    if (graph_set_nodelabel(g, i, &lbl))           goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_relabel_label(
+  graph_label_t *lbl, dsr_t *hdr, uint8_t *img, uint8_t real) {
+
+  double   xl;
+  double   yl;
+  double   zl;
+  uint32_t dims[3];
 
-    if (dims[0] >= analyze_dim_size(hdr, 0)) goto fail;
-    if (dims[1] >= analyze_dim_size(hdr, 1)) goto fail;
-    if (dims[2] >= analyze_dim_size(hdr, 2)) goto fail;
+  if (analyze_num_dims(hdr) != 3) goto fail;
 
-    lbl.labelval = analyze_read_val(hdr, img, dims);
+  if (real) {
 
-    if (graph_set_nodelabel(g, i, &lbl)) goto fail;
+    xl = analyze_pixdim_size(hdr, 0);
+    yl = analyze_pixdim_size(hdr, 1);
+    zl = analyze_pixdim_size(hdr, 2);
+
+    dims[0] = (uint32_t)(round(lbl->xval / xl));
+    dims[1] = (uint32_t)(round(lbl->yval / yl));
+    dims[2] = (uint32_t)(round(lbl->zval / zl));
+  }
+  else {
+    dims[0] = (uint32_t)lbl->xval;
+    dims[1] = (uint32_t)lbl->yval;
+    dims[2] = (uint32_t)lbl->zval;
   }
 
+  if (dims[0] >= analyze_dim_size(hdr, 0)) goto fail;
+  if (dims[1] >= analyze_dim_size(hdr, 1)) goto fail;
+  if (dims[2] >= analyze_dim_size(hdr, 2)) goto fail;
+
+  lbl->labelval = analyze_read_val(hdr, img, dims);
+
   return 0;
 
 fail:
@@ -120,10 +133,12 @@ static uint8_t _load_mapfile(char *mapfile,  array_t *map) {
     mapping.oldlbl = u;
     mapping.newlbl = v;
 
-    if (array_insert_sorted(map, &mapping, 1, NULL) == 2)
-      goto fail;
+    if (array_append(map, &mapping)) goto fail;
   }
 
+  /*the first mapping for each label is retained*/
+  if (array_merge_sorted(map, 0, 1)) goto fail;
+
   fclose(f);
   free(line);
   return 0;
@@ -2,27 +2,577 @@
  * Function which thresholds edges of a graph based on their edge betweennes
  * value.
  *
+ * For undirected graphs, the values are updated incrementally after each
+ * removal. Removing an edge only changes the contribution of source node s
+ * if the edge is on a shortest path from s, i.e. if its end points are at
+ * different distances from s. The old contributions of these sources are
+ * subtracted, with the edge temporarily restored, and the new contributions
+ * added; the rest of the values are unchanged.
+ *
+ * The cached values of undirected graphs are also mirrored in a lazy
+ * binary max-heap (see edge_heap.h), so the edge with the maximum value is
+ * found without scanning every edge. Every edge whose value is touched by
+ * an incremental update is pushed onto the heap with its new value; old
+ * entries are discarded when they reach the top, if the edge no longer
+ * exists or its value no longer matches the cache.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "util/edge_array.h"
+#include "graph/bfs.h"
 #include "graph/graph.h"
+#include "graph/edge_heap.h"
 #include "graph/graph_threshold.h"
+#include "util/rng.h"
+
+/**
+ * Number of source nodes to sample when estimating edge betweenness, or 0
+ * to calculate exact values (see graph_approx_edge_betweenness).
+ */
+static uint32_t _approx_nsamples = 0;
+
+/**
+ * The heap is rebuilt from the cache when it holds more than this many
+ * entries for every edge in the graph.
+ */
+#define HEAP_SLACK 4
+
+/**
+ * Edge-betweenness thresholding state. There is one state, which belongs
+ * to the graph most recently passed to graph_init_edge_betweenness, if it
+ * is undirected and exact values are being calculated; for any other
+ * graph, every edge is scanned, as if there were no state.
+ */
+typedef struct _eb_state {
+
+  graph_t     *g;    /**< graph the state belongs to, or NULL */
+  edge_heap_t  heap; /**< max-heap of edge-betweenness values */
+
+} eb_state_t;
+
+static eb_state_t _state = {NULL, {NULL, 0, 0, 1}};
+
+/**
+ * Rebuilds the heap from the cached values of every edge.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _rebuild(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return 1 if the top entry of the heap is the current value of an edge in
+ * the graph, 0 if it is stale, or -1 if the edge value is not cached.
+ */
+static int8_t _heap_top_valid(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Orders edges by u, then by v.
+ */
+static int _compare_edges(
+  const void *a,
+  const void *b
+);
+
+/**
+ * Frees the state, and disables it until the next call to
+ * graph_init_edge_betweenness.
+ */
+static void _state_free(void);
+
+/**
+ * graph_remove_edge_betweenness, by scanning the cached value of every
+ * edge.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _remove_scan(
+  graph_t      *g,
+  double       *betw,
+  array_t      *edges,
+  graph_edge_t *edge
+);
+
+/**
+ * Identifies the source nodes whose edge betweenness contributions would be
+ * changed by the removal of the edge between u and v - those nodes which
+ * are at different distances from u and v. The number of nodes in the
+ * same component as u and v is also calculated.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _affected_sources(
+  graph_t   *g,        /**< the graph                                */
+  uint32_t   u,        /**< edge end point                           */
+  uint32_t   v,        /**< other edge end point                     */
+  uint32_t  *sources,  /**< place to store affected sources - must
+                            have space for graph_num_nodes(g) values */
+  uint32_t  *nsources, /**< place to store number of sources         */
+  uint32_t  *nreach    /**< place to store component size            */
+);
+
+/**
+ * bfs_hybrid callback function - stores the depth of every node in the
+ * current level in the given distance array.
+ *
+ * \return 0 always.
+ */
+static uint8_t _distance_cb(
+  bfs_state_t *state, /**< search state                   */
+  void        *ctx    /**< pointer to a uint32_t array    */
+);
+
+/**
+ * Calculates the edge betweenness contributions from the given sources,
+ * multiplies them by the given sign, and adds them to the cached edge
+ * betweenness values. If the sign is 0, the cached values are replaced
+ * with the contributions.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _update_sources(
+  graph_t  *g,        /**< the graph                          */
+  uint32_t *sources,  /**< source nodes                       */
+  uint32_t  nsources, /**< number of source nodes             */
+  double    sign      /**< -1 to subtract, 1 to add, or 0 to
+                             replace, values                  */
+);
+
+void graph_approx_edge_betweenness(uint32_t nsamples) {
+
+  _approx_nsamples = nsamples;
+}
 
 uint8_t graph_init_edge_betweenness(graph_t *g) {
 
-  stats_edge_betweenness(g, 0, NULL);
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  ncmps;
+  uint32_t *sources;
+  uint32_t *components;
+  uint8_t  *done;
+
+  sources    = NULL;
+  components = NULL;
+  done       = NULL;
+  nnodes     = graph_num_nodes(g);
+
+  _state_free();
+
+  if (_approx_nsamples > 0)
+    return stats_approx_edge_betweenness(g, _approx_nsamples);
+
+  /*
+   * A single pass from every node gives the
+   * values for every component at once
+   */
+  if (!graph_is_directed(g)) {
+
+    sources = malloc(nnodes*sizeof(uint32_t));
+    if (sources == NULL) goto fail;
+
+    for (i = 0; i < nnodes; i++) sources[i] = i;
+
+    if (_update_sources(g, sources, nnodes, 0)) goto fail;
+
+    /*
+     * without a heap, the values are still in
+     * the cache, so thresholding can continue
+     */
+    _state.g = g;
+    if (_rebuild(g)) _state_free();
+
+    free(sources);
+    return 0;
+  }
+
+  components = calloc(nnodes, sizeof(uint32_t));
+  done       = calloc(nnodes, sizeof(uint8_t));
+  if (components == NULL) goto fail;
+  if (done       == NULL) goto fail;
+
+  ncmps = stats_num_components(g, 0, NULL, components);
+
+  for (i = 0; i < nnodes && ncmps > 0; i++) {
 
+    if (done[components[i]]) continue;
+
+    done[components[i]] = 1;
+    ncmps--;
+
+    if (stats_edge_betweenness(g, i, NULL)) goto fail;
+  }
+
+  free(components);
+  free(done);
   return 0;
+
+fail:
+  if (sources    != NULL) free(sources);
+  if (components != NULL) free(components);
+  if (done       != NULL) free(done);
+  return 1;
 }
 
 uint8_t graph_remove_edge_betweenness(
   graph_t *g, double *betw, array_t *edges, graph_edge_t *edge) {
 
+  uint64_t      i;
+  uint64_t      n;
+  int8_t        valid;
+  double        max;
+  graph_edge_t *top;
+  graph_edge_t *ties;
+
+  if (_state.g != g) return _remove_scan(g, betw, edges, edge);
+
+  array_clear(edges);
+  max = 0;
+
+  /*
+   * collect every edge with the maximum value -
+   * values below 0 are ignored, as by the scan
+   */
+  while (_state.heap.size > 0) {
+
+    valid = _heap_top_valid(g);
+
+    if (valid < 0) {
+      _state_free();
+      array_clear(edges);
+      return _remove_scan(g, betw, edges, edge);
+    }
+
+    if (valid == 0) {
+      edge_heap_pop(&_state.heap);
+      continue;
+    }
+
+    top = _state.heap.entries;
+
+    if (top->val < max)                     break;
+    if (edges->size > 0 && top->val != max) break;
+
+    max = top->val;
+    if (array_append(edges, top)) goto fail;
+    edge_heap_pop(&_state.heap);
+  }
+
+  if (edges->size == 0) goto fail;
+
+  /*
+   * the ties are chosen from in the same order as by
+   * the scan, which visits edges in order of u, then
+   * v; an edge may have more than one valid entry
+   */
+  ties = (graph_edge_t *)edges->data;
+
+  qsort(ties, edges->size, sizeof(graph_edge_t), _compare_edges);
+
+  for (i = 1, n = 1; i < edges->size; i++) {
+    if (ties[i].u == ties[n-1].u && ties[i].v == ties[n-1].v) continue;
+    ties[n++] = ties[i];
+  }
+  edges->size = n;
+
+  i = rng_range(rng_default(), edges->size);
+
+  if (array_get(edges, i, edge))              goto fail;
+  if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
+
+  /*the edges which were not removed go back on the heap*/
+  for (n = 0; n < edges->size; n++) {
+
+    if (n == i) continue;
+    if (edge_heap_push(&_state.heap, ties + n)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_recalculate_edge_betweenness(graph_t *g, graph_edge_t *edge) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  nsources;
+  uint32_t  nreach;
+  double    icmp;
+  double    ucmp;
+  double    vcmp;
+  uint8_t   incremental;
+  uint32_t *components;
+  uint32_t *sources;
+
+  components = NULL;
+  sources    = NULL;
+  nnodes     = graph_num_nodes(g);
+
+  /*
+   * estimates are recalculated for the whole
+   * graph, from a new sample of source nodes
+   */
+  if (_approx_nsamples > 0)
+    return stats_approx_edge_betweenness(g, _approx_nsamples);
+
+  /*
+   * The edge is restored while the old contributions
+   * are calculated. The incremental update is only
+   * worthwhile if fewer than half of the nodes in the
+   * component are affected, otherwise the component
+   * is recalculated from scratch.
+   */
+  if (!graph_is_directed(g)) {
+
+    sources = malloc(nnodes*sizeof(uint32_t));
+    if (sources == NULL) goto fail;
+
+    if (graph_add_edge(g, edge->u, edge->v, 1.0)) goto fail;
+
+    if (_affected_sources(g, edge->u, edge->v, sources, &nsources, &nreach))
+      goto fail;
+
+    incremental = 2*(uint64_t)nsources < nreach;
+
+    if (incremental && _update_sources(g, sources, nsources, -1)) goto fail;
+
+    if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
+
+    if (incremental) {
+
+      if (_update_sources(g, sources, nsources, 1)) goto fail;
+
+      free(sources);
+      return 0;
+    }
+
+    free(sources);
+    sources = NULL;
+  }
+
+  /*
+   * The cache discards component IDs when an edge removal
+   * splits a component, so these are up to date
+   */
+  components = calloc(nnodes,sizeof(uint32_t));
+  if (components == NULL) goto fail;
+
+  stats_cache_node_component(g, -1, components);
+  ucmp = components[edge->u];
+  vcmp = components[edge->v];
+
+  /*
+   * Values for directed graphs are calculated
+   * from the cached path lengths and counts
+   */
+  if (graph_is_directed(g)) {
+
+    for (i = 0; i < nnodes; i++) {
+
+      if (i == edge->u || i == edge->v) continue;
+
+      icmp = components[i];
+
+      if (icmp == ucmp || icmp == vcmp) {
+      
+        stats_pathlength(g, i, NULL);
+        stats_numpaths(  g, i, NULL);
+      }
+    }
+
+    stats_pathlength(g, edge->u, NULL);
+    stats_pathlength(g, edge->v, NULL);
+    stats_numpaths(  g, edge->u, NULL);
+    stats_numpaths(  g, edge->v, NULL);
+  }
+
+  stats_edge_betweenness(g, edge->u, NULL);
+  
+  if (ucmp != vcmp)
+    stats_edge_betweenness(g, edge->v, NULL);
+
+  if (_state.g == g && _rebuild(g)) _state_free();
+
+  free(components);
+  return 0;
+  
+fail:
+  if (components != NULL) free(components);
+  if (sources    != NULL) free(sources);
+  return 1;
+}
+
+uint8_t _affected_sources(
+  graph_t  *g,
+  uint32_t  u,
+  uint32_t  v,
+  uint32_t *sources,
+  uint32_t *nsources,
+  uint32_t *nreach) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *upaths;
+  uint32_t *vpaths;
+
+  upaths = NULL;
+  vpaths = NULL;
+  nnodes = graph_num_nodes(g);
+
+  upaths = calloc(nnodes, sizeof(uint32_t));
+  vpaths = calloc(nnodes, sizeof(uint32_t));
+  if (upaths == NULL) goto fail;
+  if (vpaths == NULL) goto fail;
+
+  if (bfs_hybrid(g, &u, 1, NULL, upaths, _distance_cb)) goto fail;
+  if (bfs_hybrid(g, &v, 1, NULL, vpaths, _distance_cb)) goto fail;
+
+  /*
+   * The distances of any node from u and v differ by at
+   * most 1, and are different iff the edge is on a
+   * shortest path from the node. Distances to
+   * unreachable nodes are 0.
+   */
+  *nsources = 0;
+  *nreach   = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (i != u && upaths[i] == 0) continue;
+
+    (*nreach)++;
+
+    if (upaths[i] != vpaths[i]) sources[(*nsources)++] = i;
+  }
+
+  free(upaths);
+  free(vpaths);
+  return 0;
+
+fail:
+  if (upaths != NULL) free(upaths);
+  if (vpaths != NULL) free(vpaths);
+  return 1;
+}
+
+uint8_t _distance_cb(bfs_state_t *state, void *ctx) {
+
+  uint64_t  i;
+  uint32_t  ni;
+  uint32_t *dists;
+
+  dists = ctx;
+
+  for (i = 0; i < state->thislevel.size; i++) {
+
+    array_get(&(state->thislevel), i, &ni);
+    dists[ni] = state->depth;
+  }
+
+  return 0;
+}
+
+uint8_t _update_sources(
+  graph_t *g, uint32_t *sources, uint32_t nsources, double sign) {
+
+  uint64_t     i;
+  uint64_t     j;
+  uint32_t     nnodes;
+  uint32_t     nnbrs;
+  uint32_t    *nbrs;
+  double      *vals;
+  double      *contrib;
+  graph_edge_t e;
+  edge_array_t betw;
+
+  vals      = NULL;
+  betw.vals = NULL;
+  nnodes    = graph_num_nodes(g);
+
+  vals = malloc(nnodes*sizeof(double));
+  if (vals == NULL) goto fail;
+
+  if (edge_array_create(g, sizeof(double), &betw))         goto fail;
+  if (stats_brandes(g, sources, nsources, 0, NULL, &betw)) goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_EDGE_BETWEENNESS,
+                  STATS_CACHE_TYPE_EDGE,
+                  sizeof(double));
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    if (nnbrs == 0) continue;
+
+    contrib = edge_array_get_all(&betw, i);
+
+    if (sign == 0) {
+      stats_cache_update(g, STATS_CACHE_EDGE_BETWEENNESS, i, -1, contrib);
+      continue;
+    }
+
+    if (stats_cache_edge_betweenness(g, i, vals)) goto fail;
+
+    for (j = 0; j < nnbrs; j++) vals[j] += sign * contrib[j];
+
+    stats_cache_update(g, STATS_CACHE_EDGE_BETWEENNESS, i, -1, vals);
+
+    /*
+     * every edge whose value has been touched goes onto the
+     * heap with its new value - the removed edge, which is
+     * restored while its old contributions are subtracted,
+     * is discarded when it reaches the top
+     */
+    if (_state.g != g) continue;
+
+    nbrs = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (i > nbrs[j] || contrib[j] == 0) continue;
+
+      e.u   = i;
+      e.v   = nbrs[j];
+      e.val = vals[j];
+
+      if (edge_heap_push(&_state.heap, &e)) {
+        _state_free();
+        break;
+      }
+    }
+  }
+
+  if (_state.g == g &&
+      _state.heap.size > HEAP_SLACK * (graph_num_edges(g) + 1) &&
+      _rebuild(g))
+    _state_free();
+
+  edge_array_free(&betw);
+  free(vals);
+  return 0;
+
+fail:
+  if (betw.vals != NULL) edge_array_free(&betw);
+  if (vals      != NULL) free(vals);
+  return 1;
+}
+
+uint8_t _remove_scan(
+  graph_t *g, double *betw, array_t *edges, graph_edge_t *edge) {
+
   uint64_t     i;
   uint64_t     j;
   uint32_t     nnodes;
@@ -59,7 +609,7 @@ uint8_t graph_remove_edge_betweenness(
   }
 
   /*randomly remove one of those edges*/
-  i = floor((edges->size) * ((double)random() / RAND_MAX));
+  i = rng_range(rng_default(), edges->size);
 
   if (array_get(edges, i, edge))              goto fail;
   if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
@@ -70,57 +620,85 @@ fail:
   return 1;
 }
 
-uint8_t graph_recalculate_edge_betweenness(graph_t *g, graph_edge_t *edge) {
+uint8_t _rebuild(graph_t *g) {
 
-  uint64_t  i;
-  uint32_t  nnodes;
-  double    icmp;
-  double    ucmp;
-  double    vcmp;
-  uint32_t *components;
+  uint64_t      i;
+  uint64_t      j;
+  uint32_t      nnodes;
+  uint32_t      nnbrs;
+  uint32_t     *nbrs;
+  double       *vals;
+  graph_edge_t  e;
 
-  components = NULL;
-  nnodes     = graph_num_nodes(g);
+  nnodes = graph_num_nodes(g);
+  vals   = malloc((nnodes + 1) * sizeof(double));
+  if (vals == NULL) goto fail;
 
-  /*
-   * I'm assuming that component IDs have been recalculated
-   * in the graph_threshold_components function, in
-   * graph_threshold.c
-   */
-  components = calloc(nnodes,sizeof(uint32_t));
-  if (components == NULL) goto fail;
-
-  stats_cache_node_component(g, -1, components);
-  ucmp = components[edge->u];
-  vcmp = components[edge->v];
+  edge_heap_clear(&_state.heap);
 
   for (i = 0; i < nnodes; i++) {
 
-    if (i == edge->u || i == edge->v) continue;
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
 
-    icmp = components[i];
+    if (nnbrs == 0) continue;
 
-    if (icmp == ucmp || icmp == vcmp) {
-      
-      stats_pathlength(g, i, NULL);
-      stats_numpaths(  g, i, NULL);
-    }
-  }
+    if (stats_cache_edge_betweenness(g, i, vals)) goto fail;
 
-  stats_pathlength(g, edge->u, NULL);
-  stats_pathlength(g, edge->v, NULL);
-  stats_numpaths(  g, edge->u, NULL);
-  stats_numpaths(  g, edge->v, NULL);
+    for (j = 0; j < nnbrs; j++) {
 
-  stats_edge_betweenness(g, edge->u, NULL);
-  
-  if (ucmp != vcmp)
-    stats_edge_betweenness(g, edge->v, NULL);
+      if (i > nbrs[j]) continue;
 
-  free(components);
+      e.u   = i;
+      e.v   = nbrs[j];
+      e.val = vals[j];
+
+      if (edge_heap_push(&_state.heap, &e)) goto fail;
+    }
+  }
+
+  free(vals);
   return 0;
-  
+
 fail:
-  if (components != NULL) free(components);
+  if (vals != NULL) free(vals);
   return 1;
 }
+
+int8_t _heap_top_valid(graph_t *g) {
+
+  double        val;
+  graph_edge_t *top;
+
+  top = _state.heap.entries;
+
+  if (!graph_are_neighbours(g, top->u, top->v)) return 0;
+
+  if (stats_cache_check(
+        g, STATS_CACHE_EDGE_BETWEENNESS, top->u, top->v, &val) != 1)
+    return -1;
+
+  return val == top->val;
+}
+
+int _compare_edges(const void *a, const void *b) {
+
+  const graph_edge_t *ea;
+  const graph_edge_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->u < eb->u) return -1;
+  if (ea->u > eb->u) return  1;
+  if (ea->v < eb->v) return -1;
+  if (ea->v > eb->v) return  1;
+  return 0;
+}
+
+void _state_free(void) {
+
+  edge_heap_free(&_state.heap);
+
+  _state.g = NULL;
+}
@@ -1,30 +1,365 @@
 /**
  * Remove edges from a graph based on pathsharing.
  *
+ * The cached path-sharing values are mirrored in a binary min-heap (see
+ * edge_heap.h), so the edge with the minimum value is found without
+ * scanning every edge. The heap is lazy - when an edge is removed, or its
+ * value is recalculated, its old entry stays in the heap, and is discarded
+ * when it reaches the top, if the edge no longer exists or its value no
+ * longer matches the cache.
+ *
+ * Removing the edge between u and v only changes the path-sharing values of
+ * the edges of u and v, and of the edges between a neighbour of u and a
+ * neighbour of v; only those edges are recalculated, and pushed onto the
+ * heap, so the cost of each removal depends on the neighbourhood of the
+ * removed edge, rather than the size of the graph.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 #include "graph/graph.h"
+#include "graph/edge_heap.h"
 #include "graph/graph_threshold.h"
+#include "util/rng.h"
+
+/**
+ * The heap is rebuilt from the cache when it holds more than this many
+ * entries for every edge in the graph.
+ */
+#define HEAP_SLACK 4
+
+/**
+ * Marks used to identify the neighbours of the end points of a removed
+ * edge.
+ */
+#define MARK_U 1
+#define MARK_V 2
+
+/**
+ * Path-sharing thresholding state. There is one state, which belongs to
+ * the graph most recently passed to graph_init_pathsharing; for any other
+ * graph, every edge is scanned and recalculated, as if there were no state.
+ */
+typedef struct _ps_state {
+
+  graph_t     *g;     /**< graph the state belongs to, or NULL    */
+  edge_heap_t  heap;  /**< min-heap of path-sharing values        */
+  uint8_t     *marks; /**< per-node marks, all 0 between calls    */
+
+} ps_state_t;
 
+static ps_state_t _state = {NULL, {NULL, 0, 0, 0}, NULL};
+
+/**
+ * Creates a list of every edge in the given graph, with u < v. The list
+ * must be freed by the caller.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _all_edges(
+  graph_t       *g,      /**< the graph                          */
+  graph_edge_t **edges,  /**< place to store the list            */
+  uint64_t      *nedges  /**< place to store the number of edges */
+);
+
+/**
+ * Looks up the cached path-sharing value for each of the given edges, and
+ * pushes them onto the heap. Rebuilds the heap if it has grown too large.
+ *
+ * \return 0 on success, non-0 on failure, or if a value is not in the
+ * cache.
+ */
+static uint8_t _push_edges(
+  graph_t      *g,     /**< the graph           */
+  graph_edge_t *edges, /**< the edges           */
+  uint64_t      n      /**< number of edges     */
+);
+
+/**
+ * Rebuilds the heap from the cached values of every edge.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _rebuild(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * \return 1 if the top entry of the heap is the current value of an edge in
+ * the graph, 0 if it is stale, or -1 if the edge value is not cached.
+ */
+static int8_t _heap_top_valid(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Orders edges by u, then by v.
+ */
+static int _compare_edges(
+  const void *a,
+  const void *b
+);
+
+/**
+ * Frees the state, and disables it until the next call to
+ * graph_init_pathsharing.
+ */
+static void _state_free(void);
+
+/**
+ * graph_remove_pathsharing, by scanning the cached value of every edge.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _remove_scan(
+  graph_t      *g,
+  double       *share,
+  array_t      *edges,
+  graph_edge_t *edge
+);
+
+/**
+ * graph_recalculate_pathsharing, for every pair of a neighbour of u and a
+ * neighbour of v.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _recalculate_pairs(
+  graph_t      *g,
+  graph_edge_t *edge
+);
 
 uint8_t graph_init_pathsharing(graph_t *g) {
-  
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  nnodes;
-  uint32_t  nnbrs;
-  uint32_t *nbrs;
+
+  uint64_t      nedges;
+  graph_edge_t *edges;
+
+  edges = NULL;
+
+  _state_free();
+
+  if (_all_edges(g, &edges, &nedges)) goto fail;
+
+  if (stats_edge_pathsharing_list(g, edges, nedges, 0))
+    goto fail;
+
+  /*
+   * without a heap, the values are still in
+   * the cache, so thresholding can continue
+   */
+  _state.marks = calloc(graph_num_nodes(g) + 1, sizeof(uint8_t));
+  if (_state.marks != NULL) {
+    _state.g = g;
+    if (_push_edges(g, edges, nedges)) _state_free();
+  }
+
+  free(edges);
+  return 0;
+
+fail:
+  if (edges != NULL) free(edges);
+  return 1;
+}
+
+uint8_t graph_remove_pathsharing(
+  graph_t *g, double *share, array_t *edges, graph_edge_t *edge) {
+
+  uint64_t      i;
+  uint64_t      n;
+  int8_t        valid;
+  double        min;
+  graph_edge_t *ties;
+
+  if (_state.g != g) return _remove_scan(g, share, edges, edge);
+
+  array_clear(edges);
+  min = 1.0;
+
+  /*
+   * collect every edge with the minimum value -
+   * values above 1.0 are ignored, as by the scan
+   */
+  while (_state.heap.size > 0) {
+
+    valid = _heap_top_valid(g);
+
+    if (valid < 0) {
+      _state_free();
+      array_clear(edges);
+      return _remove_scan(g, share, edges, edge);
+    }
+
+    if (valid == 0) {
+      edge_heap_pop(&_state.heap);
+      continue;
+    }
+
+    if (_state.heap.entries[0].val > min)                     break;
+    if (edges->size > 0 && _state.heap.entries[0].val != min) break;
+
+    min = _state.heap.entries[0].val;
+    if (array_append(edges, _state.heap.entries)) goto fail;
+    edge_heap_pop(&_state.heap);
+  }
+
+  if (edges->size == 0) goto fail;
+
+  /*
+   * the ties are chosen from in the same order as by
+   * the scan, which visits edges in order of u, then
+   * v; an edge may have more than one valid entry
+   */
+  ties = (graph_edge_t *)edges->data;
+
+  qsort(ties, edges->size, sizeof(graph_edge_t), _compare_edges);
+
+  for (i = 1, n = 1; i < edges->size; i++) {
+    if (ties[i].u == ties[n-1].u && ties[i].v == ties[n-1].v) continue;
+    ties[n++] = ties[i];
+  }
+  edges->size = n;
+
+  i = rng_range(rng_default(), edges->size);
+
+  if (array_get(edges, i, edge))              goto fail;
+  if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
+
+  /*the edges which were not removed go back on the heap*/
+  for (n = 0; n < edges->size; n++) {
+
+    if (n == i) continue;
+    if (edge_heap_push(&_state.heap, ties + n)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_recalculate_pathsharing(graph_t *g, graph_edge_t *edge) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint64_t      cost[2];
+  uint8_t       side;
+  uint32_t      ends[2];
+  uint32_t      x;
+  uint32_t      y;
+  uint32_t      nnbrs[2];
+  uint32_t     *nbrs[2];
+  uint32_t      xnnbrs;
+  uint32_t     *xnbrs;
+  uint8_t       mark[2];
+  graph_edge_t *edges;
+
+  if (_state.g != g) return _recalculate_pairs(g, edge);
+
+  edges   = NULL;
+  ends[0] = edge->u;
+  ends[1] = edge->v;
+  mark[0] = MARK_U;
+  mark[1] = MARK_V;
+
+  for (side = 0; side < 2; side++) {
+
+    nnbrs[side] = graph_num_neighbours(g, ends[side]);
+    nbrs [side] = graph_get_neighbours(g, ends[side]);
+    cost [side] = 0;
+
+    for (i = 0; i < nnbrs[side]; i++) {
+      _state.marks[nbrs[side][i]] |= mark[side];
+      cost[side] += graph_num_neighbours(g, nbrs[side][i]);
+    }
+  }
+
+  /*
+   * the edges between the neighbours of u and v are
+   * found from whichever side has fewer edges to visit
+   */
+  side = cost[1] < cost[0];
+
+  edges = malloc((nnbrs[0] + nnbrs[1] + cost[side] + 1) *
+                 sizeof(graph_edge_t));
+  if (edges == NULL) goto fail;
+
+  n = 0;
+
+  for (side = 0; side < 2; side++) {
+    for (i = 0; i < nnbrs[side]; i++, n++) {
+      edges[n].u = ends[side];
+      edges[n].v = nbrs[side][i];
+    }
+  }
+
+  side = cost[1] < cost[0];
+
+  for (i = 0; i < nnbrs[side]; i++) {
+
+    x      = nbrs[side][i];
+    xnnbrs = graph_num_neighbours(g, x);
+    xnbrs  = graph_get_neighbours(g, x);
+
+    for (j = 0; j < xnnbrs; j++) {
+
+      y = xnbrs[j];
+
+      if (!(_state.marks[y] & mark[1-side])) continue;
+
+      /*
+       * edges between two nodes which are both neighbours
+       * of u and of v are found twice - only keep one
+       */
+      if ((_state.marks[y] & mark[side]) &&
+          (_state.marks[x] & mark[1-side]) &&
+          y < x)
+        continue;
+
+      edges[n].u = x;
+      edges[n].v = y;
+      n++;
+    }
+  }
+
+  for (side = 0; side < 2; side++) {
+    for (i = 0; i < nnbrs[side]; i++) _state.marks[nbrs[side][i]] = 0;
+  }
+
+  if (stats_edge_pathsharing_list(g, edges, n, 0)) goto fail;
+
+  if (_push_edges(g, edges, n)) _state_free();
+
+  free(edges);
+  return 0;
+
+fail:
+  if (edges != NULL) free(edges);
+  return 1;
+}
+
+uint8_t _all_edges(graph_t *g, graph_edge_t **edges, uint64_t *nedges) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint32_t      nnodes;
+  uint32_t      nnbrs;
+  uint32_t     *nbrs;
+  graph_edge_t *list;
 
   nnodes = graph_num_nodes(g);
-  
-  for (i = 0; i < nnodes; i++) {
-    
+  list   = malloc((graph_num_edges(g) + 1) * sizeof(graph_edge_t));
+  if (list == NULL) goto fail;
+
+  for (i = 0, n = 0; i < nnodes; i++) {
+
     nnbrs = graph_num_neighbours(g, i);
     nbrs  = graph_get_neighbours(g, i);
 
@@ -32,14 +367,111 @@ uint8_t graph_init_pathsharing(graph_t *g) {
 
       if (i > nbrs[j]) continue;
 
-      stats_edge_pathsharing(g, i, nbrs[j]);
+      list[n].u = i;
+      list[n].v = nbrs[j];
+      n++;
     }
   }
 
+  *edges  = list;
+  *nedges = n;
   return 0;
+
+fail:
+  return 1;
 }
 
-uint8_t graph_remove_pathsharing(
+uint8_t _push_edges(graph_t *g, graph_edge_t *edges, uint64_t n) {
+
+  uint64_t     i;
+  graph_edge_t e;
+
+  if (_state.heap.size + n > HEAP_SLACK * (graph_num_edges(g) + 1))
+    return _rebuild(g);
+
+  for (i = 0; i < n; i++) {
+
+    if (!graph_are_neighbours(g, edges[i].u, edges[i].v)) continue;
+
+    /*entries are stored with u < v, as they are ordered by the scan*/
+    if (edges[i].u < edges[i].v) { e.u = edges[i].u; e.v = edges[i].v; }
+    else                         { e.u = edges[i].v; e.v = edges[i].u; }
+
+    if (stats_cache_check(
+          g, STATS_CACHE_EDGE_PATHSHARING, e.u, e.v, &(e.val)) != 1)
+      goto fail;
+
+    if (edge_heap_push(&_state.heap, &e)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _rebuild(graph_t *g) {
+
+  uint64_t      nedges;
+  graph_edge_t *edges;
+
+  edges = NULL;
+
+  edge_heap_clear(&_state.heap);
+
+  if (_all_edges(g, &edges, &nedges)) goto fail;
+  if (_push_edges(g, edges, nedges))  goto fail;
+
+  free(edges);
+  return 0;
+
+fail:
+  if (edges != NULL) free(edges);
+  return 1;
+}
+
+int8_t _heap_top_valid(graph_t *g) {
+
+  double        val;
+  graph_edge_t *top;
+
+  top = _state.heap.entries;
+
+  if (!graph_are_neighbours(g, top->u, top->v)) return 0;
+
+  if (stats_cache_check(
+        g, STATS_CACHE_EDGE_PATHSHARING, top->u, top->v, &val) != 1)
+    return -1;
+
+  return val == top->val;
+}
+
+int _compare_edges(const void *a, const void *b) {
+
+  const graph_edge_t *ea;
+  const graph_edge_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->u < eb->u) return -1;
+  if (ea->u > eb->u) return  1;
+  if (ea->v < eb->v) return -1;
+  if (ea->v > eb->v) return  1;
+  return 0;
+}
+
+void _state_free(void) {
+
+  if (_state.marks != NULL) free(_state.marks);
+
+  edge_heap_free(&_state.heap);
+
+  _state.g     = NULL;
+  _state.marks = NULL;
+}
+
+uint8_t _remove_scan(
   graph_t *g, double *share, array_t *edges, graph_edge_t *edge) {
 
   uint64_t     i;
@@ -60,7 +492,7 @@ uint8_t graph_remove_pathsharing(
     stats_cache_edge_pathsharing(g, i, share);
 
     for (j = 0; j < nnbrs; j++) {
-      
+
       if (i        > nbrs[j]) continue;
       if (share[j] > min)     continue;
 
@@ -77,40 +509,66 @@ uint8_t graph_remove_pathsharing(
   }
 
   /*randomly remove one of those edges*/
-  i = floor((edges->size) * ((double)random() / RAND_MAX));
+  i = rng_range(rng_default(), edges->size);
 
   if (array_get(edges, i, edge))              goto fail;
   if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
 
   return 0;
-  
+
 fail:
   return 1;
 }
 
-uint8_t graph_recalculate_pathsharing(graph_t *g, graph_edge_t *edge) {
+uint8_t _recalculate_pairs(graph_t *g, graph_edge_t *edge) {
 
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  unnbrs;
-  uint32_t *unbrs;
-  uint32_t  vnnbrs;
-  uint32_t *vnbrs;
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint32_t      unnbrs;
+  uint32_t     *unbrs;
+  uint32_t      vnnbrs;
+  uint32_t     *vnbrs;
+  graph_edge_t *edges;
 
   unnbrs = graph_num_neighbours(g, edge->u);
   unbrs  = graph_get_neighbours(g, edge->u);
   vnnbrs = graph_num_neighbours(g, edge->v);
   vnbrs  = graph_get_neighbours(g, edge->v);
 
-  for (i = 0; i < unnbrs; i++)
-    stats_edge_pathsharing(g, edge->u, unbrs[i]);
-  
-  for (i = 0; i < vnnbrs; i++) 
-    stats_edge_pathsharing(g, edge->v, vnbrs[i]);
-  
-  for (i = 0; i < unnbrs; i++)
-    for (j = 0; j < vnnbrs; j++)
-      stats_edge_pathsharing(g, unbrs[i],vnbrs[j]);
+  /*
+   * the edges of u and v, and any edges between
+   * their neighbours, are recalculated in parallel
+   */
+  n     = unnbrs + vnnbrs + (uint64_t)unnbrs * vnnbrs;
+  edges = malloc((n+1) * sizeof(graph_edge_t));
+  if (edges == NULL) goto fail;
 
+  n = 0;
+
+  for (i = 0; i < unnbrs; i++, n++) {
+    edges[n].u = edge->u;
+    edges[n].v = unbrs[i];
+  }
+
+  for (i = 0; i < vnnbrs; i++, n++) {
+    edges[n].u = edge->v;
+    edges[n].v = vnbrs[i];
+  }
+
+  for (i = 0; i < unnbrs; i++) {
+    for (j = 0; j < vnnbrs; j++, n++) {
+      edges[n].u = unbrs[i];
+      edges[n].v = vnbrs[j];
+    }
+  }
+
+  if (stats_edge_pathsharing_list(g, edges, n, 0)) goto fail;
+
+  free(edges);
   return 0;
+
+fail:
+  if (edges != NULL) free(edges);
+  return 1;
 }
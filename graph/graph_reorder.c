@@ -0,0 +1,448 @@
+/**
+ * Functions for renumbering the nodes of a graph. See
+ * graph/graph_reorder.h for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "graph/graph_reorder.h"
+
+/**
+ * Number of bits used for each coordinate in the Morton order.
+ */
+#define MORTON_BITS 21
+
+/**
+ * A node, and the key by which it is sorted.
+ */
+typedef struct _node_key {
+
+  uint64_t key; /**< sort key */
+  uint32_t id;  /**< node ID  */
+
+} node_key_t;
+
+/**
+ * A neighbour, and the weight of the edge to it.
+ */
+typedef struct _nbr_wt {
+
+  uint32_t nbr; /**< neighbour ID */
+  float    wt;  /**< edge weight  */
+
+} nbr_wt_t;
+
+/**
+ * Compares two node_key_t structs, by key, then by ID.
+ */
+static int _compare_keys(const void *a, const void *b);
+
+/**
+ * Compares two nbr_wt_t structs, by neighbour ID.
+ */
+static int _compare_nbrs(const void *a, const void *b);
+
+/**
+ * Sorts the nodes by the given keys, and stores the sorted IDs in perm.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _sort_keys(
+  node_key_t *keys,   /**< key for each node, in node order */
+  uint32_t    nnodes, /**< number of nodes                  */
+  uint32_t   *perm    /**< place to store the ordering      */
+);
+
+/**
+ * Calculates the reverse Cuthill-McKee ordering of the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _order_rcm(
+  graph_t  *g,   /**< the graph                   */
+  uint32_t *perm /**< place to store the ordering */
+);
+
+/**
+ * Calculates the descending degree ordering of the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _order_degree(
+  graph_t  *g,   /**< the graph                   */
+  uint32_t *perm /**< place to store the ordering */
+);
+
+/**
+ * Calculates the Morton ordering of the node coordinates of the given
+ * graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _order_spatial(
+  graph_t  *g,   /**< the graph                   */
+  uint32_t *perm /**< place to store the ordering */
+);
+
+/**
+ * \return the given value with two 0 bits inserted between each of its
+ * lowest MORTON_BITS bits.
+ */
+static uint64_t _spread(
+  uint64_t x /**< value to spread */
+);
+
+uint8_t graph_order(graph_t *g, graph_order_t order, uint32_t *perm) {
+
+  switch (order) {
+    case GRAPH_ORDER_RCM:     return _order_rcm(    g, perm);
+    case GRAPH_ORDER_DEGREE:  return _order_degree( g, perm);
+    case GRAPH_ORDER_SPATIAL: return _order_spatial(g, perm);
+  }
+
+  return 1;
+}
+
+uint8_t graph_reorder(graph_t *gin, graph_t *gout, uint32_t *perm) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nnodes;
+  uint32_t        nnbrs;
+  uint32_t        maxnbrs;
+  uint32_t       *nbrs;
+  float          *wts;
+  uint32_t       *inv;
+  nbr_wt_t       *nw;
+  uint32_t       *newnbrs;
+  double         *newwts;
+  uint8_t         created;
+  graph_builder_t builder;
+
+  inv     = NULL;
+  nw      = NULL;
+  newnbrs = NULL;
+  newwts  = NULL;
+  created = 0;
+  nnodes  = graph_num_nodes(gin);
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  inv = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  if (inv == NULL) goto fail;
+
+  /*inv[u] is the new ID of original node u*/
+  for (i = 0; i < nnodes; i++) inv[i] = 0xFFFFFFFF;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (perm[i] >= nnodes)          goto fail;
+    if (inv[perm[i]] != 0xFFFFFFFF) goto fail;
+
+    inv[perm[i]] = i;
+  }
+
+  maxnbrs = 1;
+  for (i = 0; i < nnodes; i++) {
+    nnbrs = graph_num_neighbours(gin, i);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  nw      = malloc(maxnbrs * sizeof(nbr_wt_t));
+  newnbrs = malloc(maxnbrs * sizeof(uint32_t));
+  newwts  = malloc(maxnbrs * sizeof(double));
+  if (nw      == NULL) goto fail;
+  if (newnbrs == NULL) goto fail;
+  if (newwts  == NULL) goto fail;
+
+  if (graph_create(gout, nnodes, graph_is_directed(gin))) goto fail;
+  created = 1;
+
+  if (graph_builder_init(&builder, gout, 1)) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (graph_copy_nodelabel(gin, perm[i], gout, i)) goto fail;
+
+    nnbrs = graph_num_neighbours(gin, perm[i]);
+    nbrs  = graph_get_neighbours(gin, perm[i]);
+    wts   = graph_get_weights(   gin, perm[i]);
+
+    for (j = 0; j < nnbrs; j++) {
+      nw[j].nbr = inv[nbrs[j]];
+      nw[j].wt  = wts[j];
+    }
+
+    qsort(nw, nnbrs, sizeof(nbr_wt_t), _compare_nbrs);
+
+    for (j = 0; j < nnbrs; j++) {
+      newnbrs[j] = nw[j].nbr;
+      newwts[ j] = nw[j].wt;
+    }
+
+    if (graph_builder_set_neighbours(&builder, i, nnbrs, newnbrs, newwts))
+      goto fail;
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(inv);
+  free(nw);
+  free(newnbrs);
+  free(newwts);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  if (inv     != NULL) free(inv);
+  if (nw      != NULL) free(nw);
+  if (newnbrs != NULL) free(newnbrs);
+  if (newwts  != NULL) free(newwts);
+  if (created)         graph_free(gout);
+  return 1;
+}
+
+int _compare_keys(const void *a, const void *b) {
+
+  const node_key_t *ka;
+  const node_key_t *kb;
+
+  ka = a;
+  kb = b;
+
+  if (ka->key < kb->key) return -1;
+  if (ka->key > kb->key) return  1;
+  if (ka->id  < kb->id)  return -1;
+  if (ka->id  > kb->id)  return  1;
+  return 0;
+}
+
+int _compare_nbrs(const void *a, const void *b) {
+
+  const nbr_wt_t *na;
+  const nbr_wt_t *nb;
+
+  na = a;
+  nb = b;
+
+  if (na->nbr < nb->nbr) return -1;
+  if (na->nbr > nb->nbr) return  1;
+  return 0;
+}
+
+uint8_t _sort_keys(node_key_t *keys, uint32_t nnodes, uint32_t *perm) {
+
+  uint64_t i;
+
+  qsort(keys, nnodes, sizeof(node_key_t), _compare_keys);
+
+  for (i = 0; i < nnodes; i++) perm[i] = keys[i].id;
+
+  return 0;
+}
+
+uint8_t _order_rcm(graph_t *g, uint32_t *perm) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint64_t    s;
+  uint64_t    head;
+  uint64_t    tail;
+  uint64_t    nnew;
+  uint32_t    nnodes;
+  uint32_t    nnbrs;
+  uint32_t    u;
+  uint32_t    tmp;
+  uint32_t   *nbrs;
+  uint8_t    *visited;
+  node_key_t *starts;
+  node_key_t *level;
+
+  visited = NULL;
+  starts  = NULL;
+  level   = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  visited = calloc(nnodes + 1, sizeof(uint8_t));
+  starts  = malloc(((uint64_t)nnodes + 1) * sizeof(node_key_t));
+  level   = malloc(((uint64_t)nnodes + 1) * sizeof(node_key_t));
+
+  if (visited == NULL) goto fail;
+  if (starts  == NULL) goto fail;
+  if (level   == NULL) goto fail;
+
+  /*each component is searched from its lowest degree node*/
+  for (i = 0; i < nnodes; i++) {
+    starts[i].key = graph_num_neighbours(g, i);
+    starts[i].id  = i;
+  }
+
+  qsort(starts, nnodes, sizeof(node_key_t), _compare_keys);
+
+  /*
+   * perm is used as the search queue - the neighbours
+   * of each node are appended in ascending order of
+   * degree
+   */
+  for (s = 0, tail = 0; s < nnodes; s++) {
+
+    if (visited[starts[s].id]) continue;
+
+    u            = starts[s].id;
+    head         = tail;
+    perm[tail++] = u;
+    visited[u]   = 1;
+
+    while (head < tail) {
+
+      u     = perm[head++];
+      nnbrs = graph_num_neighbours(g, u);
+      nbrs  = graph_get_neighbours(g, u);
+
+      for (j = 0, nnew = 0; j < nnbrs; j++) {
+
+        if (visited[nbrs[j]]) continue;
+
+        visited[nbrs[j]] = 1;
+        level[nnew].key  = graph_num_neighbours(g, nbrs[j]);
+        level[nnew].id   = nbrs[j];
+        nnew++;
+      }
+
+      qsort(level, nnew, sizeof(node_key_t), _compare_keys);
+
+      for (j = 0; j < nnew; j++) perm[tail++] = level[j].id;
+    }
+  }
+
+  /*the Cuthill-McKee ordering is reversed*/
+  for (i = 0; i < nnodes / 2; i++) {
+    tmp                  = perm[i];
+    perm[i]              = perm[nnodes - i - 1];
+    perm[nnodes - i - 1] = tmp;
+  }
+
+  free(visited);
+  free(starts);
+  free(level);
+  return 0;
+
+fail:
+  if (visited != NULL) free(visited);
+  if (starts  != NULL) free(starts);
+  if (level   != NULL) free(level);
+  return 1;
+}
+
+uint8_t _order_degree(graph_t *g, uint32_t *perm) {
+
+  uint64_t    i;
+  uint32_t    nnodes;
+  node_key_t *keys;
+
+  nnodes = graph_num_nodes(g);
+  keys   = malloc(((uint64_t)nnodes + 1) * sizeof(node_key_t));
+
+  if (keys == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    keys[i].key = UINT32_MAX - graph_num_neighbours(g, i);
+    keys[i].id  = i;
+  }
+
+  _sort_keys(keys, nnodes, perm);
+
+  free(keys);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _order_spatial(graph_t *g, uint32_t *perm) {
+
+  uint64_t       i;
+  uint64_t       d;
+  uint32_t       nnodes;
+  uint64_t       q;
+  double         c;
+  double         lo[3];
+  double         hi[3];
+  double         xyz[3];
+  graph_label_t *lbl;
+  node_key_t    *keys;
+
+  nnodes = graph_num_nodes(g);
+  keys   = malloc(((uint64_t)nnodes + 1) * sizeof(node_key_t));
+
+  if (keys == NULL) goto fail;
+
+  for (d = 0; d < 3; d++) {
+    lo[d] =  INFINITY;
+    hi[d] = -INFINITY;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl    = graph_get_nodelabel(g, i);
+    xyz[0] = lbl->xval;
+    xyz[1] = lbl->yval;
+    xyz[2] = lbl->zval;
+
+    for (d = 0; d < 3; d++) {
+      if (xyz[d] < lo[d]) lo[d] = xyz[d];
+      if (xyz[d] > hi[d]) hi[d] = xyz[d];
+    }
+  }
+
+  /*coordinates are scaled to MORTON_BITS bits, and interleaved*/
+  for (i = 0; i < nnodes; i++) {
+
+    lbl    = graph_get_nodelabel(g, i);
+    xyz[0] = lbl->xval;
+    xyz[1] = lbl->yval;
+    xyz[2] = lbl->zval;
+
+    keys[i].key = 0;
+    keys[i].id  = i;
+
+    for (d = 0; d < 3; d++) {
+
+      if (hi[d] > lo[d]) c = (xyz[d] - lo[d]) / (hi[d] - lo[d]);
+      else               c = 0;
+
+      if (!(c >= 0)) c = 0;
+      if (  c >  1)  c = 1;
+
+      q            = c * ((1ULL << MORTON_BITS) - 1);
+      keys[i].key |= _spread(q) << d;
+    }
+  }
+
+  _sort_keys(keys, nnodes, perm);
+
+  free(keys);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint64_t _spread(uint64_t x) {
+
+  x &= (1ULL << MORTON_BITS) - 1;
+
+  x = (x | (x << 32)) & 0x1F00000000FFFFULL;
+  x = (x | (x << 16)) & 0x1F0000FF0000FFULL;
+  x = (x | (x <<  8)) & 0x100F00F00F00F00FULL;
+  x = (x | (x <<  4)) & 0x10C30C30C30C30C3ULL;
+  x = (x | (x <<  2)) & 0x1249249249249249ULL;
+
+  return x;
+}
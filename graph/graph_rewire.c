@@ -0,0 +1,300 @@
+/**
+ * Degree-preserving randomisation of undirected graphs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "graph/graph_rewire.h"
+#include "util/rng.h"
+
+/**
+ * Marks an empty slot in an edge set. No edge has this key, as the low
+ * end point of an edge is always less than its high end point.
+ */
+#define EDGE_SET_EMPTY UINT64_MAX
+
+/**
+ * A set of undirected edges - an open addressing hash table with linear
+ * probing. Removals shift the following entries back, rather than leaving
+ * tombstones, so that a table which has many edges removed and added does
+ * not fill up.
+ */
+typedef struct _edge_set {
+
+  uint64_t *keys; /**< the table                    */
+  uint64_t  mask; /**< table size - 1 (a power of 2) */
+
+} edge_set_t;
+
+/**
+ * \return the key of the given edge.
+ */
+static uint64_t _edge_key(
+  uint32_t u, /**< edge end point       */
+  uint32_t v  /**< other edge end point */
+);
+
+/**
+ * \return the table slot in which a search for the given key starts.
+ */
+static uint64_t _edge_slot(
+  edge_set_t *set, /**< the edge set */
+  uint64_t    key  /**< edge key     */
+);
+
+/**
+ * Allocates an edge set with space for the given number of edges.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _edge_set_init(
+  edge_set_t *set,   /**< the set to initialise */
+  uint64_t    nedges /**< number of edges       */
+);
+
+/**
+ * \return non-0 if the given edge is in the set, 0 otherwise.
+ */
+static uint8_t _edge_set_contains(
+  edge_set_t *set, /**< the edge set         */
+  uint32_t    u,   /**< edge end point       */
+  uint32_t    v    /**< other edge end point */
+);
+
+/**
+ * Adds the given edge to the set. The set must have room for it, and the
+ * edge must not already be in the set.
+ */
+static void _edge_set_add(
+  edge_set_t *set, /**< the edge set         */
+  uint32_t    u,   /**< edge end point       */
+  uint32_t    v    /**< other edge end point */
+);
+
+/**
+ * Removes the given edge from the set; it must be in the set.
+ */
+static void _edge_set_remove(
+  edge_set_t *set, /**< the edge set         */
+  uint32_t    u,   /**< edge end point       */
+  uint32_t    v    /**< other edge end point */
+);
+
+uint8_t graph_rewire(graph_t *g, graph_t *ref, uint64_t nswaps, rng_t *rng) {
+
+  uint64_t         i;
+  uint64_t         j;
+  uint64_t         k;
+  uint64_t         nedges;
+  uint32_t         nnodes;
+  uint32_t         nnbrs;
+  uint32_t        *nbrs;
+  float           *wts;
+  uint32_t        *edges;
+  float           *ewts;
+  uint32_t         a;
+  uint32_t         b;
+  uint32_t         c;
+  uint32_t         d;
+  uint32_t         tmp;
+  edge_set_t       set;
+  graph_builder_t  builder;
+
+  edges    = NULL;
+  ewts     = NULL;
+  set.keys = NULL;
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (graph_is_directed(g)) goto fail;
+
+  nnodes = graph_num_nodes(g);
+  nedges = graph_num_edges(g);
+
+  edges = malloc(2 * nedges * sizeof(uint32_t));
+  ewts  = malloc(    nedges * sizeof(float));
+
+  if (edges == NULL)                 goto fail;
+  if (ewts  == NULL)                 goto fail;
+  if (_edge_set_init(&set, nedges))  goto fail;
+
+  for (i = 0, k = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] < i) continue;
+
+      edges[2*k]   = i;
+      edges[2*k+1] = nbrs[j];
+      ewts[k]      = wts[j];
+      _edge_set_add(&set, i, nbrs[j]);
+      k++;
+    }
+  }
+
+  /*
+   * edges (a, b) and (c, d) are rewired to (a, d) and
+   * (c, b), as long as this does not create a self
+   * loop or a duplicate edge
+   */
+  for (k = 0; nedges > 1 && k < nswaps; k++) {
+
+    i = rng_range(rng, nedges);
+    j = rng_range(rng, nedges);
+
+    if (i == j) continue;
+
+    a = edges[2*i];
+    b = edges[2*i+1];
+    c = edges[2*j];
+    d = edges[2*j+1];
+
+    if (rng_range(rng, 2)) {
+      tmp = c;
+      c   = d;
+      d   = tmp;
+    }
+
+    if (a == d || c == b || a == c || b == d) continue;
+    if (_edge_set_contains(&set, a, d))       continue;
+    if (_edge_set_contains(&set, c, b))       continue;
+
+    _edge_set_remove(&set, a, b);
+    _edge_set_remove(&set, c, d);
+    _edge_set_add(   &set, a, d);
+    _edge_set_add(   &set, c, b);
+
+    edges[2*i+1] = d;
+    edges[2*j]   = c;
+    edges[2*j+1] = b;
+    ewts[i]      = 1;
+    ewts[j]      = 1;
+  }
+
+  free(set.keys);
+  set.keys = NULL;
+
+  if (graph_create(ref, nnodes, 0))              goto fail;
+  if (graph_builder_init(&builder, ref, nedges)) goto fail;
+
+  for (k = 0; k < nedges; k++) {
+    if (graph_builder_add(&builder, edges[2*k], edges[2*k+1], ewts[k]))
+      goto fail;
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(edges);
+  free(ewts);
+  return 0;
+
+fail:
+  if (edges    != NULL) free(edges);
+  if (ewts     != NULL) free(ewts);
+  if (set.keys != NULL) free(set.keys);
+  graph_builder_free(&builder);
+  return 1;
+}
+
+uint64_t _edge_key(uint32_t u, uint32_t v) {
+
+  if (u > v) return ((uint64_t)v << 32) | u;
+  else       return ((uint64_t)u << 32) | v;
+}
+
+uint64_t _edge_slot(edge_set_t *set, uint64_t key) {
+
+  /* fibonacci hashing, to spread sequential keys */
+  return ((key * 0x9E3779B97F4A7C15ULL) >> 17) & set->mask;
+}
+
+uint8_t _edge_set_init(edge_set_t *set, uint64_t nedges) {
+
+  uint64_t size;
+
+  /* keep the table at most half full */
+  size = 16;
+  while (size < 2 * nedges) size <<= 1;
+
+  set->mask = size - 1;
+  set->keys = malloc(size * sizeof(uint64_t));
+
+  if (set->keys == NULL) return 1;
+
+  memset(set->keys, 0xFF, size * sizeof(uint64_t));
+  return 0;
+}
+
+uint8_t _edge_set_contains(edge_set_t *set, uint32_t u, uint32_t v) {
+
+  uint64_t key;
+  uint64_t i;
+
+  key = _edge_key(u, v);
+  i   = _edge_slot(set, key);
+
+  while (set->keys[i] != EDGE_SET_EMPTY) {
+    if (set->keys[i] == key) return 1;
+    i = (i + 1) & set->mask;
+  }
+
+  return 0;
+}
+
+void _edge_set_add(edge_set_t *set, uint32_t u, uint32_t v) {
+
+  uint64_t key;
+  uint64_t i;
+
+  key = _edge_key(u, v);
+  i   = _edge_slot(set, key);
+
+  while (set->keys[i] != EDGE_SET_EMPTY) i = (i + 1) & set->mask;
+
+  set->keys[i] = key;
+}
+
+void _edge_set_remove(edge_set_t *set, uint32_t u, uint32_t v) {
+
+  uint64_t key;
+  uint64_t i;
+  uint64_t j;
+  uint64_t home;
+
+  key = _edge_key(u, v);
+  i   = _edge_slot(set, key);
+
+  while (set->keys[i] != key) i = (i + 1) & set->mask;
+
+  /*
+   * Shift back any following entries which would
+   * no longer be found once slot i is emptied -
+   * those whose home slot is not cyclically
+   * within (i, j].
+   */
+  j = i;
+  while (1) {
+
+    j = (j + 1) & set->mask;
+
+    if (set->keys[j] == EDGE_SET_EMPTY) break;
+
+    home = _edge_slot(set, set->keys[j]);
+
+    if (((j - home) & set->mask) < ((j - i) & set->mask)) continue;
+
+    set->keys[i] = set->keys[j];
+    i            = j;
+  }
+
+  set->keys[i] = EDGE_SET_EMPTY;
+}
@@ -0,0 +1,39 @@
+/**
+ * Degree-preserving randomisation of undirected graphs.
+ *
+ * graph_rewire repeatedly picks two edges (a, b) and (c, d) uniformly at
+ * random, and rewires them to (a, d) and (c, b), unless this would create a
+ * self loop or a duplicate edge (Maslov & Sneppen, 2002). Every node keeps
+ * its degree. The swaps are performed on a flat edge list, so that an edge
+ * may be sampled in constant time, against a hash set of the edges, so
+ * that duplicates may be detected in constant time; the graph is only built
+ * once, after all of the swaps have been made.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_REWIRE_H__
+#define __GRAPH_REWIRE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "util/rng.h"
+
+/**
+ * Creates a degree-preserving randomisation of the given undirected graph,
+ * by attempting the given number of edge swaps. Edges which have not been
+ * swapped keep their weights; swapped edges are given a weight of 1. Node
+ * labels are not copied. The result depends only on the graph and on the
+ * state of the random number generator.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t graph_rewire(
+  graph_t  *g,      /**< the graph                              */
+  graph_t  *ref,    /**< uninitialised graph to create          */
+  uint64_t  nswaps, /**< number of swaps to attempt             */
+  rng_t    *rng     /**< random number generator                */
+);
+
+#endif /* __GRAPH_REWIRE_H__ */
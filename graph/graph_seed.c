@@ -52,7 +52,7 @@ uint8_t graph_seed(
 
   for (i = 0; i < nseeds; i++) ctx.nodemask[seeds[i]] = 1;
 
-  if (bfs(gin, seeds, nseeds, NULL, &ctx, NULL, _bfs_cb, NULL)) goto fail;
+  if (bfs_hybrid(gin, seeds, nseeds, NULL, &ctx, _bfs_cb)) goto fail;
 
   if (graph_mask(gin, gout, ctx.nodemask)) goto fail;
 
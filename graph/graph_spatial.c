@@ -0,0 +1,525 @@
+/**
+ * A spatial index over node coordinates. See graph/graph_spatial.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_spatial.h"
+#include "util/array.h"
+#include "util/compare.h"
+
+/**
+ * Maximum number of grid cells per indexed node. The cell size is chosen
+ * to give roughly one node per cell, but is increased if the rounding of
+ * the number of cells along each axis would give many more cells than
+ * this.
+ */
+#define SPATIAL_MAX_CELLS_PER_NODE 4
+
+/**
+ * The spatial index of a graph.
+ */
+typedef struct _spatial {
+
+  uint32_t  npts;    /**< number of indexed nodes                       */
+  double    lo[3];   /**< lowest coordinates of the indexed nodes       */
+  double    size[3]; /**< cell size along each axis                     */
+  uint32_t  dims[3]; /**< number of cells along each axis               */
+  uint64_t *cells;   /**< start of each cell in nodes/pts, with an extra
+                          entry equal to npts                           */
+  uint32_t *nodes;   /**< node IDs, cell by cell                        */
+  float    *pts;     /**< x, y and z coordinates of each entry in nodes */
+
+} spatial_t;
+
+/**
+ * \return the spatial index of the given graph, creating it if necessary,
+ * or NULL on failure.
+ */
+static spatial_t *_get_spatial(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Frees the given spatial index - passed to the graph as its ctx_free
+ * function.
+ */
+static void _spatial_free(
+  void *vs /**< pointer to a spatial_t struct */
+);
+
+/**
+ * \return non-0 if all of the coordinates of the given node label are
+ * finite.
+ */
+static uint8_t _finite(
+  graph_label_t *lbl /**< the node label */
+);
+
+/**
+ * \return the cell, along the given axis, which contains the given
+ * coordinate. Coordinates outside of the grid are clamped to it.
+ */
+static uint32_t _cell(
+  spatial_t *s,    /**< the index      */
+  uint8_t    axis, /**< the axis       */
+  double     x     /**< the coordinate */
+);
+
+/**
+ * \return the index of the given cell.
+ */
+static uint64_t _cell_idx(
+  spatial_t *s, /**< the index        */
+  uint32_t   x, /**< x cell           */
+  uint32_t   y, /**< y cell           */
+  uint32_t   z  /**< z cell           */
+);
+
+/**
+ * \return the squared distance between the given point, and entry i of
+ * the index.
+ */
+static double _dist2(
+  spatial_t *s,     /**< the index  */
+  uint64_t   i,     /**< the entry  */
+  float     *point  /**< the point  */
+);
+
+uint8_t graph_spatial_init(graph_t *g) {
+
+  uint64_t       i;
+  uint64_t       c;
+  uint8_t        d;
+  uint8_t        ndims;
+  uint32_t       nnodes;
+  double         hi[3];
+  double         ext[3];
+  double         vol;
+  double         side;
+  double         ncells;
+  float          xyz[3];
+  graph_label_t *lbl;
+  spatial_t     *s;
+
+  if (g->ctx[_GRAPH_SPATIAL_CTX_LOC_] != NULL) return 0;
+
+  s = calloc(1, sizeof(spatial_t));
+  if (s == NULL) goto fail;
+
+  nnodes = graph_num_nodes(g);
+
+  for (d = 0; d < 3; d++) {
+    s->lo[d] =  DBL_MAX;
+    hi[d]    = -DBL_MAX;
+  }
+
+  /*find the bounding box of the indexed nodes*/
+  for (i = 0; i < nnodes; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+
+    if (!_finite(lbl)) continue;
+
+    xyz[0] = lbl->xval;
+    xyz[1] = lbl->yval;
+    xyz[2] = lbl->zval;
+
+    for (d = 0; d < 3; d++) {
+      if (xyz[d] < s->lo[d]) s->lo[d] = xyz[d];
+      if (xyz[d] > hi[d])    hi[d]    = xyz[d];
+    }
+
+    s->npts++;
+  }
+
+  /*
+   * the cell size is chosen to give one node per cell,
+   * over the axes along which the nodes are spread
+   */
+  ndims = 0;
+  vol   = 1;
+
+  for (d = 0; d < 3; d++) {
+
+    if (s->npts == 0) {
+      s->lo[d] = 0;
+      hi[d]    = 0;
+    }
+
+    ext[d] = hi[d] - s->lo[d];
+
+    if (ext[d] > 0) {
+      vol *= ext[d];
+      ndims++;
+    }
+  }
+
+  side = (ndims > 0) ? pow(vol / s->npts, 1.0 / ndims) : 1;
+
+  while (1) {
+
+    for (d = 0, ncells = 1; d < 3; d++) {
+      ncells *= (ext[d] > 0) ? floor(ext[d] / side) + 1 : 1;
+    }
+
+    if (ncells <= (double)SPATIAL_MAX_CELLS_PER_NODE * s->npts + 1) break;
+
+    side *= 1.5;
+  }
+
+  for (d = 0; d < 3; d++) {
+
+    if (ext[d] > 0) {
+      s->dims[d] = floor(ext[d] / side) + 1;
+      s->size[d] = side;
+    }
+    else {
+      s->dims[d] = 1;
+      s->size[d] = 1;
+    }
+  }
+
+  ncells   = (double)s->dims[0] * s->dims[1] * s->dims[2];
+  s->cells = calloc((uint64_t)ncells + 2, sizeof(uint64_t));
+  s->nodes = malloc(((uint64_t)s->npts + 1) * sizeof(uint32_t));
+  s->pts   = malloc(((uint64_t)s->npts + 1) * 3 * sizeof(float));
+
+  if (s->cells == NULL) goto fail;
+  if (s->nodes == NULL) goto fail;
+  if (s->pts   == NULL) goto fail;
+
+  /*
+   * count the nodes in each cell (at cells[c+2]), so that
+   * after a cumulative sum, cells[c+1] is the start of
+   * cell c, and is moved to the start of cell c+1 as the
+   * nodes are added, in order of ID
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+
+    if (!_finite(lbl)) continue;
+
+    c = _cell_idx(s,
+                  _cell(s, 0, lbl->xval),
+                  _cell(s, 1, lbl->yval),
+                  _cell(s, 2, lbl->zval));
+    s->cells[c + 2]++;
+  }
+
+  for (c = 0; c < (uint64_t)ncells; c++) s->cells[c + 2] += s->cells[c + 1];
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+
+    if (!_finite(lbl)) continue;
+
+    c = _cell_idx(s,
+                  _cell(s, 0, lbl->xval),
+                  _cell(s, 1, lbl->yval),
+                  _cell(s, 2, lbl->zval));
+    c = s->cells[c + 1]++;
+
+    s->nodes[c]       = i;
+    s->pts  [c*3]     = lbl->xval;
+    s->pts  [c*3 + 1] = lbl->yval;
+    s->pts  [c*3 + 2] = lbl->zval;
+  }
+
+  g->ctx[     _GRAPH_SPATIAL_CTX_LOC_] = s;
+  g->ctx_free[_GRAPH_SPATIAL_CTX_LOC_] = _spatial_free;
+
+  return 0;
+
+fail:
+  if (s != NULL) _spatial_free(s);
+  return 1;
+}
+
+void graph_spatial_free(graph_t *g) {
+
+  if (g->ctx[_GRAPH_SPATIAL_CTX_LOC_] == NULL) return;
+
+  _spatial_free(g->ctx[_GRAPH_SPATIAL_CTX_LOC_]);
+
+  g->ctx[     _GRAPH_SPATIAL_CTX_LOC_] = NULL;
+  g->ctx_free[_GRAPH_SPATIAL_CTX_LOC_] = NULL;
+}
+
+uint8_t graph_spatial_box(
+  graph_t *g, float *lo, float *hi, array_t *nodes) {
+
+  uint64_t   i;
+  uint64_t   c;
+  uint64_t   start;
+  uint32_t   x;
+  uint32_t   y;
+  uint32_t   z;
+  uint8_t    d;
+  uint32_t   clo[3];
+  uint32_t   chi[3];
+  float     *p;
+  spatial_t *s;
+
+  s = _get_spatial(g);
+  if (s == NULL) goto fail;
+
+  start = nodes->size;
+
+  for (d = 0; d < 3; d++) {
+
+    if (!(lo[d] <= hi[d])) return 0;
+
+    clo[d] = _cell(s, d, lo[d]);
+    chi[d] = _cell(s, d, hi[d]);
+  }
+
+  for (z = clo[2]; z <= chi[2]; z++) {
+    for (y = clo[1]; y <= chi[1]; y++) {
+      for (x = clo[0]; x <= chi[0]; x++) {
+
+        c = _cell_idx(s, x, y, z);
+
+        for (i = s->cells[c]; i < s->cells[c + 1]; i++) {
+
+          p = s->pts + i*3;
+
+          if (p[0] < lo[0] || p[0] > hi[0]) continue;
+          if (p[1] < lo[1] || p[1] > hi[1]) continue;
+          if (p[2] < lo[2] || p[2] > hi[2]) continue;
+
+          if (array_append(nodes, s->nodes + i)) goto fail;
+        }
+      }
+    }
+  }
+
+  qsort((uint32_t *)nodes->data + start,
+        nodes->size - start,
+        sizeof(uint32_t),
+        compare_u32);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_spatial_radius(
+  graph_t *g, float *centre, double radius, array_t *nodes) {
+
+  uint64_t   i;
+  uint64_t   c;
+  uint64_t   start;
+  uint32_t   x;
+  uint32_t   y;
+  uint32_t   z;
+  uint8_t    d;
+  uint32_t   clo[3];
+  uint32_t   chi[3];
+  double     r2;
+  spatial_t *s;
+
+  s = _get_spatial(g);
+  if (s == NULL) goto fail;
+
+  if (!(radius >= 0)) return 0;
+
+  start = nodes->size;
+  r2    = radius * radius;
+
+  for (d = 0; d < 3; d++) {
+    clo[d] = _cell(s, d, centre[d] - radius);
+    chi[d] = _cell(s, d, centre[d] + radius);
+  }
+
+  for (z = clo[2]; z <= chi[2]; z++) {
+    for (y = clo[1]; y <= chi[1]; y++) {
+      for (x = clo[0]; x <= chi[0]; x++) {
+
+        c = _cell_idx(s, x, y, z);
+
+        for (i = s->cells[c]; i < s->cells[c + 1]; i++) {
+
+          if (!(_dist2(s, i, centre) <= r2)) continue;
+
+          if (array_append(nodes, s->nodes + i)) goto fail;
+        }
+      }
+    }
+  }
+
+  qsort((uint32_t *)nodes->data + start,
+        nodes->size - start,
+        sizeof(uint32_t),
+        compare_u32);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t graph_spatial_nearest(
+  graph_t *g, float *point, uint32_t *node, double *dist) {
+
+  uint64_t   i;
+  uint64_t   c;
+  int64_t    x;
+  int64_t    y;
+  int64_t    z;
+  int64_t    r;
+  int64_t    maxr;
+  int64_t    step;
+  uint8_t    d;
+  uint8_t    found;
+  int64_t    pc[3];
+  double     d2;
+  double     best;
+  double     minsize;
+  double     bound;
+  uint32_t   bestn;
+  spatial_t *s;
+
+  s = _get_spatial(g);
+  if (s == NULL)    goto fail;
+  if (s->npts == 0) goto fail;
+
+  found   = 0;
+  best    = INFINITY;
+  bestn   = 0;
+  maxr    = 0;
+  minsize = INFINITY;
+
+  for (d = 0; d < 3; d++) {
+
+    pc[d] = _cell(s, d, point[d]);
+
+    if (pc[d]                  > maxr) maxr = pc[d];
+    if (s->dims[d] - 1 - pc[d] > maxr) maxr = s->dims[d] - 1 - pc[d];
+
+    if (s->dims[d] > 1 && s->size[d] < minsize) minsize = s->size[d];
+  }
+
+  /*
+   * search the cells in shells of increasing (Chebyshev)
+   * distance r from the cell which contains the point
+   */
+  for (r = 0; r <= maxr; r++) {
+
+    for (z = pc[2] - r; z <= pc[2] + r; z++) {
+      if (z < 0 || z >= s->dims[2]) continue;
+
+      for (y = pc[1] - r; y <= pc[1] + r; y++) {
+        if (y < 0 || y >= s->dims[1]) continue;
+
+        /*away from the faces of the shell, only its ends are on it*/
+        if (llabs(z - pc[2]) < r && llabs(y - pc[1]) < r) step = 2*r;
+        else                                              step = 1;
+
+        for (x = pc[0] - r; x <= pc[0] + r; x += step) {
+          if (x < 0 || x >= s->dims[0]) continue;
+
+          c = _cell_idx(s, x, y, z);
+
+          for (i = s->cells[c]; i < s->cells[c + 1]; i++) {
+
+            d2 = _dist2(s, i, point);
+
+            if (d2 < best || (d2 == best && s->nodes[i] < bestn)) {
+              best  = d2;
+              bestn = s->nodes[i];
+              found = 1;
+            }
+          }
+        }
+      }
+    }
+
+    /*
+     * any node in a cell beyond this shell is at least r
+     * cells away along some axis; one cell is allowed
+     * for rounding in the cell calculation
+     */
+    if (found && r > 0 && minsize < INFINITY) {
+
+      bound = (r - 1) * minsize;
+
+      if (best < bound * bound) break;
+    }
+  }
+
+  if (!found) goto fail;
+
+  *node = bestn;
+  if (dist != NULL) *dist = sqrt(best);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+spatial_t *_get_spatial(graph_t *g) {
+
+  if (graph_spatial_init(g)) return NULL;
+
+  return g->ctx[_GRAPH_SPATIAL_CTX_LOC_];
+}
+
+void _spatial_free(void *vs) {
+
+  spatial_t *s;
+
+  s = vs;
+
+  if (s->cells != NULL) free(s->cells);
+  if (s->nodes != NULL) free(s->nodes);
+  if (s->pts   != NULL) free(s->pts);
+
+  free(s);
+}
+
+uint8_t _finite(graph_label_t *lbl) {
+
+  return isfinite(lbl->xval) && isfinite(lbl->yval) && isfinite(lbl->zval);
+}
+
+uint32_t _cell(spatial_t *s, uint8_t axis, double x) {
+
+  double v;
+
+  v = (x - s->lo[axis]) / s->size[axis];
+
+  if (!(v > 0))           return 0;
+  if (v >= s->dims[axis]) return s->dims[axis] - 1;
+
+  return (uint32_t)v;
+}
+
+uint64_t _cell_idx(spatial_t *s, uint32_t x, uint32_t y, uint32_t z) {
+
+  return ((uint64_t)z * s->dims[1] + y) * s->dims[0] + x;
+}
+
+double _dist2(spatial_t *s, uint64_t i, float *point) {
+
+  double dx;
+  double dy;
+  double dz;
+
+  dx = (double)s->pts[i*3]     - point[0];
+  dy = (double)s->pts[i*3 + 1] - point[1];
+  dz = (double)s->pts[i*3 + 2] - point[2];
+
+  return dx*dx + dy*dy + dz*dz;
+}
@@ -0,0 +1,93 @@
+/**
+ * A spatial index over node coordinates, for finding the nodes within a
+ * box or a radius, or the node nearest to a point, without scanning every
+ * node label.
+ *
+ * The index is a uniform grid over the bounding box of the node
+ * coordinates, with roughly one node per cell. Nodes are stored cell by
+ * cell, in ascending order of ID within each cell, along with their
+ * coordinates. A query only examines the cells which overlap with its
+ * region.
+ *
+ * The index is created the first time that it is needed, and is attached
+ * to the graph (via the graph ctx fields), so it is reused by later
+ * queries, and freed along with the graph. It is discarded when a node
+ * label is changed with graph_set_nodelabel; if node coordinates are
+ * changed in any other way, graph_spatial_free must be called. Nodes
+ * with a coordinate which is not finite are not indexed, and are never
+ * returned by a query.
+ *
+ * The index is not created in a thread-safe manner - if a graph is to be
+ * queried by several threads, graph_spatial_init should be called first.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_SPATIAL_H__
+#define __GRAPH_SPATIAL_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+#include "util/array.h"
+
+/**
+ * Creates the spatial index for the given graph, if it has not already
+ * been created.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_spatial_init(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Frees the spatial index of the given graph, if it has one.
+ */
+void graph_spatial_free(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Finds the nodes with coordinates inside the given box, which includes
+ * its bounds. The IDs of the nodes are appended to the given array (of
+ * uint32_t values), in ascending order.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_spatial_box(
+  graph_t *g,    /**< the graph                                    */
+  float   *lo,   /**< lowest x, y and z coordinates (inclusive)    */
+  float   *hi,   /**< highest x, y and z coordinates (inclusive)   */
+  array_t *nodes /**< array to append the IDs of the nodes found to */
+);
+
+/**
+ * Finds the nodes which are within the given (Euclidean) distance of the
+ * given point. The IDs of the nodes are appended to the given array (of
+ * uint32_t values), in ascending order.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_spatial_radius(
+  graph_t *g,      /**< the graph                                    */
+  float   *centre, /**< x, y and z coordinates of the point          */
+  double   radius, /**< maximum distance (inclusive)                 */
+  array_t *nodes   /**< array to append the IDs of the nodes found to */
+);
+
+/**
+ * Finds the node which is nearest to the given point. If more than one
+ * node is at the same distance, the node with the lowest ID is chosen.
+ *
+ * \return 0 on success, non-0 on failure, or if there are no (indexed)
+ * nodes.
+ */
+uint8_t graph_spatial_nearest(
+  graph_t  *g,     /**< the graph                                  */
+  float    *point, /**< x, y and z coordinates of the point        */
+  uint32_t *node,  /**< place to store the ID of the nearest node  */
+  double   *dist   /**< optional place to store its distance from
+                        the point                                  */
+);
+
+#endif /* __GRAPH_SPATIAL_H__ */
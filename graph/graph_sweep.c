@@ -0,0 +1,335 @@
+/**
+ * Threshold sweeps over a weighted graph. See graph/graph_sweep.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_sweep.h"
+
+/**
+ * qsort comparison function for sweep_edge_t structs - orders edges by
+ * key, highest first, and then by end points, lowest first, which is the
+ * order in which graph_threshold_top retains tied edges.
+ */
+static int _compare_edges(
+  const void *a, /**< pointer to a sweep_edge_t */
+  const void *b  /**< pointer to a sweep_edge_t */
+);
+
+/**
+ * \return the root of the set which contains node u, halving the path to
+ * it along the way.
+ */
+static uint32_t _find(
+  graph_sweep_t *gs, /**< the sweep */
+  uint32_t       u   /**< the node  */
+);
+
+/**
+ * Counts the common neighbours of u and v, which are about to be joined
+ * by an edge, and adds the new triangles to the triangle counts.
+ */
+static void _add_triangles(
+  graph_sweep_t *gs, /**< the sweep        */
+  uint32_t       u,  /**< first end point  */
+  uint32_t       v   /**< second end point */
+);
+
+/**
+ * \return the key of the given weight (see graph_sweep_init).
+ */
+static float _key(
+  graph_sweep_t *gs, /**< the sweep       */
+  float          wt  /**< the edge weight */
+);
+
+uint8_t graph_sweep_init(
+  graph_sweep_t *gs,
+  graph_t       *gin,
+  uint8_t        absval,
+  uint8_t        reverse,
+  uint8_t        triangles) {
+
+  uint64_t  i;
+  uint32_t  u;
+  uint32_t  j;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+
+  memset(gs, 0, sizeof(graph_sweep_t));
+
+  nnodes      = graph_num_nodes(gin);
+  gs->absval  = absval;
+  gs->reverse = reverse;
+  gs->ncmps   = nnodes;
+  gs->maxcmp  = (nnodes > 0) ? 1 : 0;
+
+  if (graph_is_directed(gin)) goto fail;
+
+  if (graph_create(         &gs->g, nnodes, 0)) goto fail;
+  if (graph_copy_nodelabels(gin,    &gs->g))    goto fail;
+
+  gs->edges  = malloc(((uint64_t)graph_num_edges(gin) + 1) *
+                      sizeof(sweep_edge_t));
+  gs->parent = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  gs->size   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (gs->edges  == NULL) goto fail;
+  if (gs->parent == NULL) goto fail;
+  if (gs->size   == NULL) goto fail;
+
+  if (triangles) {
+    gs->tris = calloc((uint64_t)nnodes + 1, sizeof(uint64_t));
+    if (gs->tris == NULL) goto fail;
+  }
+
+  for (u = 0; u < nnodes; u++) {
+    gs->parent[u] = u;
+    gs->size  [u] = 1;
+  }
+
+  for (u = 0, i = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(gin, u);
+    nbrs  = graph_get_neighbours(gin, u);
+    wts   = graph_get_weights   (gin, u);
+
+    if (wts == NULL) goto fail;
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] < u)   continue;
+      if (isnan(wts[j])) continue;
+
+      gs->edges[i].key = _key(gs, wts[j]);
+      gs->edges[i].wt  = wts[j];
+      gs->edges[i].u   = u;
+      gs->edges[i].v   = nbrs[j];
+      i++;
+    }
+  }
+
+  gs->nedges = i;
+
+  qsort(gs->edges, gs->nedges, sizeof(sweep_edge_t), _compare_edges);
+
+  return 0;
+
+fail:
+  graph_sweep_free(gs);
+  return 1;
+}
+
+void graph_sweep_free(graph_sweep_t *gs) {
+
+  if (gs->g.neighbours != NULL) graph_free(&gs->g);
+  if (gs->edges        != NULL) free(gs->edges);
+  if (gs->parent       != NULL) free(gs->parent);
+  if (gs->size         != NULL) free(gs->size);
+  if (gs->tris         != NULL) free(gs->tris);
+
+  memset(gs, 0, sizeof(graph_sweep_t));
+}
+
+uint8_t graph_sweep_add(graph_sweep_t *gs, uint64_t nedges) {
+
+  uint32_t      ru;
+  uint32_t      rv;
+  uint32_t      tmp;
+  uint32_t      deg;
+  sweep_edge_t *e;
+
+  if (nedges > gs->nedges) nedges = gs->nedges;
+
+  for (; gs->nadded < nedges; gs->nadded++) {
+
+    e = gs->edges + gs->nadded;
+
+    if (gs->tris != NULL) _add_triangles(gs, e->u, e->v);
+
+    if (graph_add_edge(&gs->g, e->u, e->v, e->wt)) goto fail;
+
+    deg = graph_num_neighbours(&gs->g, e->u);
+    if (deg > gs->maxdeg) gs->maxdeg = deg;
+    deg = graph_num_neighbours(&gs->g, e->v);
+    if (deg > gs->maxdeg) gs->maxdeg = deg;
+
+    ru = _find(gs, e->u);
+    rv = _find(gs, e->v);
+
+    if (ru == rv) continue;
+
+    /*the smaller set is attached to the larger one*/
+    if (gs->size[ru] < gs->size[rv]) {
+      tmp = ru;
+      ru  = rv;
+      rv  = tmp;
+    }
+
+    gs->parent[rv]  = ru;
+    gs->size  [ru] += gs->size[rv];
+    gs->ncmps      --;
+
+    if (gs->size[ru] > gs->maxcmp) gs->maxcmp = gs->size[ru];
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint64_t graph_sweep_count(graph_sweep_t *gs, double threshold) {
+
+  uint64_t lo;
+  uint64_t hi;
+  uint64_t mid;
+  double   key;
+
+  /*
+   * graph_threshold_weight compares the (absolute)
+   * weight against the threshold, at double precision,
+   * so the threshold is only negated, never made
+   * absolute, or rounded to a float
+   */
+  key = gs->reverse ? -threshold : threshold;
+  lo  = 0;
+  hi  = gs->nedges;
+
+  /*edges are sorted by key, highest first*/
+  while (lo < hi) {
+
+    mid = lo + (hi - lo) / 2;
+
+    if (gs->edges[mid].key >= key) lo = mid + 1;
+    else                           hi = mid;
+  }
+
+  return lo;
+}
+
+graph_t *graph_sweep_graph(graph_sweep_t *gs) {
+  return &gs->g;
+}
+
+uint32_t graph_sweep_num_components(graph_sweep_t *gs) {
+  return gs->ncmps;
+}
+
+uint32_t graph_sweep_largest_component(graph_sweep_t *gs) {
+  return gs->maxcmp;
+}
+
+uint32_t graph_sweep_max_degree(graph_sweep_t *gs) {
+  return gs->maxdeg;
+}
+
+uint64_t graph_sweep_num_triangles(graph_sweep_t *gs) {
+  return gs->ntris;
+}
+
+double graph_sweep_clustering(graph_sweep_t *gs) {
+
+  uint32_t u;
+  uint32_t nnodes;
+  uint32_t deg;
+  double   clust;
+
+  if (gs->tris == NULL) return 0;
+
+  nnodes = graph_num_nodes(&gs->g);
+  clust  = 0;
+
+  /*the same definition as stats_clustering*/
+  for (u = 0; u < nnodes; u++) {
+
+    deg = graph_num_neighbours(&gs->g, u);
+
+    if      (deg == 0) continue;
+    else if (deg == 1) clust += 1.0;
+    else               clust += gs->tris[u] / (deg * (deg - 1) / 2.0);
+  }
+
+  return clust / nnodes;
+}
+
+int _compare_edges(const void *a, const void *b) {
+
+  const sweep_edge_t *ea;
+  const sweep_edge_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->key > eb->key) return -1;
+  if (ea->key < eb->key) return  1;
+  if (ea->u   < eb->u)   return -1;
+  if (ea->u   > eb->u)   return  1;
+  if (ea->v   < eb->v)   return -1;
+  if (ea->v   > eb->v)   return  1;
+
+  return 0;
+}
+
+uint32_t _find(graph_sweep_t *gs, uint32_t u) {
+
+  while (gs->parent[u] != u) {
+    gs->parent[u] = gs->parent[gs->parent[u]];
+    u             = gs->parent[u];
+  }
+
+  return u;
+}
+
+void _add_triangles(graph_sweep_t *gs, uint32_t u, uint32_t v) {
+
+  uint32_t  i;
+  uint32_t  j;
+  uint32_t  nunbrs;
+  uint32_t  nvnbrs;
+  uint32_t *unbrs;
+  uint32_t *vnbrs;
+  uint64_t  ncommon;
+
+  nunbrs  = graph_num_neighbours(&gs->g, u);
+  nvnbrs  = graph_num_neighbours(&gs->g, v);
+  unbrs   = graph_get_neighbours(&gs->g, u);
+  vnbrs   = graph_get_neighbours(&gs->g, v);
+  ncommon = 0;
+
+  /*
+   * every common neighbour forms a new triangle
+   * with u and v - neighbour lists are sorted
+   */
+  for (i = 0, j = 0; i < nunbrs && j < nvnbrs;) {
+
+    if      (unbrs[i] < vnbrs[j]) i++;
+    else if (unbrs[i] > vnbrs[j]) j++;
+    else {
+      gs->tris[unbrs[i]]++;
+      ncommon++;
+      i++;
+      j++;
+    }
+  }
+
+  gs->tris[u] += ncommon;
+  gs->tris[v] += ncommon;
+  gs->ntris   += ncommon;
+}
+
+float _key(graph_sweep_t *gs, float wt) {
+
+  if (gs->absval)  wt = fabs(wt);
+  if (gs->reverse) wt = -wt;
+
+  return wt;
+}
@@ -0,0 +1,171 @@
+/**
+ * Threshold sweeps over a weighted graph. A graph_sweep_t sorts the edges
+ * of a weighted graph by weight once, and then adds them, from the highest
+ * weight to the lowest, to an initially empty graph with the same nodes.
+ * The graph may be examined at any point during the sweep, so a series of
+ * thresholded graphs (e.g. at a range of densities) is produced from one
+ * pass over the edges, rather than by thresholding the input graph from
+ * scratch for each one.
+ *
+ * Some measures are kept up to date as edges are added, so can be queried
+ * in constant, or linear, time at any point:
+ *
+ * - Components are tracked with a disjoint set forest (union by size,
+ *   with path halving).
+ *
+ * - The maximum degree is tracked directly.
+ *
+ * - If requested, the number of triangles around every node is tracked,
+ *   by counting the common neighbours of the end points of every edge
+ *   which is added. This gives the number of triangles in the graph, and
+ *   the clustering coefficient of every node.
+ *
+ * Any other measure can be calculated on the graph returned by
+ * graph_sweep_graph, in the usual way.
+ *
+ * Edges are retained in the same order as by graph_threshold_top, so the
+ * graph obtained after adding n edges is identical to that produced by
+ * graph_threshold_top for n edges.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_SWEEP_H__
+#define __GRAPH_SWEEP_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * An edge of the input graph, with the key by which it is sorted.
+ */
+typedef struct _sweep_edge {
+
+  float    key; /**< sort key (see graph_sweep_init) */
+  float    wt;  /**< edge weight                     */
+  uint32_t u;   /**< lower end point                 */
+  uint32_t v;   /**< higher end point                */
+
+} sweep_edge_t;
+
+/**
+ * Threshold sweep handle.
+ */
+typedef struct _graph_sweep {
+
+  graph_t       g;       /**< the graph which edges are added to       */
+  uint64_t      nedges;  /**< number of edges in the input graph,
+                              excluding those with a weight of NaN     */
+  uint64_t      nadded;  /**< number of edges added so far             */
+  sweep_edge_t *edges;   /**< input edges, in the order they are added */
+  uint32_t     *parent;  /**< disjoint set forest                      */
+  uint32_t     *size;    /**< size of each set, indexed by its root    */
+  uint32_t      ncmps;   /**< number of components                     */
+  uint32_t      maxcmp;  /**< size of the largest component            */
+  uint32_t      maxdeg;  /**< maximum degree                           */
+  uint64_t     *tris;    /**< number of triangles around each node,
+                              or NULL if triangles are not tracked     */
+  uint64_t      ntris;   /**< number of triangles in the graph         */
+  uint8_t       absval;  /**< keys are absolute weights                */
+  uint8_t       reverse; /**< keys are negated weights                 */
+
+} graph_sweep_t;
+
+/**
+ * Initialises a sweep over the edges of the given graph, which must be
+ * undirected and weighted. Edges are sorted by key, highest first, where
+ * the key of an edge is its weight, or its absolute weight if absval is
+ * set, negated if reverse is set. Edges with a weight of NaN are never
+ * added. The input graph is not modified, and is not needed once this
+ * function has returned.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_sweep_init(
+  graph_sweep_t *gs,       /**< sweep to initialise            */
+  graph_t       *gin,      /**< weighted input graph           */
+  uint8_t        absval,   /**< sort edges by absolute weight  */
+  uint8_t        reverse,  /**< add the edges with the smallest
+                                weights first                  */
+  uint8_t        triangles /**< track triangles (needed by
+                                graph_sweep_num_triangles and
+                                graph_sweep_clustering)        */
+);
+
+/**
+ * Frees the memory used by the sweep, including its graph.
+ */
+void graph_sweep_free(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * Adds edges to the graph until it has the given number of edges, or
+ * until every edge has been added. Does nothing if the graph already has
+ * at least that many edges.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_sweep_add(
+  graph_sweep_t *gs,    /**< the sweep                              */
+  uint64_t       nedges /**< number of edges the graph should have  */
+);
+
+/**
+ * \return the number of edges which would be retained by thresholding the
+ * input graph at the given weight, with graph_threshold_weight (edges with
+ * a weight of NaN are not counted).
+ */
+uint64_t graph_sweep_count(
+  graph_sweep_t *gs,       /**< the sweep        */
+  double         threshold /**< weight threshold */
+);
+
+/**
+ * \return the graph which edges are being added to. The graph belongs to
+ * the sweep, and must not be modified.
+ */
+graph_t *graph_sweep_graph(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * \return the number of components in the graph, including isolated nodes
+ * (the same as stats_num_components with a minimum size of 1).
+ */
+uint32_t graph_sweep_num_components(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * \return the number of nodes in the largest component of the graph.
+ */
+uint32_t graph_sweep_largest_component(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * \return the maximum node degree of the graph.
+ */
+uint32_t graph_sweep_max_degree(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * \return the number of triangles in the graph, or 0 if triangles are not
+ * being tracked.
+ */
+uint64_t graph_sweep_num_triangles(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+/**
+ * \return the average clustering coefficient of the graph, with the same
+ * definition as stats_avg_clustering, or 0 if triangles are not being
+ * tracked.
+ */
+double graph_sweep_clustering(
+  graph_sweep_t *gs /**< the sweep */
+);
+
+#endif /* __GRAPH_SWEEP_H__ */
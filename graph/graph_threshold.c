@@ -2,6 +2,8 @@
  * Various methods of removing edges from graphs, including:
  * 
  *   - removing edges by thresholding their weight value
+ *   - retaining a specified number of edges, or a specified density, with
+ *     the largest weight values
  *   - removing a specified number of edges, according to some criteria,
  *     e.g. edge-betweenness or path-sharing
  *   - removing edges until a specified number of components has formed, 
@@ -9,18 +11,96 @@
  *   - removing edges until modularity is maximised, again, according to
  *     some criteria
  *
+ * The criteria based methods may be checkpointed, so that a long running
+ * job can be resumed (see graph_threshold_checkpoint).
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
 #include <math.h>
+#include <time.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "graph/graph.h"
+#include "graph/graph_builder.h"
 #include "graph/graph_threshold.h"
+#include "graph/graph_components.h"
+#include "graph/graph_partition.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "util/array.h"
+#include "util/rng.h"
+#include "util/progress.h"
+
+/**
+ * Identifies a checkpoint file.
+ */
+#define CHECKPOINT_ID 0x43545243
+
+/**
+ * Checkpoint file, or NULL if checkpointing is disabled (see
+ * graph_threshold_checkpoint).
+ */
+static char *_ckpt_file = NULL;
+
+/**
+ * Minimum number of seconds between checkpoints.
+ */
+static uint32_t _ckpt_interval = 0;
+
+/**
+ * State of a checkpointed edge removal run.
+ */
+typedef struct _checkpoint {
+
+  array_t  removed; /**< every edge removed so far, as graph_edge_t
+                         structs                                    */
+  uint64_t nreplay; /**< number of removals read from the file,
+                         which are replayed                         */
+  uint8_t  record;  /**< non-0 if removals are recorded, which they
+                         are when checkpointing, and when the
+                         output graph is reconstructed from them    */
+  rng_t    rng;     /**< generator state read from the file         */
+  uint32_t nnodes;  /**< number of nodes in the input graph         */
+  uint64_t nedges;  /**< number of edges in the input graph         */
+  time_t   saved;   /**< time of the last save                      */
+
+} checkpoint_t;
+
+/**
+ * Threshold used by graph_threshold_weight.
+ */
+typedef struct _weight_threshold {
 
+  double  threshold; /**< threshold to apply                  */
+  uint8_t absval;    /**< use absolute values                 */
+  uint8_t reverse;   /**< remove edges above, instead of below */
+
+} weight_threshold_t;
+
+/**
+ * graph_edge_filter_t function used by graph_threshold_weight.
+ *
+ * \return non-0 if the edge passes the threshold, 0 otherwise.
+ */
+static uint8_t _passes_threshold(
+  void    *ctx, /**< pointer to a weight_threshold_t */
+  uint32_t u,   /**< edge start point                 */
+  uint32_t v,   /**< edge end point                   */
+  float    wt   /**< edge weight                      */
+);
+
+/**
+ * Adds the edges of gin which pass the threshold to gout, in one go via a
+ * graph_builder_t, so that the neighbour lists of gout are built once,
+ * rather than being updated for every edge. Used for directed input
+ * graphs, which are converted to undirected graphs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
 static uint8_t _threshold_edges(
   graph_t *gin,
   graph_t *gout,
@@ -29,6 +109,180 @@ static uint8_t _threshold_edges(
   uint8_t  reverse
 );
 
+/**
+ * Calculates the key by which an edge is ranked in graph_threshold_top -
+ * edges with larger keys are retained first.
+ */
+static float _edge_key(
+  float   wt,     /**< edge weight                 */
+  uint8_t absval, /**< use the absolute weight     */
+  uint8_t reverse /**< rank smaller weights higher */
+);
+
+/**
+ * Rearranges the given values so that the k'th smallest (counting from 0)
+ * is at index k, all smaller or equal values are before it, and all larger
+ * or equal values are after it (like std::nth_element). This is a
+ * quickselect with a median of three pivot, so takes linear time on
+ * average.
+ *
+ * \return the k'th smallest value.
+ */
+static float _select(
+  float   *vals, /**< values to select from             */
+  uint64_t n,    /**< number of values                  */
+  uint64_t k     /**< index of the value to select, < n */
+);
+
+/**
+ * Swaps two values.
+ */
+static void _swap(
+  float *a, /**< first value  */
+  float *b  /**< second value */
+);
+
+/**
+ * Starts tracking the components of lgin, a copy of gin from which edges
+ * are to be removed, along with a partition of gin which follows them.
+ * This is used by graph_threshold_modularity and graph_threshold_chira,
+ * so that the quality of the partition is only updated for nodes which
+ * are split off into a new component.
+ *
+ * \return 1 if tracking has started, 0 if not (e.g. for directed graphs),
+ * in which case the caller must recalculate components after each removal.
+ */
+static uint8_t _track_components(
+  graph_t            *gin,  /**< the original graph       */
+  graph_t            *lgin, /**< the graph being edited   */
+  graph_components_t *gc,   /**< component tracker to use */
+  graph_partition_t  *gp    /**< partition to use         */
+);
+
+/**
+ * Stops tracking started by _track_components.
+ */
+static void _untrack_components(
+  graph_components_t *gc, /**< the component tracker */
+  graph_partition_t  *gp  /**< the partition          */
+);
+
+/**
+ * graph_components_moved_t callback used by _track_components. Moves the
+ * node into the same community of the partition.
+ */
+static void _follow_components(
+  void    *ctx,  /**< pointer to a graph_partition_t */
+  uint32_t u,    /**< the node                       */
+  uint32_t from, /**< old component ID               */
+  uint32_t to    /**< new component ID               */
+);
+
+/**
+ * Sorted edges which are left out by graph_threshold_replay.
+ */
+typedef struct _replay {
+
+  graph_edge_t *edges;  /**< the edges, sorted by end points */
+  uint64_t      nedges; /**< number of edges                 */
+
+} replay_t;
+
+/**
+ * Compares two edges by their end points, for sorting and searching the
+ * edges in a replay_t struct.
+ */
+static int _compare_edges(
+  const void *a, /**< pointer to a graph_edge_t */
+  const void *b  /**< pointer to a graph_edge_t */
+);
+
+/**
+ * graph_edge_filter_t function used by graph_threshold_replay.
+ *
+ * \return 0 if the edge is in the replay_t struct, non-0 otherwise.
+ */
+static uint8_t _not_removed(
+  void    *ctx, /**< pointer to a replay_t struct */
+  uint32_t u,   /**< edge start point             */
+  uint32_t v,   /**< edge end point               */
+  float    wt   /**< edge weight                  */
+);
+
+/**
+ * Recalculates edge values after the i'th edge has been removed. If the
+ * batch size is 1 (or 0), the recalc function is called. Otherwise nothing
+ * is done until a full batch of edges has been removed, after which the
+ * init function is called to recalculate every value.
+ *
+ * While removals are being replayed from a checkpoint, nothing is done;
+ * after the last one, the generator state is restored, and the init
+ * function is called. A checkpoint is saved, if one is due, before the
+ * values are recalculated.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _recalculate(
+  graph_t      *g,                /**< the graph                 */
+  uint64_t      i,                /**< number of edges removed,
+                                       minus 1                   */
+  uint32_t      batch,            /**< batch size                */
+  graph_edge_t *edge,             /**< edge which was removed    */
+  checkpoint_t *ck,               /**< checkpoint state          */
+  uint8_t     (*init)(graph_t *g),
+  uint8_t     (*recalc)(graph_t *g, graph_edge_t *edge)
+);
+
+/**
+ * Removes the i'th edge from the graph - either the next edge which was
+ * read from the checkpoint file, or the edge chosen by the remove
+ * function, which is then recorded in the checkpoint state.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _remove(
+  graph_t      *g,     /**< the graph                               */
+  double       *space, /**< space passed to the remove function     */
+  array_t      *edges, /**< array passed to the remove function     */
+  graph_edge_t *edge,  /**< place to store the removed edge         */
+  checkpoint_t *ck,    /**< checkpoint state                        */
+  uint64_t      i,     /**< number of edges removed so far          */
+  uint8_t     (*remove)(
+    graph_t *g, double *space, array_t *edges, graph_edge_t *edge)
+);
+
+/**
+ * Initialises the checkpoint state for an edge removal run on the given
+ * graph, reading the checkpoint file if checkpointing is enabled and the
+ * file exists.
+ *
+ * \return 0 on success, non-0 on failure, including if the checkpoint was
+ * saved for a different graph.
+ */
+static uint8_t _ckpt_init(
+  graph_t      *g,     /**< the input graph                     */
+  checkpoint_t *ck,    /**< checkpoint state to initialise      */
+  uint8_t       record /**< record removals even if checkpointing
+                            is disabled                         */
+);
+
+/**
+ * Saves the given checkpoint state, along with the current state of the
+ * default generator, to the checkpoint file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ckpt_save(
+  checkpoint_t *ck /**< checkpoint state */
+);
+
+/**
+ * Frees the memory used by the given checkpoint state.
+ */
+static void _ckpt_free(
+  checkpoint_t *ck /**< checkpoint state */
+);
+
 uint8_t graph_threshold_weight(
   graph_t *gin,
   graph_t *gout,
@@ -36,9 +290,27 @@ uint8_t graph_threshold_weight(
   uint8_t  absval,
   uint8_t  reverse) {
 
-  if (graph_create(         gout, graph_num_nodes(gin), 0))          goto fail;
-  if (graph_copy_nodelabels(gin,  gout))                             goto fail;
-  if (_threshold_edges(     gin,  gout, threshold, absval, reverse)) goto fail;
+  weight_threshold_t thres;
+
+  if (graph_is_directed(gin)) {
+
+    if (graph_create(gout, graph_num_nodes(gin), 0))             goto fail;
+    if (graph_copy_nodelabels(gin, gout))                        goto fail;
+    if (_threshold_edges(gin, gout, threshold, absval, reverse)) goto fail;
+
+    return 0;
+  }
+
+  thres.threshold = threshold;
+  thres.absval    = absval;
+  thres.reverse   = reverse;
+
+  /*
+   * the neighbour lists of undirected graphs are
+   * already sorted, so the edges which pass are
+   * copied straight across
+   */
+  if (graph_copy_filtered(gin, gout, _passes_threshold, &thres)) goto fail;
 
   return 0;
 
@@ -46,12 +318,143 @@ fail:
   return 1;
 }
 
+uint8_t graph_threshold_top(
+  graph_t *gin,
+  graph_t *gout,
+  uint64_t nedges,
+  uint8_t  absval,
+  uint8_t  reverse) {
+
+  uint64_t        i;
+  uint64_t        n;
+  uint64_t        nties;
+  uint8_t         directed;
+  uint32_t        u;
+  uint32_t        v;
+  uint32_t        nnodes;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  float          *wts;
+  float          *keys;
+  float           key;
+  float           cut;
+  graph_builder_t builder;
+
+  keys     = NULL;
+  nnodes   = graph_num_nodes(gin);
+  directed = graph_is_directed(gin);
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (graph_create(         gout, nnodes, 0)) goto fail;
+  if (graph_copy_nodelabels(gin,  gout))      goto fail;
+
+  keys = malloc(((uint64_t)graph_num_edges(gin) + 1) * sizeof(float));
+  if (keys == NULL) goto fail;
+
+  /*gather the key of every edge, each undirected edge only once*/
+  for (u = 0, n = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(gin, u);
+    nbrs  = graph_get_neighbours(gin, u);
+    wts   = graph_get_weights   (gin, u);
+
+    if (wts == NULL) goto fail;
+
+    for (v = 0; v < nnbrs; v++) {
+
+      if (!directed && nbrs[v] < u) continue;
+      if (isnan(wts[v]))            continue;
+
+      keys[n++] = _edge_key(wts[v], absval, reverse);
+    }
+  }
+
+  if (nedges > n) nedges = n;
+
+  if (nedges == 0) {
+    free(keys);
+    return 0;
+  }
+
+  /*
+   * the cutoff is the nedges'th largest key - all edges
+   * above it are retained, along with as many of the
+   * edges at it as are needed to make up nedges
+   */
+  cut   = _select(keys, n, n - nedges);
+  nties = nedges;
+  for (i = 0; i < n; i++) {
+    if (keys[i] > cut) nties--;
+  }
+
+  free(keys);
+  keys = NULL;
+
+  if (graph_builder_init(&builder, gout, nedges)) goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(gin, u);
+    nbrs  = graph_get_neighbours(gin, u);
+    wts   = graph_get_weights   (gin, u);
+
+    for (v = 0; v < nnbrs; v++) {
+
+      if (!directed && nbrs[v] < u) continue;
+      if (isnan(wts[v]))            continue;
+
+      key = _edge_key(wts[v], absval, reverse);
+
+      if (key < cut) continue;
+      if (key == cut) {
+        if (nties == 0) continue;
+        nties--;
+      }
+
+      if (graph_builder_add(&builder, u, nbrs[v], wts[v])) goto fail;
+    }
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  return 0;
+
+fail:
+  if (keys != NULL) free(keys);
+  graph_builder_free(&builder);
+  return 1;
+}
+
+uint8_t graph_threshold_density(
+  graph_t *gin,
+  graph_t *gout,
+  double   density,
+  uint8_t  absval,
+  uint8_t  reverse) {
+
+  double nnodes;
+  double maxedges;
+
+  if (density < 0 || density > 1) goto fail;
+
+  nnodes   = graph_num_nodes(gin);
+  maxedges = nnodes * (nnodes - 1) / 2.0;
+
+  return graph_threshold_top(
+    gin, gout, (uint64_t)round(density * maxedges), absval, reverse);
+
+fail:
+  return 1;
+}
+
 uint8_t graph_threshold_edges(
   graph_t  *gin,
   graph_t  *gout,
   uint32_t  nedges,
   uint32_t  flags,
   void     *opt,
+  uint32_t  batch,
   uint8_t (*init)(graph_t *g),
   uint8_t (*remove)(
     graph_t      *g,
@@ -68,11 +471,14 @@ uint8_t graph_threshold_edges(
   double      *space;
   array_t      edges;
   graph_edge_t edge;
+  checkpoint_t ck;
 
   edges.data = NULL;
   space      = NULL;
   nnodes     = graph_num_nodes(gin);
 
+  if (_ckpt_init(gin, &ck, 0)) goto fail;
+
   if (array_create(&edges, sizeof(graph_edge_t), 10)) goto fail;
 
   if (graph_copy(gin,  gout)) goto fail;
@@ -81,22 +487,23 @@ uint8_t graph_threshold_edges(
   space = calloc(nnodes,sizeof(double));
   if (space == NULL) goto fail;
 
-  init(gout);
+  if (ck.nreplay == 0) init(gout);
 
   for (i = 0; i < nedges; i++) {
 
-    array_clear(&edges);
-    if (remove(gout, space, &edges, &edge)) goto fail;
+    if (_remove(gout, space, &edges, &edge, &ck, i, remove)) goto fail;
 
-    if (i == nedges -1)      break;
-    if (recalc(gout, &edge)) goto fail;
+    if (i == nedges -1) break;
+    if (_recalculate(gout, i, batch, &edge, &ck, init, recalc)) goto fail;
   }
 
+  _ckpt_free(&ck);
   array_free(&edges);
   free(space);
   return 0;
   
 fail:
+  _ckpt_free(&ck);
   if (edges.data != NULL) array_free(&edges);
   if (space      != NULL) free(space);
   return 1;
@@ -108,6 +515,7 @@ uint8_t graph_threshold_components(
   uint32_t  cmplimit,
   uint32_t  igndis,
   void     *opt,
+  uint32_t  batch,
   uint8_t (*init)(graph_t *g),
   uint8_t (*remove)(
     graph_t      *g,
@@ -118,16 +526,23 @@ uint8_t graph_threshold_components(
     graph_t      *g,
     graph_edge_t *edge)
 ) {
-  uint32_t     nnodes;
-  uint64_t     ncmps;
-  double      *space;
-  array_t      edges;
-  graph_edge_t edge;
+  uint64_t           i;
+  uint32_t           nnodes;
+  uint64_t           ncmps;
+  double            *space;
+  array_t            edges;
+  graph_edge_t       edge;
+  graph_components_t gc;
+  uint8_t            tracked;
+  checkpoint_t       ck;
 
   edges.data  = NULL;
   space       = NULL;
+  tracked     = 0;
   nnodes      = graph_num_nodes(gin);
 
+  if (_ckpt_init(gin, &ck, 0)) goto fail;
+
   if (cmplimit > nnodes) goto fail;
 
   if (array_create(&edges,  sizeof(graph_edge_t), 10)) goto fail;
@@ -138,26 +553,38 @@ uint8_t graph_threshold_components(
   space = calloc(nnodes,sizeof(double));
   if (space == NULL) goto fail;
 
-  init(gout);
-  
-  ncmps = stats_num_components(gout, igndis, NULL, NULL);
-  while (ncmps < cmplimit) {
+  if (ck.nreplay == 0) init(gout);
+
+  /*
+   * Components of undirected graphs are tracked as
+   * edges are removed, rather than being counted
+   * from scratch after every removal
+   */
+  tracked = !graph_components_init(&gc, gout, igndis);
 
-    array_clear(&edges);
+  if (tracked) ncmps = graph_components_count(&gc);
+  else         ncmps = stats_num_components(gout, igndis, NULL, NULL);
 
-    if (remove(gout, space, &edges, &edge)) goto fail;
+  for (i = 0; ncmps < cmplimit; i++) {
 
-    ncmps = stats_num_components(gout, igndis, NULL, NULL);
+    if (_remove(gout, space, &edges, &edge, &ck, i, remove)) goto fail;
 
-    if (ncmps >= cmplimit)   break;
-    if (recalc(gout, &edge)) goto fail;
+    if (tracked) ncmps = graph_components_count(&gc);
+    else         ncmps = stats_num_components(gout, igndis, NULL, NULL);
+
+    if (ncmps >= cmplimit) break;
+    if (_recalculate(gout, i, batch, &edge, &ck, init, recalc)) goto fail;
   }
 
+  if (tracked) graph_components_free(&gc);
+  _ckpt_free(&ck);
   free(space);
   array_free(&edges);
   return 0;
   
 fail:
+  _ckpt_free(&ck);
+  if (tracked)             graph_components_free(&gc);
   if (space       != NULL) free(space);
   if (edges.data  != NULL) array_free(&edges);
   return 1;
@@ -169,6 +596,7 @@ uint8_t graph_threshold_modularity(
   uint32_t  edgelimit,
   uint32_t  flags,
   void     *opt,
+  uint32_t  batch,
   uint8_t (*init)(graph_t *g),
   uint8_t (*remove)(
     graph_t      *g,
@@ -184,29 +612,38 @@ uint8_t graph_threshold_modularity(
   graph_t      lgin;
   array_t      edges;
   graph_edge_t edge;
-  graph_t      gmod;
+  uint64_t     nbest;
   double      *space;
   double       mod;
   double       maxmod;
   uint32_t     ncmps;
   uint32_t    *components;
   mod_opt_t   *modopt;
+  uint8_t      tracked;
+  checkpoint_t ck;
+  graph_components_t gc;
+  graph_partition_t  gp;
 
   maxmod          = -1.0;
   modopt          = opt;
   space           = NULL;
   edges.data      = NULL;
-  gmod.neighbours = NULL;
+  lgin.neighbours = NULL;
   components      = NULL;
+  tracked         = 0;
+  nbest           = 0;
 
   if (modopt != NULL) {
     modopt->modularity = NULL;
     modopt->ncmps      = NULL;
+    modopt->removed    = NULL;
     modopt->nvals      = edgelimit;
   }
 
   nnodes = graph_num_nodes(gin);
 
+  if (_ckpt_init(gin, &ck, 1)) goto fail;
+
   if (graph_copy(gin,  &lgin)) goto fail;
   if (stats_cache_init(&lgin)) goto fail;
 
@@ -226,19 +663,30 @@ uint8_t graph_threshold_modularity(
     if (modopt->ncmps == NULL) goto fail;
   }
 
-  init(&lgin);
+  /*
+   * Modularity is calculated on the original graph, with
+   * the discovered components as the community structure.
+   * Where possible, the components are tracked as edges
+   * are removed, and the partition of the original graph
+   * follows them, so that modularity is only updated for
+   * the nodes which are split off into a new component.
+   */
+  tracked = _track_components(gin, &lgin, &gc, &gp);
+
+  if (ck.nreplay == 0) init(&lgin);
 
   for (i = 0; i < edgelimit; i++) {
 
-    array_clear(&edges);
-    if (remove(&lgin, space, &edges, &edge)) goto fail;
+    if (_remove(&lgin, space, &edges, &edge, &ck, i, remove)) goto fail;
 
-    /*
-     * modularity is calculated on the original graph, with 
-     * the discovered components as the community structure
-     */
-    ncmps = stats_num_components(&lgin, 0, NULL, components);
-    mod   = stats_modularity(gin, ncmps, components);
+    if (tracked) {
+      ncmps = graph_components_count(&gc);
+      mod   = graph_partition_modularity(&gp);
+    }
+    else {
+      ncmps = stats_num_components(&lgin, 0, NULL, components);
+      mod   = stats_modularity(gin, ncmps, components);
+    }
 
     if (modopt != NULL) {
       modopt->modularity[i] = mod;
@@ -246,29 +694,47 @@ uint8_t graph_threshold_modularity(
     }
 
     if (mod >= maxmod) {
-
       maxmod = mod;
-
-      if (gmod.neighbours != NULL) 
-        graph_free(&gmod);
-      gmod.neighbours = NULL;
-      if (graph_copy(&lgin, &gmod)) goto fail;
+      nbest  = i + 1;
     }
 
-    if (recalc(&lgin, &edge)) goto fail;
+    if (_recalculate(&lgin, i, batch, &edge, &ck, init, recalc)) goto fail;
   }
 
-  if (graph_copy(&gmod, gout)) goto fail;
+  if (tracked) _untrack_components(&gc, &gp);
+  tracked = 0;
+
+  /*
+   * rather than keeping a copy of the best graph,
+   * it is reconstructed from the removal order
+   */
+  if (graph_threshold_replay(
+        gin, gout, (graph_edge_t *)ck.removed.data, nbest))
+    goto fail;
+
+  if (modopt != NULL) {
+    modopt->removed = malloc(edgelimit * sizeof(graph_edge_t));
+    if (modopt->removed == NULL) goto fail;
+
+    memcpy(modopt->removed,
+           ck.removed.data,
+           edgelimit * sizeof(graph_edge_t));
+  }
 
+  _ckpt_free(&ck);
+  graph_free(&lgin);
+  free(components);
   free(space);
   array_free(&edges);
 
   return 0;
 
 fail:
+  _ckpt_free(&ck);
+  if (tracked)                 _untrack_components(&gc, &gp);
   if (space           != NULL) free(space);
   if (edges.data      != NULL) array_free(&edges);
-  if (gmod.neighbours != NULL) graph_free(&gmod);
+  if (lgin.neighbours != NULL) graph_free(&lgin);
   if (components      != NULL) free(components);
 
   if (modopt != NULL) {
@@ -285,6 +751,7 @@ uint8_t graph_threshold_chira(
   uint32_t  edgelimit,
   uint32_t  flags,
   void     *opt,
+  uint32_t  batch,
   uint8_t (*init)(graph_t *g),
   uint8_t (*remove)(
     graph_t      *g,
@@ -300,21 +767,29 @@ uint8_t graph_threshold_chira(
   graph_t      lgin;
   array_t      edges;
   graph_edge_t edge;
-  graph_t      gmod;
+  uint64_t     nbest;
   double      *space;
   double       mod;
   double       maxmod;
   uint32_t     ncmps;
   uint32_t    *components;
+  uint8_t      tracked;
+  checkpoint_t ck;
+  graph_components_t gc;
+  graph_partition_t  gp;
 
   maxmod          = -1.0;
   space           = NULL;
   edges.data      = NULL;
-  gmod.neighbours = NULL;
+  lgin.neighbours = NULL;
   components      = NULL;
+  tracked         = 0;
+  nbest           = 0;
 
   nnodes = graph_num_nodes(gin);
 
+  if (_ckpt_init(gin, &ck, 1)) goto fail;
+
   if (graph_copy(gin,  &lgin)) goto fail;
   if (stats_cache_init(&lgin)) goto fail;
 
@@ -326,50 +801,280 @@ uint8_t graph_threshold_chira(
   space = calloc(nnodes,sizeof(double));
   if (space == NULL) goto fail;
 
-  init(&lgin);
+  /*
+   * fitness is calculated on the original graph, with
+   * the discovered components as the community
+   * structure - see graph_threshold_modularity
+   */
+  tracked = _track_components(gin, &lgin, &gc, &gp);
+
+  if (ck.nreplay == 0) init(&lgin);
 
   for (i = 0; i < edgelimit; i++) {
 
-    array_clear(&edges);
-    if (remove(&lgin, space, &edges, &edge)) goto fail;
+    if (_remove(&lgin, space, &edges, &edge, &ck, i, remove)) goto fail;
 
-    /*
-     * modularity is calculated on the original graph, with 
-     * the discovered components as the community structure
-     */
-    ncmps = stats_num_components(&lgin, 0, NULL, components);
-    mod   = stats_chira(gin, ncmps, components);
+    if (tracked) {
+      mod = graph_partition_chira(&gp);
+    }
+    else {
+      ncmps = stats_num_components(&lgin, 0, NULL, components);
+      mod   = stats_chira(gin, ncmps, components);
+    }
 
     if (mod >= maxmod) {
-
       maxmod = mod;
-
-      if (gmod.neighbours != NULL) 
-        graph_free(&gmod);
-      gmod.neighbours = NULL;
-      if (graph_copy(&lgin, &gmod)) goto fail;
+      nbest  = i + 1;
     }
 
-    if (recalc(&lgin, &edge)) goto fail;
+    if (_recalculate(&lgin, i, batch, &edge, &ck, init, recalc)) goto fail;
   }
 
-  if (graph_copy(&gmod, gout)) goto fail;
+  if (tracked) _untrack_components(&gc, &gp);
+  tracked = 0;
 
+  /*
+   * rather than keeping a copy of the best graph,
+   * it is reconstructed from the removal order
+   */
+  if (graph_threshold_replay(
+        gin, gout, (graph_edge_t *)ck.removed.data, nbest))
+    goto fail;
+
+  _ckpt_free(&ck);
+  graph_free(&lgin);
+  free(components);
   free(space);
   array_free(&edges);
 
   return 0;
 
 fail:
+  _ckpt_free(&ck);
+  if (tracked)                 _untrack_components(&gc, &gp);
   if (space           != NULL) free(space);
   if (edges.data      != NULL) array_free(&edges);
-  if (gmod.neighbours != NULL) graph_free(&gmod);
+  if (lgin.neighbours != NULL) graph_free(&lgin);
   if (components      != NULL) free(components);
 
   return 1;
 }
 
 
+void graph_threshold_checkpoint(char *fname, uint32_t interval) {
+
+  _ckpt_file     = fname;
+  _ckpt_interval = interval;
+}
+
+uint8_t _recalculate(
+  graph_t      *g,
+  uint64_t      i,
+  uint32_t      batch,
+  graph_edge_t *edge,
+  checkpoint_t *ck,
+  uint8_t     (*init)(graph_t *g),
+  uint8_t     (*recalc)(graph_t *g, graph_edge_t *edge)) {
+
+  if (i + 1 < ck->nreplay) return 0;
+
+  /*
+   * the generator is restored to its state before
+   * the recalculation that the checkpoint was saved
+   * in front of, so random choices are unchanged
+   */
+  if (i + 1 == ck->nreplay) {
+    *rng_default() = ck->rng;
+    return init(g);
+  }
+
+  if (batch > 1 && (i + 1) % batch != 0) return 0;
+
+  if (_ckpt_file != NULL &&
+      time(NULL) - ck->saved >= _ckpt_interval) {
+    if (_ckpt_save(ck)) return 1;
+  }
+
+  if (batch <= 1) return recalc(g, edge);
+  else            return init(g);
+}
+
+uint8_t _remove(
+  graph_t      *g,
+  double       *space,
+  array_t      *edges,
+  graph_edge_t *edge,
+  checkpoint_t *ck,
+  uint64_t      i,
+  uint8_t     (*remove)(
+    graph_t *g, double *space, array_t *edges, graph_edge_t *edge)) {
+
+  if (i < ck->nreplay) {
+
+    if (array_get(&(ck->removed), i, edge))    goto fail;
+    if (graph_remove_edge(g, edge->u, edge->v)) goto fail;
+
+    return 0;
+  }
+
+  array_clear(edges);
+
+  if (remove(g, space, edges, edge)) goto fail;
+
+  if (ck->record && array_append(&(ck->removed), edge)) goto fail;
+
+  PROGRESS_ADD(PROGRESS_EDGES, 1);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ckpt_init(graph_t *g, checkpoint_t *ck, uint8_t record) {
+
+  FILE        *f;
+  uint64_t     i;
+  uint32_t     id;
+  uint32_t     nnodes;
+  uint64_t     nedges;
+  uint64_t     nremoved;
+  uint32_t     uv[2];
+  graph_edge_t edge;
+
+  f = NULL;
+
+  memset(ck, 0, sizeof(checkpoint_t));
+
+  ck->nnodes = graph_num_nodes(g);
+  ck->nedges = graph_num_edges(g);
+  ck->saved  = time(NULL);
+
+  if (_ckpt_file == NULL && !record) return 0;
+
+  ck->record = 1;
+
+  if (array_create(&(ck->removed), sizeof(graph_edge_t), 1024)) goto fail;
+
+  if (_ckpt_file == NULL) return 0;
+
+  f = fopen(_ckpt_file, "rb");
+  if (f == NULL) return 0;
+
+  if (fread(&id,        sizeof(id),       1, f) != 1) goto fail;
+  if (fread(&nnodes,    sizeof(nnodes),   1, f) != 1) goto fail;
+  if (fread(&nedges,    sizeof(nedges),   1, f) != 1) goto fail;
+  if (fread(&nremoved,  sizeof(nremoved), 1, f) != 1) goto fail;
+  if (fread(&(ck->rng), sizeof(rng_t),    1, f) != 1) goto fail;
+
+  if (id       != CHECKPOINT_ID) goto fail;
+  if (nnodes   != ck->nnodes)    goto fail;
+  if (nedges   != ck->nedges)    goto fail;
+  if (nremoved >  nedges)        goto fail;
+
+  for (i = 0; i < nremoved; i++) {
+
+    if (fread(uv, sizeof(uv), 1, f) != 1) goto fail;
+
+    edge.u = uv[0];
+    edge.v = uv[1];
+
+    if (array_append(&(ck->removed), &edge)) goto fail;
+  }
+
+  fclose(f);
+
+  ck->nreplay = nremoved;
+
+  return 0;
+
+fail:
+  if (f != NULL) fclose(f);
+  _ckpt_free(ck);
+  return 1;
+}
+
+uint8_t _ckpt_save(checkpoint_t *ck) {
+
+  FILE        *f;
+  char        *tmpf;
+  uint64_t     i;
+  uint64_t     nremoved;
+  uint32_t     id;
+  uint32_t     uv[2];
+  graph_edge_t edge;
+
+  f    = NULL;
+  tmpf = NULL;
+  id   = CHECKPOINT_ID;
+
+  /*
+   * the checkpoint is written to a temporary file, which
+   * then replaces the old one, so a process which is
+   * killed while saving leaves the old checkpoint intact
+   */
+  tmpf = malloc(strlen(_ckpt_file) + 5);
+  if (tmpf == NULL) goto fail;
+
+  sprintf(tmpf, "%s.tmp", _ckpt_file);
+
+  f = fopen(tmpf, "wb");
+  if (f == NULL) goto fail;
+
+  nremoved = ck->removed.size;
+
+  if (fwrite(&id,           sizeof(id),         1, f) != 1) goto fail;
+  if (fwrite(&(ck->nnodes), sizeof(ck->nnodes), 1, f) != 1) goto fail;
+  if (fwrite(&(ck->nedges), sizeof(ck->nedges), 1, f) != 1) goto fail;
+  if (fwrite(&nremoved,     sizeof(nremoved),   1, f) != 1) goto fail;
+  if (fwrite(rng_default(), sizeof(rng_t),      1, f) != 1) goto fail;
+
+  for (i = 0; i < nremoved; i++) {
+
+    if (array_get(&(ck->removed), i, &edge)) goto fail;
+
+    uv[0] = edge.u;
+    uv[1] = edge.v;
+
+    if (fwrite(uv, sizeof(uv), 1, f) != 1) goto fail;
+  }
+
+  if (fclose(f)) {
+    f = NULL;
+    goto fail;
+  }
+  f = NULL;
+
+  if (rename(tmpf, _ckpt_file)) goto fail;
+
+  free(tmpf);
+  ck->saved = time(NULL);
+  return 0;
+
+fail:
+  if (f    != NULL) fclose(f);
+  if (tmpf != NULL) free(tmpf);
+  return 1;
+}
+
+void _ckpt_free(checkpoint_t *ck) {
+
+  if (ck->removed.data != NULL) array_free(&(ck->removed));
+  ck->removed.data = NULL;
+}
+
+uint8_t _passes_threshold(void *ctx, uint32_t u, uint32_t v, float wt) {
+
+  weight_threshold_t *thres;
+
+  thres = ctx;
+
+  if (thres->absval) wt = fabs(wt);
+
+  if (thres->reverse) return !(wt > thres->threshold);
+  else                return !(wt < thres->threshold);
+}
+
 uint8_t _threshold_edges(
   graph_t *gin,
   graph_t *gout,
@@ -377,15 +1082,22 @@ uint8_t _threshold_edges(
   uint8_t  absval,
   uint8_t  reverse) {
 
-  uint32_t  u;
-  uint32_t  v;
-  uint32_t  nnodes;
-  uint32_t  nnbrs;
-  uint32_t *nbrs;
-  float    *wts;
-  float     wt;
+  uint8_t         directed;
+  uint32_t        u;
+  uint32_t        v;
+  uint32_t        nnodes;
+  uint32_t        nnbrs;
+  uint32_t       *nbrs;
+  float          *wts;
+  float           wt;
+  graph_builder_t builder;
 
-  nnodes = graph_num_nodes(gin);
+  nnodes   = graph_num_nodes(gin);
+  directed = graph_is_directed(gin);
+
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (graph_builder_init(&builder, gout, graph_num_edges(gin))) goto fail;
 
   for (u = 0; u < nnodes; u++) {
 
@@ -397,18 +1109,204 @@ uint8_t _threshold_edges(
 
     for (v = 0; v < nnbrs; v++) {
 
+      /*each undirected edge only needs to be queued once*/
+      if (!directed && nbrs[v] < u) continue;
+
       if (absval) wt = fabs(wts[v]);
       else        wt =      wts[v];
 
       if (reverse) { if (wt > threshold) continue; }
       else         { if (wt < threshold) continue; }
       
-      if (graph_add_edge(gout, u, nbrs[v], wts[v])) goto fail;
+      if (graph_builder_add(&builder, u, nbrs[v], wts[v])) goto fail;
+    }
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  return 1;
+}
+
+uint8_t _track_components(
+  graph_t            *gin,
+  graph_t            *lgin,
+  graph_components_t *gc,
+  graph_partition_t  *gp) {
+
+  if (graph_components_init(gc, lgin, 0)) return 0;
+
+  if (graph_partition_init(gp, gin, gc->cmps)) {
+    graph_components_free(gc);
+    return 0;
+  }
+
+  graph_components_on_move(gc, _follow_components, gp);
+
+  return 1;
+}
+
+void _untrack_components(graph_components_t *gc, graph_partition_t *gp) {
+
+  graph_components_free(gc);
+  graph_partition_free(gp);
+}
+
+void _follow_components(void *ctx, uint32_t u, uint32_t from, uint32_t to) {
+
+  graph_partition_move(ctx, u, to);
+}
+
+float _edge_key(float wt, uint8_t absval, uint8_t reverse) {
+
+  if (absval)  wt = fabs(wt);
+  if (reverse) wt = -wt;
+
+  return wt;
+}
+
+float _select(float *vals, uint64_t n, uint64_t k) {
+
+  int64_t lo;
+  int64_t hi;
+  int64_t mid;
+  int64_t i;
+  int64_t j;
+  float   pivot;
+
+  lo = 0;
+  hi = n - 1;
+
+  while (lo < hi) {
+
+    /*
+     * order the first, middle and last values, so that
+     * sorted input does not take quadratic time, and
+     * the scans below cannot run off either end
+     */
+    mid = lo + (hi - lo) / 2;
+    if (vals[mid] < vals[lo])  _swap(vals + mid, vals + lo);
+    if (vals[hi]  < vals[lo])  _swap(vals + hi,  vals + lo);
+    if (vals[hi]  < vals[mid]) _swap(vals + hi,  vals + mid);
+
+    pivot = vals[mid];
+    i     = lo;
+    j     = hi;
+
+    while (i <= j) {
+
+      while (vals[i] < pivot) i++;
+      while (vals[j] > pivot) j--;
+
+      if (i <= j) {
+        _swap(vals + i, vals + j);
+        i++;
+        j--;
+      }
     }
+
+    /*values in (j, i) are equal to the pivot*/
+    if      ((int64_t)k <= j) hi = j;
+    else if ((int64_t)k >= i) lo = i;
+    else                      break;
   }
 
+  return vals[k];
+}
+
+void _swap(float *a, float *b) {
+
+  float tmp;
+
+  tmp = *a;
+  *a  = *b;
+  *b  = tmp;
+}
+
+uint8_t graph_threshold_replay(
+  graph_t      *gin,
+  graph_t      *gout,
+  graph_edge_t *removed,
+  uint64_t      nremoved) {
+
+  uint64_t  i;
+  uint32_t  tmp;
+  replay_t  replay;
+
+  replay.edges  = NULL;
+  replay.nedges = nremoved;
+
+  if (nremoved > 0) {
+
+    replay.edges = malloc(nremoved * sizeof(graph_edge_t));
+    if (replay.edges == NULL) goto fail;
+
+    memcpy(replay.edges, removed, nremoved * sizeof(graph_edge_t));
+
+    /*
+     * the filter is given the lower end point of an
+     * undirected edge first, so the removed edges are
+     * stored the same way
+     */
+    if (!graph_is_directed(gin)) {
+      for (i = 0; i < nremoved; i++) {
+
+        if (replay.edges[i].u <= replay.edges[i].v) continue;
+
+        tmp               = replay.edges[i].u;
+        replay.edges[i].u = replay.edges[i].v;
+        replay.edges[i].v = tmp;
+      }
+    }
+
+    qsort(replay.edges, nremoved, sizeof(graph_edge_t), _compare_edges);
+  }
+
+  if (graph_copy_filtered(gin, gout, _not_removed, &replay)) goto fail;
+
+  if (replay.edges != NULL) free(replay.edges);
+
   return 0;
 
 fail:
+  if (replay.edges != NULL) free(replay.edges);
   return 1;
 }
+
+int _compare_edges(const void *a, const void *b) {
+
+  const graph_edge_t *ea;
+  const graph_edge_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->u < eb->u) return -1;
+  if (ea->u > eb->u) return  1;
+  if (ea->v < eb->v) return -1;
+  if (ea->v > eb->v) return  1;
+
+  return 0;
+}
+
+uint8_t _not_removed(void *ctx, uint32_t u, uint32_t v, float wt) {
+
+  replay_t     *replay;
+  graph_edge_t  key;
+
+  replay = ctx;
+  key.u  = u;
+  key.v  = v;
+
+  if (replay->nedges == 0) return 1;
+
+  return bsearch(&key,
+                 replay->edges,
+                 replay->nedges,
+                 sizeof(graph_edge_t),
+                 _compare_edges) == NULL;
+}
@@ -16,11 +16,16 @@
  */
 typedef struct _mod_opt {
 
-  uint32_t  nvals;      /**< number of values in each of the arrays, 
-                             equivalent to number of edges removed       */
-  double   *modularity; /**< modularity after each edge has been removed */
-  uint32_t *ncmps;      /**< number of components after 
-                             each edge has been removed                  */
+  uint32_t      nvals;      /**< number of values in each of the arrays,
+                                 equivalent to number of edges removed   */
+  double       *modularity; /**< modularity after each edge has been
+                                 removed                                 */
+  uint32_t     *ncmps;      /**< number of components after
+                                 each edge has been removed              */
+  graph_edge_t *removed;    /**< the edges, in the order in which they
+                                 were removed - any level of the
+                                 hierarchy may be reconstructed from the
+                                 input graph with graph_threshold_replay */
 
 } mod_opt_t;
 
@@ -28,7 +33,8 @@ typedef struct _mod_opt {
  * Creates a new, unweighted graph from the weighted input graph by applying
  * the given threshold to the edges of the input graph. All edges which have 
  * a weight greater than or equal to the threshold are added to the output
- * graph. All other edges are excluded.
+ * graph. All other edges are excluded. For undirected graphs, the passing
+ * edges are copied in one pass with graph_copy_filtered.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -40,9 +46,53 @@ uint8_t graph_threshold_weight(
   uint8_t  reverse    /**< remove edges above threshold, instead of below */
 );
 
+/**
+ * Creates a new graph from the weighted input graph, containing the nedges
+ * edges with the largest weights (or the smallest, if reverse is set). The
+ * cutoff weight is found with a linear time selection over the edge
+ * weights, rather than by sorting them. If several edges have the cutoff
+ * weight, those which come first (in order of their lowest end point) are
+ * retained, so the output graph has exactly nedges edges (or all of the
+ * edges of the input graph, if it has fewer). Edges with a weight of NaN
+ * are never retained.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_threshold_top(
+  graph_t *gin,     /**< weighted input graph                   */
+  graph_t *gout,    /**< pointer to an empty output graph       */
+  uint64_t nedges,  /**< number of edges to retain              */
+  uint8_t  absval,  /**< use absolute values for thresholding   */
+  uint8_t  reverse  /**< retain the edges with the smallest
+                         weights, instead of the largest        */
+);
+
+/**
+ * Creates a new graph from the weighted input graph, which has the given
+ * density (see stats_density), by retaining the edges with the largest
+ * weights (or the smallest, if reverse is set). See graph_threshold_top.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_threshold_density(
+  graph_t *gin,     /**< weighted input graph                   */
+  graph_t *gout,    /**< pointer to an empty output graph       */
+  double   density, /**< density of the output graph, 0.0 - 1.0 */
+  uint8_t  absval,  /**< use absolute values for thresholding   */
+  uint8_t  reverse  /**< retain the edges with the smallest
+                         weights, instead of the largest        */
+);
+
 /**
  * Removes the given number of edges using the given remove function.
  *
+ * If batch is 1 (or 0), the recalc function is called after every edge is
+ * removed, so each edge is chosen using up to date values. Otherwise, batch
+ * edges are removed using the same values (apart from those of the removed
+ * edges), and then the init function is called to recalculate every value.
+ * This is faster, but the result is not the same as removing one edge at a
+ * time.
+ *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t graph_threshold_edges(
@@ -51,6 +101,8 @@ uint8_t graph_threshold_edges(
   uint32_t  nedges,  /**< number of edges to remove                   */
   uint32_t  flags,   /**< Unused                                      */
   void     *opt,     /**< Unused                                      */
+  uint32_t  batch,   /**< number of edges to remove between each
+                          recalculation (see below)                   */
   uint8_t (*init)(   /**< function which does required initialisation */
     graph_t     *g),
   uint8_t (*remove)( /**< function which removes a single edge        */
@@ -76,6 +128,8 @@ uint8_t graph_threshold_components(
   uint32_t  cmplimit, /**< number of components to stop on               */
   uint32_t  igndis,   /**< ignore components below this size             */
   void     *opt,      /**< Unused                                        */
+  uint32_t  batch,    /**< number of edges to remove between each
+                           recalculation (see graph_threshold_edges)     */
   uint8_t (*init)(   /**< function which does required initialisation    */
     graph_t     *g), 
   uint8_t (*remove)( /**< function which removes a single edge        */
@@ -93,6 +147,11 @@ uint8_t graph_threshold_components(
  * Removes edges from the graph until the modularity is at its maximum
  * possible value. Removes at most the given number of edges.
  *
+ * Rather than taking a copy of the graph every time the modularity
+ * improves, the order in which edges are removed is recorded, and the
+ * output graph is reconstructed from the input graph once, at the end
+ * (see graph_threshold_replay).
+ *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t graph_threshold_modularity(
@@ -104,6 +163,8 @@ uint8_t graph_threshold_modularity(
                             mod_opt_t struct - memory is allocated to 
                             store the modularity value and number of 
                             components after each edge has been removed   */
+  uint32_t  batch,     /**< number of edges to remove between each
+                            recalculation (see graph_threshold_edges)     */
   uint8_t (*init)(     /**< function which does required initialisation   */
     graph_t     *g), 
   uint8_t (*remove)( /**< function which removes a single edge            */
@@ -119,7 +180,9 @@ uint8_t graph_threshold_modularity(
 
 /**
  * Removes edges from the graph until the chira fitness is at its maximum
- * possible value. Removes at most the given number of edges.
+ * possible value. Removes at most the given number of edges. The output
+ * graph is reconstructed in the same way as for
+ * graph_threshold_modularity.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -132,6 +195,8 @@ uint8_t graph_threshold_chira(
                             mod_opt_t struct - memory is allocated to 
                             store the chira value and number of 
                             components after each edge has been removed   */
+  uint32_t  batch,     /**< number of edges to remove between each
+                            recalculation (see graph_threshold_edges)     */
   uint8_t (*init)(     /**< function which does required initialisation   */
     graph_t     *g), 
   uint8_t (*remove)( /**< function which removes a single edge            */
@@ -145,6 +210,28 @@ uint8_t graph_threshold_chira(
     graph_edge_t *edge) /**< end point of edge which was removed */
 );
 
+/**
+ * Enables or disables checkpointing of graph_threshold_edges,
+ * graph_threshold_components, graph_threshold_modularity and
+ * graph_threshold_chira. When enabled, the sequence of removed edges, and
+ * the state of the default random number generator, are saved to the
+ * given file at most once every interval seconds, just before the edge
+ * values are recalculated. The file is replaced atomically, so it always
+ * holds a complete checkpoint.
+ *
+ * If the file already exists when one of these functions is called, the
+ * removals recorded in it are replayed, the edge values are calculated
+ * from scratch, and edge removal continues from that point; if the file
+ * was saved for a different graph, the function fails. The function must
+ * be called with the same arguments as the run which saved the file. The
+ * file is not deleted when the function finishes - that is up to the
+ * caller. This setting applies to all subsequent calls, on any graph.
+ */
+void graph_threshold_checkpoint(
+  char    *fname,   /**< checkpoint file, or NULL to disable */
+  uint32_t interval /**< minimum seconds between saves       */
+);
+
 /**
  * Peforms any initialisation required for graph thresholding via
  * path-sharing (e.g. initial calculation/caching of path-sharing values).
@@ -178,6 +265,19 @@ uint8_t graph_recalculate_pathsharing(
   graph_edge_t *edge /**< edge which was removed */
 );
 
+/**
+ * Enables or disables approximate edge-betweenness thresholding. If nsamples
+ * is non-zero, graph_init_edge_betweenness and
+ * graph_recalculate_edge_betweenness estimate the edge betweenness of every
+ * edge from nsamples randomly selected source nodes (see
+ * stats_approx_edge_betweenness), rather than calculating exact values.
+ * This setting applies to all subsequent calls, on any graph.
+ */
+void graph_approx_edge_betweenness(
+  uint32_t nsamples /**< number of source nodes to sample, or 0 for
+                         exact values                              */
+);
+
 /**
  * Peforms any initialisation required for graph thresholding via
  * edge-betweenness.
@@ -211,4 +311,20 @@ uint8_t graph_recalculate_edge_betweenness(
   graph_edge_t *edge /**< edge which was removed */
 );
 
+/**
+ * Creates a copy of the input graph with the given edges removed, e.g. the
+ * first n edges removed by graph_threshold_modularity (see mod_opt_t). The
+ * edges are sorted, and are all left out in one pass with
+ * graph_copy_filtered, rather than being removed one by one. Edges which
+ * are not in the input graph are ignored.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_threshold_replay(
+  graph_t      *gin,     /**< input graph                              */
+  graph_t      *gout,    /**< pointer to an uninitialised output graph */
+  graph_edge_t *removed, /**< edges to remove                          */
+  uint64_t      nremoved /**< number of edges to remove                */
+);
+
 #endif /* __GRAPH_THRESHOLD_H__ */
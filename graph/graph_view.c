@@ -0,0 +1,301 @@
+/**
+ * Lightweight subgraph views.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_view.h"
+#include "graph/graph_builder.h"
+
+/**
+ * \return non-0 if the given parent node is in the view, 0 otherwise.
+ */
+static uint8_t _in_view(
+  graph_view_t *v, /**< the view       */
+  uint32_t      n  /**< parent node ID */
+);
+
+/**
+ * Counts the edges between the nodes of the given view, and stores the
+ * count in the view.
+ */
+static void _count_edges(
+  graph_view_t *v /**< the view */
+);
+
+uint8_t graph_view_create(graph_view_t *v, graph_t *g, uint8_t *mask) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  memset(v, 0, sizeof(graph_view_t));
+
+  if (graph_is_directed(g)) goto fail;
+
+  nnodes = graph_num_nodes(g);
+  v->g   = g;
+
+  v->map   = malloc(nnodes * sizeof(uint32_t));
+  v->nodes = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  if (v->map   == NULL && nnodes > 0) goto fail;
+  if (v->nodes == NULL)               goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (!mask[i]) {
+      v->map[i] = GRAPH_VIEW_NONE;
+      continue;
+    }
+
+    v->map[i]               = v->numnodes;
+    v->nodes[v->numnodes++] = i;
+  }
+
+  _count_edges(v);
+
+  return 0;
+
+fail:
+  graph_view_free(v);
+  return 1;
+}
+
+uint8_t graph_view_partition(
+  graph_view_t *views, graph_t *g, uint32_t *parts, uint32_t nparts) {
+
+  uint64_t  i;
+  uint32_t  p;
+  uint32_t  nnodes;
+  uint32_t *map;
+  uint32_t *sizes;
+
+  map   = NULL;
+  sizes = NULL;
+  memset(views, 0, nparts * sizeof(graph_view_t));
+
+  if (graph_is_directed(g)) goto fail;
+  if (nparts == 0)          goto fail;
+
+  nnodes = graph_num_nodes(g);
+
+  map   = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  sizes = calloc(nparts, sizeof(uint32_t));
+  if (map   == NULL) goto fail;
+  if (sizes == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    p = parts[i];
+
+    if (p == GRAPH_VIEW_NONE) {
+      map[i] = GRAPH_VIEW_NONE;
+      continue;
+    }
+    if (p >= nparts) goto fail;
+
+    map[i] = sizes[p]++;
+  }
+
+  for (p = 0; p < nparts; p++) {
+
+    views[p].g     = g;
+    views[p].map   = map;
+    views[p].parts = parts;
+    views[p].part  = p;
+    views[p].nodes = malloc((sizes[p] > 0 ? sizes[p] : 1) *
+                            sizeof(uint32_t));
+
+    if (views[p].nodes == NULL) goto fail;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    p = parts[i];
+    if (p == GRAPH_VIEW_NONE) continue;
+
+    views[p].nodes[views[p].numnodes++] = i;
+  }
+
+  for (p = 0; p < nparts; p++) _count_edges(views + p);
+
+  free(sizes);
+  return 0;
+
+fail:
+  if (sizes != NULL) free(sizes);
+  if (views[0].map == NULL && map != NULL) free(map);
+  graph_view_partition_free(views, nparts);
+  return 1;
+}
+
+void graph_view_partition_free(graph_view_t *views, uint32_t nparts) {
+
+  uint64_t i;
+
+  if (views  == NULL) return;
+  if (nparts == 0)    return;
+
+  if (views[0].map != NULL) free(views[0].map);
+
+  for (i = 0; i < nparts; i++) {
+    if (views[i].nodes != NULL) free(views[i].nodes);
+    memset(views + i, 0, sizeof(graph_view_t));
+  }
+}
+
+void graph_view_free(graph_view_t *v) {
+
+  if (v == NULL) return;
+
+  if (v->map   != NULL) free(v->map);
+  if (v->nodes != NULL) free(v->nodes);
+
+  memset(v, 0, sizeof(graph_view_t));
+}
+
+uint32_t graph_view_num_nodes(graph_view_t *v) {
+  return v->numnodes;
+}
+
+uint32_t graph_view_num_edges(graph_view_t *v) {
+  return v->numedges;
+}
+
+uint32_t graph_view_parent_id(graph_view_t *v, uint32_t u) {
+  return v->nodes[u];
+}
+
+graph_label_t * graph_view_get_nodelabel(graph_view_t *v, uint32_t u) {
+  return graph_get_nodelabel(v->g, v->nodes[u]);
+}
+
+uint32_t graph_view_max_neighbours(graph_view_t *v, uint32_t u) {
+  return graph_num_neighbours(v->g, v->nodes[u]);
+}
+
+uint32_t graph_view_get_neighbours(
+  graph_view_t *v, uint32_t u, uint32_t *nbrs, float *wts) {
+
+  uint64_t  i;
+  uint32_t  n;
+  uint32_t  nnbrs;
+  uint32_t *gnbrs;
+  float    *gwts;
+
+  nnbrs = graph_num_neighbours(v->g, v->nodes[u]);
+  gnbrs = graph_get_neighbours(v->g, v->nodes[u]);
+  gwts  = graph_get_weights(   v->g, v->nodes[u]);
+
+  /*
+   * view IDs are assigned in the order of parent IDs,
+   * so remapping a sorted list keeps it sorted
+   */
+  for (i = 0, n = 0; i < nnbrs; i++) {
+
+    if (!_in_view(v, gnbrs[i])) continue;
+
+    nbrs[n] = v->map[gnbrs[i]];
+    if (wts != NULL) wts[n] = gwts[i];
+    n++;
+  }
+
+  return n;
+}
+
+uint8_t graph_view_materialise(graph_view_t *v, graph_t *gout) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nnbrs;
+  uint32_t        maxnbrs;
+  uint32_t       *nbrs;
+  float          *wts;
+  double         *dwts;
+  uint8_t         created;
+  graph_builder_t builder;
+
+  nbrs    = NULL;
+  wts     = NULL;
+  dwts    = NULL;
+  created = 0;
+  memset(&builder, 0, sizeof(graph_builder_t));
+
+  if (graph_create(gout, v->numnodes, 0)) goto fail;
+  created = 1;
+
+  maxnbrs = 1;
+  for (i = 0; i < v->numnodes; i++) {
+    nnbrs = graph_view_max_neighbours(v, i);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  nbrs = malloc(maxnbrs * sizeof(uint32_t));
+  wts  = malloc(maxnbrs * sizeof(float));
+  dwts = malloc(maxnbrs * sizeof(double));
+  if (nbrs == NULL) goto fail;
+  if (wts  == NULL) goto fail;
+  if (dwts == NULL) goto fail;
+
+  if (graph_builder_init(&builder, gout, 1)) goto fail;
+
+  for (i = 0; i < v->numnodes; i++) {
+
+    if (graph_copy_nodelabel(v->g, graph_view_parent_id(v, i), gout, i))
+      goto fail;
+
+    nnbrs = graph_view_get_neighbours(v, i, nbrs, wts);
+
+    for (j = 0; j < nnbrs; j++) dwts[j] = wts[j];
+
+    if (graph_builder_set_neighbours(&builder, i, nnbrs, nbrs, dwts))
+      goto fail;
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(nbrs);
+  free(wts);
+  free(dwts);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  if (nbrs != NULL) free(nbrs);
+  if (wts  != NULL) free(wts);
+  if (dwts != NULL) free(dwts);
+  if (created)      graph_free(gout);
+  return 1;
+}
+
+uint8_t _in_view(graph_view_t *v, uint32_t n) {
+
+  if (v->parts != NULL) return v->parts[n] == v->part;
+  return v->map[n] != GRAPH_VIEW_NONE;
+}
+
+void _count_edges(graph_view_t *v) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+
+  v->numedges = 0;
+
+  /*each edge is counted once, at its low end point*/
+  for (i = 0; i < v->numnodes; i++) {
+
+    nnbrs = graph_num_neighbours(v->g, v->nodes[i]);
+    nbrs  = graph_get_neighbours(v->g, v->nodes[i]);
+
+    for (j = 0; j < nnbrs; j++) {
+      if (nbrs[j] > v->nodes[i] && _in_view(v, nbrs[j]))
+        v->numedges++;
+    }
+  }
+}
@@ -0,0 +1,169 @@
+/**
+ * Lightweight subgraph views. A graph_view_t selects a subset of the nodes
+ * of a parent graph, and presents them, along with the edges between them,
+ * as a graph with nodes numbered from 0, without copying any adjacency -
+ * neighbour lists are read from the parent, and remapped, on demand. A
+ * view costs two integers per parent node, so many regions of one large
+ * graph can be extracted and inspected cheaply; a view may be written to
+ * file directly with ngdb_write_view (see io/ngdb_graph.h), and is
+ * materialised into a real graph_t with graph_view_materialise only when
+ * one is needed, e.g. for mutation, or for the stats functions.
+ *
+ * The parent graph must be undirected, and must not be modified while the
+ * view exists. It may be frozen.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __GRAPH_VIEW_H__
+#define __GRAPH_VIEW_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Value in the map array of a graph_view_t for parent nodes which are not
+ * in the view.
+ */
+#define GRAPH_VIEW_NONE 0xFFFFFFFF
+
+/**
+ * Subgraph view handle.
+ */
+typedef struct _graph_view {
+
+  graph_t  *g;        /**< parent graph                                 */
+  uint32_t  numnodes; /**< number of nodes in the view                  */
+  uint32_t  numedges; /**< number of edges between nodes in the view    */
+  uint32_t *nodes;    /**< parent ID of each view node, in ascending
+                           order                                        */
+  uint32_t *map;      /**< view ID of each parent node, or
+                           GRAPH_VIEW_NONE                              */
+  uint32_t *parts;    /**< for views created by graph_view_partition,
+                           the partition of each parent node, shared
+                           with the other views, in which case map is
+                           also shared; NULL otherwise                  */
+  uint32_t  part;     /**< partition of this view, if parts is set      */
+
+} graph_view_t;
+
+/**
+ * Creates a view of the nodes of the given graph which have a non-0 value
+ * in the mask array (see graph_mask, in graph/graph_mask.h). Nodes keep
+ * their relative order.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t graph_view_create(
+  graph_view_t *v,   /**< view to initialise                       */
+  graph_t      *g,   /**< parent graph                             */
+  uint8_t      *mask /**< one value for every node in g - non-0 to
+                          include the node in the view             */
+);
+
+/**
+ * Creates one view for every partition of the nodes of the given graph, in
+ * a single pass over the graph. As each parent node is in at most one
+ * partition, all of the views share one map array, so a partition costs
+ * little more than the list of its nodes, regardless of the size of the
+ * parent graph. The views must be freed together with
+ * graph_view_partition_free.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t graph_view_partition(
+  graph_view_t *views,  /**< space for nparts views to initialise        */
+  graph_t      *g,      /**< parent graph                                */
+  uint32_t     *parts,  /**< one value for every node in g - the
+                             partition of the node, in the range
+                             [0, nparts), or GRAPH_VIEW_NONE to leave
+                             the node out of all views. Not copied - must
+                             not be modified until the views are freed.  */
+  uint32_t      nparts  /**< number of partitions                        */
+);
+
+/**
+ * Frees the memory used by views created by graph_view_partition.
+ */
+void graph_view_partition_free(
+  graph_view_t *views, /**< the views         */
+  uint32_t      nparts /**< number of views   */
+);
+
+/**
+ * Frees the memory used by the given view. The parent graph is not
+ * affected. Must not be used on views created by graph_view_partition.
+ */
+void graph_view_free(
+  graph_view_t *v /**< the view */
+);
+
+/**
+ * \return the number of nodes in the view.
+ */
+uint32_t graph_view_num_nodes(
+  graph_view_t *v /**< the view */
+);
+
+/**
+ * \return the number of edges in the view.
+ */
+uint32_t graph_view_num_edges(
+  graph_view_t *v /**< the view */
+);
+
+/**
+ * \return the ID, in the parent graph, of the given view node.
+ */
+uint32_t graph_view_parent_id(
+  graph_view_t *v, /**< the view      */
+  uint32_t      u  /**< view node ID  */
+);
+
+/**
+ * \return the label of the given view node (the label of the node in the
+ * parent graph).
+ */
+graph_label_t * graph_view_get_nodelabel(
+  graph_view_t *v, /**< the view      */
+  uint32_t      u  /**< view node ID  */
+);
+
+/**
+ * \return an upper bound on the number of neighbours of the given view
+ * node - the number of neighbours of the node in the parent graph. Use
+ * this to size the buffers passed to graph_view_get_neighbours.
+ */
+uint32_t graph_view_max_neighbours(
+  graph_view_t *v, /**< the view      */
+  uint32_t      u  /**< view node ID  */
+);
+
+/**
+ * Copies the neighbours of the given view node, as view node IDs in
+ * ascending order, and the corresponding edge weights, into the given
+ * buffers, which must have space for graph_view_max_neighbours values.
+ *
+ * \return the number of neighbours of the node in the view.
+ */
+uint32_t graph_view_get_neighbours(
+  graph_view_t *v,    /**< the view                          */
+  uint32_t      u,    /**< view node ID                      */
+  uint32_t     *nbrs, /**< space to store neighbour IDs      */
+  float        *wts   /**< space to store weights, or NULL   */
+);
+
+/**
+ * Creates a new, undirected, graph which contains the nodes, labels and
+ * edges of the given view.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t graph_view_materialise(
+  graph_view_t *v,   /**< the view                   */
+  graph_t      *gout /**< uninitialised output graph */
+);
+
+#endif /* __GRAPH_VIEW_H__ */
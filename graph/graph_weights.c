@@ -0,0 +1,370 @@
+/**
+ * Functions for finding the range and sum of, and rescaling, the edge
+ * weights of a graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <float.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define WEIGHTS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "graph/graph.h"
+#include "graph/graph_weights.h"
+
+/**
+ * Range kernel selected by _select_kernels.
+ */
+static void (*_range)(
+  float   *wts,
+  uint64_t n,
+  float   *min,
+  float   *max) = NULL;
+
+/**
+ * Sum kernel selected by _select_kernels.
+ */
+static double (*_sum)(
+  float   *wts,
+  uint64_t n) = NULL;
+
+/**
+ * Scaling kernel selected by _select_kernels.
+ */
+static void (*_scale)(
+  float   *wts,
+  uint64_t n,
+  double   oldlo,
+  double   scale,
+  double   newlo) = NULL;
+
+/**
+ * Ensures that _select_kernels is only called once.
+ */
+static pthread_once_t _kernels_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Sets the _range and _scale pointers, according to the instructions
+ * supported by the processor.
+ */
+static void _select_kernels(void);
+
+/**
+ * Portable range kernel. Written so that the compiler can vectorise it.
+ */
+static void _range_scalar(
+  float   *wts, /**< the weights                */
+  uint64_t n,   /**< number of weights          */
+  float   *min, /**< place to store the minimum */
+  float   *max  /**< place to store the maximum */
+);
+
+/**
+ * Portable sum kernel - four partial sums, in the same order as the AVX
+ * kernel.
+ */
+static double _sum_scalar(
+  float   *wts, /**< the weights       */
+  uint64_t n    /**< number of weights */
+);
+
+/**
+ * Portable scaling kernel.
+ */
+static double _sum_scalar(float *wts, uint64_t n) {
+
+  uint64_t i;
+  double   s[4];
+  double   sum;
+
+  s[0] = s[1] = s[2] = s[3] = 0;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    s[0] += wts[i];
+    s[1] += wts[i + 1];
+    s[2] += wts[i + 2];
+    s[3] += wts[i + 3];
+  }
+
+  sum = (s[0] + s[1]) + (s[2] + s[3]);
+
+  for (; i < n; i++) sum += wts[i];
+
+  return sum;
+}
+
+void _scale_scalar(
+  float   *wts,   /**< the weights                     */
+  uint64_t n,     /**< number of weights               */
+  double   oldlo, /**< old minimum value               */
+  double   scale, /**< ratio of new range to old range */
+  double   newlo  /**< new minimum value               */
+);
+
+#ifdef WEIGHTS_X86_SIMD
+/**
+ * AVX range kernel - eight weights at a time.
+ */
+static void _range_avx(
+  float   *wts,
+  uint64_t n,
+  float   *min,
+  float   *max
+) __attribute__((target("avx")));
+
+/**
+ * AVX sum kernel - four weights at a time, converted to double precision.
+ */
+static double _sum_avx(
+  float   *wts,
+  uint64_t n
+) __attribute__((target("avx")));
+
+/**
+ * AVX scaling kernel - eight weights at a time, converted to double
+ * precision four at a time. FMA is deliberately not enabled, as a fused
+ * multiply-add would round differently to the scalar kernel.
+ */
+static double _sum_avx(float *wts, uint64_t n) {
+
+  uint64_t i;
+  double   s[4];
+  double   sum;
+  __m256d  acc;
+
+  acc = _mm256_setzero_pd();
+
+  for (i = 0; i + 4 <= n; i += 4)
+    acc = _mm256_add_pd(acc, _mm256_cvtps_pd(_mm_loadu_ps(wts + i)));
+
+  _mm256_storeu_pd(s, acc);
+
+  sum = (s[0] + s[1]) + (s[2] + s[3]);
+
+  for (; i < n; i++) sum += wts[i];
+
+  return sum;
+}
+
+void _scale_avx(
+  float   *wts,
+  uint64_t n,
+  double   oldlo,
+  double   scale,
+  double   newlo
+) __attribute__((target("avx")));
+#endif
+
+void graph_weights_range(float *wts, uint64_t n, float *min, float *max) {
+
+  pthread_once(&_kernels_once, _select_kernels);
+
+  _range(wts, n, min, max);
+}
+
+double graph_weights_sum(float *wts, uint64_t n) {
+
+  pthread_once(&_kernels_once, _select_kernels);
+
+  return _sum(wts, n);
+}
+
+void graph_weights_scale(
+  float   *wts,
+  uint64_t n,
+  double   oldlo,
+  double   oldhi,
+  double   newlo,
+  double   newhi) {
+
+  pthread_once(&_kernels_once, _select_kernels);
+
+  _scale(wts, n, oldlo, (newhi - newlo) / (oldhi - oldlo), newlo);
+}
+
+void graph_weight_range(graph_t *g, double *min, double *max) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t nnbrs;
+  float   *wts;
+  float    lo;
+  float    hi;
+
+  *min =  DBL_MAX;
+  *max = -DBL_MAX;
+
+  nnodes = graph_num_nodes(g);
+
+  if (graph_is_frozen(g)) {
+
+    if (g->csroffsets[nnodes] == 0) return;
+
+    graph_weights_range(g->csrwts, g->csroffsets[nnodes], &lo, &hi);
+
+    if (lo <= hi) {
+      *min = lo;
+      *max = hi;
+    }
+    return;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    wts   = graph_get_weights   (g, i);
+
+    if (nnbrs == 0 || wts == NULL) continue;
+
+    graph_weights_range(wts, nnbrs, &lo, &hi);
+
+    if (lo > hi) continue;
+
+    if (lo < *min) *min = lo;
+    if (hi > *max) *max = hi;
+  }
+}
+
+void graph_normalise_weights(
+  graph_t *g, double oldlo, double oldhi, double newlo, double newhi) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t nnbrs;
+  float   *wts;
+
+  nnodes = graph_num_nodes(g);
+
+  if (graph_is_frozen(g)) {
+
+    graph_weights_scale(
+      g->csrwts, g->csroffsets[nnodes], oldlo, oldhi, newlo, newhi);
+    return;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    wts   = graph_get_weights   (g, i);
+
+    if (nnbrs == 0 || wts == NULL) continue;
+
+    graph_weights_scale(wts, nnbrs, oldlo, oldhi, newlo, newhi);
+  }
+}
+
+void _select_kernels(void) {
+
+  _range = _range_scalar;
+  _sum   = _sum_scalar;
+  _scale = _scale_scalar;
+
+#ifdef WEIGHTS_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx")) {
+    _range = _range_avx;
+    _sum   = _sum_avx;
+    _scale = _scale_avx;
+  }
+#endif
+}
+
+void _range_scalar(float *wts, uint64_t n, float *min, float *max) {
+
+  uint64_t i;
+  float    lo;
+  float    hi;
+
+  lo =  FLT_MAX;
+  hi = -FLT_MAX;
+
+  /*comparisons with NaN are false, so NaNs are skipped*/
+  for (i = 0; i < n; i++) {
+    lo = (wts[i] < lo) ? wts[i] : lo;
+    hi = (wts[i] > hi) ? wts[i] : hi;
+  }
+
+  *min = lo;
+  *max = hi;
+}
+
+void _scale_scalar(
+  float *wts, uint64_t n, double oldlo, double scale, double newlo) {
+
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    wts[i] = (wts[i] - oldlo) * scale + newlo;
+}
+
+#ifdef WEIGHTS_X86_SIMD
+void _range_avx(float *wts, uint64_t n, float *min, float *max) {
+
+  uint64_t i;
+  float    lo;
+  float    hi;
+  float    lanes[8];
+  __m256   vlo;
+  __m256   vhi;
+  __m256   w;
+
+  vlo = _mm256_set1_ps( FLT_MAX);
+  vhi = _mm256_set1_ps(-FLT_MAX);
+
+  /*
+   * min/max return their second operand if either is
+   * NaN, so passing the running value second skips NaNs
+   */
+  for (i = 0; i + 8 <= n; i += 8) {
+
+    w   = _mm256_loadu_ps(wts + i);
+    vlo = _mm256_min_ps(w, vlo);
+    vhi = _mm256_max_ps(w, vhi);
+  }
+
+  _range_scalar(wts + i, n - i, &lo, &hi);
+
+  _mm256_storeu_ps(lanes, vlo);
+  for (i = 0; i < 8; i++) lo = (lanes[i] < lo) ? lanes[i] : lo;
+
+  _mm256_storeu_ps(lanes, vhi);
+  for (i = 0; i < 8; i++) hi = (lanes[i] > hi) ? lanes[i] : hi;
+
+  *min = lo;
+  *max = hi;
+}
+
+void _scale_avx(
+  float *wts, uint64_t n, double oldlo, double scale, double newlo) {
+
+  uint64_t i;
+  __m256d  vlo;
+  __m256d  vscale;
+  __m256d  vnewlo;
+  __m256d  a;
+  __m256d  b;
+
+  vlo    = _mm256_set1_pd(oldlo);
+  vscale = _mm256_set1_pd(scale);
+  vnewlo = _mm256_set1_pd(newlo);
+
+  for (i = 0; i + 8 <= n; i += 8) {
+
+    a = _mm256_cvtps_pd(_mm_loadu_ps(wts + i));
+    b = _mm256_cvtps_pd(_mm_loadu_ps(wts + i + 4));
+
+    a = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(a, vlo), vscale), vnewlo);
+    b = _mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(b, vlo), vscale), vnewlo);
+
+    _mm_storeu_ps(wts + i,     _mm256_cvtpd_ps(a));
+    _mm_storeu_ps(wts + i + 4, _mm256_cvtpd_ps(b));
+  }
+
+  _scale_scalar(wts + i, n - i, oldlo, scale, newlo);
+}
+#endif
@@ -0,0 +1,78 @@
+/**
+ * Functions for finding the range and sum of, and rescaling, the edge
+ * weights of a graph. The weights are processed an array at a time - the
+ * weight list of each node or, for a frozen graph, the single CSR weight
+ * array - with vectorised kernels where the processor supports them.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef GRAPH_WEIGHTS_H
+#define GRAPH_WEIGHTS_H
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Finds the minimum and maximum of the given weights. NaN values are
+ * ignored. If there are no (non-NaN) weights, min is set to FLT_MAX, and
+ * max to -FLT_MAX.
+ */
+void graph_weights_range(
+  float   *wts, /**< the weights                 */
+  uint64_t n,   /**< number of weights           */
+  float   *min, /**< place to store the minimum  */
+  float   *max  /**< place to store the maximum  */
+);
+
+/**
+ * \return the sum of the given weights. The sum is accumulated in double
+ * precision, in four interleaved partial sums which are combined at the
+ * end, by both the scalar and the vectorised kernel, so the result does
+ * not depend on which kernel is used.
+ */
+double graph_weights_sum(
+  float   *wts, /**< the weights       */
+  uint64_t n    /**< number of weights */
+);
+
+/**
+ * Rescales the given weights, in place, from the old range to the new
+ * range - each weight w becomes (w - oldlo) * scale + newlo, where scale is
+ * (newhi - newlo) / (oldhi - oldlo). The arithmetic is performed in double
+ * precision, so the result does not depend on whether the vectorised
+ * kernel is used.
+ */
+void graph_weights_scale(
+  float   *wts,   /**< the weights       */
+  uint64_t n,     /**< number of weights */
+  double   oldlo, /**< old minimum value */
+  double   oldhi, /**< old maximum value */
+  double   newlo, /**< new minimum value */
+  double   newhi  /**< new maximum value */
+);
+
+/**
+ * Finds the minimum and maximum edge weights of the given graph. If the
+ * graph has no edges, min is set to DBL_MAX, and max to -DBL_MAX.
+ */
+void graph_weight_range(
+  graph_t *g,   /**< the graph                          */
+  double  *min, /**< place to store minimum edge weight */
+  double  *max  /**< place to store maximum edge weight */
+);
+
+/**
+ * Rescales all of the edge weights in the given graph from the old range
+ * (oldlo,oldhi) to the new range (newlo,newhi). The weights of both
+ * directions of an undirected edge are rescaled.
+ */
+void graph_normalise_weights(
+  graph_t *g,     /**< the graph         */
+  double   oldlo, /**< old minimum value */
+  double   oldhi, /**< old maximum value */
+  double   newlo, /**< new minimum value */
+  double   newhi  /**< new maximum value */
+);
+
+#endif
@@ -10,12 +10,17 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "io/analyze75.h"
 #include "io/nifti1.h"
 #include "util/suffix.h"
 #include "util/filesize.h"
 #include "util/reverse.h"
+#include "util/profile.h"
+#include "util/ioqueue.h"
 
 /**
  * Reverses all header key fields.
@@ -32,6 +37,85 @@ static void _reverse_image_dimension(image_dimension_t *id);
  */
 static void _reverse_data_history(data_history_t *dh);
 
+/**
+ * Reads the given byte range of a file into the same offset of the given
+ * buffer, retrying on short reads.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _pread_all(
+  int      fd,  /**< file descriptor                   */
+  uint8_t *buf, /**< buffer holding the whole file     */
+  uint64_t off, /**< offset of range in file and buffer */
+  uint64_t len  /**< length of range                    */
+);
+
+/**
+ * Context for _load_one.
+ */
+typedef struct _load_ctx {
+
+  char    **files; /**< file names                 */
+  dsr_t    *hdrs;  /**< place to store headers     */
+  uint8_t **imgs;  /**< place to store image data  */
+
+} load_ctx_t;
+
+/**
+ * ioqueue_run function used by analyze_load_many, which loads one image.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _load_one(
+  uint64_t i,  /**< image index             */
+  void    *ctx /**< pointer to a load_ctx_t */
+);
+
+/**
+ * Number of values which are buffered at a time by analyze_scale_block,
+ * analyze_nanfix_block and analyze_replace_block.
+ */
+#define _BLOCK_BUF_VALS 1024
+
+
+/**
+ * Loop used by analyze_search_block for each datatype. The values, of the
+ * given type, are read from dvals, and converted to ctype, in which they
+ * are compared with the two ranges [l1, h1] and [l2, h2]; normal tests a
+ * converted value v. The loop is branch-free, so the compiler can
+ * vectorise it, and matching indices are compacted into idxs by always
+ * writing the current index, and only moving past it on a match.
+ */
+#define _SEARCH_LOOP(type, ctype, normal, l1, h1, l2, h2) do {           \
+    type    *d   = (type *)(dvals);                                       \
+    uint32_t nrm = 0;                                                     \
+    uint32_t cnt = 0;                                                     \
+    if (idxs == NULL) {                                                   \
+      for (i = 0; i < len; i++) {                                         \
+        ctype    v  = d[i];                                               \
+        uint32_t ok = (normal);                                           \
+        nrm += ok;                                                        \
+        cnt += ok & ((v >= (l1) && v <= (h1)) | (v >= (l2) && v <= (h2)));\
+      }                                                                   \
+    }                                                                     \
+    else {                                                                \
+      for (i = 0; i < len; i++) {                                         \
+        ctype    v  = d[i];                                               \
+        uint32_t ok = (normal);                                           \
+        nrm += ok;                                                        \
+        idxs[count + cnt] = idx + i;                                      \
+        cnt += ok & ((v >= (l1) && v <= (h1)) | (v >= (l2) && v <= (h2)));\
+      }                                                                   \
+    }                                                                     \
+    nnorm += nrm;                                                         \
+    count += cnt;                                                         \
+  } while (0)
+
+/**
+ * Bounds on the integer comparison range used by analyze_search_block; wide
+ * enough for any integral datatype, and exactly representable as a double.
+ */
+#define _SEARCH_INT_LIMIT 4611686018427387904.0
 
 uint16_t analyze_datatype(dsr_t *hdr) {
 
@@ -221,6 +305,8 @@ uint8_t analyze_load_hdr(char *file, dsr_t *dsr) {
 
   if (fread(bytes, 1, sz, f) != sz) goto fail;
 
+  PROFILE_COUNT(PROFILE_ANALYZE_READ, sz);
+
   memcpy(dsr, bytes, sz);
 
   if (dsr->dime.dim[0] > 7) {
@@ -273,6 +359,8 @@ uint8_t analyze_write_img(char *filename, dsr_t *hdr, uint8_t *img) {
 
   if (fwrite(img, 1, nvals*valsz, fd) != nvals*valsz) goto fail;
 
+  PROFILE_COUNT(PROFILE_ANALYZE_WRITTEN, nvals*valsz);
+
   fclose(fd);
   free(filename);
   return 0;
@@ -302,6 +390,8 @@ uint8_t analyze_write_hdr(char *filename, dsr_t *hdr) {
   if (fd == NULL) goto fail;
 
   if (fwrite(&hdrcpy, 1, 348, fd) != 348) goto fail;
+
+  PROFILE_COUNT(PROFILE_ANALYZE_WRITTEN, 348);
   
   free(filename);
   fclose(fd);
@@ -468,6 +558,8 @@ uint8_t analyze_load(
 
     if (fread(*data, 1, sz, f) != sz) goto fail;
 
+    PROFILE_COUNT(PROFILE_ANALYZE_READ, sz);
+
     fclose(f);
   }
 
@@ -482,6 +574,222 @@ fail:
   return 1;
 }
 
+uint8_t analyze_load_many(
+  uint32_t  n,
+  char    **files,
+  dsr_t    *hdrs,
+  uint8_t **imgs,
+  uint16_t  window)
+{
+  uint64_t   i;
+  load_ctx_t ctx;
+
+  for (i = 0; i < n; i++) imgs[i] = NULL;
+
+  ctx.files = files;
+  ctx.hdrs  = hdrs;
+  ctx.imgs  = imgs;
+
+  if (ioqueue_run(n, window, &ctx, _load_one)) goto fail;
+
+  return 0;
+
+fail:
+  for (i = 0; i < n; i++) {
+    if (imgs[i] != NULL) free(imgs[i]);
+    imgs[i] = NULL;
+  }
+  return 1;
+}
+
+uint8_t _load_one(uint64_t i, void *vctx) {
+
+  load_ctx_t *ctx;
+
+  ctx = vctx;
+
+  return analyze_load(ctx->files[i], ctx->hdrs + i, ctx->imgs + i);
+}
+
+uint8_t analyze_load_mmap(
+  char     *filename,
+  dsr_t    *hdr,
+  uint8_t **data,
+  uint8_t   advice)
+{
+  FILE       *f;
+  char       *afilename;
+  void       *map;
+  uint64_t    sz;
+  struct stat st;
+
+  f         = NULL;
+  afilename = NULL;
+  *data     = NULL;
+
+  if (filename == NULL)                goto fail;
+  if (analyze_load_hdr(filename, hdr)) goto fail;
+
+  afilename = set_suffix(filename, "img");
+  if (afilename == NULL) goto fail;
+
+  f = fopen(afilename, (advice & ANALYZE_MAP_SHARED) ? "r+b" : "rb");
+  if (f == NULL) goto fail;
+
+  if (fstat(fileno(f), &st)) goto fail;
+
+  sz = (uint64_t)analyze_value_size(hdr) * analyze_num_vals(hdr);
+  if (sz == 0 || st.st_size != sz) goto fail;
+
+  map = mmap(NULL,
+             sz,
+             PROT_READ | PROT_WRITE,
+             (advice & ANALYZE_MAP_SHARED) ? MAP_SHARED : MAP_PRIVATE,
+             fileno(f),
+             0);
+  if (map == MAP_FAILED) goto fail;
+
+  if (advice & ANALYZE_MAP_SEQUENTIAL) madvise(map, sz, MADV_SEQUENTIAL);
+  if (advice & ANALYZE_MAP_WILLNEED)   madvise(map, sz, MADV_WILLNEED);
+
+  PROFILE_COUNT(PROFILE_ANALYZE_READ, sz);
+
+  /*the mapping stays valid after the file is closed*/
+  fclose(f);
+  free(afilename);
+
+  *data = map;
+  return 0;
+
+fail:
+  if (f         != NULL) fclose(f);
+  if (afilename != NULL) free(afilename);
+  return 1;
+}
+
+uint8_t analyze_load_part(
+  char     *filename,
+  dsr_t    *hdr,
+  uint8_t **data,
+  uint32_t *lo,
+  uint32_t *hi)
+{
+  FILE       *f;
+  char       *afilename;
+  struct stat st;
+  uint64_t    i;
+  uint64_t    t;
+  uint64_t    z;
+  uint64_t    dims[4];
+  uint64_t    valsize;
+  uint64_t    sz;
+  uint64_t    off;
+  uint64_t    len;
+  uint64_t    runoff;
+  uint64_t    runlen;
+  uint64_t    nread;
+
+  f         = NULL;
+  afilename = NULL;
+  *data     = NULL;
+
+  if (filename == NULL)                goto fail;
+  if (analyze_load_hdr(filename, hdr)) goto fail;
+  if (analyze_num_dims(hdr) < 3)       goto fail;
+  if (analyze_num_dims(hdr) > 4)       goto fail;
+
+  for (i = 0; i < 4; i++) {
+    dims[i] = analyze_dim_size(hdr, i);
+    if (dims[i] == 0) dims[i] = 1;
+  }
+
+  for (i = 0; i < 3; i++) {
+    if (lo[i] >= hi[i] || hi[i] > dims[i]) goto fail;
+  }
+
+  valsize = analyze_value_size(hdr);
+  sz      = valsize * dims[0] * dims[1] * dims[2] * dims[3];
+
+  afilename = set_suffix(filename, "img");
+  if (afilename == NULL) goto fail;
+
+  f = fopen(afilename, "rb");
+  if (f == NULL) goto fail;
+
+  if (fstat(fileno(f), &st)) goto fail;
+  if (sz == 0 || st.st_size != sz) goto fail;
+
+  *data = calloc(sz, 1);
+  if (*data == NULL) goto fail;
+
+  /*
+   * each z-slice of the box is one run, from (lo[0],lo[1])
+   * to (hi[0]-1,hi[1]-1); runs which are adjacent in the
+   * file are merged, and read with a single pread
+   */
+  len    = ((hi[1] - lo[1] - 1) * dims[0] + hi[0] - lo[0]) * valsize;
+  runoff = 0;
+  runlen = 0;
+  nread  = 0;
+
+  for (t = 0; t < dims[3]; t++) {
+    for (z = lo[2]; z < hi[2]; z++) {
+
+      off  = (((t * dims[2] + z) * dims[1] + lo[1]) * dims[0] + lo[0]);
+      off *= valsize;
+
+      if (runlen > 0 && runoff + runlen == off) {
+        runlen += len;
+        continue;
+      }
+
+      if (_pread_all(fileno(f), *data, runoff, runlen)) goto fail;
+
+      nread += runlen;
+      runoff = off;
+      runlen = len;
+    }
+  }
+
+  if (_pread_all(fileno(f), *data, runoff, runlen)) goto fail;
+
+  nread += runlen;
+
+  PROFILE_COUNT(PROFILE_ANALYZE_READ, nread);
+
+  fclose(f);
+  free(afilename);
+  return 0;
+
+fail:
+  if (f         != NULL) fclose(f);
+  if (afilename != NULL) free(afilename);
+  if (*data     != NULL) free(*data);
+  *data = NULL;
+  return 1;
+}
+
+uint8_t _pread_all(int fd, uint8_t *buf, uint64_t off, uint64_t len) {
+
+  uint64_t i;
+  ssize_t  r;
+
+  for (i = 0; i < len; i += r) {
+
+    r = pread(fd, buf + off + i, len - i, off + i);
+    if (r <= 0) return 1;
+  }
+
+  return 0;
+}
+
+void analyze_unmap(dsr_t *hdr, uint8_t *data) {
+
+  if (data == NULL) return;
+
+  munmap(data, (uint64_t)analyze_value_size(hdr) * analyze_num_vals(hdr));
+}
+
 void _reverse_header_key(header_key_t *d) {
 
   reverse(&(d->sizeof_hdr), 
@@ -676,6 +984,424 @@ void analyze_write_by_idx(
   }
 }
 
+void analyze_read_block(
+  dsr_t *hdr, uint8_t *img, uint32_t idx, uint32_t n, double *vals) {
+
+  uint32_t i;
+  uint8_t  valsz;
+
+  valsz = analyze_value_size(hdr);
+  img  += (uint64_t)valsz * idx;
+
+  /*byte-swapped data is handled one value at a time*/
+  if (hdr->rev) {
+    for (i = 0; i < n; i++) vals[i] = analyze_read_by_idx(hdr, img, i);
+    return;
+  }
+
+  switch (hdr->dime.datatype) {
+
+    case DT_UNSIGNED_CHAR: {
+      uint8_t *d = img;
+      for (i = 0; i < n; i++) vals[i] = d[i];
+      break;
+    }
+
+    case DT_SIGNED_SHORT: {
+      int16_t *d = (int16_t *)img;
+      for (i = 0; i < n; i++) vals[i] = d[i];
+      break;
+    }
+
+    case DT_SIGNED_INT: {
+      int32_t *d = (int32_t *)img;
+      for (i = 0; i < n; i++) vals[i] = d[i];
+      break;
+    }
+
+    case DT_FLOAT: {
+      float *d = (float *)img;
+      for (i = 0; i < n; i++) vals[i] = d[i];
+      break;
+    }
+
+    case DT_DOUBLE:
+      memcpy(vals, img, n * sizeof(double));
+      break;
+
+    default:
+      for (i = 0; i < n; i++) vals[i] = DBL_MAX;
+  }
+}
+
+void analyze_add_block(
+  dsr_t *hdr, uint8_t *img, uint32_t idx, uint32_t n, double *vals) {
+
+  uint32_t i;
+  uint8_t  valsz;
+
+  valsz = analyze_value_size(hdr);
+  img  += (uint64_t)valsz * idx;
+
+  if (hdr->rev) {
+    for (i = 0; i < n; i++) vals[i] += analyze_read_by_idx(hdr, img, i);
+    return;
+  }
+
+  switch (hdr->dime.datatype) {
+
+    case DT_UNSIGNED_CHAR: {
+      uint8_t *d = img;
+      for (i = 0; i < n; i++) vals[i] += d[i];
+      break;
+    }
+
+    case DT_SIGNED_SHORT: {
+      int16_t *d = (int16_t *)img;
+      for (i = 0; i < n; i++) vals[i] += d[i];
+      break;
+    }
+
+    case DT_SIGNED_INT: {
+      int32_t *d = (int32_t *)img;
+      for (i = 0; i < n; i++) vals[i] += d[i];
+      break;
+    }
+
+    case DT_FLOAT: {
+      float *d = (float *)img;
+      for (i = 0; i < n; i++) vals[i] += d[i];
+      break;
+    }
+
+    case DT_DOUBLE: {
+      double *d = (double *)img;
+      for (i = 0; i < n; i++) vals[i] += d[i];
+      break;
+    }
+
+    default:
+      for (i = 0; i < n; i++) vals[i] += DBL_MAX;
+  }
+}
+
+void analyze_write_block(
+  dsr_t *hdr, uint8_t *img, uint32_t idx, uint32_t n, double *vals) {
+
+  uint32_t i;
+  uint8_t  valsz;
+
+  valsz = analyze_value_size(hdr);
+  img  += (uint64_t)valsz * idx;
+
+  if (hdr->rev) {
+    for (i = 0; i < n; i++) analyze_write_by_idx(hdr, img, i, vals[i]);
+    return;
+  }
+
+  switch (hdr->dime.datatype) {
+
+    case DT_UNSIGNED_CHAR: {
+      uint8_t *d = img;
+      for (i = 0; i < n; i++) d[i] = (uint8_t)round(vals[i]);
+      break;
+    }
+
+    case DT_SIGNED_SHORT: {
+      int16_t *d = (int16_t *)img;
+      for (i = 0; i < n; i++) d[i] = (int16_t)round(vals[i]);
+      break;
+    }
+
+    case DT_SIGNED_INT: {
+      int32_t *d = (int32_t *)img;
+      for (i = 0; i < n; i++) d[i] = (int32_t)round(vals[i]);
+      break;
+    }
+
+    case DT_FLOAT: {
+      float *d = (float *)img;
+      for (i = 0; i < n; i++) d[i] = (float)vals[i];
+      break;
+    }
+
+    case DT_DOUBLE:
+      memcpy(img, vals, n * sizeof(double));
+      break;
+
+    default:
+      break;
+  }
+}
+
+void analyze_scale_block(
+  dsr_t *hdr, uint8_t *img, uint32_t idx, uint32_t n, double scale) {
+
+  uint32_t i;
+  uint32_t len;
+  double   buf[_BLOCK_BUF_VALS];
+
+  for (; n > 0; idx += len, n -= len) {
+
+    len = (n < _BLOCK_BUF_VALS) ? n : _BLOCK_BUF_VALS;
+
+    analyze_read_block(hdr, img, idx, len, buf);
+    for (i = 0; i < len; i++) buf[i] *= scale;
+    analyze_write_block(hdr, img, idx, len, buf);
+  }
+}
+
+uint32_t analyze_nanfix_block(
+  dsr_t *hdr, uint8_t *img, uint32_t idx, uint32_t n, double val) {
+
+  uint32_t i;
+  uint32_t len;
+  uint32_t nnan;
+  double   buf[_BLOCK_BUF_VALS];
+
+  if (hdr->dime.datatype != DT_FLOAT &&
+      hdr->dime.datatype != DT_DOUBLE)
+    return 0;
+
+  for (nnan = 0; n > 0; idx += len, n -= len) {
+
+    len = (n < _BLOCK_BUF_VALS) ? n : _BLOCK_BUF_VALS;
+
+    analyze_read_block(hdr, img, idx, len, buf);
+    for (i = 0; i < len; i++) {
+      if (isnan(buf[i])) {
+        analyze_write_by_idx(hdr, img, idx + i, val);
+        nnan++;
+      }
+    }
+  }
+
+  return nnan;
+}
+
+uint32_t analyze_replace_block(
+  dsr_t   *hdr,
+  uint8_t *img,
+  uint32_t idx,
+  uint32_t n,
+  double  *from,
+  double  *to,
+  uint16_t nreps) {
+
+  uint32_t i;
+  uint16_t j;
+  uint32_t len;
+  uint32_t nrep;
+  double   buf[_BLOCK_BUF_VALS];
+
+  for (nrep = 0; n > 0; idx += len, n -= len) {
+
+    len = (n < _BLOCK_BUF_VALS) ? n : _BLOCK_BUF_VALS;
+
+    analyze_read_block(hdr, img, idx, len, buf);
+    for (i = 0; i < len; i++) {
+      for (j = 0; j < nreps; j++) {
+        if (buf[i] == from[j]) {
+          analyze_write_by_idx(hdr, img, idx + i, to[j]);
+          nrep++;
+          break;
+        }
+      }
+    }
+  }
+
+  return nrep;
+}
+
+uint32_t analyze_search_block(
+  dsr_t    *hdr,
+  uint8_t  *img,
+  uint32_t  idx,
+  uint32_t  n,
+  double    lo,
+  double    hi,
+  uint8_t   absolute,
+  uint32_t *nnormal,
+  uint32_t *idxs) {
+
+  uint32_t i;
+  uint32_t len;
+  uint32_t count;
+  uint32_t nnorm;
+  uint8_t  valsz;
+  uint16_t datatype;
+  void    *dvals;
+  double   l1, h1, l2, h2;
+  int64_t  il1, ih1, il2, ih2;
+  double   buf[_BLOCK_BUF_VALS];
+
+  count    = 0;
+  nnorm    = 0;
+  valsz    = analyze_value_size(hdr);
+  datatype = hdr->dime.datatype;
+
+  /*
+   * |v| in [lo, hi] is tested as v in [lo, hi]
+   * or v in [-hi, -lo]; otherwise the second
+   * range is empty.
+   */
+  if (absolute) {
+    if (lo < 0) lo = 0;
+    l1 =  lo; h1 =  hi;
+    l2 = -hi; h2 = -lo;
+  }
+  else {
+    l1 = lo; h1 = hi;
+    l2 = 1;  h2 = 0;
+  }
+
+  /*byte-swapped data, and other datatypes, are converted a block at a time*/
+  if (hdr->rev || (datatype != DT_UNSIGNED_CHAR &&
+                   datatype != DT_SIGNED_SHORT  &&
+                   datatype != DT_SIGNED_INT    &&
+                   datatype != DT_FLOAT         &&
+                   datatype != DT_DOUBLE)) {
+    datatype = DT_DOUBLE;
+    valsz    = 0;
+  }
+
+  /*
+   * Integral values are compared as integers, against
+   * bounds which are rounded inwards. Empty ranges stay
+   * empty, as the rounding can only narrow them.
+   */
+  il1 = ceil( fmin(fmax(l1, -_SEARCH_INT_LIMIT), _SEARCH_INT_LIMIT));
+  il2 = ceil( fmin(fmax(l2, -_SEARCH_INT_LIMIT), _SEARCH_INT_LIMIT));
+  ih1 = floor(fmin(fmax(h1, -_SEARCH_INT_LIMIT), _SEARCH_INT_LIMIT));
+  ih2 = floor(fmin(fmax(h2, -_SEARCH_INT_LIMIT), _SEARCH_INT_LIMIT));
+
+  while (n > 0) {
+
+    if (valsz == 0) {
+      len   = (n < _BLOCK_BUF_VALS) ? n : _BLOCK_BUF_VALS;
+      dvals = buf;
+      analyze_read_block(hdr, img, idx, len, buf);
+    }
+    else {
+      len   = n;
+      dvals = img + (uint64_t)valsz * idx;
+    }
+
+    switch (datatype) {
+
+      case DT_UNSIGNED_CHAR:
+        _SEARCH_LOOP(uint8_t, int64_t, 1, il1, ih1, il2, ih2);
+        break;
+
+      case DT_SIGNED_SHORT:
+        _SEARCH_LOOP(int16_t, int64_t, 1, il1, ih1, il2, ih2);
+        break;
+
+      case DT_SIGNED_INT:
+        _SEARCH_LOOP(int32_t, int64_t, 1, il1, ih1, il2, ih2);
+        break;
+
+      /*a float is never subnormal once converted to double*/
+      case DT_FLOAT:
+        _SEARCH_LOOP(float, double, fabs(v) <= DBL_MAX, l1, h1, l2, h2);
+        break;
+
+      case DT_DOUBLE:
+        _SEARCH_LOOP(double, double,
+          (v == 0) | ((fabs(v) >= DBL_MIN) & (fabs(v) <= DBL_MAX)),
+          l1, h1, l2, h2);
+        break;
+    }
+
+    idx += len;
+    n   -= len;
+  }
+
+  if (nnormal != NULL) *nnormal = nnorm;
+
+  return count;
+}
+
+uint8_t analyze_copy_box(
+  dsr_t    *srchdr,
+  uint8_t  *srcimg,
+  uint32_t *srcstart,
+  dsr_t    *dsthdr,
+  uint8_t  *dstimg,
+  uint32_t *dststart,
+  uint32_t *size) {
+
+  uint8_t  i;
+  uint8_t  ndims;
+  uint8_t  valsz;
+  uint32_t idx[8];
+  uint64_t srcstride[8];
+  uint64_t dststride[8];
+  uint64_t srcoff;
+  uint64_t dstoff;
+  uint64_t rowsz;
+
+  ndims = analyze_num_dims(  srchdr);
+  valsz = analyze_value_size(srchdr);
+
+  if (ndims == 0 || ndims > 7)                                  goto fail;
+  if (valsz == 0)                                               goto fail;
+  if (analyze_num_dims(dsthdr) != ndims)                        goto fail;
+  if (analyze_datatype(dsthdr) != analyze_datatype(srchdr))     goto fail;
+  if (dsthdr->rev              != srchdr->rev)                  goto fail;
+
+  srcoff = 0;
+  dstoff = 0;
+
+  for (i = 0; i < ndims; i++) {
+
+    if (srcstart[i] + (uint64_t)size[i] > analyze_dim_size(srchdr, i))
+      goto fail;
+    if (dststart[i] + (uint64_t)size[i] > analyze_dim_size(dsthdr, i))
+      goto fail;
+
+    /*nothing to copy*/
+    if (size[i] == 0) return 0;
+
+    srcstride[i] = (uint64_t)valsz * analyze_dim_offset(srchdr, i);
+    dststride[i] = (uint64_t)valsz * analyze_dim_offset(dsthdr, i);
+    srcoff      += srcstart[i] * srcstride[i];
+    dstoff      += dststart[i] * dststride[i];
+    idx[i]       = 0;
+  }
+
+  rowsz = (uint64_t)size[0] * valsz;
+
+  while (1) {
+
+    memmove(dstimg + dstoff, srcimg + srcoff, rowsz);
+
+    /*
+     * move to the next row, carrying
+     * over into the higher dimensions
+     */
+    for (i = 1; i < ndims; i++) {
+
+      idx[i]++;
+      srcoff += srcstride[i];
+      dstoff += dststride[i];
+
+      if (idx[i] < size[i]) break;
+
+      srcoff -= size[i] * srcstride[i];
+      dstoff -= size[i] * dststride[i];
+      idx[i]  = 0;
+    }
+
+    if (i == ndims) break;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
 double analyze_read_unsigned_char(dsr_t *hdr, uint8_t *data) {
 
   return data[0];
@@ -202,6 +202,92 @@ uint8_t analyze_load(
   uint8_t **data      /**< pointer which will be allocated for image */
 );
 
+/**
+ * Loads a number of images, as analyze_load, with up to window files
+ * being read at once (see util/ioqueue.h), which hides the latency of
+ * opening and reading each file on network storage. On failure, any
+ * images which were loaded are freed, and all of the image pointers are
+ * set to NULL.
+ *
+ * \return 0 on success, non-0 if any image could not be loaded.
+ */
+uint8_t analyze_load_many(
+  uint32_t  n,      /**< number of images                         */
+  char    **files,  /**< names of files to load                   */
+  dsr_t    *hdrs,   /**< array of n header structs                */
+  uint8_t **imgs,   /**< array of n pointers which will be
+                         allocated for the images                 */
+  uint16_t  window  /**< number of files to read at once
+                         (0 - use ioqueue_default_window)         */
+);
+
+/**
+ * Access advice flags for analyze_load_mmap.
+ */
+#define ANALYZE_MAP_SEQUENTIAL 1 /**< data will be read sequentially */
+#define ANALYZE_MAP_WILLNEED   2 /**< start reading the data in now  */
+#define ANALYZE_MAP_SHARED     4 /**< write changes back to the file */
+
+/**
+ * Loads the header, and maps the image file into memory, instead of
+ * reading it. By default, the mapping is private and copy-on-write: the
+ * image data may be modified, but changes are never written back to the
+ * file, and unmodified pages are shared, through the page cache, with any
+ * other processes which are reading the same file. The advice flags (a
+ * combination of the ANALYZE_MAP_* flags, or 0) are passed on to the
+ * kernel via madvise.
+ *
+ * If the ANALYZE_MAP_SHARED flag is given, the file is opened for writing,
+ * and any changes to the image data are written back to it, so an image
+ * can be modified in place. Only the pages which are actually changed are
+ * written.
+ *
+ * The header is always loaded, as it is needed to check the image file
+ * size. The image must be unmapped with analyze_unmap, not free.
+ *
+ * \return 0 on success, non-0 otherwise.
+ */
+uint8_t analyze_load_mmap(
+  char     *filename, /**< name of file to load                   */
+  dsr_t    *hdr,      /**< pointer to header struct               */
+  uint8_t **data,     /**< pointer which will be set to the image
+                           mapping                                */
+  uint8_t   advice    /**< ANALYZE_MAP_* flags                    */
+);
+
+/**
+ * Loads the header, and reads only the part of the image which lies
+ * within the given bounding box - voxels (x,y,z) with lo[0] <= x < hi[0],
+ * lo[1] <= y < hi[1] and lo[2] <= z < hi[2], at every time step of a 4D
+ * image. Memory is allocated for the whole image, and is zero-filled.
+ * Each z-slice of the box is read with a single pread, from its first
+ * voxel to its last, so the parts of the rows which lie outside of the
+ * box in x are read too; slices which are adjacent in the file (when the
+ * box spans the full x and y extents) are merged into one pread. The rest
+ * of the image is never read, and, as the allocation is zero-filled,
+ * costs no memory until it is modified.
+ *
+ * The image must be freed with free, as for analyze_load.
+ *
+ * \return 0 on success, non-0 otherwise (including if the box does
+ * not lie within the image).
+ */
+uint8_t analyze_load_part(
+  char     *filename, /**< name of file to load                      */
+  dsr_t    *hdr,      /**< pointer to header struct                  */
+  uint8_t **data,     /**< pointer which will be allocated for image */
+  uint32_t *lo,       /**< lower corner of box (inclusive, 3 values) */
+  uint32_t *hi        /**< upper corner of box (exclusive, 3 values) */
+);
+
+/**
+ * Unmaps an image which was loaded with analyze_load_mmap.
+ */
+void analyze_unmap(
+  dsr_t   *hdr, /**< image header   */
+  uint8_t *data /**< image data     */
+);
+
 /**
  * Writes the image data to the given file.
  *
@@ -349,6 +435,143 @@ void analyze_write_by_idx(
   double   val   /**< value to write */
 );
 
+/**
+ * Reads a contiguous block of values, starting at the given index, into
+ * the given array. The datatype is checked once for the whole block,
+ * rather than once per value, so this is much faster than repeated calls
+ * to analyze_read_by_idx. Values of an unsupported datatype are read as
+ * DBL_MAX.
+ */
+void analyze_read_block(
+  dsr_t   *hdr,  /**< file header                     */
+  uint8_t *img,  /**< image data                      */
+  uint32_t idx,  /**< index of first value            */
+  uint32_t n,    /**< number of values                */
+  double  *vals  /**< place to store the n values     */
+);
+
+/**
+ * Adds a contiguous block of values, starting at the given index, to the
+ * given array.
+ */
+void analyze_add_block(
+  dsr_t   *hdr,  /**< file header                     */
+  uint8_t *img,  /**< image data                      */
+  uint32_t idx,  /**< index of first value            */
+  uint32_t n,    /**< number of values                */
+  double  *vals  /**< the n values to add to          */
+);
+
+/**
+ * Writes a contiguous block of values, starting at the given index, to
+ * the image data. Integral values are rounded, as in analyze_write_by_idx.
+ */
+void analyze_write_block(
+  dsr_t   *hdr,  /**< file header                     */
+  uint8_t *img,  /**< image data                      */
+  uint32_t idx,  /**< index of first value            */
+  uint32_t n,    /**< number of values                */
+  double  *vals  /**< the n values to write           */
+);
+
+/**
+ * Multiplies a contiguous block of values, starting at the given index,
+ * by the given scaling factor, in place.
+ */
+void analyze_scale_block(
+  dsr_t   *hdr,   /**< file header            */
+  uint8_t *img,   /**< image data             */
+  uint32_t idx,   /**< index of first value   */
+  uint32_t n,     /**< number of values       */
+  double   scale  /**< scaling factor         */
+);
+
+/**
+ * Replaces NaN values in a contiguous block of values, starting at the
+ * given index, with the given value. Only float and double images can
+ * contain NaNs; other images are left untouched. Only the NaN values are
+ * written to, so the rest of the image data is never modified (and, for
+ * an image mapped with ANALYZE_MAP_SHARED, never written back).
+ *
+ * \return the number of values which were replaced.
+ */
+uint32_t analyze_nanfix_block(
+  dsr_t   *hdr,  /**< file header               */
+  uint8_t *img,  /**< image data                */
+  uint32_t idx,  /**< index of first value      */
+  uint32_t n,    /**< number of values          */
+  double   val   /**< value with which to replace
+                      NaNs                      */
+);
+
+/**
+ * Replaces values in a contiguous block of values, starting at the given
+ * index. Each value which is equal to one of the values in the from list
+ * is replaced with the corresponding value in the to list; if a value
+ * matches more than one entry, the first is used. As with
+ * analyze_nanfix_block, only the replaced values are written to.
+ *
+ * \return the number of values which were replaced.
+ */
+uint32_t analyze_replace_block(
+  dsr_t   *hdr,  /**< file header                       */
+  uint8_t *img,  /**< image data                        */
+  uint32_t idx,  /**< index of first value              */
+  uint32_t n,    /**< number of values                  */
+  double  *from, /**< values to replace                 */
+  double  *to,   /**< corresponding replacement values  */
+  uint16_t nreps /**< length of from/to lists           */
+);
+
+/**
+ * Searches a contiguous block of values, starting at the given index, for
+ * values v in the range lo <= v <= hi, or, if absolute is non-0, values
+ * with lo <= |v| <= hi. Values which are non-zero, but are not normal
+ * (i.e. NaN, infinite or subnormal, once converted to double), never
+ * match. The values are compared in their own datatype where possible,
+ * without being converted one at a time.
+ *
+ * If idxs is not NULL, the indices of the matching values are stored in
+ * it, in ascending order; it must have space for n values.
+ *
+ * \return the number of matching values.
+ */
+uint32_t analyze_search_block(
+  dsr_t    *hdr,      /**< file header                            */
+  uint8_t  *img,      /**< image data                             */
+  uint32_t  idx,      /**< index of first value                   */
+  uint32_t  n,        /**< number of values                       */
+  double    lo,       /**< lowest matching value                  */
+  double    hi,       /**< highest matching value                 */
+  uint8_t   absolute, /**< compare absolute values                */
+  uint32_t *nnormal,  /**< optional place to store the number of
+                           values which are 0 or normal           */
+  uint32_t *idxs      /**< optional place to store the indices of
+                           matching values                        */
+);
+
+/**
+ * Copies a box of values from one image to another. The box starts at the
+ * given indices in each image, and has the given size along each
+ * dimension. The values are copied as raw bytes, one contiguous run along
+ * the first dimension at a time, so no datatype conversion takes place,
+ * and the two images must have the same datatype, endianness and number
+ * of dimensions (but may have different dimension sizes). The two images
+ * may be the same.
+ *
+ * \return 0 on success, non-0 if the images are not compatible, or if the
+ * box does not fit inside both images.
+ */
+uint8_t analyze_copy_box(
+  dsr_t    *srchdr,   /**< source image header                   */
+  uint8_t  *srcimg,   /**< source image data                     */
+  uint32_t *srcstart, /**< indices of the box in the source      */
+  dsr_t    *dsthdr,   /**< destination image header              */
+  uint8_t  *dstimg,   /**< destination image data                */
+  uint32_t *dststart, /**< indices of the box in the destination */
+  uint32_t *size      /**< size of the box along each dimension  */
+);
+
 /**
  * \return an unsigned char read from the data.
  */
@@ -0,0 +1,443 @@
+/**
+ * Reads/writes graphs in the CSR interchange format.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "graph/graph.h"
+#include "graph/graph_event.h"
+#include "util/array.h"
+#include "util/bigmem.h"
+#include "util/compare.h"
+#include "util/memacct.h"
+#include "io/csr.h"
+
+#define CSR_VERSION 1
+
+/**
+ * Every section of a CSR file starts on a multiple of this many bytes.
+ */
+#define CSR_ALIGN 64
+
+/**
+ * The sections of a CSR file are stored in little endian order, and
+ * mapped directly into graph arrays, so the format can only be read and
+ * written on little endian machines.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#define CSR_NATIVE 0
+#else
+#define CSR_NATIVE 1
+#endif
+
+/**
+ * CSR file header - exactly CSR_ALIGN bytes long.
+ */
+typedef struct _csr_hdr {
+
+  uint32_t magic;        /**< CSR_MAGIC                          */
+  uint32_t version;      /**< CSR_VERSION                        */
+  uint32_t flags;        /**< CSR_FLAG_* bits                    */
+  uint32_t numnodes;     /**< number of nodes                    */
+  uint64_t numrefs;      /**< total length of the neighbour lists */
+  uint32_t numedges;     /**< number of edges                    */
+  uint32_t reserved[9];  /**< 0                                  */
+
+} csr_hdr_t;
+
+/**
+ * CSR file sections, in file order.
+ */
+typedef enum {
+  CSR_OFFSETS = 0,
+  CSR_NBRS,
+  CSR_WTS,
+  CSR_LABELS,
+  CSR_END
+} csr_section_t;
+
+/**
+ * Calculates the file offset of every section of a CSR file with the
+ * given header. Sections which are not present have zero length.
+ */
+static void _layout(
+  csr_hdr_t *hdr, /**< file header                       */
+  uint64_t  *offs /**< place to store CSR_END+1 offsets  */
+);
+
+/**
+ * \return the given size, rounded up to a multiple of CSR_ALIGN.
+ */
+static uint64_t _align(
+  uint64_t sz /**< size to round up */
+);
+
+/**
+ * Writes the neighbour lists (if wts is 0) or weight lists (if wts is
+ * non-0) of every node, starting at the given file offset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_lists(
+  FILE    *fd,  /**< file to write to                  */
+  graph_t *g,   /**< the graph                         */
+  uint64_t off, /**< file offset of the section        */
+  uint8_t  wts  /**< write weights rather than nbrs    */
+);
+
+/**
+ * Writes the given data at the given file offset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_at(
+  FILE       *fd,  /**< file to write to  */
+  uint64_t    off, /**< file offset       */
+  const void *src, /**< data to write     */
+  uint64_t    len  /**< number of bytes   */
+);
+
+/**
+ * Finds the unique label values of the given graph, and stores them in
+ * its labelvals array.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_labelvals(
+  graph_t *g /**< graph with labels, but no label values */
+);
+
+uint8_t csr_write(graph_t *g, char *f, uint32_t flags) {
+
+  uint64_t  i;
+  uint64_t  offs[CSR_END+1];
+  uint64_t *csroffsets;
+  uint32_t  n;
+  FILE     *fd;
+  csr_hdr_t hdr;
+
+  fd         = NULL;
+  csroffsets = NULL;
+
+  if (!CSR_NATIVE) goto fail;
+  if (g == NULL)   goto fail;
+
+  n = graph_num_nodes(g);
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic    = CSR_MAGIC;
+  hdr.version  = CSR_VERSION;
+  hdr.numnodes = n;
+  hdr.numedges = graph_num_edges(g);
+  hdr.flags    = flags & ((1 << CSR_FLAG_WEIGHTS) | (1 << CSR_FLAG_LABELS));
+
+  if (graph_is_directed(g)) hdr.flags |= 1 << CSR_FLAG_DIRECTED;
+
+  if (graph_is_frozen(g)) csroffsets = g->csroffsets;
+  else {
+
+    csroffsets = malloc(((uint64_t)n + 1) * sizeof(uint64_t));
+    if (csroffsets == NULL) goto fail;
+
+    csroffsets[0] = 0;
+    for (i = 0; i < n; i++)
+      csroffsets[i+1] = csroffsets[i] + graph_num_neighbours(g, i);
+  }
+
+  hdr.numrefs = csroffsets[n];
+
+  _layout(&hdr, offs);
+
+  fd = fopen(f, "wb");
+  if (fd == NULL) goto fail;
+
+  if (_write_at(fd, 0, &hdr, sizeof(hdr))) goto fail;
+
+  if (_write_at(fd,
+                offs[CSR_OFFSETS],
+                csroffsets,
+                ((uint64_t)n + 1) * sizeof(uint64_t)))
+    goto fail;
+
+  if (_write_lists(fd, g, offs[CSR_NBRS], 0)) goto fail;
+
+  if ((hdr.flags >> CSR_FLAG_WEIGHTS) & 1) {
+    if (_write_lists(fd, g, offs[CSR_WTS], 1)) goto fail;
+  }
+
+  if ((hdr.flags >> CSR_FLAG_LABELS) & 1) {
+    if (_write_at(fd,
+                  offs[CSR_LABELS],
+                  g->nodelabels.data,
+                  (uint64_t)n * sizeof(graph_label_t)))
+      goto fail;
+  }
+
+  /*the file must span every section, even if the last ones are empty*/
+  if (fflush(fd))                             goto fail;
+  if (ftruncate(fileno(fd), offs[CSR_END]))   goto fail;
+  if (fclose(fd))              { fd = NULL;     goto fail; }
+
+  if (csroffsets != g->csroffsets) free(csroffsets);
+
+  return 0;
+
+fail:
+  if (fd != NULL) fclose(fd);
+  if (csroffsets != NULL && csroffsets != g->csroffsets) free(csroffsets);
+  return 1;
+}
+
+uint8_t csr_read(char *f, graph_t *g) {
+
+  int         fd;
+  uint64_t    i;
+  uint64_t    offs[CSR_END+1];
+  uint32_t    n;
+  uint32_t   *numnbrs;
+  uint8_t    *map;
+  uint64_t    mapsize;
+  struct stat st;
+  csr_hdr_t   hdr;
+
+  fd      = -1;
+  map     = NULL;
+  mapsize = 0;
+
+  memset(g, 0, sizeof(graph_t));
+
+  if (!CSR_NATIVE) goto fail;
+
+  fd = open(f, O_RDONLY);
+  if (fd < 0)                          goto fail;
+  if (fstat(fd, &st))                  goto fail;
+  if (st.st_size < (off_t)sizeof(hdr)) goto fail;
+
+  mapsize = st.st_size;
+
+  /*private and writable, as for graph images (see graph_image.c)*/
+  map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) { map = NULL; goto fail; }
+
+  close(fd);
+  fd = -1;
+
+  memcpy(&hdr, map, sizeof(hdr));
+
+  if (hdr.magic   != CSR_MAGIC)   goto fail;
+  if (hdr.version != CSR_VERSION) goto fail;
+
+  _layout(&hdr, offs);
+
+  if (offs[CSR_END] > mapsize) goto fail;
+
+  n = hdr.numnodes;
+
+  g->numnodes   = n;
+  g->numedges   = hdr.numedges;
+  g->flags      = 1 << GRAPH_FLAG_FROZEN;
+  g->map        = map;
+  g->mapsize    = mapsize;
+  g->csroffsets = (uint64_t *)(map + offs[CSR_OFFSETS]);
+  g->csrnbrs    = (uint32_t *)(map + offs[CSR_NBRS]);
+
+  if ((hdr.flags >> CSR_FLAG_DIRECTED) & 1)
+    g->flags |= 1 << GRAPH_FLAG_DIRECTED;
+
+  if (g->csroffsets[0] != 0)            goto fail;
+  if (g->csroffsets[n] != hdr.numrefs)  goto fail;
+
+  if ((hdr.flags >> CSR_FLAG_WEIGHTS) & 1)
+    g->csrwts = (float *)(map + offs[CSR_WTS]);
+
+  else {
+    g->csrwts = bigmem_alloc((hdr.numrefs > 0 ? hdr.numrefs : 1) *
+                             sizeof(float));
+    if (g->csrwts == NULL) goto fail;
+
+    for (i = 0; i < hdr.numrefs; i++) g->csrwts[i] = 1;
+  }
+
+  /*
+   * the neighbour counts are not stored in the
+   * file, as they are implied by the offsets
+   */
+  if (array_create(&g->numneighbours, sizeof(uint32_t), n)) goto fail;
+  array_set_acct(&g->numneighbours, MEMACCT_GRAPH);
+
+  numnbrs = (uint32_t *)g->numneighbours.data;
+  for (i = 0; i < n; i++)
+    numnbrs[i] = g->csroffsets[i+1] - g->csroffsets[i];
+  g->numneighbours.size = n;
+
+  if ((hdr.flags >> CSR_FLAG_LABELS) & 1) {
+
+    memset(&g->nodelabels, 0, sizeof(array_t));
+    g->nodelabels.capacity = n;
+    g->nodelabels.size     = n;
+    g->nodelabels.datasz   = sizeof(graph_label_t);
+    g->nodelabels.data     = map + offs[CSR_LABELS];
+  }
+  else {
+
+    if (array_create(&g->nodelabels, sizeof(graph_label_t), n)) goto fail;
+    array_set_acct(&g->nodelabels, MEMACCT_GRAPH);
+
+    memset(g->nodelabels.data, 0, (uint64_t)n * sizeof(graph_label_t));
+    g->nodelabels.size = n;
+  }
+
+  if (_read_labelvals(g)) goto fail;
+
+  if (array_create(&g->event_listeners, sizeof(graph_event_listener_t), 5))
+    goto fail;
+  array_set_cmps(&g->event_listeners, graph_compare_event_listeners, NULL);
+
+  return 0;
+
+fail:
+  if (fd >= 0) close(fd);
+  if (g->map != NULL) graph_free(g);
+  else if (map != NULL) munmap(map, mapsize);
+  memset(g, 0, sizeof(graph_t));
+  return 1;
+}
+
+uint8_t csr_is(char *f) {
+
+  FILE    *fd;
+  uint32_t magic;
+
+  fd = fopen(f, "rb");
+  if (fd == NULL) return 0;
+
+  if (fread(&magic, sizeof(magic), 1, fd) != 1) magic = 0;
+
+  fclose(fd);
+
+  return magic == CSR_MAGIC;
+}
+
+void _layout(csr_hdr_t *hdr, uint64_t *offs) {
+
+  uint64_t n;
+  uint64_t wts;
+  uint64_t lbls;
+
+  n    = hdr->numnodes;
+  wts  = (hdr->flags >> CSR_FLAG_WEIGHTS) & 1;
+  lbls = (hdr->flags >> CSR_FLAG_LABELS)  & 1;
+
+  offs[CSR_OFFSETS] = _align(sizeof(csr_hdr_t));
+  offs[CSR_NBRS]    = offs[CSR_OFFSETS] + _align((n + 1) * sizeof(uint64_t));
+  offs[CSR_WTS]     = offs[CSR_NBRS]    +
+                      _align(hdr->numrefs * sizeof(uint32_t));
+  offs[CSR_LABELS]  = offs[CSR_WTS]     +
+                      wts * _align(hdr->numrefs * sizeof(float));
+  offs[CSR_END]     = offs[CSR_LABELS]  +
+                      lbls * n * sizeof(graph_label_t);
+}
+
+uint64_t _align(uint64_t sz) {
+
+  return (sz + CSR_ALIGN - 1) & ~((uint64_t)CSR_ALIGN - 1);
+}
+
+uint8_t _write_lists(FILE *fd, graph_t *g, uint64_t off, uint8_t wts) {
+
+  uint64_t i;
+  uint32_t n;
+  uint32_t nnbrs;
+
+  n = graph_num_nodes(g);
+
+  if (graph_is_frozen(g)) {
+
+    if (wts) return _write_at(fd, off, g->csrwts,
+                              g->csroffsets[n] * sizeof(float));
+    else     return _write_at(fd, off, g->csrnbrs,
+                              g->csroffsets[n] * sizeof(uint32_t));
+  }
+
+  if (fseeko(fd, off, SEEK_SET)) goto fail;
+
+  for (i = 0; i < n; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+
+    if (nnbrs == 0) continue;
+
+    if (wts) {
+      if (fwrite(graph_get_weights(g, i), sizeof(float), nnbrs, fd) != nnbrs)
+        goto fail;
+    }
+    else {
+      if (fwrite(graph_get_neighbours(g, i), sizeof(uint32_t), nnbrs, fd)
+          != nnbrs)
+        goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _write_at(FILE *fd, uint64_t off, const void *src, uint64_t len) {
+
+  if (len == 0) return 0;
+
+  if (fseeko(fd, off, SEEK_SET))      goto fail;
+  if (fwrite(src, 1, len, fd) != len) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _read_labelvals(graph_t *g) {
+
+  uint64_t       i;
+  uint32_t       n;
+  uint32_t       nvals;
+  uint32_t      *vals;
+  graph_label_t *lbls;
+
+  vals = NULL;
+  n    = g->numnodes;
+  lbls = (graph_label_t *)g->nodelabels.data;
+
+  vals = malloc(((uint64_t)n + 1) * sizeof(uint32_t));
+  if (vals == NULL) goto fail;
+
+  for (i = 0; i < n; i++) vals[i] = lbls[i].labelval;
+
+  qsort(vals, n, sizeof(uint32_t), compare_u32);
+
+  for (i = 0, nvals = 0; i < n; i++) {
+    if (nvals == 0 || vals[i] != vals[nvals-1]) vals[nvals++] = vals[i];
+  }
+
+  if (array_create(&g->labelvals, sizeof(uint32_t), nvals + 1)) goto fail;
+  array_set_cmps(&g->labelvals, compare_u32, compare_u32_insert);
+
+  memcpy(g->labelvals.data, vals, (uint64_t)nvals * sizeof(uint32_t));
+  g->labelvals.size = nvals;
+
+  free(vals);
+  return 0;
+
+fail:
+  if (vals != NULL) free(vals);
+  return 1;
+}
@@ -0,0 +1,77 @@
+/**
+ * Reads/writes graphs in the CSR interchange format - a simple, documented
+ * binary container for the compressed sparse row adjacency of a graph,
+ * intended for handing graphs to other programs. The format is described
+ * in README.CSR.
+ *
+ * Unlike a graph image (see graph/graph_image.h), a CSR file only contains
+ * the adjacency, and optionally the edge weights and node labels, in fixed
+ * size little endian fields, so it can be read by any program which can
+ * map a file and index an array.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __CSR_H__
+#define __CSR_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Identifies a CSR file - the bytes "CSRG".
+ */
+#define CSR_MAGIC 0x47525343
+
+/**
+ * CSR file flag bit locations.
+ */
+typedef enum _csr_flags {
+
+  CSR_FLAG_DIRECTED = 0, /**< the graph is directed                */
+  CSR_FLAG_WEIGHTS  = 1, /**< the file contains edge weights       */
+  CSR_FLAG_LABELS   = 2  /**< the file contains node labels        */
+
+} csr_flags_t;
+
+/**
+ * Writes the given graph to a CSR file. The CSR_FLAG_WEIGHTS and
+ * CSR_FLAG_LABELS bits of the given flags select the optional sections
+ * which are written; CSR_FLAG_DIRECTED is set from the graph. If the graph
+ * is frozen (see graph_freeze), its CSR arrays are written as they are;
+ * otherwise, the neighbour lists are written one node at a time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t csr_write(
+  graph_t *g,     /**< graph to write                         */
+  char    *f,     /**< file to write it to                    */
+  uint32_t flags  /**< optional sections (CSR_FLAG_* bits)    */
+);
+
+/**
+ * Maps the given CSR file into memory, and points the given graph struct
+ * into it, without reading or parsing the adjacency. The graph is frozen;
+ * it may be thawed, modified and freed as normal, but none of the changes
+ * are written back to the file. Edges are given a weight of 1 if the file
+ * has no weights, and nodes a zero label if it has no labels. The graph
+ * has no hub indices (see graph_get_nbr_idx), and the neighbours of every
+ * node must be in ascending order, as they are in files written by
+ * csr_write.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t csr_read(
+  char    *f, /**< CSR file to read            */
+  graph_t *g  /**< uninitialised graph struct  */
+);
+
+/**
+ * \return non-0 if the given file is a CSR file, 0 otherwise (or if it
+ * cannot be read).
+ */
+uint8_t csr_is(
+  char *f /**< file to check */
+);
+
+#endif /* __CSR_H__ */
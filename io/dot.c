@@ -1,4 +1,6 @@
 /**
+ * Write graphviz dot files. All output goes through a large buffer, and
+ * node and edge lines are formatted by hand.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -13,12 +15,16 @@
 #include "stats/stats_cache.h"
 #include "graph/graph.h"
 #include "util/getline.h"
+#include "util/rng.h"
+#include "util/outbuf.h"
 
 /**
- * Writes the given graph to the given file.
+ * Writes the given graph to the given stream.
+ *
+ * \return 0 on success, non-0 on failure.
  */
-static void _write_graph(
-  FILE      *hd,      /**< file to write to                           */
+static uint8_t _write_graph(
+  outbuf_t  *ob,      /**< stream to write to                         */
   graph_t   *g,       /**< graph to write                             */
   uint16_t   opts,    /**< output options                             */
   uint32_t  *lblvals, /**< label values for label<->colour mapping    */
@@ -30,10 +36,11 @@ static void _write_graph(
  * Writes the specified node.
  */
 static void _write_node(
-  FILE      *hd,      /**< file to write to                           */
+  outbuf_t  *ob,      /**< stream to write to                         */
   graph_t   *g,       /**< graph to write                             */
   uint32_t   u,       /**< node to write                              */
   uint16_t   opts,    /**< output options                             */
+  uint32_t   cmpnum,  /**< component number of the node, if needed    */
   uint32_t  *lblvals, /**< label values for label<->colour mapping    */
   char     **colours, /**< colour strings  for label<->colour mapping */
   uint32_t   ncolours /**< number of label<->colour mappings          */
@@ -43,13 +50,10 @@ static void _write_node(
  * Writes the edges for the specified node.
  */
 static void _write_edges(
-  FILE      *hd,      /**< file to write to                           */
+  outbuf_t  *ob,      /**< stream to write to                         */
   graph_t   *g,       /**< graph to write                             */
   uint32_t   u,       /**< node whose edges are to be written         */
-  uint16_t   opts,    /**< output options                             */
-  uint32_t  *lblvals, /**< label values for label<->colour mapping    */
-  char     **colours, /**< colour strings  for label<->colour mapping */
-  uint32_t   ncolours /**< number of label<->colour mappings          */
+  uint16_t   opts     /**< output options                             */
 );
 
 /**
@@ -70,23 +74,12 @@ static int64_t _read_colourmap(
 );
 
 /**
- * Populates the given string with a random RGB colour
- * string. There must be space for 7 characters in the string.
+ * Writes a random RGB colour string (6 hexadecimal digits) to the given
+ * stream. The colour depends only on the seed.
  */
 static void _mk_rand_color(
-  char *hex, /**< place to store colour string */
-  int   seed /**< generator seed               */
-);
-
-/**
- * Joins the given tokens with the given character.
- */
-static void _join(
-  char     *dst,   /**< place to put the joined string -
-                        there must be enough room        */
-  char    **tkns,  /**< tokens to join                   */
-  uint32_t  ntkns, /**< number of tokens                 */
-  char      with   /**< character to join tokens with    */
+  outbuf_t *ob,  /**< stream to write to */
+  int       seed /**< generator seed     */
 );
 
 
@@ -95,31 +88,39 @@ uint8_t dot_write(FILE *hd, graph_t *g, char *cmap, uint16_t opts) {
   int64_t    ncolours;
   uint32_t  *lblvals;
   char     **colours;
+  outbuf_t   ob;
 
   ncolours = 0;
   lblvals  = NULL;
   colours  = NULL;
 
+  memset(&ob, 0, sizeof(outbuf_t));
+
   ncolours = _read_colourmap(cmap, &lblvals, &colours);
   if (ncolours < 0) goto fail;
 
+  if (outbuf_create(&ob, hd, 0)) goto fail;
+
   stats_cache_init(g);
   stats_num_components(g, 1, NULL, NULL);
 
-  _write_graph(hd, g, opts, lblvals, colours, ncolours);
+  if (_write_graph(&ob, g, opts, lblvals, colours, ncolours)) goto fail;
+  if (outbuf_flush(&ob))                                        goto fail;
 
+  outbuf_free(&ob);
   free(lblvals);
   free(colours);
   return 0;
 
 fail:
+  outbuf_free(&ob);
   if (lblvals != NULL) free(lblvals);
   if (colours != NULL) free(colours);
   return 1;
 }
 
-void _write_graph(
-  FILE      *hd,
+uint8_t _write_graph(
+  outbuf_t  *ob,
   graph_t   *g,
   uint16_t   opts,
   uint32_t  *lblvals,
@@ -128,95 +129,103 @@ void _write_graph(
   
   uint64_t   i;
   uint32_t   nnodes;
+  uint32_t  *cmpnums;
 
-  nnodes = graph_num_nodes(g);
+  cmpnums = NULL;
+  nnodes  = graph_num_nodes(g);
 
-  fprintf(hd, "strict graph cnet {\n");
-  fprintf(hd, "graph [outputorder=edgesfirst];\n");
-  fprintf(hd, "node [fixedsize=true];\n");
-  fprintf(hd, "node [width=0.2];\n");
-  fprintf(hd, "node [height=0.2];\n");
-  fprintf(hd, "node [penwidth=0.3];\n");
-  fprintf(hd, "node [style=filled];\n");
-  fprintf(hd, "node [fontsize=6];\n");
-  fprintf(hd, "node [fontcolor=\"#33333388\"];\n");
-  fprintf(hd, "edge [color=\"#33333344\"];\n");
-  fprintf(hd, "edge [penwidth=0.3];\n");
+  if ((opts >> DOT_CMP_COLOUR) & 1) {
+
+    cmpnums = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+    if (cmpnums == NULL)                            goto fail;
+    if (stats_cache_node_component(g, -1, cmpnums)) goto fail;
+  }
+
+  outbuf_str(ob, "strict graph cnet {\n");
+  outbuf_str(ob, "graph [outputorder=edgesfirst];\n");
+  outbuf_str(ob, "node [fixedsize=true];\n");
+  outbuf_str(ob, "node [width=0.2];\n");
+  outbuf_str(ob, "node [height=0.2];\n");
+  outbuf_str(ob, "node [penwidth=0.3];\n");
+  outbuf_str(ob, "node [style=filled];\n");
+  outbuf_str(ob, "node [fontsize=6];\n");
+  outbuf_str(ob, "node [fontcolor=\"#33333388\"];\n");
+  outbuf_str(ob, "edge [color=\"#33333344\"];\n");
+  outbuf_str(ob, "edge [penwidth=0.3];\n");
 
   for (i = 0; i < nnodes; i++)
-    _write_node( hd, g, i, opts, lblvals, colours, ncolours);
+    _write_node(ob, g, i, opts, cmpnums ? cmpnums[i] : 0,
+                lblvals, colours, ncolours);
 
   if (!((opts >> DOT_OMIT_EDGES) & 1)) {
-  for (i = 0; i < nnodes; i++)
-    _write_edges(hd, g, i, opts, lblvals, colours, ncolours);
+    for (i = 0; i < nnodes; i++)
+      _write_edges(ob, g, i, opts);
   }
 
-  fprintf(hd, "}\n");
+  outbuf_str(ob, "}\n");
+
+  if (cmpnums != NULL) free(cmpnums);
+  return 0;
+
+fail:
+  if (cmpnums != NULL) free(cmpnums);
+  return 1;
 }
 
 void _write_node(
-  FILE      *hd,
+  outbuf_t  *ob,
   graph_t   *g,
   uint32_t   u,
   uint16_t   opts,
+  uint32_t   cmpnum,
   uint32_t  *lblvals,
   char     **colours,
   uint32_t   ncolours) {
   
   uint64_t       i;
   graph_label_t *lbl;
-  char           lblstr[50];
-  char           posstr[50];
-  char           clrstr[50];
-  char          *tkns  [3];
-  char           atts  [200];
-  uint32_t       cmpnum;
-
-  tkns  [0] = lblstr;
-  tkns  [1] = posstr;
-  tkns  [2] = clrstr;
-  atts  [0] = '\0';
-  lblstr[0] = '\0';
-  posstr[0] = '\0';
-  clrstr[0] = '\0';
   
   lbl = graph_get_nodelabel(g, u);
 
+  outbuf_u64(ob, u);
+  outbuf_str(ob, " [label=\"");
+
   if (((opts >> DOT_NODE_LABELVAL) & 1) &&
-      ((opts >> DOT_NODE_NODEID)   & 1))
-    sprintf(lblstr, "label=\"%u:%u\"", u, lbl->labelval);
+      ((opts >> DOT_NODE_NODEID)   & 1)) {
+    outbuf_u64( ob, u);
+    outbuf_char(ob, ':');
+    outbuf_u64( ob, lbl->labelval);
+  }
   
   else if ((opts >> DOT_NODE_LABELVAL) & 1)
-    sprintf(lblstr, "label=\"%u\"", lbl->labelval);
+    outbuf_u64(ob, lbl->labelval);
   
   else if ((opts >> DOT_NODE_NODEID) & 1) 
-    sprintf(lblstr, "label=\"%u\"", u);
-  
-  else
-    sprintf(lblstr, "label=\"\"");
+    outbuf_u64(ob, u);
+
+  outbuf_char(ob, '"');
   
-  if ((opts >>  DOT_NODE_POS) & 1)
-    sprintf(posstr,
-            "pos=\"%0.6f,%0.6f,%0.6f\"",
-            lbl->xval, lbl->yval, lbl->zval);
+  if ((opts >>  DOT_NODE_POS) & 1) {
+    outbuf_str(  ob, ",pos=\"");
+    outbuf_fixed(ob, lbl->xval, 6);
+    outbuf_char( ob, ',');
+    outbuf_fixed(ob, lbl->yval, 6);
+    outbuf_char( ob, ',');
+    outbuf_fixed(ob, lbl->zval, 6);
+    outbuf_char( ob, '"');
+  }
 
   if ((opts >> DOT_CMP_COLOUR) & 1) {
 
-    stats_cache_node_component(g, u, &cmpnum);
-
-
-    sprintf(clrstr, "fillcolor=\"#");
-    _mk_rand_color(clrstr + 12, cmpnum);
-    clrstr[18] = '"';
-    clrstr[19] = '\0';
+    outbuf_str(    ob, ",fillcolor=\"#");
+    _mk_rand_color(ob, cmpnum);
+    outbuf_char(   ob, '"');
   }
   else if ((opts >> DOT_RAND_COLOUR) & 1) {
 
-    sprintf(clrstr, "fillcolor=\"#");
-    _mk_rand_color(clrstr + 12, lbl->labelval);
-    clrstr[18] = '"';
-    clrstr[19] = '\0';
-
+    outbuf_str(    ob, ",fillcolor=\"#");
+    _mk_rand_color(ob, lbl->labelval);
+    outbuf_char(   ob, '"');
   }
   else if (ncolours > 0) {
 
@@ -224,41 +233,23 @@ void _write_node(
       if (lblvals[i] == lbl->labelval)
         break;
     }
-    if (i < ncolours)
-      sprintf(clrstr, "fillcolor=\"#%s\"", colours[i]);
+    if (i < ncolours) {
+      outbuf_str( ob, ",fillcolor=\"#");
+      outbuf_str( ob, colours[i]);
+      outbuf_char(ob, '"');
+    }
   }
 
-  _join(atts, tkns, 3, ',');
-
-  if (atts[0] == '\0') fprintf(hd, "%u;\n",      u);
-  else                 fprintf(hd, "%u [%s];\n", u, atts);
+  outbuf_str(ob, "];\n");
 }
 
-void _write_edges(
-  FILE      *hd,
-  graph_t   *g,
-  uint32_t   u,
-  uint16_t   opts,
-  uint32_t  *lblvals,
-  char     **colours,
-  uint32_t   ncolours) {
+void _write_edges(outbuf_t *ob, graph_t *g, uint32_t u, uint16_t opts) {
 
   uint64_t  i;
   uint32_t  nnbrs;
   uint32_t *nbrs;
   float    *wts;
 
-  char  lblstr[50];
-  char  wtstr [50];
-  char *tkns  [2];
-  char  atts  [200];
-
-  tkns  [0] = lblstr;
-  tkns  [1] = wtstr;
-  atts  [0] = '\0';
-  lblstr[0] = '\0';
-  wtstr [0] = '\0';
-
   nnbrs = graph_num_neighbours(g, u);
   nbrs  = graph_get_neighbours(g, u);
   wts   = graph_get_weights(   g, u);
@@ -268,15 +259,23 @@ void _write_edges(
     if (((opts >> DOT_UNDIR) & 1) && (nbrs[i] <= u))
       continue;
 
-    if ((opts >> DOT_EDGE_LABELS) & 1)
-      sprintf(lblstr, "label=%0.4f", wts[i]);
-    if ((opts >> DOT_EDGE_WEIGHT) & 1)
-      sprintf(lblstr, "penwidth=%0.4f", 0.5+wts[i]*19.5);
+    outbuf_u64(ob, u);
+    outbuf_str(ob, " -- ");
+    outbuf_u64(ob, nbrs[i]);
 
-    _join(atts, tkns, 2, ',');
+    /*edge width takes precedence over edge labels*/
+    if ((opts >> DOT_EDGE_WEIGHT) & 1) {
+      outbuf_str(  ob, " [penwidth=");
+      outbuf_fixed(ob, 0.5+wts[i]*19.5, 4);
+      outbuf_char( ob, ']');
+    }
+    else if ((opts >> DOT_EDGE_LABELS) & 1) {
+      outbuf_str(  ob, " [label=");
+      outbuf_fixed(ob, wts[i], 4);
+      outbuf_char( ob, ']');
+    }
 
-    if (atts[0] == '\0') fprintf(hd, "%u -- %u;\n", u, nbrs[i]);
-    else                 fprintf(hd, "%u -- %u [%s];\n", u, nbrs[i], atts);
+    outbuf_str(ob, ";\n");
   }
 }
 
@@ -352,36 +351,26 @@ fail:
   return -1;
 }
 
-void _mk_rand_color(char *hex, int seed) {
+void _mk_rand_color(outbuf_t *ob, int seed) {
 
-  srand(seed+105);
+  static const char hex[] = "0123456789abcdef";
 
   uint8_t r;
   uint8_t g;
   uint8_t b;
+  rng_t   rng;
 
-  r = 80 + (uint8_t)(160*((double)random()/RAND_MAX));
-  g = 80 + (uint8_t)(160*((double)random()/RAND_MAX));
-  b = 80 + (uint8_t)(160*((double)random()/RAND_MAX));
-
-  sprintf(hex, "%02x%02x%02x", r, g, b);
-}
-
-void _join(char *dst, char **tkns, uint32_t ntkns, char with) {
+  /*a private generator, so colours only depend on the seed*/
+  rng_seed(&rng, seed+105);
 
-  uint64_t i;
-  char    *odst;
-
-  odst = dst;
-
-  for (i = 0; i < ntkns; i++) {
-    
-    if (!tkns[i] || tkns[i][0] == '\0') continue;
-
-    sprintf(dst, "%s%c", tkns[i], with);
-    
-    dst += 1 + strlen(tkns[i]);
-  }
+  r = 80 + (uint8_t)(160*rng_uniform(&rng));
+  g = 80 + (uint8_t)(160*rng_uniform(&rng));
+  b = 80 + (uint8_t)(160*rng_uniform(&rng));
 
-  odst[strlen(odst)-1] = '\0';
+  outbuf_char(ob, hex[r >> 4]);
+  outbuf_char(ob, hex[r & 15]);
+  outbuf_char(ob, hex[g >> 4]);
+  outbuf_char(ob, hex[g & 15]);
+  outbuf_char(ob, hex[b >> 4]);
+  outbuf_char(ob, hex[b & 15]);
 }
@@ -3,49 +3,445 @@
  *
  * Author: Paul McCarthy <pauldmccarthy@gmail.com>
  */
+#include <math.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "io/edgefile.h"
 #include "graph/graph.h"
-#include "io/ngdb_graph.h"
+#include "graph/graph_builder.h"
+#include "util/array.h"
+#include "util/parallel.h"
+#include "util/profile.h"
 
+/**
+ * Minimum size, in bytes, of the chunks in which the file is parsed.
+ */
+#define EDGEFILE_MIN_CHUNK 1048576
+
+/**
+ * Number of chunks per thread, so that threads which finish early can pick
+ * up more work.
+ */
+#define EDGEFILE_CHUNKS_PER_THREAD 4
+
+/**
+ * Mantissas are accumulated in 64 bits; any digits after this many are
+ * only used for their magnitude.
+ */
+#define EDGEFILE_MAX_MANTISSA 100000000000000000ULL
+
+/**
+ * An edge, as read from the file.
+ */
+typedef struct _file_edge {
+
+  uint32_t u;  /**< first end point  */
+  uint32_t v;  /**< second end point */
+  float    wt; /**< edge weight      */
+
+} file_edge_t;
+
+/**
+ * The edges parsed from one chunk of the file.
+ */
+typedef struct _edge_chunk {
+
+  array_t  edges; /**< file_edge_t structs, in file order */
+  uint32_t maxid; /**< largest node ID in the chunk       */
+
+} edge_chunk_t;
+
+/**
+ * Context shared by the threads parsing the file.
+ */
+typedef struct _parse_ctx {
+
+  char         *data;    /**< file contents    */
+  uint64_t      size;    /**< file size        */
+  uint64_t      nchunks; /**< number of chunks */
+  edge_chunk_t *chunks;  /**< parsed chunks    */
+
+} parse_ctx_t;
+
+/**
+ * parallel_for function - parses chunks [start, end).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _parse_chunks(
+  uint64_t start,  /**< first chunk               */
+  uint64_t end,    /**< one past the last chunk   */
+  uint16_t thread, /**< calling thread            */
+  void    *vctx    /**< pointer to a parse_ctx_t  */
+);
+
+/**
+ * Parses the lines which start within the given chunk of the file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _parse_chunk(
+  parse_ctx_t *ctx, /**< shared context */
+  uint64_t     c    /**< chunk to parse */
+);
+
+/**
+ * Skips over spaces, tabs, commas and carriage returns.
+ */
+static void _skip_sep(
+  char **p,  /**< current position, updated */
+  char  *end /**< end of the file           */
+);
+
+/**
+ * Parses an unsigned 32 bit integer.
+ *
+ * \return 0 on success, non-0 if there is no integer at the current
+ * position, or it is too large.
+ */
+static uint8_t _parse_id(
+  char    **p,   /**< current position, updated */
+  char     *end, /**< end of the file           */
+  uint32_t *val  /**< place to store the value  */
+);
+
+/**
+ * Parses a decimal floating point value, with an optional sign, decimal
+ * point and exponent.
+ *
+ * \return 0 on success, non-0 if there is no value at the current
+ * position.
+ */
+static uint8_t _parse_weight(
+  char **p,   /**< current position, updated */
+  char  *end, /**< end of the file           */
+  float *val  /**< place to store the value  */
+);
+
+uint8_t edgefile_read(
+  graph_t *g, uint32_t nnodes, char *fname, uint16_t nthreads) {
+
+  int             fd;
+  struct stat     st;
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        total;
+  uint64_t        maxid;
+  uint8_t         empty;
+  file_edge_t    *e;
+  parse_ctx_t     ctx;
+  graph_builder_t builder;
+
+  PROFILE_FUNC();
+
+  fd = -1;
+  memset(&ctx,     0, sizeof(parse_ctx_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
+  memset(g,        0, sizeof(graph_t));
+
+  fd = open(fname, O_RDONLY);
+  if (fd < 0)         goto fail;
+  if (fstat(fd, &st)) goto fail;
+
+  ctx.size = st.st_size;
+
+  if (ctx.size > 0) {
+
+    ctx.data = mmap(NULL, ctx.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (ctx.data == MAP_FAILED) {
+      ctx.data = NULL;
+      goto fail;
+    }
+
+    madvise(ctx.data, ctx.size, MADV_WILLNEED);
+  }
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  ctx.nchunks = ctx.size / EDGEFILE_MIN_CHUNK + 1;
+  if (ctx.nchunks > (uint64_t)nthreads * EDGEFILE_CHUNKS_PER_THREAD)
+    ctx.nchunks = (uint64_t)nthreads * EDGEFILE_CHUNKS_PER_THREAD;
+
+  ctx.chunks = calloc(ctx.nchunks, sizeof(edge_chunk_t));
+  if (ctx.chunks == NULL) goto fail;
+
+  for (i = 0; i < ctx.nchunks; i++) {
+    if (array_create(&(ctx.chunks[i].edges), sizeof(file_edge_t), 1024))
+      goto fail;
+  }
+
+  if (parallel_for(nthreads, ctx.nchunks, 1, &ctx, _parse_chunks))
+    goto fail;
+
+  total = 0;
+  maxid = 0;
+  empty = 1;
+
+  for (i = 0; i < ctx.nchunks; i++) {
+
+    if (ctx.chunks[i].edges.size == 0) continue;
+
+    total += ctx.chunks[i].edges.size;
+    empty  = 0;
+
+    if (ctx.chunks[i].maxid > maxid) maxid = ctx.chunks[i].maxid;
+  }
+
+  if (total > 0xFFFFFFFF) goto fail;
+
+  if (nnodes == 0) {
+    if (!empty && maxid == 0xFFFFFFFF) goto fail;
+    if (!empty)                        nnodes = maxid + 1;
+  }
+
+  if (graph_create(g, nnodes, 0))             goto fail;
+  if (graph_builder_init(&builder, g, total)) goto fail;
 
+  /*
+   * edges are queued in file order, and each
+   * chunk is freed as soon as it is queued
+   */
+  for (i = 0; i < ctx.nchunks; i++) {
 
+    for (j = 0; j < ctx.chunks[i].edges.size; j++) {
 
-uint8_t edgefile_read(graph_t *g, uint32_t nnodes, char *fname) {
+      e = array_getd(&(ctx.chunks[i].edges), j);
 
-  FILE  *f;
-  char  *line;
-  size_t len;
+      if (graph_builder_add(&builder, e->u, e->v, e->wt)) goto fail;
+    }
 
-  uint32_t u;
-  uint32_t v;
+    array_free(&(ctx.chunks[i].edges));
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(ctx.chunks);
+  if (ctx.data != NULL) munmap(ctx.data, ctx.size);
+  close(fd);
+
+  return 0;
+
+fail:
+  if (ctx.chunks != NULL) {
+    for (i = 0; i < ctx.nchunks; i++) array_free(&(ctx.chunks[i].edges));
+    free(ctx.chunks);
+  }
+  if (ctx.data != NULL) munmap(ctx.data, ctx.size);
+  if (fd       >= 0)    close(fd);
+  graph_builder_free(&builder);
+  graph_free(g);
+  return 1;
+}
 
-  line = malloc(64);
+uint8_t _parse_chunks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
 
-  if (line == NULL) goto fail;
+  uint64_t c;
 
-  f = fopen(fname, "rt");
+  for (c = start; c < end; c++) {
+    if (_parse_chunk(vctx, c)) goto fail;
+  }
+
+  return 0;
 
-  if (f == NULL) goto fail;
+fail:
+  return 1;
+}
 
-  if (graph_create(g, nnodes, 0)) goto fail;
+uint8_t _parse_chunk(parse_ctx_t *ctx, uint64_t c) {
 
-  while (getline(&line, &len, f) != -1) {
+  char         *p;
+  char         *lim;
+  char         *end;
+  file_edge_t   e;
+  edge_chunk_t *chunk;
 
-    sscanf(line, "%u %u", &u, &v);
+  chunk = ctx->chunks + c;
+  end   = ctx->data + ctx->size;
+  p     = ctx->data + ( c    * ctx->size) / ctx->nchunks;
+  lim   = ctx->data + ((c+1) * ctx->size) / ctx->nchunks;
 
-    if (graph_add_edge(g, u, v, 1)) goto fail;
+  /*
+   * a line belongs to the chunk in which it starts - if the
+   * chunk starts part way through a line, that line belongs
+   * to the previous chunk
+   */
+  if (c > 0 && p[-1] != '\n') {
+    while (p < end && *p != '\n') p++;
+    p++;
   }
 
-  fclose(f);
+  while (p < lim) {
+
+    _skip_sep(&p, end);
+
+    if (p == end) break;
+
+    if (*p == '\n') {
+      p++;
+      continue;
+    }
+
+    if (*p == '#' || *p == '%') {
+      while (p < end && *p != '\n') p++;
+      p++;
+      continue;
+    }
+
+    if (_parse_id(&p, end, &e.u)) goto fail;
+    _skip_sep(&p, end);
+    if (_parse_id(&p, end, &e.v)) goto fail;
+    _skip_sep(&p, end);
+
+    e.wt = 1;
+
+    if (p < end && *p != '\n') {
+      if (_parse_weight(&p, end, &e.wt)) goto fail;
+      _skip_sep(&p, end);
+    }
+
+    if (p < end && *p != '\n') goto fail;
+    p++;
+
+    if (array_append(&(chunk->edges), &e)) goto fail;
+
+    if (e.u > chunk->maxid) chunk->maxid = e.u;
+    if (e.v > chunk->maxid) chunk->maxid = e.v;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _skip_sep(char **p, char *end) {
+
+  char *s;
+
+  s = *p;
+
+  while (s < end && (*s == ' ' || *s == '\t' || *s == ',' || *s == '\r'))
+    s++;
+
+  *p = s;
+}
+
+uint8_t _parse_id(char **p, char *end, uint32_t *val) {
+
+  char    *s;
+  uint64_t v;
+
+  s = *p;
+  v = 0;
+
+  if (s == end || *s < '0' || *s > '9') goto fail;
+
+  while (s < end && *s >= '0' && *s <= '9') {
+
+    v = v*10 + (*s - '0');
+    s++;
+
+    if (v > 0xFFFFFFFF) goto fail;
+  }
+
+  *val = v;
+  *p   = s;
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _parse_weight(char **p, char *end, float *val) {
+
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  char    *s;
+  uint8_t  neg;
+  uint8_t  eneg;
+  uint64_t mant;
+  uint64_t ndigits;
+  int64_t  exp;
+  int64_t  e;
+  double   v;
+
+  s       = *p;
+  neg     = 0;
+  eneg    = 0;
+  mant    = 0;
+  ndigits = 0;
+  exp     = 0;
+  e       = 0;
+
+  if (s < end && (*s == '-' || *s == '+')) {
+    neg = (*s == '-');
+    s++;
+  }
+
+  for (; s < end && *s >= '0' && *s <= '9'; s++, ndigits++) {
+    if (mant < EDGEFILE_MAX_MANTISSA) mant = mant*10 + (*s - '0');
+    else                              exp++;
+  }
+
+  if (s < end && *s == '.') {
+
+    for (s++; s < end && *s >= '0' && *s <= '9'; s++, ndigits++) {
+      if (mant < EDGEFILE_MAX_MANTISSA) {
+        mant = mant*10 + (*s - '0');
+        exp--;
+      }
+    }
+  }
+
+  if (ndigits == 0) goto fail;
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+
+    s++;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+      eneg = (*s == '-');
+      s++;
+    }
+
+    if (s == end || *s < '0' || *s > '9') goto fail;
+
+    for (; s < end && *s >= '0' && *s <= '9'; s++) {
+      if (e < 100000) e = e*10 + (*s - '0');
+    }
+
+    exp += eneg ? -e : e;
+  }
+
+  /*
+   * the result is exact when both the mantissa and the
+   * power of ten can be represented exactly as doubles
+   */
+  v = mant;
+
+  if      (exp >= 0 && exp <=  22) v *= pow10[ exp];
+  else if (exp <  0 && exp >= -22) v /= pow10[-exp];
+  else                             v *= pow(10, exp);
 
-  free(line);
+  *val = neg ? -v : v;
+  *p   = s;
   return 0;
 
 fail:
-  if (line != NULL) free(line);
   return 1;
-}  
+}
@@ -2,14 +2,17 @@
  * Read in simple text based graph files.
  *
  * An edge file is a plain text file which specifies the edges in an
- * unweighted, undirected graph. Each edge in the graph is specified on one
- * line of the file. An edge is specified by listing two numbers, which are
- * the (0-indexed) IDs of the endpoint nodes. An example edge file is:
+ * undirected graph. Each edge in the graph is specified on one line of the
+ * file. An edge is specified by listing two numbers, which are the
+ * (0-indexed) IDs of the endpoint nodes, optionally followed by the edge
+ * weight. Values may be separated by spaces, tabs or commas. Edges without
+ * a weight are given a weight of 1. Blank lines, and lines starting with
+ * '#' or '%', are ignored. An example edge file is:
  *
  * 0 1
- * 1 3
+ * 1 3 0.5
  * 3 4
- * 4 7
+ * 4 7 2
  *
  * Author: Paul McCarthy <pauldmccarthy@gmail.com>
  */
@@ -24,12 +27,22 @@
  * Create a graph from an edge file. Edge file specification is
  * in the header comments of this file.
  *
- * \return 0 on success, non-0 on failure.
+ * The file is mapped into memory, split into chunks of whole lines, and
+ * the chunks are parsed in parallel. The edges are then added to the graph
+ * in file order, with a graph_builder_t (see graph/graph_builder.h), so if
+ * an edge is listed more than once, the weight of its first occurrence is
+ * retained.
+ *
+ * \return 0 on success, non-0 on failure (including if a line cannot be
+ * parsed, or lists a self-loop or a node which is out of range).
  */
 uint8_t edgefile_read(
-  graph_t *g,      /**< empty graph to create */
-  uint32_t nnodes, /**< number of nodes       */
-  char    *fname   /**< edge file to load     */
+  graph_t *g,        /**< empty graph to create                      */
+  uint32_t nnodes,   /**< number of nodes, or 0 to use one more than
+                          the largest node ID in the file            */
+  char    *fname,    /**< edge file to load                          */
+  uint16_t nthreads  /**< number of threads (0 for default, see
+                          util/parallel.h)                           */
 );
 
 
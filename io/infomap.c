@@ -14,16 +14,22 @@
  * 2:1 0.0429867 "Node 2"
  * 2:2 0.0820133 "Node 5"
  *
+ * The whole file is read into memory, and is parsed in place with
+ * strtoul/strtod, rather than line by line with getline and sscanf, as
+ * partitions are often imported for thousands of graphs at a time. Empty
+ * lines, and comment lines after the header, are skipped.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 
-#include "util/getline.h"
 #include "graph/graph.h"
 #include "util/array.h"
 #include "util/compare.h"
+#include "util/readfile.h"
 #include "io/infomap.h"
 
 /**
@@ -44,52 +50,60 @@ static uint8_t _read_nmodules(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _read_node(
-  char             *nodeline, /**< string containing module ID and node ID */
-  node_partition_t *infomap   /**< infomap_t struct                        */
+  char             *nodeline, /**< pointer to the start of a node line */
+  node_partition_t *infomap   /**< infomap_t struct                    */
 );
 
 uint8_t infomap_load(char *fname, node_partition_t *infomap) {
 
-  FILE    *f;
   uint64_t i;
+  uint32_t nodes;
+  char    *data;
   char    *line;
-  size_t   len;
 
-  f                 = NULL;
-  line              = NULL;
-  len               = 0;
+  data              = NULL;
   infomap->nparts   = 0;
   infomap->nnodes   = 0;
   infomap->parts    = NULL;
 
-  f = fopen(fname, "rt");
-  if (f == NULL) goto fail;
+  if (readfile(fname, &data, NULL)) goto fail;
 
   /* read number of modules from header line */
-  if (getline(&line, &len, f) < 0)   goto fail;
-  if (_read_nmodules(line, infomap)) goto fail;
+  if (_read_nmodules(data, infomap)) goto fail;
   if (infomap->nparts == 0)          goto fail;
 
   /* read node lines */
-  while (1) {
+  for (line = readfile_next_line(data);
+       *line != '\0';
+       line = readfile_next_line(line)) {
 
-    if (getline(&line, &len, f) < 0) break;
+    line = readfile_skip_blanks(line);
 
-    if (_read_node(line, infomap)) goto fail;
+    if (*line == '\n' || *line == '#') continue;
 
-    free(line);
-    line = NULL;
+    if (_read_node(line, infomap)) goto fail;
   }
 
   if (infomap->nnodes == 0) goto fail;
 
-  if (line != NULL) free(line);
+  /*
+   * node IDs are appended to their modules as they are
+   * read, and then sorted in one go - a node which is
+   * listed twice in the same module is an error
+   */
+  for (i = 0; i < infomap->nparts; i++) {
+
+    nodes = infomap->parts[i].size;
+    if (array_merge_sorted(&infomap->parts[i], 0, 1)) goto fail;
+    if (infomap->parts[i].size != nodes)              goto fail;
+  }
+
+  free(data);
   return 0;
 
 fail:
   
-  if (line != NULL) free(line);
-  if (f    != NULL) fclose(f);
+  if (data != NULL) free(data);
 
   if (infomap->parts != NULL) {
     
@@ -111,10 +125,26 @@ uint8_t _read_nmodules(char *hdrline, node_partition_t *infomap) {
   uint64_t i;
   uint32_t nparts;
   double   code_length;
-  char     fmt [] = "# Code length %f in %u modules.";
+  char    *end;
+  char     prefix[] = "# Code length ";
 
-  if (sscanf(hdrline, fmt, &code_length, &nparts) != 2)
-    goto fail;
+  /*
+   * parsed by hand, as sscanf would scan the
+   * whole file for its terminator
+   */
+  if (strncmp(hdrline, prefix, strlen(prefix))) goto fail;
+
+  hdrline    += strlen(prefix);
+  code_length = strtod(hdrline, &end);
+  if (end == hdrline || code_length < 0)     goto fail;
+
+  hdrline = end;
+  if (strncmp(hdrline, " in ", 4))           goto fail;
+
+  hdrline += 4;
+  nparts   = strtoul(hdrline, &end, 10);
+  if (end == hdrline)                        goto fail;
+  if (strncmp(end, " modules", 8))           goto fail;
 
   infomap->nparts = nparts;
 
@@ -137,22 +167,32 @@ fail:
 uint8_t _read_node(char *nodeline, node_partition_t *infomap) {
 
   uint32_t module;
-  uint32_t rank;
-  double   length;
   uint32_t node;
-  char     fmt [] = "%u:%u %f \"%u\"";
+  char    *end;
 
-  if (sscanf(nodeline, fmt, &module, &rank, &length, &node) != 4)
-    goto fail;
+  /* module:rank flow "node" */
+  module = strtoul(nodeline, &end, 10);
+  if (end == nodeline || *end != ':')   goto fail;
+
+  nodeline = end + 1;
+  strtoul(nodeline, &end, 10);
+  if (end == nodeline)                  goto fail;
+
+  nodeline = readfile_skip_blanks(end);
+  strtod(nodeline, &end);
+  if (end == nodeline)                  goto fail;
+
+  nodeline = readfile_skip_blanks(end);
+  if (*nodeline != '"')                 goto fail;
+
+  nodeline++;
+  node = strtoul(nodeline, &end, 10);
+  if (end == nodeline || *end != '"')   goto fail;
 
   if (module == 0 || module > infomap->nparts)
     goto fail;
 
-  if (array_insert_sorted(&infomap->parts[module-1],
-                          &node,
-                          1,
-                          NULL))
-    goto fail;
+  if (array_append(&infomap->parts[module-1], &node)) goto fail;
 
   infomap->nnodes ++;
   
@@ -19,6 +19,10 @@
  * 24: 65 66 67 70 71 72 73 74 75 76 77 79 80 82 83 85 86 87 89 91 93 94 95 96
  * 18: 2 16 31 32 35 38 43 45 47 59 68 69 78 81 84 88 90 92
  * 
+ * The whole file is read into memory, and is parsed in place with
+ * strtoul, rather than line by line with getline and sscanf, as
+ * partitions are often imported for thousands of graphs at a time.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 
@@ -27,10 +31,10 @@
 #include <string.h>
 #include <stdio.h>
 
-#include "util/getline.h"
 #include "graph/graph.h"
 #include "util/array.h"
 #include "util/compare.h"
+#include "util/readfile.h"
 #include "io/lol.h"
 
 /**
@@ -38,11 +42,11 @@
  * elements, and nunbmer of partitions, and initialises the fields of the
  * node_partition_t struct.
  *
- * \return 0 on success, non-0 on failure.
+ * \return pointer to the line following the header, or NULL on failure.
  */
-static uint8_t _read_hdr(
-  FILE             *f,  /**< open file handle to the lolfile             */
-  node_partition_t *lol /**< pointer to an empty node_partition_t struct */
+static char * _read_hdr(
+  char             *data, /**< contents of the lolfile                    */
+  node_partition_t *lol   /**< pointer to an empty node_partition_t struct */
 );
 
 /**
@@ -52,10 +56,10 @@ static uint8_t _read_hdr(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _read_parts(
-  FILE             *f,  /**< open file handle to the lolfile, pointing 
-                             to the start of the partition list        */
-  node_partition_t *lol /**< pointer to a node_partition_t struct,
-                             with all fields initialised               */
+  char             *data, /**< pointer into the lolfile contents, at the
+                               start of the partition list               */
+  node_partition_t *lol   /**< pointer to a node_partition_t struct,
+                               with all fields initialised               */
 );
 
 /**
@@ -64,23 +68,24 @@ static uint8_t _read_parts(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _read_part(
-  char    *partline, /**< string containing the partition description */
+  char    *partline, /**< pointer to the node IDs of a partition line */
   array_t *part      /**< array to put the node IDs                   */
 );
 
 
 uint8_t lol_load(char *fname, node_partition_t *lol) {
 
-  FILE    *f;
+  char    *data;
+  char    *parts;
   uint64_t i;
 
-  f          = NULL;
+  data       = NULL;
   lol->parts = NULL;
 
-  f = fopen(fname, "rt");
-  if (f == NULL) goto fail;
+  if (readfile(fname, &data, NULL)) goto fail;
 
-  if (_read_hdr(f, lol)) goto fail;
+  parts = _read_hdr(data, lol);
+  if (parts == NULL) goto fail;
 
   lol->parts = calloc(lol->nparts, sizeof(array_t));
   if (lol->parts == NULL) goto fail;
@@ -91,15 +96,15 @@ uint8_t lol_load(char *fname, node_partition_t *lol) {
     array_set_cmps(&lol->parts[i], compare_u32, compare_u32_insert);
   }
 
-  if (_read_parts(f, lol)) goto fail;
+  if (_read_parts(parts, lol)) goto fail;
 
-  fclose(f);
+  free(data);
 
   return 0;
 
 fail:
 
-  if (f != NULL) fclose(f);
+  if (data != NULL) free(data);
 
   if (lol->parts != NULL) {
 
@@ -114,98 +119,103 @@ fail:
   return 1;
 }
 
-static uint8_t _read_hdr(FILE *f, node_partition_t *lol) {
+static char * _read_hdr(char *data, node_partition_t *lol) {
 
-  char   *line;
-  size_t  len;
+  char *line;
+  char *end;
+  char  nelems[] = "Number of elements:";
+  char  nlists[] = "Number of lists:";
 
-  line        = NULL;
-  len         = 0;
   lol->nparts = 0xFFFFFFFF;
   lol->nnodes = 0xFFFFFFFF;
 
-  while (1) {
+  for (line = data; *line != '\0'; line = readfile_next_line(line)) {
+
+    if (!strncmp(line, nelems, strlen(nelems))) {
 
-    if (getline(&line, &len, f) < 0) goto fail;
+      lol->nnodes = strtoul(line + strlen(nelems), &end, 10);
+      if (end == line + strlen(nelems)) goto fail;
+    }
 
-    if (sscanf(line, "Number of elements: %u\n", &(lol->nnodes)) == 1) 
-      continue;
+    else if (!strncmp(line, nlists, strlen(nlists))) {
 
-    if (sscanf(line, "Number of lists: %u\n", &(lol->nparts)) == 1) 
+      lol->nparts = strtoul(line + strlen(nlists), &end, 10);
+      if (end == line + strlen(nlists)) goto fail;
       break;
-
-    free(line);
-    line = NULL;
+    }
   }
 
   if (lol->nparts == 0xFFFFFFFF ||
       lol->nnodes == 0xFFFFFFFF)
     goto fail;
 
-  if (line != NULL) free(line);
-  return 0;
+  return readfile_next_line(line);
 
 fail:
-  if (line != NULL) free(line);
-  return 1;
+  return NULL;
 }
 
 
-static uint8_t _read_parts(FILE *f, node_partition_t *lol) {
+static uint8_t _read_parts(char *data, node_partition_t *lol) {
 
   char    *line;
-  size_t   len;
+  char    *end;
   uint64_t part;
-  uint32_t partsz;
-  char    *clnpos;
 
-  line = NULL;
-  len  = 0;
   part = 0;
 
-  while (getline(&line, &len, f) > 0)  {
+  for (line = data; *line != '\0'; line = readfile_next_line(line)) {
 
-    if (sscanf(line, "%u: ", &partsz) != 1) 
-      continue;
+    /*lines which do not start with a partition size are skipped*/
+    line = readfile_skip_blanks(line);
+    if (*line < '0' || *line > '9') continue;
 
-    clnpos = strchr(line, ':');
-    if (clnpos == NULL) goto fail;
+    strtoul(line, &end, 10);
 
-    if (_read_part(clnpos+1, &lol->parts[part])) goto fail;
+    end = readfile_skip_blanks(end);
+    if (*end != ':')          goto fail;
+    if (part >= lol->nparts)  goto fail;
 
-    part ++;
+    if (_read_part(end+1, &lol->parts[part])) goto fail;
 
-    free(line);
-    line = NULL;
+    part ++;
   }
 
   if (part != lol->nparts) goto fail;
 
-  if (line != NULL) free(line);
   return 0;
 
 fail:
-  if (line != NULL) free(line);
   return 1;
 }
 
 static uint8_t _read_part(char *partline, array_t *part) {
 
-  char    *tkn;
-  char    *saveptr;
+  char    *end;
   uint32_t nid;
+  uint32_t nsorted;
+  uint32_t nadded;
 
-  saveptr = NULL;
+  nsorted = part->size;
 
-  tkn = strtok_r(partline, " ", &saveptr);
+  while (1) {
 
-  while (tkn != NULL) {
+    partline = readfile_skip_blanks(partline);
 
-    nid = atoi(tkn) - 1;
-    if (array_insert_sorted(part, &nid, 1, NULL)) goto fail;
-    tkn = strtok_r(NULL, " ", &saveptr);
+    if (*partline == '\n' || *partline == '\0') break;
+
+    nid = strtoul(partline, &end, 10) - 1;
+    if (end == partline) goto fail;
+
+    if (array_append(part, &nid)) goto fail;
+    partline = end;
   }
 
+  /*the node IDs are sorted in one go - duplicates are an error*/
+  nadded = part->size;
+  if (array_merge_sorted(part, nsorted, 1)) goto fail;
+  if (part->size != nadded)                 goto fail;
+
   return 0;
 
 fail:
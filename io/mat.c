@@ -12,12 +12,38 @@
 #include <float.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "io/mat.h"
+#include "util/memacct.h"
+#include "util/profile.h"
 
 #define MAT_FILE_ID  0x8493
 #define MAT_HDR_SIZE 23
 
+/**
+ * Size of the stdio buffer used when creating a mat file.
+ */
+#define MAT_WRITE_BUF_SIZE 1048576
+
+/**
+ * Number of values which are converted at a time when
+ * writing to a file with float32 or float16 storage.
+ */
+#define MAT_CONV_BUF_LEN 1024
+
+/**
+ * When a block is read from a tiled file, the values below the diagonal
+ * are read from the rows of the mirrored tile, in one go, if the block
+ * has at least this many rows within the tile; otherwise they are read
+ * one at a time.
+ */
+#define MAT_TILE_MIRROR_ROWS 16
+
 typedef enum __mat_mode {
 
   MAT_MODE_READ,
@@ -43,6 +69,9 @@ struct __mat {
   uint16_t   hdrsize;   /**< header data size           */
   uint8_t    labelsize; /**< label size                 */
   mat_mode_t mode;      /**< open mode (read or create) */
+  uint8_t   *map;       /**< file mapping, if opened
+                             with mat_open_mmap         */
+  uint64_t   mapsize;   /**< size of file mapping       */
 };
 
 /**
@@ -65,6 +94,23 @@ static uint8_t _mat_write_header(
   mat_t *mat /**< mat struct with an open file handle */
 );
 
+/**
+ * Creates a mat file - see mat_create and mat_create_shared. If shared
+ * is non-0, an existing file is resized to the size of the full matrix,
+ * rather than being truncated.
+ *
+ * \return a newly allocated mat_t struct on success, NULL on failure.
+ */
+static mat_t * _mat_create(
+  char    *fname,     /**< name of file to create        */
+  uint64_t numrows,   /**< number of rows                */
+  uint64_t numcols,   /**< number of columns             */
+  uint16_t flags,     /**< file options                  */
+  uint16_t hdrsize,   /**< header data size              */
+  uint8_t  labelsize, /**< label size                    */
+  uint8_t  shared     /**< non-0 to keep an existing file */
+);
+
 /**
  * Calculates the offset into the mat->hd file for the given row/column.
  *
@@ -76,6 +122,79 @@ static uint64_t _mat_calc_offset(
   uint64_t col
 );
 
+/**
+ * Reads a range of consecutive row or column labels with one read, or
+ * copies them from the file mapping, if the file was opened with
+ * mat_open_mmap.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_read_labels(
+  mat_t         *mat,   /**< mat struct with an open file           */
+  mat_seek_loc_t what,  /**< MAT_SEEK_ROWLABEL or MAT_SEEK_COLLABEL */
+  uint64_t       first, /**< first row/column                       */
+  uint64_t       len,   /**< number of labels to read               */
+  void          *data   /**< place to store labels                  */
+);
+
+/**
+ * Writes a range of consecutive row or column labels with one write.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_write_labels(
+  mat_t         *mat,   /**< mat struct with an open file           */
+  mat_seek_loc_t what,  /**< MAT_SEEK_ROWLABEL or MAT_SEEK_COLLABEL */
+  uint64_t       first, /**< first row/column                       */
+  uint64_t       len,   /**< number of labels to write              */
+  void          *data   /**< labels to write                        */
+);
+
+/**
+ * Reads the given number of consecutive values from the given row,
+ * starting at the given column, which must lie on or above the diagonal
+ * of a symmetric file. The values of a tiled file are read one tile at a
+ * time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_read_span(
+  mat_t   *mat, /**< mat struct with an open file */
+  uint64_t row, /**< row to read                  */
+  uint64_t col, /**< starting column              */
+  uint64_t len, /**< number of values to read     */
+  double  *vals /**< place to store values        */
+);
+
+/**
+ * Writes the given number of consecutive values to the given row, in the
+ * same way that _mat_read_span reads them.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_write_span(
+  mat_t   *mat, /**< mat struct with an open file */
+  uint64_t row, /**< row to write to              */
+  uint64_t col, /**< starting column              */
+  uint64_t len, /**< number of values to write    */
+  double  *vals /**< values to write              */
+);
+
+/**
+ * Writes a block of consecutive, complete rows to a tiled file - see
+ * mat_write_rows. The rows of each tile are written in file order, and
+ * the file position is only moved when the next tile row is not
+ * contiguous with the previous one.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_write_tiled_rows(
+  mat_t   *mat,   /**< mat struct with an open file */
+  uint64_t row,   /**< first row to write to        */
+  uint64_t nrows, /**< number of rows to write      */
+  double  *vals   /**< data to write                */
+);
+
 /**
  * Seeks to the given row/column in the given mat->hd file.
  *
@@ -97,6 +216,69 @@ static uint8_t _mat_seek_to(
   mat_seek_loc_t what /**< location to seek to          */
 );
 
+/**
+ * Reads the given number of consecutive values, starting at the given file
+ * offset, converting them to double if necessary. Values are copied from
+ * the file mapping, if the file was opened with mat_open_mmap.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_read_vals(
+  mat_t   *mat,    /**< mat struct with an open file */
+  uint64_t offset, /**< file offset                  */
+  uint64_t len,    /**< number of values to read     */
+  double  *vals    /**< place to store values        */
+);
+
+/**
+ * Writes the given values at the current file location, converting them
+ * to the file storage type if necessary.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_write_vals(
+  mat_t   *mat, /**< mat struct with an open file */
+  uint64_t len, /**< number of values to write    */
+  double  *vals /**< values to write              */
+);
+
+/**
+ * Converts the given number of values from the file storage type to
+ * double. The src and dst pointers may refer to the same memory.
+ */
+static void _mat_decode(
+  mat_t      *mat, /**< mat struct                  */
+  const void *src, /**< values in file storage type */
+  uint64_t    len, /**< number of values            */
+  double     *dst  /**< place to store values       */
+);
+
+/**
+ * Converts the given number of values from double to the file storage
+ * type.
+ */
+static void _mat_encode(
+  mat_t   *mat, /**< mat struct                      */
+  double  *src, /**< values to convert               */
+  uint64_t len, /**< number of values                */
+  void    *dst  /**< place to store converted values */
+);
+
+/**
+ * \return the given IEEE 754 half precision value as a double.
+ */
+static double _half_to_double(
+  uint16_t h /**< half precision value */
+);
+
+/**
+ * \return the given value as an IEEE 754 half precision value, rounded
+ * to the nearest representable value.
+ */
+static uint16_t _double_to_half(
+  double d /**< value to convert */
+);
+
 mat_t * mat_open(char *fname) {
 
   mat_t *mat;
@@ -105,7 +287,7 @@ mat_t * mat_open(char *fname) {
 
   if (fname == NULL) goto fail;
 
-  mat = malloc(sizeof(mat_t));
+  mat = calloc(1, sizeof(mat_t));
   if (mat == NULL) goto fail;
 
   mat->hd = fopen(fname, "rb");
@@ -113,6 +295,8 @@ mat_t * mat_open(char *fname) {
 
   if (_mat_read_header(mat)) goto fail;
 
+  if (mat_is_tiled(mat) && !mat_is_symmetric(mat)) goto fail;
+
   mat->mode = MAT_MODE_READ;
 
   return mat;
@@ -126,11 +310,54 @@ fail:
   return NULL;
 }
 
+mat_t * mat_open_mmap(char *fname) {
+
+  mat_t      *mat;
+  struct stat st;
+  void       *map;
+
+  mat = mat_open(fname);
+  if (mat == NULL) goto fail;
+
+  if (fstat(fileno(mat->hd), &st)) goto fail;
+
+  if (st.st_size < _mat_calc_offset(
+        mat, mat->numrows-1, mat->numcols-1) + mat_elem_size(mat))
+    goto fail;
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(mat->hd), 0);
+  if (map == MAP_FAILED) goto fail;
+
+  mat->map     = map;
+  mat->mapsize = st.st_size;
+
+  return mat;
+
+fail:
+  if (mat != NULL) mat_close(mat);
+  return NULL;
+}
+
+uint8_t mat_sync(mat_t *mat) {
+
+  if (mat       == NULL)            goto fail;
+  if (mat->mode != MAT_MODE_CREATE) goto fail;
+
+  if (fflush(mat->hd))        goto fail;
+  if (fsync(fileno(mat->hd))) goto fail;
+
+  return 0;
+fail:
+  return 1;
+}
+
 uint8_t mat_close(mat_t *mat) {
 
   if (mat     == NULL) goto fail;
   if (mat->hd == NULL) goto fail;
 
+  if (mat->map != NULL) munmap(mat->map, mat->mapsize);
+
   fclose(mat->hd);
   mat->hd = NULL;
   free(mat);
@@ -170,6 +397,16 @@ uint8_t mat_is_symmetric(mat_t *mat) {
   return (mat->flags >> MAT_IS_SYMMETRIC) & 1;
 }
 
+uint8_t mat_is_tiled(mat_t *mat) {
+
+  return (mat->flags >> MAT_IS_TILED) & 1;
+}
+
+uint64_t mat_tile_size(mat_t *mat) {
+
+  return mat_is_tiled(mat) ? MAT_TILE_SIZE : 0;
+}
+
 uint8_t mat_has_row_labels(mat_t *mat) {
   
   return (mat->flags >> MAT_HAS_ROW_LABELS) & 1;
@@ -180,6 +417,18 @@ uint8_t mat_has_col_labels(mat_t *mat) {
   return (mat->flags >> MAT_HAS_COL_LABELS) & 1;
 }
 
+uint8_t mat_elem_size(mat_t *mat) {
+
+  if ((mat->flags >> MAT_ELEM_FLOAT16) & 1) return sizeof(uint16_t);
+  if ((mat->flags >> MAT_ELEM_FLOAT32) & 1) return sizeof(float);
+  return sizeof(double);
+}
+
+uint8_t mat_is_mapped(mat_t *mat) {
+
+  return mat->map != NULL;
+}
+
 double mat_read_elem(mat_t *mat, uint64_t row, uint64_t col) {
 
   double val;
@@ -212,23 +461,22 @@ uint8_t mat_read_row_part(
 
   if (!mat_is_symmetric(mat) || (col >= row)) {
 
-    if (_mat_seek(mat, row, col))                         goto fail;
-    if (fread(vals, sizeof(double), len, mat->hd) != len) goto fail;
+    if (_mat_read_span(mat, row, col, len, vals)) goto fail;
   }
   
   else {
 
     collen = row - col;
-    rowlen = col + len - row;
+    if (collen > len) collen = len;
+    rowlen = len - collen;
 
     /* translate reads for bottom left of matrix into top right */
     if (mat_read_col_part(mat, col, row, collen, vals))
       goto fail;
 
     /*read values from top right of matrix as normal */
-    if (_mat_seek(mat, row, row)) goto fail;
-    
-    if (fread(vals+collen, sizeof(double), rowlen, mat->hd) != rowlen)
+    if (rowlen > 0 &&
+        mat_read_row_part(mat, row, row, rowlen, vals+collen))
       goto fail;
   }
 
@@ -263,8 +511,10 @@ uint8_t mat_read_col_part(
 
   for (i = 0; i < len; i++, row++) {
 
-    if (_mat_seek(mat, row, col))                       goto fail;
-    if (fread(vals+i, sizeof(double), 1, mat->hd) != 1) goto fail;
+    if (mat_is_symmetric(mat) && (col < row)) goto fail;
+    
+    if (_mat_read_vals(mat, _mat_calc_offset(mat, row, col), 1, vals+i))
+      goto fail;
   }
 
   return 0;
@@ -273,37 +523,175 @@ fail:
   return 1;
 }
 
-uint8_t mat_read_row_label(mat_t *mat, uint64_t row, void *data) {
+uint8_t mat_read_block(
+  mat_t   *mat,
+  uint64_t row,
+  uint64_t col,
+  uint64_t nrows,
+  uint64_t ncols,
+  double  *vals) {
 
-  if (!mat_has_row_labels(mat))       goto fail;
-  if (row            <  0)            goto fail;
-  if (row            >= mat->numrows) goto fail;
-  if (mat->labelsize == 0)            goto fail;
+  uint64_t i;
+  uint64_t r;
+  uint64_t c;
+  uint64_t sr;
+  uint64_t sc;
+  uint64_t ti;
+  uint64_t tj;
+  uint64_t bj;
+  uint64_t r0;
+  uint64_t r1;
+  uint64_t c0;
+  uint64_t c1;
+  uint64_t a0;
+  uint64_t a1;
+  uint64_t w;
+  double  *tmp;
+
+  tmp = NULL;
+
+  if (mat         == NULL)          goto fail;
+  if (mat->mode   != MAT_MODE_READ) goto fail;
+  if (vals        == NULL)          goto fail;
+  if (nrows == 0 || ncols == 0)     return 0;
+  if (row + nrows >  mat->numrows)  goto fail;
+  if (col + ncols >  mat->numcols)  goto fail;
+
+  if (!mat_is_tiled(mat)) {
+
+    for (i = 0; i < nrows; i++) {
+      if (mat_read_row_part(mat, row + i, col, ncols, vals + i*ncols))
+        goto fail;
+    }
+    return 0;
+  }
 
-  if (_mat_seek_to(mat, MAT_SEEK_ROWLABEL))              goto fail;
-  if (fseeko(mat->hd, (mat->labelsize) * row, SEEK_CUR)) goto fail;
-  if (fread(data, mat->labelsize, 1, mat->hd) != 1)      goto fail;
-  
+  tmp = malloc(MAT_TILE_SIZE * MAT_TILE_SIZE * sizeof(double));
+  if (tmp == NULL) goto fail;
+  memacct_alloc(MEMACCT_MAT, MAT_TILE_SIZE * MAT_TILE_SIZE * sizeof(double));
+
+  for (ti = row / MAT_TILE_SIZE; ti*MAT_TILE_SIZE < row + nrows; ti++) {
+    for (tj = col / MAT_TILE_SIZE; tj*MAT_TILE_SIZE < col + ncols; tj++) {
+
+      /*the part of the block within this tile*/
+      r0 = ti * MAT_TILE_SIZE;
+      c0 = tj * MAT_TILE_SIZE;
+      r1 = r0 + MAT_TILE_SIZE;
+      c1 = c0 + MAT_TILE_SIZE;
+      
+      if (r0 < row)         r0 = row;
+      if (c0 < col)         c0 = col;
+      if (r1 > row + nrows) r1 = row + nrows;
+      if (c1 > col + ncols) c1 = col + ncols;
+
+      /*
+       * values are read from the stored tile in the upper triangle,
+       * (min(ti,tj), bj) - rows a0 to a1-1 of it are read in one go
+       */
+      bj = (ti > tj) ? ti : tj;
+      w  = mat->numcols - bj * MAT_TILE_SIZE;
+      if (w > MAT_TILE_SIZE) w = MAT_TILE_SIZE;
+
+      a0 = r0;
+      a1 = r1;
+
+      if (r1 - r0 >= MAT_TILE_MIRROR_ROWS) {
+        if      (ti >  tj) { a0 = c0; a1 = c1; }
+        else if (ti == tj) { if (c0 < a0) a0 = c0; }
+      }
+      else if (ti > tj) a1 = a0;
+
+      if (a1 > a0) {
+        if (_mat_read_vals(mat,
+                           _mat_calc_offset(mat, a0, bj * MAT_TILE_SIZE),
+                           (a1 - a0) * w,
+                           tmp))
+          goto fail;
+      }
+
+      for (r = r0; r < r1; r++) {
+        for (c = c0; c < c1; c++) {
+
+          sr = (c >= r) ? r : c;
+          sc = (c >= r) ? c : r;
+
+          if (sr >= a0 && sr < a1) {
+            vals[(r - row)*ncols + (c - col)] =
+              tmp[(sr - a0)*w + (sc - bj * MAT_TILE_SIZE)];
+          }
+          else if (_mat_read_vals(mat,
+                                  _mat_calc_offset(mat, sr, sc),
+                                  1,
+                                  vals + (r - row)*ncols + (c - col)))
+            goto fail;
+        }
+      }
+    }
+  }
+
+  memacct_free(MEMACCT_MAT, MAT_TILE_SIZE * MAT_TILE_SIZE * sizeof(double));
+  free(tmp);
   return 0;
-  
+
 fail:
+  if (tmp != NULL) {
+    memacct_free(MEMACCT_MAT, MAT_TILE_SIZE*MAT_TILE_SIZE*sizeof(double));
+    free(tmp);
+  }
   return 1;
 }
 
+const double * mat_row_ptr(mat_t *mat, uint64_t row) {
+
+  uint64_t off;
+
+  if (mat                == NULL)           return NULL;
+  if (mat->map           == NULL)           return NULL;
+  if (row                >= mat->numrows)   return NULL;
+  if (mat_elem_size(mat) != sizeof(double)) return NULL;
+  if (mat_is_tiled(mat))                    return NULL;
+
+  off = _mat_calc_offset(mat, row, mat_is_symmetric(mat) ? row : 0);
+
+  /*
+   * the data follows the variable length header
+   * data and labels, so may not be aligned
+   */
+  if (((uintptr_t)(mat->map + off)) % sizeof(double) != 0) return NULL;
+
+  return (const double *)(mat->map + off);
+}
+
+uint8_t mat_read_row_label(mat_t *mat, uint64_t row, void *data) {
+
+  return mat_read_row_labels(mat, row, 1, data);
+}
+
 uint8_t mat_read_col_label(mat_t *mat, uint64_t col, void *data) {
 
-  if (!mat_has_col_labels(mat))       goto fail;
-  if (col            <  0)            goto fail;
-  if (col            >= mat->numcols) goto fail;
-  if (mat->labelsize == 0)            goto fail;
+  return mat_read_col_labels(mat, col, 1, data);
+}
 
+uint8_t mat_read_row_labels(
+  mat_t *mat, uint64_t row, uint64_t len, void *data) {
 
-  if (_mat_seek_to(mat, MAT_SEEK_COLLABEL))              goto fail;
-  if (fseeko(mat->hd, (mat->labelsize) * col, SEEK_CUR)) goto fail;
-  if (fread(data, mat->labelsize, 1, mat->hd) != 1)      goto fail;
+  if (!mat_has_row_labels(mat))       goto fail;
+  if (row + len      >  mat->numrows) goto fail;
+
+  return _mat_read_labels(mat, MAT_SEEK_ROWLABEL, row, len, data);
+
+fail:
+  return 1;
+}
+
+uint8_t mat_read_col_labels(
+  mat_t *mat, uint64_t col, uint64_t len, void *data) {
+
+  if (!mat_has_col_labels(mat))       goto fail;
+  if (col + len      >  mat->numcols) goto fail;
+
+  return _mat_read_labels(mat, MAT_SEEK_COLLABEL, col, len, data);
 
-  return 0;
-  
 fail:
   return 1;
 }
@@ -331,8 +719,35 @@ mat_t * mat_create(
   uint16_t hdrsize,
   uint8_t  labelsize) {
 
-  mat_t *mat;
+  return _mat_create(fname, numrows, numcols, flags, hdrsize, labelsize, 0);
+}
+
+mat_t * mat_create_shared(
+  char    *fname,
+  uint64_t numrows,
+  uint64_t numcols,
+  uint16_t flags,
+  uint16_t hdrsize,
+  uint8_t  labelsize) {
+
+  return _mat_create(fname, numrows, numcols, flags, hdrsize, labelsize, 1);
+}
+
+mat_t * _mat_create(
+  char    *fname,
+  uint64_t numrows,
+  uint64_t numcols,
+  uint16_t flags,
+  uint16_t hdrsize,
+  uint8_t  labelsize,
+  uint8_t  shared) {
+
+  int      fd;
+  uint64_t i;
+  uint64_t len;
+  mat_t   *mat;
   mat = NULL;
+  fd  = -1;
 
   mat = calloc(1, sizeof(mat_t));
   if (mat == NULL) goto fail;
@@ -347,17 +762,55 @@ mat_t * mat_create(
   if (numrows == 0)                                  goto fail;
   if (numcols == 0)                                  goto fail;
   if (mat_is_symmetric(mat) && (numrows != numcols)) goto fail;
+  if (mat_is_tiled(mat)     && !mat_is_symmetric(mat)) goto fail;
+  if (mat_elem_size(mat) == sizeof(uint16_t) &&
+      ((flags >> MAT_ELEM_FLOAT32) & 1))             goto fail;
   if (mat_has_row_labels(mat) && labelsize == 0)     goto fail;
   if (mat_has_col_labels(mat) && labelsize == 0)     goto fail;
   
-  mat->hd = fopen(fname, "wb");
-  if (mat->hd == NULL) goto fail;
+  if (!shared) {
+    mat->hd = fopen(fname, "wb");
+    if (mat->hd == NULL) goto fail;
+  }
+
+  /*
+   * other processes may already have written
+   * some rows, so the file must not be truncated
+   */
+  else {
+    fd = open(fname, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) goto fail;
+
+    if (ftruncate(fd, _mat_calc_offset(mat, numrows-1, numcols-1) +
+                      mat_elem_size(mat)))
+      goto fail;
+
+    mat->hd = fdopen(fd, "r+b");
+    if (mat->hd == NULL) goto fail;
+    fd = -1;
+  }
+
+  if (setvbuf(mat->hd, NULL, _IOFBF, MAT_WRITE_BUF_SIZE)) goto fail;
 
   if (_mat_write_header(mat)) goto fail;
 
+  /*
+   * clear out the header data and labels of any previous
+   * file - the caller writes its own after this anyway
+   */
+  if (shared) {
+
+    len = _mat_calc_offset(mat, 0, 0) - MAT_HDR_SIZE;
+
+    for (i = 0; i < len; i++) {
+      if (fputc(0, mat->hd) == EOF) goto fail;
+    }
+  }
+
   return mat;
 
 fail:
+  if (fd >= 0) close(fd);
   if (mat != NULL) {
     if (mat->hd != NULL) fclose(mat->hd);
     free(mat);
@@ -392,19 +845,20 @@ uint8_t mat_write_row_part(
 
   if (!mat_is_symmetric(mat) || (col >= row)) {
 
-    if (_mat_seek(mat,row,col))                            goto fail;
-    if (fwrite(vals, sizeof(double), len, mat->hd) != len) goto fail;
+    if (_mat_write_span(mat, row, col, len, vals)) goto fail;
   }
 
   else {
 
-    rowlen = col + len - row;
     collen = row - col;
+    if (collen > len) collen = len;
+    rowlen = len - collen;
 
     if (mat_write_col_part(mat, col, row, collen, vals)) goto fail;
-    if (_mat_seek(mat, row, row))                        goto fail;
-    if (fwrite(vals+collen, sizeof(double), rowlen, mat->hd) != rowlen)
-      goto fail;
+
+    if (rowlen > 0) {
+      if (_mat_write_span(mat, row, row, rowlen, vals+collen)) goto fail;
+    }
   }
 
   return 0;
@@ -413,6 +867,101 @@ fail:
   return 1;
 }
 
+uint8_t mat_write_rows(
+  mat_t *mat, uint64_t row, uint64_t nrows, double *vals) {
+
+  uint64_t i;
+  uint64_t off;
+  uint64_t len;
+
+  if (mat         == NULL)            goto fail;
+  if (mat->mode   != MAT_MODE_CREATE) goto fail;
+  if (vals        == NULL)            goto fail;
+  if (nrows       == 0)               return 0;
+  if (row + nrows >  mat->numrows)    goto fail;
+
+  if (mat_is_tiled(mat)) return _mat_write_tiled_rows(mat, row, nrows, vals);
+
+  if (_mat_seek(mat, row, mat_is_symmetric(mat) ? row : 0)) goto fail;
+
+  for (i = 0; i < nrows; i++) {
+
+    off = i * mat->numcols;
+    len = mat->numcols;
+
+    if (mat_is_symmetric(mat)) {
+      off += row + i;
+      len -= row + i;
+    }
+
+    if (_mat_write_vals(mat, len, vals+off)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_write_tiled_rows(
+  mat_t *mat, uint64_t row, uint64_t nrows, double *vals) {
+
+  uint64_t r;
+  uint64_t ti;
+  uint64_t tj;
+  uint64_t r0;
+  uint64_t r1;
+  uint64_t c0;
+  uint64_t w;
+  uint64_t n;
+  uint64_t off;
+  uint64_t pos;
+  double   zeros[MAT_TILE_SIZE];
+
+  memset(zeros, 0, sizeof(zeros));
+
+  n   = mat->numcols;
+  pos = 0;
+
+  for (ti = row / MAT_TILE_SIZE; ti*MAT_TILE_SIZE < row + nrows; ti++) {
+
+    r0 = ti * MAT_TILE_SIZE;
+    r1 = r0 + MAT_TILE_SIZE;
+
+    if (r0 < row)         r0 = row;
+    if (r1 > row + nrows) r1 = row + nrows;
+
+    for (tj = ti; tj*MAT_TILE_SIZE < n; tj++) {
+
+      c0 = tj * MAT_TILE_SIZE;
+      w  = n - c0;
+      if (w > MAT_TILE_SIZE) w = MAT_TILE_SIZE;
+
+      off = _mat_calc_offset(mat, r0, c0);
+
+      if (off != pos && fseeko(mat->hd, off, SEEK_SET)) goto fail;
+
+      for (r = r0; r < r1; r++) {
+
+        /*the lower triangle of a diagonal tile is padding*/
+        if (tj == ti) {
+          if (_mat_write_vals(mat, r - c0, zeros))                 goto fail;
+          if (_mat_write_vals(mat, w - (r - c0), vals + (r-row)*n + r))
+            goto fail;
+        }
+        else if (_mat_write_vals(mat, w, vals + (r-row)*n + c0))  goto fail;
+      }
+
+      pos = off + (r1 - r0) * w * mat_elem_size(mat);
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
 uint8_t mat_write_col(mat_t *mat, uint64_t col, double *vals) {
 
   return mat_write_col_part(mat, 0, col, mat->numrows, vals);
@@ -434,8 +983,8 @@ uint8_t mat_write_col_part(
 
   for (i = 0; i < len; i++, row++) {
 
-    if (_mat_seek(mat, row, col))                        goto fail;
-    if (fwrite(vals+i, sizeof(double), 1, mat->hd) != 1) goto fail;
+    if (_mat_seek(mat, row, col))        goto fail;
+    if (_mat_write_vals(mat, 1, vals+i)) goto fail;
   }
 
   return 0;
@@ -446,36 +995,35 @@ fail:
 
 uint8_t mat_write_row_label(mat_t *mat, uint64_t row, void *data) {
 
-  if (mat            == NULL)            goto fail;
-  if (mat->mode      != MAT_MODE_CREATE) goto fail;
-  if (row            >= mat->numrows)    goto fail;
-  if (mat->labelsize == 0)               goto fail;
-  if (!mat_has_row_labels(mat))          goto fail;
+  return mat_write_row_labels(mat, row, 1, data);
+}
 
-  if (_mat_seek_to(mat, MAT_SEEK_ROWLABEL))            goto fail;
-  if (fseeko(mat->hd, (mat->labelsize)*row, SEEK_CUR)) goto fail;
-  if (fwrite(data, mat->labelsize, 1, mat->hd) != 1)   goto fail;
+uint8_t mat_write_col_label(mat_t *mat, uint64_t col, void *data) {
+
+  return mat_write_col_labels(mat, col, 1, data);
+}
+
+uint8_t mat_write_row_labels(
+  mat_t *mat, uint64_t row, uint64_t len, void *data) {
+
+  if (mat            == NULL)         goto fail;
+  if (!mat_has_row_labels(mat))       goto fail;
+  if (row + len      >  mat->numrows) goto fail;
+
+  return _mat_write_labels(mat, MAT_SEEK_ROWLABEL, row, len, data);
 
-  return 0;
-  
 fail:
   return 1;
 }
 
-uint8_t mat_write_col_label(mat_t *mat, uint64_t col, void *data) {
-
-  if (mat            == NULL)            goto fail;
-  if (mat->mode      != MAT_MODE_CREATE) goto fail;
-  if (col            == 0)               goto fail;
-  if (col            >= mat->numcols)    goto fail;
-  if (mat->labelsize == 0)               goto fail;
-  if (!mat_has_col_labels(mat))          goto fail;
+uint8_t mat_write_col_labels(
+  mat_t *mat, uint64_t col, uint64_t len, void *data) {
 
-  if (_mat_seek_to(mat, MAT_SEEK_COLLABEL))            goto fail;
-  if (fseeko(mat->hd, (mat->labelsize)*col, SEEK_CUR)) goto fail;
-  if (fwrite(data, mat->labelsize, 1, mat->hd) != 1)   goto fail; 
+  if (mat            == NULL)         goto fail;
+  if (!mat_has_col_labels(mat))       goto fail;
+  if (col + len      >  mat->numcols) goto fail;
 
-  return 0;
+  return _mat_write_labels(mat, MAT_SEEK_COLLABEL, col, len, data);
 
 fail:
   return 1;
@@ -506,6 +1054,289 @@ fail:
   return 1;
 }
 
+uint8_t _mat_read_vals(
+  mat_t *mat, uint64_t offset, uint64_t len, double *vals) {
+
+  uint64_t size;
+
+  size = len * mat_elem_size(mat);
+
+  if (mat->map != NULL) {
+
+    if (offset + size > mat->mapsize) goto fail;
+
+    _mat_decode(mat, mat->map + offset, len, vals);
+  }
+
+  else {
+
+    /*
+     * values are read into the vals array, and
+     * then expanded in place to double precision
+     */
+    if (fseeko(mat->hd, offset, SEEK_SET))                    goto fail;
+    if (fread(vals, mat_elem_size(mat), len, mat->hd) != len) goto fail;
+
+    _mat_decode(mat, vals, len, vals);
+  }
+
+  PROFILE_COUNT(PROFILE_MAT_READ, size);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_read_labels(
+  mat_t *mat, mat_seek_loc_t what, uint64_t first, uint64_t len, void *data) {
+
+  uint64_t off;
+
+  if (mat->labelsize == 0) goto fail;
+  if (len            == 0) return 0;
+
+  /*labels are laid out as in _mat_seek_to*/
+  if (mat->map != NULL) {
+
+    off = MAT_HDR_SIZE + mat->hdrsize + first * mat->labelsize;
+
+    if (what == MAT_SEEK_COLLABEL && mat_has_row_labels(mat))
+      off += mat->numrows * mat->labelsize;
+
+    if (off + len * mat->labelsize > mat->mapsize) goto fail;
+
+    memcpy(data, mat->map + off, len * mat->labelsize);
+    return 0;
+  }
+
+  if (_mat_seek_to(mat, what))                           goto fail;
+  if (fseeko(mat->hd, mat->labelsize * first, SEEK_CUR)) goto fail;
+  if (fread(data, mat->labelsize, len, mat->hd) != len)  goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_write_labels(
+  mat_t *mat, mat_seek_loc_t what, uint64_t first, uint64_t len, void *data) {
+
+  if (mat->mode      != MAT_MODE_CREATE) goto fail;
+  if (mat->labelsize == 0)               goto fail;
+  if (len            == 0)               return 0;
+
+  if (_mat_seek_to(mat, what))                           goto fail;
+  if (fseeko(mat->hd, mat->labelsize * first, SEEK_CUR)) goto fail;
+  if (fwrite(data, mat->labelsize, len, mat->hd) != len) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_read_span(
+  mat_t *mat, uint64_t row, uint64_t col, uint64_t len, double *vals) {
+
+  uint64_t n;
+
+  if (!mat_is_tiled(mat))
+    return _mat_read_vals(mat, _mat_calc_offset(mat, row, col), len, vals);
+
+  for (; len > 0; len -= n, col += n, vals += n) {
+
+    n = MAT_TILE_SIZE - (col % MAT_TILE_SIZE);
+    if (n > len) n = len;
+
+    if (_mat_read_vals(mat, _mat_calc_offset(mat, row, col), n, vals))
+      goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_write_span(
+  mat_t *mat, uint64_t row, uint64_t col, uint64_t len, double *vals) {
+
+  uint64_t n;
+
+  for (; len > 0; len -= n, col += n, vals += n) {
+
+    n = len;
+
+    if (mat_is_tiled(mat)) {
+      n = MAT_TILE_SIZE - (col % MAT_TILE_SIZE);
+      if (n > len) n = len;
+    }
+
+    if (_mat_seek(mat, row, col))      goto fail;
+    if (_mat_write_vals(mat, n, vals)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mat_write_vals(mat_t *mat, uint64_t len, double *vals) {
+
+  uint64_t i;
+  uint64_t n;
+  uint8_t  buf[MAT_CONV_BUF_LEN * sizeof(float)];
+
+  PROFILE_COUNT(PROFILE_MAT_WRITTEN, len * mat_elem_size(mat));
+
+  if (mat_elem_size(mat) == sizeof(double)) {
+    if (fwrite(vals, sizeof(double), len, mat->hd) != len) goto fail;
+    return 0;
+  }
+
+  for (i = 0; i < len; i += n) {
+
+    n = len - i;
+    if (n > MAT_CONV_BUF_LEN) n = MAT_CONV_BUF_LEN;
+
+    _mat_encode(mat, vals+i, n, buf);
+
+    if (fwrite(buf, mat_elem_size(mat), n, mat->hd) != n) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _mat_decode(mat_t *mat, const void *src, uint64_t len, double *dst) {
+
+  uint64_t       i;
+  const uint8_t *bytes;
+  float          f;
+  uint16_t       h;
+
+  bytes = src;
+
+  /*
+   * values are converted from last to first, so the
+   * conversion can be performed in place - the value
+   * at index i is always read before it is overwritten
+   */
+  switch (mat_elem_size(mat)) {
+
+    case sizeof(double):
+      if ((const void *)dst != src) memmove(dst, src, len*sizeof(double));
+      break;
+
+    case sizeof(float):
+      for (i = len; i > 0; i--) {
+        memcpy(&f, bytes + (i-1)*sizeof(float), sizeof(float));
+        dst[i-1] = f;
+      }
+      break;
+
+    case sizeof(uint16_t):
+      for (i = len; i > 0; i--) {
+        memcpy(&h, bytes + (i-1)*sizeof(uint16_t), sizeof(uint16_t));
+        dst[i-1] = _half_to_double(h);
+      }
+      break;
+  }
+}
+
+void _mat_encode(mat_t *mat, double *src, uint64_t len, void *dst) {
+
+  uint64_t i;
+  uint8_t *bytes;
+  float    f;
+  uint16_t h;
+
+  bytes = dst;
+
+  switch (mat_elem_size(mat)) {
+
+    case sizeof(double):
+      memcpy(dst, src, len*sizeof(double));
+      break;
+
+    case sizeof(float):
+      for (i = 0; i < len; i++) {
+        f = src[i];
+        memcpy(bytes + i*sizeof(float), &f, sizeof(float));
+      }
+      break;
+
+    case sizeof(uint16_t):
+      for (i = 0; i < len; i++) {
+        h = _double_to_half(src[i]);
+        memcpy(bytes + i*sizeof(uint16_t), &h, sizeof(uint16_t));
+      }
+      break;
+  }
+}
+
+double _half_to_double(uint16_t h) {
+
+  uint16_t sign;
+  uint16_t expo;
+  uint16_t mant;
+  double   val;
+
+  sign = (h >> 15) & 0x1;
+  expo = (h >> 10) & 0x1F;
+  mant =  h        & 0x3FF;
+
+  if      (expo == 0)    val = ldexp(mant, -24);
+  else if (expo == 0x1F) val = (mant == 0) ? INFINITY : NAN;
+  else                   val = ldexp(mant | 0x400, expo - 25);
+
+  return sign ? -val : val;
+}
+
+uint16_t _double_to_half(double d) {
+
+  uint16_t sign;
+  int      expo;
+  double   mant;
+  uint32_t bits;
+
+  sign = signbit(d) ? 0x8000 : 0;
+  d    = fabs(d);
+
+  if (isnan(d)) return sign | 0x7E00;
+  if (isinf(d)) return sign | 0x7C00;
+
+  /*d = mant * 2^expo, where 0.5 <= mant < 1*/
+  mant = frexp(d, &expo);
+
+  /*
+   * subnormal or zero - the value is stored as a
+   * multiple of 2^-24, and rounds up to the smallest
+   * normal value if necessary
+   */
+  if (d == 0 || expo < -13) {
+    bits = nearbyint(ldexp(d, 24));
+    return sign | bits;
+  }
+
+  /*
+   * 11 significant bits, rounded to nearest even; if rounding
+   * carries into bit 11, the exponent field is incremented
+   * by the addition below, which is what we want
+   */
+  bits = nearbyint(ldexp(mant, 11));
+  bits = ((expo + 14) << 10) + (bits - 0x400);
+
+  if (bits >= 0x7C00) return sign | 0x7C00;
+
+  return sign | bits;
+}
+
 uint8_t _mat_read_header(mat_t *mat) {
 
   uint16_t id;
@@ -568,10 +1399,14 @@ uint64_t _mat_calc_offset(mat_t *mat, uint64_t row, uint64_t col) {
   uint64_t clbl_off;
   uint64_t row_off;
   uint64_t col_off;
+  uint64_t bi;
+  uint64_t bj;
+  uint64_t h;
+  uint64_t w;
 
   nrows    = mat->numrows;
   ncols    = mat->numcols;
-  val_size = sizeof(double);
+  val_size = mat_elem_size(mat);
   rlbl_off = 0;
   clbl_off = 0;
   row_off  = 0;
@@ -584,7 +1419,28 @@ uint64_t _mat_calc_offset(mat_t *mat, uint64_t row, uint64_t col) {
   if (mat_has_col_labels(mat))
     clbl_off = (mat->labelsize) * ncols;
 
-  if (mat_is_symmetric(mat)) {
+  /*
+   * tiles (bi,bj), bi <= bj, are stored row by row - the tile rows
+   * before bi are all MAT_TILE_SIZE high, and tile row bi is h high,
+   * with all but its last tile MAT_TILE_SIZE wide
+   */
+  if (mat_is_tiled(mat)) {
+
+    bi = row / MAT_TILE_SIZE;
+    bj = col / MAT_TILE_SIZE;
+    h  = nrows - bi * MAT_TILE_SIZE;
+    w  = ncols - bj * MAT_TILE_SIZE;
+
+    if (h > MAT_TILE_SIZE) h = MAT_TILE_SIZE;
+    if (w > MAT_TILE_SIZE) w = MAT_TILE_SIZE;
+
+    row_off = MAT_TILE_SIZE * (bi * ncols - MAT_TILE_SIZE * (bi * (bi-1) / 2))
+            + h * (bj - bi) * MAT_TILE_SIZE
+            + (row % MAT_TILE_SIZE) * w;
+    row_off *= val_size;
+    col_off  = (col % MAT_TILE_SIZE) * val_size;
+  }
+  else if (mat_is_symmetric(mat)) {
     row_off = ((ncols * row) - round(row*(row-1.0)/2.0)) * val_size;
     col_off = (col - row) * val_size;
   }
@@ -22,10 +22,18 @@ typedef enum {
   MAT_IS_SYMMETRIC   = 0,
   MAT_HAS_ROW_LABELS = 1,
   MAT_HAS_COL_LABELS = 2,
-
+  MAT_ELEM_FLOAT32   = 3, /**< values stored as single precision */
+  MAT_ELEM_FLOAT16   = 4, /**< values stored as half precision   */
+  MAT_IS_TILED       = 5, /**< symmetric matrix stored as packed
+                               MAT_TILE_SIZE square tiles        */
 
 } mat_flags_t;
 
+/**
+ * Width/height of the tiles in a file with the MAT_IS_TILED flag.
+ */
+#define MAT_TILE_SIZE 256
+
 
 /**
  * Opens an existing mat file for reading.
@@ -36,6 +44,30 @@ mat_t * mat_open(
   char *fname /**< name of file to open */
 );
 
+/**
+ * Opens an existing mat file for reading, and maps it into memory. All of
+ * the read functions work as normal, but copy data from the mapping rather
+ * than reading from the file; in addition, zero-copy access to the
+ * matrix rows is available via mat_row_ptr. The mapping is shared, so
+ * multiple processes reading the same file will share the page cache.
+ *
+ * \return a newly allocated mat_t struct on success, NULL on failure.
+ */
+mat_t * mat_open_mmap(
+  char *fname /**< name of file to open */
+);
+
+/**
+ * Flushes everything that has been written to the given mat file through
+ * to disk, so that it survives the process being killed, or the machine
+ * going down.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_sync(
+  mat_t *mat /**< mat file to flush */
+);
+
 /**
  * Closes the given mat file.
  */
@@ -85,6 +117,23 @@ uint8_t mat_is_symmetric(
   mat_t *mat /**< mat file to query */
 );
 
+/**
+ * \return non-0 if the given mat file is stored in tiles (see
+ * MAT_IS_TILED and README.MAT), 0 otherwise.
+ */
+uint8_t mat_is_tiled(
+  mat_t *mat /**< mat file to query */
+);
+
+/**
+ * \return the width/height of the tiles which the given mat file is
+ * stored in, or 0 if it is not tiled. Blocks which are aligned to tile
+ * boundaries are the cheapest to read with mat_read_block.
+ */
+uint64_t mat_tile_size(
+  mat_t *mat /**< mat file to query */
+);
+
 /**
  * \return non-0 if the given mat file has row labels, 0 otherwise.
  */
@@ -99,6 +148,25 @@ uint8_t mat_has_col_labels(
   mat_t *mat /**< mat file to query */
 );
 
+/**
+ * \return the size, in bytes, of one value as stored in the file - 8 by
+ * default, or 4 or 2 if the MAT_ELEM_FLOAT32 or MAT_ELEM_FLOAT16 flags are
+ * set. Values are always converted to/from double when they are read or
+ * written.
+ */
+uint8_t mat_elem_size(
+  mat_t *mat /**< mat file to query */
+);
+
+/**
+ * \return non-0 if the given mat file was opened with mat_open_mmap, 0
+ * otherwise. Reads from a mapped file may be performed concurrently from
+ * multiple threads.
+ */
+uint8_t mat_is_mapped(
+  mat_t *mat /**< mat file to query */
+);
+
 /**
  * \return the element at the given row/column.
  */
@@ -132,6 +200,47 @@ uint8_t mat_read_row_part(
   double  *vals /**< space to store row section */
 );
 
+/**
+ * Copies the block of nrows*ncols values, whose top left corner is at the
+ * given row/column, into the given array, in row-major order. Values in
+ * the lower triangle of a symmetric file are translated into the upper
+ * triangle.
+ *
+ * For tiled files, the part of the block within each tile is read with a
+ * single contiguous read, so it is much faster to read a block of rows
+ * in one go than to read each of its rows individually. For other files,
+ * the block is read one row at a time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_read_block(
+  mat_t   *mat,   /**< mat file to query                 */
+  uint64_t row,   /**< first row of the block            */
+  uint64_t col,   /**< first column of the block         */
+  uint64_t nrows, /**< number of rows in the block       */
+  uint64_t ncols, /**< number of columns in the block    */
+  double  *vals   /**< space to store nrows*ncols values */
+);
+
+/**
+ * Returns a pointer to the stored data for the given row of a mat file
+ * which was opened with mat_open_mmap. For symmetric files, only the
+ * upper triangle is stored, so the pointer is to the element on the
+ * diagonal, and the row contains (numcols - row) values; otherwise, the
+ * pointer is to the first element in the row.
+ *
+ * \return a pointer to the row data, or NULL if the file was not opened
+ * with mat_open_mmap, its values are not stored as double precision, it
+ * is tiled (so its rows are not contiguous), the row data is not aligned
+ * to an 8 byte boundary (which depends on the size of the header data and
+ * labels), or the row is out of bounds. Rows for which NULL is returned
+ * can be read with mat_read_row_part.
+ */
+const double * mat_row_ptr(
+  mat_t   *mat, /**< mat file to query */
+  uint64_t row  /**< row index         */
+);
+
 /**
  * Copies the specified column into the given pointer.
  *
@@ -178,6 +287,33 @@ uint8_t mat_read_col_label(
   void    *data /**< space to store column label */
 );
 
+/**
+ * Reads the labels for the given range of rows, with a single read. The
+ * labels are stored contiguously, mat_label_size bytes each, so all of
+ * the row labels can be read at once with row 0 and len mat_num_rows.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_read_row_labels(
+  mat_t   *mat, /**< mat file to query              */
+  uint64_t row, /**< first row                      */
+  uint64_t len, /**< number of labels to read       */
+  void    *data /**< space to store len row labels  */
+);
+
+/**
+ * Reads the labels for the given range of columns, with a single read -
+ * see mat_read_row_labels.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_read_col_labels(
+  mat_t   *mat, /**< mat file to query              */
+  uint64_t col, /**< first column                   */
+  uint64_t len, /**< number of labels to read       */
+  void    *data /**< space to store len col labels  */
+);
+
 /**
  * Reads the header data from the given file.
  *
@@ -202,6 +338,26 @@ mat_t * mat_create(
   uint8_t  labelsize /**< label size             */
 );
 
+/**
+ * Creates or opens a mat file which is written by several processes at
+ * once, each of which writes a different set of rows. Unlike mat_create,
+ * an existing file is not truncated - it is resized to the size of the
+ * full matrix, so the rows written by the other processes are retained.
+ * Every process must pass the same arguments, and write the same header
+ * data and labels. The header data and label sections are cleared when
+ * the file is opened.
+ *
+ * \return a newly allocated mat_t struct on success, NULL on failure.
+ */
+mat_t * mat_create_shared(
+  char    *fname,    /**< name of file to create */
+  uint64_t numrows,  /**< number of rows         */
+  uint64_t numcols,  /**< number of columns      */
+  uint16_t flags,    /**< file options           */
+  uint16_t hdrsize,  /**< header data size       */
+  uint8_t  labelsize /**< label size             */
+);
+
 /**
  * Writes the value to the specified row/column.
  *
@@ -238,6 +394,27 @@ uint8_t mat_write_row_part(
   double  *vals /**< data to write             */
 );
 
+/**
+ * Writes a block of consecutive, complete rows, starting at the given row.
+ * The vals array must contain (nrows*numcols) values, in row-major order.
+ * For symmetric files, only the values on or above the diagonal are
+ * written; those below it are ignored.
+ *
+ * Rows are contiguous in the file, so the whole block is written with a
+ * single seek, followed by a sequence of buffered writes. This is much
+ * faster than writing a large matrix element by element. In a tiled file,
+ * a block of rows which is aligned to tile boundaries is also written
+ * with a single seek; otherwise, one seek is needed for every tile row.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_write_rows(
+  mat_t   *mat,   /**< mat file to write to     */
+  uint64_t row,   /**< first row to write to    */
+  uint64_t nrows, /**< number of rows to write  */
+  double  *vals   /**< data to write            */
+);
+
 /**
  * Writes the data to the specified column.
  *
@@ -284,6 +461,30 @@ uint8_t mat_write_col_label(
   void    *data /**< data to write        */
 );
 
+/**
+ * Writes the labels for the given range of rows, with a single write.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_write_row_labels(
+  mat_t   *mat, /**< mat file to write to                     */
+  uint64_t row, /**< first row to write to                    */
+  uint64_t len, /**< number of labels to write                */
+  void    *data /**< len labels, mat_label_size bytes each    */
+);
+
+/**
+ * Writes the labels for the given range of columns, with a single write.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t mat_write_col_labels(
+  mat_t   *mat, /**< mat file to write to                     */
+  uint64_t col, /**< first column to write to                 */
+  uint64_t len, /**< number of labels to write                */
+  void    *data /**< len labels, mat_label_size bytes each    */
+);
+
 /**
  * Writes the given data to the header data section.
  * The header data section is then padded with 0s.
@@ -11,21 +11,34 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "io/ngdb.h"
+#include "util/vbyte.h"
+#include "util/profile.h"
 
 /**********************************
  * Data structures and definitions.
  *********************************/
 
-#define NGDB_FILE_ID   0x1357
-#define NGDB_NODE_SYNC 0x2468
-#define NGDB_REF_SYNC  0x9753
+#define NGDB_FILE_ID    0x1357
+#define NGDB_FILE_ID_V2 0x1358
+#define NGDB_FILE_ID_V3 0x1359
+#define NGDB_NODE_SYNC  0x2468
+#define NGDB_REF_SYNC   0x9753
+
+/**
+ * Size of the stdio buffer used for ngdb files.
+ */
+#define NGDB_BUF_SIZE 1048576
 
 typedef enum __ngdb_mode {
 
   NGDB_MODE_READ,
-  NGDB_MODE_CREATE
+  NGDB_MODE_CREATE,
+  NGDB_MODE_UPDATE
 } ngdb_mode_t;
 
 /**
@@ -39,8 +52,38 @@ struct __ngdb {
   uint16_t    rdata_len; /**< reference data section length     */
   uint32_t    num_nodes; /**< number of nodes in the graph      */
   uint32_t    num_refs;  /**< number of references in the graph */
-  ngdb_mode_t mode;      /**< read only/create mode             */
+  ngdb_mode_t mode;      /**< read only/create/update mode      */
+  uint16_t    version;   /**< file format version (1, 2 or 3)   */
 
+  /*
+   * The remaining fields are only used for version 2 and 3 files.
+   */
+  uint64_t   *offsets;   /**< index of the first reference of each node
+                              (num_nodes+1 values), or for version 3
+                              files, the offset of the reference block
+                              of each node. While a file is being
+                              created, offsets[i+1] is instead the number
+                              of references for node i                 */
+  uint8_t    *buf;       /**< scratch space for reading references    */
+  uint64_t    buflen;    /**< length of buf                           */
+  uint32_t   *nidxs;     /**< create mode, only used if references were
+                              not added in node order - the node of
+                              every reference, in the order they were
+                              added                                   */
+  uint64_t    nidxcap;   /**< capacity of nidxs                       */
+  uint32_t    lastidx;   /**< create mode - node of the most recently
+                              added reference                         */
+  uint8_t     sorted;    /**< create mode - whether references have
+                              been added in node order                */
+  uint8_t     atend;     /**< create mode - whether fid is positioned
+                              at the end of the reference list        */
+  uint8_t    *map;       /**< file mapping, if the file was opened
+                              with ngdb_open_mmap. The offset table is
+                              not read into memory in this case       */
+  uint64_t    mapsize;   /**< size of file mapping                    */
+  uint8_t     compress;  /**< create mode - whether the file is to be
+                              written in the version 3 format when it
+                              is closed                               */
 };
 
 /**
@@ -74,6 +117,18 @@ typedef struct __ref {
  * Private function prototypes
  ****************************/
 
+/**
+ * Opens the given file, reads its header and, for version 2 and 3 files,
+ * its offset table. In NGDB_MODE_UPDATE, the file is opened for reading
+ * and writing.
+ *
+ * \return a newly allocated ngdb_t struct on success, NULL on failure.
+ */
+static ngdb_t * _ngdb_open(
+  char       *filename, /**< name of the file to open         */
+  ngdb_mode_t mode      /**< NGDB_MODE_READ or NGDB_MODE_UPDATE */
+);
+
 /**
  * Reads the header from the start of the ngdb->fid file.and copies the
  * information into the other fields of ngdb_t. Also checks the file ID bytes,
@@ -131,62 +186,198 @@ static uint8_t _ngdb_read_node(
 );
 
 /**
- * Writes/rewrites the given node to the given graph.
+ * Read the reference at the given file address.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _ngdb_write_node(
-  ngdb_t *ngdb, /**< the graph in question */
-  node_t *node  /**< node info             */
+static uint8_t _ngdb_read_ref(
+  ngdb_t   *ngdb, /**< the graph in question            */
+  uint32_t  addr, /**< address of reference             */
+  ref_t    *ref   /**< ref_t struct to put reference in */
 );
 
 /**
- * Read the reference at the given file address.
+ * Translates the given node index into a file location.
+ *
+ * \return the file location.
+ */
+static uint32_t _ngdb_idx_to_addr(
+  ngdb_t   *ngdb, /**< the graph in question */
+  uint32_t  idx   /**< the node in question  */
+);
+
+/**
+ * \return the file location of the data for the given node, in a file of
+ * any version.
+ */
+static uint64_t _ngdb_node_data_addr(
+  ngdb_t   *ngdb, /**< the graph in question */
+  uint32_t  idx   /**< the node in question  */
+);
+
+/**
+ * \return the file location of the data for the given node, in a version 2
+ * file.
+ */
+static uint64_t _ngdb_v2_node_addr(
+  ngdb_t   *ngdb, /**< the graph in question */
+  uint32_t  idx   /**< the node in question  */
+);
+
+/**
+ * \return the file location of the reference at the given index (into the
+ * list of all references), in a version 2 file.
+ */
+static uint64_t _ngdb_v2_ref_addr(
+  ngdb_t   *ngdb, /**< the graph in question             */
+  uint64_t  ridx  /**< index into the list of references */
+);
+
+/**
+ * Reads the reference offset table from a version 2 file, and checks that
+ * it is valid, and that the file is big enough to contain all of the
+ * references.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _ngdb_read_ref(
+static uint8_t _ngdb_v2_read_offsets(
+  ngdb_t *ngdb /**< the graph in question */
+);
+
+/**
+ * Copies len bytes from the given location in a version 2 file, either from
+ * the file mapping, or from the file itself.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v2_read_at(
+  ngdb_t   *ngdb, /**< the graph in question  */
+  uint64_t  addr, /**< file location          */
+  uint64_t  len,  /**< number of bytes to read */
+  void     *dst   /**< place to put the bytes  */
+);
+
+/**
+ * Looks up the location of the references for the given node, in a version
+ * 2 file which has been opened for reading. For version 3 files, first and
+ * nrefs are instead the offset and length, in bytes, of the reference
+ * block of the node.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v2_node_refs(
+  ngdb_t   *ngdb,  /**< the graph in question                       */
+  uint32_t  idx,   /**< the node in question                        */
+  uint64_t *first, /**< place to store the index of the first ref   */
+  uint64_t *nrefs  /**< place to store the number of refs, or NULL  */
+);
+
+/**
+ * Reads a contiguous run of references from a version 2 file. If the graph
+ * has no reference data, or data is NULL, the reference data is not copied.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v2_read_refs(
+  ngdb_t   *ngdb,  /**< the graph in question                        */
+  uint64_t  first, /**< index of the first reference to read         */
+  uint64_t  nrefs, /**< number of references to read                 */
+  uint32_t *refs,  /**< memory to store nrefs references             */
+  uint8_t  *data   /**< NULL, or memory to store nrefs*rdata_len bytes */
+);
+
+/**
+ * Gets a pointer to len bytes of the reference blocks of a version 3 file,
+ * starting at the given block offset. A mapped file is accessed directly;
+ * otherwise the bytes are read into ngdb->buf.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v3_read_blocks(
   ngdb_t   *ngdb, /**< the graph in question            */
-  uint32_t  addr, /**< address of reference             */
-  ref_t    *ref   /**< ref_t struct to put reference in */
+  uint64_t  off,  /**< offset of the first byte         */
+  uint64_t  len,  /**< number of bytes                  */
+  uint8_t **blk   /**< place to store a pointer to them */
 );
 
 /**
- * Writes/rewrites the given reference to the graph.
+ * Decodes the reference block of one node in a version 3 file. If refs is
+ * NULL, only the number of references is decoded.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _ngdb_write_ref(
-  ngdb_t *ngdb, /**< the graph in question  */
-  ref_t  *ref   /**< the reference to write */
+static uint8_t _ngdb_v3_decode(
+  ngdb_t   *ngdb,  /**< the graph in question                          */
+  uint8_t  *blk,   /**< the reference block                            */
+  uint64_t  len,   /**< length of the block in bytes                   */
+  uint32_t *nrefs, /**< place to store the number of references        */
+  uint32_t *refs,  /**< NULL, or memory to store the references        */
+  uint8_t  *data   /**< NULL, or memory to store nrefs*rdata_len bytes */
 );
 
 /**
- * Appends the given reference address to the given node's reference list.
+ * Reads and decodes the references of one node in a version 3 file (see
+ * _ngdb_v3_decode).
  *
- * \return 0 on success, non-0 on error;
+ * \return 0 on success, non-0 on failure.
  */
-static uint8_t _ngdb_add_to_ref_list(
-  ngdb_t   *ngdb, /**< the graph in question */
-  node_t   *node, /**< the node in question  */
-  ref_t    *ref   /**< the new reference     */
+static uint8_t _ngdb_v3_read_node(
+  ngdb_t   *ngdb,  /**< the graph in question                          */
+  uint32_t  idx,   /**< the node in question                           */
+  uint32_t *nrefs, /**< place to store the number of references        */
+  uint32_t *refs,  /**< NULL, or memory to store the references        */
+  uint8_t  *data   /**< NULL, or memory to store nrefs*rdata_len bytes */
 );
 
 /**
- * Translates the given node index into a file location.
+ * Called the first time a reference is added out of node order. Allocates
+ * ngdb->nidxs, and fills it in for the references which have already been
+ * added.
  *
- * \return the file location.
+ * \return 0 on success, non-0 on failure.
  */
-static uint32_t _ngdb_idx_to_addr(
-  ngdb_t   *ngdb, /**< the graph in question */
-  uint32_t  idx   /**< the node in question  */
+static uint8_t _ngdb_v2_unsort(
+  ngdb_t *ngdb /**< the graph in question */
+);
+
+/**
+ * Completes a version 2 file which is being created - sorts the references
+ * by node, if necessary, and writes the offset table.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v2_finalise(
+  ngdb_t *ngdb /**< the graph in question */
+);
+
+/**
+ * Called by _ngdb_v2_finalise for a compressed file, which is being
+ * created, once its references have been sorted. Reads the references
+ * back in, and replaces them, and the offset table, with the version 3
+ * reference blocks and block offsets. The block of each node contains:
+ *
+ *   - the number of references (see vbyte_encode)
+ *   - if the graph has reference data, the number of leading bytes of
+ *     the data of every reference which are 0, and so are not stored
+ *   - the references (see vbyte_stream_encode)
+ *   - the remaining bytes of the data of each reference
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_v3_write_refs(
+  ngdb_t *ngdb /**< the graph in question */
 );
 
 /**
- * \return a file address to write the next reference to.
+ * Re-orders the references in a version 2 file which is being created, so
+ * that the references for each node are stored contiguously, in the order
+ * in which they were added. The offset table must contain the index of the
+ * first reference for each node.
+ *
+ * \return 0 on success, non-0 on failure.
  */
-static uint32_t _ngdb_new_ref_addr(
-  ngdb_t *ngdb /**< The graph in question */
+static uint8_t _ngdb_v2_sort_refs(
+  ngdb_t *ngdb /**< the graph in question */
 );
 
 /******************
@@ -200,21 +391,88 @@ static uint32_t _ngdb_new_ref_addr(
  */
 ngdb_t * ngdb_open(char *filename) {
 
+  return _ngdb_open(filename, NGDB_MODE_READ);
+}
+
+ngdb_t * ngdb_open_update(char *filename) {
+
+  return _ngdb_open(filename, NGDB_MODE_UPDATE);
+}
+
+ngdb_t * _ngdb_open(char *filename, ngdb_mode_t mode) {
+
   ngdb_t *ngdb;
   ngdb = NULL;
 
   if (filename == NULL) goto fail;
 
-  ngdb = malloc(sizeof(ngdb_t));
+  ngdb = calloc(1, sizeof(ngdb_t));
+  if (ngdb == NULL) goto fail;
+
+  if (mode == NGDB_MODE_UPDATE) ngdb->fid = fopen(filename, "r+b");
+  else                          ngdb->fid = fopen(filename, "r");
+  if (ngdb->fid == NULL) goto fail;
+
+  if (setvbuf(ngdb->fid, NULL, _IOFBF, NGDB_BUF_SIZE)) goto fail;
+  if (_ngdb_read_header(ngdb) != 0)                    goto fail;
+
+  if (ngdb->version >= 2 && _ngdb_v2_read_offsets(ngdb)) goto fail;
+
+  ngdb->mode = mode;
+  
+  return ngdb;
+
+fail:
+
+  if (ngdb != NULL) {
+    if (ngdb->fid     != NULL) fclose(ngdb->fid);
+    if (ngdb->offsets != NULL) free(ngdb->offsets);
+    free(ngdb);
+  }
+  return NULL;
+}
+
+/**
+ * Opens the file as normal, but does not read the offset table, and then
+ * maps the file into memory.
+ */
+ngdb_t * ngdb_open_mmap(char *filename) {
+
+  ngdb_t     *ngdb;
+  struct stat st;
+
+  ngdb = NULL;
+
+  if (filename == NULL) goto fail;
+
+  ngdb = calloc(1, sizeof(ngdb_t));
   if (ngdb == NULL) goto fail;
 
   ngdb->fid = fopen(filename, "r");
   if (ngdb->fid == NULL) goto fail;
 
   if (_ngdb_read_header(ngdb) != 0) goto fail;
+  if (ngdb->version           <  2) goto fail;
 
   ngdb->mode = NGDB_MODE_READ;
-  
+
+  if (fstat(fileno(ngdb->fid), &st) != 0) goto fail;
+
+  ngdb->mapsize = st.st_size;
+
+  /*the reference blocks of a version 3 file are checked as they are used*/
+  if (ngdb->version == 2 &&
+      ngdb->mapsize < _ngdb_v2_ref_addr(ngdb, ngdb->num_refs)) goto fail;
+  if (ngdb->mapsize < _ngdb_v2_ref_addr(ngdb, 0))              goto fail;
+
+  ngdb->map = mmap(
+    NULL, ngdb->mapsize, PROT_READ, MAP_SHARED, fileno(ngdb->fid), 0);
+
+  if (ngdb->map == MAP_FAILED) {
+    ngdb->map = NULL;
+    goto fail;
+  }
+
   return ngdb;
 
 fail:
@@ -226,29 +484,39 @@ fail:
   return NULL;
 }
 
+uint8_t ngdb_is_mapped(ngdb_t *ngdb) {
+
+  return ngdb->map != NULL;
+}
+
 /**
  * Closes ngdb->fid and frees ngdb. If ngdb->mode is NGDB_MODE_CREATE, writes
- * out the header section before closing.
+ * out the reference offset table and header section before closing.
  */
 uint8_t ngdb_close(ngdb_t *ngdb) {
 
-  if (ngdb      == NULL) goto fail;
-  if (ngdb->fid == NULL) goto fail;
+  uint8_t err;
+
+  err = 0;
 
-  if (ngdb->mode == NGDB_MODE_CREATE) {
+  if (ngdb      == NULL) return 1;
+  if (ngdb->fid == NULL) err = 1;
 
-    if (_ngdb_write_header(ngdb) != 0) goto fail;
+  if (!err && ngdb->mode == NGDB_MODE_CREATE) {
+
+    if (_ngdb_v2_finalise(ngdb)  != 0) err = 1;
+    if (_ngdb_write_header(ngdb) != 0) err = 1;
   }
 
-  fclose(ngdb->fid);
-  ngdb->fid = NULL;
-  free(ngdb);
+  if (ngdb->map != NULL && munmap(ngdb->map, ngdb->mapsize) != 0) err = 1;
+  if (ngdb->fid != NULL && fclose(ngdb->fid)                != 0) err = 1;
 
-  return 0;
-fail:
+  if (ngdb->offsets != NULL) free(ngdb->offsets);
+  if (ngdb->buf     != NULL) free(ngdb->buf);
+  if (ngdb->nidxs   != NULL) free(ngdb->nidxs);
+  free(ngdb);
 
-  if (ngdb != NULL) free(ngdb);
-  return 1;
+  return err;
 }
 
 /**
@@ -296,13 +564,30 @@ uint32_t ngdb_num_refs(ngdb_t *ngdb) {
  */
 uint32_t ngdb_node_num_refs(ngdb_t *ngdb, uint32_t idx) {
 
-  node_t node;
+  node_t   node;
+  uint64_t first;
+  uint64_t nrefs;
+  uint32_t n;
   node.data = NULL;
 
   if (ngdb      == NULL)            goto fail;
   if (ngdb->fid == NULL)            goto fail;
   if (idx       >= ngdb->num_nodes) goto fail;
 
+  if (ngdb->version == 3) {
+
+    if (_ngdb_v3_read_node(ngdb, idx, &n, NULL, NULL)) goto fail;
+    return n;
+  }
+
+  if (ngdb->version == 2) {
+
+    if (ngdb->mode == NGDB_MODE_CREATE) return ngdb->offsets[idx+1];
+
+    if (_ngdb_v2_node_refs(ngdb, idx, &first, &nrefs)) goto fail;
+    return nrefs;
+  }
+
   if (_ngdb_read_node(ngdb, idx, &node) != 0) goto fail;
 
   return node.num_refs;
@@ -313,14 +598,54 @@ fail:
 
 uint32_t ngdb_node_get_ref(ngdb_t *ngdb, uint32_t nidx, uint32_t ridx) {
 
-  node_t node;
-  ref_t  ref;
+  node_t    node;
+  ref_t     ref;
+  uint32_t  idx;
+  uint32_t  n;
+  uint32_t *refs;
+  uint64_t  first;
+  uint64_t  nrefs;
   node.data = NULL;
   ref.data  = NULL;
+  refs      = NULL;
 
   if (ngdb      == NULL) goto fail;
   if (ngdb->fid == NULL) goto fail;
 
+  /*version 3 - the whole reference block must be decoded*/
+  if (ngdb->version == 3) {
+
+    if (nidx >= ngdb->num_nodes)                        goto fail;
+    if (_ngdb_v3_read_node(ngdb, nidx, &n, NULL, NULL)) goto fail;
+    if (ridx >= n)                                      goto fail;
+
+    refs = malloc(n*sizeof(uint32_t));
+    if (refs == NULL) goto fail;
+
+    if (_ngdb_v3_read_node(ngdb, nidx, &n, refs, NULL)) goto fail;
+
+    idx = refs[ridx];
+    free(refs);
+
+    return idx;
+  }
+
+  if (ngdb->version == 2) {
+
+    if (ngdb->mode == NGDB_MODE_CREATE)                 goto fail;
+    if (nidx       >= ngdb->num_nodes)                  goto fail;
+    if (_ngdb_v2_node_refs(ngdb, nidx, &first, &nrefs)) goto fail;
+    if (ridx       >= nrefs)                            goto fail;
+
+    if (_ngdb_v2_read_at(ngdb,
+                         _ngdb_v2_ref_addr(ngdb, first + ridx),
+                         sizeof(idx),
+                         &idx))
+      goto fail;
+
+    return idx;
+  }
+
   if (_ngdb_read_node(ngdb, nidx, &node) != 0) goto fail;
 
   if (ridx >= node.num_refs) goto fail;
@@ -346,13 +671,17 @@ uint32_t ngdb_node_get_ref(ngdb_t *ngdb, uint32_t nidx, uint32_t ridx) {
   return ref.idx;
 
 fail:
+  if (refs != NULL) free(refs);
   return 0xFFFFFFFF;
 }
 
 uint8_t ngdb_node_get_all_refs(
   ngdb_t *ngdb, uint32_t idx, uint32_t *refs, void *data) {
 
+  uint32_t n;
   uint32_t refno;
+  uint64_t first;
+  uint64_t nrefs;
   node_t   node;
   ref_t    ref;
   uint8_t *udata;
@@ -369,6 +698,21 @@ uint8_t ngdb_node_get_all_refs(
   
   if (ngdb->rdata_len == 0) udata = NULL;
 
+  if (ngdb->version == 3)
+    return _ngdb_v3_read_node(ngdb, idx, &n, refs, udata);
+
+  /*
+   * version 2 - all references for the node are stored
+   * contiguously, so they can be read in one go
+   */
+  if (ngdb->version == 2) {
+
+    if (ngdb->mode == NGDB_MODE_CREATE)                goto fail;
+    if (_ngdb_v2_node_refs(ngdb, idx, &first, &nrefs)) goto fail;
+
+    return _ngdb_v2_read_refs(ngdb, first, nrefs, refs, udata);
+  }
+
   if (_ngdb_read_node(ngdb, idx, &node) != 0) goto fail;
 
   /*no refs to look up, or invalid first ref*/
@@ -392,6 +736,76 @@ fail:
   return 1;
 }
 
+uint8_t ngdb_nodes_get_all_refs(
+  ngdb_t *ngdb, uint32_t start, uint32_t n, uint32_t *refs, void *data) {
+
+  uint64_t i;
+  uint64_t first;
+  uint64_t last;
+  uint64_t lastn;
+  uint64_t off;
+  uint64_t len;
+  uint32_t nrefs;
+  uint8_t *udata;
+  uint8_t *blk;
+
+  udata = data;
+
+  if (ngdb      == NULL)                     goto fail;
+  if (ngdb->fid == NULL)                     goto fail;
+  if (refs      == NULL)                     goto fail;
+  if ((uint64_t)start + n > ngdb->num_nodes) goto fail;
+
+  if (ngdb->rdata_len == 0) udata = NULL;
+
+  if (ngdb->version == 2) {
+
+    if (ngdb->mode == NGDB_MODE_CREATE) goto fail;
+    if (n          == 0)              return 0;
+
+    if (_ngdb_v2_node_refs(ngdb, start,     &first, NULL))   goto fail;
+    if (_ngdb_v2_node_refs(ngdb, start+n-1, &last,  &lastn)) goto fail;
+
+    if (ngdb->version == 2)
+      return _ngdb_v2_read_refs(
+        ngdb, first, last + lastn - first, refs, udata);
+
+    /*version 3 - the blocks are read in one go, and decoded one by one*/
+    if (_ngdb_v3_read_blocks(ngdb, first, last + lastn - first, &blk))
+      goto fail;
+
+    for (i = start; i < (uint64_t)start + n; i++) {
+
+      if (_ngdb_v2_node_refs(ngdb, i, &off, &len)) goto fail;
+      if (_ngdb_v3_decode(
+            ngdb, blk + off - first, len, &nrefs, refs, udata))
+        goto fail;
+
+      refs += nrefs;
+      if (udata != NULL) udata += (uint64_t)nrefs*ngdb->rdata_len;
+    }
+
+    return 0;
+  }
+
+  /*version 1 - one node at a time*/
+  for (i = start; i < (uint64_t)start + n; i++) {
+
+    nrefs = ngdb_node_num_refs(ngdb, i);
+    if (nrefs == 0xFFFFFFFF) goto fail;
+
+    if (ngdb_node_get_all_refs(ngdb, i, refs, udata)) goto fail;
+
+    refs += nrefs;
+    if (udata != NULL) udata += nrefs*ngdb->rdata_len;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
 /**
  * Copies the header data section into the data.
  */
@@ -402,6 +816,8 @@ uint8_t ngdb_hdr_get_data(ngdb_t *ngdb, uint8_t *data) {
   if (data            == NULL) goto fail;
   if (ngdb->hdata_len == 0)    return 1;
 
+  ngdb->atend = 0;
+
   if (_ngdb_read_hdr_data(ngdb, data) != 0) goto fail;
 
   return 0;
@@ -425,6 +841,17 @@ uint8_t ngdb_node_get_data(ngdb_t *ngdb, uint32_t idx, uint8_t *data) {
   /*there is no data in this graph*/
   if (ngdb->ndata_len == 0) return 1;
 
+  if (ngdb->version >= 2) {
+
+    ngdb->atend = 0;
+
+    if (_ngdb_v2_read_at(
+          ngdb, _ngdb_v2_node_addr(ngdb, idx), ngdb->ndata_len, data))
+      goto fail;
+
+    return 0;
+  }
+
   node.data = data;
 
   if (_ngdb_read_node(ngdb, idx, &node) != 0) goto fail;
@@ -435,11 +862,56 @@ fail:
   return 2;
 }
 
+uint8_t ngdb_nodes_get_data(
+  ngdb_t *ngdb, uint32_t start, uint32_t n, uint8_t *data) {
+
+  uint64_t i;
+
+  if (ngdb      == NULL)                     goto fail;
+  if (ngdb->fid == NULL)                     goto fail;
+  if (data      == NULL)                     goto fail;
+  if ((uint64_t)start + n > ngdb->num_nodes) goto fail;
+
+  if (ngdb->ndata_len == 0) return 1;
+  if (n               == 0) return 0;
+
+  if (ngdb->version >= 2) {
+
+    ngdb->atend = 0;
+
+    if (_ngdb_v2_read_at(ngdb,
+                         _ngdb_v2_node_addr(ngdb, start),
+                         (uint64_t)n*ngdb->ndata_len,
+                         data))
+      goto fail;
+
+    return 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (ngdb_node_get_data(ngdb, start+i, data + i*ngdb->ndata_len))
+      goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 2;
+}
+
 uint8_t ngdb_ref_get_data(
 ngdb_t *ngdb, uint32_t nidx, uint32_t ridx, uint8_t *data) {
 
-  node_t node;
-  ref_t  ref;
+  node_t    node;
+  ref_t     ref;
+  uint64_t  first;
+  uint64_t  nrefs;
+  uint32_t  n;
+  uint32_t *refs;
+  uint8_t  *rdata;
+
+  refs  = NULL;
+  rdata = NULL;
 
   if (ngdb            == NULL)            goto fail;
   if (ngdb->fid       == NULL)            goto fail; 
@@ -447,6 +919,41 @@ ngdb_t *ngdb, uint32_t nidx, uint32_t ridx, uint8_t *data) {
   if (nidx            >= ngdb->num_nodes) goto fail;
   if (ngdb->rdata_len == 0)               return 1;
 
+  if (ngdb->version == 3) {
+
+    if (_ngdb_v3_read_node(ngdb, nidx, &n, NULL, NULL)) goto fail;
+    if (ridx >= n)                                      goto fail;
+
+    refs  = malloc(n*sizeof(uint32_t));
+    rdata = malloc((uint64_t)n*ngdb->rdata_len);
+    if (refs  == NULL) goto fail;
+    if (rdata == NULL) goto fail;
+
+    if (_ngdb_v3_read_node(ngdb, nidx, &n, refs, rdata)) goto fail;
+
+    memcpy(data, rdata + (uint64_t)ridx*ngdb->rdata_len, ngdb->rdata_len);
+
+    free(refs);
+    free(rdata);
+    return 0;
+  }
+
+  if (ngdb->version == 2) {
+
+    if (ngdb->mode == NGDB_MODE_CREATE)                 goto fail;
+    if (_ngdb_v2_node_refs(ngdb, nidx, &first, &nrefs)) goto fail;
+    if (ridx       >= nrefs)                            goto fail;
+
+    if (_ngdb_v2_read_at(ngdb,
+                         _ngdb_v2_ref_addr(ngdb, first + ridx) +
+                         sizeof(uint32_t),
+                         ngdb->rdata_len,
+                         data))
+      goto fail;
+
+    return 0;
+  }
+
   node.data = NULL;
   node.dlen = 0;
 
@@ -468,6 +975,8 @@ ngdb_t *ngdb, uint32_t nidx, uint32_t ridx, uint8_t *data) {
 
   return 0;
 fail:
+  if (refs  != NULL) free(refs);
+  if (rdata != NULL) free(rdata);
   return 2;
 }
 
@@ -480,37 +989,36 @@ char *filename, uint32_t num_nodes,
 uint16_t hdata_len, uint16_t ndata_len, uint16_t rdata_len) {
 
   ngdb_t *ngdb;
-  uint32_t i;
-  node_t node;
 
   ngdb = NULL;
 
   if (filename == NULL) goto fail;
 
-  ngdb = malloc(sizeof(ngdb_t));
+  ngdb = calloc(1, sizeof(ngdb_t));
   if (ngdb == NULL) goto fail;
 
   ngdb->fid = fopen(filename, "wb+");
   if (ngdb->fid == NULL) goto fail;
 
+  if (setvbuf(ngdb->fid, NULL, _IOFBF, NGDB_BUF_SIZE)) goto fail;
+
   ngdb->hdata_len  = hdata_len;
   ngdb->ndata_len  = ndata_len;
   ngdb->rdata_len  = rdata_len;
   ngdb->num_nodes  = num_nodes;
   ngdb->num_refs   = 0;
   ngdb->mode       = NGDB_MODE_CREATE;
+  ngdb->version    = 2;
+  ngdb->sorted     = 1;
 
-  for (i = 0; i < num_nodes; i++) {
-
-    node.num_refs  = 0;
-    node.first_ref = 0;
-    node.last_ref  = 0;
-    node.data      = NULL;
-    node.dlen      = 0;
-    node.idx       = i;
-    if (_ngdb_write_node(ngdb, &node) != 0) goto fail;
-  }
-  if (fflush(ngdb->fid) != 0) goto fail;
+  /*
+   * the header, node data and offset table are all a fixed
+   * size, so nothing needs to be written until data is
+   * provided - any sections which are never written will
+   * read back as zeros
+   */
+  ngdb->offsets = calloc((uint64_t)num_nodes+1, sizeof(uint64_t));
+  if (ngdb->offsets == NULL) goto fail;
 
   return ngdb;
 
@@ -522,53 +1030,206 @@ fail:
       fclose(ngdb->fid);
       remove(filename);
     }
+    if (ngdb->offsets != NULL) free(ngdb->offsets);
     free(ngdb);
   }
  
   return NULL;
 }
 
-uint32_t ngdb_add_ref(
-ngdb_t *ngdb, uint32_t idx, uint32_t refidx, void *data, uint16_t dlen) {
+ngdb_t * ngdb_create_compressed(
+char *filename, uint32_t num_nodes,
+uint16_t hdata_len, uint16_t ndata_len, uint16_t rdata_len) {
 
-  node_t   node;
-  ref_t    ref;
-  uint32_t raddr;
+  ngdb_t *ngdb;
 
-  if (ngdb       == NULL)             goto fail;
-  if (ngdb->fid  == NULL)             goto fail;
-  if (idx        >= ngdb->num_nodes)  goto fail;
-  if (refidx     >= ngdb->num_nodes)  goto fail;
-  if (ngdb->mode != NGDB_MODE_CREATE) goto fail;
+  ngdb = ngdb_create(filename, num_nodes, hdata_len, ndata_len, rdata_len);
+  if (ngdb == NULL) return NULL;
 
-  /*
-   * write new reference to end of file
-   * read in 'idx' node
-   * add new ref to idx node's ref list
-   * update idx node's ref count
-   */
-  raddr = _ngdb_new_ref_addr(ngdb);
+  ngdb->compress = 1;
 
-  ref.idx   = refidx;
-  ref.next  = 0;
-  ref.addr  = raddr;
-  ref.dlen  = dlen;
-  ref.data  = data;
-  node.data = NULL;
-  node.dlen = 0;
+  return ngdb;
+}
+
+uint32_t ngdb_add_ref(
+ngdb_t *ngdb, uint32_t idx, uint32_t refidx, void *data, uint16_t dlen) {
+
+  uint32_t *tmp;
+  uint8_t   zero;
+
+  zero = 0;
+
+  if (ngdb           == NULL)             goto fail;
+  if (ngdb->fid      == NULL)             goto fail;
+  if (idx            >= ngdb->num_nodes)  goto fail;
+  if (refidx         >= ngdb->num_nodes)  goto fail;
+  if (ngdb->mode     != NGDB_MODE_CREATE) goto fail;
+  if (dlen           >  ngdb->rdata_len)  goto fail;
+  if (dlen != 0 && data == NULL)          goto fail;
+  if (ngdb->num_refs == 0xFFFFFFFE)       goto fail;
+
+  /*
+   * references are appended to the end of the reference list;
+   * if they are not added in node order, we need to keep track
+   * of which node each reference belongs to, so they can be
+   * sorted when the file is closed
+   */
+  if (ngdb->sorted && idx < ngdb->lastidx) {
+    if (_ngdb_v2_unsort(ngdb)) goto fail;
+  }
+
+  if (!ngdb->sorted) {
+
+    if (ngdb->num_refs == ngdb->nidxcap) {
+
+      tmp = realloc(ngdb->nidxs, 2*ngdb->nidxcap*sizeof(uint32_t));
+      if (tmp == NULL) goto fail;
+
+      ngdb->nidxs   = tmp;
+      ngdb->nidxcap = 2*ngdb->nidxcap;
+    }
+
+    ngdb->nidxs[ngdb->num_refs] = idx;
+  }
+
+  if (!ngdb->atend) {
+    if (fseeko(ngdb->fid,
+               _ngdb_v2_ref_addr(ngdb, ngdb->num_refs),
+               SEEK_SET) != 0)
+      goto fail;
+  }
+
+  /*a failed write leaves the file position unknown*/
+  ngdb->atend = 0;
+
+  if (fwrite(&refidx, sizeof(refidx), 1, ngdb->fid) != 1) goto fail;
+  if (dlen != 0 && fwrite(data, dlen, 1, ngdb->fid) != 1)  goto fail;
 
-  if (_ngdb_write_ref(ngdb, &ref)              != 0) goto fail; 
-  if (_ngdb_read_node(ngdb, idx, &node)        != 0) goto fail;
-  if (_ngdb_add_to_ref_list(ngdb, &node, &ref) != 0) goto fail;
+  for (; dlen < ngdb->rdata_len; dlen++)
+    if (fwrite(&zero, 1, 1, ngdb->fid) != 1) goto fail;
 
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN, sizeof(refidx) + ngdb->rdata_len);
+
+  ngdb->atend   = 1;
+  ngdb->lastidx = idx;
   ngdb->num_refs++;
+  ngdb->offsets[idx+1]++;
 
-  return node.num_refs-1;
+  return ngdb->offsets[idx+1]-1;
 
 fail:
   return 0xFFFFFFFF;
 }
 
+uint8_t ngdb_node_add_refs(
+  ngdb_t *ngdb, uint32_t idx, uint32_t n, uint32_t *refs, void *data) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  chunk;
+  uint64_t  rsize;
+  uint8_t  *tmp;
+  uint8_t  *rec;
+  uint32_t *nidxs;
+
+  if (ngdb           == NULL)             goto fail;
+  if (ngdb->fid      == NULL)             goto fail;
+  if (idx            >= ngdb->num_nodes)  goto fail;
+  if (ngdb->mode     != NGDB_MODE_CREATE) goto fail;
+  if (n != 0 && refs == NULL)             goto fail;
+  if ((uint64_t)ngdb->num_refs + n > 0xFFFFFFFE) goto fail;
+
+  if (n == 0) return 0;
+
+  for (i = 0; i < n; i++) {
+    if (refs[i] >= ngdb->num_nodes) goto fail;
+  }
+
+  /* the same bookkeeping as ngdb_add_ref */
+  if (ngdb->sorted && idx < ngdb->lastidx) {
+    if (_ngdb_v2_unsort(ngdb)) goto fail;
+  }
+
+  if (!ngdb->sorted) {
+
+    if ((uint64_t)ngdb->num_refs + n > ngdb->nidxcap) {
+
+      j = 2*ngdb->nidxcap;
+      if (j < (uint64_t)ngdb->num_refs + n) j = (uint64_t)ngdb->num_refs + n;
+
+      nidxs = realloc(ngdb->nidxs, j*sizeof(uint32_t));
+      if (nidxs == NULL) goto fail;
+
+      ngdb->nidxs   = nidxs;
+      ngdb->nidxcap = j;
+    }
+
+    for (i = 0; i < n; i++) ngdb->nidxs[ngdb->num_refs+i] = idx;
+  }
+
+  /*
+   * the reference records are assembled in the scratch
+   * buffer, and written in chunks of up to NGDB_BUF_SIZE
+   * bytes, rather than with several writes per reference
+   */
+  rsize = sizeof(uint32_t) + ngdb->rdata_len;
+  chunk = NGDB_BUF_SIZE / rsize;
+  if (chunk == 0) chunk = 1;
+  if (chunk > n)  chunk = n;
+
+  if (ngdb->buflen < chunk*rsize) {
+
+    tmp = realloc(ngdb->buf, chunk*rsize);
+    if (tmp == NULL) goto fail;
+
+    ngdb->buf    = tmp;
+    ngdb->buflen = chunk*rsize;
+  }
+
+  if (!ngdb->atend) {
+    if (fseeko(ngdb->fid,
+               _ngdb_v2_ref_addr(ngdb, ngdb->num_refs),
+               SEEK_SET) != 0)
+      goto fail;
+  }
+
+  /*a failed write leaves the file position unknown*/
+  ngdb->atend = 0;
+
+  for (i = 0; i < n; i += chunk) {
+
+    if (chunk > n - i) chunk = n - i;
+
+    for (j = 0; j < chunk; j++) {
+
+      rec = ngdb->buf + j*rsize;
+
+      memcpy(rec, refs + i + j, sizeof(uint32_t));
+
+      if (ngdb->rdata_len == 0) continue;
+
+      if (data == NULL) memset(rec + sizeof(uint32_t), 0, ngdb->rdata_len);
+      else              memcpy(rec + sizeof(uint32_t),
+                               (uint8_t *)data + (i+j)*ngdb->rdata_len,
+                               ngdb->rdata_len);
+    }
+
+    if (fwrite(ngdb->buf, rsize, chunk, ngdb->fid) != chunk) goto fail;
+  }
+
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN, n*rsize);
+
+  ngdb->atend           = 1;
+  ngdb->lastidx         = idx;
+  ngdb->num_refs       += n;
+  ngdb->offsets[idx+1] += n;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
 uint8_t ngdb_hdr_set_data(ngdb_t *ngdb, uint8_t *data, uint16_t dlen) {
 
   if ( ngdb            == NULL)             goto fail;
@@ -578,6 +1239,8 @@ uint8_t ngdb_hdr_set_data(ngdb_t *ngdb, uint8_t *data, uint16_t dlen) {
   if ( dlen            != 0 
     && data            == NULL)             goto fail;
 
+  ngdb->atend = 0;
+
   if (_ngdb_write_hdr_data(ngdb, data, dlen) != 0) goto fail;
 
   return 0;
@@ -589,24 +1252,163 @@ fail:
 uint8_t ngdb_node_set_data(
 ngdb_t *ngdb, uint32_t idx, uint8_t *data, uint16_t dlen) {
 
-  node_t node;
-  node.data = NULL;
+  uint8_t zero;
+
+  zero = 0;
 
   if (ngdb              == NULL)             goto fail;
   if (ngdb->fid         == NULL)             goto fail;
-  if (ngdb->mode        != NGDB_MODE_CREATE) goto fail;
+  if (ngdb->mode        == NGDB_MODE_READ)   goto fail;
   if (dlen != 0 && data == NULL)             goto fail;
   if (dlen              >  ngdb->ndata_len)  goto fail;
   if (idx               >= ngdb->num_nodes)  goto fail;
 
+  ngdb->atend = 0;
+
+  if (fseeko(ngdb->fid, _ngdb_node_data_addr(ngdb, idx), SEEK_SET) != 0)
+    goto fail;
+
+  if (dlen != 0 && fwrite(data, dlen, 1, ngdb->fid) != 1) goto fail;
+
+  for (; dlen < ngdb->ndata_len; dlen++)
+    if (fwrite(&zero, 1, 1, ngdb->fid) != 1) goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN, ngdb->ndata_len);
+
+  return 0;
+fail:
+  return 1;
+}
+
+uint8_t ngdb_nodes_set_data(
+  ngdb_t *ngdb, uint32_t start, uint32_t n, uint8_t *data) {
+
+  uint64_t i;
+
+  if (ngdb       == NULL)                     goto fail;
+  if (ngdb->fid  == NULL)                     goto fail;
+  if (ngdb->mode == NGDB_MODE_READ)           goto fail;
+  if (data       == NULL)                     goto fail;
+  if ((uint64_t)start + n  > ngdb->num_nodes) goto fail;
+
+  if (ngdb->ndata_len == 0) goto fail;
+  if (n               == 0) return 0;
+
+  if (ngdb->version >= 2) {
+
+    ngdb->atend = 0;
+
+    if (fseeko(ngdb->fid, _ngdb_v2_node_addr(ngdb, start), SEEK_SET) != 0)
+      goto fail;
+    if (fwrite(data, ngdb->ndata_len, n, ngdb->fid) != n)
+      goto fail;
+
+    PROFILE_COUNT(PROFILE_NGDB_WRITTEN, (uint64_t)n*ngdb->ndata_len);
+
+    return 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    if (ngdb_node_set_data(ngdb,
+                           start+i,
+                           data + i*ngdb->ndata_len,
+                           ngdb->ndata_len))
+      goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t ngdb_node_set_all_ref_data(ngdb_t *ngdb, uint32_t idx, void *data) {
+
+  uint64_t first;
+  uint64_t nrefs;
+  uint64_t rsize;
+  uint64_t refno;
+  uint8_t *udata;
+  uint8_t *tmp;
+  node_t   node;
+  ref_t    ref;
+
+  udata     = data;
+  node.data = NULL;
+  ref.data  = NULL;
+
+  if (ngdb            == NULL)             goto fail;
+  if (ngdb->fid       == NULL)             goto fail;
+  if (ngdb->mode      != NGDB_MODE_UPDATE) goto fail;
+  if (ngdb->version   == 3)                goto fail;
+  if (ngdb->rdata_len == 0)                goto fail;
+  if (data            == NULL)             goto fail;
+  if (idx             >= ngdb->num_nodes)  goto fail;
+
+  /*
+   * version 2 - the references of the node are contiguous,
+   * but are interleaved with their indices, so the block is
+   * read in, patched, and written back out in one go
+   */
+  if (ngdb->version == 2) {
+
+    rsize = sizeof(uint32_t) + ngdb->rdata_len;
+
+    if (_ngdb_v2_node_refs(ngdb, idx, &first, &nrefs)) goto fail;
+    if (nrefs == 0) return 0;
+
+    if (ngdb->buflen < nrefs*rsize) {
+
+      tmp = realloc(ngdb->buf, nrefs*rsize);
+      if (tmp == NULL) goto fail;
+
+      ngdb->buf    = tmp;
+      ngdb->buflen = nrefs*rsize;
+    }
+
+    if (_ngdb_v2_read_at(
+          ngdb, _ngdb_v2_ref_addr(ngdb, first), nrefs*rsize, ngdb->buf))
+      goto fail;
+
+    for (refno = 0; refno < nrefs; refno++)
+      memcpy(ngdb->buf + refno*rsize + sizeof(uint32_t),
+             udata     + refno*ngdb->rdata_len,
+             ngdb->rdata_len);
+
+    if (fseeko(ngdb->fid, _ngdb_v2_ref_addr(ngdb, first), SEEK_SET) != 0)
+      goto fail;
+    if (fwrite(ngdb->buf, rsize, nrefs, ngdb->fid) != nrefs)
+      goto fail;
+
+    PROFILE_COUNT(PROFILE_NGDB_WRITTEN, nrefs*rsize);
+
+    return 0;
+  }
+
+  /*
+   * version 1 - step through the reference list; the data
+   * follows the sync bytes, index and next address
+   */
   if (_ngdb_read_node(ngdb, idx, &node) != 0) goto fail;
 
-  node.data = data;
-  node.dlen = dlen;
+  if (node.num_refs  == 0) return 0;
+  if (node.first_ref == 0) goto fail;
+
+  ref.next = node.first_ref;
+  do {
 
-  if (_ngdb_write_node(ngdb, &node) != 0) goto fail;
+    if (_ngdb_read_ref(ngdb, ref.next, &ref) != 0) goto fail;
+
+    if (fseeko(ngdb->fid, ref.addr + 10, SEEK_SET)   != 0) goto fail;
+    if (fwrite(udata, ngdb->rdata_len, 1, ngdb->fid) != 1) goto fail;
+
+    PROFILE_COUNT(PROFILE_NGDB_WRITTEN, ngdb->rdata_len);
+
+    udata += ngdb->rdata_len;
+  } while (ref.next != 0);
 
   return 0;
+
 fail:
   return 1;
 }
@@ -623,7 +1425,11 @@ uint8_t _ngdb_read_header(ngdb_t *ngdb) {
 
   /*check file id*/
   if (fread(&id, sizeof(id), 1, ngdb->fid) != 1) goto fail;
-  if (id != NGDB_FILE_ID)                        goto fail;
+
+  if      (id == NGDB_FILE_ID)    ngdb->version = 1;
+  else if (id == NGDB_FILE_ID_V2) ngdb->version = 2;
+  else if (id == NGDB_FILE_ID_V3) ngdb->version = 3;
+  else                            goto fail;
 
   /*read in header*/
   if (fread(&(ngdb->hdata_len),  sizeof(ngdb->hdata_len), 1, ngdb->fid) != 1)
@@ -649,7 +1455,9 @@ uint8_t _ngdb_write_header(ngdb_t *ngdb) {
 
   rewind(ngdb->fid);
 
-  id = NGDB_FILE_ID;
+  if      (ngdb->version == 3) id = NGDB_FILE_ID_V3;
+  else if (ngdb->version == 2) id = NGDB_FILE_ID_V2;
+  else                         id = NGDB_FILE_ID;
   if (fwrite(&(id),              sizeof(id),              1, ngdb->fid) != 1)
     goto fail;
   if (fwrite(&(ngdb->hdata_len), sizeof(ngdb->hdata_len), 1, ngdb->fid) != 1)
@@ -724,6 +1532,13 @@ uint8_t _ngdb_read_node(ngdb_t *ngdb, uint32_t idx, node_t *node) {
   }
   else node->dlen = 0;
 
+  PROFILE_COUNT(PROFILE_NGDB_READ,
+                sizeof(sync)            +
+                sizeof(node->num_refs)  +
+                sizeof(node->first_ref) +
+                sizeof(node->last_ref)  +
+                node->dlen);
+
   node->idx = idx;
 
   return 0;
@@ -732,43 +1547,6 @@ fail:
   return 1;
 }
 
-uint8_t _ngdb_write_node(ngdb_t *ngdb, node_t *node) {
-
-  uint16_t sync;
-  uint16_t dlen;
-  uint8_t  tmp;
-
-  dlen = node->dlen;
-  tmp  = 0;
-
-  if (fseeko(ngdb->fid, _ngdb_idx_to_addr(ngdb, node->idx), SEEK_SET) != 0)
-    goto fail;
-
-  sync = NGDB_NODE_SYNC;
-  if (fwrite(&sync,              sizeof(sync),            1, ngdb->fid) != 1)
-    goto fail;
-  if (fwrite(&(node->num_refs),  sizeof(node->num_refs),  1, ngdb->fid) != 1)
-    goto fail;
-  if (fwrite(&(node->first_ref), sizeof(node->first_ref), 1, ngdb->fid) != 1)
-    goto fail;
-  if (fwrite(&(node->last_ref),  sizeof(node->last_ref),  1, ngdb->fid) != 1)
-    goto fail;
-
-  if (dlen != 0) {
-
-    /*write the provided data*/
-    if (fwrite(node->data, dlen, 1, ngdb->fid) != 1) goto fail;
-
-    /*zero fill the remainder*/
-    for (; dlen < ngdb->ndata_len; dlen++)
-      if (fwrite(&tmp, 1, 1, ngdb->fid) != 1) goto fail;
-  }
-
-  return 0;
-fail: 
-  return 1;
-}
-
 uint8_t _ngdb_read_ref(ngdb_t *ngdb, uint32_t addr, ref_t *ref) {
 
   uint16_t sync;
@@ -792,6 +1570,10 @@ uint8_t _ngdb_read_ref(ngdb_t *ngdb, uint32_t addr, ref_t *ref) {
   }
   else ref->dlen = 0;
 
+  PROFILE_COUNT(PROFILE_NGDB_READ,
+                sizeof(sync) + sizeof(ref->idx) + sizeof(ref->next) +
+                ref->dlen);
+
   ref->addr = addr;
 
   return 0;
@@ -801,79 +1583,564 @@ fail:
 
 }
 
-uint8_t _ngdb_write_ref(ngdb_t *ngdb, ref_t *ref) {
+uint32_t _ngdb_idx_to_addr(ngdb_t *ngdb, uint32_t idx) {
+
+  return (16 + ngdb->hdata_len) + idx*(14 + ngdb->ndata_len);
+}
+
+uint64_t _ngdb_node_data_addr(ngdb_t *ngdb, uint32_t idx) {
 
-  uint16_t sync;
-  uint16_t dlen;
-  uint8_t  tmp;
+  /*version 1 - the data follows the sync bytes and reference list info*/
+  if (ngdb->version == 1) return (uint64_t)_ngdb_idx_to_addr(ngdb, idx) + 14;
+
+  return _ngdb_v2_node_addr(ngdb, idx);
+}
+
+uint64_t _ngdb_v2_node_addr(ngdb_t *ngdb, uint32_t idx) {
+
+  return 16 + ngdb->hdata_len + (uint64_t)idx*ngdb->ndata_len;
+}
+
+uint64_t _ngdb_v2_ref_addr(ngdb_t *ngdb, uint64_t ridx) {
 
-  dlen = ref->dlen;
-  tmp  = 0;
+  return _ngdb_v2_node_addr(ngdb, ngdb->num_nodes)      +
+         ((uint64_t)ngdb->num_nodes+1)*sizeof(uint64_t) +
+         ridx*(sizeof(uint32_t) + ngdb->rdata_len);
+}
 
-  if (fseeko(ngdb->fid, ref->addr, SEEK_SET) != 0) goto fail;
+uint8_t _ngdb_v2_read_offsets(ngdb_t *ngdb) {
 
-  sync = NGDB_REF_SYNC;
-  if (fwrite(&(sync),      sizeof(sync),      1, ngdb->fid) != 1) goto fail;
-  if (fwrite(&(ref->idx),  sizeof(ref->idx),  1, ngdb->fid) != 1) goto fail;
-  if (fwrite(&(ref->next), sizeof(ref->next), 1, ngdb->fid) != 1) goto fail;
+  uint64_t    i;
+  uint64_t    n;
+  struct stat st;
 
-  if (dlen != 0) {
+  n = (uint64_t)ngdb->num_nodes+1;
 
-    /*write the provided data*/
-    if (fwrite(ref->data, dlen, 1, ngdb->fid) != 1) goto fail;
+  /*
+   * a file which is bigger than 4GB may have been
+   * truncated if it was copied by a tool without
+   * large file support
+   */
+  if (fstat(fileno(ngdb->fid), &st) != 0) goto fail;
+  if ((uint64_t)st.st_size < _ngdb_v2_ref_addr(ngdb, 0)) goto fail;
+  if (ngdb->version == 2 &&
+      (uint64_t)st.st_size < _ngdb_v2_ref_addr(ngdb, ngdb->num_refs))
+    goto fail;
+
+  ngdb->offsets = malloc(n*sizeof(uint64_t));
+  if (ngdb->offsets == NULL) goto fail;
+
+  if (fseeko(ngdb->fid, _ngdb_v2_node_addr(ngdb, ngdb->num_nodes), SEEK_SET))
+    goto fail;
+  if (fread(ngdb->offsets, sizeof(uint64_t), n, ngdb->fid) != n)
+    goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_READ, n*sizeof(uint64_t));
+
+  /*offsets must be ascending, and cover all of the references*/
+  if (ngdb->offsets[0] != 0) goto fail;
+
+  for (i = 0; i < ngdb->num_nodes; i++) {
+    if (ngdb->offsets[i+1] < ngdb->offsets[i]) goto fail;
+  }
 
-    /*zero fill the remainder*/
-    for (; dlen < ngdb->rdata_len; dlen++)
-      if (fwrite(&tmp, 1, 1, ngdb->fid) != 1) goto fail;
+  /*version 3 - the offsets must lie within the file*/
+  if (ngdb->version == 3) {
+    if (ngdb->offsets[ngdb->num_nodes] >
+        (uint64_t)st.st_size - _ngdb_v2_ref_addr(ngdb, 0))
+      goto fail;
   }
 
+  else if (ngdb->offsets[ngdb->num_nodes] != ngdb->num_refs) goto fail;
+
   return 0;
 
 fail:
   return 1;
 }
 
-uint8_t _ngdb_add_to_ref_list(ngdb_t *ngdb, node_t *node, ref_t *ref) {
+uint8_t _ngdb_v2_read_at(
+  ngdb_t *ngdb, uint64_t addr, uint64_t len, void *dst) {
+
+  if (ngdb->map != NULL) {
+
+    if (addr + len > ngdb->mapsize) goto fail;
+
+    memcpy(dst, ngdb->map + addr, len);
+    PROFILE_COUNT(PROFILE_NGDB_READ, len);
+    return 0;
+  }
+
+  if (fseeko(ngdb->fid, addr, SEEK_SET) != 0)   goto fail;
+  if (fread(dst, 1, len, ngdb->fid)     != len) goto fail;
 
-  ref_t tmp;
+  PROFILE_COUNT(PROFILE_NGDB_READ, len);
+
+  return 0;
+
+fail:
+  return 1;
+}
 
-  tmp.data = NULL;
-  tmp.dlen = 0;
+uint8_t _ngdb_v2_node_refs(
+  ngdb_t *ngdb, uint32_t idx, uint64_t *first, uint64_t *nrefs) {
 
-  /*first reference for this node - add address to node section*/
-  if (node->first_ref == 0) {
+  uint64_t offs[2];
+  uint64_t limit;
 
-    node->first_ref = ref->addr;
-    if (_ngdb_write_node(ngdb, node) != 0) goto fail;
+  if (ngdb->map == NULL) {
+    offs[0] = ngdb->offsets[idx];
+    offs[1] = ngdb->offsets[idx+1];
   }
 
-  /*otherwise add new ref address to end of list*/
+  /*
+   * the offset table of a mapped file is not validated
+   * when it is opened, so each entry is checked as it
+   * is used
+   */
   else {
 
-    if (_ngdb_read_ref(ngdb, node->last_ref, &tmp) != 0) goto fail;
+    memcpy(offs,
+           ngdb->map + _ngdb_v2_node_addr(ngdb, ngdb->num_nodes) +
+           (uint64_t)idx*sizeof(uint64_t),
+           sizeof(offs));
 
-    tmp.next = ref->addr;
+    if (ngdb->version == 3)
+      limit = ngdb->mapsize - _ngdb_v2_ref_addr(ngdb, 0);
+    else
+      limit = ngdb->num_refs;
 
-    if (_ngdb_write_ref(ngdb, &tmp) != 0) goto fail;
+    if (offs[1] < offs[0]) goto fail;
+    if (offs[1] > limit)   goto fail;
   }
 
-  node->num_refs++;
-  node->last_ref = ref->addr;
+  *first = offs[0];
+  if (nrefs != NULL) *nrefs = offs[1] - offs[0];
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ngdb_v2_read_refs(
+  ngdb_t *ngdb, uint64_t first, uint64_t nrefs, uint32_t *refs, uint8_t *data) {
+
+  uint64_t       refno;
+  uint64_t       rsize;
+  uint8_t       *tmp;
+  const uint8_t *src;
+
+  rsize = sizeof(uint32_t) + ngdb->rdata_len;
+
+  if (nrefs == 0) return 0;
 
-  if (_ngdb_write_node(ngdb, node) != 0) goto fail;
+  /*no data - the reference indices can be read straight in*/
+  if (ngdb->rdata_len == 0)
+    return _ngdb_v2_read_at(ngdb,
+                            _ngdb_v2_ref_addr(ngdb, first),
+                            nrefs*sizeof(uint32_t),
+                            refs);
+
+  if (ngdb->map != NULL) {
+    src = ngdb->map + _ngdb_v2_ref_addr(ngdb, first);
+    PROFILE_COUNT(PROFILE_NGDB_READ, nrefs*rsize);
+  }
+
+  else {
+
+    if (ngdb->buflen < nrefs*rsize) {
+
+      tmp = realloc(ngdb->buf, nrefs*rsize);
+      if (tmp == NULL) goto fail;
+
+      ngdb->buf    = tmp;
+      ngdb->buflen = nrefs*rsize;
+    }
+
+    if (_ngdb_v2_read_at(
+          ngdb, _ngdb_v2_ref_addr(ngdb, first), nrefs*rsize, ngdb->buf))
+      goto fail;
+
+    src = ngdb->buf;
+  }
+
+  for (refno = 0; refno < nrefs; refno++) {
+
+    memcpy(refs+refno, src + refno*rsize, sizeof(uint32_t));
+    if (data != NULL)
+      memcpy(data + refno*ngdb->rdata_len,
+             src  + refno*rsize + sizeof(uint32_t),
+             ngdb->rdata_len);
+  }
 
   return 0;
+
 fail:
   return 1;
 }
 
-uint32_t _ngdb_idx_to_addr(ngdb_t *ngdb, uint32_t idx) {
+uint8_t _ngdb_v3_read_blocks(
+  ngdb_t *ngdb, uint64_t off, uint64_t len, uint8_t **blk) {
 
-  return (16 + ngdb->hdata_len) + idx*(14 + ngdb->ndata_len);
+  uint64_t base;
+  uint8_t *tmp;
+
+  base = _ngdb_v2_ref_addr(ngdb, 0);
+
+  if (ngdb->map != NULL) {
+
+    if (base + off + len > ngdb->mapsize) goto fail;
+
+    *blk = ngdb->map + base + off;
+    PROFILE_COUNT(PROFILE_NGDB_READ, len);
+    return 0;
+  }
+
+  if (ngdb->buflen < len) {
+
+    tmp = realloc(ngdb->buf, len);
+    if (tmp == NULL) goto fail;
+
+    ngdb->buf    = tmp;
+    ngdb->buflen = len;
+  }
+
+  if (_ngdb_v2_read_at(ngdb, base + off, len, ngdb->buf)) goto fail;
+
+  *blk = ngdb->buf;
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ngdb_v3_decode(
+  ngdb_t   *ngdb,
+  uint8_t  *blk,
+  uint64_t  len,
+  uint32_t *nrefs,
+  uint32_t *refs,
+  uint8_t  *data) {
+
+  uint64_t i;
+  uint64_t n;
+  uint64_t used;
+  uint64_t dlen;
+  uint8_t  zeros;
+
+  zeros = 0;
+
+  used = vbyte_decode(blk, len, &n);
+  if (used == 0)          goto fail;
+  if (n    >  0xFFFFFFFF)  goto fail;
+
+  *nrefs = n;
+
+  if (refs == NULL || n == 0) return 0;
+
+  blk += used;
+  len -= used;
+
+  if (ngdb->rdata_len > 0) {
+
+    if (len == 0) goto fail;
+
+    zeros = *blk++;
+    len--;
+
+    if (zeros > ngdb->rdata_len) goto fail;
+  }
+
+  if (vbyte_stream_decode(blk, len, n, refs, &used)) goto fail;
+
+  blk += used;
+  len -= used;
+  dlen = ngdb->rdata_len - zeros;
+
+  if (len < n*dlen) goto fail;
+  if (data == NULL) return 0;
+
+  for (i = 0; i < n; i++) {
+
+    memset(data + i*ngdb->rdata_len,         0,            zeros);
+    memcpy(data + i*ngdb->rdata_len + zeros, blk + i*dlen, dlen);
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ngdb_v3_read_node(
+  ngdb_t   *ngdb,
+  uint32_t  idx,
+  uint32_t *nrefs,
+  uint32_t *refs,
+  uint8_t  *data) {
+
+  uint64_t off;
+  uint64_t len;
+  uint8_t *blk;
+
+  if (_ngdb_v2_node_refs(ngdb, idx, &off, &len)) goto fail;
+
+  /*the reference count is at the start of the block*/
+  if (refs == NULL && len > VBYTE_MAX_LEN) len = VBYTE_MAX_LEN;
+
+  if (_ngdb_v3_read_blocks(ngdb, off, len, &blk))         goto fail;
+  if (_ngdb_v3_decode(ngdb, blk, len, nrefs, refs, data)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ngdb_v2_unsort(ngdb_t *ngdb) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t ref;
+
+  ngdb->nidxcap = 2*(uint64_t)ngdb->num_refs;
+  if (ngdb->nidxcap < 1024) ngdb->nidxcap = 1024;
+
+  ngdb->nidxs = malloc(ngdb->nidxcap*sizeof(uint32_t));
+  if (ngdb->nidxs == NULL) goto fail;
+
+  /*the references added so far are in node order*/
+  for (i = 0, ref = 0; i < ngdb->num_nodes; i++) {
+    for (j = 0; j < ngdb->offsets[i+1]; j++) {
+      ngdb->nidxs[ref++] = i;
+    }
+  }
+
+  ngdb->sorted = 0;
+
+  return 0;
+
+fail:
+  return 1;
 }
 
-uint32_t _ngdb_new_ref_addr(ngdb_t *ngdb) {
+uint8_t _ngdb_v2_finalise(ngdb_t *ngdb) {
+
+  uint64_t i;
+  uint64_t n;
+
+  n = (uint64_t)ngdb->num_nodes+1;
+
+  /*turn the per-node reference counts into offsets*/
+  for (i = 0; i < ngdb->num_nodes; i++)
+    ngdb->offsets[i+1] += ngdb->offsets[i];
+
+  if (!ngdb->sorted && _ngdb_v2_sort_refs(ngdb)) goto fail;
+
+  if (ngdb->compress) return _ngdb_v3_write_refs(ngdb);
+
+  ngdb->atend = 0;
+
+  if (fseeko(ngdb->fid, _ngdb_v2_node_addr(ngdb, ngdb->num_nodes), SEEK_SET))
+    goto fail;
+  if (fwrite(ngdb->offsets, sizeof(uint64_t), n, ngdb->fid) != n)
+    goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN, n*sizeof(uint64_t));
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _ngdb_v3_write_refs(ngdb_t *ngdb) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  k;
+  uint64_t  n;
+  uint64_t  nrefs;
+  uint64_t  maxrefs;
+  uint64_t  rsize;
+  uint64_t  len;
+  uint8_t   zeros;
+  uint8_t  *in;
+  uint8_t  *src;
+  uint8_t  *blk;
+  uint32_t *refs;
+  uint64_t *boffs;
+
+  in    = NULL;
+  blk   = NULL;
+  refs  = NULL;
+  boffs = NULL;
+  n     = (uint64_t)ngdb->num_nodes+1;
+  rsize = sizeof(uint32_t) + ngdb->rdata_len;
+
+  maxrefs = 0;
+  for (i = 0; i < ngdb->num_nodes; i++) {
+    nrefs = ngdb->offsets[i+1] - ngdb->offsets[i];
+    if (nrefs > maxrefs) maxrefs = nrefs;
+  }
+
+  in    = malloc(ngdb->num_refs*rsize + 1);
+  refs  = malloc(maxrefs*sizeof(uint32_t) + 1);
+  boffs = malloc(n*sizeof(uint64_t));
+  blk   = malloc(VBYTE_MAX_LEN + 1 +
+                 vbyte_stream_max_len(maxrefs) +
+                 maxrefs*ngdb->rdata_len);
+
+  if (in    == NULL) goto fail;
+  if (refs  == NULL) goto fail;
+  if (boffs == NULL) goto fail;
+  if (blk   == NULL) goto fail;
+
+  ngdb->atend = 0;
+
+  if (fseeko(ngdb->fid, _ngdb_v2_ref_addr(ngdb, 0), SEEK_SET) != 0)
+    goto fail;
+  if (fread(in, rsize, ngdb->num_refs, ngdb->fid) != ngdb->num_refs)
+    goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_READ, ngdb->num_refs*rsize);
+
+  /*the blocks are written over the references which have just been read*/
+  if (fseeko(ngdb->fid, _ngdb_v2_ref_addr(ngdb, 0), SEEK_SET) != 0)
+    goto fail;
+
+  boffs[0] = 0;
+
+  for (i = 0; i < ngdb->num_nodes; i++) {
+
+    nrefs = ngdb->offsets[i+1] - ngdb->offsets[i];
+    src   = in + ngdb->offsets[i]*rsize;
+    len   = vbyte_encode(nrefs, blk);
+
+    if (nrefs > 0) {
+
+      /*find the number of leading data bytes which are always 0*/
+      if (ngdb->rdata_len > 0) {
+
+        zeros = ngdb->rdata_len;
+
+        for (j = 0; j < nrefs && zeros > 0; j++) {
+          for (k = 0; k < zeros; k++) {
+            if (src[j*rsize + sizeof(uint32_t) + k] != 0) break;
+          }
+          zeros = k;
+        }
+
+        blk[len++] = zeros;
+      }
+      else zeros = 0;
 
-  return _ngdb_idx_to_addr(ngdb, ngdb->num_nodes) + 
-         (ngdb->num_refs)*(10 + ngdb->rdata_len);
+      for (j = 0; j < nrefs; j++)
+        memcpy(refs+j, src + j*rsize, sizeof(uint32_t));
+
+      len += vbyte_stream_encode(refs, nrefs, blk + len);
+
+      for (j = 0; j < nrefs; j++) {
+
+        memcpy(blk + len,
+               src + j*rsize + sizeof(uint32_t) + zeros,
+               ngdb->rdata_len - zeros);
+        len += ngdb->rdata_len - zeros;
+      }
+    }
+
+    if (fwrite(blk, 1, len, ngdb->fid) != len) goto fail;
+
+    boffs[i+1] = boffs[i] + len;
+  }
+
+  if (fseeko(ngdb->fid, _ngdb_v2_node_addr(ngdb, ngdb->num_nodes), SEEK_SET))
+    goto fail;
+  if (fwrite(boffs, sizeof(uint64_t), n, ngdb->fid) != n)
+    goto fail;
+
+  /*
+   * the blocks are usually smaller than the references
+   * which they replaced, so the rest of the file is cut
+   */
+  if (fflush(ngdb->fid) != 0) goto fail;
+  if (ftruncate(fileno(ngdb->fid),
+                _ngdb_v2_ref_addr(ngdb, 0) + boffs[ngdb->num_nodes]))
+    goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN,
+                boffs[ngdb->num_nodes] + n*sizeof(uint64_t));
+
+  ngdb->version = 3;
+
+  free(in);
+  free(refs);
+  free(boffs);
+  free(blk);
+
+  return 0;
+
+fail:
+  if (in    != NULL) free(in);
+  if (refs  != NULL) free(refs);
+  if (boffs != NULL) free(boffs);
+  if (blk   != NULL) free(blk);
+  return 1;
+}
+
+uint8_t _ngdb_v2_sort_refs(ngdb_t *ngdb) {
+
+  uint64_t  i;
+  uint64_t  rsize;
+  uint64_t *fill;
+  uint8_t  *in;
+  uint8_t  *out;
+
+  fill  = NULL;
+  in    = NULL;
+  out   = NULL;
+  rsize = sizeof(uint32_t) + ngdb->rdata_len;
+
+  fill = malloc((uint64_t)ngdb->num_nodes*sizeof(uint64_t));
+  in   = malloc(ngdb->num_refs*rsize);
+  out  = malloc(ngdb->num_refs*rsize);
+
+  if (fill == NULL) goto fail;
+  if (in   == NULL) goto fail;
+  if (out  == NULL) goto fail;
+
+  memcpy(fill, ngdb->offsets, ngdb->num_nodes*sizeof(uint64_t));
+
+  ngdb->atend = 0;
+
+  if (fseeko(ngdb->fid, _ngdb_v2_ref_addr(ngdb, 0), SEEK_SET) != 0)
+    goto fail;
+  if (fread(in, rsize, ngdb->num_refs, ngdb->fid) != ngdb->num_refs)
+    goto fail;
+
+  /*a stable counting sort, using the node of each reference*/
+  for (i = 0; i < ngdb->num_refs; i++) {
+    memcpy(out + (fill[ngdb->nidxs[i]]++)*rsize, in + i*rsize, rsize);
+  }
+
+  if (fseeko(ngdb->fid, _ngdb_v2_ref_addr(ngdb, 0), SEEK_SET) != 0)
+    goto fail;
+  if (fwrite(out, rsize, ngdb->num_refs, ngdb->fid) != ngdb->num_refs)
+    goto fail;
+
+  PROFILE_COUNT(PROFILE_NGDB_READ,    ngdb->num_refs*rsize);
+  PROFILE_COUNT(PROFILE_NGDB_WRITTEN, ngdb->num_refs*rsize);
+
+  free(fill);
+  free(in);
+  free(out);
+
+  return 0;
+
+fail:
+  if (fill != NULL) free(fill);
+  if (in   != NULL) free(in);
+  if (out  != NULL) free(out);
+  return 1;
 }
@@ -18,7 +18,8 @@ typedef struct __ngdb ngdb_t;
 /**
  * Open the given graph for reading, and return a pointer to a ngdb_t struct
  * which has been allocated on the heap. When this pointer is passed to
- * ngdb_close, it will be freed.
+ * ngdb_close, it will be freed. Version 1, 2 and 3 (compressed) files may
+ * be opened.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -26,6 +27,44 @@ ngdb_t * ngdb_open(
   char *filename /**< name of the ngdb file to open */
 );
 
+/**
+ * Open the given graph for reading, and map it into memory. All of the read
+ * functions work as normal, but copy data straight from the mapping, so
+ * reading the references of a node requires no system calls, and only
+ * those parts of the file which are accessed are ever read from disk. The
+ * mapping is shared, so multiple processes reading the same file will share
+ * the page cache. Only version 2 and 3 files can be mapped.
+ *
+ * \return a pointer to a newly allocated ngdb_t struct on success, NULL on
+ * failure (including if the file is a version 1 file).
+ */
+ngdb_t * ngdb_open_mmap(
+  char *filename /**< name of the ngdb file to open */
+);
+
+/**
+ * Open the given graph for reading and in-place updating. All of the read
+ * functions work as normal. The node data sections, and for version 1 and
+ * 2 files the reference data sections, are a fixed length, so they may be
+ * overwritten with ngdb_node_set_data, ngdb_nodes_set_data and
+ * ngdb_node_set_all_ref_data, without the rest of the file being touched.
+ * Nothing else about the graph can be changed.
+ *
+ * \return a pointer to a newly allocated ngdb_t struct on success, NULL on
+ * failure.
+ */
+ngdb_t * ngdb_open_update(
+  char *filename /**< name of the ngdb file to open */
+);
+
+/**
+ * \return non-0 if the given graph was opened with ngdb_open_mmap, 0
+ * otherwise.
+ */
+uint8_t ngdb_is_mapped(
+  ngdb_t *ngdb /**< the graph to query */
+);
+
 /**
  * Close the given graph. You must call this function after creating a
  * graph. If you create a graph, and you don't call this function, the file
@@ -110,6 +149,25 @@ uint8_t ngdb_node_get_all_refs(
                         ngdb_node_num_refs*ngdb_ref_data_len bytes    */
 );
 
+/**
+ * Get all references for a range of nodes. The references for node start
+ * are stored first, followed by the references for node start+1, and so
+ * on. The refs (and data) arrays must have enough space to store the
+ * references of all of the nodes. For version 2 files, the references are
+ * read in one go, so this is the fastest way to read a whole graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_nodes_get_all_refs(
+  ngdb_t    *ngdb,  /**< the graph to query                       */
+  uint32_t   start, /**< the first node to query                  */
+  uint32_t   n,     /**< number of nodes to query                 */
+  uint32_t  *refs,  /**< memory to store the references           */
+  void      *data   /**< NULL, or memory to store the data of all
+                         references (ngdb_ref_data_len bytes for
+                         each reference)                          */
+);
+
 /**
  * Get the data in the header. You must provide a uint8_t array which has
  * enough space to store the number of bytes returned by ngdb_hdr_data_len. If
@@ -137,6 +195,20 @@ uint8_t ngdb_node_get_data(
   uint8_t  *data  /**< memory to store node_data_len bytes */
 );
 
+/**
+ * Get the data for a range of nodes. The data array must have enough space
+ * to store n*ngdb_node_data_len bytes.
+ *
+ * \return 0 on success, 1 if the graph has no data (i.e. ngdb_node_data_len
+ * == 0), some other value on failure.
+ */
+uint8_t ngdb_nodes_get_data(
+  ngdb_t   *ngdb,  /**< the graph to query                       */
+  uint32_t  start, /**< the first node to query                  */
+  uint32_t  n,     /**< number of nodes to query                 */
+  uint8_t  *data   /**< memory to store n*node_data_len bytes    */
+);
+
 /**
  * Get the data for the given reference. You must provide a uint8_t array
  * which has enough space to store the number of bytes returned by
@@ -158,7 +230,11 @@ uint8_t ngdb_ref_get_data(
  *******************/
 
 /**
- * Create a ngdb file. 
+ * Create a ngdb file. Files are created in the version 2 format, which is
+ * not readable by older versions of this library.
+ *
+ * While a file is being created, the ngdb_node_get_ref,
+ * ngdb_node_get_all_refs and ngdb_ref_get_data functions cannot be used.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -170,9 +246,31 @@ ngdb_t * ngdb_create(
   uint16_t  rdata_len  /**< reference data section length */
 );
 
+/**
+ * Create a compressed ngdb file. Files are created as by ngdb_create, and
+ * converted to the version 3 format when they are closed - the references
+ * of each node are delta coded (see util/vbyte.h), and leading reference
+ * data bytes which are 0 for every reference of a node are not stored.
+ * Closing the file requires enough memory to store all of the references.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+ngdb_t * ngdb_create_compressed(
+  char     *filename,  /**< name of the new file          */
+  uint32_t  num_nodes, /**< number of nodes in the graph  */
+  uint16_t  hdata_len, /**< header data section length    */
+  uint16_t  ndata_len, /**< node data section length      */
+  uint16_t  rdata_len  /**< reference data section length */
+);
+
 /**
  * Add a reference to the given node. You may pass in NULL and 0 for data and
- * dlen respectively if you wish to set them later, via ngdb_ref_set_data.
+ * dlen respectively, in which case the reference data is set to zeros.
+ *
+ * References may be added in any order, but it is much faster to add them
+ * in node order (i.e. all references for node 0, then all references for
+ * node 1, and so on). Otherwise, the references are sorted when the file is
+ * closed, which requires enough memory to store two copies of them.
  *
  * \return the index of the new reference on success, 2^32 on error.
  */
@@ -185,6 +283,24 @@ uint32_t ngdb_add_ref(
 
 );
 
+/**
+ * Add several references to the given node, as if they were added one by
+ * one with ngdb_add_ref, but with far fewer writes - the references are
+ * written in large, sequential chunks. The data array, if not NULL, must
+ * contain n*ngdb_ref_data_len bytes, in the same order as the references
+ * (the layout returned by ngdb_node_get_all_refs); if it is NULL, the
+ * reference data is set to zeros.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_node_add_refs(
+  ngdb_t   *ngdb, /**< the graph in question                   */
+  uint32_t  idx,  /**< the node to add references to           */
+  uint32_t  n,    /**< number of references                    */
+  uint32_t *refs, /**< the references (indices of other nodes) */
+  void     *data  /**< the data of every reference, or NULL    */
+);
+
 /**
  * Set the header data.
  *
@@ -197,7 +313,8 @@ uint8_t ngdb_hdr_set_data(
 );
 
 /**
- * Set the data for the given node. 
+ * Set the data for the given node. The graph must have been opened with
+ * ngdb_create or ngdb_open_update.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -208,4 +325,33 @@ uint8_t ngdb_node_set_data(
   uint16_t  dlen  /**< length of the data           */ 
 );
 
+/**
+ * Set the data for a range of consecutive nodes. The data array must
+ * contain n*ngdb_node_data_len bytes. For version 2 and 3 files, the node
+ * data sections are contiguous, so they are written in one go.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_nodes_set_data(
+  ngdb_t   *ngdb,  /**< the graph in question   */
+  uint32_t  start, /**< first node              */
+  uint32_t  n,     /**< number of nodes         */
+  uint8_t  *data   /**< the data for every node */
+);
+
+/**
+ * Overwrites the data of every reference of the given node, in a graph
+ * which was opened with ngdb_open_update. The data array must contain
+ * ngdb_node_num_refs*ngdb_ref_data_len bytes, in the same order as the
+ * references returned by ngdb_node_get_all_refs. The reference data of
+ * version 3 (compressed) files cannot be updated.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_node_set_all_ref_data(
+  ngdb_t   *ngdb, /**< the graph in question                  */
+  uint32_t  idx,  /**< the node to set the reference data for */
+  void     *data  /**< the data for every reference           */
+);
+
 #endif /* __NGDB_H__ */
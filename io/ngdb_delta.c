@@ -0,0 +1,538 @@
+/**
+ * Reads/writes graph delta files.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_builder.h"
+#include "util/array.h"
+#include "util/suffix.h"
+#include "io/ngdb_graph.h"
+#include "io/ngdb_delta.h"
+
+#define DELTA_VERSION 1
+
+/**
+ * FNV-1a parameters, used by ngdb_delta_hash.
+ */
+#define DELTA_HASH_INIT  0xCBF29CE484222325ULL
+#define DELTA_HASH_PRIME 0x00000100000001B3ULL
+
+/**
+ * Delta file header - 64 bytes long. The header is followed by the base
+ * path (pathlen bytes, not null terminated), then nremoved delta_pair_t
+ * records, then nadded delta_edge_t records. Both lists are sorted by u,
+ * then by v; for undirected graphs, only edges with u < v are stored.
+ */
+typedef struct _delta_hdr {
+
+  uint32_t magic;       /**< NGDB_DELTA_MAGIC                   */
+  uint32_t version;     /**< DELTA_VERSION                      */
+  uint32_t numnodes;    /**< number of nodes                    */
+  uint32_t directed;    /**< non-0 if the graph is directed     */
+  uint64_t hash;        /**< ngdb_delta_hash of the base graph  */
+  uint64_t nremoved;    /**< number of removed edges            */
+  uint64_t nadded;      /**< number of added edges              */
+  uint32_t pathlen;     /**< length of the base path            */
+  uint32_t reserved[5]; /**< 0                                  */
+
+} delta_hdr_t;
+
+/**
+ * An edge which is removed from the base graph.
+ */
+typedef struct _delta_pair {
+  uint32_t u;
+  uint32_t v;
+} delta_pair_t;
+
+/**
+ * An edge which is added to the base graph.
+ */
+typedef struct _delta_edge {
+  uint32_t u;
+  uint32_t v;
+  float    wt;
+} delta_edge_t;
+
+/**
+ * Context passed to _keep.
+ */
+typedef struct _delta_ctx {
+
+  delta_pair_t *removed; /**< removed edges, sorted by u then v      */
+  uint64_t     *offsets; /**< start of the removed edges of each u   */
+
+} delta_ctx_t;
+
+/**
+ * graph_edge_filter_t function which keeps every edge that is not in the
+ * removed list of the given delta_ctx_t.
+ *
+ * \return 0 if the edge was removed, non-0 otherwise.
+ */
+static uint8_t _keep(
+  void    *ctx, /**< pointer to a delta_ctx_t */
+  uint32_t u,   /**< edge start point         */
+  uint32_t v,   /**< edge end point           */
+  float    wt   /**< edge weight              */
+);
+
+/**
+ * Compares the neighbour lists of node u in the base and derived graphs,
+ * appending the edges which only occur in the base to the removed list,
+ * and the edges which only occur in the derived graph (or which occur in
+ * both, with a different weight) to the added list. For undirected
+ * graphs, only neighbours greater than u are compared.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _diff_node(
+  graph_t *base,    /**< the base graph                     */
+  graph_t *g,       /**< the derived graph                  */
+  uint32_t u,       /**< the node                           */
+  array_t *removed, /**< array of delta_pair_t              */
+  array_t *added    /**< array of delta_edge_t              */
+);
+
+/**
+ * Reads the header, base path and edge lists of the given delta file.
+ * The path, removed and added lists are allocated, and must be freed by
+ * the caller.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_delta(
+  char          *f,       /**< delta file                          */
+  delta_hdr_t   *hdr,     /**< place to store the header           */
+  char         **path,    /**< place to store the base path        */
+  delta_pair_t **removed, /**< place to store the removed edges    */
+  delta_edge_t **added    /**< place to store the added edges      */
+);
+
+uint64_t ngdb_delta_hash(graph_t *g) {
+
+  uint64_t       h;
+  uint64_t       i;
+  uint64_t       j;
+  uint32_t       n;
+  uint32_t       nnbrs;
+  uint32_t      *nbrs;
+  uint32_t       w;
+  float         *wts;
+  graph_label_t *lbl;
+  graph_label_t  zero;
+
+  /*FNV-1a, one 32 bit word at a time*/
+#define HASH_WORD(x) do { h ^= (x); h *= DELTA_HASH_PRIME; } while (0)
+
+  memset(&zero, 0, sizeof(zero));
+
+  h = DELTA_HASH_INIT;
+  n = graph_num_nodes(g);
+
+  HASH_WORD(n);
+  HASH_WORD(graph_is_directed(g));
+
+  for (i = 0; i < n; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+    if (lbl == NULL) lbl = &zero;
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+    wts   = graph_get_weights(   g, i);
+
+    HASH_WORD(lbl->labelval);
+    memcpy(&w, &lbl->xval, sizeof(w)); HASH_WORD(w);
+    memcpy(&w, &lbl->yval, sizeof(w)); HASH_WORD(w);
+    memcpy(&w, &lbl->zval, sizeof(w)); HASH_WORD(w);
+    HASH_WORD(nnbrs);
+
+    for (j = 0; j < nnbrs; j++) {
+      memcpy(&w, wts + j, sizeof(w));
+      HASH_WORD(nbrs[j]);
+      HASH_WORD(w);
+    }
+  }
+
+#undef HASH_WORD
+
+  return h;
+}
+
+uint8_t ngdb_delta_write(graph_t *base, graph_t *g, char *basepath, char *f) {
+
+  uint64_t       i;
+  uint32_t       n;
+  FILE          *fd;
+  graph_label_t *blbl;
+  graph_label_t *glbl;
+  array_t        removed;
+  array_t        added;
+  delta_hdr_t    hdr;
+
+  fd = NULL;
+
+  memset(&removed, 0, sizeof(removed));
+  memset(&added,   0, sizeof(added));
+
+  n = graph_num_nodes(base);
+
+  if (graph_num_nodes(g)   != n)                     goto fail;
+  if (graph_is_directed(g) != graph_is_directed(base)) goto fail;
+
+  for (i = 0; i < n; i++) {
+
+    blbl = graph_get_nodelabel(base, i);
+    glbl = graph_get_nodelabel(g,    i);
+
+    if ((blbl == NULL) != (glbl == NULL)) goto fail;
+    if (blbl != NULL && memcmp(blbl, glbl, sizeof(graph_label_t)))
+      goto fail;
+  }
+
+  if (array_create(&removed, sizeof(delta_pair_t), 1024)) goto fail;
+  if (array_create(&added,   sizeof(delta_edge_t), 1024)) goto fail;
+
+  for (i = 0; i < n; i++) {
+    if (_diff_node(base, g, i, &removed, &added)) goto fail;
+  }
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic    = NGDB_DELTA_MAGIC;
+  hdr.version  = DELTA_VERSION;
+  hdr.numnodes = n;
+  hdr.directed = graph_is_directed(g);
+  hdr.hash     = ngdb_delta_hash(base);
+  hdr.nremoved = removed.size;
+  hdr.nadded   = added.size;
+  hdr.pathlen  = strlen(basepath);
+
+  fd = fopen(f, "wb");
+  if (fd == NULL) goto fail;
+
+  if (fwrite(&hdr,     sizeof(hdr),  1,           fd) != 1)           goto fail;
+  if (fwrite(basepath, 1,            hdr.pathlen, fd) != hdr.pathlen) goto fail;
+  if (fwrite(removed.data, sizeof(delta_pair_t), removed.size, fd)
+      != removed.size)
+    goto fail;
+  if (fwrite(added.data, sizeof(delta_edge_t), added.size, fd)
+      != added.size)
+    goto fail;
+
+  if (fclose(fd)) { fd = NULL; goto fail; }
+
+  array_free(&removed);
+  array_free(&added);
+  return 0;
+
+fail:
+  if (fd != NULL) fclose(fd);
+  array_free(&removed);
+  array_free(&added);
+  return 1;
+}
+
+uint8_t ngdb_delta_apply(char *f, graph_t *base, graph_t *g) {
+
+  uint64_t        i;
+  uint32_t        n;
+  char           *path;
+  delta_pair_t   *removed;
+  delta_edge_t   *added;
+  uint64_t       *offsets;
+  delta_hdr_t     hdr;
+  delta_ctx_t     ctx;
+  graph_builder_t b;
+
+  path    = NULL;
+  removed = NULL;
+  added   = NULL;
+  offsets = NULL;
+
+  memset(g,  0, sizeof(graph_t));
+  memset(&b, 0, sizeof(b));
+
+  if (_read_delta(f, &hdr, &path, &removed, &added)) goto fail;
+
+  n = hdr.numnodes;
+
+  if (graph_num_nodes(base)   != n)              goto fail;
+  if (graph_is_directed(base) != !!hdr.directed) goto fail;
+  if (ngdb_delta_hash(base)   != hdr.hash)       goto fail;
+
+  /*index the start of the removed edges of each node*/
+  offsets = calloc((uint64_t)n + 1, sizeof(uint64_t));
+  if (offsets == NULL) goto fail;
+
+  for (i = 0; i < hdr.nremoved; i++) {
+    if (removed[i].u >= n) goto fail;
+    offsets[removed[i].u + 1]++;
+  }
+  for (i = 0; i < n; i++) offsets[i+1] += offsets[i];
+
+  ctx.removed = removed;
+  ctx.offsets = offsets;
+
+  if (graph_copy_filtered(base, g, _keep, &ctx)) goto fail;
+
+  if (graph_num_edges(base) - graph_num_edges(g) != hdr.nremoved)
+    goto fail;
+
+  if (hdr.nadded > 0) {
+
+    if (graph_builder_init(&b, g, hdr.nadded)) goto fail;
+
+    for (i = 0; i < hdr.nadded; i++) {
+      if (graph_builder_add(&b, added[i].u, added[i].v, added[i].wt))
+        goto fail;
+    }
+
+    if (graph_builder_finalise(&b)) goto fail;
+    graph_builder_free(&b);
+  }
+
+  free(path);
+  free(removed);
+  free(added);
+  free(offsets);
+  return 0;
+
+fail:
+  if (path    != NULL) free(path);
+  if (removed != NULL) free(removed);
+  if (added   != NULL) free(added);
+  if (offsets != NULL) free(offsets);
+  graph_builder_free(&b);
+  if (graph_num_nodes(g) > 0) graph_free(g);
+  memset(g, 0, sizeof(graph_t));
+  return 1;
+}
+
+uint8_t ngdb_delta_read(char *f, graph_t *g) {
+
+  char        *path;
+  char        *dir;
+  char        *basepath;
+  delta_pair_t *removed;
+  delta_edge_t *added;
+  delta_hdr_t  hdr;
+  graph_t      base;
+
+  path     = NULL;
+  dir      = NULL;
+  basepath = NULL;
+  removed  = NULL;
+  added    = NULL;
+
+  memset(&base, 0, sizeof(base));
+
+  if (_read_delta(f, &hdr, &path, &removed, &added)) goto fail;
+
+  free(removed); removed = NULL;
+  free(added);   added   = NULL;
+
+  /*relative base paths are relative to the delta file*/
+  if (path[0] == '/') basepath = path;
+  else {
+
+    dir = malloc(strlen(f) + 1);
+    if (dir == NULL) goto fail;
+
+    dirname(f, dir);
+
+    if (dir[0] == '\0') basepath = path;
+    else {
+      basepath = join_path(dir, path);
+      if (basepath == NULL) goto fail;
+    }
+  }
+
+  if (ngdb_read(basepath, &base))   goto fail;
+  if (ngdb_delta_apply(f, &base, g)) goto fail;
+
+  graph_free(&base);
+  if (basepath != path) free(basepath);
+  free(path);
+  if (dir != NULL) free(dir);
+  return 0;
+
+fail:
+  if (graph_num_nodes(&base) > 0) graph_free(&base);
+  if (basepath != NULL && basepath != path) free(basepath);
+  if (path     != NULL) free(path);
+  if (dir      != NULL) free(dir);
+  if (removed  != NULL) free(removed);
+  if (added    != NULL) free(added);
+  return 1;
+}
+
+uint8_t ngdb_delta_is(char *f) {
+
+  FILE    *fd;
+  uint32_t magic;
+
+  fd = fopen(f, "rb");
+  if (fd == NULL) return 0;
+
+  if (fread(&magic, sizeof(magic), 1, fd) != 1) magic = 0;
+
+  fclose(fd);
+
+  return magic == NGDB_DELTA_MAGIC;
+}
+
+uint8_t _keep(void *vctx, uint32_t u, uint32_t v, float wt) {
+
+  delta_ctx_t  *ctx;
+  delta_pair_t *r;
+  uint64_t      lo;
+  uint64_t      hi;
+  uint64_t      mid;
+
+  ctx = vctx;
+  r   = ctx->removed;
+  lo  = ctx->offsets[u];
+  hi  = ctx->offsets[u+1];
+
+  while (lo < hi) {
+
+    mid = lo + (hi - lo) / 2;
+
+    if      (r[mid].v < v) lo = mid + 1;
+    else if (r[mid].v > v) hi = mid;
+    else                   return 0;
+  }
+
+  return 1;
+}
+
+uint8_t _diff_node(
+  graph_t *base,
+  graph_t *g,
+  uint32_t u,
+  array_t *removed,
+  array_t *added) {
+
+  uint32_t     i;
+  uint32_t     j;
+  uint32_t     bn;
+  uint32_t     gn;
+  uint32_t    *bnbrs;
+  uint32_t    *gnbrs;
+  float       *bwts;
+  float       *gwts;
+  uint8_t      directed;
+  delta_pair_t p;
+  delta_edge_t e;
+
+  directed = graph_is_directed(g);
+
+  bn    = graph_num_neighbours(base, u);
+  bnbrs = graph_get_neighbours(base, u);
+  bwts  = graph_get_weights(   base, u);
+  gn    = graph_num_neighbours(g,    u);
+  gnbrs = graph_get_neighbours(g,    u);
+  gwts  = graph_get_weights(   g,    u);
+
+  i = 0;
+  j = 0;
+
+  /*undirected edges are only stored from their lower end point*/
+  if (!directed) {
+    while (i < bn && bnbrs[i] <= u) i++;
+    while (j < gn && gnbrs[j] <= u) j++;
+  }
+
+  p.u = u;
+  e.u = u;
+
+  while (i < bn || j < gn) {
+
+    if (j == gn || (i < bn && bnbrs[i] < gnbrs[j])) {
+      p.v = bnbrs[i++];
+      if (array_append(removed, &p)) goto fail;
+    }
+    else if (i == bn || gnbrs[j] < bnbrs[i]) {
+      e.v  = gnbrs[j];
+      e.wt = gwts[j++];
+      if (array_append(added, &e)) goto fail;
+    }
+    else {
+
+      if (bwts[i] != gwts[j]) {
+        p.v  = bnbrs[i];
+        e.v  = gnbrs[j];
+        e.wt = gwts[j];
+        if (array_append(removed, &p)) goto fail;
+        if (array_append(added,   &e)) goto fail;
+      }
+
+      i++;
+      j++;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _read_delta(
+  char          *f,
+  delta_hdr_t   *hdr,
+  char         **path,
+  delta_pair_t **removed,
+  delta_edge_t **added) {
+
+  FILE *fd;
+
+  fd       = NULL;
+  *path    = NULL;
+  *removed = NULL;
+  *added   = NULL;
+
+  fd = fopen(f, "rb");
+  if (fd == NULL) goto fail;
+
+  if (fread(hdr, sizeof(delta_hdr_t), 1, fd) != 1) goto fail;
+
+  if (hdr->magic   != NGDB_DELTA_MAGIC) goto fail;
+  if (hdr->version != DELTA_VERSION)    goto fail;
+
+  *path    = malloc(hdr->pathlen + 1);
+  *removed = malloc((hdr->nremoved + 1) * sizeof(delta_pair_t));
+  *added   = malloc((hdr->nadded   + 1) * sizeof(delta_edge_t));
+
+  if (*path == NULL || *removed == NULL || *added == NULL) goto fail;
+
+  if (fread(*path, 1, hdr->pathlen, fd) != hdr->pathlen) goto fail;
+  (*path)[hdr->pathlen] = '\0';
+
+  if (fread(*removed, sizeof(delta_pair_t), hdr->nremoved, fd)
+      != hdr->nremoved)
+    goto fail;
+  if (fread(*added, sizeof(delta_edge_t), hdr->nadded, fd)
+      != hdr->nadded)
+    goto fail;
+
+  fclose(fd);
+  return 0;
+
+fail:
+  if (fd       != NULL) fclose(fd);
+  if (*path    != NULL) free(*path);
+  if (*removed != NULL) free(*removed);
+  if (*added   != NULL) free(*added);
+  *path    = NULL;
+  *removed = NULL;
+  *added   = NULL;
+  return 1;
+}
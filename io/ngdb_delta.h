@@ -0,0 +1,95 @@
+/**
+ * Reads/writes graph delta files. A delta file stores a graph which was
+ * derived from another (the base graph) - e.g. by thresholding or trimming
+ * it - as the edges which were removed from, and added to, the base,
+ * along with the path to the base file, and a hash of the base graph. As
+ * thresholded variants of a graph usually share most of its edges, a
+ * delta file is much smaller than a full copy of the variant.
+ *
+ * When a delta file is read, the base graph is loaded with ngdb_read (so
+ * it may be a ngdb file, a graph image, a CSR file, or another delta
+ * file), its hash is checked, and the removed edges are dropped in a
+ * single pass by graph_copy_filtered; any added edges are then inserted
+ * with a graph_builder_t. A delta file may be given to any program which
+ * reads ngdb files.
+ *
+ * The derived graph must have the same nodes, with the same labels, and
+ * the same directedness, as its base. Graph and node metadata (see
+ * graph_get_meta) are not stored. A change of weight is stored as the
+ * removal and re-addition of the edge.
+ *
+ * Delta files are written in native byte order.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __NGDB_DELTA_H__
+#define __NGDB_DELTA_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Identifies a delta file - the bytes "NGDD".
+ */
+#define NGDB_DELTA_MAGIC 0x4444474E
+
+/**
+ * \return a 64 bit hash of the given graph, calculated over its node
+ * labels, neighbour lists and edge weights. Graphs which compare equal
+ * have the same hash, regardless of the format they were loaded from.
+ */
+uint64_t ngdb_delta_hash(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Compares the given graph with its base, and writes the difference
+ * between them to a delta file. The base path is stored as it is given;
+ * if it is relative, it is interpreted relative to the directory which
+ * contains the delta file.
+ *
+ * \return 0 on success, non-0 on failure (including if the nodes, labels
+ * or directedness of the two graphs differ).
+ */
+uint8_t ngdb_delta_write(
+  graph_t *base,     /**< the base graph                      */
+  graph_t *g,        /**< the graph derived from the base     */
+  char    *basepath, /**< path to the file containing base    */
+  char    *f         /**< delta file to write                 */
+);
+
+/**
+ * Applies the given delta file to an already loaded base graph, creating
+ * the derived graph. The base graph is not modified, so it may be shared
+ * between many delta files.
+ *
+ * \return 0 on success, non-0 on failure (including if the hash of the
+ * base graph does not match the hash stored in the delta file).
+ */
+uint8_t ngdb_delta_apply(
+  char    *f,    /**< delta file                  */
+  graph_t *base, /**< the base graph              */
+  graph_t *g     /**< uninitialised graph struct  */
+);
+
+/**
+ * Loads the base graph of the given delta file, and applies the delta to
+ * it.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_delta_read(
+  char    *f, /**< delta file                  */
+  graph_t *g  /**< uninitialised graph struct  */
+);
+
+/**
+ * \return non-0 if the given file is a delta file, 0 otherwise (or if it
+ * cannot be read).
+ */
+uint8_t ngdb_delta_is(
+  char *f /**< file to check */
+);
+
+#endif /* __NGDB_DELTA_H__ */
@@ -0,0 +1,742 @@
+/**
+ * External-memory traversal of ngdb files. See ngdb_extmem.h.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io/ngdb.h"
+#include "io/ngdb_extmem.h"
+#include "util/array.h"
+#include "util/profile.h"
+#include "stats/stats.h"
+
+/**
+ * Number of searches run at once by ngdb_ext_approx_paths.
+ */
+#define _MULTI_WIDTH 64
+
+/**
+ * The references of a range of nodes, read from an ngdb file.
+ */
+typedef struct _stream {
+
+  ngdb_t   *ngdb;   /**< the file                                     */
+  uint32_t  nnodes; /**< number of nodes in the file                  */
+  uint32_t  start;  /**< first node in the current chunk              */
+  uint32_t  n;      /**< number of nodes in the current chunk         */
+  uint64_t  cap;    /**< capacity of refs                             */
+  uint32_t *refs;   /**< references of the nodes in the chunk         */
+  uint64_t *offs;   /**< offset of the references of each node in
+                         refs (n + 1 values)                          */
+
+} stream_t;
+
+/**
+ * Allocates the buffers of the given stream.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_init(
+  stream_t *s,   /**< the stream     */
+  ngdb_t   *ngdb /**< the file       */
+);
+
+/**
+ * Frees the buffers of the given stream.
+ */
+static void _stream_free(
+  stream_t *s /**< the stream */
+);
+
+/**
+ * Sets the bounds of the next chunk, which starts at the given node, and
+ * continues for as many nodes as will fit. The references are not read.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_bounds(
+  stream_t *s,    /**< the stream               */
+  uint32_t  start /**< first node of the chunk  */
+);
+
+/**
+ * Reads the references of the nodes in the current chunk, and checks that
+ * they are valid node IDs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_read(
+  stream_t *s /**< the stream */
+);
+
+/**
+ * Makes the given node the current chunk, and reads its references.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _stream_node(
+  stream_t *s, /**< the stream    */
+  uint32_t  u  /**< node to read  */
+);
+
+/**
+ * \return non-0 if any bit in the range [start, end) of the given bitmap
+ * is set, 0 otherwise.
+ */
+static uint8_t _any_set(
+  uint64_t *bits,  /**< the bitmap            */
+  uint32_t  start, /**< first bit             */
+  uint32_t  end    /**< one past the last bit */
+);
+
+/**
+ * Finds the union-find root of the given node, halving the path to it.
+ *
+ * \return the root of u.
+ */
+static uint32_t _uf_find(
+  uint32_t *parent, /**< union-find parents */
+  uint32_t  u       /**< node to find       */
+);
+
+/**
+ * Runs up to _MULTI_WIDTH of the searches for ngdb_ext_approx_paths, and
+ * accumulates, for each, the sum of the distances and inverse distances
+ * to, and the number of, the nodes which it reaches.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _multi_bfs(
+  stream_t *s,        /**< the stream                           */
+  uint32_t *roots,    /**< root nodes                           */
+  uint32_t  nroots,   /**< number of roots (<= _MULTI_WIDTH)    */
+  uint64_t *visited,  /**< space for one mask per node          */
+  uint64_t *frontier, /**< space for one mask per node          */
+  uint64_t *next,     /**< space for one mask per node          */
+  double   *tally,    /**< distance sum for each root           */
+  uint32_t *count,    /**< number of nodes reached by each root */
+  double   *invs      /**< inverse distance sum for each root   */
+);
+
+#define _BIT_SET(b, i) ((b)[(i) >> 6] |=  (1ULL << ((i) & 63)))
+#define _BIT_GET(b, i) ((b)[(i) >> 6] &   (1ULL << ((i) & 63)))
+
+uint8_t ngdb_ext_components(
+  ngdb_t *ngdb, uint32_t *components, uint32_t *ncmps, array_t *sizes) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  c;
+  uint32_t  zero;
+  uint32_t *parent;
+  uint32_t *cmpsz;
+  stream_t  s;
+
+  PROFILE_FUNC();
+
+  parent = NULL;
+  zero   = 0;
+
+  memset(&s, 0, sizeof(stream_t));
+
+  if (_stream_init(&s, ngdb)) goto fail;
+
+  parent = malloc(((uint64_t)s.nnodes + 1) * sizeof(uint32_t));
+  if (parent == NULL) goto fail;
+
+  for (i = 0; i < s.nnodes; i++) parent[i] = i;
+
+  /*
+   * one pass over the references - the
+   * component with the larger root is
+   * attached to that with the smaller
+   */
+  for (i = 0; i < s.nnodes; i += s.n) {
+
+    if (_stream_bounds(&s, i)) goto fail;
+    if (_stream_read(  &s))    goto fail;
+
+    for (u = 0; u < s.n; u++) {
+      for (j = s.offs[u]; j < s.offs[u+1]; j++) {
+
+        c = _uf_find(parent, s.start + u);
+        v = _uf_find(parent, s.refs[j]);
+
+        if      (c < v) parent[v] = c;
+        else if (v < c) parent[c] = v;
+      }
+    }
+  }
+
+  /*
+   * every component is numbered when its
+   * lowest node is seen - the label of a
+   * root is stored in its own slot
+   */
+  for (i = 0; i < s.nnodes; i++) components[i] = UINT32_MAX;
+
+  c = 0;
+  for (i = 0; i < s.nnodes; i++) {
+
+    u = _uf_find(parent, i);
+
+    if (components[u] == UINT32_MAX) components[u] = c++;
+    components[i] = components[u];
+  }
+
+  *ncmps = c;
+
+  if (sizes != NULL) {
+
+    array_clear(sizes);
+
+    for (i = 0; i < c; i++) {
+      if (array_append(sizes, &zero)) goto fail;
+    }
+
+    cmpsz = (uint32_t *)sizes->data;
+    for (i = 0; i < s.nnodes; i++) cmpsz[components[i]]++;
+  }
+
+  free(parent);
+  _stream_free(&s);
+  return 0;
+
+fail:
+  if (parent != NULL) free(parent);
+  _stream_free(&s);
+  return 1;
+}
+
+uint8_t ngdb_ext_bfs(
+  ngdb_t   *ngdb,
+  uint32_t *roots,
+  uint32_t  nroots,
+  uint32_t *dists,
+  array_t  *levels) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  w;
+  uint64_t  nwords;
+  uint64_t  bits;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  depth;
+  uint32_t  nfront;
+  uint32_t  nnext;
+  uint64_t *visited;
+  uint64_t *frontier;
+  uint64_t *next;
+  uint64_t *tmp;
+  stream_t  s;
+
+  PROFILE_FUNC();
+
+  visited  = NULL;
+  frontier = NULL;
+  next     = NULL;
+
+  memset(&s, 0, sizeof(stream_t));
+
+  if (_stream_init(&s, ngdb)) goto fail;
+
+  nwords   = ((uint64_t)s.nnodes + 63) / 64 + 1;
+  visited  = calloc(nwords, sizeof(uint64_t));
+  frontier = calloc(nwords, sizeof(uint64_t));
+  next     = calloc(nwords, sizeof(uint64_t));
+
+  if (visited  == NULL) goto fail;
+  if (frontier == NULL) goto fail;
+  if (next     == NULL) goto fail;
+
+  if (levels != NULL) array_clear(levels);
+
+  if (dists != NULL) {
+    for (i = 0; i < s.nnodes; i++) dists[i] = UINT32_MAX;
+  }
+
+  nfront = 0;
+  for (i = 0; i < nroots; i++) {
+
+    if (roots[i] >= s.nnodes)        goto fail;
+    if (_BIT_GET(visited, roots[i])) continue;
+
+    _BIT_SET(visited,  roots[i]);
+    _BIT_SET(frontier, roots[i]);
+    if (dists != NULL) dists[roots[i]] = 0;
+    nfront++;
+  }
+
+  depth = 0;
+
+  while (nfront > 0) {
+
+    if (levels != NULL && array_append(levels, &nfront)) goto fail;
+
+    depth++;
+    nnext = 0;
+    memset(next, 0, nwords * sizeof(uint64_t));
+
+    /*
+     * a small frontier - read the
+     * references of each of its nodes
+     */
+    if ((uint64_t)nfront * NGDB_EXTMEM_SPARSE < s.nnodes) {
+
+      for (w = 0; w < nwords; w++) {
+
+        bits = frontier[w];
+
+        while (bits) {
+
+          u     = w * 64 + __builtin_ctzll(bits);
+          bits &= bits - 1;
+
+          if (_stream_node(&s, u)) goto fail;
+
+          for (j = 0; j < s.offs[1]; j++) {
+
+            v = s.refs[j];
+            if (_BIT_GET(visited, v)) continue;
+
+            _BIT_SET(visited, v);
+            _BIT_SET(next,    v);
+            if (dists != NULL) dists[v] = depth;
+            nnext++;
+          }
+        }
+      }
+    }
+
+    /*
+     * a large frontier - stream every
+     * chunk which contains a frontier node
+     */
+    else {
+
+      for (i = 0; i < s.nnodes; i += s.n) {
+
+        if (_stream_bounds(&s, i)) goto fail;
+        if (!_any_set(frontier, s.start, s.start + s.n)) continue;
+        if (_stream_read(&s))                            goto fail;
+
+        for (u = 0; u < s.n; u++) {
+
+          if (!_BIT_GET(frontier, s.start + u)) continue;
+
+          for (j = s.offs[u]; j < s.offs[u+1]; j++) {
+
+            v = s.refs[j];
+            if (_BIT_GET(visited, v)) continue;
+
+            _BIT_SET(visited, v);
+            _BIT_SET(next,    v);
+            if (dists != NULL) dists[v] = depth;
+            nnext++;
+          }
+        }
+      }
+    }
+
+    tmp      = frontier;
+    frontier = next;
+    next     = tmp;
+    nfront   = nnext;
+  }
+
+  free(visited);
+  free(frontier);
+  free(next);
+  _stream_free(&s);
+  return 0;
+
+fail:
+  if (visited  != NULL) free(visited);
+  if (frontier != NULL) free(frontier);
+  if (next     != NULL) free(next);
+  _stream_free(&s);
+  return 1;
+}
+
+uint8_t ngdb_ext_approx_paths(
+  ngdb_t *ngdb, uint32_t nsamples, stats_approx_paths_t *paths) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  nroots;
+  uint32_t *roots;
+  uint64_t *visited;
+  uint64_t *frontier;
+  uint64_t *next;
+  double   *tally;
+  uint32_t *count;
+  double   *invs;
+  double   *pathlens;
+  double   *effs;
+  stream_t  s;
+
+  PROFILE_FUNC();
+
+  roots    = NULL;
+  visited  = NULL;
+  frontier = NULL;
+  next     = NULL;
+  tally    = NULL;
+  count    = NULL;
+  invs     = NULL;
+  pathlens = NULL;
+  effs     = NULL;
+
+  memset(&s, 0, sizeof(stream_t));
+
+  if (_stream_init(&s, ngdb)) goto fail;
+
+  nnodes = s.nnodes;
+
+  if (nnodes   == 0)      goto fail;
+  if (nsamples == 0)      goto fail;
+  if (nsamples >  nnodes) nsamples = nnodes;
+
+  roots    = malloc((uint64_t)nnodes   * sizeof(uint32_t));
+  visited  = malloc((uint64_t)nnodes   * sizeof(uint64_t));
+  frontier = malloc((uint64_t)nnodes   * sizeof(uint64_t));
+  next     = malloc((uint64_t)nnodes   * sizeof(uint64_t));
+  tally    = calloc(nsamples,            sizeof(double));
+  count    = calloc(nsamples,            sizeof(uint32_t));
+  invs     = calloc(nsamples,            sizeof(double));
+  pathlens = malloc((uint64_t)nsamples * sizeof(double));
+  effs     = malloc((uint64_t)nsamples * sizeof(double));
+
+  if (roots    == NULL) goto fail;
+  if (visited  == NULL) goto fail;
+  if (frontier == NULL) goto fail;
+  if (next     == NULL) goto fail;
+  if (tally    == NULL) goto fail;
+  if (count    == NULL) goto fail;
+  if (invs     == NULL) goto fail;
+  if (pathlens == NULL) goto fail;
+  if (effs     == NULL) goto fail;
+
+  if (stats_approx_paths_sample(nnodes, nsamples, roots)) goto fail;
+
+  for (i = 0; i < nsamples; i += nroots) {
+
+    nroots = nsamples - i;
+    if (nroots > _MULTI_WIDTH) nroots = _MULTI_WIDTH;
+
+    if (_multi_bfs(&s,
+                   roots + i,
+                   nroots,
+                   visited,
+                   frontier,
+                   next,
+                   tally + i,
+                   count + i,
+                   invs  + i))
+      goto fail;
+  }
+
+  for (i = 0; i < nsamples; i++) {
+
+    if (count[i] == 0) pathlens[i] = 0;
+    else               pathlens[i] = tally[i] / count[i];
+
+    if (nnodes > 1) effs[i] = invs[i] / (nnodes - 1);
+    else            effs[i] = 0;
+  }
+
+  stats_approx_paths_estimate(nnodes, nsamples, pathlens, effs, paths);
+
+  free(roots);
+  free(visited);
+  free(frontier);
+  free(next);
+  free(tally);
+  free(count);
+  free(invs);
+  free(pathlens);
+  free(effs);
+  _stream_free(&s);
+  return 0;
+
+fail:
+  if (roots    != NULL) free(roots);
+  if (visited  != NULL) free(visited);
+  if (frontier != NULL) free(frontier);
+  if (next     != NULL) free(next);
+  if (tally    != NULL) free(tally);
+  if (count    != NULL) free(count);
+  if (invs     != NULL) free(invs);
+  if (pathlens != NULL) free(pathlens);
+  if (effs     != NULL) free(effs);
+  _stream_free(&s);
+  return 1;
+}
+
+uint8_t _multi_bfs(
+  stream_t *s,
+  uint32_t *roots,
+  uint32_t  nroots,
+  uint64_t *visited,
+  uint64_t *frontier,
+  uint64_t *next,
+  double   *tally,
+  uint32_t *count,
+  double   *invs) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t bits;
+  uint64_t mask;
+  uint32_t u;
+  uint32_t b;
+  uint32_t depth;
+  uint32_t nfront;
+  uint32_t sizes[_MULTI_WIDTH];
+
+  memset(visited,  0, (uint64_t)s->nnodes * sizeof(uint64_t));
+  memset(frontier, 0, (uint64_t)s->nnodes * sizeof(uint64_t));
+  memset(next,     0, (uint64_t)s->nnodes * sizeof(uint64_t));
+
+  for (b = 0; b < nroots; b++) {
+    visited [roots[b]] |= 1ULL << b;
+    frontier[roots[b]] |= 1ULL << b;
+  }
+
+  nfront = nroots;
+  depth  = 0;
+
+  while (nfront > 0) {
+
+    depth++;
+
+    /*
+     * push the searches in the frontier of each
+     * node out to its neighbours - as for a single
+     * search, a small frontier is read one node
+     * at a time
+     */
+    if ((uint64_t)nfront * NGDB_EXTMEM_SPARSE < s->nnodes) {
+
+      for (i = 0; i < s->nnodes; i++) {
+
+        mask = frontier[i];
+        if (mask == 0) continue;
+
+        if (_stream_node(s, i)) goto fail;
+
+        for (j = 0; j < s->offs[1]; j++) next[s->refs[j]] |= mask;
+      }
+    }
+    else {
+
+      for (i = 0; i < s->nnodes; i += s->n) {
+
+        if (_stream_bounds(s, i)) goto fail;
+        if (_stream_read(  s))    goto fail;
+
+        for (u = 0; u < s->n; u++) {
+
+          mask = frontier[s->start + u];
+          if (mask == 0) continue;
+
+          for (j = s->offs[u]; j < s->offs[u+1]; j++)
+            next[s->refs[j]] |= mask;
+        }
+      }
+    }
+
+    /*the searches which reach each node for the first time*/
+    memset(sizes, 0, sizeof(sizes));
+    nfront = 0;
+
+    for (i = 0; i < s->nnodes; i++) {
+
+      bits         = next[i] & ~visited[i];
+      visited[i]  |= bits;
+      frontier[i]  = bits;
+      next[i]      = 0;
+
+      if (bits == 0) continue;
+
+      nfront++;
+
+      while (bits) {
+        sizes[__builtin_ctzll(bits)]++;
+        bits &= bits - 1;
+      }
+    }
+
+    /*accumulated in the same way as by stats_approx_paths*/
+    for (b = 0; b < nroots; b++) {
+
+      if (sizes[b] == 0) continue;
+
+      tally[b] += sizes[b]*depth;
+      count[b] += sizes[b];
+      invs[ b] += (float)(sizes[b])/depth;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _stream_init(stream_t *s, ngdb_t *ngdb) {
+
+  memset(s, 0, sizeof(stream_t));
+
+  s->ngdb   = ngdb;
+  s->nnodes = ngdb_num_nodes(ngdb);
+  s->cap    = NGDB_EXTMEM_CHUNK_REFS;
+  s->refs   = malloc(s->cap * sizeof(uint32_t));
+  s->offs   = malloc((NGDB_EXTMEM_CHUNK_NODES + 1) * sizeof(uint64_t));
+
+  if (s->refs == NULL) goto fail;
+  if (s->offs == NULL) goto fail;
+
+  return 0;
+
+fail:
+  _stream_free(s);
+  return 1;
+}
+
+void _stream_free(stream_t *s) {
+
+  if (s->refs != NULL) free(s->refs);
+  if (s->offs != NULL) free(s->offs);
+
+  s->refs = NULL;
+  s->offs = NULL;
+}
+
+uint8_t _stream_bounds(stream_t *s, uint32_t start) {
+
+  uint32_t nrefs;
+  uint64_t total;
+  void    *tmp;
+
+  s->start = start;
+  s->n     = 0;
+  total    = 0;
+
+  while ((uint64_t)start + s->n < s->nnodes &&
+         s->n < NGDB_EXTMEM_CHUNK_NODES) {
+
+    nrefs = ngdb_node_num_refs(s->ngdb, start + s->n);
+
+    if (nrefs == 0xFFFFFFFF)                goto fail;
+    if (s->n > 0 && total + nrefs > s->cap) break;
+
+    s->offs[s->n] = total;
+    total        += nrefs;
+    s->n         ++;
+  }
+
+  s->offs[s->n] = total;
+
+  /*a single node with more references than fit*/
+  if (total > s->cap) {
+
+    tmp = realloc(s->refs, total * sizeof(uint32_t));
+    if (tmp == NULL) goto fail;
+
+    s->refs = tmp;
+    s->cap  = total;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _stream_read(stream_t *s) {
+
+  uint64_t i;
+
+  if (s->n == 0) return 0;
+
+  if (ngdb_nodes_get_all_refs(s->ngdb, s->start, s->n, s->refs, NULL))
+    goto fail;
+
+  for (i = 0; i < s->offs[s->n]; i++) {
+    if (s->refs[i] >= s->nnodes) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _stream_node(stream_t *s, uint32_t u) {
+
+  uint32_t nrefs;
+  void    *tmp;
+
+  nrefs = ngdb_node_num_refs(s->ngdb, u);
+  if (nrefs == 0xFFFFFFFF) goto fail;
+
+  if (nrefs > s->cap) {
+
+    tmp = realloc(s->refs, (uint64_t)nrefs * sizeof(uint32_t));
+    if (tmp == NULL) goto fail;
+
+    s->refs = tmp;
+    s->cap  = nrefs;
+  }
+
+  s->start   = u;
+  s->n       = 1;
+  s->offs[0] = 0;
+  s->offs[1] = nrefs;
+
+  return _stream_read(s);
+
+fail:
+  return 1;
+}
+
+uint8_t _any_set(uint64_t *bits, uint32_t start, uint32_t end) {
+
+  uint64_t w;
+  uint64_t first;
+  uint64_t last;
+  uint64_t mask;
+
+  if (start >= end) return 0;
+
+  first = start >> 6;
+  last  = (end - 1) >> 6;
+
+  for (w = first; w <= last; w++) {
+
+    mask = ~0ULL;
+    if (w == first) mask &= ~0ULL << (start & 63);
+    if (w == last)  mask &= ~0ULL >> (63 - ((end - 1) & 63));
+
+    if (bits[w] & mask) return 1;
+  }
+
+  return 0;
+}
+
+uint32_t _uf_find(uint32_t *parent, uint32_t u) {
+
+  while (parent[u] != u) {
+    parent[u] = parent[parent[u]];
+    u         = parent[u];
+  }
+
+  return u;
+}
@@ -0,0 +1,106 @@
+/**
+ * External-memory traversal of ngdb files, for graphs which are too large
+ * to be loaded into memory. Rather than creating a graph_t, the functions
+ * stream the references of an open ngdb file in node-ordered chunks of at
+ * most NGDB_EXTMEM_CHUNK_REFS references, and keep only a few words (or
+ * bits) of state for every node in memory:
+ *
+ *   - ngdb_ext_components labels the connected components with one
+ *     union-find pass over the references (semi-external connectivity).
+ *
+ *   - ngdb_ext_bfs runs a breadth first search, one level at a time, with
+ *     bitmaps of the visited and frontier nodes. A level whose frontier is
+ *     small only reads the references of the frontier nodes; other levels
+ *     stream every chunk which contains a frontier node.
+ *
+ *   - ngdb_ext_approx_paths estimates the path length and global
+ *     efficiency in the same way as stats_approx_paths (see
+ *     stats/stats.h), running up to 64 of the sampled searches at once,
+ *     with a 64 bit visited and frontier mask for every node.
+ *
+ * Files opened with ngdb_open_mmap are read through the map, so the pages
+ * of the file are only held in memory by the page cache. The graph must
+ * be undirected, with symmetric references, as written by ngdb_write.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __NGDB_EXTMEM_H__
+#define __NGDB_EXTMEM_H__
+
+#include <stdint.h>
+
+#include "io/ngdb.h"
+#include "util/array.h"
+#include "stats/stats.h"
+
+/**
+ * Maximum number of references held in memory at once (unless a single
+ * node has more than this).
+ */
+#define NGDB_EXTMEM_CHUNK_REFS (1 << 21)
+
+/**
+ * Maximum number of nodes in one chunk.
+ */
+#define NGDB_EXTMEM_CHUNK_NODES (1 << 16)
+
+/**
+ * A search level whose frontier contains fewer than 1 in this many nodes
+ * reads the references of each frontier node individually, rather than
+ * streaming the chunks which contain them.
+ */
+#define NGDB_EXTMEM_SPARSE 64
+
+/**
+ * Labels the connected components of the graph in the given ngdb file.
+ * The result is the same as that of stats_num_components (see
+ * stats/stats.h) with a minimum size of 1 - components are numbered from
+ * 0, in order of their lowest node.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_ext_components(
+  ngdb_t   *ngdb,       /**< open ngdb handle                         */
+  uint32_t *components, /**< place to store the component of every
+                             node - must be of length ngdb_num_nodes  */
+  uint32_t *ncmps,      /**< place to store the number of components  */
+  array_t  *sizes       /**< NULL, or an array of uint32_t in which to
+                             store the size of every component        */
+);
+
+/**
+ * Runs a breadth first search, from the given root nodes, over the graph
+ * in the given ngdb file. The distance of every node from its nearest
+ * root is stored in dists (UINT32_MAX for unreached nodes), and the
+ * number of nodes at each depth, in levels.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_ext_bfs(
+  ngdb_t   *ngdb,   /**< open ngdb handle                              */
+  uint32_t *roots,  /**< root nodes                                    */
+  uint32_t  nroots, /**< number of root nodes                          */
+  uint32_t *dists,  /**< NULL, or place to store the distance of every
+                         node - must be of length ngdb_num_nodes       */
+  array_t  *levels  /**< NULL, or an array of uint32_t in which to
+                         store the number of nodes at every depth,
+                         from 0 (the roots)                            */
+);
+
+/**
+ * Estimates the characteristic path length and global efficiency of the
+ * graph in the given ngdb file, from breadth first searches from nsamples
+ * source nodes. The sources are selected, and the estimates calculated,
+ * in the same way as by stats_approx_paths, so the results are the same
+ * as those for the loaded graph, for the same random number generator
+ * state.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_ext_approx_paths(
+  ngdb_t               *ngdb,     /**< open ngdb handle                 */
+  uint32_t              nsamples, /**< number of source nodes to sample */
+  stats_approx_paths_t *paths     /**< place to store the estimates     */
+);
+
+#endif /* __NGDB_EXTMEM_H__ */
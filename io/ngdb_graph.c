@@ -3,26 +3,118 @@
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
+#include <math.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "graph/graph.h"
 #include "graph/graph_log.h"
+#include "graph/graph_builder.h"
+#include "graph/graph_compact.h"
+#include "graph/graph_image.h"
+#include "graph/graph_prune.h"
+#include "io/csr.h"
+#include "io/ngdb_delta.h"
 #include "io/ngdb.h"
 #include "util/array.h"
 #include "util/compare.h"
+#include "util/profile.h"
 #include "io/ngdb_graph.h"
 
+/**
+ * Maximum number of references read at a time by _read_adjacency (unless
+ * a single node has more references than this).
+ */
+#define NGDB_READ_CHUNK_REFS 1048576
+
+/**
+ * Number of node labels read at a time by _read_labels.
+ */
+#define NGDB_READ_CHUNK_NODES 65536
+
+/**
+ * Number of node labels written at a time by _write_nodes and
+ * _write_view_nodes.
+ */
+#define NGDB_WRITE_CHUNK_NODES 65536
+
+/**
+ * Loads the given ngdb file into the given graph. If bulk is non-0, the
+ * file is read in large chunks, and the neighbour list of each node is
+ * copied straight into the graph; this will fail if the file was not
+ * created by ngdb_write (e.g. if the references of a node are not sorted,
+ * or are not symmetric). Otherwise, the file is read one node at a time,
+ * and the edges are added individually.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _ngdb_read(
+  char    *ngdbfile, /**< name of ngdb file to load            */
+  graph_t *graph,    /**< pointer to a graph struct to use     */
+  uint8_t  bulk      /**< read in bulk, or one node at a time  */
+);
+
+/**
+ * Reads the neighbours of every node, in chunks of ~NGDB_READ_CHUNK_REFS
+ * references, and copies them straight into the graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_adjacency(
+  ngdb_t          *ngdb,    /**< ngdb handle           */
+  graph_builder_t *builder  /**< builder for the graph */
+);
+
+/**
+ * Reads the labels of every node, in chunks of NGDB_READ_CHUNK_NODES.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_labels(
+  ngdb_t  *ngdb,  /**< ngdb handle  */
+  graph_t *graph  /**< ptr to graph */
+);
+
+/**
+ * Reads the neighbours and edge weights for the given node, into the given
+ * buffers, which are enlarged if necessary.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_node_refs(
+  ngdb_t    *ngdb,  /**< ngdb handle                          */
+  uint32_t   nidx,  /**< node index                           */
+  uint32_t **refs,  /**< neighbour buffer                     */
+  double   **wts,   /**< weight buffer                        */
+  uint32_t  *cap,   /**< capacity of the buffers              */
+  uint32_t  *nrefs  /**< place to store number of neighbours  */
+);
+
+/**
+ * Loads the subgraph induced by the nodes which are marked in the given
+ * map - see ngdb_read_seed and ngdb_read_mask. Only the references of the
+ * marked nodes are read. On entry, map[i] is non-0 if node i is to be
+ * included; on return, it is 1 + the index of node i in g.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_subgraph(
+  ngdb_t   *ngdb, /**< ngdb handle                        */
+  graph_t  *g,    /**< pointer to a graph struct to use   */
+  uint32_t *map   /**< nodes to include in the subgraph   */
+);
+
 /**
  * Reads the neighbours for the given node.
  *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _read_refs(
-  ngdb_t  *ngdb,  /**< ngdb handle  */
-  graph_t *graph, /**< ptr to graph */
-  uint32_t nidx   /**< node index   */
+  ngdb_t          *ngdb,    /**< ngdb handle                */
+  graph_builder_t *builder, /**< builder for the graph      */
+  uint32_t         nidx     /**< node index                 */
 );
 
 /**
@@ -36,6 +128,26 @@ static uint8_t _read_label(
   uint32_t nidx   /**< node index   */
 );
 
+/**
+ * Sets the label and metadata of the given node from the given record.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _set_label(
+  graph_t      *g,    /**< ptr to graph   */
+  uint32_t      nidx, /**< node index     */
+  ngdb_label_t *lbl   /**< the node label */
+);
+
+/**
+ * Fills the given record with the label and metadata of the given node.
+ */
+static void _get_label(
+  graph_t      *g,    /**< ptr to graph                 */
+  uint32_t      nidx, /**< node index                   */
+  ngdb_label_t *lbl   /**< place to store the node label */
+);
+
 /**
  * Reads header data from the ngdb file, adding it as a
  * log to the graph (see graph_log.h).
@@ -47,265 +159,1426 @@ static uint8_t _read_hdr(
   graph_t *graph /**< graph handle */
 );
 
+/**
+ * Finds the root of the given node in a union-find forest, halving the
+ * path on the way.
+ *
+ * \return the root node.
+ */
+static uint32_t _uf_find(
+  uint32_t *parent, /**< parent of every node */
+  uint32_t  u       /**< node to look up      */
+);
+
+/**
+ * Hashes one reference of an undirected graph, from the point of view of
+ * the node at its other end, for the symmetry check in ngdb_prune.
+ *
+ * \return a 64 bit hash of the node and weight.
+ */
+static uint64_t _ref_hash(
+  uint32_t u, /**< node at the other end of the reference */
+  float    wt /**< reference weight                       */
+);
+
+/**
+ * First pass of ngdb_prune - finds the connected components of the given
+ * file, and checks that its references are sorted and symmetric. The
+ * component root and size of every node are stored in the given arrays.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _prune_components(
+  ngdb_t   *ngdb,   /**< ngdb handle                   */
+  uint32_t *parent, /**< place to store component roots */
+  uint32_t *sizes   /**< place to store component sizes */
+);
+
 uint8_t ngdb_read(char *ngdbfile, graph_t *graph) {
 
-  ngdb_t  *ngdb;
-  uint32_t i;
-  uint32_t nnodes;
+  PROFILE_FUNC();
+
+  if (graph_image_is(ngdbfile)) return graph_image_attach(ngdbfile, graph);
+  if (csr_is(ngdbfile))         return csr_read(ngdbfile, graph);
+  if (ngdb_delta_is(ngdbfile))  return ngdb_delta_read(ngdbfile, graph);
+
+  /*
+   * fall back to reading one node at a time if the
+   * file cannot be loaded in bulk, e.g. because it
+   * was not created by ngdb_write
+   */
+  if (_ngdb_read(ngdbfile, graph, 1) == 0) return 0;
+
+  return _ngdb_read(ngdbfile, graph, 0);
+}
+
+uint8_t _ngdb_read(char *ngdbfile, graph_t *graph, uint8_t bulk) {
+
+  ngdb_t         *ngdb;
+  uint32_t        i;
+  uint32_t        nnodes;
+  graph_builder_t builder;
 
   ngdb = NULL;
 
-  memset(graph, 0, sizeof(graph_t));
+  memset(graph,    0, sizeof(graph_t));
+  memset(&builder, 0, sizeof(graph_builder_t));
 
-  ngdb = ngdb_open(ngdbfile);
+  ngdb = ngdb_open_mmap(ngdbfile);
+  if (ngdb == NULL) ngdb = ngdb_open(ngdbfile);
   if (ngdb == NULL) goto fail;
 
   nnodes = ngdb_num_nodes(ngdb);
 
-  if (graph_create(graph, nnodes, 0)) goto fail;
-  if (_read_hdr(ngdb, graph))         goto fail;
-  for (i = 0; i < nnodes; i++) {
-    if (_read_refs (ngdb, graph, i) != 0) goto fail;
-    if (_read_label(ngdb, graph, i) != 0) goto fail;
+  if (graph_create(graph, nnodes, 0))              goto fail;
+  if (graph_builder_init(&builder, graph, nnodes)) goto fail;
+  if (_read_hdr(ngdb, graph))                      goto fail;
+
+  if (bulk) {
+
+    if (ngdb_node_data_len(ngdb) != sizeof(ngdb_label_t)) goto fail;
+    if (ngdb_ref_data_len( ngdb) != sizeof(double))       goto fail;
+    if (_read_labels   (ngdb, graph))                     goto fail;
+    if (_read_adjacency(ngdb, &builder))                  goto fail;
+  }
+
+  else {
+    for (i = 0; i < nnodes; i++) {
+      if (_read_refs (ngdb, &builder, i) != 0) goto fail;
+      if (_read_label(ngdb, graph,    i) != 0) goto fail;
+    }
   }
 
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
   ngdb_close(ngdb);
 
   return 0;
 fail: 
 
   if (ngdb != NULL) ngdb_close(ngdb);
+  graph_builder_free(&builder);
   graph_free(graph);
 
   return 1;
 }
 
-static uint8_t _read_hdr(ngdb_t *ngdb, graph_t *graph) {
-  
-  uint8_t *hdrdata;
-  uint16_t hdrlen;
+uint8_t ngdb_read_compact(char *f, graph_compact_t *c, uint8_t wtbits) {
 
-  hdrdata = NULL;
-  hdrlen  = ngdb_hdr_data_len(ngdb);
+  ngdb_t   *ngdb;
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  nnodes;
+  uint32_t  nrefs;
+  uint32_t  cap;
+  uint32_t *refs;
+  double   *wts;
+  uint32_t  fcap;
+  float    *fwts;
+  float     wtmin;
+  float     wtmax;
+  uint8_t   found;
+
+  ngdb  = NULL;
+  refs  = NULL;
+  wts   = NULL;
+  fwts  = NULL;
+  cap   = 0;
+  fcap  = 0;
+  wtmin = 1;
+  wtmax = 1;
+  found = 0;
+
+  memset(c, 0, sizeof(graph_compact_t));
+
+  ngdb = ngdb_open_mmap(f);
+  if (ngdb == NULL) ngdb = ngdb_open(f);
+  if (ngdb == NULL) goto fail;
 
-  if (hdrlen == 0) return 0;
+  if (ngdb_ref_data_len(ngdb) != sizeof(double)) goto fail;
 
-  hdrdata = malloc(hdrlen);
-  if (hdrdata == NULL) goto fail;
+  nnodes = ngdb_num_nodes(ngdb);
 
-  if (ngdb_hdr_get_data(ngdb, hdrdata))               goto fail;
-  if (graph_log_init(graph))                          goto fail;
-  if (graph_log_import(graph, (char *)hdrdata, "\n")) goto fail;
+  /*the weight range is needed before any weights can be quantised*/
+  for (i = 0; i < nnodes && (wtbits == 8 || wtbits == 16); i++) {
 
-  return 0;
-  
-fail:
-  if (hdrdata != NULL) free(hdrdata);
-  return 1;
-}
+    if (_read_node_refs(ngdb, i, &refs, &wts, &cap, &nrefs)) goto fail;
 
-uint8_t _read_refs(ngdb_t *ngdb, graph_t *graph, uint32_t nidx) {
+    for (j = 0; j < nrefs; j++) {
 
-  uint64_t  i;
-  uint32_t  numrefs;
-  uint32_t *refs;
-  double   *wts;
+      if (isnan(wts[j])) continue;
 
-  refs = NULL;
-  wts  = NULL;
+      if (!found || wts[j] < wtmin) wtmin = wts[j];
+      if (!found || wts[j] > wtmax) wtmax = wts[j];
+      found = 1;
+    }
+  }
 
-  numrefs = ngdb_node_num_refs(ngdb, nidx);
+  if (graph_compact_init(c, nnodes, 0, wtbits, wtmin, wtmax)) goto fail;
 
-  if (numrefs == 0xFFFFFFFF) goto fail;
+  for (i = 0; i < nnodes; i++) {
 
-  if (numrefs > 0) {
+    if (_read_node_refs(ngdb, i, &refs, &wts, &cap, &nrefs)) goto fail;
 
-    refs = malloc(numrefs*sizeof(uint32_t));
-    wts  = malloc(numrefs*sizeof(double));
+    if (fwts == NULL || nrefs > fcap) {
 
-    if (refs                                          == NULL) goto fail;
-    if (wts                                           == NULL) goto fail;
-    if (ngdb_node_get_all_refs(ngdb, nidx, refs, wts) != 0)    goto fail;
-    if (array_expand(&graph->neighbours[nidx], numrefs+1))     goto fail;
-    if (array_expand(&graph->weights[   nidx], numrefs+1))     goto fail;
+      if (fwts != NULL) free(fwts);
 
-    for (i = 0; i < numrefs; i++) {
-      if (graph_add_edge(graph, nidx, refs[i], wts[i])) goto fail;
+      fcap = cap;
+      fwts = malloc(((uint64_t)fcap + 1) * sizeof(float));
+      if (fwts == NULL) goto fail;
     }
-    
-    free(refs);
-    free(wts);
-    refs = NULL;
-    wts  = NULL;
+
+    for (j = 0; j < nrefs; j++) fwts[j] = wts[j];
+
+    if (graph_compact_add_node(c, refs, fwts, nrefs)) goto fail;
   }
 
+  if (graph_compact_finalise(c)) goto fail;
+
+  ngdb_close(ngdb);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  free(fwts);
+
   return 0;
+
 fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
   if (refs != NULL) free(refs);
   if (wts  != NULL) free(wts);
+  if (fwts != NULL) free(fwts);
+  graph_compact_free(c);
   return 1;
 }
 
-uint8_t _read_label(ngdb_t *ngdb, graph_t *graph, uint32_t nidx) {
+uint8_t ngdb_read_seed(
+  ngdb_t   *ngdb,
+  graph_t  *g,
+  uint32_t *seeds,
+  uint32_t  nseeds,
+  uint8_t   depth) {
 
-  uint8_t bytes[sizeof(graph_label_t)];
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t  d;
+  uint32_t  u;
+  uint32_t  nnodes;
+  uint32_t  nrefs;
+  uint32_t  cap;
+  uint32_t *refs;
+  double   *wts;
+  uint32_t *map;
+  array_t   thislevel;
+  array_t   nextlevel;
+  array_t   tmp;
 
-  memset(bytes, 0, sizeof(graph_label_t));
+  refs = NULL;
+  wts  = NULL;
+  map  = NULL;
+  cap  = 0;
 
-  if (ngdb_node_get_data(ngdb, nidx, bytes)) goto fail;
+  memset(g,          0, sizeof(graph_t));
+  memset(&thislevel, 0, sizeof(array_t));
+  memset(&nextlevel, 0, sizeof(array_t));
 
-  graph_set_nodelabel(graph, nidx, (graph_label_t *)bytes);
+  if (ngdb_node_data_len(ngdb) >  sizeof(ngdb_label_t)) goto fail;
+  if (ngdb_ref_data_len (ngdb) != sizeof(double))       goto fail;
 
-  return 0;
+  nnodes = ngdb_num_nodes(ngdb);
 
-fail:
-  return 1;
-}
+  /*
+   * map[i] is non-0 if node i is in the subgraph; once the
+   * search is complete, it is 1 + the index of node i in g
+   */
+  map = calloc(nnodes, sizeof(uint32_t));
+  if (map == NULL) goto fail;
 
-/**
- * Writes the ngdb file header.
- *
- * \return 0 on success, non-0 on failure.
- */
-static uint8_t _write_hdr(
-  ngdb_t  *ngdb, /**< ngdb handle  */
-  graph_t *g     /**< ptr to graph */
-);
+  if (array_create(&thislevel, sizeof(uint32_t), nseeds+1)) goto fail;
+  if (array_create(&nextlevel, sizeof(uint32_t), 16))       goto fail;
 
-/**
- * Writes the graph nodes to the ngdb file.
- *
- * \return 0 on success, non-0 on failure. 
- */
-static uint8_t _write_nodes(
-  ngdb_t  *ngdb, /**< ngdb handle  */
-  graph_t *g     /**< ptr to graph */
-);
+  for (i = 0; i < nseeds; i++) {
 
-/**
- * Writes the graph edges as references to the ngdb file.
- *
- * \return 0 on success, non-0 on failure. 
- */
-static uint8_t _write_refs(
-  ngdb_t  *ngdb, /**< ngdb handle  */
-  graph_t *g     /**< ptr to graph */
-);
+    if (seeds[i] >= nnodes) goto fail;
+    if (map[seeds[i]])      continue;
 
-uint8_t ngdb_write(graph_t *g, char *f) {
+    map[seeds[i]] = 1;
+    if (array_append(&thislevel, seeds + i)) goto fail;
+  }
 
-  ngdb_t *ngdb;
+  /*bfs treats a depth of 0 the same as a depth of 1*/
+  if (depth == 0) depth = 1;
 
-  ngdb = ngdb_create(
-    f,
-    graph_num_nodes(g),
-    NGDB_HDR_DATA_SIZE,
-    sizeof(graph_label_t),
-    sizeof(double));
+  for (d = 0; d < depth && thislevel.size > 0; d++) {
 
-  if (ngdb == NULL)          goto fail;
-  if (_write_hdr  (ngdb, g)) goto fail;
-  if (_write_nodes(ngdb, g)) goto fail;
-  if (_write_refs (ngdb, g)) goto fail;
-  if (ngdb_close(ngdb))      goto fail;
+    array_clear(&nextlevel);
+
+    for (i = 0; i < thislevel.size; i++) {
+
+      u = *(uint32_t *)array_getd(&thislevel, i);
+
+      if (_read_node_refs(ngdb, u, &refs, &wts, &cap, &nrefs)) goto fail;
+
+      for (j = 0; j < nrefs; j++) {
+
+        if (refs[j] >= nnodes) goto fail;
+        if (map[refs[j]])      continue;
+
+        map[refs[j]] = 1;
+        if (array_append(&nextlevel, refs + j)) goto fail;
+      }
+    }
+
+    memcpy(&tmp,       &thislevel, sizeof(array_t));
+    memcpy(&thislevel, &nextlevel, sizeof(array_t));
+    memcpy(&nextlevel, &tmp,       sizeof(array_t));
+  }
+
+  if (_read_subgraph(ngdb, g, map)) goto fail;
+
+  array_free(&thislevel);
+  array_free(&nextlevel);
+  free(map);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
 
   return 0;
 
 fail:
-  if (ngdb != NULL) ngdb_close(ngdb);
+  array_free(&thislevel);
+  array_free(&nextlevel);
+  if (map  != NULL) free(map);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  graph_free(g);
   return 1;
 }
 
-uint8_t _write_hdr(ngdb_t *ngdb, graph_t *g) {
-
-  uint16_t len;
-  uint8_t *data;
-  char    *delim = "\n";
+uint8_t ngdb_read_nodes(ngdb_t *ngdb, graph_t *g, uint32_t *degrees) {
 
-  len = NGDB_HDR_DATA_SIZE;
+  uint64_t i;
+  uint32_t nnodes;
 
-  data = calloc(len, 1);
-  if (data == NULL) goto fail;
+  memset(g, 0, sizeof(graph_t));
 
-  if (graph_log_exists(g) && graph_log_total_len(g) > 0) {
+  if (ngdb_node_data_len(ngdb) > sizeof(ngdb_label_t)) goto fail;
 
-    len = graph_log_total_len(g) +
-      (graph_log_num_msgs(g)-1) * strlen(delim) + 1;
+  nnodes = ngdb_num_nodes(ngdb);
 
-    graph_log_export(g, (char *)data, delim);
+  if (graph_create(g, nnodes, 0)) goto fail;
+  if (_read_hdr(ngdb, g))         goto fail;
 
-    if (len > NGDB_HDR_DATA_SIZE) {
-      len = NGDB_HDR_DATA_SIZE;
-      data[len-1] = '\0';
+  if (ngdb_node_data_len(ngdb) == sizeof(ngdb_label_t)) {
+    if (_read_labels(ngdb, g)) goto fail;
+  }
+  else {
+    for (i = 0; i < nnodes; i++) {
+      if (_read_label(ngdb, g, i)) goto fail;
     }
   }
 
-  if (ngdb_hdr_set_data(ngdb, data, len)) goto fail;
+  for (i = 0; degrees != NULL && i < nnodes; i++) {
 
-  free(data);
+    degrees[i] = ngdb_node_num_refs(ngdb, i);
+    if (degrees[i] == 0xFFFFFFFF) goto fail;
+  }
 
   return 0;
-  
+
 fail:
-  if (data != NULL) free(data);
+  graph_free(g);
   return 1;
 }
 
-uint8_t _write_nodes(ngdb_t *ngdb, graph_t *g) {
+uint8_t ngdb_read_mask(ngdb_t *ngdb, graph_t *g, uint8_t *mask) {
 
-  uint64_t       i;
-  uint32_t       nnodes;
-  graph_label_t *lbl;
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *map;
 
-  nnodes = graph_num_nodes(g);
+  map = NULL;
 
-  for (i = 0; i < nnodes; i++) {
+  memset(g, 0, sizeof(graph_t));
 
-    lbl = graph_get_nodelabel(g, i);
-    if (lbl == NULL) break;
+  if (ngdb_node_data_len(ngdb) >  sizeof(ngdb_label_t)) goto fail;
+  if (ngdb_ref_data_len (ngdb) != sizeof(double))       goto fail;
 
-    if (ngdb_node_set_data(ngdb, 
-                           i, 
-                           (uint8_t *)lbl, 
-                           sizeof(graph_label_t))) 
-      goto fail;
-  }
+  nnodes = ngdb_num_nodes(ngdb);
 
+  map = malloc(nnodes * sizeof(uint32_t));
+  if (nnodes > 0 && map == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) map[i] = mask[i] != 0;
+
+  if (_read_subgraph(ngdb, g, map)) goto fail;
+
+  free(map);
   return 0;
+
 fail:
+  if (map != NULL) free(map);
+  graph_free(g);
   return 1;
 }
 
-uint8_t _write_refs(ngdb_t *ngdb, graph_t *g) {
+uint8_t _read_subgraph(ngdb_t *ngdb, graph_t *g, uint32_t *map) {
 
-  uint32_t  u;
-  uint32_t  v;
-  uint32_t  nnodes;
-  uint32_t  nnbrs;
-  uint32_t *nbrs;
-  float    *wts;
-  double    data;
-  uint8_t   dlen;
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        v;
+  uint32_t        nnodes;
+  uint32_t        nout;
+  uint32_t        nrefs;
+  uint32_t        cap;
+  uint32_t       *refs;
+  double         *wts;
+  graph_builder_t builder;
+  ngdb_label_t    lbl;
 
-  nnodes = graph_num_nodes(g);
+  refs = NULL;
+  wts  = NULL;
+  cap  = 0;
 
-  for (u = 0; u < nnodes; u++) {
+  memset(&builder, 0, sizeof(graph_builder_t));
 
-    nnbrs = graph_num_neighbours(g, u);
-    nbrs  = graph_get_neighbours(g, u);
-    wts   = graph_get_weights   (g, u);
+  nnodes = ngdb_num_nodes(ngdb);
 
-    for (v = 0; v < nnbrs; v++) {
+  for (i = 0, nout = 0; i < nnodes; i++) {
+    if (map[i]) map[i] = ++nout;
+  }
 
-      data = (wts == NULL) ? 0 : wts[v];
-      dlen = (wts == NULL) ? 0 : sizeof(double);
-      
-      if (ngdb_add_ref(ngdb, u, nbrs[v], &data, dlen) == 0xFFFFFFFF)
+  if (graph_create(g, nout, 0))              goto fail;
+  if (graph_builder_init(&builder, g, nout)) goto fail;
+
+  /*
+   * Edges are queued in the same order as they
+   * are read by ngdb_read, so if an edge is
+   * duplicated in the file, the same weight is
+   * retained
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    if (!map[i]) continue;
+
+    memset(&lbl, 0, sizeof(ngdb_label_t));
+    if (ngdb_node_get_data(ngdb, i, (uint8_t *)&lbl)) goto fail;
+    if (_set_label(g, map[i]-1, &lbl))                goto fail;
+
+    if (_read_node_refs(ngdb, i, &refs, &wts, &cap, &nrefs)) goto fail;
+
+    for (j = 0; j < nrefs; j++) {
+
+      v = refs[j];
+
+      if (v >= nnodes)          goto fail;
+      if (!map[v] || v == i)    continue;
+
+      if (graph_builder_add(&builder, map[i]-1, map[v]-1, wts[j]))
+        goto fail;
+    }
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  return 1;
+}
+
+uint8_t _read_node_refs(
+  ngdb_t    *ngdb,
+  uint32_t   nidx,
+  uint32_t **refs,
+  double   **wts,
+  uint32_t  *cap,
+  uint32_t  *nrefs) {
+
+  void *tmp;
+
+  *nrefs = ngdb_node_num_refs(ngdb, nidx);
+
+  if (*nrefs == 0xFFFFFFFF) goto fail;
+  if (*nrefs == 0)          return 0;
+
+  if (*nrefs > *cap) {
+
+    tmp = realloc(*refs, *nrefs*sizeof(uint32_t));
+    if (tmp == NULL) goto fail;
+    *refs = tmp;
+
+    tmp = realloc(*wts, *nrefs*sizeof(double));
+    if (tmp == NULL) goto fail;
+    *wts = tmp;
+
+    *cap = *nrefs;
+  }
+
+  if (ngdb_node_get_all_refs(ngdb, nidx, *refs, *wts)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+static uint8_t _read_hdr(ngdb_t *ngdb, graph_t *graph) {
+  
+  uint8_t *hdrdata;
+  uint16_t hdrlen;
+
+  hdrdata = NULL;
+  hdrlen  = ngdb_hdr_data_len(ngdb);
+
+  if (hdrlen == 0) return 0;
+
+  hdrdata = malloc(hdrlen);
+  if (hdrdata == NULL) goto fail;
+
+  if (ngdb_hdr_get_data(ngdb, hdrdata))               goto fail;
+  if (graph_log_init(graph))                          goto fail;
+  if (graph_log_import(graph, (char *)hdrdata, "\n")) goto fail;
+
+  return 0;
+  
+fail:
+  if (hdrdata != NULL) free(hdrdata);
+  return 1;
+}
+
+uint8_t _read_refs(ngdb_t *ngdb, graph_builder_t *builder, uint32_t nidx) {
+
+  uint64_t  i;
+  uint32_t  numrefs;
+  uint32_t *refs;
+  double   *wts;
+
+  refs = NULL;
+  wts  = NULL;
+
+  numrefs = ngdb_node_num_refs(ngdb, nidx);
+
+  if (numrefs == 0xFFFFFFFF) goto fail;
+
+  if (numrefs > 0) {
+
+    refs = malloc(numrefs*sizeof(uint32_t));
+    wts  = malloc(numrefs*sizeof(double));
+
+    if (refs                                          == NULL) goto fail;
+    if (wts                                           == NULL) goto fail;
+    if (ngdb_node_get_all_refs(ngdb, nidx, refs, wts) != 0)    goto fail;
+
+    for (i = 0; i < numrefs; i++) {
+      if (graph_builder_add(builder, nidx, refs[i], wts[i])) goto fail;
+    }
+    
+    free(refs);
+    free(wts);
+    refs = NULL;
+    wts  = NULL;
+  }
+
+  return 0;
+fail:
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  return 1;
+}
+
+uint8_t _read_adjacency(ngdb_t *ngdb, graph_builder_t *builder) {
+
+  uint64_t  i;
+  uint64_t  off;
+  uint64_t  nrefs;
+  uint64_t  cap;
+  uint32_t  start;
+  uint32_t  n;
+  uint32_t  cnt;
+  uint32_t  nnodes;
+  uint32_t *refs;
+  double   *wts;
+  void     *tmp;
+
+  nnodes = ngdb_num_nodes(ngdb);
+  cap    = ngdb_num_refs(ngdb);
+
+  if (cap > NGDB_READ_CHUNK_REFS) cap = NGDB_READ_CHUNK_REFS;
+  if (cap == 0)                   cap = 1;
+
+  refs = malloc(cap*sizeof(uint32_t));
+  wts  = malloc(cap*sizeof(double));
+
+  if (refs == NULL) goto fail;
+  if (wts  == NULL) goto fail;
+
+  for (start = 0; start < nnodes; start += n) {
+
+    /*as many nodes as will fit in one chunk, but at least one*/
+    nrefs = 0;
+    for (n = 0; start + n < nnodes; n++) {
+
+      cnt = ngdb_node_num_refs(ngdb, start + n);
+
+      if (cnt == 0xFFFFFFFF)                            goto fail;
+      if (n > 0 && nrefs + cnt > NGDB_READ_CHUNK_REFS) break;
+
+      nrefs += cnt;
+    }
+
+    if (nrefs > cap) {
+
+      tmp = realloc(refs, nrefs*sizeof(uint32_t));
+      if (tmp == NULL) goto fail;
+      refs = tmp;
+
+      tmp = realloc(wts, nrefs*sizeof(double));
+      if (tmp == NULL) goto fail;
+      wts = tmp;
+
+      cap = nrefs;
+    }
+
+    if (ngdb_nodes_get_all_refs(ngdb, start, n, refs, wts)) goto fail;
+
+    for (i = 0, off = 0; i < n; i++, off += cnt) {
+
+      cnt = ngdb_node_num_refs(ngdb, start + i);
+
+      if (graph_builder_set_neighbours(
+            builder, start + i, cnt, refs + off, wts + off))
+        goto fail;
+    }
+  }
+
+  free(refs);
+  free(wts);
+
+  return 0;
+
+fail:
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+  return 1;
+}
+
+uint8_t _read_labels(ngdb_t *ngdb, graph_t *graph) {
+
+  uint64_t      i;
+  uint32_t      start;
+  uint32_t      n;
+  uint32_t      nnodes;
+  ngdb_label_t *data;
+
+  nnodes = ngdb_num_nodes(ngdb);
+  data   = malloc(NGDB_READ_CHUNK_NODES*sizeof(ngdb_label_t));
+
+  if (data == NULL) goto fail;
+
+  for (start = 0; start < nnodes; start += n) {
+
+    n = NGDB_READ_CHUNK_NODES;
+    if (start + n > nnodes) n = nnodes - start;
+
+    if (ngdb_nodes_get_data(ngdb, start, n, (uint8_t *)data)) goto fail;
+
+    for (i = 0; i < n; i++) {
+      if (_set_label(graph, start + i, data + i)) goto fail;
+    }
+  }
+
+  free(data);
+  return 0;
+
+fail:
+  if (data != NULL) free(data);
+  return 1;
+}
+
+uint8_t _read_label(ngdb_t *ngdb, graph_t *graph, uint32_t nidx) {
+
+  ngdb_label_t lbl;
+
+  memset(&lbl, 0, sizeof(ngdb_label_t));
+
+  if (ngdb_node_get_data(ngdb, nidx, (uint8_t *)&lbl)) goto fail;
+  if (_set_label(graph, nidx, &lbl))                   goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+/**
+ * Writes the ngdb file header.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_hdr(
+  ngdb_t  *ngdb, /**< ngdb handle  */
+  graph_t *g     /**< ptr to graph */
+);
+
+/**
+ * Writes the graph nodes to the ngdb file.
+ *
+ * \return 0 on success, non-0 on failure. 
+ */
+static uint8_t _write_nodes(
+  ngdb_t  *ngdb, /**< ngdb handle  */
+  graph_t *g     /**< ptr to graph */
+);
+
+/**
+ * Writes the graph edges as references to the ngdb file.
+ *
+ * \return 0 on success, non-0 on failure. 
+ */
+static uint8_t _write_refs(
+  ngdb_t  *ngdb, /**< ngdb handle  */
+  graph_t *g     /**< ptr to graph */
+);
+
+/**
+ * Writes the labels of the nodes in the given view to the ngdb file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_view_nodes(
+  ngdb_t       *ngdb, /**< ngdb handle  */
+  graph_view_t *v     /**< ptr to view  */
+);
+
+/**
+ * Writes the edges of the given view as references to the ngdb file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_view_refs(
+  ngdb_t       *ngdb, /**< ngdb handle  */
+  graph_view_t *v     /**< ptr to view  */
+);
+
+uint8_t ngdb_write(graph_t *g, char *f) {
+
+  ngdb_t *ngdb;
+  PROFILE_FUNC();
+
+  ngdb = ngdb_create(
+    f,
+    graph_num_nodes(g),
+    NGDB_HDR_DATA_SIZE,
+    sizeof(ngdb_label_t),
+    sizeof(double));
+
+  if (ngdb == NULL)          goto fail;
+  if (_write_hdr  (ngdb, g)) goto fail;
+  if (_write_nodes(ngdb, g)) goto fail;
+  if (_write_refs (ngdb, g)) goto fail;
+  if (ngdb_close(ngdb))      goto fail;
+
+  return 0;
+
+fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
+  return 1;
+}
+
+uint8_t _write_hdr(ngdb_t *ngdb, graph_t *g) {
+
+  uint64_t len;
+  uint8_t *data;
+  char    *delim = "\n";
+
+  len = NGDB_HDR_DATA_SIZE;
+
+  /*
+   * The log is exported in its entirety, and then
+   * truncated to fit in the header, so the buffer
+   * must be big enough for the whole log.
+   */
+  if (graph_log_exists(g) && graph_log_total_len(g) > 0) {
+    len = (uint64_t)graph_log_total_len(g) +
+      (graph_log_num_msgs(g)-1) * strlen(delim) + 1;
+  }
+
+  data = calloc(len > NGDB_HDR_DATA_SIZE ? len : NGDB_HDR_DATA_SIZE, 1);
+  if (data == NULL) goto fail;
+
+  if (graph_log_exists(g) && graph_log_total_len(g) > 0) {
+
+    graph_log_export(g, (char *)data, delim);
+
+    if (len > NGDB_HDR_DATA_SIZE) {
+      len = NGDB_HDR_DATA_SIZE;
+      data[len-1] = '\0';
+    }
+  }
+
+  if (ngdb_hdr_set_data(ngdb, data, len)) goto fail;
+
+  free(data);
+
+  return 0;
+  
+fail:
+  if (data != NULL) free(data);
+  return 1;
+}
+
+uint8_t _write_nodes(ngdb_t *ngdb, graph_t *g) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint32_t      nnodes;
+  ngdb_label_t *lbls;
+
+  lbls   = NULL;
+  nnodes = graph_num_nodes(g);
+  n      = nnodes;
+
+  if (n > NGDB_WRITE_CHUNK_NODES) n = NGDB_WRITE_CHUNK_NODES;
+
+  if (n == 0) return 0;
+
+  lbls = malloc(n * sizeof(ngdb_label_t));
+  if (lbls == NULL) goto fail;
+
+  /*
+   * the node data sections are contiguous, so the
+   * labels are written in large chunks
+   */
+  for (i = 0; i < nnodes; i += n) {
+
+    if (n > nnodes - i) n = nnodes - i;
+
+    for (j = 0; j < n; j++) {
+      if (graph_get_nodelabel(g, i+j) == NULL) break;
+      _get_label(g, i+j, lbls+j);
+    }
+
+    if (j > 0 && ngdb_nodes_set_data(ngdb, i, j, (uint8_t *)lbls))
+      goto fail;
+
+    if (j < n) break;
+  }
+
+  free(lbls);
+  return 0;
+
+fail:
+  if (lbls != NULL) free(lbls);
+  return 1;
+}
+
+uint8_t _write_refs(ngdb_t *ngdb, graph_t *g) {
+
+  uint64_t  i;
+  uint32_t  u;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t  maxnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+  double   *data;
+
+  data    = NULL;
+  nnodes  = graph_num_nodes(g);
+  maxnbrs = 1;
+
+  for (u = 0; u < nnodes; u++) {
+    nnbrs = graph_num_neighbours(g, u);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  data = malloc(maxnbrs * sizeof(double));
+  if (data == NULL) goto fail;
+
+  /*
+   * the references of each node are written in one go,
+   * in node order, so the reference section is written
+   * in a single sequential pass
+   */
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_num_neighbours(g, u);
+    nbrs  = graph_get_neighbours(g, u);
+    wts   = graph_get_weights   (g, u);
+
+    for (i = 0; i < nnbrs; i++)
+      data[i] = (wts == NULL) ? 0 : wts[i];
+
+    if (ngdb_node_add_refs(ngdb, u, nnbrs, nbrs, data)) goto fail;
+  }
+
+  free(data);
+  return 0;
+
+fail:
+  if (data != NULL) free(data);
+  return 1;
+}
+
+uint8_t ngdb_write_view(graph_view_t *v, char *f) {
+
+  ngdb_t *ngdb;
+  PROFILE_FUNC();
+
+  ngdb = ngdb_create(
+    f,
+    graph_view_num_nodes(v),
+    NGDB_HDR_DATA_SIZE,
+    sizeof(ngdb_label_t),
+    sizeof(double));
+
+  if (ngdb == NULL)                 goto fail;
+  if (_write_hdr       (ngdb, v->g)) goto fail;
+  if (_write_view_nodes(ngdb, v))    goto fail;
+  if (_write_view_refs (ngdb, v))    goto fail;
+  if (ngdb_close(ngdb))              goto fail;
+
+  return 0;
+
+fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
+  return 1;
+}
+
+uint8_t _write_view_nodes(ngdb_t *ngdb, graph_view_t *v) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint32_t      nnodes;
+  ngdb_label_t *lbls;
+
+  lbls   = NULL;
+  nnodes = graph_view_num_nodes(v);
+  n      = nnodes;
+
+  if (n > NGDB_WRITE_CHUNK_NODES) n = NGDB_WRITE_CHUNK_NODES;
+
+  if (n == 0) return 0;
+
+  lbls = malloc(n * sizeof(ngdb_label_t));
+  if (lbls == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i += n) {
+
+    if (n > nnodes - i) n = nnodes - i;
+
+    for (j = 0; j < n; j++) {
+      if (graph_view_get_nodelabel(v, i+j) == NULL) break;
+      _get_label(v->g, graph_view_parent_id(v, i+j), lbls+j);
+    }
+
+    if (j > 0 && ngdb_nodes_set_data(ngdb, i, j, (uint8_t *)lbls))
+      goto fail;
+
+    if (j < n) break;
+  }
+
+  free(lbls);
+  return 0;
+
+fail:
+  if (lbls != NULL) free(lbls);
+  return 1;
+}
+
+uint8_t _write_view_refs(ngdb_t *ngdb, graph_view_t *v) {
+
+  uint64_t  i;
+  uint32_t  u;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t  maxnbrs;
+  uint32_t *nbrs;
+  float    *wts;
+  double   *data;
+
+  nbrs    = NULL;
+  wts     = NULL;
+  data    = NULL;
+  nnodes  = graph_view_num_nodes(v);
+  maxnbrs = 1;
+
+  for (u = 0; u < nnodes; u++) {
+    nnbrs = graph_view_max_neighbours(v, u);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  nbrs = malloc(maxnbrs * sizeof(uint32_t));
+  wts  = malloc(maxnbrs * sizeof(float));
+  data = malloc(maxnbrs * sizeof(double));
+  if (nbrs == NULL) goto fail;
+  if (wts  == NULL) goto fail;
+  if (data == NULL) goto fail;
+
+  for (u = 0; u < nnodes; u++) {
+
+    nnbrs = graph_view_get_neighbours(v, u, nbrs, wts);
+
+    for (i = 0; i < nnbrs; i++) data[i] = wts[i];
+
+    if (ngdb_node_add_refs(ngdb, u, nnbrs, nbrs, data)) goto fail;
+  }
+
+  free(nbrs);
+  free(wts);
+  free(data);
+  return 0;
+
+fail:
+  if (nbrs != NULL) free(nbrs);
+  if (wts  != NULL) free(wts);
+  if (data != NULL) free(data);
+  return 1;
+}
+
+uint8_t _set_label(graph_t *g, uint32_t nidx, ngdb_label_t *lbl) {
+
+  uint64_t i;
+
+  if (graph_set_nodelabel(g, nidx, &(lbl->label))) goto fail;
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++) {
+    if (graph_set_node_meta(g, nidx, i, lbl->meta[i])) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _get_label(graph_t *g, uint32_t nidx, ngdb_label_t *lbl) {
+
+  uint64_t i;
+
+  memcpy(&(lbl->label), graph_get_nodelabel(g, nidx), sizeof(graph_label_t));
+
+  for (i = 0; i < _GRAPH_NODE_LABEL_META; i++)
+    lbl->meta[i] = graph_get_node_meta(g, nidx, i);
+}
+
+uint8_t ngdb_prune(
+  char *fin, char *fout, uint32_t size, double prop, char *hdrmsg) {
+
+  ngdb_t       *in;
+  ngdb_t       *out;
+  graph_t       log;
+  uint64_t      i;
+  uint64_t      j;
+  uint32_t      start;
+  uint32_t      n;
+  uint32_t      nnodes;
+  uint32_t      noutnodes;
+  uint32_t      nwritten;
+  uint32_t      ncomps;
+  uint32_t      nrefs;
+  uint32_t      cap;
+  uint32_t      thres;
+  uint32_t     *parent;
+  uint32_t     *sizes;
+  uint32_t     *refs;
+  double       *wts;
+  double        wt;
+  ngdb_label_t *lbls;
+
+  in     = NULL;
+  out    = NULL;
+  parent = NULL;
+  sizes  = NULL;
+  refs   = NULL;
+  wts    = NULL;
+  lbls   = NULL;
+  cap    = 0;
+
+  memset(&log, 0, sizeof(graph_t));
+
+  in = ngdb_open_mmap(fin);
+  if (in == NULL) in = ngdb_open(fin);
+  if (in == NULL) goto fail;
+
+  if (ngdb_node_data_len(in) != sizeof(ngdb_label_t)) goto fail;
+  if (ngdb_ref_data_len( in) != sizeof(double))       goto fail;
+
+  nnodes = ngdb_num_nodes(in);
+
+  parent = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  sizes  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  if (parent == NULL) goto fail;
+  if (sizes  == NULL) goto fail;
+
+  if (_prune_components(in, parent, sizes)) goto fail;
+
+  /*
+   * gather the size of every component at the front of the
+   * parent array, to calculate the threshold, and then
+   * resolve every node to its component size
+   */
+  ncomps = 0;
+  for (i = 0; i < nnodes; i++) {
+    if (parent[i] == i) parent[ncomps++] = sizes[i];
+  }
+
+  thres = graph_prune_threshold(parent, ncomps, nnodes, size, prop);
+
+  /*
+   * the sizes array now holds the new ID of every
+   * surviving node, or 0xFFFFFFFF for removed nodes
+   */
+  noutnodes = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    if (sizes[i] > thres) sizes[i] = noutnodes++;
+    else                  sizes[i] = 0xFFFFFFFF;
+  }
+
+  free(parent);
+  parent = NULL;
+
+  out = ngdb_create(fout,
+                    noutnodes,
+                    NGDB_HDR_DATA_SIZE,
+                    sizeof(ngdb_label_t),
+                    sizeof(double));
+  if (out == NULL) goto fail;
+
+  /*copy the graph log, via a graph which holds nothing else*/
+  if (_read_hdr(in, &log))                             goto fail;
+  if (!graph_log_exists(&log) && graph_log_init(&log)) goto fail;
+  if (hdrmsg != NULL && graph_log_add(&log, hdrmsg))   goto fail;
+  if (_write_hdr(out, &log))                           goto fail;
+
+  /*copy the labels of the surviving nodes, a chunk at a time*/
+  lbls = malloc(NGDB_READ_CHUNK_NODES*sizeof(ngdb_label_t));
+  if (lbls == NULL) goto fail;
+
+  nwritten = 0;
+  for (start = 0; start < nnodes; start += n) {
+
+    n = nnodes - start;
+    if (n > NGDB_READ_CHUNK_NODES) n = NGDB_READ_CHUNK_NODES;
+
+    if (ngdb_nodes_get_data(in, start, n, (uint8_t *)lbls)) goto fail;
+
+    for (i = 0, j = 0; i < n; i++) {
+
+      if (sizes[start + i] == 0xFFFFFFFF) continue;
+
+      if (j < i) lbls[j] = lbls[i];
+      j++;
+    }
+
+    if (ngdb_nodes_set_data(out, nwritten, j, (uint8_t *)lbls)) goto fail;
+
+    nwritten += j;
+  }
+
+  /*
+   * copy the references between surviving nodes - the new
+   * IDs are in the same order as the old ones, so the
+   * references of every node stay sorted. Weights are
+   * rounded to single precision, as they would be if the
+   * graph were loaded.
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    if (sizes[i] == 0xFFFFFFFF) continue;
+
+    if (_read_node_refs(in, i, &refs, &wts, &cap, &nrefs)) goto fail;
+
+    for (j = 0; j < nrefs; j++) {
+
+      if (sizes[refs[j]] == 0xFFFFFFFF) continue;
+
+      wt = (float)wts[j];
+
+      if (ngdb_add_ref(out, sizes[i], sizes[refs[j]], &wt, sizeof(double))
+          == 0xFFFFFFFF)
         goto fail;
     }
   }
 
+  if (ngdb_close(out)) {
+    out = NULL;
+    goto fail;
+  }
+
+  ngdb_close(in);
+  graph_free(&log);
+  free(sizes);
+  free(lbls);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+
+  return 0;
+
+fail:
+  if (in     != NULL) ngdb_close(in);
+  if (out    != NULL) ngdb_close(out);
+  if (parent != NULL) free(parent);
+  if (sizes  != NULL) free(sizes);
+  if (lbls   != NULL) free(lbls);
+  if (refs   != NULL) free(refs);
+  if (wts    != NULL) free(wts);
+  graph_free(&log);
+  return 1;
+}
+
+uint8_t ngdb_threshold(
+  char *fin, char *fout, double threshold, uint8_t absval, uint8_t reverse) {
+
+  ngdb_t       *in;
+  ngdb_t       *out;
+  graph_t       log;
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      k;
+  uint32_t      start;
+  uint32_t      n;
+  uint32_t      nnodes;
+  uint32_t      nrefs;
+  uint32_t      cap;
+  uint32_t     *refs;
+  double       *wts;
+  uint64_t     *acc;
+  float         wt;
+  ngdb_label_t *lbls;
+
+  in   = NULL;
+  out  = NULL;
+  refs = NULL;
+  wts  = NULL;
+  acc  = NULL;
+  lbls = NULL;
+  cap  = 0;
+
+  memset(&log, 0, sizeof(graph_t));
+
+  in = ngdb_open_mmap(fin);
+  if (in == NULL) in = ngdb_open(fin);
+  if (in == NULL) goto fail;
+
+  if (ngdb_node_data_len(in) != sizeof(ngdb_label_t)) goto fail;
+  if (ngdb_ref_data_len( in) != sizeof(double))       goto fail;
+
+  nnodes = ngdb_num_nodes(in);
+
+  /*see _prune_components*/
+  acc  = calloc((uint64_t)nnodes + 1, sizeof(uint64_t));
+  lbls = malloc(NGDB_READ_CHUNK_NODES*sizeof(ngdb_label_t));
+  if (acc  == NULL) goto fail;
+  if (lbls == NULL) goto fail;
+
+  out = ngdb_create(fout,
+                    nnodes,
+                    NGDB_HDR_DATA_SIZE,
+                    sizeof(ngdb_label_t),
+                    sizeof(double));
+  if (out == NULL) goto fail;
+
+  /*
+   * graph_threshold_weight does not copy the graph
+   * log, so the header is written from a graph with
+   * no log
+   */
+  if (_write_hdr(out, &log)) goto fail;
+
+  for (start = 0; start < nnodes; start += n) {
+
+    n = nnodes - start;
+    if (n > NGDB_READ_CHUNK_NODES) n = NGDB_READ_CHUNK_NODES;
+
+    if (ngdb_nodes_get_data(in,  start, n, (uint8_t *)lbls)) goto fail;
+    if (ngdb_nodes_set_data(out, start, n, (uint8_t *)lbls)) goto fail;
+  }
+
+  /*
+   * Weights are rounded to single precision, and
+   * thresholded, as they would be if the graph were
+   * loaded. Every reference is checked, as in
+   * _prune_components, as it is read.
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    if (_read_node_refs(in, i, &refs, &wts, &cap, &nrefs)) goto fail;
+
+    for (j = 0, k = 0; j < nrefs; j++) {
+
+      if (refs[j] >= nnodes)             goto fail;
+      if (refs[j] == i)                  goto fail;
+      if (j > 0 && refs[j] <= refs[j-1]) goto fail;
+
+      if (refs[j] < i) acc[i]       -= _ref_hash(refs[j], wts[j]);
+      else             acc[refs[j]] += _ref_hash(i,       wts[j]);
+
+      wt = (float)wts[j];
+
+      if (absval) wt = fabs(wt);
+
+      if (reverse) { if (wt > threshold) continue; }
+      else         { if (wt < threshold) continue; }
+
+      refs[k] = refs[j];
+      wts [k] = (float)wts[j];
+      k++;
+    }
+
+    if (acc[i] != 0) goto fail;
+
+    if (ngdb_node_add_refs(out, i, k, refs, wts)) goto fail;
+  }
+
+  if (ngdb_close(out)) {
+    out = NULL;
+    remove(fout);
+    goto fail;
+  }
+
+  ngdb_close(in);
+  free(acc);
+  free(lbls);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+
+  return 0;
+
+fail:
+  if (in   != NULL) ngdb_close(in);
+  if (acc  != NULL) free(acc);
+  if (lbls != NULL) free(lbls);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+
+  if (out != NULL) {
+    ngdb_close(out);
+    remove(fout);
+  }
+  return 1;
+}
+
+uint8_t _prune_components(ngdb_t *ngdb, uint32_t *parent, uint32_t *sizes) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  t;
+  uint32_t  nnodes;
+  uint32_t  nrefs;
+  uint32_t  cap;
+  uint32_t *refs;
+  double   *wts;
+  uint64_t *acc;
+
+  refs = NULL;
+  wts  = NULL;
+  cap  = 0;
+
+  nnodes = ngdb_num_nodes(ngdb);
+
+  /*
+   * acc[v] accumulates a hash of every reference (u -> v,
+   * u < v) into the node; the references (v -> u) which
+   * match them are subtracted when the references of v
+   * are read, after those of every node u < v, so for a
+   * symmetric graph, the result is always 0
+   */
+  acc = calloc((uint64_t)nnodes + 1, sizeof(uint64_t));
+  if (acc == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    parent[i] = i;
+    sizes [i] = 1;
+  }
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (_read_node_refs(ngdb, i, &refs, &wts, &cap, &nrefs)) goto fail;
+
+    for (j = 0; j < nrefs; j++) {
+
+      if (refs[j] >= nnodes)             goto fail;
+      if (refs[j] == i)                  goto fail;
+      if (j > 0 && refs[j] <= refs[j-1]) goto fail;
+
+      if (refs[j] < i) {
+        acc[i] -= _ref_hash(refs[j], wts[j]);
+        continue;
+      }
+
+      acc[refs[j]] += _ref_hash(i, wts[j]);
+
+      /*union by size*/
+      u = _uf_find(parent, i);
+      v = _uf_find(parent, refs[j]);
+
+      if (u == v) continue;
+
+      if (sizes[u] < sizes[v]) {
+        t = u;
+        u = v;
+        v = t;
+      }
+
+      parent[v]  = u;
+      sizes[u]  += sizes[v];
+    }
+
+    if (acc[i] != 0) goto fail;
+  }
+
+  /*resolve the size of the component of every node*/
+  for (i = 0; i < nnodes; i++) parent[i] = _uf_find(parent, i);
+  for (i = 0; i < nnodes; i++) sizes[i]  = sizes[parent[i]];
+
+  free(acc);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
+
   return 0;
+
 fail:
+  if (acc  != NULL) free(acc);
+  if (refs != NULL) free(refs);
+  if (wts  != NULL) free(wts);
   return 1;
 }
+
+uint32_t _uf_find(uint32_t *parent, uint32_t u) {
+
+  while (parent[u] != u) {
+    parent[u] = parent[parent[u]];
+    u         = parent[u];
+  }
+
+  return u;
+}
+
+uint64_t _ref_hash(uint32_t u, float wt) {
+
+  uint32_t bits;
+  uint64_t h;
+
+  memcpy(&bits, &wt, sizeof(bits));
+
+  /*splitmix64 finaliser*/
+  h = ((uint64_t)u << 32) | bits;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+
+  return h ^ (h >> 31);
+}
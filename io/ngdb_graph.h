@@ -10,16 +10,39 @@
 
 #include "io/ngdb.h"
 #include "graph/graph.h"
+#include "graph/graph_view.h"
+#include "graph/graph_compact.h"
 
 #define NGDB_HDR_DATA_SIZE 8192
 
+/**
+ * A node label as stored in the node data section of an ngdb file - the
+ * graph_label_t fields, followed by the node metadata (see
+ * graph_get_node_meta), in slot order.
+ */
+typedef struct _ngdb_label {
+
+  graph_label_t label;                        /**< node label    */
+  uint32_t      meta[_GRAPH_NODE_LABEL_META]; /**< node metadata */
+
+} ngdb_label_t;
+
 /**
  * Loads the graph contained in the given 
  * ngdb file into the given graph struct.
  *
- * Assumes that the ngdb file has a node 
- * data section of 16 bytes, containing 
- * a graph_label_t struct (see graph.h).
+ * Assumes that the ngdb file has a node
+ * data section containing an ngdb_label_t
+ * struct.
+ *
+ * If the file is a graph image (see
+ * graph/graph_image.h) rather than an ngdb
+ * file, the graph is attached to it. If it
+ * is a CSR file (see io/csr.h), it is
+ * mapped with csr_read, and if it is a
+ * delta file (see io/ngdb_delta.h), its
+ * base graph is loaded and the delta is
+ * applied with ngdb_delta_read.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -28,6 +51,126 @@ uint8_t ngdb_read(
   graph_t *g  /**< pointer to a graph struct to use */
 );
 
+/**
+ * Loads the subgraph of the given ngdb file which is reached by a breadth
+ * first search, to the given depth, from the given seed nodes. The result
+ * is the same as that of ngdb_read followed by graph_seed (see
+ * graph/graph_seed.h), except that the graph log is not loaded; but only
+ * the references of the nodes in the subgraph are read. If the file was
+ * opened with ngdb_open_mmap, only those parts of the file which contain
+ * the node labels and references of the subgraph are read from disk.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_read_seed(
+  ngdb_t   *ngdb,   /**< open ngdb handle                 */
+  graph_t  *g,      /**< pointer to a graph struct to use */
+  uint32_t *seeds,  /**< seed node IDs                    */
+  uint32_t  nseeds, /**< number of seed nodes             */
+  uint8_t   depth   /**< depth of breadth first search    */
+);
+
+/**
+ * First stage of a staged load, for tools which only need the node labels
+ * up front, and the adjacency of some of the nodes later on. Creates a
+ * graph containing every node of the given ngdb file, with its label and
+ * metadata, and the graph log, but without any edges. If degrees is not
+ * NULL, the number of references of every node is stored in it; this is
+ * read from the node index, not from the references.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_read_nodes(
+  ngdb_t   *ngdb,   /**< open ngdb handle                          */
+  graph_t  *g,      /**< pointer to a graph struct to use          */
+  uint32_t *degrees /**< NULL, or space for ngdb_num_nodes degrees */
+);
+
+/**
+ * Second stage of a staged load - loads the subgraph induced by the nodes
+ * with a non-0 value in the given mask, which must contain one value for
+ * every node in the file. The result is the same as that of ngdb_read
+ * followed by graph_mask (see graph/graph_mask.h), except that the graph
+ * log is not loaded (it can be copied from the graph created by
+ * ngdb_read_nodes); but only the references of the masked nodes are read.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_read_mask(
+  ngdb_t  *ngdb, /**< open ngdb handle                 */
+  graph_t *g,    /**< pointer to a graph struct to use */
+  uint8_t *mask  /**< nodes to load                    */
+);
+
+/**
+ * Loads the adjacency of the given ngdb file into the given compact graph
+ * (see graph/graph_compact.h), one node at a time, without creating a
+ * graph_t. Node labels and the graph log are not loaded. If wtbits is 8
+ * or 16, the file is read twice - once to find the range of the edge
+ * weights, and once to quantise them.
+ *
+ * The references of every node must be in ascending order, without
+ * duplicates, as they are in files created by ngdb_write.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_read_compact(
+  char            *f,     /**< name of ngdb file to load           */
+  graph_compact_t *c,     /**< uninitialised compact graph         */
+  uint8_t          wtbits /**< bits per weight - 0, 8, 16 or 32    */
+);
+
+/**
+ * Removes small components from the graph in the given ngdb file, and
+ * writes the result to a new file, without loading either graph into
+ * memory. The components are found with a union-find pass over the
+ * references of the input file, and a second pass then streams the
+ * surviving nodes and references, with their new node IDs, to the output
+ * file. Components are chosen for removal in the same way as by
+ * graph_prune (see graph/graph_prune.h), and the output file is the same
+ * as that which would be written by ngdb_read, graph_prune, graph_log_copy,
+ * graph_log_add (if hdrmsg is not NULL) and ngdb_write.
+ *
+ * The input file must have been created by ngdb_write - the references of
+ * every node must be in ascending order, without duplicates, and must be
+ * symmetric. This is checked, and the function fails before the output
+ * file is created if it is not the case.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_prune(
+  char    *fin,   /**< name of ngdb file to prune                  */
+  char    *fout,  /**< name of file to write to                    */
+  uint32_t size,  /**< component size parameter (see graph_prune)  */
+  double   prop,  /**< minimum proportion of largest component     */
+  char    *hdrmsg /**< message to add to the graph log, or NULL    */
+);
+
+/**
+ * Thresholds the edges of the given ngdb file by weight, and writes the
+ * result to a new file, without loading the graph into memory. The node
+ * labels and references are streamed from the input file to the output
+ * file in a single pass, and references which do not pass the threshold
+ * are dropped, so only O(V) memory is used. Edges are retained in the same
+ * way as by graph_threshold_weight (see graph/graph_threshold.h), and the
+ * output file is the same as that which would be written by ngdb_read,
+ * graph_threshold_weight and ngdb_write.
+ *
+ * The input file must have been created by ngdb_write (see ngdb_prune).
+ * As this is only known once every reference has been read, the output
+ * file is deleted if it is not the case.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_threshold(
+  char    *fin,       /**< name of ngdb file to threshold            */
+  char    *fout,      /**< name of file to write to                  */
+  double   threshold, /**< threshold to apply                        */
+  uint8_t  absval,    /**< use absolute values for thresholding      */
+  uint8_t  reverse    /**< remove edges above threshold, instead of
+                           below                                     */
+);
+
 /**
  * Writes the given graph to the given file.
  *
@@ -38,4 +181,17 @@ uint8_t ngdb_write(
   char    *f  /**< file to write it to */
 );
 
+/**
+ * Writes the given subgraph view to the given file, without materialising
+ * it. The file is identical to that which would be written by
+ * graph_view_materialise followed by ngdb_write, with the log of the
+ * parent graph (see graph/graph_log.h) saved in the header.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ngdb_write_view(
+  graph_view_t *v, /**< view to write       */
+  char         *f  /**< file to write it to */
+);
+
 #endif /* __NGDB_GRAPH_H__ */
@@ -6,12 +6,25 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <zlib.h>
 
 #include "io/analyze75.h"
 #include "io/nifti1.h"
 #include "util/reverse.h"
 #include "util/suffix.h"
 #include "util/filesize.h"
+#include "util/profile.h"
+
+/**
+ * Size of the chunks in which image data is read from a file - gzread
+ * reads at most UINT_MAX bytes at a time.
+ */
+#define NIFTI1_READ_CHUNK (1 << 24)
+
+/**
+ * Size of the zlib input buffer used when reading from a file.
+ */
+#define NIFTI1_GZ_BUFFER  (1 << 18)
 
 void nifti1_reverse_hdr(nifti1_hdr_t *hdr) {
 
@@ -62,10 +75,11 @@ void nifti1_reverse_hdr(nifti1_hdr_t *hdr) {
   reverse(&(hdr->qoffset_y),   &(hdr->qoffset_y),   sizeof(hdr->qoffset_y));
   reverse(&(hdr->qoffset_z),   &(hdr->qoffset_z),   sizeof(hdr->qoffset_z));
 
-  for (i = 0; i < 4; i++)
+  for (i = 0; i < 4; i++) {
     reverse((hdr->srow_x)+i, (hdr->srow_x)+i, sizeof((hdr->srow_x)[i]));
     reverse((hdr->srow_y)+i, (hdr->srow_y)+i, sizeof((hdr->srow_y)[i]));
     reverse((hdr->srow_z)+i, (hdr->srow_z)+i, sizeof((hdr->srow_z)[i]));
+  }
 }
 
 uint8_t nifti1_load_hdr(char *filename, nifti1_hdr_t *hdr) {
@@ -155,3 +169,87 @@ uint8_t nifti1_to_analyze(nifti1_hdr_t *nhdr, dsr_t *ahdr) {
 
   return 0;
 }
+
+uint8_t nifti1_is_single_file(char *filename) {
+
+  uint64_t len;
+
+  len = strlen(filename);
+
+  if (len > 4 && !strcmp(filename+len-4, ".nii"))    return 1;
+  if (len > 7 && !strcmp(filename+len-7, ".nii.gz")) return 1;
+
+  return 0;
+}
+
+uint8_t nifti1_load(char *filename, dsr_t *hdr, uint8_t **data) {
+
+  gzFile       f;
+  uint64_t     sz;
+  uint64_t     off;
+  uint64_t     len;
+  int          nread;
+  nifti1_hdr_t nhdr;
+
+  f     = NULL;
+  *data = NULL;
+
+  memset(&nhdr, 0, sizeof(nifti1_hdr_t));
+
+  /*gzread reads uncompressed files as they are*/
+  f = gzopen(filename, "rb");
+  if (f == NULL) goto fail;
+
+  gzbuffer(f, NIFTI1_GZ_BUFFER);
+
+  if (gzread(f, &nhdr, 348) != 348) goto fail;
+
+  if (nhdr.sizeof_hdr != 348) {
+
+    nifti1_reverse_hdr(&nhdr);
+
+    if (nhdr.sizeof_hdr != 348) goto fail;
+
+    nhdr.rev = 1;
+  }
+
+  if (memcmp(nhdr.magic, "n+1", 4)) goto fail;
+  if (nhdr.dim[0] > 7)              goto fail;
+  if (nhdr.vox_offset < 348)        goto fail;
+
+  if (nifti1_to_analyze(&nhdr, hdr)) goto fail;
+
+  sz = (uint64_t)analyze_value_size(hdr) * analyze_num_vals(hdr);
+  if (sz == 0) goto fail;
+
+  /*skip over any extensions, to the start of the image data*/
+  if (gzseek(f, (z_off_t)nhdr.vox_offset, SEEK_SET) == -1) goto fail;
+
+  *data = malloc(sz);
+  if (*data == NULL) goto fail;
+
+  /*
+   * the data is decompressed in chunks straight into
+   * the image buffer, so the compressed file is never
+   * held in memory, nor written out uncompressed
+   */
+  for (off = 0; off < sz; off += len) {
+
+    len = sz - off;
+    if (len > NIFTI1_READ_CHUNK) len = NIFTI1_READ_CHUNK;
+
+    nread = gzread(f, *data + off, len);
+    if (nread != len) goto fail;
+  }
+
+  PROFILE_COUNT(PROFILE_ANALYZE_READ, sz);
+
+  gzclose(f);
+  return 0;
+
+fail:
+  if (f     != NULL) gzclose(f);
+  if (*data != NULL) free(*data);
+  *data = NULL;
+  return 1;
+}
@@ -1,5 +1,7 @@
 /**
- * Definition of the NIFTI-1 header format:
+ * Definition of the NIFTI-1 header format, and functions for reading
+ * NIFTI-1 headers and single file (.nii, or gzip compressed .nii.gz)
+ * images:
  *   http://nifti.nimh.nih.gov/nifti-1
  *
  * Based on the header file 'nifti1.h', written by Bob Cox, 
@@ -101,4 +103,29 @@ uint8_t nifti1_to_analyze(
   dsr_t        *ahdr  /**< pointer to ANALYZE75 header to write */
 );
 
+/**
+ * \return 1 if the given file name has a single file NIFTI-1 suffix (.nii
+ * or .nii.gz), 0 otherwise.
+ */
+uint8_t nifti1_is_single_file(
+  char *filename /**< file name to check */
+);
+
+/**
+ * Loads a single file NIFTI-1 image (.nii, or .nii.gz). The header is
+ * converted to an ANALYZE75 header (see nifti1_to_analyze), and the image
+ * data is streamed from the file, being decompressed on the fly if the
+ * file is compressed, straight into a newly allocated buffer, which the
+ * caller is responsible for freeing. As with ANALYZE75 images, the data is
+ * left in the byte order of the file (see dsr_t.rev), and any intensity
+ * scaling (scl_slope/scl_inter) is not applied.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t nifti1_load(
+  char     *filename, /**< file to read                        */
+  dsr_t    *hdr,      /**< place to store the converted header */
+  uint8_t **data      /**< place to store the image data       */
+);
+
 #endif
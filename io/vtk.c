@@ -1,32 +1,85 @@
 /**
  * Print a graph in VTK format.
- * 
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
- */ 
+ */
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "graph/graph.h"
+#include "util/outbuf.h"
 
 #include "io/vtk.h"
 
+/**
+ * \return the number of lines to be written for the graph edges, i.e. the
+ * number of edges (u, v) where u < v.
+ */
+static uint64_t _num_lines(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Writes the given graph in the XML PolyData format.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _print_xml(
+  FILE     *f,        /**< file handle                           */
+  graph_t  *g,        /**< the graph                             */
+  uint8_t   nodes,    /**< non-0 to include nodes and scalars    */
+  uint8_t   edges,    /**< non-0 to include edges                */
+  uint8_t   nscalars, /**< number of scalar arrays               */
+  char    **names,    /**< scalar names                          */
+  double  **scalars   /**< scalar arrays                         */
+);
+
+/**
+ * Writes an XML DataArray element, for an array in the appended data
+ * section, and advances the offset past the array.
+ */
+static void _xml_array(
+  outbuf_t *ob,     /**< the stream                                    */
+  char     *type,   /**< VTK data type                                 */
+  char     *name,   /**< array name, or NULL                           */
+  uint8_t   ncomps, /**< number of components                          */
+  uint64_t  nbytes, /**< size of the array data                        */
+  uint64_t *offset  /**< offset of the array in the appended data      */
+);
+
+/**
+ * Writes the given string, escaping any XML special characters.
+ */
+static void _xml_str(
+  outbuf_t *ob, /**< the stream      */
+  char     *str /**< string to write */
+);
+
 uint8_t vtk_print_graph(
-  FILE    *f,
-  graph_t *g,
-  uint8_t  nscalars,
-  char   **scalar_names,
-  double **scalars
+  FILE        *f,
+  graph_t     *g,
+  vtk_format_t fmt,
+  uint8_t      nodes,
+  uint8_t      edges,
+  uint8_t      nscalars,
+  char       **scalar_names,
+  double     **scalars
 )
 {
   uint8_t  i;
 
-  if (vtk_print_hdr(  f, g)) goto fail;
-  if (vtk_print_nodes(f, g)) goto fail;
-  if (vtk_print_edges(f, g)) goto fail;
+  if (fmt == VTK_XML)
+    return _print_xml(f, g, nodes, edges, nscalars, scalar_names, scalars);
 
-  for (i = 0; i < nscalars; i++) {
-    if (vtk_print_node_scalar(f, g, i == 0, scalar_names[i], scalars[i]))
+  if (          vtk_print_hdr(  f, g, fmt)) goto fail;
+  if (nodes  && vtk_print_nodes(f, g, fmt)) goto fail;
+  if (edges  && vtk_print_edges(f, g, fmt)) goto fail;
+
+  for (i = 0; nodes && i < nscalars; i++) {
+    if (vtk_print_node_scalar(
+          f, g, fmt, i == 0, scalar_names[i], scalars[i]))
       goto fail;
   }
 
@@ -36,69 +89,128 @@ fail:
   return 1;
 }
 
-uint8_t vtk_print_hdr(FILE *f, graph_t *g) {
+uint8_t vtk_print_hdr(FILE *f, graph_t *g, vtk_format_t fmt) {
 
   uint64_t       i;
   uint32_t       npoints;
   graph_label_t *label;
+  outbuf_t       ob;
+
+  memset(&ob, 0, sizeof(outbuf_t));
+
+  if (fmt == VTK_XML)           goto fail;
+  if (outbuf_create(&ob, f, 0)) goto fail;
 
   npoints = graph_num_nodes(g);
 
-  if (fprintf(f, "# vtk DataFile Version 3.0\n") < 0) goto fail;
-  if (fprintf(f, "cvtk graph\n")                 < 0) goto fail;
-  if (fprintf(f, "ASCII\n")                      < 0) goto fail;
-  if (fprintf(f, "DATASET POLYDATA\n")           < 0) goto fail;
-  if (fprintf(f, "POINTS %u FLOAT\n", npoints)   < 0) goto fail;
+  outbuf_str(&ob, "# vtk DataFile Version 3.0\n");
+  outbuf_str(&ob, "cvtk graph\n");
+  outbuf_str(&ob, (fmt == VTK_BINARY) ? "BINARY\n" : "ASCII\n");
+  outbuf_str(&ob, "DATASET POLYDATA\n");
+  outbuf_str(&ob, "POINTS ");
+  outbuf_u64(&ob, npoints);
+  outbuf_str(&ob, " FLOAT\n");
 
   for (i = 0; i < npoints; i++) {
 
     label = graph_get_nodelabel(g, i);
     if (label == NULL) goto fail;
 
-    if (fprintf(f, "%0.6f %0.6f %0.6f\n", 
-        label->xval,
-        label->yval,
-        label->zval) < 0) goto fail;
+    if (fmt == VTK_BINARY) {
+      outbuf_be32(&ob, &label->xval);
+      outbuf_be32(&ob, &label->yval);
+      outbuf_be32(&ob, &label->zval);
+    }
+    else {
+      outbuf_fixed(&ob, label->xval, 6);
+      outbuf_char( &ob, ' ');
+      outbuf_fixed(&ob, label->yval, 6);
+      outbuf_char( &ob, ' ');
+      outbuf_fixed(&ob, label->zval, 6);
+      outbuf_char( &ob, '\n');
+    }
   }
- 
+
+  if (fmt == VTK_BINARY) outbuf_char(&ob, '\n');
+
+  if (outbuf_flush(&ob)) goto fail;
+
+  outbuf_free(&ob);
   return 0;
 
 fail:
+  outbuf_free(&ob);
   return 1;
 }
 
-uint8_t vtk_print_nodes(FILE *f, graph_t *g) {
+uint8_t vtk_print_nodes(FILE *f, graph_t *g, vtk_format_t fmt) {
 
   uint32_t i;
   uint32_t npoints;
-  
+  int32_t  val;
+  outbuf_t ob;
+
+  memset(&ob, 0, sizeof(outbuf_t));
+
+  if (fmt == VTK_XML)           goto fail;
+  if (outbuf_create(&ob, f, 0)) goto fail;
+
   npoints = graph_num_nodes(g);
 
-  if (fprintf(f, "VERTICES %u %u\n", npoints, npoints*2) < 0) goto fail;
+  outbuf_str(&ob, "VERTICES ");
+  outbuf_u64(&ob, npoints);
+  outbuf_char(&ob, ' ');
+  outbuf_u64(&ob, (uint32_t)(npoints*2));
+  outbuf_char(&ob, '\n');
 
   for (i = 0; i < npoints; i++) {
 
-    if (fprintf(f, "1 %u\n", i) < 0) goto fail;
-  } 
+    if (fmt == VTK_BINARY) {
+      val = 1; outbuf_be32(&ob, &val);
+      val = i; outbuf_be32(&ob, &val);
+    }
+    else {
+      outbuf_str( &ob, "1 ");
+      outbuf_u64( &ob, i);
+      outbuf_char(&ob, '\n');
+    }
+  }
+
+  if (fmt == VTK_BINARY) outbuf_char(&ob, '\n');
+
+  if (outbuf_flush(&ob)) goto fail;
 
+  outbuf_free(&ob);
   return 0;
 
 fail:
+  outbuf_free(&ob);
   return 1;
 }
 
-uint8_t vtk_print_edges(FILE *f, graph_t *g) {
+uint8_t vtk_print_edges(FILE *f, graph_t *g, vtk_format_t fmt) {
 
   uint32_t  i;
   uint32_t  j;
   uint32_t  nlines;
   uint32_t  npoints;
   uint32_t *nbrs;
+  int32_t   val;
+  outbuf_t  ob;
+
+  memset(&ob, 0, sizeof(outbuf_t));
+
+  if (fmt == VTK_XML)           goto fail;
+  if (outbuf_create(&ob, f, 0)) goto fail;
 
   npoints = graph_num_nodes(g);
-  nlines  = graph_num_edges(g);
+  nlines  = _num_lines(g);
 
-  if (fprintf(f, "LINES %u %u\n", nlines, nlines*3) < 0) goto fail;
+  outbuf_str(&ob, "LINES ");
+  outbuf_u64(&ob, nlines);
+  outbuf_char(&ob, ' ');
+  outbuf_u64(&ob, (uint32_t)(nlines*3));
+  outbuf_char(&ob, '\n');
 
   for (i = 0; i < npoints; i++) {
 
@@ -109,41 +221,288 @@ uint8_t vtk_print_edges(FILE *f, graph_t *g) {
 
       if (nbrs[j] <= i) continue;
 
-      if (fprintf(f, "2 %u %u\n", i, nbrs[j]) < 0) goto fail;
+      if (fmt == VTK_BINARY) {
+        val = 2;       outbuf_be32(&ob, &val);
+        val = i;       outbuf_be32(&ob, &val);
+        val = nbrs[j]; outbuf_be32(&ob, &val);
+      }
+      else {
+        outbuf_str( &ob, "2 ");
+        outbuf_u64( &ob, i);
+        outbuf_char(&ob, ' ');
+        outbuf_u64( &ob, nbrs[j]);
+        outbuf_char(&ob, '\n');
+      }
     }
   }
 
+  if (fmt == VTK_BINARY) outbuf_char(&ob, '\n');
+
+  if (outbuf_flush(&ob)) goto fail;
+
+  outbuf_free(&ob);
   return 0;
 
-fail: 
+fail:
+  outbuf_free(&ob);
   return 1;
 }
 
 uint8_t vtk_print_node_scalar(
-  FILE *f, graph_t *g, uint8_t first, char *name, double *data) {
+  FILE        *f,
+  graph_t     *g,
+  vtk_format_t fmt,
+  uint8_t      first,
+  char        *name,
+  double      *data) {
 
   uint32_t i;
   uint32_t len;
+  outbuf_t ob;
+
+  memset(&ob, 0, sizeof(outbuf_t));
+
+  if (fmt == VTK_XML)           goto fail;
+  if (outbuf_create(&ob, f, 0)) goto fail;
 
   len = graph_num_nodes(g);
 
   if (first) {
 
-    if (fprintf(f, "POINT_DATA %u\n",       len)  < 0) goto fail;
-    if (fprintf(f, "SCALARS %s double 1\n", name) < 0) goto fail;
-    if (fprintf(f, "LOOKUP_TABLE default\n")      < 0) goto fail;
+    outbuf_str(&ob, "POINT_DATA ");
+    outbuf_u64(&ob, len);
+    outbuf_str(&ob, "\nSCALARS ");
+    outbuf_str(&ob, name);
+    outbuf_str(&ob, " double 1\n");
+    outbuf_str(&ob, "LOOKUP_TABLE default\n");
   }
   else {
-    if (fprintf(f, "FIELD FieldData 1\n")         < 0) goto fail;
-    if (fprintf(f, "%s 1 %u double\n", name, len) < 0) goto fail;
+    outbuf_str(&ob, "FIELD FieldData 1\n");
+    outbuf_str(&ob, name);
+    outbuf_str(&ob, " 1 ");
+    outbuf_u64(&ob, len);
+    outbuf_str(&ob, " double\n");
   }
 
   for (i = 0; i < len; i++) {
-    if (fprintf(f, "%0.5f\n", data[i]) < 0) goto fail;
+
+    if (fmt == VTK_BINARY) outbuf_be64(&ob, data + i);
+    else {
+      outbuf_fixed(&ob, data[i], 5);
+      outbuf_char( &ob, '\n');
+    }
+  }
+
+  if (fmt == VTK_BINARY) outbuf_char(&ob, '\n');
+
+  if (outbuf_flush(&ob)) goto fail;
+
+  outbuf_free(&ob);
+  return 0;
+
+fail:
+  outbuf_free(&ob);
+  return 1;
+}
+
+uint64_t _num_lines(graph_t *g) {
+
+  uint32_t  i;
+  uint32_t  j;
+  uint32_t  nnbrs;
+  uint32_t  nnodes;
+  uint32_t *nbrs;
+  uint64_t  nlines;
+
+  nnodes = graph_num_nodes(g);
+  nlines = 0;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++)
+      if (nbrs[j] > i) nlines++;
+  }
+
+  return nlines;
+}
+
+uint8_t _print_xml(
+  FILE     *f,
+  graph_t  *g,
+  uint8_t   nodes,
+  uint8_t   edges,
+  uint8_t   nscalars,
+  char    **names,
+  double  **scalars) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       k;
+  uint64_t       nnodes;
+  uint64_t       nverts;
+  uint64_t       nlines;
+  uint64_t       offset;
+  uint64_t       nbytes;
+  uint32_t       nnbrs;
+  uint32_t      *nbrs;
+  int64_t        val;
+  uint16_t       one;
+  graph_label_t *lbl;
+  outbuf_t       ob;
+
+  memset(&ob, 0, sizeof(outbuf_t));
+
+  if (outbuf_create(&ob, f, 0)) goto fail;
+
+  one    = 1;
+  offset = 0;
+  nnodes = graph_num_nodes(g);
+  nverts = nodes ? nnodes        : 0;
+  nlines = edges ? _num_lines(g) : 0;
+
+  if (!nodes) nscalars = 0;
+
+  outbuf_str(&ob, "<?xml version=\"1.0\"?>\n");
+  outbuf_str(&ob, "<VTKFile type=\"PolyData\" version=\"1.0\" byte_order=\"");
+  outbuf_str(&ob, (*(uint8_t *)&one) ? "LittleEndian" : "BigEndian");
+  outbuf_str(&ob, "\" header_type=\"UInt64\">\n");
+  outbuf_str(&ob, "<PolyData>\n");
+  outbuf_str(&ob, "<Piece NumberOfPoints=\"");
+  outbuf_u64(&ob, nnodes);
+  outbuf_str(&ob, "\" NumberOfVerts=\"");
+  outbuf_u64(&ob, nverts);
+  outbuf_str(&ob, "\" NumberOfLines=\"");
+  outbuf_u64(&ob, nlines);
+  outbuf_str(&ob, "\" NumberOfStrips=\"0\" NumberOfPolys=\"0\">\n");
+
+  if (nscalars > 0) {
+    outbuf_str(&ob, "<PointData Scalars=\"");
+    _xml_str(  &ob, names[0]);
+    outbuf_str(&ob, "\">\n");
+
+    for (i = 0; i < nscalars; i++)
+      _xml_array(&ob, "Float64", names[i], 1, nnodes * 8, &offset);
+
+    outbuf_str(&ob, "</PointData>\n");
+  }
+
+  outbuf_str(&ob, "<Points>\n");
+  _xml_array(&ob, "Float32", NULL, 3, nnodes * 12, &offset);
+  outbuf_str(&ob, "</Points>\n");
+
+  outbuf_str(&ob, "<Verts>\n");
+  _xml_array(&ob, "Int64", "connectivity", 1, nverts * 8, &offset);
+  _xml_array(&ob, "Int64", "offsets",      1, nverts * 8, &offset);
+  outbuf_str(&ob, "</Verts>\n");
+
+  outbuf_str(&ob, "<Lines>\n");
+  _xml_array(&ob, "Int64", "connectivity", 1, nlines * 16, &offset);
+  _xml_array(&ob, "Int64", "offsets",      1, nlines * 8,  &offset);
+  outbuf_str(&ob, "</Lines>\n");
+
+  outbuf_str(&ob, "</Piece>\n");
+  outbuf_str(&ob, "</PolyData>\n");
+  outbuf_str(&ob, "<AppendedData encoding=\"raw\">\n_");
+
+  /*arrays are written in the order in which they were declared above*/
+  for (i = 0; i < nscalars; i++) {
+    nbytes = nnodes * 8;
+    outbuf_bytes(&ob, &nbytes,    sizeof(nbytes));
+    outbuf_bytes(&ob, scalars[i], nbytes);
+  }
+
+  nbytes = nnodes * 12;
+  outbuf_bytes(&ob, &nbytes, sizeof(nbytes));
+  for (i = 0; i < nnodes; i++) {
+    lbl = graph_get_nodelabel(g, i);
+    outbuf_bytes(&ob, &lbl->xval, sizeof(float));
+    outbuf_bytes(&ob, &lbl->yval, sizeof(float));
+    outbuf_bytes(&ob, &lbl->zval, sizeof(float));
+  }
+
+  nbytes = nverts * 8;
+  outbuf_bytes(&ob, &nbytes, sizeof(nbytes));
+  for (val = 0; val < nverts; val++) outbuf_bytes(&ob, &val, sizeof(val));
+
+  outbuf_bytes(&ob, &nbytes, sizeof(nbytes));
+  for (val = 1; val <= nverts; val++) outbuf_bytes(&ob, &val, sizeof(val));
+
+  nbytes = nlines * 16;
+  outbuf_bytes(&ob, &nbytes, sizeof(nbytes));
+  for (i = 0; edges && i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] <= i) continue;
+
+      val = i;       outbuf_bytes(&ob, &val, sizeof(val));
+      val = nbrs[j]; outbuf_bytes(&ob, &val, sizeof(val));
+    }
+  }
+
+  nbytes = nlines * 8;
+  outbuf_bytes(&ob, &nbytes, sizeof(nbytes));
+  for (k = 1; k <= nlines; k++) {
+    val = 2 * k;
+    outbuf_bytes(&ob, &val, sizeof(val));
   }
 
+  outbuf_str(&ob, "\n</AppendedData>\n");
+  outbuf_str(&ob, "</VTKFile>\n");
+
+  if (outbuf_flush(&ob)) goto fail;
+
+  outbuf_free(&ob);
   return 0;
 
 fail:
+  outbuf_free(&ob);
   return 1;
 }
+
+void _xml_array(
+  outbuf_t *ob,
+  char     *type,
+  char     *name,
+  uint8_t   ncomps,
+  uint64_t  nbytes,
+  uint64_t *offset) {
+
+  outbuf_str(ob, "<DataArray type=\"");
+  outbuf_str(ob, type);
+  outbuf_char(ob, '"');
+
+  if (name != NULL) {
+    outbuf_str(ob, " Name=\"");
+    _xml_str(  ob, name);
+    outbuf_char(ob, '"');
+  }
+
+  outbuf_str(ob, " NumberOfComponents=\"");
+  outbuf_u64(ob, ncomps);
+  outbuf_str(ob, "\" format=\"appended\" offset=\"");
+  outbuf_u64(ob, *offset);
+  outbuf_str(ob, "\"/>\n");
+
+  *offset += sizeof(uint64_t) + nbytes;
+}
+
+void _xml_str(outbuf_t *ob, char *str) {
+
+  for (; *str != '\0'; str++) {
+
+    switch (*str) {
+      case '&':  outbuf_str( ob, "&amp;");  break;
+      case '<':  outbuf_str( ob, "&lt;");   break;
+      case '>':  outbuf_str( ob, "&gt;");   break;
+      case '"':  outbuf_str( ob, "&quot;"); break;
+      default:   outbuf_char(ob, *str);     break;
+    }
+  }
+}
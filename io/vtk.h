@@ -2,15 +2,21 @@
  * Output a graph in VTK format. You can either use vtk_print_graph, which
  * will print out a complete VTK file, or use a combination of the other
  * functions.
- * 
+ *
  * If you choose the latter option, you must call vtk_print_hdr first to print
  * a file header. If you don't, the file will be invalid, and it will be your
  * own fault. You may then optionally print out the nodes and edges, and then,
  * associated node scalars. If you want node scalars, you must print nodes
- * before the scalars.
- * 
+ * before the scalars. The same format must be passed to every function.
+ *
+ * Three formats are supported - the legacy VTK format, in ASCII or in
+ * (big endian) binary, and the XML PolyData format, with all data stored
+ * as raw binary in an appended section. The XML format can only be written
+ * in one go, via vtk_print_graph. All output goes through large buffers,
+ * and values are formatted by hand, so writing is fast for large graphs.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
- */ 
+ */
 #ifndef __VTK_H__
 #define __VTK_H__
 
@@ -19,68 +25,89 @@
 
 #include "graph/graph.h"
 
+/**
+ * Output formats.
+ */
+typedef enum {
+
+  VTK_ASCII  = 0, /**< legacy format, ASCII                          */
+  VTK_BINARY = 1, /**< legacy format, big endian binary              */
+  VTK_XML    = 2  /**< XML PolyData format (.vtp), raw appended data */
+
+} vtk_format_t;
+
 /**
  * Writes the given graph as a VTK POLYDATA type, to the given file handle.
  * This function will output a complete, valid VTK file, with node scalar
  * data, by calling the other functions defined in this file. If you want to
- * do something more complex, use the other functions directly. 
+ * do something more complex, use the other functions directly (unless you
+ * want XML output).
  *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t vtk_print_graph(
-  FILE    *fout,         /**< output handle to write to            */
-  graph_t *graph,        /**< the graph to print                   */
-  uint8_t  nscalars,     /**< number of scalar arrays              */
-  char   **scalar_names, /**< names of node scalar data - 
-                              must have length nscalars            */
-  double **scalars       /**< list of scalar arrays - must have 
-                              length nscalars, with each entry 
-                              having length graph_num_nodes(graph) */
+  FILE        *fout,         /**< output handle to write to            */
+  graph_t     *graph,        /**< the graph to print                   */
+  vtk_format_t fmt,          /**< output format                        */
+  uint8_t      nodes,        /**< non-0 to include the nodes, and node
+                                  scalars                              */
+  uint8_t      edges,        /**< non-0 to include the edges           */
+  uint8_t      nscalars,     /**< number of scalar arrays              */
+  char       **scalar_names, /**< names of node scalar data -
+                                  must have length nscalars            */
+  double     **scalars       /**< list of scalar arrays - must have
+                                  length nscalars, with each entry
+                                  having length graph_num_nodes(graph) */
 );
 
 /**
- * Print the file header and polygon points.
+ * Print the file header and polygon points, in a legacy format.
  *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t vtk_print_hdr(
-  FILE    *f, /**< file handle */
-  graph_t *g  /**< the graph   */
+  FILE        *f,  /**< file handle                      */
+  graph_t     *g,  /**< the graph                        */
+  vtk_format_t fmt /**< VTK_ASCII or VTK_BINARY          */
 );
 
 /**
- * Print the graph nodes.
+ * Print the graph nodes, in a legacy format.
  *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t vtk_print_nodes(
-  FILE    *f, /**< file handle */
-  graph_t *g  /**< the graph   */
+  FILE        *f,  /**< file handle                      */
+  graph_t     *g,  /**< the graph                        */
+  vtk_format_t fmt /**< VTK_ASCII or VTK_BINARY          */
 );
 
 /**
- * Print the graph edges.
+ * Print the graph edges, in a legacy format.
  *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t vtk_print_edges(
-  FILE    *f, /**< file handle */
-  graph_t *g  /**< the graph   */
+  FILE        *f,  /**< file handle                      */
+  graph_t     *g,  /**< the graph                        */
+  vtk_format_t fmt /**< VTK_ASCII or VTK_BINARY          */
 );
 
 /**
- * Print the given node scalar data.
+ * Print the given node scalar data, in a legacy format.
  *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t vtk_print_node_scalar(
-  FILE    *f,     /**< file handle                                       */
-  graph_t *g,     /**< the graph                                         */
-  uint8_t  first, /**< pass in non-0 if this is the first scalar to be
-                       printed, 0 otherwise. If you don't, it's your
-                       own fault                                         */
-  char    *name,  /**< scalar name                                       */
-  double  *data   /**< scalar data, must be graph_num_nodes(g) in length */
+  FILE        *f,     /**< file handle                                   */
+  graph_t     *g,     /**< the graph                                     */
+  vtk_format_t fmt,   /**< VTK_ASCII or VTK_BINARY                       */
+  uint8_t      first, /**< pass in non-0 if this is the first scalar to
+                           be printed, 0 otherwise. If you don't, it's
+                           your own fault                                */
+  char        *name,  /**< scalar name                                   */
+  double      *data   /**< scalar data, must be graph_num_nodes(g) in
+                           length                                        */
 );
 
 
@@ -1,6 +1,8 @@
 /**
  * Update the node labels in a ngdb file. The new label values are taken the
- * corresponding voxel value in a specified 3D ANALYZE75 image file.
+ * corresponding voxel value in a specified 3D ANALYZE75 image file. If the
+ * input and output files are the same, the node data sections of the file
+ * are updated in place, rather than the whole file being rewritten.
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com> 
  */
@@ -14,9 +16,15 @@
 
 #include "graph/graph.h"
 #include "util/startup.h"
+#include "io/ngdb.h"
 #include "io/analyze75.h"
 #include "io/ngdb_graph.h"
 
+/**
+ * Number of node labels updated at a time by _relabel_inplace.
+ */
+#define CHUNK_NODES 65536
+
 typedef struct _args {
   char   *input;
   char   *output;
@@ -59,6 +67,18 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * Updates the node labels of the given ngdb file in place.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _relabel_inplace(
+  char    *fname, /**< ngdb file to update                */
+  dsr_t   *hdr,   /**< label image header                 */
+  uint8_t *img,   /**< label image data                   */
+  uint8_t  real   /**< node coordinates are in real units */
+);
+
 int main(int argc, char *argv[]) {
 
   graph_t     g;
@@ -71,13 +91,23 @@ int main(int argc, char *argv[]) {
 
   startup("labelngdb", argc, argv, &argp, &args);
 
-  if (ngdb_read(args.input, &g)) {
-    printf("error openineg input file %s\n", args.input);
+  if (analyze_load(args.labelf, &hdr, &img)) {
+    printf("error opening label file %s\n", args.labelf);
     goto fail;
   }
 
-  if (analyze_load(args.labelf, &hdr, &img)) {
-    printf("error opening label file %s\n", args.labelf);
+  if (!strcmp(args.input, args.output)) {
+
+    if (_relabel_inplace(args.input, &hdr, img, args.real)) {
+      printf("error relabelling %s in place\n", args.input);
+      goto fail;
+    }
+
+    return 0;
+  }
+
+  if (ngdb_read(args.input, &g)) {
+    printf("error openineg input file %s\n", args.input);
     goto fail;
   }
 
@@ -97,3 +127,55 @@ int main(int argc, char *argv[]) {
 fail:
   return 1;
 }
+
+uint8_t _relabel_inplace(char *fname, dsr_t *hdr, uint8_t *img, uint8_t real) {
+
+  uint64_t      i;
+  uint32_t      start;
+  uint32_t      n;
+  uint32_t      nnodes;
+  ngdb_t       *ngdb;
+  ngdb_label_t *lbls;
+
+  ngdb = NULL;
+  lbls = NULL;
+
+  ngdb = ngdb_open_update(fname);
+  if (ngdb == NULL) goto fail;
+
+  if (ngdb_node_data_len(ngdb) != sizeof(ngdb_label_t)) goto fail;
+
+  lbls = malloc(CHUNK_NODES*sizeof(ngdb_label_t));
+  if (lbls == NULL) goto fail;
+
+  nnodes = ngdb_num_nodes(ngdb);
+
+  for (start = 0; start < nnodes; start += n) {
+
+    n = nnodes - start;
+    if (n > CHUNK_NODES) n = CHUNK_NODES;
+
+    if (ngdb_nodes_get_data(ngdb, start, n, (uint8_t *)lbls)) goto fail;
+
+    for (i = 0; i < n; i++) {
+      if (graph_relabel_label(&(lbls[i].label), hdr, img, real)) goto fail;
+    }
+
+    if (ngdb_nodes_set_data(ngdb, start, n, (uint8_t *)lbls)) goto fail;
+  }
+
+  free(lbls);
+  lbls = NULL;
+
+  if (ngdb_close(ngdb)) {
+    ngdb = NULL;
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  if (ngdb != NULL) ngdb_close(ngdb);
+  if (lbls != NULL) free(lbls);
+  return 1;
+}
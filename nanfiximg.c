@@ -1,5 +1,7 @@
 /**
- * Replaces NaN values with zeros, in a 3D image.
+ * Replaces NaN values with zeros, in a 3D image. With the -i flag, the
+ * image file is modified in place; it is mapped into memory, so only the
+ * pages which contain NaNs are written back to it.
  *
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com> 
@@ -14,19 +16,86 @@
 
 #include "io/analyze75.h"
 #include "util/startup.h"
+#include "util/parallel.h"
+
+/**
+ * Number of values which are checked at a time.
+ */
+#define _NANFIX_CHUNK 65536
+
+/**
+ * Context passed to _nanfix_vals.
+ */
+typedef struct _nanfix_ctx {
+
+  dsr_t    *hdr;   /**< image header                        */
+  uint8_t  *img;   /**< image data                          */
+  uint32_t *nnans; /**< number of NaNs replaced, per thread */
+
+} nanfix_ctx_t;
 
 static uint8_t _nanfix(dsr_t *hdr, uint8_t *img); 
 
+/**
+ * Replaces NaN values in the given image file itself.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _nanfix_inplace(
+  char *filename /**< image file */
+);
+
+/**
+ * parallel_for function which replaces NaNs in a range of values.
+ *
+ * \return 0.
+ */
+static uint8_t _nanfix_inplace(char *filename) {
+
+  dsr_t    hdr;
+  uint8_t *img;
+
+  if (analyze_load_mmap(
+        filename, &hdr, &img, ANALYZE_MAP_SEQUENTIAL | ANALYZE_MAP_SHARED)) {
+    printf("error mapping %s\n", filename);
+    goto fail;
+  }
+
+  if (_nanfix(&hdr, img)) {
+    printf("error fixing nan values\n");
+    analyze_unmap(&hdr, img);
+    goto fail;
+  }
+
+  analyze_unmap(&hdr, img);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _nanfix_vals(
+  uint64_t  start,  /**< first value              */
+  uint64_t  end,    /**< one past last value      */
+  uint16_t  thread, /**< calling thread           */
+  void     *ctx     /**< pointer to nanfix_ctx_t  */
+);
+
 int main(int argc, char *argv[]) {
 
   dsr_t    hdr;
   uint8_t *img;
   uint16_t datatype;
 
+  img = NULL;
+
   startup("nanfiximg", argc, argv, NULL, NULL);
 
+  if (argc == 3 && !strcmp(argv[1], "-i")) return _nanfix_inplace(argv[2]);
+
   if (argc != 3) {
-    printf("usage: nanfiximg infile outfile\n");
+    printf("usage: nanfiximg infile outfile\n"\
+           "       nanfiximg -i file\n");
     goto fail;
   }
 
@@ -66,24 +135,45 @@ int main(int argc, char *argv[]) {
 }
 
 uint8_t _nanfix(dsr_t *hdr, uint8_t *img) {
-  
-  uint32_t i;
-  double   val;
-  uint32_t nvals;
 
-  nvals   = analyze_num_vals(hdr);
+  uint16_t     i;
+  uint16_t     nthreads;
+  uint32_t     nnan;
+  nanfix_ctx_t ctx;
 
-  uint32_t nnan = 0;
+  nthreads = parallel_num_threads();
+  if (nthreads > PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
 
-  for (i = 0; i < nvals; i++) {
+  ctx.hdr   = hdr;
+  ctx.img   = img;
+  ctx.nnans = calloc(nthreads, sizeof(uint32_t));
+  if (ctx.nnans == NULL) goto fail;
 
-    val = analyze_read_by_idx(hdr, img, i);
-    if (isnan(val)) {val = 0; nnan++;}
+  if (parallel_for(nthreads,
+                   analyze_num_vals(hdr),
+                   _NANFIX_CHUNK,
+                   &ctx,
+                   _nanfix_vals))
+    goto fail;
 
-    analyze_write_by_idx(hdr, img, i, val);
-  }
+  for (nnan = 0, i = 0; i < nthreads; i++) nnan += ctx.nnans[i];
 
   printf("nnan: %u\n", nnan);
 
+  free(ctx.nnans);
+  return 0;
+
+fail:
+  if (ctx.nnans != NULL) free(ctx.nnans);
+  return 1;
+}
+
+uint8_t _nanfix_vals(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  nanfix_ctx_t *c = ctx;
+
+  c->nnans[thread] +=
+    analyze_nanfix_block(c->hdr, c->img, start, end - start, 0);
+
   return 0;
 }
@@ -19,15 +19,41 @@
 #include "io/analyze75.h"
 
 
+/**
+ * Node values which can be exported. Several may be selected at once; the
+ * graph is read and the node coordinates are mapped only once, and each
+ * value is written to its own image.
+ */
 typedef enum {
 
-  N2I_DEGREE,
+  N2I_DEGREE = 0,
   N2I_DEGCENT,
   N2I_LBLVAL,
   N2I_CMPNUM,
+  N2I_CLUSTERING,
+  N2I_PATHLENGTH,
+  N2I_LOCEFF,
+  N2I_BETWEENNESS,
+  N2I_CORENESS,
+  N2I_NUM_VALS
 
 } img_val_t;
 
+/**
+ * Output file name suffix for each value, used when more than one value
+ * is exported.
+ */
+static char *_val_names[] = {
+  "degree",
+  "degcent",
+  "lblval",
+  "cmpnum",
+  "clustering",
+  "pathlength",
+  "locefficiency",
+  "betweenness",
+  "coreness"
+};
 
 typedef struct args {
 
@@ -41,24 +67,30 @@ typedef struct args {
   double    zl;
   uint8_t   real;
   uint8_t   rev;
-  img_val_t value;
+  uint16_t  values; /**< bit mask of selected img_val_t values */
 
 } args_t;
 
 static struct argp_option options[] = {
 
-  {"xn",      'x', "INT",   0, "X dimension size"},
-  {"yn",      'y', "INT",   0, "Y dimension size"},
-  {"zn",      'z', "INT",   0, "Z dimension size"},
-  {"xl",      'a', "FLOAT", 0, "X voxel length"},
-  {"yl",      'b', "FLOAT", 0, "Y voxel length"},
-  {"zl",      'c', "FLOAT", 0, "Z voxel length"},
-  {"real",    'e', NULL,    0, "node labels are in real units (default: false)"},
-  {"rev",     'r', NULL,    0, "reverse endianness"},
-  {"degree",  'd', NULL,    0, "output degree values"},
-  {"degcent", 'g', NULL,    0, "output degree centrality values"},
-  {"lblval",  'l', NULL,    0, "output node label value"},
-  {"cmpnum",  'm', NULL,    0, "output component number"},
+  {"xn",          'x', "INT",   0, "X dimension size"},
+  {"yn",          'y', "INT",   0, "Y dimension size"},
+  {"zn",          'z', "INT",   0, "Z dimension size"},
+  {"xl",          'a', "FLOAT", 0, "X voxel length"},
+  {"yl",          'b', "FLOAT", 0, "Y voxel length"},
+  {"zl",          'c', "FLOAT", 0, "Z voxel length"},
+  {"real",        'e', NULL,    0, "node labels are in real units "\
+                                   "(default: false)"},
+  {"rev",         'r', NULL,    0, "reverse endianness"},
+  {"degree",      'd', NULL,    0, "output degree values"},
+  {"degcent",     'g', NULL,    0, "output degree centrality values"},
+  {"lblval",      'l', NULL,    0, "output node label value"},
+  {"cmpnum",      'm', NULL,    0, "output component number"},
+  {"clustering",  'k', NULL,    0, "output clustering coefficient"},
+  {"pathlength",  'p', NULL,    0, "output characteristic path length"},
+  {"loceff",      'f', NULL,    0, "output local efficiency"},
+  {"betweenness", 'n', NULL,    0, "output betweenness centrality"},
+  {"coreness",    'o', NULL,    0, "output core number"},
   {0}
 };
 
@@ -67,18 +99,23 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   args_t *a = state->input;
 
   switch (key) {
-    case 'x': a->xn    = atoi(arg);   break;
-    case 'y': a->yn    = atoi(arg);   break;
-    case 'z': a->zn    = atoi(arg);   break;
-    case 'a': a->xl    = atof(arg);   break;
-    case 'b': a->yl    = atof(arg);   break;
-    case 'c': a->zl    = atof(arg);   break;
-    case 'e': a->real  = 1;           break;
-    case 'r': a->rev   = 1;           break;
-    case 'd': a->value = N2I_DEGREE;  break;
-    case 'g': a->value = N2I_DEGCENT; break;
-    case 'l': a->value = N2I_LBLVAL;  break;
-    case 'm': a->value = N2I_CMPNUM;  break;
+    case 'x': a->xn      = atoi(arg);             break;
+    case 'y': a->yn      = atoi(arg);             break;
+    case 'z': a->zn      = atoi(arg);             break;
+    case 'a': a->xl      = atof(arg);             break;
+    case 'b': a->yl      = atof(arg);             break;
+    case 'c': a->zl      = atof(arg);             break;
+    case 'e': a->real    = 1;                     break;
+    case 'r': a->rev     = 1;                     break;
+    case 'd': a->values |= 1 << N2I_DEGREE;       break;
+    case 'g': a->values |= 1 << N2I_DEGCENT;      break;
+    case 'l': a->values |= 1 << N2I_LBLVAL;       break;
+    case 'm': a->values |= 1 << N2I_CMPNUM;       break;
+    case 'k': a->values |= 1 << N2I_CLUSTERING;   break;
+    case 'p': a->values |= 1 << N2I_PATHLENGTH;   break;
+    case 'f': a->values |= 1 << N2I_LOCEFF;       break;
+    case 'n': a->values |= 1 << N2I_BETWEENNESS;  break;
+    case 'o': a->values |= 1 << N2I_CORENESS;     break;
       
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) a->input  = arg;
@@ -97,31 +134,74 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 }
 
 static char doc[] = "ngdb2img - convert a spatially annotated "\
-                    "ngdb file to an ANALYZE75 image file";
+                    "ngdb file to an ANALYZE75 image file\v"\
+                    "If more than one node value is selected, each is "\
+                    "written to OUTPUT_<value>.";
 
 
 static void _fill_hdr(
   dsr_t  *dsr,
   args_t *args);
 
-static uint8_t _graph_to_img(
-  graph_t  *g,
-  dsr_t    *dsr,
-  uint8_t  *img,
-  uint8_t   real,
-  img_val_t val
+/**
+ * Calculates the image index of every node, from the node label
+ * coordinates. Nodes which lie outside of the image are given the index
+ * UINT32_MAX.
+ */
+static void _map_nodes(
+  graph_t  *g,    /**< the graph                            */
+  dsr_t    *hdr,  /**< image header                         */
+  uint8_t   real, /**< non-0 if coordinates are in real units */
+  uint32_t *vidx  /**< place to store the node image indices */
+);
+
+/**
+ * Calculates the given value for every node.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _node_vals(
+  graph_t  *g,       /**< the graph                     */
+  img_val_t valtype, /**< value to calculate            */
+  double   *vals,    /**< place to store the node values */
+  uint32_t *uvals    /**< workspace, one per node        */
+);
+
+/**
+ * Writes the given node values into the image, at the given node indices.
+ * If several nodes map to the same voxel, the last one is written.
+ */
+static void _graph_to_img(
+  dsr_t    *hdr,    /**< image header                      */
+  uint8_t  *img,    /**< image data, cleared to 0 first    */
+  uint32_t  nnodes, /**< number of nodes                   */
+  uint32_t *vidx,   /**< image index of each node          */
+  double   *vals    /**< value of each node                */
 );
 
 
 int main(int argc, char *argv[]) {
 
+  uint16_t    i;
+  uint16_t    nvals;
   graph_t     gin;
   dsr_t       hdr;
   uint8_t    *img;
-  uint32_t    nbytes;
+  uint32_t   *vidx;
+  uint32_t   *uvals;
+  double     *vals;
+  char       *outf;
+  uint32_t    nnodes;
+  uint64_t    nbytes;
   args_t      args;
   struct argp argp = {options, _parse_opt, "INPUT OUTPUT", doc};
 
+  img   = NULL;
+  vidx  = NULL;
+  uvals = NULL;
+  vals  = NULL;
+  outf  = NULL;
+
   memset(&args, 0, sizeof(args_t));
   
   args.xn = 64;
@@ -133,6 +213,11 @@ int main(int argc, char *argv[]) {
 
   startup("ngdb2img", argc, argv, &argp, &args);
 
+  if (args.values == 0) args.values = 1 << N2I_DEGREE;
+
+  for (nvals = 0, i = 0; i < N2I_NUM_VALS; i++)
+    if (args.values & (1 << i)) nvals++;
+
   if (ngdb_read(args.input, &gin)) {
     printf("Could not read in %s\n", args.input);
     goto fail;
@@ -142,37 +227,65 @@ int main(int argc, char *argv[]) {
 
   _fill_hdr(&hdr, &args);
 
-  nbytes = analyze_value_size(&hdr)*analyze_num_vals(& hdr);
+  nnodes = graph_num_nodes(&gin);
+  nbytes = (uint64_t)analyze_value_size(&hdr)*analyze_num_vals(& hdr);
 
-  img = calloc(1, nbytes);
-  if (img == NULL) {
-    printf("calloc fail!?\n");
-    goto fail;
-  }
+  img   = malloc(nbytes);
+  vidx  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  uvals = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  vals  = malloc(((uint64_t)nnodes + 1) * sizeof(double));
+  outf  = malloc(strlen(args.output) + 20);
 
-  if (_graph_to_img(&gin, &hdr, img, args.real, args.value)) {
-    printf("Could not convert graph to image\n");
+  if (img == NULL || vidx == NULL || uvals == NULL ||
+      vals == NULL || outf == NULL) {
+    printf("malloc fail!?\n");
     goto fail;
   }
 
-  if (analyze_write_hdr(args.output, &hdr)) {
-    printf("Error writing header %s\n", args.output);
-    goto fail;
-  }
+  _map_nodes(&gin, &hdr, args.real, vidx);
 
-  if (analyze_write_img(args.output, &hdr, img)) {
-    printf("Error writing image %s\n", args.output);
-    goto fail;
+  for (i = 0; i < N2I_NUM_VALS; i++) {
+
+    if (!(args.values & (1 << i))) continue;
+
+    if (nvals == 1) strcpy( outf, args.output);
+    else            sprintf(outf, "%s_%s", args.output, _val_names[i]);
+
+    if (_node_vals(&gin, i, vals, uvals)) {
+      printf("Could not calculate node %s values\n", _val_names[i]);
+      goto fail;
+    }
+
+    memset(img, 0, nbytes);
+    _graph_to_img(&hdr, img, nnodes, vidx, vals);
+
+    if (analyze_write_hdr(outf, &hdr)) {
+      printf("Error writing header %s\n", outf);
+      goto fail;
+    }
+
+    if (analyze_write_img(outf, &hdr, img)) {
+      printf("Error writing image %s\n", outf);
+      goto fail;
+    }
   }
 
   free(img);
+  free(vidx);
+  free(uvals);
+  free(vals);
+  free(outf);
   return 0;
 
 fail:
+  if (img   != NULL) free(img);
+  if (vidx  != NULL) free(vidx);
+  if (uvals != NULL) free(uvals);
+  if (vals  != NULL) free(vals);
+  if (outf  != NULL) free(outf);
   return 1;
 }
 
-
 static void _fill_hdr(dsr_t *dsr, args_t *args) {
 
   memset(dsr, 0, sizeof(dsr_t));
@@ -199,58 +312,130 @@ static void _fill_hdr(dsr_t *dsr, args_t *args) {
   dsr->rev            = args->rev;
 }
 
-static uint8_t _graph_to_img(
-  graph_t *g, dsr_t *hdr, uint8_t *img, uint8_t real, img_val_t valtype) {
+void _map_nodes(graph_t *g, dsr_t *hdr, uint8_t real, uint32_t *vidx) {
 
   uint64_t       i;
   uint32_t       nnodes;
   graph_label_t *lbl;
+  double         x, y, z;
+  double         xs, ys, zs;
+  double         xn, yn, zn;
 
-  double xl;
-  double yl;
-  double zl;
-  float  val;
-  uint32_t uval;
-
-  uint32_t imgi[4];
-
-  memset(imgi, 0, sizeof(imgi));
+  nnodes = graph_num_nodes(g);
 
-  xl = analyze_pixdim_size(hdr, 0);
-  yl = analyze_pixdim_size(hdr, 1);
-  zl = analyze_pixdim_size(hdr, 2);
+  xn = analyze_dim_size(hdr, 0);
+  yn = analyze_dim_size(hdr, 1);
+  zn = analyze_dim_size(hdr, 2);
 
-  nnodes = graph_num_nodes(g);
+  xs = real ? 1.0 / analyze_pixdim_size(hdr, 0) : 1;
+  ys = real ? 1.0 / analyze_pixdim_size(hdr, 1) : 1;
+  zs = real ? 1.0 / analyze_pixdim_size(hdr, 2) : 1;
 
+  /*
+   * Real coordinates are rounded to the nearest voxel; 
+   * voxel coordinates are truncated. The loop has no 
+   * calls, so that the compiler can vectorise it.
+   */
   for (i = 0; i < nnodes; i++) {
 
-    lbl = graph_get_nodelabel(    g, i);
-
-    switch (valtype) {
-      case N2I_DEGREE:  val = stats_degree           (g, i); break;
-      case N2I_DEGCENT: val = stats_degree_centrality(g, i); break;
-      case N2I_LBLVAL:  val = lbl->labelval;                 break;
-      case N2I_CMPNUM:
-        stats_cache_node_component(g, i, &uval);
-        val = uval;
-        break;
-      default: return 1;
-    }
+    lbl = graph_get_nodelabel(g, i);
 
-    if (real) {
+    x = lbl->xval * xs;
+    y = lbl->yval * ys;
+    z = lbl->zval * zs;
 
-      imgi[0] = (uint32_t)(round(lbl->xval / xl));
-      imgi[1] = (uint32_t)(round(lbl->yval / yl));
-      imgi[2] = (uint32_t)(round(lbl->zval / zl));
+    if (real) {
+      x = floor(x + 0.5);
+      y = floor(y + 0.5);
+      z = floor(z + 0.5);
     }
     else {
-      imgi[0] = (uint32_t)lbl->xval;
-      imgi[1] = (uint32_t)lbl->yval;
-      imgi[2] = (uint32_t)lbl->zval;
+      x = trunc(x);
+      y = trunc(y);
+      z = trunc(z);
     }
 
-    analyze_write_val(hdr, img, imgi, val);
+    if (!(x >= 0 && x < xn && y >= 0 && y < yn && z >= 0 && z < zn)) {
+      vidx[i] = UINT32_MAX;
+      continue;
+    }
+
+    vidx[i] = (uint32_t)x + ((uint32_t)y + (uint32_t)z * yn) * xn;
+  }
+}
+
+uint8_t _node_vals(
+  graph_t *g, img_val_t valtype, double *vals, uint32_t *uvals) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  switch (valtype) {
+
+    case N2I_DEGREE:
+      for (i = 0; i < nnodes; i++) vals[i] = stats_degree(g, i);
+      break;
+
+    case N2I_DEGCENT:
+      for (i = 0; i < nnodes; i++) vals[i] = stats_degree_centrality(g, i);
+      break;
+
+    case N2I_LBLVAL:
+      for (i = 0; i < nnodes; i++)
+        vals[i] = graph_get_nodelabel(g, i)->labelval;
+      break;
+
+    case N2I_CMPNUM:
+      if (stats_cache_node_component(g, -1, uvals)) goto fail;
+      for (i = 0; i < nnodes; i++) vals[i] = uvals[i];
+      break;
+
+    case N2I_CORENESS:
+      if (stats_cache_node_coreness(g, -1, uvals)) goto fail;
+      for (i = 0; i < nnodes; i++) vals[i] = uvals[i];
+      break;
+
+    case N2I_CLUSTERING:
+      if (stats_cache_node_clustering(g, -1, vals)) goto fail;
+      break;
+
+    case N2I_PATHLENGTH:
+      if (stats_cache_node_pathlength(g, -1, vals)) goto fail;
+      break;
+
+    case N2I_LOCEFF:
+      if (stats_cache_node_local_efficiency(g, -1, vals)) goto fail;
+      break;
+
+    case N2I_BETWEENNESS:
+      if (stats_cache_betweenness_centrality(g, -1, vals)) goto fail;
+      break;
+
+    default: goto fail;
   }
 
   return 0;
+
+fail:
+  return 1;
+}
+
+void _graph_to_img(
+  dsr_t *hdr, uint8_t *img, uint32_t nnodes, uint32_t *vidx, double *vals) {
+
+  uint64_t i;
+  float   *fimg;
+
+  fimg = (float *)img;
+
+  /*the image is always float - write straight into it, unless swapped*/
+  for (i = 0; i < nnodes; i++) {
+
+    if (vidx[i] == UINT32_MAX) continue;
+
+    if (hdr->rev) analyze_write_by_idx(hdr, img, vidx[i], vals[i]);
+    else          fimg[vidx[i]] = vals[i];
+  }
 }
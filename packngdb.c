@@ -0,0 +1,441 @@
+/**
+ * Converts a ngdb file to the compressed (version 3) ngdb format, or back
+ * to the uncompressed (version 2) format. The header, node and reference
+ * data are copied as they are, so any ngdb file may be converted.
+ * Alternately, the graph may be saved as a graph image, which can be
+ * shared between processes (see graph/graph_image.h), as a CSR
+ * interchange file, for other programs to read (see README.CSR), or as a
+ * delta file, which only stores the edges which differ from a base graph
+ * (see io/ngdb_delta.h).
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "io/csr.h"
+#include "io/ngdb.h"
+#include "io/ngdb_delta.h"
+#include "io/ngdb_graph.h"
+#include "graph/graph.h"
+#include "graph/graph_image.h"
+#include "util/startup.h"
+#include "util/suffix.h"
+
+/**
+ * Maximum number of references copied at a time.
+ */
+#define PACK_CHUNK_REFS 1048576
+
+typedef struct _args {
+  char   *input;
+  char   *output;
+  uint8_t uncompress;
+  uint8_t image;
+  uint8_t csr;
+  uint8_t noweights;
+  uint8_t nolabels;
+  char   *delta;
+} args_t;
+
+static char doc[] =
+  "packngdb -- convert a ngdb file to/from the compressed ngdb format";
+
+static struct argp_option options[] = {
+  {"uncompress", 'u', NULL, 0, "write an uncompressed file"},
+  {"image",      'i', NULL, 0, "write a graph image, which other programs "
+                               "can attach to without loading it"},
+  {"csr",        'c', NULL, 0, "write a CSR interchange file"},
+  {"noweights",  'w', NULL, 0, "CSR: do not save edge weights"},
+  {"nolabels",   'l', NULL, 0, "CSR: do not save node labels"},
+  {"delta",      'd', "FILE", 0, "write a delta file, containing the "
+                                 "edges which differ from the given base "
+                                 "file (a relative path is taken to be "
+                                 "relative to the output file)"},
+  {0}
+};
+
+static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
+
+  args_t *args;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'u': args->uncompress = 1; break;
+    case 'i': args->image      = 1; break;
+    case 'c': args->csr        = 1; break;
+    case 'w': args->noweights  = 1; break;
+    case 'l': args->nolabels   = 1; break;
+    case 'd': args->delta      = arg; break;
+
+    case ARGP_KEY_ARG:
+      if      (state->arg_num == 0) args->input  = arg;
+      else if (state->arg_num == 1) args->output = arg;
+      else                          argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num != 2) argp_usage(state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Loads the input file, and writes it to the output as a graph image.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_image(
+  char *input, /**< input file  */
+  char *output /**< output file */
+);
+
+/**
+ * Loads the input file, and writes it to the output as a CSR file, with
+ * the given CSR_FLAG_* sections.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_csr(
+  char    *input,  /**< input file        */
+  char    *output, /**< output file       */
+  uint32_t flags   /**< sections to write */
+);
+
+/**
+ * Loads the input and base files, and writes the difference between them
+ * to the output as a delta file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_delta(
+  char *input,  /**< input file                               */
+  char *base,   /**< base file, relative to the output file   */
+  char *output  /**< output file                              */
+);
+
+/**
+ * Copies the header and node data from the input to the output.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _copy_data(
+  ngdb_t *in, /**< input file  */
+  ngdb_t *out /**< output file */
+);
+
+/**
+ * Copies the references from the input to the output, a range of nodes at
+ * a time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _copy_refs(
+  ngdb_t *in, /**< input file  */
+  ngdb_t *out /**< output file */
+);
+
+int main(int argc, char *argv[]) {
+
+  ngdb_t     *in;
+  ngdb_t     *out;
+  args_t      args;
+  struct argp argp = {options, _parse_opt, "INPUT OUTPUT", doc};
+
+  in  = NULL;
+  out = NULL;
+
+  memset(&args, 0, sizeof(args));
+
+  startup("packngdb", argc, argv, &argp, &args);
+
+  if (args.image) return _write_image(args.input, args.output);
+  if (args.delta) return _write_delta(args.input, args.delta, args.output);
+  if (args.csr)
+    return _write_csr(args.input,
+                      args.output,
+                      (!args.noweights << CSR_FLAG_WEIGHTS) |
+                      (!args.nolabels  << CSR_FLAG_LABELS));
+
+  in = ngdb_open_mmap(args.input);
+  if (in == NULL) in = ngdb_open(args.input);
+  if (in == NULL) {
+    printf("error opening input file %s\n", args.input);
+    goto fail;
+  }
+
+  if (args.uncompress)
+    out = ngdb_create(args.output,
+                      ngdb_num_nodes(    in),
+                      ngdb_hdr_data_len( in),
+                      ngdb_node_data_len(in),
+                      ngdb_ref_data_len( in));
+  else
+    out = ngdb_create_compressed(args.output,
+                                 ngdb_num_nodes(    in),
+                                 ngdb_hdr_data_len( in),
+                                 ngdb_node_data_len(in),
+                                 ngdb_ref_data_len( in));
+
+  if (out == NULL) {
+    printf("error creating output file %s\n", args.output);
+    goto fail;
+  }
+
+  if (_copy_data(in, out)) {
+    printf("error copying header/node data\n");
+    goto fail;
+  }
+
+  if (_copy_refs(in, out)) {
+    printf("error copying references\n");
+    goto fail;
+  }
+
+  if (ngdb_close(out)) {
+    out = NULL;
+    printf("error writing output file %s\n", args.output);
+    goto fail;
+  }
+
+  ngdb_close(in);
+  return 0;
+
+fail:
+  if (in  != NULL) ngdb_close(in);
+  if (out != NULL) ngdb_close(out);
+  return 1;
+}
+
+uint8_t _write_image(char *input, char *output) {
+
+  graph_t g;
+
+  if (ngdb_read(input, &g)) {
+    printf("error reading input file %s\n", input);
+    goto fail;
+  }
+
+  if (graph_freeze(&g)) {
+    printf("error freezing graph\n");
+    goto fail;
+  }
+
+  if (graph_image_write(&g, output)) {
+    printf("error writing output file %s\n", output);
+    goto fail;
+  }
+
+  graph_free(&g);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _write_csr(char *input, char *output, uint32_t flags) {
+
+  graph_t g;
+
+  if (ngdb_read(input, &g)) {
+    printf("error reading input file %s\n", input);
+    goto fail;
+  }
+
+  if (graph_freeze(&g)) {
+    printf("error freezing graph\n");
+    goto fail;
+  }
+
+  if (csr_write(&g, output, flags)) {
+    printf("error writing output file %s\n", output);
+    goto fail;
+  }
+
+  graph_free(&g);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _write_delta(char *input, char *base, char *output) {
+
+  char   *dir;
+  char   *basepath;
+  graph_t g;
+  graph_t b;
+
+  dir      = NULL;
+  basepath = base;
+
+  memset(&g, 0, sizeof(g));
+  memset(&b, 0, sizeof(b));
+
+  /*the base path is stored relative to the output file*/
+  if (base[0] != '/') {
+
+    dir = malloc(strlen(output) + 1);
+    if (dir == NULL) goto fail;
+
+    dirname(output, dir);
+
+    if (dir[0] != '\0') {
+      basepath = join_path(dir, base);
+      if (basepath == NULL) goto fail;
+    }
+  }
+
+  if (ngdb_read(input, &g)) {
+    printf("error reading input file %s\n", input);
+    goto fail;
+  }
+
+  if (ngdb_read(basepath, &b)) {
+    printf("error reading base file %s\n", basepath);
+    goto fail;
+  }
+
+  if (ngdb_delta_write(&b, &g, base, output)) {
+    printf("error writing output file %s - the input and base must have "
+           "the same nodes\n", output);
+    goto fail;
+  }
+
+  graph_free(&g);
+  graph_free(&b);
+  if (basepath != base) free(basepath);
+  if (dir      != NULL) free(dir);
+  return 0;
+
+fail:
+  if (graph_num_nodes(&g) > 0) graph_free(&g);
+  if (graph_num_nodes(&b) > 0) graph_free(&b);
+  if (basepath != base) free(basepath);
+  if (dir      != NULL) free(dir);
+  return 1;
+}
+
+uint8_t _copy_data(ngdb_t *in, ngdb_t *out) {
+
+  uint64_t i;
+  uint16_t hlen;
+  uint16_t nlen;
+  uint8_t *data;
+
+  data = NULL;
+  hlen = ngdb_hdr_data_len( in);
+  nlen = ngdb_node_data_len(in);
+
+  data = malloc(hlen > nlen ? hlen : nlen);
+  if (data == NULL && (hlen > 0 || nlen > 0)) goto fail;
+
+  if (hlen > 0) {
+    if (ngdb_hdr_get_data(in, data))        goto fail;
+    if (ngdb_hdr_set_data(out, data, hlen)) goto fail;
+  }
+
+  for (i = 0; nlen > 0 && i < ngdb_num_nodes(in); i++) {
+    if (ngdb_node_get_data(in,  i, data))       goto fail;
+    if (ngdb_node_set_data(out, i, data, nlen)) goto fail;
+  }
+
+  if (data != NULL) free(data);
+  return 0;
+
+fail:
+  if (data != NULL) free(data);
+  return 1;
+}
+
+uint8_t _copy_refs(ngdb_t *in, ngdb_t *out) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  r;
+  uint64_t  cap;
+  uint64_t  total;
+  uint32_t  n;
+  uint32_t  start;
+  uint32_t  nnodes;
+  uint32_t  nrefs;
+  uint32_t *nnrefs;
+  uint16_t  rlen;
+  uint32_t *refs;
+  uint8_t  *data;
+
+  nnrefs = NULL;
+  refs   = NULL;
+  data   = NULL;
+  cap    = 0;
+  nnodes = ngdb_num_nodes(in);
+  rlen   = ngdb_ref_data_len(in);
+
+  nnrefs = malloc((nnodes+1)*sizeof(uint32_t));
+  if (nnrefs == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    nnrefs[i] = ngdb_node_num_refs(in, i);
+    if (nnrefs[i] == 0xFFFFFFFF) goto fail;
+  }
+
+  for (start = 0; start < nnodes; start += n) {
+
+    /*
+     * copy as many nodes as fit in PACK_CHUNK_REFS
+     * references, and at least one node
+     */
+    total = nnrefs[start];
+    for (n = 1; start + n < nnodes; n++) {
+      if (total + nnrefs[start+n] > PACK_CHUNK_REFS) break;
+      total += nnrefs[start+n];
+    }
+
+    if (total > cap || refs == NULL) {
+
+      cap = total > 0 ? total : 1;
+
+      free(refs);
+      free(data);
+      refs = malloc(cap*sizeof(uint32_t));
+      data = malloc(cap*rlen + 1);
+
+      if (refs == NULL) goto fail;
+      if (data == NULL) goto fail;
+    }
+
+    if (ngdb_nodes_get_all_refs(in, start, n, refs, rlen ? data : NULL))
+      goto fail;
+
+    for (i = start, r = 0; i < (uint64_t)start + n; i++) {
+
+      nrefs = nnrefs[i];
+
+      for (j = 0; j < nrefs; j++, r++) {
+        if (ngdb_add_ref(out, i, refs[r], data + r*rlen, rlen) == 0xFFFFFFFF)
+          goto fail;
+      }
+    }
+  }
+
+  free(nnrefs);
+  if (refs != NULL) free(refs);
+  if (data != NULL) free(data);
+  return 0;
+
+fail:
+  if (nnrefs != NULL) free(nnrefs);
+  if (refs   != NULL) free(refs);
+  if (data   != NULL) free(data);
+  return 1;
+}
@@ -22,13 +22,16 @@ typedef struct _args {
   double   from[MAX_REPLACEMENTS];
   double   to  [MAX_REPLACEMENTS];
   uint16_t nreps;
+  uint8_t  inplace;
 
 } args_t;
 
 static char *doc = "repimg -- replace values in an ANALYZE75 image";
 
 static struct argp_option options[] = {
-  {"rep", 'r', "FLOAT,FLOAT", 0, "replacement (from,to)"},
+  {"rep",     'r', "FLOAT,FLOAT", 0, "replacement (from,to)"},
+  {"inplace", 'i', NULL,          0, "modify the input image in place, "\
+                                     "rather than writing a new image"},
   {0}
 };
 
@@ -78,6 +81,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
   switch (key) {
 
     case 'r': _parse_rep(arg, args); break;
+    case 'i': args->inplace = 0xFF;  break;
 
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) args->input  = arg;
@@ -86,7 +90,7 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
       break;
 
     case ARGP_KEY_END:
-      if (state->arg_num != 2) argp_usage(state);
+      if (state->arg_num != (args->inplace ? 1 : 2)) argp_usage(state);
       break;
 
     default: return ARGP_ERR_UNKNOWN;
@@ -99,12 +103,15 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
  * Replaces values from the 'from' list with values from the 'to' list,
  * in the given image.
  */
-static void _replace(
-  dsr_t   *hdr,   /**< image header                     */
-  uint8_t *img,   /**< image data                       */
-  double  *from,  /**< list of values to replace        */
-  double  *to,    /**< corresponding replacement values */
-  uint16_t nreps  /**< length of from/to lists          */
+/**
+ * Replaces values in the input image file itself. The image is mapped
+ * into memory, so only the pages which contain replaced values are
+ * written back to the file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _replace_inplace(
+  args_t *args /**< program arguments */
 );
 
 int main(int argc, char *argv[]) {
@@ -118,12 +125,15 @@ int main(int argc, char *argv[]) {
 
   startup("repimg", argc, argv, &argp, &args);
 
+  if (args.inplace) return _replace_inplace(&args);
+
   if (analyze_load(args.input, &hdr, &img)) {
     printf("error reading file %s\n", args.input);
     goto fail;
   }
 
-  _replace(&hdr, img, args.from, args.to, args.nreps);
+  analyze_replace_block(
+    &hdr, img, 0, analyze_num_vals(&hdr), args.from, args.to, args.nreps);
 
   if (analyze_write_hdr(args.output, &hdr)) {
     printf("error writing header %s\n", args.output);
@@ -141,27 +151,24 @@ fail:
   return 1;
 }
 
-void _replace(
-  dsr_t *hdr, uint8_t *img, double *from, double *to, uint16_t nreps) {
+uint8_t _replace_inplace(args_t *args) {
 
-  uint64_t i;
-  uint64_t j;
-  uint32_t nvals;
-  double   val;
+  dsr_t    hdr;
+  uint8_t *img;
 
-  nvals = analyze_num_vals(hdr);
-
-  for (i = 0; i < nvals; i++) {
+  if (analyze_load_mmap(
+        args->input, &hdr, &img, ANALYZE_MAP_SEQUENTIAL | ANALYZE_MAP_SHARED)) {
+    printf("error mapping file %s\n", args->input);
+    goto fail;
+  }
 
-    val = analyze_read_by_idx(hdr, img, i);
+  analyze_replace_block(
+    &hdr, img, 0, analyze_num_vals(&hdr), args->from, args->to, args->nreps);
 
-    for (j = 0; j < nreps; j++) {
+  analyze_unmap(&hdr, img);
 
-      if (val == from[j]) {
+  return 0;
 
-        analyze_write_by_idx(hdr, img, i, to[j]);
-        break;
-      }
-    }
-  }
+fail:
+  return 1;
 }
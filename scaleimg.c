@@ -11,8 +11,37 @@
 
 #include "io/analyze75.h"
 #include "util/startup.h"
+#include "util/parallel.h"
 
-static void _scaleimg(dsr_t *hdr, uint8_t *img, double scale);
+/**
+ * Number of values which are scaled at a time.
+ */
+#define _SCALE_CHUNK 65536
+
+/**
+ * Context passed to _scale_vals.
+ */
+typedef struct _scale_ctx {
+
+  dsr_t   *hdr;   /**< image header   */
+  uint8_t *img;   /**< image data     */
+  double   scale; /**< scaling factor */
+
+} scale_ctx_t;
+
+static uint8_t _scaleimg(dsr_t *hdr, uint8_t *img, double scale);
+
+/**
+ * parallel_for function which scales a range of values.
+ *
+ * \return 0.
+ */
+static uint8_t _scale_vals(
+  uint64_t  start,  /**< first value             */
+  uint64_t  end,    /**< one past last value     */
+  uint16_t  thread, /**< calling thread          */
+  void     *ctx     /**< pointer to scale_ctx_t  */
+);
 
 int main(int argc, char *argv[]) {
 
@@ -36,10 +65,10 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
-  _scaleimg(&hdr, img, scale);
+  if (_scaleimg(&hdr, img, scale)) goto fail;
 
-  if (analyze_write_hdr(argv[3], &hdr))      goto fail;
-  if (analyze_write_img(argv[3], &hdr, img)) goto fail;
+  if (analyze_write_hdr(argv[2], &hdr))      goto fail;
+  if (analyze_write_img(argv[2], &hdr, img)) goto fail;
 
   free(img);
   return 0;
@@ -49,22 +78,31 @@ int main(int argc, char *argv[]) {
   return 1;
 }
 
-void _scaleimg(dsr_t *hdr, uint8_t *img, double scale) {
+uint8_t _scaleimg(dsr_t *hdr, uint8_t *img, double scale) {
 
-  uint32_t i;
-  double   val;
-  uint32_t nvals;
+  scale_ctx_t ctx;
 
-  nvals   = analyze_num_vals(  hdr);
+  ctx.hdr   = hdr;
+  ctx.img   = img;
+  ctx.scale = scale;
 
-  for (i = 0; i < nvals; i++) {
-
-    val = analyze_read_by_idx(hdr, img, i);
-    analyze_write_by_idx(     hdr, img, i, val*scale);
-  }
+  if (parallel_for(
+        0, analyze_num_vals(hdr), _SCALE_CHUNK, &ctx, _scale_vals))
+    return 1;
 
   hdr->dime.cal_max *= scale;
   hdr->dime.cal_min *= scale;
   hdr->dime.glmax   *= scale;
   hdr->dime.glmin   *= scale;
+
+  return 0;
+}
+
+uint8_t _scale_vals(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  scale_ctx_t *c = ctx;
+
+  analyze_scale_block(c->hdr, c->img, start, end - start, c->scale);
+
+  return 0;
 }
@@ -13,6 +13,12 @@
 
 #include "io/analyze75.h"
 #include "util/startup.h"
+#include "util/parallel.h"
+
+/**
+ * Number of values which are searched at a time.
+ */
+#define _SEARCH_CHUNK 65536
 
 
 typedef struct _args {
@@ -58,13 +64,46 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
 }
 
 
-static void _search(
+/**
+ * Context passed to _search_vals.
+ */
+typedef struct _search_ctx {
+
+  dsr_t    *hdr;    /**< image header                                */
+  uint8_t  *img;    /**< image data                                  */
+  double    lo;     /**< lowest matching value                       */
+  double    hi;     /**< highest matching value                      */
+  uint32_t *idxs;   /**< indices of matching values - the matches in
+                         each chunk start at the chunk offset        */
+  uint32_t *counts; /**< number of matches in each chunk             */
+
+} search_ctx_t;
+
+/**
+ * Prints the indices of all values within the given precision of the
+ * given value. The image is searched in parallel, a chunk at a time.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _search(
   dsr_t   *hdr,
   uint8_t *img,
   double   value,
   double   precision
 );
 
+/**
+ * parallel_for function which searches a chunk of values.
+ *
+ * \return 0.
+ */
+static uint8_t _search_vals(
+  uint64_t  start,  /**< first value              */
+  uint64_t  end,    /**< one past last value      */
+  uint16_t  thread, /**< calling thread           */
+  void     *ctx     /**< pointer to search_ctx_t  */
+);
+
 int main(int argc, char *argv[]) {
 
   dsr_t       hdr;
@@ -81,34 +120,49 @@ int main(int argc, char *argv[]) {
     goto fail;
   }
 
-  _search(&hdr, img, args.value, args.precision);
-
+  if (_search(&hdr, img, args.value, args.precision)) {
+    printf("error searching file %s\n", args.input);
+    goto fail;
+  }
 
+  free(img);
   return 0;
   
 fail:
   return 1;
 }
 
-void _search(dsr_t *hdr, uint8_t *img, double value, double precision) {
+uint8_t _search(dsr_t *hdr, uint8_t *img, double value, double precision) {
+
+  uint64_t     i;
+  uint64_t     j;
+  uint64_t     k;
+  uint32_t     nvals;
+  uint32_t     nchunks;
+  uint8_t      ndims;
+  uint32_t     dimidxs[8];
+  search_ctx_t ctx;
 
-  uint64_t i;
-  uint64_t j;
-  double   curval;
-  uint32_t nvals;
-  uint8_t  ndims;
-  uint32_t dimidxs[8];
+  ndims   = analyze_num_dims(hdr);
+  nvals   = analyze_num_vals(hdr);
+  nchunks = (nvals + _SEARCH_CHUNK - 1) / _SEARCH_CHUNK;
 
-  ndims = analyze_num_dims(hdr);
-  nvals = analyze_num_vals(hdr);
+  ctx.hdr    = hdr;
+  ctx.img    = img;
+  ctx.lo     = value - precision;
+  ctx.hi     = value + precision;
+  ctx.idxs   = malloc((uint64_t)nvals * sizeof(uint32_t));
+  ctx.counts = calloc(nchunks, sizeof(uint32_t));
 
-  for (i = 0; i < nvals; i++) {
+  if (ctx.idxs   == NULL && nvals   > 0) goto fail;
+  if (ctx.counts == NULL && nchunks > 0) goto fail;
 
-    curval = analyze_read_by_idx(hdr, img, i);
-    
-    if (abs(curval - value) <= precision) {
+  if (parallel_for(0, nvals, _SEARCH_CHUNK, &ctx, _search_vals)) goto fail;
 
-      analyze_get_indices(hdr, i, dimidxs);
+  for (i = 0; i < nchunks; i++) {
+    for (k = 0; k < ctx.counts[i]; k++) {
+
+      analyze_get_indices(hdr, ctx.idxs[i * _SEARCH_CHUNK + k], dimidxs);
       for (j = 0; j < ndims; j++) {
         
         printf("%2u", dimidxs[j]);
@@ -118,4 +172,24 @@ void _search(dsr_t *hdr, uint8_t *img, double value, double precision) {
       printf("\n");
     }
   }
+
+  free(ctx.idxs);
+  free(ctx.counts);
+  return 0;
+
+fail:
+  if (ctx.idxs   != NULL) free(ctx.idxs);
+  if (ctx.counts != NULL) free(ctx.counts);
+  return 1;
+}
+
+uint8_t _search_vals(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  search_ctx_t *c = ctx;
+
+  c->counts[start / _SEARCH_CHUNK] = analyze_search_block(
+    c->hdr, c->img, start, end - start, c->lo, c->hi, 0, NULL,
+    c->idxs + start);
+
+  return 0;
 }
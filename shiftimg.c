@@ -50,16 +50,9 @@ static error_t _parse_opt (
 );
 
 /**
- * \return the number of values contained in a single 'slice' across the given
- * dimension.
- */
-static uint32_t _calc_slicesize(
-  dsr_t  *hdr, /**< image header       */
-  uint8_t dim  /**< dimension to slice */
-);
-
-/**
- * Shifts the image along the given dimension, the given number of voxels. 
+ * Shifts the image along the given dimension, the given number of voxels.
+ * The shifted image is copied as (at most) two boxes - the part which
+ * stays inside the image, and the part which wraps around.
  */
 static uint8_t _shift(
   dsr_t   *hdr,      /**< image header                                     */
@@ -70,30 +63,6 @@ static uint8_t _shift(
   uint8_t  wrap      /**< whether to wrap around.                          */
 );
 
-/**
- * Reads a single slice from the given image, along the given dimension.
- */
-static void _readslice(
-  dsr_t   *hdr,     /**< image header                  */
-  uint8_t *image,   /**< image data                    */
-  uint8_t  dim,     /**< dimension to slice            */
-  uint8_t  sliceno, /**< slice number (index into dim) */
-  double  *slice,   /**< place to store slice          */
-  uint32_t slicesz  /**< number of values in a slice   */
-);
-
-/**
- * Writes a single slice to the given image, along the given dimension.
- */
-static void _writeslice(
-  dsr_t   *hdr,     /**< image header              */
-  uint8_t *image,   /**< image data                */
-  uint8_t  dim,     /**< dimension to write to     */
-  uint8_t  sliceno, /**< slice number              */
-  double  *slice,   /**< slice data                */
-  uint32_t slicesz  /**< number of values in slice */
-);
-
 int main (int argc, char *argv[]) {
 
   uint8_t i;
@@ -104,13 +73,9 @@ int main (int argc, char *argv[]) {
   uint8_t         *tmpimg;
   uint32_t         nvals;
   uint8_t          valsz;
-  FILE            *fimg;
-  FILE            *fhdr;
   struct arguments arguments;
   struct argp      argp = {options, _parse_opt, "INPUT OUTPUT", doc};
 
-  fimg   = NULL;
-  fhdr   = NULL;
   inimg  = NULL;
   outimg = NULL;
   tmpimg = NULL;
@@ -155,15 +120,11 @@ int main (int argc, char *argv[]) {
   if (analyze_write_hdr(arguments.output, &inhdr))         goto fail;
   if (analyze_write_img(arguments.output, &inhdr, outimg)) goto fail;
 
-  fclose(fimg);
-  fclose(fhdr);
   free(inimg);
   free(outimg);
   return 0;  
 fail:
   printf("fail?\n");
-  if (fimg   != NULL) fclose(fimg);
-  if (fhdr   != NULL) fclose(fhdr);
   if (inimg  != NULL) free(inimg);
   if (outimg != NULL) free(outimg);
   return 1;
@@ -218,24 +179,6 @@ error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
-uint32_t _calc_slicesize(dsr_t *hdr, uint8_t dim) {
-
-  uint8_t   i;
-  uint8_t   ndims;
-  uint32_t  slicesize;
-
-  ndims   = analyze_num_dims(hdr);
-
-  slicesize = 1;
-  for (i = 0; i < ndims; i++) {
-
-    if (i == dim) continue;
-    slicesize *= analyze_dim_size(hdr, i);
-  }
-
-  return slicesize;
-}
-
 uint8_t _shift(
   dsr_t   *hdr, 
   uint8_t *oldimage, 
@@ -244,104 +187,53 @@ uint8_t _shift(
   int16_t  shift, 
   uint8_t  wrap)
 {
-  int64_t   i;
-  int64_t   newi;
-  double   *slice;
-  uint32_t  dimsz;
-  uint32_t  slicesz;
-
-  slice = NULL;
-
-  dimsz   = analyze_dim_size(hdr, dim);
-  slicesz = _calc_slicesize( hdr, dim);
-
-  slice = malloc(slicesz * sizeof(double));
-  if (slice == NULL) goto fail;
-
-  for (i = 0; i < dimsz; i++) {
-
-    newi = (i+shift) % dimsz;
-
-    if (newi < 0) newi = dimsz + newi;
-
-    if (!wrap) {
-
-      if (shift > 0 && newi < i) continue;
-      if (shift < 0 && newi > i) continue;
-    }
-
-    _readslice( hdr, oldimage, dim,    i, slice, slicesz);
-    _writeslice(hdr, newimage, dim, newi, slice, slicesz);
-  }
-
-  free(slice);
-  return 0;
-fail:
-
-  if (slice  != NULL) free(slice);
-  return 1;
-}
-
-void _readslice(
-  dsr_t   *hdr,
-  uint8_t *image,
-  uint8_t  dim,
-  uint8_t  sliceno,
-  double  *slice,
-  uint32_t slicesz) {
-  
-  uint32_t i;
-  uint8_t  j;
+  uint8_t  i;
   uint8_t  ndims;
-  uint32_t dimidx[4];
+  int64_t  dimsz;
+  int64_t  s;
+  uint32_t srcstart[8];
+  uint32_t dststart[8];
+  uint32_t size[8];
 
   ndims = analyze_num_dims(hdr);
 
-  memset(dimidx, 0, 4 * sizeof(uint32_t));
-  dimidx[dim] = sliceno;
-
-  for (i = 0; i < slicesz; i++) {
-
-    slice[i] = analyze_read_val(hdr, image, dimidx);
+  if (dim >= ndims) goto fail;
 
-    for (j = 0; j < ndims; j++) {
+  dimsz = analyze_dim_size(hdr, dim);
 
-      if (j == dim) continue;
-
-      dimidx[j] = (dimidx[j]+1) % analyze_dim_size(hdr, j);
-      if (dimidx[j] > 0) break;
-    }
+  for (i = 0; i < ndims; i++) {
+    srcstart[i] = 0;
+    dststart[i] = 0;
+    size[i]     = analyze_dim_size(hdr, i);
   }
-}
 
-void _writeslice(
-  dsr_t   *hdr,
-  uint8_t *image,
-  uint8_t  dim,
-  uint8_t  sliceno,
-  double  *slice,
-  uint32_t slicesz)
-{
-  uint32_t i;
-  uint8_t  j;
-  uint8_t  ndims;
-  uint32_t dimidx[4];
+  s = shift;
+  if (wrap) s = ((s % dimsz) + dimsz) % dimsz;
 
-  ndims = analyze_num_dims(hdr);
+  /*everything has been shifted off the edge*/
+  if (s >= dimsz || -s >= dimsz) return 0;
 
-  memset(dimidx, 0, 4 * sizeof(uint32_t));
-  dimidx[dim] = sliceno;
+  /*the part which stays inside the image*/
+  if (s >= 0) dststart[dim] =  s;
+  else        srcstart[dim] = -s;
+  size[dim] = (s >= 0) ? dimsz - s : dimsz + s;
 
-  for (i = 0; i < slicesz; i++) {
+  if (analyze_copy_box(
+        hdr, oldimage, srcstart, hdr, newimage, dststart, size))
+    goto fail;
 
-    analyze_write_val(hdr, image, dimidx, slice[i]);
+  if (!wrap || s == 0) return 0;
 
-    for (j = 0; j < ndims; j++) {
+  /*the part which wraps around to the start*/
+  srcstart[dim] = dimsz - s;
+  dststart[dim] = 0;
+  size[dim]     = s;
 
-      if (j == dim) continue;
+  if (analyze_copy_box(
+        hdr, oldimage, srcstart, hdr, newimage, dststart, size))
+    goto fail;
 
-      dimidx[j] = (dimidx[j]+1) % analyze_dim_size(hdr, j);
-      if (dimidx[j] > 0) break;
-    }
-  }
+  return 0;
+fail:
+  return 1;
 }
@@ -14,7 +14,10 @@
 #include <stdint.h>
 
 #include "util/array.h"
+#include "util/edge_array.h"
 #include "graph/graph.h"
+#include "graph/graph_compact.h"
+#include "graph/dijkstra.h"
 
 /**
  * \return the density of the given graph.
@@ -37,6 +40,72 @@ double stats_max_degree(
   graph_t *g /**< the graph to query */
 );
 
+/**
+ * Degree-based statistics of a graph, calculated together by
+ * stats_degree_summary.
+ */
+typedef struct _stats_degree_summary {
+
+  double nnodes;        /**< number of nodes             */
+  double nedges;        /**< number of edges             */
+  double density;       /**< see stats_density           */
+  double avgdegree;     /**< see stats_avg_degree        */
+  double mindegree;     /**< minimum degree              */
+  double maxdegree;     /**< see stats_max_degree        */
+  double nisolated;     /**< number of nodes of degree 0 */
+  double assortativity; /**< see stats_assortativity     */
+
+} stats_degree_summary_t;
+
+/**
+ * Calculates the degree-based statistics of the given graph in one
+ * parallel sweep over its nodes. The summary is stored in the stats cache
+ * (STATS_CACHE_DEGREE_SUMMARY), as are the maximum degree and the
+ * assortativity.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_degree_summary(
+  graph_t                *g, /**< the graph to query           */
+  stats_degree_summary_t *s  /**< place to store the summary   */
+);
+
+/**
+ * Counts the number of nodes of every degree.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_degree_histogram(
+  graph_t  *g,   /**< the graph to query                              */
+  uint32_t *hist /**< space to store stats_max_degree(g)+1 counts - the
+                      number of nodes with degree 0, 1, and so on      */
+);
+
+/**
+ * Calculates the rich-club coefficient of the given undirected graph, for
+ * every degree k from 0 to stats_max_degree(g). The coefficient phi(k) is
+ * the density of the subgraph of nodes with degree greater than k:
+ *
+ *   phi(k) = 2 E(>k) / (N(>k) (N(>k) - 1))
+ *
+ * or 0 if fewer than two nodes have degree greater than k.
+ *
+ *   Colizza V, Flammini A, Serrano MA & Vespignani A 2006. Detecting
+ *   rich-club ordering in complex networks. Nature Physics 2:110-115
+ *
+ * The nodes are sorted by degree once, and added to the club from the
+ * highest degree downwards, counting the edges between each new node and
+ * the nodes already in the club, so every coefficient is calculated in
+ * one pass over the edges. See stats_reference_rich_club for values
+ * normalised against degree-preserving random graphs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_rich_club(
+  graph_t *g,  /**< the graph to query                              */
+  double  *phi /**< space to store stats_max_degree(g)+1 coefficients */
+);
+
 /**
  * \return the average clustering coefficient of the given graph.
  */
@@ -44,23 +113,59 @@ double stats_avg_clustering(
   graph_t *g /**< the graph to query */
 );
 
+/**
+ * Counts the number of triangles (sets of three mutually connected nodes)
+ * in the given undirected graph.
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t stats_num_triangles(
+  graph_t  *g,         /**< the graph to query                  */
+  uint64_t *ntriangles /**< place to store the number of triangles */
+);
+
 /**
  * Returns an approximation of the clustering coefficient by sampling a number
  * of triples (3 connected nodes) in the given graph. The returned clustering
  * coefficient is the ratio of the number of triangles (fully connected
- * triples) to the number of triples sampled.
-
- * Assumes that the stdlib random number generator has already been seeded.
+ * triples) to the number of triples sampled. Every triple in the graph is
+ * equally likely to be sampled (the centre of each triple is drawn with
+ * probability proportional to deg*(deg-1)), so the estimate is of the
+ * transitivity of the graph. Triples are tested in parallel.
+ *
+ * Assumes that the random number generator has already been seeded.
  *
  *   Schank T & Wagner D 2005. Approximating Clustering
  *   Coefficient and Transitivity. Journal of Graph
  *   Algorithms and Applications, 9:2:265-275
+ *
+ * \return the estimate, or -1 on failure.
  */
 double stats_approx_clustering(
   graph_t *g,       /**< the graph to query              */
   uint32_t ntriples /**< the number of triples to sample */
 );
 
+/**
+ * As stats_approx_clustering, but also calculates the standard error of
+ * the estimate. If target is positive, sampling stops as soon as the
+ * standard error is no greater than target, or once ntriples triples have
+ * been sampled, whichever comes first. The error is checked after every
+ * 65536 triples.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_clustering_err(
+  graph_t *g,        /**< the graph to query                       */
+  uint32_t ntriples, /**< the maximum number of triples to sample  */
+  double   target,   /**< target standard error, or 0 to sample
+                          ntriples triples                         */
+  double  *clust,    /**< place to store the estimate              */
+  double  *err       /**< place to store the standard error of the
+                          estimate (may be NULL)                   */
+);
+
 /**
  * \return the characteristic path length of the given graph.
  */
@@ -121,6 +226,125 @@ uint32_t stats_num_components(
                          stored here                                      */
 );
 
+/**
+ * Calculates the core number of every node in the given undirected graph
+ * (see graph/graph_kcore.h), and caches them (STATS_CACHE_NODE_CORENESS).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_coreness(
+  graph_t  *g,     /**< the graph to query                           */
+  uint32_t *cores  /**< if not NULL, the core number of each node is
+                        stored here                                  */
+);
+
+/**
+ * \return the strength of the given node - the sum of the weights of its
+ * edges (its degree, if the graph has no weights). The value is cached
+ * (STATS_CACHE_NODE_STRENGTH).
+ */
+double stats_strength(
+  graph_t *g, /**< the graph to query */
+  uint32_t n  /**< the node           */
+);
+
+/**
+ * \return the weighted degree centrality of the given node - its strength
+ * divided by the number of other nodes (see stats_degree_centrality).
+ */
+double stats_weighted_degree_centrality(
+  graph_t *g, /**< the graph to query */
+  uint32_t n  /**< the node           */
+);
+
+/**
+ * Calculates the weighted clustering coefficient of every node in the
+ * given undirected graph:
+ *
+ *   Onnela JP, Saramaki J, Kertesz J & Kaski K 2005. Intensity and
+ *   coherence of motifs in weighted complex networks. Physical Review E
+ *   71(6):065103
+ *
+ * The coefficient of node i is the sum, over every triangle (i, j, h), of
+ * the geometric mean of the triangle's edge weights, normalised by the
+ * largest absolute weight in the graph, divided by k(i)(k(i)-1)/2. It is
+ * 0 for nodes with fewer than two neighbours. The nodes are shared between
+ * the given number of threads (0 to use all available processors), and
+ * the values are cached (STATS_CACHE_NODE_WCLUSTERING).
+ *
+ * \return 0 on success, non-0 on failure (including if the graph is
+ * directed).
+ */
+uint8_t stats_weighted_clustering(
+  graph_t  *g,        /**< the graph to query                         */
+  uint16_t  nthreads, /**< number of threads                          */
+  double   *clust     /**< if not NULL, the weighted clustering of each
+                           node is stored here                        */
+);
+
+/**
+ * Calculates the exact diameter of the given undirected graph - the
+ * longest shortest path within any of its components - with the iFUB
+ * algorithm, which usually needs only a handful of breadth first
+ * searches, rather than one from every node. The diameter is cached
+ * (STATS_CACHE_DIAMETER). Fails for directed graphs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_diameter(
+  graph_t  *g,       /**< the graph to query                          */
+  uint32_t *diameter /**< if not NULL, the diameter is stored here    */
+);
+
+/**
+ * Calculates the exact eccentricity of every node in the given undirected
+ * graph - its largest distance to any other node in the same component
+ * (0 for nodes with no neighbours). Bounds on the eccentricity of every
+ * node are tightened by each breadth first search, which is made from
+ * the node whose bounds are furthest apart, until all of them are exact.
+ * The eccentricities, and the diameter, are cached
+ * (STATS_CACHE_NODE_ECCENTRICITY and STATS_CACHE_DIAMETER). Fails for
+ * directed graphs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_eccentricity(
+  graph_t  *g,  /**< the graph to query                               */
+  uint32_t *ecc /**< if not NULL, the eccentricity of each node is
+                     stored here                                      */
+);
+
+/**
+ * Calculates the participation coefficient and the within-module degree
+ * z-score of every node in the given graph, where the modules are the
+ * node label values (e.g. as given by ctrim or clouvain):
+ *
+ *   Guimera R & Amaral LAN 2005. Functional cartography of complex
+ *   metabolic networks. Nature 433:895-900
+ *
+ * The participation coefficient of node i is 1 - sum_s (k(i,s)/k(i))^2,
+ * where k(i,s) is the number of edges between i and module s, and k(i) is
+ * the degree of i (0 for nodes with no neighbours). The z-score is the
+ * number of edges between i and its own module, standardised against the
+ * other nodes of that module (0 if they all have the same number).
+ *
+ * The per-module edge counts of each node are accumulated in one pass
+ * over its neighbours, in parallel over the nodes, by the given number of
+ * threads (0 to use all available processors). Both values are cached
+ * (STATS_CACHE_NODE_PARTICIPATION and STATS_CACHE_NODE_ZSCORE). For
+ * directed graphs, out-edges are used.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_roles(
+  graph_t  *g,             /**< the graph to query                    */
+  uint16_t  nthreads,      /**< number of threads                     */
+  double   *participation, /**< if not NULL, the participation
+                                coefficient of each node is stored here */
+  double   *zscore         /**< if not NULL, the within-module degree
+                                z-score of each node is stored here     */
+);
+
 /**
  * \return the spatial span of the given component, that is, the maximum
  * distance between all pairs of nodes in the component, or a negative value
@@ -131,6 +355,44 @@ double stats_component_span(
   uint32_t cmp /**< the component */
 );
 
+/**
+ * Spatial extent of one component, as calculated by stats_component_spans.
+ */
+typedef struct _stats_span {
+
+  uint32_t size;        /**< number of nodes in the component          */
+  double   min[3];      /**< lower corner of the bounding box          */
+  double   max[3];      /**< upper corner of the bounding box          */
+  double   centroid[3]; /**< mean coordinates of the nodes             */
+  double   span;        /**< distance between the two nodes found by a
+                             double sweep - a lower bound on the span,
+                             which is at least half of it              */
+  double   spanbound;   /**< upper bound on the span - the smaller of
+                             the bounding box diagonal, and twice the
+                             largest distance from the centroid        */
+
+} stats_span_t;
+
+/**
+ * Calculates the spatial extent of every component in the given graph,
+ * in a few linear passes over the nodes, grouped by their component IDs
+ * (see stats_cache_node_component). The span (see stats_component_span)
+ * is approximated by a double sweep - the node furthest from the
+ * centroid is found, and then the node furthest from that one -
+ * rather than by comparing every pair of nodes. Where span and spanbound
+ * are equal, the span is exact.
+ *
+ * \return 0 on success, non-0 on failure, or if the graph has no labels.
+ */
+uint8_t stats_component_spans(
+  graph_t      *g,     /**< the graph                                 */
+  uint32_t      ncmps, /**< number of components (see
+                            stats_cache_num_components) - nodes in
+                            higher components are ignored             */
+  stats_span_t *spans  /**< place to store the extent of each
+                            component (length ncmps)                  */
+);
+
 /**
  * \return the size of the largest component in the given graph, 0 on failure.
  */
@@ -258,6 +520,19 @@ double stats_closeness_centrality(
   uint32_t nidx /**< the node to query  */
 );
 
+/**
+ * \return the harmonic centrality for the given node - the sum of the
+ * inverse distances from the node to every other node, divided by
+ * (n - 1), or -1 on failure. Nodes which cannot be reached from the given
+ * node contribute 0, so the measure is well defined for disconnected
+ * graphs. The mean harmonic centrality of all nodes is the global
+ * efficiency of the graph.
+ */
+double stats_harmonic_centrality(
+  graph_t *g,   /**< the graph to query */
+  uint32_t nidx /**< the node to query  */
+);
+
 /**
  * \return the betweenness centrality for the given node.
  */
@@ -270,7 +545,12 @@ double stats_betweenness_centrality(
  * Counts the number of shortest paths which exist between the given node and
  * all other nodes in the graph.  Optionally saves the per-node path count in
  * the provided numpaths array, which must be graph_num_nodes(g) in length. If
- * you don't care about the per-node counts, pass in NULL.
+ * you don't care about the per-node counts, pass in NULL - they are then
+ * not stored in the stats cache either, as the pair cache needs space for
+ * every pair of nodes.
+ *
+ * Path counts may overflow on large, dense graphs; see the lognumpaths
+ * measure of stats_brandes_paths for counts which do not.
  *
  * \return the total number of paths from this node to all other nodes.
  */
@@ -290,6 +570,22 @@ double stats_edge_pathsharing(
   uint32_t v  /**< another node */
 );
 
+/**
+ * Calculates the pathsharing value for every edge in the given list, storing
+ * each value in the val field of the edge, and in the stats cache. The
+ * values are calculated in parallel, by the given number of threads (pass in
+ * 0 to use all available processors). Any pairs of nodes in the list which
+ * are not neighbours are given a value of 0.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_edge_pathsharing_list(
+  graph_t      *g,       /**< the graph                 */
+  graph_edge_t *edges,   /**< the edges to calculate    */
+  uint64_t      nedges,  /**< number of edges           */
+  uint16_t      nthreads /**< number of threads to use  */
+);
+
 /**
  * Calculates the modularity of the given graph; modularity gives an
  * indication of the extent to which the graph is made up of densely
@@ -323,6 +619,56 @@ double stats_chira(
   uint32_t *communities   /**< community IDs for each node */
 );
 
+/**
+ * Edge counts within and between the regions of a graph, where a region
+ * is the set of nodes with the same label value, calculated by
+ * stats_regions.
+ */
+typedef struct _stats_regions {
+
+  uint32_t  nregions; /**< number of regions                           */
+  uint32_t *labels;   /**< label value of each region, ascending       */
+  uint32_t *sizes;    /**< number of nodes in each region              */
+  double   *counts;   /**< nregions*nregions matrix - the number of
+                           edges within region i at (i, i), and the
+                           number between regions i and j at (i, j)    */
+
+} stats_regions_t;
+
+/**
+ * Counts the edges within and between every pair of regions, in one
+ * parallel pass over the graph (see graph/graph_aggregate.h). For an
+ * undirected graph, the count matrix is symmetric; for a directed graph,
+ * entry (i, j) is the number of edges from region i to region j.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_regions(
+  graph_t         *g,        /**< graph to query                       */
+  uint16_t         nthreads, /**< number of threads (0 for default,
+                                  see util/parallel.h)                 */
+  stats_regions_t *regs      /**< place to store the counts            */
+);
+
+/**
+ * \return the density of the edges within region i (if i == j), as a
+ * proportion of the number of pairs of its nodes, or between regions i
+ * and j, as a proportion of the number of pairs of nodes with one in
+ * each region. If there are no such pairs, the edge count is returned.
+ */
+double stats_region_density(
+  stats_regions_t *regs, /**< counts from stats_regions */
+  uint32_t         i,    /**< first region              */
+  uint32_t         j     /**< second region             */
+);
+
+/**
+ * Frees the memory used by the given region counts.
+ */
+void stats_regions_free(
+  stats_regions_t *regs /**< counts from stats_regions */
+);
+
 /**
  * \return the number of edges which lie between nodes with the same
  * label value. 
@@ -350,6 +696,287 @@ uint8_t stats_edge_betweenness(
                             adjacent to node v are stored here */
 );
 
+/**
+ * Runs Brandes' algorithm from each of the given source nodes (or from
+ * every node, if sources is NULL), with the searches shared between the
+ * given number of threads (pass in 0 to use all available processors).
+ * The sources are split into a fixed number of blocks, each of which
+ * accumulates its own dependency values, and the blocks are added
+ * together in order, so the results do not depend upon the number of
+ * threads, or upon the order in which they finish.
+ *
+ * If nodebetw is not NULL, the sum, over all sources, of the dependency of
+ * each source on each node, is stored in it (it must have space for
+ * graph_num_nodes(g) values). When every node is a source, this is twice
+ * the number of shortest paths (weighted by 1/the number of alternatives)
+ * which pass through the node.
+ *
+ * If edgebetw is not NULL, it must be an edge array of doubles; half of the
+ * sum, over all sources, of the dependency of each source on each edge, is
+ * added to the value for the edge. When every node in a component is a
+ * source, this is the edge betweenness, as calculated by
+ * stats_edge_betweenness.
+ *
+ * Only undirected graphs are supported.
+ *
+ *   Brandes U 2001. A faster algorithm for betweenness centrality.
+ *   Journal of Mathematical Sociology 25(2):163-177
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_brandes(
+  graph_t      *g,        /**< graph to query                         */
+  uint32_t     *sources,  /**< source nodes, or NULL for all nodes    */
+  uint32_t      nsources, /**< number of sources (ignored if sources
+                               is NULL)                               */
+  uint16_t      nthreads, /**< number of threads to use               */
+  double       *nodebetw, /**< place to store node values, or NULL    */
+  edge_array_t *edgebetw  /**< place to add edge values, or NULL      */
+);
+
+/**
+ * Per-source shortest path measures, which may be gathered during the
+ * searches run by stats_brandes_paths. Each array, if not NULL, must have
+ * space for graph_num_nodes(g) values, and receives one value for each
+ * source node, indexed by node.
+ */
+typedef struct _stats_paths {
+
+  double *pathlength; /**< average distance from the source to the
+                           nodes reachable from it, as calculated by
+                           stats_pathlength (may be NULL)          */
+  double *invdist;    /**< sum of the inverse distances from the
+                           source to the nodes reachable from it, as
+                           used by stats_global_efficiency (may be
+                           NULL)                                   */
+  double *numpaths;   /**< total number of shortest paths from the
+                           source, as calculated by stats_numpaths
+                           (may be NULL)                           */
+  double *lognumpaths;/**< natural logarithm of the total number of
+                           shortest paths from the source, which is
+                           finite even when the number itself
+                           overflows (-INFINITY if no other node is
+                           reachable, may be NULL)                 */
+
+} stats_paths_t;
+
+/**
+ * As stats_brandes, but also gathers the given per-source path measures
+ * during the same searches. If nodebetw is NULL, only the searches are
+ * run - dependencies are not accumulated.
+ *
+ * Path counts are rescaled by powers of two, at each distance from the
+ * source, whenever they become large, so neither the betweenness values
+ * nor lognumpaths overflow. Rescaling is exact, so results for graphs
+ * whose path counts do not need it are unchanged.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_brandes_paths(
+  graph_t       *g,        /**< graph to query                      */
+  uint32_t      *sources,  /**< source nodes, or NULL for all nodes */
+  uint32_t       nsources, /**< number of sources (ignored if
+                                sources is NULL)                    */
+  uint16_t       nthreads, /**< number of threads to use            */
+  double        *nodebetw, /**< place to store node values, or NULL */
+  stats_paths_t *paths     /**< place to store per-source path
+                                measures, or NULL                   */
+);
+
+/**
+ * As stats_brandes_paths, but for weighted graphs - shortest paths are
+ * found with Dijkstra's algorithm, using edge lengths derived from the edge
+ * weights (see graph/dijkstra.h). The per-source path measures are the
+ * weighted equivalents of those gathered by stats_brandes_paths. Directed
+ * graphs are supported.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_weighted_brandes(
+  graph_t          *g,        /**< graph to query                      */
+  uint32_t         *sources,  /**< source nodes, or NULL for all nodes */
+  uint32_t          nsources, /**< number of sources (ignored if
+                                   sources is NULL)                    */
+  uint16_t          nthreads, /**< number of threads to use            */
+  dijkstra_length_t length,   /**< edge length conversion              */
+  double           *nodebetw, /**< place to store node values, or NULL */
+  stats_paths_t    *paths     /**< place to store per-source path
+                                   measures, or NULL                   */
+);
+
+/**
+ * \return the weighted characteristic path length of the given graph - the
+ * average, over all nodes, of the mean weighted distance from each node to
+ * the nodes reachable from it - or a negative value on failure.
+ */
+double stats_weighted_pathlength(
+  graph_t          *g,     /**< the graph to query     */
+  dijkstra_length_t length /**< edge length conversion */
+);
+
+/**
+ * \return the weighted global efficiency of the given graph - the mean,
+ * over all ordered pairs of nodes, of the inverse weighted distance between
+ * them - or a negative value on failure.
+ */
+double stats_weighted_efficiency(
+  graph_t          *g,     /**< the graph to query     */
+  dijkstra_length_t length /**< edge length conversion */
+);
+
+/**
+ * Calculates the weighted betweenness centrality of every node in the
+ * given graph, normalised in the same way as stats_betweenness_centrality.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_weighted_betweenness(
+  graph_t          *g,        /**< the graph to query                  */
+  dijkstra_length_t length,   /**< edge length conversion              */
+  uint16_t          nthreads, /**< number of threads to use            */
+  double           *betw      /**< place to store graph_num_nodes(g)
+                                   values                              */
+);
+
+/**
+ * Estimates the betweenness centrality of every node in the given graph, by
+ * running Brandes' algorithm from nsamples source nodes, selected uniformly
+ * at random, and scaling the result. The estimates are normalised in the
+ * same way as stats_betweenness_centrality. If nsamples is greater than or
+ * equal to the number of nodes, the exact values are calculated. See
+ * stats_approx_betweenness_error for a bound on the error.
+ *
+ * Assumes that the stdlib random number generator has already been seeded.
+ *
+ *   Brandes U & Pich C 2007. Centrality estimation in large networks.
+ *   International Journal of Bifurcation and Chaos 17(7):2303-2318
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_betweenness(
+  graph_t *g,          /**< the graph to query                       */
+  uint32_t nsamples,   /**< number of source nodes to sample         */
+  double  *betweenness /**< place to store estimates - must have
+                            space for graph_num_nodes(g) values      */
+);
+
+/**
+ * Estimates the edge betweenness of every edge in the given graph, in the
+ * same way as stats_approx_betweenness. The estimates are stored in the
+ * stats cache, in place of the exact values which would be calculated by
+ * stats_edge_betweenness, so they may be retrieved with
+ * stats_cache_edge_betweenness. Each call uses a new sample of source nodes.
+ *
+ * Assumes that the stdlib random number generator has already been seeded.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_edge_betweenness(
+  graph_t *g,        /**< the graph to query               */
+  uint32_t nsamples  /**< number of source nodes to sample */
+);
+
+/**
+ * Calculates the maximum error in the estimates returned by
+ * stats_approx_betweenness, which holds with probability at least 1-delta
+ * for all nvals estimates simultaneously. The bound is derived from
+ * Hoeffding's inequality, so is conservative. It applies to normalised
+ * values; for the (unnormalised) estimates calculated by
+ * stats_approx_edge_betweenness, multiply by (nnodes*(nnodes-1)/2).
+ *
+ * \return the error bound.
+ */
+double stats_approx_betweenness_error(
+  uint32_t nnodes,   /**< number of nodes in the graph        */
+  uint64_t nvals,    /**< number of estimates (nodes or edges) */
+  uint32_t nsamples, /**< number of sampled source nodes       */
+  double   delta     /**< failure probability, e.g. 0.05       */
+);
+
+/**
+ * Estimates of the shortest path measures of a graph, calculated by
+ * stats_approx_paths.
+ */
+typedef struct _stats_approx_paths {
+
+  uint32_t nsamples;       /**< number of sampled source nodes        */
+  double   pathlength;     /**< characteristic path length estimate   */
+  double   pathlength_err; /**< half-width of the 95% confidence
+                                interval of the path length estimate  */
+  double   efficiency;     /**< global efficiency estimate            */
+  double   efficiency_err; /**< half-width of the 95% confidence
+                                interval of the efficiency estimate   */
+
+} stats_approx_paths_t;
+
+/**
+ * Estimates the characteristic path length and global efficiency of the
+ * given graph, from breadth first searches from nsamples source nodes,
+ * selected uniformly at random, without replacement. Both measures are
+ * means, over every node, of a per-node value (the mean distance to, and
+ * the mean inverse distance to, every other node), so the mean over the
+ * sampled nodes is an unbiased estimate. Confidence intervals are
+ * calculated from the sample variance, with the finite population
+ * correction, so if nsamples is greater than or equal to the number of
+ * nodes, the exact values (the same as those calculated by
+ * stats_avg_pathlength and stats_global_efficiency) are calculated, with
+ * zero error. The path lengths of the sampled nodes are stored in the
+ * stats cache.
+ *
+ * Assumes that the random number generator has already been seeded.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_paths(
+  graph_t              *g,        /**< the graph to query               */
+  uint32_t              nsamples, /**< number of source nodes to sample */
+  stats_approx_paths_t *paths     /**< place to store the estimates     */
+);
+
+/**
+ * Equivalent to stats_approx_paths, for a graph which has been loaded
+ * into the compact adjacency format (see graph/graph_compact.h). The same
+ * nodes are sampled, and the same estimates are calculated, as for the
+ * equivalent graph_t, but nothing is stored in the stats cache.
+ *
+ * Assumes that the random number generator has already been seeded.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_paths_compact(
+  graph_compact_t      *c,        /**< the compact graph                */
+  uint32_t              nsamples, /**< number of source nodes to sample */
+  stats_approx_paths_t *paths     /**< place to store the estimates     */
+);
+
+/**
+ * Selects k distinct nodes of a graph with the given number of nodes,
+ * uniformly at random, in the same way as stats_approx_paths, and stores
+ * them, in ascending order, in the given array, which must have space for
+ * nnodes values.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_approx_paths_sample(
+  uint32_t  nnodes, /**< number of nodes           */
+  uint32_t  k,      /**< number of nodes to select */
+  uint32_t *roots   /**< place to store the nodes  */
+);
+
+/**
+ * Calculates the estimates of stats_approx_paths from the mean distance,
+ * and mean inverse distance, from each of the sampled nodes to every other
+ * node.
+ */
+void stats_approx_paths_estimate(
+  uint32_t              nnodes,   /**< number of nodes in the graph     */
+  uint32_t              nsamples, /**< number of sampled nodes          */
+  double               *pathlens, /**< mean distance from each sample   */
+  double               *effs,     /**< mean inverse distance from each
+                                       sample                           */
+  stats_approx_paths_t *paths     /**< place to store the estimates     */
+);
+
 /**
  * \return the spatial distance between the two given nodes, according to the
  * coordinates in their label, if present. If the graph has no labels, returns
@@ -369,6 +996,25 @@ double stats_avg_edge_distance(
   uint32_t u  /**< the node  */
 );
 
+/**
+ * Calculates the spatial distance of every edge, and the average edge
+ * distance of every node, in one sweep over the graph. The node
+ * coordinates are copied out of the labels once, into separate arrays,
+ * and the distances from each node to its neighbours are calculated
+ * several at a time. The averages are stored in the stats cache
+ * (STATS_CACHE_NODE_EDGEDIST).
+ *
+ * \return 0 on success, non-0 on failure, or if the graph has no labels.
+ */
+uint8_t stats_edge_distances(
+  graph_t *g,     /**< the graph                                         */
+  double  *dists, /**< space to store 2*graph_num_edges(g) distances, in
+                       adjacency order (the distances of the edges of
+                       node 0, then of node 1, and so on), or NULL       */
+  double  *avgs   /**< space to store graph_num_nodes(g) averages, or
+                       NULL                                              */
+);
+
 /**
  * Calculates the classification error for the given graph.
  *
@@ -383,6 +1029,11 @@ double stats_avg_edge_distance(
  *     M. E. J. Newman 2004. Fast algorithm for
  *     detecting community structure in networks.
  *     Physical Review E, vol. 69, no. 6, pg. 066133.
+ *
+ * The components are matched against the label values with the
+ * contingency table of the component IDs and the label values (see
+ * stats_contingency). Where two components are equally large for one
+ * label value, the one with the lower ID is chosen.
  */
 double stats_newman_error(
   graph_t *g
@@ -414,6 +1065,61 @@ double stats_mutual_information(
   uint32_t *lblsk  /**< second set of labels */
 );
 
+/**
+ * A non-empty cell of a contingency table.
+ */
+typedef struct _stats_cell {
+
+  uint32_t j;     /**< index of the first label  */
+  uint32_t k;     /**< index of the second label */
+  uint32_t count; /**< number of values with both labels */
+
+} stats_cell_t;
+
+/**
+ * The contingency table of two labellings, as built by stats_contingency.
+ * Labels are numbered in the order in which they first appear, so the
+ * table does not depend on the label values, or on the number of threads
+ * used to build it.
+ */
+typedef struct _stats_contingency {
+
+  uint32_t      n;       /**< number of values                         */
+  uint32_t      nj;      /**< number of distinct first labels          */
+  uint32_t      nk;      /**< number of distinct second labels         */
+  uint32_t     *valsj;   /**< value of each first label                */
+  uint32_t     *valsk;   /**< value of each second label               */
+  uint32_t     *countsj; /**< number of values with each first label   */
+  uint32_t     *countsk; /**< number of values with each second label  */
+  uint32_t      ncells;  /**< number of non-empty cells                */
+  stats_cell_t *cells;   /**< non-empty cells, sorted by j, and then k */
+
+} stats_contingency_t;
+
+/**
+ * Builds the contingency table of the two given labellings, with hash
+ * tables, in one pass over the labels. The labels are split into one
+ * contiguous block per thread, which are counted in parallel by the given
+ * number of threads (0 to use the default), and then merged in order.
+ * The table must be freed with stats_contingency_free.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_contingency(
+  uint32_t             n,        /**< number of labels          */
+  uint32_t            *lblsj,    /**< first set of labels       */
+  uint32_t            *lblsk,    /**< second set of labels      */
+  uint16_t             nthreads, /**< number of threads         */
+  stats_contingency_t *ct        /**< place to store the table  */
+);
+
+/**
+ * Frees the memory used by the given contingency table.
+ */
+void stats_contingency_free(
+  stats_contingency_t *ct /**< the table */
+);
+
 /**
  * \return the number of nodes with the given label value.
  */
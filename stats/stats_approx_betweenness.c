@@ -0,0 +1,182 @@
+/**
+ * Functions which estimate node and edge betweenness, by running Brandes'
+ * algorithm from a random sample of source nodes, and scaling the result.
+ *
+ *   Brandes U & Pich C 2007. Centrality estimation in large networks.
+ *   International Journal of Bifurcation and Chaos 17(7):2303-2318
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "graph/graph.h"
+#include "util/edge_array.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "util/rng.h"
+
+/**
+ * Selects nsamples distinct nodes, uniformly at random, from the given graph.
+ * If nsamples is greater than or equal to the number of nodes, every node is
+ * selected.
+ *
+ * \return a newly allocated array containing the selected nodes, or NULL on
+ * failure. The number of selected nodes is stored in nsamples.
+ */
+static uint32_t *_sample_sources(
+  graph_t  *g,       /**< the graph                       */
+  uint32_t *nsamples /**< number of nodes to select; the
+                          number actually selected is
+                          stored here                     */
+);
+
+uint8_t stats_approx_betweenness(
+  graph_t *g, uint32_t nsamples, double *betweenness) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *sources;
+  double    scale;
+
+  sources = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  if (nsamples == 0) goto fail;
+
+  sources = _sample_sources(g, &nsamples);
+  if (sources == NULL) goto fail;
+
+  if (stats_brandes(g, sources, nsamples, 0, betweenness, NULL)) goto fail;
+
+  /*
+   * Each source contributes its dependency on every node,
+   * so scaling the sampled total by nnodes/nsamples gives
+   * an unbiased estimate of the total over all sources.
+   * This is then normalised in the same way as the exact
+   * value (see stats_betweenness_centrality).
+   */
+  scale = ((double)nnodes / nsamples) / ((nnodes-1.0) * (nnodes-2.0));
+
+  for (i = 0; i < nnodes; i++) betweenness[i] *= scale;
+
+  free(sources);
+  return 0;
+
+fail:
+  if (sources != NULL) free(sources);
+  return 1;
+}
+
+uint8_t stats_approx_edge_betweenness(graph_t *g, uint32_t nsamples) {
+
+  uint64_t     i;
+  uint64_t     j;
+  uint32_t     nnodes;
+  uint32_t     nnbrs;
+  uint32_t    *nbrs;
+  uint32_t    *sources;
+  double       scale;
+  double       val;
+  edge_array_t betw;
+
+  sources   = NULL;
+  betw.vals = NULL;
+  nnodes    = graph_num_nodes(g);
+
+  if (nsamples == 0) goto fail;
+
+  sources = _sample_sources(g, &nsamples);
+  if (sources == NULL) goto fail;
+
+  if (edge_array_create(g, sizeof(double), &betw))         goto fail;
+  if (stats_brandes(g, sources, nsamples, 0, NULL, &betw)) goto fail;
+
+  /*
+   * Sources are sampled from the whole graph, rather than
+   * from each component, so the same scaling factor gives
+   * an unbiased estimate for the edges of every component
+   */
+  scale = (double)nnodes / nsamples;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      if (nbrs[j] < i) continue;
+
+      val = scale * (*(double *)edge_array_get_by_idx(&betw, i, j));
+      edge_array_set(&betw, i, nbrs[j], &val);
+    }
+  }
+
+  stats_cache_add(g,
+                  STATS_CACHE_EDGE_BETWEENNESS,
+                  STATS_CACHE_TYPE_EDGE,
+                  sizeof(double));
+
+  for (i = 0; i < nnodes; i++) {
+    stats_cache_update(g, STATS_CACHE_EDGE_BETWEENNESS, i, -1,
+                       edge_array_get_all(&betw, i));
+  }
+
+  edge_array_free(&betw);
+  free(sources);
+  return 0;
+
+fail:
+  if (betw.vals != NULL) edge_array_free(&betw);
+  if (sources   != NULL) free(sources);
+  return 1;
+}
+
+double stats_approx_betweenness_error(
+  uint32_t nnodes, uint64_t nvals, uint32_t nsamples, double delta) {
+
+  if (nsamples >= nnodes) return 0;
+  if (nsamples == 0)      return INFINITY;
+  if (nnodes   <  3)      return 0;
+
+  /*
+   * Each sampled source contributes a term in [0, n/(n-1)]
+   * to the normalised estimate, so Hoeffding's inequality
+   * (which also holds when sampling without replacement),
+   * with a union bound over all nvals values, gives the
+   * maximum deviation with probability at least 1-delta.
+   */
+  return (nnodes / (nnodes-1.0)) *
+    sqrt(log(2.0 * nvals / delta) / (2.0 * nsamples));
+}
+
+uint32_t *_sample_sources(graph_t *g, uint32_t *nsamples) {
+
+  uint64_t  i;
+  uint32_t  j;
+  uint32_t  tmp;
+  uint32_t  nnodes;
+  uint32_t *nodes;
+
+  nnodes = graph_num_nodes(g);
+
+  if (*nsamples > nnodes) *nsamples = nnodes;
+
+  nodes = malloc(nnodes*sizeof(uint32_t));
+  if (nodes == NULL) return NULL;
+
+  for (i = 0; i < nnodes; i++) nodes[i] = i;
+
+  /*partial Fisher-Yates shuffle*/
+  for (i = 0; i < *nsamples; i++) {
+
+    j        = i + rng_range(rng_default(), nnodes - i);
+    tmp      = nodes[i];
+    nodes[i] = nodes[j];
+    nodes[j] = tmp;
+  }
+
+  return nodes;
+}
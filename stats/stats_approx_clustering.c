@@ -5,16 +5,63 @@
  *   Schank T & Wagner D 2005. Approximating Clustering
  *   Coefficient and Transitivity. Journal of Graph
  *   Algorithms and Applications, 9:2:265-275
+ *
+ * Triples are drawn in fixed size batches, each with its own generator,
+ * so the batches may be tested in parallel, and the estimate does not
+ * depend upon the number of threads.
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "graph/graph.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "util/alias.h"
+#include "util/parallel.h"
+#include "util/rng.h"
+
+/**
+ * Number of triples in one batch.
+ */
+#define TRIPLE_BATCH 4096
+
+/**
+ * Number of batches which are tested between checks of the standard
+ * error, when a target standard error is given.
+ */
+#define ROUND_BATCHES 16
+
+/**
+ * Context passed to _test_batches.
+ */
+typedef struct _clust_ctx {
+
+  graph_t  *g;        /**< the graph                          */
+  alias_t  *centres;  /**< triple centre distribution         */
+  uint64_t  seed;     /**< seed of the first batch            */
+  uint64_t  ntriples; /**< total number of triples            */
+  uint64_t  first;    /**< index of the first batch to test   */
+  uint32_t *closed;   /**< number of closed triples per batch */
+
+} clust_ctx_t;
+
+/**
+ * parallel_for function - tests the triples in the batches in the range
+ * [first + start, first + end).
+ *
+ * \return 0 always.
+ */
+static uint8_t _test_batches(
+  uint64_t start,  /**< first batch, relative to ctx->first */
+  uint64_t end,    /**< one past last batch                 */
+  uint16_t thread, /**< calling thread                      */
+  void    *ctx     /**< pointer to clust_ctx_t              */
+);
 
 /**
  * Randomly selects and tests a triple (a set of 3 connected nodes) from the
@@ -24,63 +71,199 @@
  * connected), 0 otherwise.
  */
 static uint8_t _test_next_triple(
-  graph_t *g /**< the graph */
+  graph_t *g,       /**< the graph                  */
+  alias_t *centres, /**< triple centre distribution */
+  rng_t   *rng      /**< the generator              */
 );
 
 double stats_approx_clustering(graph_t *g, uint32_t ntriples) {
 
-  uint64_t i;
-  uint32_t ntriangles;
-  double   clust;
+  double clust;
+
+  if (stats_approx_clustering_err(g, ntriples, 0, &clust, NULL)) return -1;
 
-  for (i = 0, ntriangles = 0; i < ntriples; i++) {
+  return clust;
+}
+
+uint8_t stats_approx_clustering_err(
+  graph_t *g,
+  uint32_t ntriples,
+  double   target,
+  double  *clust,
+  double  *err) {
+
+  uint64_t     i;
+  uint64_t     nbatches;
+  uint64_t     last;
+  uint64_t     nclosed;
+  uint64_t     ntested;
+  uint32_t     nnodes;
+  uint32_t     deg;
+  double      *weights;
+  double       total;
+  double       p;
+  double       se;
+  alias_t      centres;
+  clust_ctx_t  ctx;
+
+  weights = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  memset(&centres, 0, sizeof(alias_t));
+  memset(&ctx,     0, sizeof(clust_ctx_t));
+
+  if (ntriples == 0) goto fail;
+  if (nnodes   == 0) goto fail;
+
+  weights = malloc(nnodes * sizeof(double));
+  if (weights == NULL) goto fail;
+
+  /*
+   * Each triple is equally likely to be drawn, so the
+   * centre of a triple is drawn in proportion to the
+   * number of triples centred upon each node
+   */
+  for (i = 0, total = 0; i < nnodes; i++) {
+
+    deg = graph_num_neighbours(g, i);
 
-    if (_test_next_triple(g)) ntriangles ++;
+    if (deg < 2) weights[i] = 0;
+    else         weights[i] = (double)deg * (deg - 1);
+
+    total += weights[i];
   }
 
-  clust = (double)ntriangles/ntriples;
+  /*no triples at all*/
+  if (total == 0) {
+
+    free(weights);
+    weights = NULL;
+    p       = 0;
+    se      = 0;
+    goto done;
+  }
+
+  if (alias_create(&centres, weights, nnodes)) goto fail;
+
+  free(weights);
+  weights = NULL;
+
+  nbatches = (ntriples + TRIPLE_BATCH - 1) / TRIPLE_BATCH;
 
+  ctx.g        = g;
+  ctx.centres  = &centres;
+  ctx.seed     = rng_next(rng_default());
+  ctx.ntriples = ntriples;
+  ctx.closed   = calloc(nbatches, sizeof(uint32_t));
+
+  if (ctx.closed == NULL) goto fail;
+
+  nclosed = 0;
+  ntested = 0;
+  p       = 0;
+  se      = 0;
+
+  /*
+   * Without a target, every batch is tested in one
+   * go; otherwise, the standard error is checked
+   * after every round of batches
+   */
+  while (ctx.first < nbatches) {
+
+    if (target > 0) last = ctx.first + ROUND_BATCHES;
+    else            last = nbatches;
+
+    if (last > nbatches) last = nbatches;
+
+    if (parallel_for(0, last - ctx.first, 1, &ctx, _test_batches))
+      goto fail;
+
+    for (i = ctx.first; i < last; i++) nclosed += ctx.closed[i];
+
+    if (last == nbatches) ntested  = ntriples;
+    else                  ntested  = last * TRIPLE_BATCH;
+
+    ctx.first = last;
+
+    p  = (double)nclosed / ntested;
+    se = sqrt(p * (1 - p) / ntested);
+
+    if (target > 0 && se <= target) break;
+  }
+
+  alias_free(&centres);
+  free(ctx.closed);
+
+done:
   stats_cache_add(g,
                   STATS_CACHE_APPROX_CLUSTERING,
                   STATS_CACHE_TYPE_GRAPH,
                   sizeof(double));
-  stats_cache_update(g, STATS_CACHE_APPROX_CLUSTERING, 0, -1, &clust);
+  stats_cache_update(g, STATS_CACHE_APPROX_CLUSTERING, 0, -1, &p);
 
-  return clust;
+  *clust = p;
+  if (err != NULL) *err = se;
+
+  return 0;
+
+fail:
+  if (weights    != NULL) free(weights);
+  if (ctx.closed != NULL) free(ctx.closed);
+  alias_free(&centres);
+  return 1;
 }
 
-uint8_t _test_next_triple(graph_t *g) {
+uint8_t _test_batches(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t     b;
+  uint64_t     i;
+  uint64_t     n;
+  uint32_t     closed;
+  rng_t        rng;
+  clust_ctx_t *cctx;
+
+  cctx = ctx;
+
+  for (b = cctx->first + start; b < cctx->first + end; b++) {
+
+    rng_seed(&rng, cctx->seed + b);
+
+    n = cctx->ntriples - b * TRIPLE_BATCH;
+    if (n > TRIPLE_BATCH) n = TRIPLE_BATCH;
+
+    for (i = 0, closed = 0; i < n; i++) {
+      if (_test_next_triple(cctx->g, cctx->centres, &rng)) closed++;
+    }
+
+    cctx->closed[b] = closed;
+  }
+
+  return 0;
+}
+
+uint8_t _test_next_triple(graph_t *g, alias_t *centres, rng_t *rng) {
 
   uint32_t  n;
   uint32_t  u;
   uint32_t  v;
-  uint32_t  nnodes;
   uint32_t  nnbrs;
   uint32_t *nbrs;
 
   /*
-   * 1. select a node, n, at random
+   * 1. select a triple centre, n, at random
    * 2. select two of n's neighbours, u and v, at random
    * 3. return true if u and v are neighbours of each other, 
    *    return false otherwise
    */
+  n     = alias_sample(centres, rng);
+  nnbrs = graph_num_neighbours(g, n);
+  nbrs  = graph_get_neighbours(g, n);
 
-  nnodes = graph_num_nodes(g);
-
-  nnbrs = 0;
-  while (nnbrs < 2) {
-    n     = ((uint32_t)rand()) % nnodes;
-    nnbrs = graph_num_neighbours(g, n);
-    nbrs  = graph_get_neighbours(g, n);
-  }
-
-  u = ((uint32_t)rand()) % nnbrs;
-  v = u;
+  u = rng_range(rng, nnbrs);
+  v = rng_range(rng, nnbrs - 1);
 
-  while (v == u) {
-
-    v = ((uint32_t)rand()) % nnbrs;
-  }
+  if (v >= u) v++;
 
   u = nbrs[u];
   v = nbrs[v];
@@ -0,0 +1,355 @@
+/**
+ * Provides a function which estimates the characteristic path length and
+ * global efficiency of a graph, by sampling source nodes. Each measure is
+ * the mean of a per-node value, so it is estimated by the mean over a
+ * uniform random sample of nodes, with a confidence interval from the
+ * sample variance:
+ *
+ *   Eppstein D & Wang J 2004. Fast approximation of centrality. Journal
+ *   of Graph Algorithms and Applications 8(1):39-45
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_compact.h"
+#include "graph/bfs.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "util/compare.h"
+#include "util/rng.h"
+
+/**
+ * z value for a 95% confidence interval.
+ */
+#define _Z95 1.959964
+
+/**
+ * State for the searches from the sampled nodes.
+ */
+typedef struct _approx_ctx {
+
+  double   *tally; /**< path length tally for each sample       */
+  uint32_t *count; /**< number of nodes reached by each sample  */
+  double   *invs;  /**< sum of inverse distances for each sample */
+
+} approx_ctx_t;
+
+/**
+ * Callback function for bfs_multi. Updates the path length tally and
+ * count, and the inverse distance sum, for each of the searches in the
+ * batch.
+ *
+ * \return 0 always.
+ */
+static uint8_t _bfs_multi_cb(
+  bfs_multi_state_t *state,  /**< search state                   */
+  void              *context /**< pointer to approx_ctx_t struct */
+);
+
+/**
+ * Calculates the mean of the given values, and the half-width of its
+ * 95% confidence interval, as an estimate of the mean of a population of
+ * the given size.
+ */
+static void _estimate(
+  double   *vals,  /**< sampled values                  */
+  uint32_t  k,     /**< number of values                */
+  uint32_t  n,     /**< population size                 */
+  double   *mean,  /**< place to store the mean         */
+  double   *err    /**< place to store the error        */
+);
+
+uint8_t stats_approx_paths(
+  graph_t *g, uint32_t nsamples, stats_approx_paths_t *paths) {
+
+  uint64_t     i;
+  uint32_t     nnodes;
+  uint32_t    *roots;
+  double      *pathlens;
+  double      *effs;
+  approx_ctx_t ctx;
+
+  roots    = NULL;
+  pathlens = NULL;
+  effs     = NULL;
+  nnodes   = graph_num_nodes(g);
+
+  memset(&ctx, 0, sizeof(approx_ctx_t));
+
+  if (nnodes   == 0)      goto fail;
+  if (nsamples == 0)      goto fail;
+  if (nsamples >  nnodes) nsamples = nnodes;
+
+  roots     = malloc(nnodes   * sizeof(uint32_t));
+  pathlens  = malloc(nsamples * sizeof(double));
+  effs      = malloc(nsamples * sizeof(double));
+  ctx.tally = calloc(nsamples,  sizeof(double));
+  ctx.count = calloc(nsamples,  sizeof(uint32_t));
+  ctx.invs  = calloc(nsamples,  sizeof(double));
+
+  if (roots     == NULL) goto fail;
+  if (pathlens  == NULL) goto fail;
+  if (effs      == NULL) goto fail;
+  if (ctx.tally == NULL) goto fail;
+  if (ctx.count == NULL) goto fail;
+  if (ctx.invs  == NULL) goto fail;
+
+  if (stats_approx_paths_sample(nnodes, nsamples, roots)) goto fail;
+
+  if (bfs_multi(g, roots, nsamples, NULL, 0, &ctx, _bfs_multi_cb))
+    goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_PATHLENGTH,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  for (i = 0; i < nsamples; i++) {
+
+    if (ctx.count[i] == 0) pathlens[i] = 0;
+    else                   pathlens[i] = ctx.tally[i] / ctx.count[i];
+
+    if (nnodes > 1) effs[i] = ctx.invs[i] / (nnodes - 1);
+    else            effs[i] = 0;
+
+    stats_cache_update(
+      g, STATS_CACHE_NODE_PATHLENGTH, roots[i], -1, pathlens + i);
+  }
+
+  stats_approx_paths_estimate(nnodes, nsamples, pathlens, effs, paths);
+
+  stats_cache_add(g,
+                  STATS_CACHE_APPROX_PATHS,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(stats_approx_paths_t));
+  stats_cache_update(g, STATS_CACHE_APPROX_PATHS, 0, -1, paths);
+
+  free(roots);
+  free(pathlens);
+  free(effs);
+  free(ctx.tally);
+  free(ctx.count);
+  free(ctx.invs);
+
+  return 0;
+
+fail:
+  if (roots     != NULL) free(roots);
+  if (pathlens  != NULL) free(pathlens);
+  if (effs      != NULL) free(effs);
+  if (ctx.tally != NULL) free(ctx.tally);
+  if (ctx.count != NULL) free(ctx.count);
+  if (ctx.invs  != NULL) free(ctx.invs);
+  return 1;
+}
+
+uint8_t stats_approx_paths_compact(
+  graph_compact_t *c, uint32_t nsamples, stats_approx_paths_t *paths) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint32_t  d;
+  uint32_t  maxd;
+  uint32_t  nnodes;
+  uint32_t  count;
+  double    tally;
+  double    invs;
+  uint32_t *roots;
+  uint32_t *dists;
+  uint32_t *queue;
+  uint32_t *sizes;
+  double   *pathlens;
+  double   *effs;
+
+  roots    = NULL;
+  dists    = NULL;
+  queue    = NULL;
+  sizes    = NULL;
+  pathlens = NULL;
+  effs     = NULL;
+  nnodes   = c->nnodes;
+
+  if (nnodes   == 0)      goto fail;
+  if (nsamples == 0)      goto fail;
+  if (nsamples >  nnodes) nsamples = nnodes;
+
+  roots    = malloc(nnodes   * sizeof(uint32_t));
+  dists    = malloc(nnodes   * sizeof(uint32_t));
+  queue    = malloc(nnodes   * sizeof(uint32_t));
+  sizes    = calloc(nnodes,    sizeof(uint32_t));
+  pathlens = malloc(nsamples * sizeof(double));
+  effs     = malloc(nsamples * sizeof(double));
+
+  if (roots    == NULL) goto fail;
+  if (dists    == NULL) goto fail;
+  if (queue    == NULL) goto fail;
+  if (sizes    == NULL) goto fail;
+  if (pathlens == NULL) goto fail;
+  if (effs     == NULL) goto fail;
+
+  if (stats_approx_paths_sample(nnodes, nsamples, roots)) goto fail;
+
+  for (i = 0; i < nsamples; i++) {
+
+    if (graph_compact_bfs(c, roots[i], dists, queue)) goto fail;
+
+    /*count the number of nodes at each distance*/
+    maxd = 0;
+    for (j = 0; j < nnodes; j++) {
+
+      d = dists[j];
+      if (d == 0 || d == GRAPH_COMPACT_NO_PATH) continue;
+
+      sizes[d]++;
+      if (d > maxd) maxd = d;
+    }
+
+    /*
+     * accumulated level by level, in the
+     * same order as by _bfs_multi_cb
+     */
+    tally = 0;
+    count = 0;
+    invs  = 0;
+    for (d = 1; d <= maxd; d++) {
+
+      if (sizes[d] == 0) continue;
+
+      tally += sizes[d]*d;
+      count += sizes[d];
+      invs  += (float)(sizes[d])/d;
+      sizes[d] = 0;
+    }
+
+    if (count == 0) pathlens[i] = 0;
+    else            pathlens[i] = tally / count;
+
+    if (nnodes > 1) effs[i] = invs / (nnodes - 1);
+    else            effs[i] = 0;
+  }
+
+  stats_approx_paths_estimate(nnodes, nsamples, pathlens, effs, paths);
+
+  free(roots);
+  free(dists);
+  free(queue);
+  free(sizes);
+  free(pathlens);
+  free(effs);
+
+  return 0;
+
+fail:
+  if (roots    != NULL) free(roots);
+  if (dists    != NULL) free(dists);
+  if (queue    != NULL) free(queue);
+  if (sizes    != NULL) free(sizes);
+  if (pathlens != NULL) free(pathlens);
+  if (effs     != NULL) free(effs);
+  return 1;
+}
+
+uint8_t _bfs_multi_cb(bfs_multi_state_t *state, void *context) {
+
+  uint64_t      i;
+  uint64_t      bits;
+  uint32_t      b;
+  approx_ctx_t *ctx;
+  uint32_t      sizes[BFS_MULTI_WIDTH];
+
+  ctx = (approx_ctx_t *)context;
+
+  memset(sizes, 0, sizeof(sizes));
+
+  /*count the number of nodes at this level, for each search*/
+  for (i = 0; i < state->nlevel; i++) {
+
+    bits = state->reached[state->level[i]];
+
+    while (bits) {
+      sizes[__builtin_ctzll(bits)]++;
+      bits &= bits - 1;
+    }
+  }
+
+  /*
+   * the inverse distances are accumulated in
+   * the same way as by stats_global_efficiency
+   */
+  for (b = 0; b < state->nroots; b++) {
+
+    if (sizes[b] == 0) continue;
+
+    ctx->tally[state->batch + b] += sizes[b]*(state->depth);
+    ctx->count[state->batch + b] += sizes[b];
+    ctx->invs[ state->batch + b] += (float)(sizes[b])/(state->depth);
+  }
+
+  return 0;
+}
+
+uint8_t stats_approx_paths_sample(
+  uint32_t nnodes, uint32_t k, uint32_t *roots) {
+
+  uint64_t i;
+  uint64_t j;
+  uint32_t tmp;
+
+  for (i = 0; i < nnodes; i++) roots[i] = i;
+
+  /*partial Fisher-Yates shuffle*/
+  for (i = 0; i < k && k < nnodes; i++) {
+
+    j        = i + rng_range(rng_default(), nnodes - i);
+    tmp      = roots[i];
+    roots[i] = roots[j];
+    roots[j] = tmp;
+  }
+
+  /*the searches are run, and cached, in node order*/
+  qsort(roots, k, sizeof(uint32_t), compare_u32);
+
+  return 0;
+}
+
+void stats_approx_paths_estimate(
+  uint32_t              nnodes,
+  uint32_t              nsamples,
+  double               *pathlens,
+  double               *effs,
+  stats_approx_paths_t *paths) {
+
+  paths->nsamples = nsamples;
+
+  _estimate(pathlens, nsamples, nnodes,
+            &paths->pathlength, &paths->pathlength_err);
+  _estimate(effs,     nsamples, nnodes,
+            &paths->efficiency, &paths->efficiency_err);
+}
+
+void _estimate(
+  double *vals, uint32_t k, uint32_t n, double *mean, double *err) {
+
+  uint64_t i;
+  double   var;
+
+  *mean = 0;
+  *err  = 0;
+
+  for (i = 0; i < k; i++) *mean += vals[i];
+  *mean /= k;
+
+  if (k < 2 || k >= n) return;
+
+  for (i = 0, var = 0; i < k; i++)
+    var += (vals[i] - *mean) * (vals[i] - *mean);
+
+  var /= (k - 1);
+
+  *err = _Z95 * sqrt((var / k) * ((double)(n - k) / (n - 1)));
+}
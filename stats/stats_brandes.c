@@ -0,0 +1,602 @@
+/**
+ * Parallel implementation of Brandes' algorithm for calculating node and
+ * edge betweenness.
+ *
+ *   Brandes U 2001. A faster algorithm for betweenness centrality.
+ *   Journal of Mathematical Sociology 25(2):163-177
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "graph/graph.h"
+#include "util/edge_array.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/progress.h"
+#include "stats/stats.h"
+
+/**
+ * Distance value for nodes which have not been reached by a search.
+ */
+#define BRANDES_UNREACHED 0xFFFFFFFF
+
+/**
+ * Path counts are rescaled, by a power of two, at any distance at which
+ * the largest count exceeds this value, so that they do not overflow.
+ */
+#define BRANDES_SCALE_LIMIT 0x1p512
+
+/**
+ * Number of blocks that the sources are split into (or one block per
+ * source, if there are fewer sources). This does not depend on the number
+ * of threads, so neither does the order in which results are added
+ * together.
+ */
+#define BRANDES_BLOCKS 256
+
+/**
+ * Workspace for one block of sources. Blocks are searched in waves of at
+ * most one block per workspace - each block is searched by a single
+ * thread, into the accumulators of its workspace, which are added to the
+ * totals, in block order, at the end of each wave.
+ */
+typedef struct _brandes_ws {
+
+  uint32_t *dist;    /**< distance from the source to each node        */
+  uint32_t *order;   /**< nodes in the order in which they were found   */
+  double   *sigma;   /**< number of shortest paths to each node         */
+  double   *delta;   /**< dependency of the source on each node         */
+  int32_t  *exps;    /**< binary exponent of the path counts at each
+                          distance - the number of shortest paths to a
+                          node is sigma * 2^exps[dist]                  */
+  double   *nodeacc; /**< node betweenness accumulator (may be NULL)    */
+  double   *edgeacc; /**< edge betweenness accumulator, indexed by
+                          slot (may be NULL)                            */
+
+} brandes_ws_t;
+
+/**
+ * Context shared between all threads.
+ */
+typedef struct _brandes_ctx {
+
+  graph_t      *g;
+  uint32_t     *sources;  /**< source nodes, or NULL for all nodes    */
+  uint32_t      nsources; /**< number of sources                      */
+  uint32_t      nblocks;  /**< number of blocks                       */
+  uint32_t      wave;     /**< first block of the current wave        */
+  uint64_t     *offsets;  /**< offset of each node's neighbours in the
+                               slots array                            */
+  uint64_t     *slots;    /**< index into the edge accumulators for
+                               each neighbour of every node - both
+                               directions of an edge share a slot,
+                               that of the edge from its lower end
+                               point                                  */
+  brandes_ws_t *ws;       /**< one workspace per block in a wave      */
+  stats_paths_t *paths;   /**< per-source path measures, or NULL      */
+
+} brandes_ctx_t;
+
+/**
+ * Does the work of stats_brandes and stats_brandes_paths.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _brandes(
+  graph_t       *g,        /**< graph to query                      */
+  uint32_t      *sources,  /**< source nodes, or NULL for all nodes */
+  uint32_t       nsources, /**< number of sources                   */
+  uint16_t       nthreads, /**< number of threads to use            */
+  double        *nodebetw, /**< place to store node values, or NULL */
+  edge_array_t  *edgebetw, /**< place to add edge values, or NULL   */
+  stats_paths_t *paths     /**< place to store per-source path
+                                measures, or NULL                   */
+);
+
+/**
+ * parallel_for function - runs the searches for blocks [start, end) of
+ * the current wave; block wave+b is searched with workspace b.
+ *
+ * \return 0 always.
+ */
+static uint8_t _brandes_blocks(
+  uint64_t start,  /**< first block                  */
+  uint64_t end,    /**< one past the last block      */
+  uint16_t thread, /**< calling thread               */
+  void    *vctx    /**< pointer to a brandes_ctx_t   */
+);
+
+/**
+ * Runs a single search from the given source, adding its contribution to
+ * the accumulators in the given workspace.
+ */
+static void _brandes_source(
+  brandes_ctx_t *ctx,   /**< shared context         */
+  brandes_ws_t  *ws,    /**< workspace for the block */
+  uint32_t       s      /**< the source             */
+);
+
+/**
+ * Rescales the path counts of the nodes in order[start, end), which are
+ * all at the same distance from the source, if the largest of them exceeds
+ * BRANDES_SCALE_LIMIT, and sets the exponent for that distance. Scaling by
+ * a power of two is exact, so counts which are not rescaled are identical
+ * to those of a search without scaling.
+ */
+static void _brandes_rescale(
+  brandes_ws_t *ws,    /**< workspace holding the search       */
+  uint64_t      start, /**< first node at the distance         */
+  uint64_t      end    /**< one past the last node             */
+);
+
+/**
+ * Calculates the per-source path measures for source s, from the search
+ * which has just been run from it, and stores them in ctx->paths.
+ */
+static void _brandes_paths(
+  brandes_ctx_t *ctx,  /**< shared context                          */
+  brandes_ws_t  *ws,   /**< workspace holding the search results    */
+  uint32_t       s,    /**< the source                              */
+  uint64_t       tail  /**< number of nodes reached from the source */
+);
+
+uint8_t stats_brandes(
+  graph_t      *g,
+  uint32_t     *sources,
+  uint32_t      nsources,
+  uint16_t      nthreads,
+  double       *nodebetw,
+  edge_array_t *edgebetw) {
+
+  PROFILE_FUNC();
+
+  return _brandes(g, sources, nsources, nthreads, nodebetw, edgebetw, NULL);
+}
+
+uint8_t stats_brandes_paths(
+  graph_t       *g,
+  uint32_t      *sources,
+  uint32_t       nsources,
+  uint16_t       nthreads,
+  double        *nodebetw,
+  stats_paths_t *paths) {
+
+  PROFILE_FUNC();
+
+  return _brandes(g, sources, nsources, nthreads, nodebetw, NULL, paths);
+}
+
+uint8_t _brandes(
+  graph_t       *g,
+  uint32_t      *sources,
+  uint32_t       nsources,
+  uint16_t       nthreads,
+  double        *nodebetw,
+  edge_array_t  *edgebetw,
+  stats_paths_t *paths) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       b;
+  uint64_t       nedges;
+  uint32_t       nnodes;
+  uint32_t       nws;
+  uint32_t       nwave;
+  uint32_t       nnbrs;
+  uint32_t      *nbrs;
+  int64_t        vidx;
+  double         val;
+  double        *edgetot;
+  brandes_ctx_t  ctx;
+  brandes_ws_t  *ws;
+
+  memset(&ctx, 0, sizeof(brandes_ctx_t));
+
+  edgetot = NULL;
+  nws     = 0;
+  nnodes  = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) goto fail;
+  if (sources == NULL)      nsources = nnodes;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads >  nsources)             nthreads = nsources;
+  if (nthreads == 0)                    nthreads = 1;
+
+  ctx.g        = g;
+  ctx.sources  = sources;
+  ctx.nsources = nsources;
+  ctx.nblocks  = nsources < BRANDES_BLOCKS ? nsources : BRANDES_BLOCKS;
+  ctx.paths    = paths;
+
+  if (ctx.nblocks == 0) ctx.nblocks = 1;
+
+  /*one workspace for every block that may be searched at once*/
+  nws = nthreads < ctx.nblocks ? nthreads : ctx.nblocks;
+
+  ctx.offsets = calloc(nnodes+1, sizeof(uint64_t));
+  ctx.ws      = calloc(nws, sizeof(brandes_ws_t));
+  if (ctx.offsets == NULL) goto fail;
+  if (ctx.ws      == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++)
+    ctx.offsets[i+1] = ctx.offsets[i] + graph_num_neighbours(g, i);
+
+  nedges = ctx.offsets[nnodes];
+
+  if (edgebetw != NULL) {
+
+    ctx.slots = malloc((nedges + 1) * sizeof(uint64_t));
+    edgetot   = calloc( nedges + 1,   sizeof(double));
+    if (ctx.slots == NULL) goto fail;
+    if (edgetot   == NULL) goto fail;
+
+    for (i = 0; i < nnodes; i++) {
+
+      nnbrs = graph_num_neighbours(g, i);
+      nbrs  = graph_get_neighbours(g, i);
+
+      for (j = 0; j < nnbrs; j++) {
+
+        if (nbrs[j] > i) {
+          ctx.slots[ctx.offsets[i] + j] = ctx.offsets[i] + j;
+          continue;
+        }
+
+        vidx = graph_get_nbr_idx(g, nbrs[j], i);
+        if (vidx < 0) goto fail;
+
+        ctx.slots[ctx.offsets[i] + j] = ctx.offsets[nbrs[j]] + vidx;
+      }
+    }
+  }
+
+  for (b = 0; b < nws; b++) {
+
+    ws = ctx.ws + b;
+
+    ws->dist  = malloc(nnodes*sizeof(uint32_t));
+    ws->order = malloc(nnodes*sizeof(uint32_t));
+    ws->sigma = calloc(nnodes, sizeof(double));
+    ws->delta = calloc(nnodes, sizeof(double));
+    ws->exps  = calloc(nnodes+1, sizeof(int32_t));
+
+    if (ws->dist  == NULL) goto fail;
+    if (ws->order == NULL) goto fail;
+    if (ws->sigma == NULL) goto fail;
+    if (ws->delta == NULL) goto fail;
+    if (ws->exps  == NULL) goto fail;
+
+    for (i = 0; i < nnodes; i++) ws->dist[i] = BRANDES_UNREACHED;
+
+    if (nodebetw != NULL) {
+      ws->nodeacc = calloc(nnodes, sizeof(double));
+      if (ws->nodeacc == NULL) goto fail;
+    }
+
+    if (edgebetw != NULL) {
+      ws->edgeacc = calloc(ctx.offsets[nnodes], sizeof(double));
+      if (ws->edgeacc == NULL) goto fail;
+    }
+  }
+
+  if (nodebetw != NULL) memset(nodebetw, 0, nnodes * sizeof(double));
+
+  for (ctx.wave = 0; ctx.wave < ctx.nblocks; ctx.wave += nwave) {
+
+    nwave = ctx.nblocks - ctx.wave;
+    if (nwave > nws) nwave = nws;
+
+    if (parallel_for(nthreads, nwave, 1, &ctx, _brandes_blocks))
+      goto fail;
+
+    /*
+     * Results are added to the totals in block order,
+     * so they do not depend upon how many blocks were
+     * searched at once, or how blocks were shared
+     * between threads.
+     */
+    for (b = 0; b < nwave; b++) {
+
+      ws = ctx.ws + b;
+
+      if (nodebetw != NULL) {
+        for (i = 0; i < nnodes; i++) nodebetw[i] += ws->nodeacc[i];
+        memset(ws->nodeacc, 0, nnodes * sizeof(double));
+      }
+
+      if (edgebetw != NULL) {
+        for (i = 0; i < nedges; i++) edgetot[i] += ws->edgeacc[i];
+        memset(ws->edgeacc, 0, nedges * sizeof(double));
+      }
+    }
+  }
+
+  if (edgebetw != NULL) {
+
+    for (i = 0; i < nnodes; i++) {
+
+      nnbrs = graph_num_neighbours(g, i);
+      nbrs  = graph_get_neighbours(g, i);
+
+      for (j = 0; j < nnbrs; j++) {
+
+        if (nbrs[j] < i) continue;
+
+        val  = *(double *)edge_array_get_by_idx(edgebetw, i, j);
+        val += edgetot[ctx.offsets[i] + j];
+
+        edge_array_set(edgebetw, i, nbrs[j], &val);
+      }
+    }
+  }
+
+  for (b = 0; b < nws; b++) {
+    ws = ctx.ws + b;
+    free(ws->dist);
+    free(ws->order);
+    free(ws->sigma);
+    free(ws->delta);
+    free(ws->exps);
+    if (ws->nodeacc != NULL) free(ws->nodeacc);
+    if (ws->edgeacc != NULL) free(ws->edgeacc);
+  }
+  free(ctx.ws);
+  free(ctx.offsets);
+  if (ctx.slots != NULL) free(ctx.slots);
+  if (edgetot   != NULL) free(edgetot);
+
+  return 0;
+
+fail:
+  if (ctx.ws != NULL) {
+    for (b = 0; b < nws; b++) {
+      ws = ctx.ws + b;
+      if (ws->dist    != NULL) free(ws->dist);
+      if (ws->order   != NULL) free(ws->order);
+      if (ws->sigma   != NULL) free(ws->sigma);
+      if (ws->delta   != NULL) free(ws->delta);
+      if (ws->exps    != NULL) free(ws->exps);
+      if (ws->nodeacc != NULL) free(ws->nodeacc);
+      if (ws->edgeacc != NULL) free(ws->edgeacc);
+    }
+    free(ctx.ws);
+  }
+  if (ctx.offsets != NULL) free(ctx.offsets);
+  if (ctx.slots   != NULL) free(ctx.slots);
+  if (edgetot     != NULL) free(edgetot);
+  return 1;
+}
+
+uint8_t _brandes_blocks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       b;
+  uint64_t       i;
+  uint64_t       blk;
+  uint64_t       first;
+  uint64_t       last;
+  uint32_t       s;
+  brandes_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (b = start; b < end; b++) {
+
+    blk   = ctx->wave + b;
+    first = (blk     * ctx->nsources) / ctx->nblocks;
+    last  = ((blk+1) * ctx->nsources) / ctx->nblocks;
+
+    for (i = first; i < last; i++) {
+
+      if (ctx->sources != NULL) s = ctx->sources[i];
+      else                      s = i;
+
+      _brandes_source(ctx, ctx->ws + b, s);
+    }
+
+    PROGRESS_ADD(PROGRESS_SOURCES, last - first);
+  }
+
+  return 0;
+}
+
+void _brandes_source(brandes_ctx_t *ctx, brandes_ws_t *ws, uint32_t s) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  head;
+  uint64_t  tail;
+  uint64_t  levelend;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  int32_t   shift;
+  double    c;
+  double    tally;
+
+  ws->dist [s] = 0;
+  ws->sigma[s] = 1;
+  ws->exps [0] = 0;
+  ws->order[0] = s;
+  head         = 0;
+  tail         = 1;
+  levelend     = 1;
+
+  /*count the shortest paths from s to every node*/
+  while (head < tail) {
+
+    /*
+     * all of the nodes at the next distance have been
+     * found, and their path counts are complete
+     */
+    if (head == levelend) {
+      _brandes_rescale(ws, levelend, tail);
+      levelend = tail;
+    }
+
+    u     = ws->order[head++];
+    nnbrs = graph_num_neighbours(ctx->g, u);
+    nbrs  = graph_get_neighbours(ctx->g, u);
+
+    for (j = 0; j < nnbrs; j++) {
+
+      v = nbrs[j];
+
+      if (ws->dist[v] == BRANDES_UNREACHED) {
+        ws->dist[v]       = ws->dist[u] + 1;
+        ws->order[tail++] = v;
+      }
+
+      if (ws->dist[v] == ws->dist[u] + 1) ws->sigma[v] += ws->sigma[u];
+    }
+  }
+
+  if (ctx->paths != NULL) _brandes_paths(ctx, ws, s, tail);
+
+  /*there are no dependencies to accumulate if only paths were wanted*/
+  if (ws->nodeacc == NULL && ws->edgeacc == NULL) goto reset;
+
+  /*
+   * Accumulate dependencies, from the furthest nodes
+   * back to the source. The dependency of a node is the
+   * sum of the shares of the dependencies of its
+   * neighbours which are further away from the source.
+   */
+  for (i = tail; i > 0; i--) {
+
+    u     = ws->order[i-1];
+    nnbrs = graph_num_neighbours(ctx->g, u);
+    nbrs  = graph_get_neighbours(ctx->g, u);
+    tally = 0;
+
+    /*
+     * difference in scale between u and the nodes after
+     * it (meaningless, but unused, if there are none)
+     */
+    shift = ws->exps[ws->dist[u]] - ws->exps[ws->dist[u]+1];
+
+    for (j = 0; j < nnbrs; j++) {
+
+      v = nbrs[j];
+
+      if (ws->dist[v] <= ws->dist[u]) continue;
+
+      if (shift == 0)
+        c = (1 + ws->delta[v]) * (ws->sigma[u] / ws->sigma[v]);
+      else
+        c = (1 + ws->delta[v]) * ldexp(ws->sigma[u] / ws->sigma[v], shift);
+
+      tally += c;
+
+      if (ws->edgeacc != NULL)
+        ws->edgeacc[ctx->slots[ctx->offsets[u] + j]] += c / 2.0;
+    }
+
+    ws->delta[u] = tally;
+
+    if (ws->nodeacc != NULL && u != s) ws->nodeacc[u] += tally;
+  }
+
+reset:
+  /*reset the workspace for the next search*/
+  for (i = 0; i < tail; i++) {
+    u            = ws->order[i];
+    ws->dist [u] = BRANDES_UNREACHED;
+    ws->sigma[u] = 0;
+    ws->delta[u] = 0;
+  }
+}
+
+void _brandes_paths(
+  brandes_ctx_t *ctx, brandes_ws_t *ws, uint32_t s, uint64_t tail) {
+
+  uint64_t i;
+  uint64_t size;
+  uint32_t depth;
+  int32_t  exp;
+  double   tally;
+  double   invdist;
+  double   numpaths;
+
+  tally    = 0;
+  invdist  = 0;
+  numpaths = 0;
+  exp      = 0;
+
+  /*
+   * Nodes are in order of distance from the source, so the
+   * nodes at each distance are visited together. The sums
+   * are calculated in the same way, and in the same order,
+   * as by stats_pathlength, stats_global_efficiency and
+   * stats_numpaths, so the results are identical to theirs.
+   */
+  for (i = 1; i < tail; i += size) {
+
+    depth = ws->dist[ws->order[i]];
+
+    /*
+     * the total is kept at the scale of the current
+     * distance, which never decreases
+     */
+    if (ws->exps[depth] != exp) {
+      numpaths = ldexp(numpaths, exp - ws->exps[depth]);
+      exp      = ws->exps[depth];
+    }
+
+    for (size = 0; i+size < tail; size++) {
+
+      if (ws->dist[ws->order[i+size]] != depth) break;
+      numpaths += ws->sigma[ws->order[i+size]];
+    }
+
+    tally   += size*depth;
+    invdist += (float)(size)/(depth);
+  }
+
+  if (ctx->paths->pathlength != NULL) {
+    if (tail == 1) ctx->paths->pathlength[s] = 0;
+    else           ctx->paths->pathlength[s] = tally / (tail-1);
+  }
+
+  if (ctx->paths->invdist  != NULL) ctx->paths->invdist [s] = invdist;
+  if (ctx->paths->numpaths != NULL)
+    ctx->paths->numpaths[s] = ldexp(numpaths, exp);
+
+  if (ctx->paths->lognumpaths != NULL) {
+    if (numpaths == 0) ctx->paths->lognumpaths[s] = -INFINITY;
+    else ctx->paths->lognumpaths[s] = log(numpaths) + exp * M_LN2;
+  }
+}
+
+void _brandes_rescale(brandes_ws_t *ws, uint64_t start, uint64_t end) {
+
+  uint64_t i;
+  uint32_t depth;
+  int      exp;
+  double   max;
+
+  depth = ws->dist[ws->order[start]];
+  max   = 0;
+
+  ws->exps[depth] = ws->exps[depth-1];
+
+  for (i = start; i < end; i++) {
+    if (ws->sigma[ws->order[i]] > max) max = ws->sigma[ws->order[i]];
+  }
+
+  if (max <= BRANDES_SCALE_LIMIT) return;
+
+  frexp(max, &exp);
+
+  for (i = start; i < end; i++)
+    ws->sigma[ws->order[i]] = ldexp(ws->sigma[ws->order[i]], -exp);
+
+  ws->exps[depth] += exp;
+}
@@ -7,40 +7,356 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "graph/graph.h"
+#include "graph/graph_event.h"
 #include "util/array.h"
+#include "util/bigmem.h"
+#include "util/profile.h"
+#include "util/memacct.h"
 #include "stats/stats_cache.h"
 
+/**
+ * The values of a field which may be affected by the
+ * addition or removal of an edge (u, v).
+ */
+typedef enum {
+
+  EDIT_SCOPE_NONE,      /**< no values                                */
+  EDIT_SCOPE_ENDPOINTS, /**< values for u and v                       */
+  EDIT_SCOPE_NBRHOOD,   /**< values for u, v and common neighbours    */
+  EDIT_SCOPE_COMPONENT, /**< values for all nodes in the component(s)
+                             containing u and v                       */
+  EDIT_SCOPE_ALL,       /**< all values                               */
+  EDIT_SCOPE_COUNT      /**< none - the value is a count of edges,
+                             which is adjusted in place                */
+
+} edit_scope_t;
+
 /**
  * Frees the memory used by the given cache. Called by graph_free.
  */
 static void _cache_free(void *cache);
 
 /**
- * Reads data from the given cache file.
+ * Does the work of stats_cache_add; the entry list lock must be held for
+ * writing.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _cache_add(
+  stats_cache_t *c,    /**< the cache          */
+  uint16_t       id,   /**< field ID           */
+  cache_type_t   type, /**< field type         */
+  uint16_t       size  /**< size of one value  */
+);
+
+/**
+ * Does the work of stats_cache_check. The entry list lock is held for
+ * reading throughout, so the field cannot be evicted while it is in use;
+ * the field values are accessed under the shard lock(s) of the node(s)
+ * concerned.
+ *
+ * \return see stats_cache_check.
+ */
+static int8_t _cache_check(
+  stats_cache_t *c,  /**< the cache                  */
+  uint16_t       id, /**< field ID                   */
+  uint32_t       u,  /**< node                       */
+  int64_t        v,  /**< second node, if applicable */
+  void          *d   /**< place to store value(s)    */
+);
+
+/**
+ * Does the work of stats_cache_update. Locking is as for _cache_check.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _cache_update(
+  stats_cache_t *c,  /**< the cache                  */
+  uint16_t       id, /**< field ID                   */
+  uint32_t       u,  /**< node                       */
+  int64_t        v,  /**< second node, if applicable */
+  void          *d   /**< value(s) to store          */
+);
+
+/**
+ * Graph event callback, called when an edge is added to the graph.
+ * Invalidates the values which are affected by the new edge.
+ */
+static void _edge_added(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the cache                    */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx, /**< index of v in u's neighbours */
+  float    wt    /**< edge weight                  */
+);
+
+/**
+ * Graph event callback, called when an edge is removed from the graph.
+ * Invalidates the values which are affected by the removal.
+ */
+static void _edge_removed(
+  graph_t *g,    /**< the graph                    */
+  void    *ctx,  /**< the cache                    */
+  uint32_t u,    /**< edge start point             */
+  uint32_t v,    /**< edge end point               */
+  uint32_t uidx, /**< index of u in v's neighbours */
+  uint32_t vidx  /**< index of v in u's neighbours */
+);
+
+/**
+ * Graph event callback, called when the neighbour lists of the graph have
+ * been rebuilt. Invalidates every value in the cache.
+ */
+static void _edges_rebuilt(
+  graph_t *g,  /**< the graph */
+  void    *ctx /**< the cache */
+);
+
+/**
+ * Invalidates the values which are affected by the addition or removal of
+ * the edge (u, v). The graph has already been modified.
+ */
+static void _invalidate_edit(
+  stats_cache_t *c,    /**< the cache                                */
+  uint32_t       u,    /**< edge start point                         */
+  uint32_t       v,    /**< edge end point                           */
+  uint8_t        added /**< non-0 if the edge was added, 0 if removed */
+);
+
+/**
+ * Adjusts a cached intra- or inter-community edge count (see
+ * stats_num_intra_edges) after the addition or removal of the edge (u, v).
+ * Nothing is done if the count has not been cached.
+ */
+static void _update_count(
+  stats_cache_t *c,    /**< the cache                  */
+  cache_entry_t *e,    /**< the field                  */
+  uint32_t       u,    /**< edge start point           */
+  uint32_t       v,    /**< edge end point             */
+  uint8_t        added /**< non-0 if the edge was added */
+);
+
+/**
+ * Adjusts the degree distribution after the addition or removal of the
+ * edge (u, v) - the graph has already been modified. The distribution is
+ * marked as out of date for directed graphs, or if it cannot be grown.
+ */
+static void _update_degrees(
+  stats_cache_t *c,    /**< the cache                  */
+  uint32_t       u,    /**< edge start point           */
+  uint32_t       v,    /**< edge end point             */
+  uint8_t        added /**< non-0 if the edge was added */
+);
+
+/**
+ * Builds the degree distribution from scratch. The entry list lock must be
+ * held for writing.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _build_degrees(
+  stats_cache_t *c /**< the cache */
+);
+
+/**
+ * \return the values of the given field which may be affected by the
+ * addition or removal of the edge (u, v).
+ */
+static edit_scope_t _edit_scope(
+  stats_cache_t *c,     /**< the cache                               */
+  cache_entry_t *e,     /**< the field                               */
+  uint32_t       u,     /**< edge start point                        */
+  uint32_t       v,     /**< edge end point                          */
+  uint8_t        added, /**< non-0 if the edge was added             */
+  uint8_t       *cmp    /**< nodes in the component(s) of u and v,
+                             as returned by _edit_component; may
+                             be NULL                                 */
+);
+
+/**
+ * Identifies the nodes in the component(s) containing u and v, once an
+ * edge (u, v) has been added or removed. Only used for undirected graphs.
+ *
+ * \return a newly allocated array containing 1 for every node which is
+ * reachable from u, 2 for every other node which is reachable from v, and
+ * 0 for all other nodes, or NULL on failure.
+ */
+static uint8_t *_edit_component(
+  stats_cache_t *c, /**< the cache        */
+  uint32_t       u, /**< edge start point */
+  uint32_t       v  /**< edge end point   */
+);
+
+/**
+ * Marks the values of the given field for node u as not cached.
+ */
+static void _invalidate_node(
+  stats_cache_t *c, /**< the cache */
+  cache_entry_t *e, /**< the field */
+  uint32_t       u  /**< the node  */
+);
+
+/**
+ * Marks every value of the given field as not cached.
+ */
+static void _invalidate_field(
+  stats_cache_t *c, /**< the cache */
+  cache_entry_t *e  /**< the field */
+);
+
+/**
+ * Identifies a file created by stats_cache_save.
+ */
+#define STATS_CACHE_FILE_MAGIC 0x48434143454e4343ULL
+
+/**
+ * \return a 64 bit FNV-1a hash of the given graph - its size, edges, edge
+ * weights and node labels.
+ */
+static uint64_t _graph_hash(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Adds the given bytes to a 64 bit FNV-1a hash.
+ *
+ * \return the updated hash.
+ */
+static uint64_t _fnv1a(
+  uint64_t hash, /**< hash so far          */
+  void    *data, /**< data to add          */
+  uint64_t len   /**< number of bytes      */
+);
+
+/**
+ * Writes the values of the given cache field to the given file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _save_field(
+  stats_cache_t *c,  /**< the cache          */
+  cache_entry_t *e,  /**< the field to save  */
+  FILE          *fd  /**< file to write to   */
+);
+
+/**
+ * Reads the values of the given cache field, which has already been added
+ * to the cache, from the given file.
  *
- * \return 0 on success, non-0 otherwise.
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _load_field(
+  stats_cache_t *c,  /**< the cache          */
+  cache_entry_t *e,  /**< the field to load  */
+  FILE          *fd  /**< file to read from  */
+);
+
+/**
+ * Locks the shard(s) of the given node(s). If v is not negative, and the
+ * two nodes live in different shards, both shards are locked, lowest
+ * first.
+ */
+static void _lock_shards(
+  stats_cache_t *c, /**< the cache                           */
+  uint32_t       u, /**< first node                          */
+  int64_t        v  /**< second node, or negative for none   */
+);
+
+/**
+ * Unlocks the shard(s) locked by _lock_shards.
  */
-static uint8_t _file_cache_read(
-  FILE    *fd,    /**< file handle                                        */
-  void    *data,  /**< place to store data (must be nvals*size in length) */
-  uint32_t nvals, /**< number of values to read                           */
-  uint16_t size,  /**< size of one value                                  */
-  long     offset /**< offset into file                                   */
+static void _unlock_shards(
+  stats_cache_t *c, /**< the cache                           */
+  uint32_t       u, /**< first node                          */
+  int64_t        v  /**< second node, or negative for none   */
 );
 
 /**
- * Writes data to the given cache file.
+ * Copies the values for node u out of the given pair cache field,
+ * converting them from the storage format.
+ */
+static void _pair_row_read(
+  cache_entry_t *e,      /**< the pair field                           */
+  uint32_t       nnodes, /**< number of nodes in the graph             */
+  uint32_t       u,      /**< the node                                 */
+  void          *data    /**< place to store nnodes values             */
+);
+
+/**
+ * Copies the given values for node u into the given pair cache field,
+ * converting them to the storage format.
+ */
+static void _pair_row_write(
+  cache_entry_t *e,      /**< the pair field                           */
+  uint32_t       nnodes, /**< number of nodes in the graph             */
+  uint32_t       u,      /**< the node                                 */
+  void          *data    /**< nnodes values to store                   */
+);
+
+/**
+ * Looks up the entry with the given ID, and marks it as the most recently
+ * used entry. The entry list lock must be held, for reading or writing.
  *
- * \return 0 on success, non-0 otherwise.
+ * \return 1 if the entry was found, 0 otherwise.
+ */
+static uint8_t _touch_cache_entry(
+  stats_cache_t *c,    /**< the cache                        */
+  uint16_t       id,   /**< id to search for                 */
+  cache_entry_t *entry /**< place to store the entry if found */
+);
+
+/**
+ * \return the number of bytes of memory (or, for pair-level fields, of
+ * cached rows) used by the given entry.
+ */
+static uint64_t _entry_bytes(
+  stats_cache_t *c, /**< the cache */
+  cache_entry_t *e  /**< the entry */
+);
+
+/**
+ * Brings the bytes accounted to every entry (see util/memacct.h) up to
+ * date. Edge-level fields are not included, as the edge arrays which hold
+ * them are accounted for themselves. The entry list lock must be held for
+ * writing.
  */
-static uint8_t _file_cache_write(
-  FILE    *fd,    /**< file handle                                  */
-  void    *data,  /**< data to write (must be nvals*size in length) */
-  uint32_t nvals, /**< number of values to write                    */
-  uint16_t size,  /**< size of one value                            */
-  long     offset /**< offset into file                             */
+static void _account_entries(
+  stats_cache_t *c /**< the cache */
+);
+
+/**
+ * Adds (or removes) the bytes of one newly cached (or invalidated) row of
+ * a pair-level field to the bytes accounted to its entry. May be called
+ * with the entry list lock held for reading.
+ */
+static void _account_row(
+  cache_entry_t *e,     /**< the entry                        */
+  uint64_t       bytes, /**< size of a row                    */
+  uint8_t        add    /**< non-0 to add, 0 to remove        */
+);
+
+/**
+ * Evicts the least recently used entries from the cache until it is within
+ * its memory budget, if it has one. The entry with the given ID is never
+ * evicted. The entry list lock must be held for writing.
+ */
+static void _enforce_budget(
+  stats_cache_t *c,   /**< the cache                               */
+  int32_t        keep /**< ID of an entry to keep, or -1 for none  */
+);
+
+/**
+ * Frees the memory used by the given entry, according to its type.
+ */
+static void _free_entry(
+  cache_entry_t *e /**< the entry to free */
 );
 
 /**
@@ -179,7 +495,9 @@ static int8_t _check_pair_field(
 /**
  * Check to see if data has been cached for the given edge field, for the
  * given node. If there is cached data, and the 'd' pointer is not NULL, the
- * data is copied into the 'data' pointer.
+ * data is copied into the 'data' pointer - the values for every edge of u
+ * if v is negative, or otherwise just the value for the edge between u and
+ * v.
  *
  * \return 1 if data is cached, 0 if it is not, -1 on failure.
  */
@@ -260,271 +578,1604 @@ static void _free_graph_field(
   cache_entry_t *c /**< graph entry to free */
 );
 
-/**
- * Frees the memory used by the given list cache.
- */
-static void _free_list_field(
-  cache_entry_t *c /**< list entry to free */
-);
+/**
+ * Frees the memory used by the given list cache.
+ */
+static void _free_list_field(
+  cache_entry_t *c /**< list entry to free */
+);
+
+/**
+ * Frees the memory used by the given node cache.
+ */
+static void _free_node_field(
+  cache_entry_t *c /**< node entry to free */
+);
+
+/**
+ * Frees the memory used by the given pair cache.
+ */
+static void _free_pair_field(
+  cache_entry_t *c /**< pair entry to free */
+);
+
+/**
+ * Frees the memory used by the given edge cache.
+ */
+static void _free_edge_field(
+  cache_entry_t *c /**< edge entry to free */
+);
+
+uint8_t stats_cache_init(graph_t *g) {
+
+  uint64_t       i;
+  uint32_t       nnodes;
+  stats_cache_t *c;
+
+  c      = NULL;
+
+  /*allocate space for the cache struct*/
+  c = calloc(1, sizeof(stats_cache_t));
+  if (c == NULL) goto fail;
+  
+  c->g = g;
+
+  /*
+   * under a memory budget, the cache gets whatever is
+   * left of it - 0 means no limit, so at least 1 byte
+   */
+  if (memacct_budget() > 0) {
+
+    c->budget = memacct_remaining();
+    if (c->budget == 0) c->budget = 1;
+
+    nnodes = graph_num_nodes(g);
+    if (!memacct_fits((uint64_t)nnodes * nnodes * sizeof(double)))
+      c->compact = 1;
+  }
+
+  if (pthread_rwlock_init(&c->lock, NULL)) {
+    free(c);
+    c = NULL;
+    goto fail;
+  }
+
+  for (i = 0; i < STATS_CACHE_NUM_SHARDS; i++)
+    pthread_mutex_init(c->shards+i, NULL);
+  
+  /*initialise cache struct fields*/
+  if (array_create(&(c->cache_entries), sizeof(cache_entry_t), 5)) goto fail;
+  array_set_cmps(&c->cache_entries, _entry_cmp, NULL);
+
+  c->gel.ctx           = c;
+  c->gel.edge_added    = _edge_added;
+  c->gel.edge_removed  = _edge_removed;
+  c->gel.edges_rebuilt = _edges_rebuilt;
+
+  if (graph_add_event_listener(g, &c->gel)) {
+    c->gel.ctx = NULL;
+    goto fail;
+  }
+
+  /*attach the cache to the graph*/
+  g->ctx[     _GRAPH_STATS_CACHE_CTX_LOC_] = c;
+  g->ctx_free[_GRAPH_STATS_CACHE_CTX_LOC_] = _cache_free;
+
+  return 0;
+  
+fail:
+  if (c != NULL) _cache_free(c);
+  return 1;
+}
+
+uint8_t stats_cache_reset(graph_t *g) {
+
+  stats_cache_t *c;
+  uint64_t       budget;
+  uint8_t        compact;
+  uint32_t       pathsamples;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+
+  if (c == NULL) goto fail;
+
+  /*settings survive a reset*/
+  budget      = c->budget;
+  compact     = c->compact;
+  pathsamples = c->pathsamples;
+
+  _cache_free(c);
+
+  if (stats_cache_init(g)) goto fail;
+
+  c              = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  c->budget      = budget;
+  c->compact     = compact;
+  c->pathsamples = pathsamples;
+
+  return 0;
+  
+fail:
+  return 1;
+}
+
+uint8_t stats_cache_add(
+  graph_t *g, uint16_t id, cache_type_t type, uint16_t size) {
+
+  stats_cache_t *c;
+  uint8_t        res;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  pthread_rwlock_wrlock(&c->lock);
+  res = _cache_add(c, id, type, size);
+  pthread_rwlock_unlock(&c->lock);
+
+  return res;
+}
+
+int8_t stats_cache_check(
+  graph_t *g, uint16_t id, uint32_t u, int64_t v, void *d) {
+
+  int8_t         hit;
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+
+  if (c == NULL)                 return 0;
+  if (u >= graph_num_nodes(g))   return -1;
+
+  hit = _cache_check(c, id, u, v, d);
+
+  if (hit == 1) PROFILE_COUNT(PROFILE_CACHE_HITS,   1);
+  else          PROFILE_COUNT(PROFILE_CACHE_MISSES, 1);
+
+  return hit;
+}
+
+uint8_t stats_cache_update(
+  graph_t *g, uint16_t id, uint32_t u, int64_t v, void *d) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+
+  if (u >= graph_num_nodes(g)) return 1;
+  if (c == NULL)               return 0;
+
+  return _cache_update(c, id, u, v, d);
+}
+
+uint8_t stats_cache_degree_dist(
+  graph_t *g, uint32_t *maxdeg, uint32_t *hist) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  pthread_rwlock_wrlock(&c->lock);
+
+  if (!c->degvalid && _build_degrees(c)) {
+    pthread_rwlock_unlock(&c->lock);
+    return 1;
+  }
+
+  *maxdeg = c->maxdeg;
+  if (hist != NULL)
+    memcpy(hist, c->deghist, ((uint64_t)c->maxdeg + 1) * sizeof(uint32_t));
+
+  pthread_rwlock_unlock(&c->lock);
+
+  return 0;
+}
+
+uint8_t stats_cache_save(graph_t *g, char *fname) {
+
+  uint64_t       i;
+  uint64_t       hdr[3];
+  stats_cache_t *c;
+  cache_entry_t  e;
+  FILE          *fd;
+  char          *tmpname;
+
+  fd      = NULL;
+  tmpname = NULL;
+  c       = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+
+  if (c == NULL) goto fail;
+
+  /*
+   * the file is written under a temporary name, and
+   * renamed into place once it is complete, so a save
+   * which is interrupted never leaves a truncated file
+   * with a valid header behind
+   */
+  tmpname = malloc(strlen(fname) + 5);
+  if (tmpname == NULL) goto fail;
+  sprintf(tmpname, "%s.tmp", fname);
+
+  fd = fopen(tmpname, "wb");
+  if (fd == NULL) goto fail;
+
+  hdr[0] = STATS_CACHE_FILE_MAGIC;
+  hdr[1] = _graph_hash(g);
+  hdr[2] = c->cache_entries.size;
+
+  pthread_rwlock_rdlock(&c->lock);
+
+  if (fwrite(hdr, sizeof(hdr), 1, fd) != 1) goto unlock;
+
+  for (i = 0; i < c->cache_entries.size; i++) {
+
+    array_get(&(c->cache_entries), i, &e);
+
+    if (fwrite(&e.id,   sizeof(e.id),   1, fd) != 1) goto unlock;
+    if (fwrite(&e.type, sizeof(e.type), 1, fd) != 1) goto unlock;
+    if (fwrite(&e.size, sizeof(e.size), 1, fd) != 1) goto unlock;
+    if (_save_field(c, &e, fd))                      goto unlock;
+  }
+
+  pthread_rwlock_unlock(&c->lock);
+
+  if (fclose(fd)) {
+    fd = NULL;
+    goto fail;
+  }
+  fd = NULL;
+
+  if (rename(tmpname, fname)) goto fail;
+
+  free(tmpname);
+  return 0;
+
+unlock:
+  pthread_rwlock_unlock(&c->lock);
+fail:
+  if (fd      != NULL) fclose(fd);
+  if (tmpname != NULL) {
+    remove(tmpname);
+    free(tmpname);
+  }
+  return 1;
+}
+
+uint8_t stats_cache_load(graph_t *g, char *fname) {
+
+  uint64_t       i;
+  uint64_t       hdr[3];
+  stats_cache_t *c;
+  cache_entry_t  e;
+  FILE          *fd;
+
+  fd = NULL;
+  c  = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+
+  if (c == NULL) goto fail;
+
+  fd = fopen(fname, "rb");
+  if (fd == NULL) return 0;
+
+  /*not a cache file, or saved from a different graph*/
+  if (fread(hdr, sizeof(hdr), 1, fd) != 1 ||
+      hdr[0] != STATS_CACHE_FILE_MAGIC    ||
+      hdr[1] != _graph_hash(g)) {
+    fclose(fd);
+    return 0;
+  }
+
+  for (i = 0; i < hdr[2]; i++) {
+
+    if (fread(&e.id,   sizeof(e.id),   1, fd) != 1)  goto corrupt;
+    if (fread(&e.type, sizeof(e.type), 1, fd) != 1)  goto corrupt;
+    if (fread(&e.size, sizeof(e.size), 1, fd) != 1)  goto corrupt;
+    if (stats_cache_add(g, e.id, e.type, e.size))    goto corrupt;
+
+    pthread_rwlock_rdlock(&c->lock);
+    _get_cache_entry(&(c->cache_entries), e.id, &e);
+    pthread_rwlock_unlock(&c->lock);
+
+    if (_load_field(c, &e, fd)) goto corrupt;
+  }
+
+  /*the loaded rows have not been accounted for*/
+  pthread_rwlock_wrlock(&c->lock);
+  _account_entries(c);
+  pthread_rwlock_unlock(&c->lock);
+
+  fclose(fd);
+  return 0;
+
+/*
+ * the file is truncated or unreadable - the entries
+ * loaded so far are discarded, and the values are
+ * recalculated, as if the file did not match
+ */
+corrupt:
+  fclose(fd);
+  fd = NULL;
+  if (stats_cache_reset(g)) goto fail;
+  return 0;
+
+fail:
+  if (fd != NULL) fclose(fd);
+  return 1;
+}
+
+uint8_t stats_cache_compact_pairs(graph_t *g, uint8_t compact) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  c->compact = compact;
+
+  return 0;
+}
+
+uint8_t stats_cache_set_budget(graph_t *g, uint64_t budget) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  pthread_rwlock_wrlock(&c->lock);
+  c->budget = budget;
+  _enforce_budget(c, -1);
+  pthread_rwlock_unlock(&c->lock);
+
+  return 0;
+}
+
+uint8_t stats_cache_set_path_samples(graph_t *g, uint32_t nsamples) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  c->pathsamples = nsamples;
+
+  return 0;
+}
+
+uint32_t stats_cache_path_samples(graph_t *g) {
+
+  stats_cache_t *c;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 0;
+
+  return c->pathsamples;
+}
+
+uint8_t stats_cache_usage(graph_t *g, array_t *usage, uint64_t *total) {
+
+  uint64_t             i;
+  stats_cache_t       *c;
+  cache_entry_t       *e;
+  stats_cache_usage_t  u;
+
+  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  if (c == NULL) return 1;
+
+  if (total != NULL) *total = 0;
+
+  pthread_rwlock_rdlock(&c->lock);
+
+  for (i = 0; i < c->cache_entries.size; i++) {
+
+    e = array_getd(&(c->cache_entries), i);
+
+    u.id       = e->id;
+    u.type     = e->type;
+    u.bytes    = _entry_bytes(c, e);
+    u.lastused = __atomic_load_n(&e->lastused, __ATOMIC_RELAXED);
+
+    if (total != NULL) *total += u.bytes;
+
+    if (usage != NULL && array_append(usage, &u)) {
+      pthread_rwlock_unlock(&c->lock);
+      return 1;
+    }
+  }
+
+  pthread_rwlock_unlock(&c->lock);
+
+  return 0;
+}
+
+char * stats_cache_field_name(uint16_t id) {
+
+  switch (id) {
+    case STATS_CACHE_APPROX_CLUSTERING:      return "approx clustering";
+    case STATS_CACHE_GRAPH_CLUSTERING:       return "graph clustering";
+    case STATS_CACHE_GRAPH_PATHLENGTH:       return "graph pathlength";
+    case STATS_CACHE_ASSORTATIVITY:          return "assortativity";
+    case STATS_CACHE_NUM_COMPONENTS:         return "num components";
+    case STATS_CACHE_LARGEST_COMPONENT:      return "largest component";
+    case STATS_CACHE_CONNECTED:              return "connected";
+    case STATS_CACHE_GLOBAL_EFFICIENCY:      return "global efficiency";
+    case STATS_CACHE_LOCAL_EFFICIENCY:       return "local efficiency";
+    case STATS_CACHE_MODULARITY:             return "modularity";
+    case STATS_CACHE_INTRA_EDGES:            return "intra edges";
+    case STATS_CACHE_INTER_EDGES:            return "inter edges";
+    case STATS_CACHE_MAX_DEGREE:             return "max degree";
+    case STATS_CACHE_CHIRA:                  return "chira";
+    case STATS_CACHE_NODE_CLUSTERING:        return "node clustering";
+    case STATS_CACHE_NODE_PATHLENGTH:        return "node pathlength";
+    case STATS_CACHE_NODE_LOCAL_EFFICIENCY:  return "node local efficiency";
+    case STATS_CACHE_BETWEENNESS_CENTRALITY: return "betweenness centrality";
+    case STATS_CACHE_NODE_NUMPATHS:          return "node numpaths";
+    case STATS_CACHE_NODE_COMPONENT:         return "node component";
+    case STATS_CACHE_NODE_EDGEDIST:          return "node edgedist";
+    case STATS_CACHE_PAIR_PATHLENGTH:        return "pair pathlength";
+    case STATS_CACHE_PAIR_NUMPATHS:          return "pair numpaths";
+    case STATS_CACHE_EDGE_PATHSHARING:       return "edge pathsharing";
+    case STATS_CACHE_EDGE_BETWEENNESS:       return "edge betweenness";
+    case STATS_CACHE_DEGREE_SUMMARY:         return "degree summary";
+    case STATS_CACHE_NODE_CORENESS:          return "node coreness";
+    case STATS_CACHE_APPROX_PATHS:           return "approx paths";
+    case STATS_CACHE_NODE_HARMONIC:          return "node harmonic";
+    case STATS_CACHE_NODE_PARTICIPATION:     return "node participation";
+    case STATS_CACHE_NODE_ZSCORE:            return "node zscore";
+    case STATS_CACHE_NODE_STRENGTH:          return "node strength";
+    case STATS_CACHE_NODE_WCLUSTERING:       return "node w. clustering";
+    case STATS_CACHE_DIAMETER:               return "diameter";
+    case STATS_CACHE_NODE_ECCENTRICITY:      return "node eccentricity";
+  }
+
+  return "unknown";
+}
+
+uint8_t _cache_add(
+  stats_cache_t *c, uint16_t id, cache_type_t type, uint16_t size) {
+
+  cache_entry_t e;
+  uint8_t       res;
+
+  /*ignore if an entry with the given id already exists*/
+  if (_get_cache_entry(&(c->cache_entries), id, NULL)) return 0;
+
+  e.id       = id;
+  e.type     = type;
+  e.size     = size;
+  e.acct     = 0;
+  e.lastused = __atomic_add_fetch(&c->clock, 1, __ATOMIC_RELAXED);
+
+  /*create the new entry*/
+  switch (type) {
+    case STATS_CACHE_TYPE_GRAPH: res = _new_graph_field(c, &e, size); break;
+    case STATS_CACHE_TYPE_LIST:  res = _new_list_field( c, &e, size); break;
+    case STATS_CACHE_TYPE_NODE:  res = _new_node_field( c, &e, size); break;
+    case STATS_CACHE_TYPE_PAIR:  res = _new_pair_field( c, &e, size); break;
+    case STATS_CACHE_TYPE_EDGE:  res = _new_edge_field( c, &e, size); break;
+    default:                     goto fail;
+  }
+
+  if (res) goto fail;
+
+  /*add the entry to the cache_entries list*/
+  if (array_append(&(c->cache_entries), &e)) {
+    _free_entry(&e);
+    goto fail;
+  }
+
+  _enforce_budget(c, id);
+  _account_entries(c);
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+int8_t _cache_check(
+  stats_cache_t *c, uint16_t id, uint32_t u, int64_t v, void *d) {
+
+  cache_entry_t e;
+  int8_t        res;
+
+  pthread_rwlock_rdlock(&c->lock);
+
+  if (!_touch_cache_entry(c, id, &e)) {
+    pthread_rwlock_unlock(&c->lock);
+    return 0;
+  }
+
+  switch(e.type) {
+    case STATS_CACHE_TYPE_GRAPH:
+      res = _check_graph_field(c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_LIST:
+      res = _check_list_field( c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_NODE:
+      res = _check_node_field( c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_PAIR:
+      res = _check_pair_field( c, &e, u, v, d);
+      break;
+    case STATS_CACHE_TYPE_EDGE:
+      res = _check_edge_field( c, &e, u, v, d);
+      break;
+      
+    default: res = -1; break;
+  }
+
+  pthread_rwlock_unlock(&c->lock);
+
+  return res;
+}
+
+uint8_t _cache_update(
+  stats_cache_t *c, uint16_t id, uint32_t u, int64_t v, void *d) {
+
+  cache_entry_t e;
+  uint8_t       res;
+
+  pthread_rwlock_rdlock(&c->lock);
+
+  if (!_touch_cache_entry(c, id, &e)) {
+    pthread_rwlock_unlock(&c->lock);
+    return 1;
+  }
+
+  switch(e.type) {
+
+    case STATS_CACHE_TYPE_GRAPH:
+      res = _update_graph_field(c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_LIST:
+      res = _update_list_field(c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_NODE:
+      res = _update_node_field(c, &e, u, d);
+      break;
+    case STATS_CACHE_TYPE_PAIR:
+      res = _update_pair_field(c, &e, u, v, d);
+      break;
+    case STATS_CACHE_TYPE_EDGE:
+      res = _update_edge_field(c, &e, u, v, d);
+      break;
+
+    default: res = 1; break;
+  }
+
+  pthread_rwlock_unlock(&c->lock);
+
+  return res;
+}
+
+void _cache_free(void *cache) {
+
+  int64_t        i;
+  stats_cache_t *c;
+  cache_entry_t  e;
+  
+  c = (stats_cache_t *)cache;
+
+  if (c == NULL) return;
+
+  for (i = 0; i < c->cache_entries.size; i++) {
+    array_get(&(c->cache_entries), i, &e);
+    _free_entry(&e);
+  }
+
+  if (c->gel.ctx != NULL) graph_remove_event_listener(c->g, &c->gel);
+  if (c->deghist != NULL) free(c->deghist);
+
+  array_free(&(c->cache_entries));
+  pthread_rwlock_destroy(&c->lock);
+
+  for (i = 0; i < STATS_CACHE_NUM_SHARDS; i++)
+    pthread_mutex_destroy(c->shards+i);
+
+  free(c);
+}
+
+void _edge_added(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx, float wt) {
+
+  _invalidate_edit(ctx, u, v, 1);
+}
+
+void _edge_removed(
+  graph_t *g, void *ctx, uint32_t u, uint32_t v,
+  uint32_t uidx, uint32_t vidx) {
+
+  _invalidate_edit(ctx, u, v, 0);
+}
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  uint64_t       i;
+  stats_cache_t *c;
+
+  c = ctx;
+
+  pthread_rwlock_wrlock(&c->lock);
+
+  c->degvalid = 0;
+
+  for (i = 0; i < c->cache_entries.size; i++)
+    _invalidate_field(c, array_getd(&(c->cache_entries), i));
+
+  pthread_rwlock_unlock(&c->lock);
+}
+
+void _invalidate_edit(stats_cache_t *c, uint32_t u, uint32_t v, uint8_t added) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       k;
+  uint32_t       nnodes;
+  uint32_t       unnbrs;
+  uint32_t       vnnbrs;
+  uint32_t      *unbrs;
+  uint32_t      *vnbrs;
+  uint8_t        directed;
+  uint8_t       *cmp;
+  cache_entry_t *e;
+
+  cmp      = NULL;
+  nnodes   = graph_num_nodes(c->g);
+  directed = graph_is_directed(c->g);
+
+  pthread_rwlock_wrlock(&c->lock);
+
+  _update_degrees(c, u, v, added);
+
+  /*
+   * the component search is only needed for undirected
+   * graphs which contain path-based node/pair fields,
+   * or component IDs which may have been split
+   */
+  for (i = 0; i < c->cache_entries.size && !directed; i++) {
+
+    e = array_getd(&(c->cache_entries), i);
+
+    if (_edit_scope(c, e, u, v, added, NULL) == EDIT_SCOPE_COMPONENT ||
+        (!added && e->id == STATS_CACHE_NODE_COMPONENT)) {
+      cmp = _edit_component(c, u, v);
+      break;
+    }
+  }
+
+  for (i = 0; i < c->cache_entries.size; i++) {
+
+    e = array_getd(&(c->cache_entries), i);
+
+    switch (_edit_scope(c, e, u, v, added, cmp)) {
+
+      case EDIT_SCOPE_NONE:
+        break;
+
+      case EDIT_SCOPE_NBRHOOD:
+
+        unnbrs = graph_num_neighbours(c->g, u);
+        unbrs  = graph_get_neighbours(c->g, u);
+        vnnbrs = graph_num_neighbours(c->g, v);
+        vnbrs  = graph_get_neighbours(c->g, v);
+
+        /*neighbour lists are sorted*/
+        for (j = 0, k = 0; j < unnbrs && k < vnnbrs;) {
+
+          if      (unbrs[j] < vnbrs[k]) j++;
+          else if (unbrs[j] > vnbrs[k]) k++;
+          else {
+            _invalidate_node(c, e, unbrs[j]);
+            j++;
+            k++;
+          }
+        }
+
+        /*fall through*/
+      case EDIT_SCOPE_ENDPOINTS:
+        _invalidate_node(c, e, u);
+        _invalidate_node(c, e, v);
+        break;
+
+      case EDIT_SCOPE_COMPONENT:
+
+        if (cmp == NULL) {
+          _invalidate_field(c, e);
+          break;
+        }
+
+        for (j = 0; j < nnodes; j++) {
+          if (cmp[j]) _invalidate_node(c, e, j);
+        }
+        break;
+
+      case EDIT_SCOPE_ALL:
+        _invalidate_field(c, e);
+        break;
+
+      case EDIT_SCOPE_COUNT:
+        _update_count(c, e, u, v, added);
+        break;
+    }
+  }
+
+  pthread_rwlock_unlock(&c->lock);
+
+  if (cmp != NULL) free(cmp);
+}
+
+edit_scope_t _edit_scope(
+  stats_cache_t *c,
+  cache_entry_t *e,
+  uint32_t       u,
+  uint32_t       v,
+  uint8_t        added,
+  uint8_t       *cmp) {
+
+  uint8_t       directed;
+  node_cache_t *nc;
+  uint32_t     *cmps;
+
+  directed = graph_is_directed(c->g);
+
+  /*
+   * an undirected edge is an intra-community edge if its
+   * end points have the same label, so the counts only
+   * change by one, and node labels are not affected
+   */
+  if (!directed && (e->id == STATS_CACHE_INTRA_EDGES ||
+                    e->id == STATS_CACHE_INTER_EDGES))
+    return EDIT_SCOPE_COUNT;
+
+  switch (e->type) {
+    case STATS_CACHE_TYPE_GRAPH: return EDIT_SCOPE_ALL;
+    case STATS_CACHE_TYPE_LIST:  return EDIT_SCOPE_ALL;
+    case STATS_CACHE_TYPE_EDGE:  return EDIT_SCOPE_NONE;
+    default:                     break;
+  }
+
+  switch (e->id) {
+
+    case STATS_CACHE_NODE_EDGEDIST:
+    case STATS_CACHE_NODE_STRENGTH:
+      return EDIT_SCOPE_ENDPOINTS;
+
+    case STATS_CACHE_NODE_CLUSTERING:
+    case STATS_CACHE_NODE_LOCAL_EFFICIENCY:
+      return directed ? EDIT_SCOPE_ALL : EDIT_SCOPE_NBRHOOD;
+
+    case STATS_CACHE_NODE_PATHLENGTH:
+    case STATS_CACHE_NODE_HARMONIC:
+    case STATS_CACHE_NODE_ECCENTRICITY:
+    case STATS_CACHE_NODE_NUMPATHS:
+    case STATS_CACHE_BETWEENNESS_CENTRALITY:
+    case STATS_CACHE_PAIR_PATHLENGTH:
+    case STATS_CACHE_PAIR_NUMPATHS:
+
+      return directed ? EDIT_SCOPE_ALL : EDIT_SCOPE_COMPONENT;
+
+    /*
+     * an edge only changes the core numbers of nodes
+     * which are in the same component as its end points
+     */
+    case STATS_CACHE_NODE_CORENESS:
+      return directed ? EDIT_SCOPE_ALL : EDIT_SCOPE_COMPONENT;
+
+    /*
+     * Component IDs are only affected if components
+     * are merged or split. An added edge merges two
+     * components if u and v were in different
+     * components; a removed edge splits a component
+     * if v is no longer reachable from u.
+     */
+    case STATS_CACHE_NODE_COMPONENT:
+
+      if (directed) return EDIT_SCOPE_ALL;
+
+      if (added) {
+
+        nc   = e->cache;
+        cmps = (uint32_t *)nc->data.data;
+
+        if (__atomic_load_n(nc->cached+u, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(nc->cached+v, __ATOMIC_ACQUIRE) &&
+            cmps[u] == cmps[v])
+          return EDIT_SCOPE_NONE;
+      }
+      else if (cmp != NULL && cmp[v] == 1) return EDIT_SCOPE_NONE;
+
+      return EDIT_SCOPE_ALL;
+  }
+
+  return EDIT_SCOPE_ALL;
+}
+
+void _update_count(
+  stats_cache_t *c, cache_entry_t *e, uint32_t u, uint32_t v, uint8_t added) {
+
+  graph_cache_t *gc;
+  uint8_t        intra;
+
+  gc = e->cache;
+
+  if (!__atomic_load_n(&gc->cached, __ATOMIC_ACQUIRE)) return;
+
+  intra = graph_get_nodelabel(c->g, u)->labelval ==
+          graph_get_nodelabel(c->g, v)->labelval;
+
+  if (intra != (e->id == STATS_CACHE_INTRA_EDGES)) return;
+
+  *(double *)gc->data += added ? 1 : -1;
+}
+
+void _update_degrees(
+  stats_cache_t *c, uint32_t u, uint32_t v, uint8_t added) {
+
+  uint64_t  i;
+  uint32_t  deg;
+  uint32_t  len;
+  uint32_t *tmp;
+  uint32_t  nodes[2];
+
+  if (!c->degvalid) return;
+
+  /*
+   * the out-degree of only one end point of a directed
+   * edge changes, and graph_add_edge and graph_remove_edge
+   * disagree on which one that is, so just rebuild
+   */
+  if (graph_is_directed(c->g)) {
+    c->degvalid = 0;
+    return;
+  }
+
+  nodes[0] = u;
+  nodes[1] = v;
+
+  for (i = 0; i < 2; i++) {
+
+    deg = graph_num_neighbours(c->g, nodes[i]);
+
+    if (added) {
+
+      if (deg >= c->deghistlen) {
+
+        len = 2 * c->deghistlen;
+        tmp = realloc(c->deghist, len * sizeof(uint32_t));
+
+        if (tmp == NULL) {
+          c->degvalid = 0;
+          return;
+        }
+
+        memset(tmp + c->deghistlen, 0,
+               (len - c->deghistlen) * sizeof(uint32_t));
+
+        c->deghist    = tmp;
+        c->deghistlen = len;
+      }
+
+      c->deghist[deg-1]--;
+      c->deghist[deg]  ++;
+
+      if (deg > c->maxdeg) c->maxdeg = deg;
+    }
+    else {
+
+      c->deghist[deg+1]--;
+      c->deghist[deg]  ++;
+
+      /*
+       * the node which lost an edge now has degree
+       * deg, so the maximum drops by at most one
+       */
+      if (c->deghist[c->maxdeg] == 0) c->maxdeg--;
+    }
+  }
+}
+
+uint8_t _build_degrees(stats_cache_t *c) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  deg;
+  uint32_t  maxdeg;
+  uint32_t  len;
+  uint32_t *tmp;
+
+  nnodes = graph_num_nodes(c->g);
+  maxdeg = 0;
+
+  for (i = 0; i < nnodes; i++) {
+    deg = graph_num_neighbours(c->g, i);
+    if (deg > maxdeg) maxdeg = deg;
+  }
+
+  /* leave room for the maximum to grow */
+  len = 16;
+  while (len <= maxdeg) len *= 2;
+
+  if (len > c->deghistlen) {
+
+    tmp = realloc(c->deghist, len * sizeof(uint32_t));
+    if (tmp == NULL) return 1;
+
+    c->deghist    = tmp;
+    c->deghistlen = len;
+  }
+
+  memset(c->deghist, 0, c->deghistlen * sizeof(uint32_t));
+
+  for (i = 0; i < nnodes; i++)
+    c->deghist[graph_num_neighbours(c->g, i)]++;
+
+  c->maxdeg   = maxdeg;
+  c->degvalid = 1;
+
+  return 0;
+}
+
+uint8_t *_edit_component(stats_cache_t *c, uint32_t u, uint32_t v) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  head;
+  uint64_t  tail;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+  uint32_t *queue;
+  uint32_t  roots[2];
+  uint8_t  *cmp;
+
+  queue    = NULL;
+  cmp      = NULL;
+  nnodes   = graph_num_nodes(c->g);
+  roots[0] = u;
+  roots[1] = v;
+
+  cmp   = calloc(nnodes, sizeof(uint8_t));
+  queue = malloc(nnodes*sizeof(uint32_t));
+  if (cmp   == NULL) goto fail;
+  if (queue == NULL) goto fail;
+
+  for (i = 0; i < 2; i++) {
+
+    if (cmp[roots[i]]) continue;
+
+    head          = 0;
+    tail          = 0;
+    queue[tail++] = roots[i];
+    cmp[roots[i]] = i+1;
+
+    while (head < tail) {
+
+      nnbrs = graph_num_neighbours(c->g, queue[head]);
+      nbrs  = graph_get_neighbours(c->g, queue[head]);
+      head++;
+
+      for (j = 0; j < nnbrs; j++) {
+
+        if (cmp[nbrs[j]]) continue;
+
+        cmp[nbrs[j]]  = i+1;
+        queue[tail++] = nbrs[j];
+      }
+    }
+  }
+
+  free(queue);
+  return cmp;
+
+fail:
+  if (cmp   != NULL) free(cmp);
+  if (queue != NULL) free(queue);
+  return NULL;
+}
+
+void _invalidate_node(stats_cache_t *c, cache_entry_t *e, uint32_t u) {
+
+  node_cache_t *nc;
+  file_cache_t *fc;
+  edge_cache_t *ec;
+
+  switch (e->type) {
+
+    case STATS_CACHE_TYPE_NODE:
+      nc = e->cache;
+      __atomic_store_n(nc->cached+u, 0, __ATOMIC_RELEASE);
+      break;
+
+    case STATS_CACHE_TYPE_PAIR:
+      fc = e->cache;
+      if (__atomic_exchange_n(fc->cached+u, 0, __ATOMIC_ACQ_REL))
+        _account_row(e, (uint64_t)graph_num_nodes(c->g) * fc->storesz, 0);
+      break;
+
+    case STATS_CACHE_TYPE_EDGE:
+      ec = e->cache;
+      __atomic_store_n(ec->cached+u, 0, __ATOMIC_RELEASE);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void _invalidate_field(stats_cache_t *c, cache_entry_t *e) {
+
+  uint64_t       i;
+  uint32_t       nnodes;
+  graph_cache_t *gc;
+  list_cache_t  *lc;
+
+  nnodes = graph_num_nodes(c->g);
+
+  switch (e->type) {
+
+    case STATS_CACHE_TYPE_GRAPH:
+      gc = e->cache;
+      __atomic_store_n(&gc->cached, 0, __ATOMIC_RELEASE);
+      break;
+
+    case STATS_CACHE_TYPE_LIST:
+      lc = e->cache;
+      array_clear(&(lc->data));
+      break;
+
+    default:
+      for (i = 0; i < nnodes; i++) _invalidate_node(c, e, i);
+      break;
+  }
+}
+
+uint64_t _graph_hash(graph_t *g) {
+
+  uint64_t       i;
+  uint64_t       hash;
+  uint32_t       nnodes;
+  uint32_t       nnbrs;
+  uint32_t       vals[6];
+  graph_label_t *lbl;
+
+  hash   = 0xcbf29ce484222325ULL;
+  nnodes = graph_num_nodes(g);
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    lbl   = graph_get_nodelabel( g, i);
+
+    vals[0] = nnbrs;
+    vals[1] = graph_is_directed(g);
+    vals[2] = lbl->labelval;
+    memcpy(vals+3, &lbl->xval, sizeof(float));
+    memcpy(vals+4, &lbl->yval, sizeof(float));
+    memcpy(vals+5, &lbl->zval, sizeof(float));
+
+    hash = _fnv1a(hash, vals, sizeof(vals));
+    hash = _fnv1a(hash, graph_get_neighbours(g, i), nnbrs*sizeof(uint32_t));
+    hash = _fnv1a(hash, graph_get_weights(   g, i), nnbrs*sizeof(float));
+  }
+
+  return hash;
+}
+
+uint64_t _fnv1a(uint64_t hash, void *data, uint64_t len) {
+
+  uint64_t i;
+  uint8_t *bytes;
+
+  bytes = data;
+
+  for (i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+uint8_t _save_field(stats_cache_t *c, cache_entry_t *e, FILE *fd) {
+
+  uint64_t       i;
+  uint64_t       nentries;
+  uint32_t       nnodes;
+  uint32_t       nnbrs;
+  uint8_t       *row;
+  uint8_t       *flat;
+  graph_cache_t *gc;
+  list_cache_t  *lc;
+  node_cache_t  *nc;
+  file_cache_t  *fc;
+  edge_cache_t  *ec;
+
+  row    = NULL;
+  nnodes = graph_num_nodes(c->g);
+
+  switch (e->type) {
+
+    case STATS_CACHE_TYPE_GRAPH:
+      gc = e->cache;
+      if (fwrite(&gc->cached, 1,       1, fd) != 1) goto fail;
+      if (fwrite(gc->data,    e->size, 1, fd) != 1) goto fail;
+      break;
+
+    case STATS_CACHE_TYPE_LIST:
+      lc = e->cache;
+      if (fwrite(&lc->data.size, sizeof(lc->data.size), 1, fd) != 1)
+        goto fail;
+      if (lc->data.size > 0 &&
+          fwrite(lc->data.data, e->size, lc->data.size, fd) != lc->data.size)
+        goto fail;
+      break;
+
+    case STATS_CACHE_TYPE_NODE:
+      nc = e->cache;
+      if (fwrite(nc->cached,    1,       nnodes, fd) != nnodes) goto fail;
+      if (fwrite(nc->data.data, e->size, nnodes, fd) != nnodes) goto fail;
+      break;
+
+    /*only the rows which have been cached are saved*/
+    case STATS_CACHE_TYPE_PAIR:
+
+      fc  = e->cache;
+      row = malloc((uint64_t)nnodes*e->size);
+      if (row == NULL) goto fail;
+
+      if (fwrite(fc->cached, 1, nnodes, fd) != nnodes) goto fail;
+
+      for (i = 0; i < nnodes; i++) {
+
+        if (!fc->cached[i]) continue;
+
+        _pair_row_read(e, nnodes, i, row);
+        if (fwrite(row, e->size, nnodes, fd) != nnodes) goto fail;
+      }
+
+      free(row);
+      row = NULL;
+      break;
+
+    case STATS_CACHE_TYPE_EDGE:
+
+      ec = e->cache;
+
+      if (fwrite(ec->cached, 1, nnodes, fd) != nnodes) goto fail;
+
+      /*values stored contiguously can be written in one go*/
+      flat = edge_array_get_flat(&ec->data);
+
+      if (flat != NULL) {
+
+        nentries = 0;
+        for (i = 0; i < nnodes; i++)
+          nentries += graph_num_neighbours(c->g, i);
+
+        if (nentries > 0 && fwrite(flat, e->size, nentries, fd) != nentries)
+          goto fail;
+        break;
+      }
+
+      for (i = 0; i < nnodes; i++) {
+
+        nnbrs = graph_num_neighbours(c->g, i);
+
+        if (nnbrs > 0 &&
+            fwrite(edge_array_get_all(&ec->data, i), e->size, nnbrs, fd)
+            != nnbrs)
+          goto fail;
+      }
+      break;
+
+    default: goto fail;
+  }
+
+  return 0;
+
+fail:
+  if (row != NULL) free(row);
+  return 1;
+}
+
+uint8_t _load_field(stats_cache_t *c, cache_entry_t *e, FILE *fd) {
+
+  uint64_t       i;
+  uint32_t       len;
+  uint32_t       nnodes;
+  uint32_t       nnbrs;
+  uint32_t       maxnbrs;
+  uint8_t       *row;
+  uint8_t       *cached;
+  graph_cache_t *gc;
+  list_cache_t  *lc;
+  node_cache_t  *nc;
+  file_cache_t  *fc;
+  edge_cache_t  *ec;
+
+  row    = NULL;
+  cached = NULL;
+  nnodes = graph_num_nodes(c->g);
+
+  switch (e->type) {
+
+    case STATS_CACHE_TYPE_GRAPH:
+      gc = e->cache;
+      if (fread(&gc->cached, 1,       1, fd) != 1) goto fail;
+      if (fread(gc->data,    e->size, 1, fd) != 1) goto fail;
+      break;
+
+    case STATS_CACHE_TYPE_LIST:
+
+      lc  = e->cache;
+      row = malloc(e->size);
+      if (row == NULL) goto fail;
+
+      if (fread(&len, sizeof(len), 1, fd) != 1) goto fail;
+
+      for (i = 0; i < len; i++) {
+        if (fread(row, e->size, 1, fd) != 1)   goto fail;
+        if (array_append(&(lc->data), row))    goto fail;
+      }
+
+      free(row);
+      row = NULL;
+      break;
+
+    case STATS_CACHE_TYPE_NODE:
+      nc = e->cache;
+      if (fread(nc->cached,    1,       nnodes, fd) != nnodes) goto fail;
+      if (fread(nc->data.data, e->size, nnodes, fd) != nnodes) goto fail;
+      break;
+
+    case STATS_CACHE_TYPE_PAIR:
+
+      fc  = e->cache;
+      row = malloc((uint64_t)nnodes*e->size);
+      if (row == NULL) goto fail;
+
+      if (fread(fc->cached, 1, nnodes, fd) != nnodes) goto fail;
+
+      for (i = 0; i < nnodes; i++) {
+
+        if (!fc->cached[i]) continue;
+
+        if (fread(row, e->size, nnodes, fd) != nnodes) goto fail;
+        _pair_row_write(e, nnodes, i, row);
+      }
+
+      free(row);
+      row = NULL;
+      break;
+
+    case STATS_CACHE_TYPE_EDGE:
+
+      ec      = e->cache;
+      maxnbrs = 0;
+
+      for (i = 0; i < nnodes; i++) {
+        nnbrs = graph_num_neighbours(c->g, i);
+        if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+      }
 
-/**
- * Frees the memory used by the given node cache.
- */
-static void _free_node_field(
-  cache_entry_t *c /**< node entry to free */
-);
+      cached = malloc(nnodes);
+      row    = malloc((uint64_t)maxnbrs*e->size + 1);
+      if (cached == NULL) goto fail;
+      if (row    == NULL) goto fail;
 
-/**
- * Frees the memory used by the given pair cache.
- */
-static void _free_pair_field(
-  cache_entry_t *c /**< pair entry to free */
-);
+      if (fread(cached, 1, nnodes, fd) != nnodes) goto fail;
 
-/**
- * Frees the memory used by the given edge cache.
- */
-static void _free_edge_field(
-  cache_entry_t *c /**< edge entry to free */
-);
+      for (i = 0; i < nnodes; i++) {
 
-uint8_t stats_cache_init(graph_t *g) {
+        nnbrs = graph_num_neighbours(c->g, i);
 
-  stats_cache_t *c;
+        if (nnbrs > 0 && fread(row, e->size, nnbrs, fd) != nnbrs) goto fail;
 
-  c      = NULL;
+        if (cached[i]) {
+          edge_array_set_all(&ec->data, i, row);
+          ec->cached[i] = 1;
+        }
+      }
 
-  /*allocate space for the cache struct*/
-  c = calloc(1, sizeof(stats_cache_t));
-  if (c == NULL) goto fail;
-  
-  c->g = g;
-  
-  /*initialise cache struct fields*/
-  if (array_create(&(c->cache_entries), sizeof(cache_entry_t), 5)) goto fail;
-  array_set_cmps(&c->cache_entries, _entry_cmp, NULL);
+      free(cached);
+      free(row);
+      cached = NULL;
+      row    = NULL;
+      break;
 
-  /*attach the cache to the graph*/
-  g->ctx[     _GRAPH_STATS_CACHE_CTX_LOC_] = c;
-  g->ctx_free[_GRAPH_STATS_CACHE_CTX_LOC_] = _cache_free;
+    default: goto fail;
+  }
 
   return 0;
-  
+
 fail:
-  if (c != NULL) _cache_free(c);
+  if (row    != NULL) free(row);
+  if (cached != NULL) free(cached);
   return 1;
 }
 
-uint8_t stats_cache_reset(graph_t *g) {
-
-  stats_cache_t *c;
-
-  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+void _lock_shards(stats_cache_t *c, uint32_t u, int64_t v) {
 
-  if (c == NULL) goto fail;
+  uint32_t su;
+  uint32_t sv;
 
-  _cache_free(c);
+  su = u % STATS_CACHE_NUM_SHARDS;
+  sv = (v < 0) ? su : v % STATS_CACHE_NUM_SHARDS;
 
-  return stats_cache_init(g);
-  
-fail:
-  return 1;
+  if (sv < su) pthread_mutex_lock(c->shards+sv);
+  pthread_mutex_lock(c->shards+su);
+  if (sv > su) pthread_mutex_lock(c->shards+sv);
 }
 
-uint8_t stats_cache_add(
-  graph_t *g, uint16_t id, cache_type_t type, uint16_t size) {
+void _unlock_shards(stats_cache_t *c, uint32_t u, int64_t v) {
 
+  uint32_t su;
+  uint32_t sv;
 
-  stats_cache_t *c;
-  cache_entry_t  e;
-  uint8_t        res;
+  su = u % STATS_CACHE_NUM_SHARDS;
+  sv = (v < 0) ? su : v % STATS_CACHE_NUM_SHARDS;
 
-  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
-  if (c == NULL) goto fail;
+  pthread_mutex_unlock(c->shards+su);
+  if (sv != su) pthread_mutex_unlock(c->shards+sv);
+}
 
-  /*ignore if an entry with the given id already exists*/
-  if (_get_cache_entry(&(c->cache_entries), id, NULL)) return 0;
+void _pair_row_read(
+  cache_entry_t *e, uint32_t nnodes, uint32_t u, void *data) {
 
-  e.id   = id;
-  e.type = type;
-  e.size = size;
+  uint64_t      i;
+  file_cache_t *fc;
+  uint8_t      *row;
+  double       *vals;
 
-  /*create the new entry*/
-  switch (type) {
-    case STATS_CACHE_TYPE_GRAPH: res = _new_graph_field(c, &e, size); break;
-    case STATS_CACHE_TYPE_LIST:  res = _new_list_field( c, &e, size); break;
-    case STATS_CACHE_TYPE_NODE:  res = _new_node_field( c, &e, size); break;
-    case STATS_CACHE_TYPE_PAIR:  res = _new_pair_field( c, &e, size); break;
-    case STATS_CACHE_TYPE_EDGE:  res = _new_edge_field( c, &e, size); break;
-    default:                     goto fail;
-  }
+  fc   = e->cache;
+  row  = fc->map + (uint64_t)u * nnodes * fc->storesz;
+  vals = data;
 
-  if (res) goto fail;
+  switch (fc->format) {
 
-  /*add the entry to the cache_entries list*/
-  if (array_append(&(c->cache_entries), &e)) goto fail;
+    case STATS_CACHE_PAIR_RAW:
+      memcpy(data, row, (uint64_t)nnodes * fc->storesz);
+      break;
 
-  return 0;
+    case STATS_CACHE_PAIR_FLOAT:
+      for (i = 0; i < nnodes; i++) vals[i] = ((float *)row)[i];
+      break;
 
-fail:
-  return 1;
+    case STATS_CACHE_PAIR_UINT16:
+      for (i = 0; i < nnodes; i++) vals[i] = ((uint16_t *)row)[i];
+      break;
+  }
 }
 
-int8_t stats_cache_check(
-  graph_t *g, uint16_t id, uint32_t u, int64_t v, void *d) {
+void _pair_row_write(
+  cache_entry_t *e, uint32_t nnodes, uint32_t u, void *data) {
 
-  stats_cache_t *c;
-  uint32_t       nnodes;
-  cache_entry_t  e;
-  int8_t         res;
+  uint64_t      i;
+  file_cache_t *fc;
+  uint8_t      *row;
+  double       *vals;
 
-  nnodes = graph_num_nodes(g);
-  c      = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
-  
-  if (c == NULL)   return 0;
-  if (u >= nnodes) goto fail;
+  fc   = e->cache;
+  row  = fc->map + (uint64_t)u * nnodes * fc->storesz;
+  vals = data;
 
-  if (!_get_cache_entry(&(c->cache_entries), id, &e)) return 0;
+  switch (fc->format) {
 
-  switch(e.type) {
-    case STATS_CACHE_TYPE_GRAPH:
-      res = _check_graph_field(c, &e, u, d);
-      break;
-    case STATS_CACHE_TYPE_LIST:
-      res = _check_list_field( c, &e, u, d);
-      break;
-    case STATS_CACHE_TYPE_NODE:
-      res = _check_node_field( c, &e, u, d);
+    case STATS_CACHE_PAIR_RAW:
+      memcpy(row, data, (uint64_t)nnodes * fc->storesz);
       break;
-    case STATS_CACHE_TYPE_PAIR:
-      res = _check_pair_field( c, &e, u, v, d);
+
+    case STATS_CACHE_PAIR_FLOAT:
+      for (i = 0; i < nnodes; i++) ((float *)row)[i] = vals[i];
       break;
-    case STATS_CACHE_TYPE_EDGE:
-      res = _check_edge_field( c, &e, u, v, d);
+
+    case STATS_CACHE_PAIR_UINT16:
+      for (i = 0; i < nnodes; i++) {
+        if      (!(vals[i] > 0))     ((uint16_t *)row)[i] = 0;
+        else if (vals[i] >= 0xFFFF)  ((uint16_t *)row)[i] = 0xFFFF;
+        else                         ((uint16_t *)row)[i] = vals[i];
+      }
       break;
-      
-    default: goto fail;
   }
+}
 
-  return res;
+uint8_t _get_cache_entry(
+  array_t *entries, uint16_t id, cache_entry_t *entry) {
 
-fail:
-  return -1;
+  int64_t       idx;
+  cache_entry_t e1;
+
+  e1.id = id;
+
+  idx = array_find(entries, &e1, 0);
+
+  if (idx == -1) return 0;
+
+  if (entry != NULL) array_get(entries, idx, entry);
+
+  return 1;
 }
 
-uint8_t stats_cache_update(
-  graph_t *g, uint16_t id, uint32_t u, int64_t v, void *d) {
+uint8_t _touch_cache_entry(
+  stats_cache_t *c, uint16_t id, cache_entry_t *entry) {
 
-  stats_cache_t *c;
-  uint32_t       nnodes;
-  cache_entry_t  e;
-  uint8_t        res;
+  int64_t        idx;
+  cache_entry_t  e1;
+  cache_entry_t *e;
 
-  nnodes = graph_num_nodes(g);
-  c = g->ctx[_GRAPH_STATS_CACHE_CTX_LOC_];
+  e1.id = id;
 
-  if (u >= nnodes) goto fail;
-  if (c == NULL)   return 0;
+  idx = array_find(&(c->cache_entries), &e1, 0);
+  if (idx == -1) return 0;
 
-  if (!_get_cache_entry(&(c->cache_entries), id, &e)) goto fail;
+  e = array_getd(&(c->cache_entries), idx);
 
-  switch(e.type) {
+  /*
+   * readers share the entry list lock, so
+   * the timestamp is updated atomically
+   */
+  __atomic_store_n(&e->lastused,
+                   __atomic_add_fetch(&c->clock, 1, __ATOMIC_RELAXED),
+                   __ATOMIC_RELAXED);
+
+  *entry = *e;
+
+  return 1;
+}
+
+uint64_t _entry_bytes(stats_cache_t *c, cache_entry_t *e) {
+
+  uint64_t      i;
+  uint64_t      bytes;
+  uint32_t      nnodes;
+  list_cache_t *lc;
+  node_cache_t *nc;
+  file_cache_t *fc;
+  edge_cache_t *ec;
+
+  nnodes = graph_num_nodes(c->g);
+  bytes  = 0;
+
+  switch (e->type) {
 
     case STATS_CACHE_TYPE_GRAPH:
-      res = _update_graph_field(c, &e, u, d);
+      bytes = e->size;
       break;
+
     case STATS_CACHE_TYPE_LIST:
-      res = _update_list_field(c, &e, u, d);
+      lc    = e->cache;
+      bytes = (uint64_t)lc->data.capacity * lc->data.datasz;
       break;
+
     case STATS_CACHE_TYPE_NODE:
-      res = _update_node_field(c, &e, u, d);
+      nc    = e->cache;
+      bytes = (uint64_t)nc->data.capacity * nc->data.datasz + nnodes;
       break;
+
+    /*
+     * pair-level fields are file backed, so
+     * only the cached rows are counted
+     */
     case STATS_CACHE_TYPE_PAIR:
-      res = _update_pair_field(c, &e, u, v, d);
+      fc    = e->cache;
+      bytes = nnodes;
+      for (i = 0; i < nnodes; i++) {
+        if (__atomic_load_n(fc->cached+i, __ATOMIC_ACQUIRE))
+          bytes += (uint64_t)nnodes * fc->storesz;
+      }
       break;
+
     case STATS_CACHE_TYPE_EDGE:
-      res = _update_edge_field(c, &e, u, v, d);
+      ec    = e->cache;
+      bytes = nnodes;
+      for (i = 0; i < nnodes; i++)
+        bytes += (uint64_t)ec->data.vals[i].capacity * ec->data.valsz;
       break;
-
-    default: goto fail;
   }
 
-  return res;
-  
-fail:
-  return 1;
+  return bytes;
 }
 
-void _cache_free(void *cache) {
+void _enforce_budget(stats_cache_t *c, int32_t keep) {
 
-  int64_t        i;
-  stats_cache_t *c;
-  cache_entry_t  e;
-  
-  c = (stats_cache_t *)cache;
+  uint64_t       i;
+  uint64_t       total;
+  int64_t        lru;
+  uint64_t      *bytes;
+  cache_entry_t *e;
+  cache_entry_t *olde;
 
-  if (c == NULL) return;
+  if (c->budget             == 0) return;
+  if (c->cache_entries.size == 0) return;
 
+  bytes = malloc(c->cache_entries.size * sizeof(uint64_t));
+  if (bytes == NULL) return;
+
+  olde  = NULL;
+  total = 0;
   for (i = 0; i < c->cache_entries.size; i++) {
-    array_get(&(c->cache_entries), i, &e);
+    bytes[i] = _entry_bytes(c, array_getd(&(c->cache_entries), i));
+    total   += bytes[i];
+  }
+
+  while (total > c->budget) {
+
+    lru = -1;
+
+    for (i = 0; i < c->cache_entries.size; i++) {
 
-    switch(e.type) {
-      case STATS_CACHE_TYPE_GRAPH: _free_graph_field(&e); break;
-      case STATS_CACHE_TYPE_LIST:  _free_list_field( &e); break;
-      case STATS_CACHE_TYPE_NODE:  _free_node_field( &e); break;
-      case STATS_CACHE_TYPE_PAIR:  _free_pair_field( &e); break;
-      case STATS_CACHE_TYPE_EDGE:  _free_edge_field( &e); break;
-      default: continue;
+      e = array_getd(&(c->cache_entries), i);
+
+      if (e->id == keep) continue;
+      if (lru == -1 || e->lastused < olde->lastused) {
+        lru  = i;
+        olde = e;
+      }
     }
+
+    if (lru == -1) break;
+
+    total -= bytes[lru];
+    _free_entry(olde);
+    array_remove_by_idx(&(c->cache_entries), lru);
+
+    /*keep the byte counts in line with the entries*/
+    for (i = lru; i < c->cache_entries.size; i++) bytes[i] = bytes[i+1];
   }
 
-  array_free(&(c->cache_entries));
-  free(c);
+  free(bytes);
 }
 
-uint8_t _file_cache_read(
-  FILE *fd, void *data, uint32_t nvals, uint16_t size, long offset) {
+void _account_entries(stats_cache_t *c) {
 
-  offset *= size;
+  uint64_t       i;
+  uint64_t       bytes;
+  cache_entry_t *e;
 
-  if (fseek(fd, offset, SEEK_SET))           goto fail;
-  if (fread(data, size, nvals, fd) != nvals) goto fail;
-
-  return 0;
-  
-fail:
-  return 1;
-}
+  for (i = 0; i < c->cache_entries.size; i++) {
 
-uint8_t _file_cache_write(
-  FILE *fd, void *data, uint32_t nvals, uint16_t size, long offset) {
+    e = array_getd(&(c->cache_entries), i);
 
-  offset *= size;
+    if (e->type == STATS_CACHE_TYPE_EDGE) continue;
 
-  if (fseek( fd, offset, SEEK_SET))           goto fail;
-  if (fwrite(data, size, nvals, fd) != nvals) goto fail;
-  
-  return 0;
-  
-fail:
-  return 1;
-}
+    bytes = _entry_bytes(c, e);
 
-uint8_t _get_cache_entry(
-  array_t *entries, uint16_t id, cache_entry_t *entry) {
+    if      (bytes > e->acct)
+      memacct_alloc(MEMACCT_STATS_CACHE, bytes - e->acct);
+    else if (bytes < e->acct)
+      memacct_free( MEMACCT_STATS_CACHE, e->acct - bytes);
 
-  int64_t       idx;
-  cache_entry_t e1;
+    e->acct = bytes;
+  }
+}
 
-  e1.id = id;
+void _account_row(cache_entry_t *e, uint64_t bytes, uint8_t add) {
 
-  idx = array_find(entries, &e1, 0);
+  if (add) {
+    __atomic_add_fetch(&e->acct, bytes, __ATOMIC_RELAXED);
+    memacct_alloc(MEMACCT_STATS_CACHE, bytes);
+  }
+  else {
+    __atomic_sub_fetch(&e->acct, bytes, __ATOMIC_RELAXED);
+    memacct_free(MEMACCT_STATS_CACHE, bytes);
+  }
+}
 
-  if (idx == -1) return 0;
+void _free_entry(cache_entry_t *e) {
 
-  if (entry != NULL) array_get(entries, idx, entry);
+  memacct_free(MEMACCT_STATS_CACHE, e->acct);
+  e->acct = 0;
 
-  return 1;
+  switch(e->type) {
+    case STATS_CACHE_TYPE_GRAPH: _free_graph_field(e); break;
+    case STATS_CACHE_TYPE_LIST:  _free_list_field( e); break;
+    case STATS_CACHE_TYPE_NODE:  _free_node_field( e); break;
+    case STATS_CACHE_TYPE_PAIR:  _free_pair_field( e); break;
+    case STATS_CACHE_TYPE_EDGE:  _free_edge_field( e); break;
+  }
 }
 
 int _entry_cmp(const void *a, const void *b) {
@@ -573,6 +2224,8 @@ uint8_t _new_list_field(stats_cache_t *c, cache_entry_t *ce, uint16_t size) {
 
   if (array_create(&(lc->data), size, 5)) goto fail;
 
+  ce->cache = lc;
+
   return 0;
 
 fail:
@@ -595,6 +2248,12 @@ uint8_t _new_node_field(stats_cache_t *c, cache_entry_t *e, uint16_t size) {
 
   if (array_create(&nc->data, size, nnodes)) goto fail;
 
+  /*
+   * the array is sized up front, so that updates
+   * for different nodes do not touch shared state
+   */
+  nc->data.size = nnodes;
+
   nc->cached = calloc(nnodes, 1);
   if (nc->cached == NULL) goto fail;
 
@@ -623,9 +2282,54 @@ uint8_t _new_pair_field(stats_cache_t *c, cache_entry_t *e, uint16_t size) {
   fc->cached = calloc(nnodes, sizeof(uint8_t));
   if (fc->cached == NULL) goto fail;
   
+  /*
+   * Compacted formats are only used for double
+   * values; path lengths are hop counts, so
+   * are stored exactly as 16 bit integers.
+   */
+  fc->format  = STATS_CACHE_PAIR_RAW;
+  fc->storesz = size;
+
+  if (c->compact && size == sizeof(double)) {
+
+    if (e->id == STATS_CACHE_PAIR_PATHLENGTH) {
+      fc->format  = STATS_CACHE_PAIR_UINT16;
+      fc->storesz = sizeof(uint16_t);
+    }
+    else {
+      fc->format  = STATS_CACHE_PAIR_FLOAT;
+      fc->storesz = sizeof(float);
+    }
+  }
+
+  /*
+   * The file is extended to its full size without
+   * writing anything, so it is sparse - disk space
+   * is only used for the rows which are cached.
+   */
+  fc->mapsize   = (uint64_t)nnodes * nnodes * fc->storesz;
   fc->cachefile = tmpfile();
   if (fc->cachefile == NULL) goto fail;
 
+  if (fc->mapsize > 0) {
+
+    if (ftruncate(fileno(fc->cachefile), fc->mapsize)) goto fail;
+
+    fc->map = mmap(NULL,
+                   fc->mapsize,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED,
+                   fileno(fc->cachefile),
+                   0);
+
+    if (fc->map == MAP_FAILED) {
+      fc->map = NULL;
+      goto fail;
+    }
+
+    bigmem_advise(fc->map, fc->mapsize);
+  }
+
   e->cache = fc;
 
   return 0;
@@ -634,6 +2338,7 @@ fail:
   if (fc != NULL) {
     if (fc->cached    != NULL) free(fc->cached);
     if (fc->cachefile != NULL) fclose(fc->cachefile);
+    free(fc);
   }
   return -1;
 }
@@ -672,9 +2377,13 @@ int8_t _check_graph_field(
 
   gc = e->cache;
 
-  if (!gc->cached) return 0;
+  if (!__atomic_load_n(&gc->cached, __ATOMIC_ACQUIRE)) return 0;
 
-  if (d != NULL) memcpy(d, gc->data, e->size);
+  if (d != NULL) {
+    _lock_shards(c, 0, -1);
+    memcpy(d, gc->data, e->size);
+    _unlock_shards(c, 0, -1);
+  }
 
   return 1;
 }
@@ -686,10 +2395,17 @@ int8_t _check_list_field(
 
   lc = e->cache;
 
-  if (lc->data.size == 0) return 0;
+  _lock_shards(c, 0, -1);
+
+  if (lc->data.size == 0) {
+    _unlock_shards(c, 0, -1);
+    return 0;
+  }
 
   if (d != NULL) memcpy(d, &(lc->data), sizeof(array_t));
 
+  _unlock_shards(c, 0, -1);
+
   return 1;
 }
 
@@ -700,9 +2416,13 @@ int8_t _check_node_field(
 
   nc = e->cache;
 
-  if (!nc->cached[u]) return 0;
+  if (!__atomic_load_n(nc->cached+u, __ATOMIC_ACQUIRE)) return 0;
 
-  if (d != NULL) array_get(&nc->data, u, d);
+  if (d != NULL) {
+    _lock_shards(c, u, -1);
+    array_get(&nc->data, u, d);
+    _unlock_shards(c, u, -1);
+  }
 
   return 1;
 }
@@ -716,16 +2436,16 @@ int8_t _check_pair_field(
   fc     = e->cache;
   nnodes = graph_num_nodes(c->g);
 
-  if (!fc->cached[u]) return 0;
+  if (!__atomic_load_n(fc->cached+u, __ATOMIC_ACQUIRE)) return 0;
 
   if (d != NULL) {
-    if (_file_cache_read(fc->cachefile, d, nnodes, e->size, u*nnodes))
-      goto fail;
+
+    _lock_shards(c, u, -1);
+    _pair_row_read(e, nnodes, u, d);
+    _unlock_shards(c, u, -1);
   }
 
   return 1;
-fail:
-  return -1;
 }
 
 int8_t _check_edge_field(
@@ -739,15 +2459,25 @@ int8_t _check_edge_field(
   ec    = e->cache;
   nnbrs = graph_num_neighbours(c->g, u);
 
-  if (!ec->cached[u] && v < 0) return 0;
+  if (!__atomic_load_n(ec->cached+u, __ATOMIC_ACQUIRE)) return 0;
 
   if (d != NULL) {
 
-    if (v < 0) sz = e->size * nnbrs;
-    else       sz = e->size;
-    
-    tmp = edge_array_get_all(&ec->data, u);
-    memcpy(d, tmp, sz);
+    _lock_shards(c, u, -1);
+
+    if (v < 0) {
+      sz  = e->size * nnbrs;
+      tmp = edge_array_get_all(&ec->data, u);
+    }
+    else {
+      sz  = e->size;
+      tmp = edge_array_get(&ec->data, u, v);
+    }
+
+    if (tmp != NULL) memcpy(d, tmp, sz);
+    _unlock_shards(c, u, -1);
+
+    if (tmp == NULL) return 0;
   }
 
   return 1;
@@ -758,8 +2488,11 @@ uint8_t _update_graph_field(
 
   graph_cache_t *gc;
   gc = e->cache;
+
+  _lock_shards(c, 0, -1);
   memcpy(gc->data, d, e->size);
-  gc->cached = 1;
+  __atomic_store_n(&gc->cached, 1, __ATOMIC_RELEASE);
+  _unlock_shards(c, 0, -1);
 
   return 0;
 }
@@ -770,7 +2503,14 @@ uint8_t _update_list_field(
   list_cache_t *lc;
   lc = e->cache;
 
-  if (array_append(&(lc->data), d)) goto fail;
+  _lock_shards(c, 0, -1);
+
+  if (array_append(&(lc->data), d)) {
+    _unlock_shards(c, 0, -1);
+    goto fail;
+  }
+
+  _unlock_shards(c, 0, -1);
 
   return 0;
   
@@ -785,8 +2525,10 @@ uint8_t _update_node_field(
 
   nc  = e->cache;
 
+  _lock_shards(c, u, -1);
   array_set(&nc->data, u, d);
-  nc->cached[u] = 1;
+  __atomic_store_n(nc->cached+u, 1, __ATOMIC_RELEASE);
+  _unlock_shards(c, u, -1);
   
   return 0;
 }
@@ -800,15 +2542,13 @@ uint8_t _update_pair_field(
   nnodes = graph_num_nodes(c->g);
   fc     = e->cache;
 
-  if (_file_cache_write(fc->cachefile, d, nnodes, e->size, u*nnodes))
-    goto fail;
-
-  fc->cached[u] = 1;
+  _lock_shards(c, u, -1);
+  _pair_row_write(e, nnodes, u, d);
+  if (!__atomic_exchange_n(fc->cached+u, 1, __ATOMIC_ACQ_REL))
+    _account_row(e, (uint64_t)nnodes * fc->storesz, 1);
+  _unlock_shards(c, u, -1);
   
   return 0;
-
-fail:
-  return 1;
 }
 
 uint8_t _update_edge_field(
@@ -818,13 +2558,21 @@ uint8_t _update_edge_field(
 
   ec    = e->cache;
 
+  /*
+   * when a single edge is set, the value is
+   * stored in the rows of both end points
+   */
+  _lock_shards(c, u, v);
+
   if (v < 0) 
     edge_array_set_all(&ec->data, u, d);
   else 
     edge_array_set(&ec->data, u, v, d);
   
-  ec->cached[u] = 1;
-  if (v >= 0) ec->cached[v] = 1;
+  __atomic_store_n(ec->cached+u, 1, __ATOMIC_RELEASE);
+  if (v >= 0) __atomic_store_n(ec->cached+v, 1, __ATOMIC_RELEASE);
+
+  _unlock_shards(c, u, v);
 
   return 0;
 }
@@ -858,6 +2606,7 @@ static void _free_pair_field(cache_entry_t *c) {
 
   file_cache_t *fc;
   fc = (file_cache_t *)c->cache;
+  if (fc->map != NULL) munmap(fc->map, fc->mapsize);
   free(fc->cached);
   fclose(fc->cachefile);
   free(fc);
@@ -22,7 +22,43 @@
  *
  * Graph, node, list and edge-level statistics are kept in memory; pair-level
  * statistics take up too much space, so are stored offline in temporary
- * files, one per statistic.
+ * files, one per statistic. Each file is sparse, and memory mapped, so the
+ * kernel takes care of paging rows in and out. Pair-level values may
+ * optionally be stored at reduced precision (see stats_cache_compact_pairs).
+ *
+ * The cache may be used from several threads at once. The list of fields
+ * is protected by a read/write lock, which is only held for writing while
+ * a field is being added or evicted (see stats_cache_set_budget). Values are protected by a set of shard locks,
+ * the values for node u living in shard (u % STATS_CACHE_NUM_SHARDS), and
+ * the per-node 'cached' flags are read and written atomically, so threads
+ * working on different nodes rarely contend.
+ *
+ * The cache listens for edge events on its graph (see graph_event.h), and
+ * invalidates the values which an added or removed edge (u, v) can affect:
+ *
+ * - Graph and list-level fields are always invalidated, apart from the
+ *   intra- and inter-community edge counts of undirected graphs, which are
+ *   adjusted in place according to the labels of u and v.
+ *
+ * - Clustering and local efficiency are invalidated for u, v and their
+ *   common neighbours, and edge distance for u and v.
+ *
+ * - Path-based node and pair-level fields (path length, harmonic
+ *   centrality, number of paths, betweenness) are invalidated for the nodes in the component(s) which
+ *   contain u and v.
+ *
+ * - Component membership is only invalidated if the edit splits or merges
+ *   components.
+ *
+ * - The degree distribution (see stats_cache_degree_dist) of undirected
+ *   graphs is adjusted in place, according to the new degrees of u and v.
+ *
+ * - Edge-level fields are left alone - they are maintained incrementally
+ *   by the code which edits the graph (see graph_threshold.h).
+ *
+ * For directed graphs, every node and pair-level field other than edge
+ * distance is invalidated in full. When the edges of the graph are rebuilt
+ * (GRAPH_EVENT_EDGES_REBUILT), everything is invalidated.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
@@ -31,10 +67,13 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "graph/graph.h"
+#include "graph/graph_event.h"
 #include "util/array.h"
 #include "util/edge_array.h"
+#include "stats/stats.h"
 
 /**
  * Cache field identifiers.
@@ -73,7 +112,31 @@ enum {
   
   /*edge-level statistics*/
   STATS_CACHE_EDGE_PATHSHARING,
-  STATS_CACHE_EDGE_BETWEENNESS
+  STATS_CACHE_EDGE_BETWEENNESS,
+
+  /*
+   * graph-level statistics which are not in the group above,
+   * so that the IDs of fields in saved cache files (see
+   * stats_cache_save) remain the same
+   */
+  STATS_CACHE_DEGREE_SUMMARY,
+
+  /*node-level statistics, after the above for the same reason*/
+  STATS_CACHE_NODE_CORENESS,
+
+  /*graph-level statistics, after the above for the same reason*/
+  STATS_CACHE_APPROX_PATHS,
+
+  /*node-level statistics, after the above for the same reason*/
+  STATS_CACHE_NODE_HARMONIC,
+  STATS_CACHE_NODE_PARTICIPATION,
+  STATS_CACHE_NODE_ZSCORE,
+  STATS_CACHE_NODE_STRENGTH,
+  STATS_CACHE_NODE_WCLUSTERING,
+
+  /*graph and node-level statistics, after the above*/
+  STATS_CACHE_DIAMETER,
+  STATS_CACHE_NODE_ECCENTRICITY
 };
 
 /**
@@ -119,13 +182,30 @@ typedef struct _edge_cache {
 } edge_cache_t;
 
 /**
- * Struct used for pair and edge cache fields.
+ * Storage formats for pair-level fields.
+ */
+typedef enum {
+
+  STATS_CACHE_PAIR_RAW,    /**< values are stored as given            */
+  STATS_CACHE_PAIR_FLOAT,  /**< double values are stored as floats    */
+  STATS_CACHE_PAIR_UINT16  /**< double values, which must be integers,
+                                are stored as uint16_t values; values
+                                outside [0, 65535] are saturated      */
+
+} pair_format_t;
+
+/**
+ * Struct used for pair cache fields.
  */
 typedef struct _file_cache {
 
-  uint8_t *cached;    /**< per-node mask, whether values
-                           for that node are in the cache        */
-  FILE    *cachefile; /**< temp file containing the cache values */
+  uint8_t      *cached;    /**< per-node mask, whether values
+                                for that node are in the cache        */
+  FILE         *cachefile; /**< temp file containing the cache values */
+  uint8_t      *map;       /**< memory mapping of the cache file      */
+  uint64_t      mapsize;   /**< size of the mapping, in bytes         */
+  pair_format_t format;    /**< storage format                        */
+  uint16_t      storesz;   /**< size of one stored value              */
 
 } file_cache_t;
 
@@ -134,27 +214,80 @@ typedef struct _file_cache {
  */
 typedef struct _cache_entry {
 
-  uint16_t     id;    /**< globally unique field ID    */
-  cache_type_t type;  /**< field type                  */
-  uint16_t     size;  /**< size of one value           */
-  void        *cache; /**< pointer to the cache struct */
+  uint16_t     id;       /**< globally unique field ID          */
+  cache_type_t type;     /**< field type                        */
+  uint16_t     size;     /**< size of one value                 */
+  void        *cache;    /**< pointer to the cache struct       */
+  uint64_t     lastused; /**< cache clock value at the time the
+                              field was last accessed           */
+  uint64_t     acct;     /**< bytes accounted to the field (see
+                              util/memacct.h) - brought up to date
+                              whenever a field is added, and
+                              whenever a pair-level row is cached
+                              or invalidated                    */
 
 } cache_entry_t;
 
+/**
+ * Number of shard locks protecting the cached values.
+ */
+#define STATS_CACHE_NUM_SHARDS 64
+
 /**
  * This struct is added to the graph_t context
  */
 typedef struct _stats_cache {
 
-  graph_t *g;             /**< the graph being cached             */
-  array_t  cache_entries; /**< array of cache_entry_t structs     */
+  graph_t         *g;             /**< the graph being cached         */
+  array_t          cache_entries; /**< array of cache_entry_t structs */
+  pthread_rwlock_t lock;          /**< protects cache_entries         */
+  pthread_mutex_t  shards[STATS_CACHE_NUM_SHARDS];
+                                  /**< protect the cached values     */
+  uint8_t          compact;       /**< whether pair-level fields are
+                                       stored at reduced precision   */
+  uint64_t         budget;        /**< memory budget in bytes, or 0
+                                       for no limit                  */
+  uint32_t         pathsamples;   /**< number of source nodes sampled
+                                       for graph-level path measures,
+                                       or 0 for exact values         */
+  uint64_t         clock;         /**< incremented on every field
+                                       access, for LRU eviction      */
+  graph_event_listener_t gel;     /**< listens for edge additions and
+                                       removals, to invalidate the
+                                       values that they affect       */
+  uint32_t        *deghist;       /**< number of nodes of each degree,
+                                       maintained as edges are added
+                                       and removed                   */
+  uint32_t         deghistlen;    /**< capacity of deghist           */
+  uint32_t         maxdeg;        /**< maximum degree                */
+  uint8_t          degvalid;      /**< whether deghist and maxdeg
+                                       are up to date                */
 
 } stats_cache_t;
 
+/**
+ * Memory usage of one cache field, as reported by stats_cache_usage.
+ */
+typedef struct _stats_cache_usage {
+
+  uint16_t     id;       /**< field ID                               */
+  cache_type_t type;     /**< field type                             */
+  uint64_t     bytes;    /**< bytes used by the field                */
+  uint64_t     lastused; /**< cache clock value at last access - the
+                              field with the lowest value is the next
+                              to be evicted                          */
+
+} stats_cache_usage_t;
+
 /**
  * Attach a cache to the given graph. A call to graph_free (see graph_free.h)
  * will free the memory used by the cache.
  *
+ * If a memory budget has been set (see util/memacct.h), the cache is given
+ * a budget of whatever is left of it (see stats_cache_set_budget), and
+ * pair-level fields are compacted (see stats_cache_compact_pairs) if one
+ * full precision pair-level field would not fit in what is left.
+ *
  * \return 0 on success, non-0 on failure.
  */
 uint8_t stats_cache_init(
@@ -162,13 +295,10 @@ uint8_t stats_cache_init(
 );
 
 /**
- * Resets the cache on the given graph, discarding all cached values. This
- * function should be used after a graph has been modified, to discard
- * obsolete cache values.
- *
- * In particular, if graph edges have beeen added or removed, the cache memory
- * space will no longer be valid, so resetting the cache is necessary in such
- * a situation.
+ * Resets the cache on the given graph, discarding all cached values. Edge
+ * additions and removals are tracked by the cache, so this is only needed
+ * to discard the values of edge-level fields, or to free all of the
+ * memory used by the cache.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -233,6 +363,135 @@ uint8_t stats_cache_update(
   void     *data /**< pointer to the new value(s)                 */
 );
 
+/**
+ * Sets whether pair-level fields which are added to the cache from now on
+ * are stored at reduced precision. Compaction is off by default. When it is
+ * on, path lengths (STATS_CACHE_PAIR_PATHLENGTH), which are hop counts, are
+ * stored as uint16_t values, and any other pair-level fields of double
+ * values (e.g. STATS_CACHE_PAIR_NUMPATHS) are stored as floats. This
+ * reduces the size of the pair cache by a factor of four or two,
+ * respectively.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_cache_compact_pairs(
+  graph_t *g,      /**< the graph                             */
+  uint8_t  compact /**< non-0 to compact pair-level fields    */
+);
+
+/**
+ * Sets a memory budget for the cache. Whenever a field is added, and when
+ * the budget is set, the least recently used fields are evicted, in their
+ * entirety, until the cache is within budget. An evicted field behaves as
+ * if it had never been added - checks report a miss, and updates fail -
+ * so the statistic is simply recalculated when it is next needed.
+ *
+ * Graph, list, node and edge-level fields are counted at their allocated
+ * size; pair-level fields are file backed, and are counted by the number
+ * of rows which have been cached. The budget survives stats_cache_reset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_cache_set_budget(
+  graph_t  *g,     /**< the graph                        */
+  uint64_t  budget /**< budget in bytes, 0 for no limit  */
+);
+
+/**
+ * Sets the approximation level of the graph-level shortest path measures.
+ * When nsamples is non-0, stats_cache_graph_pathlength and
+ * stats_cache_global_efficiency return estimates calculated from nsamples
+ * source nodes by stats_approx_paths, unless the exact value is already in
+ * the cache. The level is 0 (exact values) by default, and survives
+ * stats_cache_reset.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_cache_set_path_samples(
+  graph_t  *g,       /**< the graph                               */
+  uint32_t  nsamples /**< number of source nodes, 0 for no
+                          approximation                           */
+);
+
+/**
+ * \return the approximation level set by stats_cache_set_path_samples, or
+ * 0 if the graph has no cache.
+ */
+uint32_t stats_cache_path_samples(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Reports the memory used by each field in the cache. One
+ * stats_cache_usage_t struct, for each field, is appended to the given
+ * array, which must have been created by the caller.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_cache_usage(
+  graph_t  *g,     /**< the graph                                  */
+  array_t  *usage, /**< array of stats_cache_usage_t structs, may
+                        be NULL                                    */
+  uint64_t *total  /**< place to store the total bytes used, may
+                        be NULL                                    */
+);
+
+/**
+ * Queries the degree distribution of the given graph. The distribution is
+ * built by a scan over the nodes the first time it is queried, and is then
+ * kept up to date as edges are added to and removed from undirected graphs,
+ * at a constant cost per edit, so that repeated queries on a graph which
+ * is being thresholded do not rescan it. It is rebuilt after an edit to a
+ * directed graph, or after the edges of the graph have been rebuilt.
+ *
+ * \return 0 on success, non-0 on failure, or if the graph has no cache.
+ */
+uint8_t stats_cache_degree_dist(
+  graph_t  *g,      /**< the graph                                    */
+  uint32_t *maxdeg, /**< place to store the maximum degree            */
+  uint32_t *hist    /**< space to store maxdeg+1 counts - the number
+                         of nodes with degree 0, 1, and so on. May be
+                         NULL.                                        */
+);
+
+/**
+ * \return a short, human readable name for the given cache field ID.
+ */
+char * stats_cache_field_name(
+  uint16_t id /**< the field ID */
+);
+
+/**
+ * Saves the contents of the cache to the given file, so that they may be
+ * re-used by a later run on the same graph (see stats_cache_load). The file
+ * is tagged with a hash of the graph structure, edge weights and node
+ * labels. Values are written in native byte order, so the file is only
+ * portable between machines of the same architecture. The file is written
+ * to a temporary file (fname.tmp), which is then renamed into place.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_cache_save(
+  graph_t *g,    /**< the graph                  */
+  char    *fname /**< name of the file to create */
+);
+
+/**
+ * Loads cached values, previously saved with stats_cache_save, into the
+ * cache of the given graph, which must have been initialised with
+ * stats_cache_init. Nothing is loaded if the file does not exist, or if it
+ * was saved from a different graph. If the file is truncated or otherwise
+ * unreadable, the cache is reset (see stats_cache_reset), so that nothing
+ * is loaded from it.
+ *
+ * \return 0 on success, or if the file does not exist or does not match
+ * the graph, non-0 on failure.
+ */
+uint8_t stats_cache_load(
+  graph_t *g,    /**< the graph                */
+  char    *fname /**< name of the file to load */
+);
+
 /**
  * Wrapper functions for each type of data which may be in the cache.  These
  * functions are implemented in stats_cache_wrapper.c. Use these functions if
@@ -255,11 +514,19 @@ double stats_cache_intra_edges(      graph_t *g);
 double stats_cache_inter_edges(      graph_t *g);
 double stats_cache_max_degree(       graph_t *g);
 double stats_cache_chira(            graph_t *g);
+double stats_cache_diameter(         graph_t *g);
+
+uint8_t stats_cache_degree_summary(
+  graph_t *g, stats_degree_summary_t *s);
+uint8_t stats_cache_approx_paths(
+  graph_t *g, uint32_t nsamples, stats_approx_paths_t *paths);
 
 uint8_t stats_cache_node_clustering(
   graph_t *g, int64_t n, double *data);
 uint8_t stats_cache_node_pathlength(
   graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_harmonic(
+  graph_t *g, int64_t n, double *data);
 uint8_t stats_cache_node_local_efficiency(
   graph_t *g, int64_t n, double *data);
 uint8_t stats_cache_betweenness_centrality(
@@ -270,6 +537,18 @@ uint8_t stats_cache_node_component(
   graph_t *g, int64_t n, uint32_t *data);
 uint8_t stats_cache_node_edgedist(
   graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_coreness(
+  graph_t *g, int64_t n, uint32_t *data);
+uint8_t stats_cache_node_participation(
+  graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_zscore(
+  graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_strength(
+  graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_wclustering(
+  graph_t *g, int64_t n, double *data);
+uint8_t stats_cache_node_eccentricity(
+  graph_t *g, int64_t n, uint32_t *data);
 
 uint8_t stats_cache_pair_pathlength(graph_t *g, uint32_t n, double *paths);
 uint8_t stats_cache_pair_numpaths(  graph_t *g, uint32_t n, double *paths);
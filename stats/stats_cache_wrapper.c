@@ -1,17 +1,94 @@
 /**
+ * Cached access to graph statistics. When a node-level statistic is
+ * requested for every node, the nodes are shared between threads. Every
+ * wrapper is timed when profiling is enabled (see util/profile.h).
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "util/parallel.h"
+#include "util/profile.h"
 #include "graph/graph.h"
+#include "graph/graph_bitset.h"
+#include "graph/graph_labelidx.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
+#include "stats/stats_plan.h"
+
+/**
+ * Number of nodes handed to a thread at a time, by _node_stat_all.
+ */
+#define NODE_STAT_CHUNK 16
+
+/**
+ * Context passed to _node_stat_range.
+ */
+typedef struct _node_stat_ctx {
+
+  graph_t *g;                         /**< the graph          */
+  uint16_t id;                        /**< cache field ID     */
+  double  *data;                      /**< the node values    */
+  double (*stat)(graph_t *, uint32_t); /**< per-node statistic */
+
+} node_stat_ctx_t;
+
+/**
+ * Calculates the given node-level statistic for every node in the graph,
+ * across all available processors. The statistic function must be safe to
+ * call from several threads at once; it will usually also store its value
+ * in the stats cache. Nodes whose value is already in the cache (e.g.
+ * because it was calculated for every node at once - see
+ * stats_plan_paths) are not recalculated.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _node_stat_all(
+  graph_t *g,                         /**< the graph                       */
+  uint16_t id,                        /**< cache field ID of the statistic */
+  double  *data,                      /**< place to store the value for
+                                           each node                       */
+  double (*stat)(graph_t *, uint32_t)  /**< function which calculates the
+                                           statistic for one node          */
+);
+
+/**
+ * parallel_for function used by _node_stat_all.
+ *
+ * \return 0.
+ */
+static uint8_t _node_stat_range(
+  uint64_t start,  /**< first node         */
+  uint64_t end,    /**< one past last node */
+  uint16_t thread, /**< calling thread     */
+  void    *ctx     /**< node_stat_ctx_t    */
+);
+
+/**
+ * Copies the cached value of the given node-level field for every node
+ * into data.
+ *
+ * \return 1 if every node has a cached value, 0 otherwise (in which case
+ * the contents of data are undefined).
+ */
+static uint8_t _node_check_all(
+  graph_t *g,   /**< the graph               */
+  uint16_t id,  /**< cache field ID          */
+  double  *data /**< place to store the values */
+);
+
+/**
+ * Adapters for the per-node statistics which take extra arguments, for
+ * use with _node_stat_all.
+ */
+static double _node_pathlength(graph_t *g, uint32_t n);
+static double _node_numpaths(  graph_t *g, uint32_t n);
 
 double stats_cache_approx_clustering(graph_t *g, uint32_t ntriples) {
 
   double clust;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_APPROX_CLUSTERING, 0, -1, &clust) == 1)
     return clust;
@@ -22,6 +99,7 @@ double stats_cache_approx_clustering(graph_t *g, uint32_t ntriples) {
 double stats_cache_graph_clustering(graph_t *g) {
 
   double clust;
+  PROFILE_FUNC();
   
   if (stats_cache_check(g, STATS_CACHE_GRAPH_CLUSTERING, 0, -1, &clust) == 1)
     return clust;
@@ -31,8 +109,8 @@ double stats_cache_graph_clustering(graph_t *g) {
 
 uint8_t stats_cache_node_clustering(graph_t *g, int64_t n, double *data) {
 
-  uint64_t i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g);
 
@@ -43,9 +121,9 @@ uint8_t stats_cache_node_clustering(graph_t *g, int64_t n, double *data) {
     
     if (n < 0 || n >= nnodes) {
       
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_clustering(g, i);
-      }
+      if (_node_stat_all(
+            g, STATS_CACHE_NODE_CLUSTERING, data, stats_clustering))
+        goto fail;
     }
     
     else {
@@ -53,22 +131,33 @@ uint8_t stats_cache_node_clustering(graph_t *g, int64_t n, double *data) {
     }
   }
   return 0;
+
+fail:
+  return 1;
 }
 
 double stats_cache_graph_pathlength(graph_t *g) {
 
-  double path;
+  double               path;
+  stats_approx_paths_t paths;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_GRAPH_PATHLENGTH, 0, -1, &path) == 1)
     return path;
 
+  if (stats_cache_path_samples(g) > 0) {
+    if (stats_cache_approx_paths(g, stats_cache_path_samples(g), &paths))
+      return -1;
+    return paths.pathlength;
+  }
+
   return stats_avg_pathlength(g);
 }
 
 uint8_t stats_cache_node_pathlength(graph_t *g, int64_t n, double *data) {
 
-  uint64_t i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g);
   
@@ -79,9 +168,9 @@ uint8_t stats_cache_node_pathlength(graph_t *g, int64_t n, double *data) {
     
     if (n < 0 || n >= nnodes) {
       
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_pathlength(g, i, NULL);
-      }
+      if (_node_stat_all(
+            g, STATS_CACHE_NODE_PATHLENGTH, data, _node_pathlength))
+        goto fail;
     }
     
     else {
@@ -90,10 +179,52 @@ uint8_t stats_cache_node_pathlength(graph_t *g, int64_t n, double *data) {
   }
 
   return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t stats_cache_node_harmonic(graph_t *g, int64_t n, double *data) {
+
+  uint32_t nnodes;
+  PROFILE_FUNC();
+
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_HARMONIC, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+
+      /*
+       * all nodes are calculated from one set of
+       * searches where possible - any which are
+       * left are calculated one by one
+       */
+      if (stats_plan_paths(g, STATS_PLAN_HARMONIC)) goto fail;
+
+      if (_node_stat_all(
+            g, STATS_CACHE_NODE_HARMONIC, data, stats_harmonic_centrality))
+        goto fail;
+    }
+
+    else {
+      *data = stats_harmonic_centrality(g, n);
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
 }
 
 uint8_t stats_cache_pair_pathlength(graph_t *g, uint32_t n, double *paths) {
 
+  PROFILE_FUNC();
+
   if (stats_cache_check(g, STATS_CACHE_PAIR_PATHLENGTH, n, -1, paths) == 1)
     return 0;
 
@@ -104,6 +235,7 @@ uint8_t stats_cache_pair_pathlength(graph_t *g, uint32_t n, double *paths) {
 double stats_cache_assortativity(graph_t *g) {
 
   double r;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_ASSORTATIVITY, 0, -1, &r) == 1)
     return r;
@@ -113,8 +245,10 @@ double stats_cache_assortativity(graph_t *g) {
 
 double stats_cache_num_components(graph_t *g) {
 
-  double ncmps;
+  uint32_t ncmps;
+  PROFILE_FUNC();
 
+  /*the number of components is cached as a uint32_t*/
   if (stats_cache_check(g, STATS_CACHE_NUM_COMPONENTS, 0, -1, &ncmps) == 1)
     return ncmps;
 
@@ -123,7 +257,8 @@ double stats_cache_num_components(graph_t *g) {
 
 double stats_cache_largest_component(graph_t *g) {
 
-  double lcmp;
+  uint32_t lcmp;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_LARGEST_COMPONENT, 0, -1, &lcmp) == 1)
     return lcmp;
@@ -135,6 +270,7 @@ uint8_t stats_cache_node_component(graph_t *g, int64_t n, uint32_t *data) {
 
   uint32_t  nnodes;
   uint32_t *components;
+  PROFILE_FUNC();
 
   components = NULL;
   nnodes     = graph_num_nodes(g);
@@ -169,9 +305,259 @@ fail:
   return 1;
 }
 
+uint8_t stats_cache_node_coreness(graph_t *g, int64_t n, uint32_t *data) {
+
+  uint32_t  nnodes;
+  uint32_t *cores;
+  PROFILE_FUNC();
+
+  cores  = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_CORENESS, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+      if (stats_coreness(g, data)) goto fail;
+    }
+
+    else {
+
+      cores = calloc(nnodes, sizeof(uint32_t));
+      if (cores == NULL) goto fail;
+
+      if (stats_coreness(g, cores)) goto fail;
+
+      *data = cores[n];
+
+      free(cores);
+      cores = NULL;
+    }
+  }
+
+  return 0;
+
+fail:
+  if (cores != NULL) free(cores);
+  return 1;
+}
+
+uint8_t stats_cache_node_eccentricity(
+  graph_t *g, int64_t n, uint32_t *data) {
+
+  uint32_t  nnodes;
+  uint32_t *ecc;
+  PROFILE_FUNC();
+
+  ecc    = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_ECCENTRICITY, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+      if (stats_eccentricity(g, data)) goto fail;
+    }
+
+    else {
+
+      ecc = calloc(nnodes, sizeof(uint32_t));
+      if (ecc == NULL) goto fail;
+
+      if (stats_eccentricity(g, ecc)) goto fail;
+
+      *data = ecc[n];
+
+      free(ecc);
+      ecc = NULL;
+    }
+  }
+
+  return 0;
+
+fail:
+  if (ecc != NULL) free(ecc);
+  return 1;
+}
+
+uint8_t stats_cache_node_participation(graph_t *g, int64_t n, double *data) {
+
+  uint32_t  nnodes;
+  double   *vals;
+  PROFILE_FUNC();
+
+  vals   = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_PARTICIPATION, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+
+      /*stats_roles caches both fields at once*/
+      if (!_node_check_all(g, STATS_CACHE_NODE_PARTICIPATION, data) &&
+          stats_roles(g, 0, data, NULL))
+        goto fail;
+    }
+
+    else {
+
+      vals = calloc(nnodes, sizeof(double));
+      if (vals == NULL) goto fail;
+
+      if (stats_roles(g, 0, vals, NULL)) goto fail;
+
+      *data = vals[n];
+
+      free(vals);
+      vals = NULL;
+    }
+  }
+
+  return 0;
+
+fail:
+  if (vals != NULL) free(vals);
+  return 1;
+}
+
+uint8_t stats_cache_node_zscore(graph_t *g, int64_t n, double *data) {
+
+  uint32_t  nnodes;
+  double   *vals;
+  PROFILE_FUNC();
+
+  vals   = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_ZSCORE, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+
+      /*stats_roles caches both fields at once*/
+      if (!_node_check_all(g, STATS_CACHE_NODE_ZSCORE, data) &&
+          stats_roles(g, 0, NULL, data))
+        goto fail;
+    }
+
+    else {
+
+      vals = calloc(nnodes, sizeof(double));
+      if (vals == NULL) goto fail;
+
+      if (stats_roles(g, 0, NULL, vals)) goto fail;
+
+      *data = vals[n];
+
+      free(vals);
+      vals = NULL;
+    }
+  }
+
+  return 0;
+
+fail:
+  if (vals != NULL) free(vals);
+  return 1;
+}
+
+uint8_t stats_cache_node_strength(graph_t *g, int64_t n, double *data) {
+
+  uint32_t nnodes;
+  PROFILE_FUNC();
+
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_STRENGTH, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+      if (_node_stat_all(g, STATS_CACHE_NODE_STRENGTH, data, stats_strength))
+        goto fail;
+    }
+
+    else {
+      *data = stats_strength(g, n);
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t stats_cache_node_wclustering(graph_t *g, int64_t n, double *data) {
+
+  uint32_t  nnodes;
+  double   *vals;
+  PROFILE_FUNC();
+
+  vals   = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_NODE_WCLUSTERING, n, -1, data) == 1)
+    return 0;
+
+  if (data != NULL) {
+
+    if (n < 0 || n >= nnodes) {
+
+      if (!_node_check_all(g, STATS_CACHE_NODE_WCLUSTERING, data) &&
+          stats_weighted_clustering(g, 0, data))
+        goto fail;
+    }
+
+    else {
+
+      vals = calloc(nnodes, sizeof(double));
+      if (vals == NULL) goto fail;
+
+      if (stats_weighted_clustering(g, 0, vals)) goto fail;
+
+      *data = vals[n];
+
+      free(vals);
+      vals = NULL;
+    }
+  }
+
+  return 0;
+
+fail:
+  if (vals != NULL) free(vals);
+  return 1;
+}
+
+uint8_t _node_check_all(graph_t *g, uint16_t id, double *data) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  for (i = 0; i < nnodes; i++) {
+    if (stats_cache_check(g, id, i, -1, data + i) != 1) return 0;
+  }
+
+  return nnodes > 0;
+}
+
 double stats_cache_connected(graph_t *g) {
 
   double connected;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_CONNECTED, 0, -1, &connected) == 1)
     return connected;
@@ -181,11 +567,19 @@ double stats_cache_connected(graph_t *g) {
 
 double stats_cache_global_efficiency(graph_t *g) {
 
-  double eff;
+  double               eff;
+  stats_approx_paths_t paths;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_GLOBAL_EFFICIENCY, 0, -1, &eff) == 1)
     return eff;
 
+  if (stats_cache_path_samples(g) > 0) {
+    if (stats_cache_approx_paths(g, stats_cache_path_samples(g), &paths))
+      return -1;
+    return paths.efficiency;
+  }
+
   return stats_global_efficiency(g);
 }
 
@@ -193,6 +587,7 @@ double stats_cache_global_efficiency(graph_t *g) {
 double stats_cache_local_efficiency(graph_t *g) {
 
   double eff;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_LOCAL_EFFICIENCY, 0, -1, &eff) == 1)
     return eff;
@@ -204,8 +599,8 @@ double stats_cache_local_efficiency(graph_t *g) {
 uint8_t stats_cache_node_local_efficiency(
   graph_t *g, int64_t n, double *data) {
 
-  int64_t  i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g);
 
@@ -216,9 +611,10 @@ uint8_t stats_cache_node_local_efficiency(
 
     if (n < 0 || n >= nnodes) {
       
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_local_efficiency(g, i);
-      }
+      if (_node_stat_all(
+            g, STATS_CACHE_NODE_LOCAL_EFFICIENCY, data,
+            stats_local_efficiency))
+        goto fail;
     }
     
     else {
@@ -227,43 +623,41 @@ uint8_t stats_cache_node_local_efficiency(
   }
 
   return 0;
+
+fail:
+  return 1;
 }
 
 double stats_cache_modularity(graph_t *g) {
 
   double    mod;
   uint32_t *comms;
-  uint64_t  i;
-  uint32_t  nnodes;
   uint32_t  ncomms;
-
-  comms = NULL;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_MODULARITY, 0, -1, &mod) == 1)
     return mod;
 
-  nnodes = graph_num_nodes(    g);
-  ncomms = graph_num_labelvals(g);
+  /*
+   * communities are identified by the dense
+   * index of each node's label value, so that
+   * they lie in the range [0, ncomms)
+   */
+  ncomms = graph_labelidx_num(  g);
+  comms  = graph_labelidx_nodes(g);
 
-  comms = calloc(nnodes,sizeof(uint32_t));
   if (comms == NULL) goto fail;
 
-  for (i = 0; i < nnodes; i++) 
-    comms[i] = graph_get_nodelabel(g, i)->labelval;
-
-  mod = stats_modularity(g, ncomms, comms);
-  free(comms);
-  return mod;
+  return stats_modularity(g, ncomms, comms);
 
 fail:
-
-  if (comms != NULL) free(comms);
   return 0xFF;
 }
 
 double stats_cache_intra_edges(graph_t *g) {
 
   double intra;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_INTRA_EDGES, 0, -1, &intra) == 1)
     return intra;
@@ -274,6 +668,7 @@ double stats_cache_intra_edges(graph_t *g) {
 double stats_cache_inter_edges(graph_t *g) {
 
   double inter;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_INTER_EDGES, 0, -1, &inter) == 1)
     return inter;
@@ -285,46 +680,78 @@ double stats_cache_inter_edges(graph_t *g) {
 
 double stats_cache_max_degree(graph_t *g) {
 
-  double maxdeg;
+  uint32_t maxdeg;
+  PROFILE_FUNC();
 
-  if (stats_cache_check(g, STATS_CACHE_MAX_DEGREE, 0, -1, &maxdeg) == 1)
+  /*the cache keeps the degree distribution up to date*/
+  if (stats_cache_degree_dist(g, &maxdeg, NULL) == 0)
     return maxdeg;
 
-  maxdeg = stats_max_degree(g);
+  return stats_max_degree(g);
+}
 
+double stats_cache_diameter(graph_t *g) {
 
-  return maxdeg;
+  double   r;
+  uint32_t diam;
+  PROFILE_FUNC();
+
+  if (stats_cache_check(g, STATS_CACHE_DIAMETER, 0, -1, &r) == 1)
+    return r;
+
+  if (stats_diameter(g, &diam)) return -1;
+
+  return diam;
+}
+
+uint8_t stats_cache_degree_summary(graph_t *g, stats_degree_summary_t *s) {
+
+  PROFILE_FUNC();
+
+  if (stats_cache_check(g, STATS_CACHE_DEGREE_SUMMARY, 0, -1, s) == 1)
+    return 0;
+
+  return stats_degree_summary(g, s);
+}
+
+uint8_t stats_cache_approx_paths(
+  graph_t *g, uint32_t nsamples, stats_approx_paths_t *paths) {
+
+  PROFILE_FUNC();
+
+  /*a cached estimate is only used if it has the same number of samples*/
+  if (nsamples > graph_num_nodes(g)) nsamples = graph_num_nodes(g);
+
+  if (stats_cache_check(g, STATS_CACHE_APPROX_PATHS, 0, -1, paths) == 1 &&
+      paths->nsamples == nsamples)
+    return 0;
+
+  return stats_approx_paths(g, nsamples, paths);
 }
 
 double stats_cache_chira(graph_t *g) {
 
   double    mod;
   uint32_t *comms;
-  uint64_t  i;
-  uint32_t  nnodes;
   uint32_t  ncomms;
-
-  comms = NULL;
+  PROFILE_FUNC();
 
   if (stats_cache_check(g, STATS_CACHE_CHIRA, 0, -1, &mod) == 1)
     return mod;
 
-  nnodes = graph_num_nodes(    g);
-  ncomms = graph_num_labelvals(g);
+  /*
+   * communities are identified by the dense
+   * index of each node's label value, so that
+   * they lie in the range [0, ncomms)
+   */
+  ncomms = graph_labelidx_num(  g);
+  comms  = graph_labelidx_nodes(g);
 
-  comms = calloc(nnodes,sizeof(uint32_t));
   if (comms == NULL) goto fail;
 
-  for (i = 0; i < nnodes; i++) 
-    comms[i] = graph_get_nodelabel(g, i)->labelval;
-
-  mod = stats_chira(g, ncomms, comms);
-  free(comms);
-  return mod;
+  return stats_chira(g, ncomms, comms);
 
 fail:
-
-  if (comms != NULL) free(comms);
   return 0xFF;
 }
 
@@ -333,6 +760,7 @@ uint8_t stats_cache_betweenness_centrality(
 
   uint64_t i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g);
 
@@ -344,8 +772,22 @@ uint8_t stats_cache_betweenness_centrality(
 
     if (n < 0 || n >= nnodes) {
 
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_betweenness_centrality(g, i);
+      /*
+       * For undirected graphs, the values for every
+       * node are calculated (and cached) in one pass
+       */
+      if (graph_is_directed(g)) {
+        if (_node_stat_all(
+              g, STATS_CACHE_BETWEENNESS_CENTRALITY, data,
+              stats_betweenness_centrality))
+          goto fail;
+      }
+      else {
+        for (i = 0; i < nnodes; i++) {
+          if (stats_cache_check(
+                g, STATS_CACHE_BETWEENNESS_CENTRALITY, i, -1, data+i) != 1)
+            data[i] = stats_betweenness_centrality(g, i);
+        }
       }
     }
 
@@ -355,12 +797,15 @@ uint8_t stats_cache_betweenness_centrality(
   }
 
   return 0;
+
+fail:
+  return 1;
 }
 
 uint8_t stats_cache_node_numpaths(graph_t *g, int64_t n, double *data) {
 
-  uint64_t i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g);
 
@@ -371,9 +816,15 @@ uint8_t stats_cache_node_numpaths(graph_t *g, int64_t n, double *data) {
 
     if (n < 0 || n >= nnodes) {
 
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_numpaths(g, i, NULL);
-      }
+      /*
+       * counting from every node in one Brandes sweep
+       * does not need the per-pair counts to be cached
+       */
+      if (stats_plan_paths(g, STATS_PLAN_NUMPATHS)) goto fail;
+
+      if (_node_stat_all(
+            g, STATS_CACHE_NODE_NUMPATHS, data, _node_numpaths))
+        goto fail;
     }
 
     else {
@@ -382,12 +833,15 @@ uint8_t stats_cache_node_numpaths(graph_t *g, int64_t n, double *data) {
   }
 
   return 0;
+
+fail:
+  return 1;
 }
 
 uint8_t stats_cache_node_edgedist(graph_t *g, int64_t n, double *data) {
 
-  uint64_t i;
   uint32_t nnodes;
+  PROFILE_FUNC();
 
   nnodes = graph_num_nodes(g); 
 
@@ -395,26 +849,45 @@ uint8_t stats_cache_node_edgedist(graph_t *g, int64_t n, double *data) {
     return 0;
 
   if (data != NULL) {
-    
+
     if (n < 0 || n >= nnodes) {
 
-      for (i = 0; i < nnodes; i++) {
-        data[i] = stats_avg_edge_distance(g, i);
-      }
+      if (stats_edge_distances(g, NULL, data) &&
+          _node_stat_all(
+            g, STATS_CACHE_NODE_EDGEDIST, data, stats_avg_edge_distance))
+        goto fail;
     }
 
     else {
+
+      /*
+       * the averages for every node are calculated in one
+       * sweep, which costs little more than the average for
+       * one node - but only if they can be cached for later
+       */
+      if (stats_cache_add(g,
+                          STATS_CACHE_NODE_EDGEDIST,
+                          STATS_CACHE_TYPE_NODE,
+                          sizeof(double)) == 0       &&
+          stats_edge_distances(g, NULL, NULL) == 0 &&
+          stats_cache_check(
+            g, STATS_CACHE_NODE_EDGEDIST, n, -1, data) == 1)
+        return 0;
+
       *data = stats_avg_edge_distance(g, n);
     }
   }
-  
-
 
   return 0;
+
+fail:
+  return 1;
 }
 
 uint8_t stats_cache_pair_numpaths(graph_t *g, uint32_t n, double *paths) {
 
+  PROFILE_FUNC();
+
   if (stats_cache_check(g, STATS_CACHE_PAIR_NUMPATHS, n, -1, paths) == 1)
     return 0;
 
@@ -428,6 +901,7 @@ uint8_t stats_cache_edge_pathsharing(graph_t *g, uint32_t n, double *ps) {
   uint32_t  nnbrs;
   uint32_t *nbrs;
   double    tmp;
+  PROFILE_FUNC();
   
   if (stats_cache_check(g, STATS_CACHE_EDGE_PATHSHARING, n, -1, ps) == 1)
     return 0;
@@ -446,9 +920,60 @@ uint8_t stats_cache_edge_pathsharing(graph_t *g, uint32_t n, double *ps) {
 
 uint8_t stats_cache_edge_betweenness(graph_t *g, uint32_t n, double *eb) {
 
+  PROFILE_FUNC();
+
   if (stats_cache_check(g, STATS_CACHE_EDGE_BETWEENNESS, n, -1, eb) == 1)
     return 0;
 
   stats_edge_betweenness(g, n, eb);
   return 0;
 }
+
+uint8_t _node_stat_all(
+  graph_t  *g,
+  uint16_t  id,
+  double   *data,
+  double  (*stat)(graph_t *, uint32_t)) {
+
+  node_stat_ctx_t ctx;
+
+  ctx.g    = g;
+  ctx.id   = id;
+  ctx.data = data;
+  ctx.stat = stat;
+
+  /*
+   * the bitset adjacency matrix is created up front, as
+   * it is not created in a thread-safe manner - without
+   * it, the node values are calculated as usual
+   */
+  graph_bitset_init(g);
+
+  return parallel_for(
+    0, graph_num_nodes(g), NODE_STAT_CHUNK, &ctx, _node_stat_range);
+}
+
+uint8_t _node_stat_range(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t         i;
+  node_stat_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++) {
+
+    if (stats_cache_check(ctx->g, ctx->id, i, -1, ctx->data+i) != 1)
+      ctx->data[i] = ctx->stat(ctx->g, i);
+  }
+
+  return 0;
+}
+
+double _node_pathlength(graph_t *g, uint32_t n) {
+  return stats_pathlength(g, n, NULL);
+}
+
+double _node_numpaths(graph_t *g, uint32_t n) {
+  return stats_numpaths(g, n, NULL);
+}
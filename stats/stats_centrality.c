@@ -7,6 +7,10 @@
  * 
  *   - Closeness centrality, the inverse of the average shortest path from a
  *     node to all other nodes.
+ *
+ *   - Harmonic centrality, the average inverse shortest path from a node
+ *     to all other nodes (with unreachable nodes counting as 0), which,
+ *     unlike closeness, is meaningful for disconnected graphs.
  * 
  *   - Betweenness centrality, the ratio of shortest paths which contain this 
  *     node to all shortest paths, between every pair of nodes in the graph.
@@ -15,6 +19,9 @@
  *   Conceptual Clarification. Social Networksw, 
  *   1:3:215-239
  *
+ *   Boldi P & Vigna S 2014. Axioms for Centrality.
+ *   Internet Mathematics, 10:3-4:222-262
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 #include <stdint.h>
@@ -22,9 +29,34 @@
 #include <float.h>
 
 #include "graph/graph.h"
+#include "graph/bfs.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
+/**
+ * Calculates the betweenness centrality of the given node from the path
+ * lengths and path counts between every pair of nodes. Used for directed
+ * graphs.
+ *
+ * \return the betweenness centrality of the given node, or -1 on failure.
+ */
+static double _pair_betweenness(
+  graph_t *g, /**< the graph to query */
+  uint32_t v  /**< the node to query  */
+);
+
+/**
+ * Callback function for the breadth first search used by
+ * stats_harmonic_centrality. Adds the inverse distance of every node at
+ * the current level to the sum.
+ *
+ * \return 0 always.
+ */
+static uint8_t _harmonic_cb(
+  bfs_state_t *state,  /**< current search state   */
+  void        *context /**< pointer to a double sum */
+);
+
 double stats_degree_centrality(graph_t *g, uint32_t nidx) {
 
   double nnodes;
@@ -61,8 +93,87 @@ double stats_closeness_centrality(graph_t *g, uint32_t nidx) {
   return closeness;
 }
 
+double stats_harmonic_centrality(graph_t *g, uint32_t nidx) {
+
+  uint32_t nnodes;
+  double   invsum;
+  double   harmonic;
+
+  nnodes = graph_num_nodes(g);
+  invsum = 0;
+
+  if (nnodes < 2) harmonic = 0;
+
+  else {
+
+    if (bfs_hybrid(g, &nidx, 1, NULL, &invsum, _harmonic_cb)) goto fail;
+
+    harmonic = invsum / (nnodes - 1);
+  }
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_HARMONIC,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_NODE_HARMONIC, nidx, -1, &harmonic);
+
+  return harmonic;
+
+fail:
+  return -1;
+}
+
 double stats_betweenness_centrality(graph_t *g, uint32_t v) {
 
+  uint64_t i;
+  uint32_t nnodes;
+  double   betweenness;
+  double   val;
+  double  *nodebetw;
+
+  if (graph_is_directed(g)) return _pair_betweenness(g, v);
+
+  nodebetw = NULL;
+  nnodes   = graph_num_nodes(g);
+
+  nodebetw = calloc(nnodes, sizeof(double));
+  if (nodebetw == NULL) goto fail;
+
+  /*
+   * The values for every node are calculated in one
+   * pass, and cached, so subsequent calls for other
+   * nodes are free if the stats cache is enabled.
+   *
+   * Brandes' algorithm counts the shortest paths
+   * between every pair of nodes twice, once from each
+   * end; the normalisation (2/((n-1)(n-2))) accounts
+   * for this.
+   */
+  if (stats_brandes(g, NULL, 0, 0, nodebetw, NULL)) goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_BETWEENNESS_CENTRALITY,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  for (i = 0; i < nnodes; i++) {
+
+    val = nodebetw[i] / ((nnodes-1.0)*(nnodes-2.0));
+    stats_cache_update(g, STATS_CACHE_BETWEENNESS_CENTRALITY, i, -1, &val);
+  }
+
+  betweenness = nodebetw[v] / ((nnodes-1.0)*(nnodes-2.0));
+
+  free(nodebetw);
+  return betweenness;
+
+fail:
+  if (nodebetw != NULL) free(nodebetw);
+  return -1;
+}
+
+double _pair_betweenness(graph_t *g, uint32_t v) {
+
   int64_t   s;
   int64_t   t;
   uint32_t  count;
@@ -160,3 +271,19 @@ fail:
   if (spaths    != NULL) free(spaths);
   return -1;
 }
+
+uint8_t _harmonic_cb(bfs_state_t *state, void *context) {
+
+  double *invsum;
+
+  invsum = context;
+
+  /*
+   * accumulated in the same way as by the
+   * all-sources searches (see stats_plan.h)
+   */
+  if (state->depth > 0 && state->thislevel.size > 0)
+    *invsum += (float)(state->thislevel.size)/(state->depth);
+
+  return 0;
+}
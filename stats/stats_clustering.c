@@ -7,11 +7,18 @@
  *   Watts DJ & Strogatz Sh 1998. Collective dynamics 
  *   of small world networks. Nature, 393:440-442.
  *
+ * The number of edges between the neighbours of a node is counted by
+ * intersecting its (sorted) neighbour list with that of each neighbour,
+ * or, when the graph has a bitset adjacency matrix (see
+ * graph/graph_bitset.h), by intersecting rows of the matrix.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 #include <stdint.h>
 
+#include "util/intersect.h"
 #include "graph/graph.h"
+#include "graph/graph_bitset.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
@@ -25,6 +32,9 @@ double stats_avg_clustering(graph_t *g) {
   numnodes = graph_num_nodes(g); 
   avgclust = 0;
 
+  /*without a bitset, the node values are calculated as usual*/
+  graph_bitset_init(g);
+
   for (i = 0; i < numnodes; i++) {
 
     clust = stats_clustering(g, i);
@@ -44,14 +54,15 @@ double stats_avg_clustering(graph_t *g) {
 
 double stats_clustering(graph_t *g, uint32_t nidx) {
 
-  uint32_t  i;
-  uint32_t  j;
-  uint32_t  numedges;
-  uint32_t  maxedges;
-  uint32_t  nneighbours;
-  uint32_t *neighbours;
-  double    clust;
+  uint32_t        i;
+  uint32_t        numedges;
+  uint32_t        maxedges;
+  uint32_t        nneighbours;
+  uint32_t       *neighbours;
+  graph_bitset_t *bs;
+  double          clust;
 
+  bs          = graph_bitset_get(g);
   nneighbours = graph_num_neighbours(g, nidx);
   neighbours  = graph_get_neighbours(g, nidx);
   maxedges    = nneighbours*(nneighbours-1) / 2;
@@ -62,14 +73,24 @@ double stats_clustering(graph_t *g, uint32_t nidx) {
 
   /*
    * count the number of edges which exist 
-   * between the neighbours of node nidx
+   * between the neighbours of node nidx - for
+   * each neighbour i, the edges from i to the
+   * neighbours which come after it in the list
+   * (or, with a bitset, every edge is counted
+   * twice)
    */
-  for (i = 0; i < nneighbours; i++) {
-    for (j = i+1; j < nneighbours; j++) {
+  for (i = 0; bs != NULL && i < nneighbours; i++)
+    numedges += graph_bitset_common(bs, nidx, neighbours[i]);
+
+  if (bs != NULL) numedges /= 2;
+
+  for (i = 0; bs == NULL && i < nneighbours-1; i++) {
 
-      if (graph_are_neighbours(g, neighbours[i], neighbours[j]))
-        numedges ++;
-    }
+    numedges += intersect_count(
+      neighbours + i + 1,
+      nneighbours - i - 1,
+      graph_get_neighbours(g, neighbours[i]),
+      graph_num_neighbours(g, neighbours[i]));
   }
 
   clust = (double)numedges / maxedges;
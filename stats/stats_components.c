@@ -4,6 +4,7 @@
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 
+#include <math.h>
 #include <float.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -39,6 +40,14 @@ static uint8_t _bfs_cb(
   void        *context /**< pointer to a visited array */
 );
 
+/**
+ * \return the distance between the given node and point.
+ */
+static double _point_dist(
+  graph_label_t *lbl, /**< label of the node */
+  double        *p    /**< the point (x,y,z) */
+);
+
 uint32_t stats_num_components(
   graph_t *g, uint32_t sz, array_t *sizes, uint32_t *cmpnums) {
 
@@ -70,7 +79,7 @@ uint32_t stats_num_components(
     ctx.component[i] = ctx.cmpnum;
     root = i;
     ctx.visited[i] = 1;
-    if (bfs(g, &root, 1, NULL, &ctx, NULL, _bfs_cb, NULL)) goto fail;
+    if (bfs_hybrid(g, &root, 1, NULL, &ctx, _bfs_cb)) goto fail;
 
     if (ctx.size < sz) continue;
     
@@ -149,6 +158,159 @@ fail:
   return -1.0;
 }
 
+uint8_t stats_component_spans(
+  graph_t *g, uint32_t ncmps, stats_span_t *spans) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint32_t       c;
+  uint32_t       nnodes;
+  uint32_t      *cmps;
+  uint32_t      *far;
+  double        *fardist;
+  double         p[3];
+  double         d;
+  double         diag;
+  graph_label_t *lbl;
+  stats_span_t  *s;
+
+  cmps    = NULL;
+  far     = NULL;
+  fardist = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  if (ncmps == 0) return 0;
+
+  cmps    = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  far     = malloc((uint64_t)ncmps * sizeof(uint32_t));
+  fardist = malloc((uint64_t)ncmps * sizeof(double));
+
+  if (cmps    == NULL) goto fail;
+  if (far     == NULL) goto fail;
+  if (fardist == NULL) goto fail;
+
+  if (nnodes > 0 && stats_cache_node_component(g, -1, cmps)) goto fail;
+
+  for (i = 0; i < ncmps; i++) {
+
+    s = spans + i;
+
+    s->size      = 0;
+    s->span      = 0;
+    s->spanbound = 0;
+
+    for (j = 0; j < 3; j++) {
+      s->min[     j] =  DBL_MAX;
+      s->max[     j] = -DBL_MAX;
+      s->centroid[j] =  0;
+    }
+
+    fardist[i] = -1;
+  }
+
+  /*bounding boxes, and coordinate sums*/
+  for (i = 0; i < nnodes; i++) {
+
+    if (cmps[i] >= ncmps) continue;
+
+    lbl = graph_get_nodelabel(g, i);
+    if (lbl == NULL) goto fail;
+
+    s    = spans + cmps[i];
+    p[0] = lbl->xval;
+    p[1] = lbl->yval;
+    p[2] = lbl->zval;
+
+    s->size++;
+
+    for (j = 0; j < 3; j++) {
+      if (p[j] < s->min[j]) s->min[j] = p[j];
+      if (p[j] > s->max[j]) s->max[j] = p[j];
+      s->centroid[j] += p[j];
+    }
+  }
+
+  for (i = 0; i < ncmps; i++) {
+    for (j = 0; j < 3 && spans[i].size > 0; j++)
+      spans[i].centroid[j] /= spans[i].size;
+  }
+
+  /*the node in each component furthest from its centroid*/
+  for (i = 0; i < nnodes; i++) {
+
+    c = cmps[i];
+    if (c >= ncmps) continue;
+
+    d = _point_dist(graph_get_nodelabel(g, i), spans[c].centroid);
+
+    if (d > fardist[c]) {
+      fardist[c] = d;
+      far[    c] = i;
+    }
+  }
+
+  /*
+   * the node furthest from that one - the
+   * furthest distance from any point is at
+   * least the distance from it to the
+   * centroid, so the span found is at least
+   * half of the true span
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    c = cmps[i];
+    if (c >= ncmps) continue;
+
+    lbl  = graph_get_nodelabel(g, far[c]);
+    p[0] = lbl->xval;
+    p[1] = lbl->yval;
+    p[2] = lbl->zval;
+
+    d = _point_dist(graph_get_nodelabel(g, i), p);
+
+    if (d > spans[c].span) spans[c].span = d;
+  }
+
+  for (i = 0; i < ncmps; i++) {
+
+    s = spans + i;
+
+    if (s->size == 0) continue;
+
+    diag = 0;
+    for (j = 0; j < 3; j++)
+      diag += (s->max[j] - s->min[j]) * (s->max[j] - s->min[j]);
+    diag = sqrt(diag);
+
+    s->spanbound = 2 * fardist[i];
+    if (diag < s->spanbound) s->spanbound = diag;
+  }
+
+  free(cmps);
+  free(far);
+  free(fardist);
+  return 0;
+
+fail:
+  if (cmps    != NULL) free(cmps);
+  if (far     != NULL) free(far);
+  if (fardist != NULL) free(fardist);
+  return 1;
+}
+
+double _point_dist(graph_label_t *lbl, double *p) {
+
+  double dx;
+  double dy;
+  double dz;
+
+  dx = lbl->xval - p[0];
+  dy = lbl->yval - p[1];
+  dz = lbl->zval - p[2];
+
+  return sqrt(dx*dx + dy*dy + dz*dz);
+}
+
 static uint8_t _bfs_cb(bfs_state_t *state, void *context) {
   
   uint64_t i;
@@ -0,0 +1,43 @@
+/**
+ * Function which calculates the core number of every node in a graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_kcore.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+
+uint8_t stats_coreness(graph_t *g, uint32_t *cores) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t *c;
+
+  nnodes = graph_num_nodes(g);
+  c      = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (c == NULL)               goto fail;
+  if (graph_kcore(g, c, NULL)) goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_CORENESS,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(uint32_t));
+
+  for (i = 0; i < nnodes; i++)
+    stats_cache_update(g, STATS_CACHE_NODE_CORENESS, i, -1, c+i);
+
+  if (cores != NULL) memcpy(cores, c, nnodes*sizeof(uint32_t));
+
+  free(c);
+  return 0;
+
+fail:
+  if (c != NULL) free(c);
+  return 1;
+}
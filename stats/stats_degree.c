@@ -1,15 +1,77 @@
 /**
- * Functions which calculate the degree of a node, or of a graph.
+ * Functions which calculate the degree of a node, or of a graph, and a
+ * summary of the degree-based statistics of a graph, including its
+ * assortativity:
+ *
+ *   Newman MEJ 2002. Assortative mixing in networks.
+ *   Physical Review Letters, Vol. 89, No. 2.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 
+#include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "graph/graph.h"
+#include "util/parallel.h"
+#include "util/profile.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
+/**
+ * Number of nodes handed to a thread at a time by stats_degree_summary.
+ */
+#define DEGREE_SUMMARY_CHUNK 4096
+
+/**
+ * Sums accumulated by one thread. The assortativity sums are over every
+ * edge (u,v), but are accumulated node by node:
+ *
+ *   sum of deg(u)*deg(v)         = 1/2 sum_u deg(u) * sum_{v in N(u)} deg(v)
+ *   sum of deg(u)+deg(v)         = sum_u deg(u)^2
+ *   sum of deg(u)^2+deg(v)^2     = sum_u deg(u)^3
+ *
+ * They are integers, so the result does not depend on how the nodes are
+ * shared between threads. The struct is padded to a cache line, so that
+ * the sums of different threads do not share one.
+ */
+typedef struct _degree_sums {
+
+  uint64_t prod;      /**< twice the sum of deg(u)*deg(v)   */
+  uint64_t sq;        /**< sum of deg(u)^2                   */
+  uint64_t cube;      /**< sum of deg(u)^3                   */
+  uint32_t mindeg;    /**< minimum degree                    */
+  uint32_t maxdeg;    /**< maximum degree                    */
+  uint32_t nisolated; /**< number of nodes with no neighbours */
+  uint8_t  pad[28];
+
+} degree_sums_t;
+
+/**
+ * Context passed to _degree_sums.
+ */
+typedef struct _degree_ctx {
+
+  graph_t       *g;    /**< the graph             */
+  degree_sums_t *sums; /**< sums for every thread */
+
+} degree_ctx_t;
+
+/**
+ * parallel_for function used by stats_degree_summary - accumulates the
+ * sums for nodes [start, end).
+ *
+ * \return 0.
+ */
+static uint8_t _degree_sums(
+  uint64_t start,  /**< first node          */
+  uint64_t end,    /**< one past last node  */
+  uint16_t thread, /**< calling thread      */
+  void    *ctx     /**< degree_ctx_t        */
+);
+
 double stats_avg_degree(graph_t *g) {
 
   uint32_t nnodes;
@@ -51,3 +113,146 @@ uint32_t stats_degree(graph_t *g, uint32_t nidx) {
 
   return graph_num_neighbours(g, nidx);
 }
+
+uint8_t stats_degree_summary(graph_t *g, stats_degree_summary_t *s) {
+
+  uint64_t       i;
+  uint16_t       nthreads;
+  uint32_t       nnodes;
+  uint32_t       nedges;
+  uint64_t       prod;
+  uint64_t       sq;
+  uint64_t       cube;
+  double         m;
+  double         r;
+  degree_sums_t *t;
+  degree_ctx_t   ctx;
+
+  PROFILE_FUNC();
+
+  nnodes   = graph_num_nodes(g);
+  nedges   = graph_num_edges(g);
+  nthreads = parallel_num_threads();
+  if (nthreads > PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads == 0)                   nthreads = 1;
+
+  ctx.g    = g;
+  ctx.sums = calloc(nthreads, sizeof(degree_sums_t));
+  if (ctx.sums == NULL) goto fail;
+
+  for (i = 0; i < nthreads; i++) ctx.sums[i].mindeg = UINT32_MAX;
+
+  if (parallel_for(
+        nthreads, nnodes, DEGREE_SUMMARY_CHUNK, &ctx, _degree_sums))
+    goto fail;
+
+  memset(s, 0, sizeof(stats_degree_summary_t));
+
+  prod         = 0;
+  sq           = 0;
+  cube         = 0;
+  s->mindegree = nnodes > 0 ? UINT32_MAX : 0;
+
+  for (i = 0; i < nthreads; i++) {
+
+    t     = ctx.sums + i;
+    prod += t->prod;
+    sq   += t->sq;
+    cube += t->cube;
+
+    if (t->mindeg < s->mindegree) s->mindegree = t->mindeg;
+    if (t->maxdeg > s->maxdegree) s->maxdegree = t->maxdeg;
+
+    s->nisolated += t->nisolated;
+  }
+
+  free(ctx.sums);
+  ctx.sums = NULL;
+
+  m  = nedges;
+  r  = ((prod / 2.0) / m) - pow((0.5 * sq) / m, 2);
+  r /= ((0.5 * cube) / m) - pow((0.5 * sq) / m, 2);
+
+  s->nnodes        = nnodes;
+  s->nedges        = nedges;
+  s->density       = stats_density(g);
+  s->avgdegree     = stats_avg_degree(g);
+  s->assortativity = r;
+
+  stats_cache_add(g,
+                  STATS_CACHE_DEGREE_SUMMARY,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(stats_degree_summary_t));
+  stats_cache_add(g,
+                  STATS_CACHE_MAX_DEGREE,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(double));
+  stats_cache_add(g,
+                  STATS_CACHE_ASSORTATIVITY,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_DEGREE_SUMMARY, 0, -1, s);
+  stats_cache_update(g, STATS_CACHE_MAX_DEGREE,     0, -1, &(s->maxdegree));
+  stats_cache_update(g, STATS_CACHE_ASSORTATIVITY,  0, -1, &r);
+
+  return 0;
+
+fail:
+  if (ctx.sums != NULL) free(ctx.sums);
+  return 1;
+}
+
+uint8_t stats_degree_histogram(graph_t *g, uint32_t *hist) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t cmaxdeg;
+  double   maxdeg;
+
+  /*the cache keeps the distribution up to date*/
+  if (stats_cache_degree_dist(g, &cmaxdeg, hist) == 0) return 0;
+
+  nnodes = graph_num_nodes(g);
+  maxdeg = stats_max_degree(g);
+
+  memset(hist, 0, ((uint64_t)maxdeg + 1) * sizeof(uint32_t));
+
+  for (i = 0; i < nnodes; i++) hist[graph_num_neighbours(g, i)]++;
+
+  return 0;
+}
+
+uint8_t _degree_sums(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       deg;
+  uint64_t       nbrdeg;
+  uint32_t      *nbrs;
+  degree_ctx_t  *ctx;
+  degree_sums_t *t;
+
+  ctx = vctx;
+  t   = ctx->sums + thread;
+
+  for (i = start; i < end; i++) {
+
+    deg    = graph_num_neighbours(ctx->g, i);
+    nbrs   = graph_get_neighbours(ctx->g, i);
+    nbrdeg = 0;
+
+    for (j = 0; j < deg; j++)
+      nbrdeg += graph_num_neighbours(ctx->g, nbrs[j]);
+
+    t->prod += deg * nbrdeg;
+    t->sq   += deg * deg;
+    t->cube += deg * deg * deg;
+
+    if (deg < t->mindeg) t->mindeg = deg;
+    if (deg > t->maxdeg) t->maxdeg = deg;
+    if (deg == 0)        t->nisolated++;
+  }
+
+  return 0;
+}
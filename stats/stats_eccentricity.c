@@ -0,0 +1,526 @@
+/**
+ * Functions which calculate the exact diameter of a graph, and the exact
+ * eccentricity of every node, with far fewer breadth first searches than
+ * one from every node.
+ *
+ * The diameter is found with the iFUB (iterative fringe upper bound)
+ * algorithm, started from a node chosen by the 4-sweep heuristic:
+ *
+ *   Crescenzi P, Grossi R, Habib M, Lanzi L & Marino A 2013. On computing
+ *   the diameter of real-world undirected graphs. Theoretical Computer
+ *   Science 514:84-95
+ *
+ * The eccentricities are found by keeping lower and upper bounds on the
+ * eccentricity of every node, which each search tightens, and searching
+ * from the nodes whose bounds are furthest apart until all are exact:
+ *
+ *   Takes FW & Kosters WA 2013. Computing the eccentricity distribution
+ *   of large graphs. Algorithms 6(1):100-118
+ *
+ * Every search uses one bfs workspace (see graph/bfs.h).
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/bfs.h"
+#include "util/profile.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+
+/**
+ * State of the searches - the distances from the root of the last search.
+ */
+typedef struct _sweep {
+
+  bfs_ws_t  ws;       /**< search workspace                          */
+  uint32_t *dist;     /**< distance of every node from the root, or
+                           UINT32_MAX if it was not reached          */
+  uint32_t *order;    /**< nodes reached, in order of distance       */
+  uint32_t  nreached; /**< number of nodes reached                   */
+  uint32_t  ecc;      /**< eccentricity of the root                  */
+
+} sweep_t;
+
+/**
+ * Allocates the given sweep state.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _sweep_init(
+  sweep_t *s,     /**< the sweep state */
+  uint32_t nnodes /**< number of nodes */
+);
+
+/**
+ * Frees the memory used by the given sweep state.
+ */
+static void _sweep_free(
+  sweep_t *s /**< the sweep state */
+);
+
+/**
+ * Searches from the given root, recording the distance to every node that
+ * it reaches.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _sweep(
+  sweep_t *s,   /**< the sweep state */
+  graph_t *g,   /**< the graph       */
+  uint32_t root /**< the root node   */
+);
+
+/**
+ * bfs callback function - records the distance to the nodes in the
+ * current level.
+ *
+ * \return 0.
+ */
+static uint8_t _sweep_level(
+  bfs_state_t *state, /**< search state             */
+  void        *ctx    /**< pointer to a sweep_t     */
+);
+
+/**
+ * \return the node half way along a shortest path from the root of the
+ * last sweep to the given node.
+ */
+static uint32_t _midpoint(
+  sweep_t *s, /**< the sweep state                  */
+  graph_t *g, /**< the graph                        */
+  uint32_t b  /**< a node reached by the last sweep */
+);
+
+/**
+ * Finds the diameter of the component containing the given node, with
+ * iFUB, unless it cannot be larger than the given lower bound.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _component_diameter(
+  sweep_t  *s,    /**< the sweep state                           */
+  graph_t  *g,    /**< the graph                                 */
+  uint32_t  r,    /**< a node in the component                   */
+  uint8_t  *done,   /**< set for every node in the component     */
+  uint32_t *fringe, /**< space for the nodes in the component    */
+  uint32_t *fdist,  /**< space for their distances               */
+  uint32_t *diam    /**< the largest diameter found so far,
+                         updated if this component's is larger   */
+);
+
+uint8_t stats_diameter(graph_t *g, uint32_t *diameter) {
+
+  uint64_t  i;
+  uint32_t  nnodes;
+  uint32_t  diam;
+  double    val;
+  uint8_t  *done;
+  uint32_t *fringe;
+  uint32_t *fdist;
+  sweep_t   s;
+
+  PROFILE_FUNC();
+
+  memset(&s, 0, sizeof(sweep_t));
+  done   = NULL;
+  fringe = NULL;
+  fdist  = NULL;
+  nnodes = graph_num_nodes(g);
+  diam   = 0;
+
+  if (graph_is_directed(g)) goto fail;
+
+  done   = calloc(nnodes + 1, sizeof(uint8_t));
+  fringe = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  fdist  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (done   == NULL)          goto fail;
+  if (fringe == NULL)          goto fail;
+  if (fdist  == NULL)          goto fail;
+  if (_sweep_init(&s, nnodes)) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    if (done[i]) continue;
+
+    if (_component_diameter(&s, g, i, done, fringe, fdist, &diam))
+      goto fail;
+  }
+
+  val = diam;
+  stats_cache_add(g,
+                  STATS_CACHE_DIAMETER,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_DIAMETER, 0, -1, &val);
+
+  if (diameter != NULL) *diameter = diam;
+
+  _sweep_free(&s);
+  free(done);
+  free(fringe);
+  free(fdist);
+  return 0;
+
+fail:
+  _sweep_free(&s);
+  if (done   != NULL) free(done);
+  if (fringe != NULL) free(fringe);
+  if (fdist  != NULL) free(fdist);
+  return 1;
+}
+
+uint8_t stats_eccentricity(graph_t *g, uint32_t *ecc) {
+
+  uint64_t  i;
+  uint32_t  w;
+  uint32_t  v;
+  uint32_t  d;
+  uint32_t  lo;
+  uint32_t  hi;
+  uint32_t  nnodes;
+  uint32_t  ncands;
+  uint32_t  diam;
+  uint32_t *lower;
+  uint32_t *upper;
+  uint32_t *cands;
+  uint8_t   pickhi;
+  double    val;
+  sweep_t   s;
+
+  PROFILE_FUNC();
+
+  memset(&s, 0, sizeof(sweep_t));
+  lower  = NULL;
+  upper  = NULL;
+  cands  = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) goto fail;
+
+  lower = calloc(nnodes + 1, sizeof(uint32_t));
+  upper = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  cands = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (lower == NULL)           goto fail;
+  if (upper == NULL)           goto fail;
+  if (cands == NULL)           goto fail;
+  if (_sweep_init(&s, nnodes)) goto fail;
+
+  /*isolated nodes are already exact*/
+  ncands = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    if (graph_num_neighbours(g, i) == 0) upper[i] = 0;
+    else {
+      upper[i]        = UINT32_MAX;
+      cands[ncands++] = i;
+    }
+  }
+
+  /*
+   * alternate between the candidate with the
+   * largest upper bound, and the candidate
+   * with the smallest lower bound, preferring
+   * high degree nodes, which are central
+   */
+  pickhi = 1;
+
+  while (ncands > 0) {
+
+    v = cands[0];
+
+    for (i = 1; i < ncands; i++) {
+
+      w = cands[i];
+
+      if (pickhi) {
+        if (upper[w] < upper[v]) continue;
+        if (upper[w] > upper[v]) { v = w; continue; }
+      }
+      else {
+        if (lower[w] > lower[v]) continue;
+        if (lower[w] < lower[v]) { v = w; continue; }
+      }
+
+      if (graph_num_neighbours(g, w) > graph_num_neighbours(g, v)) v = w;
+    }
+
+    pickhi = !pickhi;
+
+    if (_sweep(&s, g, v)) goto fail;
+
+    /*
+     * for every node w in the component,
+     *   max(d(v,w), ecc(v) - d(v,w)) <= ecc(w)
+     *                                <= ecc(v) + d(v,w)
+     */
+    for (i = 0; i < s.nreached; i++) {
+
+      w  = s.order[i];
+      d  = s.dist[w];
+      lo = (d > s.ecc - d) ? d : s.ecc - d;
+      hi = s.ecc + d;
+
+      if (lo > lower[w]) lower[w] = lo;
+      if (hi < upper[w]) upper[w] = hi;
+    }
+
+    /*remove the candidates which are now exact*/
+    for (i = 0, w = 0; i < ncands; i++) {
+      if (lower[cands[i]] != upper[cands[i]]) cands[w++] = cands[i];
+    }
+    ncands = w;
+  }
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_ECCENTRICITY,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(uint32_t));
+
+  diam = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    if (lower[i] > diam) diam = lower[i];
+
+    stats_cache_update(g, STATS_CACHE_NODE_ECCENTRICITY, i, -1, lower+i);
+  }
+
+  /*the diameter comes for free*/
+  val = diam;
+  stats_cache_add(g,
+                  STATS_CACHE_DIAMETER,
+                  STATS_CACHE_TYPE_GRAPH,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_DIAMETER, 0, -1, &val);
+
+  if (ecc != NULL) memcpy(ecc, lower, nnodes * sizeof(uint32_t));
+
+  _sweep_free(&s);
+  free(lower);
+  free(upper);
+  free(cands);
+  return 0;
+
+fail:
+  _sweep_free(&s);
+  if (lower != NULL) free(lower);
+  if (upper != NULL) free(upper);
+  if (cands != NULL) free(cands);
+  return 1;
+}
+
+uint8_t _component_diameter(
+  sweep_t  *s,
+  graph_t  *g,
+  uint32_t  r,
+  uint8_t  *done,
+  uint32_t *fringe,
+  uint32_t *fdist,
+  uint32_t *diam) {
+
+  uint64_t i;
+  uint32_t n;
+  uint32_t u;
+  uint32_t a;
+  uint32_t lb;
+  uint32_t ub;
+  uint32_t bi;
+  uint32_t lvl;
+  uint32_t end;
+  uint32_t start;
+
+  /*
+   * the first search finds the component, and
+   * its highest degree node, where the 4-sweep
+   * starts
+   */
+  if (_sweep(s, g, r)) goto fail;
+
+  n = s->nreached;
+  u = r;
+
+  for (i = 0; i < n; i++) {
+
+    done[s->order[i]] = 1;
+
+    if (graph_num_neighbours(g, s->order[i]) > graph_num_neighbours(g, u))
+      u = s->order[i];
+  }
+
+  /*a component of n nodes has diameter < n*/
+  if (n <= *diam + 1) return 0;
+
+  /*
+   * 4-sweep - two double sweeps, each from the
+   * midpoint of the path found by the last; the
+   * eccentricities found are lower bounds
+   */
+  lb = 0;
+
+  for (i = 0; i < 2; i++) {
+
+    if (_sweep(s, g, u)) goto fail;
+    a = s->order[s->nreached - 1];
+
+    if (_sweep(s, g, a)) goto fail;
+    if (s->ecc > lb) lb = s->ecc;
+
+    u = _midpoint(s, g, s->order[s->nreached - 1]);
+  }
+
+  if (_sweep(s, g, u)) goto fail;
+  if (s->ecc > lb) lb = s->ecc;
+
+  /*
+   * iFUB - the nodes at distance i from u are
+   * searched, deepest first; any node further
+   * from u has eccentricity <= 2(i-1), so once
+   * the lower bound reaches that, it is exact
+   */
+  for (i = 0; i < n; i++) {
+    fringe[i] = s->order[i];
+    fdist[ i] = s->dist[fringe[i]];
+  }
+
+  lvl = s->ecc;
+  ub  = 2 * s->ecc;
+  end = n;
+
+  while (ub > lb && lvl > 0) {
+
+    start = end;
+    while (start > 0 && fdist[start - 1] == lvl) start--;
+
+    bi = 0;
+    for (i = start; i < end; i++) {
+
+      a = fringe[i];
+
+      if (_sweep(s, g, a)) goto fail;
+      if (s->ecc > bi) bi = s->ecc;
+
+      if (bi > 2 * (lvl - 1)) break;
+    }
+
+    if (bi > lb) lb = bi;
+    if (lb > 2 * (lvl - 1)) break;
+
+    ub = 2 * (lvl - 1);
+    lvl--;
+    end = start;
+  }
+
+  if (lb > *diam) *diam = lb;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _sweep_init(sweep_t *s, uint32_t nnodes) {
+
+  uint64_t i;
+
+  if (bfs_ws_init(&s->ws, nnodes)) goto fail;
+
+  s->dist  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  s->order = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (s->dist  == NULL) goto fail;
+  if (s->order == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) s->dist[i] = UINT32_MAX;
+
+  s->nreached = 0;
+  s->ecc      = 0;
+
+  return 0;
+
+fail:
+  _sweep_free(s);
+  return 1;
+}
+
+void _sweep_free(sweep_t *s) {
+
+  bfs_ws_free(&s->ws);
+
+  if (s->dist  != NULL) free(s->dist);
+  if (s->order != NULL) free(s->order);
+
+  s->dist  = NULL;
+  s->order = NULL;
+}
+
+uint8_t _sweep(sweep_t *s, graph_t *g, uint32_t root) {
+
+  uint64_t i;
+
+  /*only the nodes reached by the last search need resetting*/
+  for (i = 0; i < s->nreached; i++) s->dist[s->order[i]] = UINT32_MAX;
+
+  s->dist[root] = 0;
+  s->order[0]   = root;
+  s->nreached   = 1;
+
+  if (bfs_ws_hybrid(&s->ws, g, &root, 1, NULL, s, _sweep_level))
+    goto fail;
+
+  s->ecc = s->dist[s->order[s->nreached - 1]];
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _sweep_level(bfs_state_t *state, void *ctx) {
+
+  uint64_t  i;
+  uint32_t  n;
+  uint32_t *nodes;
+  sweep_t  *s;
+
+  s     = ctx;
+  nodes = (uint32_t *)state->thislevel.data;
+
+  for (i = 0; i < state->thislevel.size; i++) {
+
+    n                       = nodes[i];
+    s->dist[n]              = state->depth;
+    s->order[s->nreached++] = n;
+  }
+
+  return 0;
+}
+
+uint32_t _midpoint(sweep_t *s, graph_t *g, uint32_t b) {
+
+  uint64_t  i;
+  uint32_t  d;
+  uint32_t  nnbrs;
+  uint32_t *nbrs;
+
+  d = s->dist[b];
+
+  /*walk back towards the root for half the distance*/
+  while (s->dist[b] > d / 2) {
+
+    nnbrs = graph_num_neighbours(g, b);
+    nbrs  = graph_get_neighbours(g, b);
+
+    for (i = 0; i < nnbrs; i++) {
+      if (s->dist[nbrs[i]] == s->dist[b] - 1) break;
+    }
+
+    b = nbrs[i];
+  }
+
+  return b;
+}
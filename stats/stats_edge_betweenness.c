@@ -47,12 +47,13 @@ static uint8_t _all_edge_betweenness(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _node_betweenness(
-  graph_t      *g,        /**< the graph                              */
-  uint32_t      v,        /**< source node                            */
-  edge_array_t *betw,     /**< betweenness values for this node       */
-  edge_array_t *ttlbetw,  /**< betweenness tallies                    */
-  double       *numpaths, /**< memory to use for storing path counts  */
-  double       *pathlens  /**< memory to use for storing path lengths */
+  graph_t        *g,        /**< the graph                              */
+  uint32_t        v,        /**< source node                            */
+  edge_array_t   *betw,     /**< betweenness values for this node       */
+  edge_array_t   *ttlbetw,  /**< betweenness tallies                    */
+  double         *numpaths, /**< memory to use for storing path counts  */
+  double         *pathlens, /**< memory to use for storing path lengths */
+  graph_levels_t *levels    /**< level structure to use for the search  */
 );
 
 uint8_t stats_edge_betweenness(graph_t *g, uint32_t v, double *betweenness) {
@@ -91,15 +92,21 @@ fail:
 uint8_t _all_edge_betweenness(
   graph_t *g, edge_array_t *betw, edge_array_t *ttlbetw, uint32_t cmp) { 
 
-  uint64_t     i;
-  uint32_t     nnodes;
-  double      *numpaths;
-  double      *pathlens;
-  uint32_t    *components;
+  uint64_t       i;
+  uint32_t       nnodes;
+  uint32_t       nsources;
+  double        *numpaths;
+  double        *pathlens;
+  uint32_t      *components;
+  uint32_t      *sources;
+  graph_levels_t levels;
+
+  memset(&levels, 0, sizeof(graph_levels_t));
 
   numpaths   = NULL;
   pathlens   = NULL;
   components = NULL;
+  sources    = NULL;
   nnodes   = graph_num_nodes(g);
 
   numpaths = calloc(nnodes, sizeof(double));
@@ -111,12 +118,32 @@ uint8_t _all_edge_betweenness(
   components = calloc(nnodes, sizeof(uint32_t));
   if (components == NULL) goto fail;
 
+  sources = malloc(nnodes*sizeof(uint32_t));
+  if (sources == NULL) goto fail;
+
   stats_cache_node_component(g, -1, components);
-  
-  for (i = 0; i < nnodes; i++) {
-    if (components[i] != cmp) continue;
-    if (_node_betweenness(g, i, betw, ttlbetw, numpaths, pathlens))
-      goto fail;
+
+  for (i = 0, nsources = 0; i < nnodes; i++) {
+    if (components[i] == cmp) sources[nsources++] = i;
+  }
+
+  /*
+   * The searches for undirected graphs are shared
+   * between threads; the original serial algorithm
+   * is retained for directed graphs
+   */
+  if (!graph_is_directed(g)) {
+    if (stats_brandes(g, sources, nsources, 0, NULL, ttlbetw)) goto fail;
+  }
+  else {
+
+    if (graph_levels_init(&levels, nnodes)) goto fail;
+
+    for (i = 0; i < nsources; i++) {
+      if (_node_betweenness(
+            g, sources[i], betw, ttlbetw, numpaths, pathlens, &levels))
+        goto fail;
+    }
   }
 
   stats_cache_add(g,
@@ -132,23 +159,29 @@ uint8_t _all_edge_betweenness(
   free(numpaths);
   free(pathlens);
   free(components);
+  free(sources);
+  graph_levels_free(&levels);
   return 0;
   
 fail:
+  graph_levels_free(&levels);
   if (numpaths   != NULL) free(numpaths);
   if (pathlens   != NULL) free(pathlens);
   if (components != NULL) free(components);
+  if (sources    != NULL) free(sources);
   return 1;
 }
 
 uint8_t _node_betweenness(
-  graph_t      *g,
-  uint32_t      v,
-  edge_array_t *betw,
-  edge_array_t *ttlbetw,
-  double       *numpaths,
-  double       *pathlens) {
-
+  graph_t        *g,
+  uint32_t        v,
+  edge_array_t   *betw,
+  edge_array_t   *ttlbetw,
+  double         *numpaths,
+  double         *pathlens,
+  graph_levels_t *levels) {
+
+  uint64_t   d;
   uint64_t   i;
   uint64_t   j;
   uint32_t   ni;
@@ -158,22 +191,22 @@ uint8_t _node_betweenness(
   double     tmp;
   double     tmp2;
   double     tally;
-  cstack_t   levels;
-  array_t   *level;
-
-  levels.data = NULL;
 
   stats_cache_pair_numpaths(   g, v, numpaths);
   stats_cache_pair_pathlength( g, v, pathlens);
 
-  if (graph_level_stack(g, v, &levels)) goto fail;
+  if (graph_levels(g, v, levels)) goto fail;
 
-  level = stack_pop(&levels);
-  while (level != NULL) {
+  /*
+   * levels are processed from the furthest to the
+   * closest - the source node (level 0) has no edges
+   * to a closer level, so is skipped
+   */
+  for (d = levels->nlevels - 1; d > 0; d--) {
 
-    for (i = 0; i < level->size; i++) {
+    for (i = levels->offsets[d]; i < levels->offsets[d+1]; i++) {
       
-      array_get(level, i, &ni);
+      ni = levels->order[i];
 
       nnbrs = graph_num_neighbours(g, ni);
       nbrs  = graph_get_neighbours(g, ni);
@@ -219,12 +252,8 @@ uint8_t _node_betweenness(
         edge_array_set(ttlbetw, ni, nj, &tmp2);
       }
     }
-
-    array_free(level);
-    level = stack_pop(&levels);
   }
 
-  stack_free(&levels);
   return 0;
 
 fail:
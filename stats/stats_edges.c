@@ -1,16 +1,65 @@
 /**
- * Functions which count the number of within- and between-cluster edges.
+ * Functions which count the number of within- and between-cluster edges,
+ * and which calculate the spatial distances of edges.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "graph/graph.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
+/**
+ * Node coordinates, stored as a structure of arrays, so that the
+ * coordinates of the neighbours of a node may be read without touching
+ * the rest of their labels.
+ */
+typedef struct _coords {
+
+  float *x; /**< x coordinate of each node */
+  float *y; /**< y coordinate of each node */
+  float *z; /**< z coordinate of each node */
+
+} coords_t;
+
+/**
+ * Copies the coordinates of every node out of its label.
+ *
+ * \return 0 on success, non-0 on failure, or if any node has no label.
+ */
+static uint8_t _coords_create(
+  graph_t  *g, /**< the graph                */
+  coords_t *c  /**< coordinates to initialise */
+);
+
+/**
+ * Frees the memory used by the given coordinates.
+ */
+static void _coords_free(
+  coords_t *c /**< the coordinates */
+);
+
+/**
+ * Calculates the distances from one node to each of its neighbours. As
+ * in stats_edge_distance, coordinate differences are calculated in single
+ * precision, and the distances in double precision.
+ */
+static void _node_distances(
+  coords_t *c,     /**< node coordinates                    */
+  uint32_t  u,     /**< the node                            */
+  uint32_t *nbrs,  /**< neighbours of the node              */
+  uint32_t  nnbrs, /**< number of neighbours                */
+  double   *dists  /**< place to store nnbrs distances      */
+);
+
 double stats_num_intra_edges(graph_t *g, double *inter_out) {
 
   uint64_t       i;
@@ -115,3 +164,207 @@ double stats_avg_edge_distance(graph_t *g, uint32_t u) {
 
   return avg;
 }
+
+uint8_t stats_edge_distances(graph_t *g, double *dists, double *avgs) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  off;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint32_t  maxnbrs;
+  uint32_t *nbrs;
+  double   *buf;
+  double   *nodedists;
+  double    avg;
+  coords_t  c;
+
+  buf = NULL;
+  c.x = NULL;
+  c.y = NULL;
+  c.z = NULL;
+
+  nnodes  = graph_num_nodes(g);
+  maxnbrs = 0;
+
+  for (i = 0; i < nnodes; i++) {
+    nnbrs = graph_num_neighbours(g, i);
+    if (nnbrs > maxnbrs) maxnbrs = nnbrs;
+  }
+
+  if (_coords_create(g, &c)) goto fail;
+
+  if (dists == NULL) {
+    buf = malloc((maxnbrs > 0 ? maxnbrs : 1) * sizeof(double));
+    if (buf == NULL) goto fail;
+  }
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_EDGEDIST,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  off = 0;
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+    nbrs  = graph_get_neighbours(g, i);
+
+    if (dists != NULL) nodedists = dists + off;
+    else               nodedists = buf;
+
+    _node_distances(&c, i, nbrs, nnbrs, nodedists);
+
+    avg = 0;
+    for (j = 0; j < nnbrs; j++) avg += nodedists[j];
+    avg /= nnbrs;
+
+    if (avgs != NULL) avgs[i] = avg;
+
+    stats_cache_update(g, STATS_CACHE_NODE_EDGEDIST, i, -1, &avg);
+
+    off += nnbrs;
+  }
+
+  _coords_free(&c);
+  if (buf != NULL) free(buf);
+
+  return 0;
+
+fail:
+  _coords_free(&c);
+  if (buf != NULL) free(buf);
+  return 1;
+}
+
+uint8_t _coords_create(graph_t *g, coords_t *c) {
+
+  uint64_t       i;
+  uint32_t       nnodes;
+  uint32_t       sz;
+  graph_label_t *lbl;
+
+  c->x = NULL;
+  c->y = NULL;
+  c->z = NULL;
+
+  nnodes = graph_num_nodes(g);
+  sz     = nnodes > 0 ? nnodes : 1;
+
+  c->x = malloc(sz * sizeof(float));
+  c->y = malloc(sz * sizeof(float));
+  c->z = malloc(sz * sizeof(float));
+
+  if (c->x == NULL) goto fail;
+  if (c->y == NULL) goto fail;
+  if (c->z == NULL) goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+
+    lbl = graph_get_nodelabel(g, i);
+    if (lbl == NULL) goto fail;
+
+    c->x[i] = lbl->xval;
+    c->y[i] = lbl->yval;
+    c->z[i] = lbl->zval;
+  }
+
+  return 0;
+
+fail:
+  _coords_free(c);
+  return 1;
+}
+
+void _coords_free(coords_t *c) {
+
+  if (c->x != NULL) free(c->x);
+  if (c->y != NULL) free(c->y);
+  if (c->z != NULL) free(c->z);
+
+  c->x = NULL;
+  c->y = NULL;
+  c->z = NULL;
+}
+
+void _node_distances(
+  coords_t *c, uint32_t u, uint32_t *nbrs, uint32_t nnbrs, double *dists) {
+
+  uint64_t j;
+  float    ux;
+  float    uy;
+  float    uz;
+  double   dx;
+  double   dy;
+  double   dz;
+
+#ifdef __SSE2__
+  uint32_t v0;
+  uint32_t v1;
+  uint32_t v2;
+  uint32_t v3;
+  __m128   vux;
+  __m128   vuy;
+  __m128   vuz;
+  __m128   fx;
+  __m128   fy;
+  __m128   fz;
+  __m128d  lo;
+  __m128d  hi;
+#endif
+
+  ux = c->x[u];
+  uy = c->y[u];
+  uz = c->z[u];
+  j  = 0;
+
+#ifdef __SSE2__
+
+  vux = _mm_set1_ps(ux);
+  vuy = _mm_set1_ps(uy);
+  vuz = _mm_set1_ps(uz);
+
+  /*
+   * four neighbours at a time - the differences are
+   * calculated in single precision, then widened to
+   * two pairs of doubles for the sums and square roots
+   */
+  for (; j + 4 <= nnbrs; j += 4) {
+
+    v0 = nbrs[j];
+    v1 = nbrs[j+1];
+    v2 = nbrs[j+2];
+    v3 = nbrs[j+3];
+
+    fx = _mm_sub_ps(vux, _mm_set_ps(c->x[v3], c->x[v2], c->x[v1], c->x[v0]));
+    fy = _mm_sub_ps(vuy, _mm_set_ps(c->y[v3], c->y[v2], c->y[v1], c->y[v0]));
+    fz = _mm_sub_ps(vuz, _mm_set_ps(c->z[v3], c->z[v2], c->z[v1], c->z[v0]));
+
+    lo = _mm_add_pd(
+      _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(fx), _mm_cvtps_pd(fx)),
+                 _mm_mul_pd(_mm_cvtps_pd(fy), _mm_cvtps_pd(fy))),
+      _mm_mul_pd(_mm_cvtps_pd(fz), _mm_cvtps_pd(fz)));
+
+    fx = _mm_movehl_ps(fx, fx);
+    fy = _mm_movehl_ps(fy, fy);
+    fz = _mm_movehl_ps(fz, fz);
+
+    hi = _mm_add_pd(
+      _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(fx), _mm_cvtps_pd(fx)),
+                 _mm_mul_pd(_mm_cvtps_pd(fy), _mm_cvtps_pd(fy))),
+      _mm_mul_pd(_mm_cvtps_pd(fz), _mm_cvtps_pd(fz)));
+
+    _mm_storeu_pd(dists + j,     _mm_sqrt_pd(lo));
+    _mm_storeu_pd(dists + j + 2, _mm_sqrt_pd(hi));
+  }
+#endif
+
+  for (; j < nnbrs; j++) {
+
+    dx = ux - c->x[nbrs[j]];
+    dy = uy - c->y[nbrs[j]];
+    dz = uz - c->z[nbrs[j]];
+
+    dists[j] = sqrt((dx*dx) + (dy*dy) + (dz*dz));
+  }
+}
@@ -7,6 +7,15 @@
  *   Massimo Marchiori, Vito Latora 2001. Efficient behaviour of 
  *   small-world networks. Physical Review Letters 87(19):198701
  *
+ * The local efficiency of a node is calculated upon a copy of the subgraph
+ * formed by its neighbours, with nodes given local indices, so the cost of
+ * each node is proportional to the size of its neighbourhood, rather than
+ * to the size of the graph. Small neighbourhoods are stored as dense
+ * bitset adjacency matrices, so that each level of a search is a handful
+ * of bitwise operations; larger neighbourhoods are stored in compressed
+ * sparse row form. The nodes are shared between threads by
+ * stats_cache_node_local_efficiency.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 #include <stdint.h>
@@ -16,20 +25,67 @@
 #include "graph/graph.h"
 #include "graph/bfs.h"
 #include "util/array.h"
+#include "util/compare.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
+/**
+ * Neighbourhoods with up to this many nodes are searched using a dense
+ * bitset adjacency matrix (which uses n*n/8 bytes).
+ */
+#define LOCEFF_BITSET_MAX 1024
 
+/**
+ * Copies the subgraph formed by the neighbours of the given node, in
+ * compressed sparse row form. Neighbour i of the node is given local
+ * index i; the local neighbours of local node i are stored at
+ * adj[offsets[i]] to adj[offsets[i+1]-1].
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _local_subgraph(
+  graph_t   *g,       /**< the graph                                  */
+  uint32_t   nidx,    /**< the node                                   */
+  uint64_t **offsets, /**< place to store a pointer to the offsets
+                           (numnbrs+1 entries) - must be freed        */
+  uint32_t **adj      /**< place to store a pointer to the local
+                           adjacency lists - must be freed            */
+);
+
+/**
+ * Sums the inverse shortest path lengths between every pair of nodes in
+ * the given local subgraph, searching a dense bitset copy of it.
+ *
+ * \return the sum, or -1 on failure.
+ */
+static double _bitset_invsum(
+  uint32_t  n,       /**< number of nodes in the subgraph */
+  uint64_t *offsets, /**< subgraph offsets                */
+  uint32_t *adj      /**< subgraph adjacency lists        */
+);
+
+/**
+ * Sums the inverse shortest path lengths between every pair of nodes in
+ * the given local subgraph, with a breadth first search from each node.
+ *
+ * \return the sum, or -1 on failure.
+ */
+static double _csr_invsum(
+  uint32_t  n,       /**< number of nodes in the subgraph */
+  uint64_t *offsets, /**< subgraph offsets                */
+  uint32_t *adj      /**< subgraph adjacency lists        */
+);
 
 /**
- * Callback function for the breadth first search. Updates the inverse
- * accumulation.
+ * Callback function for bfs_multi. Updates the sum of inverse shortest
+ * path lengths for each of the searches in the batch; the sums are stored
+ * in the given array, in the same order as the root nodes.
  *
  * \return 0 always.
  */
-static uint8_t _bfs_cb(
-  bfs_state_t *state,  /**< current search state      */
-  void        *context /**< pointer to a double value */
+static uint8_t _bfs_multi_cb(
+  bfs_multi_state_t *state,  /**< search state                   */
+  void              *context /**< pointer to an array of doubles */
 );
 
 
@@ -60,19 +116,27 @@ double stats_avg_local_efficiency(graph_t *g) {
 
   uint64_t i;
   uint32_t nnodes;
-  double   loceff;
+  double  *loceffs;
   double   loceff_tally;
 
+  loceffs      = NULL;
   nnodes       = graph_num_nodes(g);
   loceff_tally = 0;
 
+  loceffs = malloc(((uint64_t)nnodes + 1) * sizeof(double));
+  if (loceffs == NULL) goto fail;
+
+  /*the nodes are calculated in parallel, and summed in order*/
+  if (stats_cache_node_local_efficiency(g, -1, loceffs)) goto fail;
+
   for (i = 0; i < nnodes; i++) {
-    if (stats_cache_node_local_efficiency(g, i, &loceff)) goto fail;
 
-    loceff_tally += loceff;
+    if (loceffs[i] < 0) goto fail;
+    loceff_tally += loceffs[i];
   }
 
   loceff_tally /= nnodes;
+  free(loceffs);
 
   stats_cache_add(g,
                   STATS_CACHE_LOCAL_EFFICIENCY,
@@ -83,39 +147,38 @@ double stats_avg_local_efficiency(graph_t *g) {
   return loceff_tally;
 
 fail: 
+  if (loceffs != NULL) free(loceffs);
   return -1;
 }
 
 
 double stats_local_efficiency(graph_t *g, uint32_t nidx) {
 
-  uint32_t  i;
-  uint32_t  numnodes;
   uint32_t  numnbrs;
-  uint32_t *nbrs;
-  uint8_t  *subgraphmask;
+  uint64_t *offsets;
+  uint32_t *adj;
+  double    invsum;
   double    effic;
 
-  subgraphmask = NULL;
-  numnodes     = graph_num_nodes(     g);
-  numnbrs      = graph_num_neighbours(g, nidx);
-  nbrs         = graph_get_neighbours(g, nidx);
+  offsets = NULL;
+  adj     = NULL;
+  numnbrs = graph_num_neighbours(g, nidx);
 
   if (numnbrs == 0 || numnbrs == 1) return 0.0;
 
-  subgraphmask = malloc(numnodes*sizeof(uint8_t));
-  if (subgraphmask == NULL) goto fail;
+  if (_local_subgraph(g, nidx, &offsets, &adj)) goto fail;
 
-  /*
-   * Fudge the subgraphmask to limit the search to
-   * the subgraph formed by the neighbours of nidx
-   */
-  for (i = 0; i < numnodes; i++) subgraphmask[i]       = 1;
-  for (i = 0; i < numnbrs;  i++) subgraphmask[nbrs[i]] = 0;
+  if (numnbrs <= LOCEFF_BITSET_MAX)
+    invsum = _bitset_invsum(numnbrs, offsets, adj);
+  else
+    invsum = _csr_invsum(   numnbrs, offsets, adj);
+
+  if (invsum < 0) goto fail;
 
-  effic = stats_sub_efficiency(g, numnbrs, subgraphmask);
+  effic = invsum / ((double)numnbrs * (numnbrs - 1));
 
-  free(subgraphmask);
+  free(offsets);
+  free(adj);
 
   stats_cache_add(g,
                   STATS_CACHE_NODE_LOCAL_EFFICIENCY,
@@ -126,7 +189,8 @@ double stats_local_efficiency(graph_t *g, uint32_t nidx) {
   return effic;
 
 fail:
-  if (subgraphmask != NULL) free(subgraphmask);
+  if (offsets != NULL) free(offsets);
+  if (adj     != NULL) free(adj);
   return -1;
 }
 
@@ -135,41 +199,333 @@ double stats_sub_efficiency(graph_t *g, uint32_t nnodes, uint8_t *mask) {
 
   uint32_t  i;
   uint32_t  gnnodes;
+  uint32_t  nroots;
+  uint16_t  nthreads;
+  uint32_t *roots;
+  double   *invs;
   double    invsum;
-  double    inv;
   double    effic;
 
+  roots   = NULL;
+  invs    = NULL;
   invsum  = 0;
   gnnodes = graph_num_nodes(g);
 
-  for (i = 0; i < gnnodes; i++) {
+  roots = malloc(gnnodes*sizeof(uint32_t));
+  invs  = calloc(gnnodes, sizeof(double));
+  if (roots == NULL) goto fail;
+  if (invs  == NULL) goto fail;
+
+  for (i = 0, nroots = 0; i < gnnodes; i++) {
 
     if (mask && mask[i]) continue;
+    roots[nroots++] = i;
+  }
+
+  /*
+   * subgraphs (e.g. for local efficiency) are usually
+   * small, and not worth sharing between threads
+   */
+  if (mask == NULL) nthreads = 0;
+  else              nthreads = 1;
 
-    inv = 0;
-    if (bfs(g, &i, 1, mask, &inv, NULL, _bfs_cb, NULL)) goto fail;
+  if (bfs_multi(g, roots, nroots, mask, nthreads, invs, _bfs_multi_cb))
+    goto fail;
 
-    if (inv < 0) goto fail;
-    invsum += inv;
+  /*results are summed in node order, as in a serial search*/
+  for (i = 0; i < nroots; i++) {
+
+    if (invs[i] < 0) goto fail;
+    invsum += invs[i];
   }
 
   effic = invsum / (nnodes*(nnodes-1));
 
+  free(roots);
+  free(invs);
+
   return effic;
 
 fail:
+  if (roots != NULL) free(roots);
+  if (invs  != NULL) free(invs);
   return -1;
 }
 
-
-static uint8_t _bfs_cb(bfs_state_t *state, void *context) {
+static uint8_t _bfs_multi_cb(bfs_multi_state_t *state, void *context) {
   
-  double *inv;
+  uint64_t i;
+  uint64_t bits;
+  uint32_t b;
+  double  *invs;
+  uint32_t sizes[BFS_MULTI_WIDTH];
+
+  invs = (double *)context;
+
+  memset(sizes, 0, sizeof(sizes));
+
+  /*count the number of nodes at this level, for each search*/
+  for (i = 0; i < state->nlevel; i++) {
+
+    bits = state->reached[state->level[i]];
+
+    while (bits) {
+      sizes[__builtin_ctzll(bits)]++;
+      bits &= bits - 1;
+    }
+  }
+
+  for (b = 0; b < state->nroots; b++) {
+
+    if (sizes[b] == 0) continue;
+    invs[state->batch + b] += (float)(sizes[b])/(state->depth);
+  }
+
+  return 0;
+}
+
+
+uint8_t _local_subgraph(
+  graph_t *g, uint32_t nidx, uint64_t **offsets, uint32_t **adj) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  nedges;
+  uint32_t  numnbrs;
+  uint32_t  unnbrs;
+  uint32_t *nbrs;
+  uint32_t *unbrs;
+  int64_t   lidx;
+  uint64_t *offs;
+  uint32_t *ladj;
+
+  offs    = NULL;
+  ladj    = NULL;
+  numnbrs = graph_num_neighbours(g, nidx);
+  nbrs    = graph_get_neighbours(g, nidx);
+
+  offs = calloc((uint64_t)numnbrs + 1, sizeof(uint64_t));
+  if (offs == NULL) goto fail;
+
+  /*
+   * Neighbour lists are sorted, so the local index of
+   * a node (its position in nbrs) is a binary search.
+   * The first pass counts the local edges of each
+   * node, and the second stores them.
+   */
+  for (i = 0; i < numnbrs; i++) {
+
+    unnbrs = graph_num_neighbours(g, nbrs[i]);
+    unbrs  = graph_get_neighbours(g, nbrs[i]);
+
+    for (j = 0; j < unnbrs; j++) {
+      if (search_u32(nbrs, numnbrs, unbrs[j]) >= 0) offs[i + 1]++;
+    }
+  }
+
+  for (i = 0; i < numnbrs; i++) offs[i + 1] += offs[i];
+
+  nedges = offs[numnbrs];
+  ladj   = malloc((nedges + 1) * sizeof(uint32_t));
+  if (ladj == NULL) goto fail;
+
+  for (i = 0, nedges = 0; i < numnbrs; i++) {
+
+    unnbrs = graph_num_neighbours(g, nbrs[i]);
+    unbrs  = graph_get_neighbours(g, nbrs[i]);
+
+    for (j = 0; j < unnbrs; j++) {
 
-  inv = (double *)context;
+      lidx = search_u32(nbrs, numnbrs, unbrs[j]);
 
-  (*inv) += (float)(state->thislevel.size)/(state->depth);
+      if (lidx >= 0) ladj[nedges++] = lidx;
+    }
+  }
+
+  *offsets = offs;
+  *adj     = ladj;
 
   return 0;
+
+fail:
+  if (offs != NULL) free(offs);
+  if (ladj != NULL) free(ladj);
+  return 1;
 }
 
+double _bitset_invsum(uint32_t n, uint64_t *offsets, uint32_t *adj) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  w;
+  uint64_t  v;
+  uint64_t  bits;
+  uint32_t  nwords;
+  uint32_t  depth;
+  uint32_t  size;
+  uint64_t *matrix;
+  uint64_t *visited;
+  uint64_t *thislevel;
+  uint64_t *nextlevel;
+  uint64_t *tmp;
+  double    inv;
+  double    invsum;
+
+  matrix  = NULL;
+  visited = NULL;
+  invsum  = 0;
+  nwords  = (n + 63) / 64;
+
+  matrix  = calloc((uint64_t)n * nwords, sizeof(uint64_t));
+  visited = calloc(3 * nwords,           sizeof(uint64_t));
+
+  if (matrix  == NULL) goto fail;
+  if (visited == NULL) goto fail;
+
+  thislevel = visited   + nwords;
+  nextlevel = thislevel + nwords;
+
+  for (i = 0; i < n; i++) {
+    for (j = offsets[i]; j < offsets[i + 1]; j++)
+      matrix[i * nwords + adj[j] / 64] |= 1ULL << (adj[j] % 64);
+  }
+
+  for (i = 0; i < n; i++) {
+
+    memset(visited,   0, nwords * sizeof(uint64_t));
+    memset(thislevel, 0, nwords * sizeof(uint64_t));
+
+    visited[  i / 64] = 1ULL << (i % 64);
+    thislevel[i / 64] = 1ULL << (i % 64);
+
+    inv   = 0;
+    depth = 0;
+
+    while (1) {
+
+      memset(nextlevel, 0, nwords * sizeof(uint64_t));
+
+      /*the next level is the union of the rows in this level*/
+      for (w = 0; w < nwords; w++) {
+
+        bits = thislevel[w];
+
+        while (bits) {
+
+          v     = w * 64 + __builtin_ctzll(bits);
+          bits &= bits - 1;
+
+          for (j = 0; j < nwords; j++)
+            nextlevel[j] |= matrix[v * nwords + j];
+        }
+      }
+
+      for (w = 0, size = 0; w < nwords; w++) {
+        nextlevel[w] &= ~visited[w];
+        visited[  w] |=  nextlevel[w];
+        size         +=  __builtin_popcountll(nextlevel[w]);
+      }
+
+      if (size == 0) break;
+
+      depth++;
+
+      /*accumulated in the same way as by stats_sub_efficiency*/
+      inv += (float)(size)/(depth);
+
+      tmp       = thislevel;
+      thislevel = nextlevel;
+      nextlevel = tmp;
+    }
+
+    invsum += inv;
+  }
+
+  free(matrix);
+  free(visited);
+
+  return invsum;
+
+fail:
+  if (matrix  != NULL) free(matrix);
+  if (visited != NULL) free(visited);
+  return -1;
+}
+
+double _csr_invsum(uint32_t n, uint64_t *offsets, uint32_t *adj) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  head;
+  uint64_t  tail;
+  uint64_t  end;
+  uint32_t  u;
+  uint32_t  v;
+  uint32_t  depth;
+  uint32_t *queue;
+  uint32_t *seen;
+  double    inv;
+  double    invsum;
+
+  queue  = NULL;
+  seen   = NULL;
+  invsum = 0;
+
+  queue = malloc(n * sizeof(uint32_t));
+  seen  = calloc(n,  sizeof(uint32_t));
+
+  if (queue == NULL) goto fail;
+  if (seen  == NULL) goto fail;
+
+  /*
+   * seen[v] holds the (1-based) index of the last
+   * search to reach v, so it is never cleared
+   */
+  for (i = 0; i < n; i++) {
+
+    queue[0] = i;
+    seen[i]  = i + 1;
+    head     = 0;
+    tail     = 1;
+    inv      = 0;
+    depth    = 0;
+
+    while (head < tail) {
+
+      end = tail;
+
+      for (; head < end; head++) {
+
+        u = queue[head];
+
+        for (j = offsets[u]; j < offsets[u + 1]; j++) {
+
+          v = adj[j];
+          if (seen[v] == i + 1) continue;
+
+          seen[v]       = i + 1;
+          queue[tail++] = v;
+        }
+      }
+
+      if (tail == end) break;
+
+      depth++;
+
+      /*accumulated in the same way as by stats_sub_efficiency*/
+      inv += (float)(tail - end)/(depth);
+    }
+
+    invsum += inv;
+  }
+
+  free(queue);
+  free(seen);
+
+  return invsum;
+
+fail:
+  if (queue != NULL) free(queue);
+  if (seen  != NULL) free(seen);
+  return -1;
+}
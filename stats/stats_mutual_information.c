@@ -1,5 +1,10 @@
 /**
  * Calculates the normalised mutual information of two collections of labels.
+ * The contingency table of the two labellings, and their marginal counts,
+ * are built in one pass over the labels, with hash tables, so the cost is
+ * linear in the number of labels, regardless of the number of distinct
+ * label values. The labels are counted in contiguous blocks, in parallel,
+ * and the block tables are merged in order.
  *
  *   Manning CD, Raghavan P and Shutze H 2008. Introduction to Information
  *   Retrieval. Cambridge University Press. Available online at:
@@ -8,7 +13,7 @@
  *   Danon L, Dutch J, Diaz-Guilera A, Arenas A. 2005. Comparing
  *   community structure identification. Journal of Statistical
  *   Mechanics: Theory and Experiment, vol. 2005, no. 9, pg. 09008.
- * 
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <math.h>
@@ -17,81 +22,186 @@
 #include <string.h>
 
 #include "graph/graph.h"
+#include "util/parallel.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
 /**
- * Collection of indices which have the same label.
+ * Multiplier used to hash keys (2^64 divided by the golden ratio).
+ */
+#define COUNT_HASH_MULT 0x9E3779B97F4A7C15ULL
+
+/**
+ * Minimum number of labels counted by each thread - below this, a block
+ * is not worth the cost of merging its tables.
+ */
+#define CONTINGENCY_MIN_BLOCK 65536
+
+/**
+ * An entry in a count_table_t.
+ */
+typedef struct _count {
+
+  uint64_t key;   /**< key                                          */
+  uint32_t count; /**< number of times the key has been added, or 0
+                       if the slot is empty                          */
+  uint32_t idx;   /**< number of distinct keys which were added
+                       before this one                               */
+
+} count_t;
+
+/**
+ * Open addressing hash table which counts occurrences of keys.
+ */
+typedef struct _count_table {
+
+  count_t *slots; /**< table slots                   */
+  uint64_t mask;  /**< number of slots - 1           */
+  uint8_t  shift; /**< 64 - log2(number of slots)    */
+  uint32_t size;  /**< number of distinct keys added */
+
+} count_table_t;
+
+/**
+ * Counts of one contiguous block of labels.
  */
-typedef struct _set {
+typedef struct _block {
 
-  uint32_t lblval; /**< the label value */
-  array_t  idxs;   /**< list of indices */
+  count_table_t tj;  /**< first label counts                      */
+  count_table_t tk;  /**< second label counts                     */
+  count_table_t tjk; /**< label pair counts, keyed on
+                          (first value << 32 | second value)      */
 
-} set_t;
+} block_t;
 
 /**
- * Partitions the indices of given list of labels (basically creating
- * a histogram of repeating values in the label list).
+ * Context passed to _count_blocks.
+ */
+typedef struct _block_ctx {
+
+  uint32_t  n;       /**< number of labels        */
+  uint32_t  nblocks; /**< number of blocks        */
+  uint32_t *lblsj;   /**< first set of labels     */
+  uint32_t *lblsk;   /**< second set of labels    */
+  block_t  *blocks;  /**< counts of each block    */
+
+} block_ctx_t;
+
+/**
+ * Creates a table with space for at least the given number of distinct
+ * keys.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _partition(
-  uint32_t  n,    /**< number of labels                          */
-  uint32_t *lbls, /**< list of labels                            */
-  array_t  *sets  /**< uninitialised array to store partitioning
-                       (as a collection of set_t structs).       */
+static uint8_t _table_create(
+  count_table_t *t, /**< the table to initialise      */
+  uint32_t       n  /**< maximum number of keys       */
+);
+
+/**
+ * Frees the memory used by the given table.
+ */
+static void _table_free(
+  count_table_t *t /**< the table */
 );
 
 /**
- * \return the number of values which are presenti in both of the
- * given partitionings. 
+ * Adds the given amount to the count of the given key.
+ *
+ * \return the entry for the key.
  */
-static uint32_t _intersection(
-  set_t *setj, /**< first partitioning  */
-  set_t *setk  /**< second partitioning */
+static count_t *_table_add(
+  count_table_t *t,     /**< the table     */
+  uint64_t       key,   /**< the key       */
+  uint32_t       count  /**< amount to add */
 );
 
 /**
- * \return the mutual information between the two provided partitionings.
+ * \return the entry for the given key, which must be in the table.
+ */
+static count_t *_table_find(
+  count_table_t *t,  /**< the table */
+  uint64_t       key /**< the key   */
+);
+
+/**
+ * Copies the keys and counts in the given table to the given arrays, in
+ * the order in which the keys were first added.
+ */
+static void _entries(
+  count_table_t *t,      /**< the table                        */
+  uint32_t      *keys,   /**< space to store t->size keys      */
+  uint32_t      *counts  /**< space to store t->size counts    */
+);
+
+/**
+ * parallel_for function which counts the labels in the given range of
+ * blocks.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _count_blocks(
+  uint64_t start,  /**< first block              */
+  uint64_t end,    /**< one past last block      */
+  uint16_t thread, /**< calling thread           */
+  void    *ctx     /**< pointer to a block_ctx_t */
+);
+
+/**
+ * Merges the counts of the given blocks, in order, into the given table.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _merge_blocks(
+  block_t             *blocks,  /**< the blocks        */
+  uint32_t             nblocks, /**< number of blocks  */
+  uint32_t             n,       /**< number of labels  */
+  stats_contingency_t *ct       /**< the table         */
+);
+
+/**
+ * Compares two stats_cell_t structs by their first, and then second,
+ * label indices.
+ */
+static int _cell_cmp(const void *a, const void *b);
+
+/**
+ * \return the mutual information between two labellings, given their
+ * contingency table.
  */
 static double _mutual_information(
-  uint32_t  n,     /**< total number of values */
-  array_t  *sets1, /**< first partitioning     */
-  array_t  *sets2  /**< second partitioning    */
+  stats_contingency_t *ct /**< the contingency table */
 );
 
 /**
- * \return the entropy of the given partitioning.
+ * \return the entropy of the given labelling.
  */
 static double _entropy(
-  array_t *sets, /**< tne partitioning       */
-  uint32_t n     /**< total number of values */
+  uint32_t *counts,  /**< number of values with each label */
+  uint32_t  nlabels, /**< number of distinct labels         */
+  uint32_t  n        /**< total number of values            */
 );
 
 
 double stats_mutual_information(
   uint32_t n, uint32_t *lblsj, uint32_t *lblsk) {
 
-  array_t  setsj;
-  array_t  setsk;
-  double   mi;
-  double   nmi;
-  double   entj;
-  double   entk;
+  double              mi;
+  double              nmi;
+  double              entj;
+  double              entk;
+  stats_contingency_t ct;
 
-  memset(&setsj, 0, sizeof(array_t));
-  memset(&setsk, 0, sizeof(array_t));
+  if (stats_contingency(n, lblsj, lblsk, 0, &ct)) goto fail;
 
-  if (_partition(n, lblsj, &setsj)) goto fail;
-  if (_partition(n, lblsk, &setsk)) goto fail;
+  mi   = _mutual_information(&ct);
+  entj = _entropy(ct.countsj, ct.nj, n);
+  entk = _entropy(ct.countsk, ct.nk, n);
 
-  mi   = _mutual_information(n, &setsj, &setsk);
-  entj = _entropy(&setsj, n);
-  entk = _entropy(&setsk, n);
-  
   nmi  = mi / ((entj + entk)/2.0);
 
+  stats_contingency_free(&ct);
+
   return nmi;
 
 fail:
@@ -105,142 +215,406 @@ double stats_graph_mutual_information(graph_t *g) {
   uint32_t  nnodes;
   uint32_t *lblsj;
   uint32_t *lblsk;
+  double    nmi;
 
   nnodes = graph_num_nodes(g);
 
-  lblsj = calloc(nnodes, sizeof(uint32_t));
-  lblsk = calloc(nnodes, sizeof(uint32_t));
+  lblsj = calloc(nnodes + 1, sizeof(uint32_t));
+  lblsk = calloc(nnodes + 1, sizeof(uint32_t));
+
+  if (lblsj == NULL) goto fail;
+  if (lblsk == NULL) goto fail;
 
   stats_num_components(g, 0, NULL, lblsj);
 
-  for (i = 0; i < nnodes; i++) 
+  for (i = 0; i < nnodes; i++)
     lblsk[i] = graph_get_nodelabel(g, i)->labelval;
 
-  return stats_mutual_information(nnodes, lblsj, lblsk);
+  nmi = stats_mutual_information(nnodes, lblsj, lblsk);
+
+  free(lblsj);
+  free(lblsk);
+
+  return nmi;
+
+fail:
+  if (lblsj != NULL) free(lblsj);
+  if (lblsk != NULL) free(lblsk);
+  return -1;
+}
+
+
+uint8_t stats_contingency(
+  uint32_t             n,
+  uint32_t            *lblsj,
+  uint32_t            *lblsk,
+  uint16_t             nthreads,
+  stats_contingency_t *ct) {
+
+  uint64_t    i;
+  block_ctx_t ctx;
+
+  memset(ct,   0, sizeof(stats_contingency_t));
+  memset(&ctx, 0, sizeof(block_ctx_t));
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads == 0)                    nthreads = 1;
+
+  /*
+   * one block per thread - blocks, rather than
+   * threads, own the tables, so that they can
+   * be merged in label order, whichever thread
+   * counted them
+   */
+  ctx.n       = n;
+  ctx.lblsj   = lblsj;
+  ctx.lblsk   = lblsk;
+  ctx.nblocks = n / CONTINGENCY_MIN_BLOCK;
+
+  if (ctx.nblocks > nthreads) ctx.nblocks = nthreads;
+  if (ctx.nblocks == 0)       ctx.nblocks = 1;
+
+  ctx.blocks = calloc(ctx.nblocks, sizeof(block_t));
+  if (ctx.blocks == NULL) goto fail;
+
+  if (parallel_for(nthreads, ctx.nblocks, 1, &ctx, _count_blocks))
+    goto fail;
+
+  if (_merge_blocks(ctx.blocks, ctx.nblocks, n, ct)) goto fail;
+
+  for (i = 0; i < ctx.nblocks; i++) {
+    _table_free(&ctx.blocks[i].tj);
+    _table_free(&ctx.blocks[i].tk);
+    _table_free(&ctx.blocks[i].tjk);
+  }
+  free(ctx.blocks);
+
+  return 0;
+
+fail:
+  for (i = 0; ctx.blocks != NULL && i < ctx.nblocks; i++) {
+    _table_free(&ctx.blocks[i].tj);
+    _table_free(&ctx.blocks[i].tk);
+    _table_free(&ctx.blocks[i].tjk);
+  }
+  if (ctx.blocks != NULL) free(ctx.blocks);
+  stats_contingency_free(ct);
+  return 1;
+}
+
+
+void stats_contingency_free(stats_contingency_t *ct) {
+
+  if (ct->valsj   != NULL) free(ct->valsj);
+  if (ct->valsk   != NULL) free(ct->valsk);
+  if (ct->countsj != NULL) free(ct->countsj);
+  if (ct->countsk != NULL) free(ct->countsk);
+  if (ct->cells   != NULL) free(ct->cells);
+
+  memset(ct, 0, sizeof(stats_contingency_t));
 }
 
 
-uint8_t _partition(
-  uint32_t  n,
-  uint32_t *lbls,
-  array_t  *sets) {
+uint8_t _count_blocks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t     i;
+  uint64_t     b;
+  uint64_t     bstart;
+  uint64_t     bend;
+  block_t     *blk;
+  block_ctx_t *ctx;
+
+  ctx = vctx;
 
-  uint32_t  i;
-  uint32_t  j;
-  set_t    *s;
+  for (b = start; b < end; b++) {
 
-  if (array_create(sets, sizeof(set_t), 10)) goto fail;
+    blk    = ctx->blocks + b;
+    bstart = ((uint64_t)ctx->n *  b)      / ctx->nblocks;
+    bend   = ((uint64_t)ctx->n * (b + 1)) / ctx->nblocks;
 
-  for (i = 0; i < n; i++) {
+    if (_table_create(&blk->tj,  bend - bstart)) goto fail;
+    if (_table_create(&blk->tk,  bend - bstart)) goto fail;
+    if (_table_create(&blk->tjk, bend - bstart)) goto fail;
 
-    for (j = 0; j < sets->size; j++) {
-      
-      s = (set_t *)array_getd(sets, j);
+    for (i = bstart; i < bend; i++) {
 
-      if (s->lblval == lbls[i]) {
-        
-        if (array_append(&(s->idxs), &i)) goto fail;
-        break;
-      }
+      _table_add(&blk->tj,  ctx->lblsj[i], 1);
+      _table_add(&blk->tk,  ctx->lblsk[i], 1);
+      _table_add(&blk->tjk,
+                 ((uint64_t)ctx->lblsj[i] << 32) | ctx->lblsk[i], 1);
     }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+
+uint8_t _merge_blocks(
+  block_t *blocks, uint32_t nblocks, uint32_t n, stats_contingency_t *ct) {
+
+  uint64_t       i;
+  uint64_t       b;
+  uint32_t       maxsz;
+  uint32_t      *keys;
+  uint32_t      *counts;
+  count_t       *c;
+  count_t       *cj;
+  count_t       *ck;
+  count_table_t  tj;
+  count_table_t  tk;
+  count_table_t  tjk;
+
+  keys   = NULL;
+  counts = NULL;
+
+  memset(&tj,  0, sizeof(count_table_t));
+  memset(&tk,  0, sizeof(count_table_t));
+  memset(&tjk, 0, sizeof(count_table_t));
+
+  maxsz = 0;
+  for (b = 0; b < nblocks; b++) {
+    if (blocks[b].tj.size > maxsz) maxsz = blocks[b].tj.size;
+    if (blocks[b].tk.size > maxsz) maxsz = blocks[b].tk.size;
+  }
+
+  keys   = malloc(((uint64_t)maxsz + 1) * sizeof(uint32_t));
+  counts = malloc(((uint64_t)maxsz + 1) * sizeof(uint32_t));
+
+  if (keys   == NULL)        goto fail;
+  if (counts == NULL)        goto fail;
+  if (_table_create(&tj,  n)) goto fail;
+  if (_table_create(&tk,  n)) goto fail;
+  if (_table_create(&tjk, n)) goto fail;
+
+  /*
+   * Labels are numbered in the order in which they are
+   * first seen - block tables are merged in block order,
+   * and the keys of each block in the order in which the
+   * block first saw them, so the numbering is the same
+   * as that of one pass over all of the labels.
+   */
+  for (b = 0; b < nblocks; b++) {
+
+    _entries(&blocks[b].tj, keys, counts);
+    for (i = 0; i < blocks[b].tj.size; i++)
+      _table_add(&tj, keys[i], counts[i]);
+
+    _entries(&blocks[b].tk, keys, counts);
+    for (i = 0; i < blocks[b].tk.size; i++)
+      _table_add(&tk, keys[i], counts[i]);
+  }
 
-    if (j == sets->size) {
-      
-      s = calloc(sizeof(set_t), 1);
-      if (s == NULL) goto fail;
-      
-      s->lblval = lbls[i];
+  for (b = 0; b < nblocks; b++) {
+    for (i = 0; i <= blocks[b].tjk.mask; i++) {
 
-      if (array_create(&(s->idxs), sizeof(uint32_t), 10)) goto fail;
-      if (array_append(&(s->idxs), &i))                   goto fail;
-      if (array_append(sets, s))                          goto fail;
+      c = blocks[b].tjk.slots + i;
+      if (c->count == 0) continue;
+
+      cj = _table_find(&tj, c->key >> 32);
+      ck = _table_find(&tk, c->key & 0xFFFFFFFF);
+
+      _table_add(&tjk, ((uint64_t)cj->idx << 32) | ck->idx, c->count);
     }
   }
 
-  free(lbls);
+  ct->n       = n;
+  ct->nj      = tj.size;
+  ct->nk      = tk.size;
+  ct->ncells  = tjk.size;
+  ct->valsj   = malloc(((uint64_t)tj.size  + 1) * sizeof(uint32_t));
+  ct->valsk   = malloc(((uint64_t)tk.size  + 1) * sizeof(uint32_t));
+  ct->countsj = malloc(((uint64_t)tj.size  + 1) * sizeof(uint32_t));
+  ct->countsk = malloc(((uint64_t)tk.size  + 1) * sizeof(uint32_t));
+  ct->cells   = malloc(((uint64_t)tjk.size + 1) * sizeof(stats_cell_t));
+
+  if (ct->valsj   == NULL) goto fail;
+  if (ct->valsk   == NULL) goto fail;
+  if (ct->countsj == NULL) goto fail;
+  if (ct->countsk == NULL) goto fail;
+  if (ct->cells   == NULL) goto fail;
+
+  _entries(&tj, ct->valsj, ct->countsj);
+  _entries(&tk, ct->valsk, ct->countsk);
+
+  for (i = 0, b = 0; i <= tjk.mask; i++) {
+
+    c = tjk.slots + i;
+    if (c->count == 0) continue;
+
+    ct->cells[b].j     = c->key >> 32;
+    ct->cells[b].k     = c->key & 0xFFFFFFFF;
+    ct->cells[b].count = c->count;
+    b++;
+  }
+
+  /*so the cells are traversed in the same order whatever the values*/
+  qsort(ct->cells, ct->ncells, sizeof(stats_cell_t), _cell_cmp);
+
+  _table_free(&tj);
+  _table_free(&tk);
+  _table_free(&tjk);
+  free(keys);
+  free(counts);
   return 0;
-  
+
 fail:
+  _table_free(&tj);
+  _table_free(&tk);
+  _table_free(&tjk);
+  if (keys   != NULL) free(keys);
+  if (counts != NULL) free(counts);
   return 1;
 }
 
 
-uint32_t _intersection(set_t *setj, set_t *setk) {
+uint8_t _table_create(count_table_t *t, uint32_t n) {
+
+  uint64_t nslots;
 
-  uint64_t j;
-  uint64_t k;
-  uint32_t idxj;
-  uint32_t idxk;
-  uint32_t count;
+  memset(t, 0, sizeof(count_table_t));
 
-  count = 0;
+  /*at most half full*/
+  nslots   = 16;
+  t->shift = 60;
+  while (nslots < 2 * (uint64_t)n) {
+    nslots <<= 1;
+    t->shift--;
+  }
 
-  for (j = 0; j < setj->idxs.size; j++) {
+  t->slots = calloc(nslots, sizeof(count_t));
+  if (t->slots == NULL) goto fail;
 
-    idxj = *(uint32_t *)array_getd(&(setj->idxs), j);
+  t->mask = nslots - 1;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+
+void _table_free(count_table_t *t) {
+
+  if (t->slots != NULL) free(t->slots);
+
+  memset(t, 0, sizeof(count_table_t));
+}
 
-    for (k = 0; k < setk->idxs.size; k++) {
 
-      idxk = *(uint32_t *)array_getd(&(setk->idxs), k);
+count_t *_table_add(count_table_t *t, uint64_t key, uint32_t count) {
 
-      if (idxj == idxk) {
-        count++;
-        break;
-      }
+  uint64_t i;
+  count_t *c;
+
+  i = (key * COUNT_HASH_MULT) >> t->shift;
+
+  while (1) {
+
+    c = t->slots + i;
+
+    if (c->count == 0) {
+      c->key = key;
+      c->idx = t->size++;
+      break;
+    }
+
+    if (c->key == key) break;
+
+    i = (i + 1) & t->mask;
+  }
+
+  c->count += count;
+
+  return c;
+}
+
+
+count_t *_table_find(count_table_t *t, uint64_t key) {
+
+  uint64_t i;
+
+  i = (key * COUNT_HASH_MULT) >> t->shift;
+
+  while (t->slots[i].key != key || t->slots[i].count == 0)
+    i = (i + 1) & t->mask;
+
+  return t->slots + i;
+}
+
+
+void _entries(count_table_t *t, uint32_t *keys, uint32_t *counts) {
+
+  uint64_t i;
+
+  for (i = 0; i <= t->mask; i++) {
+    if (t->slots[i].count > 0) {
+      keys[  t->slots[i].idx] = t->slots[i].key;
+      counts[t->slots[i].idx] = t->slots[i].count;
     }
   }
+}
+
+
+int _cell_cmp(const void *a, const void *b) {
+
+  stats_cell_t *ca;
+  stats_cell_t *cb;
 
-  return count;
+  ca = (stats_cell_t *)a;
+  cb = (stats_cell_t *)b;
+
+  if (ca->j > cb->j) return  1;
+  if (ca->j < cb->j) return -1;
+  if (ca->k > cb->k) return  1;
+  if (ca->k < cb->k) return -1;
+
+  return 0;
 }
 
 
-double _mutual_information(uint32_t n, array_t *setsj, array_t *setsk) {
+double _mutual_information(stats_contingency_t *ct) {
 
-  uint64_t j;
-  uint64_t k;
+  uint64_t i;
+  uint32_t n;
   uint32_t intcount;
   double   jkval;
   double   mi;
-  set_t   *setj;
-  set_t   *setk;
 
   mi = 0;
+  n  = ct->n;
 
-  for (j = 0; j < setsj->size; j++) {
-
-    setj = (set_t *)array_getd(setsj, j);
+  for (i = 0; i < ct->ncells; i++) {
 
-    for (k = 0; k < setsk->size; k++) {
+    intcount  = ct->cells[i].count;
+    jkval     = n*((double)intcount);
+    jkval    /= ((double)ct->countsj[ct->cells[i].j]) *
+                ct->countsk[ct->cells[i].k];
+    jkval     = log2(jkval);
+    jkval    *= ((double)intcount) / n;
 
-      setk      = (set_t *)array_getd(setsk, k);
-      intcount  = _intersection(setj, setk);
-      jkval     = n*((double)intcount);
-      jkval    /= (setj->idxs.size)*(setk->idxs.size);
-      jkval     = log2(jkval);
-      jkval    *= ((double)intcount) / n;
-
-      if (isfinite(jkval))
-        mi += jkval;
-    }
+    if (isfinite(jkval))
+      mi += jkval;
   }
-  
+
   return mi;
 }
 
 
-double _entropy(array_t *sets, uint32_t n) {
+double _entropy(uint32_t *counts, uint32_t nlabels, uint32_t n) {
 
   uint64_t i;
   double   ent;
   double   enti;
-  set_t   *seti;
   ent = 0;
 
-  for (i = 0; i < sets->size; i++) {
-
-    seti  = (set_t *)array_getd(sets, i);
+  for (i = 0; i < nlabels; i++) {
 
-    enti  = ((double)seti->idxs.size) / n;
+    enti  = ((double)counts[i]) / n;
     enti *= log2(enti);
 
     if (isfinite(enti))
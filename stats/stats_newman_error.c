@@ -8,126 +8,102 @@
  *     detecting community structure in networks.
  *     Physical Review E, vol. 69, no. 6, pg. 066133.
  *
+ * The groups are the cells of the contingency table of the component IDs
+ * and the label values (see stats_contingency), which is built in one
+ * hashed, parallel pass over the nodes.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "graph/graph.h"
 #include "stats/stats.h"
+#include "stats/stats_cache.h"
 
-/**
- * Compares two node_group_t structs by the component value.
- */
-static int _group_component_cmp(const void *g1, const void *g2);
+double stats_newman_error(graph_t *g) {
 
-/**
- * For each unique label value in the graph, Finds the largest group in the
- * given array of node_group_t structs. Removes all other groups from the
- * array.
- *
- * \return 0 on success, non-0 on failure.
- */
-static uint8_t _find_max_groups(
-  graph_t *g,        /**< the graph                                        */
-  array_t *allgroups,/**< array containing node_group_t structs            */
-  array_t *maxgroups /**< pointer to initialised array to store max groups */
-);
+  uint64_t            i;
+  uint32_t            k;
+  uint32_t            nnodes;
+  uint32_t            ncorrect;
+  uint32_t           *cmps;
+  uint32_t           *lbls;
+  int64_t            *maxcell;
+  uint32_t           *nmatches;
+  stats_cell_t       *cell;
+  stats_contingency_t ct;
 
-double stats_newman_error(graph_t *g) {
+  memset(&ct, 0, sizeof(stats_contingency_t));
+  cmps     = NULL;
+  lbls     = NULL;
+  maxcell  = NULL;
+  nmatches = NULL;
+  ncorrect = 0;
+  nnodes   = graph_num_nodes(g);
 
-  uint64_t     i;
-  uint32_t     nnodes;
-  uint32_t     ncorrect;
-  array_t      allgroups;
-  array_t      maxgroups;
-  node_group_t group;
+  cmps = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  lbls = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
 
-  allgroups.data = NULL;
-  maxgroups.data = NULL;
-  ncorrect       = 0;
-  nnodes         = graph_num_nodes(g);
+  if (cmps == NULL) goto fail;
+  if (lbls == NULL) goto fail;
 
-  if (array_create(&allgroups, sizeof(node_group_t), 10)) goto fail;
-  if (array_create(&maxgroups, sizeof(node_group_t), 10)) goto fail;
-  if (graph_communities(g, 1, &allgroups))                goto fail;
-  if (_find_max_groups( g, &allgroups, &maxgroups))       goto fail;
+  if (nnodes > 0 && stats_cache_node_component(g, -1, cmps)) goto fail;
 
-  array_set_cmps(&maxgroups, _group_component_cmp, NULL);
+  for (i = 0; i < nnodes; i++)
+    lbls[i] = graph_get_nodelabel(g, i)->labelval;
 
-  for (i = 0; i < maxgroups.size; i++) {
+  if (stats_contingency(nnodes, cmps, lbls, 0, &ct)) goto fail;
 
-    array_get(&maxgroups, i, &group);
-    if (array_count(&maxgroups, &group) == 1)
-      ncorrect += group.nnodes;
-  }
+  maxcell  = malloc(((uint64_t)ct.nk + 1) * sizeof(int64_t));
+  nmatches = calloc( (uint64_t)ct.nj + 1,   sizeof(uint32_t));
 
-  array_free(&maxgroups);
-  array_free(&allgroups);
-  
-  return (double)ncorrect/nnodes;
-  
-fail:
-  if (allgroups.data != NULL) array_free(&allgroups);
-  if (maxgroups.data != NULL) array_free(&maxgroups);
-  return -1;
-}
+  if (maxcell  == NULL) goto fail;
+  if (nmatches == NULL) goto fail;
 
-static uint8_t _find_max_groups(
-  graph_t *g, array_t *allgroups, array_t *maxgroups) {
-
-  uint64_t     i;
-  node_group_t grp1;
-  node_group_t grp2;
-  uint32_t     nlblvals;
-  int64_t     *maxidx;
-
-  maxidx      = NULL;
-  nlblvals    = graph_num_labelvals(g);
-  maxidx      = malloc(nlblvals*sizeof(int64_t));
-  if (maxidx == NULL) goto fail;
-  
-  for (i = 0; i < nlblvals; i++) maxidx[i] = -1;
-
-  /*find the largest group for each label value*/
-  for (i = 0; i < allgroups->size; i++) {
-    
-    if (array_get(allgroups, i, &grp1)) goto fail;
-
-    if (maxidx[grp1.labelidx] == -1) maxidx[grp1.labelidx] = i;
-    else {
-      if (array_get(allgroups, maxidx[grp1.labelidx], &grp2)) goto fail;
-      if (grp1.nnodes > grp2.nnodes) maxidx[grp1.labelidx] = i;
-    }
-  }
+  for (i = 0; i < ct.nk; i++) maxcell[i] = -1;
 
-  /*add the largest groups to the maxgroups array*/
-  for (i = 0; i < nlblvals; i++) {
+  /*
+   * find the largest group for each label value -
+   * components are numbered in order of their
+   * lowest node, so are first seen in ID order, and
+   * the cells are sorted by component, so ties go
+   * to the lowest component ID
+   */
+  for (i = 0; i < ct.ncells; i++) {
 
-    if (maxidx[i] == -1) continue;
-    
-    if (array_get(allgroups, maxidx[i], &grp1)) goto fail;
-    if (array_append(maxgroups, &grp1))         goto fail;
+    k = ct.cells[i].k;
+
+    if (maxcell[k] == -1 ||
+        ct.cells[i].count > ct.cells[maxcell[k]].count)
+      maxcell[k] = i;
   }
 
-  free(maxidx);
-  return 0;
-  
-fail:
-  if (maxidx != NULL) free(maxidx);
-  return 1;
-}
+  for (i = 0; i < ct.nk; i++)
+    nmatches[ct.cells[maxcell[i]].j]++;
 
-static int _group_component_cmp(const void *g1, const void *g2) {
+  /*groups which share a component are incorrect*/
+  for (i = 0; i < ct.nk; i++) {
 
-  node_group_t *ng1;
-  node_group_t *ng2;
+    cell = ct.cells + maxcell[i];
 
-  ng1 = (node_group_t *)g1;
-  ng2 = (node_group_t *)g2;
+    if (nmatches[cell->j] == 1) ncorrect += cell->count;
+  }
+
+  free(cmps);
+  free(lbls);
+  free(maxcell);
+  free(nmatches);
+  stats_contingency_free(&ct);
 
-  if      (ng1->component > ng2->component) return 1;
-  else if (ng1->component < ng2->component) return -1;
+  return (double)ncorrect/nnodes;
 
-  return 0;
+fail:
+  if (cmps     != NULL) free(cmps);
+  if (lbls     != NULL) free(lbls);
+  if (maxcell  != NULL) free(maxcell);
+  if (nmatches != NULL) free(nmatches);
+  stats_contingency_free(&ct);
+  return -1;
 }
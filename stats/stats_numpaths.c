@@ -78,12 +78,20 @@ double stats_numpaths(graph_t *g, uint32_t nidx, double *numpaths) {
                   STATS_CACHE_NODE_NUMPATHS,
                   STATS_CACHE_TYPE_NODE,
                   sizeof(double));
-  stats_cache_add(g,
-                  STATS_CACHE_PAIR_NUMPATHS,
-                  STATS_CACHE_TYPE_PAIR,
-                  sizeof(double));
   stats_cache_update(g, STATS_CACHE_NODE_NUMPATHS, nidx, -1, &(ctx.total));
-  stats_cache_update(g, STATS_CACHE_PAIR_NUMPATHS, nidx, -1, ctx.numpaths);
+
+  /*
+   * the pair cache needs space for every pair of
+   * nodes, so it is only used when the per-node
+   * counts have been asked for
+   */
+  if (numpaths != NULL) {
+    stats_cache_add(g,
+                    STATS_CACHE_PAIR_NUMPATHS,
+                    STATS_CACHE_TYPE_PAIR,
+                    sizeof(double));
+    stats_cache_update(g, STATS_CACHE_PAIR_NUMPATHS, nidx, -1, ctx.numpaths);
+  }
 
   free(ctx.numpaths);
   free(ctx.visited);
@@ -0,0 +1,280 @@
+/**
+ * Partial shortest path statistics, calculated from a range of source
+ * nodes.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "io/mat.h"
+#include "graph/graph.h"
+#include "stats/stats.h"
+#include "stats/stats_plan.h"
+#include "stats/stats_partial.h"
+
+/**
+ * Size, in bytes, of the header data and row labels in a partial file.
+ */
+#define PARTIAL_HDR_SIZE   64
+#define PARTIAL_LABEL_SIZE 16
+
+/**
+ * Row labels in a partial file, in the order of the fields in
+ * stats_partial_t.
+ */
+static char *_partial_labels[STATS_PARTIAL_NUM_FIELDS] = {
+  "sources", "pathlength", "invdist", "numpaths", "betweenness"
+};
+
+/**
+ * Fills in the given array with pointers to the value arrays of the given
+ * partial results, in the order of the fields in stats_partial_t.
+ */
+static void _partial_fields(
+  stats_partial_t *p,     /**< the partial results           */
+  double         **fields /**< array of length
+                               STATS_PARTIAL_NUM_FIELDS      */
+);
+
+/**
+ * Creates the header data which identifies the graph that partial results
+ * were calculated from.
+ */
+static void _partial_hdr(
+  stats_partial_t *p,  /**< the partial results         */
+  char            *hdr /**< buffer of PARTIAL_HDR_SIZE  */
+);
+
+uint8_t stats_partial_init(
+  stats_partial_t *p, uint32_t nnodes, uint64_t nedges) {
+
+  uint64_t i;
+  double  *fields[STATS_PARTIAL_NUM_FIELDS];
+
+  memset(p, 0, sizeof(stats_partial_t));
+
+  p->nnodes = nnodes;
+  p->nedges = nedges;
+
+  p->sources     = calloc(nnodes, sizeof(double));
+  p->pathlength  = calloc(nnodes, sizeof(double));
+  p->invdist     = calloc(nnodes, sizeof(double));
+  p->numpaths    = calloc(nnodes, sizeof(double));
+  p->betweenness = calloc(nnodes, sizeof(double));
+
+  _partial_fields(p, fields);
+
+  for (i = 0; i < STATS_PARTIAL_NUM_FIELDS; i++)
+    if (fields[i] == NULL) goto fail;
+
+  return 0;
+
+fail:
+  stats_partial_free(p);
+  return 1;
+}
+
+void stats_partial_free(stats_partial_t *p) {
+
+  uint64_t i;
+  double  *fields[STATS_PARTIAL_NUM_FIELDS];
+
+  _partial_fields(p, fields);
+
+  for (i = 0; i < STATS_PARTIAL_NUM_FIELDS; i++)
+    if (fields[i] != NULL) free(fields[i]);
+
+  memset(p, 0, sizeof(stats_partial_t));
+}
+
+uint8_t stats_partial_calc(
+  graph_t         *g,
+  uint8_t          measures,
+  uint32_t         start,
+  uint32_t         end,
+  uint16_t         nthreads,
+  stats_partial_t *p) {
+
+  uint64_t      i;
+  uint32_t      nnodes;
+  uint32_t     *sources;
+  double       *nodebetw;
+  stats_paths_t paths;
+
+  sources = NULL;
+  nnodes  = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) return 1;
+  if (end   > nnodes)       end   = nnodes;
+  if (start > end)          start = end;
+
+  if (stats_partial_init(p, nnodes, graph_num_edges(g))) goto fail;
+
+  if (end > start) {
+    sources = malloc((end - start) * sizeof(uint32_t));
+    if (sources == NULL) goto fail;
+  }
+
+  for (i = start; i < end; i++) {
+    sources[i - start] = i;
+    p->sources[i]      = 1;
+  }
+
+  paths.pathlength = (measures & STATS_PLAN_PATHLENGTH) ? p->pathlength : NULL;
+  paths.invdist    = (measures & STATS_PLAN_EFFICIENCY) ? p->invdist    : NULL;
+  paths.numpaths   = (measures & STATS_PLAN_NUMPATHS)   ? p->numpaths   : NULL;
+  paths.lognumpaths = NULL;
+  nodebetw         = (measures & STATS_PLAN_BETWEENNESS)
+                   ? p->betweenness : NULL;
+
+  if (end > start &&
+      stats_brandes_paths(
+        g, sources, end - start, nthreads, nodebetw, &paths))
+    goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    if (paths.pathlength == NULL) p->pathlength [i] = NAN;
+    if (paths.invdist    == NULL) p->invdist    [i] = NAN;
+    if (paths.numpaths   == NULL) p->numpaths   [i] = NAN;
+    if (nodebetw         == NULL) p->betweenness[i] = NAN;
+  }
+
+  if (sources != NULL) free(sources);
+  return 0;
+
+fail:
+  if (sources != NULL) free(sources);
+  stats_partial_free(p);
+  return 1;
+}
+
+uint8_t stats_partial_merge(stats_partial_t *dst, stats_partial_t *src) {
+
+  uint64_t i;
+  uint64_t j;
+  double  *dfields[STATS_PARTIAL_NUM_FIELDS];
+  double  *sfields[STATS_PARTIAL_NUM_FIELDS];
+
+  if (dst->nnodes != src->nnodes) return 1;
+  if (dst->nedges != src->nedges) return 1;
+
+  _partial_fields(dst, dfields);
+  _partial_fields(src, sfields);
+
+  for (i = 0; i < STATS_PARTIAL_NUM_FIELDS; i++)
+    for (j = 0; j < dst->nnodes; j++)
+      dfields[i][j] += sfields[i][j];
+
+  return 0;
+}
+
+uint8_t stats_partial_save(stats_partial_t *p, char *fname) {
+
+  uint64_t i;
+  mat_t   *mat;
+  double  *fields[STATS_PARTIAL_NUM_FIELDS];
+  char     hdr[  PARTIAL_HDR_SIZE];
+  char     label[PARTIAL_LABEL_SIZE];
+
+  _partial_fields(p, fields);
+  _partial_hdr(   p, hdr);
+
+  mat = mat_create(fname,
+                   STATS_PARTIAL_NUM_FIELDS,
+                   p->nnodes,
+                   (1 << MAT_HAS_ROW_LABELS),
+                   PARTIAL_HDR_SIZE,
+                   PARTIAL_LABEL_SIZE);
+  if (mat == NULL) goto fail;
+
+  if (mat_write_hdr_data(mat, hdr, PARTIAL_HDR_SIZE)) goto fail;
+
+  for (i = 0; i < STATS_PARTIAL_NUM_FIELDS; i++) {
+
+    memset( label, 0,                  sizeof(label));
+    strncpy(label, _partial_labels[i], sizeof(label) - 1);
+
+    if (mat_write_row_label(mat, i, label))     goto fail;
+    if (mat_write_row(      mat, i, fields[i])) goto fail;
+  }
+
+  if (mat_close(mat)) return 1;
+
+  return 0;
+
+fail:
+  if (mat != NULL) mat_close(mat);
+  return 1;
+}
+
+uint8_t stats_partial_load(char *fname, stats_partial_t *p) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint64_t nedges;
+  mat_t   *mat;
+  double  *fields[STATS_PARTIAL_NUM_FIELDS];
+  char     hdr[  PARTIAL_HDR_SIZE];
+  char     label[PARTIAL_LABEL_SIZE];
+
+  memset(p, 0, sizeof(stats_partial_t));
+
+  mat = mat_open(fname);
+  if (mat == NULL) goto fail;
+
+  if (mat_num_rows(mat)      != STATS_PARTIAL_NUM_FIELDS) goto fail;
+  if (mat_hdr_data_size(mat) != PARTIAL_HDR_SIZE)         goto fail;
+  if (mat_label_size(mat)    != PARTIAL_LABEL_SIZE)       goto fail;
+  if (!mat_has_row_labels(mat))                           goto fail;
+  if (mat_read_hdr_data(mat, hdr))                        goto fail;
+
+  hdr[PARTIAL_HDR_SIZE-1] = '\0';
+
+  if (sscanf(hdr, "cnet partial: %" SCNu32 " nodes, %" SCNu64 " edges",
+             &nnodes, &nedges) != 2)
+    goto fail;
+
+  if (nnodes != mat_num_cols(mat))               goto fail;
+  if (stats_partial_init(p, nnodes, nedges))     goto fail;
+
+  _partial_fields(p, fields);
+
+  for (i = 0; i < STATS_PARTIAL_NUM_FIELDS; i++) {
+
+    if (mat_read_row_label(mat, i, label)) goto fail;
+    label[PARTIAL_LABEL_SIZE-1] = '\0';
+
+    if (strcmp(label, _partial_labels[i]))  goto fail;
+    if (mat_read_row(mat, i, fields[i]))    goto fail;
+  }
+
+  mat_close(mat);
+  return 0;
+
+fail:
+  if (mat != NULL) mat_close(mat);
+  stats_partial_free(p);
+  return 1;
+}
+
+void _partial_fields(stats_partial_t *p, double **fields) {
+
+  fields[0] = p->sources;
+  fields[1] = p->pathlength;
+  fields[2] = p->invdist;
+  fields[3] = p->numpaths;
+  fields[4] = p->betweenness;
+}
+
+void _partial_hdr(stats_partial_t *p, char *hdr) {
+
+  memset(hdr, 0, PARTIAL_HDR_SIZE);
+  snprintf(hdr, PARTIAL_HDR_SIZE,
+           "cnet partial: %" PRIu32 " nodes, %" PRIu64 " edges",
+           p->nnodes, p->nedges);
+}
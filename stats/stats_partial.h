@@ -0,0 +1,126 @@
+/**
+ * Partial shortest path statistics, calculated from a range of source
+ * nodes. The source-based measures - path length (and so closeness
+ * centrality), global efficiency, the number of shortest paths, and
+ * betweenness centrality - are all sums over searches from every node in
+ * the graph, so the searches for a large graph may be split into ranges of
+ * source nodes, which are run separately (e.g. as different jobs on a
+ * cluster), and then merged. Merging partial results in any order gives
+ * the same values as calculating them from every node at once (except for
+ * rounding differences in betweenness centrality).
+ *
+ * Partial results are saved as mat files (see README.MAT), with one
+ * column for every node in the graph, and one labelled row for each of
+ * the fields in stats_partial_t, in the order in which they are listed.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __STATS_PARTIAL_H__
+#define __STATS_PARTIAL_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Partial results. Each array has one value for every node in the graph.
+ * Arrays for measures which were not calculated contain NaN.
+ */
+typedef struct _stats_partial {
+
+  uint32_t  nnodes;      /**< number of nodes in the graph          */
+  uint64_t  nedges;      /**< number of edges in the graph          */
+  double   *sources;     /**< number of times each node has been
+                              used as a source                      */
+  double   *pathlength;  /**< average path length of each source
+                              (see stats_pathlength), 0 for nodes
+                              which have not been used as sources   */
+  double   *invdist;     /**< sum of the inverse distances from each
+                              source, 0 for other nodes             */
+  double   *numpaths;    /**< number of shortest paths from each
+                              source (see stats_numpaths), 0 for
+                              other nodes                           */
+  double   *betweenness; /**< unnormalised betweenness of every node,
+                              counting only the shortest paths from
+                              the sources                           */
+
+} stats_partial_t;
+
+/**
+ * Number of fields (mat file rows) in a stats_partial_t.
+ */
+#define STATS_PARTIAL_NUM_FIELDS 5
+
+/**
+ * Initialises partial results for a graph with the given numbers of
+ * nodes and edges, with every value set to 0.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_partial_init(
+  stats_partial_t *p,      /**< partial results to initialise */
+  uint32_t         nnodes, /**< number of nodes               */
+  uint64_t         nedges  /**< number of edges               */
+);
+
+/**
+ * Frees the memory used by the given partial results.
+ */
+void stats_partial_free(
+  stats_partial_t *p /**< partial results to free */
+);
+
+/**
+ * Calculates the given measures (a bitwise OR of the STATS_PLAN_* flags -
+ * see stats_plan.h) from the source nodes in the range [start, end), in
+ * one set of searches (see stats_brandes_paths). Results for measures
+ * which are not requested are set to NaN. Only undirected graphs are
+ * supported.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_partial_calc(
+  graph_t         *g,        /**< the graph                         */
+  uint8_t          measures, /**< measures to calculate             */
+  uint32_t         start,    /**< first source node                 */
+  uint32_t         end,      /**< one past the last source node     */
+  uint16_t         nthreads, /**< number of threads (0 to use all
+                                  CPUs)                             */
+  stats_partial_t *p         /**< uninitialised partial results, to
+                                  store the results in              */
+);
+
+/**
+ * Adds the partial results in src to those in dst.
+ *
+ * \return 0 on success, non-0 if the results are from graphs with
+ * different numbers of nodes or edges.
+ */
+uint8_t stats_partial_merge(
+  stats_partial_t *dst, /**< results to add to */
+  stats_partial_t *src  /**< results to add    */
+);
+
+/**
+ * Saves the given partial results to a mat file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_partial_save(
+  stats_partial_t *p,    /**< partial results to save */
+  char            *fname /**< name of file to create  */
+);
+
+/**
+ * Loads partial results from a mat file which was created by
+ * stats_partial_save.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_partial_load(
+  char            *fname, /**< name of file to load                 */
+  stats_partial_t *p      /**< uninitialised partial results, to
+                               store the loaded results in          */
+);
+
+#endif /* __STATS_PARTIAL_H__ */
@@ -30,6 +30,17 @@ typedef struct _ctx {
   uint32_t count;      /**< current path length count */
 } ctx_t;
 
+/**
+ * Structure used by stats_avg_pathlength to save the state of the
+ * searches from every node.
+ */
+typedef struct _all_ctx {
+
+  double   *tally; /**< path length tally for each node */
+  uint32_t *count; /**< path length count for each node */
+
+} all_ctx_t;
+
 /**
  * Callback function for the breadth first search. Updates path lengths,
  * efficiency, tally and count as needed.
@@ -41,21 +52,57 @@ static uint8_t _bfs_cb(
   void        *context /**< pointer to ctx_t struct */
 );
 
+/**
+ * Callback function for bfs_multi, used by stats_avg_pathlength. Updates
+ * the tally and count for each of the searches in the batch.
+ *
+ * \return 0 always.
+ */
+static uint8_t _bfs_multi_cb(
+  bfs_multi_state_t *state,  /**< search state                */
+  void              *context /**< pointer to all_ctx_t struct */
+);
+
 double stats_avg_pathlength(graph_t *g) {
 
-  uint32_t i;
-  uint32_t numnodes;
-  uint32_t count;
-  double   avgpath;
-  double   path;
+  uint32_t  i;
+  uint32_t  numnodes;
+  uint32_t  count;
+  double    avgpath;
+  double    path;
+  all_ctx_t ctx;
 
   avgpath  = 0;
   count    = 0;
   numnodes = graph_num_nodes(g); 
 
+  ctx.tally = calloc(numnodes, sizeof(double));
+  ctx.count = calloc(numnodes, sizeof(uint32_t));
+
+  if (ctx.tally == NULL) goto fail;
+  if (ctx.count == NULL) goto fail;
+
+  /*
+   * The pair path lengths are not cached here, as
+   * the multi-source search does not keep them;
+   * they are calculated on demand, by
+   * stats_cache_pair_pathlength.
+   */
+  if (bfs_multi(g, NULL, 0, NULL, 0, &ctx, _bfs_multi_cb)) goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_PATHLENGTH,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  /*results are summed in node order, as in a serial search*/
   for (i = 0; i < numnodes; i++) {
 
-    path = stats_pathlength(g, i, NULL);
+    if (ctx.count[i] == 0) path = 0;
+    else                   path = ctx.tally[i] / ctx.count[i];
+
+    stats_cache_update(g, STATS_CACHE_NODE_PATHLENGTH, i, -1, &path);
+
     if (path < 0) goto fail;
     if (isnan(path)) continue;
 
@@ -71,9 +118,14 @@ double stats_avg_pathlength(graph_t *g) {
                   sizeof(double));
   stats_cache_update(g, STATS_CACHE_GRAPH_PATHLENGTH, 0, -1, &avgpath);
 
+  free(ctx.tally);
+  free(ctx.count);
+
   return avgpath;
 
 fail:
+  if (ctx.tally != NULL) free(ctx.tally);
+  if (ctx.count != NULL) free(ctx.count);
   return -1;
 }
 
@@ -97,7 +149,7 @@ double stats_pathlength(
 
   ctx.pathlens[nidx] = 0;
 
-  if (bfs(g, &nidx, 1, NULL, &ctx, NULL, _bfs_cb, NULL)) goto fail;
+  if (bfs_hybrid(g, &nidx, 1, NULL, &ctx, _bfs_cb)) goto fail;
 
   if (ctx.count == 0) path = 0;
   else                path = ctx.tally / ctx.count;
@@ -149,7 +201,7 @@ double stats_sub_pathlength(
 
   ctx.pathlens[nidx] = 0;
 
-  if (bfs(g, &nidx, 1, mask, &ctx, NULL, _bfs_cb, NULL)) goto fail;
+  if (bfs_hybrid(g, &nidx, 1, mask, &ctx, _bfs_cb)) goto fail;
 
   if (ctx.count == 0) path = 0;
   else                path = ctx.tally / ctx.count;
@@ -196,3 +248,35 @@ uint8_t _bfs_cb(bfs_state_t *state, void *context) {
 
   return 0;
 }
+
+uint8_t _bfs_multi_cb(bfs_multi_state_t *state, void *context) {
+
+  uint64_t   i;
+  uint64_t   bits;
+  uint32_t   b;
+  all_ctx_t *ctx;
+  uint32_t   sizes[BFS_MULTI_WIDTH];
+
+  ctx = (all_ctx_t *)context;
+
+  memset(sizes, 0, sizeof(sizes));
+
+  /*count the number of nodes at this level, for each search*/
+  for (i = 0; i < state->nlevel; i++) {
+
+    bits = state->reached[state->level[i]];
+
+    while (bits) {
+      sizes[__builtin_ctzll(bits)]++;
+      bits &= bits - 1;
+    }
+  }
+
+  for (b = 0; b < state->nroots; b++) {
+
+    ctx->tally[state->batch + b] += sizes[b]*(state->depth);
+    ctx->count[state->batch + b] += sizes[b];
+  }
+
+  return 0;
+}
@@ -7,6 +7,10 @@
  *
  * Path-sharing is symmetric, i.e. sharing(u,v) == sharing(v,u)
  *
+ * When the graph has a bitset adjacency matrix (see graph/graph_bitset.h),
+ * the edges between each neighbour of u and the neighbours of v are found
+ * by intersecting rows of the matrix, a word at a time.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #include <stdint.h>
@@ -14,27 +18,170 @@
 #include <string.h>
 
 #include "util/edge_array.h"
+#include "util/parallel.h"
 #include "graph/graph.h"
+#include "graph/graph_bitset.h"
 #include "stats/stats.h"
 #include "stats/stats_cache.h"
 
+/**
+ * Number of edges handed to a thread at a time by
+ * stats_edge_pathsharing_list.
+ */
+#define PATHSHARING_CHUNK 256
+
+/**
+ * Context passed to _pathsharing_range.
+ */
+typedef struct _ps_ctx {
+
+  graph_t      *g;     /**< the graph           */
+  graph_edge_t *edges; /**< the edges to score  */
+
+} ps_ctx_t;
+
+/**
+ * Calculates the path-sharing value for the edge between u and v, without
+ * touching the stats cache. This function only reads from the graph, so may
+ * be called from multiple threads.
+ *
+ * \return the path-sharing value.
+ */
+static double _pathsharing(
+  graph_t *g, /**< the graph    */
+  uint32_t u, /**< one node     */
+  uint32_t v  /**< another node */
+);
+
+/**
+ * parallel_for function - calculates the path-sharing values for edges
+ * [start, end) in the list.
+ *
+ * \return 0 always.
+ */
+static uint8_t _pathsharing_range(
+  uint64_t start,  /**< first edge                */
+  uint64_t end,    /**< one past the last edge    */
+  uint16_t thread, /**< calling thread (unused)   */
+  void    *vctx    /**< pointer to a ps_ctx_t     */
+);
+
+/**
+ * Adds the weights of the edges between node a and the neighbours of node
+ * v, other than node u, to the given count, using the bitset adjacency
+ * matrix of the graph. The weights are added in ascending order of
+ * neighbour, so the result is identical to a scan of the neighbours of v.
+ */
+static void _bitset_shared(
+  graph_t        *g,    /**< the graph                     */
+  graph_bitset_t *bs,   /**< its adjacency matrix          */
+  uint32_t        a,    /**< neighbour of u                */
+  uint32_t        u,    /**< the node to exclude           */
+  uint32_t        v,    /**< the node whose neighbours are
+                             considered                    */
+  double         *count /**< count to add the weights to   */
+);
+
 double stats_edge_pathsharing(graph_t *g, uint32_t u, uint32_t v) {
 
-  uint64_t  i;
-  uint64_t  j;
-  uint32_t  nunbrs;
-  uint32_t  nvnbrs;
-  uint32_t *unbrs;
-  float    *uwts;
-  uint32_t *vnbrs;
-  float    *vwts;  
-  double    count;
-  double    divisor;
-  double    ps;
+  double ps;
 
   if (u == v)                         return 0;
   if (!graph_are_neighbours(g, u, v)) return 0;
 
+  ps = _pathsharing(g, u, v);
+
+  stats_cache_add(g,
+                  STATS_CACHE_EDGE_PATHSHARING,
+                  STATS_CACHE_TYPE_EDGE,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_EDGE_PATHSHARING, u, v, &ps);
+
+  return ps;
+}
+
+uint8_t stats_edge_pathsharing_list(
+  graph_t      *g,
+  graph_edge_t *edges,
+  uint64_t      nedges,
+  uint16_t      nthreads) {
+
+  uint64_t i;
+  ps_ctx_t ctx;
+
+  ctx.g     = g;
+  ctx.edges = edges;
+
+  /*the matrix is not created in a thread-safe manner*/
+  if (graph_bitset_init(g)) goto fail;
+
+  if (parallel_for(
+        nthreads, nedges, PATHSHARING_CHUNK, &ctx, _pathsharing_range))
+    goto fail;
+
+  /*the cache is not thread safe, so is updated afterwards*/
+  stats_cache_add(g,
+                  STATS_CACHE_EDGE_PATHSHARING,
+                  STATS_CACHE_TYPE_EDGE,
+                  sizeof(double));
+
+  for (i = 0; i < nedges; i++) {
+
+    if (edges[i].u == edges[i].v) continue;
+    if (!graph_are_neighbours(g, edges[i].u, edges[i].v)) continue;
+
+    stats_cache_update(g,
+                       STATS_CACHE_EDGE_PATHSHARING,
+                       edges[i].u,
+                       edges[i].v,
+                       &(edges[i].val));
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _pathsharing_range(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t      i;
+  ps_ctx_t     *ctx;
+  graph_edge_t *e;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++) {
+
+    e = ctx->edges + i;
+
+    e->val = 0;
+
+    if (e->u == e->v)                              continue;
+    if (!graph_are_neighbours(ctx->g, e->u, e->v)) continue;
+
+    e->val = _pathsharing(ctx->g, e->u, e->v);
+  }
+
+  return 0;
+}
+
+double _pathsharing(graph_t *g, uint32_t u, uint32_t v) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nunbrs;
+  uint32_t        nvnbrs;
+  uint32_t       *unbrs;
+  float          *uwts;
+  uint32_t       *vnbrs;
+  float          *vwts;  
+  double          count;
+  double          divisor;
+  graph_bitset_t *bs;
+
+  bs     = graph_bitset_get(g);
   nunbrs = graph_num_neighbours(g, u);
   nvnbrs = graph_num_neighbours(g, v);
   unbrs  = graph_get_neighbours(g, u);
@@ -56,6 +203,14 @@ double stats_edge_pathsharing(graph_t *g, uint32_t u, uint32_t v) {
     if (unbrs[i] == v) continue;
     if (graph_are_neighbours(g, v, unbrs[i])) count += uwts[i];
 
+    if (bs != NULL) {
+
+      if (graph_bitset_test(bs, v, unbrs[i])) divisor -= 1;
+
+      _bitset_shared(g, bs, unbrs[i], u, v, &count);
+      continue;
+    }
+
     for (j = 0; j < nvnbrs; j++) {
 
       if (vnbrs[j] == u)                       continue; 
@@ -66,13 +221,47 @@ double stats_edge_pathsharing(graph_t *g, uint32_t u, uint32_t v) {
     }
   }
 
-  ps = count / divisor;
+  return count / divisor;
+}
 
-  stats_cache_add(g,
-                  STATS_CACHE_EDGE_PATHSHARING,
-                  STATS_CACHE_TYPE_EDGE,
-                  sizeof(double));
-  stats_cache_update(g, STATS_CACHE_EDGE_PATHSHARING, u, v, &ps);
+void _bitset_shared(
+  graph_t        *g,
+  graph_bitset_t *bs,
+  uint32_t        a,
+  uint32_t        u,
+  uint32_t        v,
+  double         *count) {
 
-  return ps;
+  uint64_t  w;
+  uint64_t  bits;
+  uint64_t  bit;
+  uint32_t  rank;
+  uint64_t *arow;
+  uint64_t *vrow;
+  float    *awts;
+
+  arow = bs->rows + (uint64_t)a * bs->nwords;
+  vrow = bs->rows + (uint64_t)v * bs->nwords;
+  awts = graph_get_weights(g, a);
+
+  /*
+   * the index of a neighbour b in the neighbour (and
+   * weight) list of a is the number of bits before b
+   * in the row of a
+   */
+  for (w = 0, rank = 0; w < bs->nwords; w++) {
+
+    bits = arow[w] & vrow[w];
+
+    if (w == u / 64) bits &= ~(1ULL << (u % 64));
+
+    while (bits) {
+
+      bit     = bits & (~bits + 1);
+      bits   &= bits - 1;
+      *count += awts[rank + __builtin_popcountll(arow[w] & (bit - 1))];
+    }
+
+    rank += __builtin_popcountll(arow[w]);
+  }
 }
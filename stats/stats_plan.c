@@ -0,0 +1,431 @@
+/**
+ * Calculates a set of shortest path measures from one set of searches.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/bfs.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "stats/stats_plan.h"
+#include "util/profile.h"
+
+/**
+ * Per-node results of the searches, which are passed to _plan_store.
+ * Arrays for measures which were not requested are NULL.
+ */
+typedef struct _plan_results {
+
+  double   *pathlength; /**< average path length of each node       */
+  double   *invdist;    /**< sum of inverse distances for each node */
+  double   *numpaths;   /**< number of shortest paths from each node */
+  double   *nodebetw;   /**< unnormalised betweenness of each node  */
+  double   *tally;      /**< path length tally for each node, used
+                             by the multi-source search             */
+  uint32_t *count;      /**< path length count for each node, used
+                             by the multi-source search             */
+
+} plan_results_t;
+
+/**
+ * \return the subset of the given measures which are not already in the
+ * stats cache.
+ */
+static uint8_t _plan_needed(
+  graph_t *g,       /**< the graph              */
+  uint8_t  measures /**< the requested measures */
+);
+
+/**
+ * Adds the cache fields for the given measures.
+ *
+ * \return 0 on success, non-0 if the graph has no stats cache, or the
+ * fields could not be added.
+ */
+static uint8_t _plan_add_fields(
+  graph_t *g,       /**< the graph    */
+  uint8_t  measures /**< the measures */
+);
+
+/**
+ * Allocates the result arrays for the given measures.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _plan_alloc(
+  graph_t        *g,        /**< the graph                    */
+  uint8_t         measures, /**< the measures                 */
+  plan_results_t *res       /**< results struct to initialise */
+);
+
+/**
+ * Frees the memory used by the given results.
+ */
+static void _plan_free(
+  plan_results_t *res /**< the results */
+);
+
+/**
+ * Calculates the measures for which result arrays have been allocated,
+ * with stats_brandes_paths. Used when the number of paths or betweenness
+ * centrality is needed.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _plan_brandes(
+  graph_t        *g,  /**< the graph                  */
+  plan_results_t *res /**< place to store the results */
+);
+
+/**
+ * Calculates path length and/or global efficiency with bfs_multi.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _plan_bfs(
+  graph_t        *g,        /**< the graph                  */
+  uint8_t         measures, /**< the measures               */
+  plan_results_t *res       /**< place to store the results */
+);
+
+/**
+ * Callback function for bfs_multi, used by _plan_bfs. Updates the path
+ * length tally and count, and the sum of inverse distances, for each of
+ * the searches in the batch, in the same way as stats_avg_pathlength and
+ * stats_global_efficiency.
+ *
+ * \return 0 always.
+ */
+static uint8_t _plan_bfs_cb(
+  bfs_multi_state_t *state,  /**< search state                     */
+  void              *context /**< pointer to a plan_results_t struct */
+);
+
+/**
+ * Stores the given results in the stats cache.
+ */
+static void _plan_store(
+  graph_t        *g,        /**< the graph    */
+  uint8_t         measures, /**< the measures */
+  plan_results_t *res       /**< the results  */
+);
+
+uint8_t stats_plan_paths(graph_t *g, uint8_t measures) {
+
+  plan_results_t res;
+  PROFILE_FUNC();
+
+  memset(&res, 0, sizeof(plan_results_t));
+
+  if (graph_is_directed(g))  return 0;
+  if (graph_num_nodes(g) < 2) return 0;
+
+  measures = _plan_needed(g, measures);
+
+  if (measures == 0)                  return 0;
+  if (_plan_add_fields(g, measures))  return 0;
+  if (_plan_alloc(g, measures, &res)) goto fail;
+
+  if (measures & (STATS_PLAN_NUMPATHS | STATS_PLAN_BETWEENNESS)) {
+    if (_plan_brandes(g, &res)) goto fail;
+  }
+  else {
+    if (_plan_bfs(g, measures, &res)) goto fail;
+  }
+
+  _plan_store(g, measures, &res);
+  _plan_free(&res);
+
+  return 0;
+
+fail:
+  _plan_free(&res);
+  return 1;
+}
+
+uint8_t _plan_needed(graph_t *g, uint8_t measures) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint8_t  needed;
+  double   val;
+
+  nnodes = graph_num_nodes(g);
+  needed = 0;
+
+  if ((measures & STATS_PLAN_PATHLENGTH) &&
+      stats_cache_check(g, STATS_CACHE_GRAPH_PATHLENGTH, 0, -1, &val) != 1)
+    needed |= STATS_PLAN_PATHLENGTH;
+
+  if ((measures & STATS_PLAN_EFFICIENCY) &&
+      stats_cache_check(g, STATS_CACHE_GLOBAL_EFFICIENCY, 0, -1, &val) != 1)
+    needed |= STATS_PLAN_EFFICIENCY;
+
+  for (i = 0; (measures & STATS_PLAN_NUMPATHS) && i < nnodes; i++) {
+
+    if (stats_cache_check(g, STATS_CACHE_NODE_NUMPATHS, i, -1, &val) != 1) {
+      needed |= STATS_PLAN_NUMPATHS;
+      break;
+    }
+  }
+
+  for (i = 0; (measures & STATS_PLAN_HARMONIC) && i < nnodes; i++) {
+
+    if (stats_cache_check(g, STATS_CACHE_NODE_HARMONIC, i, -1, &val) != 1) {
+      needed |= STATS_PLAN_HARMONIC;
+      break;
+    }
+  }
+
+  for (i = 0; (measures & STATS_PLAN_BETWEENNESS) && i < nnodes; i++) {
+
+    if (stats_cache_check(
+          g, STATS_CACHE_BETWEENNESS_CENTRALITY, i, -1, &val) != 1) {
+      needed |= STATS_PLAN_BETWEENNESS;
+      break;
+    }
+  }
+
+  return needed;
+}
+
+uint8_t _plan_add_fields(graph_t *g, uint8_t measures) {
+
+  if (measures & STATS_PLAN_PATHLENGTH) {
+
+    if (stats_cache_add(g,
+                        STATS_CACHE_NODE_PATHLENGTH,
+                        STATS_CACHE_TYPE_NODE,
+                        sizeof(double)))
+      goto fail;
+    if (stats_cache_add(g,
+                        STATS_CACHE_GRAPH_PATHLENGTH,
+                        STATS_CACHE_TYPE_GRAPH,
+                        sizeof(double)))
+      goto fail;
+  }
+
+  if ((measures & STATS_PLAN_EFFICIENCY) &&
+      stats_cache_add(g,
+                      STATS_CACHE_GLOBAL_EFFICIENCY,
+                      STATS_CACHE_TYPE_GRAPH,
+                      sizeof(double)))
+    goto fail;
+
+  if ((measures & STATS_PLAN_HARMONIC) &&
+      stats_cache_add(g,
+                      STATS_CACHE_NODE_HARMONIC,
+                      STATS_CACHE_TYPE_NODE,
+                      sizeof(double)))
+    goto fail;
+
+  if ((measures & STATS_PLAN_NUMPATHS) &&
+      stats_cache_add(g,
+                      STATS_CACHE_NODE_NUMPATHS,
+                      STATS_CACHE_TYPE_NODE,
+                      sizeof(double)))
+    goto fail;
+
+  if ((measures & STATS_PLAN_BETWEENNESS) &&
+      stats_cache_add(g,
+                      STATS_CACHE_BETWEENNESS_CENTRALITY,
+                      STATS_CACHE_TYPE_NODE,
+                      sizeof(double)))
+    goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _plan_alloc(graph_t *g, uint8_t measures, plan_results_t *res) {
+
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  if (measures & STATS_PLAN_PATHLENGTH) {
+    res->pathlength = calloc(nnodes, sizeof(double));
+    if (res->pathlength == NULL) goto fail;
+  }
+
+  if (measures & (STATS_PLAN_EFFICIENCY | STATS_PLAN_HARMONIC)) {
+    res->invdist = calloc(nnodes, sizeof(double));
+    if (res->invdist == NULL) goto fail;
+  }
+
+  if (measures & STATS_PLAN_NUMPATHS) {
+    res->numpaths = calloc(nnodes, sizeof(double));
+    if (res->numpaths == NULL) goto fail;
+  }
+
+  if (measures & STATS_PLAN_BETWEENNESS) {
+    res->nodebetw = calloc(nnodes, sizeof(double));
+    if (res->nodebetw == NULL) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _plan_free(plan_results_t *res) {
+
+  if (res->pathlength != NULL) free(res->pathlength);
+  if (res->invdist    != NULL) free(res->invdist);
+  if (res->numpaths   != NULL) free(res->numpaths);
+  if (res->nodebetw   != NULL) free(res->nodebetw);
+  if (res->tally      != NULL) free(res->tally);
+  if (res->count      != NULL) free(res->count);
+}
+
+uint8_t _plan_brandes(graph_t *g, plan_results_t *res) {
+
+  stats_paths_t paths;
+
+  paths.pathlength  = res->pathlength;
+  paths.invdist     = res->invdist;
+  paths.numpaths    = res->numpaths;
+  paths.lognumpaths = NULL;
+
+  return stats_brandes_paths(g, NULL, 0, 0, res->nodebetw, &paths);
+}
+
+uint8_t _plan_bfs(graph_t *g, uint8_t measures, plan_results_t *res) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  if (measures & STATS_PLAN_PATHLENGTH) {
+
+    res->tally = calloc(nnodes, sizeof(double));
+    res->count = calloc(nnodes, sizeof(uint32_t));
+
+    if (res->tally == NULL) goto fail;
+    if (res->count == NULL) goto fail;
+  }
+
+  if (bfs_multi(g, NULL, 0, NULL, 0, res, _plan_bfs_cb)) goto fail;
+
+  for (i = 0; (measures & STATS_PLAN_PATHLENGTH) && i < nnodes; i++) {
+
+    if (res->count[i] == 0) res->pathlength[i] = 0;
+    else                    res->pathlength[i] = res->tally[i] / res->count[i];
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _plan_bfs_cb(bfs_multi_state_t *state, void *context) {
+
+  uint64_t        i;
+  uint64_t        bits;
+  uint32_t        b;
+  uint32_t        n;
+  plan_results_t *res;
+  uint32_t        sizes[BFS_MULTI_WIDTH];
+
+  res = context;
+
+  memset(sizes, 0, sizeof(sizes));
+
+  /*count the number of nodes at this level, for each search*/
+  for (i = 0; i < state->nlevel; i++) {
+
+    bits = state->reached[state->level[i]];
+
+    while (bits) {
+      sizes[__builtin_ctzll(bits)]++;
+      bits &= bits - 1;
+    }
+  }
+
+  for (b = 0; b < state->nroots; b++) {
+
+    n = state->batch + b;
+
+    if (res->tally != NULL) {
+      res->tally[n] += sizes[b]*(state->depth);
+      res->count[n] += sizes[b];
+    }
+
+    if (res->invdist != NULL && sizes[b] > 0)
+      res->invdist[n] += (float)(sizes[b])/(state->depth);
+  }
+
+  return 0;
+}
+
+void _plan_store(graph_t *g, uint8_t measures, plan_results_t *res) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t count;
+  double   avgpath;
+  double   invsum;
+  double   effic;
+  double   val;
+
+  nnodes = graph_num_nodes(g);
+
+  /*
+   * Graph-level values are summed in node order, in the
+   * same way as by stats_avg_pathlength and
+   * stats_global_efficiency
+   */
+  if (measures & STATS_PLAN_PATHLENGTH) {
+
+    avgpath = 0;
+    count   = 0;
+
+    for (i = 0; i < nnodes; i++) {
+
+      stats_cache_update(
+        g, STATS_CACHE_NODE_PATHLENGTH, i, -1, res->pathlength + i);
+
+      if (isnan(res->pathlength[i])) continue;
+
+      count++;
+      avgpath += res->pathlength[i];
+    }
+
+    avgpath /= count;
+    stats_cache_update(g, STATS_CACHE_GRAPH_PATHLENGTH, 0, -1, &avgpath);
+  }
+
+  if (measures & STATS_PLAN_EFFICIENCY) {
+
+    invsum = 0;
+    for (i = 0; i < nnodes; i++) invsum += res->invdist[i];
+
+    effic = invsum / (nnodes*(nnodes-1));
+    stats_cache_update(g, STATS_CACHE_GLOBAL_EFFICIENCY, 0, -1, &effic);
+  }
+
+  for (i = 0; (measures & STATS_PLAN_HARMONIC) && i < nnodes; i++) {
+
+    val = res->invdist[i] / (nnodes - 1);
+    stats_cache_update(g, STATS_CACHE_NODE_HARMONIC, i, -1, &val);
+  }
+
+  for (i = 0; (measures & STATS_PLAN_NUMPATHS) && i < nnodes; i++)
+    stats_cache_update(g, STATS_CACHE_NODE_NUMPATHS, i, -1, res->numpaths+i);
+
+  for (i = 0; (measures & STATS_PLAN_BETWEENNESS) && i < nnodes; i++) {
+
+    val = res->nodebetw[i] / ((nnodes-1.0)*(nnodes-2.0));
+    stats_cache_update(g, STATS_CACHE_BETWEENNESS_CENTRALITY, i, -1, &val);
+  }
+}
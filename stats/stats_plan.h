@@ -0,0 +1,54 @@
+/**
+ * Planning of the shortest path searches needed by a set of graph
+ * measures. Path length (and so closeness centrality), global efficiency
+ * and harmonic centrality, the number of shortest paths, and betweenness
+ * centrality are all derived
+ * from a breadth first search from every node in the graph. Calculated
+ * separately, each measure runs its own searches; stats_plan_paths works
+ * out the smallest set of searches which provides all of the requested
+ * measures, runs them once, and stores every measure in the stats cache,
+ * where it is found by the usual functions (e.g.
+ * stats_cache_graph_pathlength, stats_cache_node_numpaths).
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __STATS_PLAN_H__
+#define __STATS_PLAN_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Measures which may be requested from stats_plan_paths.
+ */
+#define STATS_PLAN_PATHLENGTH  0x01 /**< node and graph path length, and
+                                         so closeness centrality        */
+#define STATS_PLAN_EFFICIENCY  0x02 /**< global efficiency              */
+#define STATS_PLAN_NUMPATHS    0x04 /**< node number of shortest paths  */
+#define STATS_PLAN_BETWEENNESS 0x08 /**< node betweenness centrality    */
+#define STATS_PLAN_HARMONIC    0x10 /**< node harmonic centrality       */
+
+/**
+ * Calculates the requested measures, which is a bitwise OR of the
+ * STATS_PLAN_* flags, for the given graph, and stores them in its stats
+ * cache. Measures which are already cached are not recalculated.
+ *
+ * If the number of shortest paths or betweenness centrality is requested,
+ * every measure is gathered during the searches of Brandes' algorithm (see
+ * stats_brandes_paths); otherwise, path length, efficiency and harmonic
+ * centrality are all gathered by one multi-source search (see bfs_multi),
+ * which is shared between all available threads. The cached values
+ * are identical to those calculated by the individual measure functions.
+ *
+ * Nothing is done for directed graphs, or for graphs without a stats
+ * cache; the measures are then calculated separately, on demand, as usual.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_plan_paths(
+  graph_t *g,       /**< the graph                          */
+  uint8_t  measures /**< the measures which will be needed  */
+);
+
+#endif /* __STATS_PLAN_H__ */
@@ -0,0 +1,618 @@
+/**
+ * Random reference graph ensembles, and a cache of their clustering and
+ * path length values. Also calculates reference rich-club coefficients.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "graph/graph.h"
+#include "graph/graph_rewire.h"
+#include "util/parallel.h"
+#include "util/rng.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+#include "stats/stats_reference.h"
+
+/**
+ * Number of edge swaps attempted per edge, when generating a
+ * degree-preserving reference graph.
+ */
+#define STATS_REF_SWAPS 10
+
+/**
+ * One entry in the reference cache.
+ */
+typedef struct _ref_entry {
+
+  stats_ref_type_t type;   /**< reference graph type                */
+  uint32_t         nrefs;  /**< number of reference graphs          */
+  uint32_t         nnodes; /**< number of nodes                     */
+  uint64_t         nedges; /**< number of edges                     */
+  uint64_t         hash;   /**< hash of the degree sequence, for
+                                degree-preserving references, 0
+                                otherwise                           */
+  stats_ref_t      ref;    /**< the reference values                */
+
+} ref_entry_t;
+
+/**
+ * State shared by the threads generating a reference ensemble.
+ */
+typedef struct _ref_job {
+
+  graph_t          *g;          /**< the graph                       */
+  stats_ref_type_t  type;       /**< reference graph type            */
+  rng_t            *rngs;       /**< generator for each reference    */
+  double           *clustering; /**< clustering of each reference    */
+  double           *pathlength; /**< path length of each reference   */
+  uint32_t          ndegrees;   /**< rich-club coefficients per
+                                     reference (max degree + 1)      */
+  double           *richclub;   /**< rich-club coefficients of each
+                                     reference                       */
+
+} ref_job_t;
+
+/**
+ * The reference cache.
+ */
+static ref_entry_t     *_entries  = NULL;
+static uint32_t         _nentries = 0;
+static pthread_mutex_t  _lock     = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \return a hash of the sorted degree sequence of the given graph, or 0 on
+ * failure.
+ */
+static uint64_t _degree_hash(
+  graph_t *g /**< the graph */
+);
+
+/**
+ * Looks up the given key in the reference cache. Only the key fields of
+ * the entry are used; if a match is found, its reference values are
+ * copied into the entry.
+ *
+ * \return 1 if a match was found, 0 otherwise.
+ */
+static uint8_t _lookup(
+  ref_entry_t *e /**< the key */
+);
+
+/**
+ * Adds the given entry to the reference cache, replacing any entry with
+ * the same key.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _insert(
+  ref_entry_t *e /**< the entry */
+);
+
+/**
+ * parallel_for function which generates and measures a range of
+ * reference graphs.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _generate(
+  uint64_t  start,  /**< first reference          */
+  uint64_t  end,    /**< one past last reference  */
+  uint16_t  thread, /**< calling thread           */
+  void     *ctx     /**< pointer to a ref_job_t   */
+);
+
+/**
+ * parallel_for function which generates a range of degree-preserving
+ * reference graphs, and calculates their rich-club coefficients.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _generate_rich_club(
+  uint64_t  start,  /**< first reference          */
+  uint64_t  end,    /**< one past last reference  */
+  uint16_t  thread, /**< calling thread           */
+  void     *ctx     /**< pointer to a ref_job_t   */
+);
+
+/**
+ * Seeds one random number stream for each reference graph, from the
+ * calling thread's default generator. Each reference gets its own stream,
+ * so the ensemble does not depend upon how references are distributed
+ * across threads.
+ */
+static void _seed_streams(
+  rng_t    *rngs, /**< space for nrefs generators */
+  uint32_t  nrefs /**< number of reference graphs */
+);
+
+/**
+ * Creates an Erdos-Renyi random graph with the same numbers of nodes and
+ * edges as the given graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_er(
+  graph_t      *g,    /**< the graph                   */
+  graph_t      *ref,  /**< uninitialised graph to create */
+  rng_t        *rng   /**< random number generator      */
+);
+
+/**
+ * Creates a degree-preserving randomisation of the given graph, by
+ * repeatedly swapping the end points of randomly chosen pairs of edges
+ * (see graph/graph_rewire.h).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_degree(
+  graph_t      *g,    /**< the graph                   */
+  graph_t      *ref,  /**< uninitialised graph to create */
+  rng_t        *rng   /**< random number generator      */
+);
+
+/**
+ * Comparison function for uint32_t values, used to sort degree sequences.
+ */
+static int _compare_degrees(
+  const void *a, /**< pointer to a uint32_t       */
+  const void *b  /**< pointer to another uint32_t */
+);
+
+uint8_t stats_reference(
+  graph_t          *g,
+  stats_ref_type_t  type,
+  uint32_t          nrefs,
+  uint16_t          nthreads,
+  stats_ref_t      *ref) {
+
+  uint64_t    i;
+  ref_entry_t e;
+  ref_job_t   job;
+
+  memset(&job, 0, sizeof(ref_job_t));
+
+  if (nrefs == 0)           goto fail;
+  if (graph_is_directed(g)) goto fail;
+
+  e.type   = type;
+  e.nrefs  = nrefs;
+  e.nnodes = graph_num_nodes(g);
+  e.nedges = graph_num_edges(g);
+  e.hash   = 0;
+
+  if (type == STATS_REF_DEGREE) {
+    e.hash = _degree_hash(g);
+    if (e.hash == 0) goto fail;
+  }
+
+  if (_lookup(&e)) {
+    *ref = e.ref;
+    return 0;
+  }
+
+  job.g          = g;
+  job.type       = type;
+  job.rngs       = malloc(nrefs * sizeof(rng_t));
+  job.clustering = calloc(nrefs,  sizeof(double));
+  job.pathlength = calloc(nrefs,  sizeof(double));
+
+  if (job.rngs       == NULL) goto fail;
+  if (job.clustering == NULL) goto fail;
+  if (job.pathlength == NULL) goto fail;
+
+  _seed_streams(job.rngs, nrefs);
+
+  if (parallel_for(nthreads, nrefs, 1, &job, _generate)) goto fail;
+
+  e.ref.clustering = 0;
+  e.ref.pathlength = 0;
+
+  for (i = 0; i < nrefs; i++) {
+    e.ref.clustering += job.clustering[i];
+    e.ref.pathlength += job.pathlength[i];
+  }
+
+  e.ref.clustering /= nrefs;
+  e.ref.pathlength /= nrefs;
+
+  if (_insert(&e)) goto fail;
+
+  *ref = e.ref;
+
+  free(job.rngs);
+  free(job.clustering);
+  free(job.pathlength);
+  return 0;
+
+fail:
+  if (job.rngs       != NULL) free(job.rngs);
+  if (job.clustering != NULL) free(job.clustering);
+  if (job.pathlength != NULL) free(job.pathlength);
+  return 1;
+}
+
+double stats_reference_smallworld_index(graph_t *g, stats_ref_t *ref) {
+
+  double gamma;
+  double lambda;
+
+  gamma  = stats_cache_graph_clustering(g) / ref->clustering;
+  lambda = stats_cache_graph_pathlength(g) / ref->pathlength;
+
+  return gamma / lambda;
+}
+
+uint8_t stats_reference_rich_club(
+  graph_t  *g,
+  uint32_t  nrefs,
+  uint16_t  nthreads,
+  double   *ref,
+  double   *norm) {
+
+  uint64_t  i;
+  uint64_t  k;
+  ref_job_t job;
+
+  memset(&job, 0, sizeof(ref_job_t));
+
+  if (nrefs == 0)           goto fail;
+  if (graph_is_directed(g)) goto fail;
+
+  job.g        = g;
+  job.type     = STATS_REF_DEGREE;
+  job.ndegrees = (uint32_t)stats_max_degree(g) + 1;
+  job.rngs     = malloc(nrefs * sizeof(rng_t));
+  job.richclub = malloc((uint64_t)nrefs * job.ndegrees * sizeof(double));
+
+  if (job.rngs     == NULL) goto fail;
+  if (job.richclub == NULL) goto fail;
+
+  _seed_streams(job.rngs, nrefs);
+
+  if (parallel_for(nthreads, nrefs, 1, &job, _generate_rich_club))
+    goto fail;
+
+  /*
+   * the references are summed in order,
+   * so the result is the same for any
+   * number of threads
+   */
+  for (k = 0; k < job.ndegrees; k++) {
+
+    ref[k] = 0;
+    for (i = 0; i < nrefs; i++) ref[k] += job.richclub[i * job.ndegrees + k];
+    ref[k] /= nrefs;
+  }
+
+  if (norm != NULL) {
+
+    if (stats_rich_club(g, norm)) goto fail;
+
+    for (k = 0; k < job.ndegrees; k++) {
+      if (ref[k] > 0) norm[k] /= ref[k];
+      else            norm[k]  = NAN;
+    }
+  }
+
+  free(job.rngs);
+  free(job.richclub);
+  return 0;
+
+fail:
+  if (job.rngs     != NULL) free(job.rngs);
+  if (job.richclub != NULL) free(job.richclub);
+  return 1;
+}
+
+uint8_t stats_reference_load(char *fname) {
+
+  FILE       *fd;
+  char        line[256];
+  int         type;
+  ref_entry_t e;
+
+  fd = fopen(fname, "rt");
+  if (fd == NULL) return 0;
+
+  while (fgets(line, sizeof(line), fd) != NULL) {
+
+    if (line[0] == '#') continue;
+
+    if (sscanf(line, "%d %" SCNu32 " %" SCNu32 " %" SCNu64 " %" SCNx64
+               " %lf %lf",
+               &type, &e.nrefs, &e.nnodes, &e.nedges, &e.hash,
+               &e.ref.clustering, &e.ref.pathlength) != 7)
+      goto fail;
+
+    if (type != STATS_REF_ER && type != STATS_REF_DEGREE) goto fail;
+
+    e.type = type;
+
+    if (_insert(&e)) goto fail;
+  }
+
+  fclose(fd);
+  return 0;
+
+fail:
+  fclose(fd);
+  return 1;
+}
+
+uint8_t stats_reference_save(char *fname) {
+
+  uint64_t     i;
+  FILE        *fd;
+  ref_entry_t *e;
+
+  fd = fopen(fname, "wt");
+  if (fd == NULL) goto fail;
+
+  pthread_mutex_lock(&_lock);
+
+  fprintf(fd, "# type nrefs nnodes nedges degreehash "
+              "clustering pathlength\n");
+
+  for (i = 0; i < _nentries; i++) {
+
+    e = _entries + i;
+
+    fprintf(fd, "%d %" PRIu32 " %" PRIu32 " %" PRIu64 " %016" PRIx64
+            " %.17g %.17g\n",
+            e->type, e->nrefs, e->nnodes, e->nedges, e->hash,
+            e->ref.clustering, e->ref.pathlength);
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  if (fclose(fd)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void stats_reference_clear(void) {
+
+  pthread_mutex_lock(&_lock);
+
+  if (_entries != NULL) free(_entries);
+
+  _entries  = NULL;
+  _nentries = 0;
+
+  pthread_mutex_unlock(&_lock);
+}
+
+uint64_t _degree_hash(graph_t *g) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  hash;
+  uint32_t  nnodes;
+  uint32_t *degrees;
+
+  nnodes  = graph_num_nodes(g);
+  degrees = malloc(nnodes * sizeof(uint32_t));
+  if (degrees == NULL) return 0;
+
+  for (i = 0; i < nnodes; i++) degrees[i] = graph_num_neighbours(g, i);
+
+  qsort(degrees, nnodes, sizeof(uint32_t), _compare_degrees);
+
+  /*64 bit FNV-1a, over the bytes of the sorted degrees*/
+  hash = 14695981039346656037ULL;
+
+  for (i = 0; i < nnodes; i++) {
+    for (j = 0; j < sizeof(uint32_t); j++) {
+      hash ^= (degrees[i] >> (8*j)) & 0xFF;
+      hash *= 1099511628211ULL;
+    }
+  }
+
+  free(degrees);
+
+  if (hash == 0) hash = 1;
+
+  return hash;
+}
+
+uint8_t _lookup(ref_entry_t *e) {
+
+  uint64_t     i;
+  uint8_t      found;
+  ref_entry_t *c;
+
+  found = 0;
+
+  pthread_mutex_lock(&_lock);
+
+  for (i = 0; i < _nentries; i++) {
+
+    c = _entries + i;
+
+    if (c->type   != e->type)   continue;
+    if (c->nrefs  != e->nrefs)  continue;
+    if (c->nnodes != e->nnodes) continue;
+    if (c->nedges != e->nedges) continue;
+    if (c->hash   != e->hash)   continue;
+
+    e->ref = c->ref;
+    found  = 1;
+    break;
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  return found;
+}
+
+uint8_t _insert(ref_entry_t *e) {
+
+  uint64_t     i;
+  ref_entry_t *c;
+  ref_entry_t *tmp;
+
+  pthread_mutex_lock(&_lock);
+
+  for (i = 0; i < _nentries; i++) {
+
+    c = _entries + i;
+
+    if (c->type   != e->type)   continue;
+    if (c->nrefs  != e->nrefs)  continue;
+    if (c->nnodes != e->nnodes) continue;
+    if (c->nedges != e->nedges) continue;
+    if (c->hash   != e->hash)   continue;
+
+    *c = *e;
+    pthread_mutex_unlock(&_lock);
+    return 0;
+  }
+
+  tmp = realloc(_entries, (_nentries + 1) * sizeof(ref_entry_t));
+  if (tmp == NULL) goto fail;
+
+  _entries              = tmp;
+  _entries[_nentries++] = *e;
+
+  pthread_mutex_unlock(&_lock);
+  return 0;
+
+fail:
+  pthread_mutex_unlock(&_lock);
+  return 1;
+}
+
+uint8_t _generate(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   i;
+  graph_t    ref;
+  ref_job_t *job;
+
+  job = ctx;
+
+  for (i = start; i < end; i++) {
+
+    memset(&ref, 0, sizeof(graph_t));
+
+    if (job->type == STATS_REF_ER) {
+      if (_create_er(job->g, &ref, job->rngs+i)) goto fail;
+    }
+    else {
+      if (_create_degree(job->g, &ref, job->rngs+i)) goto fail;
+    }
+
+    if (graph_freeze(&ref))     goto fail;
+    if (stats_cache_init(&ref)) goto fail;
+
+    job->clustering[i] = stats_cache_graph_clustering(&ref);
+    job->pathlength[i] = stats_cache_graph_pathlength(&ref);
+
+    graph_free(&ref);
+  }
+
+  return 0;
+
+fail:
+  graph_free(&ref);
+  return 1;
+}
+
+uint8_t _generate_rich_club(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   i;
+  graph_t    ref;
+  ref_job_t *job;
+
+  job = ctx;
+
+  for (i = start; i < end; i++) {
+
+    memset(&ref, 0, sizeof(graph_t));
+
+    if (_create_degree(job->g, &ref, job->rngs+i)) goto fail;
+    if (graph_freeze(&ref))                     goto fail;
+
+    if (stats_rich_club(&ref, job->richclub + i * job->ndegrees))
+      goto fail;
+
+    graph_free(&ref);
+  }
+
+  return 0;
+
+fail:
+  graph_free(&ref);
+  return 1;
+}
+
+void _seed_streams(rng_t *rngs, uint32_t nrefs) {
+
+  uint64_t i;
+
+  rng_seed(rngs, rng_next(rng_default()));
+  for (i = 1; i < nrefs; i++) {
+    rngs[i] = rngs[i-1];
+    rng_jump(rngs+i);
+  }
+}
+
+uint8_t _create_er(graph_t *g, graph_t *ref, rng_t *rng) {
+
+  uint64_t nedges;
+  uint64_t maxedges;
+  uint32_t nnodes;
+  uint32_t u;
+  uint32_t v;
+
+  nnodes   = graph_num_nodes(g);
+  nedges   = graph_num_edges(g);
+  maxedges = ((uint64_t)nnodes * (nnodes - 1)) / 2;
+
+  if (nedges > maxedges)           goto fail;
+  if (graph_create(ref, nnodes, 0)) goto fail;
+
+  while (graph_num_edges(ref) < nedges) {
+
+    u = rng_range(rng, nnodes);
+    v = rng_range(rng, nnodes);
+
+    if (u == v)                         continue;
+    if (graph_are_neighbours(ref, u, v)) continue;
+
+    if (graph_add_edge(ref, u, v, 1)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _create_degree(graph_t *g, graph_t *ref, rng_t *rng) {
+
+  return graph_rewire(g, ref, STATS_REF_SWAPS * graph_num_edges(g), rng);
+}
+
+int _compare_degrees(const void *a, const void *b) {
+
+  uint32_t da;
+  uint32_t db;
+
+  da = *(const uint32_t *)a;
+  db = *(const uint32_t *)b;
+
+  if (da < db) return -1;
+  if (da > db) return  1;
+  return 0;
+}
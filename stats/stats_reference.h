@@ -0,0 +1,135 @@
+/**
+ * Random reference graph ensembles, used to normalise clustering and path
+ * length when calculating the small-world index (see
+ * stats_smallworld_index). Instead of the analytic Erdos-Renyi
+ * approximations given by stats_er_clustering and stats_er_pathlength, the
+ * reference values are averaged over an ensemble of random graphs, which
+ * are generated, and measured, in parallel. Two kinds of reference graph
+ * are supported:
+ *
+ * - Erdos-Renyi graphs with the same number of nodes and edges.
+ *
+ * - Degree-preserving randomisations, in which the edges of the graph are
+ *   repeatedly swapped, so every node keeps its degree:
+ *
+ *     Maslov S & Sneppen K 2002. Specificity and stability in topology of
+ *     protein networks. Science 296(5569):910-913
+ *
+ * Reference values are cached, keyed by the reference type, the ensemble
+ * size, the numbers of nodes and edges and, for degree-preserving
+ * references, the degree sequence. So graphs of the same size and density
+ * (or with the same degree distribution) share one ensemble. The cache
+ * lives for the lifetime of the process, and can be saved to, and loaded
+ * from, a file, so that it can be shared between runs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __STATS_REFERENCE_H__
+#define __STATS_REFERENCE_H__
+
+#include <stdint.h>
+
+#include "graph/graph.h"
+
+/**
+ * Reference graph types.
+ */
+typedef enum {
+
+  STATS_REF_ER     = 0, /**< Erdos-Renyi random graphs         */
+  STATS_REF_DEGREE = 1  /**< degree-preserving randomisations */
+
+} stats_ref_type_t;
+
+/**
+ * Reference values, averaged over an ensemble of random graphs.
+ */
+typedef struct _stats_ref {
+
+  double clustering; /**< average clustering coefficient  */
+  double pathlength; /**< average characteristic path
+                          length                          */
+
+} stats_ref_t;
+
+/**
+ * Calculates reference clustering and path length values for the given
+ * graph, which must be undirected, by generating nrefs random reference
+ * graphs of the given type. If matching values are already in the
+ * reference cache, they are returned without generating any graphs.
+ *
+ * Each reference graph uses its own random number stream, derived from the
+ * calling thread's default generator (see rng_default), so the results
+ * depend upon the seed, but not upon the number of threads.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_reference(
+  graph_t          *g,        /**< the graph                          */
+  stats_ref_type_t  type,     /**< type of reference graph            */
+  uint32_t          nrefs,    /**< number of reference graphs         */
+  uint16_t          nthreads, /**< number of threads (0 to use all
+                                   CPUs)                              */
+  stats_ref_t      *ref       /**< place to store the reference values */
+);
+
+/**
+ * \return the small world index of the given graph, using the given
+ * reference values (see stats_reference).
+ */
+double stats_reference_smallworld_index(
+  graph_t     *g,  /**< the graph            */
+  stats_ref_t *ref /**< the reference values */
+);
+
+/**
+ * Calculates reference rich-club coefficients for the given graph, which
+ * must be undirected (see stats_rich_club), averaged over nrefs
+ * degree-preserving randomisations of the graph. Since the reference
+ * graphs have the same degree sequence as the graph, they have the same
+ * maximum degree. If norm is not NULL, the normalised coefficients of the
+ * graph - its coefficients divided by the reference coefficients - are
+ * stored in it; a normalised coefficient is NaN where the reference
+ * coefficient is 0.
+ *
+ * As with stats_reference, each reference graph uses its own random
+ * number stream, so the results do not depend upon the number of threads.
+ * Rich-club coefficients are not stored in the reference cache.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_reference_rich_club(
+  graph_t  *g,        /**< the graph                                  */
+  uint32_t  nrefs,    /**< number of reference graphs                 */
+  uint16_t  nthreads, /**< number of threads (0 to use all CPUs)      */
+  double   *ref,      /**< space to store stats_max_degree(g)+1
+                           reference coefficients                     */
+  double   *norm      /**< space to store stats_max_degree(g)+1
+                           normalised coefficients, or NULL           */
+);
+
+/**
+ * Loads reference values from the given file, adding them to the
+ * reference cache. Nothing is done if the file does not exist.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_reference_load(
+  char *fname /**< name of file to load */
+);
+
+/**
+ * Saves the contents of the reference cache to the given file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t stats_reference_save(
+  char *fname /**< name of file to save to */
+);
+
+/**
+ * Empties the reference cache.
+ */
+void stats_reference_clear(void);
+
+#endif /* __STATS_REFERENCE_H__ */
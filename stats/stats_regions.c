@@ -0,0 +1,96 @@
+/**
+ * Functions which count the edges within and between the regions of a
+ * graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_aggregate.h"
+#include "stats/stats.h"
+
+uint8_t stats_regions(graph_t *g, uint16_t nthreads, stats_regions_t *regs) {
+
+  uint64_t          i;
+  uint64_t          p;
+  uint32_t          n;
+  uint32_t          a;
+  uint32_t          b;
+  uint32_t          nnodes;
+  uint32_t         *groups;
+  graph_aggregate_t agg;
+
+  groups = NULL;
+  nnodes = graph_num_nodes(g);
+  memset(&agg, 0, sizeof(graph_aggregate_t));
+  memset(regs, 0, sizeof(stats_regions_t));
+
+  groups = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  if (groups == NULL) goto fail;
+
+  if (graph_aggregate_labels(g, groups, &regs->labels, &regs->nregions))
+    goto fail;
+  if (graph_aggregate(&agg, g, groups, regs->nregions, nthreads))
+    goto fail;
+
+  n            = regs->nregions;
+  regs->sizes  = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  regs->counts = calloc((n > 0 ? (uint64_t)n * n : 1), sizeof(double));
+
+  if (regs->sizes  == NULL) goto fail;
+  if (regs->counts == NULL) goto fail;
+
+  memcpy(regs->sizes, agg.sizes, n * sizeof(uint32_t));
+
+  for (i = 0; i < n; i++)
+    regs->counts[i * n + i] = agg.within[i];
+
+  /*undirected edges are only counted for pairs with a < b*/
+  for (p = 0; p < agg.npairs; p++) {
+
+    a = agg.pairs[2*p];
+    b = agg.pairs[2*p+1];
+
+    regs->counts[(uint64_t)a * n + b] = agg.counts[p];
+
+    if (!graph_is_directed(g))
+      regs->counts[(uint64_t)b * n + a] = agg.counts[p];
+  }
+
+  graph_aggregate_free(&agg);
+  free(groups);
+  return 0;
+
+fail:
+  graph_aggregate_free(&agg);
+  if (groups != NULL) free(groups);
+  stats_regions_free(regs);
+  return 1;
+}
+
+double stats_region_density(stats_regions_t *regs, uint32_t i, uint32_t j) {
+
+  double count;
+  double npairs;
+
+  count = regs->counts[(uint64_t)i * regs->nregions + j];
+
+  if (i == j) npairs = (double)regs->sizes[i] * (regs->sizes[i] - 1) / 2.0;
+  else        npairs = (double)regs->sizes[i] *  regs->sizes[j];
+
+  if (npairs > 0) count /= npairs;
+
+  return count;
+}
+
+void stats_regions_free(stats_regions_t *regs) {
+
+  if (regs->labels != NULL) free(regs->labels);
+  if (regs->sizes  != NULL) free(regs->sizes);
+  if (regs->counts != NULL) free(regs->counts);
+
+  memset(regs, 0, sizeof(stats_regions_t));
+}
@@ -0,0 +1,107 @@
+/**
+ * Function for calculating the rich-club coefficients of a graph.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "stats/stats.h"
+
+uint8_t stats_rich_club(graph_t *g, double *phi) {
+
+  int64_t   k;
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  n;
+  uint64_t  nedges;
+  uint32_t  u;
+  uint32_t  deg;
+  uint32_t  nnodes;
+  uint32_t  maxdeg;
+  uint32_t *nbrs;
+  uint32_t *starts;
+  uint32_t *order;
+  uint32_t *rank;
+
+  starts = NULL;
+  order  = NULL;
+  rank   = NULL;
+
+  if (graph_is_directed(g)) goto fail;
+
+  nnodes = graph_num_nodes(g);
+  maxdeg = 0;
+
+  for (i = 0; i < nnodes; i++) {
+    deg = graph_num_neighbours(g, i);
+    if (deg > maxdeg) maxdeg = deg;
+  }
+
+  starts = calloc((uint64_t)maxdeg + 2, sizeof(uint32_t));
+  order  = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+  rank   = malloc(((uint64_t)nnodes + 1) * sizeof(uint32_t));
+
+  if (starts == NULL) goto fail;
+  if (order  == NULL) goto fail;
+  if (rank   == NULL) goto fail;
+
+  /*
+   * counting sort of the nodes by descending degree -
+   * starts[maxdeg-k] is the position in the order of
+   * the first node with degree k
+   */
+  for (i = 0; i < nnodes; i++)
+    starts[maxdeg - graph_num_neighbours(g, i) + 1]++;
+
+  for (i = 1; i <= maxdeg + 1; i++) starts[i] += starts[i-1];
+
+  for (i = 0; i < nnodes; i++) {
+    j        = starts[maxdeg - graph_num_neighbours(g, i)]++;
+    order[j] = i;
+    rank[i]  = j;
+  }
+
+  /*
+   * sweep down from the highest degree; before the
+   * nodes of degree k are added, the retained nodes
+   * are exactly those with degree > k. Each new node
+   * adds its edges to the nodes already retained,
+   * i.e. the neighbours which come before it.
+   */
+  n      = 0;
+  nedges = 0;
+
+  for (k = maxdeg; k >= 0; k--) {
+
+    if (n < 2) phi[k] = 0;
+    else       phi[k] = (2.0 * nedges) / ((double)n * (n - 1));
+
+    for (; n < nnodes; n++) {
+
+      u   = order[n];
+      deg = graph_num_neighbours(g, u);
+
+      if (deg != k) break;
+
+      nbrs = graph_get_neighbours(g, u);
+
+      for (j = 0; j < deg; j++) {
+        if (rank[nbrs[j]] < n) nedges++;
+      }
+    }
+  }
+
+  free(starts);
+  free(order);
+  free(rank);
+  return 0;
+
+fail:
+  if (starts != NULL) free(starts);
+  if (order  != NULL) free(order);
+  if (rank   != NULL) free(rank);
+  return 1;
+}
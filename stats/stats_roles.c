@@ -0,0 +1,253 @@
+/**
+ * Function which calculates the participation coefficient and the
+ * within-module degree z-score of every node, used to classify nodes
+ * into the roles described in:
+ *
+ *   Guimera R & Amaral LAN 2005. Functional cartography of complex
+ *   metabolic networks. Nature 433:895-900
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph/graph.h"
+#include "graph/graph_aggregate.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+
+/**
+ * Number of nodes handed to a thread at a time.
+ */
+#define ROLES_CHUNK 1024
+
+/**
+ * A thread's workspace - a sparse accumulator of the number of edges
+ * between one node and each module. Only the modules which the node is
+ * connected to are touched, and reset, so the cost for each node is
+ * proportional to its degree, not to the number of modules.
+ */
+typedef struct _roles_ws {
+
+  uint32_t *counts;  /**< number of edges to each module      */
+  uint32_t *touched; /**< modules with a non-zero count       */
+
+} roles_ws_t;
+
+/**
+ * Context passed to _roles.
+ */
+typedef struct _roles_ctx {
+
+  graph_t    *g;             /**< the graph                         */
+  uint32_t   *modules;       /**< module of every node              */
+  roles_ws_t *ws;            /**< workspace for every thread        */
+  double     *participation; /**< participation of every node       */
+  uint32_t   *within;        /**< within-module degree of every node */
+
+} roles_ctx_t;
+
+/**
+ * parallel_for function which calculates the participation coefficient
+ * and within-module degree of a range of nodes, in one pass over their
+ * neighbours.
+ *
+ * \return 0.
+ */
+static uint8_t _roles(
+  uint64_t  start,  /**< first node                */
+  uint64_t  end,    /**< one past last node        */
+  uint16_t  thread, /**< calling thread            */
+  void     *ctx     /**< pointer to a roles_ctx_t  */
+);
+
+uint8_t stats_roles(
+  graph_t  *g,
+  uint16_t  nthreads,
+  double   *participation,
+  double   *zscore) {
+
+  uint64_t     i;
+  uint32_t     m;
+  uint32_t     nnodes;
+  uint32_t     nmodules;
+  uint32_t    *labels;
+  uint64_t    *sums;
+  uint64_t    *sqsums;
+  uint64_t    *sizes;
+  double       mean;
+  double       sd;
+  double       z;
+  roles_ctx_t  ctx;
+
+  PROFILE_FUNC();
+
+  memset(&ctx, 0, sizeof(roles_ctx_t));
+  labels = NULL;
+  sums   = NULL;
+  sqsums = NULL;
+  nnodes = graph_num_nodes(g);
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads == 0)                    nthreads = 1;
+
+  ctx.g             = g;
+  ctx.modules       = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  ctx.within        = malloc((nnodes > 0 ? nnodes : 1) * sizeof(uint32_t));
+  ctx.participation = malloc((nnodes > 0 ? nnodes : 1) * sizeof(double));
+  ctx.ws            = calloc(nthreads, sizeof(roles_ws_t));
+
+  if (ctx.modules       == NULL) goto fail;
+  if (ctx.within        == NULL) goto fail;
+  if (ctx.participation == NULL) goto fail;
+  if (ctx.ws            == NULL) goto fail;
+
+  /*modules are the node label values*/
+  if (graph_aggregate_labels(g, ctx.modules, &labels, &nmodules))
+    goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+
+    ctx.ws[i].counts  = calloc(nmodules > 0 ? nmodules : 1,
+                               sizeof(uint32_t));
+    ctx.ws[i].touched = malloc((nmodules > 0 ? nmodules : 1) *
+                               sizeof(uint32_t));
+
+    if (ctx.ws[i].counts  == NULL) goto fail;
+    if (ctx.ws[i].touched == NULL) goto fail;
+  }
+
+  if (parallel_for(nthreads, nnodes, ROLES_CHUNK, &ctx, _roles)) goto fail;
+
+  /*
+   * the within-module degree statistics are
+   * integer sums, so the z-scores do not
+   * depend on the number of threads
+   */
+  sums = calloc(3 * (uint64_t)nmodules + 1, sizeof(uint64_t));
+  if (sums == NULL) goto fail;
+
+  sqsums = sums   + nmodules;
+  sizes  = sqsums + nmodules;
+
+  for (i = 0; i < nnodes; i++) {
+
+    m          = ctx.modules[i];
+    sums[  m] += ctx.within[i];
+    sqsums[m] += (uint64_t)ctx.within[i] * ctx.within[i];
+    sizes[ m] += 1;
+  }
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_PARTICIPATION,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_ZSCORE,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  for (i = 0; i < nnodes; i++) {
+
+    m    = ctx.modules[i];
+    mean = (double)sums[m]   / sizes[m];
+    sd   = (double)sqsums[m] / sizes[m] - mean * mean;
+    sd   = (sd > 0) ? sqrt(sd) : 0;
+
+    /*
+     * a standard deviation of 0 means that every
+     * node in the module has the same within-module
+     * degree, so none of them stands out
+     */
+    if (sd > 0) z = (ctx.within[i] - mean) / sd;
+    else        z = 0;
+
+    stats_cache_update(
+      g, STATS_CACHE_NODE_PARTICIPATION, i, -1, ctx.participation + i);
+    stats_cache_update(g, STATS_CACHE_NODE_ZSCORE, i, -1, &z);
+
+    if (participation != NULL) participation[i] = ctx.participation[i];
+    if (zscore        != NULL) zscore[i]        = z;
+  }
+
+  for (i = 0; i < nthreads; i++) {
+    free(ctx.ws[i].counts);
+    free(ctx.ws[i].touched);
+  }
+
+  free(ctx.ws);
+  free(ctx.modules);
+  free(ctx.within);
+  free(ctx.participation);
+  free(labels);
+  free(sums);
+  return 0;
+
+fail:
+  if (ctx.ws != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (ctx.ws[i].counts  != NULL) free(ctx.ws[i].counts);
+      if (ctx.ws[i].touched != NULL) free(ctx.ws[i].touched);
+    }
+    free(ctx.ws);
+  }
+  if (ctx.modules       != NULL) free(ctx.modules);
+  if (ctx.within        != NULL) free(ctx.within);
+  if (ctx.participation != NULL) free(ctx.participation);
+  if (labels            != NULL) free(labels);
+  if (sums              != NULL) free(sums);
+  return 1;
+}
+
+uint8_t _roles(uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t     i;
+  uint64_t     j;
+  uint32_t     m;
+  uint32_t     nnbrs;
+  uint32_t     ntouched;
+  uint32_t    *nbrs;
+  double       sum;
+  double       frac;
+  roles_ws_t  *ws;
+  roles_ctx_t *ctx;
+
+  ctx = vctx;
+  ws  = ctx->ws + thread;
+
+  for (i = start; i < end; i++) {
+
+    nnbrs    = graph_num_neighbours(ctx->g, i);
+    nbrs     = graph_get_neighbours(ctx->g, i);
+    ntouched = 0;
+
+    for (j = 0; j < nnbrs; j++) {
+
+      m = ctx->modules[nbrs[j]];
+
+      if (ws->counts[m]++ == 0) ws->touched[ntouched++] = m;
+    }
+
+    ctx->within[i] = ws->counts[ctx->modules[i]];
+
+    /*P(i) = 1 - sum over modules s of (k(i,s) / k(i))^2*/
+    sum = 0;
+    for (j = 0; j < ntouched; j++) {
+
+      m     = ws->touched[j];
+      frac  = (double)ws->counts[m] / nnbrs;
+      sum  += frac * frac;
+
+      ws->counts[m] = 0;
+    }
+
+    ctx->participation[i] = (nnbrs > 0) ? 1 - sum : 0;
+  }
+
+  return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * Functions which calculate weighted node measures - the strength (sum of
+ * edge weights) of a node, the weighted degree centrality, and the
+ * weighted clustering coefficient:
+ *
+ *   Onnela JP, Saramaki J, Kertesz J & Kaski K 2005. Intensity and
+ *   coherence of motifs in weighted complex networks. Physical Review E
+ *   71(6):065103
+ *
+ * The weight lists of each node are read directly, and strengths are
+ * summed with the vectorised kernel in graph/graph_weights.h. Triangles
+ * are enumerated by merging the sorted neighbour lists of each node and
+ * its neighbours, which gives the positions, and so the weights, of the
+ * edges of every triangle.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "graph/graph.h"
+#include "graph/graph_weights.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "stats/stats.h"
+#include "stats/stats_cache.h"
+
+/**
+ * Number of nodes handed to a thread at a time by
+ * stats_weighted_clustering.
+ */
+#define WCLUSTERING_CHUNK 64
+
+/**
+ * Context passed to _wclustering.
+ */
+typedef struct _wclustering_ctx {
+
+  graph_t *g;      /**< the graph                             */
+  double   maxwt;  /**< largest absolute weight in the graph  */
+  double  *clust;  /**< weighted clustering of every node     */
+
+} wclustering_ctx_t;
+
+/**
+ * \return the weighted clustering coefficient of the given node, with
+ * weights divided by maxwt.
+ */
+static double _node_wclustering(
+  graph_t *g,     /**< the graph                      */
+  uint32_t n,     /**< the node                       */
+  double   maxwt  /**< largest absolute weight, > 0   */
+);
+
+/**
+ * parallel_for function which calculates the weighted clustering of a
+ * range of nodes.
+ *
+ * \return 0.
+ */
+static uint8_t _wclustering(
+  uint64_t  start,  /**< first node                     */
+  uint64_t  end,    /**< one past last node             */
+  uint16_t  thread, /**< calling thread                 */
+  void     *ctx     /**< pointer to a wclustering_ctx_t */
+);
+
+double stats_strength(graph_t *g, uint32_t n) {
+
+  uint32_t nnbrs;
+  float   *wts;
+  double   strength;
+
+  nnbrs = graph_num_neighbours(g, n);
+  wts   = graph_get_weights(   g, n);
+
+  /*a graph without weights is treated as binary*/
+  if (wts == NULL) strength = nnbrs;
+  else             strength = graph_weights_sum(wts, nnbrs);
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_STRENGTH,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+  stats_cache_update(g, STATS_CACHE_NODE_STRENGTH, n, -1, &strength);
+
+  return strength;
+}
+
+double stats_weighted_degree_centrality(graph_t *g, uint32_t n) {
+
+  double nnodes;
+  double strength;
+
+  nnodes = graph_num_nodes(g);
+
+  if (stats_cache_node_strength(g, n, &strength)) return NAN;
+
+  return strength / (nnodes - 1);
+}
+
+uint8_t stats_weighted_clustering(
+  graph_t *g, uint16_t nthreads, double *clust) {
+
+  uint64_t          i;
+  uint32_t          nnodes;
+  double            lo;
+  double            hi;
+  wclustering_ctx_t ctx;
+
+  PROFILE_FUNC();
+
+  ctx.clust = NULL;
+  nnodes    = graph_num_nodes(g);
+
+  if (graph_is_directed(g)) goto fail;
+
+  ctx.g     = g;
+  ctx.clust = calloc(nnodes > 0 ? nnodes : 1, sizeof(double));
+
+  if (ctx.clust == NULL) goto fail;
+
+  /*
+   * weights are normalised by the largest absolute
+   * weight; if there are no weights (or no edges),
+   * every edge has a weight of 1
+   */
+  graph_weight_range(g, &lo, &hi);
+
+  if (lo > hi) ctx.maxwt = 1;
+  else         ctx.maxwt = (fabs(lo) > fabs(hi)) ? fabs(lo) : fabs(hi);
+
+  /*if every weight is 0, so is every coefficient*/
+  if (ctx.maxwt > 0 &&
+      parallel_for(nthreads, nnodes, WCLUSTERING_CHUNK, &ctx, _wclustering))
+    goto fail;
+
+  stats_cache_add(g,
+                  STATS_CACHE_NODE_WCLUSTERING,
+                  STATS_CACHE_TYPE_NODE,
+                  sizeof(double));
+
+  for (i = 0; i < nnodes; i++)
+    stats_cache_update(g, STATS_CACHE_NODE_WCLUSTERING, i, -1, ctx.clust+i);
+
+  if (clust != NULL) {
+    for (i = 0; i < nnodes; i++) clust[i] = ctx.clust[i];
+  }
+
+  free(ctx.clust);
+  return 0;
+
+fail:
+  if (ctx.clust != NULL) free(ctx.clust);
+  return 1;
+}
+
+uint8_t _wclustering(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t           i;
+  wclustering_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++)
+    ctx->clust[i] = _node_wclustering(ctx->g, i, ctx->maxwt);
+
+  return 0;
+}
+
+double _node_wclustering(graph_t *g, uint32_t n, double maxwt) {
+
+  uint64_t  p;
+  uint64_t  x;
+  uint64_t  y;
+  uint32_t  j;
+  uint32_t  na;
+  uint32_t  nb;
+  uint32_t *a;
+  uint32_t *b;
+  float    *wa;
+  float    *wb;
+  double    sum;
+  double    prod;
+
+  na = graph_num_neighbours(g, n);
+  a  = graph_get_neighbours(g, n);
+  wa = graph_get_weights(   g, n);
+
+  if (na < 2) return 0;
+
+  sum = 0;
+
+  /*
+   * each triangle (n, j, h), with j before h in the
+   * neighbour list of n, is found by merging the
+   * neighbours of n which come after j with the
+   * neighbours of j
+   */
+  for (p = 0; p < na; p++) {
+
+    j  = a[p];
+    nb = graph_num_neighbours(g, j);
+    b  = graph_get_neighbours(g, j);
+    wb = graph_get_weights(   g, j);
+    x  = p + 1;
+    y  = 0;
+
+    if (j == n) continue;
+
+    while (x < na && y < nb) {
+
+      if      (a[x] < b[y]) x++;
+      else if (a[x] > b[y]) y++;
+      else {
+
+        if (a[x] != n) {
+
+          if (wa == NULL || wb == NULL) prod = 1;
+          else prod = (wa[p] / maxwt) * (wa[x] / maxwt) * (wb[y] / maxwt);
+
+          sum += cbrt(prod);
+        }
+        x++;
+        y++;
+      }
+    }
+  }
+
+  return 2 * sum / ((double)na * (na - 1));
+}
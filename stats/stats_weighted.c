@@ -0,0 +1,385 @@
+/**
+ * Weighted path measures - Brandes' algorithm, with the breadth first
+ * searches replaced by Dijkstra's algorithm (see graph/dijkstra.h), and the
+ * path length, global efficiency and betweenness measures derived from it.
+ *
+ *   Brandes U 2001. A faster algorithm for betweenness centrality.
+ *   Journal of Mathematical Sociology 25(2):163-177
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "graph/graph.h"
+#include "graph/dijkstra.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "stats/stats.h"
+
+/**
+ * Number of blocks that the sources are split into, as in stats_brandes.c.
+ */
+#define WEIGHTED_BLOCKS 256
+
+/**
+ * Workspace for one block of sources in a wave, as in stats_brandes.c.
+ */
+typedef struct _weighted_ws {
+
+  dijkstra_t search;  /**< search buffers                              */
+  double    *delta;   /**< dependency of the source on each node       */
+  double    *nodeacc; /**< node betweenness accumulator (may be NULL)  */
+
+} weighted_ws_t;
+
+/**
+ * Context shared between all threads.
+ */
+typedef struct _weighted_ctx {
+
+  graph_t       *g;
+  uint32_t      *sources;  /**< source nodes, or NULL for all nodes */
+  uint32_t       nsources; /**< number of sources                   */
+  uint32_t       nblocks;  /**< number of blocks                    */
+  uint32_t       wave;     /**< first block of the current wave     */
+  weighted_ws_t *ws;       /**< one workspace per block in a wave   */
+  stats_paths_t *paths;    /**< per-source path measures, or NULL   */
+
+} weighted_ctx_t;
+
+/**
+ * parallel_for function - runs the searches for blocks [start, end) of
+ * the current wave; block wave+b is searched with workspace b.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _weighted_blocks(
+  uint64_t start,  /**< first block                 */
+  uint64_t end,    /**< one past the last block     */
+  uint16_t thread, /**< calling thread              */
+  void    *vctx    /**< pointer to a weighted_ctx_t */
+);
+
+/**
+ * Runs a single search from the given source, adding its contribution to
+ * the accumulators in the given workspace.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _weighted_source(
+  weighted_ctx_t *ctx, /**< shared context          */
+  weighted_ws_t  *ws,  /**< workspace for the block */
+  uint32_t        s    /**< the source              */
+);
+
+uint8_t stats_weighted_brandes(
+  graph_t          *g,
+  uint32_t         *sources,
+  uint32_t          nsources,
+  uint16_t          nthreads,
+  dijkstra_length_t length,
+  double           *nodebetw,
+  stats_paths_t    *paths) {
+
+  uint64_t        i;
+  uint64_t        b;
+  uint32_t        nnodes;
+  uint32_t        nws;
+  uint32_t        nwave;
+  weighted_ctx_t  ctx;
+  weighted_ws_t  *ws;
+
+  PROFILE_FUNC();
+
+  memset(&ctx, 0, sizeof(weighted_ctx_t));
+
+  nws    = 0;
+  nnodes = graph_num_nodes(g);
+
+  if (sources == NULL) nsources = nnodes;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads >  nsources)             nthreads = nsources;
+  if (nthreads == 0)                    nthreads = 1;
+
+  ctx.g        = g;
+  ctx.sources  = sources;
+  ctx.nsources = nsources;
+  ctx.nblocks  = nsources < WEIGHTED_BLOCKS ? nsources : WEIGHTED_BLOCKS;
+  ctx.paths    = paths;
+
+  if (ctx.nblocks == 0) ctx.nblocks = 1;
+
+  nws = nthreads < ctx.nblocks ? nthreads : ctx.nblocks;
+
+  ctx.ws = calloc(nws, sizeof(weighted_ws_t));
+  if (ctx.ws == NULL) goto fail;
+
+  for (b = 0; b < nws; b++) {
+
+    ws = ctx.ws + b;
+
+    if (dijkstra_create(&(ws->search), g, length)) goto fail;
+
+    ws->delta = calloc(nnodes > 0 ? nnodes : 1, sizeof(double));
+    if (ws->delta == NULL) goto fail;
+
+    if (nodebetw != NULL) {
+      ws->nodeacc = calloc(nnodes > 0 ? nnodes : 1, sizeof(double));
+      if (ws->nodeacc == NULL) goto fail;
+    }
+  }
+
+  if (nodebetw != NULL) memset(nodebetw, 0, nnodes * sizeof(double));
+
+  for (ctx.wave = 0; ctx.wave < ctx.nblocks; ctx.wave += nwave) {
+
+    nwave = ctx.nblocks - ctx.wave;
+    if (nwave > nws) nwave = nws;
+
+    if (parallel_for(nthreads, nwave, 1, &ctx, _weighted_blocks))
+      goto fail;
+
+    /*results are added together in block order, as in stats_brandes*/
+    if (nodebetw == NULL) continue;
+
+    for (b = 0; b < nwave; b++) {
+
+      ws = ctx.ws + b;
+
+      for (i = 0; i < nnodes; i++) nodebetw[i] += ws->nodeacc[i];
+      memset(ws->nodeacc, 0, nnodes * sizeof(double));
+    }
+  }
+
+  for (b = 0; b < nws; b++) {
+    ws = ctx.ws + b;
+    dijkstra_free(&(ws->search));
+    free(ws->delta);
+    if (ws->nodeacc != NULL) free(ws->nodeacc);
+  }
+  free(ctx.ws);
+
+  return 0;
+
+fail:
+  if (ctx.ws != NULL) {
+    for (b = 0; b < nws; b++) {
+      ws = ctx.ws + b;
+      dijkstra_free(&(ws->search));
+      if (ws->delta   != NULL) free(ws->delta);
+      if (ws->nodeacc != NULL) free(ws->nodeacc);
+    }
+    free(ctx.ws);
+  }
+  return 1;
+}
+
+double stats_weighted_pathlength(graph_t *g, dijkstra_length_t length) {
+
+  uint64_t      i;
+  uint32_t      nnodes;
+  double        pathlength;
+  stats_paths_t paths;
+
+  nnodes = graph_num_nodes(g);
+  memset(&paths, 0, sizeof(stats_paths_t));
+
+  if (nnodes == 0) return 0;
+
+  paths.pathlength = malloc(nnodes * sizeof(double));
+  if (paths.pathlength == NULL) goto fail;
+
+  if (stats_weighted_brandes(g, NULL, 0, 0, length, NULL, &paths))
+    goto fail;
+
+  pathlength = 0;
+  for (i = 0; i < nnodes; i++) pathlength += paths.pathlength[i];
+
+  free(paths.pathlength);
+
+  return pathlength / nnodes;
+
+fail:
+  if (paths.pathlength != NULL) free(paths.pathlength);
+  return -1;
+}
+
+double stats_weighted_efficiency(graph_t *g, dijkstra_length_t length) {
+
+  uint64_t      i;
+  uint32_t      nnodes;
+  double        invsum;
+  stats_paths_t paths;
+
+  nnodes = graph_num_nodes(g);
+  memset(&paths, 0, sizeof(stats_paths_t));
+
+  if (nnodes < 2) return 0;
+
+  paths.invdist = malloc(nnodes * sizeof(double));
+  if (paths.invdist == NULL) goto fail;
+
+  if (stats_weighted_brandes(g, NULL, 0, 0, length, NULL, &paths))
+    goto fail;
+
+  invsum = 0;
+  for (i = 0; i < nnodes; i++) invsum += paths.invdist[i];
+
+  free(paths.invdist);
+
+  return invsum / ((double)nnodes * (nnodes-1));
+
+fail:
+  if (paths.invdist != NULL) free(paths.invdist);
+  return -1;
+}
+
+uint8_t stats_weighted_betweenness(
+  graph_t          *g,
+  dijkstra_length_t length,
+  uint16_t          nthreads,
+  double           *betw) {
+
+  uint64_t i;
+  uint32_t nnodes;
+
+  nnodes = graph_num_nodes(g);
+
+  if (stats_weighted_brandes(g, NULL, 0, nthreads, length, betw, NULL))
+    goto fail;
+
+  for (i = 0; i < nnodes; i++) {
+    if (nnodes > 2) betw[i] /= ((nnodes-1.0)*(nnodes-2.0));
+    else            betw[i]  = 0;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _weighted_blocks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t        b;
+  uint64_t        i;
+  uint64_t        blk;
+  uint64_t        first;
+  uint64_t        last;
+  uint32_t        s;
+  weighted_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (b = start; b < end; b++) {
+
+    blk   = ctx->wave + b;
+    first = (blk     * ctx->nsources) / ctx->nblocks;
+    last  = ((blk+1) * ctx->nsources) / ctx->nblocks;
+
+    for (i = first; i < last; i++) {
+
+      if (ctx->sources != NULL) s = ctx->sources[i];
+      else                      s = i;
+
+      if (_weighted_source(ctx, ctx->ws + b, s)) goto fail;
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _weighted_source(
+  weighted_ctx_t *ctx, weighted_ws_t *ws, uint32_t s) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint32_t    u;
+  uint32_t    v;
+  uint32_t    nnbrs;
+  uint32_t   *nbrs;
+  float      *wts;
+  double      len;
+  double      c;
+  double      tally;
+  double      invdist;
+  double      numpaths;
+  dijkstra_t *d;
+
+  d = &(ws->search);
+
+  if (dijkstra_search(d, s)) goto fail;
+
+  if (ctx->paths != NULL) {
+
+    tally    = 0;
+    invdist  = 0;
+    numpaths = 0;
+
+    for (i = 1; i < d->norder; i++) {
+
+      u         = d->order[i];
+      tally    += d->dist[u];
+      invdist  += 1.0 / d->dist[u];
+      numpaths += d->sigma[u];
+    }
+
+    if (ctx->paths->pathlength != NULL) {
+      if (d->norder == 1) ctx->paths->pathlength[s] = 0;
+      else                ctx->paths->pathlength[s] = tally / (d->norder-1);
+    }
+
+    if (ctx->paths->invdist  != NULL) ctx->paths->invdist [s] = invdist;
+    if (ctx->paths->numpaths != NULL) ctx->paths->numpaths[s] = numpaths;
+  }
+
+  if (ws->nodeacc == NULL) return 0;
+
+  /*
+   * Accumulate dependencies, from the furthest nodes back
+   * to the source. The successors of a node on shortest
+   * paths are those neighbours whose distance is exactly
+   * that of the node plus the edge length, summed in the
+   * same way as by the search.
+   */
+  for (i = d->norder; i > 0; i--) {
+
+    u     = d->order[i-1];
+    nnbrs = graph_num_neighbours(ctx->g, u);
+    nbrs  = graph_get_neighbours(ctx->g, u);
+    wts   = graph_get_weights(   ctx->g, u);
+    tally = 0;
+
+    for (j = 0; j < nnbrs; j++) {
+
+      v   = nbrs[j];
+      len = dijkstra_edge_length(d->length, wts[j]);
+
+      if (len < 0)                        continue;
+      if (d->dist[u] + len != d->dist[v]) continue;
+
+      c      = (1 + ws->delta[v]) * (d->sigma[u] / d->sigma[v]);
+      tally += c;
+    }
+
+    ws->delta[u] = tally;
+
+    if (u != s) ws->nodeacc[u] += tally;
+  }
+
+  for (i = 0; i < d->norder; i++) ws->delta[d->order[i]] = 0;
+
+  return 0;
+
+fail:
+  return 1;
+}
@@ -1,6 +1,6 @@
 /**
  * Functions for reading a collection of 3D ANALYZE75 images, or a single 4D
- * image.
+ * ANALYZE75 or NIFTI-1 image.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -13,18 +13,38 @@
 #include <sys/stat.h>
 
 #include "io/analyze75.h"
+#include "io/nifti1.h"
 #include "util/suffix.h"
+#include "util/bigmem.h"
+#include "util/memacct.h"
 #include "util/compare.h"
+#include "util/ioqueue.h"
 #include "timeseries/analyze_volume.h"
 
 /**
- * Converts a 4D ANALYZE75 image to an analyze_volume_t struct.
+ * Opens the volume in the specified path. If lo and hi are not NULL, only
+ * the voxels within the bounding box they describe are read (see
+ * analyze_open_volume_roi).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _open_volume(
+  char             *path, /**< file/directory containing volume image(s) */
+  analyze_volume_t *vol,  /**< volume to be populated                    */
+  uint32_t         *lo,   /**< lower corner of box, or NULL              */
+  uint32_t         *hi    /**< upper corner of box, or NULL              */
+);
+
+/**
+ * Converts a 4D ANALYZE75 or NIFTI-1 image to an analyze_volume_t struct.
  *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _4d_to_volume(
   char             *imgfile, /**< 4D image file name           */
-  analyze_volume_t *vol      /**< empty volume to be populated */
+  analyze_volume_t *vol,     /**< empty volume to be populated */
+  uint32_t         *lo,      /**< lower corner of box, or NULL */
+  uint32_t         *hi       /**< upper corner of box, or NULL */
 );
 
 /**
@@ -36,7 +56,39 @@ static uint8_t _4d_to_volume(
 static uint8_t _3d_to_volume(
   char            **imgfiles, /**< list of image file names     */
   uint16_t          nfiles,   /**< number of files              */
-  analyze_volume_t *vol       /**< empty volume to be populated */
+  analyze_volume_t *vol,      /**< empty volume to be populated */
+  uint32_t         *lo,       /**< lower corner of box, or NULL */
+  uint32_t         *hi        /**< upper corner of box, or NULL */
+);
+
+/**
+ * Context for _load_image.
+ */
+typedef struct _load_ctx {
+
+  analyze_volume_t *vol; /**< volume being populated       */
+  uint32_t         *lo;  /**< lower corner of box, or NULL */
+  uint32_t         *hi;  /**< upper corner of box, or NULL */
+
+} load_ctx_t;
+
+/**
+ * ioqueue_run function used by _3d_to_volume, which maps or reads one
+ * image of a volume, according to how the first image was opened.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _load_image(
+  uint64_t i,  /**< image index, after the first mapped image */
+  void    *ctx /**< pointer to a load_ctx_t                  */
+);
+
+/**
+ * Frees the time series cache of the given volume, if it has one, and
+ * releases the bytes accounted to it (see util/memacct.h).
+ */
+static void _free_cache(
+  analyze_volume_t *vol /**< the volume */
 );
 
 /**
@@ -74,6 +126,18 @@ static int _cmp_filenames(
 
 uint8_t analyze_open_volume(char *path, analyze_volume_t *vol) {
 
+  return _open_volume(path, vol, NULL, NULL);
+}
+
+uint8_t analyze_open_volume_roi(
+  char *path, analyze_volume_t *vol, uint32_t *lo, uint32_t *hi) {
+
+  return _open_volume(path, vol, lo, hi);
+}
+
+uint8_t _open_volume(
+  char *path, analyze_volume_t *vol, uint32_t *lo, uint32_t *hi) {
+
   uint32_t i;
   char   **files;
   int32_t  nfiles;
@@ -87,12 +151,12 @@ uint8_t analyze_open_volume(char *path, analyze_volume_t *vol) {
 
   if (nfiles == 1) {
     
-    if (_4d_to_volume(files[0], vol)) goto fail;
+    if (_4d_to_volume(files[0], vol, lo, hi)) goto fail;
     free(files[0]);
     free(files);
   }
   else {
-    if (_3d_to_volume(files, nfiles, vol)) goto fail;
+    if (_3d_to_volume(files, nfiles, vol, lo, hi)) goto fail;
   }
 
   return 0;
@@ -108,21 +172,48 @@ fail:
   return 1;
 }
 
+void _free_cache(analyze_volume_t *vol) {
+
+  memacct_free(
+    MEMACCT_TSCACHE, (uint64_t)vol->ncached*vol->nimgs*sizeof(double));
+
+  if (vol->cacheidx != NULL) free(vol->cacheidx);
+  bigmem_free(vol->tscache);
+  vol->cacheidx = NULL;
+  vol->tscache  = NULL;
+  vol->ncached  = 0;
+}
+
 void analyze_free_volume(analyze_volume_t *vol) {
 
   uint32_t i;
 
   if (vol        == NULL) return;
+
+  _free_cache(vol);
+
   if (vol->hdrs  == NULL) return;
   if (vol->imgs  == NULL) return;
   if (vol->files == NULL) return;
   if (vol->nimgs == 0)    return;
 
   for (i = 0; i < vol->nimgs; i++) {
-    free(vol->imgs[i]);
+
+    if      (vol->map != NULL) ;
+    else if (vol->buf != NULL) ;
+    else if (vol->mapped)      analyze_unmap(vol->hdrs+i, vol->imgs[i]);
+    else                       free(vol->imgs[i]);
     free(vol->files[i]);
   }
 
+  if (vol->map != NULL) analyze_unmap(&(vol->maphdr), vol->map);
+  if (vol->buf != NULL) {
+    memacct_free(MEMACCT_VOLUME, (uint64_t)vol->nimgs *
+                                 analyze_num_vals(vol->hdrs) *
+                                 analyze_value_size(vol->hdrs));
+    free(vol->buf);
+  }
+
   free(vol->hdrs);
   free(vol->imgs);
   free(vol->files);
@@ -151,10 +242,100 @@ uint8_t analyze_read_timeseries(
   return 0;
 }
 
+uint8_t analyze_cache_volume(
+  analyze_volume_t *vol, uint32_t *idxs, uint32_t nidxs) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t t;
+  uint64_t blkend;
+  uint32_t nvals;
+  uint32_t vidx;
+  double  *ts;
+
+  _free_cache(vol);
+
+  nvals = analyze_num_vals(vol->hdrs);
+  if (idxs == NULL) nidxs = nvals;
+
+  vol->cacheidx = malloc(nvals*sizeof(uint32_t));
+  if (vol->cacheidx == NULL) goto fail;
+  
+  vol->tscache = bigmem_alloc((uint64_t)nidxs*vol->nimgs*sizeof(double));
+  if (vol->tscache == NULL && nidxs > 0) goto fail;
+
+  /*
+   * ncached is set now, rather than once the cache
+   * has been filled, so that _free_cache releases
+   * the accounted bytes if we fail below
+   */
+  vol->ncached = nidxs;
+  memacct_alloc(MEMACCT_TSCACHE, (uint64_t)nidxs*vol->nimgs*sizeof(double));
+
+  memset(vol->cacheidx, 0xFF, nvals*sizeof(uint32_t));
+
+  for (i = 0; i < nidxs; i++) {
+
+    vidx = (idxs == NULL) ? i : idxs[i];
+    if (vidx >= nvals) goto fail;
+
+    vol->cacheidx[vidx] = i;
+  }
+
+  /*
+   * The volume is transposed in blocks of voxels,
+   * so that the cache writes for each block stay
+   * within a small region of memory, while each
+   * image is still read in ascending order.
+   */
+  for (i = 0; i < nidxs; i += 256) {
+
+    blkend = (i + 256 > nidxs) ? nidxs : i + 256;
+
+    for (t = 0; t < vol->nimgs; t++) {
+      for (j = i; j < blkend; j++) {
+
+        vidx = (idxs == NULL) ? j : idxs[j];
+        ts   = vol->tscache + j*vol->nimgs;
+
+        ts[t] = analyze_read_by_idx(vol->hdrs+t, vol->imgs[t], vidx);
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  _free_cache(vol);
+  return 1;
+}
+
+double * analyze_get_timeseries(analyze_volume_t *vol, uint32_t idx) {
+
+  uint32_t cidx;
+
+  if (vol->ncached == 0)                   return NULL;
+  if (idx >= analyze_num_vals(vol->hdrs))  return NULL;
+
+  cidx = vol->cacheidx[idx];
+
+  if (cidx == ANALYZE_VOLUME_NOT_CACHED) return NULL;
+
+  return vol->tscache + (uint64_t)cidx*vol->nimgs;
+}
+
 uint8_t analyze_read_timeseries_by_idx(
   analyze_volume_t *vol, uint32_t idx, double *timeseries) {
 
   uint32_t dims[5];
+  double  *cached;
+
+  cached = analyze_get_timeseries(vol, idx);
+
+  if (cached != NULL) {
+    memcpy(timeseries, cached, vol->nimgs*sizeof(double));
+    return 0;
+  }
 
   analyze_get_indices(vol->hdrs, idx, dims);
 
@@ -296,7 +477,8 @@ fail:
 }
 
 
-uint8_t _4d_to_volume(char *imgfile, analyze_volume_t *vol) {
+uint8_t _4d_to_volume(
+  char *imgfile, analyze_volume_t *vol, uint32_t *lo, uint32_t *hi) {
 
   uint32_t i;
   uint32_t imgsz;
@@ -309,8 +491,31 @@ uint8_t _4d_to_volume(char *imgfile, analyze_volume_t *vol) {
   memset(vol,     0, sizeof(analyze_volume_t));
   memset(dimidxs, 0, sizeof(dimidxs));
 
-  if (analyze_load(imgfile, &volhdr, &volimg)) goto fail;
-  if (analyze_num_dims(&volhdr) != 4)          goto fail;
+  /*
+   * NIFTI-1 images are read straight into one
+   * buffer, as is the bounding box of an ANALYZE75
+   * image; otherwise ANALYZE75 images are mapped
+   * if possible, otherwise read in
+   */
+  if (nifti1_is_single_file(imgfile)) {
+    if (nifti1_load(imgfile, &volhdr, &volimg)) goto fail;
+    vol->buf = volimg;
+  }
+  else if (lo != NULL) {
+    if (analyze_load_part(imgfile, &volhdr, &volimg, lo, hi)) goto fail;
+    vol->buf = volimg;
+  }
+  else if (analyze_load_mmap(
+             imgfile, &volhdr, &volimg, ANALYZE_MAP_WILLNEED)) {
+    if (analyze_load(imgfile, &volhdr, &volimg)) goto fail;
+  }
+  else {
+    vol->mapped = 1;
+    vol->map    = volimg;
+    memcpy(&(vol->maphdr), &volhdr, sizeof(dsr_t));
+  }
+  
+  if (analyze_num_dims(&volhdr) != 4) goto fail;
 
   vol->nimgs = analyze_dim_size(&volhdr, 3);
 
@@ -333,8 +538,10 @@ uint8_t _4d_to_volume(char *imgfile, analyze_volume_t *vol) {
 
   for (i = 0; i < vol->nimgs; i++) {
 
-    vol->imgs[i] = malloc(imgsz);
-    if (vol->imgs[i] == NULL) goto fail;
+    if (!vol->mapped && vol->buf == NULL) {
+      vol->imgs[i] = malloc(imgsz);
+      if (vol->imgs[i] == NULL) goto fail;
+    }
 
     vol->files[i] = malloc(strlen(imgfile)+1);
     if (vol->files[i] == NULL) goto fail;
@@ -350,15 +557,24 @@ uint8_t _4d_to_volume(char *imgfile, analyze_volume_t *vol) {
     /*copy the portion of the volume at the current time step */
     dimidxs[3] = i;
     imgoff = analyze_get_offset(&volhdr, dimidxs);
-    memcpy(vol->imgs[i], volimg+imgoff, imgsz);
+
+    /*images point directly into the mapping or buffer*/
+    if (vol->mapped || vol->buf != NULL) vol->imgs[i] = volimg+imgoff;
+    else memcpy(vol->imgs[i], volimg+imgoff, imgsz);
   }
   
-  free(volimg);
+  if (!vol->mapped && vol->buf == NULL) free(volimg);
+
+  if (vol->buf != NULL)
+    memacct_alloc(MEMACCT_VOLUME, (uint64_t)vol->nimgs*imgsz);
   
   return 0;
 fail:
 
-  if (volimg != NULL) free(volimg);
+  if (volimg != NULL) {
+    if (vol->mapped) analyze_unmap(&volhdr, volimg);
+    else             free(volimg);
+  }
   
   if (vol->hdrs != NULL) free(vol->hdrs);
   
@@ -371,20 +587,26 @@ fail:
   }
 
   if (vol->imgs != NULL) {
-    for (i = 0; i < vol->nimgs; i++) {
+    for (i = 0; !vol->mapped && vol->buf == NULL && i < vol->nimgs; i++) {
       if (vol->imgs[i] != NULL)
         free(vol->imgs[i]);
     }
     free(vol->imgs);
   } 
 
+  memset(vol, 0, sizeof(analyze_volume_t));
   return 1;
 }
 
 uint8_t _3d_to_volume(
-  char **imgfiles, uint16_t nfiles, analyze_volume_t *vol) {
+  char            **imgfiles,
+  uint16_t          nfiles,
+  analyze_volume_t *vol,
+  uint32_t         *lo,
+  uint32_t         *hi) {
 
-  uint32_t i;
+  uint32_t   i;
+  load_ctx_t ctx;
 
   memset(vol, 0, sizeof(analyze_volume_t));  
 
@@ -396,10 +618,22 @@ uint8_t _3d_to_volume(
   vol->imgs = calloc(vol->nimgs, sizeof(uint8_t *));
   if (vol->imgs == NULL) goto fail;
 
-  for (i = 0; i < vol->nimgs; i++) {
-    if (analyze_load(vol->files[i], (vol->hdrs)+i, (vol->imgs)+i)) 
-      goto fail;
-  }
+  /*
+   * map the images if possible - if the first 
+   * image can't be mapped, read them all in. If
+   * a bounding box was given, only it is read.
+   */
+  if (lo == NULL)
+    vol->mapped = !analyze_load_mmap(
+      vol->files[0], vol->hdrs, vol->imgs, ANALYZE_MAP_WILLNEED);
+
+  /*the remaining images are opened concurrently*/
+  ctx.vol = vol;
+  ctx.lo  = lo;
+  ctx.hi  = hi;
+
+  if (ioqueue_run(vol->nimgs - vol->mapped, 0, &ctx, _load_image))
+    goto fail;
   
   if (analyze_hdr_compat(vol->nimgs, vol->hdrs, 0)) goto fail;
   if (analyze_num_dims(&(vol->hdrs[0])) != 3)       goto fail;
@@ -408,13 +642,36 @@ uint8_t _3d_to_volume(
 
 fail:
 
-  if (vol->hdrs != NULL) free(vol->hdrs);
   if (vol->imgs != NULL) {
     for (i = 0; i < vol->nimgs; i++) {
-      if (vol->imgs[i] != NULL)
-        free(vol->imgs[i]);
+      if (vol->imgs[i] == NULL) continue;
+      if (vol->mapped) analyze_unmap(vol->hdrs+i, vol->imgs[i]);
+      else             free(vol->imgs[i]);
     }
     free(vol->imgs);
   }
+  if (vol->hdrs != NULL) free(vol->hdrs);
   return 1;  
 }
+
+uint8_t _load_image(uint64_t i, void *vctx) {
+
+  load_ctx_t       *ctx;
+  analyze_volume_t *vol;
+
+  ctx = vctx;
+  vol = ctx->vol;
+
+  /*the first image has already been mapped*/
+  i += vol->mapped;
+
+  if (ctx->lo != NULL)
+    return analyze_load_part(
+      vol->files[i], vol->hdrs+i, vol->imgs+i, ctx->lo, ctx->hi);
+
+  if (vol->mapped)
+    return analyze_load_mmap(
+      vol->files[i], vol->hdrs+i, vol->imgs+i, ANALYZE_MAP_WILLNEED);
+
+  return analyze_load(vol->files[i], vol->hdrs+i, vol->imgs+i);
+}
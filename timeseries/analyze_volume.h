@@ -11,19 +11,52 @@
 
 #include "io/analyze75.h"
 
+/**
+ * Value stored in the analyze_volume_t.cacheidx array for voxels
+ * which are not in the time series cache.
+ */
+#define ANALYZE_VOLUME_NOT_CACHED 0xFFFFFFFF
+
 typedef struct __analyze_volume {
   
-  uint16_t  nimgs; /**< number of images in the volume */
-  char    **files; /**< image file names               */
-  dsr_t    *hdrs;  /**< image headers                  */
-  uint8_t **imgs;  /**< image data                     */
+  uint16_t  nimgs;    /**< number of images in the volume          */
+  char    **files;    /**< image file names                        */
+  dsr_t    *hdrs;     /**< image headers                           */
+  uint8_t **imgs;     /**< image data                              */
+  uint8_t   mapped;   /**< non-0 if the images were mapped into
+                           memory with analyze_load_mmap, rather
+                           than read in                           */
+  uint8_t  *map;      /**< if a 4D image was mapped, the mapping,
+                           into which imgs point; NULL otherwise   */
+  dsr_t     maphdr;   /**< header of the mapped 4D image           */
+  uint8_t  *buf;      /**< if a 4D image was read into a single
+                           buffer (e.g. a NIFTI-1 image), the
+                           buffer, into which imgs point; NULL
+                           otherwise                               */
+
+  uint32_t  ncached;  /**< number of voxels in the time series
+                           cache (0 if there is no cache)         */
+  uint32_t *cacheidx; /**< for every voxel, the index of its time
+                           series in the cache, or
+                           ANALYZE_VOLUME_NOT_CACHED               */
+  double   *tscache;  /**< voxel-major time series cache - ncached
+                           time series of length nimgs, stored
+                           contiguously                            */
   
 } analyze_volume_t;
 
 /**
  * Opens the volume in the specified path for reading. If the path is a
  * directory, it is assumed to contain a series of 3D ANALYZE75 image files.
- * If the path is a file, it is assumed to be a 4D ANALYZE75 image.
+ * If the path is a file, it is assumed to be a 4D ANALYZE75 image, or, if
+ * it has a .nii or .nii.gz suffix, a 4D single file NIFTI-1 image.
+ *
+ * Where possible, the images are mapped into memory (see
+ * analyze_load_mmap), so opening a volume is fast, and the image data is
+ * shared with other processes which are reading the same files. If the
+ * images cannot be mapped, they are read into memory instead. NIFTI-1
+ * images are always read in (see nifti1_load), being decompressed as they
+ * are read if necessary.
  *
  * \return 0 on success, non-0 on failure.
  */
@@ -33,6 +66,53 @@ uint8_t analyze_open_volume(
                                analyze_volume_t struct                   */
 );
 
+/**
+ * Opens the volume in the specified path for reading, like
+ * analyze_open_volume, but only reads the voxels which lie within the
+ * given bounding box - voxels (x,y,z) with lo[0] <= x < hi[0], lo[1] <= y
+ * < hi[1] and lo[2] <= z < hi[2] (see analyze_load_part). Voxels outside
+ * of the box must not be used - most of them read as 0. Single file
+ * NIFTI-1 images may be compressed, so are always read in full.
+ *
+ * \return 0 on success, non-0 on failure (including if the box does
+ * not lie within the volume).
+ */
+uint8_t analyze_open_volume_roi(
+  char             *path, /**< file/directory containing volume image(s) */
+  analyze_volume_t *vol,  /**< pointer to an uninitialised
+                               analyze_volume_t struct                   */
+  uint32_t         *lo,   /**< lower corner of box (inclusive, 3 values) */
+  uint32_t         *hi    /**< upper corner of box (exclusive, 3 values) */
+);
+
+/**
+ * Builds a voxel-major time series cache for the given voxels. The time
+ * series for each voxel is converted to double, and stored contiguously in
+ * vol->tscache, in the order in which the voxels are listed. Subsequent
+ * calls to analyze_get_timeseries and analyze_read_timeseries_by_idx for
+ * these voxels are served from the cache. If idxs is NULL, all voxels in the
+ * volume are cached. Any existing cache is discarded.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t analyze_cache_volume(
+  analyze_volume_t *vol,  /**< volume to cache                         */
+  uint32_t         *idxs, /**< indices of voxels to cache, or NULL     */
+  uint32_t          nidxs /**< number of voxel indices (ignored if
+                               idxs is NULL)                           */
+);
+
+/**
+ * \return a pointer to the cached time series for the given voxel, or NULL
+ * if the voxel is not in the time series cache. The pointer refers directly
+ * to the cache, so any changes made to the time series through it will be
+ * visible to subsequent calls.
+ */
+double * analyze_get_timeseries(
+  analyze_volume_t *vol, /**< volume to query */
+  uint32_t          idx  /**< voxel index     */
+);
+
 /**
  * Frees the memory used by the given volume.
  */
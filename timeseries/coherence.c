@@ -0,0 +1,470 @@
+/**
+ * Magnitude squared coherence between many time series, estimated with
+ * Welch's method, and averaged over a frequency band.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bigmem.h"
+#include "util/parallel.h"
+#include "timeseries/coherence.h"
+
+/**
+ * Number of columns in one tile of the coherence matrix. The spectra of
+ * the series in a tile are shared by every row of the block, so they
+ * should fit in cache.
+ */
+#define COHERENCE_TILE 16
+
+/**
+ * Number of series whose spectra are calculated by each call to
+ * _spectra_chunk.
+ */
+#define COHERENCE_CHUNK 64
+
+/**
+ * Context passed to _spectra_chunk.
+ */
+typedef struct _spectra_ctx {
+
+  coherence_t *coh;    /**< the struct being initialised      */
+  double      *series; /**< the time series                   */
+  uint32_t     len;    /**< time series length                */
+  uint32_t     step;   /**< offset between segments           */
+  double      *window; /**< Hann window, seglen values        */
+  double      *cs;     /**< cos(2*pi*k/nfft), for k < nfft/2  */
+  double      *sn;     /**< sin(2*pi*k/nfft), for k < nfft/2  */
+
+} spectra_ctx_t;
+
+/**
+ * Context passed to _block_tiles.
+ */
+typedef struct _block_ctx {
+
+  coherence_t *coh;   /**< the cached spectra       */
+  uint32_t     row;   /**< first row of the block   */
+  uint32_t     nrows; /**< number of rows in block  */
+  uint64_t     first; /**< first column tile        */
+  double      *out;   /**< block output             */
+
+} block_ctx_t;
+
+/**
+ * \return a pointer to the cached spectra of the given series.
+ */
+static double * _spectra(
+  coherence_t *coh, /**< the cached spectra */
+  uint64_t     i    /**< series index       */
+);
+
+/**
+ * In-place, iterative, radix-2 complex FFT.
+ */
+static void _fft(
+  double  *re, /**< real parts                       */
+  double  *im, /**< imaginary parts                  */
+  uint32_t n,  /**< length, a power of 2             */
+  double  *cs, /**< cosine table (see spectra_ctx_t) */
+  double  *sn  /**< sine table (see spectra_ctx_t)   */
+);
+
+/**
+ * parallel_for function which calculates, normalises and caches the
+ * spectra of a range of series.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _spectra_chunk(
+  uint64_t start,  /**< first series                */
+  uint64_t end,    /**< one past last series        */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to a spectra_ctx_t  */
+);
+
+/**
+ * parallel_for function which calculates a range of column tiles of a
+ * block of the coherence matrix.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _block_tiles(
+  uint64_t start,  /**< first tile (relative to ctx->first) */
+  uint64_t end,    /**< one past last tile                  */
+  uint16_t thread, /**< thread identifier                   */
+  void    *ctx     /**< pointer to a block_ctx_t            */
+);
+
+/**
+ * \return the mean coherence over the band between the given series.
+ */
+static double _pair(
+  coherence_t *coh, /**< the cached spectra           */
+  double      *x,   /**< spectra of the first series  */
+  double      *y,   /**< spectra of the second series */
+  double      *cr,  /**< workspace, nbins values      */
+  double      *ci   /**< workspace, nbins values      */
+);
+
+uint8_t coherence_init(
+  coherence_t *coh,
+  double      *series,
+  uint32_t     len,
+  uint32_t     nseries,
+  uint32_t     seglen,
+  double       sampletime,
+  double       lofreq,
+  double       hifreq,
+  uint16_t     nthreads) {
+
+  uint64_t      i;
+  uint32_t      step;
+  int64_t       lobin;
+  int64_t       hibin;
+  double        scale;
+  spectra_ctx_t ctx;
+
+  memset(coh, 0, sizeof(coherence_t));
+  memset(&ctx, 0, sizeof(ctx));
+
+  if (seglen < 2 || seglen > len) goto fail;
+
+  step = seglen / 2;
+
+  coh->nseries = nseries;
+  coh->seglen  = seglen;
+  coh->nsegs   = (len - seglen) / step + 1;
+
+  /*a single segment would give a coherence of 1 everywhere*/
+  if (coh->nsegs < 2) goto fail;
+
+  for (coh->nfft = 1; coh->nfft < seglen; coh->nfft <<= 1);
+
+  /*bin k is at frequency k / (nfft * sampletime)*/
+  if (sampletime <= 0) sampletime = 1;
+
+  /*
+   * the band is clamped in floating point, as the
+   * limits may be infinite (e.g. the default upper
+   * limit), and can't be converted to an integer
+   */
+  scale = coh->nfft * sampletime;
+
+  if      (lofreq * scale <= 1)          lobin = 1;
+  else if (lofreq * scale >  coh->nfft)  lobin = coh->nfft;
+  else                                   lobin = ceil(lofreq * scale - 1e-9);
+
+  if      (hifreq * scale >= coh->nfft/2) hibin = coh->nfft/2;
+  else if (hifreq * scale <  0)           hibin = 0;
+  else                                    hibin = floor(hifreq * scale + 1e-9);
+
+  if (hibin < lobin) goto fail;
+
+  coh->lobin = lobin;
+  coh->nbins = hibin - lobin + 1;
+
+  coh->spectra = bigmem_alloc(
+    (uint64_t)nseries * 2 * coh->nsegs * coh->nbins * sizeof(double));
+  if (coh->spectra == NULL) goto fail;
+
+  ctx.window = malloc(seglen       * sizeof(double));
+  ctx.cs     = malloc(coh->nfft/2  * sizeof(double));
+  ctx.sn     = malloc(coh->nfft/2  * sizeof(double));
+
+  if (ctx.window == NULL || ctx.cs == NULL || ctx.sn == NULL) goto fail;
+
+  for (i = 0; i < seglen; i++)
+    ctx.window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / seglen);
+
+  for (i = 0; i < coh->nfft/2; i++) {
+    ctx.cs[i] = cos(2 * M_PI * i / coh->nfft);
+    ctx.sn[i] = sin(2 * M_PI * i / coh->nfft);
+  }
+
+  ctx.coh    = coh;
+  ctx.series = series;
+  ctx.len    = len;
+  ctx.step   = step;
+
+  if (parallel_for(
+        nthreads, nseries, COHERENCE_CHUNK, &ctx, _spectra_chunk))
+    goto fail;
+
+  free(ctx.window);
+  free(ctx.cs);
+  free(ctx.sn);
+
+  return 0;
+
+fail:
+  if (ctx.window != NULL) free(ctx.window);
+  if (ctx.cs     != NULL) free(ctx.cs);
+  if (ctx.sn     != NULL) free(ctx.sn);
+  coherence_free(coh);
+  return 1;
+}
+
+void coherence_free(coherence_t *coh) {
+
+  bigmem_free(coh->spectra);
+  memset(coh, 0, sizeof(coherence_t));
+}
+
+uint8_t coherence_block(
+  coherence_t *coh,
+  uint32_t     row,
+  uint32_t     nrows,
+  uint16_t     nthreads,
+  double      *out) {
+
+  block_ctx_t ctx;
+  uint64_t    last;
+
+  if (out == NULL)                goto fail;
+  if (row + nrows > coh->nseries) goto fail;
+  if (nrows == 0)                 return 0;
+
+  ctx.coh   = coh;
+  ctx.row   = row;
+  ctx.nrows = nrows;
+  ctx.out   = out;
+
+  /*only tiles which intersect with the upper triangle are calculated*/
+  ctx.first = row / COHERENCE_TILE;
+  last      = (coh->nseries + COHERENCE_TILE - 1) / COHERENCE_TILE;
+
+  if (parallel_for(nthreads, last - ctx.first, 1, &ctx, _block_tiles))
+    goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+double * _spectra(coherence_t *coh, uint64_t i) {
+
+  return coh->spectra + i * 2 * coh->nsegs * coh->nbins;
+}
+
+void _fft(double *re, double *im, uint32_t n, double *cs, double *sn) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t bit;
+  uint64_t half;
+  uint64_t stride;
+  uint64_t len;
+  double   t;
+  double   wr;
+  double   wi;
+  double   vr;
+  double   vi;
+
+  /*bit-reversal permutation*/
+  for (i = 1, j = 0; i < n; i++) {
+
+    for (bit = n >> 1; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+
+    if (i < j) {
+      t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+
+  for (len = 2; len <= n; len <<= 1) {
+
+    half   = len / 2;
+    stride = n / len;
+
+    for (i = 0; i < n; i += len) {
+      for (k = 0; k < half; k++) {
+
+        /*exp(-2*pi*i*k/len)*/
+        wr =  cs[k*stride];
+        wi = -sn[k*stride];
+
+        vr = re[i+k+half] * wr - im[i+k+half] * wi;
+        vi = re[i+k+half] * wi + im[i+k+half] * wr;
+
+        re[i+k+half] = re[i+k] - vr;
+        im[i+k+half] = im[i+k] - vi;
+        re[i+k]     += vr;
+        im[i+k]     += vi;
+      }
+    }
+  }
+}
+
+uint8_t _spectra_chunk(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       s;
+  uint64_t       t;
+  uint64_t       f;
+  uint32_t       nbins;
+  uint32_t       nsegs;
+  double        *re;
+  double        *im;
+  double        *x;
+  double        *sre;
+  double        *sim;
+  double         mean;
+  double         pwr;
+  spectra_ctx_t *ctx;
+  coherence_t   *coh;
+
+  ctx   = vctx;
+  coh   = ctx->coh;
+  nbins = coh->nbins;
+  nsegs = coh->nsegs;
+
+  re = malloc(2 * coh->nfft * sizeof(double));
+  if (re == NULL) goto fail;
+  im = re + coh->nfft;
+
+  for (i = start; i < end; i++) {
+
+    x   = ctx->series + i * ctx->len;
+    sre = _spectra(coh, i);
+    sim = sre + (uint64_t)nsegs * nbins;
+
+    for (s = 0; s < nsegs; s++) {
+
+      mean = 0;
+      for (t = 0; t < coh->seglen; t++) mean += x[s*ctx->step + t];
+      mean /= coh->seglen;
+
+      memset(re, 0, 2 * coh->nfft * sizeof(double));
+
+      for (t = 0; t < coh->seglen; t++)
+        re[t] = (x[s*ctx->step + t] - mean) * ctx->window[t];
+
+      _fft(re, im, coh->nfft, ctx->cs, ctx->sn);
+
+      memcpy(sre + s*nbins, re + coh->lobin, nbins * sizeof(double));
+      memcpy(sim + s*nbins, im + coh->lobin, nbins * sizeof(double));
+    }
+
+    /*
+     * scale each bin by the total power at that frequency, so
+     * the coherence of a pair is just the squared magnitude of
+     * the sum of their cross-spectra
+     */
+    for (f = 0; f < nbins; f++) {
+
+      pwr = 0;
+      for (s = 0; s < nsegs; s++)
+        pwr += sre[s*nbins + f] * sre[s*nbins + f] +
+               sim[s*nbins + f] * sim[s*nbins + f];
+
+      pwr = (pwr > 0) ? 1.0 / sqrt(pwr) : 0;
+
+      for (s = 0; s < nsegs; s++) {
+        sre[s*nbins + f] *= pwr;
+        sim[s*nbins + f] *= pwr;
+      }
+    }
+  }
+
+  free(re);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _block_tiles(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t     tile;
+  uint64_t     r;
+  uint64_t     c;
+  uint64_t     c0;
+  uint64_t     c1;
+  uint64_t     n;
+  double      *cr;
+  double      *x;
+  block_ctx_t *ctx;
+  coherence_t *coh;
+
+  ctx = vctx;
+  coh = ctx->coh;
+  n   = coh->nseries;
+
+  cr = malloc(2 * coh->nbins * sizeof(double));
+  if (cr == NULL) goto fail;
+
+  for (tile = ctx->first + start; tile < ctx->first + end; tile++) {
+
+    c0 = tile * COHERENCE_TILE;
+    c1 = c0   + COHERENCE_TILE;
+    if (c1 > n) c1 = n;
+
+    for (r = ctx->row; r < ctx->row + ctx->nrows && r < c1; r++) {
+
+      x = _spectra(coh, r);
+
+      for (c = (c0 > r) ? c0 : r; c < c1; c++)
+        ctx->out[(r - ctx->row)*n + c] =
+          _pair(coh, x, _spectra(coh, c), cr, cr + coh->nbins);
+    }
+  }
+
+  free(cr);
+  return 0;
+
+fail:
+  return 1;
+}
+
+double _pair(coherence_t *coh, double *x, double *y, double *cr, double *ci) {
+
+  uint64_t s;
+  uint64_t f;
+  uint64_t nbins;
+  uint64_t off;
+  double  *xr;
+  double  *xi;
+  double  *yr;
+  double  *yi;
+  double   sum;
+
+  nbins = coh->nbins;
+  off   = (uint64_t)coh->nsegs * nbins;
+  xr    = x;
+  xi    = x + off;
+  yr    = y;
+  yi    = y + off;
+
+  memset(cr, 0, nbins * sizeof(double));
+  memset(ci, 0, nbins * sizeof(double));
+
+  /*the inner loops run over contiguous bins, so they vectorise*/
+  for (s = 0; s < coh->nsegs; s++) {
+    for (f = 0; f < nbins; f++) {
+      cr[f] += xr[s*nbins + f] * yr[s*nbins + f] +
+               xi[s*nbins + f] * yi[s*nbins + f];
+      ci[f] += xi[s*nbins + f] * yr[s*nbins + f] -
+               xr[s*nbins + f] * yi[s*nbins + f];
+    }
+  }
+
+  sum = 0;
+  for (f = 0; f < nbins; f++) sum += cr[f] * cr[f] + ci[f] * ci[f];
+
+  sum /= nbins;
+
+  /*rounding error can push the coherence of similar series over 1*/
+  if (sum > 1) sum = 1;
+
+  return sum;
+}
@@ -0,0 +1,90 @@
+/**
+ * Magnitude squared coherence between many time series, estimated with
+ * Welch's method, and averaged over a frequency band.
+ *
+ * Each time series is split into segments of a fixed length, which overlap
+ * by half. Every segment has its mean removed, is multiplied by a Hann
+ * window, zero-padded to a power of two, and transformed with an FFT. The
+ * spectra of every series are calculated once, by coherence_init, and
+ * cached - only the frequency bins within the band are kept. Each bin is
+ * scaled by the inverse square root of the power of the series at that
+ * frequency (summed over all segments), so the coherence between series x
+ * and y at frequency f is simply:
+ *
+ *   |sum_s X_s(f) conj(Y_s(f))|^2
+ *
+ * The coherence between many pairs of series can then be calculated, with
+ * coherence_block, without any further FFTs.
+ *
+ * The cache takes (2 * nsegs * nbins) doubles for each time series.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __COHERENCE_H__
+#define __COHERENCE_H__
+
+#include <stdint.h>
+
+typedef struct _coherence {
+
+  uint32_t nseries; /**< number of time series                          */
+  uint32_t seglen;  /**< segment length                                 */
+  uint32_t nfft;    /**< FFT length (seglen rounded up to a power of 2) */
+  uint32_t nsegs;   /**< number of segments                             */
+  uint32_t lobin;   /**< first frequency bin in the band                */
+  uint32_t nbins;   /**< number of frequency bins in the band           */
+  double  *spectra; /**< normalised spectra of each series - the real
+                         parts of all segments, followed by the
+                         imaginary parts, each segment being nbins long */
+
+} coherence_t;
+
+/**
+ * Calculates and caches the spectra of the given time series. The band is
+ * given in Hz if the sample time is positive, or otherwise in cycles per
+ * sample (in which case the highest frequency is 0.5). The zero frequency
+ * bin is never included, as the segments have their mean removed.
+ *
+ * \return 0 on success, non-0 on failure (including if the segment length
+ * is less than 2, the series are too short for two segments, or there are
+ * no frequency bins within the band).
+ */
+uint8_t coherence_init(
+  coherence_t *coh,        /**< the struct to initialise                */
+  double      *series,     /**< time series, stored contiguously, one
+                                after the other (they are not modified) */
+  uint32_t     len,        /**< length of each time series              */
+  uint32_t     nseries,    /**< number of time series                   */
+  uint32_t     seglen,     /**< segment length                          */
+  double       sampletime, /**< time between samples, in seconds        */
+  double       lofreq,     /**< lowest frequency in the band            */
+  double       hifreq,     /**< highest frequency in the band           */
+  uint16_t     nthreads    /**< number of threads to use (0 - default)  */
+);
+
+/**
+ * Frees the memory used by the given coherence_t.
+ */
+void coherence_free(
+  coherence_t *coh /**< the struct to free */
+);
+
+/**
+ * Calculates a block of rows from the upper triangle of the coherence
+ * matrix between the cached series, in the same layout as corr_block (see
+ * timeseries/correlation.h) - the mean coherence over the band between
+ * series (row+i) and series j, for j >= (row+i), is stored at
+ * out[i*nseries + j]. Frequencies at which either series has no power
+ * contribute 0 to the mean.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t coherence_block(
+  coherence_t *coh,      /**< the cached spectra                */
+  uint32_t     row,      /**< first row of the block            */
+  uint32_t     nrows,    /**< number of rows in the block       */
+  uint16_t     nthreads, /**< number of threads to use          */
+  double      *out       /**< place to store coherence values   */
+);
+
+#endif
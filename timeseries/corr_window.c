@@ -0,0 +1,319 @@
+/**
+ * Incremental calculation of the correlation matrices of many overlapping
+ * windows of the same set of time series.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bigmem.h"
+#include "util/parallel.h"
+#include "timeseries/corr_window.h"
+
+/**
+ * Number of rows of the cross-product sums which are updated by each
+ * call to _update_rows. Later rows are shorter, so a small chunk size
+ * keeps the threads evenly loaded.
+ */
+#define CORR_WINDOW_CHUNK 16
+
+/**
+ * A variance which is smaller than this fraction of the corresponding sum
+ * of squares is treated as zero, as it is probably just rounding error.
+ */
+#define CORR_WINDOW_EPS 1e-12
+
+/**
+ * Context passed to _update_rows - the time points in [oldstart, oldend)
+ * are removed from the sums, and those in [newstart, newend) are added.
+ */
+typedef struct _window_ctx {
+
+  corr_window_t *cw;       /**< the window struct           */
+  uint32_t       oldstart; /**< first time point to remove  */
+  uint32_t       oldend;   /**< one past last to remove     */
+  uint32_t       newstart; /**< first time point to add     */
+  uint32_t       newend;   /**< one past last to add        */
+
+} window_ctx_t;
+
+/**
+ * Recalculates all of the sums for the current window from scratch.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _resync(
+  corr_window_t *cw,      /**< the window struct         */
+  uint16_t       nthreads /**< number of threads to use  */
+);
+
+/**
+ * Removes/adds the given ranges of time points from/to the sums of each
+ * series, and the cross-product sums of every pair.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _update(
+  corr_window_t *cw,       /**< the window struct           */
+  uint32_t       oldstart, /**< first time point to remove  */
+  uint32_t       oldend,   /**< one past last to remove     */
+  uint32_t       newstart, /**< first time point to add     */
+  uint32_t       newend,   /**< one past last to add        */
+  uint16_t       nthreads  /**< number of threads to use    */
+);
+
+/**
+ * parallel_for function which updates the cross-product sums of a range
+ * of rows.
+ *
+ * \return 0.
+ */
+static uint8_t _update_rows(
+  uint64_t start,  /**< first row                 */
+  uint64_t end,    /**< one past last row         */
+  uint16_t thread, /**< thread identifier         */
+  void    *ctx     /**< pointer to a window_ctx_t */
+);
+
+uint8_t corr_window_init(
+  corr_window_t *cw,
+  double        *series,
+  uint32_t       len,
+  uint32_t       nseries,
+  uint32_t       window,
+  uint16_t       nthreads) {
+
+  uint64_t i;
+  uint64_t t;
+  double   mean;
+
+  memset(cw, 0, sizeof(corr_window_t));
+
+  if (window < 2 || window > len) goto fail;
+
+  cw->nseries = nseries;
+  cw->len     = len;
+  cw->window  = window;
+
+  cw->obs   = bigmem_alloc((uint64_t)len * nseries * sizeof(double));
+  cw->sums  = calloc(nseries, sizeof(double));
+  cw->sdev  = calloc(nseries, sizeof(double));
+  cw->cross = bigmem_alloc(
+    (uint64_t)nseries * (nseries + 1) / 2 * sizeof(double));
+
+  if (cw->obs == NULL || cw->sums == NULL || cw->sdev == NULL ||
+      cw->cross == NULL) goto fail;
+
+  for (i = 0; i < nseries; i++) {
+
+    mean = 0;
+    for (t = 0; t < len; t++) mean += series[i*len + t];
+    mean /= len;
+
+    for (t = 0; t < len; t++)
+      cw->obs[t*nseries + i] = series[i*len + t] - mean;
+  }
+
+  if (_resync(cw, nthreads)) goto fail;
+
+  return 0;
+
+fail:
+  corr_window_free(cw);
+  return 1;
+}
+
+void corr_window_free(corr_window_t *cw) {
+
+  bigmem_free(cw->obs);
+  bigmem_free(cw->cross);
+  if (cw->sums != NULL) free(cw->sums);
+  if (cw->sdev != NULL) free(cw->sdev);
+
+  memset(cw, 0, sizeof(corr_window_t));
+}
+
+uint8_t corr_window_slide(
+  corr_window_t *cw, uint32_t step, uint16_t nthreads) {
+
+  uint32_t start;
+
+  start = cw->start;
+
+  if ((uint64_t)start + step + cw->window > cw->len) return 1;
+
+  cw->start += step;
+  cw->nslides ++;
+
+  /*
+   * if the window has moved past all of its old
+   * points, updating is no cheaper than starting
+   * again, and recalculating is more accurate
+   */
+  if (step >= cw->window || cw->nslides >= CORR_WINDOW_RESYNC)
+    return _resync(cw, nthreads);
+
+  return _update(cw,
+                 start,
+                 start + step,
+                 start + cw->window,
+                 start + cw->window + step,
+                 nthreads);
+}
+
+double * corr_window_cross(corr_window_t *cw, uint32_t i) {
+
+  uint64_t n;
+
+  n = cw->nseries;
+
+  return cw->cross + (i * n - (uint64_t)i * (i - 1) / 2);
+}
+
+void corr_window_block(
+  corr_window_t *cw, uint32_t row, uint32_t nrows, double *out) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t n;
+  double   w;
+  double  *crow;
+  double  *sdev;
+  double   var;
+  double   cov;
+  double   r;
+
+  n = cw->nseries;
+  w = cw->window;
+
+  sdev = cw->sdev;
+
+  /*the standard deviation term of every series, 0 if there is none*/
+  for (j = row; j < n; j++) {
+
+    crow = corr_window_cross(cw, j);
+    var  = crow[0] - cw->sums[j] * cw->sums[j] / w;
+
+    if (var <= crow[0] * CORR_WINDOW_EPS) sdev[j] = 0;
+    else                                  sdev[j] = sqrt(var);
+  }
+
+  for (i = 0; i < nrows; i++) {
+
+    crow = corr_window_cross(cw, row + i) - (row + i);
+
+    for (j = row + i; j < n; j++) {
+
+      if (sdev[row + i] == 0 || sdev[j] == 0) {
+        out[i*n + j] = 0;
+        continue;
+      }
+
+      if (j == row + i) {
+        out[i*n + j] = 1;
+        continue;
+      }
+
+      cov = crow[j] - cw->sums[row + i] * cw->sums[j] / w;
+      r   = cov / (sdev[row + i] * sdev[j]);
+
+      if      (r >  1) r =  1;
+      else if (r < -1) r = -1;
+
+      out[i*n + j] = r;
+    }
+  }
+}
+
+uint8_t _resync(corr_window_t *cw, uint16_t nthreads) {
+
+  memset(cw->sums,  0, cw->nseries * sizeof(double));
+  memset(cw->cross, 0,
+         (uint64_t)cw->nseries * (cw->nseries + 1) / 2 * sizeof(double));
+
+  cw->nslides = 0;
+
+  return _update(cw, 0, 0, cw->start, cw->start + cw->window, nthreads);
+}
+
+uint8_t _update(
+  corr_window_t *cw,
+  uint32_t       oldstart,
+  uint32_t       oldend,
+  uint32_t       newstart,
+  uint32_t       newend,
+  uint16_t       nthreads) {
+
+  uint64_t     i;
+  uint64_t     t;
+  double      *x;
+  window_ctx_t ctx;
+
+  for (t = oldstart; t < oldend; t++) {
+    x = cw->obs + t*cw->nseries;
+    for (i = 0; i < cw->nseries; i++) cw->sums[i] -= x[i];
+  }
+
+  for (t = newstart; t < newend; t++) {
+    x = cw->obs + t*cw->nseries;
+    for (i = 0; i < cw->nseries; i++) cw->sums[i] += x[i];
+  }
+
+  ctx.cw       = cw;
+  ctx.oldstart = oldstart;
+  ctx.oldend   = oldend;
+  ctx.newstart = newstart;
+  ctx.newend   = newend;
+
+  return parallel_for(
+    nthreads, cw->nseries, CORR_WINDOW_CHUNK, &ctx, _update_rows);
+}
+
+uint8_t _update_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       t;
+  uint64_t       n;
+  double         a;
+  double        *x;
+  double        *crow;
+  window_ctx_t  *ctx;
+  corr_window_t *cw;
+
+  ctx = vctx;
+  cw  = ctx->cw;
+  n   = cw->nseries;
+
+  for (i = start; i < end; i++) {
+
+    crow = corr_window_cross(cw, i) - i;
+
+    for (t = ctx->oldstart; t < ctx->oldend; t++) {
+
+      x = cw->obs + t*n;
+      a = x[i];
+
+      if (a == 0) continue;
+
+      for (j = i; j < n; j++) crow[j] -= a * x[j];
+    }
+
+    for (t = ctx->newstart; t < ctx->newend; t++) {
+
+      x = cw->obs + t*n;
+      a = x[i];
+
+      if (a == 0) continue;
+
+      for (j = i; j < n; j++) crow[j] += a * x[j];
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * Incremental calculation of the correlation matrices of many overlapping
+ * windows of the same set of time series, for dynamic connectivity
+ * analyses.
+ *
+ * The sum of each time series over the current window, and the
+ * cross-product sums of every pair of time series (including each series
+ * with itself), are maintained as the window slides. When the window
+ * moves by some number of time points, the contribution of the points
+ * which leave the window is subtracted from every cross-product, and that
+ * of the points which enter it is added, so each slide costs
+ * O(nseries^2 * step), rather than the O(nseries^2 * window) needed to
+ * calculate the correlations from scratch. The correlation of any pair
+ * can then be calculated from the sums in constant time.
+ *
+ * The time series are centred on their overall mean before any sums are
+ * taken, which keeps the magnitude of the sums, and so the cancellation
+ * error in the variances and covariances, small. The sums are also
+ * recalculated from scratch every CORR_WINDOW_RESYNC slides, so that
+ * rounding errors do not accumulate over long runs.
+ *
+ * The cross-product sums take nseries*(nseries+1)/2 doubles of memory.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __CORR_WINDOW_H__
+#define __CORR_WINDOW_H__
+
+#include <stdint.h>
+
+/**
+ * Number of slides after which the sums are recalculated from scratch.
+ */
+#define CORR_WINDOW_RESYNC 32
+
+typedef struct _corr_window {
+
+  uint32_t nseries; /**< number of time series                        */
+  uint32_t len;     /**< length of the time series                    */
+  uint32_t window;  /**< window length                                */
+  uint32_t start;   /**< first time point in the current window       */
+  uint32_t nslides; /**< slides since the sums were last calculated   */
+  double  *obs;     /**< centred time series, time-major - the values
+                         of every series at time t are stored at
+                         obs[t*nseries]                               */
+  double  *sums;    /**< sum of each series over the window           */
+  double  *cross;   /**< cross-product sums, upper triangle, packed
+                         by row (see corr_window_cross)               */
+  double  *sdev;    /**< workspace for corr_window_block              */
+
+} corr_window_t;
+
+/**
+ * Initialises the given corr_window_t, and calculates the sums for the
+ * window starting at time point 0.
+ *
+ * \return 0 on success, non-0 on failure (including if the window is
+ * shorter than 2, or longer than the time series).
+ */
+uint8_t corr_window_init(
+  corr_window_t *cw,       /**< the window struct to initialise         */
+  double        *series,   /**< time series, stored contiguously, one
+                                after the other (they are not modified) */
+  uint32_t       len,      /**< length of each time series              */
+  uint32_t       nseries,  /**< number of time series                   */
+  uint32_t       window,   /**< window length                           */
+  uint16_t       nthreads  /**< number of threads to use (0 - default)  */
+);
+
+/**
+ * Frees the memory used by the given corr_window_t.
+ */
+void corr_window_free(
+  corr_window_t *cw /**< the window struct */
+);
+
+/**
+ * Moves the window forward by the given number of time points, updating
+ * the sums.
+ *
+ * \return 0 on success, non-0 on failure (including if the window would
+ * go past the end of the time series).
+ */
+uint8_t corr_window_slide(
+  corr_window_t *cw,      /**< the window struct                       */
+  uint32_t       step,    /**< number of time points to move by        */
+  uint16_t       nthreads /**< number of threads to use (0 - default)  */
+);
+
+/**
+ * \return a pointer to the cross-product sums of series i with series i,
+ * i+1, ..., nseries-1.
+ */
+double * corr_window_cross(
+  corr_window_t *cw, /**< the window struct */
+  uint32_t       i   /**< series index      */
+);
+
+/**
+ * Calculates a block of rows from the upper triangle of the correlation
+ * matrix of the current window, in the same layout as corr_block (see
+ * timeseries/correlation.h) - the correlation between series (row+i) and
+ * series j, for j >= (row+i), is stored at out[i*nseries + j]. A series
+ * with zero variance over the window has a correlation of 0 with every
+ * series, including itself; the self-correlation of any other series is
+ * 1.
+ */
+void corr_window_block(
+  corr_window_t *cw,    /**< the window struct                        */
+  uint32_t       row,   /**< first row of the block                   */
+  uint32_t       nrows, /**< number of rows in the block              */
+  double        *out    /**< place to store correlation values        */
+);
+
+#endif
@@ -1,15 +1,375 @@
 /**
  * Implementation of Pearson's correlation coefficient between two time
- * series.
+ * series, and a blocked, multi-threaded engine for calculating the
+ * correlation between many time series.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 
 #include <math.h>
+#include <float.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CORR_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define CORR_NEON_SIMD
+#include <arm_neon.h>
+#endif
+
+#include "util/parallel.h"
 #include "timeseries/correlation.h"
 
+/**
+ * Width/height of one tile of the correlation matrix.
+ */
+#define CORR_TILE 32
+
+/**
+ * Number of time points processed at a time within a tile,
+ * so the row and column series stay in cache.
+ */
+#define CORR_KBLOCK 256
+
+/**
+ * Number of rows/columns in the sub-blocks of a tile which are calculated
+ * in one go by a _kern function.
+ */
+#define CORR_KERN 4
+
+/**
+ * The quantised time series of a corr_screen_t are padded to a multiple
+ * of this many values, so the _qkern functions do not need to handle a
+ * remainder.
+ */
+#define CORR_SCREEN_ALIGN 32
+
+/**
+ * Context passed to _corr_tiles.
+ */
+typedef struct _corr_ctx {
+
+  double  *series;  /**< normalised time series      */
+  float   *fseries; /**< single precision normalised
+                         time series (used instead of
+                         series if not NULL)         */
+  uint32_t len;     /**< time series length          */
+  uint32_t nseries; /**< number of time series       */
+  uint32_t row;     /**< first row of block          */
+  uint32_t nrows;   /**< number of rows in block     */
+  double  *out;     /**< block output                */
+  corr_screen_t
+          *screen;  /**< screen to skip pairs which
+                         cannot pass a threshold, or
+                         NULL                        */
+
+} corr_ctx_t;
+
+/**
+ * Context passed to _cross_tiles.
+ */
+typedef struct _cross_ctx {
+
+  double  *rows;  /**< normalised row time series    */
+  uint32_t nrows; /**< number of row time series     */
+  double  *cols;  /**< normalised column time series */
+  uint32_t ncols; /**< number of column time series  */
+  uint32_t len;   /**< time series length            */
+  double  *out;   /**< output                        */
+
+} cross_ctx_t;
+
+/**
+ * Dot product implementation selected by _select_dot.
+ */
+static double (*_dot)(double *x, double *y, uint32_t len) = NULL;
+
+/**
+ * Sub-block implementation selected by _select_dot.
+ */
+static void (*_kern)(
+  double *x, double *y, uint32_t stride, uint32_t len, double *acc) = NULL;
+
+/**
+ * Single precision sub-block implementation selected by _select_dot.
+ */
+static void (*_kernf)(
+  float *x, float *y, uint32_t stride, uint32_t len, double *acc) = NULL;
+
+/**
+ * Quantised sub-block implementation selected by _select_dot.
+ */
+static void (*_qkern)(
+  int16_t *x, int16_t *y, uint32_t stride, uint32_t len, int32_t *acc) = NULL;
+
+/**
+ * Ensures that _select_dot is only called once.
+ */
+static pthread_once_t _dot_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Sets the _dot, _kern, _kernf and _qkern pointers, according to the instructions
+ * supported by the processor.
+ */
+static void _select_dot(void);
+
+/**
+ * Portable dot product, which the compiler may auto-vectorise.
+ */
+static double _dot_scalar(
+  double  *x,
+  double  *y,
+  uint32_t len
+);
+
+/**
+ * Calculates the dot products between CORR_KERN consecutive time series
+ * starting at x, and CORR_KERN consecutive time series starting at y, and
+ * adds them to the acc array, which is a CORR_KERN*CORR_TILE section of a
+ * tile - the product of x+i and y+j is added to acc[i*CORR_TILE + j].
+ * Every x series is multiplied with every y series, and vice versa, so
+ * each value that is loaded is used CORR_KERN times, rather than once, as
+ * it would be with separate calls to _dot. This is the same register
+ * blocking that is used in matrix multiplication (GEMM) routines.
+ */
+static void _kern_scalar(
+  double  *x,      /**< first row series                          */
+  double  *y,      /**< first column series                       */
+  uint32_t stride, /**< distance between consecutive series       */
+  uint32_t len,    /**< number of values to use from each series  */
+  double  *acc     /**< place to add the dot products             */
+);
+
+/**
+ * Single precision version of _kern_scalar. The products are summed in
+ * single precision, and the sums are added to acc (which is double
+ * precision). The kernels are called with at most CORR_KBLOCK values at a
+ * time, so no single precision sum has more than CORR_KBLOCK terms - the
+ * SIMD kernels split each sum across their vector lanes, so have even
+ * fewer.
+ */
+static void _kernf_scalar(
+  float   *x,      /**< first row series                          */
+  float   *y,      /**< first column series                       */
+  uint32_t stride, /**< distance between consecutive series       */
+  uint32_t len,    /**< number of values to use from each series  */
+  double  *acc     /**< place to add the dot products             */
+);
+
+/**
+ * Single precision dot product, used for the partial sub-blocks at the
+ * edge of the matrix. The products are summed in double precision.
+ */
+static double _dotf(
+  float   *x,
+  float   *y,
+  uint32_t len
+);
+
+/**
+ * Quantised version of _kern_scalar, used by corr_screen_t screens. The
+ * products are summed exactly, in 32 bit integers. The len must be a
+ * multiple of CORR_SCREEN_ALIGN.
+ */
+static void _qkern_scalar(
+  int16_t *x,      /**< first row series                          */
+  int16_t *y,      /**< first column series                       */
+  uint32_t stride, /**< distance between consecutive series       */
+  uint32_t len,    /**< number of values to use from each series  */
+  int32_t *acc     /**< place to add the dot products             */
+);
+
+#ifdef CORR_X86_SIMD
+/**
+ * AVX2/FMA dot product.
+ */
+static double _dot_avx2(
+  double  *x,
+  double  *y,
+  uint32_t len
+) __attribute__((target("avx2,fma")));
+
+/**
+ * AVX-512 dot product.
+ */
+static double _dot_avx512(
+  double  *x,
+  double  *y,
+  uint32_t len
+) __attribute__((target("avx512f")));
+
+/**
+ * AVX2/FMA sub-block - there are only 16 vector registers, so the
+ * sub-block is calculated as two halves.
+ */
+static void _kern_avx2(
+  double  *x,
+  double  *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+) __attribute__((target("avx2,fma")));
+
+/**
+ * AVX-512 sub-block.
+ */
+static void _kern_avx512(
+  double  *x,
+  double  *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+) __attribute__((target("avx512f")));
+
+/**
+ * Single precision AVX2/FMA sub-block.
+ */
+static void _kernf_avx2(
+  float   *x,
+  float   *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+) __attribute__((target("avx2,fma")));
+
+/**
+ * Single precision AVX-512 sub-block.
+ */
+static void _kernf_avx512(
+  float   *x,
+  float   *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+) __attribute__((target("avx512f")));
+
+/**
+ * Quantised AVX2 sub-block, calculated as two halves, like _kern_avx2.
+ */
+static void _qkern_avx2(
+  int16_t *x,
+  int16_t *y,
+  uint32_t stride,
+  uint32_t len,
+  int32_t *acc
+) __attribute__((target("avx2")));
+
+/**
+ * Quantised AVX-512 sub-block.
+ */
+static void _qkern_avx512(
+  int16_t *x,
+  int16_t *y,
+  uint32_t stride,
+  uint32_t len,
+  int32_t *acc
+) __attribute__((target("avx512f,avx512bw")));
+#endif
+
+#ifdef CORR_NEON_SIMD
+/**
+ * NEON dot product.
+ */
+static double _dot_neon(
+  double  *x,
+  double  *y,
+  uint32_t len
+);
+
+/**
+ * NEON sub-block.
+ */
+static void _kern_neon(
+  double  *x,
+  double  *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+);
+
+/**
+ * Single precision NEON sub-block.
+ */
+static void _kernf_neon(
+  float   *x,
+  float   *y,
+  uint32_t stride,
+  uint32_t len,
+  double  *acc
+);
+
+/**
+ * Quantised NEON sub-block.
+ */
+static void _qkern_neon(
+  int16_t *x,
+  int16_t *y,
+  uint32_t stride,
+  uint32_t len,
+  int32_t *acc
+);
+#endif
+
+/**
+ * parallel_for function, which calculates all of the tiles in the block for
+ * the given range of column tiles.
+ *
+ * \return 0.
+ */
+static uint8_t _corr_tiles(
+  uint64_t start,  /**< first column tile               */
+  uint64_t end,    /**< one past the last column tile   */
+  uint16_t thread, /**< thread identifier               */
+  void    *ctx     /**< pointer to a corr_ctx_t struct  */
+);
+
+/**
+ * parallel_for function, which calculates all of the tiles of a corr_cross
+ * call for the given range of column tiles.
+ *
+ * \return 0.
+ */
+static uint8_t _cross_tiles(
+  uint64_t start,  /**< first column tile               */
+  uint64_t end,    /**< one past the last column tile   */
+  uint16_t thread, /**< thread identifier               */
+  void    *ctx     /**< pointer to a cross_ctx_t struct */
+);
+
+/**
+ * Sub-function of corr_block and corr_block_float - calculates the block
+ * described by the given context.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _corr_block(
+  corr_ctx_t *ctx,     /**< block to calculate, with all fields set */
+  uint16_t    nthreads /**< number of threads to use                */
+);
+
+/**
+ * Sub-function of _corr_tiles - calculates the quantised dot products of
+ * the pairs in the given tile, on or above the diagonal, and works out
+ * which of them may pass the screen threshold. pass[i][j] is set for each
+ * pair (r0+i, c0+j) which may pass, and kpass[i][j] for each sub-block
+ * (r0+i*CORR_KERN, c0+j*CORR_KERN) which contains such a pair.
+ */
+static void _screen_tile(
+  corr_screen_t *scr,  /**< the screen                  */
+  uint64_t       r0,   /**< first row of the tile       */
+  uint64_t       r1,   /**< one past the last row       */
+  uint64_t       c0,   /**< first column of the tile    */
+  uint64_t       c1,   /**< one past the last column    */
+  uint8_t        pass[CORR_TILE][CORR_TILE],
+  uint8_t        kpass[CORR_TILE/CORR_KERN][CORR_TILE/CORR_KERN]
+);
+
 double pearson(double *x, double *y, uint32_t len) {
 
   double   sumx;
@@ -26,9 +386,9 @@ double pearson(double *x, double *y, uint32_t len) {
   sumxy = 0;
   sumx2 = 0;
   sumy2 = 0;
-  
+
   for (i = 0; i < len; i++) {
-    
+
     sumx  += x[i];
     sumy  += y[i];
     sumxy += x[i] * y[i];
@@ -41,6 +401,1219 @@ double pearson(double *x, double *y, uint32_t len) {
           sqrt((len * sumy2) - sumy*sumy);
 
   if (isnan(denom)) return 0.0;
-  
+
   return numer / denom;
 }
+
+void pearson_moments(double *x, uint32_t len, double *mean, double *sd) {
+
+  uint64_t i;
+  double   m;
+  double   ss;
+
+  m  = 0;
+  ss = 0;
+
+  if (len == 0) {
+    *mean = 0;
+    *sd   = 0;
+    return;
+  }
+
+  for (i = 0; i < len; i++) m += x[i];
+  m /= len;
+
+  for (i = 0; i < len; i++) ss += (x[i] - m) * (x[i] - m);
+
+  *mean = m;
+  *sd   = sqrt(ss / len);
+}
+
+double pearson_pre(
+  double  *x,
+  double  *y,
+  uint32_t len,
+  double   mx,
+  double   sx,
+  double   my,
+  double   sy) {
+
+  double r;
+
+  if (len == 0)           return 0.0;
+  if (sx <= 0 || sy <= 0) return 0.0;
+
+  r = (corr_dot(x, y, len) - len*mx*my) / (len*sx*sy);
+
+  if (r >  1.0) r =  1.0;
+  if (r < -1.0) r = -1.0;
+
+  return r;
+}
+
+double corr_dot(double *x, double *y, uint32_t len) {
+
+  pthread_once(&_dot_once, _select_dot);
+
+  return _dot(x, y, len);
+}
+
+void _select_dot(void) {
+
+  _dot   = _dot_scalar;
+  _kern  = _kern_scalar;
+  _kernf = _kernf_scalar;
+  _qkern = _qkern_scalar;
+
+#ifdef CORR_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512f")) {
+    _dot   = _dot_avx512;
+    _kern  = _kern_avx512;
+    _kernf = _kernf_avx512;
+  }
+  else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    _dot   = _dot_avx2;
+    _kern  = _kern_avx2;
+    _kernf = _kernf_avx2;
+  }
+
+  if      (__builtin_cpu_supports("avx512bw")) _qkern = _qkern_avx512;
+  else if (__builtin_cpu_supports("avx2"))     _qkern = _qkern_avx2;
+#endif
+
+#ifdef CORR_NEON_SIMD
+  _dot   = _dot_neon;
+  _kern  = _kern_neon;
+  _kernf = _kernf_neon;
+  _qkern = _qkern_neon;
+#endif
+}
+
+double _dot_scalar(double *x, double *y, uint32_t len) {
+
+  uint64_t i;
+  double   dot;
+
+  dot = 0;
+  for (i = 0; i < len; i++) dot += x[i] * y[i];
+
+  return dot;
+}
+
+void _kern_scalar(
+  double *x, double *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  double   sums[CORR_KERN][CORR_KERN];
+
+  memset(sums, 0, sizeof(sums));
+
+  for (k = 0; k < len; k++) {
+    for (i = 0; i < CORR_KERN; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+        sums[i][j] += x[i*stride + k] * y[j*stride + k];
+      }
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) acc[i*CORR_TILE + j] += sums[i][j];
+  }
+}
+
+void _kernf_scalar(
+  float *x, float *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  float    sums[CORR_KERN][CORR_KERN];
+
+  memset(sums, 0, sizeof(sums));
+
+  for (k = 0; k < len; k++) {
+    for (i = 0; i < CORR_KERN; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+        sums[i][j] += x[i*stride + k] * y[j*stride + k];
+      }
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) acc[i*CORR_TILE + j] += sums[i][j];
+  }
+}
+
+double _dotf(float *x, float *y, uint32_t len) {
+
+  uint64_t i;
+  double   dot;
+
+  dot = 0;
+  for (i = 0; i < len; i++) dot += (double)x[i] * y[i];
+
+  return dot;
+}
+
+void _qkern_scalar(
+  int16_t *x, int16_t *y, uint32_t stride, uint32_t len, int32_t *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  int32_t  sums[CORR_KERN][CORR_KERN];
+
+  memset(sums, 0, sizeof(sums));
+
+  for (k = 0; k < len; k++) {
+    for (i = 0; i < CORR_KERN; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+        sums[i][j] += (int32_t)x[i*stride + k] * y[j*stride + k];
+      }
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) acc[i*CORR_TILE + j] += sums[i][j];
+  }
+}
+
+#ifdef CORR_X86_SIMD
+double _dot_avx2(double *x, double *y, uint32_t len) {
+
+  uint64_t i;
+  double   dot;
+  double   tmp[4];
+  __m256d  acc0;
+  __m256d  acc1;
+
+  acc0 = _mm256_setzero_pd();
+  acc1 = _mm256_setzero_pd();
+
+  for (i = 0; i + 8 <= len; i += 8) {
+    acc0 = _mm256_fmadd_pd(
+      _mm256_loadu_pd(x+i),   _mm256_loadu_pd(y+i),   acc0);
+    acc1 = _mm256_fmadd_pd(
+      _mm256_loadu_pd(x+i+4), _mm256_loadu_pd(y+i+4), acc1);
+  }
+
+  _mm256_storeu_pd(tmp, _mm256_add_pd(acc0, acc1));
+  dot = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+
+  for (; i < len; i++) dot += x[i] * y[i];
+
+  return dot;
+}
+
+double _dot_avx512(double *x, double *y, uint32_t len) {
+
+  uint64_t i;
+  double   dot;
+  __m512d  acc0;
+  __m512d  acc1;
+
+  acc0 = _mm512_setzero_pd();
+  acc1 = _mm512_setzero_pd();
+
+  for (i = 0; i + 16 <= len; i += 16) {
+    acc0 = _mm512_fmadd_pd(
+      _mm512_loadu_pd(x+i),   _mm512_loadu_pd(y+i),   acc0);
+    acc1 = _mm512_fmadd_pd(
+      _mm512_loadu_pd(x+i+8), _mm512_loadu_pd(y+i+8), acc1);
+  }
+
+  dot = _mm512_reduce_add_pd(_mm512_add_pd(acc0, acc1));
+
+  for (; i < len; i++) dot += x[i] * y[i];
+
+  return dot;
+}
+
+void _kern_avx2(
+  double *x, double *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t h;
+  uint64_t t;
+  double   tmp[4];
+  double   sum;
+  __m256d  xv[2];
+  __m256d  yv[CORR_KERN];
+  __m256d  sums[2][CORR_KERN];
+
+  for (h = 0; h < CORR_KERN; h += 2) {
+
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm256_setzero_pd();
+    }
+
+    for (k = 0; k + 4 <= len; k += 4) {
+
+      for (j = 0; j < CORR_KERN; j++) yv[j] = _mm256_loadu_pd(y+j*stride+k);
+      for (i = 0; i < 2; i++) {
+
+        xv[i] = _mm256_loadu_pd(x + (h+i)*stride + k);
+
+        for (j = 0; j < CORR_KERN; j++)
+          sums[i][j] = _mm256_fmadd_pd(xv[i], yv[j], sums[i][j]);
+      }
+    }
+
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+
+        _mm256_storeu_pd(tmp, sums[i][j]);
+        sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+
+        for (t = k; t < len; t++)
+          sum += x[(h+i)*stride + t] * y[j*stride + t];
+
+        acc[(h+i)*CORR_TILE + j] += sum;
+      }
+    }
+  }
+}
+
+void _kern_avx512(
+  double *x, double *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t t;
+  double   sum;
+  __m512d  xv;
+  __m512d  yv[CORR_KERN];
+  __m512d  sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm512_setzero_pd();
+  }
+
+  for (k = 0; k + 8 <= len; k += 8) {
+
+    for (j = 0; j < CORR_KERN; j++) yv[j] = _mm512_loadu_pd(y+j*stride+k);
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = _mm512_loadu_pd(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++)
+        sums[i][j] = _mm512_fmadd_pd(xv, yv[j], sums[i][j]);
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) {
+
+      sum = _mm512_reduce_add_pd(sums[i][j]);
+
+      for (t = k; t < len; t++) sum += x[i*stride + t] * y[j*stride + t];
+
+      acc[i*CORR_TILE + j] += sum;
+    }
+  }
+}
+
+void _kernf_avx2(
+  float *x, float *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t h;
+  uint64_t t;
+  double   tmp[4];
+  double   sum;
+  __m256   xv[2];
+  __m256   yv[CORR_KERN];
+  __m256   sums[2][CORR_KERN];
+  __m256d  lanes;
+
+  for (h = 0; h < CORR_KERN; h += 2) {
+
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm256_setzero_ps();
+    }
+
+    for (k = 0; k + 8 <= len; k += 8) {
+
+      for (j = 0; j < CORR_KERN; j++) yv[j] = _mm256_loadu_ps(y+j*stride+k);
+      for (i = 0; i < 2; i++) {
+
+        xv[i] = _mm256_loadu_ps(x + (h+i)*stride + k);
+
+        for (j = 0; j < CORR_KERN; j++)
+          sums[i][j] = _mm256_fmadd_ps(xv[i], yv[j], sums[i][j]);
+      }
+    }
+
+    /*the lane sums are combined in double precision*/
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+
+        lanes = _mm256_add_pd(
+          _mm256_cvtps_pd(_mm256_castps256_ps128(sums[i][j])),
+          _mm256_cvtps_pd(_mm256_extractf128_ps(sums[i][j], 1)));
+
+        _mm256_storeu_pd(tmp, lanes);
+        sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+
+        for (t = k; t < len; t++)
+          sum += (double)x[(h+i)*stride + t] * y[j*stride + t];
+
+        acc[(h+i)*CORR_TILE + j] += sum;
+      }
+    }
+  }
+}
+
+void _kernf_avx512(
+  float *x, float *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t t;
+  double   sum;
+  __m512   xv;
+  __m512   yv[CORR_KERN];
+  __m512   sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm512_setzero_ps();
+  }
+
+  for (k = 0; k + 16 <= len; k += 16) {
+
+    for (j = 0; j < CORR_KERN; j++) yv[j] = _mm512_loadu_ps(y+j*stride+k);
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = _mm512_loadu_ps(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++)
+        sums[i][j] = _mm512_fmadd_ps(xv, yv[j], sums[i][j]);
+    }
+  }
+
+  /*the lane sums are combined in double precision*/
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) {
+
+      sum = _mm512_reduce_add_pd(_mm512_add_pd(
+        _mm512_cvtps_pd(_mm512_castps512_ps256(sums[i][j])),
+        _mm512_cvtps_pd(_mm256_castpd_ps(
+          _mm512_extractf64x4_pd(_mm512_castps_pd(sums[i][j]), 1)))));
+
+      for (t = k; t < len; t++)
+        sum += (double)x[i*stride + t] * y[j*stride + t];
+
+      acc[i*CORR_TILE + j] += sum;
+    }
+  }
+}
+
+void _qkern_avx2(
+  int16_t *x, int16_t *y, uint32_t stride, uint32_t len, int32_t *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint64_t h;
+  uint64_t t;
+  int32_t  tmp[8];
+  int32_t  sum;
+  __m256i  xv;
+  __m256i  yv[CORR_KERN];
+  __m256i  sums[2][CORR_KERN];
+
+  for (h = 0; h < CORR_KERN; h += 2) {
+
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm256_setzero_si256();
+    }
+
+    for (k = 0; k < len; k += 16) {
+
+      for (j = 0; j < CORR_KERN; j++)
+        yv[j] = _mm256_loadu_si256((__m256i *)(y + j*stride + k));
+
+      for (i = 0; i < 2; i++) {
+
+        xv = _mm256_loadu_si256((__m256i *)(x + (h+i)*stride + k));
+
+        for (j = 0; j < CORR_KERN; j++)
+          sums[i][j] = _mm256_add_epi32(
+            sums[i][j], _mm256_madd_epi16(xv, yv[j]));
+      }
+    }
+
+    for (i = 0; i < 2; i++) {
+      for (j = 0; j < CORR_KERN; j++) {
+
+        _mm256_storeu_si256((__m256i *)tmp, sums[i][j]);
+
+        for (sum = 0, t = 0; t < 8; t++) sum += tmp[t];
+
+        acc[(h+i)*CORR_TILE + j] += sum;
+      }
+    }
+  }
+}
+
+void _qkern_avx512(
+  int16_t *x, int16_t *y, uint32_t stride, uint32_t len, int32_t *acc) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  __m512i  xv;
+  __m512i  yv[CORR_KERN];
+  __m512i  sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = _mm512_setzero_si512();
+  }
+
+  for (k = 0; k < len; k += 32) {
+
+    for (j = 0; j < CORR_KERN; j++)
+      yv[j] = _mm512_loadu_si512(y + j*stride + k);
+
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = _mm512_loadu_si512(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++)
+        sums[i][j] = _mm512_add_epi32(
+          sums[i][j], _mm512_madd_epi16(xv, yv[j]));
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++)
+      acc[i*CORR_TILE + j] += _mm512_reduce_add_epi32(sums[i][j]);
+  }
+}
+#endif
+
+#ifdef CORR_NEON_SIMD
+double _dot_neon(double *x, double *y, uint32_t len) {
+
+  uint64_t    i;
+  double      dot;
+  float64x2_t acc0;
+  float64x2_t acc1;
+
+  acc0 = vdupq_n_f64(0);
+  acc1 = vdupq_n_f64(0);
+
+  for (i = 0; i + 4 <= len; i += 4) {
+    acc0 = vfmaq_f64(acc0, vld1q_f64(x+i),   vld1q_f64(y+i));
+    acc1 = vfmaq_f64(acc1, vld1q_f64(x+i+2), vld1q_f64(y+i+2));
+  }
+
+  dot = vaddvq_f64(vaddq_f64(acc0, acc1));
+
+  for (; i < len; i++) dot += x[i] * y[i];
+
+  return dot;
+}
+
+void _kern_neon(
+  double *x, double *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint64_t    k;
+  uint64_t    t;
+  double      sum;
+  float64x2_t xv;
+  float64x2_t yv[CORR_KERN];
+  float64x2_t sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = vdupq_n_f64(0);
+  }
+
+  for (k = 0; k + 2 <= len; k += 2) {
+
+    for (j = 0; j < CORR_KERN; j++) yv[j] = vld1q_f64(y + j*stride + k);
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = vld1q_f64(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++)
+        sums[i][j] = vfmaq_f64(sums[i][j], xv, yv[j]);
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) {
+
+      sum = vaddvq_f64(sums[i][j]);
+
+      for (t = k; t < len; t++) sum += x[i*stride + t] * y[j*stride + t];
+
+      acc[i*CORR_TILE + j] += sum;
+    }
+  }
+}
+
+void _kernf_neon(
+  float *x, float *y, uint32_t stride, uint32_t len, double *acc) {
+
+  uint64_t    i;
+  uint64_t    j;
+  uint64_t    k;
+  uint64_t    t;
+  double      sum;
+  float32x4_t xv;
+  float32x4_t yv[CORR_KERN];
+  float32x4_t sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = vdupq_n_f32(0);
+  }
+
+  for (k = 0; k + 4 <= len; k += 4) {
+
+    for (j = 0; j < CORR_KERN; j++) yv[j] = vld1q_f32(y + j*stride + k);
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = vld1q_f32(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++)
+        sums[i][j] = vfmaq_f32(sums[i][j], xv, yv[j]);
+    }
+  }
+
+  /*the lane sums are combined in double precision*/
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) {
+
+      sum = vaddvq_f64(vaddq_f64(vcvt_f64_f32(vget_low_f32( sums[i][j])),
+                                 vcvt_f64_f32(vget_high_f32(sums[i][j]))));
+
+      for (t = k; t < len; t++)
+        sum += (double)x[i*stride + t] * y[j*stride + t];
+
+      acc[i*CORR_TILE + j] += sum;
+    }
+  }
+}
+
+void _qkern_neon(
+  int16_t *x, int16_t *y, uint32_t stride, uint32_t len, int32_t *acc) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  k;
+  int16x8_t xv;
+  int16x8_t yv[CORR_KERN];
+  int32x4_t sums[CORR_KERN][CORR_KERN];
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++) sums[i][j] = vdupq_n_s32(0);
+  }
+
+  for (k = 0; k < len; k += 8) {
+
+    for (j = 0; j < CORR_KERN; j++) yv[j] = vld1q_s16(y + j*stride + k);
+    for (i = 0; i < CORR_KERN; i++) {
+
+      xv = vld1q_s16(x + i*stride + k);
+
+      for (j = 0; j < CORR_KERN; j++) {
+        sums[i][j] = vmlal_s16(
+          sums[i][j], vget_low_s16(xv), vget_low_s16(yv[j]));
+        sums[i][j] = vmlal_high_s16(sums[i][j], xv, yv[j]);
+      }
+    }
+  }
+
+  for (i = 0; i < CORR_KERN; i++) {
+    for (j = 0; j < CORR_KERN; j++)
+      acc[i*CORR_TILE + j] += vaddvq_s32(sums[i][j]);
+  }
+}
+#endif
+
+void corr_normalise(double *ts, uint32_t len) {
+
+  uint64_t i;
+  double   mean;
+  double   ss;
+
+  if (len == 0) return;
+
+  mean = 0;
+  for (i = 0; i < len; i++) mean += ts[i];
+  mean /= len;
+
+  ss = 0;
+  for (i = 0; i < len; i++) {
+    ts[i] -= mean;
+    ss    += ts[i] * ts[i];
+  }
+
+  if (ss <= 0 || isnan(ss)) {
+    memset(ts, 0, len*sizeof(double));
+    return;
+  }
+
+  ss = 1.0 / sqrt(ss);
+  for (i = 0; i < len; i++) ts[i] *= ss;
+}
+
+void corr_normalise_float(double *ts, uint32_t len, float *out) {
+
+  uint64_t i;
+
+  corr_normalise(ts, len);
+
+  for (i = 0; i < len; i++) out[i] = ts[i];
+}
+
+uint8_t corr_block(
+  double  *series,
+  uint32_t len,
+  uint32_t nseries,
+  uint32_t row,
+  uint32_t nrows,
+  uint16_t nthreads,
+  double  *out) {
+
+  corr_ctx_t ctx;
+
+  if (series == NULL) return 1;
+
+  ctx.series  = series;
+  ctx.fseries = NULL;
+  ctx.len     = len;
+  ctx.nseries = nseries;
+  ctx.row     = row;
+  ctx.nrows   = nrows;
+  ctx.out     = out;
+  ctx.screen  = NULL;
+
+  return _corr_block(&ctx, nthreads);
+}
+
+uint8_t corr_block_float(
+  float   *series,
+  uint32_t len,
+  uint32_t nseries,
+  uint32_t row,
+  uint32_t nrows,
+  uint16_t nthreads,
+  double  *out) {
+
+  corr_ctx_t ctx;
+
+  if (series == NULL) return 1;
+
+  ctx.series  = NULL;
+  ctx.fseries = series;
+  ctx.len     = len;
+  ctx.nseries = nseries;
+  ctx.row     = row;
+  ctx.nrows   = nrows;
+  ctx.out     = out;
+  ctx.screen  = NULL;
+
+  return _corr_block(&ctx, nthreads);
+}
+
+uint8_t corr_cross(
+  double  *rows,
+  uint32_t nrows,
+  double  *cols,
+  uint32_t ncols,
+  uint32_t len,
+  uint16_t nthreads,
+  double  *out) {
+
+  cross_ctx_t ctx;
+
+  if (rows == NULL || cols == NULL || out == NULL) return 1;
+  if (nrows == 0   || ncols == 0)                  return 0;
+
+  pthread_once(&_dot_once, _select_dot);
+
+  ctx.rows  = rows;
+  ctx.nrows = nrows;
+  ctx.cols  = cols;
+  ctx.ncols = ncols;
+  ctx.len   = len;
+  ctx.out   = out;
+
+  return parallel_for(
+    nthreads, (ncols + CORR_TILE - 1) / CORR_TILE, 1, &ctx, _cross_tiles);
+}
+
+uint8_t corr_screen_init(
+  corr_screen_t *scr,
+  double        *series,
+  float         *fseries,
+  uint32_t       len,
+  uint32_t       nseries,
+  double         threshold,
+  uint8_t        absval) {
+
+  uint64_t i;
+  uint64_t k;
+  uint64_t nq;
+  double  *x;
+  int16_t *q;
+  double   max;
+  double   s;
+  double   v;
+  double   e;
+  double   qn;
+  double   n;
+
+  x = NULL;
+
+  memset(scr, 0, sizeof(corr_screen_t));
+
+  if (series == NULL && fseries == NULL)   goto fail;
+  if (len == 0 || len > CORR_SCREEN_MAXLEN) goto fail;
+  if (threshold <= 0)                       goto fail;
+
+  scr->len       = len;
+  scr->qlen      = ((len + CORR_SCREEN_ALIGN - 1) / CORR_SCREEN_ALIGN) *
+                   CORR_SCREEN_ALIGN;
+  scr->nseries   = nseries;
+  scr->threshold = threshold;
+  scr->absval    = absval;
+
+  /*
+   * The error of a double precision correlation value is negligible; in
+   * single precision, each value is summed over at most CORR_KBLOCK
+   * products before it is added to a double precision sum, and the
+   * products of two normalised series sum to at most 1 in magnitude.
+   */
+  if (series != NULL) scr->slack = 4.0 * len         * DBL_EPSILON;
+  else                scr->slack = 4.0 * CORR_KBLOCK * FLT_EPSILON;
+
+  /*
+   * The sub-blocks at the bottom and right of the matrix read past the
+   * last series, so there are enough all-zero series on the end to fill
+   * the last tile, plus one sub-block.
+   */
+  nq = ((uint64_t)(nseries + CORR_TILE - 1) / CORR_TILE) * CORR_TILE +
+       CORR_KERN;
+
+  scr->q     = calloc(nq * scr->qlen, sizeof(int16_t));
+  scr->scale = malloc(nseries * sizeof(double));
+  scr->qnorm = malloc(nseries * sizeof(double));
+  scr->err   = malloc(nseries * sizeof(double));
+  scr->norm  = malloc(nseries * sizeof(double));
+  x          = malloc(len     * sizeof(double));
+
+  if (scr->q     == NULL) goto fail;
+  if (scr->scale == NULL) goto fail;
+  if (scr->qnorm == NULL) goto fail;
+  if (scr->err   == NULL) goto fail;
+  if (scr->norm  == NULL) goto fail;
+  if (x          == NULL) goto fail;
+
+  for (i = 0; i < nseries; i++) {
+
+    q = scr->q + i * scr->qlen;
+
+    for (k = 0; k < len; k++) {
+      if (series != NULL) x[k] = series[ i*len + k];
+      else                x[k] = fseries[i*len + k];
+    }
+
+    max = 0;
+    for (k = 0; k < len; k++) {
+      if (fabs(x[k]) > max) max = fabs(x[k]);
+    }
+
+    /*zero variance series are left as all zeros*/
+    s  = (max > 0) ? (127.0 / max) : 0;
+    e  = 0;
+    qn = 0;
+    n  = 0;
+
+    for (k = 0; k < len; k++) {
+
+      q[k] = (int16_t)lrint(x[k] * s);
+      v    = (max > 0) ? (q[k] * (max / 127.0)) : 0;
+
+      e  += (x[k] - v) * (x[k] - v);
+      qn += v * v;
+      n  += x[k] * x[k];
+    }
+
+    scr->scale[i] = max / 127.0;
+    scr->err[  i] = sqrt(e);
+    scr->qnorm[i] = sqrt(qn);
+    scr->norm[ i] = sqrt(n);
+  }
+
+  free(x);
+  return 0;
+
+fail:
+  if (x != NULL) free(x);
+  corr_screen_free(scr);
+  return 1;
+}
+
+void corr_screen_free(corr_screen_t *scr) {
+
+  if (scr->q     != NULL) free(scr->q);
+  if (scr->scale != NULL) free(scr->scale);
+  if (scr->qnorm != NULL) free(scr->qnorm);
+  if (scr->err   != NULL) free(scr->err);
+  if (scr->norm  != NULL) free(scr->norm);
+
+  memset(scr, 0, sizeof(corr_screen_t));
+}
+
+uint8_t corr_block_screen(
+  double        *series,
+  uint32_t       len,
+  uint32_t       nseries,
+  uint32_t       row,
+  uint32_t       nrows,
+  uint16_t       nthreads,
+  corr_screen_t *scr,
+  double        *out) {
+
+  corr_ctx_t ctx;
+
+  if (series == NULL)          return 1;
+  if (scr    == NULL)          return 1;
+  if (scr->len     != len)     return 1;
+  if (scr->nseries != nseries) return 1;
+
+  ctx.series  = series;
+  ctx.fseries = NULL;
+  ctx.len     = len;
+  ctx.nseries = nseries;
+  ctx.row     = row;
+  ctx.nrows   = nrows;
+  ctx.out     = out;
+  ctx.screen  = scr;
+
+  return _corr_block(&ctx, nthreads);
+}
+
+uint8_t corr_block_float_screen(
+  float         *series,
+  uint32_t       len,
+  uint32_t       nseries,
+  uint32_t       row,
+  uint32_t       nrows,
+  uint16_t       nthreads,
+  corr_screen_t *scr,
+  double        *out) {
+
+  corr_ctx_t ctx;
+
+  if (series == NULL)          return 1;
+  if (scr    == NULL)          return 1;
+  if (scr->len     != len)     return 1;
+  if (scr->nseries != nseries) return 1;
+
+  ctx.series  = NULL;
+  ctx.fseries = series;
+  ctx.len     = len;
+  ctx.nseries = nseries;
+  ctx.row     = row;
+  ctx.nrows   = nrows;
+  ctx.out     = out;
+  ctx.screen  = scr;
+
+  return _corr_block(&ctx, nthreads);
+}
+
+uint8_t _corr_block(corr_ctx_t *ctx, uint16_t nthreads) {
+
+  uint64_t first;
+  uint64_t last;
+
+  pthread_once(&_dot_once, _select_dot);
+
+  if (ctx->out == NULL)                      goto fail;
+  if (ctx->row + ctx->nrows > ctx->nseries)  goto fail;
+  if (ctx->nrows == 0)                       return 0;
+
+  /*
+   * only column tiles which intersect with the
+   * upper triangle of the block are calculated
+   */
+  first = ctx->row / CORR_TILE;
+  last  = (ctx->nseries + CORR_TILE - 1) / CORR_TILE;
+
+  if (parallel_for(nthreads, last - first, 1, ctx, _corr_tiles))
+    goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _corr_tiles(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  corr_ctx_t *ctx;
+  uint64_t    ct;
+  uint64_t    r0;
+  uint64_t    r1;
+  uint64_t    c0;
+  uint64_t    c1;
+  uint64_t    k0;
+  uint64_t    k1;
+  uint64_t    r;
+  uint64_t    c;
+  uint64_t    kr;
+  uint64_t    kc;
+  uint64_t    xo;
+  uint64_t    yo;
+  double      acc[CORR_TILE][CORR_TILE];
+  uint8_t     pass[CORR_TILE][CORR_TILE];
+  uint8_t     kpass[CORR_TILE/CORR_KERN][CORR_TILE/CORR_KERN];
+
+  ctx = vctx;
+
+  start += ctx->row / CORR_TILE;
+  end   += ctx->row / CORR_TILE;
+
+  for (ct = start; ct < end; ct++) {
+
+    c0 = ct * CORR_TILE;
+    c1 = c0 + CORR_TILE;
+    if (c1 > ctx->nseries) c1 = ctx->nseries;
+
+    /*
+     * tiles, and their sub-blocks, are aligned to multiples
+     * of CORR_TILE, rather than to the first row of the block,
+     * so that every pair is calculated in the same way (by
+     * _kern or by _dot, which round differently), wherever
+     * the block starts - rows of the first and last tiles
+     * which lie outside of the block are calculated, but
+     * are not stored
+     */
+    for (r0 = (ctx->row / CORR_TILE) * CORR_TILE;
+         r0 < ctx->row + ctx->nrows;
+         r0 += CORR_TILE) {
+
+      r1 = r0 + CORR_TILE;
+      if (r1 > ctx->nseries) r1 = ctx->nseries;
+
+      /*tile lies entirely below the diagonal*/
+      if (c1 <= r0) continue;
+
+      memset(acc, 0, sizeof(acc));
+
+      if (ctx->screen != NULL)
+        _screen_tile(ctx->screen, r0, r1, c0, c1, pass, kpass);
+
+      for (k0 = 0; k0 < ctx->len; k0 += CORR_KBLOCK) {
+
+        k1 = k0 + CORR_KBLOCK;
+        if (k1 > ctx->len) k1 = ctx->len;
+
+        for (r = r0; r < r1; r += CORR_KERN) {
+          for (c = c0; c < c1; c += CORR_KERN) {
+
+            /*sub-block lies entirely below the diagonal*/
+            if (c + CORR_KERN <= r) continue;
+
+            /*no pair in the sub-block can pass the screen*/
+            if (ctx->screen != NULL &&
+                !kpass[(r-r0) / CORR_KERN][(c-c0) / CORR_KERN])
+              continue;
+
+            /*
+             * values below the diagonal in a full sub-block
+             * are calculated, but are not stored
+             */
+            if (r + CORR_KERN <= r1 && c + CORR_KERN <= c1) {
+
+              xo = r * ctx->len + k0;
+              yo = c * ctx->len + k0;
+
+              if (ctx->fseries != NULL)
+                _kernf(ctx->fseries + xo, ctx->fseries + yo,
+                       ctx->len, k1 - k0, &acc[r-r0][c-c0]);
+              else
+                _kern( ctx->series  + xo, ctx->series  + yo,
+                       ctx->len, k1 - k0, &acc[r-r0][c-c0]);
+              continue;
+            }
+
+            /*partial sub-blocks at the edge of the matrix*/
+            for (kr = r; kr < r + CORR_KERN && kr < r1; kr++) {
+
+              xo = kr * ctx->len + k0;
+
+              for (kc = (c > kr) ? c : kr; kc < c + CORR_KERN && kc < c1;
+                   kc++) {
+
+                if (ctx->screen != NULL && !pass[kr-r0][kc-c0]) continue;
+
+                yo = kc * ctx->len + k0;
+
+                if (ctx->fseries != NULL)
+                  acc[kr-r0][kc-c0] += _dotf(
+                    ctx->fseries + xo, ctx->fseries + yo, k1 - k0);
+                else
+                  acc[kr-r0][kc-c0] += _dot(
+                    ctx->series  + xo, ctx->series  + yo, k1 - k0);
+              }
+            }
+          }
+        }
+      }
+
+      for (r = r0; r < r1; r++) {
+
+        if (r <  ctx->row)              continue;
+        if (r >= ctx->row + ctx->nrows) break;
+
+        for (c = (c0 > r) ? c0 : r; c < c1; c++) {
+          ctx->out[(r - ctx->row) * ctx->nseries + c] = acc[r-r0][c-c0];
+        }
+      }
+    }
+  }
+
+  return 0;
+}
+
+void _screen_tile(
+  corr_screen_t *scr,
+  uint64_t       r0,
+  uint64_t       r1,
+  uint64_t       c0,
+  uint64_t       c1,
+  uint8_t        pass[CORR_TILE][CORR_TILE],
+  uint8_t        kpass[CORR_TILE/CORR_KERN][CORR_TILE/CORR_KERN]) {
+
+  uint64_t r;
+  uint64_t c;
+  double   dot;
+  double   bound;
+  int32_t  qacc[CORR_TILE][CORR_TILE];
+
+  memset(qacc,  0, sizeof(qacc));
+  memset(pass,  0, CORR_TILE * CORR_TILE * sizeof(uint8_t));
+  memset(kpass, 0, (CORR_TILE/CORR_KERN) * (CORR_TILE/CORR_KERN));
+
+  /*
+   * the padding series on the end of the quantised
+   * series mean that every sub-block is a full one
+   */
+  for (r = r0; r < r1; r += CORR_KERN) {
+    for (c = c0; c < c1; c += CORR_KERN) {
+
+      if (c + CORR_KERN <= r) continue;
+
+      _qkern(scr->q + r * scr->qlen,
+             scr->q + c * scr->qlen,
+             scr->qlen,
+             scr->qlen,
+             &qacc[r-r0][c-c0]);
+    }
+  }
+
+  for (r = r0; r < r1; r++) {
+    for (c = (c0 > r) ? c0 : r; c < c1; c++) {
+
+      dot   = qacc[r-r0][c-c0] * scr->scale[r] * scr->scale[c];
+      bound = scr->qnorm[r] * scr->err[c] +
+              scr->err[r]   * scr->norm[c] +
+              scr->slack;
+
+      if (scr->absval) dot = fabs(dot);
+
+      if (dot + bound < scr->threshold) continue;
+
+      pass[r-r0][c-c0] = 1;
+      kpass[(r-r0) / CORR_KERN][(c-c0) / CORR_KERN] = 1;
+    }
+  }
+}
+
+uint8_t _cross_tiles(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  cross_ctx_t *ctx;
+  uint64_t     ct;
+  uint64_t     r0;
+  uint64_t     r1;
+  uint64_t     c0;
+  uint64_t     c1;
+  uint64_t     k0;
+  uint64_t     k1;
+  uint64_t     r;
+  uint64_t     c;
+  uint64_t     kr;
+  uint64_t     kc;
+  double       acc[CORR_TILE][CORR_TILE];
+
+  ctx = vctx;
+
+  for (ct = start; ct < end; ct++) {
+
+    c0 = ct * CORR_TILE;
+    c1 = c0 + CORR_TILE;
+    if (c1 > ctx->ncols) c1 = ctx->ncols;
+
+    for (r0 = 0; r0 < ctx->nrows; r0 += CORR_TILE) {
+
+      r1 = r0 + CORR_TILE;
+      if (r1 > ctx->nrows) r1 = ctx->nrows;
+
+      memset(acc, 0, sizeof(acc));
+
+      for (k0 = 0; k0 < ctx->len; k0 += CORR_KBLOCK) {
+
+        k1 = k0 + CORR_KBLOCK;
+        if (k1 > ctx->len) k1 = ctx->len;
+
+        for (r = r0; r < r1; r += CORR_KERN) {
+          for (c = c0; c < c1; c += CORR_KERN) {
+
+            if (r + CORR_KERN <= r1 && c + CORR_KERN <= c1) {
+              _kern(ctx->rows + r * ctx->len + k0,
+                    ctx->cols + c * ctx->len + k0,
+                    ctx->len, k1 - k0, &acc[r-r0][c-c0]);
+              continue;
+            }
+
+            /*partial sub-blocks at the edge of the matrix*/
+            for (kr = r; kr < r + CORR_KERN && kr < r1; kr++) {
+              for (kc = c; kc < c + CORR_KERN && kc < c1; kc++) {
+                acc[kr-r0][kc-c0] += _dot(
+                  ctx->rows + kr * ctx->len + k0,
+                  ctx->cols + kc * ctx->len + k0,
+                  k1 - k0);
+              }
+            }
+          }
+        }
+      }
+
+      for (r = r0; r < r1; r++) {
+        for (c = c0; c < c1; c++)
+          ctx->out[r * ctx->ncols + c] = acc[r-r0][c-c0];
+      }
+    }
+  }
+
+  return 0;
+}
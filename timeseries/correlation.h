@@ -1,6 +1,7 @@
 /**
  * Implementation of Pearson's correlation coefficient between two time
- * series.
+ * series, and a blocked, multi-threaded engine for calculating the
+ * correlation between many time series.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -9,10 +10,276 @@
 
 #include <stdint.h>
 
+/**
+ * Longest time series which can be used with corr_screen_init - the
+ * quantised dot products are summed in 32 bit integers.
+ */
+#define CORR_SCREEN_MAXLEN (1 << 17)
+
+/**
+ * Quantised copies of a set of normalised time series, used by
+ * corr_block_screen and corr_block_float_screen to skip the pairs of time
+ * series whose correlation cannot pass a threshold.
+ *
+ * Every time series x is scaled so that its largest absolute value is
+ * 127, and rounded to integers, giving q. Writing x' for q scaled back
+ * down, and e for the rounding error x - x', the dot product of two time
+ * series is:
+ *
+ *   x.y = x'.y' + x'.e_y + e_x.y
+ *
+ * so it differs from x'.y' by at most |x'||e_y| + |e_x||y|. The dot
+ * product of q_x and q_y is calculated exactly, in integer arithmetic,
+ * and a pair of time series is only correlated properly if x'.y', plus
+ * this bound (and a small allowance for the rounding error of the
+ * correlation itself), passes the threshold.
+ */
+typedef struct _corr_screen {
+
+  uint32_t len;       /**< time series length                         */
+  uint32_t qlen;      /**< padded length of each quantised series     */
+  uint32_t nseries;   /**< number of time series                      */
+  double   threshold; /**< correlation threshold                      */
+  uint8_t  absval;    /**< compare the absolute correlation with the
+                           threshold                                  */
+  double   slack;     /**< allowance for the rounding error of the
+                           correlation values                         */
+  int16_t *q;         /**< quantised time series, qlen values each,
+                           followed by some all-zero padding series   */
+  double  *scale;     /**< scale from q back to x' for each series    */
+  double  *qnorm;     /**< length of x' for each series               */
+  double  *err;       /**< length of e for each series                */
+  double  *norm;      /**< length of x for each series                */
+
+} corr_screen_t;
+
 double pearson(
   double  *x,
   double  *y,
   uint32_t len
 );
 
+/**
+ * Calculates the mean and (population) standard deviation of the given time
+ * series, for use with pearson_pre.
+ */
+void pearson_moments(
+  double  *x,    /**< time series                    */
+  uint32_t len,  /**< time series length             */
+  double  *mean, /**< place to store mean            */
+  double  *sd    /**< place to store std. deviation  */
+);
+
+/**
+ * Calculates Pearson's correlation coefficient between two time series,
+ * given their precomputed moments (see pearson_moments), so only the dot
+ * product needs to be calculated. If either time series has zero variance,
+ * 0 is returned.
+ *
+ * If you are correlating many time series against each other, it is
+ * cheaper, and numerically more robust, to normalise them once with
+ * corr_normalise, and then use corr_dot.
+ */
+double pearson_pre(
+  double  *x,   /**< first time series             */
+  double  *y,   /**< second time series            */
+  uint32_t len, /**< time series length             */
+  double   mx,  /**< mean of x                     */
+  double   sx,  /**< standard deviation of x       */
+  double   my,  /**< mean of y                     */
+  double   sy   /**< standard deviation of y       */
+);
+
+/**
+ * \return the dot product of the two given vectors. This function uses
+ * AVX-512, AVX2/FMA, or NEON instructions when they are supported by the
+ * processor; the implementation is selected on the first call.
+ */
+double corr_dot(
+  double  *x,  /**< first vector  */
+  double  *y,  /**< second vector */
+  uint32_t len /**< vector length */
+);
+
+/**
+ * Normalises the given time series in place, so that it has zero mean and
+ * unit length. The Pearson correlation between two normalised time series is
+ * then simply their dot product. A time series with zero variance is set to
+ * all zeros, so its correlation with any other time series will be 0.
+ */
+void corr_normalise(
+  double  *ts, /**< time series to normalise */
+  uint32_t len /**< time series length       */
+);
+
+/**
+ * Calculates a block of rows from the upper triangle of the correlation
+ * matrix between the given time series, which must have already been
+ * normalised with corr_normalise. The time series are stored contiguously,
+ * one after the other, in the series array.
+ *
+ * The block is calculated as a collection of square tiles, which are shared
+ * between the given number of threads (pass in 0 to use all available
+ * processors). Each tile is calculated in small sub-blocks, each of which
+ * correlates several row series with several column series at once, in
+ * the same way as a matrix multiplication routine, so that every value
+ * that is loaded from memory is used more than once.
+ *
+ * The out array must have space for (nrows*nseries) values; the correlation
+ * between series (row+i) and series j, for j >= (row+i), is stored at
+ * out[i*nseries + j]. Values below the diagonal are left untouched.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_block(
+  double  *series,   /**< normalised time series           */
+  uint32_t len,      /**< length of each time series       */
+  uint32_t nseries,  /**< number of time series            */
+  uint32_t row,      /**< first row of the block           */
+  uint32_t nrows,    /**< number of rows in the block      */
+  uint16_t nthreads, /**< number of threads to use         */
+  double  *out       /**< place to store correlation values */
+);
+
+/**
+ * Calculates the correlation between every one of a set of row time series
+ * and every one of a set of column time series, all of which must have
+ * already been normalised with corr_normalise - for example, between a
+ * few seed time series and every voxel in a volume. Each set is stored
+ * contiguously, one series after the other.
+ *
+ * The result is calculated in the same tiles and sub-blocks as by
+ * corr_block, so it is the product of the row matrix with the transpose of
+ * the column matrix. The column tiles are shared between the given number
+ * of threads (pass in 0 to use all available processors).
+ *
+ * The out array must have space for (nrows*ncols) values; the correlation
+ * between row series i and column series j is stored at out[i*ncols + j].
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_cross(
+  double  *rows,     /**< normalised row time series        */
+  uint32_t nrows,    /**< number of row time series         */
+  double  *cols,     /**< normalised column time series     */
+  uint32_t ncols,    /**< number of column time series      */
+  uint32_t len,      /**< length of each time series        */
+  uint16_t nthreads, /**< number of threads to use          */
+  double  *out       /**< place to store correlation values */
+);
+
+/**
+ * Normalises the given time series in place, in the same way as
+ * corr_normalise, and stores a single precision copy of the result in
+ * out, for use with corr_block_float. The mean and length of the series
+ * are calculated in double precision, so the only error in the copy is
+ * the rounding of each value to single precision.
+ */
+void corr_normalise_float(
+  double  *ts,  /**< time series to normalise              */
+  uint32_t len, /**< time series length                    */
+  float   *out  /**< place to store the single precision copy */
+);
+
+/**
+ * Single precision version of corr_block, for time series which have
+ * been normalised with corr_normalise_float. As SIMD vectors hold twice
+ * as many single precision values, each sub-block is calculated about
+ * twice as quickly.
+ *
+ * The products are summed in single precision only within each SIMD
+ * lane, over at most CORR_KBLOCK (256) time points at a time; the lane
+ * sums, and the sums of successive groups of time points, are added in
+ * double precision. The error of a correlation value therefore grows with
+ * the square root of the time series length, rather than with the length
+ * - against corr_block, it is typically around 1e-7, and below 1e-6 for
+ * time series with up to several thousand time points. The values are
+ * stored in double precision, in the same layout as by corr_block.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_block_float(
+  float   *series,   /**< normalised time series            */
+  uint32_t len,      /**< length of each time series        */
+  uint32_t nseries,  /**< number of time series             */
+  uint32_t row,      /**< first row of the block            */
+  uint32_t nrows,    /**< number of rows in the block       */
+  uint16_t nthreads, /**< number of threads to use          */
+  double  *out       /**< place to store correlation values */
+);
+
+/**
+ * Prepares the quantised copies of the given normalised time series, for
+ * use with corr_block_screen (if series is given) or
+ * corr_block_float_screen (if fseries is given, and series is NULL). The
+ * quantised copies need a quarter (or half, for fseries) of the memory of
+ * the time series themselves.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_screen_init(
+  corr_screen_t *scr,       /**< the screen to initialise               */
+  double        *series,    /**< normalised time series, or NULL        */
+  float         *fseries,   /**< single precision normalised time
+                                 series, or NULL                        */
+  uint32_t       len,       /**< length of each time series (at most
+                                 CORR_SCREEN_MAXLEN)                    */
+  uint32_t       nseries,   /**< number of time series                  */
+  double         threshold, /**< correlation threshold - must be > 0    */
+  uint8_t        absval     /**< compare the absolute correlation value
+                                 with the threshold                     */
+);
+
+/**
+ * Frees the memory used by the given screen.
+ */
+void corr_screen_free(
+  corr_screen_t *scr /**< the screen to free */
+);
+
+/**
+ * Calculates a block of the correlation matrix in the same way as
+ * corr_block, but uses the given screen (see corr_screen_init) to skip
+ * the pairs of time series whose correlation cannot pass its threshold.
+ * Before each tile is calculated, the quantised dot products of all of
+ * its pairs are calculated, which is several times cheaper than
+ * calculating the correlations; only the sub-blocks (and, at the edge of
+ * the matrix, the pairs) which contain a pair that may pass are then
+ * calculated.
+ *
+ * Every value which is calculated is identical to that calculated by
+ * corr_block, and every value which passes the threshold is calculated;
+ * the others are either calculated, or set to 0. The block is therefore
+ * only useful for thresholding.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_block_screen(
+  double        *series,   /**< normalised time series            */
+  uint32_t       len,      /**< length of each time series        */
+  uint32_t       nseries,  /**< number of time series             */
+  uint32_t       row,      /**< first row of the block            */
+  uint32_t       nrows,    /**< number of rows in the block       */
+  uint16_t       nthreads, /**< number of threads to use          */
+  corr_screen_t *scr,      /**< screen created from series        */
+  double        *out       /**< place to store correlation values */
+);
+
+/**
+ * Single precision version of corr_block_screen - every value which is
+ * calculated is identical to that calculated by corr_block_float.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t corr_block_float_screen(
+  float         *series,   /**< normalised time series            */
+  uint32_t       len,      /**< length of each time series        */
+  uint32_t       nseries,  /**< number of time series             */
+  uint32_t       row,      /**< first row of the block            */
+  uint32_t       nrows,    /**< number of rows in the block       */
+  uint16_t       nthreads, /**< number of threads to use          */
+  corr_screen_t *scr,      /**< screen created from series        */
+  double        *out       /**< place to store correlation values */
+);
+
 #endif
@@ -0,0 +1,792 @@
+/**
+ * Partial correlation between many time series, from a Ledoit-Wolf
+ * shrinkage estimate of their correlation matrix.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/bigmem.h"
+#include "util/parallel.h"
+#include "timeseries/correlation.h"
+#include "timeseries/partial_corr.h"
+
+/**
+ * Width/height of the tiles which the Cholesky decomposition is
+ * calculated in.
+ */
+#define PARTIAL_BLOCK 64
+
+/**
+ * Number of columns in one tile of the partial correlation matrix, in
+ * the full form.
+ */
+#define PARTIAL_TILE 16
+
+/**
+ * Number of elements of each row of C^-T which are processed at a time
+ * within a tile, so that the rows of the tile stay in cache.
+ */
+#define PARTIAL_KBLOCK 256
+
+/**
+ * Context shared by the parallel_for functions in this file - not every
+ * field is used by every function.
+ */
+typedef struct _partial_ctx {
+
+  double  *a;     /**< matrix being worked on                  */
+  uint64_t n;     /**< matrix width/height                     */
+  uint64_t k0;    /**< first column of the current panel       */
+  uint64_t k1;    /**< one past the last column of the panel   */
+  double  *diag;  /**< diagonal of the Cholesky factor         */
+  double  *y;     /**< input rows (transpose, or Q)            */
+  uint64_t len;   /**< length of each input row                */
+  double   scale; /**< scale factor applied to the input rows  */
+  uint32_t row;   /**< first row of the output block           */
+  uint32_t nrows; /**< number of rows in the output block      */
+  double  *pdiag; /**< diagonal of the precision matrix        */
+  double  *out;   /**< output block                            */
+
+} partial_ctx_t;
+
+/**
+ * Calculates the Ledoit-Wolf shrinkage intensity, and the mean diagonal
+ * of R, from the Gram matrix G = Y'Y (see partial_corr.h).
+ */
+static void _ledoit_wolf(
+  double  *g,       /**< len * len Gram matrix            */
+  uint32_t len,     /**< time series length               */
+  uint32_t nseries, /**< number of time series            */
+  double  *s,       /**< place to store the shrinkage     */
+  double  *mu       /**< place to store the mean diagonal */
+);
+
+/**
+ * Calculates the Gram matrix G = Y'Y of the given normalised series.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _gram(
+  double  *series,   /**< normalised time series */
+  uint32_t len,      /**< time series length     */
+  uint32_t nseries,  /**< number of time series  */
+  uint16_t nthreads, /**< number of threads      */
+  double  *g         /**< place to store G       */
+);
+
+/**
+ * Decomposes the given symmetric, positive definite n * n matrix, in
+ * place, into C C', where C is lower triangular. Only the lower triangle
+ * (including the diagonal) is read and written.
+ *
+ * The matrix is processed in panels of PARTIAL_BLOCK columns; after each
+ * panel is factored, the trailing lower triangle is updated in square
+ * tiles, which are shared between the threads.
+ *
+ * \return 0 on success, non-0 if the matrix is not positive definite.
+ */
+static uint8_t _cholesky(
+  double  *a,       /**< matrix to decompose */
+  uint64_t n,       /**< matrix width/height */
+  uint16_t nthreads /**< number of threads   */
+);
+
+/**
+ * Initialises the given partial_corr_t in the full form.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _init_full(
+  partial_corr_t *pc,       /**< the struct to initialise */
+  double         *series,   /**< normalised time series   */
+  double          mu,       /**< mean diagonal of R       */
+  uint16_t        nthreads  /**< number of threads        */
+);
+
+/**
+ * Initialises the given partial_corr_t in the low-rank form.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _init_lowrank(
+  partial_corr_t *pc,       /**< the struct to initialise */
+  double         *series,   /**< normalised time series   */
+  double         *g,        /**< Gram matrix Y'Y          */
+  double          mu,       /**< mean diagonal of R       */
+  uint16_t        nthreads  /**< number of threads        */
+);
+
+/**
+ * parallel_for function which calculates rows of the Gram matrix, from
+ * the transposed series in ctx->y.
+ */
+static uint8_t _gram_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which calculates a range of rows of the current
+ * Cholesky panel, below its diagonal block.
+ */
+static uint8_t _chol_panel(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which applies the current Cholesky panel to a
+ * range of tiles of the trailing lower triangle. Tiles are numbered row
+ * by row, so tile t is at tile row r, column t - r(r+1)/2.
+ */
+static uint8_t _chol_update(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which copies a range of rows of the shrunk
+ * correlation matrix below the diagonal.
+ */
+static uint8_t _shrink_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which replaces a range of rows of the upper
+ * triangle with the corresponding columns of C^-1, by forward
+ * substitution against the Cholesky factor stored below the diagonal.
+ */
+static uint8_t _invert_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which calculates a range of rows of Q (see
+ * partial_corr.h) by forward substitution, and scales them.
+ */
+static uint8_t _lowrank_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+/**
+ * parallel_for function which calculates a range of column tiles of a
+ * block of the partial correlation matrix in the full form.
+ */
+static uint8_t _full_tiles(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx);
+
+uint8_t partial_corr_init(
+  partial_corr_t *pc,
+  double         *series,
+  uint32_t        len,
+  uint32_t        nseries,
+  double          shrinkage,
+  uint8_t         lowrank,
+  uint16_t        nthreads) {
+
+  uint64_t i;
+  double  *g;
+  double   lw;
+  double   mu;
+
+  g = NULL;
+
+  memset(pc, 0, sizeof(partial_corr_t));
+
+  if (len < 2 || nseries == 0) goto fail;
+  if (shrinkage > 1)           goto fail;
+
+  for (i = 0; i < nseries; i++) corr_normalise(series + i*len, len);
+
+  g = malloc((uint64_t)len * len * sizeof(double));
+  if (g == NULL) goto fail;
+
+  if (_gram(series, len, nseries, nthreads, g)) goto fail;
+
+  _ledoit_wolf(g, len, nseries, &lw, &mu);
+
+  pc->nseries   = nseries;
+  pc->len       = len;
+  pc->lowrank   = lowrank;
+  pc->shrinkage = (shrinkage < 0) ? lw : shrinkage;
+
+  if (lowrank) {
+    if (_init_lowrank(pc, series, g, mu, nthreads)) goto fail;
+  }
+  else if (_init_full(pc, series, mu, nthreads)) goto fail;
+
+  free(g);
+  return 0;
+
+fail:
+  if (g != NULL) free(g);
+  partial_corr_free(pc);
+  return 1;
+}
+
+void partial_corr_free(partial_corr_t *pc) {
+
+  bigmem_free(pc->data);
+  if (pc->pdiag != NULL) free(pc->pdiag);
+  memset(pc, 0, sizeof(partial_corr_t));
+}
+
+uint8_t partial_corr_block(
+  partial_corr_t *pc,
+  uint32_t        row,
+  uint32_t        nrows,
+  uint16_t        nthreads,
+  double         *out) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      n;
+  uint64_t      first;
+  uint64_t      last;
+  partial_ctx_t ctx;
+
+  n = pc->nseries;
+
+  if (out == NULL)       goto fail;
+  if (row + nrows > n)   goto fail;
+  if (nrows == 0)        return 0;
+
+  if (pc->lowrank) {
+
+    if (corr_block(pc->data, pc->len, n, row, nrows, nthreads, out))
+      goto fail;
+
+    /*rounding error can push the values of similar series past 1*/
+    for (i = 0; i < nrows; i++) {
+      for (j = row + i; j < n; j++) {
+        if      (out[i*n + j] >  1.0) out[i*n + j] =  1.0;
+        else if (out[i*n + j] < -1.0) out[i*n + j] = -1.0;
+      }
+      out[i*n + row + i] = 1.0;
+    }
+
+    return 0;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  ctx.a     = pc->data;
+  ctx.n     = n;
+  ctx.row   = row;
+  ctx.nrows = nrows;
+  ctx.pdiag = pc->pdiag;
+  ctx.out   = out;
+
+  /*only tiles which intersect with the upper triangle are calculated*/
+  first = row / PARTIAL_TILE;
+  last  = (n + PARTIAL_TILE - 1) / PARTIAL_TILE;
+  ctx.k0 = first;
+
+  if (parallel_for(nthreads, last - first, 1, &ctx, _full_tiles))
+    goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _ledoit_wolf(
+  double *g, uint32_t len, uint32_t nseries, double *s, double *mu) {
+
+  uint64_t i;
+  double   tr;
+  double   fro;
+  double   diag2;
+  double   b2;
+  double   d2;
+
+  tr    = 0;
+  fro   = 0;
+  diag2 = 0;
+
+  for (i = 0; i < (uint64_t)len * len; i++) fro += g[i] * g[i];
+
+  for (i = 0; i < len; i++) {
+    tr    += g[i*len + i];
+    diag2 += g[i*len + i] * g[i*len + i];
+  }
+
+  /*
+   * ||R||^2 = ||G||^2 and tr(R) = tr(G), so the Ledoit-Wolf
+   * estimate can be calculated without forming R:
+   *
+   *   d^2 = ||R - mu I||^2
+   *   b^2 = (1 / len^2) sum_t ||z_t z_t' - R||^2
+   *
+   * where z_t are the samples (the columns of Y, scaled by sqrt(len))
+   */
+  *mu = tr / nseries;
+  d2  = fro - tr * tr / nseries;
+  b2  = diag2 - fro / len;
+
+  if (b2 < 0)  b2 = 0;
+  if (b2 > d2) b2 = d2;
+
+  *s = (d2 > 0) ? b2 / d2 : 0;
+}
+
+uint8_t _gram(
+  double  *series,
+  uint32_t len,
+  uint32_t nseries,
+  uint16_t nthreads,
+  double  *g) {
+
+  uint64_t      i;
+  uint64_t      t;
+  double       *yt;
+  partial_ctx_t ctx;
+
+  /*transposed, so that each element of G is a contiguous dot product*/
+  yt = bigmem_alloc((uint64_t)len * nseries * sizeof(double));
+  if (yt == NULL) goto fail;
+
+  for (i = 0; i < nseries; i++)
+    for (t = 0; t < len; t++)
+      yt[t*nseries + i] = series[i*len + t];
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.a   = g;
+  ctx.n   = len;
+  ctx.y   = yt;
+  ctx.len = nseries;
+
+  if (parallel_for(nthreads, len, 1, &ctx, _gram_rows)) goto fail;
+
+  bigmem_free(yt);
+  return 0;
+
+fail:
+  bigmem_free(yt);
+  return 1;
+}
+
+uint8_t _cholesky(double *a, uint64_t n, uint16_t nthreads) {
+
+  uint64_t      i;
+  uint64_t      j;
+  uint64_t      k0;
+  uint64_t      k1;
+  uint64_t      ntiles;
+  double        v;
+  partial_ctx_t ctx;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.a = a;
+  ctx.n = n;
+
+  for (k0 = 0; k0 < n; k0 += PARTIAL_BLOCK) {
+
+    k1 = k0 + PARTIAL_BLOCK;
+    if (k1 > n) k1 = n;
+
+    /*the diagonal block is small, and is factored serially*/
+    for (j = k0; j < k1; j++) {
+      for (i = j; i < k1; i++) {
+
+        v = a[i*n + j] - corr_dot(a + i*n + k0, a + j*n + k0, j - k0);
+
+        if (i == j) {
+          if (!(v > 0)) goto fail;
+          a[j*n + j] = sqrt(v);
+        }
+        else a[i*n + j] = v / a[j*n + j];
+      }
+    }
+
+    if (k1 == n) break;
+
+    ctx.k0 = k0;
+    ctx.k1 = k1;
+
+    if (parallel_for(nthreads, n - k1, 16, &ctx, _chol_panel)) goto fail;
+
+    ntiles = (n - k1 + PARTIAL_BLOCK - 1) / PARTIAL_BLOCK;
+    ntiles = ntiles * (ntiles + 1) / 2;
+
+    if (parallel_for(nthreads, ntiles, 1, &ctx, _chol_update)) goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _init_full(
+  partial_corr_t *pc, double *series, double mu, uint16_t nthreads) {
+
+  uint64_t      i;
+  uint64_t      n;
+  double       *cdiag;
+  partial_ctx_t ctx;
+
+  n     = pc->nseries;
+  cdiag = NULL;
+
+  pc->data  = bigmem_alloc(n * n * sizeof(double));
+  pc->pdiag = malloc(n * sizeof(double));
+  cdiag     = malloc(n * sizeof(double));
+
+  if (pc->data == NULL || pc->pdiag == NULL || cdiag == NULL) goto fail;
+
+  /*the upper triangle of R*/
+  if (corr_block(series, pc->len, n, 0, n, nthreads, pc->data)) goto fail;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.a     = pc->data;
+  ctx.n     = n;
+  ctx.scale = 1 - pc->shrinkage;
+  ctx.diag  = cdiag;
+  ctx.pdiag = pc->pdiag;
+
+  if (parallel_for(nthreads, n, 64, &ctx, _shrink_rows)) goto fail;
+
+  for (i = 0; i < n; i++) pc->data[i*n + i] += pc->shrinkage * mu;
+
+  if (_cholesky(pc->data, n, nthreads)) goto fail;
+
+  /*the diagonal of C is needed by the inversion, which overwrites it*/
+  for (i = 0; i < n; i++) cdiag[i] = pc->data[i*n + i];
+
+  if (parallel_for(nthreads, n, 4, &ctx, _invert_rows)) goto fail;
+
+  free(cdiag);
+  return 0;
+
+fail:
+  if (cdiag != NULL) free(cdiag);
+  return 1;
+}
+
+uint8_t _init_lowrank(
+  partial_corr_t *pc,
+  double         *series,
+  double         *g,
+  double          mu,
+  uint16_t        nthreads) {
+
+  uint64_t      i;
+  uint64_t      len;
+  double        delta;
+  partial_ctx_t ctx;
+
+  len   = pc->len;
+  delta = pc->shrinkage * mu;
+
+  /*without shrinkage, S has rank < len, and has no inverse*/
+  if (!(delta > 0)) goto fail;
+
+  pc->data = bigmem_alloc((uint64_t)pc->nseries * len * sizeof(double));
+  if (pc->data == NULL) goto fail;
+
+  /*C C' = delta I + (1 - s) G, stored in place of G*/
+  for (i = 0; i < len * len; i++) g[i] *= 1 - pc->shrinkage;
+  for (i = 0; i < len;       i++) g[i*len + i] += delta;
+
+  if (_cholesky(g, len, nthreads)) goto fail;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.a     = g;
+  ctx.n     = len;
+  ctx.y     = series;
+  ctx.len   = len;
+  ctx.scale = sqrt(1 - pc->shrinkage);
+  ctx.out   = pc->data;
+
+  if (parallel_for(
+        nthreads, pc->nseries, 64, &ctx, _lowrank_rows)) goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _gram_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       a;
+  uint64_t       b;
+  partial_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (a = start; a < end; a++) {
+    for (b = a; b < ctx->n; b++) {
+
+      ctx->a[a*ctx->n + b] = corr_dot(ctx->y + a*ctx->len,
+                                      ctx->y + b*ctx->len,
+                                      ctx->len);
+      ctx->a[b*ctx->n + a] = ctx->a[a*ctx->n + b];
+    }
+  }
+
+  return 0;
+}
+
+uint8_t _chol_panel(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       n;
+  uint64_t       k0;
+  double        *a;
+  partial_ctx_t *ctx;
+
+  ctx = vctx;
+  a   = ctx->a;
+  n   = ctx->n;
+  k0  = ctx->k0;
+
+  for (i = ctx->k1 + start; i < ctx->k1 + end; i++) {
+    for (j = k0; j < ctx->k1; j++) {
+
+      a[i*n + j] = (a[i*n + j] - corr_dot(a + i*n + k0, a + j*n + k0, j - k0))
+                 / a[j*n + j];
+    }
+  }
+
+  return 0;
+}
+
+uint8_t _chol_update(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       t;
+  uint64_t       tr;
+  uint64_t       tc;
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       i1;
+  uint64_t       j0;
+  uint64_t       j1;
+  uint64_t       n;
+  uint64_t       k0;
+  uint64_t       klen;
+  double        *a;
+  partial_ctx_t *ctx;
+
+  ctx  = vctx;
+  a    = ctx->a;
+  n    = ctx->n;
+  k0   = ctx->k0;
+  klen = ctx->k1 - ctx->k0;
+
+  for (t = start; t < end; t++) {
+
+    tr = (uint64_t)((sqrt(8.0 * t + 1) - 1) / 2);
+
+    /*correct for any rounding error in the square root*/
+    while (tr * (tr + 1) / 2 > t)        tr--;
+    while ((tr + 1) * (tr + 2) / 2 <= t) tr++;
+
+    tc = t - tr * (tr + 1) / 2;
+
+    i  = ctx->k1 + tr * PARTIAL_BLOCK;
+    i1 = i + PARTIAL_BLOCK;
+    j0 = ctx->k1 + tc * PARTIAL_BLOCK;
+    j1 = j0 + PARTIAL_BLOCK;
+
+    if (i1 > n) i1 = n;
+    if (j1 > n) j1 = n;
+
+    for (; i < i1; i++) {
+      for (j = j0; j < j1 && j <= i; j++) {
+        a[i*n + j] -= corr_dot(a + i*n + k0, a + j*n + k0, klen);
+      }
+    }
+  }
+
+  return 0;
+}
+
+uint8_t _shrink_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       n;
+  double        *a;
+  partial_ctx_t *ctx;
+
+  ctx = vctx;
+  a   = ctx->a;
+  n   = ctx->n;
+
+  /*
+   * only the lower triangle is used by _cholesky, and the upper
+   * triangle (which is only read here) is overwritten afterwards
+   */
+  for (i = start; i < end; i++) {
+
+    for (j = 0; j < i; j++) a[i*n + j] = a[j*n + i] * ctx->scale;
+
+    a[i*n + i] *= ctx->scale;
+  }
+
+  return 0;
+}
+
+uint8_t _invert_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       j;
+  uint64_t       k;
+  uint64_t       n;
+  double        *a;
+  double        *u;
+  double         cjj;
+  partial_ctx_t *ctx;
+
+  ctx = vctx;
+  a   = ctx->a;
+  n   = ctx->n;
+
+  /*
+   * row j of C^-T is column j of C^-1, the solution of C x = e_j. Row
+   * j of the matrix only ever holds C to the left of the diagonal,
+   * which this does not touch, and row k of C is only read to the left
+   * of the diagonal, so the rows can be processed concurrently.
+   */
+  for (j = start; j < end; j++) {
+
+    u   = a + j*n;
+    cjj = ctx->diag[j];
+
+    u[j] = 1.0 / cjj;
+
+    for (k = j + 1; k < n; k++)
+      u[k] = -corr_dot(a + k*n + j, u + j, k - j) / ctx->diag[k];
+
+    ctx->pdiag[j] = corr_dot(u + j, u + j, n - j);
+  }
+
+  return 0;
+}
+
+uint8_t _lowrank_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       i;
+  uint64_t       a;
+  uint64_t       len;
+  double        *c;
+  double        *y;
+  double        *q;
+  double         qq;
+  partial_ctx_t *ctx;
+
+  ctx = vctx;
+  c   = ctx->a;
+  len = ctx->len;
+
+  for (i = start; i < end; i++) {
+
+    y = ctx->y   + i*len;
+    q = ctx->out + i*len;
+
+    /*q C' = sqrt(1 - s) y*/
+    for (a = 0; a < len; a++)
+      q[a] = (ctx->scale * y[a] - corr_dot(c + a*len, q, a)) / c[a*len + a];
+
+    /*
+     * P(i,i) = (1 - |q|^2) / delta, and P(i,j) = -q_i.q_j / delta, so
+     * scaling q by 1/sqrt(1 - |q|^2) makes the dot products of the
+     * rows the partial correlations
+     */
+    qq = corr_dot(q, q, len);
+    qq = (qq < 1) ? 1.0 / sqrt(1 - qq) : 0;
+
+    for (a = 0; a < len; a++) q[a] *= qq;
+  }
+
+  return 0;
+}
+
+uint8_t _full_tiles(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t       tile;
+  uint64_t       n;
+  uint64_t       r;
+  uint64_t       i;
+  uint64_t       c;
+  uint64_t       c0;
+  uint64_t       c1;
+  uint64_t       k0;
+  uint64_t       k1;
+  uint64_t       kk;
+  uint64_t       rend;
+  double        *a;
+  double        *out;
+  double         v;
+  partial_ctx_t *ctx;
+
+  ctx  = vctx;
+  a    = ctx->a;
+  n    = ctx->n;
+  out  = ctx->out;
+  rend = ctx->row + ctx->nrows;
+
+  for (tile = ctx->k0 + start; tile < ctx->k0 + end; tile++) {
+
+    c0 = tile * PARTIAL_TILE;
+    c1 = c0   + PARTIAL_TILE;
+    if (c1 > n) c1 = n;
+
+    for (i = ctx->row; i < rend && i < c1; i++) {
+      r = i - ctx->row;
+      for (c = (c0 > i) ? c0 : i; c < c1; c++) out[r*n + c] = 0;
+    }
+
+    /*
+     * P(i,c) is the dot product of rows i and c of C^-T, which
+     * are 0 to the left of column c
+     */
+    for (k0 = c0; k0 < n; k0 += PARTIAL_KBLOCK) {
+
+      k1 = k0 + PARTIAL_KBLOCK;
+      if (k1 > n) k1 = n;
+
+      for (i = ctx->row; i < rend && i < c1; i++) {
+
+        r = i - ctx->row;
+
+        for (c = (c0 > i) ? c0 : i; c < c1; c++) {
+
+          kk = (k0 > c) ? k0 : c;
+          if (kk >= k1) continue;
+
+          out[r*n + c] += corr_dot(a + i*n + kk, a + c*n + kk, k1 - kk);
+        }
+      }
+    }
+
+    for (i = ctx->row; i < rend && i < c1; i++) {
+
+      r = i - ctx->row;
+
+      for (c = (c0 > i) ? c0 : i; c < c1; c++) {
+
+        if (c == i) {
+          out[r*n + c] = 1.0;
+          continue;
+        }
+
+        v = -out[r*n + c] / sqrt(ctx->pdiag[i] * ctx->pdiag[c]);
+
+        if      (v >  1.0) v =  1.0;
+        else if (v < -1.0) v = -1.0;
+
+        out[r*n + c] = v;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * Partial correlation between many time series, from a Ledoit-Wolf
+ * shrinkage estimate of their correlation matrix.
+ *
+ * The time series are normalised (see corr_normalise), so that their
+ * sample correlation matrix is R = Y Y', where the rows of Y are the
+ * normalised series. R is shrunk towards a scaled identity matrix:
+ *
+ *   S = (1 - s) R + s m I
+ *
+ * where m is the mean of the diagonal of R, and the shrinkage intensity
+ * s is either given, or estimated with the Ledoit-Wolf formula. The
+ * partial correlation between series i and j is then calculated from the
+ * precision matrix P = S^-1:
+ *
+ *   -P(i,j) / sqrt(P(i,i) P(j,j))
+ *
+ * P can be calculated in two ways. By default, S is formed explicitly,
+ * and factored with a blocked, multi-threaded Cholesky decomposition
+ * S = C C'. The factor is inverted in place, so partial_corr_block
+ * computes each element of P as the dot product of two rows of C^-T. This
+ * needs memory for nseries^2 values.
+ *
+ * Alternately, as R has rank no greater than the time series length, S is
+ * the sum of a diagonal and a low-rank matrix, and the Woodbury identity
+ * gives P directly from a small (len * len) Cholesky decomposition:
+ *
+ *   P = (I - Q Q') / (s m), Q = sqrt(1 - s) Y C^-T, C C' = s m I + (1 - s) Y'Y
+ *
+ * Each row of Q is scaled so that the partial correlations are simply the
+ * dot products of the rows, which are calculated with corr_block. This
+ * needs memory for (nseries * len) values, so is much faster and smaller
+ * when nseries is much larger than len, but requires the shrinkage to be
+ * greater than 0. Both methods give the same values, up to rounding error.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __PARTIAL_CORR_H__
+#define __PARTIAL_CORR_H__
+
+#include <stdint.h>
+
+typedef struct _partial_corr {
+
+  uint32_t nseries;   /**< number of time series                       */
+  uint32_t len;       /**< time series length                          */
+  uint8_t  lowrank;   /**< non-0 if the low-rank form is used          */
+  double   shrinkage; /**< shrinkage intensity                         */
+  double  *data;      /**< low-rank: (nseries * len) scaled rows of Q;
+                           otherwise the (nseries * nseries) matrix,
+                           with C^-T in the upper triangle, and C
+                           below the diagonal                          */
+  double  *pdiag;     /**< diagonal of P (not used in low-rank form)   */
+
+} partial_corr_t;
+
+/**
+ * Normalises the given time series, estimates the shrinkage intensity,
+ * and calculates the precision matrix (or its low-rank form).
+ *
+ * \return 0 on success, non-0 on failure (including if the shrunk matrix
+ * is not positive definite, e.g. because the shrinkage is 0 and there
+ * are more series than time points).
+ */
+uint8_t partial_corr_init(
+  partial_corr_t *pc,        /**< the struct to initialise              */
+  double         *series,    /**< time series, stored contiguously, one
+                                  after the other (they are normalised
+                                  in place)                             */
+  uint32_t        len,       /**< length of each time series            */
+  uint32_t        nseries,   /**< number of time series                 */
+  double          shrinkage, /**< shrinkage intensity in [0, 1], or
+                                  negative to use the Ledoit-Wolf
+                                  estimate                              */
+  uint8_t         lowrank,   /**< use the low-rank form                 */
+  uint16_t        nthreads   /**< number of threads to use (0 - default)*/
+);
+
+/**
+ * Frees the memory used by the given partial_corr_t.
+ */
+void partial_corr_free(
+  partial_corr_t *pc /**< the struct to free */
+);
+
+/**
+ * Calculates a block of rows from the upper triangle of the partial
+ * correlation matrix, in the same layout as corr_block (see
+ * timeseries/correlation.h) - the partial correlation between series
+ * (row+i) and series j, for j >= (row+i), is stored at
+ * out[i*nseries + j]. The diagonal is set to 1.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t partial_corr_block(
+  partial_corr_t *pc,       /**< the precision matrix               */
+  uint32_t        row,      /**< first row of the block             */
+  uint32_t        nrows,    /**< number of rows in the block        */
+  uint16_t        nthreads, /**< number of threads to use           */
+  double         *out       /**< place to store partial correlations */
+);
+
+#endif
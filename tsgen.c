@@ -1,6 +1,8 @@
 /**
  * Program which generates random time series data, and saves it to an
- * ANALYZE75 volume.
+ * ANALYZE75 volume. The images are generated and written in parallel;
+ * every image has its own random number stream (see util/rng.h), so the
+ * output depends only on the seed, and not on the number of threads.
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -12,7 +14,9 @@
 #include <string.h>
 
 #include "io/analyze75.h"
+#include "util/rng.h"
 #include "util/startup.h"
+#include "util/parallel.h"
 
 typedef struct _args {
 
@@ -29,6 +33,9 @@ typedef struct _args {
   double   lo;
   double   hi;
   uint8_t  re;
+  uint16_t nt;
+  double   tw;
+  uint16_t nthreads;
   
 } args_t;
 
@@ -55,6 +62,12 @@ static struct argp_option options[] = {
   {"lo", 'l', "FLOAT", 0, "minimum value"},
   {"hi", 'h', "FLOAT", 0, "maximum value"},
   {"re", 'r',  NULL,   0, "reverse endianness"},
+  {"nt", 'k', "INT",   0, "number of signal templates - voxels which share "\
+                          "a template have correlated time series "\
+                          "(default: 0, no templates)"},
+  {"tw", 'w', "FLOAT", 0, "weight of the template signal, between 0 and 1 "\
+                          "(default: 0.5)"},
+  {NULL,      'j', "INT", 0, "number of threads (default: --threads)"},
   {0}
 };
 
@@ -76,6 +89,9 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
     case 'l': args->lo = atof(arg); break;
     case 'h': args->hi = atof(arg); break;
     case 'r': args->re = 1;         break;
+    case 'k': args->nt = atoi(arg); break;
+    case 'w': args->tw = atof(arg); break;
+    case 'j': args->nthreads = atoi(arg); break;
       
     case ARGP_KEY_ARG:
       if      (state->arg_num == 0) args->output = arg;
@@ -93,6 +109,26 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * Number of values which are generated at a time.
+ */
+#define _GEN_BLOCK 4096
+
+/**
+ * Context passed to _gen_images.
+ */
+typedef struct _gen_ctx {
+
+  args_t   *args;      /**< program arguments                          */
+  dsr_t    *hdr;       /**< header shared by all images                */
+  uint32_t  nvals;     /**< number of values in one image              */
+  double   *templates; /**< args->nt template time series, each of
+                            length args->tn, or NULL                   */
+  uint8_t **imgs;      /**< image buffer for each thread               */
+  double  **vals;      /**< value buffer (_GEN_BLOCK) for each thread  */
+
+} gen_ctx_t;
+
 /**
  * Creates a file name for the given image. Caller is responsible for freeing
  * the memory after use.
@@ -106,14 +142,50 @@ static char * _file_name(
 );
 
 /**
- * Creates one image, according to the arguments.
+ * Creates the header which is shared by all images, according to the
+ * arguments.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_hdr(
+  dsr_t  *hdr, /**< header to populate */
+  args_t *args /**< program arguments  */
+);
+
+/**
+ * Generates the random template time series, from stream 0 of the seed.
  *
  * \return 0 on success, non-0 on failure.
  */
-static uint8_t _create_image(
-  dsr_t    *hdr, /**< header to populate                                    */
-  uint8_t **img, /**< pointer which will be updated to point to a new image */
-  args_t   *args /**< program arguments                                     */
+static uint8_t _create_templates(
+  args_t  *args,     /**< program arguments                       */
+  double **templates /**< pointer which will be updated to point to
+                          the templates                           */
+);
+
+/**
+ * Generates the given image into the given buffer. Each voxel is assigned
+ * to one of the templates, in contiguous runs of voxels; its value is the
+ * template value for this image, mixed with uniform noise, according to
+ * the template weight.
+ */
+static void _create_image(
+  gen_ctx_t *ctx,  /**< generation context                  */
+  uint32_t   ti,   /**< image number (time point)           */
+  uint8_t   *img,  /**< place to store image                */
+  double    *vals  /**< workspace of length _GEN_BLOCK      */
+);
+
+/**
+ * parallel_for function which generates and writes a range of images.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _gen_images(
+  uint64_t  start,  /**< first image             */
+  uint64_t  end,    /**< one past last image     */
+  uint16_t  thread, /**< calling thread          */
+  void     *ctx     /**< pointer to a gen_ctx_t  */
 );
 
 /**
@@ -132,52 +204,80 @@ static double _scale_val(
 int main(int argc, char *argv[]) {
 
   uint32_t    i;
+  uint16_t    nthreads;
   dsr_t       hdr;
-  uint8_t    *img;
-  char       *fname;
+  gen_ctx_t   ctx;
   args_t      args;
   struct argp argp = {options, _parse_opt, "OUTDIR", doc};
 
   memset(&args, 0, sizeof(args));
+  memset(&ctx,  0, sizeof(ctx));
   args.dt = DT_FLOAT;
+  args.tw = 0.5;
 
   startup("tsgen", argc, argv, &argp, &args);
 
-  for (i = 0; i < args.tn; i++) {
+  nthreads = args.nthreads;
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (nthreads >  args.tn)              nthreads = args.tn;
+  if (nthreads == 0)                    nthreads = 1;
 
-    fname = _file_name(args.output, args.tn+args.ts, i+args.ts);
+  if (args.tw < 0 || args.tw > 1) {
+    printf("template weight must be between 0 and 1\n");
+    goto fail;
+  }
 
-    if (fname == NULL) {
-      printf("error generating file name (series too long?)\n");
-      goto fail;
-    }
+  if (_create_hdr(&hdr, &args)) {
+    printf("error creating header (data type %u)\n", args.dt);
+    goto fail;
+  }
 
-    if (_create_image(&hdr, &img, &args)) {
-      printf("error creating image (%s)\n", fname);
-      goto fail;
-    }
+  if (_create_templates(&args, &ctx.templates)) {
+    printf("error creating templates\n");
+    goto fail;
+  }
 
-    if (analyze_write_hdr(fname, &hdr)) {
-      printf("error writing header (%s)\n", fname);
-      goto fail;
-    }
+  ctx.args  = &args;
+  ctx.hdr   = &hdr;
+  ctx.nvals = analyze_num_vals(&hdr);
+  ctx.imgs  = calloc(nthreads, sizeof(uint8_t *));
+  ctx.vals  = calloc(nthreads, sizeof(double  *));
 
-    if (analyze_write_img(fname, &hdr, img)) {
-      printf("error writing image (%s)\n", fname);
-      goto fail;
-    } 
+  if (ctx.imgs == NULL) goto fail;
+  if (ctx.vals == NULL) goto fail;
 
-    free(img);
-    img = NULL;
-    memset(&hdr, 0, sizeof(dsr_t));
+  for (i = 0; i < nthreads; i++) {
+
+    ctx.imgs[i] = malloc((uint64_t)ctx.nvals * analyze_value_size(&hdr));
+    ctx.vals[i] = malloc(_GEN_BLOCK * sizeof(double));
+
+    if (ctx.imgs[i] == NULL) goto fail;
+    if (ctx.vals[i] == NULL) goto fail;
   }
 
+  if (parallel_for(nthreads, args.tn, 1, &ctx, _gen_images)) goto fail;
+
+  for (i = 0; i < nthreads; i++) {
+    free(ctx.imgs[i]);
+    free(ctx.vals[i]);
+  }
+  free(ctx.imgs);
+  free(ctx.vals);
+  if (ctx.templates != NULL) free(ctx.templates);
+
   return 0;
 
 fail:
+  for (i = 0; i < nthreads; i++) {
+    if (ctx.imgs != NULL && ctx.imgs[i] != NULL) free(ctx.imgs[i]);
+    if (ctx.vals != NULL && ctx.vals[i] != NULL) free(ctx.vals[i]);
+  }
+  if (ctx.imgs      != NULL) free(ctx.imgs);
+  if (ctx.vals      != NULL) free(ctx.vals);
+  if (ctx.templates != NULL) free(ctx.templates);
   return 1;
 }
-
 char * _file_name(char *outdir, uint16_t tn, uint16_t ti) {
 
   uint8_t fmtlen;
@@ -212,16 +312,11 @@ fail:
   return NULL;
 }
 
-uint8_t _create_image(dsr_t *hdr, uint8_t **img, args_t *args) {
+uint8_t _create_hdr(dsr_t *hdr, args_t *args) {
 
-  uint64_t i;
-  uint32_t nvals;
-  uint8_t  valsz;
-  uint8_t *limg;
-  double   val;
+  uint8_t valsz;
 
   memset(hdr, 0, sizeof(dsr_t));
-  limg  = NULL;
   valsz = analyze_datatype_size(args->dt);
 
   if (valsz == 0) goto fail;
@@ -240,24 +335,124 @@ uint8_t _create_image(dsr_t *hdr, uint8_t **img, args_t *args) {
   hdr->dime.bitpix   = valsz * 8;
   hdr->rev           = args->re;
 
-  nvals = analyze_num_vals(hdr);
+  return 0;
+  
+fail:
+  return 1;
+}
 
-  limg = malloc(nvals*valsz);
-  if (limg == NULL) goto fail;
+uint8_t _create_templates(args_t *args, double **templates) {
 
-  for (i = 0; i < nvals; i++) {
-    
-    val = rand();
-    val = _scale_val(val, 0, RAND_MAX, args->lo, args->hi);
+  uint64_t i;
+  uint64_t n;
+  double  *t;
+  rng_t    rng;
+
+  *templates = NULL;
+
+  if (args->nt == 0) return 0;
+
+  n = (uint64_t)args->nt * args->tn;
+  t = malloc(n * sizeof(double));
+  if (t == NULL) goto fail;
+
+  rng_stream(&rng, rng_get_seed(), 0);
+
+  for (i = 0; i < n; i++) t[i] = rng_uniform(&rng);
+
+  *templates = t;
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _create_image(gen_ctx_t *ctx, uint32_t ti, uint8_t *img, double *vals) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t len;
+  uint64_t nt;
+  double   tw;
+  double   lo;
+  double   hi;
+  double  *tval;
+  rng_t    rng;
+
+  nt = ctx->args->nt;
+  tw = ctx->args->tw;
+  lo = ctx->args->lo;
+  hi = ctx->args->hi;
+
+  /*stream 0 is used for the templates*/
+  rng_stream(&rng, rng_get_seed(), (uint64_t)ti + 1);
+
+  for (i = 0; i < ctx->nvals; i += len) {
+
+    len = (ctx->nvals - i > _GEN_BLOCK) ? _GEN_BLOCK : ctx->nvals - i;
+
+    for (j = 0; j < len; j++) vals[j] = rng_uniform(&rng);
+
+    /*
+     * mix in the template signal - voxel v uses template
+     * (v * nt / nvals), so each template covers one
+     * contiguous run of voxels
+     */
+    if (nt > 0) {
+
+      tval = ctx->templates + ti;
+
+      for (j = 0; j < len; j++)
+        vals[j] = tw       * tval[((i + j) * nt / ctx->nvals) * ctx->args->tn]
+                + (1 - tw) * vals[j];
+    }
 
-    analyze_write_by_idx(hdr, limg, i, val);
+    for (j = 0; j < len; j++) vals[j] = _scale_val(vals[j], 0, 1, lo, hi);
+
+    analyze_write_block(ctx->hdr, img, i, len, vals);
+  }
+}
+
+uint8_t _gen_images(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t   i;
+  char      *fname;
+  gen_ctx_t *c;
+
+  c     = ctx;
+  fname = NULL;
+
+  for (i = start; i < end; i++) {
+
+    fname = _file_name(c->args->output, 
+                       c->args->tn + c->args->ts,
+                       i           + c->args->ts);
+
+    if (fname == NULL) {
+      printf("error generating file name (series too long?)\n");
+      goto fail;
+    }
+
+    _create_image(c, i, c->imgs[thread], c->vals[thread]);
+
+    if (analyze_write_hdr(fname, c->hdr)) {
+      printf("error writing header (%s)\n", fname);
+      goto fail;
+    }
+
+    if (analyze_write_img(fname, c->hdr, c->imgs[thread])) {
+      printf("error writing image (%s)\n", fname);
+      goto fail;
+    } 
+
+    free(fname);
+    fname = NULL;
   }
 
-  *img = limg;
   return 0;
-  
+
 fail:
-  if (limg != NULL) free(limg);
+  if (fname != NULL) free(fname);
   return 1;
 }
 
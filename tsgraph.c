@@ -14,11 +14,18 @@
 #include "io/mat.h"
 #include "io/ngdb_graph.h"
 #include "util/startup.h"
+#include "util/parallel.h"
 #include "graph/graph.h"
 #include "graph/graph_log.h"
+#include "graph/graph_cbuilder.h"
 
 #define MAX_LABELS 50
 
+/**
+ * Number of rows handed to a worker thread at a time.
+ */
+#define CONNECT_CHUNK_ROWS 16
+
 typedef struct __args {
 
   char    *input;
@@ -31,12 +38,30 @@ typedef struct __args {
   uint8_t  reverse;
   uint8_t  ninclbls;
   uint8_t  nexclbls;
+  uint16_t nthreads;
   
   double   inclbls[MAX_LABELS];
   double   exclbls[MAX_LABELS];  
 
 } args_t;
 
+/**
+ * Context passed to _threshold_rows.
+ */
+typedef struct __connect_ctx {
+
+  mat_t            *mat;       /**< mat file                         */
+  uint32_t         *nodes;     /**< row/column/node ids to include   */
+  uint32_t          nnodes;    /**< number of nodes                  */
+  double            threshold; /**< threshold                        */
+  uint8_t           absval;    /**< use absolute correlation value   */
+  uint8_t           reverse;   /**< reverse threshold                */
+  uint64_t          bufrows;   /**< rows in each row buffer          */
+  double           *rowbufs;   /**< per-thread row buffers           */
+  graph_cbuilder_t *builder;   /**< per-thread edge buffers          */
+
+} connect_ctx_t;
+
 static char doc[] =
   "tsgraph -- generate a graph from a .mat file";
 
@@ -59,6 +84,8 @@ static struct argp_option options[] = {
    "include only rows/columns with this label"},
   {"excl",      'e', "FLOAT", 0,
    "exclude rows/columns with this label"},
+  {NULL,        'j', "INT",   0,
+   "number of threads (default: --threads)"},
   {0}
 };
 
@@ -73,6 +100,7 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
     case 'w': args->weighted  = 1;         break;
     case 't': args->threshold = atof(arg); break;
     case 'r': args->reverse   = 1;         break;
+    case 'j': args->nthreads  = atoi(arg); break;
       
     case 'i':
       if (args->ninclbls < MAX_LABELS) 
@@ -102,6 +130,16 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
   return 0;
 }
 
+/**
+ * Reads all of the row labels from the given mat file, with one read.
+ *
+ * \return a newly allocated buffer containing mat_num_rows labels, each
+ * mat_label_size bytes long, or NULL on failure.
+ */
+static uint8_t * _read_labels(
+  mat_t *mat /**< the matrix file */
+);
+
 /**
  * Compiles a list of row/column IDs (i.e. node IDs) from the given
  * include/exclude lists. The node IDs are stored in the given nodes
@@ -112,6 +150,7 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
  */
 static int64_t _apply_label_mask(
   mat_t    *mat,      /**< the matrix file                           */
+  uint8_t  *labels,   /**< row labels (see _read_labels)             */
   double   *inclbls,  /**< include only rows/columns with this label */
   double   *exclbls,  /**< exclude rows/columns with this label      */
   uint8_t   ninclbls, /**< number of labels in include list          */
@@ -131,20 +170,36 @@ static uint8_t _check_label(
 );
 
 /**
- * Adds edges between the nodes in the graph, according to the correlation
- * values in the matrix file.
+ * Creates the graph, with edges between the nodes according to the
+ * correlation values in the matrix file.
  *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _connect_graph(
   mat_t    *mat,       /**< mat file                             */
-  graph_t  *graph,     /**< initialised empty graph              */
+  graph_t  *graph,     /**< uninitialised graph                  */
   uint32_t *nodes,     /**< row/column/node ids to include       */
   uint32_t  nnodes,    /**< number of nodes                      */
   double    threshold, /**< ignore correlation values below this */
   uint8_t   absval,    /**< use absolute correlation value       */
-  uint8_t   reverse    /**< ignore correlation values above the
+  uint8_t   reverse,   /**< ignore correlation values above the
                             threshold, rather than below         */
+  uint8_t   directed,  /**< create a directed graph              */
+  uint16_t  nthreads   /**< number of threads to use             */
+);
+
+/**
+ * parallel_for function used by _connect_graph. Thresholds the given
+ * range of rows, adding the surviving edges to the calling thread's
+ * edge buffer.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _threshold_rows(
+  uint64_t start,  /**< first row                          */
+  uint64_t end,    /**< one past the last row              */
+  uint16_t thread, /**< thread identifier                  */
+  void    *ctx     /**< pointer to a connect_ctx_t struct  */
 );
 
 /**
@@ -153,10 +208,11 @@ static uint8_t _connect_graph(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _copy_labels(
-  mat_t    *mat,   /**< mat file                     */
-  graph_t  *graph, /**< initialised graph            */
-  uint32_t *nodes, /**< row/column ids into mat file */
-  uint32_t  nnodes /**< number of nodes              */
+  mat_t    *mat,    /**< mat file                       */
+  uint8_t  *labels, /**< row labels (see _read_labels)  */
+  graph_t  *graph,  /**< initialised graph              */
+  uint32_t *nodes,  /**< row/column ids into mat file   */
+  uint32_t  nnodes  /**< number of nodes                */
 );
 
 int main (int argc, char *argv[]) {
@@ -166,12 +222,14 @@ int main (int argc, char *argv[]) {
   mat_t      *mat;
   graph_t     graph;
   uint32_t   *nodes;
+  uint8_t    *labels;
   uint16_t    mathdrlen;
   char       *mathdrmsg;
   int64_t     nnodes;
 
   mathdrmsg = NULL;
   nodes     = NULL;
+  labels    = NULL;
 
   memset(&args, 0, sizeof(args));
   args.threshold = 0.9;
@@ -179,12 +237,19 @@ int main (int argc, char *argv[]) {
   startup("tsgraph", argc, argv, &argp, &args);
 
   /*open mat file*/
-  mat = mat_open(args.input);
+  mat = mat_open_mmap(args.input);
+  if (mat == NULL) mat = mat_open(args.input);
   if (mat == NULL) {
     printf("error opening mat file %s\n", args.input);
     goto fail;
   }
 
+  labels = _read_labels(mat);
+  if (labels == NULL) {
+    printf("error reading row labels\n");
+    goto fail;
+  }
+
   /*figure out which rows/columns to include*/
   nodes = calloc(mat_num_rows(mat), sizeof(uint32_t));
   if (nodes == NULL) {
@@ -194,6 +259,7 @@ int main (int argc, char *argv[]) {
   
   nnodes = _apply_label_mask(
     mat,
+    labels,
     args.inclbls,
     args.exclbls,
     args.ninclbls,
@@ -205,13 +271,7 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
 
-  /*create graph */
-  if (graph_create(&graph, nnodes, args.directed)) {
-    printf("error creating graph\n");
-    goto fail;
-  }
-
-  /*connect graph */
+  /*create and connect graph */
   if (_connect_graph(
         mat,
         &graph,
@@ -219,13 +279,15 @@ int main (int argc, char *argv[]) {
         nnodes,
         args.threshold,
         args.absval,
-        args.reverse)) {
+        args.reverse,
+        args.directed,
+        args.nthreads)) {
     printf("error connecting graph\n");
     goto fail;
   }
 
   /*copy row labels into graph*/
-  if (_copy_labels(mat, &graph, nodes, nnodes)) {
+  if (_copy_labels(mat, labels, &graph, nodes, nnodes)) {
     printf("error copying labels\n");
     goto fail;
   }
@@ -267,16 +329,40 @@ int main (int argc, char *argv[]) {
 
   graph_free(&graph);
   free(nodes);
+  free(labels);
   mat_close(mat);
   return 0;
 
 fail:
   if (nodes  != NULL) free(nodes);
+  if (labels != NULL) free(labels);
   return 1;
 }
 
+uint8_t * _read_labels(mat_t *mat) {
+
+  uint8_t *labels;
+
+  labels = NULL;
+
+  /*labels are copied straight into the graph later on*/
+  if (mat_label_size(mat) < sizeof(graph_label_t)) goto fail;
+
+  labels = malloc(mat_num_rows(mat) * mat_label_size(mat));
+  if (labels == NULL) goto fail;
+
+  if (mat_read_row_labels(mat, 0, mat_num_rows(mat), labels)) goto fail;
+
+  return labels;
+
+fail:
+  if (labels != NULL) free(labels);
+  return NULL;
+}
+
 int64_t _apply_label_mask(
   mat_t    *mat,
+  uint8_t  *labels,
   double   *inclbls,
   double   *exclbls,
   uint8_t   ninclbls,
@@ -286,9 +372,11 @@ int64_t _apply_label_mask(
   uint64_t      i;
   uint32_t      nrows;
   uint32_t      nnodes;
+  uint16_t      lblsize;
   graph_label_t lbl;
 
-  nrows = mat_num_rows(mat);
+  nrows   = mat_num_rows(mat);
+  lblsize = mat_label_size(mat);
 
   if (ninclbls == 0 && nexclbls == 0) {
     
@@ -297,17 +385,14 @@ int64_t _apply_label_mask(
   }
 
   for (i = 0, nnodes = 0; i < nrows; i++) {
-    
-    if (mat_read_row_label(mat, i, &lbl)) goto fail;
+
+    memcpy(&lbl, labels + i*lblsize, sizeof(lbl));
 
     if (_check_label(inclbls, exclbls, ninclbls, nexclbls, lbl.labelval))
       nodes[nnodes++] = i;
   }
 
   return nnodes;
-
-fail:
-  return -1;
 }
 
 uint8_t _check_label(
@@ -341,48 +426,153 @@ uint8_t _connect_graph(
   uint32_t  nnodes,
   double    threshold,
   uint8_t   absval,
-  uint8_t   reverse) {
+  uint8_t   reverse,
+  uint8_t   directed,
+  uint16_t  nthreads) {
+
+  connect_ctx_t    ctx;
+  graph_cbuilder_t builder;
+
+  memset(&ctx,     0, sizeof(ctx));
+  memset(&builder, 0, sizeof(builder));
+
+  /*
+   * reads from a mat file are only thread
+   * safe if it has been memory mapped
+   */
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+  if (!mat_is_mapped(mat))              nthreads = 1;
+
+  ctx.mat       = mat;
+  ctx.nodes     = nodes;
+  ctx.nnodes    = nnodes;
+  ctx.threshold = threshold;
+  ctx.absval    = absval;
+  ctx.reverse   = reverse;
+  ctx.builder   = &builder;
+
+  /*
+   * rows of a tiled file are read a block at
+   * a time (see _threshold_rows)
+   */
+  ctx.bufrows = mat_is_tiled(mat) ? CONNECT_CHUNK_ROWS : 1;
+  ctx.rowbufs = malloc(
+    (uint64_t)nthreads*ctx.bufrows*mat_num_cols(mat)*sizeof(double));
+
+  if (ctx.rowbufs == NULL) goto fail;
+
+  if (graph_cbuilder_init(&builder, nnodes, directed, nthreads)) goto fail;
+
+  /*
+   * each thread adds the edges of its rows to its
+   * own buffer, so the threads never wait on each
+   * other; the buffers are merged by the builder
+   */
+  if (parallel_for(
+        nthreads, nnodes, CONNECT_CHUNK_ROWS, &ctx, _threshold_rows))
+    goto fail;
 
-  uint64_t i;
-  uint64_t j;
-  double   corrval;
-  double   corrvalcpy;
-  uint8_t  addedge;
+  if (graph_cbuilder_finalise(&builder, graph, nthreads)) goto fail;
 
-  for (i = 0; i < nnodes; i++) {
-    for (j = i+1; j < nnodes; j++) {
+  graph_cbuilder_free(&builder);
+  free(ctx.rowbufs);
+  return 0;
+
+fail:
+  graph_cbuilder_free(&builder);
+  if (ctx.rowbufs != NULL) free(ctx.rowbufs);
+  return 1;
+}
+
+uint8_t _threshold_rows(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  connect_ctx_t *ctx;
+  uint64_t       i;
+  uint64_t       j;
+  uint64_t       k;
+  uint64_t       ncols;
+  uint32_t       node;
+  uint32_t       base;
+  double        *buf;
+  double        *row;
+  double         corrval;
+  double         corrvalcpy;
+  uint8_t        addedge;
+
+  ctx   = vctx;
+  ncols = mat_num_cols(ctx->mat);
+  buf   = ctx->rowbufs + thread*ctx->bufrows*ncols;
+  k     = start;
+  base  = 0;
+
+  for (i = start; i < end; i++) {
+
+    node = ctx->nodes[i];
+
+    /*
+     * nodes are in ascending order, so we only need the part of each row
+     * to the right of it. The rows of nodes which are close together are
+     * read as one block - this is only done for tiled files, where a
+     * block is read a tile at a time, so bufrows is 1 otherwise.
+     */
+    if (i == k) {
+
+      base = node;
+
+      for (k = i + 1; k < end; k++) {
+        if (ctx->nodes[k] - base >= ctx->bufrows) break;
+      }
+
+      if (mat_read_block(ctx->mat,
+                         base,
+                         base,
+                         ctx->nodes[k-1] - base + 1,
+                         ncols - base,
+                         buf))
+        goto fail;
+    }
+
+    row = buf + (node - base)*(ncols - base) + (node - base);
 
-      corrval    = mat_read_elem(mat, nodes[i], nodes[j]);
+    for (j = i+1; j < ctx->nnodes; j++) {
+
+      corrval    = row[ctx->nodes[j] - node];
       corrvalcpy = corrval;
-      
-      if (absval) corrval = fabs(corrval);
 
-      if (!reverse) addedge = corrval >= threshold;
-      else          addedge = corrval <= threshold;
-      
+      if (ctx->absval) corrval = fabs(corrval);
+
+      if (!ctx->reverse) addedge = corrval >= ctx->threshold;
+      else               addedge = corrval <= ctx->threshold;
+
       if (addedge) {
-        if (graph_add_edge(graph, i, j, corrvalcpy))
+        if (graph_cbuilder_add(ctx->builder, thread, i, j, corrvalcpy))
           goto fail;
       }
     }
   }
 
   return 0;
-  
+
 fail:
   return 1;
 }
 
 uint8_t _copy_labels(
-  mat_t *mat, graph_t *g, uint32_t *nodes, uint32_t nnodes) {
+  mat_t *mat, uint8_t *labels, graph_t *g, uint32_t *nodes, uint32_t nnodes) {
 
   uint64_t      i;
+  uint16_t      lblsize;
   graph_label_t lbl;
 
+  lblsize = mat_label_size(mat);
+
   for (i = 0; i < nnodes; i++) {
 
-    if (mat_read_row_label( mat, nodes[i], &lbl)) goto fail;
-    if (graph_set_nodelabel(g,   i,        &lbl)) goto fail;
+    memcpy(&lbl, labels + nodes[i]*lblsize, sizeof(lbl));
+
+    if (graph_set_nodelabel(g, i, &lbl)) goto fail;
   }
 
   return 0;
@@ -13,6 +13,7 @@
 #include "util/startup.h"
 #include "io/analyze75.h"
 #include "io/ngdb_graph.h"
+#include "io/mat.h"
 #include "timeseries/analyze_volume.h"
 #include "graph/graph.h"
 
@@ -22,6 +23,7 @@ typedef struct _args {
   char    *lblf;
   char    *maskf;
   char    *ngdbf;
+  char    *matf;
   
   uint8_t  allnode;
   uint32_t nodeidx;
@@ -47,6 +49,8 @@ static struct argp_option options[] = {
   {"byidx",   'i',  NULL,    0, "extract time series by xyz indices"},
   {"byreal",  'r',  NULL,    0, "extract time series by real xyz coordinates"},
   {"avg",     'a',  NULL,    0, "print average of all specified time series"},
+  {"matf",    'b', "FILE",   0, "write time series to a mat file, one per "\
+                                "row, rather than printing them"},
   {"lblval",  'v', "INT",    0, "extract time series with this label"},
   {"x",       'x', "FLOAT",  0, "x index/coordinate"},
   {"y",       'y', "FLOAT",  0, "y index/coordinate"},
@@ -74,6 +78,7 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
     case 'i': args->byidx   = 1;           break;
     case 'r': args->byreal  = 1;           break;
     case 'a': args->avg     = 1;           break;
+    case 'b': args->matf    = arg;         break;
     case 'v': args->lblval  = atoi(arg);   break;
     case 'x': args->x       = atof(arg);   break;
     case 'y': args->y       = atof(arg);   break;
@@ -120,10 +125,35 @@ static uint8_t _make_idx_mask(
   uint8_t          *mask  
 );
 
+/**
+ * Prints the time series of every voxel in the mask, in voxel order, or
+ * their average, or writes them to a mat file. The time series are read
+ * a block of voxels at a time, via the volume time series cache, and each
+ * block is written to the mat file as a single run of rows.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
 static uint8_t _print_by_mask(
   analyze_volume_t *vol,
   uint8_t          *mask,
-  uint8_t           avg
+  uint8_t           avg,
+  char             *matf
+);
+
+/**
+ * Creates a mat file to store the given number of time series. Unless
+ * only an average is being written, each row is labelled with the voxel
+ * indices of its time series.
+ *
+ * \return the new mat file, or NULL on failure.
+ */
+static mat_t * _create_mat(
+  analyze_volume_t *vol,     /**< the volume                        */
+  char             *matf,    /**< name of file to create            */
+  uint32_t         *idxs,    /**< voxel index of each time series   */
+  uint32_t          nseries, /**< number of time series (rows)      */
+  uint8_t           avg      /**< non-0 if only an average is being
+                                  written                           */
 );
 
 static void _print_ts(
@@ -184,7 +214,7 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (_print_by_mask(&vol, mask, args.avg)) {
+  if (_print_by_mask(&vol, mask, args.avg, args.matf)) {
     printf("error printing time series\n");
     goto fail;
   }
@@ -347,53 +377,135 @@ fail:
 }
 
 
-uint8_t _print_by_mask(analyze_volume_t *vol, uint8_t *mask, uint8_t avg) {
+uint8_t _print_by_mask(
+  analyze_volume_t *vol, uint8_t *mask, uint8_t avg, char *matf) {
 
-  uint32_t nseries;
-  uint32_t nvxls;
-  uint64_t i;
-  uint32_t j;
-  double  *tsdata;
-  double  *tsavg;
+  uint32_t  nseries;
+  uint32_t  nvxls;
+  uint32_t  blksz;
+  uint32_t  nblk;
+  uint64_t  i;
+  uint64_t  k;
+  uint32_t  j;
+  uint32_t *idxs;
+  double   *tsdata;
+  double   *tsavg;
+  mat_t    *mat;
 
-  tsdata  = NULL;
+  idxs    = NULL;
   tsavg   = NULL;
+  mat     = NULL;
   nseries = 0;
   nvxls   = analyze_num_vals(vol->hdrs);
 
-  tsdata = calloc(vol->nimgs, sizeof(double));
-  if (tsdata == NULL) goto fail;
+  idxs = malloc(nvxls*sizeof(uint32_t));
+  if (idxs == NULL) goto fail;
   
   tsavg = calloc(vol->nimgs, sizeof(double));
   if (tsavg == NULL) goto fail; 
 
   for (i = 0; i < nvxls; i++) {
+    if (mask[i]) idxs[nseries++] = i;
+  }
 
-    if (!mask[i]) continue;
+  if (matf != NULL) {
+    mat = _create_mat(vol, matf, idxs, avg ? 1 : nseries, avg);
+    if (mat == NULL) goto fail;
+  }
 
-    nseries ++;
-    
-    if (analyze_read_timeseries_by_idx(vol, i, tsdata)) goto fail;
+  /*limit the cache to about 4 million values*/
+  blksz = 4194304 / (vol->nimgs > 0 ? vol->nimgs : 1);
+  if (blksz < 256) blksz = 256;
+
+  for (i = 0; i < nseries; i += nblk) {
+
+    nblk = (nseries - i > blksz) ? blksz : nseries - i;
+
+    if (analyze_cache_volume(vol, idxs + i, nblk)) goto fail;
 
-    for (j = 0; j < vol->nimgs; j++) tsavg[j] += tsdata[j];
+    for (k = 0; k < nblk; k++) {
 
-    if (!avg) _print_ts(vol->nimgs, tsdata);
+      tsdata = vol->tscache + k*vol->nimgs;
+
+      for (j = 0; j < vol->nimgs; j++) tsavg[j] += tsdata[j];
+
+      if (!avg && mat == NULL) _print_ts(vol->nimgs, tsdata);
+    }
+
+    /*the cache holds the block in row order*/
+    if (!avg && mat != NULL) {
+      if (mat_write_rows(mat, i, nblk, vol->tscache)) goto fail;
+    }
   }
 
   for (j = 0; j < vol->nimgs; j++) tsavg[j] /= nseries;
 
-  if (avg) _print_ts(vol->nimgs, tsavg);
+  if (avg && mat != NULL && mat_write_row(mat, 0, tsavg)) goto fail;
+  if (avg && mat == NULL) _print_ts(vol->nimgs, tsavg);
 
-  free(tsdata);
+  if (mat != NULL && mat_close(mat)) {
+    mat = NULL;
+    goto fail;
+  }
+
+  free(idxs);
   free(tsavg);
   return 0;
 fail:
 
-  if (tsdata != NULL) free(tsdata);
-  if (tsavg  != NULL) free(tsavg);
+  if (idxs  != NULL) free(idxs);
+  if (tsavg != NULL) free(tsavg);
+  if (mat   != NULL) mat_close(mat);
   return 1;
 }
 
+mat_t * _create_mat(
+  analyze_volume_t *vol,
+  char             *matf,
+  uint32_t         *idxs,
+  uint32_t          nseries,
+  uint8_t           avg) {
+
+  uint64_t      i;
+  uint32_t      dims[8];
+  ngdb_label_t *labels;
+  mat_t        *mat;
+
+  labels = NULL;
+
+  mat = mat_create(matf,
+                   nseries,
+                   vol->nimgs,
+                   avg ? 0 : (1 << MAT_HAS_ROW_LABELS),
+                   0,
+                   avg ? 0 : sizeof(ngdb_label_t));
+  if (mat == NULL) goto fail;
+
+  if (avg) return mat;
+
+  labels = calloc(nseries, sizeof(ngdb_label_t));
+  if (labels == NULL) goto fail;
+
+  for (i = 0; i < nseries; i++) {
+
+    analyze_get_indices(vol->hdrs, idxs[i], dims);
+
+    labels[i].label.xval = dims[0];
+    labels[i].label.yval = dims[1];
+    labels[i].label.zval = dims[2];
+  }
+
+  if (mat_write_row_labels(mat, 0, nseries, labels)) goto fail;
+
+  free(labels);
+  return mat;
+
+fail:
+  if (labels != NULL) free(labels);
+  if (mat    != NULL) mat_close(mat);
+  return NULL;
+}
+
 void _print_ts(uint16_t len, double *tsdata) {
 
   uint32_t i;
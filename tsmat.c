@@ -1,10 +1,84 @@
 /**
  * Generates a correlation matrix from an ANALYZE75 volume, saving it as a
- * symmetric MAT file.
+ * symmetric MAT file. Alternately, the correlation matrix may be
+ * thresholded as it is calculated, and saved directly as a graph (this is
+ * equivalent to running tsmat followed by tsgraph, but without the
+ * intermediate matrix file).
+ *
+ * A large matrix may be split across several processes (e.g. the tasks
+ * of a cluster job array) with the --shard option. Each process computes
+ * a contiguous range of rows, chosen so that every process computes about
+ * the same number of values from the upper triangle, and writes them
+ * straight into the shared output file; once all processes have finished,
+ * the file is complete. Every process must be given the same arguments,
+ * apart from the shard number.
+ *
+ * With the --checkpoint option, the number of rows which have been
+ * completed is recorded in a small side file after every block of rows is
+ * written. If the side file exists when tsmat is started, the rows which
+ * were completed are kept, and calculation resumes at the first incomplete
+ * block. The side file is deleted once the matrix is complete. Each shard
+ * must be given its own side file.
+ *
+ * With the --window option, a separate correlation matrix (or graph) is
+ * generated for every window of the given length, moving along the time
+ * series by --step time points at a time, for dynamic connectivity
+ * analyses. OUTPUT is then used as a prefix - the file for the window
+ * starting at time point t is called OUTPUT_tttt.mat (or .ngdb). The
+ * correlations are updated incrementally as the window slides (see
+ * timeseries/corr_window.h), which needs memory for nincvxls^2 / 2 values.
+ *
+ * With the --cohe option, the magnitude squared coherence, averaged over
+ * a frequency band, is used instead of Pearson correlation. The spectra of
+ * every time series are calculated once, with Welch's method, and cached
+ * (see timeseries/coherence.h), before any values are calculated.
+ *
+ * With the --partial option, partial correlation is used instead, from a
+ * Ledoit-Wolf shrinkage estimate of the correlation matrix (see
+ * timeseries/partial_corr.h). The precision matrix is calculated once,
+ * before any values are calculated, which needs memory for nincvxls^2
+ * values - or, with the --lowrank option, nincvxls * (time series length)
+ * values, which is much smaller when there are many more voxels than time
+ * points.
+ *
+ * With the --single option, Pearson correlation is calculated in single
+ * precision (see corr_block_float in timeseries/correlation.h), which is
+ * about twice as fast, and differs from the double precision values by
+ * around 1e-7.
+ *
+ * With the --cohort option, the matrices of a whole cohort of subjects,
+ * which share one mask, are calculated in a single run. The subjects are
+ * listed in a file, one "INPUT [OUTPUT]" pair per line. The included
+ * voxels, and the row labels, are worked out once, from the first subject,
+ * and every block of rows is calculated for all of the subjects at once,
+ * on one set of threads. With the --mean option, the mean of the subject
+ * matrices is calculated from the same blocks, and saved as it goes, so
+ * a separate avgmat run is not needed; subjects without an OUTPUT only
+ * contribute to the mean. The time series of every subject are held in
+ * memory at once.
+ *
+ * With the --screen option, in graph mode, the pairs of voxels whose
+ * Pearson correlation cannot pass the threshold are ruled out with cheap
+ * 8 bit quantised correlations, and a conservative bound on their error
+ * (see corr_screen_t in timeseries/correlation.h), and only the remaining
+ * pairs are correlated properly. The graph is identical to that created
+ * without --screen; the higher the threshold, the more time is saved.
+ *
+ * With the --knn option, in graph mode, every voxel is connected to the
+ * K voxels with which it has the highest correlation (or absolute
+ * correlation, with --absval), rather than to those whose correlation
+ * passes a threshold, so that every node has about the same degree. The
+ * K best values seen so far for each voxel are kept in a small heap as
+ * the blocks of rows are calculated, which needs memory for nincvxls * K
+ * values, rather than for the whole matrix. Ties are broken in favour of
+ * the lower voxel index. The graph contains every edge which is among
+ * the K best of either of its end points - with the --mutual option, it
+ * only contains the edges which are among the K best of both.
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 
+#include <math.h>
 #include <argp.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -13,19 +87,50 @@
 
 #include "io/mat.h"
 #include "io/analyze75.h"
+#include "util/progress.h"
 #include "util/startup.h"
+#include "util/parallel.h"
+#include "io/ngdb_graph.h"
 #include "graph/graph.h"
+#include "graph/graph_log.h"
+#include "graph/graph_builder.h"
+#include "timeseries/coherence.h"
+#include "timeseries/corr_window.h"
 #include "timeseries/correlation.h"
+#include "timeseries/partial_corr.h"
 #include "timeseries/analyze_volume.h"
 
 typedef enum {
   CORRTYPE_PEARSON,
-  CORRTYPE_COHERENCE
+  CORRTYPE_COHERENCE,
+  CORRTYPE_PARTIAL
 } corrtype_t;
 
 #define MAX_LABELS        50
 #define MAT_HDR_DATA_SIZE 8192
 
+/**
+ * Number of rows of the correlation matrix which are calculated 
+ * in one go, before being written out to the mat file.
+ */
+#define CORR_BLOCK_ROWS 256
+
+/**
+ * Number of rows of a subject's matrix which are handed out to a thread
+ * at a time in cohort mode. Each block contains a multiple of this many
+ * rows of every subject, and about CORR_BLOCK_ROWS rows in total. It is
+ * a multiple of the tile sizes used by corr_block, coherence_block and
+ * partial_corr_block, so every row is calculated in the same way as in a
+ * single subject run.
+ */
+#define COHORT_ROW_CHUNK 32
+
+/**
+ * Number of voxels which are read in one go, with analyze_read_block,
+ * while figuring out which voxels to include.
+ */
+#define SELECT_BLOCK 4096
+
 typedef struct __args {
 
   char    *input;
@@ -39,14 +144,116 @@ typedef struct __args {
   double   hithresval;
   double   sampletime;
   uint8_t  corrtype;
+  uint16_t nthreads;
+  uint8_t  precision;
+  uint8_t  tiled;
+  uint8_t  graph;
+  double   corrthres;
+  uint8_t  absval;
+  uint8_t  reverse;
   uint8_t  ninclbls;
   uint8_t  nexclbls;
+  uint32_t shard;
+  uint32_t nshards;
+  char    *checkpoint;
+  uint32_t window;
+  uint32_t step;
+  uint32_t seglen;
+  double   lofreq;
+  double   hifreq;
+  double   shrinkage;
+  uint8_t  lowrank;
+  uint8_t  single;
+  uint8_t  screen;
+  uint32_t knn;
+  uint8_t  mutual;
+  char    *cohort;
+  char    *meanf;
   
   double   inclbls[MAX_LABELS];
   double   exclbls[MAX_LABELS];
 
 } args_t;
 
+/**
+ * A correlation measure, prepared for calculating the correlation matrix
+ * in blocks of rows (see _prepare_measure and _measure_block).
+ */
+typedef struct _measure {
+
+  uint8_t         corrtype; /**< correlation measure                    */
+  uint32_t        len;      /**< time series length                     */
+  double         *series;   /**< normalised time series (Pearson)       */
+  float          *fseries;  /**< single precision normalised time series
+                                 (Pearson, with --single), or NULL      */
+  corr_screen_t  *screen;   /**< screen for pairs which cannot pass the
+                                 graph threshold (Pearson, with
+                                 --screen), or NULL                     */
+  coherence_t     coh;      /**< cached spectra (coherence)             */
+  partial_corr_t  pc;       /**< precision matrix (partial correlation) */
+
+} measure_t;
+
+/**
+ * A subject in cohort mode (see _mk_cohort).
+ */
+typedef struct _subject {
+
+  char            *input;    /**< time series volume                   */
+  char            *output;   /**< output file, or NULL if the subject's
+                                  matrix is not saved                  */
+  analyze_volume_t vol;      /**< opened volume                        */
+  uint8_t          volinit;  /**< non-0 if vol has been opened         */
+  measure_t        measure;  /**< prepared correlation measure         */
+  uint8_t          measinit; /**< non-0 if measure has been prepared   */
+  mat_t           *mat;      /**< output file, or NULL                 */
+  double          *block;    /**< the current block of rows            */
+
+} subject_t;
+
+/**
+ * State shared by the threads calculating a block of rows for every
+ * subject in cohort mode.
+ */
+typedef struct _cohort_block {
+
+  subject_t *subjs;    /**< the subjects                              */
+  uint32_t   nsubjs;   /**< number of subjects                        */
+  uint32_t   nincvxls; /**< number of included voxels                 */
+  uint32_t   row;      /**< first row of the block                    */
+  uint32_t   nrows;    /**< number of rows in the block               */
+  double    *mean;     /**< mean of the subject blocks, or NULL       */
+
+} cohort_block_t;
+
+/**
+ * A candidate neighbour in a kNN heap (see _mk_knn_graph).
+ */
+typedef struct _knn_ent {
+
+  double   val; /**< correlation value (absolute, with --absval) */
+  uint32_t idx; /**< the neighbouring voxel                      */
+  float    wt;  /**< correlation value, used as the edge weight  */
+
+} knn_ent_t;
+
+/**
+ * State shared by the threads adding a block of rows to the kNN heaps.
+ */
+typedef struct _knn_block {
+
+  knn_ent_t *heaps;    /**< k candidates for every voxel, as min-heaps,
+                            with the worst candidate at the root       */
+  uint32_t  *sizes;    /**< number of candidates in each heap          */
+  uint32_t   k;        /**< number of neighbours to keep for each voxel */
+  uint32_t   nincvxls; /**< number of included voxels                  */
+  uint8_t    absval;   /**< rank by absolute correlation value         */
+  double    *block;    /**< the current block of rows                  */
+  uint32_t   row;      /**< first row of the block                     */
+  uint32_t   nrows;    /**< number of rows in the block                */
+
+} knn_block_t;
+
 static char doc[] =
 "tsmat -- generate a correlation matrix from an ANALYZE75 volume";
 
@@ -58,18 +265,91 @@ static struct argp_option options[] = {
   {"hithres",    'h', "FLOAT", 0, "high threshold"},
   {"sampletime", 't', "FLOAT", 0, "time between samples"},
   {"pcorr",      'p', NULL,    0, "use pearson correlation"},
-  {"cohe",       'c', NULL,    0, "use coherence (not supported yet)"},
+  {"single",     'F', NULL,    0, "pearson correlation: calculate in "
+                                  "single precision (faster)"},
+  {"cohe",       'c', NULL,    0, "use coherence"},
+  {"seglen",     'L', "INT",   0, "coherence: Welch segment length "
+                                  "(default: the largest power of 2 up "
+                                  "to half the time series, at most 64)"},
+  {"band",       'b', "LO:HI", 0, "coherence: average over this frequency "
+                                  "band, in Hz, or in cycles per sample "
+                                  "if the sample time is not given "
+                                  "(default: all but 0)"},
+  {"partial",    'P', NULL,    0, "use partial correlation"},
+  {"shrinkage",  'H', "FLOAT", 0, "partial correlation: shrinkage "
+                                  "intensity, in [0, 1] (default: "
+                                  "Ledoit-Wolf estimate)"},
+  {"lowrank",    'K', NULL,    0, "partial correlation: use the low-rank "
+                                  "form, for when there are many more "
+                                  "voxels than time points"},
   {"incl",       'i', "FLOAT", 0, "include only voxels with this label"},
   {"excl",       'e', "FLOAT", 0, "exclude voxels with this label"},
+  {NULL,         'j', "INT",   0, "number of threads (default: --threads)"},
+  {"precision",  'r', "BITS",  0, "storage precision - 64, 32 or 16 "
+                                  "(default: 64)"},
+  {"tiled",      'I', NULL,    0, "matrix mode: store the matrix in tiles, "
+                                  "for faster reading of blocks of rows "
+                                  "and columns"},
+  {"graph",      'g', NULL,    0, "save a thresholded graph (.ngdb) "
+                                  "rather than a matrix"},
+  {"corrthres",  'T', "FLOAT", 0, "graph mode: discard correlation values "
+                                  "below this (default: 0.9)"},
+  {"absval",     'a', NULL,    0, "graph mode: use absolute correlation "
+                                  "value"},
+  {"reverse",    'R', NULL,    0, "graph mode: discard correlation values "
+                                  "above the threshold, rather than below"},
+  {"knn",        'n', "K",     0, "graph mode: connect every voxel to "
+                                  "the K voxels it is most correlated "
+                                  "with, rather than using a threshold"},
+  {"mutual",     'u', NULL,    0, "kNN mode: only keep edges between "
+                                  "voxels which are among each other's "
+                                  "K nearest"},
+  {"screen",     'Q', NULL,    0, "graph mode, pearson correlation: rule "
+                                  "out pairs which cannot pass the "
+                                  "threshold with quantised correlations "
+                                  "first (faster for high thresholds)"},
+  {"shard",      'S', "K/N",   0, "matrix mode: compute only shard K of N "
+                                  "(K from 0), writing it into a shared "
+                                  "OUTPUT file"},
+  {"checkpoint", 'k', "FILE",  0, "matrix mode: record progress in this "
+                                  "file, and resume from it if it exists"},
+  {"window",     'w', "LEN",   0, "generate one matrix/graph for every "
+                                  "window of this many time points, "
+                                  "using OUTPUT as a prefix"},
+  {"step",       'W', "INT",   0, "window mode: time points to move the "
+                                  "window by (default: 1)"},
+  {"cohort",     'C', "FILE",  0, "cohort mode: calculate the matrix of "
+                                  "every subject in this file, one "
+                                  "'INPUT [OUTPUT]' per line"},
+  {"mean",       'M', "FILE",  0, "cohort mode: save the mean of the "
+                                  "subject matrices to this file"},
   {0}
 };
 
+/**
+ * Figures out the bounding box of the voxels which may be included in the
+ * correlation matrix, according to the include/exclude labels and the mask
+ * file, so that only that part of the volume needs to be read (see
+ * analyze_open_volume_roi). If neither is given, or they do not restrict
+ * the voxels to a box within a 3D image, found is set to 0, and the whole
+ * volume should be read.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _roi_bounds(
+  args_t   *args, /**< tsmat program arguments                  */
+  uint32_t *lo,   /**< place to store lower corner (inclusive)  */
+  uint32_t *hi,   /**< place to store upper corner (exclusive)  */
+  uint8_t  *found /**< set to non-0 if a bounding box was found */
+);
+
 /**
  * Figures out which voxels to include in the correlation matrix. Creates an
  * array to store the indices of these voxels, and points the given incvxls
  * pointer to this array. Voxel inclusion is determined by a combination of
- * the low/high thresholds, the include/exclude labels, and the mask file (in
- * that order), all specified in the program arguments.
+ * the include/exclude labels, the mask file, and the low/high thresholds
+ * (in that order, so that only the time series of the remaining voxels are
+ * read), all specified in the program arguments.
  *
  * \return number of voxels that have been included on success, -1 on failure.
  */
@@ -82,7 +362,9 @@ static int64_t _create_mask(
 
 /**
  * Updates the given mask array by excluding all voxels which do not lie
- * within the specified low/high threshold values.
+ * within the specified low/high threshold values. The images are read one
+ * at a time, in blocks of SELECT_BLOCK voxels, rather than one time series
+ * at a time, and reading stops as soon as every voxel has been included.
  *
  * \return number of voxels that have been masked on success, -1 on failure. 
  */
@@ -99,6 +381,10 @@ static int64_t _apply_threshold_mask(
  *   1. are contained within the exclbls list, or
  *   2. are not contained within the inclbls list.
  *
+ * The labels are read in blocks of SELECT_BLOCK voxels. For 8 and 16 bit
+ * label images, the result of _check_label is precomputed for every
+ * possible label value, so each voxel is tested with one table lookup.
+ *
  * \return number of voxels that have been masked on success, -1 on failure.
  */
 static int64_t _apply_label_mask(
@@ -125,22 +411,6 @@ static int64_t _apply_file_mask(
   char             *maskf /**< mask file                      */  
 );
 
-/**
- * Checks the given time series data to see if it lies within the given
- * threshold range.
- *
- * \return 1 if the time series lies within the threshold
- * values and should be included, 0 otherwise.
- */
-static uint8_t _threshold(
-  double  *lothres, /**< pointer to low threshold value,
-                         NULL if no low threshold        */
-  double  *hithres, /**< pointer to high threshold value,
-                         NULL if no high threshold       */
-  double  *tsdata,  /**< time series to be checked       */
-  uint32_t len      /**< length of time series           */
-);
-
 /**
  * \return 1 if the label should be included, 0 otherwise.
  */
@@ -159,26 +429,386 @@ static uint8_t _check_label(
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _write_labels(
-  dsr_t    *hdr,     /**< label header              */
-  uint8_t  *img,     /**< label data                */
-  mat_t    *mat,     /**< matrix file               */
-  uint32_t *incvxls, /**< voxels to include         */
-  uint32_t  nincvxls /**< number of included voxels */
+  dsr_t    *hdr,     /**< label header                        */
+  uint8_t  *img,     /**< label data                          */
+  mat_t    *mat,     /**< matrix file (NULL in graph mode)    */
+  graph_t  *graph,   /**< graph (NULL if creating a matrix)   */
+  uint32_t *incvxls, /**< voxels to include                   */
+  uint32_t  nincvxls /**< number of included voxels           */
+);
+
+/**
+ * Loads the time series for all included voxels into the volume time
+ * series cache, where they are stored contiguously, in order, and
+ * normalises them in place (see corr_normalise).
+ *
+ * \return pointer to the normalised time series, or NULL on failure.
+ */
+static double * _prepare_series(
+  analyze_volume_t *vol,     /**< time series volume           */
+  uint32_t         *incvxls, /**< indices of voxels to include */
+  uint32_t          nincvxls /**< number of included voxels    */
+);
+
+/**
+ * Loads the time series for all included voxels into the volume time
+ * series cache, and prepares the correlation measure given in the program
+ * arguments - the series are normalised for Pearson correlation (see
+ * _prepare_series; with --single, a single precision copy is made with
+ * corr_normalise_float), their spectra are calculated for coherence (see
+ * coherence_init), according to the segment length, band and sample time
+ * arguments, or the precision matrix is calculated for partial
+ * correlation (see partial_corr_init).
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _prepare_measure(
+  analyze_volume_t *vol,      /**< time series volume              */
+  args_t           *args,     /**< tsmat program arguments         */
+  uint32_t         *incvxls,  /**< indices of voxels to include    */
+  uint32_t          nincvxls, /**< number of included voxels       */
+  measure_t        *measure   /**< struct to initialise            */
+);
+
+/**
+ * Calculates a block of rows from the upper triangle of the correlation
+ * matrix with the given measure, in the layout used by corr_block.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _measure_block(
+  measure_t *measure,  /**< prepared correlation measure */
+  uint32_t   nincvxls, /**< number of included voxels    */
+  uint32_t   row,      /**< first row of the block       */
+  uint32_t   nrows,    /**< number of rows in the block  */
+  uint16_t   nthreads, /**< number of threads to use     */
+  double    *block     /**< place to store the block     */
+);
+
+/**
+ * Frees any memory used by the given measure (the double precision
+ * Pearson time series are part of the volume, so are freed with it).
+ */
+static void _free_measure(
+  measure_t *measure /**< measure to free */
+);
+
+/**
+ * Calculates the range of rows of the correlation matrix which are
+ * computed by the given shard. The rows are split so that every shard
+ * computes about the same number of values on or above the diagonal -
+ * row i contains (nincvxls - i) of them, so the early shards get fewer
+ * rows than the later ones.
+ */
+static void _shard_rows(
+  uint32_t  nincvxls, /**< number of included voxels        */
+  uint32_t  shard,    /**< shard number, in [0, nshards)    */
+  uint32_t  nshards,  /**< number of shards                 */
+  uint32_t *first,    /**< place to store the first row     */
+  uint32_t *last      /**< place to store one past the last */
+);
+
+/**
+ * Reads the given checkpoint file, which records the progress of a
+ * previous run with the same arguments. If the file does not exist,
+ * nextrow is set to firstrow.
+ *
+ * \return 0 on success, non-0 if the file exists, but is unreadable, or
+ * was saved by a run with different arguments.
+ */
+static uint8_t _read_checkpoint(
+  char     *fname,    /**< checkpoint file                       */
+  uint32_t  nincvxls, /**< number of included voxels             */
+  uint16_t  matflags, /**< mat file flags                        */
+  uint32_t  firstrow, /**< first row calculated by this run      */
+  uint32_t  lastrow,  /**< one past the last row                 */
+  uint32_t *nextrow   /**< place to store the first row which has
+                           not been completed                    */
+);
+
+/**
+ * Saves the given checkpoint file, replacing it atomically, so that a
+ * process which is killed while saving leaves the old file intact.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_checkpoint(
+  char     *fname,    /**< checkpoint file                        */
+  uint32_t  nincvxls, /**< number of included voxels              */
+  uint16_t  matflags, /**< mat file flags                         */
+  uint32_t  firstrow, /**< first row calculated by this run       */
+  uint32_t  lastrow,  /**< one past the last row                  */
+  uint32_t  nextrow   /**< first row which has not been completed */
 );
 
 /**
  * Calculates a correlation value between all pairs of time series,
  * storing the values in the given mat file, which is assumed to
- * have already been created.
+ * have already been created. The matrix is calculated with the given
+ * measure, in blocks of CORR_BLOCK_ROWS rows (see _measure_block), each
+ * of which is written to the file in one go. Only rows firstrow to lastrow-1 are
+ * calculated and written, starting from startrow. If a checkpoint file is
+ * given, the mat file is flushed to disk after each block, and the
+ * checkpoint is updated.
  *
  * \return 0 on success, non-0 on failure.
  */
 static uint8_t _mk_corr_matrix(
-  analyze_volume_t *vol,      /**< time series volume           */
+  measure_t        *measure,  /**< prepared correlation measure */
   mat_t            *mat,      /**< mat file ready for writing   */
-  corrtype_t        corrtype, /**< correlation measure to use   */
-  uint32_t         *incvxls,  /**< indices of voxels to include */
-  uint32_t          nincvxls  /**< number of included voxels    */
+  uint32_t          nincvxls, /**< number of included voxels    */
+  uint16_t          nthreads, /**< number of threads to use     */
+  uint32_t          firstrow, /**< first row to calculate       */
+  uint32_t          lastrow,  /**< one past the last row        */
+  uint32_t          startrow, /**< first row not yet calculated */
+  uint16_t          matflags, /**< mat file flags               */
+  char             *ckptf     /**< checkpoint file, or NULL     */
+);
+
+/**
+ * Calculates a correlation value between all pairs of time series, in
+ * the same way as _mk_corr_matrix, but adds an edge to the given graph
+ * for every pair of voxels whose correlation passes the threshold,
+ * rather than saving the values. The threshold is applied in the same
+ * way as in tsgraph, and edges are added in the same order, so the
+ * resulting graph is identical to that created by tsgraph from the
+ * equivalent matrix file.
+ *
+ * If screen is non-0, the measure must be Pearson correlation, reverse
+ * must be 0 and the threshold must be positive; a corr_screen_t is used
+ * to skip the pairs which cannot pass the threshold.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mk_corr_graph(
+  measure_t        *measure,   /**< prepared correlation measure         */
+  graph_t          *graph,     /**< empty graph with nincvxls nodes      */
+  uint32_t          nincvxls,  /**< number of included voxels            */
+  uint16_t          nthreads,  /**< number of threads to use             */
+  double            threshold, /**< ignore correlation values below this */
+  uint8_t           absval,    /**< use absolute correlation value       */
+  uint8_t           reverse,   /**< ignore correlation values above the
+                                    threshold, rather than below         */
+  uint8_t           screen     /**< screen out pairs which cannot pass  */
+);
+
+/**
+ * Adds an edge to the given graph builder for every pair of voxels, in
+ * the given block of rows of the correlation matrix (see corr_block),
+ * whose correlation passes the threshold.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _add_block_edges(
+  graph_builder_t *builder,   /**< builder for the graph                */
+  double          *block,     /**< block of correlation values          */
+  uint32_t         row,       /**< first row of the block               */
+  uint32_t         nrows,     /**< number of rows in the block          */
+  uint32_t         nincvxls,  /**< number of included voxels            */
+  double           threshold, /**< ignore correlation values below this */
+  uint8_t          absval,    /**< use absolute correlation value       */
+  uint8_t          reverse    /**< ignore correlation values above the
+                                   threshold, rather than below         */
+);
+
+/**
+ * Calculates a correlation value between all pairs of time series, in
+ * the same way as _mk_corr_matrix, and adds an edge to the given graph
+ * from every voxel to each of the k voxels with which it has the highest
+ * correlation (see the --knn option) - or, if mutual is non-0, between
+ * every pair of voxels which each have the other among their k best. The
+ * edge weights are the correlation values.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mk_knn_graph(
+  measure_t *measure,  /**< prepared correlation measure          */
+  graph_t   *graph,    /**< empty graph with nincvxls nodes      */
+  uint32_t   nincvxls, /**< number of included voxels            */
+  uint16_t   nthreads, /**< number of threads to use             */
+  uint32_t   k,        /**< number of neighbours for every voxel */
+  uint8_t    absval,   /**< rank by absolute correlation value   */
+  uint8_t    mutual    /**< only keep mutual neighbours          */
+);
+
+/**
+ * parallel_for function used by _mk_knn_graph, which offers the values in
+ * rows start to end-1 (relative to the start of the block) to the heaps
+ * of those rows.
+ *
+ * \return 0.
+ */
+static uint8_t _knn_rows(
+  uint64_t start,  /**< first row, relative to the block start */
+  uint64_t end,    /**< one past the last row                  */
+  uint16_t thread, /**< calling thread                         */
+  void    *ctx     /**< pointer to a knn_block_t               */
+);
+
+/**
+ * parallel_for function used by _mk_knn_graph, which offers the values in
+ * columns start to end-1 of the block (the upper triangle only) to the
+ * heaps of those columns.
+ *
+ * \return 0.
+ */
+static uint8_t _knn_cols(
+  uint64_t start,  /**< first column              */
+  uint64_t end,    /**< one past the last column  */
+  uint16_t thread, /**< calling thread            */
+  void    *ctx     /**< pointer to a knn_block_t  */
+);
+
+/**
+ * Offers a candidate neighbour to the given heap. It is added if the heap
+ * has fewer than k candidates, or if it is better than the worst of them,
+ * which it then replaces. A candidate is better than another if it has a
+ * higher value, or the same value and a lower index.
+ */
+static void _knn_offer(
+  knn_ent_t *heap,  /**< the heap                     */
+  uint32_t  *size,  /**< number of candidates in heap */
+  uint32_t   k,     /**< capacity of the heap         */
+  double     wt,    /**< candidate correlation value  */
+  uint32_t   idx,   /**< candidate index              */
+  uint8_t    absval /**< rank by absolute value       */
+);
+
+/**
+ * \return non-0 if candidate a is worse than candidate b - it has a lower
+ * value, or the same value and a higher index. The root of a kNN heap is
+ * its worst candidate.
+ */
+static uint8_t _knn_worse(
+  knn_ent_t *a, /**< first candidate  */
+  knn_ent_t *b  /**< second candidate */
+);
+
+/**
+ * Compares two knn_ent_t structs by their idx, for sorting the kNN heaps
+ * once they are complete, so that they can be searched with bsearch.
+ */
+static int _compare_knn_idx(
+  const void *a, /**< pointer to a knn_ent_t */
+  const void *b  /**< pointer to a knn_ent_t */
+);
+
+/**
+ * Calculates the correlation matrix of every window of the time series,
+ * as specified by the window and step arguments, and saves each one as a
+ * mat file or, in graph mode, as a thresholded graph. The output file for
+ * the window starting at time point t is named with the output argument,
+ * followed by _tttt, and then the suffix. The given header data has a line
+ * describing the window appended to it in every file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mk_corr_windows(
+  analyze_volume_t *vol,      /**< time series volume              */
+  args_t           *args,     /**< tsmat program arguments         */
+  dsr_t            *lblhdr,   /**< label header, NULL if no labels */
+  uint8_t          *lblimg,   /**< label data, NULL if no labels   */
+  uint32_t         *incvxls,  /**< indices of voxels to include    */
+  uint32_t          nincvxls, /**< number of included voxels       */
+  uint16_t          matflags, /**< mat file flags                  */
+  char             *hdrdata   /**< header data for every file      */
+);
+
+/**
+ * Creates the header data which is saved to the output file - the header
+ * message given in the program arguments, if any, followed by a line
+ * describing the dimensions of the given volume.
+ *
+ * \return the header data, or NULL on failure. The caller is responsible
+ * for freeing it.
+ */
+static char * _create_hdr_data(
+  analyze_volume_t *vol, /**< time series volume      */
+  args_t           *args /**< tsmat program arguments */
+);
+
+/**
+ * Creates a row label, from the given label file, for every voxel in the
+ * incvxls list. Labels are stored in mat files as ngdb_label_t records,
+ * with zeroed node metadata, so the label size of the file is the same as
+ * that of an ngdb file.
+ */
+static void _build_labels(
+  dsr_t        *hdr,      /**< label header                          */
+  uint8_t      *img,      /**< label data                            */
+  uint32_t     *incvxls,  /**< voxels to include                     */
+  uint32_t      nincvxls, /**< number of included voxels             */
+  ngdb_label_t *labels    /**< place to store the labels - must have
+                               space for nincvxls labels             */
+);
+
+/**
+ * Reads the subjects from the given cohort file, which contains one
+ * "INPUT [OUTPUT]" pair per line. Empty lines are ignored.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _read_cohort(
+  char       *fname,  /**< cohort file                          */
+  subject_t **subjs,  /**< place to store the list of subjects  */
+  uint32_t   *nsubjs  /**< place to store the number of subjects */
+);
+
+/**
+ * Calculates the correlation matrices of all of the subjects in the
+ * cohort file given in the program arguments, and their mean (see
+ * --cohort and --mean). The voxels to include, and the row labels, are
+ * worked out once, from the first subject, and every other subject must
+ * have the same spatial dimensions. The rows are calculated in blocks,
+ * for all of the subjects at once (see _cohort_rows); each block is
+ * written to every subject's file, and their mean to the mean file, in
+ * the same way as by _mk_corr_matrix.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mk_cohort(
+  args_t  *args,    /**< tsmat program arguments */
+  uint16_t matflags /**< mat file flags          */
+);
+
+/**
+ * parallel_for function used by _mk_cohort. Items are chunks of
+ * COHORT_ROW_CHUNK rows of the current block of one subject - with n
+ * chunks in a block, item i is chunk (i % n) of subject (i / n). Each
+ * chunk is calculated with a single call to _measure_block, with one
+ * thread.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _cohort_rows(
+  uint64_t start,  /**< first item                   */
+  uint64_t end,    /**< one past the last item       */
+  uint16_t thread, /**< calling thread               */
+  void    *ctx     /**< pointer to a cohort_block_t */
+);
+
+/**
+ * parallel_for function used by _mk_cohort, which calculates rows start
+ * to end-1 (relative to the start of the block) of the mean block. The
+ * upper triangle of each subject's row is divided by the number of
+ * subjects and added to the mean, in subject order, in the same way as by
+ * avgmat.
+ *
+ * \return 0.
+ */
+static uint8_t _cohort_mean(
+  uint64_t start,  /**< first row, relative to the block start */
+  uint64_t end,    /**< one past the last row                  */
+  uint16_t thread, /**< calling thread                         */
+  void    *ctx     /**< pointer to a cohort_block_t           */
+);
+
+/**
+ * Closes the files, and frees the memory, of the given subjects.
+ */
+static void _free_subjects(
+  subject_t *subjs, /**< the subjects       */
+  uint32_t   nsubjs /**< number of subjects */
 );
 
 static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
@@ -193,7 +823,38 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
     case 's': args->hdrmsg     = arg;                break;
     case 'p': args->corrtype   = CORRTYPE_PEARSON;   break;
     case 'c': args->corrtype   = CORRTYPE_COHERENCE; break;
+    case 'P': args->corrtype   = CORRTYPE_PARTIAL;   break;
+    case 'F': args->single     = 1;                  break;
+    case 'H': args->shrinkage  = atof(arg);          break;
+    case 'K': args->lowrank    = 1;                  break;
     case 't': args->sampletime = atof(arg);          break;
+    case 'j': args->nthreads   = atoi(arg);          break;
+    case 'r': args->precision  = atoi(arg);          break;
+    case 'I': args->tiled      = 1;                  break;
+    case 'g': args->graph      = 1;                  break;
+    case 'T': args->corrthres  = atof(arg);          break;
+    case 'a': args->absval     = 1;                  break;
+    case 'R': args->reverse    = 1;                  break;
+    case 'Q': args->screen     = 1;                  break;
+    case 'n': args->knn        = atoi(arg);          break;
+    case 'u': args->mutual     = 1;                  break;
+    case 'k': args->checkpoint = arg;                break;
+    case 'w': args->window     = atoi(arg);          break;
+    case 'W': args->step       = atoi(arg);          break;
+    case 'L': args->seglen     = atoi(arg);          break;
+    case 'C': args->cohort     = arg;                break;
+    case 'M': args->meanf      = arg;                break;
+    case 'b':
+      if (sscanf(arg, "%lf:%lf", &(args->lofreq), &(args->hifreq)) != 2 ||
+          args->lofreq > args->hifreq)
+        argp_error(state, "invalid band: %s", arg);
+      break;
+    case 'S':
+      if (sscanf(arg, "%u/%u", &(args->shard), &(args->nshards)) != 2 ||
+          args->nshards == 0 ||
+          args->shard   >= args->nshards)
+        argp_error(state, "invalid shard: %s", arg);
+      break;
     case 'l':
       args->lothresval = atof(arg);
       args->lothres    = &(args->lothresval);
@@ -220,7 +881,11 @@ static error_t _parse_opt (int key, char *arg, struct argp_state *state) {
       break;
 
     case ARGP_KEY_END:
-      if (state->arg_num < 2) argp_usage(state);
+      if (args->cohort != NULL) {
+        if (state->arg_num > 0)
+          argp_error(state, "INPUT and OUTPUT are given in the cohort file");
+      }
+      else if (state->arg_num < 2) argp_usage(state);
       break;
 
     default:
@@ -239,22 +904,144 @@ int main (int argc, char *argv[]) {
   dsr_t            lblhdr;
   dsr_t           *hdrs[2];
   uint8_t         *lblimg;
-  char            *imgmsg;
   char            *hdrdata;
   args_t           args;
-  struct argp      argp = {options, _parse_opt, "INPUT OUTPUT", doc};
+  struct argp      argp = {options, _parse_opt, "INPUT OUTPUT\n-C FILE", doc};
+  uint16_t         matflags;
+  graph_t          graph;
+  uint8_t          graphinit;
+  uint32_t         firstrow;
+  uint32_t         lastrow;
+  uint32_t         startrow;
+  uint32_t         roilo[3];
+  uint32_t         roihi[3];
+  uint8_t          roi;
+  measure_t        measure;
+  uint8_t          measinit;
 
   lblimg  = NULL;
   incvxls = NULL;
   mat     = NULL;
-  imgmsg  = NULL;
   hdrdata = NULL;
+  graphinit = 0;
+  measinit  = 0;
 
   memset(&args, 0, sizeof(args));
+  args.precision = 64;
+  args.corrthres = 0.9;
+  args.step      = 1;
+  args.hifreq    = HUGE_VAL;
+  args.shrinkage = -1;
 
   startup("tsmat", argc, argv, &argp, &args);
 
-  if (analyze_open_volume(args.input, &vol)) {
+  if (args.nshards > 0 && args.graph) {
+    printf("--shard cannot be used in graph mode\n");
+    goto fail;
+  }
+
+  if (args.checkpoint != NULL && args.graph) {
+    printf("--checkpoint cannot be used in graph mode\n");
+    goto fail;
+  }
+
+  if (args.window > 0 && (args.nshards > 0 || args.checkpoint != NULL)) {
+    printf("--shard and --checkpoint cannot be used with --window\n");
+    goto fail;
+  }
+
+  if (args.window > 0 && args.corrtype != CORRTYPE_PEARSON) {
+    printf("--cohe and --partial cannot be used with --window\n");
+    goto fail;
+  }
+
+  if (args.single && (args.corrtype != CORRTYPE_PEARSON || args.window > 0)) {
+    printf("--single can only be used with Pearson correlation, "
+           "without --window\n");
+    goto fail;
+  }
+
+  if (args.screen && (!args.graph                        ||
+                      args.corrtype != CORRTYPE_PEARSON  ||
+                      args.window   >  0                 ||
+                      args.reverse                       ||
+                      args.corrthres <= 0)) {
+    printf("--screen can only be used in graph mode, with Pearson "
+           "correlation and a positive threshold, without --window or "
+           "--reverse\n");
+    goto fail;
+  }
+
+  if (args.knn > 0 && (!args.graph       ||
+                       args.window > 0   ||
+                       args.reverse      ||
+                       args.screen)) {
+    printf("--knn can only be used in graph mode, without --window, "
+           "--reverse or --screen\n");
+    goto fail;
+  }
+
+  if (args.mutual && args.knn == 0) {
+    printf("--mutual can only be used with --knn\n");
+    goto fail;
+  }
+
+  if (args.shrinkage > 1) {
+    printf("invalid shrinkage: %0.6f\n", args.shrinkage);
+    goto fail;
+  }
+
+  if (args.window > 0 && args.step == 0) {
+    printf("invalid step: %u\n", args.step);
+    goto fail;
+  }
+
+  if (args.cohort != NULL && (args.graph              ||
+                              args.nshards    >  0    ||
+                              args.checkpoint != NULL ||
+                              args.window     >  0)) {
+    printf("--graph, --shard, --checkpoint and --window cannot be used "
+           "with --cohort\n");
+    goto fail;
+  }
+
+  /*every subject must have the same voxels*/
+  if (args.cohort != NULL && (args.lothres != NULL || args.hithres != NULL)) {
+    printf("--lothres and --hithres cannot be used with --cohort\n");
+    goto fail;
+  }
+
+  if (args.meanf != NULL && args.cohort == NULL) {
+    printf("--mean can only be used with --cohort\n");
+    goto fail;
+  }
+
+  matflags = (1 << MAT_IS_SYMMETRIC) | (1 << MAT_HAS_ROW_LABELS);
+
+  if (args.tiled) matflags |= (1 << MAT_IS_TILED);
+
+  switch (args.precision) {
+    case 64:                                     break;
+    case 32: matflags |= (1 << MAT_ELEM_FLOAT32); break;
+    case 16: matflags |= (1 << MAT_ELEM_FLOAT16); break;
+    default:
+      printf("invalid precision: %u\n", args.precision);
+      goto fail;
+  }
+
+  if (args.cohort != NULL) {
+
+    if (_mk_cohort(&args, matflags)) goto fail;
+    return 0;
+  }
+
+  if (_roi_bounds(&args, roilo, roihi, &roi)) {
+    printf("error reading label/mask files\n");
+    goto fail;
+  }
+
+  if (roi ? analyze_open_volume_roi(args.input, &vol, roilo, roihi)
+          : analyze_open_volume(    args.input, &vol)) {
     printf("error opening analyze volume from %s\n", args.input);
     goto fail;
   }
@@ -272,6 +1059,12 @@ int main (int argc, char *argv[]) {
     goto fail;
   }
 
+  if (args.window > 0 && (args.window < 2 || args.window > vol.nimgs)) {
+    printf("invalid window length %u (time series length is %u)\n",
+           args.window, vol.nimgs);
+    goto fail;
+  }
+
   /*
    * if a label file was not provided, but a mask file
    * was, use the mask file to set row/column labels 
@@ -299,72 +1092,203 @@ int main (int argc, char *argv[]) {
     }
   }
 
-  mat = mat_create(
-    args.output, nincvxls, nincvxls,
-    (1 << MAT_IS_SYMMETRIC) | (1 << MAT_HAS_ROW_LABELS),
-    MAT_HDR_DATA_SIZE,
-    sizeof(graph_label_t));
+  /*the windowed matrices are calculated from the raw time series*/
+  if (args.window == 0) {
 
-  if (mat == NULL) {
-    printf("error creating mat file %s\n", args.output);
-    goto fail;
-  }
+    if (_prepare_measure(&vol, &args, incvxls, nincvxls, &measure)) {
 
-  imgmsg = malloc(200);
-  if (imgmsg == NULL) {
-    printf("out of memory?\n");
-    goto fail;
-  } 
-  
-  sprintf(
-    imgmsg,
-    "vol dims: %u (%0.6f), y: %u (%0.6f), z: %u (%0.6f), t: %u (%0.6f)",
-    analyze_dim_size(   vol.hdrs, 0),
-    analyze_pixdim_size(vol.hdrs, 0),
-    analyze_dim_size(   vol.hdrs, 1),
-    analyze_pixdim_size(vol.hdrs, 1),
-    analyze_dim_size(   vol.hdrs, 2),
-    analyze_pixdim_size(vol.hdrs, 2),
-    vol.nimgs,
-    args.sampletime);
-
-
-  if (args.hdrmsg != NULL) 
-    hdrdata = malloc(strlen(imgmsg) + strlen(args.hdrmsg) + 3);
-  else
-    hdrdata = malloc(strlen(imgmsg) + 2);
-  
-  if (hdrdata == NULL) {
-    printf("out of memory?\n");
-    goto fail;
+      if      (args.corrtype == CORRTYPE_COHERENCE)
+        printf("error calculating spectra - check the segment length "
+               "and band\n");
+      else if (args.corrtype == CORRTYPE_PARTIAL)
+        printf("error calculating precision matrix - the shrinkage "
+               "may be too small\n");
+      else
+        printf("error loading time series\n");
+      goto fail;
+    }
+    measinit = 1;
   }
 
-  if (args.hdrmsg != NULL) 
-    sprintf(hdrdata, "%s\n%s\n", args.hdrmsg, imgmsg);
-  else
-    sprintf(hdrdata, "%s\n", imgmsg);
+  firstrow = 0;
+  lastrow  = nincvxls;
 
-  if (mat_write_hdr_data(mat, hdrdata, strlen(hdrdata)+1)) {
-    printf("error writing header message \"%s\" to %s\n",
-           hdrdata, args.output);
-    goto fail;
+  if (args.nshards > 0)
+    _shard_rows(nincvxls, args.shard, args.nshards, &firstrow, &lastrow);
+
+  startrow = firstrow;
+
+  if (args.checkpoint != NULL) {
+    if (_read_checkpoint(args.checkpoint,
+                         nincvxls,
+                         matflags,
+                         firstrow,
+                         lastrow,
+                         &startrow)) {
+      printf("checkpoint %s does not match this run\n", args.checkpoint);
+      goto fail;
+    }
+  }
+
+  /*a file is created for each window as it is calculated*/
+  if (args.window > 0);
+
+  else if (args.graph) {
+
+    if (graph_create(&graph, nincvxls, 0)) {
+      printf("error creating graph\n");
+      goto fail;
+    }
+    graphinit = 1;
+  }
+
+  /*rows which have already been completed are kept*/
+  else if (args.nshards > 0 || startrow > firstrow) {
+
+    mat = mat_create_shared(
+      args.output, nincvxls, nincvxls,
+      matflags,
+      MAT_HDR_DATA_SIZE,
+      sizeof(ngdb_label_t));
+
+    if (mat == NULL) {
+      printf("error opening shared mat file %s\n", args.output);
+      goto fail;
+    }
+  }
+
+  else {
+    
+    mat = mat_create(
+      args.output, nincvxls, nincvxls,
+      matflags,
+      MAT_HDR_DATA_SIZE,
+      sizeof(ngdb_label_t));
+
+    if (mat == NULL) {
+      printf("error creating mat file %s\n", args.output);
+      goto fail;
+    }
+  }
+
+  hdrdata = _create_hdr_data(&vol, &args);
+  if (hdrdata == NULL) {
+    printf("out of memory?\n");
+    goto fail;
+  }
+
+  if (args.window > 0) {
+
+    if (_mk_corr_windows(&vol,
+                         &args,
+                         (lblimg != NULL) ? &lblhdr : NULL,
+                         lblimg,
+                         incvxls,
+                         nincvxls,
+                         matflags,
+                         hdrdata)) {
+      printf("error creating windowed correlation matrices\n");
+      goto fail;
+    }
+
+    analyze_free_volume(&vol);
+    free(hdrdata);
+    free(lblimg);
+    free(incvxls);
+
+    return 0;
+  }
+
+  if (args.graph) {
+    if (graph_log_init(&graph) || graph_log_import(&graph, hdrdata, "\n")) {
+      printf("error adding header message \"%s\"\n", hdrdata);
+      goto fail;
+    }
+  }
+  
+  else if (mat_write_hdr_data(mat, hdrdata, strlen(hdrdata)+1)) {
+    printf("error writing header message \"%s\" to %s\n",
+           hdrdata, args.output);
+    goto fail;
   }
   
   if (lblimg != NULL) {
-    if (_write_labels(&lblhdr, lblimg, mat, incvxls, nincvxls)) {
+    if (_write_labels(&lblhdr,
+                      lblimg,
+                      mat,
+                      args.graph ? &graph : NULL,
+                      incvxls,
+                      nincvxls)) {
       printf("error writing labels to %s\n", args.output);
       goto fail;
     }
   }
 
-  if (_mk_corr_matrix(&vol, mat, args.corrtype, incvxls, nincvxls)) {
-    printf("error creating correlation matrix\n");
-    goto fail;
+  if (args.graph && args.knn > 0) {
+
+    if (_mk_knn_graph(&measure,
+                      &graph,
+                      nincvxls,
+                      args.nthreads,
+                      args.knn,
+                      args.absval,
+                      args.mutual)) {
+      printf("error creating kNN graph\n");
+      goto fail;
+    }
+
+    if (ngdb_write(&graph, args.output)) {
+      printf("error writing graph to %s\n", args.output);
+      goto fail;
+    }
+
+    graph_free(&graph);
+  }
+
+  else if (args.graph) {
+
+    if (_mk_corr_graph(&measure,
+                       &graph,
+                       nincvxls,
+                       args.nthreads,
+                       args.corrthres,
+                       args.absval,
+                       args.reverse,
+                       args.screen)) {
+      printf("error creating correlation graph\n");
+      goto fail;
+    }
+
+    if (ngdb_write(&graph, args.output)) {
+      printf("error writing graph to %s\n", args.output);
+      goto fail;
+    }
+
+    graph_free(&graph);
+  }
+
+  else {
+    
+    if (_mk_corr_matrix(&measure,
+                        mat,
+                        nincvxls,
+                        args.nthreads,
+                        firstrow,
+                        lastrow,
+                        startrow,
+                        matflags,
+                        args.checkpoint)) {
+      printf("error creating correlation matrix\n");
+      goto fail;
+    }
+
+    mat_close(mat);
+
+    if (args.checkpoint != NULL) remove(args.checkpoint);
   }
 
-  mat_close(mat);
+  _free_measure(&measure);
   analyze_free_volume(&vol);
-  free(imgmsg);
   free(hdrdata);
   free(lblimg);
   free(incvxls);
@@ -374,6 +1298,92 @@ int main (int argc, char *argv[]) {
 fail:
 
   if (mat != NULL) mat_close(mat);
+  if (graphinit)   graph_free(&graph);
+  if (measinit)    _free_measure(&measure);
+  return 1;
+}
+
+uint8_t _roi_bounds(
+  args_t *args, uint32_t *lo, uint32_t *hi, uint8_t *found) {
+
+  uint64_t i;
+  uint64_t d;
+  uint32_t nvals;
+  uint32_t idxs[5];
+  dsr_t    lblhdr;
+  dsr_t    maskhdr;
+  dsr_t   *hdr;
+  dsr_t   *hdrs[2];
+  uint8_t *lblimg;
+  uint8_t *maskimg;
+  uint8_t  uselbls;
+
+  lblimg  = NULL;
+  maskimg = NULL;
+  hdr     = NULL;
+  *found  = 0;
+  uselbls = args->labelf != NULL && (args->ninclbls + args->nexclbls) > 0;
+
+  if (!uselbls && args->maskf == NULL) return 0;
+
+  if (uselbls) {
+    if (analyze_load(args->labelf, &lblhdr, &lblimg)) goto fail;
+    hdr = &lblhdr;
+  }
+
+  if (args->maskf != NULL) {
+    if (analyze_load(args->maskf, &maskhdr, &maskimg)) goto fail;
+    hdr = &maskhdr;
+  }
+
+  /*incompatible files are reported when the mask is created*/
+  if (uselbls && args->maskf != NULL) {
+
+    hdrs[0] = &lblhdr;
+    hdrs[1] = &maskhdr;
+
+    if (analyze_hdr_compat_ptr(2, hdrs, 1)) goto done;
+  }
+
+  if (analyze_num_dims(hdr) != 3) goto done;
+
+  nvals = analyze_num_vals(hdr);
+
+  for (d = 0; d < 3; d++) {
+    lo[d] = analyze_dim_size(hdr, d);
+    hi[d] = 0;
+  }
+
+  for (i = 0; i < nvals; i++) {
+
+    if (uselbls && !_check_label(args->inclbls,
+                                 args->exclbls,
+                                 args->ninclbls,
+                                 args->nexclbls,
+                                 analyze_read_by_idx(&lblhdr, lblimg, i)))
+      continue;
+
+    if (maskimg != NULL && analyze_read_by_idx(&maskhdr, maskimg, i) == 0)
+      continue;
+
+    analyze_get_indices(hdr, i, idxs);
+
+    for (d = 0; d < 3; d++) {
+      if (idxs[d] <  lo[d]) lo[d] = idxs[d];
+      if (idxs[d] >= hi[d]) hi[d] = idxs[d] + 1;
+    }
+
+    *found = 1;
+  }
+
+done:
+  if (lblimg  != NULL) free(lblimg);
+  if (maskimg != NULL) free(maskimg);
+  return 0;
+
+fail:
+  if (lblimg  != NULL) free(lblimg);
+  if (maskimg != NULL) free(maskimg);
   return 1;
 }
 
@@ -404,14 +1414,6 @@ int64_t _create_mask(
   /*all voxels are included initially*/
   memset(mask, 1, nvals);
 
-  /*masking via low/high time series threshold*/
-  if (args->lothres != NULL || args->hithres != NULL)  {
-    
-    result = _apply_threshold_mask(vol, mask, args->lothres, args->hithres);
-    if (result < 0) goto fail;
-    nincvxls -= result;
-  }
-
   /*masking via label file*/
   if (args->labelf != NULL) {
 
@@ -445,6 +1447,14 @@ int64_t _create_mask(
     nincvxls -= result;
   }
 
+  /*masking via low/high time series threshold*/
+  if (args->lothres != NULL || args->hithres != NULL)  {
+    
+    result = _apply_threshold_mask(vol, mask, args->lothres, args->hithres);
+    if (result < 0) goto fail;
+    nincvxls -= result;
+  }
+
   /*store the indices of voxels to be included in the correlation matrix*/
   lincvxls = malloc(nincvxls * sizeof(uint32_t));
   if (lincvxls == NULL) goto fail;
@@ -471,36 +1481,87 @@ int64_t _apply_threshold_mask(
   double           *lothres,
   double           *hithres) {
 
-  double  *tsdata;
-  uint32_t masked;
-  uint64_t i;
-  uint32_t nvals;
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  t;
+  uint64_t  n;
+  uint32_t  nvals;
+  uint32_t  nblks;
+  uint64_t  npending;
+  uint32_t *blkpending;
+  uint8_t  *pending;
+  double   *vals;
+  double    v;
+  uint32_t  masked;
+
+  vals       = NULL;
+  pending    = NULL;
+  blkpending = NULL;
+  nvals      = analyze_num_vals(vol->hdrs);
+  nblks      = (nvals + SELECT_BLOCK - 1) / SELECT_BLOCK;
+
+  vals       = malloc(SELECT_BLOCK * sizeof(double));
+  pending    = malloc(nvals);
+  blkpending = calloc(nblks, sizeof(uint32_t));
+
+  if (vals == NULL || pending == NULL || blkpending == NULL) goto fail;
+
+  /*
+   * a voxel is pending until one of its values lies within the
+   * thresholds; the number of pending voxels in each block is
+   * kept, so blocks with none left do not need to be read
+   */
+  npending = 0;
+  for (i = 0; i < nvals; i++) {
+    pending[i] = mask[i] != 0;
+    blkpending[i / SELECT_BLOCK] += pending[i];
+    npending                     += pending[i];
+  }
 
-  tsdata = calloc(vol->nimgs, sizeof(double));
-  if (tsdata == NULL) goto fail;
+  for (t = 0; t < vol->nimgs && npending > 0; t++) {
+    for (i = 0; i < nblks; i++) {
 
-  nvals  = analyze_num_vals(vol->hdrs);
-  masked = 0;
+      if (blkpending[i] == 0) continue;
 
-  for (i = 0; i < nvals; i++) {
+      n = SELECT_BLOCK;
+      if (i * SELECT_BLOCK + n > nvals) n = nvals - i * SELECT_BLOCK;
 
-    /*voxel has already been masked*/
-    if (mask[i] == 0) continue;
+      analyze_read_block(
+        vol->hdrs + t, vol->imgs[t], i * SELECT_BLOCK, n, vals);
 
-    if (analyze_read_timeseries_by_idx(vol, i, tsdata))
-      goto fail;
+      for (j = 0; j < n; j++) {
 
-    if (!_threshold(lothres, hithres, tsdata, vol->nimgs)) {
-      masked ++;
+        if (!pending[i * SELECT_BLOCK + j]) continue;
+
+        v = vals[j];
+
+        if (lothres != NULL && v < *lothres) continue;
+        if (hithres != NULL && v > *hithres) continue;
+
+        pending[i * SELECT_BLOCK + j] = 0;
+        blkpending[i] --;
+        npending      --;
+      }
+    }
+  }
+
+  masked = 0;
+  for (i = 0; i < nvals; i++) {
+    if (pending[i]) {
       mask[i] = 0;
+      masked ++;
     }
   }
   
-  free(tsdata);
+  free(vals);
+  free(pending);
+  free(blkpending);
   return masked;
 
 fail:
-  if (tsdata != NULL) free(tsdata);
+  if (vals       != NULL) free(vals);
+  if (pending    != NULL) free(pending);
+  if (blkpending != NULL) free(blkpending);
   return -1;
 }
 
@@ -515,27 +1576,73 @@ static int64_t _apply_label_mask(
   uint8_t           nexclbls
 ) {
 
-  double   lblval;
   uint64_t i;
+  uint64_t j;
+  uint64_t n;
+  int64_t  lutmin;
+  uint64_t lutsize;
+  uint8_t *lut;
+  double  *vals;
+  uint8_t  incl;
   uint32_t masked;
   uint32_t nvals;
 
+  lut    = NULL;
+  vals   = NULL;
   nvals  = analyze_num_vals(vol->hdrs);
   masked = 0;
+
+  if (ninclbls == 0 && nexclbls == 0) return 0;
+
+  switch (analyze_datatype(hdr)) {
+    case DT_UNSIGNED_CHAR: lutmin = 0;      lutsize = 256;   break;
+    case DT_SIGNED_SHORT:  lutmin = -32768; lutsize = 65536; break;
+    default:               lutmin = 0;      lutsize = 0;     break;
+  }
+
+  if (lutsize > 0) {
+
+    lut = malloc(lutsize);
+    if (lut == NULL) goto fail;
+
+    for (i = 0; i < lutsize; i++)
+      lut[i] = _check_label(
+        inclbls, exclbls, ninclbls, nexclbls, (double)(lutmin + (int64_t)i));
+  }
+
+  vals = malloc(SELECT_BLOCK * sizeof(double));
+  if (vals == NULL) goto fail;
   
-  for (i = 0; i < nvals; i++) {
+  for (i = 0; i < nvals; i += SELECT_BLOCK) {
 
-    if (mask[i] == 0) continue;
+    n = SELECT_BLOCK;
+    if (i + n > nvals) n = nvals - i;
 
-    lblval = analyze_read_by_idx(hdr, img, i);
+    analyze_read_block(hdr, img, i, n, vals);
 
-    if (!_check_label(inclbls, exclbls, ninclbls, nexclbls, lblval)) {
-      mask[i] = 0;
-      masked ++;
+    for (j = 0; j < n; j++) {
+
+      if (mask[i+j] == 0) continue;
+
+      if (lut != NULL) incl = lut[(int64_t)vals[j] - lutmin];
+      else             incl = _check_label(
+                         inclbls, exclbls, ninclbls, nexclbls, vals[j]);
+
+      if (!incl) {
+        mask[i+j] = 0;
+        masked ++;
+      }
     }
   }
 
+  if (lut != NULL) free(lut);
+  free(vals);
   return masked;
+
+fail:
+  if (lut  != NULL) free(lut);
+  if (vals != NULL) free(vals);
+  return -1;
 }
 
 int64_t _apply_file_mask(
@@ -546,12 +1653,15 @@ int64_t _apply_file_mask(
   dsr_t   *hdrs[2];
   dsr_t    maskhdr;
   uint8_t *maskimg;
-  double   maskval;  
+  double  *vals;
   uint64_t i;
+  uint64_t j;
+  uint64_t n;
   uint32_t masked;
   uint32_t nvals;
 
   maskimg = NULL;
+  vals    = NULL;
   nvals   = analyze_num_vals(vol->hdrs);
   masked  = 0;
 
@@ -562,50 +1672,35 @@ int64_t _apply_file_mask(
 
   if (analyze_hdr_compat_ptr(2, hdrs, 1)) goto fail;
 
-  for (i = 0; i < nvals; i++) {
+  vals = malloc(SELECT_BLOCK * sizeof(double));
+  if (vals == NULL) goto fail;
 
-    if (mask[i] == 0) continue;
+  for (i = 0; i < nvals; i += SELECT_BLOCK) {
 
-    maskval = analyze_read_by_idx(&maskhdr, maskimg, i);
+    n = SELECT_BLOCK;
+    if (i + n > nvals) n = nvals - i;
 
-    if (maskval == 0) {
-      mask[i] = 0;
-      masked ++;
+    analyze_read_block(&maskhdr, maskimg, i, n, vals);
+
+    for (j = 0; j < n; j++) {
+
+      if (mask[i+j] != 0 && vals[j] == 0) {
+        mask[i+j] = 0;
+        masked ++;
+      }
     }
-  }  
+  }
 
   free(maskimg);
+  free(vals);
   return masked;
   
 fail:
   if (maskimg != NULL) free(maskimg);
+  if (vals    != NULL) free(vals);
   return -1;
 }
 
-uint8_t _threshold(
-  double  *lothres,
-  double  *hithres,
-  double  *tsdata,
-  uint32_t len) {
-
-  uint64_t i;
-
-  for (i = 0; i < len; i++) {
-
-    if ((lothres != NULL) && (hithres != NULL)) {
-      if ((tsdata[i] >= *lothres) && (tsdata[i] <= *hithres)) return 1;
-    }
-    else if (lothres != NULL) {
-      if (tsdata[i] >= *lothres) return 1;
-    }
-    else if (hithres != NULL) {
-      if (tsdata[i] <= *hithres) return 1;
-    }
-  }
-
-  return 0;
-}
-
 uint8_t _check_label(
   double   *inclbls,
   double   *exclbls,
@@ -635,86 +1730,1450 @@ static uint8_t _write_labels(
   dsr_t    *hdr,
   uint8_t  *img,
   mat_t    *mat,
+  graph_t  *graph,
   uint32_t *incvxls,
   uint32_t  nincvxls) {
 
   uint64_t      i;  
-  uint32_t      dims[3];
-  graph_label_t label;
+  ngdb_label_t *labels;
+
+  labels = malloc(((uint64_t)nincvxls + 1) * sizeof(ngdb_label_t));
+  if (labels == NULL) goto fail;
+
+  _build_labels(hdr, img, incvxls, nincvxls, labels);
+
+  if (graph != NULL) {
+    for (i = 0; i < nincvxls; i++) {
+      if (graph_set_nodelabel(graph, i, &(labels[i].label))) goto fail;
+    }
+  }
+
+  /*mat file labels are written with a single write*/
+  else if (mat_write_row_labels(mat, 0, nincvxls, labels)) goto fail;
+
+  free(labels);
+  return 0;
+
+fail:
+  if (labels != NULL) free(labels);
+  return 1;
+}
+
+void _build_labels(
+  dsr_t        *hdr,
+  uint8_t      *img,
+  uint32_t     *incvxls,
+  uint32_t      nincvxls,
+  ngdb_label_t *labels) {
+
+  uint64_t i;
+  uint32_t dims[3];
+
+  memset(labels, 0, nincvxls * sizeof(ngdb_label_t));
 
   for (i = 0; i < nincvxls; i++) {
 
     analyze_get_indices(hdr, incvxls[i], dims);
 
-    label.labelval = analyze_read_by_idx(hdr, img, incvxls[i]);
-    label.xval     = dims[0];
-    label.yval     = dims[1];
-    label.zval     = dims[2];
+    labels[i].label.labelval = analyze_read_by_idx(hdr, img, incvxls[i]);
+    labels[i].label.xval     = dims[0];
+    labels[i].label.yval     = dims[1];
+    labels[i].label.zval     = dims[2];
+  }
+}
+
+char * _create_hdr_data(analyze_volume_t *vol, args_t *args) {
+
+  char  imgmsg[200];
+  char *hdrdata;
+
+  sprintf(
+    imgmsg,
+    "vol dims: %u (%0.6f), y: %u (%0.6f), z: %u (%0.6f), t: %u (%0.6f)",
+    analyze_dim_size(   vol->hdrs, 0),
+    analyze_pixdim_size(vol->hdrs, 0),
+    analyze_dim_size(   vol->hdrs, 1),
+    analyze_pixdim_size(vol->hdrs, 1),
+    analyze_dim_size(   vol->hdrs, 2),
+    analyze_pixdim_size(vol->hdrs, 2),
+    vol->nimgs,
+    args->sampletime);
+
+  if (args->hdrmsg != NULL) 
+    hdrdata = malloc(strlen(imgmsg) + strlen(args->hdrmsg) + 3);
+  else
+    hdrdata = malloc(strlen(imgmsg) + 2);
+  
+  if (hdrdata == NULL) return NULL;
+
+  if (args->hdrmsg != NULL) 
+    sprintf(hdrdata, "%s\n%s\n", args->hdrmsg, imgmsg);
+  else
+    sprintf(hdrdata, "%s\n", imgmsg);
+
+  return hdrdata;
+}
+
+void _shard_rows(
+  uint32_t  nincvxls,
+  uint32_t  shard,
+  uint32_t  nshards,
+  uint32_t *first,
+  uint32_t *last) {
+
+  uint64_t row;
+  uint64_t done;
+  uint64_t total;
+  uint64_t bounds[2];
+  uint32_t rows[2];
+  uint8_t  i;
+
+  total     = (uint64_t)nincvxls * (nincvxls + 1) / 2;
+  bounds[0] = (total * shard)       / nshards;
+  bounds[1] = (total * (shard + 1)) / nshards;
 
-    if (mat_write_row_label(mat, i, &label)) goto fail;
+  /*
+   * a shard starts at the first row before which at least
+   * its share of the values have been computed; integer
+   * arithmetic makes the boundaries identical in every process
+   */
+  for (i = 0; i < 2; i++) {
+
+    done = 0;
+    for (row = 0; row < nincvxls && done < bounds[i]; row++)
+      done += nincvxls - row;
+
+    rows[i] = row;
   }
 
+  *first = rows[0];
+  *last  = rows[1];
+}
+
+uint8_t _read_checkpoint(
+  char     *fname,
+  uint32_t  nincvxls,
+  uint16_t  matflags,
+  uint32_t  firstrow,
+  uint32_t  lastrow,
+  uint32_t *nextrow) {
+
+  FILE    *f;
+  uint32_t vals[5];
+
+  *nextrow = firstrow;
+
+  f = fopen(fname, "r");
+  if (f == NULL) return 0;
+
+  if (fscanf(f, "%u %u %u %u %u",
+             vals, vals+1, vals+2, vals+3, vals+4) != 5) goto fail;
+
+  fclose(f);
+  f = NULL;
+
+  if (vals[0] != nincvxls) goto fail;
+  if (vals[1] != matflags) goto fail;
+  if (vals[2] != firstrow) goto fail;
+  if (vals[3] != lastrow)  goto fail;
+  if (vals[4] <  firstrow) goto fail;
+  if (vals[4] >  lastrow)  goto fail;
+
+  *nextrow = vals[4];
+
   return 0;
 
 fail:
+  if (f != NULL) fclose(f);
+  return 1;
+}
+
+uint8_t _write_checkpoint(
+  char     *fname,
+  uint32_t  nincvxls,
+  uint16_t  matflags,
+  uint32_t  firstrow,
+  uint32_t  lastrow,
+  uint32_t  nextrow) {
+
+  FILE *f;
+  char *tmpf;
+
+  f    = NULL;
+  tmpf = NULL;
+
+  tmpf = malloc(strlen(fname) + 5);
+  if (tmpf == NULL) goto fail;
+
+  sprintf(tmpf, "%s.tmp", fname);
+
+  f = fopen(tmpf, "w");
+  if (f == NULL) goto fail;
+
+  if (fprintf(f, "%u %u %u %u %u\n",
+              nincvxls, matflags, firstrow, lastrow, nextrow) < 0)
+    goto fail;
 
+  if (fclose(f)) {
+    f = NULL;
+    goto fail;
+  }
+  f = NULL;
+
+  if (rename(tmpf, fname)) goto fail;
+
+  free(tmpf);
+  return 0;
+
+fail:
+  if (f    != NULL) fclose(f);
+  if (tmpf != NULL) free(tmpf);
   return 1;
 }
 
 uint8_t _mk_corr_matrix(
-  analyze_volume_t *vol,
+  measure_t        *measure,
   mat_t            *mat,
-  corrtype_t        corrtype,
-  uint32_t         *incvxls,
-  uint32_t          nincvxls
+  uint32_t          nincvxls,
+  uint16_t          nthreads,
+  uint32_t          firstrow,
+  uint32_t          lastrow,
+  uint32_t          startrow,
+  uint16_t          matflags,
+  char             *ckptf
 ) {
 
+  uint64_t  i;
   uint64_t  row;
-  uint64_t  col;
-  uint32_t  len;
-  double    corrval;
-  double   *rowtsdata;
-  double   *coltsdata;
+  uint32_t  nrows;
+  double   *block;
   
-  rowtsdata = NULL;
-  coltsdata = NULL;
+  block = NULL;
 
-  len = vol->nimgs;
+  block = malloc((uint64_t)CORR_BLOCK_ROWS*nincvxls*sizeof(double));
+  if (block == NULL) goto fail;
 
-  rowtsdata = malloc(len*sizeof(double));
-  if (rowtsdata == NULL) goto fail;
-  coltsdata = malloc(len*sizeof(double));
-  if (coltsdata == NULL) goto fail;
+  progress_begin(PROGRESS_ROWS, lastrow - startrow);
 
-  for (row = 0; row < nincvxls; row++) {
-    
-    if (analyze_read_timeseries_by_idx(vol, incvxls[row], rowtsdata))
+  for (row = startrow; row < lastrow; row += nrows) {
+
+    nrows = CORR_BLOCK_ROWS;
+    if (row + nrows > lastrow) nrows = lastrow - row;
+
+    if (_measure_block(measure, nincvxls, row, nrows, nthreads, block))
       goto fail;
-    
-    for (col = row; col < nincvxls; col++) {
 
-      if (col == row) {
-        if (mat_write_elem(mat, row, col, 0.0)) goto fail;
-        continue;
-      }
+    /*self-correlations are stored as 0*/
+    for (i = 0; i < nrows; i++) block[i*nincvxls + row + i] = 0.0;
 
-      if (analyze_read_timeseries_by_idx(vol, incvxls[col], coltsdata))
-        goto fail;
+    if (mat_write_rows(mat, row, nrows, block)) goto fail;
+
+    PROGRESS_ADD(PROGRESS_ROWS, nrows);
 
-      corrval = pearson(rowtsdata, coltsdata, len);
+    /*
+     * the rows must be on disk before the
+     * checkpoint says that they are complete
+     */
+    if (ckptf != NULL) {
 
-      if (mat_write_elem(mat, row, col, corrval))
+      if (mat_sync(mat)) goto fail;
+      if (_write_checkpoint(ckptf,
+                            nincvxls,
+                            matflags,
+                            firstrow,
+                            lastrow,
+                            row + nrows))
         goto fail;
     }
   }
 
-  free(rowtsdata);
-  free(coltsdata);
+  progress_end(PROGRESS_ROWS);
+
+  free(block);
   return 0;
   
 fail:
-  if (rowtsdata != NULL) free(rowtsdata);
-  if (coltsdata != NULL) free(coltsdata);
+  if (block != NULL) free(block);
   
   return 1;
 }
+
+double * _prepare_series(
+  analyze_volume_t *vol, uint32_t *incvxls, uint32_t nincvxls) {
+
+  uint64_t i;
+  uint32_t len;
+  double  *series;
+
+  len = vol->nimgs;
+
+  /*the time series are normalised in place (the volume is not used again)*/
+  if (analyze_cache_volume(vol, incvxls, nincvxls)) goto fail;
+  
+  series = vol->tscache;
+
+  for (i = 0; i < nincvxls; i++) corr_normalise(series + i*len, len);
+
+  return series;
+
+fail:
+  return NULL;
+}
+
+uint8_t _prepare_measure(
+  analyze_volume_t *vol,
+  args_t           *args,
+  uint32_t         *incvxls,
+  uint32_t          nincvxls,
+  measure_t        *measure) {
+
+  uint64_t i;
+  uint32_t seglen;
+
+  memset(measure, 0, sizeof(measure_t));
+
+  measure->corrtype = args->corrtype;
+  measure->len      = vol->nimgs;
+
+  if (args->corrtype == CORRTYPE_PEARSON && args->single) {
+
+    if (analyze_cache_volume(vol, incvxls, nincvxls)) goto fail;
+
+    measure->fseries = malloc(
+      (uint64_t)nincvxls * measure->len * sizeof(float));
+    if (measure->fseries == NULL) goto fail;
+
+    for (i = 0; i < nincvxls; i++)
+      corr_normalise_float(vol->tscache   + i * measure->len,
+                           measure->len,
+                           measure->fseries + i * measure->len);
+
+    return 0;
+  }
+
+  if (args->corrtype == CORRTYPE_PEARSON) {
+    measure->series = _prepare_series(vol, incvxls, nincvxls);
+    if (measure->series == NULL) goto fail;
+    return 0;
+  }
+
+  if (analyze_cache_volume(vol, incvxls, nincvxls)) goto fail;
+
+  if (args->corrtype == CORRTYPE_PARTIAL) {
+
+    /*the time series are normalised in place*/
+    if (partial_corr_init(&(measure->pc),
+                          vol->tscache,
+                          vol->nimgs,
+                          nincvxls,
+                          args->shrinkage,
+                          args->lowrank,
+                          args->nthreads))
+      goto fail;
+
+    return 0;
+  }
+
+  seglen = args->seglen;
+
+  if (seglen == 0) {
+    for (seglen = 64; seglen > 2 && seglen > vol->nimgs / 2; seglen >>= 1);
+  }
+
+  if (coherence_init(&(measure->coh),
+                     vol->tscache,
+                     vol->nimgs,
+                     nincvxls,
+                     seglen,
+                     args->sampletime,
+                     args->lofreq,
+                     args->hifreq,
+                     args->nthreads))
+    goto fail;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _measure_block(
+  measure_t *measure,
+  uint32_t   nincvxls,
+  uint32_t   row,
+  uint32_t   nrows,
+  uint16_t   nthreads,
+  double    *block) {
+
+  switch (measure->corrtype) {
+
+    case CORRTYPE_COHERENCE:
+      return coherence_block(&(measure->coh), row, nrows, nthreads, block);
+
+    case CORRTYPE_PARTIAL:
+      return partial_corr_block(&(measure->pc), row, nrows, nthreads, block);
+
+    default:
+
+      if (measure->screen != NULL && measure->fseries != NULL)
+        return corr_block_float_screen(measure->fseries,
+                                       measure->len,
+                                       nincvxls,
+                                       row,
+                                       nrows,
+                                       nthreads,
+                                       measure->screen,
+                                       block);
+
+      if (measure->screen != NULL)
+        return corr_block_screen(measure->series,
+                                 measure->len,
+                                 nincvxls,
+                                 row,
+                                 nrows,
+                                 nthreads,
+                                 measure->screen,
+                                 block);
+
+      if (measure->fseries != NULL)
+        return corr_block_float(measure->fseries,
+                                measure->len,
+                                nincvxls,
+                                row,
+                                nrows,
+                                nthreads,
+                                block);
+
+      return corr_block(measure->series,
+                        measure->len,
+                        nincvxls,
+                        row,
+                        nrows,
+                        nthreads,
+                        block);
+  }
+}
+
+void _free_measure(measure_t *measure) {
+
+  if      (measure->corrtype == CORRTYPE_COHERENCE)
+    coherence_free(&(measure->coh));
+  else if (measure->corrtype == CORRTYPE_PARTIAL)
+    partial_corr_free(&(measure->pc));
+  else if (measure->fseries != NULL)
+    free(measure->fseries);
+}
+
+uint8_t _mk_corr_graph(
+  measure_t        *measure,
+  graph_t          *graph,
+  uint32_t          nincvxls,
+  uint16_t          nthreads,
+  double            threshold,
+  uint8_t           absval,
+  uint8_t           reverse,
+  uint8_t           screen) {
+
+  uint64_t         row;
+  uint32_t         nrows;
+  double          *block;
+  graph_builder_t  builder;
+  corr_screen_t    scr;
+  
+  block = NULL;
+
+  memset(&builder, 0, sizeof(builder));
+  memset(&scr,     0, sizeof(scr));
+
+  if (graph_builder_init(&builder, graph, nincvxls)) goto fail;
+
+  if (screen) {
+
+    if (measure->corrtype != CORRTYPE_PEARSON || reverse) goto fail;
+
+    if (corr_screen_init(&scr,
+                         measure->series,
+                         measure->fseries,
+                         measure->len,
+                         nincvxls,
+                         threshold,
+                         absval))
+      goto fail;
+
+    measure->screen = &scr;
+  }
+
+  block = malloc((uint64_t)CORR_BLOCK_ROWS*nincvxls*sizeof(double));
+  if (block == NULL) goto fail;
+
+  progress_begin(PROGRESS_ROWS, nincvxls);
+
+  for (row = 0; row < nincvxls; row += nrows) {
+
+    nrows = CORR_BLOCK_ROWS;
+    if (row + nrows > nincvxls) nrows = nincvxls - row;
+
+    if (_measure_block(measure, nincvxls, row, nrows, nthreads, block))
+      goto fail;
+
+    if (_add_block_edges(&builder,
+                         block,
+                         row,
+                         nrows,
+                         nincvxls,
+                         threshold,
+                         absval,
+                         reverse))
+      goto fail;
+
+    PROGRESS_ADD(PROGRESS_ROWS, nrows);
+  }
+
+  progress_end(PROGRESS_ROWS);
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  measure->screen = NULL;
+  corr_screen_free(&scr);
+  graph_builder_free(&builder);
+  free(block);
+  return 0;
+  
+fail:
+  measure->screen = NULL;
+  corr_screen_free(&scr);
+  graph_builder_free(&builder);
+  if (block != NULL) free(block);
+  return 1;
+}
+
+uint8_t _add_block_edges(
+  graph_builder_t *builder,
+  double          *block,
+  uint32_t         row,
+  uint32_t         nrows,
+  uint32_t         nincvxls,
+  double           threshold,
+  uint8_t          absval,
+  uint8_t          reverse) {
+
+  uint64_t i;
+  uint64_t j;
+  double   corrval;
+  double   corrvalcpy;
+  uint8_t  addedge;
+
+  for (i = 0; i < nrows; i++) {
+    for (j = row + i + 1; j < nincvxls; j++) {
+
+      corrval    = block[i*nincvxls + j];
+      corrvalcpy = corrval;
+
+      if (absval) corrval = fabs(corrval);
+
+      if (!reverse) addedge = corrval >= threshold;
+      else          addedge = corrval <= threshold;
+
+      if (addedge) {
+        if (graph_builder_add(builder, row + i, j, corrvalcpy)) goto fail;
+      }
+    }
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _mk_corr_windows(
+  analyze_volume_t *vol,
+  args_t           *args,
+  dsr_t            *lblhdr,
+  uint8_t          *lblimg,
+  uint32_t         *incvxls,
+  uint32_t          nincvxls,
+  uint16_t          matflags,
+  char             *hdrdata) {
+
+  uint64_t        i;
+  uint64_t        row;
+  uint32_t        nrows;
+  uint32_t        start;
+  double         *block;
+  char           *fname;
+  char           *whdrdata;
+  mat_t          *mat;
+  graph_t         graph;
+  uint8_t         graphinit;
+  graph_builder_t builder;
+  corr_window_t   cw;
+
+  block     = NULL;
+  fname     = NULL;
+  whdrdata  = NULL;
+  mat       = NULL;
+  graphinit = 0;
+
+  memset(&builder, 0, sizeof(builder));
+  memset(&cw,      0, sizeof(cw));
+
+  fname    = malloc(strlen(args->output) + 32);
+  whdrdata = malloc(strlen(hdrdata)      + 64);
+  block    = malloc((uint64_t)CORR_BLOCK_ROWS*nincvxls*sizeof(double));
+
+  if (fname == NULL || whdrdata == NULL || block == NULL) goto fail;
+
+  if (analyze_cache_volume(vol, incvxls, nincvxls)) goto fail;
+
+  if (corr_window_init(&cw,
+                       vol->tscache,
+                       vol->nimgs,
+                       nincvxls,
+                       args->window,
+                       args->nthreads))
+    goto fail;
+
+  /*rows of every window*/
+  progress_begin(PROGRESS_ROWS,
+                 (uint64_t)nincvxls *
+                 ((vol->nimgs - args->window) / args->step + 1));
+
+  for (start = 0; ; start += args->step) {
+
+    sprintf(fname, "%s_%04u.%s",
+            args->output, start, args->graph ? "ngdb" : "mat");
+    sprintf(whdrdata, "%swindow: start %u, length %u\n",
+            hdrdata, start, args->window);
+
+    if (args->graph) {
+
+      if (graph_create(&graph, nincvxls, 0)) goto fail;
+      graphinit = 1;
+
+      if (graph_log_init(&graph) || graph_log_import(&graph, whdrdata, "\n"))
+        goto fail;
+
+      if (graph_builder_init(&builder, &graph, nincvxls)) goto fail;
+    }
+    else {
+
+      mat = mat_create(fname, nincvxls, nincvxls,
+                       matflags,
+                       MAT_HDR_DATA_SIZE,
+                       sizeof(ngdb_label_t));
+
+      if (mat == NULL) goto fail;
+
+      if (mat_write_hdr_data(mat, whdrdata, strlen(whdrdata)+1)) goto fail;
+    }
+
+    if (lblimg != NULL) {
+      if (_write_labels(lblhdr,
+                        lblimg,
+                        mat,
+                        args->graph ? &graph : NULL,
+                        incvxls,
+                        nincvxls))
+        goto fail;
+    }
+
+    for (row = 0; row < nincvxls; row += nrows) {
+
+      nrows = CORR_BLOCK_ROWS;
+      if (row + nrows > nincvxls) nrows = nincvxls - row;
+
+      corr_window_block(&cw, row, nrows, block);
+
+      if (args->graph) {
+        if (_add_block_edges(&builder,
+                             block,
+                             row,
+                             nrows,
+                             nincvxls,
+                             args->corrthres,
+                             args->absval,
+                             args->reverse))
+          goto fail;
+      }
+      else {
+
+        /*self-correlations are stored as 0*/
+        for (i = 0; i < nrows; i++) block[i*nincvxls + row + i] = 0.0;
+
+        if (mat_write_rows(mat, row, nrows, block)) goto fail;
+      }
+
+      PROGRESS_ADD(PROGRESS_ROWS, nrows);
+    }
+
+    if (args->graph) {
+
+      if (graph_builder_finalise(&builder)) goto fail;
+      graph_builder_free(&builder);
+
+      if (ngdb_write(&graph, fname)) goto fail;
+
+      graph_free(&graph);
+      graphinit = 0;
+    }
+    else {
+      if (mat_close(mat)) {
+        mat = NULL;
+        goto fail;
+      }
+      mat = NULL;
+    }
+
+    if ((uint64_t)start + args->step + args->window > vol->nimgs) break;
+
+    if (corr_window_slide(&cw, args->step, args->nthreads)) goto fail;
+  }
+
+  progress_end(PROGRESS_ROWS);
+
+  corr_window_free(&cw);
+  free(block);
+  free(fname);
+  free(whdrdata);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  corr_window_free(&cw);
+  if (mat       != NULL) mat_close(mat);
+  if (graphinit)         graph_free(&graph);
+  if (block     != NULL) free(block);
+  if (fname     != NULL) free(fname);
+  if (whdrdata  != NULL) free(whdrdata);
+  return 1;
+}
+
+uint8_t _read_cohort(char *fname, subject_t **subjs, uint32_t *nsubjs) {
+
+  FILE      *f;
+  char       line[4096];
+  char      *input;
+  char      *output;
+  subject_t *list;
+  subject_t *tmp;
+  uint32_t   n;
+  uint32_t   cap;
+
+  f    = NULL;
+  list = NULL;
+  n    = 0;
+  cap  = 0;
+
+  f = fopen(fname, "rt");
+  if (f == NULL) goto fail;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+
+    input  = strtok(line, " \t\r\n");
+    output = strtok(NULL, " \t\r\n");
+
+    if (input == NULL) continue;
+
+    if (n == cap) {
+      cap = (cap == 0) ? 64 : cap * 2;
+      tmp = realloc(list, cap * sizeof(subject_t));
+      if (tmp == NULL) goto fail;
+      list = tmp;
+    }
+
+    memset(list + n, 0, sizeof(subject_t));
+
+    list[n].input = strdup(input);
+    if (list[n].input == NULL) goto fail;
+    n++;
+
+    if (output != NULL) {
+      list[n-1].output = strdup(output);
+      if (list[n-1].output == NULL) goto fail;
+    }
+  }
+
+  if (ferror(f)) goto fail;
+  fclose(f);
+
+  *subjs  = list;
+  *nsubjs = n;
+  return 0;
+
+fail:
+  if (f    != NULL) fclose(f);
+  if (list != NULL) _free_subjects(list, n);
+  return 1;
+}
+
+uint8_t _mk_cohort(args_t *args, uint16_t matflags) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        row;
+  uint32_t        nrows;
+  uint32_t        blkrows;
+  uint32_t        nchunks;
+  uint32_t        nsubjs;
+  uint32_t        nincvxls;
+  int64_t         result;
+  uint32_t       *incvxls;
+  subject_t      *subjs;
+  subject_t      *subj;
+  ngdb_label_t   *labels;
+  dsr_t           lblhdr;
+  uint8_t        *lblimg;
+  dsr_t          *hdrs[2];
+  char           *hdrdata;
+  char           *meanhdr;
+  mat_t          *meanmat;
+  uint32_t        roilo[3];
+  uint32_t        roihi[3];
+  uint8_t         roi;
+  uint8_t         nout;
+  cohort_block_t  blk;
+
+  incvxls = NULL;
+  subjs   = NULL;
+  labels  = NULL;
+  lblimg  = NULL;
+  hdrdata = NULL;
+  meanhdr = NULL;
+  meanmat = NULL;
+  nsubjs  = 0;
+  memset(&blk, 0, sizeof(cohort_block_t));
+
+  if (_read_cohort(args->cohort, &subjs, &nsubjs)) {
+    printf("error reading cohort file %s\n", args->cohort);
+    goto fail;
+  }
+
+  for (i = 0, nout = 0; i < nsubjs; i++) {
+    if (subjs[i].output != NULL) nout = 1;
+  }
+
+  if (nsubjs == 0) {
+    printf("no subjects in cohort file %s\n", args->cohort);
+    goto fail;
+  }
+
+  if (!nout && args->meanf == NULL) {
+    printf("no subject has an OUTPUT, and --mean was not given\n");
+    goto fail;
+  }
+
+  if (_roi_bounds(args, roilo, roihi, &roi)) {
+    printf("error reading label/mask files\n");
+    goto fail;
+  }
+
+  /*the mask, and labels, are worked out from the first subject*/
+  for (i = 0; i < nsubjs; i++) {
+
+    subj = subjs + i;
+
+    if (roi ? analyze_open_volume_roi(subj->input, &subj->vol, roilo, roihi)
+            : analyze_open_volume(    subj->input, &subj->vol)) {
+      printf("error opening analyze volume from %s\n", subj->input);
+      goto fail;
+    }
+    subj->volinit = 1;
+
+    if (i == 0) continue;
+
+    hdrs[0] = subjs[0].vol.hdrs;
+    hdrs[1] = subj->vol.hdrs;
+
+    if (analyze_hdr_compat_ptr(2, hdrs, 1)) {
+      printf("volume files in %s do not match those in %s\n",
+             subj->input, subjs[0].input);
+      goto fail;
+    }
+  }
+
+  result = _create_mask(&subjs[0].vol, &incvxls, args);
+
+  if (result < 0) {
+    printf("error masking voxels\n");
+    goto fail;
+  }
+
+  if (result == 0) {
+    printf("All voxels have been masked - relax your constraints\n");
+    goto fail;
+  }
+
+  nincvxls = result;
+
+  if ((args->labelf == NULL) && (args->maskf != NULL))
+    args->labelf = args->maskf;
+
+  if (args->labelf != NULL) {
+
+    if (analyze_load(args->labelf, &lblhdr, &lblimg)) {
+      printf("error loading label file %s\n", args->labelf);
+      goto fail;
+    }
+
+    hdrs[0] = subjs[0].vol.hdrs;
+    hdrs[1] = &lblhdr;
+
+    if (analyze_hdr_compat_ptr(2, hdrs, 1)) {
+      printf("label file %s does not match volume files in %s\n",
+             args->labelf, subjs[0].input);
+      goto fail;
+    }
+
+    labels = malloc(((uint64_t)nincvxls + 1) * sizeof(ngdb_label_t));
+    if (labels == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+
+    _build_labels(&lblhdr, lblimg, incvxls, nincvxls, labels);
+
+    free(lblimg);
+    lblimg = NULL;
+  }
+
+  for (i = 0; i < nsubjs; i++) {
+
+    subj = subjs + i;
+
+    if (_prepare_measure(&subj->vol, args, incvxls, nincvxls, &subj->measure)) {
+      printf("error preparing correlation measure for %s\n", subj->input);
+      goto fail;
+    }
+    subj->measinit = 1;
+
+    if (subj->output == NULL) continue;
+
+    subj->mat = mat_create(
+      subj->output, nincvxls, nincvxls,
+      matflags,
+      MAT_HDR_DATA_SIZE,
+      sizeof(ngdb_label_t));
+
+    if (subj->mat == NULL) {
+      printf("error creating mat file %s\n", subj->output);
+      goto fail;
+    }
+
+    hdrdata = _create_hdr_data(&subj->vol, args);
+    if (hdrdata == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+
+    if (mat_write_hdr_data(subj->mat, hdrdata, strlen(hdrdata)+1)) {
+      printf("error writing header message to %s\n", subj->output);
+      goto fail;
+    }
+
+    free(hdrdata);
+    hdrdata = NULL;
+
+    if (labels != NULL &&
+        mat_write_row_labels(subj->mat, 0, nincvxls, labels)) {
+      printf("error writing labels to %s\n", subj->output);
+      goto fail;
+    }
+  }
+
+  if (args->meanf != NULL) {
+
+    meanmat = mat_create(
+      args->meanf, nincvxls, nincvxls,
+      matflags,
+      MAT_HDR_DATA_SIZE,
+      sizeof(ngdb_label_t));
+
+    if (meanmat == NULL) {
+      printf("error creating mat file %s\n", args->meanf);
+      goto fail;
+    }
+
+    hdrdata = _create_hdr_data(&subjs[0].vol, args);
+    meanhdr = malloc((hdrdata != NULL ? strlen(hdrdata) : 0) + 64);
+    if (hdrdata == NULL || meanhdr == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+
+    sprintf(meanhdr, "%scohort mean: %u subjects\n", hdrdata, nsubjs);
+
+    if (mat_write_hdr_data(meanmat, meanhdr, strlen(meanhdr)+1)) {
+      printf("error writing header message to %s\n", args->meanf);
+      goto fail;
+    }
+
+    if (labels != NULL &&
+        mat_write_row_labels(meanmat, 0, nincvxls, labels)) {
+      printf("error writing labels to %s\n", args->meanf);
+      goto fail;
+    }
+  }
+
+  /*
+   * each block contains about CORR_BLOCK_ROWS rows in
+   * total, so memory use does not grow much with the
+   * number of subjects
+   */
+  blkrows = CORR_BLOCK_ROWS / nsubjs;
+  blkrows = blkrows - blkrows % COHORT_ROW_CHUNK;
+  if (blkrows < COHORT_ROW_CHUNK) blkrows = COHORT_ROW_CHUNK;
+  if (blkrows > nincvxls)         blkrows = nincvxls;
+
+  for (i = 0; i < nsubjs; i++) {
+
+    subjs[i].block = malloc((uint64_t)blkrows * nincvxls * sizeof(double));
+
+    if (subjs[i].block == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+  }
+
+  if (meanmat != NULL) {
+
+    blk.mean = malloc((uint64_t)blkrows * nincvxls * sizeof(double));
+
+    if (blk.mean == NULL) {
+      printf("out of memory?\n");
+      goto fail;
+    }
+  }
+
+  blk.subjs    = subjs;
+  blk.nsubjs   = nsubjs;
+  blk.nincvxls = nincvxls;
+
+  progress_begin(PROGRESS_ROWS, nincvxls);
+
+  for (row = 0; row < nincvxls; row += nrows) {
+
+    nrows = blkrows;
+    if (row + nrows > nincvxls) nrows = nincvxls - row;
+
+    blk.row   = row;
+    blk.nrows = nrows;
+
+    nchunks = (nrows + COHORT_ROW_CHUNK - 1) / COHORT_ROW_CHUNK;
+
+    if (parallel_for(args->nthreads,
+                     (uint64_t)nsubjs * nchunks,
+                     1,
+                     &blk,
+                     _cohort_rows)) {
+      printf("error creating correlation matrices\n");
+      goto fail;
+    }
+
+    for (i = 0; i < nsubjs; i++) {
+
+      if (subjs[i].mat == NULL) continue;
+
+      /*self-correlations are stored as 0*/
+      for (j = 0; j < nrows; j++)
+        subjs[i].block[j*nincvxls + row + j] = 0.0;
+
+      if (mat_write_rows(subjs[i].mat, row, nrows, subjs[i].block)) {
+        printf("error writing rows to %s\n", subjs[i].output);
+        goto fail;
+      }
+    }
+
+    if (meanmat != NULL) {
+
+      if (parallel_for(args->nthreads,
+                       nrows,
+                       COHORT_ROW_CHUNK,
+                       &blk,
+                       _cohort_mean)) {
+        printf("error creating mean matrix\n");
+        goto fail;
+      }
+
+      for (j = 0; j < nrows; j++) blk.mean[j*nincvxls + row + j] = 0.0;
+
+      if (mat_write_rows(meanmat, row, nrows, blk.mean)) {
+        printf("error writing rows to %s\n", args->meanf);
+        goto fail;
+      }
+    }
+
+    PROGRESS_ADD(PROGRESS_ROWS, nrows);
+  }
+
+  progress_end(PROGRESS_ROWS);
+
+  if (meanmat != NULL && mat_close(meanmat)) {
+    meanmat = NULL;
+    printf("error writing mat file %s\n", args->meanf);
+    goto fail;
+  }
+  meanmat = NULL;
+
+  for (i = 0; i < nsubjs; i++) {
+
+    if (subjs[i].mat == NULL) continue;
+
+    if (mat_close(subjs[i].mat)) {
+      subjs[i].mat = NULL;
+      printf("error writing mat file %s\n", subjs[i].output);
+      goto fail;
+    }
+    subjs[i].mat = NULL;
+  }
+
+  _free_subjects(subjs, nsubjs);
+  if (blk.mean != NULL) free(blk.mean);
+  if (labels   != NULL) free(labels);
+  free(incvxls);
+  free(hdrdata);
+  free(meanhdr);
+  return 0;
+
+fail:
+  if (subjs    != NULL) _free_subjects(subjs, nsubjs);
+  if (meanmat  != NULL) mat_close(meanmat);
+  if (blk.mean != NULL) free(blk.mean);
+  if (labels   != NULL) free(labels);
+  if (lblimg   != NULL) free(lblimg);
+  if (incvxls  != NULL) free(incvxls);
+  if (hdrdata  != NULL) free(hdrdata);
+  if (meanhdr  != NULL) free(meanhdr);
+  return 1;
+}
+
+uint8_t _cohort_rows(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t        i;
+  uint64_t        r;
+  uint64_t        nrows;
+  uint64_t        nchunks;
+  cohort_block_t *blk;
+  subject_t      *subj;
+
+  blk     = ctx;
+  nchunks = (blk->nrows + COHORT_ROW_CHUNK - 1) / COHORT_ROW_CHUNK;
+
+  for (i = start; i < end; i++) {
+
+    subj  = blk->subjs + i / nchunks;
+    r     = (i % nchunks) * COHORT_ROW_CHUNK;
+    nrows = COHORT_ROW_CHUNK;
+
+    if (r + nrows > blk->nrows) nrows = blk->nrows - r;
+
+    if (_measure_block(&subj->measure,
+                       blk->nincvxls,
+                       blk->row + r,
+                       nrows,
+                       1,
+                       subj->block + r * blk->nincvxls))
+      goto fail;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _cohort_mean(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t        i;
+  uint64_t        j;
+  uint64_t        s;
+  uint64_t        n;
+  double         *out;
+  double         *vals;
+  cohort_block_t *blk;
+
+  blk = ctx;
+  n   = blk->nincvxls;
+
+  for (i = start; i < end; i++) {
+
+    out = blk->mean + i * n;
+
+    memset(out, 0, n * sizeof(double));
+
+    /*only the upper triangle is stored*/
+    for (s = 0; s < blk->nsubjs; s++) {
+
+      vals = blk->subjs[s].block + i * n;
+
+      for (j = blk->row + i; j < n; j++) out[j] += vals[j] / blk->nsubjs;
+    }
+  }
+
+  return 0;
+}
+
+void _free_subjects(subject_t *subjs, uint32_t nsubjs) {
+
+  uint64_t i;
+
+  for (i = 0; i < nsubjs; i++) {
+
+    if (subjs[i].mat      != NULL) mat_close(subjs[i].mat);
+    if (subjs[i].measinit)         _free_measure(&subjs[i].measure);
+    if (subjs[i].volinit)          analyze_free_volume(&subjs[i].vol);
+    if (subjs[i].block    != NULL) free(subjs[i].block);
+    if (subjs[i].input    != NULL) free(subjs[i].input);
+    if (subjs[i].output   != NULL) free(subjs[i].output);
+  }
+
+  free(subjs);
+}
+
+uint8_t _mk_knn_graph(
+  measure_t *measure,
+  graph_t   *graph,
+  uint32_t   nincvxls,
+  uint16_t   nthreads,
+  uint32_t   k,
+  uint8_t    absval,
+  uint8_t    mutual) {
+
+  uint64_t        row;
+  uint64_t        i;
+  uint64_t        j;
+  uint32_t        nrows;
+  double         *block;
+  knn_ent_t      *heaps;
+  uint32_t       *sizes;
+  knn_ent_t      *ent;
+  knn_ent_t       key;
+  knn_block_t     kb;
+  graph_builder_t builder;
+
+  block = NULL;
+  heaps = NULL;
+  sizes = NULL;
+
+  memset(&builder, 0, sizeof(builder));
+
+  if (nincvxls < 2) return 0;
+  if (k > nincvxls - 1) k = nincvxls - 1;
+
+  block = malloc((uint64_t)CORR_BLOCK_ROWS*nincvxls*sizeof(double));
+  heaps = malloc((uint64_t)nincvxls*k*sizeof(knn_ent_t));
+  sizes = calloc(nincvxls, sizeof(uint32_t));
+
+  if (block == NULL) goto fail;
+  if (heaps == NULL) goto fail;
+  if (sizes == NULL) goto fail;
+
+  kb.heaps    = heaps;
+  kb.sizes    = sizes;
+  kb.k        = k;
+  kb.nincvxls = nincvxls;
+  kb.absval   = absval;
+  kb.block    = block;
+
+  progress_begin(PROGRESS_ROWS, nincvxls);
+
+  for (row = 0; row < nincvxls; row += nrows) {
+
+    nrows = CORR_BLOCK_ROWS;
+    if (row + nrows > nincvxls) nrows = nincvxls - row;
+
+    if (_measure_block(measure, nincvxls, row, nrows, nthreads, block))
+      goto fail;
+
+    kb.row   = row;
+    kb.nrows = nrows;
+
+    /*
+     * every value is offered to the heap of its row, and
+     * then to the heap of its column, so each heap is only
+     * updated by one thread at a time
+     */
+    if (parallel_for(nthreads, nrows,          1,   &kb, _knn_rows))
+      goto fail;
+    if (parallel_for(nthreads, nincvxls - row, 256, &kb, _knn_cols))
+      goto fail;
+
+    PROGRESS_ADD(PROGRESS_ROWS, nrows);
+  }
+
+  progress_end(PROGRESS_ROWS);
+
+  free(block);
+  block = NULL;
+
+  if (graph_builder_init(&builder, graph, nincvxls)) goto fail;
+
+  if (mutual) {
+    for (i = 0; i < nincvxls; i++)
+      qsort(heaps + i*k, sizes[i], sizeof(knn_ent_t), _compare_knn_idx);
+  }
+
+  for (i = 0; i < nincvxls; i++) {
+    for (j = 0; j < sizes[i]; j++) {
+
+      ent = heaps + i*k + j;
+
+      /*each mutual edge is added once, from its low end point*/
+      if (mutual) {
+
+        key.idx = i;
+
+        if (ent->idx < i) continue;
+        if (bsearch(&key,
+                    heaps + (uint64_t)ent->idx * k,
+                    sizes[ent->idx],
+                    sizeof(knn_ent_t),
+                    _compare_knn_idx) == NULL)
+          continue;
+      }
+
+      if (graph_builder_add(&builder, i, ent->idx, ent->wt)) goto fail;
+    }
+  }
+
+  if (graph_builder_finalise(&builder)) goto fail;
+
+  graph_builder_free(&builder);
+  free(heaps);
+  free(sizes);
+  return 0;
+
+fail:
+  graph_builder_free(&builder);
+  if (block != NULL) free(block);
+  if (heaps != NULL) free(heaps);
+  if (sizes != NULL) free(sizes);
+  return 1;
+}
+
+uint8_t _knn_rows(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  knn_block_t *kb;
+  uint64_t     i;
+  uint64_t     j;
+  uint64_t     u;
+
+  kb = ctx;
+
+  for (i = start; i < end; i++) {
+
+    u = kb->row + i;
+
+    for (j = u + 1; j < kb->nincvxls; j++) {
+      _knn_offer(kb->heaps + u * kb->k,
+                 kb->sizes + u,
+                 kb->k,
+                 kb->block[i * kb->nincvxls + j],
+                 j,
+                 kb->absval);
+    }
+  }
+
+  return 0;
+}
+
+uint8_t _knn_cols(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  knn_block_t *kb;
+  uint64_t     i;
+  uint64_t     j;
+  uint64_t     v;
+
+  kb = ctx;
+
+  for (j = start; j < end; j++) {
+
+    v = kb->row + j;
+
+    for (i = 0; i < kb->nrows && kb->row + i < v; i++) {
+      _knn_offer(kb->heaps + v * kb->k,
+                 kb->sizes + v,
+                 kb->k,
+                 kb->block[i * kb->nincvxls + v],
+                 kb->row + i,
+                 kb->absval);
+    }
+  }
+
+  return 0;
+}
+
+void _knn_offer(
+  knn_ent_t *heap,
+  uint32_t  *size,
+  uint32_t   k,
+  double     wt,
+  uint32_t   idx,
+  uint8_t    absval) {
+
+  uint64_t  i;
+  uint64_t  c;
+  uint64_t  n;
+  double    val;
+  knn_ent_t tmp;
+
+  val = absval ? fabs(wt) : wt;
+  n   = *size;
+
+  tmp.val = val;
+  tmp.idx = idx;
+  tmp.wt  = wt;
+
+  /*the heap is not yet full - sift the candidate up*/
+  if (n < k) {
+
+    i = n;
+    while (i > 0 && _knn_worse(&tmp, heap + (i-1) / 2)) {
+      heap[i] = heap[(i-1) / 2];
+      i       = (i-1) / 2;
+    }
+
+    heap[i] = tmp;
+    *size   = n + 1;
+    return;
+  }
+
+  if (!_knn_worse(heap, &tmp)) return;
+
+  /*replace the worst candidate, and sift down*/
+  i = 0;
+  while (1) {
+
+    c = 2*i + 1;
+    if (c >= n) break;
+
+    if (c + 1 < n && _knn_worse(heap + c + 1, heap + c)) c++;
+    if (!_knn_worse(heap + c, &tmp)) break;
+
+    heap[i] = heap[c];
+    i       = c;
+  }
+
+  heap[i] = tmp;
+}
+
+uint8_t _knn_worse(knn_ent_t *a, knn_ent_t *b) {
+
+  if (a->val < b->val) return 1;
+  if (a->val > b->val) return 0;
+
+  return a->idx > b->idx;
+}
+
+int _compare_knn_idx(const void *a, const void *b) {
+
+  const knn_ent_t *ea;
+  const knn_ent_t *eb;
+
+  ea = a;
+  eb = b;
+
+  if (ea->idx < eb->idx) return -1;
+  if (ea->idx > eb->idx) return  1;
+  return 0;
+}
@@ -0,0 +1,583 @@
+/**
+ * Generates seed-based correlation maps from an ANALYZE75 volume. The time
+ * series of every voxel is correlated with the time series of each of a
+ * number of seeds, and the correlation values are saved as ANALYZE75
+ * images, one per seed.
+ *
+ * The seeds are either given as regions in a label image - the time series
+ * of a seed is then the mean time series of every voxel with its label -
+ * or as the rows of a MAT file (e.g. as created with tsimg -b). By default,
+ * the map for each seed is saved to its own image, called OUTPUT_lll,
+ * where lll is the seed label value (or row number, from 0). With the
+ * --four option, the maps are saved as the volumes of a single 4D image,
+ * OUTPUT, in seed order.
+ *
+ * The volume is read a block of voxels at a time, via the volume time
+ * series cache. Each block is normalised, and correlated with all of the
+ * seeds at once with corr_cross (see timeseries/correlation.h), which
+ * calculates the product of the seed and voxel matrices in cache-sized
+ * tiles, on all available threads. The maps of every seed are held in
+ * memory at once, as single precision values.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <argp.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "io/mat.h"
+#include "io/analyze75.h"
+#include "util/startup.h"
+#include "util/compare.h"
+#include "timeseries/correlation.h"
+#include "timeseries/analyze_volume.h"
+
+/**
+ * Number of time series values which are read and correlated in one go.
+ */
+#define SEED_BLOCK_VALS 4194304
+
+typedef struct _args {
+
+  char    *input;
+  char    *output;
+  char    *labelf;
+  char    *seedf;
+  char    *maskf;
+  uint8_t  four;
+  uint16_t nthreads;
+
+} args_t;
+
+static struct argp_option options[] = {
+  {"labelf", 'f', "FILE", 0, "ANALYZE75 label file - every label value "
+                             "(other than 0) is a seed region"},
+  {"seedf",  's', "FILE", 0, "MAT file containing seed time series, "
+                             "one per row"},
+  {"maskf",  'm', "FILE", 0, "ANALYZE75 mask file - only calculate maps "
+                             "for voxels with a non-0 mask value"},
+  {"four",   '4', NULL,   0, "save all maps to a single 4D image"},
+  {NULL,     'j', "INT",  0, "number of threads (default: --threads)"},
+  {0}
+};
+
+static char doc[] = "tsseed -- generate seed-based correlation maps "\
+                    "from an ANALYZE75 volume";
+
+static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
+
+  args_t *args;
+
+  args = state->input;
+
+  switch (key) {
+
+    case 'f': args->labelf   = arg;       break;
+    case 's': args->seedf    = arg;       break;
+    case 'm': args->maskf    = arg;       break;
+    case '4': args->four     = 1;         break;
+    case 'j': args->nthreads = atoi(arg); break;
+
+    case ARGP_KEY_ARG:
+      if      (state->arg_num == 0) args->input  = arg;
+      else if (state->arg_num == 1) args->output = arg;
+      else                          argp_usage(state);
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num != 2) argp_usage(state);
+      if ((args->labelf == NULL) == (args->seedf == NULL))
+        argp_error(state, "exactly one of --labelf or --seedf is required");
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+
+  return 0;
+}
+
+/**
+ * Creates a list of the voxels for which maps are calculated - the voxels
+ * with a non-0 value in the mask file, or every voxel if there is no mask.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _select_voxels(
+  analyze_volume_t *vol,   /**< the volume                           */
+  char             *maskf, /**< mask file, or NULL                   */
+  uint32_t        **vxls,  /**< place to store newly allocated list  */
+  uint32_t         *nvxls  /**< place to store number of voxels      */
+);
+
+/**
+ * Calculates the seed time series from the regions of the given label
+ * image - the time series of each seed is the mean time series of all of
+ * the voxels in its region. The seeds are ordered by label value.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _label_seeds(
+  analyze_volume_t *vol,    /**< the volume                            */
+  char             *labelf, /**< label file                            */
+  double          **seeds,  /**< place to store newly allocated seed
+                                 time series                           */
+  double          **lbls,   /**< place to store newly allocated seed
+                                 label values                          */
+  uint32_t         *nseeds  /**< place to store number of seeds        */
+);
+
+/**
+ * Reads the seed time series from the rows of the given MAT file.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mat_seeds(
+  analyze_volume_t *vol,    /**< the volume                          */
+  char             *seedf,  /**< MAT file                            */
+  double          **seeds,  /**< place to store newly allocated seed
+                                 time series                         */
+  uint32_t         *nseeds  /**< place to store number of seeds      */
+);
+
+/**
+ * Calculates the map of every seed, a block of voxels at a time. The map
+ * of seed i is stored at maps + i*nvals, where nvals is the number of
+ * voxels in a 3D image of the volume; voxels which are not listed are
+ * left untouched.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _mk_maps(
+  analyze_volume_t *vol,      /**< the volume                         */
+  uint32_t         *vxls,     /**< voxels to calculate                */
+  uint32_t          nvxls,    /**< number of voxels                   */
+  double           *seeds,    /**< normalised seed time series        */
+  uint32_t          nseeds,   /**< number of seeds                    */
+  uint16_t          nthreads, /**< number of threads to use           */
+  float            *maps      /**< place to store maps                */
+);
+
+/**
+ * Saves the maps, either to one image per seed, or to a single 4D image.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _write_maps(
+  analyze_volume_t *vol,    /**< the volume                            */
+  char             *output, /**< output file name, or prefix           */
+  uint8_t           four,   /**< save to a single 4D image             */
+  double           *lbls,   /**< seed label values, or NULL if the
+                                 seeds are named by number             */
+  uint32_t          nseeds, /**< number of seeds                       */
+  float            *maps    /**< the maps                              */
+);
+
+int main(int argc, char *argv[]) {
+
+  uint64_t         i;
+  uint32_t         nvals;
+  uint32_t         nvxls;
+  uint32_t         nseeds;
+  uint32_t        *vxls;
+  double          *seeds;
+  double          *lbls;
+  float           *maps;
+  analyze_volume_t vol;
+  args_t           args;
+  struct argp      argp = {options, _parse_opt, "INPUT OUTPUT", doc};
+
+  vxls  = NULL;
+  seeds = NULL;
+  lbls  = NULL;
+  maps  = NULL;
+
+  memset(&args, 0, sizeof(args_t));
+
+  startup("tsseed", argc, argv, &argp, &args);
+
+  if (analyze_open_volume(args.input, &vol)) {
+    printf("could not open ANALYZE75 volume %s\n", args.input);
+    goto fail;
+  }
+
+  nvals = analyze_num_vals(vol.hdrs);
+
+  if (_select_voxels(&vol, args.maskf, &vxls, &nvxls)) {
+    printf("error selecting voxels\n");
+    goto fail;
+  }
+
+  if (args.labelf != NULL) {
+    if (_label_seeds(&vol, args.labelf, &seeds, &lbls, &nseeds)) {
+      printf("error calculating seeds from label file %s\n", args.labelf);
+      goto fail;
+    }
+  }
+  else if (_mat_seeds(&vol, args.seedf, &seeds, &nseeds)) {
+    printf("error reading seeds from mat file %s\n", args.seedf);
+    goto fail;
+  }
+
+  if (nseeds == 0) {
+    printf("no seeds were found\n");
+    goto fail;
+  }
+
+  for (i = 0; i < nseeds; i++) corr_normalise(seeds + i*vol.nimgs, vol.nimgs);
+
+  maps = calloc((uint64_t)nseeds*nvals, sizeof(float));
+  if (maps == NULL) {
+    printf("out of memory?!\n");
+    goto fail;
+  }
+
+  if (_mk_maps(&vol, vxls, nvxls, seeds, nseeds, args.nthreads, maps)) {
+    printf("error calculating correlation maps\n");
+    goto fail;
+  }
+
+  if (_write_maps(&vol, args.output, args.four, lbls, nseeds, maps)) {
+    printf("error writing maps to %s\n", args.output);
+    goto fail;
+  }
+
+  free(vxls);
+  free(seeds);
+  free(maps);
+  if (lbls != NULL) free(lbls);
+  analyze_free_volume(&vol);
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _select_voxels(
+  analyze_volume_t *vol,
+  char             *maskf,
+  uint32_t        **vxls,
+  uint32_t         *nvxls) {
+
+  uint64_t  i;
+  uint32_t  nvals;
+  uint32_t  n;
+  uint32_t *lvxls;
+  dsr_t     mskhdr;
+  uint8_t  *mskimg;
+
+  lvxls  = NULL;
+  mskimg = NULL;
+  n      = 0;
+  nvals  = analyze_num_vals(vol->hdrs);
+
+  lvxls = malloc(nvals*sizeof(uint32_t));
+  if (lvxls == NULL) goto fail;
+
+  if (maskf != NULL) {
+    if (analyze_load(maskf, &mskhdr, &mskimg))         goto fail;
+    if (analyze_hdr_compat_two(&mskhdr, vol->hdrs, 1)) goto fail;
+  }
+
+  for (i = 0; i < nvals; i++) {
+
+    if (mskimg != NULL && analyze_read_by_idx(&mskhdr, mskimg, i) == 0)
+      continue;
+
+    lvxls[n++] = i;
+  }
+
+  if (mskimg != NULL) free(mskimg);
+
+  *vxls  = lvxls;
+  *nvxls = n;
+  return 0;
+
+fail:
+  if (lvxls  != NULL) free(lvxls);
+  if (mskimg != NULL) free(mskimg);
+  return 1;
+}
+
+uint8_t _label_seeds(
+  analyze_volume_t *vol,
+  char             *labelf,
+  double          **seeds,
+  double          **lbls,
+  uint32_t         *nseeds) {
+
+  uint64_t  i;
+  uint64_t  j;
+  uint64_t  k;
+  uint32_t  nvals;
+  uint32_t  nlblvxls;
+  uint32_t  nlbls;
+  uint32_t  blksz;
+  uint32_t  nblk;
+  uint32_t  len;
+  uint32_t *lblvxls;
+  uint32_t *seedidx;
+  uint32_t *counts;
+  double   *lbldata;
+  double   *llbls;
+  double   *lseeds;
+  double   *ts;
+  double   *sum;
+  double    val;
+  dsr_t     lblhdr;
+  uint8_t  *lblimg;
+
+  lblimg  = NULL;
+  lblvxls = NULL;
+  seedidx = NULL;
+  counts  = NULL;
+  lbldata = NULL;
+  llbls   = NULL;
+  lseeds  = NULL;
+  nvals   = analyze_num_vals(vol->hdrs);
+  len     = vol->nimgs;
+
+  if (analyze_load(labelf, &lblhdr, &lblimg))        goto fail;
+  if (analyze_hdr_compat_two(&lblhdr, vol->hdrs, 1)) goto fail;
+
+  lblvxls = malloc(nvals*sizeof(uint32_t));
+  lbldata = malloc(nvals*sizeof(double));
+  if (lblvxls == NULL || lbldata == NULL) goto fail;
+
+  /*find the labelled voxels, and their distinct label values*/
+  nlblvxls = 0;
+  for (i = 0; i < nvals; i++) {
+
+    val = analyze_read_by_idx(&lblhdr, lblimg, i);
+    if (val == 0) continue;
+
+    lblvxls[nlblvxls]   = i;
+    lbldata[nlblvxls++] = val;
+  }
+
+  llbls = malloc((nlblvxls > 0 ? nlblvxls : 1)*sizeof(double));
+  if (llbls == NULL) goto fail;
+
+  memcpy(llbls, lbldata, nlblvxls*sizeof(double));
+  qsort(llbls, nlblvxls, sizeof(double), compare_double);
+
+  nlbls = 0;
+  for (i = 0; i < nlblvxls; i++) {
+    if (nlbls == 0 || llbls[i] != llbls[nlbls-1]) llbls[nlbls++] = llbls[i];
+  }
+
+  seedidx = malloc((nlblvxls > 0 ? nlblvxls : 1)*sizeof(uint32_t));
+  counts  = calloc(nlbls > 0 ? nlbls : 1, sizeof(uint32_t));
+  lseeds  = calloc((uint64_t)(nlbls > 0 ? nlbls : 1)*len, sizeof(double));
+  if (seedidx == NULL || counts == NULL || lseeds == NULL) goto fail;
+
+  for (i = 0; i < nlblvxls; i++) {
+
+    seedidx[i] = (double *)bsearch(
+      lbldata + i, llbls, nlbls, sizeof(double), compare_double) - llbls;
+    counts[seedidx[i]]++;
+  }
+
+  /*sum the time series of each region, a block of voxels at a time*/
+  blksz = SEED_BLOCK_VALS / (len > 0 ? len : 1);
+  if (blksz < 256) blksz = 256;
+
+  for (i = 0; i < nlblvxls; i += nblk) {
+
+    nblk = (nlblvxls - i > blksz) ? blksz : nlblvxls - i;
+
+    if (analyze_cache_volume(vol, lblvxls + i, nblk)) goto fail;
+
+    for (k = 0; k < nblk; k++) {
+
+      ts  = vol->tscache + k*len;
+      sum = lseeds + (uint64_t)seedidx[i+k]*len;
+
+      for (j = 0; j < len; j++) sum[j] += ts[j];
+    }
+  }
+
+  for (i = 0; i < nlbls; i++) {
+    for (j = 0; j < len; j++) lseeds[i*len + j] /= counts[i];
+  }
+
+  free(lblimg);
+  free(lblvxls);
+  free(lbldata);
+  free(seedidx);
+  free(counts);
+
+  *seeds  = lseeds;
+  *lbls   = llbls;
+  *nseeds = nlbls;
+  return 0;
+
+fail:
+  if (lblimg  != NULL) free(lblimg);
+  if (lblvxls != NULL) free(lblvxls);
+  if (lbldata != NULL) free(lbldata);
+  if (seedidx != NULL) free(seedidx);
+  if (counts  != NULL) free(counts);
+  if (llbls   != NULL) free(llbls);
+  if (lseeds  != NULL) free(lseeds);
+  return 1;
+}
+
+uint8_t _mat_seeds(
+  analyze_volume_t *vol,
+  char             *seedf,
+  double          **seeds,
+  uint32_t         *nseeds) {
+
+  uint64_t i;
+  uint64_t nrows;
+  mat_t   *mat;
+  double  *lseeds;
+
+  lseeds = NULL;
+  mat    = mat_open(seedf);
+  if (mat == NULL) goto fail;
+
+  nrows = mat_num_rows(mat);
+
+  if (mat_num_cols(mat) != vol->nimgs) {
+    printf("seed time series length (%llu) does not match "
+           "volume (%u)\n",
+           (unsigned long long)mat_num_cols(mat), vol->nimgs);
+    goto fail;
+  }
+
+  lseeds = malloc((nrows > 0 ? nrows : 1)*vol->nimgs*sizeof(double));
+  if (lseeds == NULL) goto fail;
+
+  for (i = 0; i < nrows; i++) {
+    if (mat_read_row(mat, i, lseeds + i*vol->nimgs)) goto fail;
+  }
+
+  mat_close(mat);
+
+  *seeds  = lseeds;
+  *nseeds = nrows;
+  return 0;
+
+fail:
+  if (mat    != NULL) mat_close(mat);
+  if (lseeds != NULL) free(lseeds);
+  return 1;
+}
+
+uint8_t _mk_maps(
+  analyze_volume_t *vol,
+  uint32_t         *vxls,
+  uint32_t          nvxls,
+  double           *seeds,
+  uint32_t          nseeds,
+  uint16_t          nthreads,
+  float            *maps) {
+
+  uint64_t i;
+  uint64_t j;
+  uint64_t k;
+  uint32_t nvals;
+  uint32_t len;
+  uint32_t blksz;
+  uint32_t nblk;
+  double  *out;
+
+  out   = NULL;
+  nvals = analyze_num_vals(vol->hdrs);
+  len   = vol->nimgs;
+
+  blksz = SEED_BLOCK_VALS / (len > 0 ? len : 1);
+  if (blksz < 256) blksz = 256;
+
+  out = malloc((uint64_t)nseeds*blksz*sizeof(double));
+  if (out == NULL) goto fail;
+
+  for (i = 0; i < nvxls; i += nblk) {
+
+    nblk = (nvxls - i > blksz) ? blksz : nvxls - i;
+
+    if (analyze_cache_volume(vol, vxls + i, nblk)) goto fail;
+
+    for (k = 0; k < nblk; k++) corr_normalise(vol->tscache + k*len, len);
+
+    if (corr_cross(seeds, nseeds, vol->tscache, nblk, len, nthreads, out))
+      goto fail;
+
+    for (j = 0; j < nseeds; j++) {
+      for (k = 0; k < nblk; k++)
+        maps[j*nvals + vxls[i+k]] = out[j*nblk + k];
+    }
+  }
+
+  free(out);
+  return 0;
+
+fail:
+  if (out != NULL) free(out);
+  return 1;
+}
+
+uint8_t _write_maps(
+  analyze_volume_t *vol,
+  char             *output,
+  uint8_t           four,
+  double           *lbls,
+  uint32_t          nseeds,
+  float            *maps) {
+
+  uint64_t i;
+  uint32_t nvals;
+  dsr_t    hdr;
+  char    *outf;
+
+  outf  = NULL;
+  nvals = analyze_num_vals(vol->hdrs);
+
+  /*
+   * the maps are stored in native byte order,
+   * so the header is written in native order too
+   */
+  memcpy(&hdr, vol->hdrs, sizeof(dsr_t));
+  hdr.rev             = 0;
+  hdr.dime.datatype   = DT_FLOAT;
+  hdr.dime.bitpix     = 32;
+  hdr.dime.vox_offset = 0;
+  hdr.dime.cal_max    =  1;
+  hdr.dime.cal_min    = -1;
+  hdr.dime.glmax      =  1;
+  hdr.dime.glmin      =  0;
+
+  if (four) {
+
+    hdr.dime.dim[0]    = 4;
+    hdr.dime.dim[4]    = nseeds;
+    hdr.dime.pixdim[4] = 1;
+
+    if (analyze_write_hdr(output, &hdr))                  goto fail;
+    if (analyze_write_img(output, &hdr, (uint8_t *)maps)) goto fail;
+    return 0;
+  }
+
+  outf = malloc(strlen(output) + 32);
+  if (outf == NULL) goto fail;
+
+  for (i = 0; i < nseeds; i++) {
+
+    if (lbls != NULL) sprintf(outf, "%s_%g", output, lbls[i]);
+    else              sprintf(outf, "%s_%llu", output, (unsigned long long)i);
+
+    if (analyze_write_hdr(outf, &hdr))                             goto fail;
+    if (analyze_write_img(outf, &hdr, (uint8_t *)(maps + i*nvals))) goto fail;
+  }
+
+  free(outf);
+  return 0;
+
+fail:
+  if (outf != NULL) free(outf);
+  return 1;
+}
@@ -0,0 +1,111 @@
+/**
+ * Alias tables. See util/alias.h for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/alias.h"
+#include "util/rng.h"
+
+uint8_t alias_create(alias_t *a, double *weights, uint32_t n) {
+
+  uint64_t  i;
+  uint32_t  s;
+  uint32_t  l;
+  uint32_t  nsmall;
+  uint32_t  nlarge;
+  uint32_t *small;
+  uint32_t *large;
+  double    total;
+
+  small = NULL;
+  large = NULL;
+
+  memset(a, 0, sizeof(alias_t));
+
+  if (n == 0) goto fail;
+
+  for (i = 0, total = 0; i < n; i++) {
+    if (weights[i] < 0) goto fail;
+    total += weights[i];
+  }
+
+  if (total <= 0) goto fail;
+
+  a->n     = n;
+  a->prob  = malloc(n * sizeof(double));
+  a->alias = malloc(n * sizeof(uint32_t));
+  small    = malloc(n * sizeof(uint32_t));
+  large    = malloc(n * sizeof(uint32_t));
+
+  if (a->prob  == NULL) goto fail;
+  if (a->alias == NULL) goto fail;
+  if (small    == NULL) goto fail;
+  if (large    == NULL) goto fail;
+
+  /*
+   * Outcomes are scaled so that the mean probability
+   * is 1, and split into those below and above the
+   * mean. Each small outcome is paired with a large
+   * one, which gives up the remainder of its slot.
+   */
+  nsmall = 0;
+  nlarge = 0;
+
+  for (i = 0; i < n; i++) {
+
+    a->prob[ i] = weights[i] * n / total;
+    a->alias[i] = i;
+
+    if (a->prob[i] < 1.0) small[nsmall++] = i;
+    else                  large[nlarge++] = i;
+  }
+
+  while (nsmall > 0 && nlarge > 0) {
+
+    s = small[--nsmall];
+    l = large[--nlarge];
+
+    a->alias[s] = l;
+    a->prob[ l] = (a->prob[l] + a->prob[s]) - 1.0;
+
+    if (a->prob[l] < 1.0) small[nsmall++] = l;
+    else                  large[nlarge++] = l;
+  }
+
+  /*whatever is left over is 1, give or take rounding error*/
+  while (nlarge > 0) a->prob[large[--nlarge]] = 1.0;
+  while (nsmall > 0) a->prob[small[--nsmall]] = 1.0;
+
+  free(small);
+  free(large);
+
+  return 0;
+
+fail:
+  if (small != NULL) free(small);
+  if (large != NULL) free(large);
+  alias_free(a);
+  return 1;
+}
+
+void alias_free(alias_t *a) {
+
+  if (a->prob  != NULL) free(a->prob);
+  if (a->alias != NULL) free(a->alias);
+
+  memset(a, 0, sizeof(alias_t));
+}
+
+uint32_t alias_sample(alias_t *a, rng_t *r) {
+
+  uint32_t i;
+
+  i = rng_range(r, a->n);
+
+  if (rng_uniform(r) < a->prob[i]) return i;
+  return a->alias[i];
+}
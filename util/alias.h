@@ -0,0 +1,63 @@
+/**
+ * Alias tables, for drawing samples from a fixed discrete distribution in
+ * constant time. The table is built in O(n) time with Vose's method; each
+ * sample then takes one uniform index and one uniform comparison:
+ *
+ *   M. D. Vose, 1991. A linear algorithm for generating random numbers
+ *   with a given distribution. IEEE Transactions on Software Engineering
+ *   17(9):972-975.
+ *
+ * A table is read-only once it has been built, so it may be sampled from
+ * several threads at once, as long as each thread uses its own generator.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __ALIAS_H__
+#define __ALIAS_H__
+
+#include <stdint.h>
+
+#include "util/rng.h"
+
+/**
+ * Alias table handle.
+ */
+typedef struct _alias {
+
+  uint32_t  n;     /**< number of outcomes                          */
+  double   *prob;  /**< probability of keeping each outcome, rather
+                        than taking its alias                       */
+  uint32_t *alias; /**< the alias of each outcome                   */
+
+} alias_t;
+
+/**
+ * Builds an alias table for the distribution in which outcome i has
+ * probability proportional to weights[i]. Weights must be non-negative,
+ * and at least one must be positive.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t alias_create(
+  alias_t *a,       /**< table to initialise   */
+  double  *weights, /**< weight of each outcome */
+  uint32_t n        /**< number of outcomes     */
+);
+
+/**
+ * Frees the memory used by the given table.
+ */
+void alias_free(
+  alias_t *a /**< the table */
+);
+
+/**
+ * \return an outcome drawn from the given table, using the given
+ * generator.
+ */
+uint32_t alias_sample(
+  alias_t *a, /**< the table     */
+  rng_t   *r  /**< the generator */
+);
+
+#endif /* __ALIAS_H__ */
@@ -0,0 +1,193 @@
+/**
+ * Slab-based memory arena.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/arena.h"
+
+/**
+ * Default size of a regular block.
+ */
+#define DEFAULT_BLOCK_SIZE (1 << 20)
+
+/**
+ * Every allocation is preceded by a header which records its size class,
+ * so that it can be put on the right free list when it is released. The
+ * header is 8 bytes, so allocations are 8-byte aligned.
+ */
+typedef struct _arena_hdr {
+
+  uint64_t cls; /**< size class of the allocation */
+
+} arena_hdr_t;
+
+/**
+ * \return the smallest size class which has room for the given number of
+ * bytes (plus the header), or ARENA_NUM_CLASSES if there is none.
+ */
+static uint32_t _size_class(
+  uint64_t size /**< number of bytes required */
+);
+
+/**
+ * Allocates a new block from the system, and adds it to the arena's list
+ * of blocks.
+ *
+ * \return a pointer to the block, or NULL on failure.
+ */
+static uint8_t * _new_block(
+  arena_t *a,   /**< the arena               */
+  uint64_t size /**< size of the block, bytes */
+);
+
+uint8_t arena_create(arena_t *a, uint64_t blocksize) {
+
+  if (a == NULL) goto fail;
+
+  memset(a, 0, sizeof(arena_t));
+
+  if (blocksize == 0) blocksize = DEFAULT_BLOCK_SIZE;
+
+  a->blocksize = blocksize;
+  a->used      = blocksize;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void arena_set_acct(arena_t *a, memacct_category_t cat) {
+
+  memacct_free( a->acct, a->allocated);
+  memacct_alloc(cat,     a->allocated);
+
+  a->acct = cat;
+}
+
+void arena_destroy(arena_t *a) {
+
+  uint64_t i;
+
+  if (a == NULL) return;
+
+  for (i = 0; i < a->nblocks; i++) free(a->blocks[i]);
+  if (a->blocks != NULL) free(a->blocks);
+
+  memacct_free(a->acct, a->allocated);
+
+  memset(a, 0, sizeof(arena_t));
+}
+
+void * arena_alloc(arena_t *a, uint64_t size, uint64_t *avail) {
+
+  uint32_t     cls;
+  uint64_t     slot;
+  arena_hdr_t *hdr;
+
+  if (a == NULL) goto fail;
+
+  cls = _size_class(size);
+  if (cls >= ARENA_NUM_CLASSES) goto fail;
+
+  slot = (uint64_t)ARENA_MIN_SIZE << cls;
+
+  /*re-use a released allocation of the same class*/
+  if (a->freelists[cls] != NULL) {
+
+    hdr               = a->freelists[cls];
+    a->freelists[cls] = *(void **)(hdr + 1);
+  }
+
+  /*large allocations get their own block*/
+  else if (slot > a->blocksize / 4) {
+
+    hdr = (arena_hdr_t *)_new_block(a, slot);
+    if (hdr == NULL) goto fail;
+  }
+
+  else {
+
+    if (a->used + slot > a->blocksize) {
+
+      a->cur = _new_block(a, a->blocksize);
+      if (a->cur == NULL) goto fail;
+
+      a->used = 0;
+    }
+
+    hdr      = (arena_hdr_t *)(a->cur + a->used);
+    a->used += slot;
+  }
+
+  hdr->cls = cls;
+
+  if (avail != NULL) *avail = slot - sizeof(arena_hdr_t);
+
+  return hdr + 1;
+
+fail:
+  return NULL;
+}
+
+void arena_release(arena_t *a, void *ptr) {
+
+  arena_hdr_t *hdr;
+
+  if (a   == NULL) return;
+  if (ptr == NULL) return;
+
+  hdr = (arena_hdr_t *)ptr - 1;
+
+  *(void **)ptr          = a->freelists[hdr->cls];
+  a->freelists[hdr->cls] = hdr;
+}
+
+uint32_t _size_class(uint64_t size) {
+
+  uint32_t cls;
+
+  size += sizeof(arena_hdr_t);
+
+  for (cls = 0; cls < ARENA_NUM_CLASSES; cls++) {
+    if (((uint64_t)ARENA_MIN_SIZE << cls) >= size) break;
+  }
+
+  return cls;
+}
+
+uint8_t * _new_block(arena_t *a, uint64_t size) {
+
+  uint8_t  *block;
+  uint8_t **blocks;
+  uint32_t  newcap;
+
+  block = NULL;
+
+  if (a->nblocks == a->blockcap) {
+
+    newcap = (a->blockcap == 0) ? 16 : 2 * a->blockcap;
+    blocks = realloc(a->blocks, newcap * sizeof(uint8_t *));
+    if (blocks == NULL) goto fail;
+
+    a->blocks   = blocks;
+    a->blockcap = newcap;
+  }
+
+  block = malloc(size);
+  if (block == NULL) goto fail;
+
+  a->blocks[a->nblocks++] = block;
+  a->allocated            += size;
+
+  memacct_alloc(a->acct, size);
+
+  return block;
+
+fail:
+  return NULL;
+}
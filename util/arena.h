@@ -0,0 +1,103 @@
+/**
+ * Slab-based memory arena. Memory is carved out of a small number of large
+ * blocks, in power-of-two size classes. Released memory is kept on a free
+ * list for its size class, and is re-used by later allocations of the same
+ * class - it is only returned to the system when the whole arena is
+ * destroyed. This suits many small buffers which grow and shrink over the
+ * lifetime of a single owner (e.g. the adjacency lists of a graph which is
+ * repeatedly edited), as it avoids heap fragmentation, and all of the
+ * memory can be freed at once.
+ *
+ * Arenas are not thread safe.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdint.h>
+
+#include "util/memacct.h"
+
+/**
+ * Number of size classes - class i holds allocations of up to
+ * (ARENA_MIN_SIZE << i) bytes.
+ */
+#define ARENA_NUM_CLASSES 40
+
+/**
+ * Smallest allocation size, in bytes.
+ */
+#define ARENA_MIN_SIZE 16
+
+/**
+ * Arena handle.
+ */
+typedef struct _arena {
+
+  uint8_t **blocks;    /**< all blocks allocated by the arena      */
+  uint32_t  nblocks;   /**< number of blocks                       */
+  uint32_t  blockcap;  /**< capacity of the blocks array           */
+  uint64_t  blocksize; /**< size of a regular block, in bytes      */
+  uint8_t  *cur;       /**< regular block currently being carved   */
+  uint64_t  used;      /**< bytes used in the current block        */
+  uint64_t  allocated; /**< total size of all blocks, in bytes     */
+  uint8_t   acct;      /**< memacct_category_t to which the blocks
+                            are accounted                          */
+  void     *freelists[ARENA_NUM_CLASSES]; /**< released allocations,
+                                               by size class       */
+
+} arena_t;
+
+/**
+ * Creates an arena.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t arena_create(
+  arena_t *a,        /**< the arena to initialise                         */
+  uint64_t blocksize /**< size of a regular block, in bytes (0 for a
+                          default). Allocations which do not fit in a
+                          quarter of a block get a block of their own.    */
+);
+
+/**
+ * Accounts the blocks of the given arena, now and as they are allocated,
+ * to the given category (see util/memacct.h), until the arena is
+ * destroyed.
+ */
+void arena_set_acct(
+  arena_t           *a,  /**< the arena */
+  memacct_category_t cat /**< category  */
+);
+
+/**
+ * Frees all of the memory allocated by the arena, including all allocations
+ * which have not been released.
+ */
+void arena_destroy(
+  arena_t *a /**< the arena */
+);
+
+/**
+ * Allocates memory from the arena. The allocation is rounded up to its size
+ * class; the usable size is returned via avail.
+ *
+ * \return a pointer to the memory, or NULL on failure.
+ */
+void * arena_alloc(
+  arena_t  *a,    /**< the arena                                        */
+  uint64_t  size, /**< minimum number of bytes required                 */
+  uint64_t *avail /**< if not NULL, set to the usable size, in bytes    */
+);
+
+/**
+ * Releases memory which was allocated from the arena, so that it may be
+ * re-used by a later allocation.
+ */
+void arena_release(
+  arena_t *a,  /**< the arena                                 */
+  void    *ptr /**< pointer returned by arena_alloc, or NULL  */
+);
+
+#endif /* __ARENA_H__ */
@@ -37,6 +37,22 @@ static uint8_t _expand(
   uint32_t newcap /**< new capacity - pass in 0 to use EXPAND_RATIO */
 );
 
+/**
+ * Merges the two given sorted runs of values into out. Values from run a
+ * are placed before equal values from run b.
+ */
+static void _merge(
+  uint8_t *a,              /**< first run                      */
+  uint64_t na,             /**< number of values in a          */
+  uint8_t *b,              /**< second run                     */
+  uint64_t nb,             /**< number of values in b          */
+  uint8_t *out,            /**< place to store merged values   */
+  uint32_t datasz,         /**< size of one value              */
+  int    (*cmp)(           /**< comparison function            */
+    const void *a,
+    const void *b)
+);
+
 uint8_t array_create(array_t *array, uint32_t datasz, uint32_t capacity) {
 
   if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
@@ -46,6 +62,8 @@ uint8_t array_create(array_t *array, uint32_t datasz, uint32_t capacity) {
   array->capacity = capacity;
   array->cmp      = NULL;
   array->cmpins   = NULL;
+  array->arena    = NULL;
+  array->acct     = MEMACCT_NONE;
   array->data     = calloc(capacity, datasz);
   
   if (array->data == NULL) goto fail;
@@ -55,6 +73,35 @@ fail:
   return 1;
 }
 
+uint8_t array_create_arena(
+  array_t *array, uint32_t datasz, uint32_t capacity, arena_t *arena) {
+
+  uint64_t avail;
+
+  if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+
+  array->size     = 0;
+  array->datasz   = datasz;
+  array->cmp      = NULL;
+  array->cmpins   = NULL;
+  array->arena    = arena;
+  array->acct     = MEMACCT_NONE;
+  array->data     = arena_alloc(arena, (uint64_t)capacity*datasz, &avail);
+
+  if (array->data == NULL) goto fail;
+
+  /*use all of the space in the allocation's size class*/
+  capacity = avail / datasz;
+  if (capacity > UINT32_MAX / 2) capacity = UINT32_MAX / 2;
+  array->capacity = capacity;
+
+  memset(array->data, 0, (uint64_t)capacity*datasz);
+  
+  return 0;
+fail:
+  return 1;
+}
+
 void array_set_cmps(
   array_t *array,
   int    (*cmp)   (const void *a, const void *b),
@@ -71,7 +118,13 @@ void array_free(array_t *array) {
 
   if (array == NULL) return;
     
-  if (array->data != NULL) free(array->data);
+  if (array->data != NULL) {
+    if (array->arena != NULL) arena_release(array->arena, array->data);
+    else                      free(array->data);
+
+    memacct_free(array->acct, (uint64_t)array->capacity * array->datasz);
+  }
+  array->acct     = MEMACCT_NONE;
   array->capacity = 0;
   array->size     = 0;
   array->data     = NULL;
@@ -84,6 +137,23 @@ void array_clear(array_t *array) {
   if (array != NULL) array->size = 0;
 }
 
+void array_set_acct(array_t *array, memacct_category_t cat) {
+
+  uint64_t bytes;
+
+  if (array == NULL)        return;
+  if (array->arena != NULL) return;
+
+  bytes = (uint64_t)array->capacity * array->datasz;
+
+  if (array->data != NULL) {
+    memacct_free( array->acct, bytes);
+    memacct_alloc(cat,         bytes);
+  }
+
+  array->acct = cat;
+}
+
 uint8_t array_expand(array_t *array, uint32_t capacity) {
 
   if (array           == NULL)     goto fail;
@@ -279,6 +349,132 @@ fail:
   return 2;
 }
 
+uint8_t array_append_all(array_t *array, void *values, uint32_t n) {
+
+  if (array == NULL) goto fail;
+  if (n     == 0)    return 0;
+
+  if ((uint64_t)array->size + n > array->capacity) {
+    if (_expand(array, array->size + n)) goto fail;
+  }
+
+  memcpy(array->data + (uint64_t)array->size * array->datasz,
+         values,
+         (uint64_t)n * array->datasz);
+
+  array->size += n;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t array_merge_sorted(array_t *array, uint32_t nsorted, uint8_t unique) {
+
+  uint64_t  i;
+  uint64_t  n;
+  uint64_t  lo;
+  uint64_t  mid;
+  uint64_t  hi;
+  uint64_t  width;
+  uint64_t  ia;
+  uint64_t  ib;
+  uint64_t  io;
+  uint64_t  nkept;
+  uint32_t  sz;
+  uint8_t  *buf;
+  uint8_t  *src;
+  uint8_t  *dst;
+  uint8_t  *tmp;
+
+  buf = NULL;
+
+  if (array      == NULL)        goto fail;
+  if (array->cmp == NULL)        goto fail;
+  if (nsorted    >  array->size) nsorted = array->size;
+
+  sz = array->datasz;
+  n  = array->size - nsorted;
+
+  if (n > 0) {
+
+    buf = malloc(2 * n * sz);
+    if (buf == NULL) goto fail;
+
+    /*bottom-up merge sort of the new values*/
+    src = buf;
+    dst = buf + n * sz;
+    memcpy(src, array->data + (uint64_t)nsorted * sz, n * sz);
+
+    for (width = 1; width < n; width *= 2) {
+
+      for (lo = 0; lo < n; lo += 2 * width) {
+
+        mid = (lo + width     < n) ? lo + width     : n;
+        hi  = (lo + 2 * width < n) ? lo + 2 * width : n;
+
+        _merge(src + lo  * sz, mid - lo,
+               src + mid * sz, hi  - mid,
+               dst + lo  * sz, sz, array->cmp);
+      }
+
+      tmp = src;
+      src = dst;
+      dst = tmp;
+    }
+
+    /*
+     * merge the new values into the existing values,
+     * from the back, so that the existing values are
+     * only ever moved towards the end of the array
+     */
+    ia = nsorted;
+    ib = n;
+    io = nsorted + n;
+
+    while (ib > 0) {
+
+      if (ia > 0 && array->cmp(array->data + (ia - 1) * sz,
+                               src         + (ib - 1) * sz) > 0) {
+        ia--;
+        memcpy(array->data + (--io) * sz, array->data + ia * sz, sz);
+      }
+      else {
+        ib--;
+        memcpy(array->data + (--io) * sz, src + ib * sz, sz);
+      }
+    }
+
+    free(buf);
+    buf = NULL;
+  }
+
+  if (unique && array->size > 0) {
+
+    nkept = 1;
+
+    for (i = 1; i < array->size; i++) {
+
+      if (array->cmp(array->data + (nkept - 1) * sz,
+                     array->data + i           * sz) == 0)
+        continue;
+
+      if (i != nkept)
+        memcpy(array->data + nkept * sz, array->data + i * sz, sz);
+      nkept++;
+    }
+
+    array->size = nkept;
+  }
+
+  return 0;
+
+fail:
+  if (buf != NULL) free(buf);
+  return 1;
+}
+
 void array_sort(array_t *array) {
 
   if (array      == NULL) return;
@@ -319,6 +515,7 @@ int64_t array_remove_by_val(array_t *array, void *val, uint8_t is_sorted) {
 
 uint8_t _expand(array_t *array, uint32_t newcap) {
 
+  uint64_t avail;
   uint8_t *newdata;
 
   if (newcap == 0) {
@@ -328,8 +525,27 @@ uint8_t _expand(array_t *array, uint32_t newcap) {
   /*this will never happen, but if it does, it will be bad*/
   if (newcap <= array->capacity) goto fail;
 
-  newdata = realloc(array->data, newcap*(array->datasz));
-  if (newdata == NULL) goto fail;
+  if (array->arena != NULL) {
+
+    newdata = arena_alloc(
+      array->arena, (uint64_t)newcap*array->datasz, &avail);
+    if (newdata == NULL) goto fail;
+
+    /*realloc preserves the whole buffer, so we do too*/
+    memcpy(newdata, array->data, (uint64_t)array->capacity*array->datasz);
+    arena_release(array->arena, array->data);
+
+    newcap = avail / array->datasz;
+    if (newcap > UINT32_MAX / 2) newcap = UINT32_MAX / 2;
+  }
+
+  else {
+    newdata = realloc(array->data, newcap*(array->datasz));
+    if (newdata == NULL) goto fail;
+
+    memacct_alloc(array->acct,
+                  (uint64_t)(newcap - array->capacity) * array->datasz);
+  }
 
   array->data     = newdata;
   array->capacity = newcap;
@@ -338,3 +554,35 @@ uint8_t _expand(array_t *array, uint32_t newcap) {
 fail:
   return 1;
 }
+
+void _merge(
+  uint8_t *a,
+  uint64_t na,
+  uint8_t *b,
+  uint64_t nb,
+  uint8_t *out,
+  uint32_t datasz,
+  int    (*cmp)(const void *a, const void *b)) {
+
+  uint64_t ia;
+  uint64_t ib;
+
+  ia = 0;
+  ib = 0;
+
+  while (ia < na && ib < nb) {
+
+    if (cmp(b + ib * datasz, a + ia * datasz) < 0) {
+      memcpy(out, b + ib * datasz, datasz);
+      ib++;
+    }
+    else {
+      memcpy(out, a + ia * datasz, datasz);
+      ia++;
+    }
+    out += datasz;
+  }
+
+  if (ia < na) memcpy(out, a + ia * datasz, (na - ia) * datasz);
+  if (ib < nb) memcpy(out, b + ib * datasz, (nb - ib) * datasz);
+}
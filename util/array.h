@@ -8,6 +8,9 @@
 
 #include <stdint.h>
 
+#include "util/arena.h"
+#include "util/memacct.h"
+
 /**
  * Array handle. If the size field is not 0, data[size-1] is the
  * last value in the array.
@@ -17,6 +20,8 @@ typedef struct _array {
   uint32_t  capacity; /**< current capacity                      */
   uint32_t  size;     /**< current size (number of values)       */
   uint32_t  datasz;   /**< size of one value in the data         */
+  uint8_t   acct;     /**< memacct_category_t to which the data
+                           is accounted (see array_set_acct)      */
   uint8_t  *data;     /**< the data                              */
   int     (*cmp)(     /**< search function for sorted searches   */
     const void *a,
@@ -24,6 +29,8 @@ typedef struct _array {
   int     (*cmpins)(  /**< search function for sorted insertions */
     const void *a,
     const void *b);
+  arena_t  *arena;    /**< arena from which the data is allocated,
+                           or NULL if it is allocated with malloc */
 
 } array_t;
 
@@ -38,6 +45,21 @@ uint8_t array_create(
   uint32_t capacity /**< initial capacity    */
 );
 
+/**
+ * Creates an array with the given initial capacity, whose data is
+ * allocated from the given arena, rather than with malloc. The data is
+ * released back to the arena when the array grows, or is freed via
+ * array_free. The arena must outlive the array.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t array_create_arena(
+  array_t *array,    /**< handle to the array    */
+  uint32_t datasz,   /**< size of one value      */
+  uint32_t capacity, /**< initial capacity       */
+  arena_t *arena     /**< arena to allocate from */
+);
+
 /**
  * Sets the comparison functions for the given array. You could
  * just set them directly via array->cmp and array->cmpins.
@@ -196,6 +218,49 @@ uint8_t array_insert_sorted(
   uint32_t *idx     /**< place to put index        */
 );
 
+/**
+ * Adds the given values to the end of the array, increasing the array
+ * capacity at most once.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t array_append_all(
+  array_t *array,  /**< array handle                   */
+  void    *values, /**< the values to append           */
+  uint32_t n       /**< number of values               */
+);
+
+/**
+ * Sorts the values at the end of the given array (e.g. added with
+ * array_append or array_append_all), and merges them into the values at
+ * the start of the array, which must already be sorted, using the
+ * array->cmp comparison function. This is equivalent to, but much faster
+ * than, inserting the values one by one with array_insert_sorted - the
+ * cost is O(n log(n) + size), rather than O(n * size). The sort is
+ * stable, and values which compare equal keep their relative order, with
+ * the values which were already sorted first. If unique is non-0, all but
+ * the first of any run of equal values are discarded.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t array_merge_sorted(
+  array_t *array,   /**< array handle                           */
+  uint32_t nsorted, /**< number of (sorted) values at the start
+                         of the array                           */
+  uint8_t  unique   /**< discard duplicate values?              */
+);
+
+/**
+ * Accounts the data of the given array, now and as it grows, to the given
+ * category (see util/memacct.h), until the array is freed. Arrays which
+ * are allocated from an arena are not accounted for individually - the
+ * arena itself should be (see arena_set_acct).
+ */
+void array_set_acct(
+  array_t           *array, /**< the array */
+  memacct_category_t cat    /**< category  */
+);
+
 /**
  * Sorts the elements in the given array, using the comparison
  * function set via array_set_cmps. This is really just a wrapper
@@ -0,0 +1,270 @@
+/**
+ * Allocation of large, long lived buffers. See util/bigmem.h for more
+ * details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "util/parallel.h"
+#include "util/bigmem.h"
+
+/**
+ * Size of the header which is stored in front of every buffer, and which
+ * keeps the returned pointers 64 byte aligned.
+ */
+#define _HDR_SIZE 64
+
+/**
+ * Linux memory policy for interleaved placement (see mbind(2)).
+ */
+#define _MPOL_INTERLEAVE 3
+
+/**
+ * Maximum number of NUMA nodes which are used for interleaving.
+ */
+#define _MAX_NODES 64
+
+/**
+ * Header stored at the start of every buffer.
+ */
+typedef struct _bigmem_hdr {
+
+  uint64_t size;   /**< total size, including the header        */
+  uint8_t  mapped; /**< non-0 if mapped, 0 if from the heap     */
+
+} bigmem_hdr_t;
+
+/**
+ * Context for _touch.
+ */
+typedef struct _touch_ctx {
+
+  uint8_t *base;     /**< start of the buffer          */
+  uint64_t size;     /**< size of the buffer           */
+  uint64_t partsize; /**< size of each partition       */
+
+} touch_ctx_t;
+
+/**
+ * Current placement policy.
+ */
+static bigmem_policy_t _policy = BIGMEM_DEFAULT;
+
+/**
+ * Reads the set of online NUMA nodes from sysfs, as a bit mask.
+ *
+ * \return the number of online nodes, or 0 if it cannot be determined.
+ */
+static uint32_t _online_nodes(
+  uint64_t *mask /**< place to store the node mask */
+);
+
+/**
+ * Interleaves the pages of the given mapping across all online NUMA
+ * nodes, before they are touched.
+ */
+static void _interleave(
+  void    *ptr, /**< start of the mapping */
+  uint64_t size /**< size of the mapping  */
+);
+
+/**
+ * parallel_for function which writes to every page of a range of
+ * partitions of a buffer, so that each partition is placed on the NUMA
+ * node of the thread which touches it.
+ *
+ * \return 0 always.
+ */
+static uint8_t _touch(
+  uint64_t start,  /**< first partition          */
+  uint64_t end,    /**< one past last partition  */
+  uint16_t thread, /**< thread identifier        */
+  void    *ctx     /**< pointer to a touch_ctx_t */
+);
+
+void bigmem_set_policy(bigmem_policy_t policy) {
+
+  _policy = policy;
+}
+
+bigmem_policy_t bigmem_get_policy(void) {
+
+  return _policy;
+}
+
+void *bigmem_alloc(uint64_t size) {
+
+  uint8_t      *buf;
+  uint16_t      nthreads;
+  bigmem_hdr_t *hdr;
+  touch_ctx_t   ctx;
+
+  size += _HDR_SIZE;
+
+  if (size < BIGMEM_MIN_SIZE) {
+
+    buf = malloc(size);
+    if (buf == NULL) goto fail;
+
+    hdr         = (bigmem_hdr_t *)buf;
+    hdr->size   = size;
+    hdr->mapped = 0;
+
+    return buf + _HDR_SIZE;
+  }
+
+  buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) goto fail;
+
+  /*the policy must be set before any pages are touched*/
+  bigmem_advise(buf, size);
+
+  if (_policy == BIGMEM_FIRST_TOUCH) {
+
+    nthreads = parallel_num_threads();
+
+    ctx.base     = buf;
+    ctx.size     = size;
+    ctx.partsize = (size + nthreads - 1) / nthreads;
+
+    parallel_for(nthreads, nthreads, 1, &ctx, _touch);
+  }
+
+  hdr         = (bigmem_hdr_t *)buf;
+  hdr->size   = size;
+  hdr->mapped = 1;
+
+  return buf + _HDR_SIZE;
+
+fail:
+  return NULL;
+}
+
+void bigmem_free(void *ptr) {
+
+  bigmem_hdr_t *hdr;
+
+  if (ptr == NULL) return;
+
+  hdr = (bigmem_hdr_t *)((uint8_t *)ptr - _HDR_SIZE);
+
+  if (hdr->mapped) munmap(hdr, hdr->size);
+  else             free(hdr);
+}
+
+void bigmem_advise(void *ptr, uint64_t size) {
+
+#ifdef MADV_HUGEPAGE
+  uint64_t pagesz;
+  uint64_t start;
+
+  /*madvise needs a page aligned address*/
+  pagesz = sysconf(_SC_PAGESIZE);
+  start  = (uint64_t)ptr & ~(pagesz - 1);
+
+  madvise((void *)start, size + ((uint64_t)ptr - start), MADV_HUGEPAGE);
+#endif
+
+  if (_policy == BIGMEM_INTERLEAVE) _interleave(ptr, size);
+}
+
+uint32_t _online_nodes(uint64_t *mask) {
+
+  FILE    *f;
+  int      c;
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t i;
+  uint32_t n;
+  uint32_t val;
+  uint8_t  range;
+
+  *mask = 0;
+  n     = 0;
+  lo    = 0;
+  val   = 0;
+  range = 0;
+
+  f = fopen("/sys/devices/system/node/online", "r");
+  if (f == NULL) return 0;
+
+  /*the file contains a list of ranges, e.g. "0-1,3"*/
+  do {
+
+    c = fgetc(f);
+
+    if (c >= '0' && c <= '9') {
+      val = val * 10 + (c - '0');
+      continue;
+    }
+
+    if (c == '-') {
+      lo    = val;
+      val   = 0;
+      range = 1;
+      continue;
+    }
+
+    hi = val;
+    if (!range) lo = val;
+
+    for (i = lo; i <= hi && i < _MAX_NODES; i++) {
+      if (!((*mask >> i) & 1)) n++;
+      *mask |= 1ULL << i;
+    }
+
+    val   = 0;
+    range = 0;
+
+  } while (c != EOF && c != '\n');
+
+  fclose(f);
+
+  return n;
+}
+
+void _interleave(void *ptr, uint64_t size) {
+
+#ifdef SYS_mbind
+  uint64_t mask;
+  uint64_t pagesz;
+  uint64_t start;
+
+  /*nothing to do on single node machines*/
+  if (_online_nodes(&mask) < 2) return;
+
+  pagesz = sysconf(_SC_PAGESIZE);
+  start  = (uint64_t)ptr & ~(pagesz - 1);
+
+  syscall(SYS_mbind, start, size + ((uint64_t)ptr - start),
+          _MPOL_INTERLEAVE, &mask, _MAX_NODES + 1, 0);
+#endif
+}
+
+uint8_t _touch(uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t     i;
+  uint64_t     first;
+  uint64_t     last;
+  uint64_t     pagesz;
+  touch_ctx_t *ctx;
+
+  ctx    = vctx;
+  pagesz = sysconf(_SC_PAGESIZE);
+  first  = start * ctx->partsize;
+  last   = end   * ctx->partsize;
+
+  if (last > ctx->size) last = ctx->size;
+
+  for (i = first; i < last; i += pagesz) ctx->base[i] = 0;
+
+  return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * Allocation of large, long lived buffers (e.g. the CSR arrays of a
+ * frozen graph, or a cache of voxel time series). Buffers of at least
+ * BIGMEM_MIN_SIZE bytes are mapped directly from the system, rather than
+ * from the heap, so that they can be backed by transparent huge pages,
+ * which reduce TLB misses during random access, and so that their pages
+ * can be placed across the NUMA nodes of the machine.
+ *
+ * By default Linux places each page on the NUMA node of the thread which
+ * first touches it, so a buffer which is filled by one thread ends up on
+ * one node, and threads on the other nodes pay remote access latency for
+ * all of it. Two placement policies are available (see bigmem_set_policy):
+ *
+ *   - BIGMEM_INTERLEAVE - pages are interleaved across all NUMA nodes, so
+ *     that every thread sees the same average latency.
+ *
+ *   - BIGMEM_FIRST_TOUCH - the buffer is split into contiguous partitions,
+ *     each of which is first touched by a different thread of a parallel
+ *     loop (see util/parallel.h), so that the buffer is spread across the
+ *     nodes on which those threads run.
+ *
+ * Placement is best-effort - where it is not supported, buffers are
+ * allocated as usual. Smaller buffers always come from the heap.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __BIGMEM_H__
+#define __BIGMEM_H__
+
+#include <stdint.h>
+
+/**
+ * Buffers smaller than this come from the heap.
+ */
+#define BIGMEM_MIN_SIZE (4 * 1048576)
+
+/**
+ * NUMA placement policies.
+ */
+typedef enum {
+
+  BIGMEM_DEFAULT     = 0, /**< leave placement to the system        */
+  BIGMEM_INTERLEAVE  = 1, /**< interleave pages across NUMA nodes   */
+  BIGMEM_FIRST_TOUCH = 2  /**< partitions touched by parallel threads */
+
+} bigmem_policy_t;
+
+/**
+ * Sets the placement policy for all subsequent allocations (it is not
+ * per-thread).
+ */
+void bigmem_set_policy(
+  bigmem_policy_t policy /**< the policy */
+);
+
+/**
+ * \return the current placement policy.
+ */
+bigmem_policy_t bigmem_get_policy(void);
+
+/**
+ * Allocates a buffer of the given size, which must be freed with
+ * bigmem_free. Large buffers are zeroed; smaller buffers are not.
+ *
+ * \return a pointer to the buffer, or NULL on failure.
+ */
+void *bigmem_alloc(
+  uint64_t size /**< number of bytes */
+);
+
+/**
+ * Frees a buffer allocated by bigmem_alloc. NULL is ignored.
+ */
+void bigmem_free(
+  void *ptr /**< the buffer */
+);
+
+/**
+ * Advises the system that the given existing mapping (e.g. a memory
+ * mapped file) may be backed by huge pages and, under BIGMEM_INTERLEAVE,
+ * that its pages should be interleaved across NUMA nodes. The mapping is
+ * not touched, so BIGMEM_FIRST_TOUCH has no effect here. Both hints are
+ * ignored by the system where they do not apply.
+ */
+void bigmem_advise(
+  void    *ptr, /**< start of the mapping */
+  uint64_t size /**< size of the mapping  */
+);
+
+#endif /* __BIGMEM_H__ */
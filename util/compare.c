@@ -50,6 +50,19 @@ int compare_u32(const void *a, const void *b) {
   return -1;
 }
 
+int compare_u64(const void *a, const void *b) {
+
+  uint64_t ia;
+  uint64_t ib;
+
+  ia = *(uint64_t *)a;
+  ib = *(uint64_t *)b;
+
+  if (ia >  ib) return 1;
+  if (ia == ib) return 0;
+  return -1;
+}
+
 int compare_u32_insert(const void *a, const void *b) {
 
   return compare_insert(a, b, sizeof(uint32_t), compare_u32);
@@ -102,3 +115,33 @@ void *bsearch_insert(
 
   return bsearch(key, base, nmemb, size, compar);
 }
+
+int64_t search_u32(const uint32_t *vals, uint32_t n, uint32_t key) {
+
+  uint32_t        i;
+  uint32_t        idx;
+  uint32_t        half;
+  const uint32_t *base;
+
+  if (n == 0) return -1;
+
+  /*count the values which are less than the key*/
+  if (n <= SEARCH_U32_LINEAR) {
+
+    for (i = 0, idx = 0; i < n; i++) idx += (vals[i] < key);
+
+    if (idx < n && vals[idx] == key) return idx;
+    return -1;
+  }
+
+  /*base ends up at the last value which is <= key*/
+  base = vals;
+  while (n > 1) {
+    half  = n / 2;
+    base  = (base[half] <= key) ? base + half : base;
+    n    -= half;
+  }
+
+  if (*base == key) return base - vals;
+  return -1;
+}
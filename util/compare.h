@@ -6,6 +6,7 @@
 #ifndef __COMPARE_H__
 #define __COMPARE_H__
 
+#include <stdint.h>
 #include <stdlib.h>
 
 /**
@@ -38,6 +39,16 @@ int compare_u32(
   const void *b  /**< pointer to a uint32_t */
 );
 
+/**
+ * Compares two uint64_t values.
+ *
+ * \return >0 if (*a > *b), 0 if (*a == *b), <0 if (*a < *b).
+ */
+int compare_u64(
+  const void *a, /**< pointer to a uint64_t */
+  const void *b  /**< pointer to a uint64_t */
+);
+
 /**
  * Compares two uint32_t values. Not for use with regular bsearch - for use
  * with bsearch_insert. 
@@ -87,4 +98,25 @@ void *bsearch_insert(
     const void *)     /**< compare_*_insert function       */
 );
 
+/**
+ * Sorted lists of no more than this many values are searched linearly by
+ * search_u32.
+ */
+#define SEARCH_U32_LINEAR 16
+
+/**
+ * Searches the given sorted list of uint32_t values for the given key.
+ * Equivalent to bsearch with compare_u32, but without a call through a
+ * function pointer for every comparison - short lists are scanned
+ * linearly (a loop which the compiler can vectorise), and longer lists
+ * are searched with a branch-free binary search.
+ *
+ * \return the index of the key in the list, or -1 if it is not present.
+ */
+int64_t search_u32(
+  const uint32_t *vals, /**< sorted list of values */
+  uint32_t        n,    /**< number of values      */
+  uint32_t        key   /**< value to search for   */
+);
+
 #endif /*  __COMPARE_H__ */
@@ -1,22 +1,56 @@
 /**
- * Function which copies a file.
+ * Functions which copy files, or parts of files.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/copyfile.h"
 
 #define BUF_SIZE 1048576
 
+/**
+ * Copies as much of the given range as possible with copy_file_range.
+ *
+ * \return the number of bytes which were copied.
+ */
+static uint64_t _copy_kernel(
+  int      infd,   /**< source file descriptor      */
+  uint64_t srcoff, /**< offset in the source        */
+  int      outfd,  /**< destination file descriptor */
+  uint64_t dstoff, /**< offset in the destination   */
+  uint64_t len     /**< number of bytes to copy     */
+);
+
+/**
+ * Copies the given range through a buffer.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _copy_buffer(
+  int      infd,   /**< source file descriptor      */
+  uint64_t srcoff, /**< offset in the source        */
+  int      outfd,  /**< destination file descriptor */
+  uint64_t dstoff, /**< offset in the destination   */
+  uint64_t len     /**< number of bytes to copy     */
+);
+
 uint8_t copyfile(char *src, char *dst) {
 
-  size_t nread;
-  char  *buf;
-  FILE  *inf;
-  FILE  *outf;
-  
-  buf  = NULL;
+  FILE       *inf;
+  FILE       *outf;
+  struct stat st;
+
   inf  = NULL;
   outf = NULL;
 
@@ -26,34 +60,116 @@ uint8_t copyfile(char *src, char *dst) {
   outf = fopen(dst, "wb");
   if (outf == NULL) goto fail;
 
+  if (fstat(fileno(inf), &st)) goto fail;
+
+#ifdef FICLONE
+  /*share the data with the source, if the filesystem supports it*/
+  if (ioctl(fileno(outf), FICLONE, fileno(inf)) == 0) goto done;
+#endif
+
+  if (copyfile_range(inf, 0, outf, 0, st.st_size)) goto fail;
+
+#ifdef FICLONE
+done:
+#endif
+  fclose(inf);
+  inf = NULL;
+
+  if (fclose(outf)) {
+    outf = NULL;
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  if (inf  != NULL) fclose(inf);
+  if (outf != NULL) fclose(outf);
+
+  return 1;
+}
+
+uint8_t copyfile_range(
+  FILE *src, uint64_t srcoff, FILE *dst, uint64_t dstoff, uint64_t len) {
+
+  uint64_t ncopied;
+
+  ncopied = _copy_kernel(fileno(src), srcoff, fileno(dst), dstoff, len);
+
+  return _copy_buffer(fileno(src),
+                      srcoff + ncopied,
+                      fileno(dst),
+                      dstoff + ncopied,
+                      len    - ncopied);
+}
+
+uint64_t _copy_kernel(
+  int infd, uint64_t srcoff, int outfd, uint64_t dstoff, uint64_t len) {
+
+  uint64_t ncopied;
+#ifdef __linux__
+  ssize_t  n;
+  loff_t   inoff;
+  loff_t   outoff;
+#endif
+
+  ncopied = 0;
+
+#ifdef __linux__
+  inoff  = srcoff;
+  outoff = dstoff;
+
+  /*
+   * Stop at the first error (e.g. if the call is not
+   * supported for these files), or at the end of the
+   * source, and leave the rest to the caller.
+   */
+  while (ncopied < len) {
+
+    n = copy_file_range(infd, &inoff, outfd, &outoff, len - ncopied, 0);
+    if (n <= 0) break;
+
+    ncopied += n;
+  }
+#endif
+
+  return ncopied;
+}
+
+uint8_t _copy_buffer(
+  int infd, uint64_t srcoff, int outfd, uint64_t dstoff, uint64_t len) {
+
+  ssize_t nread;
+  ssize_t nwritten;
+  ssize_t chunk;
+  char   *buf;
+
+  buf = NULL;
+
+  if (len == 0) return 0;
+
   buf = malloc(BUF_SIZE);
   if (buf == NULL) goto fail;
 
-  while (feof(inf) == 0) {
+  while (len > 0) {
 
-    clearerr(inf);
-    clearerr(outf);
-    
-    nread = fread(buf, 1, BUF_SIZE, inf);
+    chunk = (len < BUF_SIZE) ? len : BUF_SIZE;
+    nread = pread(infd, buf, chunk, srcoff);
 
-    if (ferror(inf)) goto fail;
-    if (nread == 0)  goto fail;
+    if (nread <= 0) goto fail;
 
-    if (fwrite(buf, 1, nread, outf) != nread) goto fail;
+    nwritten = pwrite(outfd, buf, nread, dstoff);
+    if (nwritten != nread) goto fail;
 
-    if (ferror(outf)) goto fail;
+    srcoff += nread;
+    dstoff += nread;
+    len    -= nread;
   }
 
-  fclose(inf);
-  fclose(outf);
   free(buf);
-
   return 0;
 
 fail:
-  if (inf  != NULL) fclose(inf);
-  if (outf != NULL) fclose(outf);
-  if (buf  != NULL) free(buf);
-
+  if (buf != NULL) free(buf);
   return 1;
 }
@@ -1,11 +1,19 @@
 /**
- * Function which copies a file.
+ * Functions which copy files, or parts of files.
+ *
+ * Where possible, the copy is performed by the kernel, without the data
+ * passing through user space: whole files are first cloned (FICLONE), so
+ * that on a copy-on-write filesystem they share storage with the source,
+ * and ranges are copied with copy_file_range, which may itself clone or
+ * copy on the server side. If neither is available, the data is copied
+ * through a buffer.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
 #ifndef COPYFILE_H
 #define COPYFILE_H
 
+#include <stdio.h>
 #include <stdint.h>
 
 /**
@@ -18,4 +26,22 @@ uint8_t copyfile(
   char *dst  /**< name of destination file */
 );
 
+/**
+ * Copies len bytes, starting at srcoff in the source file, to dstoff in
+ * the destination file, which is extended if necessary. The files are
+ * accessed through their underlying file descriptors, and the file
+ * positions of the streams are neither used nor changed, so any buffered
+ * output on the destination stream must be flushed first.
+ *
+ * \return 0 on success, non-0 on failure (including if the source file
+ * ends before len bytes have been copied).
+ */
+uint8_t copyfile_range(
+  FILE    *src,    /**< source file                                */
+  uint64_t srcoff, /**< offset of the data in the source file      */
+  FILE    *dst,    /**< destination file, open for writing         */
+  uint64_t dstoff, /**< offset to copy the data to                 */
+  uint64_t len     /**< number of bytes to copy                    */
+);
+
 #endif
@@ -1,6 +1,7 @@
 /**
- * Functions for generating fastest-slowest dimension orderings. Used by
- * the dumpimg and dumpvolume programs. 
+ * Functions for generating fastest-slowest dimension orderings, and for
+ * reordering images according to them. Used by the dumpimg and dumpvolume
+ * programs.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -11,6 +12,28 @@
 
 #include "util/dimorder.h"
 
+/**
+ * Width and height, in values, of the tiles which are
+ * copied by dimorder_transpose.
+ */
+#define _TILE_SIZE 32
+
+/**
+ * Copies one plane of values across two dimensions, a and b, in tiles.
+ * In the source, a is the fastest changing dimension; in the destination,
+ * b is. If a and b are the same dimension, the plane is a single row.
+ */
+static void _transpose_plane(
+  uint8_t *src,   /**< start of the plane in the source        */
+  uint8_t *dst,   /**< start of the plane in the destination   */
+  uint8_t  valsz, /**< size of one value, in bytes             */
+  uint32_t na,    /**< size of dimension a                     */
+  uint32_t nb,    /**< size of dimension b                     */
+  uint64_t sb,    /**< source stride of dimension b, in bytes  */
+  uint64_t da,    /**< destination stride of dimension a, in
+                       bytes                                   */
+  uint8_t  same   /**< non-0 if a and b are the same dimension */
+);
 
 uint8_t dimorder_parse(
   dsr_t   *hdr,
@@ -75,3 +98,145 @@ void dimorder_next(dsr_t *hdr, uint32_t *dims, uint8_t *dimorder) {
     if (dims[dimorder[i]] != 0) break;
   } 
 }
+
+uint8_t dimorder_transpose(
+  dsr_t *hdr, uint8_t *img, uint8_t *dimorder, uint8_t *out) {
+
+  uint8_t  i;
+  uint8_t  d;
+  uint8_t  a;
+  uint8_t  b;
+  uint8_t  ndims;
+  uint8_t  valsz;
+  uint8_t  nouter;
+  uint8_t  outer[8];
+  uint32_t size[8];
+  uint32_t idx[8];
+  uint64_t srcstride[8];
+  uint64_t dststride[8];
+  uint64_t srcoff;
+  uint64_t dstoff;
+  uint64_t acc;
+
+  ndims = analyze_num_dims(  hdr);
+  valsz = analyze_value_size(hdr);
+
+  if (ndims == 0 || ndims > 7) goto fail;
+  if (valsz == 0)              goto fail;
+
+  for (i = 0; i < ndims; i++) {
+
+    size[i]      = analyze_dim_size(hdr, i);
+    srcstride[i] = (uint64_t)valsz * analyze_dim_offset(hdr, i);
+    idx[i]       = 0;
+
+    if (size[i] == 0) return 0;
+  }
+
+  for (acc = valsz, i = 0; i < ndims; i++) {
+    dststride[dimorder[i]] = acc;
+    acc                   *= size[dimorder[i]];
+  }
+
+  a = 0;
+  b = dimorder[0];
+
+  /*
+   * the remaining dimensions are iterated over
+   * in the new order, so the output is written
+   * (more or less) sequentially
+   */
+  for (nouter = 0, i = 0; i < ndims; i++) {
+
+    d = dimorder[i];
+    if (d == a || d == b) continue;
+    outer[nouter++] = d;
+  }
+
+  srcoff = 0;
+  dstoff = 0;
+
+  while (1) {
+
+    _transpose_plane(img + srcoff,
+                     out + dstoff,
+                     valsz,
+                     size[a],
+                     size[b],
+                     srcstride[b],
+                     dststride[a],
+                     a == b);
+
+    for (i = 0; i < nouter; i++) {
+
+      d = outer[i];
+
+      idx[d]++;
+      srcoff += srcstride[d];
+      dstoff += dststride[d];
+
+      if (idx[d] < size[d]) break;
+
+      srcoff -= size[d] * srcstride[d];
+      dstoff -= size[d] * dststride[d];
+      idx[d]  = 0;
+    }
+
+    if (i == nouter) break;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _transpose_plane(
+  uint8_t *src,
+  uint8_t *dst,
+  uint8_t  valsz,
+  uint32_t na,
+  uint32_t nb,
+  uint64_t sb,
+  uint64_t da,
+  uint8_t  same) {
+
+  uint64_t ia;
+  uint64_t ib;
+  uint64_t ia0;
+  uint64_t ib0;
+  uint64_t aend;
+  uint64_t bend;
+  uint8_t *s;
+  uint8_t *d;
+
+  if (same) {
+    memcpy(dst, src, (uint64_t)na * valsz);
+    return;
+  }
+
+  for (ib0 = 0; ib0 < nb; ib0 += _TILE_SIZE) {
+    for (ia0 = 0; ia0 < na; ia0 += _TILE_SIZE) {
+
+      aend = (ia0 + _TILE_SIZE > na) ? na : ia0 + _TILE_SIZE;
+      bend = (ib0 + _TILE_SIZE > nb) ? nb : ib0 + _TILE_SIZE;
+
+      for (ib = ib0; ib < bend; ib++) {
+
+        s = src + ib * sb + ia0 * valsz;
+        d = dst + ib * valsz + ia0 * da;
+
+        for (ia = ia0; ia < aend; ia++, s += valsz, d += da) {
+
+          switch (valsz) {
+            case 1:  memcpy(d, s, 1);     break;
+            case 2:  memcpy(d, s, 2);     break;
+            case 4:  memcpy(d, s, 4);     break;
+            case 8:  memcpy(d, s, 8);     break;
+            default: memcpy(d, s, valsz); break;
+          }
+        }
+      }
+    }
+  }
+}
@@ -1,6 +1,7 @@
 /**
- * Functions for generating fastest-slowest dimension orderings. Used by
- * the dumpimg and dumpvolume programs.
+ * Functions for generating fastest-slowest dimension orderings, and for
+ * reordering images according to them. Used by the dumpimg and dumpvolume
+ * programs.
  * 
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -36,4 +37,25 @@ void dimorder_next(
   uint8_t  *dimorder /**< dimension order   */
 );
 
+/**
+ * Copies the values of the given image into out, reordered so that they
+ * are stored in the given dimension order, i.e. out contains the values
+ * in the order in which they would be visited by repeated calls to
+ * dimorder_next. The values are copied as raw bytes, without any datatype
+ * conversion, so out must be large enough to hold the whole image.
+ *
+ * The image is copied in small tiles across the fastest dimension of the
+ * image, and the fastest dimension of the new order, so that both the
+ * reads and the writes stay within a few cache lines, regardless of the
+ * order.
+ *
+ * \return 0 on success, non-0 if the image datatype is not supported.
+ */
+uint8_t dimorder_transpose(
+  dsr_t   *hdr,      /**< image header                   */
+  uint8_t *img,      /**< image data                     */
+  uint8_t *dimorder, /**< dimension order                */
+  uint8_t *out       /**< place to store reordered image */
+);
+
 #endif
@@ -9,8 +9,32 @@
 
 #include "graph/graph.h"
 #include "graph/graph_event.h"
+#include "util/memacct.h"
 #include "util/edge_array.h"
 
+/**
+ * Creates per-node arrays which point into a single contiguous buffer,
+ * laid out according to the CSR offsets of the given frozen graph.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _create_flat(
+  edge_array_t *ea /**< the edge array, with g, valsz and vals set */
+);
+
+/**
+ * Copies the values out of the contiguous buffer into separately
+ * allocated per-node arrays, so that edges can be added or removed. Called
+ * before any edge event is handled. Does nothing if the values are not
+ * stored contiguously.
+ *
+ * \return 0 on success, non-0 on failure, in which case the edge array is
+ * unchanged.
+ */
+static uint8_t _unflatten(
+  edge_array_t *ea /**< the edge array */
+);
+
 /**
  * Called when an edge is added to the graph
  */
@@ -36,6 +60,15 @@ static void _edge_removed(
   uint32_t vidx  /**< index of v, in u's neighbour list */
 );
 
+/**
+ * Called when the graph neighbour lists have been rebuilt. The values
+ * for every node are discarded, and replaced with zeros.
+ */
+static void _edges_rebuilt(
+  graph_t *g,    /**< the graph        */
+  void    *ctx   /**< listener context */
+);
+
 uint8_t edge_array_create(
   graph_t *g, uint16_t valsz, edge_array_t *ea) {
 
@@ -46,34 +79,50 @@ uint8_t edge_array_create(
   ea->g        = g;
   ea->valsz    = valsz;
   ea->vals     = NULL;
+  ea->flat     = NULL;
 
   nnodes = graph_num_nodes(g);
 
   ea->vals = calloc(nnodes, sizeof(array_t));
   if (ea->vals == NULL) goto fail;
 
-  for (i = 0; i < nnodes; i++) {
-    
-    nnbrs = graph_num_neighbours(g, i);
-    if (array_create(&ea->vals[i], valsz, nnbrs))
-      goto fail;
+  if (graph_is_frozen(g)) {
+    if (_create_flat(ea)) goto fail;
+  }
+
+  else {
+    for (i = 0; i < nnodes; i++) {
+
+      nnbrs = graph_num_neighbours(g, i);
+      if (array_create(&ea->vals[i], valsz, nnbrs))
+        goto fail;
+
+      array_set_acct(&ea->vals[i], MEMACCT_EDGES);
+    }
   }
 
   memset(&ea->gel, 0, sizeof(graph_event_listener_t));
-  ea->gel.edge_added   = _edge_added;
-  ea->gel.edge_removed = _edge_removed;
-  ea->gel.ctx          = ea;
+  ea->gel.edge_added    = _edge_added;
+  ea->gel.edge_removed  = _edge_removed;
+  ea->gel.edges_rebuilt = _edges_rebuilt;
+  ea->gel.ctx           = ea;
   graph_add_event_listener(g, &ea->gel);
   
   return 0;
   
 fail:
-  if (ea->vals != NULL) {
+  if (ea->vals != NULL && ea->flat == NULL) {
     for (i = 0; i < nnodes; i++) {
       if (ea->vals[i].data != NULL) array_free(&ea->vals[i]);
     }
-    free(ea->vals);
   }
+  if (ea->vals != NULL) free(ea->vals);
+  if (ea->flat != NULL) {
+    free(ea->flat);
+    memacct_free(MEMACCT_EDGES, ea->flatsz);
+  }
+  ea->vals = NULL;
+  ea->flat = NULL;
                           
   return 1;
 }
@@ -87,7 +136,13 @@ void edge_array_free(edge_array_t *ea) {
 
   graph_remove_event_listener(ea->g, &ea->gel);
 
-  if (ea->vals != NULL) {
+  if (ea->flat != NULL) {
+    free(ea->flat);
+    free(ea->vals);
+    memacct_free(MEMACCT_EDGES, ea->flatsz);
+  }
+
+  else if (ea->vals != NULL) {
     
     nnodes = graph_num_nodes(ea->g);
     
@@ -99,6 +154,7 @@ void edge_array_free(edge_array_t *ea) {
 
   ea->g    = NULL;
   ea->vals = NULL;
+  ea->flat = NULL;
 }
 
 void * edge_array_get(edge_array_t *ea, uint32_t u, uint32_t v) {
@@ -130,6 +186,11 @@ void edge_array_set(edge_array_t *ea, uint32_t u, uint32_t v, void * val) {
   }
 }
 
+void * edge_array_get_flat(edge_array_t *ea) {
+
+  return ea->flat;
+}
+
 void edge_array_set_all(edge_array_t *ea, uint32_t u, void *vals) {
 
   uint64_t i;
@@ -171,6 +232,8 @@ void _edge_added(
   edge_array_t *ea;
   ea = ctx;
 
+  if (_unflatten(ea)) goto fail;
+
   data = calloc(ea->valsz, 1);
   if (data == NULL) goto fail;
 
@@ -196,7 +259,117 @@ void _edge_removed(
   edge_array_t *ea;
   ea = ctx;
 
+  if (_unflatten(ea)) return;
+
   array_remove_by_idx(&ea->vals[u], vidx);
   if (!graph_is_directed(ea->g))
     array_remove_by_idx(&ea->vals[v], uidx);
 }
+
+void _edges_rebuilt(graph_t *g, void *ctx) {
+
+  uint64_t      i;
+  uint32_t      nnodes;
+  uint32_t      nnbrs;
+  edge_array_t *ea;
+
+  ea     = ctx;
+  nnodes = graph_num_nodes(g);
+
+  if (_unflatten(ea)) return;
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = graph_num_neighbours(g, i);
+
+    if (array_expand(&ea->vals[i], nnbrs)) continue;
+
+    memset(ea->vals[i].data, 0, nnbrs*ea->valsz);
+    ea->vals[i].size = nnbrs;
+  }
+}
+
+uint8_t _create_flat(edge_array_t *ea) {
+
+  uint64_t  i;
+  uint64_t  nentries;
+  uint32_t  nnodes;
+  uint32_t  nnbrs;
+  uint64_t *offsets;
+
+  nnodes   = graph_num_nodes(ea->g);
+  offsets  = ea->g->csroffsets;
+  nentries = offsets[nnodes];
+
+  ea->flat = calloc((nentries > 0) ? nentries : 1, ea->valsz);
+  if (ea->flat == NULL) goto fail;
+
+  ea->flatsz = ((nentries > 0) ? nentries : 1) * ea->valsz;
+  memacct_alloc(MEMACCT_EDGES, ea->flatsz);
+
+  for (i = 0; i < nnodes; i++) {
+
+    nnbrs = offsets[i+1] - offsets[i];
+
+    ea->vals[i].capacity = nnbrs;
+    ea->vals[i].size     = nnbrs;
+    ea->vals[i].datasz   = ea->valsz;
+    ea->vals[i].data     = ea->flat + offsets[i]*ea->valsz;
+    ea->vals[i].cmp      = NULL;
+    ea->vals[i].cmpins   = NULL;
+    ea->vals[i].arena    = NULL;
+    ea->vals[i].acct     = MEMACCT_NONE;
+  }
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t _unflatten(edge_array_t *ea) {
+
+  uint64_t i;
+  uint32_t nnodes;
+  uint32_t nvals;
+  array_t *vals;
+
+  if (ea->flat == NULL) return 0;
+
+  nnodes = graph_num_nodes(ea->g);
+
+  vals = calloc(nnodes, sizeof(array_t));
+  if (vals == NULL) goto fail;
+
+  /*
+   * the graph has already been edited, so the per-node
+   * array sizes, rather than the graph, give the layout
+   * of the values in the contiguous buffer
+   */
+  for (i = 0; i < nnodes; i++) {
+
+    nvals = ea->vals[i].size;
+
+    if (array_create(&vals[i], ea->valsz, nvals)) goto fail;
+
+    array_set_acct(&vals[i], MEMACCT_EDGES);
+    memcpy(vals[i].data, ea->vals[i].data, nvals*ea->valsz);
+    vals[i].size = nvals;
+  }
+
+  free(ea->flat);
+  free(ea->vals);
+  memacct_free(MEMACCT_EDGES, ea->flatsz);
+
+  ea->flat = NULL;
+  ea->vals = vals;
+
+  return 0;
+
+fail:
+  if (vals != NULL) {
+    for (i = 0; i < nnodes; i++) array_free(&vals[i]);
+    free(vals);
+  }
+  return 1;
+}
@@ -2,6 +2,13 @@
  * Manage an array of values, one for each edge, for a graph. Supports
  * directed or undirected graphs.
  *
+ * If the graph is frozen (see graph_freeze) when the edge array is
+ * created, the values for all nodes are stored in a single contiguous
+ * buffer, in the same order as the CSR neighbour list of the graph, so the
+ * value for the edge at CSR offset i is at index i of the buffer (see
+ * edge_array_get_flat). If the graph is subsequently thawed and edited,
+ * the values are copied into separate per-node arrays.
+ *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */ 
 #ifndef __EDGE_ARRAY_H__
@@ -20,6 +27,11 @@ typedef struct _edge_array {
   graph_t  *g;        /**< the graph                                   */
   uint16_t  valsz;    /**< size of one value                           */
   array_t  *vals;     /**< array of array_t structs, one for each node */
+  uint8_t  *flat;     /**< contiguous values for all nodes, indexed by
+                           CSR edge offset, if the graph was frozen when
+                           the array was created - the per-node arrays
+                           point into this buffer. NULL otherwise.     */
+  uint64_t  flatsz;   /**< size of flat, in bytes                      */
 
   graph_event_listener_t gel; /**< graph event listener, to track
                                    edge addition/removal events        */
@@ -71,6 +83,16 @@ void edge_array_set(
   void         *val /**< the new value                     */
 );
 
+/**
+ * \return the contiguous buffer containing the values for every edge,
+ * indexed by CSR edge offset (see graph_t.csroffsets), or NULL if the
+ * graph was not frozen when the edge array was created, or has since been
+ * edited.
+ */
+void * edge_array_get_flat(
+  edge_array_t *ea /**< pointer to an edge_array_t struct */
+);
+
 /**
  * Sets the value for every edge starting from the given node.
  */
@@ -0,0 +1,199 @@
+/**
+ * Functions for intersecting sorted lists of node indices.
+ *
+ * The block-wise SSE2 merge is based on:
+ *
+ *   Lemire D, Boytsov L & Kurz N 2016. SIMD compression and the
+ *   intersection of sorted integers. Software: Practice and Experience
+ *   46(6):723-749
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util/intersect.h"
+
+/**
+ * If one list is more than this many times longer than the other, a
+ * galloping search is used instead of a merge.
+ */
+#define INTERSECT_GALLOP_RATIO 32
+
+/**
+ * Counts the common values of two lists by a scalar merge.
+ *
+ * \return the number of values common to both lists.
+ */
+static uint32_t _merge_count(
+  uint32_t *a,  /**< first sorted list               */
+  uint32_t  na, /**< number of values in first list  */
+  uint32_t *b,  /**< second sorted list              */
+  uint32_t  nb  /**< number of values in second list */
+);
+
+/**
+ * Counts the common values of two lists by locating each value of the
+ * short list in the long list, with an exponential search followed by a
+ * binary search.
+ *
+ * \return the number of values common to both lists.
+ */
+static uint32_t _gallop_count(
+  uint32_t *a,  /**< short sorted list               */
+  uint32_t  na, /**< number of values in short list  */
+  uint32_t *b,  /**< long sorted list                */
+  uint32_t  nb  /**< number of values in long list   */
+);
+
+#ifdef __SSE2__
+/**
+ * Counts the common values of two lists by comparing blocks of four values
+ * from each list, all against all, and advancing past whichever block has
+ * the smaller last value. The remainder is handled by _merge_count.
+ *
+ * \return the number of values common to both lists.
+ */
+static uint32_t _sse2_count(
+  uint32_t *a,  /**< first sorted list               */
+  uint32_t  na, /**< number of values in first list  */
+  uint32_t *b,  /**< second sorted list              */
+  uint32_t  nb  /**< number of values in second list */
+);
+#endif
+
+uint32_t intersect_count(uint32_t *a, uint32_t na, uint32_t *b, uint32_t nb) {
+
+  if (na == 0 || nb == 0) return 0;
+
+  /*disjoint ranges*/
+  if (a[na-1] < b[0] || b[nb-1] < a[0]) return 0;
+
+  if ((uint64_t)na * INTERSECT_GALLOP_RATIO < nb)
+    return _gallop_count(a, na, b, nb);
+  if ((uint64_t)nb * INTERSECT_GALLOP_RATIO < na)
+    return _gallop_count(b, nb, a, na);
+
+#ifdef __SSE2__
+  return _sse2_count(a, na, b, nb);
+#else
+  return _merge_count(a, na, b, nb);
+#endif
+}
+
+uint32_t _merge_count(uint32_t *a, uint32_t na, uint32_t *b, uint32_t nb) {
+
+  uint32_t i;
+  uint32_t j;
+  uint32_t count;
+
+  i     = 0;
+  j     = 0;
+  count = 0;
+
+  while (i < na && j < nb) {
+
+    if      (a[i] < b[j]) i++;
+    else if (a[i] > b[j]) j++;
+    else {
+      count++;
+      i++;
+      j++;
+    }
+  }
+
+  return count;
+}
+
+uint32_t _gallop_count(uint32_t *a, uint32_t na, uint32_t *b, uint32_t nb) {
+
+  uint32_t i;
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t mid;
+  uint32_t step;
+  uint32_t count;
+
+  lo    = 0;
+  count = 0;
+
+  for (i = 0; i < na && lo < nb; i++) {
+
+    /*find a range (lo, hi] of b which contains a[i]*/
+    step = 1;
+    hi   = lo;
+    while (hi < nb && b[hi] < a[i]) {
+      lo    = hi;
+      hi   += step;
+      step *= 2;
+    }
+    if (hi > nb) hi = nb;
+
+    /*find the first value in b[lo..hi) which is >= a[i]*/
+    while (lo < hi) {
+
+      mid = lo + (hi - lo) / 2;
+
+      if (b[mid] < a[i]) lo = mid + 1;
+      else               hi = mid;
+    }
+
+    if (lo < nb && b[lo] == a[i]) {
+      count++;
+      lo++;
+    }
+  }
+
+  return count;
+}
+
+#ifdef __SSE2__
+uint32_t _sse2_count(uint32_t *a, uint32_t na, uint32_t *b, uint32_t nb) {
+
+  uint32_t i;
+  uint32_t j;
+  uint32_t count;
+  uint32_t amax;
+  uint32_t bmax;
+  __m128i  va;
+  __m128i  vb;
+  __m128i  eq;
+
+  i     = 0;
+  j     = 0;
+  count = 0;
+
+  /*
+   * Neither list contains duplicates, so each value in
+   * the a block matches at most one value in the b block.
+   * Comparing va against the four rotations of vb thus
+   * gives at most one set lane per value of va.
+   */
+  while (i + 4 <= na && j + 4 <= nb) {
+
+    va = _mm_loadu_si128((__m128i *)(a + i));
+    vb = _mm_loadu_si128((__m128i *)(b + j));
+
+    eq = _mm_cmpeq_epi32(va, vb);
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(
+      va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(
+      va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(
+      va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+
+    count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+
+    amax = a[i+3];
+    bmax = b[j+3];
+
+    if (amax <= bmax) i += 4;
+    if (bmax <= amax) j += 4;
+  }
+
+  return count + _merge_count(a + i, na - i, b + j, nb - j);
+}
+#endif
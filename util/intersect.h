@@ -0,0 +1,28 @@
+/**
+ * Functions for intersecting sorted lists of node indices, such as graph
+ * neighbour lists.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __INTERSECT_H__
+#define __INTERSECT_H__
+
+#include <stdint.h>
+
+/**
+ * Counts the number of values which are present in both of the given lists.
+ * Both lists must be sorted in ascending order, and must not contain
+ * duplicates. When one list is much shorter than the other, each of its
+ * values is located in the longer list by a galloping search; otherwise the
+ * lists are merged, using SSE2 block comparisons where available.
+ *
+ * \return the number of values common to both lists.
+ */
+uint32_t intersect_count(
+  uint32_t *a,  /**< first sorted list                */
+  uint32_t  na, /**< number of values in first list   */
+  uint32_t *b,  /**< second sorted list               */
+  uint32_t  nb  /**< number of values in second list  */
+);
+
+#endif /* __INTERSECT_H__ */
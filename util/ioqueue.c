@@ -0,0 +1,82 @@
+/**
+ * Runs independent I/O operations concurrently on the parallel_for thread
+ * pool, with a bounded number in flight.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "util/parallel.h"
+#include "util/ioqueue.h"
+
+/**
+ * Context for _run_items.
+ */
+typedef struct _ioqueue_ctx {
+
+  void     *ctx;                   /**< context for fn */
+  uint8_t (*fn)(uint64_t, void *); /**< the operation  */
+
+} ioqueue_ctx_t;
+
+/**
+ * parallel_for function which calls the operation for each item in a
+ * chunk.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _run_items(
+  uint64_t start,  /**< first item                */
+  uint64_t end,    /**< one past last item        */
+  uint16_t thread, /**< thread identifier         */
+  void    *ctx     /**< pointer to ioqueue_ctx_t  */
+);
+
+uint16_t ioqueue_default_window(void) {
+
+  char *env;
+  long  n;
+
+  env = getenv(IOQUEUE_WINDOW_ENV);
+  n   = (env != NULL) ? atol(env) : 0;
+
+  if (n > PARALLEL_MAX_THREADS) n = PARALLEL_MAX_THREADS;
+  if (n > 0)                    return n;
+
+  return IOQUEUE_DEFAULT_WINDOW;
+}
+
+uint8_t ioqueue_run(
+  uint64_t  n,
+  uint16_t  window,
+  void     *ctx,
+  uint8_t (*fn)(uint64_t, void *)) {
+
+  ioqueue_ctx_t qctx;
+
+  if (window == 0) window = ioqueue_default_window();
+
+  qctx.ctx = ctx;
+  qctx.fn  = fn;
+
+  /*
+   * one item per chunk, so that a slow operation
+   * doesn't hold up the items queued behind it
+   */
+  return parallel_for(window, n, 1, &qctx, _run_items);
+}
+
+uint8_t _run_items(uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  uint64_t       i;
+  ioqueue_ctx_t *qctx;
+
+  qctx = ctx;
+
+  for (i = start; i < end; i++) {
+    if (qctx->fn(i, qctx->ctx)) return 1;
+  }
+
+  return 0;
+}
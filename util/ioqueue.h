@@ -0,0 +1,55 @@
+/**
+ * Runs many independent, latency bound I/O operations (e.g. opening and
+ * reading a large number of image files on network storage) concurrently,
+ * with a bounded number in flight at any one time.
+ *
+ * The operations are run on the thread pool used by parallel_for (see
+ * util/parallel.h), each blocking worker performing one operation at a
+ * time. As the workers spend most of their time waiting on the storage,
+ * the window is independent of, and may be much larger than, the number
+ * of CPUs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __IOQUEUE_H__
+#define __IOQUEUE_H__
+
+#include <stdint.h>
+
+/**
+ * Environment variable which, if set, gives the default window size.
+ */
+#define IOQUEUE_WINDOW_ENV "CCNET_IO_WINDOW"
+
+/**
+ * Number of operations in flight at once, if neither a window size nor
+ * IOQUEUE_WINDOW_ENV is given.
+ */
+#define IOQUEUE_DEFAULT_WINDOW 16
+
+/**
+ * \return the default window size - the value of IOQUEUE_WINDOW_ENV if it
+ * is set, otherwise IOQUEUE_DEFAULT_WINDOW.
+ */
+uint16_t ioqueue_default_window(void);
+
+/**
+ * Calls the given function for every item in the range [0, n), with at
+ * most window calls in progress at once. The order in which the items
+ * are started is unspecified. If any call returns non-0, no further items
+ * are started, and this function returns non-0 once the calls which are
+ * in progress have finished.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t ioqueue_run(
+  uint64_t  n,        /**< number of items                    */
+  uint16_t  window,   /**< maximum number of calls in flight
+                           (0 - use ioqueue_default_window)   */
+  void     *ctx,      /**< context passed to function         */
+  uint8_t (*fn)(      /**< function to call                   */
+    uint64_t i,       /**< item index                         */
+    void    *ctx)     /**< context                            */
+);
+
+#endif /* __IOQUEUE_H__ */
@@ -0,0 +1,177 @@
+/**
+ * Accounting of the memory used by large data structures.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/resource.h>
+
+#include "util/profile.h"
+#include "util/memacct.h"
+
+/**
+ * Names of the categories, in the order of memacct_category_t - the
+ * first is used for the totals.
+ */
+static char *_names[MEMACCT_NUM_CATEGORIES] = {
+  "total",
+  "graphs",
+  "stats caches",
+  "edge arrays",
+  "mat buffers",
+  "volume images",
+  "time series caches"
+};
+
+/**
+ * Bytes currently allocated in each category - [MEMACCT_NONE] is the
+ * total.
+ */
+static uint64_t _current[MEMACCT_NUM_CATEGORIES];
+
+/**
+ * Peak of each entry in _current.
+ */
+static uint64_t _peak[MEMACCT_NUM_CATEGORIES];
+
+/**
+ * Memory budget, or 0 for no budget.
+ */
+static uint64_t _budget = 0;
+
+/**
+ * Non-0 once the report has been registered with atexit.
+ */
+static uint8_t _reporting = 0;
+
+/**
+ * Raises the given peak to at least the given value.
+ */
+static void _raise_peak(
+  uint64_t *peak, /**< the peak      */
+  uint64_t  val   /**< current value */
+);
+
+/**
+ * Prints the counters to standard error. Registered with atexit.
+ */
+static void _report(void);
+
+void memacct_alloc(memacct_category_t cat, uint64_t bytes) {
+
+  uint64_t cur;
+
+  if (cat == MEMACCT_NONE || cat >= MEMACCT_NUM_CATEGORIES) return;
+  if (bytes == 0)                                           return;
+
+  cur = __atomic_add_fetch(_current + cat, bytes, __ATOMIC_RELAXED);
+  _raise_peak(_peak + cat, cur);
+
+  cur = __atomic_add_fetch(_current, bytes, __ATOMIC_RELAXED);
+  _raise_peak(_peak, cur);
+}
+
+void memacct_free(memacct_category_t cat, uint64_t bytes) {
+
+  if (cat == MEMACCT_NONE || cat >= MEMACCT_NUM_CATEGORIES) return;
+  if (bytes == 0)                                           return;
+
+  __atomic_sub_fetch(_current + cat, bytes, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(_current,       bytes, __ATOMIC_RELAXED);
+}
+
+uint64_t memacct_current(memacct_category_t cat) {
+
+  if (cat >= MEMACCT_NUM_CATEGORIES) return 0;
+
+  return __atomic_load_n(_current + cat, __ATOMIC_RELAXED);
+}
+
+uint64_t memacct_peak(memacct_category_t cat) {
+
+  if (cat >= MEMACCT_NUM_CATEGORIES) return 0;
+
+  return __atomic_load_n(_peak + cat, __ATOMIC_RELAXED);
+}
+
+void memacct_set_budget(uint64_t budget) {
+
+  _budget = budget;
+
+  if (budget > 0) memacct_init(1);
+}
+
+uint64_t memacct_budget(void) {
+
+  return _budget;
+}
+
+uint64_t memacct_remaining(void) {
+
+  uint64_t cur;
+
+  if (_budget == 0) return UINT64_MAX;
+
+  cur = memacct_current(MEMACCT_NONE);
+
+  return (cur >= _budget) ? 0 : _budget - cur;
+}
+
+uint8_t memacct_fits(uint64_t bytes) {
+
+  return bytes <= memacct_remaining();
+}
+
+void memacct_init(uint8_t enable) {
+
+  if (_reporting)               return;
+  if (!enable && !profile_on)   return;
+
+  _reporting = 1;
+  atexit(_report);
+}
+
+void _raise_peak(uint64_t *peak, uint64_t val) {
+
+  uint64_t old;
+
+  old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+  while (val > old &&
+         !__atomic_compare_exchange_n(
+           peak, &old, val, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void _report(void) {
+
+  uint64_t      i;
+  struct rusage ru;
+
+  fflush(stdout);
+
+  fprintf(stderr, "memory: %-40s %14s %14s\n", "category", "MB", "peak MB");
+
+  for (i = 1; i <= MEMACCT_NUM_CATEGORIES; i++) {
+
+    /*the total goes last*/
+    if (i == MEMACCT_NUM_CATEGORIES) i = 0;
+
+    fprintf(stderr, "memory: %-40s %14.2f %14.2f\n",
+            _names[i],
+            memacct_current(i) / 1048576.0,
+            memacct_peak(   i) / 1048576.0);
+
+    if (i == 0) break;
+  }
+
+  if (_budget > 0)
+    fprintf(stderr, "memory: %-40s %14.2f\n", "budget", _budget / 1048576.0);
+
+  /*ru_maxrss is in kilobytes on Linux*/
+  if (!getrusage(RUSAGE_SELF, &ru))
+    fprintf(stderr, "memory: %-40s %14s %14.2f\n",
+            "peak resident set size", "", ru.ru_maxrss / 1024.0);
+}
@@ -0,0 +1,115 @@
+/**
+ * Accounting of the memory used by the large data structures of a
+ * program - graphs, stats caches, edge arrays, mat and volume buffers,
+ * and time series caches. The code which allocates and frees these
+ * structures reports the number of bytes to this module, which keeps the
+ * current and peak number of bytes used in each category, and in total.
+ * The counters may be queried at any time, and are printed to standard
+ * error when the program exits, if profiling (see util/profile.h) is
+ * enabled, or if a memory budget has been set.
+ *
+ * A memory budget may be set with the --mem-budget option (see
+ * util/startup.c). The budget is not enforced by failing allocations;
+ * instead, code which has a choice of strategies (e.g. reading a graph
+ * into memory, or streaming it from disk) asks memacct_fits whether the
+ * larger one fits in what is left of the budget, and falls back to the
+ * smaller one if it does not.
+ *
+ * Updates are atomic, so may be made from any thread. Small and short
+ * lived allocations are not accounted for, so the totals are a lower
+ * bound on the memory used by the program; the peak resident set size
+ * reported by the system is printed alongside them.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __MEMACCT_H__
+#define __MEMACCT_H__
+
+#include <stdint.h>
+
+/**
+ * Accounting categories.
+ */
+typedef enum {
+
+  MEMACCT_NONE = 0,    /**< not accounted for                      */
+  MEMACCT_GRAPH,       /**< graph_t adjacency lists and CSR arrays */
+  MEMACCT_STATS_CACHE, /**< stats_cache fields                     */
+  MEMACCT_EDGES,       /**< edge_array_t values                    */
+  MEMACCT_MAT,         /**< mat file buffers                       */
+  MEMACCT_VOLUME,      /**< ANALYZE75/NIFTI-1 volume image data    */
+  MEMACCT_TSCACHE,     /**< voxel time series caches               */
+  MEMACCT_NUM_CATEGORIES
+
+} memacct_category_t;
+
+/**
+ * Records an allocation of the given number of bytes in the given
+ * category. Ignored for MEMACCT_NONE.
+ */
+void memacct_alloc(
+  memacct_category_t cat,  /**< category        */
+  uint64_t           bytes /**< number of bytes */
+);
+
+/**
+ * Records that the given number of bytes, previously passed to
+ * memacct_alloc for the given category, have been freed.
+ */
+void memacct_free(
+  memacct_category_t cat,  /**< category        */
+  uint64_t           bytes /**< number of bytes */
+);
+
+/**
+ * \return the number of bytes currently allocated in the given category,
+ * or in total for MEMACCT_NONE.
+ */
+uint64_t memacct_current(
+  memacct_category_t cat /**< category */
+);
+
+/**
+ * \return the largest number of bytes which have been allocated at once
+ * in the given category, or in total for MEMACCT_NONE.
+ */
+uint64_t memacct_peak(
+  memacct_category_t cat /**< category */
+);
+
+/**
+ * Sets the memory budget, in bytes, or 0 for no budget. The counters are
+ * printed at exit once a budget has been set.
+ */
+void memacct_set_budget(
+  uint64_t budget /**< budget in bytes */
+);
+
+/**
+ * \return the memory budget in bytes, or 0 if there is no budget.
+ */
+uint64_t memacct_budget(void);
+
+/**
+ * \return the number of bytes left in the budget (0 if it has been
+ * exceeded), or UINT64_MAX if there is no budget.
+ */
+uint64_t memacct_remaining(void);
+
+/**
+ * \return non-0 if an allocation of the given number of bytes would fit
+ * within the budget (always, if there is no budget), 0 otherwise.
+ */
+uint8_t memacct_fits(
+  uint64_t bytes /**< number of bytes */
+);
+
+/**
+ * Prints the counters to standard error at exit if enable is non-0, or if
+ * profiling is enabled. Called by startup.
+ */
+void memacct_init(
+  uint8_t enable /**< print the counters regardless of profiling */
+);
+
+#endif /* __MEMACCT_H__ */
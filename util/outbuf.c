@@ -0,0 +1,446 @@
+/**
+ * A buffered output stream. See util/outbuf.h for more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/parallel.h"
+#include "util/outbuf.h"
+
+/**
+ * Default buffer capacity.
+ */
+#define _DEFAULT_CAP (1 << 20)
+
+/**
+ * Initial capacity of the in-memory streams used by outbuf_parallel.
+ */
+#define _CHUNK_CAP (1 << 16)
+
+/**
+ * Largest scaled magnitude (value * 10^places) which is formatted by
+ * outbuf_fixed itself - anything larger is passed to snprintf.
+ */
+#define _FIXED_MAX 1e15
+
+/**
+ * Largest number of decimal places which is formatted by outbuf_fixed
+ * itself.
+ */
+#define _FIXED_MAX_PLACES 9
+
+/**
+ * Context for _format_chunks.
+ */
+typedef struct _par_ctx {
+
+  outbuf_t  *bufs;  /**< one in-memory stream per chunk */
+  uint64_t   n;     /**< number of items                */
+  uint64_t   chunk; /**< number of items per chunk      */
+  void      *ctx;   /**< context for fn                 */
+  uint8_t  (*fn)(uint64_t, uint64_t, outbuf_t *, void *);
+
+} par_ctx_t;
+
+/**
+ * Makes sure that there is room for the given number of bytes in the
+ * buffer, writing its contents to the file (or, for an in-memory stream,
+ * enlarging the buffer) if necessary.
+ *
+ * \return 0 if there is room, non-0 if the buffer could not be written,
+ * or if the request is larger than the buffer.
+ */
+static uint8_t _reserve(
+  outbuf_t *ob, /**< the stream      */
+  uint32_t  len /**< number of bytes */
+);
+
+/**
+ * Writes the buffer contents to the file, and empties the buffer. Does
+ * nothing for an in-memory stream.
+ */
+static void _drain(
+  outbuf_t *ob /**< the stream */
+);
+
+/**
+ * Writes the given value with snprintf, for values which outbuf_fixed
+ * cannot format exactly.
+ */
+static void _fixed_printf(
+  outbuf_t *ob,    /**< the stream                       */
+  double    val,   /**< value to write                   */
+  uint8_t   places /**< number of digits after the point */
+);
+
+/**
+ * Doubles the capacity of an in-memory stream until there is room for the
+ * given number of bytes. Sets the error flag on failure.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _grow(
+  outbuf_t *ob, /**< the stream      */
+  uint64_t  len /**< number of bytes */
+);
+
+/**
+ * parallel_for function which formats a range of chunks for
+ * outbuf_parallel, each into its own in-memory stream.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _format_chunks(
+  uint64_t start,  /**< first chunk             */
+  uint64_t end,    /**< one past last chunk     */
+  uint16_t thread, /**< thread identifier       */
+  void    *ctx     /**< pointer to a par_ctx_t  */
+);
+
+/**
+ * Writes the given 4 or 8 byte value in big endian byte order.
+ */
+static void _write_be(
+  outbuf_t   *ob,  /**< the stream               */
+  const void *val, /**< the value                */
+  uint8_t     len  /**< size of the value (4, 8) */
+);
+
+uint8_t outbuf_create(outbuf_t *ob, FILE *f, uint32_t cap) {
+
+  memset(ob, 0, sizeof(outbuf_t));
+
+  if (cap == 0) cap = _DEFAULT_CAP;
+
+  ob->buf = malloc(cap);
+  if (ob->buf == NULL) goto fail;
+
+  ob->f   = f;
+  ob->cap = cap;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+void outbuf_free(outbuf_t *ob) {
+
+  if (ob->buf != NULL) free(ob->buf);
+
+  memset(ob, 0, sizeof(outbuf_t));
+}
+
+uint8_t outbuf_flush(outbuf_t *ob) {
+
+  _drain(ob);
+
+  if (!ob->err && ob->f != NULL && fflush(ob->f)) ob->err = 1;
+
+  return ob->err;
+}
+
+void outbuf_bytes(outbuf_t *ob, const void *data, uint64_t len) {
+
+  if (ob->err) return;
+
+  if (ob->f == NULL && len > ob->cap - ob->len && _grow(ob, len)) return;
+
+  /*large writes bypass the buffer*/
+  if (len > ob->cap - ob->len) {
+
+    _drain(ob);
+
+    if (len >= ob->cap) {
+      if (!ob->err && fwrite(data, 1, len, ob->f) != len) ob->err = 1;
+      return;
+    }
+  }
+
+  memcpy(ob->buf + ob->len, data, len);
+  ob->len += len;
+}
+
+void outbuf_str(outbuf_t *ob, const char *str) {
+
+  outbuf_bytes(ob, str, strlen(str));
+}
+
+void outbuf_char(outbuf_t *ob, char c) {
+
+  if (_reserve(ob, 1)) return;
+
+  ob->buf[ob->len++] = c;
+}
+
+void outbuf_u64(outbuf_t *ob, uint64_t val) {
+
+  char    digits[20];
+  uint8_t i;
+
+  if (_reserve(ob, 20)) return;
+
+  i = 0;
+  do {
+    digits[i++] = '0' + (val % 10);
+    val        /= 10;
+  } while (val > 0);
+
+  while (i > 0) ob->buf[ob->len++] = digits[--i];
+}
+
+void outbuf_u64_width(outbuf_t *ob, uint64_t val, uint8_t width) {
+
+  uint64_t ndigits;
+  uint64_t v;
+
+  ndigits = 1;
+  for (v = val; v >= 10; v /= 10) ndigits++;
+
+  if (_reserve(ob, width)) return;
+
+  for (; ndigits < width; ndigits++) ob->buf[ob->len++] = ' ';
+
+  outbuf_u64(ob, val);
+}
+
+void outbuf_fixed(outbuf_t *ob, double val, uint8_t places) {
+
+  static const double scales[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+  };
+
+  double   scaled;
+  double   whole;
+  double   frac;
+  uint64_t rounded;
+  uint64_t scale;
+  uint64_t fp;
+  uint8_t  i;
+
+  if (places > _FIXED_MAX_PLACES || !isfinite(val)) {
+    _fixed_printf(ob, val, places);
+    return;
+  }
+
+  /*
+   * The scaled value carries a relative error of at
+   * most one ulp, so the rounding direction is only
+   * certain when the fractional part is not within
+   * that error of one half; exact (and near) halves
+   * are left to printf, which rounds them on the
+   * exact binary value.
+   */
+  scaled = fabs(val) * scales[places];
+  whole  = floor(scaled);
+  frac   = scaled - whole;
+
+  if (scaled >= _FIXED_MAX || fabs(frac - 0.5) <= scaled * 1e-15 + 1e-300) {
+    _fixed_printf(ob, val, places);
+    return;
+  }
+
+  rounded = (uint64_t)whole + (frac > 0.5);
+  scale   = (uint64_t)scales[places];
+
+  /*printf keeps the sign of values which round to 0*/
+  if (signbit(val)) outbuf_char(ob, '-');
+
+  outbuf_u64(ob, rounded / scale);
+
+  if (places == 0) return;
+
+  if (_reserve(ob, places + 1)) return;
+
+  fp = rounded % scale;
+
+  ob->buf[ob->len] = '.';
+
+  for (i = places; i > 0; i--) {
+    ob->buf[ob->len + i] = '0' + (fp % 10);
+    fp                  /= 10;
+  }
+
+  ob->len += places + 1;
+}
+
+uint8_t outbuf_parallel(
+  outbuf_t  *ob,
+  uint16_t   nthreads,
+  uint64_t   n,
+  uint64_t   chunk,
+  void      *ctx,
+  uint8_t  (*fn)(uint64_t, uint64_t, outbuf_t *, void *)) {
+
+  uint64_t  i;
+  uint64_t  nchunks;
+  uint8_t   err;
+  par_ctx_t pctx;
+
+  pctx.bufs = NULL;
+  err       = 0;
+
+  if (chunk    == 0) chunk    = 1;
+  if (nthreads == 0) nthreads = parallel_num_threads();
+
+  nchunks = (n + chunk - 1) / chunk;
+
+  if (nthreads == 1 || nchunks <= 1) {
+
+    for (i = 0; i < n; i += chunk) {
+      if (fn(i, (i + chunk < n) ? i + chunk : n, ob, ctx)) goto fail;
+    }
+
+    return ob->err;
+  }
+
+  pctx.bufs = calloc(nchunks, sizeof(outbuf_t));
+  if (pctx.bufs == NULL) goto fail;
+
+  for (i = 0; i < nchunks; i++) {
+    if (outbuf_create(pctx.bufs + i, NULL, _CHUNK_CAP)) goto fail;
+  }
+
+  pctx.n     = n;
+  pctx.chunk = chunk;
+  pctx.ctx   = ctx;
+  pctx.fn    = fn;
+
+  if (parallel_for(nthreads, nchunks, 1, &pctx, _format_chunks)) goto fail;
+
+  for (i = 0; i < nchunks; i++) {
+    outbuf_bytes(ob, pctx.bufs[i].buf, pctx.bufs[i].len);
+    outbuf_free(pctx.bufs + i);
+  }
+
+  free(pctx.bufs);
+
+  return ob->err;
+
+fail:
+  err = 1;
+  if (pctx.bufs != NULL) {
+    for (i = 0; i < nchunks; i++) outbuf_free(pctx.bufs + i);
+    free(pctx.bufs);
+  }
+  return err;
+}
+
+void outbuf_be32(outbuf_t *ob, const void *val) {
+
+  _write_be(ob, val, 4);
+}
+
+void outbuf_be64(outbuf_t *ob, const void *val) {
+
+  _write_be(ob, val, 8);
+}
+
+uint8_t _reserve(outbuf_t *ob, uint32_t len) {
+
+  if (ob->err)                  return 1;
+  if (ob->cap - ob->len >= len) return 0;
+  if (ob->f == NULL)            return _grow(ob, len);
+
+  _drain(ob);
+
+  if (ob->err)       return 1;
+  if (len > ob->cap) return 1;
+
+  return 0;
+}
+
+void _drain(outbuf_t *ob) {
+
+  if (ob->err || ob->len == 0 || ob->f == NULL) return;
+
+  if (fwrite(ob->buf, 1, ob->len, ob->f) != ob->len) ob->err = 1;
+
+  ob->len = 0;
+}
+
+uint8_t _grow(outbuf_t *ob, uint64_t len) {
+
+  uint64_t cap;
+  char    *tmp;
+
+  cap = ob->cap;
+  while (cap - ob->len < len) cap *= 2;
+
+  if (cap > 0xFFFFFFFF) goto fail;
+
+  tmp = realloc(ob->buf, cap);
+  if (tmp == NULL) goto fail;
+
+  ob->buf = tmp;
+  ob->cap = cap;
+
+  return 0;
+
+fail:
+  ob->err = 1;
+  return 1;
+}
+
+void _fixed_printf(outbuf_t *ob, double val, uint8_t places) {
+
+  char str[640];
+  int  len;
+
+  len = snprintf(str, sizeof(str), "%0.*f", places, val);
+
+  if (len < 0 || len >= (int)sizeof(str)) {
+    ob->err = 1;
+    return;
+  }
+
+  outbuf_bytes(ob, str, len);
+}
+
+void _write_be(outbuf_t *ob, const void *val, uint8_t len) {
+
+  uint16_t       one;
+  uint8_t        i;
+  const uint8_t *bytes;
+
+  if (_reserve(ob, len)) return;
+
+  one   = 1;
+  bytes = val;
+
+  if (*(uint8_t *)&one) {
+    for (i = 0; i < len; i++) ob->buf[ob->len + i] = bytes[len - i - 1];
+  }
+  else memcpy(ob->buf + ob->len, bytes, len);
+
+  ob->len += len;
+}
+
+uint8_t _format_chunks(
+  uint64_t start, uint64_t end, uint16_t thread, void *vctx) {
+
+  uint64_t   i;
+  uint64_t   first;
+  uint64_t   last;
+  par_ctx_t *ctx;
+
+  ctx = vctx;
+
+  for (i = start; i < end; i++) {
+
+    first = i * ctx->chunk;
+    last  = first + ctx->chunk;
+
+    if (last > ctx->n) last = ctx->n;
+
+    if (ctx->fn(first, last, ctx->bufs + i, ctx->ctx)) return 1;
+    if (ctx->bufs[i].err)                             return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * A buffered output stream, for writing large text or binary files.
+ *
+ * Values are formatted by hand, straight into a large buffer, which is
+ * written to the underlying file handle when it is full (or explicitly
+ * flushed). Numbers are formatted exactly as the equivalent printf
+ * conversion would format them, but much faster. A stream which is
+ * created without a file handle is an in-memory buffer, which grows as
+ * needed, and which is never written anywhere - outbuf_parallel uses
+ * these to format chunks of output on several threads at once.
+ *
+ * The write functions do not return a status; instead, an error flag is
+ * set on the stream if a write to the underlying file fails, and all
+ * further writes are ignored. The flag is returned by outbuf_flush, which
+ * must be called before the stream is freed.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __OUTBUF_H__
+#define __OUTBUF_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Output stream handle.
+ */
+typedef struct _outbuf {
+
+  FILE    *f;   /**< underlying file handle         */
+  char    *buf; /**< the buffer                     */
+  uint32_t len; /**< number of bytes in the buffer  */
+  uint32_t cap; /**< capacity of the buffer         */
+  uint8_t  err; /**< non-0 if a write has failed    */
+
+} outbuf_t;
+
+/**
+ * Creates a stream which writes to the given file handle.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t outbuf_create(
+  outbuf_t *ob, /**< the stream                                 */
+  FILE     *f,  /**< file handle to write to, or NULL for an
+                     in-memory buffer                           */
+  uint32_t  cap /**< buffer capacity in bytes (0 - use default) */
+);
+
+/**
+ * Frees the memory used by the stream. Any buffered data which has not
+ * been flushed is lost. The file handle is not closed.
+ */
+void outbuf_free(
+  outbuf_t *ob /**< the stream */
+);
+
+/**
+ * Writes any buffered data to the file handle, and flushes it.
+ *
+ * \return 0 if every write to the stream has succeeded, non-0 otherwise.
+ */
+uint8_t outbuf_flush(
+  outbuf_t *ob /**< the stream */
+);
+
+/**
+ * Writes the given raw bytes.
+ */
+void outbuf_bytes(
+  outbuf_t   *ob,   /**< the stream      */
+  const void *data, /**< data to write   */
+  uint64_t    len   /**< number of bytes */
+);
+
+/**
+ * Writes the given null-terminated string.
+ */
+void outbuf_str(
+  outbuf_t   *ob, /**< the stream      */
+  const char *str /**< string to write */
+);
+
+/**
+ * Writes the given character.
+ */
+void outbuf_char(
+  outbuf_t *ob, /**< the stream         */
+  char      c   /**< character to write */
+);
+
+/**
+ * Writes the given unsigned integer, as printf("%u").
+ */
+void outbuf_u64(
+  outbuf_t *ob, /**< the stream     */
+  uint64_t  val /**< value to write */
+);
+
+/**
+ * Writes the given unsigned integer, right aligned in a field of the given
+ * width, as printf("%*u").
+ */
+void outbuf_u64_width(
+  outbuf_t *ob,    /**< the stream          */
+  uint64_t  val,   /**< value to write      */
+  uint8_t   width  /**< minimum field width */
+);
+
+/**
+ * Writes the given value in fixed point notation with the given number of
+ * decimal places, as printf("%0.<places>f").
+ */
+void outbuf_fixed(
+  outbuf_t *ob,    /**< the stream                       */
+  double    val,   /**< value to write                   */
+  uint8_t   places /**< number of digits after the point */
+);
+
+/**
+ * Writes the given 4 byte value as binary, in big endian byte order.
+ */
+void outbuf_be32(
+  outbuf_t   *ob, /**< the stream                    */
+  const void *val /**< pointer to the value to write */
+);
+
+/**
+ * Writes the given 8 byte value as binary, in big endian byte order.
+ */
+void outbuf_be64(
+  outbuf_t   *ob, /**< the stream                    */
+  const void *val /**< pointer to the value to write */
+);
+
+/**
+ * Formats items [0, n), split into chunks of the given size, across the
+ * given number of threads (see util/parallel.h), and writes the output to
+ * the given stream in item order. Each chunk is formatted by a call to the
+ * given function, into an in-memory stream; the chunks are written to the
+ * output stream once every chunk has been formatted, so the function must
+ * only format items whose data is already in memory. With one thread, the
+ * function writes straight to the output stream.
+ *
+ * \return 0 on success, non-0 if any call to the function fails, or if
+ * memory could not be allocated.
+ */
+uint8_t outbuf_parallel(
+  outbuf_t  *ob,         /**< the output stream              */
+  uint16_t   nthreads,   /**< number of threads (0 - default) */
+  uint64_t   n,          /**< number of items                */
+  uint64_t   chunk,      /**< number of items per chunk      */
+  void      *ctx,        /**< context passed to function     */
+  uint8_t  (*fn)(        /**< function to call               */
+    uint64_t  start,     /**< first item in chunk            */
+    uint64_t  end,       /**< one past last item in chunk    */
+    outbuf_t *out,       /**< stream to write to             */
+    void     *ctx)       /**< context                        */
+);
+
+#endif /* __OUTBUF_H__ */
@@ -0,0 +1,404 @@
+/**
+ * Simple parallel-for built on top of pthreads. See util/parallel.h for
+ * more details.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "util/parallel.h"
+
+/**
+ * A contiguous range of chunks, which is worked through from the front.
+ */
+typedef struct _parallel_range {
+
+  uint64_t next; /**< next chunk to be handed out  */
+  uint64_t end;  /**< one past the last chunk      */
+
+} parallel_range_t;
+
+/**
+ * State shared between all of the threads working on a parallel_for call.
+ * All fields other than the ranges and the failed flag are protected by
+ * the pool lock.
+ */
+typedef struct _parallel_job {
+
+  uint64_t              n;        /**< number of work items              */
+  uint64_t              chunk;    /**< items per chunk                   */
+  uint16_t              nthreads; /**< maximum number of threads         */
+  uint16_t              nslots;   /**< thread identifiers handed out     */
+  uint16_t              active;   /**< pool workers working on the job   */
+  uint8_t               failed;   /**< set when any function call fails  */
+  void                 *ctx;      /**< function context                  */
+  uint8_t             (*fn)(uint64_t, uint64_t, uint16_t, void *);
+  pthread_cond_t        done;     /**< signalled when active reaches 0   */
+  struct _parallel_job *next;     /**< next job waiting for workers      */
+  parallel_range_t      ranges[PARALLEL_MAX_THREADS]; /**< one per thread */
+
+} parallel_job_t;
+
+/**
+ * Context for _reduce_chunk.
+ */
+typedef struct _reduce_ctx {
+
+  uint64_t chunk; /**< items per chunk           */
+  double  *vals;  /**< value of each chunk       */
+  void    *ctx;   /**< user function context     */
+  uint8_t (*fn)(uint64_t, uint64_t, uint16_t, void *, double *);
+
+} reduce_ctx_t;
+
+/**
+ * Protects the pool state, and the job fields listed above.
+ */
+static pthread_mutex_t _pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when a job is added to the pool.
+ */
+static pthread_cond_t _pool_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Jobs which may be joined by more workers, most recent first.
+ */
+static parallel_job_t *_pool_jobs = NULL;
+
+/**
+ * Number of pool workers which have been started.
+ */
+static uint16_t _pool_size = 0;
+
+/**
+ * Process-wide thread count (see parallel_set_default_threads), or 0.
+ */
+static uint16_t _default_nthreads = 0;
+
+/**
+ * Number of threads used by the calling thread when a thread count of 0
+ * is requested, or 0 for the process default (see parallel_set_threads).
+ */
+static __thread uint16_t _nthreads = 0;
+
+/**
+ * Pool worker entry point. Repeatedly joins the most recent job which has
+ * room for another thread, and works on it until there is no work left.
+ */
+static void * _pool_worker(
+  void *arg /**< unused */
+);
+
+/**
+ * Starts pool workers until there are at least n of them. Must be called
+ * with the pool lock held. Failure to start a worker is not an error, as
+ * jobs can always be completed by their calling threads.
+ */
+static void _ensure_pool(
+  uint16_t n /**< number of workers */
+);
+
+/**
+ * Removes the given job from the list of jobs waiting for workers, if it
+ * is on the list. Must be called with the pool lock held.
+ */
+static void _unlink(
+  parallel_job_t *job /**< the job */
+);
+
+/**
+ * Works on the given job as the given thread - chunks are taken from the
+ * thread's own range, then from the ranges of the other threads, until
+ * there are none left.
+ */
+static void _run(
+  parallel_job_t *job,   /**< the job           */
+  uint16_t        thread /**< thread identifier */
+);
+
+/**
+ * parallel_for function used by parallel_reduce - calls the user function
+ * for one chunk, and stores its value.
+ *
+ * \return the return value of the user function.
+ */
+static uint8_t _reduce_chunk(
+  uint64_t start,  /**< first item in chunk         */
+  uint64_t end,    /**< one past last item in chunk */
+  uint16_t thread, /**< thread identifier           */
+  void    *ctx     /**< pointer to reduce_ctx_t     */
+);
+
+void parallel_set_default_threads(uint16_t nthreads) {
+
+  __atomic_store_n(&_default_nthreads, nthreads, __ATOMIC_RELAXED);
+}
+
+void parallel_set_threads(uint16_t nthreads) {
+
+  _nthreads = nthreads;
+}
+
+uint16_t parallel_num_threads(void) {
+
+  char    *env;
+  long     n;
+  uint16_t nthreads;
+
+  nthreads = _nthreads;
+
+  if (nthreads == 0)
+    nthreads = __atomic_load_n(&_default_nthreads, __ATOMIC_RELAXED);
+
+  if (nthreads == 0) {
+
+    env = getenv(PARALLEL_THREADS_ENV);
+    n   = (env != NULL) ? atol(env) : 0;
+
+    if (n > PARALLEL_MAX_THREADS) n = PARALLEL_MAX_THREADS;
+    if (n > 0)                    nthreads = n;
+  }
+
+  if (nthreads == 0)                    return parallel_num_cpus();
+  if (nthreads >  PARALLEL_MAX_THREADS) return PARALLEL_MAX_THREADS;
+
+  return nthreads;
+}
+
+uint16_t parallel_num_cpus(void) {
+
+  long ncpus;
+
+  ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (ncpus < 1)                    return 1;
+  if (ncpus > PARALLEL_MAX_THREADS) return PARALLEL_MAX_THREADS;
+
+  return ncpus;
+}
+
+uint8_t parallel_for(
+  uint16_t  nthreads,
+  uint64_t  n,
+  uint64_t  chunk,
+  void     *ctx,
+  uint8_t (*fn)(uint64_t, uint64_t, uint16_t, void *)) {
+
+  uint64_t        i;
+  uint64_t        nchunks;
+  uint8_t         failed;
+  parallel_job_t *job;
+
+  if (fn    == NULL) goto fail;
+  if (n     == 0)    return 0;
+  if (chunk == 0)    chunk = 1;
+
+  if (nthreads == 0)                    nthreads = parallel_num_threads();
+  if (nthreads >  PARALLEL_MAX_THREADS) nthreads = PARALLEL_MAX_THREADS;
+
+  nchunks = (n + chunk - 1) / chunk;
+  if (nthreads > nchunks) nthreads = nchunks;
+
+  /*no point in involving the pool*/
+  if (nthreads <= 1) {
+    for (i = 0; i < n; i += chunk) {
+      if (fn(i, (i + chunk > n) ? n : i + chunk, 0, ctx)) goto fail;
+    }
+    return 0;
+  }
+
+  job = calloc(1, sizeof(parallel_job_t));
+  if (job == NULL) goto fail;
+
+  job->n        = n;
+  job->chunk    = chunk;
+  job->nthreads = nthreads;
+  job->nslots   = 1;
+  job->ctx      = ctx;
+  job->fn       = fn;
+
+  for (i = 0; i < nthreads; i++) {
+    job->ranges[i].next = (i     * nchunks) / nthreads;
+    job->ranges[i].end  = ((i+1) * nchunks) / nthreads;
+  }
+
+  if (pthread_cond_init(&job->done, NULL)) {
+    free(job);
+    goto fail;
+  }
+
+  /*the calling thread is thread 0*/
+  pthread_mutex_lock(&_pool_lock);
+  _ensure_pool(nthreads - 1);
+  job->next  = _pool_jobs;
+  _pool_jobs = job;
+  pthread_cond_broadcast(&_pool_cond);
+  pthread_mutex_unlock(&_pool_lock);
+
+  _run(job, 0);
+
+  /*
+   * every chunk has been handed out, but
+   * workers may still be running theirs
+   */
+  pthread_mutex_lock(&_pool_lock);
+  _unlink(job);
+  while (job->active > 0) pthread_cond_wait(&job->done, &_pool_lock);
+  pthread_mutex_unlock(&_pool_lock);
+
+  failed = job->failed;
+
+  pthread_cond_destroy(&job->done);
+  free(job);
+
+  return failed;
+
+fail:
+  return 1;
+}
+
+uint8_t parallel_reduce(
+  uint16_t  nthreads,
+  uint64_t  n,
+  uint64_t  chunk,
+  void     *ctx,
+  uint8_t (*fn)(uint64_t, uint64_t, uint16_t, void *, double *),
+  double   *result) {
+
+  uint64_t     i;
+  uint64_t     nchunks;
+  reduce_ctx_t rctx;
+
+  rctx.vals = NULL;
+  *result   = 0;
+
+  if (fn    == NULL) goto fail;
+  if (n     == 0)    return 0;
+  if (chunk == 0)    chunk = 1;
+
+  nchunks = (n + chunk - 1) / chunk;
+
+  rctx.chunk = chunk;
+  rctx.ctx   = ctx;
+  rctx.fn    = fn;
+  rctx.vals  = calloc(nchunks, sizeof(double));
+  if (rctx.vals == NULL) goto fail;
+
+  if (parallel_for(nthreads, n, chunk, &rctx, _reduce_chunk)) goto fail;
+
+  for (i = 0; i < nchunks; i++) *result += rctx.vals[i];
+
+  free(rctx.vals);
+  return 0;
+
+fail:
+  if (rctx.vals != NULL) free(rctx.vals);
+  return 1;
+}
+
+void * _pool_worker(void *arg) {
+
+  uint16_t        thread;
+  parallel_job_t *job;
+
+  pthread_mutex_lock(&_pool_lock);
+
+  while (1) {
+
+    while (_pool_jobs == NULL) pthread_cond_wait(&_pool_cond, &_pool_lock);
+
+    job    = _pool_jobs;
+    thread = job->nslots++;
+
+    if (job->nslots == job->nthreads) _unlink(job);
+
+    job->active++;
+    pthread_mutex_unlock(&_pool_lock);
+
+    _run(job, thread);
+
+    pthread_mutex_lock(&_pool_lock);
+    job->active--;
+    if (job->active == 0) pthread_cond_broadcast(&job->done);
+  }
+
+  return NULL;
+}
+
+void _ensure_pool(uint16_t n) {
+
+  pthread_t      thread;
+  pthread_attr_t attr;
+
+  if (n > PARALLEL_MAX_THREADS - 1) n = PARALLEL_MAX_THREADS - 1;
+  if (_pool_size >= n)              return;
+
+  if (pthread_attr_init(&attr)) return;
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  while (_pool_size < n) {
+    if (pthread_create(&thread, &attr, _pool_worker, NULL)) break;
+    _pool_size++;
+  }
+
+  pthread_attr_destroy(&attr);
+}
+
+void _unlink(parallel_job_t *job) {
+
+  parallel_job_t **prev;
+
+  for (prev = &_pool_jobs; *prev != NULL; prev = &(*prev)->next) {
+    if (*prev == job) {
+      *prev = job->next;
+      break;
+    }
+  }
+
+  job->next = NULL;
+}
+
+void _run(parallel_job_t *job, uint16_t thread) {
+
+  uint64_t          i;
+  uint64_t          c;
+  uint64_t          start;
+  uint64_t          end;
+  parallel_range_t *range;
+
+  for (i = 0; i < job->nthreads; i++) {
+
+    range = job->ranges + (thread + i) % job->nthreads;
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+
+      c = __atomic_fetch_add(&range->next, 1, __ATOMIC_RELAXED);
+      if (c >= range->end) break;
+
+      start = c * job->chunk;
+      end   = start + job->chunk;
+      if (end > job->n) end = job->n;
+
+      if (job->fn(start, end, thread, job->ctx)) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        break;
+      }
+    }
+  }
+}
+
+uint8_t _reduce_chunk(
+  uint64_t start, uint64_t end, uint16_t thread, void *ctx) {
+
+  reduce_ctx_t *rctx;
+
+  rctx = ctx;
+
+  return rctx->fn(
+    start, end, thread, rctx->ctx, rctx->vals + start / rctx->chunk);
+}
@@ -0,0 +1,118 @@
+/**
+ * Simple parallel-for built on top of pthreads.
+ *
+ * All parallel loops share a single pool of worker threads, which are
+ * started when they are first needed, and then kept for the lifetime of
+ * the process. A loop is run by the calling thread, along with as many
+ * idle pool workers as it asks for - if the pool is busy (e.g. because
+ * the loop is nested inside another parallel loop), the calling thread
+ * does the remaining work itself. So nested and concurrent loops never
+ * run more threads than the pool holds, plus the calling threads.
+ *
+ * Within a loop, the chunks are divided into one contiguous range per
+ * thread; a thread which finishes its own range takes chunks from the
+ * front of the others' ranges.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <stdint.h>
+
+/**
+ * Maximum number of threads which may be requested.
+ */
+#define PARALLEL_MAX_THREADS 256
+
+/**
+ * Environment variable which, if set, gives the default number of
+ * threads (see parallel_set_default_threads).
+ */
+#define PARALLEL_THREADS_ENV "CCNET_THREADS"
+
+/**
+ * \return the number of online processors, or 1 if this cannot be
+ * determined.
+ */
+uint16_t parallel_num_cpus(void);
+
+/**
+ * Sets the default number of threads for the whole process, which is
+ * used by every thread which has not set its own count with
+ * parallel_set_threads. Passing 0 restores the default, which is the
+ * value of PARALLEL_THREADS_ENV if it is set, otherwise all CPUs. Called
+ * by startup (see util/startup.h) for the --threads option.
+ */
+void parallel_set_default_threads(
+  uint16_t nthreads /**< number of threads, or 0 for the default */
+);
+
+/**
+ * Sets the number of threads used by the calling thread when a thread
+ * count of 0 is passed to parallel_for, or to any other function which
+ * accepts a thread count. Passing 0 restores the process default (see
+ * parallel_set_default_threads). The setting only affects the calling
+ * thread, so threads which are each working on separate jobs can limit
+ * their own parallelism.
+ */
+void parallel_set_threads(
+  uint16_t nthreads /**< number of threads, or 0 for the default */
+);
+
+/**
+ * \return the number of threads used by the calling thread when a thread
+ * count of 0 is requested (see parallel_set_threads).
+ */
+uint16_t parallel_num_threads(void);
+
+/**
+ * Calls the given function over the range [0, n), split into chunks of the
+ * given size, across the given number of threads. The thread identifier
+ * passed to the function is in the range [0, nthreads), and can be used
+ * to index per-thread workspaces - no two threads working on the same
+ * call have the same identifier. The calling thread is always thread 0.
+ *
+ * If nthreads is 0, parallel_num_threads is used. If nthreads is 1, or
+ * there is only one chunk of work, the function is called directly from
+ * the calling thread.
+ *
+ * If any call to the function returns non-0, no further chunks are handed
+ * out, and this function returns non-0.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t parallel_for(
+  uint16_t  nthreads,    /**< number of threads           */
+  uint64_t  n,           /**< number of work items        */
+  uint64_t  chunk,       /**< number of items per chunk   */
+  void     *ctx,         /**< context passed to function  */
+  uint8_t (*fn)(         /**< function to call            */
+    uint64_t start,      /**< first item in chunk         */
+    uint64_t end,        /**< one past last item in chunk */
+    uint16_t thread,     /**< calling thread identifier   */
+    void    *ctx)        /**< context                     */
+);
+
+/**
+ * Like parallel_for, but each call to the function produces a value, and
+ * the values of all chunks are summed. The values are summed in chunk
+ * order, so the result does not depend on the number of threads.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t parallel_reduce(
+  uint16_t  nthreads,    /**< number of threads           */
+  uint64_t  n,           /**< number of work items        */
+  uint64_t  chunk,       /**< number of items per chunk   */
+  void     *ctx,         /**< context passed to function  */
+  uint8_t (*fn)(         /**< function to call            */
+    uint64_t start,      /**< first item in chunk         */
+    uint64_t end,        /**< one past last item in chunk */
+    uint16_t thread,     /**< calling thread identifier   */
+    void    *ctx,        /**< context                     */
+    double  *val),       /**< place to store chunk value  */
+  double   *result       /**< place to store the sum      */
+);
+
+#endif /* __PARALLEL_H__ */
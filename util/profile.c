@@ -0,0 +1,158 @@
+/**
+ * Optional timing and counter instrumentation.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "util/profile.h"
+
+uint8_t profile_on = 0;
+
+/**
+ * Names of the counters, in the order of profile_counter_t.
+ */
+static char *_counter_names[PROFILE_NUM_COUNTERS] = {
+  "bfs searches",
+  "bfs nodes expanded",
+  "bfs edges scanned",
+  "cache hits",
+  "cache misses",
+  "ngdb bytes read",
+  "ngdb bytes written",
+  "mat bytes read",
+  "mat bytes written",
+  "analyze bytes read",
+  "analyze bytes written"
+};
+
+/**
+ * Counter values.
+ */
+static uint64_t _counters[PROFILE_NUM_COUNTERS];
+
+/**
+ * Timers which have been used, most recently added first.
+ */
+static profile_timer_t *_timers = NULL;
+
+/**
+ * Protects the timer list.
+ */
+static pthread_mutex_t _timers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \return the current time, in nanoseconds, from a monotonic clock.
+ */
+static uint64_t _now(void);
+
+/**
+ * Prints the timers and counters to standard error. Registered with
+ * atexit by profile_init.
+ */
+static void _report(void);
+
+void profile_init(uint8_t enable) {
+
+  char *env;
+
+  if (profile_on) return;
+
+  env = getenv("CCNET_PROFILE");
+
+  if (env != NULL && env[0] != '\0' && strcmp(env, "0")) enable = 1;
+
+  if (!enable) return;
+
+  profile_on = 1;
+  atexit(_report);
+}
+
+void profile_count(profile_counter_t counter, uint64_t n) {
+
+  __atomic_add_fetch(_counters + counter, n, __ATOMIC_RELAXED);
+}
+
+profile_scope_t profile_scope_begin(profile_timer_t *timer) {
+
+  profile_scope_t scope;
+
+  if (!profile_on) {
+    scope.timer = NULL;
+    scope.start = 0;
+  }
+  else {
+    scope.timer = timer;
+    scope.start = _now();
+  }
+
+  return scope;
+}
+
+void profile_scope_end(profile_scope_t *scope) {
+
+  uint64_t         elapsed;
+  profile_timer_t *t;
+
+  t = scope->timer;
+
+  if (t == NULL) return;
+
+  elapsed = _now() - scope->start;
+
+  __atomic_add_fetch(&t->calls, 1,       __ATOMIC_RELAXED);
+  __atomic_add_fetch(&t->nsecs, elapsed, __ATOMIC_RELAXED);
+
+  if (__atomic_load_n(&t->listed, __ATOMIC_ACQUIRE)) return;
+
+  pthread_mutex_lock(&_timers_lock);
+  if (!t->listed) {
+    t->next  = _timers;
+    _timers  = t;
+    __atomic_store_n(&t->listed, 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&_timers_lock);
+}
+
+uint64_t _now(void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void _report(void) {
+
+  uint64_t         i;
+  profile_timer_t *t;
+
+  fflush(stdout);
+
+  /*
+   * Times are inclusive - a function which calls other
+   * instrumented functions includes their time - and
+   * are summed across threads.
+   */
+  fprintf(stderr, "profile: %-40s %12s %14s\n",
+          "function", "calls", "seconds");
+
+  pthread_mutex_lock(&_timers_lock);
+  for (t = _timers; t != NULL; t = t->next) {
+    fprintf(stderr, "profile: %-40s %12" PRIu64 " %14.6f\n",
+            t->name, t->calls, t->nsecs / 1e9);
+  }
+  pthread_mutex_unlock(&_timers_lock);
+
+  for (i = 0; i < PROFILE_NUM_COUNTERS; i++) {
+    fprintf(stderr, "profile: %-40s %12" PRIu64 "\n",
+            _counter_names[i], _counters[i]);
+  }
+}
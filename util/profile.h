@@ -0,0 +1,124 @@
+/**
+ * Optional timing and counter instrumentation. Profiling is enabled by
+ * the --profile option (see util/startup.c), or by setting the
+ * CCNET_PROFILE environment variable to anything other than an empty
+ * string or 0. When it is enabled, the time spent in, and number of calls
+ * to, every instrumented function, and the value of every counter, are
+ * printed to standard error when the program exits.
+ *
+ * When profiling is disabled, each instrumented function costs one branch
+ * on entry and exit, and each counter update costs one branch.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdint.h>
+
+/**
+ * Event counters.
+ */
+typedef enum {
+
+  PROFILE_BFS_SEARCHES = 0, /**< breadth first searches started        */
+  PROFILE_BFS_NODES,        /**< nodes expanded by searches            */
+  PROFILE_BFS_EDGES,        /**< edges leaving the expanded nodes      */
+  PROFILE_CACHE_HITS,       /**< stats_cache_check hits                */
+  PROFILE_CACHE_MISSES,     /**< stats_cache_check misses, on graphs
+                                 which have a stats cache              */
+  PROFILE_NGDB_READ,        /**< bytes read from ngdb files            */
+  PROFILE_NGDB_WRITTEN,     /**< bytes written to ngdb files           */
+  PROFILE_MAT_READ,         /**< bytes read from mat files             */
+  PROFILE_MAT_WRITTEN,      /**< bytes written to mat files            */
+  PROFILE_ANALYZE_READ,     /**< bytes read (or mapped) from ANALYZE75
+                                 files                                 */
+  PROFILE_ANALYZE_WRITTEN,  /**< bytes written to ANALYZE75 files      */
+  PROFILE_NUM_COUNTERS
+
+} profile_counter_t;
+
+/**
+ * Accumulated time for one instrumented function. Timers are declared
+ * statically by PROFILE_FUNC, and are added to the report the first time
+ * that they are used.
+ */
+typedef struct _profile_timer {
+
+  const char            *name;   /**< function name                */
+  uint64_t               calls;  /**< number of calls              */
+  uint64_t               nsecs;  /**< total wall clock time        */
+  uint8_t                listed; /**< whether the timer has been
+                                      added to the report          */
+  struct _profile_timer *next;   /**< next timer in the report     */
+
+} profile_timer_t;
+
+/**
+ * One call to an instrumented function.
+ */
+typedef struct _profile_scope {
+
+  profile_timer_t *timer; /**< timer, or NULL if profiling is disabled */
+  uint64_t         start; /**< time at which the call started          */
+
+} profile_scope_t;
+
+/**
+ * Non-0 if profiling is enabled. Only set by profile_init.
+ */
+extern uint8_t profile_on;
+
+/**
+ * Enables profiling if enable is non-0, or if the CCNET_PROFILE
+ * environment variable is set. The report is printed at exit.
+ */
+void profile_init(
+  uint8_t enable /**< enable profiling regardless of the environment */
+);
+
+/**
+ * Adds n to the given counter. Safe to call from multiple threads. Use
+ * PROFILE_COUNT, which skips the call when profiling is disabled.
+ */
+void profile_count(
+  profile_counter_t counter, /**< counter to update */
+  uint64_t          n        /**< amount to add     */
+);
+
+/**
+ * Starts timing a call to the function with the given timer. Use
+ * PROFILE_FUNC, rather than calling this directly.
+ *
+ * \return the scope of the call.
+ */
+profile_scope_t profile_scope_begin(
+  profile_timer_t *timer /**< the function's timer */
+);
+
+/**
+ * Stops timing a call, and adds its time to the function's timer. Called
+ * automatically when the scope declared by PROFILE_FUNC ends.
+ */
+void profile_scope_end(
+  profile_scope_t *scope /**< the call */
+);
+
+/**
+ * Adds n to the given counter, if profiling is enabled.
+ */
+#define PROFILE_COUNT(counter, n)                           \
+  do { if (profile_on) profile_count((counter), (n)); } while (0)
+
+/**
+ * Times every call to the enclosing function, from the point at which
+ * this appears until the function returns, by any path. Must appear
+ * only once in a function, among its variable declarations.
+ */
+#define PROFILE_FUNC()                                                 \
+  static profile_timer_t _profile_timer = {__func__, 0, 0, 0, NULL};   \
+  profile_scope_t _profile_scope                                       \
+    __attribute__((cleanup(profile_scope_end))) =                      \
+    profile_scope_begin(&_profile_timer)
+
+#endif /* __PROFILE_H__ */
@@ -0,0 +1,317 @@
+/**
+ * Optional progress reporting for long running jobs.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "util/progress.h"
+
+uint8_t progress_on = 0;
+
+/**
+ * Names of the counters, in the order of progress_counter_t.
+ */
+static char *_counter_names[PROGRESS_NUM_COUNTERS] = {
+  "rows",
+  "edges",
+  "sources"
+};
+
+/**
+ * State of one counter.
+ */
+typedef struct _progress_job {
+
+  uint64_t done;    /**< amount of work done (updated atomically) */
+  uint64_t total;   /**< amount of work in the job, or 0          */
+  uint64_t start;   /**< time at which the job was started        */
+  uint64_t end;     /**< time at which the job finished           */
+  uint8_t  state;   /**< 0 - never started, 1 - running,
+                         2 - finished                             */
+
+} progress_job_t;
+
+static progress_job_t  _jobs[PROGRESS_NUM_COUNTERS];
+static char           *_fname    = NULL;
+static uint32_t        _interval = PROGRESS_INTERVAL;
+
+/**
+ * The timer thread.
+ */
+static pthread_t _thread;
+static uint8_t   _running = 0;
+static uint8_t   _stop    = 0;
+
+/**
+ * Protects the job states, and is used with _wake to stop the timer
+ * thread.
+ */
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _wake = PTHREAD_COND_INITIALIZER;
+
+/**
+ * \return the current time, in nanoseconds, from a monotonic clock.
+ */
+static uint64_t _now(void);
+
+/**
+ * Formats the given number of nanoseconds as hours, minutes and seconds.
+ */
+static void _fmt_time(
+  char     *buf, /**< place to store the string (at least 32 bytes) */
+  uint64_t  ns   /**< time in nanoseconds                          */
+);
+
+/**
+ * Formats a line describing the state of the given job.
+ */
+static void _fmt_job(
+  char               *buf,     /**< place to store the line (at least 256
+                                    bytes)                              */
+  progress_counter_t  counter, /**< the job                              */
+  uint64_t            now      /**< current time                         */
+);
+
+/**
+ * Prints the state of the given job to standard error, if there is no
+ * status file, or rewrites the status file with the state of every job
+ * which has been started. Must be called with _lock held.
+ */
+static void _print(
+  progress_counter_t counter, /**< the job, or PROGRESS_NUM_COUNTERS to
+                                   print every running job             */
+  uint64_t           now      /**< current time                        */
+);
+
+/**
+ * Timer thread - prints the running jobs every _interval seconds, until
+ * _stop is set.
+ */
+static void * _sampler(
+  void *arg /**< unused */
+);
+
+/**
+ * Stops the timer thread. Registered with atexit by progress_init.
+ */
+static void _shutdown(void);
+
+void progress_init(uint8_t enable, char *fname, uint32_t interval) {
+
+  if (progress_on || !enable) return;
+
+  _fname      = fname;
+  _interval   = (interval == 0) ? PROGRESS_INTERVAL : interval;
+  progress_on = 1;
+
+  atexit(_shutdown);
+}
+
+void progress_begin(progress_counter_t counter, uint64_t total) {
+
+  if (!progress_on) return;
+
+  pthread_mutex_lock(&_lock);
+
+  __atomic_store_n(&_jobs[counter].done, 0, __ATOMIC_RELAXED);
+  _jobs[counter].total = total;
+  _jobs[counter].start = _now();
+  _jobs[counter].state = 1;
+
+  if (!_running && !_stop) {
+    if (!pthread_create(&_thread, NULL, _sampler, NULL)) _running = 1;
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+void progress_add(progress_counter_t counter, uint64_t n) {
+
+  __atomic_add_fetch(&_jobs[counter].done, n, __ATOMIC_RELAXED);
+}
+
+void progress_end(progress_counter_t counter) {
+
+  if (!progress_on) return;
+
+  pthread_mutex_lock(&_lock);
+
+  if (_jobs[counter].state == 1) {
+
+    _jobs[counter].end   = _now();
+    _jobs[counter].state = 2;
+    _print(counter, _jobs[counter].end);
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+uint64_t _now(void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void _fmt_time(char *buf, uint64_t ns) {
+
+  uint64_t secs;
+
+  secs = ns / 1000000000ULL;
+
+  sprintf(buf, "%" PRIu64 "h%02um%02us",
+          secs / 3600,
+          (uint32_t)((secs / 60) % 60),
+          (uint32_t)(secs % 60));
+}
+
+void _fmt_job(char *buf, progress_counter_t counter, uint64_t now) {
+
+  uint64_t        done;
+  uint64_t        elapsed;
+  double          rate;
+  char            eta[32];
+  char            took[32];
+  progress_job_t *job;
+
+  job     = _jobs + counter;
+  done    = __atomic_load_n(&job->done, __ATOMIC_RELAXED);
+  elapsed = ((job->state == 2) ? job->end : now) - job->start;
+  rate    = (elapsed > 0) ? done / (elapsed / 1000000000.0) : 0;
+
+  if (job->state == 2) {
+
+    _fmt_time(took, elapsed);
+    sprintf(buf, "progress: %s %" PRIu64 " done in %s (%0.1f/s)",
+            _counter_names[counter], done, took, rate);
+  }
+
+  else if (job->total == 0) {
+    sprintf(buf, "progress: %s %" PRIu64 ", %0.1f/s",
+            _counter_names[counter], done, rate);
+  }
+
+  /*the estimate assumes that the average rate so far is kept up*/
+  else {
+
+    if (done == 0 || rate == 0)  strcpy(eta, "unknown");
+    else if (done >= job->total) strcpy(eta, "0h00m00s");
+    else _fmt_time(eta, (job->total - done) / rate * 1000000000.0);
+
+    sprintf(buf, "progress: %s %" PRIu64 "/%" PRIu64 " (%0.1f%%), "
+                 "%0.1f/s, ETA %s",
+            _counter_names[counter],
+            done,
+            job->total,
+            100.0 * done / job->total,
+            rate,
+            eta);
+  }
+}
+
+void _print(progress_counter_t counter, uint64_t now) {
+
+  uint64_t  i;
+  char      line[256];
+  char     *tmpf;
+  FILE     *f;
+
+  if (_fname == NULL) {
+
+    fflush(stdout);
+
+    for (i = 0; i < PROGRESS_NUM_COUNTERS; i++) {
+
+      if (counter != PROGRESS_NUM_COUNTERS && i != counter) continue;
+      if (counter == PROGRESS_NUM_COUNTERS && _jobs[i].state != 1)
+        continue;
+
+      _fmt_job(line, i, now);
+      fprintf(stderr, "%s\n", line);
+    }
+    fflush(stderr);
+    return;
+  }
+
+  /*
+   * the status file is replaced, rather than
+   * rewritten, so that it may be read at any
+   * time without seeing a partial sample
+   */
+  f    = NULL;
+  tmpf = malloc(strlen(_fname) + 5);
+  if (tmpf == NULL) goto fail;
+
+  sprintf(tmpf, "%s.tmp", _fname);
+
+  f = fopen(tmpf, "w");
+  if (f == NULL) goto fail;
+
+  for (i = 0; i < PROGRESS_NUM_COUNTERS; i++) {
+
+    if (_jobs[i].state == 0) continue;
+
+    _fmt_job(line, i, now);
+    fprintf(f, "%s\n", line);
+  }
+
+  if (fclose(f)) {
+    f = NULL;
+    goto fail;
+  }
+  f = NULL;
+
+  if (rename(tmpf, _fname)) goto fail;
+
+  free(tmpf);
+  return;
+
+fail:
+  if (f    != NULL) fclose(f);
+  if (tmpf != NULL) free(tmpf);
+}
+
+void * _sampler(void *arg) {
+
+  struct timespec deadline;
+
+  pthread_mutex_lock(&_lock);
+
+  while (!_stop) {
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += _interval;
+
+    while (!_stop &&
+           pthread_cond_timedwait(&_wake, &_lock, &deadline) != ETIMEDOUT);
+
+    if (_stop) break;
+
+    _print(PROGRESS_NUM_COUNTERS, _now());
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  return NULL;
+}
+
+void _shutdown(void) {
+
+  pthread_mutex_lock(&_lock);
+  _stop = 1;
+  pthread_cond_signal(&_wake);
+  pthread_mutex_unlock(&_lock);
+
+  if (_running) pthread_join(_thread, NULL);
+  _running = 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Optional progress reporting for long running jobs. Progress reporting
+ * is enabled by the --progress option (see util/startup.c). Code which
+ * runs a long job calls progress_begin with the amount of work to be
+ * done, counts the work as it is done with PROGRESS_ADD, and calls
+ * progress_end when the job is finished. A timer thread samples the
+ * counters of the running jobs at a fixed interval, and prints the amount
+ * of work done, the rate at which it is being done, and an estimate of
+ * the time remaining, to standard error, or to a status file, which is
+ * replaced at every sample.
+ *
+ * When progress reporting is disabled, each counter update costs one
+ * branch; when it is enabled, one relaxed atomic add.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+#include <stdint.h>
+
+/**
+ * Default number of seconds between samples.
+ */
+#define PROGRESS_INTERVAL 10
+
+/**
+ * Progress counters - one for each kind of work.
+ */
+typedef enum {
+
+  PROGRESS_ROWS = 0, /**< matrix rows calculated             */
+  PROGRESS_EDGES,    /**< edges removed from, or examined in,
+                          a graph                            */
+  PROGRESS_SOURCES,  /**< shortest path searches started     */
+  PROGRESS_NUM_COUNTERS
+
+} progress_counter_t;
+
+/**
+ * Non-0 if progress reporting is enabled. Only set by progress_init.
+ */
+extern uint8_t progress_on;
+
+/**
+ * Enables progress reporting, if enable is non-0. Called by startup.
+ */
+void progress_init(
+  uint8_t   enable,  /**< enable progress reporting                  */
+  char     *fname,   /**< status file to write, or NULL for standard
+                          error                                      */
+  uint32_t  interval /**< seconds between samples, or 0 for the
+                          default (PROGRESS_INTERVAL)                */
+);
+
+/**
+ * Starts a job, counted by the given counter, which is reset to 0. The
+ * timer thread is started on the first call. Does nothing if progress
+ * reporting is disabled.
+ */
+void progress_begin(
+  progress_counter_t counter, /**< counter for the job               */
+  uint64_t           total    /**< amount of work in the job, or 0 if
+                                   it is not known (in which case no
+                                   estimate of the time remaining is
+                                   printed)                          */
+);
+
+/**
+ * Adds n to the given counter. Safe to call from multiple threads. Use
+ * PROGRESS_ADD, which skips the call when progress reporting is disabled.
+ */
+void progress_add(
+  progress_counter_t counter, /**< counter to update */
+  uint64_t           n        /**< amount to add     */
+);
+
+/**
+ * Finishes the job counted by the given counter, and prints a summary of
+ * it. Does nothing if the counter has no running job.
+ */
+void progress_end(
+  progress_counter_t counter /**< counter for the job */
+);
+
+/**
+ * Adds n to the given counter, if progress reporting is enabled.
+ */
+#define PROGRESS_ADD(counter, n)                              \
+  do { if (progress_on) progress_add((counter), (n)); } while (0)
+
+#endif /* __PROGRESS_H__ */
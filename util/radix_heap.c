@@ -0,0 +1,177 @@
+/**
+ * Monotone radix heap.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/radix_heap.h"
+
+/**
+ * \return the bucket for the given key, relative to the given last key.
+ */
+static uint32_t _bucket(
+  uint64_t last, /**< last key removed from the heap */
+  uint64_t key   /**< the key                        */
+);
+
+/**
+ * Appends a pair to the given bucket, expanding it if necessary.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+static uint8_t _append(
+  radix_bucket_t *b,   /**< the bucket */
+  uint64_t        key, /**< pair key   */
+  uint32_t        val  /**< pair value */
+);
+
+void radix_heap_create(radix_heap_t *h) {
+
+  memset(h, 0, sizeof(radix_heap_t));
+}
+
+void radix_heap_free(radix_heap_t *h) {
+
+  uint64_t i;
+
+  if (h == NULL) return;
+
+  for (i = 0; i < RADIX_HEAP_BUCKETS; i++) {
+    if (h->buckets[i].keys != NULL) free(h->buckets[i].keys);
+    if (h->buckets[i].vals != NULL) free(h->buckets[i].vals);
+  }
+
+  memset(h, 0, sizeof(radix_heap_t));
+}
+
+void radix_heap_clear(radix_heap_t *h) {
+
+  uint64_t i;
+
+  for (i = 0; i < RADIX_HEAP_BUCKETS; i++) h->buckets[i].size = 0;
+
+  h->last = 0;
+  h->size = 0;
+}
+
+uint64_t radix_heap_size(radix_heap_t *h) {
+  return h->size;
+}
+
+uint64_t radix_heap_key(double d) {
+
+  uint64_t key;
+
+  /*+0 and -0 compare equal, but do not have the same bits*/
+  if (d == 0) return 0;
+
+  memcpy(&key, &d, sizeof(uint64_t));
+  return key;
+}
+
+uint8_t radix_heap_push(radix_heap_t *h, uint64_t key, uint32_t val) {
+
+  if (key < h->last) goto fail;
+
+  if (_append(h->buckets + _bucket(h->last, key), key, val)) goto fail;
+
+  h->size++;
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint8_t radix_heap_pop(radix_heap_t *h, uint64_t *key, uint32_t *val) {
+
+  uint64_t        i;
+  uint64_t        min;
+  radix_bucket_t *b;
+  radix_bucket_t *b0;
+
+  if (h->size == 0) goto fail;
+
+  b0 = h->buckets;
+
+  /*
+   * the first bucket is empty - find the first non-empty
+   * bucket, and redistribute its pairs around its
+   * minimum, which becomes the new last key; they all
+   * move to lower buckets, at least one to the first
+   */
+  if (b0->size == 0) {
+
+    for (i = 1; i < RADIX_HEAP_BUCKETS; i++) {
+      if (h->buckets[i].size > 0) break;
+    }
+
+    b   = h->buckets + i;
+    min = b->keys[0];
+
+    for (i = 1; i < b->size; i++) {
+      if (b->keys[i] < min) min = b->keys[i];
+    }
+
+    h->last = min;
+
+    for (i = 0; i < b->size; i++) {
+      if (_append(h->buckets + _bucket(min, b->keys[i]),
+                  b->keys[i],
+                  b->vals[i]))
+        goto fail;
+    }
+
+    b->size = 0;
+  }
+
+  b0->size--;
+  *key = b0->keys[b0->size];
+  *val = b0->vals[b0->size];
+  h->size--;
+
+  return 0;
+
+fail:
+  return 1;
+}
+
+uint32_t _bucket(uint64_t last, uint64_t key) {
+
+  if (key == last) return 0;
+
+  return 64 - __builtin_clzll(key ^ last);
+}
+
+uint8_t _append(radix_bucket_t *b, uint64_t key, uint32_t val) {
+
+  uint64_t  newcap;
+  uint64_t *keys;
+  uint32_t *vals;
+
+  if (b->size == b->cap) {
+
+    newcap = (b->cap == 0) ? 16 : 2 * b->cap;
+
+    keys = realloc(b->keys, newcap * sizeof(uint64_t));
+    if (keys == NULL) goto fail;
+    b->keys = keys;
+
+    vals = realloc(b->vals, newcap * sizeof(uint32_t));
+    if (vals == NULL) goto fail;
+    b->vals = vals;
+
+    b->cap = newcap;
+  }
+
+  b->keys[b->size] = key;
+  b->vals[b->size] = val;
+  b->size++;
+
+  return 0;
+
+fail:
+  return 1;
+}
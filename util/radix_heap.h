@@ -0,0 +1,111 @@
+/**
+ * Monotone radix heap. A priority queue of (key, value) pairs, for
+ * algorithms in which the minimum key never decreases, such as Dijkstra's
+ * algorithm. Pairs are kept in buckets according to the highest bit in
+ * which their key differs from the last key that was removed; each pair is
+ * moved to a lower bucket at most once for every bit, so push and pop cost
+ * amortised O(1), and O(log C) respectively, where C is the range of keys.
+ *
+ * Non-negative doubles may be used as keys by reinterpreting their bits as
+ * uint64_t values (see radix_heap_key), as the IEEE 754 encoding of
+ * non-negative numbers preserves their order.
+ *
+ * There is no decrease-key operation; instead, a pair may be pushed again
+ * with a lower key, and stale pairs discarded when they are popped.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __RADIX_HEAP_H__
+#define __RADIX_HEAP_H__
+
+#include <stdint.h>
+
+/**
+ * Number of buckets - one for keys equal to the last key, and one for each
+ * bit in which a key may differ from it.
+ */
+#define RADIX_HEAP_BUCKETS 65
+
+/**
+ * One bucket of a radix heap.
+ */
+typedef struct _radix_bucket {
+
+  uint64_t *keys; /**< keys in the bucket        */
+  uint32_t *vals; /**< corresponding values      */
+  uint64_t  size; /**< number of pairs           */
+  uint64_t  cap;  /**< capacity of keys and vals */
+
+} radix_bucket_t;
+
+/**
+ * Radix heap handle.
+ */
+typedef struct _radix_heap {
+
+  uint64_t       last;                        /**< last key removed     */
+  uint64_t       size;                        /**< number of pairs      */
+  radix_bucket_t buckets[RADIX_HEAP_BUCKETS]; /**< the buckets          */
+
+} radix_heap_t;
+
+/**
+ * Initialises an empty heap.
+ */
+void radix_heap_create(
+  radix_heap_t *h /**< the heap */
+);
+
+/**
+ * Frees the memory used by the given heap.
+ */
+void radix_heap_free(
+  radix_heap_t *h /**< the heap */
+);
+
+/**
+ * Empties the heap, and resets its last key to 0. The memory used by the
+ * buckets is retained, for re-use.
+ */
+void radix_heap_clear(
+  radix_heap_t *h /**< the heap */
+);
+
+/**
+ * \return the number of pairs in the heap.
+ */
+uint64_t radix_heap_size(
+  radix_heap_t *h /**< the heap */
+);
+
+/**
+ * \return the given non-negative double, as a radix heap key.
+ */
+uint64_t radix_heap_key(
+  double d /**< value to convert (must be >= 0) */
+);
+
+/**
+ * Adds a pair to the heap. The key must not be less than the last key
+ * removed from the heap.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t radix_heap_push(
+  radix_heap_t *h,   /**< the heap  */
+  uint64_t      key, /**< pair key   */
+  uint32_t      val  /**< pair value */
+);
+
+/**
+ * Removes a pair with the smallest key from the heap.
+ *
+ * \return 0 on success, non-0 if the heap is empty.
+ */
+uint8_t radix_heap_pop(
+  radix_heap_t *h,   /**< the heap                   */
+  uint64_t     *key, /**< place to store the key     */
+  uint32_t     *val  /**< place to store the value   */
+);
+
+#endif /* __RADIX_HEAP_H__ */
@@ -0,0 +1,64 @@
+/**
+ * Reads a whole text file into memory.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "util/readfile.h"
+
+uint8_t readfile(char *fname, char **data, uint64_t *len) {
+
+  FILE       *f;
+  char       *buf;
+  struct stat st;
+
+  f   = NULL;
+  buf = NULL;
+
+  f = fopen(fname, "rb");
+  if (f == NULL) goto fail;
+
+  if (fstat(fileno(f), &st)) goto fail;
+
+  buf = malloc((uint64_t)st.st_size + 1);
+  if (buf == NULL) goto fail;
+
+  if (st.st_size > 0 && fread(buf, 1, st.st_size, f) != st.st_size)
+    goto fail;
+
+  buf[st.st_size] = '\0';
+
+  fclose(f);
+
+  *data = buf;
+  if (len != NULL) *len = st.st_size;
+
+  return 0;
+
+fail:
+  if (f   != NULL) fclose(f);
+  if (buf != NULL) free(buf);
+  return 1;
+}
+
+char * readfile_next_line(char *str) {
+
+  char *nl;
+
+  nl = strchr(str, '\n');
+
+  if (nl == NULL) return str + strlen(str);
+  else            return nl + 1;
+}
+
+char * readfile_skip_blanks(char *str) {
+
+  while (*str == ' ' || *str == '\t' || *str == '\r') str++;
+
+  return str;
+}
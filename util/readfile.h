@@ -0,0 +1,43 @@
+/**
+ * Reads a whole text file into memory, so that it may be parsed with
+ * pointer arithmetic and strtoul/strtod, rather than line by line with
+ * getline and sscanf.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __READFILE_H__
+#define __READFILE_H__
+
+#include <stdint.h>
+
+/**
+ * Reads the given file into a newly allocated buffer, which is '\0'
+ * terminated. The caller is responsible for freeing the buffer.
+ *
+ * \return 0 on success, non-0 on failure.
+ */
+uint8_t readfile(
+  char      *fname, /**< name of the file to read              */
+  char     **data,  /**< place to store a pointer to the buffer */
+  uint64_t  *len    /**< place to store the file length, or
+                         NULL                                   */
+);
+
+/**
+ * \return a pointer to the start of the line following the one which
+ * str points into, or to the terminating '\0' if it is the last line.
+ */
+char * readfile_next_line(
+  char *str /**< pointer into a '\0' terminated buffer */
+);
+
+/**
+ * \return a pointer to the first character at or after str which is not
+ * a space, tab or carriage return. Unlike strtoul and friends, newlines
+ * are not skipped, so that a parser does not run into the next line.
+ */
+char * readfile_skip_blanks(
+  char *str /**< pointer into a '\0' terminated buffer */
+);
+
+#endif /* __READFILE_H__ */
@@ -0,0 +1,181 @@
+/**
+ * xoshiro256** pseudo-random number generator.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include "util/rng.h"
+
+/**
+ * Seed used for default generators.
+ */
+static uint64_t _seed = 0;
+
+/**
+ * Next unused stream, for default generators.
+ */
+static uint64_t _nstreams = 1;
+
+/**
+ * Default generator for each thread, and whether it has been
+ * initialised.
+ */
+static __thread rng_t   _default;
+static __thread uint8_t _default_init = 0;
+
+/**
+ * \return x rotated left by k bits.
+ */
+static uint64_t _rotl(
+  uint64_t x, /**< value to rotate */
+  int      k  /**< number of bits  */
+);
+
+/**
+ * splitmix64 - advances the given state, and returns the next value.
+ */
+static uint64_t _splitmix64(
+  uint64_t *x /**< splitmix64 state */
+);
+
+void rng_seed(rng_t *r, uint64_t seed) {
+
+  uint64_t i;
+
+  for (i = 0; i < 4; i++) r->s[i] = _splitmix64(&seed);
+}
+
+void rng_jump(rng_t *r) {
+
+  uint64_t i;
+  uint64_t b;
+  uint64_t s[4];
+
+  static const uint64_t jump[] = {
+    0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+  };
+
+  memset(s, 0, sizeof(s));
+
+  for (i = 0; i < 4; i++) {
+    for (b = 0; b < 64; b++) {
+
+      if (jump[i] & (1ULL << b)) {
+        s[0] ^= r->s[0];
+        s[1] ^= r->s[1];
+        s[2] ^= r->s[2];
+        s[3] ^= r->s[3];
+      }
+      rng_next(r);
+    }
+  }
+
+  memcpy(r->s, s, sizeof(s));
+}
+
+void rng_stream(rng_t *r, uint64_t seed, uint64_t stream) {
+
+  uint64_t i;
+
+  rng_seed(r, seed);
+
+  for (i = 0; i < stream; i++) rng_jump(r);
+}
+
+uint64_t rng_next(rng_t *r) {
+
+  uint64_t result;
+  uint64_t t;
+
+  result = _rotl(r->s[1] * 5, 7) * 9;
+  t      = r->s[1] << 17;
+
+  r->s[2] ^= r->s[0];
+  r->s[3] ^= r->s[1];
+  r->s[1] ^= r->s[2];
+  r->s[0] ^= r->s[3];
+  r->s[2] ^= t;
+  r->s[3]  = _rotl(r->s[3], 45);
+
+  return result;
+}
+
+double rng_uniform(rng_t *r) {
+
+  /*the top 53 bits fill the double mantissa*/
+  return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t rng_range(rng_t *r, uint64_t n) {
+
+  uint64_t x;
+  uint64_t limit;
+
+  if (n == 0) return 0;
+
+  /*
+   * reject values from the incomplete final
+   * block, so the result is not biased
+   */
+  limit = UINT64_MAX - (UINT64_MAX % n);
+
+  do {
+    x = rng_next(r);
+  } while (x >= limit);
+
+  return x % n;
+}
+
+void rng_set_seed(uint64_t seed) {
+
+  __atomic_store_n(&_seed,     seed, __ATOMIC_RELAXED);
+  __atomic_store_n(&_nstreams, 1,    __ATOMIC_RELAXED);
+
+  rng_stream(&_default, seed, 0);
+  _default_init = 1;
+}
+
+uint64_t rng_get_seed(void) {
+
+  return __atomic_load_n(&_seed, __ATOMIC_RELAXED);
+}
+
+rng_t * rng_default(void) {
+
+  uint64_t stream;
+
+  if (!_default_init) {
+
+    stream = __atomic_fetch_add(&_nstreams, 1, __ATOMIC_RELAXED);
+
+    rng_stream(&_default, rng_get_seed(), stream);
+    _default_init = 1;
+  }
+
+  return &_default;
+}
+
+void rng_set_default(rng_t *r) {
+
+  _default      = *r;
+  _default_init = 1;
+}
+
+static uint64_t _rotl(uint64_t x, int k) {
+
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t _splitmix64(uint64_t *x) {
+
+  uint64_t z;
+
+  z = (*x += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
@@ -0,0 +1,115 @@
+/**
+ * Seedable pseudo-random number generator, used in place of rand(). The
+ * generator is xoshiro256**, which is fast, has a period of 2^256 - 1, and
+ * supports jump-ahead, so that independent, non-overlapping streams can be
+ * derived from a single seed:
+ *
+ *   D. Blackman, S. Vigna, 2021. Scrambled linear pseudorandom number
+ *   generators. ACM Transactions on Mathematical Software 47(4):1-32.
+ *
+ * Generators are plain structs, so functions which need to run in parallel
+ * can keep one per thread, or per work item (see rng_stream). Functions
+ * which do not take a generator use the calling thread's default generator
+ * (see rng_default). The main thread's default generator is stream 0 of
+ * the seed given to rng_set_seed (which is called by startup); every other
+ * thread is given the next unused stream the first time it asks for its
+ * default generator.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __RNG_H__
+#define __RNG_H__
+
+#include <stdint.h>
+
+/**
+ * Generator state.
+ */
+typedef struct _rng {
+
+  uint64_t s[4]; /**< xoshiro256** state */
+
+} rng_t;
+
+/**
+ * Seeds the given generator. The seed is expanded into the full generator
+ * state with splitmix64, so similar seeds give unrelated sequences.
+ */
+void rng_seed(
+  rng_t    *r,   /**< the generator */
+  uint64_t  seed /**< the seed      */
+);
+
+/**
+ * Advances the given generator by 2^128 steps. This is equivalent to 2^128
+ * calls to rng_next, so generators which differ by one or more jumps will
+ * not produce overlapping sequences.
+ */
+void rng_jump(
+  rng_t *r /**< the generator */
+);
+
+/**
+ * Seeds the given generator to the start of the given stream of a seed -
+ * this is equivalent to calling rng_seed, followed by stream calls to
+ * rng_jump.
+ */
+void rng_stream(
+  rng_t    *r,      /**< the generator */
+  uint64_t  seed,   /**< the seed      */
+  uint64_t  stream  /**< stream number */
+);
+
+/**
+ * \return the next 64 bit value from the given generator.
+ */
+uint64_t rng_next(
+  rng_t *r /**< the generator */
+);
+
+/**
+ * \return a uniformly distributed value in the range [0, 1).
+ */
+double rng_uniform(
+  rng_t *r /**< the generator */
+);
+
+/**
+ * \return a uniformly distributed integer in the range [0, n), or 0 if n
+ * is 0.
+ */
+uint64_t rng_range(
+  rng_t    *r, /**< the generator */
+  uint64_t  n  /**< range         */
+);
+
+/**
+ * Sets the seed used for default generators, and re-seeds the calling
+ * thread's default generator to stream 0 of that seed. Threads which have
+ * already initialised their default generator are not affected.
+ */
+void rng_set_seed(
+  uint64_t seed /**< the seed */
+);
+
+/**
+ * \return the seed passed to rng_set_seed.
+ */
+uint64_t rng_get_seed(void);
+
+/**
+ * \return the calling thread's default generator.
+ */
+rng_t * rng_default(void);
+
+/**
+ * Replaces the state of the calling thread's default generator with a copy
+ * of the given generator. This can be used to make functions which use the
+ * default generator reproducible when they are called from worker threads,
+ * by giving each work item its own stream.
+ */
+void rng_set_default(
+  rng_t *r /**< generator to copy */
+);
+
+#endif /* __RNG_H__ */
@@ -1,6 +1,11 @@
 /**
  * Little function which programs call when they start. Parses options,
- * prints out some stuff, seeds the random number generator.
+ * prints out some stuff, seeds the random number generator, enables
+ * profiling (see util/profile.h) if requested, sets the default number of
+ * threads (see util/parallel.h), sets the NUMA placement of large
+ * buffers (see util/bigmem.h), sets the memory budget (see
+ * util/memacct.h), and enables progress reporting (see util/progress.h)
+ * if requested.
  *
  * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
  */
@@ -12,16 +17,42 @@
 #include <sys/time.h>
 #include <argp.h>
 
+#include "util/rng.h"
+#include "util/bigmem.h"
+#include "util/memacct.h"
+#include "util/parallel.h"
+#include "util/profile.h"
+#include "util/progress.h"
 #include "util/startup.h"
 
 static struct argp_option options[] = {
-  {"seed", 0x5EED, "INT", 0, "seed for random number generator"},
+  {"seed",    0x5EED, "INT", 0, "seed for random number generator"},
+  {"profile", 0x9F0F, NULL,  0, "print timings and counters to standard "\
+                                "error on exit"},
+  {"threads", 0x7EAD, "INT", 0, "default number of threads (default: "\
+                                PARALLEL_THREADS_ENV ", or all CPUs)"},
+  {"numa",    0x4E0A, "interleave|firsttouch", 0,
+   "NUMA placement of large buffers"},
+  {"mem-budget", 0xB0D6, "MB", 0, "memory budget - tools pick lower "\
+                                  "memory strategies to stay within it"},
+  {"progress", 0x9A0C, "FILE", OPTION_ARG_OPTIONAL,
+   "periodically print the progress of long jobs to standard error, or "\
+   "to FILE"},
+  {"progress-interval", 0x9A1E, "SECS", 0,
+   "seconds between progress reports (default: 10)"},
   {0}
 };
 
 struct args {
 
   int64_t seed;
+  uint8_t profile;
+  uint8_t numa;
+  int64_t threads;
+  double  budget;
+  uint8_t progress;
+  char   *progfile;
+  int64_t proginterval;
   void   *child_input;
 };
 
@@ -38,6 +69,37 @@ static error_t _parse_opt(int key, char *arg, struct argp_state *state) {
     case 0x5EED:
       args->seed = atoi(arg);
       break;
+
+    case 0x9F0F:
+      args->profile = 1;
+      break;
+
+    case 0x7EAD:
+      args->threads = atoi(arg);
+      if (args->threads < 1 || args->threads > PARALLEL_MAX_THREADS)
+        argp_usage(state);
+      break;
+
+    case 0x4E0A:
+      if      (!strcmp(arg, "interleave")) args->numa = BIGMEM_INTERLEAVE;
+      else if (!strcmp(arg, "firsttouch")) args->numa = BIGMEM_FIRST_TOUCH;
+      else argp_usage(state);
+      break;
+
+    case 0xB0D6:
+      args->budget = atof(arg);
+      if (args->budget <= 0) argp_usage(state);
+      break;
+
+    case 0x9A0C:
+      args->progress = 1;
+      args->progfile = arg;
+      break;
+
+    case 0x9A1E:
+      args->proginterval = atoi(arg);
+      if (args->proginterval < 1) argp_usage(state);
+      break;
       
     default:
       return ARGP_ERR_UNKNOWN;
@@ -76,6 +138,13 @@ void startup(
   my_argp.children = children;
 
   my_input.seed        = -1;
+  my_input.profile     = 0;
+  my_input.numa        = BIGMEM_DEFAULT;
+  my_input.threads     = 0;
+  my_input.budget       = 0;
+  my_input.progress     = 0;
+  my_input.progfile     = NULL;
+  my_input.proginterval = 0;
   my_input.child_input = child_input;
 
   if (child_argp != NULL && child_input != NULL)
@@ -84,5 +153,11 @@ void startup(
   gettimeofday(&t, NULL);
   if (my_input.seed == -1) my_input.seed = t.tv_usec;
 
-  srand(my_input.seed);
+  rng_set_seed(my_input.seed);
+  profile_init(my_input.profile);
+  memacct_init(0);
+  memacct_set_budget((uint64_t)(my_input.budget * 1048576));
+  progress_init(my_input.progress, my_input.progfile, my_input.proginterval);
+  bigmem_set_policy(my_input.numa);
+  parallel_set_default_threads(my_input.threads);
 }
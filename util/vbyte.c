@@ -0,0 +1,293 @@
+/**
+ * Variable byte coding of integers.
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VBYTE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "util/vbyte.h"
+
+/**
+ * Number of data bytes used by the four values of each control byte.
+ */
+static uint8_t _lens[256];
+
+/**
+ * For each control byte, the shuffle which moves the data bytes of its
+ * four values into four 32 bit lanes.
+ */
+static uint8_t _shuf[256][16];
+
+/**
+ * Stream decoder selected by _select_decode.
+ */
+static void (*_decode)(
+  uint8_t  *ctrl,
+  uint8_t  *data,
+  uint8_t  *end,
+  uint32_t  n,
+  uint32_t *vals) = NULL;
+
+/**
+ * Ensures that _select_decode is only called once.
+ */
+static pthread_once_t _decode_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Fills in the _lens and _shuf tables, and sets the _decode pointer,
+ * according to the instructions supported by the processor.
+ */
+static void _select_decode(void);
+
+/**
+ * Decodes values [start, n) of a stream, one at a time.
+ */
+static void _decode_from(
+  uint8_t  *ctrl,  /**< control bytes                       */
+  uint8_t  *data,  /**< data bytes of value start           */
+  uint32_t  start, /**< first value to decode               */
+  uint32_t  n,     /**< number of values in the stream      */
+  uint32_t *vals,  /**< place to store values               */
+  uint32_t  prev   /**< value start-1 (0 if start is 0)     */
+);
+
+/**
+ * Portable stream decoder.
+ */
+static void _decode_scalar(
+  uint8_t  *ctrl, /**< control bytes                         */
+  uint8_t  *data, /**< data bytes                            */
+  uint8_t  *end,  /**< end of the readable memory after data */
+  uint32_t  n,    /**< number of values                      */
+  uint32_t *vals  /**< place to store values                 */
+);
+
+#ifdef VBYTE_X86_SIMD
+/**
+ * SSSE3 stream decoder - decodes four values at a time, while there are at
+ * least 16 readable bytes, and the rest with _decode_from.
+ */
+static void _decode_ssse3(
+  uint8_t  *ctrl,
+  uint8_t  *data,
+  uint8_t  *end,
+  uint32_t  n,
+  uint32_t *vals
+) __attribute__((target("ssse3")));
+#endif
+
+uint8_t vbyte_encode(uint64_t val, uint8_t *out) {
+
+  uint8_t len;
+
+  len = 0;
+
+  while (val >= 0x80) {
+    out[len++] = (val & 0x7F) | 0x80;
+    val >>= 7;
+  }
+
+  out[len++] = val;
+
+  return len;
+}
+
+uint8_t vbyte_decode(uint8_t *in, uint64_t len, uint64_t *val) {
+
+  uint8_t  i;
+  uint64_t v;
+
+  v = 0;
+
+  for (i = 0; i < len && i < VBYTE_MAX_LEN; i++) {
+
+    v |= (uint64_t)(in[i] & 0x7F) << (7*i);
+
+    if (!(in[i] & 0x80)) {
+      *val = v;
+      return i+1;
+    }
+  }
+
+  return 0;
+}
+
+uint64_t vbyte_stream_max_len(uint32_t n) {
+
+  return ((uint64_t)n+3)/4 + 4*(uint64_t)n;
+}
+
+uint64_t vbyte_stream_encode(uint32_t *vals, uint32_t n, uint8_t *out) {
+
+  uint64_t i;
+  uint64_t ctrllen;
+  uint32_t d;
+  uint32_t zz;
+  uint32_t prev;
+  uint8_t  code;
+  uint8_t  k;
+  uint8_t *data;
+
+  ctrllen = ((uint64_t)n+3)/4;
+  data    = out + ctrllen;
+  prev    = 0;
+
+  memset(out, 0, ctrllen);
+
+  for (i = 0; i < n; i++) {
+
+    /*zig-zag coding maps small negative differences to small values*/
+    d    = vals[i] - prev;
+    zz   = (d << 1) ^ (0 - (d >> 31));
+    prev = vals[i];
+
+    if      (zz < (1u << 8))  code = 0;
+    else if (zz < (1u << 16)) code = 1;
+    else if (zz < (1u << 24)) code = 2;
+    else                      code = 3;
+
+    out[i/4] |= code << (2*(i%4));
+
+    for (k = 0; k <= code; k++) *data++ = zz >> (8*k);
+  }
+
+  return data - out;
+}
+
+uint8_t vbyte_stream_decode(
+  uint8_t *in, uint64_t len, uint32_t n, uint32_t *vals, uint64_t *used) {
+
+  uint64_t i;
+  uint64_t ctrllen;
+  uint64_t datalen;
+
+  pthread_once(&_decode_once, _select_decode);
+
+  ctrllen = ((uint64_t)n+3)/4;
+  datalen = 0;
+
+  if (ctrllen > len) goto fail;
+
+  for (i = 0; i < n/4; i++) datalen += _lens[in[i]];
+  for (i = 0; i < n%4; i++) datalen += ((in[n/4] >> (2*i)) & 3) + 1;
+
+  if (ctrllen + datalen > len) goto fail;
+
+  _decode(in, in + ctrllen, in + len, n, vals);
+
+  *used = ctrllen + datalen;
+  return 0;
+
+fail:
+  return 1;
+}
+
+void _select_decode(void) {
+
+  uint64_t c;
+  uint64_t k;
+  uint64_t b;
+  uint8_t  off;
+  uint8_t  len;
+
+  for (c = 0; c < 256; c++) {
+
+    off = 0;
+    memset(_shuf[c], 0x80, 16);
+
+    for (k = 0; k < 4; k++) {
+
+      len = ((c >> (2*k)) & 3) + 1;
+
+      for (b = 0; b < len; b++) _shuf[c][4*k+b] = off++;
+    }
+
+    _lens[c] = off;
+  }
+
+  _decode = _decode_scalar;
+
+#ifdef VBYTE_X86_SIMD
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("ssse3")) _decode = _decode_ssse3;
+#endif
+}
+
+void _decode_from(
+  uint8_t  *ctrl,
+  uint8_t  *data,
+  uint32_t  start,
+  uint32_t  n,
+  uint32_t *vals,
+  uint32_t  prev) {
+
+  uint64_t i;
+  uint32_t zz;
+  uint8_t  code;
+  uint8_t  k;
+
+  for (i = start; i < n; i++) {
+
+    code = (ctrl[i/4] >> (2*(i%4))) & 3;
+    zz   = 0;
+
+    for (k = 0; k <= code; k++) zz |= (uint32_t)data[k] << (8*k);
+
+    data   += code + 1;
+    prev   += (zz >> 1) ^ (0 - (zz & 1));
+    vals[i] = prev;
+  }
+}
+
+void _decode_scalar(
+  uint8_t *ctrl, uint8_t *data, uint8_t *end, uint32_t n, uint32_t *vals) {
+
+  _decode_from(ctrl, data, 0, n, vals, 0);
+}
+
+#ifdef VBYTE_X86_SIMD
+void _decode_ssse3(
+  uint8_t *ctrl, uint8_t *data, uint8_t *end, uint32_t n, uint32_t *vals) {
+
+  uint64_t i;
+  uint8_t  c;
+  __m128i  v;
+  __m128i  prev;
+  __m128i  one;
+  __m128i  zero;
+
+  prev = _mm_setzero_si128();
+  zero = _mm_setzero_si128();
+  one  = _mm_set1_epi32(1);
+
+  /*each load reads 16 bytes, which may be past the last value*/
+  for (i = 0; i + 4 <= n && data + 16 <= end; i += 4) {
+
+    c = ctrl[i/4];
+    v = _mm_loadu_si128((__m128i *)data);
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i *)_shuf[c]));
+
+    /*undo the zig-zag coding, then add up the differences*/
+    v = _mm_xor_si128(_mm_srli_epi32(v, 1),
+                      _mm_sub_epi32(zero, _mm_and_si128(v, one)));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+    v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi32(v, prev);
+
+    _mm_storeu_si128((__m128i *)(vals + i), v);
+
+    prev  = _mm_shuffle_epi32(v, 0xFF);
+    data += _lens[c];
+  }
+
+  _decode_from(ctrl, data, i, n, vals, (i > 0) ? vals[i-1] : 0);
+}
+#endif
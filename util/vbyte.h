@@ -0,0 +1,83 @@
+/**
+ * Variable byte coding of integers. vbyte_encode and vbyte_decode code
+ * single values, seven bits per byte (LEB128). The stream functions code
+ * lists of 32 bit values, such as neighbour lists, in the StreamVByte
+ * format - each value is replaced by the zig-zag coded difference between
+ * it and the previous value, and stored in 1-4 bytes, with the lengths of
+ * every four values packed into a separate control byte. Lists need not be
+ * sorted, but sorted lists code best. Streams are decoded four values at a
+ * time with SSSE3 byte shuffles, where the processor supports them.
+ *
+ *   Lemire D, Kurz N & Rupp C 2018. Stream VByte: faster byte-oriented
+ *   integer compression. Information Processing Letters 130:1-6
+ *
+ * Author: Paul McCarthy <pauld.mccarthy@gmail.com>
+ */
+#ifndef __VBYTE_H__
+#define __VBYTE_H__
+
+#include <stdint.h>
+
+/**
+ * Maximum number of bytes used by vbyte_encode.
+ */
+#define VBYTE_MAX_LEN 10
+
+/**
+ * Codes the given value into out, which must have space for VBYTE_MAX_LEN
+ * bytes.
+ *
+ * \return the number of bytes written.
+ */
+uint8_t vbyte_encode(
+  uint64_t val, /**< value to code        */
+  uint8_t *out  /**< place to store bytes */
+);
+
+/**
+ * Decodes a value coded by vbyte_encode.
+ *
+ * \return the number of bytes read, or 0 if the first len bytes of in do
+ * not contain a valid value.
+ */
+uint8_t vbyte_decode(
+  uint8_t  *in,  /**< coded bytes              */
+  uint64_t  len, /**< number of bytes in in    */
+  uint64_t *val  /**< place to store the value */
+);
+
+/**
+ * \return the maximum number of bytes used by vbyte_stream_encode to code
+ * n values.
+ */
+uint64_t vbyte_stream_max_len(
+  uint32_t n /**< number of values */
+);
+
+/**
+ * Codes the given values into out, which must have space for
+ * vbyte_stream_max_len(n) bytes.
+ *
+ * \return the number of bytes written.
+ */
+uint64_t vbyte_stream_encode(
+  uint32_t *vals, /**< values to code        */
+  uint32_t  n,    /**< number of values      */
+  uint8_t  *out   /**< place to store bytes  */
+);
+
+/**
+ * Decodes n values coded by vbyte_stream_encode.
+ *
+ * \return 0 on success, non-0 if the first len bytes of in do not contain
+ * n coded values.
+ */
+uint8_t vbyte_stream_decode(
+  uint8_t  *in,   /**< coded bytes                             */
+  uint64_t  len,  /**< number of bytes in in                   */
+  uint32_t  n,    /**< number of values to decode              */
+  uint32_t *vals, /**< place to store n values                 */
+  uint64_t *used  /**< place to store the number of bytes read */
+);
+
+#endif /* __VBYTE_H__ */